@@ -120,28 +120,23 @@ D10State::D10State(IDXGISwapChain *pSwapChain, ID3D10Device *pDevice) {
 }
 
 void D10State::blit(unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
-	HRESULT hr;
-
 	ods("D3D10: Blit %d %d %d %d", x, y, w, h);
 
 	if (!pTexture || !pSRView || uiLeft == uiRight)
 		return;
 
-	D3D10_MAPPED_TEXTURE2D mappedTex;
-	hr = pTexture->Map(D3D10CalcSubresource(0, 0, 1), D3D10_MAP_WRITE_DISCARD, 0, &mappedTex);
-	if (FAILED(hr)) {
-		ods("D3D10: Failed map");
-	}
-
-	UCHAR *pTexels = (UCHAR *) mappedTex.pData;
-
-	for (unsigned int r = 0; r < uiHeight; ++r) {
-		unsigned char *sptr = a_ucTexture + r * uiWidth * 4;
-		unsigned char *dptr = reinterpret_cast< unsigned char * >(pTexels) + r * mappedTex.RowPitch;
-		memcpy(dptr, sptr, uiWidth * 4);
-	}
-
-	pTexture->Unmap(D3D10CalcSubresource(0, 0, 1));
+	// Only the rectangle that has changed is uploaded, instead of the whole texture for every blit
+	D3D10_BOX box;
+	box.left   = x;
+	box.top    = y;
+	box.front  = 0;
+	box.right  = x + w;
+	box.bottom = y + h;
+	box.back   = 1;
+
+	const UINT rowPitch = uiWidth * 4;
+	pDevice->UpdateSubresource(pTexture, D3D10CalcSubresource(0, 0, 1), &box, a_ucTexture + y * rowPitch + x * 4,
+							   rowPitch, 0);
 }
 
 void D10State::setRect() {
@@ -207,10 +202,11 @@ void D10State::newTexture(unsigned int w, unsigned int h) {
 	desc.MipLevels = desc.ArraySize = 1;
 	desc.Format                     = DXGI_FORMAT_R8G8B8A8_UNORM;
 	desc.SampleDesc.Count           = 1;
-	desc.Usage                      = D3D10_USAGE_DYNAMIC;
-	desc.BindFlags                  = D3D10_BIND_SHADER_RESOURCE;
-	desc.CPUAccessFlags             = D3D10_CPU_ACCESS_WRITE;
-	hr                              = pDevice->CreateTexture2D(&desc, nullptr, &pTexture);
+	// The texture is updated through UpdateSubresource(), which (other than mapping it) allows updating a part of it
+	desc.Usage          = D3D10_USAGE_DEFAULT;
+	desc.BindFlags      = D3D10_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	hr                  = pDevice->CreateTexture2D(&desc, nullptr, &pTexture);
 
 	if (FAILED(hr)) {
 		pTexture = nullptr;
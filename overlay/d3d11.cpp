@@ -91,6 +91,9 @@ public:
 	ID3D11Device *pDevice;
 	ID3D11DeviceContext *pDeviceContext;
 	bool bDeferredContext;
+	/// Whether the driver supports command lists, which tells how UpdateSubresource() treats the source data of
+	/// deferred contexts
+	bool bDriverCommandLists;
 	IDXGISwapChain *pSwapChain;
 
 	D11StateBlock *pOrigStateBlock;
@@ -124,7 +127,8 @@ SwapchainMap chains;
 typedef map< ID3D11Device *, D11State * > DeviceMap;
 DeviceMap devices;
 
-D11State::D11State(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice) : bDeferredContext(false) {
+D11State::D11State(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice)
+	: bDeferredContext(false), bDriverCommandLists(false) {
 	this->pSwapChain = pSwapChain;
 	this->pDevice    = pDevice;
 
@@ -153,28 +157,30 @@ D11State::D11State(IDXGISwapChain *pSwapChain, ID3D11Device *pDevice) : bDeferre
 }
 
 void D11State::blit(unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
-	HRESULT hr;
-
 	ods("D3D11: Blit %d %d %d %d", x, y, w, h);
 
 	if (!pTexture || !pSRView || uiLeft == uiRight)
 		return;
 
-	D3D11_MAPPED_SUBRESOURCE mappedTex;
-	hr = pDeviceContext->Map(pTexture, D3D11CalcSubresource(0, 0, 1), D3D11_MAP_WRITE_DISCARD, 0, &mappedTex);
-	if (FAILED(hr)) {
-		ods("D3D11: Failed map");
+	// Only the rectangle that has changed is uploaded, instead of the whole texture for every blit
+	D3D11_BOX box;
+	box.left   = x;
+	box.top    = y;
+	box.front  = 0;
+	box.right  = x + w;
+	box.bottom = y + h;
+	box.back   = 1;
+
+	const UINT rowPitch       = uiWidth * 4;
+	const unsigned char *data = a_ucTexture + y * rowPitch + x * 4;
+
+	if (bDeferredContext && !bDriverCommandLists) {
+		// Deferred contexts of drivers that don't support command lists apply the box to the source data themselves
+		// (see the documentation of ID3D11DeviceContext::UpdateSubresource)
+		data = a_ucTexture;
 	}
 
-	UCHAR *pTexels = (UCHAR *) mappedTex.pData;
-
-	for (unsigned int r = 0; r < uiHeight; ++r) {
-		unsigned char *sptr = a_ucTexture + r * uiWidth * 4;
-		unsigned char *dptr = reinterpret_cast< unsigned char * >(pTexels) + r * mappedTex.RowPitch;
-		memcpy(dptr, sptr, uiWidth * 4);
-	}
-
-	pDeviceContext->Unmap(pTexture, D3D11CalcSubresource(0, 0, 1));
+	pDeviceContext->UpdateSubresource(pTexture, D3D11CalcSubresource(0, 0, 1), &box, data, rowPitch, 0);
 }
 
 void D11State::setRect() {
@@ -244,10 +250,11 @@ void D11State::newTexture(unsigned int w, unsigned int h) {
 	desc.MipLevels = desc.ArraySize = 1;
 	desc.Format                     = DXGI_FORMAT_R8G8B8A8_UNORM;
 	desc.SampleDesc.Count           = 1;
-	desc.Usage                      = D3D11_USAGE_DYNAMIC;
-	desc.BindFlags                  = D3D11_BIND_SHADER_RESOURCE;
-	desc.CPUAccessFlags             = D3D11_CPU_ACCESS_WRITE;
-	hr                              = pDevice->CreateTexture2D(&desc, nullptr, &pTexture);
+	// The texture is updated through UpdateSubresource(), which (other than mapping it) allows updating a part of it
+	desc.Usage          = D3D11_USAGE_DEFAULT;
+	desc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	hr                  = pDevice->CreateTexture2D(&desc, nullptr, &pTexture);
 
 	if (FAILED(hr)) {
 		pTexture = nullptr;
@@ -300,6 +307,12 @@ bool D11State::init() {
 		bDeferredContext = true;
 	}
 
+	D3D11_FEATURE_DATA_THREADING threading;
+	ZeroMemory(&threading, sizeof(threading));
+	bDriverCommandLists =
+		SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading)))
+		&& threading.DriverCommandLists;
+
 	D3D11_TEXTURE2D_DESC backBufferSurfaceDesc;
 	pBackBuffer->GetDesc(&backBufferSurfaceDesc);
 
@@ -7,9 +7,11 @@
 
 #include "mumble_positional_audio_utils.h"
 
+#include <algorithm>
 #include <cstring>
 #include <libgen.h>
 #include <sstream>
+#include <vector>
 
 #include <sys/uio.h>
 
@@ -33,6 +35,50 @@ bool HostLinux::peek(const procptr_t address, void *dst, const size_t size) cons
 	return (ret != -1 && static_cast< size_t >(ret) == in.iov_len);
 }
 
+size_t HostLinux::peek(PeekRequest *requests, const size_t count) const {
+	// UIO_MAXIOV, the maximum number of vectors process_vm_readv() accepts
+	constexpr size_t maxVectors = 1024;
+
+	std::vector< iovec > in;
+	std::vector< iovec > out;
+	in.reserve(std::min(count, maxVectors));
+	out.reserve(std::min(count, maxVectors));
+
+	size_t succeeded = 0;
+	size_t begin     = 0;
+	while (begin < count) {
+		in.clear();
+		out.clear();
+
+		const size_t end = std::min(begin + maxVectors, count);
+		for (size_t i = begin; i < end; ++i) {
+			in.push_back({ reinterpret_cast< void * >(requests[i].address), requests[i].size });
+			out.push_back({ requests[i].dst, requests[i].size });
+		}
+
+		const auto ret   = process_vm_readv(m_pid, out.data(), out.size(), in.data(), in.size(), 0);
+		size_t remaining = ret > 0 ? static_cast< size_t >(ret) : 0;
+
+		// The reads stop at the first one that fails, all before it have been performed completely
+		size_t i = begin;
+		for (; i < end && remaining >= requests[i].size; ++i) {
+			remaining -= requests[i].size;
+			requests[i].ok = true;
+			++succeeded;
+		}
+
+		if (i < end) {
+			// Skip the one that failed and retry the rest
+			requests[i].ok = false;
+			++i;
+		}
+
+		begin = i;
+	}
+
+	return succeeded;
+}
+
 Modules HostLinux::modules() const {
 	std::ostringstream path;
 	path << "/proc/";
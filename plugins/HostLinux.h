@@ -7,6 +7,7 @@
 #define HOSTLINUX_H_
 
 #include "Module.h"
+#include "PeekRequest.h"
 
 using procid_t = uint64_t;
 
@@ -16,6 +17,10 @@ protected:
 
 public:
 	bool peek(const procptr_t address, void *dst, const size_t size) const;
+	/// Performs the given reads, with as few system calls as possible, and sets their "ok" members.
+	///
+	/// @returns The number of reads that succeeded.
+	size_t peek(PeekRequest *requests, const size_t count) const;
 	Modules modules() const;
 
 	static bool isWine(const procid_t id);
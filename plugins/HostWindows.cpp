@@ -26,6 +26,19 @@ bool HostWindows::peek(const procptr_t address, void *dst, const size_t size) co
 	return (ok && read == size);
 }
 
+size_t HostWindows::peek(PeekRequest *requests, const size_t count) const {
+	// There is no vectored variant of ReadProcessMemory()
+	size_t succeeded = 0;
+	for (size_t i = 0; i < count; ++i) {
+		requests[i].ok = peek(requests[i].address, requests[i].dst, requests[i].size);
+		if (requests[i].ok) {
+			++succeeded;
+		}
+	}
+
+	return succeeded;
+}
+
 Modules HostWindows::modules() const {
 	const auto processHandle = OpenProcess(PROCESS_QUERY_INFORMATION, false, m_pid);
 	if (!processHandle) {
@@ -43,7 +43,7 @@
 #		define MUMBLE_PLUGIN_API_MAJOR_MACRO 1
 #	endif
 #	ifndef MUMBLE_PLUGIN_API_MINOR_MACRO
-#		define MUMBLE_PLUGIN_API_MINOR_MACRO 2
+#		define MUMBLE_PLUGIN_API_MINOR_MACRO 3
 #	endif
 #	ifndef MUMBLE_PLUGIN_API_PATCH_MACRO
 #		define MUMBLE_PLUGIN_API_PATCH_MACRO 0
@@ -180,6 +180,13 @@ enum Mumble_PluginFeature {
 	 * The plugin modifies the input/output audio itself
 	 */
 	MUMBLE_FEATURE_AUDIO = 1 << 1,
+	/**
+	 * The plugin only inspects the input/output audio (e.g. for metering or recognition). Its audio callbacks are
+	 * then called with copies of the audio on a thread of their own instead of the audio threads, so that a slow
+	 * callback can't delay the audio. Changes made to the copies are discarded and copies may be dropped if the
+	 * callbacks can't keep up.
+	 */
+	MUMBLE_FEATURE_AUDIO_ANALYSIS = 1 << 2,
 };
 
 /**
@@ -205,6 +212,29 @@ enum Mumble_TransmissionMode {
 	MUMBLE_TM_PUSH_TO_TALK,
 };
 
+/**
+ * This enum's values represent the stages of Mumble's audio pipeline whose latency is measured. The first two (and the
+ * last one) concern the audio of the local user, the others the audio of the users the local user hears.
+ */
+enum Mumble_AudioLatencyStage {
+	/** From the capture of the audio by the input device until it has been encoded */
+	MUMBLE_ALS_ENCODE,
+	/** From the encoding of an audio packet until it has been sent */
+	MUMBLE_ALS_SEND,
+	/** Half of the round-trip time of the UDP pings to the server */
+	MUMBLE_ALS_NETWORK,
+	/** From the reception of an audio packet until it has been handed to the audio output */
+	MUMBLE_ALS_RECEIVE,
+	/** The time an audio packet has spent in the jitter buffer */
+	MUMBLE_ALS_JITTER_BUFFER,
+	/** From the removal of an audio packet from the jitter buffer until its audio has been mixed into the output */
+	MUMBLE_ALS_MIX,
+	/** From the mix until the output device plays it, where the audio backend measures it (none otherwise) */
+	MUMBLE_ALS_PLAYBACK,
+	/** The time the echo canceller takes for a frame of the local user's audio (which is part of MUMBLE_ALS_ENCODE) */
+	MUMBLE_ALS_ECHO_CANCELLATION,
+};
+
 /**
  * This enum's values represent the error codes that are being used by the MumbleAPI.
  * You can get a string-representation for each error code via the errorMessage function.
@@ -233,6 +263,7 @@ enum Mumble_ErrorCode {
 	MUMBLE_EC_DATA_ID_TOO_LONG,
 	MUMBLE_EC_API_REQUEST_TIMEOUT,
 	MUMBLE_EC_OPERATION_UNSUPPORTED_BY_SERVER,
+	MUMBLE_EC_UNKNOWN_LATENCY_STAGE,
 };
 
 /**
@@ -444,6 +475,38 @@ struct MumbleStringWrapper {
 	bool needsReleasing;
 };
 
+/**
+ * The number of buckets of a MumbleLatencyHistogram
+ */
+#	define MUMBLE_LATENCY_HISTOGRAM_BUCKETS 11
+
+/**
+ * A histogram of the latencies measured for a stage of the audio pipeline. All times are in microseconds.
+ */
+struct MumbleLatencyHistogram {
+	/**
+	 * The upper bound (exclusive) of the latencies counted by each bucket, the lower bound being the one of the
+	 * previous bucket. The last bucket counts all latencies above the bound of the one before it, and its bound is 0.
+	 */
+	uint64_t bucketBounds[MUMBLE_LATENCY_HISTOGRAM_BUCKETS];
+	/**
+	 * The number of latencies counted by each bucket
+	 */
+	uint64_t bucketCounts[MUMBLE_LATENCY_HISTOGRAM_BUCKETS];
+	/**
+	 * The total number of latencies measured
+	 */
+	uint64_t sampleCount;
+	/**
+	 * The sum of all latencies measured (which divided by sampleCount yields their mean)
+	 */
+	uint64_t totalMicroseconds;
+	/**
+	 * The highest latency measured
+	 */
+	uint64_t maxMicroseconds;
+};
+
 MUMBLE_EXTERN_C_END
 
 #endif // EXTERNAL_MUMBLE_PLUGIN_TYPES_
@@ -466,6 +529,14 @@ typedef enum Mumble_TalkingState mumble_talking_state_t;
  * Typedef for the type of a transmission mode
  */
 typedef enum Mumble_TransmissionMode mumble_transmission_mode_t;
+/**
+ * Typedef for the type of a stage of the audio pipeline
+ */
+typedef enum Mumble_AudioLatencyStage mumble_audio_latency_stage_t;
+/**
+ * Typedef for the type of a latency histogram
+ */
+typedef struct MumbleLatencyHistogram mumble_latency_histogram_t;
 /**
  * Typedef for the type of a version
  */
@@ -617,6 +688,8 @@ MUMBLE_PLUGIN_CONSTEXPR inline const char *mumble_errorMessage(int16_t errorCode
 		case MUMBLE_EC_OPERATION_UNSUPPORTED_BY_SERVER:
 			return "The requested API operation depends on server-side functionality, not supported by the server "
 				   "you're connected to";
+		case MUMBLE_EC_UNKNOWN_LATENCY_STAGE:
+			return "The given stage of the audio pipeline does not match any stage known to Mumble";
 	}
 
 	return "Unknown error code";
@@ -998,7 +1071,8 @@ MUMBLE_PLUGIN_EXPORT void MUMBLE_PLUGIN_CALLING_CONVENTION mumble_onUserTalkingS
 
 /**
  * Called whenever there is audio input.
- * Note that this callback will be called from the AUDIO THREAD.
+ * Note that this callback will be called from the AUDIO THREAD, unless the plugin provides
+ * MUMBLE_FEATURE_AUDIO_ANALYSIS.
  * Note also that blocking this callback will cause Mumble's audio processing to get suspended.
  *
  * @param inputPCM A pointer to a short-array holding the pulse-code-modulation (PCM) representing the audio input. Its
@@ -1018,7 +1092,8 @@ MUMBLE_PLUGIN_EXPORT bool MUMBLE_PLUGIN_CALLING_CONVENTION mumble_onAudioInput(s
 /**
  * Called whenever Mumble fetches data from an active audio source (could be a voice packet or a playing sample).
  * The provided audio buffer is the raw buffer without any processing applied to it yet.
- * Note that this callback will be called from the AUDIO THREAD.
+ * Note that this callback will be called from the AUDIO THREAD, unless the plugin provides
+ * MUMBLE_FEATURE_AUDIO_ANALYSIS.
  * Note also that blocking this callback will cause Mumble's audio processing to get suspended.
  *
  * @param outputPCM A pointer to a float-array holding the pulse-code-modulation (PCM) representing the audio output.
@@ -1039,7 +1114,8 @@ MUMBLE_PLUGIN_EXPORT bool MUMBLE_PLUGIN_CALLING_CONVENTION
 /**
  * Called whenever the fully mixed and processed audio is about to be handed to the audio backend (about to be played).
  * Note that this happens immediately before Mumble clips the audio buffer.
- * Note that this callback will be called from the AUDIO THREAD.
+ * Note that this callback will be called from the AUDIO THREAD, unless the plugin provides
+ * MUMBLE_FEATURE_AUDIO_ANALYSIS.
  * Note also that blocking this callback will cause Mumble's audio processing to get suspended.
  *
  * @param outputPCM A pointer to a float-array holding the pulse-code-modulation (PCM) representing the audio output.
@@ -1807,6 +1883,21 @@ struct MUMBLE_API_STRUCT_NAME {
 	 */
 	mumble_error_t(MUMBLE_PLUGIN_CALLING_CONVENTION *playSample)(mumble_plugin_id_t callerID,
 																 const char *samplePath PARAM_v1_2(float volume));
+
+#	if SELECTED_API_VERSION >= MUMBLE_PLUGIN_VERSION_CHECK(1, 3, 0)
+	/**
+	 * Gets the histogram of the latencies Mumble has measured for the given stage of its audio pipeline since it has
+	 * been started (or since the statistics have been reset in the audio statistics dialog).
+	 *
+	 * @param callerID The ID of the plugin calling this function
+	 * @param stage The stage to get the histogram of
+	 * @param[out] histogram A pointer to the memory location the histogram should be written to
+	 * @returns The error code. If everything went well, STATUS_OK will be returned. Only then the passed pointer
+	 * may be accessed.
+	 */
+	mumble_error_t(MUMBLE_PLUGIN_CALLING_CONVENTION *getAudioLatencyHistogram)(
+		mumble_plugin_id_t callerID, mumble_audio_latency_stage_t stage, mumble_latency_histogram_t *histogram);
+#	endif
 };
 
 #	ifdef MUMBLE_PLUGIN_CREATE_MUMBLE_API_TYPEDEF
@@ -0,0 +1,22 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef PEEKREQUEST_H_
+#define PEEKREQUEST_H_
+
+#include "Module.h"
+
+#include <cstddef>
+
+/// A single read of the memory of another process, as performed by Host::peek() together with other reads.
+struct PeekRequest {
+	procptr_t address;
+	void *dst;
+	size_t size;
+	/// Set to whether all of the memory could be read
+	bool ok;
+};
+
+#endif
@@ -7,7 +7,48 @@
 
 #include "mumble_positional_audio_utils.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+
+PeekPlan::PeekPlan(const uint8_t pointerSize) : m_pointerSize(pointerSize) {
+}
+
+PeekPlan::Index PeekPlan::add(const procptr_t address, void *dst, const size_t size) {
+	m_reads.push_back({ address, dst, size, NO_PARENT, 0, false });
+	return m_reads.size() - 1;
+}
+
+PeekPlan::Index PeekPlan::follow(const Index parent, const size_t pointerOffset, const procptr_t offset, void *dst,
+								 const size_t size) {
+	m_reads.push_back({ offset, dst, size, parent, pointerOffset, false });
+	return m_reads.size() - 1;
+}
+
+PeekPlan::Index PeekPlan::addPath(const procptr_t address, const std::vector< procptr_t > &offsets, void *dst,
+								  const size_t size) {
+	m_pointers.push_back(0);
+	Index index = add(address, &m_pointers.back(), m_pointerSize);
+
+	for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+		m_pointers.push_back(0);
+		index = follow(index, 0, offsets[i], &m_pointers.back(), m_pointerSize);
+	}
+
+	return follow(index, 0, offsets.empty() ? 0 : offsets.back(), dst, size);
+}
+
+procptr_t PeekPlan::pointer(const Index index, const size_t pointerOffset) const {
+	const Read &read = m_reads[index];
+	if (!read.ok || read.size < pointerOffset + m_pointerSize) {
+		return 0;
+	}
+
+	procptr_t ret = 0;
+	memcpy(&ret, static_cast< const uint8_t * >(read.dst) + pointerOffset, m_pointerSize);
+
+	return ret;
+}
 
 ProcessBase::ProcessBase(const procid_t id, const std::string &name)
 	: Host(id), m_ok(false), m_name(name), m_pointerSize(0) {
@@ -16,6 +57,62 @@ ProcessBase::ProcessBase(const procid_t id, const std::string &name)
 ProcessBase::~ProcessBase() {
 }
 
+bool ProcessBase::peek(PeekPlan &plan) const {
+	// A read always comes after its parent, so its level is known by the time it is reached
+	std::vector< size_t > levels(plan.m_reads.size());
+	size_t maxLevel = 0;
+	for (size_t i = 0; i < plan.m_reads.size(); ++i) {
+		const auto parent = plan.m_reads[i].parent;
+		if (parent != PeekPlan::NO_PARENT) {
+			levels[i] = levels[parent] + 1;
+			maxLevel  = std::max(maxLevel, levels[i]);
+		}
+
+		plan.m_reads[i].ok = false;
+	}
+
+	std::vector< PeekRequest > requests;
+	std::vector< PeekPlan::Index > indices;
+	size_t succeeded = 0;
+
+	for (size_t level = 0; level <= maxLevel; ++level) {
+		requests.clear();
+		indices.clear();
+
+		for (size_t i = 0; i < plan.m_reads.size(); ++i) {
+			if (levels[i] != level) {
+				continue;
+			}
+
+			const auto &read  = plan.m_reads[i];
+			procptr_t address = read.address;
+			if (read.parent != PeekPlan::NO_PARENT) {
+				const auto base = plan.pointer(read.parent, read.pointerOffset);
+				if (!base) {
+					continue;
+				}
+
+				address += base;
+			}
+
+			requests.push_back({ address, read.dst, read.size, false });
+			indices.push_back(i);
+		}
+
+		if (requests.empty()) {
+			break;
+		}
+
+		succeeded += Host::peek(requests.data(), requests.size());
+
+		for (size_t i = 0; i < requests.size(); ++i) {
+			plan.m_reads[indices[i]].ok = requests[i].ok;
+		}
+	}
+
+	return succeeded == plan.m_reads.size();
+}
+
 procptr_t ProcessBase::peekPtr(const procptr_t address) const {
 	procptr_t v = 0;
 
@@ -26,6 +123,41 @@ procptr_t ProcessBase::peekPtr(const procptr_t address) const {
 	return v;
 }
 
+procptr_t ProcessBase::cachedPointer(const std::string &key, const std::function< procptr_t() > &resolver,
+									 const size_t sentinelSize) {
+	auto iter = m_cachedPointers.find(key);
+	if (iter != m_cachedPointers.end()) {
+		const auto &cached = iter->second;
+
+		std::vector< uint8_t > sentinel(cached.sentinel.size());
+		if (peek(cached.address, sentinel.data(), sentinel.size()) && sentinel == cached.sentinel) {
+			return cached.address;
+		}
+
+		m_cachedPointers.erase(iter);
+	}
+
+	const auto address = resolver();
+	if (!address) {
+		return 0;
+	}
+
+	CachedPointer cached;
+	cached.address = address;
+	cached.sentinel.resize(sentinelSize);
+	if (!peek(address, cached.sentinel.data(), cached.sentinel.size())) {
+		return address;
+	}
+
+	if (m_cachedPointers.size() >= MAX_CACHED_POINTERS) {
+		m_cachedPointers.clear();
+	}
+
+	m_cachedPointers.emplace(key, std::move(cached));
+
+	return address;
+}
+
 std::string ProcessBase::peekString(const procptr_t address, const size_t length) const {
 	std::string string;
 
@@ -81,33 +213,24 @@ procptr_t ProcessBase::findPattern(const std::vector< uint8_t > &pattern, const
 
 procptr_t ProcessBase::findPattern(const std::vector< uint8_t > &pattern, procptr_t address, const size_t size) {
 	// 32 KiB appears to be a good balance
-	constexpr uint16_t bufferSize = 32768;
-	std::vector< uint8_t > buffer(bufferSize);
-
-	const auto chunks = size / buffer.size();
-	for (size_t i = 0; i < chunks; ++i) {
-		if (!peek(address, &buffer[0], buffer.size())) {
-			return 0;
-		}
-
-		const auto ret = searchInBuffer(pattern, buffer);
-		if (ret != SIZE_MAX) {
-			return address + ret;
-		}
-
-		address += buffer.size();
+	constexpr size_t bufferSize = 32768;
+	if (pattern.empty() || pattern.size() > bufferSize) {
+		return 0;
 	}
 
-	const auto remainder = size % buffer.size();
-	if (remainder >= pattern.size()) {
-		buffer.resize(remainder);
-		if (!peek(address, &buffer[0], buffer.size())) {
+	// Consecutive chunks overlap by the size of the pattern minus one, so that a match spanning two is found as well
+	const size_t step = bufferSize - (pattern.size() - 1);
+	std::vector< uint8_t > buffer;
+
+	for (size_t offset = 0; offset + pattern.size() <= size; offset += step) {
+		buffer.resize(std::min(bufferSize, size - offset));
+		if (!peek(address + offset, &buffer[0], buffer.size())) {
 			return 0;
 		}
 
 		const auto ret = searchInBuffer(pattern, buffer);
 		if (ret != SIZE_MAX) {
-			return address + ret;
+			return address + offset + ret;
 		}
 	}
 
@@ -14,22 +14,93 @@ using Host = HostWindows;
 using Host = HostLinux;
 #endif
 
+#include <deque>
+#include <functional>
 #include <map>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+/// A set of reads that are performed together by ProcessBase::peek(PeekPlan &).
+///
+/// A read either has a fixed address or follows a pointer that another read (its parent) has stored in its
+/// destination, which describes pointer chains. All reads whose parents have been read are performed with a single
+/// Host::peek() call, so that following any number of chains of N pointers only takes N + 1 calls. A read whose parent
+/// failed or whose pointer is null fails as well.
+class PeekPlan {
+public:
+	using Index = size_t;
+
+	/// Reads the given number of bytes at the given address into dst.
+	Index add(const procptr_t address, void *dst, const size_t size);
+
+	/// Reads the given number of bytes into dst, at the given offset from the pointer that the parent has read into
+	/// its destination at pointerOffset.
+	Index follow(const Index parent, const size_t pointerOffset, const procptr_t offset, void *dst, const size_t size);
+
+	/// Follows a multi-level pointer path: the pointer at the given address is read and the first offset added to it,
+	/// then the pointer at the resulting address is read and the next offset added, and so on. The given number of
+	/// bytes is read at the address resulting from the last offset (or at the first pointer if there are no offsets).
+	Index addPath(const procptr_t address, const std::vector< procptr_t > &offsets, void *dst, const size_t size);
+
+	template< typename T > inline Index add(const procptr_t address, T &dst) { return add(address, &dst, sizeof(T)); }
+
+	template< typename T > inline Index follow(const Index parent, const size_t pointerOffset, T &dst) {
+		return follow(parent, pointerOffset, 0, &dst, sizeof(T));
+	}
+
+	/// Returns whether the given read succeeded the last time the plan was performed.
+	inline bool ok(const Index index) const { return m_reads[index].ok; }
+
+	inline size_t size() const { return m_reads.size(); }
+
+	PeekPlan(const uint8_t pointerSize);
+
+protected:
+	friend class ProcessBase;
+
+	static constexpr Index NO_PARENT = SIZE_MAX;
+
+	struct Read {
+		procptr_t address;
+		void *dst;
+		size_t size;
+		Index parent;
+		size_t pointerOffset;
+		bool ok;
+	};
+
+	uint8_t m_pointerSize;
+	std::vector< Read > m_reads;
+	/// The pointers that are read by addPath(), which have to stay where they are
+	std::deque< procptr_t > m_pointers;
+
+	/// Returns the pointer the given read has stored at the given offset into its destination, 0 if it failed.
+	procptr_t pointer(const Index index, const size_t pointerOffset) const;
+};
+
 /// Abstract class.
 /// Only defines stuff that can be used with both Linux and Windows processes.
 class ProcessBase : public Host {
 protected:
+	struct CachedPointer {
+		procptr_t address;
+		/// The first bytes at the address when it was resolved
+		std::vector< uint8_t > sentinel;
+	};
+
 	bool m_ok;
 	std::string m_name;
 	uint8_t m_pointerSize;
+	std::unordered_map< std::string, CachedPointer > m_cachedPointers;
 
 public:
 	using Host::peek;
 
 	inline bool isOk() const { return m_ok; }
 
+	inline uint8_t pointerSize() const { return m_pointerSize; }
+
 	template< typename T > inline bool peek(const procptr_t address, T &dst) const {
 		return peek(address, &dst, sizeof(T));
 	}
@@ -43,8 +114,25 @@ public:
 		return ret;
 	}
 
+	/// Performs all reads of the given plan, level by level, and returns whether all of them succeeded.
+	bool peek(PeekPlan &plan) const;
+
 	procptr_t peekPtr(const procptr_t address) const;
 
+	/// Maximum number of pointers cachedPointer() remembers. If more are resolved the cache starts over.
+	static constexpr size_t MAX_CACHED_POINTERS = 256;
+
+	/// Returns the address the resolver leads to (e.g. through a chain of pointers), as remembered under the given key.
+	///
+	/// The remembered address is validated with a single read: the first \p sentinelSize bytes at the address (e.g. an
+	/// object's vtable or class pointer) have to be the same as when it was resolved. The resolver is only called again
+	/// if they differ or can't be read. If the resolver returns 0, nothing is remembered.
+	procptr_t cachedPointer(const std::string &key, const std::function< procptr_t() > &resolver,
+							const size_t sentinelSize);
+
+	/// Forgets all pointers remembered by cachedPointer(), e.g. because the game has loaded a different level.
+	inline void forgetPointers() { m_cachedPointers.clear(); }
+
 	/// Resolves x64's RIP (Relative Instruction Pointer).
 	procptr_t peekRIP(const procptr_t address) const { return address + peek< uint32_t >(address) + 4; }
 
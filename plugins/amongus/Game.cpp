@@ -76,14 +76,28 @@ PlayerControl_Fields Game::playerControlFields() {
 }
 
 GameData_PlayerOutfit_Fields Game::playerOutfitFields(const GameData_PlayerInfo_Fields &fields) {
-	const auto dictFields = m_proc.peek< Dictionary_o >(fields.outfits).fields;
-	if (!dictFields.entries || dictFields.count < 1) {
+	if (!fields.outfits) {
 		return {};
 	}
 
-	const auto array = m_proc.peek< Dictionary_Array >(dictFields.entries);
+	// The outfit object stays the same for as long as the dictionary does, which is validated by its class pointer
+	const auto outfit = m_proc.cachedPointer(
+		"outfit:" + std::to_string(fields.outfits),
+		[this, &fields]() -> procptr_t {
+			const auto dictFields = m_proc.peek< Dictionary_o >(fields.outfits).fields;
+			if (!dictFields.entries || dictFields.count < 1) {
+				return 0;
+			}
 
-	return m_proc.peek< GameData_PlayerOutfit_o >(array.items[0].value).fields;
+			return m_proc.peek< Dictionary_Array >(dictFields.entries).items[0].value;
+		},
+		sizeof(ptr_t));
+
+	if (!outfit) {
+		return {};
+	}
+
+	return m_proc.peek< GameData_PlayerOutfit_o >(outfit).fields;
 }
 
 std::string Game::string(const procptr_t address) {
@@ -5,6 +5,7 @@
 
 #include "Game.h"
 
+#include <cstddef>
 #include <sstream>
 
 Game::Game(const procid_t id, const std::string &name) : m_proc(id, name) {
@@ -66,6 +67,28 @@ CPlayerAngles Game::playerAngles() const {
 	return m_proc.peek< CPlayerAngles >(cameraAngles.playerAngles);
 }
 
+bool Game::frame(Frame &frame) const {
+	CGameCameraAngles gameCameraAngles;
+	CCameraManagerAngles cameraManagerAngles;
+	CCameraAngles cameraAngles;
+
+	PeekPlan plan(m_proc.pointerSize());
+
+	const auto manager = plan.add(m_playerMgr, frame.manager);
+	const auto player  = plan.follow(manager, offsetof(CNetworkPlayerMgr, player), frame.player);
+	const auto info    = plan.follow(player, offsetof(CNetGamePlayer, info), frame.info);
+	plan.follow(info, offsetof(CPlayerInfo, ped), frame.entity);
+
+	const auto game          = plan.add(m_cameraMgr, gameCameraAngles);
+	const auto cameraManager = plan.follow(game, offsetof(CGameCameraAngles, cameraManagerAngles), cameraManagerAngles);
+	const auto camera        = plan.follow(cameraManager, offsetof(CCameraManagerAngles, cameraAngles), cameraAngles);
+	plan.follow(camera, offsetof(CCameraAngles, playerAngles), frame.angles);
+
+	m_proc.peek(plan);
+
+	return plan.ok(manager);
+}
+
 const std::string &Game::identity(const CNetGamePlayer &player, const CPlayerInfo &info, const CPed &entity) {
 	std::ostringstream stream;
 
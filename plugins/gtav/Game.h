@@ -15,6 +15,15 @@
 
 class Game {
 public:
+	/// Everything that is read from the game for a single frame
+	struct Frame {
+		CNetworkPlayerMgr manager{};
+		CNetGamePlayer player{};
+		CPlayerInfo info{};
+		CPed entity{};
+		CPlayerAngles angles{};
+	};
+
 	Mumble_PositionalDataErrorCode init();
 
 	static constexpr bool isMultiplayer(const CNetworkPlayerMgr &mgr) { return mgr.player; }
@@ -31,6 +40,12 @@ public:
 
 	CPlayerAngles playerAngles() const;
 
+	/// Reads the player's chain (manager, player, info and entity) and the camera's chain side by side, so that every
+	/// level of both takes a single read.
+	///
+	/// Returns false if the manager couldn't be read.
+	bool frame(Frame &frame) const;
+
 	const std::string &identity(const CNetGamePlayer &player, const CPlayerInfo &info, const CPed &entity);
 
 	Game(const procid_t id, const std::string &name);
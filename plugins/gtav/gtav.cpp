@@ -115,26 +115,23 @@ bool mumble_fetchPositionalData(float *avatarPos, float *avatarDir, float *avata
 	std::fill_n(cameraDir, 3, 0.f);
 	std::fill_n(cameraAxis, 3, 0.f);
 
-	const CNetworkPlayerMgr mgr = game->playerMgr();
-
-	if (!game->isMultiplayer(mgr)) {
+	Game::Frame frame;
+	if (!game->frame(frame) || !game->isMultiplayer(frame.manager)) {
 		return false;
 	}
 
-	const CNetGamePlayer player = game->player(mgr);
-
-	const CPlayerInfo info = game->playerInfo(player);
+	const CPlayerInfo &info = frame.info;
 	if (info.gameState != GameState::Playing) {
 		return true;
 	}
 
-	const CPed ent = game->playerEntity(info);
+	const CPed &ent = frame.entity;
 
 	std::copy(ent.position.cbegin(), ent.position.cend(), avatarPos);
 	std::copy(ent.forward.cbegin(), ent.forward.cend(), avatarDir);
 	std::copy(ent.up.cbegin(), ent.up.cend(), avatarAxis);
 
-	const CPlayerAngles cam = game->playerAngles();
+	const CPlayerAngles &cam = frame.angles;
 
 	std::copy(cam.position.cbegin(), cam.position.cend(), cameraPos);
 	std::copy(cam.forward.cbegin(), cam.forward.cend(), cameraDir);
@@ -149,7 +146,7 @@ bool mumble_fetchPositionalData(float *avatarPos, float *avatarDir, float *avata
 	}
 
 	*contextPtr  = "";
-	*identityPtr = game->identity(player, info, ent).c_str();
+	*identityPtr = game->identity(frame.player, info, ent).c_str();
 
 	return true;
 }
@@ -48,6 +48,33 @@ struct LinkedMem {
 	wchar_t description[2048]  = { 0 };
 };
 
+// The optional companion region of LinkedMem, which lets readers tell
+// whether LinkedMem has changed and whether they have read it while it
+// was being written. Games that support it set uiVersion to
+// LINKED_MEM_SYNC_VERSION and update LinkedMem like this:
+//
+// 1. Increment uiSequence (making it odd)
+// 2. Write LinkedMem
+// 3. Increment uiSequence again (making it even)
+//
+// The members are accessed as 32-bit atomics, with release semantics
+// for the second increment (and a release fence after the first one).
+// Readers only accept a copy of LinkedMem if uiSequence has been even
+// and the same before and after copying it.
+//
+// Games that don't support it keep working as before (see uiTick).
+struct LinkedMemSync {
+#ifdef _WIN32
+	UINT32 uiVersion  = 0;
+	UINT32 uiSequence = 0;
+#else
+	uint32_t uiVersion  = 0;
+	uint32_t uiSequence = 0;
+#endif
+};
+
+static constexpr unsigned int LINKED_MEM_SYNC_VERSION = 1;
+
 static inline const char *getLinkedMemoryName() {
 #ifdef _WIN32
 	return "MumbleLink";
@@ -60,4 +87,16 @@ static inline const char *getLinkedMemoryName() {
 #endif
 }
 
+static inline const char *getLinkedMemorySyncName() {
+#ifdef _WIN32
+	return "MumbleLinkSync";
+#else
+	static char name[256] = {};
+
+	snprintf(name, 256, "/MumbleLinkSync.%d", getuid());
+
+	return name;
+#endif
+}
+
 #endif // MUMBLE_PLUGINS_LINK_LINKEDMEM_H_
@@ -50,7 +50,7 @@ static_assert(sizeof(std::atomic< Chunk >) == chunkSize, "std::atomic< Chunk > h
 static_assert(chunkSize * chunkCount == sizeof(LinkedMem), "LinkedMem's size isn't a multiple of Chunk's size");
 
 SharedMemory::SharedMemory()
-	: m_data(nullptr), m_error(0),
+	: m_data(nullptr), m_size(0), m_error(0),
 #ifdef _WIN32
 	  m_handle(NULL)
 #else
@@ -75,7 +75,7 @@ void SharedMemory::close() {
 	m_handle = NULL;
 #else
 	if (m_data) {
-		munmap(m_data, sizeof(LinkedMem));
+		munmap(m_data, m_size);
 	}
 	if (!m_name.empty()) {
 		shm_unlink(m_name.c_str());
@@ -85,6 +85,7 @@ void SharedMemory::close() {
 #endif
 
 	m_data  = nullptr;
+	m_size  = 0;
 	m_error = 0;
 }
 
@@ -93,6 +94,10 @@ int SharedMemory::lastError() const {
 }
 
 bool SharedMemory::mapMemory(const char *name) {
+	return mapMemory(name, sizeof(LinkedMem));
+}
+
+bool SharedMemory::mapMemory(const char *name, std::size_t size) {
 	close();
 
 	bool created = false;
@@ -102,7 +107,7 @@ bool SharedMemory::mapMemory(const char *name) {
 
 	if (m_handle == NULL) {
 		// Attaching failed, so we have to create it
-		m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(LinkedMem), name);
+		m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast< DWORD >(size), name);
 
 		if (m_handle == NULL) {
 			m_error = GetLastError();
@@ -140,7 +145,7 @@ bool SharedMemory::mapMemory(const char *name) {
 		}
 
 		// Truncate to correct size
-		if (ftruncate(fd, sizeof(LinkedMem)) != 0) {
+		if (ftruncate(fd, static_cast< off_t >(size)) != 0) {
 			m_error = errno;
 
 			::close(fd);
@@ -151,7 +156,7 @@ bool SharedMemory::mapMemory(const char *name) {
 		created = true;
 	}
 
-	m_data = mmap(nullptr, sizeof(LinkedMem), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	m_data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 
 	if (m_data == reinterpret_cast< void * >(-1)) {
 		m_data = nullptr;
@@ -171,7 +176,9 @@ bool SharedMemory::mapMemory(const char *name) {
 	m_name.assign(name);
 #endif
 
-	if (created) {
+	m_size = size;
+
+	if (created && size == sizeof(LinkedMem)) {
 		reset();
 	}
 
@@ -213,3 +220,15 @@ void SharedMemory::write(const LinkedMem &source) {
 void SharedMemory::reset() {
 	write(LinkedMem());
 }
+
+std::uint32_t SharedMemory::load(std::size_t index) const {
+	const auto *data = static_cast< const std::atomic< Chunk > * >(m_data);
+
+	return static_cast< std::uint32_t >(data[index].load(std::memory_order_acquire));
+}
+
+void SharedMemory::store(std::size_t index, std::uint32_t value) {
+	auto *data = static_cast< std::atomic< Chunk > * >(m_data);
+
+	data[index].store(static_cast< Chunk >(value), std::memory_order_release);
+}
@@ -7,6 +7,7 @@
 #define MUMBLE_PLUGINS_LINK_SHAREDMEMORY_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #ifdef _WIN32
 #	ifndef NOMINMAX
@@ -30,16 +31,27 @@ public:
 
 	bool mapMemory(const char *name);
 
+	/// Maps the shared memory region of the given name and size, creating it if it doesn't exist yet
+	bool mapMemory(const char *name, std::size_t size);
+
 	bool isMemoryMapped() const;
 
+	// read(), write() and reset() may only be used on a region of the size of LinkedMem
 	LinkedMem read() const;
 
 	void write(const LinkedMem &source);
 
 	void reset();
 
+	/// @returns The 32-bit value at the given index of the region, loaded with acquire semantics
+	std::uint32_t load(std::size_t index) const;
+
+	/// Stores the given 32-bit value at the given index of the region with release semantics
+	void store(std::size_t index, std::uint32_t value);
+
 private:
 	void *m_data;
+	std::size_t m_size;
 	int m_error;
 
 #ifdef _WIN32
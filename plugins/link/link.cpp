@@ -3,8 +3,10 @@
 // that can be found in the LICENSE file at the root of the
 // Mumble source tree or at <https://www.mumble.info/LICENSE>.
 
+#include <atomic>
 #include <chrono>
 #include <codecvt>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
@@ -28,10 +30,19 @@ std::string pluginContext;
 std::string pluginIdentity;
 
 SharedMemory sharedMem;
+SharedMemory syncMem;
 
 std::uint32_t last_tick     = 0;
 std::int64_t last_tick_time = 0;
 
+std::uint32_t last_sequence = 0;
+LinkedMem last_lm;
+
+constexpr std::size_t syncVersionIndex  = offsetof(LinkedMemSync, uiVersion) / sizeof(std::uint32_t);
+constexpr std::size_t syncSequenceIndex = offsetof(LinkedMemSync, uiSequence) / sizeof(std::uint32_t);
+// How often reading LinkedMem is retried if the game has been writing it at the same time
+constexpr int maxReadAttempts = 16;
+
 /**
  * @returns Time in ms since Epoch
  */
@@ -39,6 +50,50 @@ static std::uint64_t getTimeSinceEpoch() {
 	return std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1);
 }
 
+/**
+ * Reads LinkedMem, using the sync region if the game supports it.
+ *
+ * @param[out] lm The contents of LinkedMem
+ * @returns Whether the game has updated LinkedMem since it has been read the last time
+ */
+static bool readLinkedMem(LinkedMem &lm) {
+	if (!syncMem.isMemoryMapped() || syncMem.load(syncVersionIndex) != LINKED_MEM_SYNC_VERSION) {
+		lm = sharedMem.read();
+
+		const bool updated = lm.uiTick != last_tick;
+		last_tick          = lm.uiTick;
+		return updated;
+	}
+
+	for (int i = 0; i < maxReadAttempts; i++) {
+		const std::uint32_t before = syncMem.load(syncSequenceIndex);
+
+		if (before == last_sequence) {
+			// Nothing has changed, so there is no need to read the shared memory
+			lm = last_lm;
+			return false;
+		}
+
+		if (before & 1) {
+			// The game is writing LinkedMem right now
+			continue;
+		}
+
+		lm = sharedMem.read();
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (syncMem.load(syncSequenceIndex) == before) {
+			last_sequence = before;
+			last_lm       = lm;
+			return true;
+		}
+	}
+
+	// The game is writing faster than we can read (or has stopped while writing): Use the last consistent copy
+	lm = last_lm;
+	return false;
+}
+
 mumble_error_t mumble_init(mumble_plugin_id_t id) {
 	UNUSED(id);
 
@@ -48,10 +103,16 @@ mumble_error_t mumble_init(mumble_plugin_id_t id) {
 		return MUMBLE_EC_INTERNAL_ERROR;
 	}
 
+	// Games that don't know about the sync region keep working without it
+	if (!syncMem.mapMemory(getLinkedMemorySyncName(), sizeof(LinkedMemSync))) {
+		std::cerr << "Link plugin: Failed to setup shared sync memory: " << syncMem.lastError() << std::endl;
+	}
+
 	return MUMBLE_STATUS_OK;
 }
 
 void mumble_shutdown() {
+	syncMem.close();
 	sharedMem.close();
 }
 
@@ -116,11 +177,11 @@ uint8_t mumble_initPositionalData(const char *const *programNames, const uint64_
 		return MUMBLE_PDEC_ERROR_TEMP;
 	}
 
-	LinkedMem lm = sharedMem.read();
+	LinkedMem lm;
+	const bool updated = readLinkedMem(lm);
 
 	if ((lm.uiVersion == 1) || (lm.uiVersion == 2)) {
-		if (lm.uiTick != last_tick) {
-			last_tick      = lm.uiTick;
+		if (updated) {
 			last_tick_time = getTimeSinceEpoch();
 
 			wchar_t buff[2048];
@@ -160,10 +221,9 @@ bool mumble_fetchPositionalData(float *avatarPos, float *avatarDir, float *avata
 	SET_TO_ZERO(cameraDir);
 	SET_TO_ZERO(cameraAxis);
 
-	LinkedMem lm = sharedMem.read();
+	LinkedMem lm;
 
-	if (lm.uiTick != last_tick) {
-		last_tick      = lm.uiTick;
+	if (readLinkedMem(lm)) {
 		last_tick_time = getTimeSinceEpoch();
 	} else if ((getTimeSinceEpoch() - last_tick_time) > 5000) {
 		return false;
@@ -229,6 +289,9 @@ void mumble_shutdownPositionalData() {
 	pluginIdentity.clear();
 
 	sharedMem.reset();
+	// The sync region belongs to the game, which may still be writing to it
+	last_sequence = 0;
+	last_lm       = LinkedMem();
 }
 
 MumbleStringWrapper mumble_getPositionalDataContextPrefix() {
@@ -10,8 +10,10 @@
 #	include <unistd.h>
 #endif
 
+#include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstddef>
 #include <cstring>
 #include <cwchar>
 #include <iostream>
@@ -19,15 +21,25 @@
 #include <thread>
 
 SharedMemory sharedMem;
+SharedMemory syncMem;
 LinkedMem lm;
+std::uint32_t sequence = 0;
 std::random_device dev;
 std::mt19937 rng(dev());
 std::uniform_real_distribution< float > generator(0, 100);
 
 void initMumble() {
 	sharedMem.mapMemory(getLinkedMemoryName());
+	syncMem.mapMemory(getLinkedMemorySyncName(), sizeof(LinkedMemSync));
 
 	lm = LinkedMem();
+
+	if (syncMem.isMemoryMapped()) {
+		sequence = syncMem.load(offsetof(LinkedMemSync, uiSequence) / sizeof(std::uint32_t));
+		// Start from an even number in case a previous writer has stopped in the middle of an update
+		sequence += sequence & 1;
+		syncMem.store(offsetof(LinkedMemSync, uiVersion) / sizeof(std::uint32_t), LINKED_MEM_SYNC_VERSION);
+	}
 }
 
 void updateMumble() {
@@ -83,12 +95,23 @@ void updateMumble() {
 	memcpy(lm.context, "ContextBlob\x00\x01\x02\x03\x04", 16);
 	lm.context_len = 16;
 
+	if (syncMem.isMemoryMapped()) {
+		// Tell Mumble that LinkedMem is being written, so that it doesn't read it halfway through
+		syncMem.store(offsetof(LinkedMemSync, uiSequence) / sizeof(std::uint32_t), ++sequence);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
 	sharedMem.write(lm);
+
+	if (syncMem.isMemoryMapped()) {
+		syncMem.store(offsetof(LinkedMemSync, uiSequence) / sizeof(std::uint32_t), ++sequence);
+	}
 }
 
 void signalHandler(int signum) {
 	std::cout << "Interrupt signal (" << signum << ") received - shutting down..." << std::endl;
 
+	syncMem.close();
 	sharedMem.close();
 
 	std::exit(signum);
@@ -8,6 +8,7 @@
 
 #include <cmath>
 #include <codecvt>
+#include <cstring>
 #include <fstream>
 #include <locale>
 #include <sstream>
@@ -150,11 +151,35 @@ static inline bool skipUntil(std::stringstream &stream, const std::stringstream:
 /// "?" is used as wildcard character.
 /// If the pattern is not found, the function returns SIZE_MAX.
 static inline size_t searchInBuffer(const std::vector< uint8_t > &pattern, const std::vector< uint8_t > &buffer) {
-	for (size_t i = 0; i < buffer.size() - pattern.size(); ++i) {
-		const auto *buf = &buffer[i];
+	if (pattern.empty() || buffer.size() < pattern.size()) {
+		return SIZE_MAX;
+	}
+
+	size_t anchor = 0;
+	while (anchor < pattern.size() && pattern[anchor] == '?') {
+		++anchor;
+	}
+
+	if (anchor == pattern.size()) {
+		return 0;
+	}
+
+	// The first byte that isn't a wildcard is searched for with memchr(), which the C libraries implement with SIMD
+	// instructions. Only where it occurs does the whole pattern have to be compared.
+	const auto *begin = &buffer[0];
+	const auto *seek  = begin + anchor;
+	const auto *end   = begin + (buffer.size() - pattern.size()) + anchor + 1;
+
+	while (seek < end) {
+		const auto *found = static_cast< const uint8_t * >(memchr(seek, pattern[anchor], end - seek));
+		if (!found) {
+			break;
+		}
+
+		const auto *buf = found - anchor;
 		bool match      = true;
 
-		for (size_t j = 0; j < pattern.size(); ++j) {
+		for (size_t j = anchor + 1; j < pattern.size(); ++j) {
 			if (pattern[j] != '?' && buf[j] != pattern[j]) {
 				match = false;
 				break;
@@ -162,8 +187,10 @@ static inline size_t searchInBuffer(const std::vector< uint8_t > &pattern, const
 		}
 
 		if (match) {
-			return buf - &buffer[0];
+			return buf - begin;
 		}
+
+		seek = found + 1;
 	}
 
 	return SIZE_MAX;
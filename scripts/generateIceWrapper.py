@@ -64,8 +64,12 @@ def generateFunction(className, functionName, wrapArgs, callArgs):
     function += "\t}\n"
     function += "#endif // ACCESS_" + className + "_" + functionName + "_ALL\n"
     function += "\n"
+    function += "#ifdef DISPATCH_" + className + "_" + functionName + "_DIRECT\n"
+    function += "\timpl_" + className + "_" + functionName + "(" + ", ".join(callArgs) + ");\n"
+    function += "#else\n"
     function += "\tExecEvent *ie = new ExecEvent(boost::bind(&impl_" + className + "_" + functionName + ", " + ", ".join(callArgs) + "));\n"
     function += "\tQCoreApplication::instance()->postEvent(mi, ie);\n"
+    function += "#endif // DISPATCH_" + className + "_" + functionName + "_DIRECT\n"
     function += "}\n"
 
     return function
@@ -9,6 +9,7 @@
 #include "User.h"
 
 #ifdef MURMUR
+#	include "PermissionCache.h"
 #	include "ServerUser.h"
 
 #	include <QtCore/QStack>
@@ -114,14 +115,14 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 	Permissions granted = 0;
 #	endif
 
+	// The stamp has to be obtained before evaluating the ACLs, so that changes made in the meantime invalidate the
+	// result right away
+	PermissionCache::Stamp stamp;
 	if (cache) {
-		QHash< Channel *, Permissions > *h = cache->value(p);
-		if (h)
-			granted = h->value(chan);
-	}
-
-	if (granted & Cached) {
-		return granted;
+		unsigned int cached;
+		if (cache->lookup(p, chan, cached, &stamp)) {
+			return static_cast< Permissions >(cached);
+		}
 	}
 
 	QStack< Channel * > chanstack;
@@ -190,10 +191,7 @@ QFlags< ChanACL::Perm > ChanACL::effectivePermissions(ServerUser *p, Channel *ch
 	}
 
 	if (cache) {
-		if (!cache->contains(p))
-			cache->insert(p, new QHash< Channel *, Permissions >);
-
-		cache->value(p)->insert(chan, granted | Cached);
+		cache->store(p, chan, stamp, granted | Cached);
 	}
 
 	return granted;
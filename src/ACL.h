@@ -12,6 +12,7 @@
 class Channel;
 class User;
 class ServerUser;
+class PermissionCache;
 
 class ChanACL : public QObject {
 private:
@@ -47,8 +48,7 @@ public:
 
 	Q_DECLARE_FLAGS(Permissions, Perm)
 
-	typedef QHash< Channel *, Permissions > ChanCache;
-	typedef QHash< User *, ChanCache * > ACLCache;
+	typedef PermissionCache ACLCache;
 
 	Channel *c;
 	bool bApplyHere;
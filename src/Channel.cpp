@@ -29,6 +29,7 @@ Channel::Channel(unsigned int id, const QString &name, QObject *p) : QObject(p)
 	uiMaxUsers  = 0;
 	bTemporary  = false;
 	cParent     = qobject_cast< Channel * >(p);
+	qlLinkGroup << this;
 	if (cParent)
 		cParent->addChannel(this);
 #ifdef MUMBLE
@@ -188,6 +189,13 @@ void Channel::link(Channel *l) {
 	qhLinks[l]++;
 	l->qsPermLinks.insert(this);
 	l->qhLinks[this]++;
+
+	if (!qlLinkGroup.contains(l)) {
+		// Linking two groups simply merges them
+		const QList< Channel * > group = qlLinkGroup + l->qlLinkGroup;
+		foreach (Channel *c, group)
+			c->qlLinkGroup = group;
+	}
 }
 
 void Channel::unlink(Channel *l) {
@@ -196,31 +204,54 @@ void Channel::unlink(Channel *l) {
 		qhLinks.remove(l);
 		l->qsPermLinks.remove(this);
 		l->qhLinks.remove(this);
+
+		// The group may have been split in two
+		rebuildLinkGroup();
+		if (!qlLinkGroup.contains(l))
+			l->rebuildLinkGroup();
 	} else {
 		foreach (Channel *c, qhLinks.keys())
 			unlink(c);
 	}
 }
 
-QSet< Channel * > Channel::allLinks() {
-	QSet< Channel * > seen;
-	seen.insert(this);
-	if (qhLinks.isEmpty())
-		return seen;
-
-	QStack< Channel * > stack;
-	stack.push(this);
-
-	while (!stack.isEmpty()) {
-		Channel *lnk = stack.pop();
-		foreach (Channel *l, lnk->qhLinks.keys()) {
-			if (!seen.contains(l)) {
-				seen.insert(l);
-				stack.push(l);
+void Channel::rebuildLinkGroup() {
+	QList< Channel * > group;
+	group << this;
+
+	if (!qhLinks.isEmpty()) {
+		QSet< Channel * > seen;
+		seen.insert(this);
+
+		QStack< Channel * > stack;
+		stack.push(this);
+
+		while (!stack.isEmpty()) {
+			Channel *lnk = stack.pop();
+			foreach (Channel *l, lnk->qhLinks.keys()) {
+				if (!seen.contains(l)) {
+					seen.insert(l);
+					group << l;
+					stack.push(l);
+				}
 			}
 		}
 	}
-	return seen;
+
+	foreach (Channel *c, group)
+		c->qlLinkGroup = group;
+}
+
+QSet< Channel * > Channel::allLinks() {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	return QSet< Channel * >(qlLinkGroup.begin(), qlLinkGroup.end());
+#else
+	return qlLinkGroup.toSet();
+#endif
+}
+
+const QList< Channel * > &Channel::linkGroup() const {
+	return qlLinkGroup;
 }
 
 QSet< Channel * > Channel::allChildren() {
@@ -245,12 +276,18 @@ void Channel::addChannel(Channel *c) {
 	c->cParent = this;
 	c->setParent(this);
 	qlChannels << c;
+
+	c->setLevel(m_level + 1);
+	updateDepth();
 }
 
 void Channel::removeChannel(Channel *c) {
 	c->cParent = nullptr;
 	c->setParent(nullptr);
 	qlChannels.removeAll(c);
+
+	c->setLevel(0);
+	updateDepth();
 }
 
 void Channel::addUser(User *p) {
@@ -277,26 +314,31 @@ Channel::operator QString() const {
 }
 
 size_t Channel::getLevel() const {
-	size_t i = 0;
-
-	const Channel *c = this;
-	while (c->cParent) {
-		c = c->cParent;
-		++i;
-	}
-
-	return i;
+	return m_level;
 }
 
 size_t Channel::getDepth() const {
-	if (qlChannels.empty()) {
-		return 0;
-	}
+	return m_depth;
+}
+
+void Channel::setLevel(size_t level) {
+	m_level = level;
+
+	// Only channels that are moved within the tree have children already
+	foreach (Channel *child, qlChannels) { child->setLevel(level + 1); }
+}
 
-	size_t result = 0;
-	foreach (Channel *child, qlChannels) { result = qMax(result, child->getDepth() + 1); }
+void Channel::updateDepth() {
+	for (Channel *c = this; c; c = c->cParent) {
+		size_t depth = 0;
+		foreach (const Channel *child, c->qlChannels) { depth = qMax(depth, child->m_depth + 1); }
 
-	return result;
+		if (depth == c->m_depth) {
+			// The parents don't change either
+			break;
+		}
+		c->m_depth = depth;
+	}
 }
 
 QString Channel::getPath() const {
@@ -58,6 +58,9 @@ public:
 
 	QSet< Channel * > qsPermLinks;
 	QHash< Channel *, int > qhLinks;
+	/// All channels that are linked with this one, directly or through other channels, including this one. All
+	/// channels of a group share the same list, which is updated whenever a link is added or removed.
+	QList< Channel * > qlLinkGroup;
 
 	bool bInheritACL;
 
@@ -90,7 +93,10 @@ public:
 #endif
 	static bool lessThan(const Channel *, const Channel *);
 
+	/// @returns The number of parents the channel has, which is kept up to date as channels are added and removed
 	size_t getLevel() const;
+	/// @returns The number of levels of children below the channel, which is kept up to date as channels are added
+	/// 	and removed
 	size_t getDepth() const;
 	QString getPath() const;
 
@@ -104,10 +110,25 @@ public:
 	void unlink(Channel *c = nullptr);
 
 	QSet< Channel * > allLinks();
+	/// @returns All channels that are linked with this one, including this one (see qlLinkGroup)
+	const QList< Channel * > &linkGroup() const;
 	QSet< Channel * > allChildren();
 
 	operator QString() const;
 
+protected:
+	/// See getLevel()
+	size_t m_level = 0;
+	/// See getDepth()
+	size_t m_depth = 0;
+
+	/// Collects the channels this one is linked with and hands the resulting group out to all of them
+	void rebuildLinkGroup();
+	/// Sets the level of this channel and updates the ones of its children
+	void setLevel(size_t level);
+	/// Recomputes the depth of this channel from the ones of its children and updates the ones of its parents
+	void updateDepth();
+
 signals:
 	/// Signal emitted whenever a user enters a channel.
 	///
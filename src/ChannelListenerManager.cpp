@@ -10,6 +10,9 @@
 #include <QReadLocker>
 #include <QWriteLocker>
 
+#include <algorithm>
+#include <atomic>
+
 std::size_t qHash(const ChannelListener &listener) {
 	return std::hash< ChannelListener >()(listener);
 }
@@ -20,21 +23,29 @@ bool operator==(const ChannelListener &lhs, const ChannelListener &rhs) {
 
 ChannelListenerManager::ChannelListenerManager()
 	: QObject(nullptr), m_listenerLock(), m_listeningUsers(), m_listenedChannels(), m_volumeLock(),
-	  m_listenerVolumeAdjustments() {
+	  m_listenerVolumeAdjustments(), m_snapshot(std::make_shared< Snapshot >()) {
 }
 
 void ChannelListenerManager::addListener(unsigned int userSession, unsigned int channelID) {
-	QWriteLocker lock(&m_listenerLock);
+	{
+		QWriteLocker lock(&m_listenerLock);
 
-	m_listeningUsers[userSession] << channelID;
-	m_listenedChannels[channelID] << userSession;
+		m_listeningUsers[userSession] << channelID;
+		m_listenedChannels[channelID] << userSession;
+	}
+
+	publishListeners(channelID);
 }
 
 void ChannelListenerManager::removeListener(unsigned int userSession, unsigned int channelID) {
-	QWriteLocker lock(&m_listenerLock);
+	{
+		QWriteLocker lock(&m_listenerLock);
+
+		m_listeningUsers[userSession].remove(channelID);
+		m_listenedChannels[channelID].remove(userSession);
+	}
 
-	m_listeningUsers[userSession].remove(channelID);
-	m_listenedChannels[channelID].remove(userSession);
+	publishListeners(channelID);
 }
 
 bool ChannelListenerManager::isListening(unsigned int userSession, unsigned int channelID) const {
@@ -61,6 +72,16 @@ const QSet< unsigned int > ChannelListenerManager::getListenersForChannel(unsign
 	return m_listenedChannels[channelID];
 }
 
+std::shared_ptr< const ChannelListenerManager::ChannelListeners >
+	ChannelListenerManager::getListenerEntries(unsigned int channelID) const {
+	static const std::shared_ptr< const ChannelListeners > noListeners = std::make_shared< ChannelListeners >();
+
+	const std::shared_ptr< const Snapshot > snapshot = std::atomic_load(&m_snapshot);
+
+	auto it = snapshot->find(channelID);
+	return it != snapshot->end() ? it->second : noListeners;
+}
+
 const QSet< unsigned int > ChannelListenerManager::getListenedChannelsForUser(unsigned int userSession) const {
 	QReadLocker lock(&m_listenerLock);
 
@@ -97,6 +118,8 @@ void ChannelListenerManager::setListenerVolumeAdjustment(unsigned int userSessio
 		m_listenerVolumeAdjustments[key] = volumeAdjustment;
 	}
 
+	publishListeners(channelID);
+
 	if (oldValue != volumeAdjustment.factor) {
 		emit localVolumeAdjustmentsChanged(channelID, volumeAdjustment.factor, oldValue);
 	}
@@ -153,4 +176,30 @@ void ChannelListenerManager::clear() {
 		QWriteLocker lock(&m_volumeLock);
 		m_listenerVolumeAdjustments.clear();
 	}
+	{
+		std::lock_guard< std::mutex > guard(m_snapshotMutex);
+		std::atomic_store(&m_snapshot, std::shared_ptr< const Snapshot >(std::make_shared< Snapshot >()));
+	}
+}
+
+void ChannelListenerManager::publishListeners(unsigned int channelID) {
+	// Reading the listeners while holding the mutex ensures that an older state never replaces a newer one
+	std::lock_guard< std::mutex > guard(m_snapshotMutex);
+
+	auto listeners = std::make_shared< ChannelListeners >();
+	for (unsigned int session : getListenersForChannel(channelID)) {
+		listeners->push_back({ session, getListenerVolumeAdjustment(session, channelID) });
+	}
+	std::sort(listeners->begin(), listeners->end(), [](const ListenerEntry &lhs, const ListenerEntry &rhs) {
+		return lhs.userSession < rhs.userSession;
+	});
+
+	auto snapshot = std::make_shared< Snapshot >(*std::atomic_load(&m_snapshot));
+	if (listeners->empty()) {
+		snapshot->erase(channelID);
+	} else {
+		(*snapshot)[channelID] = std::move(listeners);
+	}
+
+	std::atomic_store(&m_snapshot, std::shared_ptr< const Snapshot >(std::move(snapshot)));
 }
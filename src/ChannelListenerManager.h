@@ -13,7 +13,10 @@
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QSet>
 
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 class User;
 class Channel;
@@ -43,7 +46,18 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(ChannelListenerManager)
 
+public:
+	struct ListenerEntry {
+		/// The session ID of the listening user
+		unsigned int userSession;
+		VolumeAdjustment volumeAdjustment;
+	};
+	/// The listeners of a single channel (sorted by session), together with their volume adjustments
+	using ChannelListeners = std::vector< ListenerEntry >;
+
 protected:
+	using Snapshot = std::unordered_map< unsigned int, std::shared_ptr< const ChannelListeners > >;
+
 	/// A lock for guarding m_listeningUsers as well as m_listenedChannels
 	mutable QReadWriteLock m_listenerLock;
 	/// A map between a user's session and a list of IDs of all channels the user is listening to
@@ -55,6 +69,15 @@ protected:
 	/// A map between channel IDs and local volume adjustments to be made for ChannelListeners
 	/// in that channel
 	std::unordered_map< ChannelListener, VolumeAdjustment > m_listenerVolumeAdjustments;
+	/// Serializes the updates of m_snapshot
+	std::mutex m_snapshotMutex;
+	/// The listeners of every listened channel. Snapshots are never modified, but replaced as a whole whenever a
+	/// listener or a volume adjustment changes, so that they can be read without taking any of the locks above.
+	/// It must only be accessed through std::atomic_load and std::atomic_store.
+	std::shared_ptr< const Snapshot > m_snapshot;
+
+	/// Replaces the listeners of the given channel in m_snapshot by the current ones
+	void publishListeners(unsigned int channelID);
 
 public:
 	/// Constructor
@@ -89,6 +112,14 @@ public:
 	/// @returns A set of user sessions of users listening to the given channel
 	const QSet< unsigned int > getListenersForChannel(unsigned int channelID) const;
 
+	/// Unlike getListenersForChannel and getListenerVolumeAdjustment, this doesn't take any locks and is thus meant
+	/// for the hot paths, e.g. for routing audio.
+	///
+	/// @param channelID The ID of the channel
+	/// @returns The listeners of the given channel together with their volume adjustments. The list doesn't change
+	/// 	anymore, but is only kept alive by the returned pointer.
+	std::shared_ptr< const ChannelListeners > getListenerEntries(unsigned int channelID) const;
+
 	/// @param userSession The session ID of the user
 	/// @returns A set of channel IDs of channels the given user is listening to
 	const QSet< unsigned int > getListenedChannelsForUser(unsigned int userSession) const;
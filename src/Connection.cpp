@@ -7,9 +7,15 @@
 #include "Mumble.pb.h"
 #include "SSL.h"
 
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
 #include <QtCore/QtEndian>
 #include <QtNetwork/QHostAddress>
 
+#include <algorithm>
+#include <limits>
+#include <utility>
+
 #ifdef Q_OS_WIN
 #	include <qos2.h>
 #else
@@ -23,10 +29,187 @@
 HANDLE Connection::hQoS = nullptr;
 #endif
 
+// Queued messages are written right away once they add up to this many bytes
+static const int MAX_SEND_QUEUE_BYTES = 64 * 1024;
+// No more messages are written to the socket while this many bytes are still waiting to be sent
+static const qint64 MAX_SOCKET_PENDING_BYTES = 256 * 1024;
+
+ControlReadResult readControlMessage(QIODevice *device, Mumble::Protocol::TCPMessageType &type, int &packetLength,
+									 QByteArray &message) {
+	qint64 iAvailable = device->bytesAvailable();
+	if (packetLength == -1) {
+		if (iAvailable < 6)
+			return ControlReadResult::Incomplete;
+
+		unsigned char a_ucBuffer[6];
+
+		device->read(reinterpret_cast< char * >(a_ucBuffer), 6);
+		type         = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&a_ucBuffer[0]));
+		packetLength = qFromBigEndian< int >(&a_ucBuffer[2]);
+		iAvailable -= 6;
+
+		// Refused right away instead of buffering up to the announced length first (negative lengths would be
+		// mistaken for the missing header otherwise)
+		if (packetLength < 0 || packetLength > MAX_CONTROL_MESSAGE_LENGTH)
+			return ControlReadResult::TooLarge;
+	}
+
+	if (iAvailable < packetLength)
+		return ControlReadResult::Incomplete;
+
+	message.resize(packetLength);
+	device->read(message.data(), packetLength);
+	packetLength = -1;
+
+	return ControlReadResult::Complete;
+}
+
+ConnectionIOWorker::ConnectionIOWorker(QSslSocket *socket, SslErrorFilter sslErrorFilter)
+	: m_socket(socket), m_sslErrorFilter(std::move(sslErrorFilter)), m_type(Mumble::Protocol::TCPMessageType::Version),
+	  m_packetLength(-1), m_sessionProtocol(QSsl::UnknownProtocol) {
+	m_socket->setParent(this);
+
+	connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+			SLOT(socketError(QAbstractSocket::SocketError)));
+	connect(m_socket, SIGNAL(encrypted()), this, SLOT(socketEncrypted()));
+	connect(m_socket, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
+	connect(m_socket, SIGNAL(readyRead()), this, SLOT(socketRead()));
+	connect(m_socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+	connect(m_socket, SIGNAL(sslErrors(const QList< QSslError > &)), this,
+			SLOT(socketSslErrors(const QList< QSslError > &)));
+}
+
+QList< ConnectionIOWorker::Message > ConnectionIOWorker::takeMessages() {
+	QMutexLocker lock(&m_mutex);
+
+	QList< Message > messages;
+	messages.swap(m_messages);
+
+	return messages;
+}
+
+QList< QSslCertificate > ConnectionIOWorker::peerCertificateChain() const {
+	QMutexLocker lock(&m_mutex);
+	return m_peerCertificateChain;
+}
+
+QSslCipher ConnectionIOWorker::sessionCipher() const {
+	QMutexLocker lock(&m_mutex);
+	return m_sessionCipher;
+}
+
+QSsl::SslProtocol ConnectionIOWorker::sessionProtocol() const {
+	QMutexLocker lock(&m_mutex);
+	return m_sessionProtocol;
+}
+
+void ConnectionIOWorker::startServerEncryption() {
+	m_socket->startServerEncryption();
+}
+
+void ConnectionIOWorker::write(const QByteArray &data) {
+	m_socket->write(data);
+}
+
+void ConnectionIOWorker::flush() {
+	if (m_socket->state() != QAbstractSocket::ConnectedState)
+		return;
+
+	if (!m_socket->isEncrypted())
+		return;
+
+	m_socket->flush();
+}
+
+void ConnectionIOWorker::disconnectSocket(bool force) {
+	if (m_socket->state() == QAbstractSocket::UnconnectedState) {
+		emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+		return;
+	}
+
+	if (force)
+		m_socket->abort();
+	else
+		m_socket->disconnectFromHost();
+}
+
+void ConnectionIOWorker::socketRead() {
+	QList< Message > received;
+
+	while (true) {
+		Message message;
+
+		const ControlReadResult result = readControlMessage(m_socket, m_type, m_packetLength, message.data);
+		if (result == ControlReadResult::Incomplete)
+			break;
+
+		if (result == ControlReadResult::TooLarge) {
+			qWarning() << "Host tried to send huge packet";
+			disconnectSocket(true);
+			break;
+		}
+
+		message.type = m_type;
+		received.append(std::move(message));
+	}
+
+	if (received.isEmpty())
+		return;
+
+	bool notify;
+	{
+		QMutexLocker lock(&m_mutex);
+		// The connection takes all messages at once, so it only has to be told about the first ones
+		notify = m_messages.isEmpty();
+		m_messages.append(received);
+	}
+
+	if (notify)
+		emit messagesPending();
+}
+
+void ConnectionIOWorker::socketError(QAbstractSocket::SocketError err) {
+	emit connectionClosed(err, m_socket->errorString());
+}
+
+void ConnectionIOWorker::socketDisconnected() {
+	emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
+}
+
+void ConnectionIOWorker::socketEncrypted() {
+	{
+		QMutexLocker lock(&m_mutex);
+		m_peerCertificateChain = m_socket->peerCertificateChain();
+		m_sessionCipher        = m_socket->sessionCipher();
+#if QT_VERSION >= 0x050400
+		m_sessionProtocol = m_socket->sessionProtocol();
+#endif
+	}
+
+	emit encrypted();
+}
+
+void ConnectionIOWorker::socketSslErrors(const QList< QSslError > &errors) {
+	// Ignoring the errors only has an effect while the signal is being handled, so this can't wait for the connection
+	if (m_sslErrorFilter && m_sslErrorFilter(errors))
+		m_socket->ignoreSslErrors();
+
+	emit handleSslErrors(errors);
+}
+
 Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	qtsSocket = qtsSock;
 	qtsSocket->setParent(this);
 	iPacketLength        = -1;
+	m_sendLaneBytes.fill(0);
+	m_sendQueueBytes     = 0;
+	m_sendQueueScheduled = false;
+	m_socketBytesPending = 0;
+	m_sendLimitExceeded  = false;
+	m_ioWorker           = nullptr;
+	m_peerPort           = 0;
+	m_localPort          = 0;
+	m_discardMessages    = false;
 	bDisconnectedEmitted = false;
 	csCrypt              = std::make_unique< CryptStateOCB2 >();
 
@@ -34,6 +217,7 @@ Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	if (!bDeclared) {
 		bDeclared = true;
 		qRegisterMetaType< QAbstractSocket::SocketError >("QAbstractSocket::SocketError");
+		qRegisterMetaType< QList< QSslError > >("QList<QSslError>");
 	}
 
 	int nodelay = 1;
@@ -43,6 +227,7 @@ Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 	connect(qtsSocket, SIGNAL(error(QAbstractSocket::SocketError)), this,
 			SLOT(socketError(QAbstractSocket::SocketError)));
 	connect(qtsSocket, SIGNAL(encrypted()), this, SIGNAL(encrypted()));
+	connect(qtsSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(socketBytesWritten(qint64)));
 	connect(qtsSocket, SIGNAL(readyRead()), this, SLOT(socketRead()));
 	connect(qtsSocket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
 	connect(qtsSocket, SIGNAL(sslErrors(const QList< QSslError > &)), this,
@@ -54,6 +239,11 @@ Connection::Connection(QObject *p, QSslSocket *qtsSock) : QObject(p) {
 }
 
 Connection::~Connection() {
+	if (m_ioWorker) {
+		// The worker (and with it the socket) has to be destroyed by its own thread
+		m_ioWorker->deleteLater();
+	}
+
 #ifdef Q_OS_WIN
 	if (dwFlow && hQoS) {
 		if (!QOSRemoveSocketFromFlow(hQoS, 0, dwFlow, 0))
@@ -112,33 +302,26 @@ void Connection::resetActivityTime() {
  */
 void Connection::socketRead() {
 	while (true) {
-		qint64 iAvailable = qtsSocket->bytesAvailable();
-		if (iPacketLength == -1) {
-			if (iAvailable < 6)
-				return;
-
-			unsigned char a_ucBuffer[6];
-
-			qtsSocket->read(reinterpret_cast< char * >(a_ucBuffer), 6);
-			m_type        = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(&a_ucBuffer[0]));
-			iPacketLength = qFromBigEndian< int >(&a_ucBuffer[2]);
-			iAvailable -= 6;
-		}
-
-		if ((iPacketLength == -1) || (iAvailable < iPacketLength))
+		const ControlReadResult result = readControlMessage(qtsSocket, m_type, iPacketLength, m_receiveBuffer);
+		if (result == ControlReadResult::Incomplete)
 			return;
 
-		if (iPacketLength > 0x7fffff) {
+		if (result == ControlReadResult::TooLarge) {
 			qWarning() << "Host tried to send huge packet";
 			disconnectSocket(true);
 			return;
 		}
 
-		QByteArray qbaBuffer = qtsSocket->read(iPacketLength);
-		iPacketLength        = -1;
-		iAvailable -= iPacketLength;
+		emit message(m_type, m_receiveBuffer);
+	}
+}
+
+void Connection::takeMessages() {
+	for (ConnectionIOWorker::Message &msg : m_ioWorker->takeMessages()) {
+		if (m_discardMessages)
+			return;
 
-		emit message(m_type, qbaBuffer);
+		emit message(msg.type, msg.data);
 	}
 }
 
@@ -151,6 +334,10 @@ void Connection::socketSslErrors(const QList< QSslError > &qlErr) {
 }
 
 void Connection::proceedAnyway() {
+	// The I/O worker has already decided about the errors (see moveToIOThread)
+	if (m_ioWorker)
+		return;
+
 	qtsSocket->ignoreSslErrors();
 }
 
@@ -166,7 +353,7 @@ void Connection::messageToNetwork(const ::google::protobuf::Message &msg, Mumble
 	// ByteSize() has been deprecated as of protobuf v3.4
 	std::size_t len = msg.ByteSize();
 #endif
-	if (len > 0x7fffff)
+	if (len > static_cast< std::size_t >(MAX_CONTROL_MESSAGE_LENGTH))
 		return;
 	cache.resize(static_cast< int >(len + 6));
 	unsigned char *uc = reinterpret_cast< unsigned char * >(cache.data());
@@ -186,11 +373,171 @@ void Connection::sendMessage(const ::google::protobuf::Message &msg, Mumble::Pro
 }
 
 void Connection::sendMessage(const QByteArray &qbaMsg) {
-	if (!qbaMsg.isEmpty())
-		qtsSocket->write(qbaMsg);
+	if (qbaMsg.size() < 2)
+		return;
+
+	const auto type = static_cast< Mumble::Protocol::TCPMessageType >(
+		qFromBigEndian< quint16 >(reinterpret_cast< const unsigned char * >(qbaMsg.constData())));
+
+	sendMessage(qbaMsg, type == Mumble::Protocol::TCPMessageType::UDPTunnel ? SendLane::Voice : SendLane::Control);
+}
+
+void Connection::sendMessage(const QByteArray &qbaMsg, SendLane lane) {
+	if (qbaMsg.isEmpty() || m_sendLimitExceeded)
+		return;
+
+	const std::size_t index    = static_cast< std::size_t >(lane);
+	QList< QByteArray > &queue = m_sendLanes[index];
+	int &queueBytes            = m_sendLaneBytes[index];
+
+	switch (lane) {
+		case SendLane::Voice:
+			// Makes room by dropping the oldest packets
+			while (m_sendLimits.voiceBytes > 0 && !queue.isEmpty()
+				   && queueBytes + qbaMsg.size() > m_sendLimits.voiceBytes) {
+				const QByteArray dropped = queue.takeFirst();
+				queueBytes -= dropped.size();
+				m_sendQueueBytes -= dropped.size();
+
+				++m_sendStatistics.droppedVoiceMessages;
+				m_sendStatistics.droppedVoiceBytes += static_cast< quint64 >(dropped.size());
+			}
+			break;
+		case SendLane::Control:
+			if (m_sendLimits.controlBytes > 0 && queueBytes + qbaMsg.size() > m_sendLimits.controlBytes) {
+				// The peer doesn't keep up with the state changes, which can't be dropped. The connection is closed
+				// once control returns to the event loop, as the caller might be iterating over all connections.
+				qWarning("Connection: Control messages exceed the limit of the send queue");
+				m_sendLimitExceeded = true;
+				QMetaObject::invokeMethod(this, "abortOverloadedConnection", Qt::QueuedConnection);
+				return;
+			}
+			break;
+		case SendLane::Bulk:
+			// A single message is always accepted, so that blobs larger than the limit can still be sent
+			if (m_sendLimits.bulkBytes > 0 && !queue.isEmpty()
+				&& queueBytes + qbaMsg.size() > m_sendLimits.bulkBytes) {
+				++m_sendStatistics.droppedBulkMessages;
+				m_sendStatistics.droppedBulkBytes += static_cast< quint64 >(qbaMsg.size());
+				return;
+			}
+			break;
+	}
+
+	// Only the reference to the (shared) buffer is queued
+	queue.append(qbaMsg);
+	queueBytes += qbaMsg.size();
+	m_sendQueueBytes += qbaMsg.size();
+	m_sendStatistics.peakQueuedBytes = std::max(m_sendStatistics.peakQueuedBytes, m_sendQueueBytes);
+
+	if (m_sendQueueBytes >= MAX_SEND_QUEUE_BYTES) {
+		writeSendQueue();
+	} else if (!m_sendQueueScheduled) {
+		m_sendQueueScheduled = true;
+		QMetaObject::invokeMethod(this, "writeSendQueue", Qt::QueuedConnection);
+	}
+}
+
+void Connection::setSendLimits(const SendLimits &limits) {
+	m_sendLimits = limits;
+}
+
+const Connection::SendStatistics &Connection::sendStatistics() const {
+	return m_sendStatistics;
+}
+
+void Connection::writeSendQueue(bool everything) {
+	m_sendQueueScheduled = false;
+
+	if (m_sendQueueBytes == 0)
+		return;
+
+	// Writing continues once the socket has sent enough (see socketBytesWritten)
+	const qint64 budget =
+		everything ? std::numeric_limits< qint64 >::max() : MAX_SOCKET_PENDING_BYTES - m_socketBytesPending;
+
+	QList< QByteArray > batch;
+	qint64 batchBytes = 0;
+	for (std::size_t i = 0; i < SEND_LANE_COUNT && batchBytes < budget; ++i) {
+		QList< QByteArray > &queue = m_sendLanes[i];
+		while (!queue.isEmpty() && batchBytes < budget) {
+			batch.append(queue.takeFirst());
+			batchBytes += batch.last().size();
+			m_sendLaneBytes[i] -= batch.last().size();
+		}
+	}
+
+	if (batch.isEmpty())
+		return;
+
+	m_sendQueueBytes -= static_cast< int >(batchBytes);
+
+	QByteArray qba;
+	if (batch.size() == 1) {
+		qba = batch.first();
+	} else {
+		qba.reserve(static_cast< int >(batchBytes));
+		for (const QByteArray &msg : batch)
+			qba.append(msg);
+	}
+
+	m_socketBytesPending += qba.size();
+
+	if (m_ioWorker) {
+		QMetaObject::invokeMethod(m_ioWorker, "write", Qt::QueuedConnection, Q_ARG(QByteArray, qba));
+	} else {
+		qtsSocket->write(qba);
+	}
+}
+
+void Connection::socketBytesWritten(qint64 bytes) {
+	m_socketBytesPending = std::max< qint64 >(0, m_socketBytesPending - bytes);
+
+	if (m_sendQueueBytes > 0 && !m_sendQueueScheduled) {
+		writeSendQueue();
+	}
+}
+
+void Connection::abortOverloadedConnection() {
+	disconnectSocket(true);
+}
+
+void Connection::moveToIOThread(QThread *thread, SslErrorFilter sslErrorFilter) {
+	m_peerAddress  = qtsSocket->peerAddress();
+	m_peerPort     = qtsSocket->peerPort();
+	m_localAddress = qtsSocket->localAddress();
+	m_localPort    = qtsSocket->localPort();
+
+	// From now on, only the worker is going to deal with the socket
+	qtsSocket->disconnect(this);
+	qtsSocket->setParent(nullptr);
+
+	m_ioWorker = new ConnectionIOWorker(qtsSocket, std::move(sslErrorFilter));
+	m_ioWorker->moveToThread(thread);
+
+	connect(m_ioWorker, &ConnectionIOWorker::messagesPending, this, &Connection::takeMessages);
+	connect(m_ioWorker, &ConnectionIOWorker::encrypted, this, &Connection::encrypted);
+	connect(m_ioWorker, &ConnectionIOWorker::bytesWritten, this, &Connection::socketBytesWritten);
+	connect(m_ioWorker, &ConnectionIOWorker::connectionClosed, this, &Connection::connectionClosed);
+	connect(m_ioWorker, &ConnectionIOWorker::handleSslErrors, this, &Connection::handleSslErrors);
+}
+
+void Connection::startServerEncryption() {
+	if (m_ioWorker) {
+		QMetaObject::invokeMethod(m_ioWorker, "startServerEncryption", Qt::QueuedConnection);
+	} else {
+		qtsSocket->startServerEncryption();
+	}
 }
 
 void Connection::forceFlush() {
+	writeSendQueue();
+
+	if (m_ioWorker) {
+		QMetaObject::invokeMethod(m_ioWorker, "flush", Qt::QueuedConnection);
+		return;
+	}
+
 	if (qtsSocket->state() != QAbstractSocket::ConnectedState)
 		return;
 
@@ -201,6 +548,17 @@ void Connection::forceFlush() {
 }
 
 void Connection::disconnectSocket(bool force) {
+	// Messages sent right before disconnecting (e.g. the reason for it) still have to reach the peer
+	writeSendQueue(true);
+
+	if (m_ioWorker) {
+		if (force)
+			m_discardMessages = true;
+
+		QMetaObject::invokeMethod(m_ioWorker, "disconnectSocket", Qt::QueuedConnection, Q_ARG(bool, force));
+		return;
+	}
+
 	if (qtsSocket->state() == QAbstractSocket::UnconnectedState) {
 		emit connectionClosed(QAbstractSocket::UnknownSocketError, QString());
 		return;
@@ -213,19 +571,19 @@ void Connection::disconnectSocket(bool force) {
 }
 
 QHostAddress Connection::peerAddress() const {
-	return qtsSocket->peerAddress();
+	return m_ioWorker ? m_peerAddress : qtsSocket->peerAddress();
 }
 
 quint16 Connection::peerPort() const {
-	return qtsSocket->peerPort();
+	return m_ioWorker ? m_peerPort : qtsSocket->peerPort();
 }
 
 QHostAddress Connection::localAddress() const {
-	return qtsSocket->localAddress();
+	return m_ioWorker ? m_localAddress : qtsSocket->localAddress();
 }
 
 quint16 Connection::localPort() const {
-	return qtsSocket->localPort();
+	return m_ioWorker ? m_localPort : qtsSocket->localPort();
 }
 
 QList< QSslCertificate > Connection::peerCertificateChain() const {
@@ -235,15 +593,24 @@ QList< QSslCertificate > Connection::peerCertificateChain() const {
 	// Through tests and by looking into Qt's source code it was validated,
 	// that these two functions do the same thing.
 	// See mumble-voip/mumble#5280 for more information.
+	if (m_ioWorker)
+		return m_ioWorker->peerCertificateChain();
+
 	return qtsSocket->peerCertificateChain();
 }
 
 QSslCipher Connection::sessionCipher() const {
+	if (m_ioWorker)
+		return m_ioWorker->sessionCipher();
+
 	return qtsSocket->sessionCipher();
 }
 
 QSsl::SslProtocol Connection::sessionProtocol() const {
 #if QT_VERSION >= 0x050400
+	if (m_ioWorker)
+		return m_ioWorker->sessionProtocol();
+
 	return qtsSocket->sessionProtocol();
 #else
 	return QSsl::UnknownProtocol; // Cannot determine session cipher. We only know it's some TLS variant
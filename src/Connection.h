@@ -21,7 +21,12 @@
 #include <QtCore/QList>
 #include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtNetwork/QHostAddress>
 #include <QtNetwork/QSslSocket>
+
+#include <array>
+#include <cstddef>
+#include <functional>
 #include <memory>
 
 #ifdef Q_OS_WIN
@@ -34,15 +39,142 @@ namespace protobuf {
 }
 } // namespace google
 
+class QThread;
+
+/// Control messages longer than this are refused (and their sender disconnected)
+constexpr int MAX_CONTROL_MESSAGE_LENGTH = 0x7fffff;
+
+enum class ControlReadResult { Incomplete, Complete, TooLarge };
+
+/// Reads the next control message from the given device (the socket of a connection), if it has been received
+/// completely. Every message is preceded by its type (two bytes) and length (four bytes), both big endian.
+///
+/// @param type The type of the message whose header has already been read
+/// @param packetLength The length of the message whose header has already been read or -1
+/// @param[out] message Receives the message. Its memory is reused if it isn't shared and is large enough.
+ControlReadResult readControlMessage(QIODevice *device, Mumble::Protocol::TCPMessageType &type, int &packetLength,
+									 QByteArray &message);
+
+/// Decides whether a TLS handshake may proceed despite the given errors
+using SslErrorFilter = std::function< bool(const QList< QSslError > &) >;
+
+/// Does all the I/O of a Connection whose socket has been handed over to a dedicated thread (see
+/// Connection::moveToIOThread): the TLS handshake, encryption and decryption and splitting the received data into
+/// messages. The worker lives in that thread, except for the functions that are explicitly thread-safe.
+class ConnectionIOWorker : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(ConnectionIOWorker)
+public:
+	struct Message {
+		Mumble::Protocol::TCPMessageType type;
+		QByteArray data;
+	};
+
+	ConnectionIOWorker(QSslSocket *socket, SslErrorFilter sslErrorFilter);
+
+	/// Takes all messages that have been received so far (thread-safe)
+	QList< Message > takeMessages();
+	/// The properties of the TLS session, which are known once encrypted() has been emitted (thread-safe)
+	QList< QSslCertificate > peerCertificateChain() const;
+	QSslCipher sessionCipher() const;
+	QSsl::SslProtocol sessionProtocol() const;
+
+public slots:
+	void startServerEncryption();
+	void write(const QByteArray &data);
+	void flush();
+	void disconnectSocket(bool force);
+signals:
+	/// Emitted if messages have been received while there haven't been any waiting to be taken
+	void messagesPending();
+	void encrypted();
+	void bytesWritten(qint64 bytes);
+	void connectionClosed(QAbstractSocket::SocketError, const QString &reason);
+	void handleSslErrors(const QList< QSslError > &);
+protected slots:
+	void socketRead();
+	void socketError(QAbstractSocket::SocketError);
+	void socketDisconnected();
+	void socketEncrypted();
+	void socketSslErrors(const QList< QSslError > &errors);
+
+protected:
+	QSslSocket *m_socket;
+	SslErrorFilter m_sslErrorFilter;
+	Mumble::Protocol::TCPMessageType m_type;
+	int m_packetLength;
+
+	/// Protects the members below, which are accessed by the thread of the Connection as well
+	mutable QMutex m_mutex;
+	QList< Message > m_messages;
+	QList< QSslCertificate > m_peerCertificateChain;
+	QSslCipher m_sessionCipher;
+	QSsl::SslProtocol m_sessionProtocol;
+};
+
 class Connection : public QObject {
 private:
 	Q_OBJECT
 	Q_DISABLE_COPY(Connection)
+public:
+	/// The lanes outgoing messages are queued in. Whenever the socket can take more data, the lanes are written in
+	/// this order, so that voice isn't delayed by state updates and neither of them is delayed by large blobs.
+	enum class SendLane { Voice, Control, Bulk };
+	static constexpr std::size_t SEND_LANE_COUNT = 3;
+
+	/// The number of bytes the lanes may hold (0 means unlimited). If the voice lane is full, its oldest packets are
+	/// dropped, as they are stale by then anyway. The bulk lane refuses new messages instead. Control messages must
+	/// not get lost, so a connection whose control lane is full is closed.
+	struct SendLimits {
+		int voiceBytes   = 0;
+		int controlBytes = 0;
+		int bulkBytes    = 0;
+	};
+
+	struct SendStatistics {
+		quint64 droppedVoiceMessages = 0;
+		quint64 droppedVoiceBytes    = 0;
+		quint64 droppedBulkMessages  = 0;
+		quint64 droppedBulkBytes     = 0;
+		/// The largest number of bytes that have been queued at once
+		int peakQueuedBytes = 0;
+	};
+
 protected:
 	QSslSocket *qtsSocket;
 	QElapsedTimer qtLastPacket;
 	Mumble::Protocol::TCPMessageType m_type;
 	int iPacketLength;
+	/// The buffer every received message is read into. Receivers that want to keep a message share the buffer,
+	/// which makes the next message use a new one; otherwise it is reused, so reading doesn't allocate any memory.
+	QByteArray m_receiveBuffer;
+	/// The messages that have been sent but haven't been written to the socket yet, by SendLane. They are written at
+	/// once when control returns to the event loop, which turns bursts of messages into a single write (and as few
+	/// TLS records as possible). The buffers are usually shared with the other receivers of a broadcast.
+	std::array< QList< QByteArray >, SEND_LANE_COUNT > m_sendLanes;
+	std::array< int, SEND_LANE_COUNT > m_sendLaneBytes;
+	/// The number of bytes in all lanes
+	int m_sendQueueBytes;
+	/// Whether writeSendQueue() has already been scheduled
+	bool m_sendQueueScheduled;
+	/// The number of bytes that have been written to the socket, but haven't been sent yet. Once there are too many
+	/// of them, messages are kept in the lanes, where they can still be prioritized (or dropped).
+	qint64 m_socketBytesPending;
+	SendLimits m_sendLimits;
+	SendStatistics m_sendStatistics;
+	/// Whether the control lane has exceeded its limit, which closes the connection
+	bool m_sendLimitExceeded;
+	/// The worker that does all I/O if the socket has been moved to another thread (see moveToIOThread). qtsSocket
+	/// must not be used anymore in that case.
+	ConnectionIOWorker *m_ioWorker;
+	/// The addresses of the socket, which are remembered when it is moved to another thread
+	QHostAddress m_peerAddress;
+	quint16 m_peerPort;
+	QHostAddress m_localAddress;
+	quint16 m_localPort;
+	/// Whether messages that have already been received are dropped (as the connection is being aborted)
+	bool m_discardMessages;
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
 	DWORD dwFlow;
@@ -52,6 +184,14 @@ protected slots:
 	void socketError(QAbstractSocket::SocketError);
 	void socketDisconnected();
 	void socketSslErrors(const QList< QSslError > &errors);
+	void socketBytesWritten(qint64 bytes);
+	/// Writes the queued messages to the socket, as many as it can take
+	///
+	/// @param everything Whether to write all of them regardless (e.g. before disconnecting)
+	void writeSendQueue(bool everything = false);
+	/// Emits all messages the I/O worker has received
+	void takeMessages();
+	void abortOverloadedConnection();
 public slots:
 	void proceedAnyway();
 signals:
@@ -67,16 +207,29 @@ public:
 								 QByteArray &cache);
 	void sendMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 					 QByteArray &cache);
+	/// Queues the given message (including its header), which is written to the socket once control returns to the
+	/// event loop or as soon as forceFlush() is called. Tunneled voice packets use the voice lane, everything else
+	/// the control lane.
 	void sendMessage(const QByteArray &qbaMsg);
+	void sendMessage(const QByteArray &qbaMsg, SendLane lane);
+	void setSendLimits(const SendLimits &limits);
+	const SendStatistics &sendStatistics() const;
+	/// Hands the socket over to the given thread, which does all I/O (including TLS) from now on. The received
+	/// messages are passed back to the thread of the connection in batches. Has to be called before the TLS
+	/// handshake has been started.
+	///
+	/// @param sslErrorFilter Decides (in the I/O thread) whether the handshake may proceed despite the given errors,
+	/// 	which replaces calling proceedAnyway() in response to handleSslErrors()
+	void moveToIOThread(QThread *thread, SslErrorFilter sslErrorFilter);
+	void startServerEncryption();
 	void disconnectSocket(bool force = false);
 	void forceFlush();
 	qint64 activityTime() const;
 	void resetActivityTime();
 
-#ifdef MURMUR
-	/// qmCrypt locks access to csCrypt.
+	/// qmCrypt locks access to csCrypt. On the server, it only covers the encrypting half of the state (see
+	/// ServerUser::qmDecrypt).
 	QMutex qmCrypt;
-#endif
 	std::unique_ptr< CryptState > csCrypt;
 	/// Returns the peer's chain of digital certificates, starting with the peer's immediate certificate
 	/// and ending with the CA's certificate.
@@ -0,0 +1,59 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "EpochReclaimer.h"
+
+#include <algorithm>
+#include <limits>
+
+EpochReclaimer::~EpochReclaimer() {
+	for (Retired &retired : m_retired) {
+		retired.destroy();
+	}
+}
+
+void EpochReclaimer::addReader(Reader &reader) {
+	m_readers.push_back(&reader);
+}
+
+void EpochReclaimer::removeReader(Reader &reader) {
+	m_readers.erase(std::remove(m_readers.begin(), m_readers.end(), &reader), m_readers.end());
+}
+
+void EpochReclaimer::retire(std::function< void() > destroy) {
+	// Readers that enter after the epoch has been advanced can't reach the object anymore
+	m_retired.push_back({ m_epoch.fetch_add(1, std::memory_order_seq_cst), std::move(destroy) });
+}
+
+void EpochReclaimer::retire(std::shared_ptr< const void > object) {
+	retire([object]() mutable { object.reset(); });
+}
+
+bool EpochReclaimer::reclaim() {
+	if (m_retired.empty()) {
+		return false;
+	}
+
+	std::uint64_t oldestActive = std::numeric_limits< std::uint64_t >::max();
+	for (const Reader *reader : m_readers) {
+		const std::uint64_t epoch = reader->m_epoch.load(std::memory_order_seq_cst);
+		if (epoch != 0) {
+			oldestActive = std::min(oldestActive, epoch);
+		}
+	}
+
+	auto end = std::find_if(m_retired.begin(), m_retired.end(),
+							[oldestActive](const Retired &retired) { return retired.epoch >= oldestActive; });
+
+	// Destroying an object may retire further ones, so the reclaimed ones are taken out of the list first
+	std::vector< Retired > reclaimed(std::make_move_iterator(m_retired.begin()), std::make_move_iterator(end));
+	m_retired.erase(m_retired.begin(), end);
+
+	for (Retired &retired : reclaimed) {
+		retired.destroy();
+	}
+
+	return !m_retired.empty();
+}
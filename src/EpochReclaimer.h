@@ -0,0 +1,93 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_EPOCHRECLAIMER_H_
+#define MUMBLE_EPOCHRECLAIMER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// Epoch based reclamation of data that is published by a single writer and read by a fixed set of reader threads
+/// without taking any locks (read-copy-update).
+///
+/// Readers announce that they are (possibly) using published data by calling enter() and that they are done with
+/// it by calling leave(). The writer never modifies published data. Instead, it publishes a new version (e.g. by
+/// swapping an atomic pointer) and then hands the old one to retire(). Retired objects are only destroyed by
+/// reclaim() once every reader that might still be using them has left (the grace period).
+///
+/// Everything except for enter() and leave() has to be called by the writer.
+class EpochReclaimer {
+public:
+	/// The state of a single reader. Every reader thread has its own one.
+	class Reader {
+	public:
+		Reader() = default;
+
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+
+	private:
+		friend class EpochReclaimer;
+
+		/// The epoch the reader has entered in or 0 while it isn't reading
+		std::atomic< std::uint64_t > m_epoch{ 0 };
+	};
+
+	EpochReclaimer() = default;
+	/// Destroys all objects that are still waiting for their grace period. There must not be any active readers.
+	~EpochReclaimer();
+
+	EpochReclaimer(const EpochReclaimer &) = delete;
+	EpochReclaimer &operator=(const EpochReclaimer &) = delete;
+
+	/// Adds a reader. The reader must not be destroyed before it has been removed again.
+	void addReader(Reader &reader);
+	/// Removes a reader, which must not be reading at the moment
+	void removeReader(Reader &reader);
+
+	/// Called by the given reader before it reads any published data. For the grace period to cover everything the
+	/// reader gets to see, the data has to be published (and read) with sequentially consistent stores (and loads).
+	void enter(Reader &reader) const {
+		// This has to be sequentially consistent with the writer's publication and its check in reclaim(): either
+		// the writer sees this reader's epoch or this reader gets to see everything published before the check.
+		reader.m_epoch.store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+	}
+
+	/// Called by the given reader once it doesn't use any of the data it has read since enter() anymore
+	void leave(Reader &reader) const { reader.m_epoch.store(0, std::memory_order_release); }
+
+	/// Hands over an object that is no longer reachable for readers that enter from now on (i.e. it has already
+	/// been replaced). The given function, which destroys the object, is called once the grace period has passed.
+	void retire(std::function< void() > destroy);
+	/// Keeps the given object alive until the grace period has passed
+	void retire(std::shared_ptr< const void > object);
+
+	/// Destroys all retired objects whose grace period has passed
+	///
+	/// @returns Whether there are retired objects that are still waiting for their grace period
+	bool reclaim();
+
+	/// @returns Whether there are retired objects that are still waiting for their grace period
+	bool hasPending() const { return !m_retired.empty(); }
+
+protected:
+	struct Retired {
+		/// The epoch in which the object has been retired. Only readers that have entered in this epoch (or
+		/// before) may still be using it.
+		std::uint64_t epoch;
+		std::function< void() > destroy;
+	};
+
+	/// The current epoch. Starts at 1 as 0 marks readers that aren't reading.
+	std::atomic< std::uint64_t > m_epoch{ 1 };
+	std::vector< Reader * > m_readers;
+	/// The retired objects in the order they have been retired (and thus sorted by epoch)
+	std::vector< Retired > m_retired;
+};
+
+#endif // MUMBLE_EPOCHRECLAIMER_H_
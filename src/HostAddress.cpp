@@ -24,8 +24,13 @@
 #include <cstdint>
 #include <utility>
 
+HostAddress::HostAddress() {
+	reset();
+}
+
 HostAddress::HostAddress(const Q_IPV6ADDR &address) {
 	memcpy(m_byteRepresentation.data(), address.c, m_byteRepresentation.size());
+	updateHash();
 }
 
 HostAddress::HostAddress(const std::string &address) {
@@ -37,6 +42,7 @@ HostAddress::HostAddress(const std::string &address) {
 			m_byteRepresentation[i] = static_cast< unsigned char >(address[i]);
 		}
 	}
+	updateHash();
 }
 
 HostAddress::HostAddress(const QByteArray &address) {
@@ -48,6 +54,7 @@ HostAddress::HostAddress(const QByteArray &address) {
 			m_byteRepresentation[i] = static_cast< unsigned char >(address[i]);
 		}
 	}
+	updateHash();
 }
 
 HostAddress::HostAddress(const QHostAddress &address) {
@@ -66,8 +73,9 @@ HostAddress::HostAddress(const sockaddr_storage &address) {
 	} else if (address.ss_family == AF_INET6) {
 		const struct sockaddr_in6 *in6 = reinterpret_cast< const struct sockaddr_in6 * >(&address);
 		memcpy(m_byteRepresentation.data(), in6->sin6_addr.s6_addr, m_byteRepresentation.size());
+		updateHash();
 	} else {
-		m_byteRepresentation.fill(0);
+		reset();
 	}
 }
 
@@ -85,14 +93,39 @@ void HostAddress::fromIPv4(std::uint32_t address, bool convertToNetworkOrder) {
 	}
 
 	memcpy(&m_byteRepresentation[12], &address, sizeof(std::uint32_t));
+	updateHash();
 }
 
-bool HostAddress::operator<(const HostAddress &other) const {
-	return m_byteRepresentation < other.m_byteRepresentation;
+PeerKey::PeerKey() : port(0) {
+	address.fill(0);
 }
 
-bool HostAddress::operator==(const HostAddress &other) const {
-	return m_byteRepresentation == other.m_byteRepresentation;
+PeerKey::PeerKey(const HostAddress &address, std::uint16_t port)
+	: address(address.getByteRepresentation()), port(port) {
+}
+
+PeerKey::PeerKey(const sockaddr_storage &address) {
+	// Build the representation directly instead of going through HostAddress as this happens for
+	// every single UDP packet
+	if (address.ss_family == AF_INET) {
+		const struct sockaddr_in *in = reinterpret_cast< const struct sockaddr_in * >(&address);
+		this->address.fill(0);
+		this->address[10] = 0xFF;
+		this->address[11] = 0xFF;
+		memcpy(&this->address[12], &in->sin_addr.s_addr, sizeof(std::uint32_t));
+		port = in->sin_port;
+	} else if (address.ss_family == AF_INET6) {
+		const struct sockaddr_in6 *in6 = reinterpret_cast< const struct sockaddr_in6 * >(&address);
+		memcpy(this->address.data(), in6->sin6_addr.s6_addr, this->address.size());
+		port = in6->sin6_port;
+	} else {
+		this->address.fill(0);
+		port = 0;
+	}
+}
+
+bool HostAddress::operator<(const HostAddress &other) const {
+	return m_byteRepresentation < other.m_byteRepresentation;
 }
 
 bool HostAddress::match(const HostAddress &netmask, unsigned int bits) const {
@@ -160,7 +193,9 @@ void HostAddress::toSockaddr(sockaddr_storage *dst) const {
 
 std::uint32_t HostAddress::toIPv4() const {
 	// The IPv4 address is stored in the last four bytes (in network byte order)
-	return *(reinterpret_cast< const std::uint32_t * >(m_byteRepresentation[12]));
+	std::uint32_t address;
+	memcpy(&address, &m_byteRepresentation[12], sizeof(address));
+	return address;
 }
 
 const std::array< std::uint8_t, 16 > &HostAddress::getByteRepresentation() const {
@@ -169,15 +204,13 @@ const std::array< std::uint8_t, 16 > &HostAddress::getByteRepresentation() const
 
 void HostAddress::reset() {
 	m_byteRepresentation.fill(0);
+	updateHash();
 }
 
 void HostAddress::setByte(std::size_t idx, std::uint8_t value) {
 	assert(idx < m_byteRepresentation.size());
 	m_byteRepresentation[idx] = value;
-}
-
-quint32 qHash(const HostAddress &ha) {
-	return qHashRange(ha.m_byteRepresentation.begin(), ha.m_byteRepresentation.end());
+	updateHash();
 }
 
 QString HostAddress::toString(bool bracketEnclosed) const {
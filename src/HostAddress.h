@@ -12,10 +12,18 @@
 #include <Q_IPV6ADDR>
 
 #include <array>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
 
+/// An IPv4 or IPv6 address. IPv4 addresses are stored as IPv4-mapped IPv6 addresses.
+///
+/// The hash of the address is computed whenever the address changes, so that hashing (and rejecting unequal
+/// addresses in comparisons) doesn't have to look at the bytes again. This happens for every UDP packet.
 struct HostAddress {
-	HostAddress() = default;
+	HostAddress();
 	HostAddress(const Q_IPV6ADDR &);
 	HostAddress(const std::string &);
 	HostAddress(const QHostAddress &);
@@ -28,7 +36,12 @@ struct HostAddress {
 	bool isValid() const;
 
 	bool operator<(const HostAddress &) const;
-	bool operator==(const HostAddress &) const;
+	bool operator==(const HostAddress &other) const {
+		// All IPv4-mapped addresses share the upper half, so the lower half (holding the IPv4 address) is the one
+		// that tells them apart
+		return m_hash == other.m_hash && word(1) == other.word(1) && word(0) == other.word(0);
+	}
+	bool operator!=(const HostAddress &other) const { return !(*this == other); }
 
 	bool match(const HostAddress &, unsigned int bits) const;
 
@@ -46,13 +59,229 @@ struct HostAddress {
 
 	void setByte(std::size_t idx, std::uint8_t value);
 
-	friend quint32 qHash(const HostAddress &);
+	/// @returns The 64-bit hash of the address
+	std::uint64_t hash() const { return m_hash; }
+
+	friend quint32 qHash(const HostAddress &ha) { return static_cast< quint32 >(ha.m_hash ^ (ha.m_hash >> 32)); }
 
 private:
-	// Binary representation of an IPv6 address
-	std::array< std::uint8_t, 16 > m_byteRepresentation;
+	// Binary representation of an IPv6 address. The alignment lets both halves be loaded as single words.
+	alignas(std::uint64_t) std::array< std::uint8_t, 16 > m_byteRepresentation;
+	std::uint64_t m_hash;
+
+	/// @returns The upper (0) or lower (1) half of the address
+	std::uint64_t word(std::size_t i) const {
+		std::uint64_t word;
+		memcpy(&word, m_byteRepresentation.data() + i * sizeof(word), sizeof(word));
+		return word;
+	}
+
+	/// Recomputes m_hash, which has to happen after every change of m_byteRepresentation
+	void updateHash() {
+		std::uint64_t mixed = (word(0) * 0x9E3779B97F4A7C15ULL) ^ word(1);
+		mixed ^= mixed >> 29;
+		mixed *= 0xBF58476D1CE4E5B9ULL;
+		mixed ^= mixed >> 32;
+
+		m_hash = mixed;
+	}
 };
 
 Q_DECLARE_TYPEINFO(HostAddress, Q_MOVABLE_TYPE);
 
+/// Identifies a UDP peer by its address (in the same representation HostAddress uses) and its port
+struct PeerKey {
+	std::array< std::uint8_t, 16 > address;
+	/// The port in network byte order
+	std::uint16_t port;
+
+	PeerKey();
+	PeerKey(const HostAddress &address, std::uint16_t port);
+	explicit PeerKey(const struct sockaddr_storage &address);
+
+	bool operator==(const PeerKey &other) const {
+		return port == other.port && address == other.address;
+	}
+
+	std::size_t hash() const {
+		std::uint64_t high;
+		std::uint64_t low;
+		memcpy(&high, address.data(), sizeof(high));
+		memcpy(&low, address.data() + sizeof(high), sizeof(low));
+
+		std::uint64_t mixed = (high * 0x9E3779B97F4A7C15ULL) ^ low ^ (static_cast< std::uint64_t >(port) << 48);
+		mixed ^= mixed >> 29;
+		mixed *= 0xBF58476D1CE4E5B9ULL;
+		mixed ^= mixed >> 32;
+
+		return static_cast< std::size_t >(mixed);
+	}
+};
+
+/// A map from UDP peers to values (usually pointers) that is optimized for lookups.
+///
+/// The entries live in a flat, open-addressed array (with linear probing). Inserting and removing peers
+/// modifies that array in place: a slot's key is written before the slot is marked as used and is never
+/// changed afterwards, removed peers only leave a tombstone behind and values are stored atomically.
+/// Thus lookup() neither takes a lock nor can it ever observe a half-written entry. Only once the used
+/// slots (including tombstones) would exceed half of the array, a larger table is built and published
+/// atomically, so that modifications take amortized constant time.
+///
+/// T has to be usable with std::atomic (e.g. a pointer). Modifications have to be serialized by the
+/// caller. Tables that have been replaced are only freed by reclaim(), which must only be called at a
+/// point where no lookup can still be using them (e.g. while holding a lock that excludes all threads
+/// doing lookups).
+template< typename T > class PeerTable {
+public:
+	PeerTable() : m_current(nullptr), m_count(0) {}
+	~PeerTable() { delete m_current.load(std::memory_order_relaxed); }
+
+	PeerTable(const PeerTable &) = delete;
+	PeerTable &operator=(const PeerTable &) = delete;
+
+	/// @returns The value stored for the given peer or a value-initialized T if there is none
+	T lookup(const PeerKey &key) const {
+		const Snapshot *snapshot = m_current.load(std::memory_order_acquire);
+		if (!snapshot) {
+			return T();
+		}
+
+		const Entry *entry = snapshot->find(key);
+		if (!entry || entry->state.load(std::memory_order_acquire) != State::Live) {
+			return T();
+		}
+
+		return entry->value.load(std::memory_order_acquire);
+	}
+
+	/// Inserts the given value for the given peer, replacing any value that was stored for it before
+	void insert(const PeerKey &key, T value) {
+		Snapshot *current = m_current.load(std::memory_order_relaxed);
+
+		if (current) {
+			Entry *entry = current->find(key);
+			if (entry) {
+				// The peer (or its tombstone) already has a slot that can simply be reused
+				entry->value.store(value, std::memory_order_release);
+				if (entry->state.exchange(State::Live, std::memory_order_acq_rel) != State::Live) {
+					m_count.fetch_add(1, std::memory_order_relaxed);
+				}
+				return;
+			}
+		}
+
+		if (!current || 2 * (current->occupied + 1) > current->capacity) {
+			current = rebuild(current);
+		}
+
+		current->add(key, value);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Removes the given peer (if it is contained in the table)
+	void remove(const PeerKey &key) {
+		Snapshot *current = m_current.load(std::memory_order_relaxed);
+		if (!current) {
+			return;
+		}
+
+		// Removing entries from a table with linear probing would require moving the following entries
+		// around, which concurrent lookups could miss. Leave a tombstone instead, which is dropped the
+		// next time the table is rebuilt.
+		Entry *entry = current->find(key);
+		if (entry && entry->state.exchange(State::Removed, std::memory_order_acq_rel) == State::Live) {
+			entry->value.store(T(), std::memory_order_release);
+			m_count.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	std::size_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+	/// Frees all tables that have been replaced since the last call. No lookup that started before
+	/// the last modification may still be running.
+	void reclaim() { m_retired.clear(); }
+
+protected:
+	enum class State : std::uint8_t { Empty, Live, Removed };
+
+	struct Entry {
+		/// Written before state leaves Empty and never changed afterwards
+		PeerKey key;
+		std::atomic< T > value{ T() };
+		std::atomic< State > state{ State::Empty };
+	};
+
+	struct Snapshot {
+		std::unique_ptr< Entry[] > entries;
+		std::size_t capacity = 0;
+		std::size_t mask     = 0;
+		/// The number of slots that aren't empty (including tombstones). Only accessed by modifications.
+		std::size_t occupied = 0;
+
+		explicit Snapshot(std::size_t capacity)
+			: entries(new Entry[capacity]), capacity(capacity), mask(capacity - 1) {}
+
+		/// @returns The slot of the given key (which may be a tombstone) or nullptr if there is none
+		Entry *find(const PeerKey &key) const {
+			// The table is never full, so this always terminates
+			for (std::size_t i = key.hash() & mask;; i = (i + 1) & mask) {
+				Entry &entry = entries[i];
+				if (entry.state.load(std::memory_order_acquire) == State::Empty) {
+					return nullptr;
+				}
+				if (entry.key == key) {
+					return &entry;
+				}
+			}
+		}
+
+		/// Adds a key that isn't contained yet
+		void add(const PeerKey &key, T value) {
+			std::size_t i = key.hash() & mask;
+			while (entries[i].state.load(std::memory_order_relaxed) != State::Empty) {
+				i = (i + 1) & mask;
+			}
+
+			entries[i].key = key;
+			entries[i].value.store(value, std::memory_order_relaxed);
+			entries[i].state.store(State::Live, std::memory_order_release);
+			++occupied;
+		}
+	};
+
+	std::atomic< Snapshot * > m_current;
+	std::atomic< std::size_t > m_count;
+	std::vector< std::unique_ptr< Snapshot > > m_retired;
+
+	/// Publishes a new table that contains the live entries of the given one and has room for one more
+	/// entry. @returns The new table
+	Snapshot *rebuild(const Snapshot *current) {
+		// Keep the load factor at or below 50% so that probe sequences stay short. Sizing the new table
+		// for twice the live entries leaves room for as many modifications until the next rebuild.
+		const std::size_t count = m_count.load(std::memory_order_relaxed) + 1;
+		std::size_t capacity    = 16;
+		while (capacity < 4 * count) {
+			capacity *= 2;
+		}
+
+		std::unique_ptr< Snapshot > snapshot(new Snapshot(capacity));
+		if (current) {
+			for (std::size_t i = 0; i < current->capacity; ++i) {
+				const Entry &entry = current->entries[i];
+				if (entry.state.load(std::memory_order_relaxed) == State::Live) {
+					snapshot->add(entry.key, entry.value.load(std::memory_order_relaxed));
+				}
+			}
+		}
+
+		Snapshot *published = snapshot.release();
+		Snapshot *previous  = m_current.exchange(published, std::memory_order_acq_rel);
+		if (previous) {
+			m_retired.emplace_back(previous);
+		}
+
+		return published;
+	}
+};
+
 #endif
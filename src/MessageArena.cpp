@@ -0,0 +1,21 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "MessageArena.h"
+
+MessageArena::Scope::~Scope() {
+	if (--m_arena.m_depth == 0) {
+		// Frees all blocks but the initial one
+		m_arena.m_arena->Reset();
+	}
+}
+
+MessageArena::MessageArena(std::size_t blockSize) : m_block(new char[blockSize]), m_depth(0) {
+	google::protobuf::ArenaOptions options;
+	options.initial_block      = m_block.get();
+	options.initial_block_size = blockSize;
+
+	m_arena = std::make_unique< google::protobuf::Arena >(options);
+}
@@ -0,0 +1,53 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MESSAGEARENA_H_
+#define MUMBLE_MESSAGEARENA_H_
+
+#include <google/protobuf/arena.h>
+
+#include <cstddef>
+#include <memory>
+
+/// A protobuf arena that received messages are parsed into. It is reused for every message and owns an initial block
+/// that is kept when the arena is reset, so parsing a message (including its strings and repeated fields) doesn't
+/// allocate any memory as long as the message fits into that block.
+///
+/// Messages have to be created within a Scope. They stay valid until the outermost scope has been left, which allows
+/// handlers to (indirectly) process further messages while they are still using their own one.
+class MessageArena {
+public:
+	class Scope {
+	public:
+		explicit Scope(MessageArena &arena) : m_arena(arena) { ++m_arena.m_depth; }
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	protected:
+		MessageArena &m_arena;
+	};
+
+	/// @param blockSize The size of the block that is kept across messages
+	explicit MessageArena(std::size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+	MessageArena(const MessageArena &) = delete;
+	MessageArena &operator=(const MessageArena &) = delete;
+
+	/// @returns A new, empty message in the arena, which must only be used while the current Scope exists
+	template< typename T > T *create() { return google::protobuf::Arena::CreateMessage< T >(m_arena.get()); }
+
+	/// Large enough for everything but the rare messages carrying textures, comments or descriptions
+	static constexpr std::size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+protected:
+	std::unique_ptr< char[] > m_block;
+	std::unique_ptr< google::protobuf::Arena > m_arena;
+	/// The number of scopes that currently exist
+	int m_depth;
+};
+
+#endif // MUMBLE_MESSAGEARENA_H_
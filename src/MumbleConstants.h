@@ -13,6 +13,10 @@ namespace Plugins {
 		constexpr int MAX_DATA_LENGTH    = 1000;
 		constexpr int MAX_DATA_ID_LENGTH = 100;
 
+		// The number of messages a PluginDataBatch may contain and their combined size (uncompressed, in bytes)
+		constexpr int MAX_BATCH_LENGTH = 64;
+		constexpr int MAX_BATCH_SIZE   = 256 * 1024;
+
 	} // namespace PluginMessage
 } // namespace Plugins
 } // namespace Mumble
@@ -5,6 +5,7 @@
 
 #include "MumbleProtocol.h"
 #include "PacketDataStream.h"
+#include "Varint.h"
 #include "VolumeAdjustment.h"
 
 #include <QtEndian>
@@ -74,7 +75,10 @@ namespace Protocol {
 	template< Role role >
 	UDPAudioEncoder< role >::UDPAudioEncoder(Version::full_t protocolVersion)
 		: ProtocolHandler< role >(protocolVersion) {
-		m_byteBuffer.resize(MAX_UDP_PACKET_SIZE);
+		for (PacketEncoding &encoding : m_encodings) {
+			encoding.buffer.resize(MAX_UDP_PACKET_SIZE);
+			encoding.positionalBuffer.resize(MAX_UDP_PACKET_SIZE);
+		}
 
 		preparePreEncodedSnippets();
 	}
@@ -86,36 +90,46 @@ namespace Protocol {
 	}
 
 	template< Role role > void UDPAudioEncoder< role >::prepareAudioPacket(const AudioData &data) {
-		if (this->getProtocolVersion() < PROTOBUF_INTRODUCTION_VERSION) {
-			return prepareAudioPacket_legacy(data);
-		} else {
-			return prepareAudioPacket_protobuf(data);
+		// The actual encoding happens once a packet in the respective format is requested (see getEncoding)
+		m_preparedData                        = data;
+		m_preparedData.containsPositionalData = false;
+
+		for (PacketEncoding &encoding : m_encodings) {
+			encoding.prepared   = false;
+			encoding.positional = false;
 		}
 	}
 
 	template< Role role > gsl::span< const byte > UDPAudioEncoder< role >::updateAudioPacket(const AudioData &data) {
-		if (this->getProtocolVersion() < PROTOBUF_INTRODUCTION_VERSION) {
-			return updateAudioPacket_legacy(data);
-		} else {
-			return updateAudioPacket_protobuf(data);
+		switch (getPacketFormat(this->getProtocolVersion())) {
+			case PacketFormat::Legacy:
+				return updateAudioPacket< PacketFormat::Legacy >(data);
+			case PacketFormat::Protobuf:
+				return updateAudioPacket< PacketFormat::Protobuf >(data);
 		}
+
+		qWarning("MumbleProtocol: Reached theoretically unreachable code");
+		return {};
 	}
 
 	template< Role role > void UDPAudioEncoder< role >::addPositionalData(const AudioData &data) {
-		if (this->getProtocolVersion() < PROTOBUF_INTRODUCTION_VERSION) {
-			addPositionalData_legacy(data);
-		} else {
-			addPositionalData_protobuf(data);
+		m_preparedData.containsPositionalData = data.containsPositionalData;
+		m_preparedData.position               = data.position;
+
+		// Positional data is (re-)added to either encoding once it is requested
+		for (PacketEncoding &encoding : m_encodings) {
+			encoding.positional = false;
 		}
 	}
 
 	template< Role role > void UDPAudioEncoder< role >::dropPositionalData() {
-		// Pretend the positional data wasn't there
-		m_positionalAudioSize = m_staticPartSize;
+		// The buffers without positional data are used from now on (until positional data is added again)
+		m_preparedData.containsPositionalData = false;
 	}
 
-	template< Role role > void UDPAudioEncoder< role >::prepareAudioPacket_legacy(const AudioData &data) {
-		m_byteBuffer.resize(MAX_UDP_PACKET_SIZE);
+	template< Role role >
+	void UDPAudioEncoder< role >::prepareAudioPacket_legacy(PacketEncoding &encoding, const AudioData &data) {
+		encoding.buffer.resize(MAX_UDP_PACKET_SIZE);
 
 		byte type = 0;
 		switch (data.usedCodec) {
@@ -137,9 +151,9 @@ namespace Protocol {
 		assert(type < (1 << 3));
 		type = static_cast< decltype(type) >(type << 5);
 
-		m_byteBuffer[0] = type;
+		encoding.buffer[0] = type;
 
-		PacketDataStream stream(m_byteBuffer.data() + 1, static_cast< unsigned int >(m_byteBuffer.size() - 1));
+		PacketDataStream stream(encoding.buffer.data() + 1, static_cast< unsigned int >(encoding.buffer.size() - 1));
 
 		if (this->getRole() == Role::Server) {
 			stream << data.senderSession;
@@ -170,19 +184,22 @@ namespace Protocol {
 		}
 
 		// +1 since the stream doesn't know about the flags header byte
-		m_staticPartSize = stream.size() + 1;
+		encoding.staticPartSize = stream.size() + 1;
 
 		if (!stream.isValid()) {
 			qWarning("MumbleProtocol: Encoding legacy packet (fixed part) overflowed buffer size");
-			m_staticPartSize = 0;
+			encoding.staticPartSize = 0;
 		}
 
-		m_positionalAudioSize = m_staticPartSize;
+		encoding.positionalAudioSize = encoding.staticPartSize;
 	}
 
 	template< Role role >
-	gsl::span< const byte > UDPAudioEncoder< role >::updateAudioPacket_legacy(const AudioData &data) {
-		m_byteBuffer.resize(MAX_UDP_PACKET_SIZE);
+	gsl::span< const byte > UDPAudioEncoder< role >::updateAudioPacket_legacy(PacketEncoding &encoding,
+																			  const AudioData &data) {
+		const bool positional       = data.containsPositionalData && m_preparedData.containsPositionalData;
+		std::vector< byte > &buffer = positional ? encoding.positionalBuffer : encoding.buffer;
+		buffer.resize(MAX_UDP_PACKET_SIZE);
 
 		// The 5 least significant bits are where the target is supposed to be encoded
 		if (data.targetOrContext >= (1 << 5)) {
@@ -191,19 +208,26 @@ namespace Protocol {
 		}
 		// Re-assemble the header byte by overtaking the 3 most significant bits encoding the audio/packet type
 		// and combine that with the target.
-		m_byteBuffer[0] = static_cast< byte >(data.targetOrContext) | (m_byteBuffer[0] & 0xe0);
+		buffer[0] = static_cast< byte >(data.targetOrContext) | (buffer[0] & 0xe0);
 
-		std::size_t packetSize = data.containsPositionalData ? m_positionalAudioSize : m_staticPartSize;
+		std::size_t packetSize = positional ? encoding.positionalAudioSize : encoding.staticPartSize;
 
-		return gsl::span< byte >(m_byteBuffer.data(), packetSize);
+		return gsl::span< byte >(buffer.data(), packetSize);
 	}
 
 
-	template< Role role > void UDPAudioEncoder< role >::addPositionalData_legacy(const AudioData &data) {
+	template< Role role >
+	void UDPAudioEncoder< role >::addPositionalData_legacy(PacketEncoding &encoding, const AudioData &data) {
 		if (data.containsPositionalData) {
-			assert(m_byteBuffer.size() >= m_staticPartSize);
-			PacketDataStream stream(m_byteBuffer.data() + m_staticPartSize,
-									static_cast< unsigned int >(m_byteBuffer.size() - m_staticPartSize));
+			// The positional data goes behind a copy of the static part, which leaves the packet without positional
+			// data intact
+			encoding.positionalBuffer.resize(MAX_UDP_PACKET_SIZE);
+			assert(encoding.buffer.size() >= encoding.staticPartSize);
+			std::memcpy(encoding.positionalBuffer.data(), encoding.buffer.data(), encoding.staticPartSize);
+
+			PacketDataStream stream(
+				encoding.positionalBuffer.data() + encoding.staticPartSize,
+				static_cast< unsigned int >(encoding.positionalBuffer.size() - encoding.staticPartSize));
 
 			// Positional data simply gets attached to the stream after the audio payload
 			assert(data.position.size() == 3);
@@ -211,20 +235,21 @@ namespace Protocol {
 			stream << data.position[1];
 			stream << data.position[2];
 
-			m_positionalAudioSize = stream.size() + m_staticPartSize;
+			encoding.positionalAudioSize = stream.size() + encoding.staticPartSize;
 
 			if (!stream.isValid()) {
 				qWarning("MumbleProtocol: Adding positional data to legacy packet overflowed buffer size");
-				m_positionalAudioSize = m_staticPartSize;
+				encoding.positionalAudioSize = encoding.staticPartSize;
 			}
 		}
 	}
 
-	template< Role role > void UDPAudioEncoder< role >::prepareAudioPacket_protobuf(const AudioData &data) {
+	template< Role role >
+	void UDPAudioEncoder< role >::prepareAudioPacket_protobuf(PacketEncoding &encoding, const AudioData &data) {
 		// At the moment only Opus is supported in the newer Protobuf UDP protocol
 		// if the encoding is different, we automatically fall back to the legacy package format.
 		if (data.usedCodec != AudioCodec::Opus) {
-			prepareAudioPacket_legacy(data);
+			prepareAudioPacket_legacy(encoding, data);
 		}
 
 		// Note that we are partitioning the audio packet into two segments: a "fixed" part and a "variable" part.
@@ -241,13 +266,17 @@ namespace Protocol {
 		}
 
 		m_audioMessage.set_frame_number(data.frameNumber);
+		if (data.frameSize != 0) {
+			m_audioMessage.set_frame_size(data.frameSize);
+		}
 		m_audioMessage.set_opus_data(data.payload.data(), data.payload.size());
 		m_audioMessage.set_is_terminator(data.isLastFrame);
 
 		// +1 to account for the header byte set below
-		m_staticPartSize      = encodeProtobuf(m_audioMessage, m_byteBuffer, 1, MAX_UDP_PACKET_SIZE, false) + 1;
-		m_positionalAudioSize = m_staticPartSize;
-		m_byteBuffer[0]       = static_cast< byte >(UDPMessageType::Audio);
+		encoding.staticPartSize =
+			encodeProtobuf(m_audioMessage, encoding.buffer, 1, MAX_UDP_PACKET_SIZE, false) + 1;
+		encoding.positionalAudioSize = encoding.staticPartSize;
+		encoding.buffer[0]           = static_cast< byte >(UDPMessageType::Audio);
 	}
 
 	std::size_t writeSnippet(gsl::span< const byte > source, std::vector< byte > &destination, std::size_t offset,
@@ -265,9 +294,23 @@ namespace Protocol {
 		return source.size();
 	}
 
+	/// @returns Whether the given data has a redundant payload that fits into the packet after the given offset (which
+	/// is simply left out otherwise, as it is optional)
+	bool fitsRedundantPayload(const AudioData &data, std::size_t offset) {
+		// The field takes up to 2 bytes for its tag and another 2 bytes for its length (plus some room for the rest
+		// of the variable part)
+		constexpr std::size_t FIELD_OVERHEAD = 16;
+
+		return !data.redundantPayload.empty()
+			   && offset + data.redundantPayload.size() + FIELD_OVERHEAD <= MAX_UDP_PACKET_SIZE;
+	}
+
 	template< Role role >
-	gsl::span< const byte > UDPAudioEncoder< role >::updateAudioPacket_protobuf(const AudioData &data) {
-		std::size_t offset = data.containsPositionalData ? m_positionalAudioSize : m_staticPartSize;
+	gsl::span< const byte > UDPAudioEncoder< role >::updateAudioPacket_protobuf(PacketEncoding &encoding,
+																				const AudioData &data) {
+		const bool positional       = data.containsPositionalData && m_preparedData.containsPositionalData;
+		std::vector< byte > &buffer = positional ? encoding.positionalBuffer : encoding.buffer;
+		std::size_t offset          = positional ? encoding.positionalAudioSize : encoding.staticPartSize;
 
 		// We assume that something was encoded before
 		if (offset == 0) {
@@ -279,39 +322,49 @@ namespace Protocol {
 			case Role::Client: {
 				m_audioMessage.Clear();
 				m_audioMessage.set_target(data.targetOrContext);
+				if (fitsRedundantPayload(data, offset)) {
+					m_audioMessage.set_redundant_opus_data(data.redundantPayload.data(), data.redundantPayload.size());
+				}
 
-				offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+				offset += encodeProtobuf(m_audioMessage, buffer, offset, MAX_UDP_PACKET_SIZE, false);
 
-				return { m_byteBuffer.data(), offset };
+				return { buffer.data(), offset };
 			}
 			case Role::Server: {
 				if (data.volumeAdjustment.factor != 1.0f) {
-					gsl::span< const byte > buffer = getPreEncodedVolumeAdjustment(data.volumeAdjustment);
-					if (!buffer.empty()) {
+					gsl::span< const byte > snippet = getPreEncodedVolumeAdjustment(data.volumeAdjustment);
+					if (!snippet.empty()) {
 						// Use pre-encoded snippet
-						offset += writeSnippet(buffer, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE);
+						offset += writeSnippet(snippet, buffer, offset, MAX_UDP_PACKET_SIZE);
 					} else {
 						// No pre-encoded snippet found -> use explicit encoding
 						m_audioMessage.Clear();
 						m_audioMessage.set_volume_adjustment(data.volumeAdjustment.factor);
 
-						offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+						offset += encodeProtobuf(m_audioMessage, buffer, offset, MAX_UDP_PACKET_SIZE, false);
 					}
 				}
 
-				gsl::span< const byte > buffer = getPreEncodedContext(static_cast< byte >(data.targetOrContext));
-				if (!buffer.empty()) {
+				gsl::span< const byte > snippet = getPreEncodedContext(static_cast< byte >(data.targetOrContext));
+				if (!snippet.empty()) {
 					// Use pre-encoded snippet
-					offset += writeSnippet(buffer, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE);
+					offset += writeSnippet(snippet, buffer, offset, MAX_UDP_PACKET_SIZE);
 				} else {
 					// No pre-encoded snippet found -> use explicit encoding
 					m_audioMessage.Clear();
 					m_audioMessage.set_context(data.targetOrContext);
 
-					offset += encodeProtobuf(m_audioMessage, m_byteBuffer, offset, MAX_UDP_PACKET_SIZE, false);
+					offset += encodeProtobuf(m_audioMessage, buffer, offset, MAX_UDP_PACKET_SIZE, false);
+				}
+
+				if (fitsRedundantPayload(data, offset)) {
+					m_audioMessage.Clear();
+					m_audioMessage.set_redundant_opus_data(data.redundantPayload.data(), data.redundantPayload.size());
+
+					offset += encodeProtobuf(m_audioMessage, buffer, offset, MAX_UDP_PACKET_SIZE, false);
 				}
 
-				return { m_byteBuffer.data(), offset };
+				return { buffer.data(), offset };
 			}
 		}
 
@@ -320,7 +373,8 @@ namespace Protocol {
 	}
 
 
-	template< Role role > void UDPAudioEncoder< role >::addPositionalData_protobuf(const AudioData &data) {
+	template< Role role >
+	void UDPAudioEncoder< role >::addPositionalData_protobuf(PacketEncoding &encoding, const AudioData &data) {
 		if (data.containsPositionalData) {
 			m_audioMessage.Clear();
 
@@ -328,9 +382,14 @@ namespace Protocol {
 				m_audioMessage.add_positional_data(data.position[i]);
 			}
 
-			m_positionalAudioSize =
-				m_staticPartSize
-				+ encodeProtobuf(m_audioMessage, m_byteBuffer, m_staticPartSize, MAX_UDP_PACKET_SIZE, false);
+			// The positional data goes behind a copy of the static part, which leaves the packet without positional
+			// data intact
+			encoding.positionalBuffer.resize(encoding.staticPartSize);
+			std::memcpy(encoding.positionalBuffer.data(), encoding.buffer.data(), encoding.staticPartSize);
+
+			encoding.positionalAudioSize = encoding.staticPartSize
+										   + encodeProtobuf(m_audioMessage, encoding.positionalBuffer,
+															encoding.staticPartSize, MAX_UDP_PACKET_SIZE, false);
 		}
 	}
 
@@ -494,6 +553,10 @@ namespace Protocol {
 			m_pingMessage.set_user_count(data.userCount);
 			m_pingMessage.set_max_user_count(data.maxUserCount);
 			m_pingMessage.set_max_bandwidth_per_user(data.maxBandwidthPerUser);
+		} else {
+			m_pingMessage.set_packet_loss(data.packetLoss);
+			m_pingMessage.set_jitter(data.jitter);
+			m_pingMessage.set_bitrate_hint(data.bitrateHint);
 		}
 
 		// +1 in order to account for the header byte written below
@@ -698,6 +761,10 @@ namespace Protocol {
 			m_pingData.userCount           = m_pingMessage.user_count();
 			m_pingData.maxUserCount        = m_pingMessage.max_user_count();
 			m_pingData.maxBandwidthPerUser = m_pingMessage.max_bandwidth_per_user();
+		} else {
+			m_pingData.packetLoss  = m_pingMessage.packet_loss();
+			m_pingData.jitter      = m_pingMessage.jitter();
+			m_pingData.bitrateHint = m_pingMessage.bitrate_hint();
 		}
 
 		m_pingData.requestAdditionalInformation = m_pingMessage.request_extended_information();
@@ -755,7 +822,8 @@ namespace Protocol {
 						m_audioData.isLastFrame = true;
 					}
 
-					payloadSize += currentFrameSize;
+					// The payload includes the headers, just like it is appended when encoding the packet
+					payloadSize += 1 + currentFrameSize;
 
 					stream.skip(currentFrameSize);
 				} while ((header & 0x80) && stream.isValid());
@@ -800,10 +868,192 @@ namespace Protocol {
 		return true;
 	}
 
+	namespace {
+		bool readFloat(const byte *&pos, const byte *end, float &value) {
+			if (end - pos < static_cast< std::ptrdiff_t >(sizeof(float))) {
+				return false;
+			}
+
+			const std::uint32_t bits = qFromLittleEndian< quint32 >(pos);
+			std::memcpy(&value, &bits, sizeof(float));
+			pos += sizeof(float);
+
+			return true;
+		}
+	} // namespace
+
 	template< Role role > bool UDPDecoder< role >::decodeAudio_protobuf(const gsl::span< const byte > data) {
 		m_messageType = UDPMessageType::Audio;
 		m_audioData   = {};
 
+		switch (decodeAudio_protobufFast(data)) {
+			case WireDecodeResult::Decoded:
+				return true;
+			case WireDecodeResult::Invalid:
+				return false;
+			case WireDecodeResult::Unsupported:
+				// The packet contains something we don't know about (e.g. a field introduced by a newer version),
+				// which the generic parser will skip for us
+				m_audioData = {};
+				return decodeAudio_protobufGeneric(data);
+		}
+
+		return false;
+	}
+
+	template< Role role >
+	typename UDPDecoder< role >::WireDecodeResult
+		UDPDecoder< role >::decodeAudio_protobufFast(const gsl::span< const byte > data) {
+		// The wire format is documented at https://developers.google.com/protocol-buffers/docs/encoding
+		constexpr unsigned int VARINT  = 0;
+		constexpr unsigned int LENGTH  = 2;
+		constexpr unsigned int FIXED32 = 5;
+
+		const byte *pos = data.data();
+		const byte *end = data.data() + data.size();
+
+		std::uint64_t target           = 0;
+		std::uint64_t context          = 0;
+		std::uint64_t senderSession    = 0;
+		std::uint64_t frameNumber      = 0;
+		std::uint64_t frameSize        = 0;
+		std::uint64_t isTerminator     = 0;
+		float volumeAdjustment         = 0.0f;
+		unsigned int positionalEntries = 0;
+
+		while (pos != end) {
+			std::uint64_t tag = 0;
+			if (!Varint::Protobuf::decode(pos, end, tag)) {
+				return WireDecodeResult::Invalid;
+			}
+
+			const std::uint64_t field   = tag >> 3;
+			const unsigned int wireType = static_cast< unsigned int >(tag & 0x7);
+
+			switch (field) {
+				case 1:
+				case 2:
+				case 3:
+				case 4:
+				case 8:
+				case 16: {
+					if (wireType != VARINT) {
+						return WireDecodeResult::Unsupported;
+					}
+					std::uint64_t value = 0;
+					if (!Varint::Protobuf::decode(pos, end, value)) {
+						return WireDecodeResult::Invalid;
+					}
+
+					if (field == 1) {
+						// target and context are part of a oneof, so only the last one of them counts
+						target  = value;
+						context = 0;
+					} else if (field == 2) {
+						context = value;
+						target  = 0;
+					} else if (field == 3) {
+						senderSession = value;
+					} else if (field == 4) {
+						frameNumber = value;
+					} else if (field == 8) {
+						frameSize = value;
+					} else {
+						isTerminator = value;
+					}
+					break;
+				}
+				case 5:
+				case 17: {
+					if (wireType != LENGTH) {
+						return WireDecodeResult::Unsupported;
+					}
+					std::uint64_t length = 0;
+					if (!Varint::Protobuf::decode(pos, end, length)
+						|| length > static_cast< std::uint64_t >(end - pos)) {
+						return WireDecodeResult::Invalid;
+					}
+
+					// The payloads are used right where they are (in the given data)
+					const gsl::span< const byte > payload(pos, static_cast< std::size_t >(length));
+					if (field == 5) {
+						m_audioData.payload = payload;
+					} else {
+						m_audioData.redundantPayload = payload;
+					}
+					pos += static_cast< std::size_t >(length);
+					break;
+				}
+				case 6: {
+					if (wireType == FIXED32) {
+						if (positionalEntries == 3 || !readFloat(pos, end, m_audioData.position[positionalEntries])) {
+							return WireDecodeResult::Invalid;
+						}
+						positionalEntries++;
+					} else if (wireType == LENGTH) {
+						// Packed repeated floats
+						std::uint64_t length = 0;
+						if (!Varint::Protobuf::decode(pos, end, length)
+							|| length > static_cast< std::uint64_t >(end - pos) || length % sizeof(float) != 0) {
+							return WireDecodeResult::Invalid;
+						}
+						const byte *packedEnd = pos + static_cast< std::size_t >(length);
+						while (pos != packedEnd) {
+							if (positionalEntries == 3
+								|| !readFloat(pos, packedEnd, m_audioData.position[positionalEntries])) {
+								// We always expect a 3D position, if positional data is present
+								return WireDecodeResult::Invalid;
+							}
+							positionalEntries++;
+						}
+					} else {
+						return WireDecodeResult::Unsupported;
+					}
+					break;
+				}
+				case 7:
+					if (wireType != FIXED32) {
+						return WireDecodeResult::Unsupported;
+					}
+					if (!readFloat(pos, end, volumeAdjustment)) {
+						return WireDecodeResult::Invalid;
+					}
+					break;
+				default:
+					return WireDecodeResult::Unsupported;
+			}
+		}
+
+		if (m_audioData.payload.empty()) {
+			// Audio packets without audio data are invalid
+			return WireDecodeResult::Invalid;
+		}
+
+		if (positionalEntries != 0 && positionalEntries != 3) {
+			return WireDecodeResult::Invalid;
+		}
+
+		// uint32 fields are truncated just like the generic parser does it
+		m_audioData.targetOrContext =
+			static_cast< std::uint32_t >(this->getRole() == Role::Client ? context : target);
+		// Atm the only codec supported by the new package format is Opus
+		m_audioData.usedCodec              = AudioCodec::Opus;
+		m_audioData.senderSession          = static_cast< std::uint32_t >(senderSession);
+		m_audioData.frameNumber            = frameNumber;
+		m_audioData.frameSize              = static_cast< std::uint32_t >(frameSize);
+		m_audioData.isLastFrame            = isTerminator != 0;
+		m_audioData.containsPositionalData = positionalEntries == 3;
+
+		m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(volumeAdjustment);
+		if (m_audioData.volumeAdjustment.factor == 0.0f) {
+			// No volume adjustment was set, reset to default
+			m_audioData.volumeAdjustment = VolumeAdjustment::fromFactor(1.0f);
+		}
+
+		return WireDecodeResult::Decoded;
+	}
+
+	template< Role role > bool UDPDecoder< role >::decodeAudio_protobufGeneric(const gsl::span< const byte > data) {
 		if (!m_audioMessage.ParseFromArray(data.data(), static_cast< int >(data.size()))) {
 			// Invalid format
 			return false;
@@ -815,6 +1065,7 @@ namespace Protocol {
 		m_audioData.usedCodec     = AudioCodec::Opus;
 		m_audioData.senderSession = m_audioMessage.sender_session();
 		m_audioData.frameNumber   = m_audioMessage.frame_number();
+		m_audioData.frameSize     = m_audioMessage.frame_size();
 		if (m_audioMessage.opus_data().empty()) {
 			// Audio packets without audio data are invalid
 			return false;
@@ -825,6 +1076,12 @@ namespace Protocol {
 
 		m_audioData.isLastFrame = m_audioMessage.is_terminator();
 
+		if (!m_audioMessage.redundant_opus_data().empty()) {
+			std::string &redundantPayload = *m_audioMessage.mutable_redundant_opus_data();
+			m_audioData.redundantPayload =
+				gsl::span< byte >(reinterpret_cast< byte * >(&redundantPayload[0]), redundantPayload.size());
+		}
+
 		if (m_audioMessage.positional_data_size() != 0) {
 			if (m_audioMessage.positional_data_size() != 3) {
 				// We always expect a 3D position, if positional data is present
@@ -851,10 +1108,14 @@ namespace Protocol {
 		if (lhs.isLastFrame == rhs.isLastFrame && lhs.containsPositionalData == rhs.containsPositionalData
 			&& lhs.targetOrContext == rhs.targetOrContext && lhs.usedCodec == rhs.usedCodec
 			&& lhs.senderSession == rhs.senderSession && lhs.frameNumber == rhs.frameNumber
+			&& lhs.frameSize == rhs.frameSize
 			&& lhs.payload.size() == rhs.payload.size() && (!lhs.containsPositionalData || lhs.position == rhs.position)
-			&& lhs.volumeAdjustment == rhs.volumeAdjustment) {
+			&& lhs.volumeAdjustment == rhs.volumeAdjustment
+			&& lhs.redundantPayload.size() == rhs.redundantPayload.size()) {
 			// Compare payload
-			return std::memcmp(lhs.payload.data(), rhs.payload.data(), lhs.payload.size()) == 0;
+			return std::memcmp(lhs.payload.data(), rhs.payload.data(), lhs.payload.size()) == 0
+				   && std::memcmp(lhs.redundantPayload.data(), rhs.redundantPayload.data(), lhs.redundantPayload.size())
+						  == 0;
 		} else {
 			return false;
 		}
@@ -866,7 +1127,8 @@ namespace Protocol {
 		return lhs.timestamp == rhs.timestamp && lhs.requestAdditionalInformation == rhs.requestAdditionalInformation
 			   && lhs.containsAdditionalInformation == rhs.containsAdditionalInformation
 			   && lhs.serverVersion == rhs.serverVersion && lhs.userCount == rhs.userCount
-			   && lhs.maxUserCount == rhs.maxUserCount && lhs.maxBandwidthPerUser == rhs.maxBandwidthPerUser;
+			   && lhs.maxUserCount == rhs.maxUserCount && lhs.maxBandwidthPerUser == rhs.maxBandwidthPerUser
+			   && lhs.packetLoss == rhs.packetLoss && lhs.jitter == rhs.jitter && lhs.bitrateHint == rhs.bitrateHint;
 	}
 
 	bool operator!=(const PingData &lhs, const PingData &rhs) { return !(lhs == rhs); }
@@ -10,7 +10,9 @@
 #include "Version.h"
 #include "VolumeAdjustment.h"
 
+#include <array>
 #include <cstdint>
+#include <type_traits>
 #include <vector>
 
 #include <gsl/span>
@@ -20,34 +22,37 @@
  *
  * Warning: Only append to the end. Never insert in between or remove an existing entry.
  */
-#define MUMBLE_ALL_TCP_MESSAGES                         \
-	PROCESS_MUMBLE_TCP_MESSAGE(Version, 0)              \
-	PROCESS_MUMBLE_TCP_MESSAGE(UDPTunnel, 1)            \
-	PROCESS_MUMBLE_TCP_MESSAGE(Authenticate, 2)         \
-	PROCESS_MUMBLE_TCP_MESSAGE(Ping, 3)                 \
-	PROCESS_MUMBLE_TCP_MESSAGE(Reject, 4)               \
-	PROCESS_MUMBLE_TCP_MESSAGE(ServerSync, 5)           \
-	PROCESS_MUMBLE_TCP_MESSAGE(ChannelRemove, 6)        \
-	PROCESS_MUMBLE_TCP_MESSAGE(ChannelState, 7)         \
-	PROCESS_MUMBLE_TCP_MESSAGE(UserRemove, 8)           \
-	PROCESS_MUMBLE_TCP_MESSAGE(UserState, 9)            \
-	PROCESS_MUMBLE_TCP_MESSAGE(BanList, 10)             \
-	PROCESS_MUMBLE_TCP_MESSAGE(TextMessage, 11)         \
-	PROCESS_MUMBLE_TCP_MESSAGE(PermissionDenied, 12)    \
-	PROCESS_MUMBLE_TCP_MESSAGE(ACL, 13)                 \
-	PROCESS_MUMBLE_TCP_MESSAGE(QueryUsers, 14)          \
-	PROCESS_MUMBLE_TCP_MESSAGE(CryptSetup, 15)          \
-	PROCESS_MUMBLE_TCP_MESSAGE(ContextActionModify, 16) \
-	PROCESS_MUMBLE_TCP_MESSAGE(ContextAction, 17)       \
-	PROCESS_MUMBLE_TCP_MESSAGE(UserList, 18)            \
-	PROCESS_MUMBLE_TCP_MESSAGE(VoiceTarget, 19)         \
-	PROCESS_MUMBLE_TCP_MESSAGE(PermissionQuery, 20)     \
-	PROCESS_MUMBLE_TCP_MESSAGE(CodecVersion, 21)        \
-	PROCESS_MUMBLE_TCP_MESSAGE(UserStats, 22)           \
-	PROCESS_MUMBLE_TCP_MESSAGE(RequestBlob, 23)         \
-	PROCESS_MUMBLE_TCP_MESSAGE(ServerConfig, 24)        \
-	PROCESS_MUMBLE_TCP_MESSAGE(SuggestConfig, 25)       \
-	PROCESS_MUMBLE_TCP_MESSAGE(PluginDataTransmission, 26)
+#define MUMBLE_ALL_TCP_MESSAGES                            \
+	PROCESS_MUMBLE_TCP_MESSAGE(Version, 0)                 \
+	PROCESS_MUMBLE_TCP_MESSAGE(UDPTunnel, 1)               \
+	PROCESS_MUMBLE_TCP_MESSAGE(Authenticate, 2)            \
+	PROCESS_MUMBLE_TCP_MESSAGE(Ping, 3)                    \
+	PROCESS_MUMBLE_TCP_MESSAGE(Reject, 4)                  \
+	PROCESS_MUMBLE_TCP_MESSAGE(ServerSync, 5)              \
+	PROCESS_MUMBLE_TCP_MESSAGE(ChannelRemove, 6)           \
+	PROCESS_MUMBLE_TCP_MESSAGE(ChannelState, 7)            \
+	PROCESS_MUMBLE_TCP_MESSAGE(UserRemove, 8)              \
+	PROCESS_MUMBLE_TCP_MESSAGE(UserState, 9)               \
+	PROCESS_MUMBLE_TCP_MESSAGE(BanList, 10)                \
+	PROCESS_MUMBLE_TCP_MESSAGE(TextMessage, 11)            \
+	PROCESS_MUMBLE_TCP_MESSAGE(PermissionDenied, 12)       \
+	PROCESS_MUMBLE_TCP_MESSAGE(ACL, 13)                    \
+	PROCESS_MUMBLE_TCP_MESSAGE(QueryUsers, 14)             \
+	PROCESS_MUMBLE_TCP_MESSAGE(CryptSetup, 15)             \
+	PROCESS_MUMBLE_TCP_MESSAGE(ContextActionModify, 16)    \
+	PROCESS_MUMBLE_TCP_MESSAGE(ContextAction, 17)          \
+	PROCESS_MUMBLE_TCP_MESSAGE(UserList, 18)               \
+	PROCESS_MUMBLE_TCP_MESSAGE(VoiceTarget, 19)            \
+	PROCESS_MUMBLE_TCP_MESSAGE(PermissionQuery, 20)        \
+	PROCESS_MUMBLE_TCP_MESSAGE(CodecVersion, 21)           \
+	PROCESS_MUMBLE_TCP_MESSAGE(UserStats, 22)              \
+	PROCESS_MUMBLE_TCP_MESSAGE(RequestBlob, 23)            \
+	PROCESS_MUMBLE_TCP_MESSAGE(ServerConfig, 24)           \
+	PROCESS_MUMBLE_TCP_MESSAGE(SuggestConfig, 25)          \
+	PROCESS_MUMBLE_TCP_MESSAGE(PluginDataTransmission, 26) \
+	PROCESS_MUMBLE_TCP_MESSAGE(StateSnapshot, 27)          \
+	PROCESS_MUMBLE_TCP_MESSAGE(PluginDataBatch, 28)        \
+	PROCESS_MUMBLE_TCP_MESSAGE(TextMessageHistory, 29)
 
 /**
  * "X-macro" for all Mumble Protobuf UDP messages types.
@@ -112,6 +117,16 @@ namespace Protocol {
 
 	bool protocolVersionsAreCompatible(Version::full_t lhs, Version::full_t rhs);
 
+	/**
+	 * The two generations of UDP packets: the legacy format and the Protobuf-based one that has been introduced with
+	 * PROTOBUF_INTRODUCTION_VERSION
+	 */
+	enum class PacketFormat { Legacy, Protobuf };
+
+	constexpr PacketFormat getPacketFormat(Version::full_t protocolVersion) {
+		return protocolVersion < PROTOBUF_INTRODUCTION_VERSION ? PacketFormat::Legacy : PacketFormat::Protobuf;
+	}
+
 
 	template< Role role > class ProtocolHandler {
 	public:
@@ -131,7 +146,13 @@ namespace Protocol {
 		AudioCodec usedCodec          = AudioCodec::Opus;
 		std::uint32_t senderSession   = 0;
 		std::uint64_t frameNumber     = 0;
+		/// The number of samples of the frames frameNumber counts in, or 0 for regular (10 ms) frames. It is only
+		/// supported by the Protobuf packet format.
+		std::uint32_t frameSize = 0;
 		gsl::span< const byte > payload;
+		/// The payload of the previous packet of the stream (if any), which is only supported by the Protobuf packet
+		/// format. It is part of the variable part of a packet, as it is only passed on to some receivers.
+		gsl::span< const byte > redundantPayload;
 		bool isLastFrame                  = false;
 		bool containsPositionalData       = false;
 		std::array< float, 3 > position   = { 0, 0, 0 };
@@ -149,6 +170,13 @@ namespace Protocol {
 		std::uint32_t userCount            = 0;
 		std::uint32_t maxUserCount         = 0;
 		std::uint32_t maxBandwidthPerUser  = 0;
+		/// The loss (in percent) and jitter (in milliseconds) of the client's link, as reported by the client in its
+		/// connectivity pings (protobuf format only)
+		std::uint32_t packetLoss = 0;
+		std::uint32_t jitter     = 0;
+		/// The bitrate (in bits per second) the server suggests to the client in its reply to a connectivity ping. 0
+		/// means that there is no suggestion.
+		std::uint32_t bitrateHint = 0;
 
 		friend bool operator==(const PingData &lhs, const PingData &rhs);
 		friend bool operator!=(const PingData &lhs, const PingData &rhs);
@@ -175,6 +203,9 @@ namespace Protocol {
 		 * Note: Calls to this function remove any previously encoded variable parts or positional audio
 		 * from the audio packet.
 		 *
+		 * The packet is prepared for both packet formats, so the protocol version may be changed freely until the
+		 * next call to this function. Either format is only encoded once a packet is requested in it.
+		 *
 		 * @param data The AudioData to encode (partially!)
 		 */
 		void prepareAudioPacket(const AudioData &data);
@@ -187,6 +218,16 @@ namespace Protocol {
 		 * @return A span to the encoded audio packet (including the static part and potentially positional data)
 		 */
 		gsl::span< const byte > updateAudioPacket(const AudioData &data);
+		/**
+		 * Same as updateAudioPacket, but for a packet format that is known at compile time (e.g. because the
+		 * receivers have already been grouped by it). The protocol version that is currently set doesn't matter.
+		 *
+		 * @param data The AudioData to encode (partially!)
+		 * @return A span to the encoded audio packet (including the static part and potentially positional data)
+		 */
+		template< PacketFormat format > gsl::span< const byte > updateAudioPacket(const AudioData &data) {
+			return update(FormatTag< format >(), getEncoding< format >(), data);
+		}
 		/**
 		 * This function assumes that an audio packet has already been prepared. In that case it will encode
 		 * the given positional data (if any) into the audio packet.
@@ -201,8 +242,9 @@ namespace Protocol {
 		 * This function assumes that an audio packet has already been prepared. In that case it will remove
 		 * positional data from the audio packet that was previously added using addPositionalData.
 		 *
-		 * Note: A call to this function invalidates any variable part that might have been added to the audio
-		 * packet before. Thus, another call to updateAudioPacket is required after calling this function.
+		 * Note: The packet is kept both with and without the positional data, so receivers that shouldn't get the
+		 * positional data can simply be sent packets updated with AudioData::containsPositionalData unset. This
+		 * function is only needed in order to get rid of the positional data for good.
 		 *
 		 */
 		void dropPositionalData();
@@ -211,20 +253,81 @@ namespace Protocol {
 		static constexpr const int preEncodedDBAdjustmentBegin = -60;
 		static constexpr const int preEncodedDBAdjustmentEnd   = 30 + 1;
 
-		std::vector< byte > m_byteBuffer;
-		std::size_t m_staticPartSize      = 0;
-		std::size_t m_positionalAudioSize = 0;
+		/// A packet encoded in one of the two packet formats. Both of them are kept around, so that the receivers of
+		/// a packet may alternate between the formats without the packet having to be prepared all over again.
+		///
+		/// The packet is kept twice: once with just the static part and once with the positional data appended to
+		/// it. Each of them gets its own variable part, so receivers with and without positional data may alternate
+		/// as well.
+		struct PacketEncoding {
+			std::vector< byte > buffer;
+			std::vector< byte > positionalBuffer;
+			/// The size of the static part, which is the same in both buffers
+			std::size_t staticPartSize = 0;
+			/// The size of the static part plus the positional data in positionalBuffer
+			std::size_t positionalAudioSize = 0;
+			/// Whether the static part of m_preparedData has been encoded
+			bool prepared = false;
+			/// Whether the positional data of m_preparedData has been encoded
+			bool positional = false;
+		};
+
+		template< PacketFormat format > using FormatTag = std::integral_constant< PacketFormat, format >;
+
+		/// The encodings, indexed by their PacketFormat
+		std::array< PacketEncoding, 2 > m_encodings;
+		/// The data given to prepareAudioPacket (and addPositionalData). Note that the payload has to stay valid until
+		/// a packet in either format has been requested for the last time.
+		AudioData m_preparedData;
 		MumbleUDP::Audio m_audioMessage;
 		std::vector< std::vector< byte > > m_preEncodedContext;
 		std::vector< std::vector< byte > > m_preEncodedVolumeAdjustment;
 
-		void prepareAudioPacket_legacy(const AudioData &data);
-		gsl::span< const byte > updateAudioPacket_legacy(const AudioData &data);
-		void addPositionalData_legacy(const AudioData &data);
-
-		void prepareAudioPacket_protobuf(const AudioData &data);
-		gsl::span< const byte > updateAudioPacket_protobuf(const AudioData &data);
-		void addPositionalData_protobuf(const AudioData &data);
+		/// @returns The encoding in the given format, which is prepared first if necessary
+		template< PacketFormat format > PacketEncoding &getEncoding() {
+			PacketEncoding &encoding = m_encodings[static_cast< std::size_t >(format)];
+
+			if (!encoding.prepared) {
+				prepare(FormatTag< format >(), encoding);
+				encoding.prepared = true;
+			}
+
+			if (m_preparedData.containsPositionalData && !encoding.positional) {
+				addPositional(FormatTag< format >(), encoding);
+				encoding.positional = true;
+			}
+
+			return encoding;
+		}
+
+		void prepare(FormatTag< PacketFormat::Legacy >, PacketEncoding &encoding) {
+			prepareAudioPacket_legacy(encoding, m_preparedData);
+		}
+		void prepare(FormatTag< PacketFormat::Protobuf >, PacketEncoding &encoding) {
+			prepareAudioPacket_protobuf(encoding, m_preparedData);
+		}
+		void addPositional(FormatTag< PacketFormat::Legacy >, PacketEncoding &encoding) {
+			addPositionalData_legacy(encoding, m_preparedData);
+		}
+		void addPositional(FormatTag< PacketFormat::Protobuf >, PacketEncoding &encoding) {
+			addPositionalData_protobuf(encoding, m_preparedData);
+		}
+		gsl::span< const byte > update(FormatTag< PacketFormat::Legacy >, PacketEncoding &encoding,
+									   const AudioData &data) {
+			return updateAudioPacket_legacy(encoding, data);
+		}
+		gsl::span< const byte > update(FormatTag< PacketFormat::Protobuf >, PacketEncoding &encoding,
+									   const AudioData &data) {
+			return updateAudioPacket_protobuf(encoding, data);
+		}
+
+		void prepareAudioPacket_legacy(PacketEncoding &encoding, const AudioData &data);
+		gsl::span< const byte > updateAudioPacket_legacy(PacketEncoding &encoding, const AudioData &data);
+		void addPositionalData_legacy(PacketEncoding &encoding, const AudioData &data);
+
+		void prepareAudioPacket_protobuf(PacketEncoding &encoding, const AudioData &data);
+		gsl::span< const byte > updateAudioPacket_protobuf(PacketEncoding &encoding, const AudioData &data);
+		void addPositionalData_protobuf(PacketEncoding &encoding, const AudioData &data);
 
 		void preparePreEncodedSnippets();
 
@@ -271,6 +374,14 @@ namespace Protocol {
 		bool decodePing_protobuf(const gsl::span< const byte > data);
 		bool decodeAudio_legacy(const gsl::span< const byte > data, AudioCodec codec);
 		bool decodeAudio_protobuf(const gsl::span< const byte > data);
+
+		enum class WireDecodeResult { Decoded, Invalid, Unsupported };
+
+		/// Decodes the wire format of MumbleUDP::Audio by hand, without allocating anything and leaving the payload
+		/// in the given data. Packets containing fields (or encodings) this doesn't know about are Unsupported and
+		/// have to be decoded by decodeAudio_protobufGeneric() instead.
+		WireDecodeResult decodeAudio_protobufFast(const gsl::span< const byte > data);
+		bool decodeAudio_protobufGeneric(const gsl::span< const byte > data);
 	};
 
 } // namespace Protocol
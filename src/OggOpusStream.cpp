@@ -0,0 +1,119 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "OggOpusStream.h"
+
+#include <QtCore/QIODevice>
+#include <QtCore/QRandomGenerator>
+#include <QtCore/QtEndian>
+
+#include <array>
+
+namespace {
+constexpr char HEADER_TYPE_FIRST = 0x02;
+constexpr char HEADER_TYPE_LAST  = 0x04;
+/// The most lacing values (and thereby packets) a page can hold
+constexpr int MAX_SEGMENTS = 255;
+
+template< typename T > void append(QByteArray &data, T value) {
+	std::array< char, sizeof(T) > bytes;
+	qToLittleEndian(value, bytes.data());
+	data.append(bytes.data(), static_cast< int >(bytes.size()));
+}
+} // namespace
+
+OggOpusStream::OggOpusStream(QIODevice &device)
+	: m_device(device), m_serial(QRandomGenerator::global()->generate()) {
+}
+
+bool OggOpusStream::writeHeaders(unsigned int channels, unsigned int preSkip, unsigned int inputSampleRate,
+								 const QByteArray &vendor, const QList< QByteArray > &comments) {
+	QByteArray head("OpusHead");
+	head.append(static_cast< char >(1));
+	head.append(static_cast< char >(channels));
+	append< quint16 >(head, static_cast< quint16 >(preSkip));
+	append< quint32 >(head, inputSampleRate);
+	// No output gain, single stream without channel mapping
+	append< qint16 >(head, 0);
+	head.append(static_cast< char >(0));
+
+	addPacket(reinterpret_cast< const unsigned char * >(head.constData()), static_cast< std::size_t >(head.size()));
+	if (!writePage(0, false)) {
+		return false;
+	}
+
+	QByteArray tags("OpusTags");
+	append< quint32 >(tags, static_cast< quint32 >(vendor.size()));
+	tags.append(vendor);
+	append< quint32 >(tags, static_cast< quint32 >(comments.size()));
+	for (const QByteArray &comment : comments) {
+		append< quint32 >(tags, static_cast< quint32 >(comment.size()));
+		tags.append(comment);
+	}
+
+	addPacket(reinterpret_cast< const unsigned char * >(tags.constData()), static_cast< std::size_t >(tags.size()));
+	return writePage(0, false);
+}
+
+bool OggOpusStream::fits(std::size_t size) const {
+	return m_segments.size() + static_cast< int >(size / 255) + 1 <= MAX_SEGMENTS;
+}
+
+void OggOpusStream::addPacket(const unsigned char *data, std::size_t size) {
+	// The lacing values: as many 255 as fit, followed by the rest (which is 0 if the size is a multiple of 255)
+	for (std::size_t i = 0; i < size / 255; ++i) {
+		m_segments.append(static_cast< char >(255));
+	}
+	m_segments.append(static_cast< char >(size % 255));
+
+	m_pageData.append(reinterpret_cast< const char * >(data), static_cast< int >(size));
+	++m_pagePackets;
+}
+
+bool OggOpusStream::writePage(std::uint64_t granule, bool last) {
+	const char type =
+		static_cast< char >((m_pageSequence == 0 ? HEADER_TYPE_FIRST : 0) | (last ? HEADER_TYPE_LAST : 0));
+
+	QByteArray page("OggS");
+	page.append(static_cast< char >(0));
+	page.append(type);
+	append< quint64 >(page, granule);
+	append< quint32 >(page, m_serial);
+	append< quint32 >(page, m_pageSequence++);
+	// The checksum, which is computed with these bytes being 0
+	append< quint32 >(page, 0);
+	page.append(static_cast< char >(m_segments.size()));
+	page.append(m_segments);
+	page.append(m_pageData);
+
+	qToLittleEndian< quint32 >(pageChecksum(page), page.data() + 22);
+
+	m_segments.clear();
+	m_pageData.clear();
+	m_pagePackets = 0;
+
+	return m_device.write(page) == page.size();
+}
+
+std::uint32_t OggOpusStream::pageChecksum(const QByteArray &page) {
+	static const std::array< std::uint32_t, 256 > table = []() {
+		std::array< std::uint32_t, 256 > result;
+		for (std::uint32_t i = 0; i < 256; ++i) {
+			std::uint32_t crc = i << 24;
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+			}
+			result[i] = crc;
+		}
+		return result;
+	}();
+
+	std::uint32_t crc = 0;
+	for (const char byte : page) {
+		crc = (crc << 8) ^ table[((crc >> 24) ^ static_cast< unsigned char >(byte)) & 0xff];
+	}
+
+	return crc;
+}
@@ -0,0 +1,67 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_OGGOPUSSTREAM_H_
+#define MUMBLE_OGGOPUSSTREAM_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+#include <cstddef>
+#include <cstdint>
+
+class QIODevice;
+
+/// Lays Opus packets out in the pages of an Ogg Opus stream (RFC 7845) and writes the pages to a device, holding only
+/// the current page in memory. Where the packets come from is up to the user: the client's OggOpusWriter encodes
+/// them, whereas the server's ChannelRecorder stores the ones it has received.
+///
+/// Packets aren't continued on the next page, which is why a page has to be written before a packet that doesn't fit
+/// into it anymore (see fits()).
+class OggOpusStream {
+public:
+	/// @param device The device to write to, which has to be open and outlive the stream
+	explicit OggOpusStream(QIODevice &device);
+
+	/// Writes the identification header and the comment header, each of which is alone on its page. This has to be
+	/// done before any packet is added.
+	///
+	/// @param preSkip The number of samples (at 48 kHz) a decoder has to discard at the start
+	/// @param inputSampleRate The rate of the audio before it has been encoded, which is merely informational
+	/// @param comments The user comments, e.g. "TITLE=..."
+	/// @returns Whether both pages have been written
+	bool writeHeaders(unsigned int channels, unsigned int preSkip, unsigned int inputSampleRate,
+					  const QByteArray &vendor, const QList< QByteArray > &comments);
+
+	/// @returns Whether a packet of the given size still fits onto the current page
+	bool fits(std::size_t size) const;
+	/// Adds the given packet to the current page, which has to have room for it
+	void addPacket(const unsigned char *data, std::size_t size);
+	/// @returns The number of packets on the current page
+	unsigned int pagePackets() const { return m_pagePackets; }
+
+	/// Writes the current page and starts a new one
+	///
+	/// @param granule The position of the page: the end of its last packet in samples at 48 kHz, including the ones
+	/// 	to skip
+	/// @param last Whether this is the last page of the stream
+	/// @returns Whether the page has been written
+	bool writePage(std::uint64_t granule, bool last);
+
+	/// @returns The checksum of the given page, which has to be computed with the checksum's bytes being 0: a CRC-32
+	/// 	with the polynomial 0x04c11db7, neither reflected nor inverted
+	static std::uint32_t pageChecksum(const QByteArray &page);
+
+private:
+	QIODevice &m_device;
+	const std::uint32_t m_serial;
+	std::uint32_t m_pageSequence = 0;
+	/// The lacing values and the data of the packets of the current page
+	QByteArray m_segments;
+	QByteArray m_pageData;
+	unsigned int m_pagePackets = 0;
+};
+
+#endif // MUMBLE_OGGOPUSSTREAM_H_
@@ -6,10 +6,14 @@
 #ifndef MUMBLE_PACKETDATASTREAM_H_
 #define MUMBLE_PACKETDATASTREAM_H_
 
+#include "Varint.h"
+
 #include <QByteArray>
 #include <QPair>
 #include <QString>
 
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
 
 /*
@@ -139,99 +143,32 @@ public:
 	}
 
 	PacketDataStream &operator<<(const quint64 value) {
-		quint64 i = value;
-
-		if ((i & 0x8000000000000000LL) && (~i < 0x100000000LL)) {
-			// Signed number.
-			i = ~i;
-			if (i <= 0x3) {
-				// Special case for -1 to -4. The most significant bits of the first byte must be (in binary) 111111
-				// followed by the 2 bits representing the absolute value of the encoded number. Shortcase for -1 to -4
-				append(0xFC | i);
-				return *this;
-			} else {
-				// Add flag byte, whose most significant bits are (in binary) 111110 that indicates
-				// that what follows is the varint encoding of the absolute value of i, but that the
-				// value itself is supposed to be negative.
-				append(0xF8);
-			}
-		}
-		if (i < 0x80) {
-			// Encode as 7-bit, positive number -> most significant bit of first byte must be zero
-			append(i);
-		} else if (i < 0x4000) {
-			// Encode as 14-bit, positive number -> most significant bits of first byte must be (in binary) 10
-			append((i >> 8) | 0x80);
-			append(i & 0xFF);
-		} else if (i < 0x200000) {
-			// Encode as 21-bit, positive number -> most significant bits of first byte must be (in binary) 110
-			append((i >> 16) | 0xC0);
-			append((i >> 8) & 0xFF);
-			append(i & 0xFF);
-		} else if (i < 0x10000000) {
-			// Encode as 28-bit, positive number -> most significant bits of first byte must be (in binary) 1110
-			append((i >> 24) | 0xE0);
-			append((i >> 16) & 0xFF);
-			append((i >> 8) & 0xFF);
-			append(i & 0xFF);
-		} else if (i < 0x100000000LL) {
-			// Encode as 32-bit, positive number -> most significant bits of first byte must be (in binary) 111100
-			// Remaining bits in first byte remain unused
-			append(0xF0);
-			append((i >> 24) & 0xFF);
-			append((i >> 16) & 0xFF);
-			append((i >> 8) & 0xFF);
-			append(i & 0xFF);
+		if (left() >= Varint::Prefix::MAX_SIZE) {
+			offset += Varint::Prefix::encode(value, &data[offset]);
 		} else {
-			// Encode as 64-bit, positive number -> most significant bits of first byte must be (in binary) 111101
-			// Remaining bits in first byte remain unused
-			append(0xF4);
-			append((i >> 56) & 0xFF);
-			append((i >> 48) & 0xFF);
-			append((i >> 40) & 0xFF);
-			append((i >> 32) & 0xFF);
-			append((i >> 24) & 0xFF);
-			append((i >> 16) & 0xFF);
-			append((i >> 8) & 0xFF);
-			append(i & 0xFF);
+			// Close to the end, the encoding has to go through append() so that overflows are accounted for
+			unsigned char buffer[Varint::Prefix::MAX_SIZE];
+			append(reinterpret_cast< const char * >(buffer), Varint::Prefix::encode(value, buffer));
 		}
 		return *this;
 	}
 
 	PacketDataStream &operator>>(quint64 &i) {
-		quint64 v = next();
-
-		if ((v & 0x80) == 0x00) {
-			i = (v & 0x7F);
-		} else if ((v & 0xC0) == 0x80) {
-			i = (v & 0x3F) << 8 | next();
-		} else if ((v & 0xF0) == 0xF0) {
-			switch (v & 0xFC) {
-				case 0xF0:
-					i = next() << 24 | next() << 16 | next() << 8 | next();
-					break;
-				case 0xF4:
-					i = next() << 56 | next() << 48 | next() << 40 | next() << 32 | next() << 24 | next() << 16
-						| next() << 8 | next();
-					break;
-				case 0xF8:
-					*this >> i;
-					i = ~i;
-					break;
-				case 0xFC:
-					i = v & 0x03;
-					i = ~i;
-					break;
-				default:
-					ok = false;
-					i  = 0;
-					break;
-			}
-		} else if ((v & 0xF0) == 0xE0) {
-			i = (v & 0x0F) << 24 | next() << 16 | next() << 8 | next();
-		} else if ((v & 0xE0) == 0xC0) {
-			i = (v & 0x1F) << 16 | next() << 8 | next();
+		std::uint64_t v         = 0;
+		const unsigned int read = Varint::Prefix::decode(&data[offset], left(), v);
+		if (read != 0) {
+			offset += read;
+		} else {
+			// The encoding is cut off, so the stream fails and the missing bytes are read as zeros (like next() does)
+			unsigned char padded[Varint::Prefix::MAX_SIZE] = {};
+			memcpy(padded, &data[offset], std::min< unsigned int >(left(), sizeof(padded)));
+			v = 0;
+			Varint::Prefix::decode(padded, sizeof(padded), v);
+
+			offset = maxsize;
+			ok     = false;
 		}
+		i = v;
 		return *this;
 	}
 
@@ -0,0 +1,156 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PermissionCache.h"
+
+PermissionCache::PermissionCache(std::size_t capacity) {
+	std::size_t slotsPerShard = PROBE_LENGTH;
+	while (slotsPerShard * SHARD_COUNT < capacity) {
+		slotsPerShard *= 2;
+	}
+	m_shardMask = slotsPerShard - 1;
+
+	for (Shard &shard : m_shards) {
+		shard.slots.reset(new Slot[slotsPerShard]);
+	}
+	for (std::size_t i = 0; i < GENERATION_COUNT; ++i) {
+		m_userGenerations[i].store(1, std::memory_order_relaxed);
+		m_channelGenerations[i].store(1, std::memory_order_relaxed);
+	}
+}
+
+bool PermissionCache::lookup(const User *user, const Channel *channel, unsigned int &permissions,
+							 Stamp *stamp) const {
+	const Stamp current = currentStamp(user, channel);
+
+	const std::size_t h  = hash(user, channel);
+	const Shard &shard   = m_shards[h % SHARD_COUNT];
+	const std::size_t at = h / SHARD_COUNT;
+
+	for (std::size_t i = 0; i < PROBE_LENGTH; ++i) {
+		if (read(shard.slots[(at + i) & m_shardMask], user, channel, current, permissions)) {
+			return true;
+		}
+	}
+
+	if (stamp) {
+		*stamp = current;
+	}
+
+	return false;
+}
+
+void PermissionCache::store(const User *user, const Channel *channel, const Stamp &stamp, unsigned int permissions) {
+	const std::size_t h  = hash(user, channel);
+	Shard &shard         = m_shards[h % SHARD_COUNT];
+	const std::size_t at = h / SHARD_COUNT;
+
+	std::lock_guard< std::mutex > lock(shard.mutex);
+
+	// Prefer the slot that already holds the entry, then slots that don't hold a valid entry anymore. As all writes
+	// happen while holding the mutex, the slots can be read directly here.
+	Slot *target = nullptr;
+	for (std::size_t i = 0; i < PROBE_LENGTH; ++i) {
+		Slot &slot                 = shard.slots[(at + i) & m_shardMask];
+		const User *slotUser       = slot.user.load(std::memory_order_relaxed);
+		const Channel *slotChannel = slot.channel.load(std::memory_order_relaxed);
+
+		if (slotUser == user && slotChannel == channel) {
+			target = &slot;
+			break;
+		}
+
+		if (!target) {
+			unsigned int unused;
+			if (!slotUser || !read(slot, slotUser, slotChannel, currentStamp(slotUser, slotChannel), unused)) {
+				target = &slot;
+			}
+		}
+	}
+
+	if (!target) {
+		target           = &shard.slots[(at + shard.nextVictim) & m_shardMask];
+		shard.nextVictim = (shard.nextVictim + 1) % PROBE_LENGTH;
+	}
+
+	write(*target, user, channel, stamp, permissions);
+}
+
+void PermissionCache::invalidateUser(const User *user) {
+	m_userGenerations[hash(user) % GENERATION_COUNT].fetch_add(1, std::memory_order_release);
+}
+
+void PermissionCache::invalidateChannel(const Channel *channel) {
+	m_channelGenerations[hash(channel) % GENERATION_COUNT].fetch_add(1, std::memory_order_release);
+}
+
+void PermissionCache::invalidateAll() {
+	m_globalGeneration.fetch_add(1, std::memory_order_release);
+}
+
+std::size_t PermissionCache::hash(const void *pointer) {
+	std::uint64_t mixed = static_cast< std::uint64_t >(reinterpret_cast< std::uintptr_t >(pointer));
+	mixed ^= mixed >> 33;
+	mixed *= 0xFF51AFD7ED558CCDULL;
+	mixed ^= mixed >> 33;
+
+	return static_cast< std::size_t >(mixed);
+}
+
+std::size_t PermissionCache::hash(const User *user, const Channel *channel) {
+	return hash(user) ^ (hash(channel) * 0x9E3779B97F4A7C15ULL);
+}
+
+PermissionCache::Stamp PermissionCache::currentStamp(const User *user, const Channel *channel) const {
+	Stamp stamp;
+	stamp.global  = m_globalGeneration.load(std::memory_order_acquire);
+	stamp.user    = m_userGenerations[hash(user) % GENERATION_COUNT].load(std::memory_order_acquire);
+	stamp.channel = m_channelGenerations[hash(channel) % GENERATION_COUNT].load(std::memory_order_acquire);
+
+	return stamp;
+}
+
+bool PermissionCache::read(const Slot &slot, const User *user, const Channel *channel, const Stamp &stamp,
+						   unsigned int &permissions) {
+	const std::uint32_t before = slot.sequence.load(std::memory_order_acquire);
+	if (before & 1) {
+		// The slot is being written to
+		return false;
+	}
+
+	const bool matches = slot.user.load(std::memory_order_relaxed) == user
+						 && slot.channel.load(std::memory_order_relaxed) == channel
+						 && slot.globalGeneration.load(std::memory_order_relaxed) == stamp.global
+						 && slot.userGeneration.load(std::memory_order_relaxed) == stamp.user
+						 && slot.channelGeneration.load(std::memory_order_relaxed) == stamp.channel;
+	const unsigned int value = slot.permissions.load(std::memory_order_relaxed);
+
+	// Makes sure that the fields have been read before the sequence is checked again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!matches || slot.sequence.load(std::memory_order_relaxed) != before) {
+		return false;
+	}
+
+	permissions = value;
+	return true;
+}
+
+void PermissionCache::write(Slot &slot, const User *user, const Channel *channel, const Stamp &stamp,
+							unsigned int permissions) {
+	const std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	// Readers that see any of the following stores also see the odd sequence
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.user.store(user, std::memory_order_relaxed);
+	slot.channel.store(channel, std::memory_order_relaxed);
+	slot.globalGeneration.store(stamp.global, std::memory_order_relaxed);
+	slot.userGeneration.store(stamp.user, std::memory_order_relaxed);
+	slot.channelGeneration.store(stamp.channel, std::memory_order_relaxed);
+	slot.permissions.store(permissions, std::memory_order_relaxed);
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,110 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_PERMISSIONCACHE_H_
+#define MUMBLE_PERMISSIONCACHE_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+class Channel;
+class User;
+
+/// A cache for the effective permissions of users in channels that can be used by several threads at once.
+///
+/// The entries are spread over a fixed number of shards, each of which is a small open-addressed table. Every slot
+/// is protected by a sequence lock, so lookup() never blocks: if it happens to read a slot that is being written to,
+/// the lookup is treated as a miss. Stores to the same shard are serialized by the shard's mutex. As this is a
+/// cache, a store may evict other entries if there is no free slot nearby.
+///
+/// Instead of removing entries, the cache is invalidated through generation counters. Every entry remembers the
+/// generations of its user, its channel and the whole cache at the time its permissions have been computed and is
+/// only used if none of these have changed since. The generations of users and channels are kept in tables that
+/// are indexed by a hash of the pointer, so invalidating one user or channel might invalidate a few others as well.
+class PermissionCache {
+public:
+	/// The generations cached permissions are valid for
+	struct Stamp {
+		std::uint32_t global  = 0;
+		std::uint32_t user    = 0;
+		std::uint32_t channel = 0;
+	};
+
+	/// @param capacity The (maximum) number of entries. It is rounded up so that every shard has a power of two
+	/// 	of slots.
+	explicit PermissionCache(std::size_t capacity = 4096);
+
+	PermissionCache(const PermissionCache &) = delete;
+	PermissionCache &operator=(const PermissionCache &) = delete;
+
+	/// Looks up the permissions of the given user in the given channel without blocking
+	///
+	/// @param[out] permissions Receives the cached permissions, if there are any
+	/// @param[out] stamp If non-null, receives the stamp the permissions have to be stored with, if there are none.
+	/// 	The caller has to obtain it before evaluating the permissions, as changes that happen while evaluating them
+	/// 	could otherwise go unnoticed.
+	/// @returns Whether valid permissions have been found
+	bool lookup(const User *user, const Channel *channel, unsigned int &permissions, Stamp *stamp = nullptr) const;
+
+	/// Stores the given permissions, which have been evaluated after the given stamp has been obtained from lookup()
+	void store(const User *user, const Channel *channel, const Stamp &stamp, unsigned int permissions);
+
+	/// Invalidates all permissions of the given user. This has to be called after the user has been changed in a way
+	/// that affects their permissions (or before the user's memory can be reused).
+	void invalidateUser(const User *user);
+	/// Invalidates all permissions in the given channel. This has to be called after the channel has been changed in
+	/// a way that affects the permissions in it (or before the channel's memory can be reused).
+	void invalidateChannel(const Channel *channel);
+	/// Invalidates all entries
+	void invalidateAll();
+
+	static constexpr std::size_t SHARD_COUNT = 16;
+	/// The number of consecutive slots an entry may be placed in
+	static constexpr std::size_t PROBE_LENGTH = 4;
+	/// The size of the tables holding the generations of users and channels
+	static constexpr std::size_t GENERATION_COUNT = 1024;
+
+protected:
+	struct Slot {
+		/// Odd while the slot is being written to
+		std::atomic< std::uint32_t > sequence{ 0 };
+		std::atomic< const User * > user{ nullptr };
+		std::atomic< const Channel * > channel{ nullptr };
+		std::atomic< std::uint32_t > globalGeneration{ 0 };
+		std::atomic< std::uint32_t > userGeneration{ 0 };
+		std::atomic< std::uint32_t > channelGeneration{ 0 };
+		std::atomic< unsigned int > permissions{ 0 };
+	};
+
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::unique_ptr< Slot[] > slots;
+		/// The slot that is evicted next if a store doesn't find a free one (protected by mutex)
+		std::size_t nextVictim = 0;
+	};
+
+	std::size_t m_shardMask;
+	std::array< Shard, SHARD_COUNT > m_shards;
+
+	std::atomic< std::uint32_t > m_globalGeneration{ 1 };
+	std::array< std::atomic< std::uint32_t >, GENERATION_COUNT > m_userGenerations;
+	std::array< std::atomic< std::uint32_t >, GENERATION_COUNT > m_channelGenerations;
+
+	static std::size_t hash(const void *pointer);
+	static std::size_t hash(const User *user, const Channel *channel);
+
+	Stamp currentStamp(const User *user, const Channel *channel) const;
+	/// Reads the given slot and returns whether it holds valid permissions for the given user and channel
+	static bool read(const Slot &slot, const User *user, const Channel *channel, const Stamp &stamp,
+					 unsigned int &permissions);
+	static void write(Slot &slot, const User *user, const Channel *channel, const Stamp &stamp,
+					  unsigned int permissions);
+};
+
+#endif // MUMBLE_PERMISSIONCACHE_H_
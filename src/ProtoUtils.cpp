@@ -4,6 +4,10 @@
 // Mumble source tree or at <https://www.mumble.info/LICENSE>.
 
 #include "ProtoUtils.h"
+#include "MumbleConstants.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtEndian>
 
 namespace MumbleProto {
 
@@ -37,4 +41,75 @@ void setSuggestedVersion(MumbleProto::SuggestConfig &msg, const ::Version::full_
 	msg.set_version_v1(::Version::toLegacyVersion(version));
 }
 
+void setPluginDataBatchData(MumbleProto::PluginDataBatch &msg, const QByteArray &frames) {
+	const QByteArray compressed = qCompress(frames);
+
+	if (compressed.size() < frames.size()) {
+		msg.set_compression(MumbleProto::PluginDataBatch_Compression_Zlib);
+		msg.set_data(compressed.constData(), static_cast< std::size_t >(compressed.size()));
+	} else {
+		msg.set_compression(MumbleProto::PluginDataBatch_Compression_None);
+		msg.set_data(frames.constData(), static_cast< std::size_t >(frames.size()));
+	}
+}
+
+bool getPluginDataBatchTransmissions(const MumbleProto::PluginDataBatch &msg,
+									 std::vector< MumbleProto::PluginDataTransmission > &transmissions) {
+	namespace PluginMessage = Mumble::Plugins::PluginMessage;
+
+	QByteArray data = QByteArray::fromRawData(msg.data().data(), static_cast< int >(msg.data().size()));
+
+	switch (msg.compression()) {
+		case MumbleProto::PluginDataBatch_Compression_None:
+			break;
+		case MumbleProto::PluginDataBatch_Compression_Zlib:
+			// Checking the announced size first keeps qUncompress from allocating whatever the sender claims
+			if (data.size() < 4
+				|| qFromBigEndian< quint32 >(reinterpret_cast< const unsigned char * >(data.constData()))
+					   > static_cast< quint32 >(PluginMessage::MAX_BATCH_SIZE)) {
+				return false;
+			}
+
+			data = qUncompress(data);
+			break;
+		default:
+			return false;
+	}
+
+	if (data.isEmpty() || data.size() > PluginMessage::MAX_BATCH_SIZE) {
+		return false;
+	}
+
+	const unsigned char *buffer = reinterpret_cast< const unsigned char * >(data.constData());
+	const int size              = data.size();
+	int offset                  = 0;
+
+	transmissions.clear();
+
+	while (offset < size) {
+		if (size - offset < 6 || transmissions.size() >= static_cast< std::size_t >(PluginMessage::MAX_BATCH_LENGTH)) {
+			return false;
+		}
+
+		const quint16 type   = qFromBigEndian< quint16 >(&buffer[offset]);
+		const quint32 length = qFromBigEndian< quint32 >(&buffer[offset + 2]);
+		offset += 6;
+
+		if (static_cast< Mumble::Protocol::TCPMessageType >(type)
+				!= Mumble::Protocol::TCPMessageType::PluginDataTransmission
+			|| length > static_cast< quint32 >(size - offset)) {
+			return false;
+		}
+
+		transmissions.emplace_back();
+		if (!transmissions.back().ParseFromArray(data.constData() + offset, static_cast< int >(length))) {
+			return false;
+		}
+
+		offset += static_cast< int >(length);
+	}
+
+	return true;
+}
+
 } // namespace MumbleProto
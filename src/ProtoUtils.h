@@ -9,6 +9,10 @@
 #include "Mumble.pb.h"
 #include "Version.h"
 
+#include <QtCore/QByteArray>
+
+#include <vector>
+
 namespace MumbleProto {
 
 ::Version::full_t getVersion(const MumbleProto::Version &msg);
@@ -17,6 +21,16 @@ void setVersion(MumbleProto::Version &msg, const ::Version::full_t version);
 ::Version::full_t getSuggestedVersion(const MumbleProto::SuggestConfig &msg);
 void setSuggestedVersion(MumbleProto::SuggestConfig &msg, const ::Version::full_t version);
 
+/// Sets the data of the given batch to the given framed PluginDataTransmission messages, which are compressed if that
+/// makes them smaller
+void setPluginDataBatchData(MumbleProto::PluginDataBatch &msg, const QByteArray &frames);
+/// Reads the PluginDataTransmission messages of the given batch
+///
+/// @param[out] transmissions The messages, in the order they have been batched in
+/// @returns Whether the batch is valid. Batches exceeding the limits in MumbleConstants.h aren't.
+bool getPluginDataBatchTransmissions(const MumbleProto::PluginDataBatch &msg,
+									 std::vector< MumbleProto::PluginDataTransmission > &transmissions);
+
 } // namespace MumbleProto
 
 #endif // MUMBLE_PROTOUTILS_H_
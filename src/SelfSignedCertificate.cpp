@@ -71,6 +71,47 @@ EVP_PKEY *SelfSignedCertificate::generate_rsa_keypair() {
 	return pkey;
 }
 
+EVP_PKEY *SelfSignedCertificate::generate_ec_keypair() {
+	EVP_PKEY *pkey = EVP_PKEY_new();
+	if (!pkey) {
+		return nullptr;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+	if (!ctx) {
+		return nullptr;
+	}
+	if (EVP_PKEY_keygen_init(ctx) <= 0) {
+		return nullptr;
+	}
+	if (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) <= 0) {
+		return nullptr;
+	}
+	// Certificates have to refer to the curve by its name, explicit parameters aren't widely supported
+	if (EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE) <= 0) {
+		return nullptr;
+	}
+	if (EVP_PKEY_keygen(ctx, &pkey) <= 0) {
+		return nullptr;
+	}
+	EVP_PKEY_CTX_free(ctx);
+#else
+	EC_KEY *ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if (!ec) {
+		return nullptr;
+	}
+	EC_KEY_set_asn1_flag(ec, OPENSSL_EC_NAMED_CURVE);
+	if (EC_KEY_generate_key(ec) == 0) {
+		return nullptr;
+	}
+	if (EVP_PKEY_assign_EC_KEY(pkey, ec) == 0) {
+		return nullptr;
+	}
+#endif
+	return pkey;
+}
+
 #define CHECK(statement) \
 	if (!(statement)) {  \
 		ok = false;      \
@@ -79,7 +120,7 @@ EVP_PKEY *SelfSignedCertificate::generate_rsa_keypair() {
 
 
 bool SelfSignedCertificate::generate(CertificateType certificateType, QString clientCertName, QString clientCertEmail,
-									 QSslCertificate &qscCert, QSslKey &qskKey) {
+									 QSslCertificate &qscCert, QSslKey &qskKey, QSsl::KeyAlgorithm algorithm) {
 	bool ok                    = true;
 	EVP_PKEY *pkey             = nullptr;
 	X509 *x509                 = nullptr;
@@ -89,12 +130,19 @@ bool SelfSignedCertificate::generate(CertificateType certificateType, QString cl
 	ASN1_TIME *notAfter        = nullptr;
 	QString commonName;
 	bool isServerCert = certificateType == CertificateTypeServerCertificate;
+#if QT_VERSION >= 0x050500
+	bool isEC = algorithm == QSsl::Ec;
+#else
+	// QSslKey can't hold EC keys before Qt 5.5
+	bool isEC = false;
+	Q_UNUSED(algorithm);
+#endif
 
 	// In Qt 5.15, a class was added to wrap up the procedures of generating a self-signed certificate.
 	// See https://doc.qt.io/qt-5/qopcuax509certificatesigningrequest.html.
 	// We should consider migrating to this class after switching to Qt 5.15.
 
-	CHECK(pkey = generate_rsa_keypair());
+	CHECK(pkey = (isEC ? generate_ec_keypair() : generate_rsa_keypair()));
 
 	CHECK(x509 = X509_new());
 	CHECK(X509_set_version(x509, 2));
@@ -145,7 +193,9 @@ bool SelfSignedCertificate::generate(CertificateType certificateType, QString cl
 		}
 	}
 
-	CHECK(X509_sign(x509, pkey, EVP_sha1()));
+	// RSA certificates are still signed with SHA-1, as they always have been. EC certificates are new, so they don't
+	// have to be compatible with anything that doesn't know about SHA-256.
+	CHECK(X509_sign(x509, pkey, isEC ? EVP_sha256() : EVP_sha1()));
 
 	{
 		QByteArray crt;
@@ -169,7 +219,7 @@ bool SelfSignedCertificate::generate(CertificateType certificateType, QString cl
 		unsigned char *dptr = reinterpret_cast< unsigned char * >(key.data());
 		CHECK(i2d_PrivateKey(pkey, &dptr) == len);
 
-		qskKey = QSslKey(key, QSsl::Rsa, QSsl::Der);
+		qskKey = QSslKey(key, isEC ? algorithm : QSsl::Rsa, QSsl::Der);
 		CHECK(!qskKey.isNull());
 	}
 
@@ -190,12 +240,14 @@ out:
 }
 
 bool SelfSignedCertificate::generateMumbleCertificate(QString name, QString email, QSslCertificate &qscCert,
-													  QSslKey &qskKey) {
-	return SelfSignedCertificate::generate(CertificateTypeClientCertificate, name, email, qscCert, qskKey);
+													  QSslKey &qskKey, QSsl::KeyAlgorithm algorithm) {
+	return SelfSignedCertificate::generate(CertificateTypeClientCertificate, name, email, qscCert, qskKey, algorithm);
 }
 
-bool SelfSignedCertificate::generateMurmurV2Certificate(QSslCertificate &qscCert, QSslKey &qskKey) {
-	return SelfSignedCertificate::generate(CertificateTypeServerCertificate, QString(), QString(), qscCert, qskKey);
+bool SelfSignedCertificate::generateMurmurV2Certificate(QSslCertificate &qscCert, QSslKey &qskKey,
+														QSsl::KeyAlgorithm algorithm) {
+	return SelfSignedCertificate::generate(CertificateTypeServerCertificate, QString(), QString(), qscCert, qskKey,
+										   algorithm);
 }
 
 #undef SSL_STRING
@@ -6,6 +6,7 @@
 #ifndef MUMBLE_SELFSIGNEDCERTIFICATE_H_
 #define MUMBLE_SELFSIGNEDCERTIFICATE_H_
 
+#include <openssl/ec.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
 #include <openssl/x509v3.h>
@@ -19,12 +20,18 @@ enum CertificateType { CertificateTypeServerCertificate, CertificateTypeClientCe
 class SelfSignedCertificate {
 private:
 	static bool generate(CertificateType certificateType, QString clientCertName, QString clientCertEmail,
-						 QSslCertificate &qscCert, QSslKey &qskKey);
+						 QSslCertificate &qscCert, QSslKey &qskKey, QSsl::KeyAlgorithm algorithm);
 	static EVP_PKEY *generate_rsa_keypair();
+	/// Generates a P-256 key, whose signatures and key exchanges are a lot cheaper than the ones of an RSA key
+	static EVP_PKEY *generate_ec_keypair();
 
 public:
-	static bool generateMumbleCertificate(QString name, QString email, QSslCertificate &qscCert, QSslKey &qskKey);
-	static bool generateMurmurV2Certificate(QSslCertificate &qscCert, QSslKey &qskKey);
+	/// @param algorithm The kind of key to generate, QSsl::Rsa or QSsl::Ec (which requires Qt 5.5)
+	static bool generateMumbleCertificate(QString name, QString email, QSslCertificate &qscCert, QSslKey &qskKey,
+										  QSsl::KeyAlgorithm algorithm = QSsl::Rsa);
+	/// @param algorithm The kind of key to generate, QSsl::Rsa or QSsl::Ec (which requires Qt 5.5)
+	static bool generateMurmurV2Certificate(QSslCertificate &qscCert, QSslKey &qskKey,
+											QSsl::KeyAlgorithm algorithm = QSsl::Rsa);
 };
 
 #endif
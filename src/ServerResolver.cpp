@@ -30,6 +30,7 @@ public:
 	int m_srvQueueRemain;
 
 	QList< ServerResolverRecord > m_resolved;
+	quint32 m_ttl;
 
 signals:
 	void resolved();
@@ -40,7 +41,8 @@ public slots:
 	void hostFallbackResolved(QHostInfo hostInfo);
 };
 
-ServerResolverPrivate::ServerResolverPrivate(QObject *parent) : QObject(parent), m_origPort(0), m_srvQueueRemain(0) {
+ServerResolverPrivate::ServerResolverPrivate(QObject *parent)
+	: QObject(parent), m_origPort(0), m_srvQueueRemain(0), m_ttl(ServerResolver::DEFAULT_TTL) {
 }
 
 void ServerResolverPrivate::resolve(QString hostname, quint16 port) {
@@ -68,6 +70,8 @@ void ServerResolverPrivate::srvResolved() {
 	if (resolver->error() == QDnsLookup::NoError && m_srvQueueRemain > 0) {
 		for (int i = 0; i < m_srvQueue.count(); i++) {
 			QDnsServiceRecord record = m_srvQueue.at(i);
+			m_ttl                    = qMin(m_ttl, record.timeToLive());
+
 			int hostInfoId           = QHostInfo::lookupHost(record.target(), this, SLOT(hostResolved(QHostInfo)));
 			m_hostInfoIdToIndexMap[hostInfoId] = i;
 		}
@@ -148,4 +152,11 @@ QList< ServerResolverRecord > ServerResolver::records() {
 	return QList< ServerResolverRecord >();
 }
 
+quint32 ServerResolver::timeToLive() {
+	if (d) {
+		return d->m_ttl;
+	}
+	return 0;
+}
+
 #include "ServerResolver.moc"
@@ -20,6 +20,10 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(ServerResolver)
 public:
+	/// For how long the records are considered valid if the DNS doesn't tell (in seconds). The system's resolver
+	/// doesn't report the TTLs of A and AAAA records, so this is also the longest time the records are valid for.
+	static constexpr quint32 DEFAULT_TTL = 300;
+
 	ServerResolver(QObject *parent = nullptr);
 
 	QString hostname();
@@ -27,6 +31,8 @@ public:
 
 	void resolve(QString hostname, quint16 port);
 	QList< ServerResolverRecord > records();
+	/// @returns For how long the records may be cached (in seconds)
+	quint32 timeToLive();
 
 signals:
 	/// Resolved is fired once the ServerResolver
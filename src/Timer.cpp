@@ -59,6 +59,26 @@ bool Timer::operator>(const Timer &other) const {
 	return uiStart < other.uiStart;
 }
 
+CoarseTimer::CoarseTimer(bool start) {
+	uiStart = start ? now() : 0;
+}
+
+quint64 CoarseTimer::elapsed() const {
+	Q_ASSERT(uiStart != 0);
+	return now() - uiStart;
+}
+
+quint64 CoarseTimer::restart() {
+	quint64 n = now();
+	quint64 e = n - uiStart;
+	uiStart   = n;
+	return e;
+}
+
+bool CoarseTimer::isStarted() const {
+	return uiStart != 0;
+}
+
 #ifdef USE_BOOST_CHRONO
 // Ensure boost_system is header only.
 #	define BOOST_ERROR_CODE_HEADER_ONLY
@@ -124,3 +144,28 @@ quint64 Timer::now() {
 	return elapsed * 1000LL;
 }
 #endif
+
+#if defined(Q_OS_LINUX)
+#	include <time.h>
+
+quint64 CoarseTimer::now() {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) != 0) {
+		// Kernels older than 2.6.32 don't have the coarse clock. CLOCK_MONOTONIC has the same origin.
+		return Timer::now();
+	}
+	quint64 e = static_cast< quint64 >(ts.tv_sec) * 1000000ULL;
+	e += static_cast< quint64 >(ts.tv_nsec) / 1000ULL;
+	return e;
+}
+#elif defined(Q_OS_WIN)
+#	include "win.h"
+
+quint64 CoarseTimer::now() {
+	return static_cast< quint64 >(GetTickCount64()) * 1000ULL;
+}
+#else
+quint64 CoarseTimer::now() {
+	return Timer::now();
+}
+#endif
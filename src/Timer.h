@@ -12,6 +12,8 @@
 
 class Timer {
 protected:
+	friend class CoarseTimer;
+
 	quint64 uiStart;
 	static quint64 now();
 
@@ -33,4 +35,22 @@ public:
 	bool operator>(const Timer &other) const;
 };
 
+/// A timer that reads a coarse clock, which is cheaper to read than the one Timer uses but only advances every few
+/// milliseconds (CLOCK_MONOTONIC_COARSE on Linux and the tick count on Windows). It is meant for the hot paths that
+/// only measure times in the order of seconds, such as the time since the last packet that could be decrypted (see
+/// CryptState::tLastGood), which is restarted for every voice packet.
+class CoarseTimer {
+protected:
+	quint64 uiStart;
+
+public:
+	CoarseTimer(bool start = true);
+	quint64 elapsed() const;
+	quint64 restart();
+	bool isStarted() const;
+
+	/// @returns The current time of the coarse clock
+	static quint64 now();
+};
+
 #endif
@@ -0,0 +1,169 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_VARINT_H_
+#define MUMBLE_VARINT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/// The two variable-length integer encodings that are used on the wire. Both are defined here (instead of in the
+/// classes using them) so that they can be inlined into the loops that encode and decode every UDP packet.
+namespace Varint {
+
+/// Reads the given number of bytes (at most 8) as a big-endian number. Compilers turn this into a single
+/// (byte-swapping) load if there are 8 bytes.
+inline std::uint64_t loadBigEndian(const unsigned char *data, unsigned int size) {
+	std::uint64_t value = 0;
+	for (unsigned int i = 0; i < size; ++i) {
+		value = value << 8 | data[i];
+	}
+
+	return value;
+}
+
+/// Mumble's own encoding, which PacketDataStream and thus the legacy UDP protocol use. The number of leading one bits
+/// of the first byte tells the length of the encoding:
+///
+/// 0xxxxxxx                                       7-bit positive number
+/// 10xxxxxx + 1 byte                              14-bit positive number
+/// 110xxxxx + 2 bytes                             21-bit positive number
+/// 1110xxxx + 3 bytes                             28-bit positive number
+/// 111100__ + 4 bytes                             32-bit positive number
+/// 111101__ + 8 bytes                             64-bit number
+/// 111110__ + varint                              Negative recursive varint
+/// 111111xx                                       Byte-inverted negative two bit number (~xx)
+namespace Prefix {
+	/// The largest number of bytes a number is encoded in
+	constexpr unsigned int MAX_SIZE = 9;
+
+	/// The size of the encodings that only depend on the upper nibble of the first byte (0 for the ones that don't)
+	constexpr unsigned char NIBBLE_SIZES[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 4, 0 };
+
+	/// Writes the encoding of the given number
+	///
+	/// @param dst Where to write the encoding to, which has to have room for MAX_SIZE bytes (whether or not the
+	/// 	encoding needs all of them)
+	/// @returns The number of bytes the encoding takes
+	inline unsigned int encode(std::uint64_t value, unsigned char *dst) {
+		unsigned int size = 0;
+
+		if ((value & 0x8000000000000000ULL) && (~value < 0x100000000ULL)) {
+			// Negative number
+			value = ~value;
+			if (value <= 0x3) {
+				dst[0] = static_cast< unsigned char >(0xFC | value);
+				return 1;
+			}
+
+			dst[size++] = 0xF8;
+		}
+
+		if (value < 0x10000000) {
+			// 1 to 4 bytes, with as many leading one bits (followed by a zero bit) as there are additional bytes
+			const unsigned int length = 1 + (value >= 0x80) + (value >= 0x4000) + (value >= 0x200000);
+			const std::uint32_t word =
+				(static_cast< std::uint32_t >(value) | (0xFFFFFF00u >> (length - 1) << (8 * length - 8)))
+				<< (32 - 8 * length);
+
+			// Writing all 4 bytes and only counting the ones that belong to the encoding avoids branching on the length
+			dst[size]     = static_cast< unsigned char >(word >> 24);
+			dst[size + 1] = static_cast< unsigned char >(word >> 16);
+			dst[size + 2] = static_cast< unsigned char >(word >> 8);
+			dst[size + 3] = static_cast< unsigned char >(word);
+
+			return size + length;
+		}
+
+		const unsigned int bytes = value < 0x100000000ULL ? 4 : 8;
+		dst[size++]              = bytes == 4 ? 0xF0 : 0xF4;
+		for (unsigned int i = 0; i < bytes; ++i) {
+			dst[size++] = static_cast< unsigned char >(value >> (8 * (bytes - 1 - i)));
+		}
+
+		return size;
+	}
+
+	/// Reads an encoded number
+	///
+	/// @param available The number of bytes that may be read from data
+	/// @returns The number of bytes that have been read or 0 if the encoding is longer than the available data
+	inline unsigned int decode(const unsigned char *data, std::size_t available, std::uint64_t &value) {
+		if (available == 0) {
+			return 0;
+		}
+
+		const unsigned char first = data[0];
+		const unsigned int length = NIBBLE_SIZES[first >> 4];
+		if (length != 0) {
+			if (length > available) {
+				return 0;
+			}
+
+			// The prefix of an encoding of n bytes takes n bits, all of the remaining 7 * n bits are the number
+			const std::uint64_t raw = available >= 8 ? loadBigEndian(data, 8) >> (64 - 8 * length)
+													 : loadBigEndian(data, length);
+			value = raw & ((std::uint64_t(1) << (7 * length)) - 1);
+
+			return length;
+		}
+
+		switch (first & 0xFC) {
+			case 0xF0:
+				if (available < 5) {
+					return 0;
+				}
+				value = loadBigEndian(data + 1, 4);
+				return 5;
+			case 0xF4:
+				if (available < 9) {
+					return 0;
+				}
+				value = loadBigEndian(data + 1, 8);
+				return 9;
+			case 0xF8: {
+				const unsigned int read = decode(data + 1, available - 1, value);
+				value                   = ~value;
+				return read == 0 ? 0 : read + 1;
+			}
+			default:
+				value = ~static_cast< std::uint64_t >(first & 0x03);
+				return 1;
+		}
+	}
+} // namespace Prefix
+
+/// Protobuf's base-128 encoding: 7 bits per byte (least significant group first), with the most significant bit
+/// telling whether another byte follows.
+namespace Protobuf {
+	/// The largest number of bytes a 64-bit number is encoded in
+	constexpr unsigned int MAX_SIZE = 10;
+
+	/// Reads an encoded number from the given position, advancing it past the encoding
+	///
+	/// @returns Whether there has been a complete encoding of at most MAX_SIZE bytes
+	inline bool decode(const unsigned char *&pos, const unsigned char *end, std::uint64_t &value) {
+		// Tags, lengths and most values fit in a single byte
+		if (pos != end && !(*pos & 0x80)) {
+			value = *pos++;
+			return true;
+		}
+
+		value = 0;
+		for (unsigned int shift = 0; shift < 7 * MAX_SIZE && pos != end; shift += 7) {
+			const unsigned char current = *pos++;
+			value |= static_cast< std::uint64_t >(current & 0x7F) << shift;
+			if (!(current & 0x80)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+} // namespace Protobuf
+
+} // namespace Varint
+
+#endif // MUMBLE_VARINT_H_
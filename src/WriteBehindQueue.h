@@ -0,0 +1,87 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_WRITEBEHINDQUEUE_H_
+#define MUMBLE_WRITEBEHINDQUEUE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+/// The writes a write-behind thread (the client's DatabaseWriter and the server's ServerDBWriter) hasn't performed
+/// yet, in the order they have been queued in.
+///
+/// Every write is given a sequence number, by which the writer tells the threads waiting for it how far it has got. A
+/// write can be given a key, in which case it replaces a pending write with the same key. Writes with keys thus must
+/// store the complete state instead of depending on the writes queued before them.
+///
+/// The queue isn't thread-safe: both the threads queueing writes and the writer have to hold the writer's mutex.
+template< typename Task > class WriteBehindQueue {
+public:
+	struct Entry {
+		quint64 sequence;
+		/// Empty if the write has been replaced by a later one
+		Task task;
+		QString key;
+	};
+
+	/// Queues the given write. If a key is given, any pending write with the same key is dropped.
+	void enqueue(Task task, const QString &key = QString()) {
+		const quint64 sequence = nextSequence();
+
+		if (!key.isEmpty()) {
+			auto it = m_pendingKeys.find(key);
+			if (it != m_pendingKeys.end()) {
+				// The queue is sorted by sequence number
+				auto entry = std::lower_bound(m_queue.begin(), m_queue.end(), it.value(),
+											  [](const Entry &e, quint64 s) { return e.sequence < s; });
+				if (entry != m_queue.end() && entry->sequence == it.value()) {
+					entry->task = Task();
+				}
+				it.value() = sequence;
+			} else {
+				m_pendingKeys.insert(key, sequence);
+			}
+		}
+
+		m_queue.push_back({ sequence, std::move(task), key });
+	}
+
+	/// Moves up to the given number of the oldest writes to the end of the given batch
+	void take(std::vector< Entry > &batch, std::size_t count) {
+		for (; count > 0 && !m_queue.empty(); --count) {
+			Entry &entry = m_queue.front();
+			if (!entry.key.isEmpty() && m_pendingKeys.value(entry.key) == entry.sequence) {
+				m_pendingKeys.remove(entry.key);
+			}
+
+			batch.push_back(std::move(entry));
+			m_queue.pop_front();
+		}
+	}
+
+	/// @returns A new sequence number, for something the writer writes besides the queued writes (e.g. a log line)
+	quint64 nextSequence() { return m_nextSequence++; }
+	/// @returns The sequence number of whatever has been queued last
+	quint64 lastSequence() const { return m_nextSequence - 1; }
+	/// @returns The sequence number of the oldest pending write, or the one the next write will get if there is none
+	quint64 frontSequence() const { return m_queue.empty() ? m_nextSequence : m_queue.front().sequence; }
+
+	bool empty() const { return m_queue.empty(); }
+	std::size_t size() const { return m_queue.size(); }
+
+protected:
+	std::deque< Entry > m_queue;
+	/// The sequence numbers of the pending writes that have a key
+	QHash< QString, quint64 > m_pendingKeys;
+	quint64 m_nextSequence = 1;
+};
+
+#endif // MUMBLE_WRITEBEHINDQUEUE_H_
@@ -0,0 +1,389 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Measures the evaluation of ACLs on generated channel trees of a given depth and fanout: the interpreting
+// ChanACL::effectivePermissions, the compiled programs the server evaluates instead, Group::appliesToUser, rebuilding
+// all permissions the clients know about after the ACLs have changed (what Server::clearACLCache does) and checking
+// whether a client has to be told about its permissions (what Server::sendClientPermission does).
+//
+// Every channel has a mix of ACLs: some channels don't inherit the ACLs of their parent, and the ACLs refer to the
+// meta groups, to groups that are defined (and inherited) along the tree, to access tokens (#token) and to
+// certificate hashes ($hash).
+
+#include <benchmark/benchmark.h>
+
+#include "ACL.h"
+#include "ACLProgram.h"
+#include "Channel.h"
+#include "Group.h"
+#include "Mumble.pb.h"
+#include "PermissionCache.h"
+#include "ServerUser.h"
+
+#include <QtCore/QString>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+constexpr const std::size_t DEPTH_RANGE  = 0;
+constexpr const std::size_t FANOUT_RANGE = 1;
+
+// Trees from about 1k to about 10k channels, both wide and deep
+const std::vector< std::vector< std::int64_t > > TREES = { { 3, 10 }, { 5, 5 }, { 4, 9 }, { 2, 100 }, { 6, 4 } };
+
+constexpr std::size_t USER_COUNT = 256;
+// The number of channels every client has been told its permissions in, which is about what browsing the channel
+// tree accumulates (see Server::flushClientPermissionCache, which gives up at 20)
+constexpr std::size_t SENT_PERMISSIONS = 16;
+constexpr std::size_t GROUP_COUNT      = 8;
+constexpr std::size_t TOKEN_COUNT      = 8;
+
+// An arbitrary permission to check, as the server does for every action
+constexpr ChanACL::Perm CHECKED_PERMISSION = ChanACL::Enter;
+
+std::mt19937 rng(42);
+
+std::unique_ptr< Channel > root;
+std::vector< Channel * > channels;
+std::vector< std::unique_ptr< ServerUser > > users;
+/// The (user, channel) pairs the permissions are evaluated for
+std::vector< std::pair< ServerUser *, Channel * > > queries;
+
+static QString groupName(std::size_t i) {
+	return QString::fromLatin1("group%1").arg(i);
+}
+
+static QString token(std::size_t i) {
+	return QString::fromLatin1("token%1").arg(i);
+}
+
+static QString certHash(std::size_t i) {
+	return QString::fromLatin1("%1").arg(i, 40, 16, QLatin1Char('0'));
+}
+
+static std::size_t randomIndex(std::size_t count) {
+	return std::uniform_int_distribution< std::size_t >(0, count - 1)(rng);
+}
+
+static void addACL(Channel *channel, int userId, const QString &group, ChanACL::Permissions allow,
+				   ChanACL::Permissions deny, bool applyHere = true, bool applySubs = true) {
+	ChanACL *acl    = new ChanACL(channel);
+	acl->iUserId    = userId;
+	acl->qsGroup    = group;
+	acl->pAllow     = allow;
+	acl->pDeny      = deny;
+	acl->bApplyHere = applyHere;
+	acl->bApplySubs = applySubs;
+}
+
+/// Gives the given channel a few ACLs (and maybe a group), picked at random
+static void addRandomACLs(Channel *channel) {
+	if (randomIndex(8) == 0) {
+		// Channels that don't inherit the ACLs of their parents usually restrict who may enter
+		channel->bInheritACL = false;
+		addACL(channel, -1, QLatin1String("all"), ChanACL::None, ChanACL::Enter | ChanACL::Speak);
+	}
+
+	if (randomIndex(4) == 0) {
+		Group *group        = new Group(channel, groupName(randomIndex(GROUP_COUNT)));
+		group->bInherit     = randomIndex(2) == 0;
+		group->bInheritable = randomIndex(4) != 0;
+		for (std::size_t i = 0; i < 4; ++i) {
+			group->qsAdd.insert(static_cast< int >(randomIndex(USER_COUNT)));
+		}
+		group->qsRemove.insert(static_cast< int >(randomIndex(USER_COUNT)));
+	}
+
+	const std::size_t count = randomIndex(4);
+	for (std::size_t i = 0; i < count; ++i) {
+		switch (randomIndex(8)) {
+			case 0:
+				addACL(channel, -1, QLatin1String("auth"), ChanACL::Enter | ChanACL::Speak, ChanACL::None);
+				break;
+			case 1:
+				addACL(channel, -1, QLatin1String("~in"), ChanACL::Speak | ChanACL::TextMessage, ChanACL::None);
+				break;
+			case 2:
+				addACL(channel, -1, QLatin1String("!strong"), ChanACL::None, ChanACL::MakeTempChannel);
+				break;
+			case 3:
+				addACL(channel, -1, QLatin1String("#") + token(randomIndex(TOKEN_COUNT)), ChanACL::Enter,
+					   ChanACL::None);
+				break;
+			case 4:
+				addACL(channel, -1, QLatin1String("$") + certHash(randomIndex(USER_COUNT)), ChanACL::Write,
+					   ChanACL::None);
+				break;
+			case 5:
+				addACL(channel, -1, QLatin1String("sub,0,2"), ChanACL::Listen, ChanACL::Whisper, false, true);
+				break;
+			case 6:
+				addACL(channel, static_cast< int >(randomIndex(USER_COUNT)), QString(),
+					   ChanACL::MuteDeafen | ChanACL::Move, ChanACL::None);
+				break;
+			default:
+				addACL(channel, -1, groupName(randomIndex(GROUP_COUNT)), ChanACL::MakeChannel | ChanACL::LinkChannel,
+					   ChanACL::None);
+				break;
+		}
+	}
+}
+
+static void addChildren(Channel *parent, std::size_t depth, std::size_t fanout) {
+	if (depth == 0) {
+		return;
+	}
+
+	for (std::size_t i = 0; i < fanout; ++i) {
+		Channel *channel =
+			new Channel(static_cast< unsigned int >(channels.size()), QString::fromLatin1("Channel %1").arg(i), parent);
+		channels.push_back(channel);
+		addRandomACLs(channel);
+
+		addChildren(channel, depth - 1, fanout);
+	}
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		const std::size_t depth  = static_cast< std::size_t >(state.range(DEPTH_RANGE));
+		const std::size_t fanout = static_cast< std::size_t >(state.range(FANOUT_RANGE));
+
+		rng.seed(42);
+		users.clear();
+		queries.clear();
+		channels.clear();
+
+		root = std::make_unique< Channel >(Channel::ROOT_ID, QLatin1String("Root"));
+		channels.push_back(root.get());
+
+		// The default ACLs of a new server
+		Group *admin = new Group(root.get(), QLatin1String("admin"));
+		admin->qsAdd.insert(1);
+		addACL(root.get(), -1, QLatin1String("admin"), ChanACL::Write, ChanACL::None);
+		addACL(root.get(), -1, QLatin1String("auth"), ChanACL::MakeTempChannel, ChanACL::None);
+		addACL(root.get(), -1, QLatin1String("all"), ChanACL::SelfRegister, ChanACL::None, true, false);
+
+		addChildren(root.get(), depth, fanout);
+
+		for (std::size_t i = 0; i < USER_COUNT; ++i) {
+			// The first fourth of the users isn't registered. Session and ID 0 would be the SuperUser.
+			users.push_back(std::make_unique< ServerUser >(static_cast< unsigned int >(i + 1),
+														   i < USER_COUNT / 4 ? -1 : static_cast< int >(i)));
+			ServerUser *user = users.back().get();
+
+			user->qsHash    = certHash(i);
+			user->bVerified = randomIndex(2) == 0;
+			if (randomIndex(2) == 0) {
+				user->qslAccessTokens << token(randomIndex(TOKEN_COUNT));
+			}
+
+			user->cChannel = channels[randomIndex(channels.size())];
+			user->cChannel->addUser(user);
+
+			for (std::size_t j = 0; j < SENT_PERMISSIONS; ++j) {
+				user->qmPermissionSent.insert(static_cast< int >(channels[randomIndex(channels.size())]->iId), 0);
+			}
+			user->iLastPermissionCheck = static_cast< int >(user->cChannel->iId);
+		}
+
+		for (std::size_t i = 0; i < 4096; ++i) {
+			queries.emplace_back(users[randomIndex(users.size())].get(), channels[randomIndex(channels.size())]);
+		}
+	}
+
+	void TearDown(const ::benchmark::State &) {
+		for (std::unique_ptr< ServerUser > &user : users) {
+			user->cChannel->removeUser(user.get());
+		}
+		users.clear();
+		queries.clear();
+		channels.clear();
+		root.reset();
+	}
+};
+
+/// Evaluates permissions just like Server::effectivePermissions
+static ChanACL::Permissions effectivePermissions(PermissionCache &cache, ACLProgramCache &programs, ServerUser *user,
+												 Channel *channel) {
+	unsigned int cached;
+	PermissionCache::Stamp stamp;
+	if (cache.lookup(user, channel, cached, &stamp)) {
+		return static_cast< ChanACL::Permissions >(cached);
+	}
+
+	const ChanACL::Permissions granted = programs.get(*channel).evaluate(*user);
+	cache.store(user, channel, stamp, granted | ChanACL::Cached);
+
+	return granted;
+}
+
+/// Does what Server::sendClientPermission does, serializing the message instead of sending it
+///
+/// @returns The number of bytes that would have been sent
+static std::size_t sendClientPermission(PermissionCache &cache, ACLProgramCache &programs, ServerUser *user,
+										Channel *channel) {
+	const unsigned int perm = effectivePermissions(cache, programs, user, channel) | ChanACL::Cached;
+	if (user->qmPermissionSent.value(static_cast< int >(channel->iId)) == perm) {
+		return 0;
+	}
+
+	user->qmPermissionSent.insert(static_cast< int >(channel->iId), perm);
+
+	MumbleProto::PermissionQuery mppq;
+	mppq.set_channel_id(channel->iId);
+	mppq.set_permissions(perm);
+
+	return mppq.SerializeAsString().size();
+}
+
+static void setTreeLabel(::benchmark::State &state) {
+	state.SetLabel(std::to_string(channels.size()) + " channels");
+}
+
+static void trees(::benchmark::internal::Benchmark *benchmark) {
+	benchmark->ArgNames({ "depth", "fanout" });
+	for (const std::vector< std::int64_t > &tree : TREES) {
+		benchmark->Args(tree);
+	}
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_effectivePermissions)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	for (auto _ : state) {
+		for (const std::pair< ServerUser *, Channel * > &query : queries) {
+			benchmark::DoNotOptimize(ChanACL::effectivePermissions(query.first, query.second, nullptr));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * queries.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_effectivePermissions)->Apply(trees);
+
+BENCHMARK_DEFINE_F(Fixture, BM_evaluateProgram)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	// Compiling the programs is measured by BM_clearACLCache
+	ACLProgramCache programs;
+	for (Channel *channel : channels) {
+		programs.get(*channel);
+	}
+
+	for (auto _ : state) {
+		for (const std::pair< ServerUser *, Channel * > &query : queries) {
+			benchmark::DoNotOptimize(programs.get(*query.second).evaluate(*query.first));
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * queries.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_evaluateProgram)->Apply(trees);
+
+BENCHMARK_DEFINE_F(Fixture, BM_appliesToUser)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	// All group specifications of all ACLs, along with the channel that is checked and the one of the ACL
+	struct Specification {
+		const Channel *channel;
+		const Channel *aclChannel;
+		QString group;
+	};
+	std::vector< Specification > specifications;
+	for (const std::pair< ServerUser *, Channel * > &query : queries) {
+		for (const Channel *aclChannel = query.second; aclChannel; aclChannel = aclChannel->cParent) {
+			for (const ChanACL *acl : aclChannel->qlACL) {
+				specifications.push_back({ query.second, aclChannel, acl->qsGroup });
+			}
+		}
+	}
+
+	for (auto _ : state) {
+		std::size_t matches = 0;
+		for (std::size_t i = 0; i < specifications.size(); ++i) {
+			const Specification &specification = specifications[i];
+			matches += Group::appliesToUser(*specification.channel, *specification.aclChannel, specification.group,
+											*users[i % users.size()]);
+		}
+		benchmark::DoNotOptimize(matches);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * specifications.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_appliesToUser)->Apply(trees);
+
+BENCHMARK_DEFINE_F(Fixture, BM_clearACLCache)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	PermissionCache cache;
+	ACLProgramCache programs;
+	std::size_t sent = 0;
+
+	for (auto _ : state) {
+		// What Server::clearACLCache(nullptr) does: start from scratch and check all permissions the clients know
+		// about, which compiles the programs of the channels they are in again
+		programs.clear();
+		cache.invalidateAll();
+
+		for (std::unique_ptr< ServerUser > &user : users) {
+			for (auto it = user->qmPermissionSent.begin(); it != user->qmPermissionSent.end(); ++it) {
+				const unsigned int perm =
+					effectivePermissions(cache, programs, user.get(), channels[static_cast< std::size_t >(it.key())])
+					| ChanACL::Cached;
+				if (perm != it.value()) {
+					it.value() = perm;
+					++sent;
+				}
+			}
+		}
+	}
+	benchmark::DoNotOptimize(sent);
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * users.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_clearACLCache)->Apply(trees);
+
+BENCHMARK_DEFINE_F(Fixture, BM_sendClientPermission)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	PermissionCache cache;
+	ACLProgramCache programs;
+
+	for (auto _ : state) {
+		std::size_t bytes = 0;
+		for (const std::pair< ServerUser *, Channel * > &query : queries) {
+			bytes += sendClientPermission(cache, programs, query.first, query.second);
+		}
+		benchmark::DoNotOptimize(bytes);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * queries.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_sendClientPermission)->Apply(trees);
+
+BENCHMARK_DEFINE_F(Fixture, BM_hasPermission)(::benchmark::State &state) {
+	setTreeLabel(state);
+
+	PermissionCache cache;
+	ACLProgramCache programs;
+
+	for (auto _ : state) {
+		std::size_t granted = 0;
+		for (const std::pair< ServerUser *, Channel * > &query : queries) {
+			granted += (effectivePermissions(cache, programs, query.first, query.second) & CHECKED_PERMISSION) != 0;
+		}
+		benchmark::DoNotOptimize(granted);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * queries.size()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_hasPermission)->Apply(trees);
+
+BENCHMARK_MAIN();
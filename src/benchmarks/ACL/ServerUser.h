@@ -0,0 +1,27 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+
+// NOTE: This is merely a mock of the ServerUser class, containing what the ACL evaluation needs
+
+#include "User.h"
+
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
+
+class ServerUser : public User {
+public:
+	ServerUser(unsigned int session, int id) {
+		uiSession = session;
+		iId       = id;
+	}
+
+	bool bVerified = false;
+	QStringList qslAccessTokens;
+
+	/// The permissions the client has been told about (see Server::sendClientPermission)
+	QMap< int, unsigned int > qmPermissionSent;
+	int iLastPermissionCheck = -1;
+};
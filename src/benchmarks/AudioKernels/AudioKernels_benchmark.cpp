@@ -0,0 +1,303 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares the accelerated kernels of the audio input and output with their portable implementation and measures the
+// resampler, the HRTF spatializer and the time stretcher of the jitter buffer (which use them). The label of every
+// accelerated run names the instruction set that has been chosen for the CPU.
+
+#include <benchmark/benchmark.h>
+
+#include "AudioKernels.h"
+#include "AudioResampler.h"
+#include "AudioSpatializer.h"
+#include "AudioTimeStretcher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_real_distribution< float > random_sample(-1.0f, 1.0f);
+
+constexpr const std::size_t ACCELERATED_RANGE = 0;
+constexpr const std::size_t CHANNELS_RANGE    = 1;
+constexpr const std::size_t MASKED_RANGE      = 2;
+
+// 10 ms at 48 kHz, which is what the audio callbacks are typically handed
+constexpr unsigned int FRAMES = 480;
+
+// The largest channel count that is benchmarked
+constexpr unsigned int MAX_CHANNELS = 8;
+
+std::vector< float > floats;
+std::vector< short > shorts;
+std::vector< float > mixed;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &) {
+		floats.resize(FRAMES * MAX_CHANNELS);
+		shorts.resize(FRAMES * MAX_CHANNELS);
+		mixed.resize(FRAMES * MAX_CHANNELS);
+
+		for (std::size_t i = 0; i < floats.size(); ++i) {
+			floats[i] = random_sample(rng);
+			shorts[i] = static_cast< short >(random_sample(rng) * 32767.f);
+		}
+	}
+};
+
+static bool accelerated(::benchmark::State &state) {
+	const bool accelerated = state.range(ACCELERATED_RANGE) != 0;
+	state.SetLabel(accelerated ? AudioKernels::backendName() : "Scalar");
+
+	return accelerated;
+}
+
+static void downmix(::benchmark::State &state, AudioKernels::SampleFormat format, const void *input) {
+	const unsigned int channels = static_cast< unsigned int >(state.range(CHANNELS_RANGE));
+	// Leaving out the first channel is what happens for a microphone that is only connected to the right one
+	const quint64 mask = state.range(MASKED_RANGE) != 0 ? ~1ULL : ~0ULL;
+
+	const AudioKernels::Downmix mix = accelerated(state) ? AudioKernels::chooseDownmix(format, channels, mask)
+														 : AudioKernels::Scalar::chooseDownmix(format, channels, mask);
+
+	for (auto _ : state) {
+		mix(mixed.data(), input, FRAMES, channels, mask);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES * channels));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_downmixFloat)(::benchmark::State &state) {
+	downmix(state, AudioKernels::SampleFormat::Float, floats.data());
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_downmixShort)(::benchmark::State &state) {
+	downmix(state, AudioKernels::SampleFormat::Short, shorts.data());
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_downmixFloat)
+	->ArgsProduct({ { 0, 1 }, { 1, 2, 4, 6, 8 }, { 0, 1 } })
+	->ArgNames({ "accelerated", "channels", "masked" });
+
+BENCHMARK_REGISTER_F(Fixture, BM_downmixShort)
+	->ArgsProduct({ { 0, 1 }, { 1, 2, 4, 6, 8 }, { 0, 1 } })
+	->ArgNames({ "accelerated", "channels", "masked" });
+
+BENCHMARK_DEFINE_F(Fixture, BM_floatToShort)(::benchmark::State &state) {
+	const bool useAccelerated = accelerated(state);
+
+	for (auto _ : state) {
+		if (useAccelerated) {
+			AudioKernels::floatToShort(floats.data(), shorts.data(), FRAMES);
+		} else {
+			AudioKernels::Scalar::floatToShort(floats.data(), shorts.data(), FRAMES);
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_floatToShort)->Arg(0)->Arg(1)->ArgName("accelerated");
+
+BENCHMARK_DEFINE_F(Fixture, BM_shortToFloat)(::benchmark::State &state) {
+	const bool useAccelerated = accelerated(state);
+
+	for (auto _ : state) {
+		if (useAccelerated) {
+			AudioKernels::shortToFloat(shorts.data(), mixed.data(), FRAMES);
+		} else {
+			AudioKernels::Scalar::shortToFloat(shorts.data(), mixed.data(), FRAMES);
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_shortToFloat)->Arg(0)->Arg(1)->ArgName("accelerated");
+
+BENCHMARK_DEFINE_F(Fixture, BM_dot)(::benchmark::State &state) {
+	const bool useAccelerated = accelerated(state);
+	// The number of taps the resampler's filter has when upsampling
+	const std::size_t taps = 32;
+
+	float sum = 0.0f;
+	for (auto _ : state) {
+		for (std::size_t i = 0; i + taps <= FRAMES; i += taps) {
+			sum += useAccelerated ? AudioKernels::dot(floats.data() + i, mixed.data() + i, taps)
+								  : AudioKernels::Scalar::dot(floats.data() + i, mixed.data() + i, taps);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * (FRAMES / taps) * taps));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_dot)->Arg(0)->Arg(1)->ArgName("accelerated");
+
+// Mixes the given number of sources (10 ms of mono speech or stereo samples each) into the planes of a stereo output
+// the way AudioOutput::mix does, including the interleaving and the conversion to 16-bit PCM
+BENCHMARK_DEFINE_F(Fixture, BM_mixSources)(::benchmark::State &state) {
+	const bool useAccelerated  = accelerated(state);
+	const unsigned int sources = static_cast< unsigned int >(state.range(1));
+	const bool stereo          = state.range(2) != 0;
+
+	constexpr unsigned int OUTPUT_CHANNELS = 2;
+	// A positional source's volume changes over the chunk
+	const float increment = 0.1f / static_cast< float >(FRAMES);
+
+	std::vector< float > planes(FRAMES * OUTPUT_CHANNELS);
+	std::vector< float > output(FRAMES * OUTPUT_CHANNELS);
+	std::vector< short > converted(FRAMES * OUTPUT_CHANNELS);
+
+	for (auto _ : state) {
+		std::fill(planes.begin(), planes.end(), 0.0f);
+
+		for (unsigned int i = 0; i < sources; ++i) {
+			// The sources share the random samples, as there are only MAX_CHANNELS * FRAMES of them
+			const float *source = floats.data() + (i % (MAX_CHANNELS / 2)) * FRAMES * 2;
+			const float gain    = 0.5f + static_cast< float >(i) / static_cast< float >(2 * sources);
+
+			for (unsigned int s = 0; s < OUTPUT_CHANNELS; ++s) {
+				float *plane      = planes.data() + s * FRAMES;
+				const float left  = s == 0 ? 1.0f : 0.0f;
+				const float right = 1.0f - left;
+
+				if (stereo && useAccelerated) {
+					AudioKernels::accumulatePanned(plane, source, FRAMES, left, right, gain);
+				} else if (stereo) {
+					AudioKernels::Scalar::accumulatePanned(plane, source, FRAMES, left, right, gain);
+				} else if (useAccelerated) {
+					AudioKernels::accumulateRamp(plane, source, FRAMES, gain, increment);
+				} else {
+					AudioKernels::Scalar::accumulateRamp(plane, source, FRAMES, gain, increment);
+				}
+			}
+		}
+
+		if (useAccelerated) {
+			AudioKernels::interleave(planes.data(), output.data(), OUTPUT_CHANNELS, FRAMES);
+			AudioKernels::floatToShort(output.data(), converted.data(), output.size());
+		} else {
+			AudioKernels::Scalar::interleave(planes.data(), output.data(), OUTPUT_CHANNELS, FRAMES);
+			AudioKernels::Scalar::floatToShort(output.data(), converted.data(), output.size());
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES * sources));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_mixSources)
+	->ArgsProduct({ { 0, 1 }, { 1, 2, 4, 8, 16, 32, 64 }, { 0, 1 } })
+	->ArgNames({ "accelerated", "sources", "stereo" });
+
+// Resamples the mix of the audio output (at 48 kHz) to the rate of a device
+BENCHMARK_DEFINE_F(Fixture, BM_resample)(::benchmark::State &state) {
+	const unsigned int channels = static_cast< unsigned int >(state.range(0));
+	const unsigned int rate     = static_cast< unsigned int >(state.range(1));
+	state.SetLabel(AudioKernels::backendName());
+
+	AudioResampler resampler(channels, 48000, rate);
+	const unsigned int outFrames = (FRAMES * rate) / 48000;
+
+	std::vector< float > in(resampler.maxInputFramesFor(outFrames) * channels);
+	std::vector< float > out(outFrames * channels);
+	for (float &sample : in) {
+		sample = random_sample(rng);
+	}
+
+	for (auto _ : state) {
+		const unsigned int inFrames = resampler.inputFramesFor(outFrames);
+		resampler.process(in.data(), inFrames, out.data(), outFrames);
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * outFrames * channels));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_resample)
+	->ArgsProduct({ { 1, 2, 8 }, { 44100, 32000, 96000 } })
+	->ArgNames({ "channels", "rate" });
+
+// Spatializes the given number of positional sources (10 ms each), all of which move around the listener, so that the
+// filters are rebuilt in every block
+BENCHMARK_DEFINE_F(Fixture, BM_spatialize)(::benchmark::State &state) {
+	const unsigned int sources = static_cast< unsigned int >(state.range(0));
+	state.SetLabel(AudioKernels::backendName());
+
+	const std::shared_ptr< const AudioSpatializer::Dataset > dataset = AudioSpatializer::dataset(48000);
+	std::vector< std::unique_ptr< AudioSpatializer > > spatializers;
+	for (unsigned int i = 0; i < sources; ++i) {
+		spatializers.push_back(std::make_unique< AudioSpatializer >(dataset));
+	}
+
+	std::vector< float > left(FRAMES);
+	std::vector< float > right(FRAMES);
+	float angle = 0.0f;
+
+	for (auto _ : state) {
+		std::fill(left.begin(), left.end(), 0.0f);
+		std::fill(right.begin(), right.end(), 0.0f);
+
+		for (unsigned int i = 0; i < sources; ++i) {
+			const float azimuth                    = angle + static_cast< float >(i);
+			const std::array< float, 3 > direction = { std::sin(azimuth), 0.0f, std::cos(azimuth) };
+
+			spatializers[i]->process(floats.data() + (i % MAX_CHANNELS) * FRAMES, FRAMES, direction, 0.5f, 0.5f,
+									 left.data(), right.data());
+		}
+		angle += 0.5f;
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES * sources));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_spatialize)->RangeMultiplier(2)->Range(1, 64)->ArgName("sources");
+
+// Shortens or lengthens 10 ms of voiced speech (a 150 Hz tone with a few harmonics), as the jitter buffer does when
+// its level strays from the delay it aims for
+BENCHMARK_DEFINE_F(Fixture, BM_timeStretch)(::benchmark::State &state) {
+	const unsigned int channels = static_cast< unsigned int >(state.range(0));
+	const bool lengthen         = state.range(1) != 0;
+	state.SetLabel(AudioKernels::backendName());
+
+	AudioTimeStretcher stretcher(48000, channels, 2 * FRAMES);
+
+	std::vector< float > speech(FRAMES * channels);
+	for (unsigned int i = 0; i < FRAMES; ++i) {
+		const float phase  = 2.0f * static_cast< float >(M_PI) * 150.0f * static_cast< float >(i) / 48000.0f;
+		const float sample = 0.5f * std::sin(phase) + 0.25f * std::sin(2.0f * phase) + 0.1f * std::sin(3.0f * phase);
+		std::fill(speech.begin() + i * channels, speech.begin() + (i + 1) * channels, sample);
+	}
+	std::vector< float > frames(2 * FRAMES * channels);
+
+	for (auto _ : state) {
+		std::copy(speech.begin(), speech.end(), frames.begin());
+		if (lengthen) {
+			benchmark::DoNotOptimize(stretcher.lengthen(frames.data(), FRAMES, 2 * FRAMES, false));
+		} else {
+			benchmark::DoNotOptimize(stretcher.shorten(frames.data(), FRAMES, false));
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * FRAMES * channels));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_timeStretch)
+	->ArgsProduct({ { 1, 2 }, { 0, 1 } })
+	->ArgNames({ "channels", "lengthen" });
+
+BENCHMARK_MAIN();
@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
 std::random_device rd;
@@ -109,6 +110,48 @@ BENCHMARK_REGISTER_F(Fixture, BM_addReceiver)
 	->ArgsProduct({ benchmark::CreateRange(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END, /*multi=*/MULTIPLIER),
 					{ 0, 10, 40, 80 } });
 
+// The way AudioReceiverBuffer used to find duplicate receivers (looking them up in a hash map that has to be cleared
+// for every packet). This serves as the baseline for BM_addReceiver.
+BENCHMARK_DEFINE_F(Fixture, BM_addReceiver_hashMapBaseline)(::benchmark::State &state) {
+	std::vector< AudioReceiver > receivers;
+	std::unordered_map< const ServerUser *, std::size_t > receiverIndices;
+
+	ServerUser sender = users[users.size() - 1];
+
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < selectedData.size(); ++i) {
+			ReceiverData &data = selectedData[i];
+
+			if (sender.uiSession == data.receiver->uiSession || data.receiver->bDeaf || data.receiver->bSelfDeaf) {
+				continue;
+			}
+
+			auto it = receiverIndices.find(data.receiver);
+			if (it == receiverIndices.end()) {
+				receivers.emplace_back(*data.receiver, data.context, data.volumeAdjustment);
+				receiverIndices[data.receiver] = receivers.size() - 1;
+			} else {
+				AudioReceiver &entry = receivers[it->second];
+
+				entry.setContext(std::min(entry.getContext(), data.context));
+				if (entry.getVolumeAdjustment().factor < data.volumeAdjustment.factor) {
+					entry.setVolumeAdjustment(data.volumeAdjustment);
+				}
+			}
+		}
+
+		benchmark::DoNotOptimize(receivers.data());
+
+		receivers.clear();
+		receiverIndices.clear();
+	}
+
+	state.counters["unique receivers"] = getUniqueReceivers(selectedData);
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_addReceiver_hashMapBaseline)
+	->ArgsProduct({ { RECEIVER_COUNT_END }, { 0, 10, 40, 80 } });
+
 
 unsigned int dummyProcessing(const AudioReceiver &receiver) {
 	return receiver.getReceiver().uiSession;
@@ -0,0 +1,86 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <benchmark/benchmark.h>
+
+#include "crypto/CryptStateOCB2.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, 255);
+
+constexpr const std::size_t RECEIVER_COUNT_RANGE = 0;
+
+constexpr int MULTIPLIER           = 2;
+constexpr int RECEIVER_COUNT_BEGIN = 1;
+constexpr int RECEIVER_COUNT_END   = 512;
+
+// The size of a typical Opus voice packet
+constexpr unsigned int PACKET_SIZE = 120;
+
+std::vector< std::unique_ptr< CryptStateOCB2 > > states;
+std::vector< std::vector< unsigned char > > outputs;
+std::vector< CryptBatchEntry > entries;
+unsigned char packet[PACKET_SIZE];
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		const std::size_t receivers = static_cast< std::size_t >(state.range(RECEIVER_COUNT_RANGE));
+
+		states.clear();
+		outputs.clear();
+		entries.clear();
+
+		for (std::size_t i = 0; i < receivers; ++i) {
+			states.push_back(std::make_unique< CryptStateOCB2 >());
+			states.back()->genKey();
+			outputs.push_back(std::vector< unsigned char >(PACKET_SIZE + 4));
+			entries.push_back({ states.back().get(), outputs.back().data(), false });
+		}
+
+		for (std::size_t i = 0; i < PACKET_SIZE; ++i) {
+			packet[i] = static_cast< unsigned char >(random_byte(rng));
+		}
+	}
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_encryptLoop)(::benchmark::State &state) {
+	for (auto _ : state) {
+		for (std::size_t i = 0; i < states.size(); ++i) {
+			benchmark::DoNotOptimize(states[i]->encrypt(packet, outputs[i].data(), PACKET_SIZE));
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * states.size()));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptLoop)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END);
+
+BENCHMARK_DEFINE_F(Fixture, BM_encryptBatch)(::benchmark::State &state) {
+	for (auto _ : state) {
+		CryptState::encryptBatch(packet, PACKET_SIZE, entries.data(), entries.size());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * entries.size()));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encryptBatch)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(RECEIVER_COUNT_BEGIN, RECEIVER_COUNT_END);
+
+
+int main(int argc, char **argv) {
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
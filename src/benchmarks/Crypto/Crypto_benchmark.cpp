@@ -0,0 +1,297 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Measures everything in src/crypto (and the password hashing of the server): the voice encryption of every crypt mode
+// (OCB2 with and without the CPU's AES instructions, AES-GCM and ChaCha20-Poly1305) at typical voice packet sizes,
+// including the paths taken for late and lost packets, as well as hashing and PBKDF2.
+//
+// The label of every run names the implementation. The AEAD modes and the hashes use whatever OpenSSL chooses for the
+// CPU, which can be restricted with the OPENSSL_ia32cap environment variable (e.g. OPENSSL_ia32cap="~0x200000200000000"
+// disables AES-NI and PCLMULQDQ) to measure the other instruction sets.
+
+#include <benchmark/benchmark.h>
+
+#include "PBKDF2.h"
+#include "crypto/CryptState.h"
+#include "crypto/CryptStateOCB2.h"
+#include "crypto/CryptographicHash.h"
+#include "crypto/OCB2Accelerated.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, 255);
+
+constexpr const std::size_t IMPLEMENTATION_RANGE = 0;
+constexpr const std::size_t SIZE_RANGE           = 1;
+constexpr const std::size_t ORDER_RANGE          = 2;
+
+enum Implementation { OCB2_PORTABLE, OCB2_ACCELERATED, AES128_GCM, CHACHA20_POLY1305 };
+
+constexpr int FIRST_IMPLEMENTATION = OCB2_PORTABLE;
+constexpr int LAST_IMPLEMENTATION  = CHACHA20_POLY1305;
+
+// From a tiny Opus frame up to a large one
+const std::vector< std::int64_t > PACKET_SIZES = { 20, 60, 120, 200 };
+
+/// The order in which the decrypting side receives the packets
+enum Order {
+	IN_ORDER,
+	/// Every pair of packets is swapped, so that every other packet is late
+	SWAPPED,
+	/// Every other packet is lost
+	LOSSY
+};
+
+// The amount of packets that are encrypted in one go for the decryption benchmarks
+constexpr std::size_t POOL_SIZE = 256;
+
+// The amount of receivers for the batch encryption
+constexpr std::size_t RECEIVERS = 32;
+
+static const char *implementationName(int implementation) {
+	switch (implementation) {
+		case OCB2_PORTABLE:
+			return "OCB2-AES128 (portable)";
+		case OCB2_ACCELERATED:
+			return "OCB2-AES128 (AES-NI)";
+		case AES128_GCM:
+			return "AES128-GCM";
+		case CHACHA20_POLY1305:
+			return "ChaCha20-Poly1305";
+	}
+
+	return "";
+}
+
+/// @returns A new (keyless) state of the given implementation or nullptr if it isn't supported on this machine
+static std::unique_ptr< CryptState > createState(int implementation) {
+	switch (implementation) {
+		case OCB2_PORTABLE:
+		case OCB2_ACCELERATED: {
+			const bool accelerated = implementation == OCB2_ACCELERATED;
+			if (accelerated && !OCB2Accelerated::isSupported()) {
+				return nullptr;
+			}
+
+			std::unique_ptr< CryptStateOCB2 > state = std::make_unique< CryptStateOCB2 >();
+			state->setAccelerated(accelerated);
+			return state;
+		}
+		case AES128_GCM:
+			return CryptState::create(CryptMode::AES128_GCM);
+		case CHACHA20_POLY1305:
+			return CryptState::create(CryptMode::CHACHA20_POLY1305);
+	}
+
+	return nullptr;
+}
+
+/// Creates a sender and a receiver that share a key
+///
+/// @returns Whether the implementation is supported. Skips the benchmark if it isn't.
+static bool createPair(::benchmark::State &state, std::unique_ptr< CryptState > &sender,
+					   std::unique_ptr< CryptState > &receiver) {
+	const int implementation = static_cast< int >(state.range(IMPLEMENTATION_RANGE));
+	state.SetLabel(implementationName(implementation));
+
+	sender   = createState(implementation);
+	receiver = createState(implementation);
+	if (!sender || !receiver) {
+		state.SkipWithError("Not supported on this machine");
+		return false;
+	}
+
+	sender->genKey();
+	receiver->setKey(sender->getRawKey(), sender->getDecryptIV(), sender->getEncryptIV());
+
+	return true;
+}
+
+static std::vector< unsigned char > randomBytes(std::size_t size) {
+	std::vector< unsigned char > bytes(size);
+	for (unsigned char &byte : bytes) {
+		byte = static_cast< unsigned char >(random_byte(rng));
+	}
+
+	return bytes;
+}
+
+static void encrypt(::benchmark::State &state) {
+	std::unique_ptr< CryptState > sender;
+	std::unique_ptr< CryptState > receiver;
+	if (!createPair(state, sender, receiver)) {
+		return;
+	}
+
+	const unsigned int size                   = static_cast< unsigned int >(state.range(SIZE_RANGE));
+	const std::vector< unsigned char > packet = randomBytes(size);
+	std::vector< unsigned char > encrypted(size + sender->overhead());
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sender->encrypt(packet.data(), encrypted.data(), size));
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations()));
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations() * size));
+}
+
+static void decrypt(::benchmark::State &state) {
+	std::unique_ptr< CryptState > sender;
+	std::unique_ptr< CryptState > receiver;
+	if (!createPair(state, sender, receiver)) {
+		return;
+	}
+
+	const unsigned int size                   = static_cast< unsigned int >(state.range(SIZE_RANGE));
+	const unsigned int encryptedSize          = size + sender->overhead();
+	const Order order                         = static_cast< Order >(state.range(ORDER_RANGE));
+	const std::vector< unsigned char > packet = randomBytes(size);
+
+	std::vector< std::vector< unsigned char > > pool(POOL_SIZE, std::vector< unsigned char >(encryptedSize));
+	std::vector< unsigned char > decrypted(size);
+
+	// The indices of the packets of the pool in the order in which they are received
+	std::vector< std::size_t > received;
+	for (std::size_t i = 0; i < POOL_SIZE; ++i) {
+		switch (order) {
+			case IN_ORDER:
+				received.push_back(i);
+				break;
+			case SWAPPED:
+				received.push_back(i ^ 1);
+				break;
+			case LOSSY:
+				if (i % 2 == 0) {
+					received.push_back(i);
+				}
+				break;
+		}
+	}
+
+	std::size_t next    = received.size();
+	std::int64_t failed = 0;
+
+	for (auto _ : state) {
+		if (next == received.size()) {
+			// The nonces keep increasing, so that the receiver never sees the same packet twice
+			state.PauseTiming();
+			for (std::vector< unsigned char > &encrypted : pool) {
+				sender->encrypt(packet.data(), encrypted.data(), size);
+			}
+			next = 0;
+			state.ResumeTiming();
+		}
+
+		if (!receiver->decrypt(pool[received[next++]].data(), decrypted.data(), encryptedSize)) {
+			++failed;
+		}
+		benchmark::ClobberMemory();
+	}
+
+	if (failed != 0) {
+		state.SkipWithError("Decryption failed");
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations()));
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations() * size));
+}
+
+static void encryptBatch(::benchmark::State &state) {
+	const int implementation = static_cast< int >(state.range(IMPLEMENTATION_RANGE));
+	state.SetLabel(implementationName(implementation));
+
+	const unsigned int size                   = static_cast< unsigned int >(state.range(SIZE_RANGE));
+	const std::vector< unsigned char > packet = randomBytes(size);
+
+	std::vector< std::unique_ptr< CryptState > > states;
+	std::vector< std::vector< unsigned char > > outputs;
+	std::vector< CryptBatchEntry > entries;
+	for (std::size_t i = 0; i < RECEIVERS; ++i) {
+		states.push_back(createState(implementation));
+		if (!states.back()) {
+			state.SkipWithError("Not supported on this machine");
+			return;
+		}
+		states.back()->genKey();
+		outputs.emplace_back(size + states.back()->overhead());
+	}
+	for (std::size_t i = 0; i < RECEIVERS; ++i) {
+		entries.push_back({ states[i].get(), outputs[i].data(), false });
+	}
+
+	for (auto _ : state) {
+		CryptState::encryptBatch(packet.data(), size, entries.data(), entries.size());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * RECEIVERS));
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations() * RECEIVERS * size));
+}
+
+static void hash(::benchmark::State &state) {
+	const CryptographicHash::Algorithm algorithm = static_cast< CryptographicHash::Algorithm >(state.range(0));
+	state.SetLabel(CryptographicHash::humanReadableAlgorithmName(algorithm).toStdString());
+
+	const std::size_t size                   = static_cast< std::size_t >(state.range(1));
+	const std::vector< unsigned char > bytes = randomBytes(size);
+	const QByteArray blob(reinterpret_cast< const char * >(bytes.data()), static_cast< int >(size));
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(CryptographicHash::hash(blob, algorithm));
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(state.iterations() * size));
+}
+
+static void pbkdf2(::benchmark::State &state) {
+	const int iterations = static_cast< int >(state.range(0));
+	const QString salt   = PBKDF2::getSalt();
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(PBKDF2::getHash(salt, QLatin1String("correct horse battery staple"), iterations));
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations()));
+}
+
+BENCHMARK(encrypt)
+	->ArgsProduct({ benchmark::CreateDenseRange(FIRST_IMPLEMENTATION, LAST_IMPLEMENTATION, 1), PACKET_SIZES })
+	->ArgNames({ "implementation", "size" });
+
+BENCHMARK(decrypt)
+	->ArgsProduct({ benchmark::CreateDenseRange(FIRST_IMPLEMENTATION, LAST_IMPLEMENTATION, 1), PACKET_SIZES,
+					{ IN_ORDER, SWAPPED, LOSSY } })
+	->ArgNames({ "implementation", "size", "order" });
+
+BENCHMARK(encryptBatch)
+	->ArgsProduct({ benchmark::CreateDenseRange(FIRST_IMPLEMENTATION, LAST_IMPLEMENTATION, 1), PACKET_SIZES })
+	->ArgNames({ "implementation", "size" });
+
+BENCHMARK(hash)
+	->ArgsProduct({ { CryptographicHash::Sha1, CryptographicHash::Sha256 }, { 64, 1024, 64 * 1024, 1024 * 1024 } })
+	->ArgNames({ "algorithm", "size" });
+
+int main(int argc, char **argv) {
+	::benchmark::Initialize(&argc, argv);
+
+	// PBKDF2 is measured at the iteration counts the server uses: the minimum and what it determines for this machine
+	// (if the configuration doesn't set one)
+	::benchmark::RegisterBenchmark("pbkdf2", pbkdf2)
+		->Arg(PBKDF2::BENCHMARK_MINIMUM_ITERATION_COUNT)
+		->Arg(PBKDF2::benchmark())
+		->ArgName("iterations")
+		->Unit(benchmark::kMillisecond);
+
+	::benchmark::RunSpecifiedBenchmarks();
+}
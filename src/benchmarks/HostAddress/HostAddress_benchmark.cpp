@@ -0,0 +1,148 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Compares hashing, comparing and looking up HostAddress (which keeps its hash around) with the previous
+// implementation, which hashed all 16 bytes with qHashRange() and compared them as an array. The lookups are what the
+// server does with qhHostUsers for every connection and ban check.
+
+#include <benchmark/benchmark.h>
+
+#include "HostAddress.h"
+
+#include <QtCore/QHash>
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/// HostAddress as it used to be
+struct LegacyHostAddress {
+	std::array< std::uint8_t, 16 > bytes;
+
+	explicit LegacyHostAddress(const HostAddress &address) : bytes(address.getByteRepresentation()) {}
+
+	bool operator==(const LegacyHostAddress &other) const { return bytes == other.bytes; }
+};
+
+quint32 qHash(const LegacyHostAddress &address) {
+	return qHashRange(address.bytes.begin(), address.bytes.end());
+}
+
+constexpr const std::size_t LEGACY_RANGE = 0;
+constexpr const std::size_t V6_RANGE     = 1;
+
+// A rather big server
+constexpr std::size_t ADDRESSES = 4096;
+
+std::mt19937 rng(42);
+
+std::vector< HostAddress > addresses;
+std::vector< LegacyHostAddress > legacyAddresses;
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		const bool v6 = state.range(V6_RANGE) != 0;
+
+		addresses.clear();
+		legacyAddresses.clear();
+
+		for (std::size_t i = 0; i < ADDRESSES; ++i) {
+			HostAddress address;
+			if (v6) {
+				// Addresses of the same /64, just like many clients of one provider
+				address.setByte(0, 0x20);
+				address.setByte(1, 0x01);
+				for (std::size_t j = 8; j < 16; ++j) {
+					address.setByte(j, static_cast< std::uint8_t >(rng()));
+				}
+			} else {
+				address.fromIPv4(static_cast< std::uint32_t >(rng()));
+			}
+
+			addresses.push_back(address);
+			legacyAddresses.emplace_back(address);
+		}
+	}
+};
+
+static bool legacy(::benchmark::State &state) {
+	const bool legacy = state.range(LEGACY_RANGE) != 0;
+	state.SetLabel(legacy ? "Legacy" : "Cached hash");
+
+	return legacy;
+}
+
+template< typename Address > static void hash(::benchmark::State &state, const std::vector< Address > &input) {
+	for (auto _ : state) {
+		quint32 sum = 0;
+		for (const Address &address : input) {
+			sum += qHash(address);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * input.size()));
+}
+
+template< typename Address > static void compare(::benchmark::State &state, const std::vector< Address > &input) {
+	for (auto _ : state) {
+		std::size_t equal = 0;
+		// Every address is compared with its neighbour, which is what happens when walking a hash bucket
+		for (std::size_t i = 1; i < input.size(); ++i) {
+			equal += input[i] == input[i - 1];
+		}
+		benchmark::DoNotOptimize(equal);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * (input.size() - 1)));
+}
+
+template< typename Address > static void lookup(::benchmark::State &state, const std::vector< Address > &input) {
+	QHash< Address, int > table;
+	for (std::size_t i = 0; i < input.size(); ++i) {
+		table.insert(input[i], static_cast< int >(i));
+	}
+
+	for (auto _ : state) {
+		int sum = 0;
+		for (const Address &address : input) {
+			sum += table.value(address);
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations() * input.size()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_hash)(::benchmark::State &state) {
+	if (legacy(state)) {
+		hash(state, legacyAddresses);
+	} else {
+		hash(state, addresses);
+	}
+}
+BENCHMARK_REGISTER_F(Fixture, BM_hash)->ArgsProduct({ { 0, 1 }, { 0, 1 } })->ArgNames({ "legacy", "v6" });
+
+BENCHMARK_DEFINE_F(Fixture, BM_compare)(::benchmark::State &state) {
+	if (legacy(state)) {
+		compare(state, legacyAddresses);
+	} else {
+		compare(state, addresses);
+	}
+}
+BENCHMARK_REGISTER_F(Fixture, BM_compare)->ArgsProduct({ { 0, 1 }, { 0, 1 } })->ArgNames({ "legacy", "v6" });
+
+BENCHMARK_DEFINE_F(Fixture, BM_lookup)(::benchmark::State &state) {
+	if (legacy(state)) {
+		lookup(state, legacyAddresses);
+	} else {
+		lookup(state, addresses);
+	}
+}
+BENCHMARK_REGISTER_F(Fixture, BM_lookup)->ArgsProduct({ { 0, 1 }, { 0, 1 } })->ArgNames({ "legacy", "v6" });
+
+BENCHMARK_MAIN();
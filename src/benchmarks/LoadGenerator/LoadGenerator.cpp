@@ -0,0 +1,605 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// A headless load generator that connects many simulated clients to a server and has them talk the way people do:
+// in talk spurts of Opus-sized frames that alternate with silence, sometimes whispering to another channel instead of
+// speaking in their own, and moving between channels every now and then. Every client measures the latency of the
+// frames it receives from the others (each frame carries the time at which it has been sent, all clients share the
+// same clock) and how many of them have been lost.
+//
+// Loss is estimated from the gaps between the frames of the same talk spurt a client receives, so a client that
+// joins a channel in the middle of a spurt doesn't count the frames it has never been meant to hear. Voice is only
+// sent via UDP.
+//
+// Run with --help for the available options. Note that the server's connection throttling (see the
+// autobanAttempts setting) and its user limit have to allow for the number of clients.
+
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+#include "ProtoUtils.h"
+#include "Version.h"
+#include "crypto/CryptState.h"
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QtEndian>
+#include <QtNetwork/QHostInfo>
+#include <QtNetwork/QSslSocket>
+#include <QtNetwork/QUdpSocket>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Options {
+	QHostAddress host;
+	quint16 port = 64738;
+	QString password;
+	QString namePrefix   = QLatin1String("load-");
+	unsigned int clients = 100;
+	unsigned int threads = 4;
+	/// How long the clients talk for (in seconds), once all of them have connected
+	unsigned int duration = 60;
+	/// The time between two clients connecting (in milliseconds)
+	unsigned int connectInterval = 10;
+	/// The mean duration of talk spurts and of the silence between them (in milliseconds)
+	unsigned int talkMs    = 1500;
+	unsigned int silenceMs = 4500;
+	/// The size of the (random) Opus payload of every frame, 20 ms at 40 kbit/s by default
+	unsigned int frameBytes = 100;
+	/// The share of talk spurts that are whispered to another channel
+	double whisperShare = 0.1;
+	/// How often every client moves to another channel
+	double movesPerMinute = 0.5;
+	/// Whether the statistics of every receiver are printed
+	bool perReceiver = false;
+};
+
+/// Voice frames are sent every 20 ms, which is what a client does with the default audio settings
+constexpr int FRAME_INTERVAL_MS = 20;
+/// A frame covers two 10 ms blocks of audio, by which frame numbers advance
+constexpr std::uint64_t FRAMES_PER_PACKET = 2;
+/// The whisper target the clients whisper to
+constexpr unsigned int WHISPER_TARGET = 1;
+/// The latency histogram has buckets of this many microseconds
+constexpr unsigned int LATENCY_BUCKET_US = 100;
+/// Latencies beyond LATENCY_BUCKET_COUNT * LATENCY_BUCKET_US end up in the last bucket
+constexpr std::size_t LATENCY_BUCKET_COUNT = 2000;
+
+/// What every frame's payload starts with
+struct FrameHeader {
+	/// When the frame has been sent, in microseconds since the load generator has been started
+	std::int64_t sent;
+	/// The talk spurt of the sender the frame is part of and the frame's position in it
+	std::uint32_t spurt;
+	std::uint32_t index;
+};
+
+QElapsedTimer clock;
+
+std::int64_t now() {
+	return clock.nsecsElapsed() / 1000;
+}
+
+struct ReceiverStats {
+	std::uint64_t frames    = 0;
+	std::uint64_t lost      = 0;
+	std::int64_t maxLatency = 0;
+	std::array< std::uint64_t, LATENCY_BUCKET_COUNT > latencies = {};
+
+	void add(const ReceiverStats &other) {
+		frames += other.frames;
+		lost += other.lost;
+		maxLatency = std::max(maxLatency, other.maxLatency);
+		for (std::size_t i = 0; i < latencies.size(); ++i) {
+			latencies[i] += other.latencies[i];
+		}
+	}
+
+	/// @returns The given percentile of the latencies in milliseconds
+	double latency(double percentile) const {
+		const std::uint64_t rank = static_cast< std::uint64_t >(static_cast< double >(frames) * percentile);
+		std::uint64_t seen       = 0;
+		for (std::size_t i = 0; i < latencies.size(); ++i) {
+			seen += latencies[i];
+			if (seen > rank) {
+				return static_cast< double >((i + 1) * LATENCY_BUCKET_US) / 1000.0;
+			}
+		}
+		return static_cast< double >(maxLatency) / 1000.0;
+	}
+
+	double lossRate() const {
+		const std::uint64_t expected = frames + lost;
+		return expected > 0 ? static_cast< double >(lost) / static_cast< double >(expected) : 0.0;
+	}
+};
+
+/// A simulated client. It is created by the main thread and then lives in one of the worker threads, so apart from
+/// the constructor, everything but the statistics (which are read once the worker threads have finished) is only
+/// touched by that thread.
+class Client : public QObject {
+public:
+	Client(const Options &options, unsigned int index, std::uint32_t seed)
+		: m_options(options), m_index(index), m_rng(seed), m_tcp(new QSslSocket(this)), m_udp(new QUdpSocket(this)),
+		  m_frameTimer(new QTimer(this)), m_spurtTimer(new QTimer(this)), m_moveTimer(new QTimer(this)),
+		  m_pingTimer(new QTimer(this)), m_encoder(Version::get()), m_decoder(Version::get()) {
+		m_tcp->setPeerVerifyMode(QSslSocket::VerifyNone);
+
+		connect(m_tcp, &QSslSocket::encrypted, this, [this]() { sendHandshake(); });
+		connect(m_tcp, &QSslSocket::readyRead, this, [this]() { readTCP(); });
+		connect(m_tcp, &QSslSocket::disconnected, this, [this]() { stop(); });
+		connect(m_udp, &QUdpSocket::readyRead, this, [this]() { readUDP(); });
+
+		m_frameTimer->setInterval(FRAME_INTERVAL_MS);
+		m_frameTimer->setTimerType(Qt::PreciseTimer);
+		connect(m_frameTimer, &QTimer::timeout, this, [this]() { sendFrame(); });
+
+		m_spurtTimer->setSingleShot(true);
+		connect(m_spurtTimer, &QTimer::timeout, this, [this]() { toggleTalking(); });
+
+		m_moveTimer->setSingleShot(true);
+		connect(m_moveTimer, &QTimer::timeout, this, [this]() { move(); });
+
+		// The server disconnects clients it hasn't heard of in 30 seconds
+		m_pingTimer->setInterval(5000);
+		connect(m_pingTimer, &QTimer::timeout, this, [this]() {
+			MumbleProto::Ping ping;
+			ping.set_timestamp(static_cast< quint64 >(now()));
+			send(Mumble::Protocol::TCPMessageType::Ping, ping);
+		});
+
+		m_payload.resize(std::max< std::size_t >(m_options.frameBytes, sizeof(FrameHeader)));
+		for (Mumble::Protocol::byte &current : m_payload) {
+			current = static_cast< Mumble::Protocol::byte >(m_rng());
+		}
+	}
+
+	void start() { m_tcp->connectToHostEncrypted(m_options.host.toString(), m_options.port); }
+
+	void stop() {
+		m_frameTimer->stop();
+		m_spurtTimer->stop();
+		m_moveTimer->stop();
+		m_pingTimer->stop();
+	}
+
+	/// Disconnects and hands the client back to the main thread, which deletes it
+	void finish() {
+		stop();
+		m_tcp->abort();
+		moveToThread(QCoreApplication::instance()->thread());
+	}
+
+	/// @returns Whether the client has been fully connected (at some point)
+	bool hasConnected() const { return m_session != 0; }
+	std::uint64_t sentFrames() const { return m_sentFrames; }
+	const ReceiverStats &stats() const { return m_stats; }
+	unsigned int session() const { return m_session; }
+	const QString &rejection() const { return m_rejection; }
+
+protected:
+	const Options &m_options;
+	const unsigned int m_index;
+	std::mt19937 m_rng;
+	QSslSocket *m_tcp;
+	QUdpSocket *m_udp;
+	QTimer *m_frameTimer;
+	QTimer *m_spurtTimer;
+	QTimer *m_moveTimer;
+	QTimer *m_pingTimer;
+	QByteArray m_receiveBuffer;
+	std::unique_ptr< CryptState > m_crypt;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Client > m_encoder;
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > m_decoder;
+	std::array< unsigned char, Mumble::Protocol::MAX_UDP_PACKET_SIZE > m_datagram;
+
+	unsigned int m_session = 0;
+	QString m_rejection;
+	std::vector< unsigned int > m_channels;
+
+	bool m_talking              = false;
+	unsigned int m_target       = Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH;
+	std::uint32_t m_spurt       = 0;
+	std::uint32_t m_spurtIndex  = 0;
+	std::uint64_t m_frameNumber = 0;
+	std::uint64_t m_sentFrames  = 0;
+	std::vector< Mumble::Protocol::byte > m_payload;
+
+	/// The last talk spurt and frame received from every sender, by session
+	std::unordered_map< unsigned int, std::pair< std::uint32_t, std::uint32_t > > m_lastFrames;
+	ReceiverStats m_stats;
+
+	/// @returns A random duration (in milliseconds) that is exponentially distributed around the given mean
+	int randomDuration(double mean) {
+		std::exponential_distribution< double > distribution(1.0 / std::max(mean, 1.0));
+		return static_cast< int >(std::min(distribution(m_rng), 3600.0 * 1000.0)) + 1;
+	}
+
+	void send(Mumble::Protocol::TCPMessageType type, const ::google::protobuf::Message &message) {
+		const int size = static_cast< int >(message.ByteSizeLong());
+
+		QByteArray data(size + 6, Qt::Uninitialized);
+		qToBigEndian< quint16 >(static_cast< quint16 >(type), data.data());
+		qToBigEndian< quint32 >(static_cast< quint32 >(size), data.data() + 2);
+		message.SerializeToArray(data.data() + 6, size);
+
+		m_tcp->write(data);
+	}
+
+	void sendHandshake() {
+		MumbleProto::Version version;
+		MumbleProto::setVersion(version, Version::get());
+		version.set_release("LoadGenerator");
+		send(Mumble::Protocol::TCPMessageType::Version, version);
+
+		MumbleProto::Authenticate authenticate;
+		authenticate.set_username(QString::fromLatin1("%1%2").arg(m_options.namePrefix).arg(m_index).toStdString());
+		if (!m_options.password.isEmpty()) {
+			authenticate.set_password(m_options.password.toStdString());
+		}
+		authenticate.set_opus(true);
+		send(Mumble::Protocol::TCPMessageType::Authenticate, authenticate);
+
+		m_pingTimer->start();
+	}
+
+	void readTCP() {
+		m_receiveBuffer.append(m_tcp->readAll());
+
+		while (m_receiveBuffer.size() >= 6) {
+			const uchar *header = reinterpret_cast< const uchar * >(m_receiveBuffer.constData());
+			const auto type     = static_cast< Mumble::Protocol::TCPMessageType >(qFromBigEndian< quint16 >(header));
+			const int length    = static_cast< int >(qFromBigEndian< quint32 >(header + 2));
+			if (m_receiveBuffer.size() < length + 6) {
+				return;
+			}
+
+			handle(type, m_receiveBuffer.constData() + 6, length);
+			m_receiveBuffer.remove(0, length + 6);
+		}
+	}
+
+	void handle(Mumble::Protocol::TCPMessageType type, const char *data, int length) {
+		switch (type) {
+			case Mumble::Protocol::TCPMessageType::CryptSetup: {
+				MumbleProto::CryptSetup msg;
+				if (!msg.ParseFromArray(data, length)) {
+					break;
+				}
+				if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
+					m_crypt = CryptState::create(static_cast< CryptMode >(msg.mode()));
+					if (!m_crypt || !m_crypt->setKey(msg.key(), msg.client_nonce(), msg.server_nonce())) {
+						m_crypt.reset();
+					}
+				} else if (m_crypt && msg.has_server_nonce()) {
+					m_crypt->setDecryptIV(msg.server_nonce());
+				}
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::ChannelState: {
+				MumbleProto::ChannelState msg;
+				if (msg.ParseFromArray(data, length) && msg.has_channel_id()
+					&& std::find(m_channels.begin(), m_channels.end(), msg.channel_id()) == m_channels.end()) {
+					m_channels.push_back(msg.channel_id());
+				}
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::ChannelRemove: {
+				MumbleProto::ChannelRemove msg;
+				if (msg.ParseFromArray(data, length)) {
+					m_channels.erase(std::remove(m_channels.begin(), m_channels.end(), msg.channel_id()),
+									 m_channels.end());
+				}
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::ServerSync: {
+				MumbleProto::ServerSync msg;
+				if (msg.ParseFromArray(data, length)) {
+					m_session = msg.session();
+					ready();
+				}
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::Reject: {
+				MumbleProto::Reject msg;
+				if (msg.ParseFromArray(data, length)) {
+					m_rejection = QString::fromStdString(msg.reason());
+				}
+				m_tcp->disconnectFromHost();
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::UDPTunnel:
+				// The server tunnels voice through TCP until it has received a packet via UDP
+				receiveAudio(reinterpret_cast< const Mumble::Protocol::byte * >(data),
+							 static_cast< std::size_t >(length));
+				break;
+			default:
+				break;
+		}
+	}
+
+	void ready() {
+		// Whispers go to a random channel (which might be the client's own)
+		if (!m_channels.empty()) {
+			MumbleProto::VoiceTarget target;
+			target.set_id(WHISPER_TARGET);
+			target.add_targets()->set_channel_id(m_channels[m_rng() % m_channels.size()]);
+			send(Mumble::Protocol::TCPMessageType::VoiceTarget, target);
+		}
+
+		m_spurtTimer->start(randomDuration(m_options.silenceMs));
+		if (m_options.movesPerMinute > 0) {
+			m_moveTimer->start(randomDuration(60000.0 / m_options.movesPerMinute));
+		}
+	}
+
+	void toggleTalking() {
+		m_talking = !m_talking;
+
+		if (m_talking) {
+			std::uniform_real_distribution< double > share(0.0, 1.0);
+			m_target     = share(m_rng) < m_options.whisperShare ? WHISPER_TARGET
+																 : Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH;
+			m_spurtIndex = 0;
+			m_spurt++;
+
+			m_frameTimer->start();
+			m_spurtTimer->start(randomDuration(m_options.talkMs));
+		} else {
+			// The last frame is sent by the next tick of the frame timer
+			m_spurtTimer->start(randomDuration(m_options.silenceMs));
+		}
+	}
+
+	void move() {
+		if (m_channels.size() > 1) {
+			MumbleProto::UserState state;
+			state.set_session(m_session);
+			state.set_channel_id(m_channels[m_rng() % m_channels.size()]);
+			send(Mumble::Protocol::TCPMessageType::UserState, state);
+		}
+
+		m_moveTimer->start(randomDuration(60000.0 / m_options.movesPerMinute));
+	}
+
+	void sendFrame() {
+		if (!m_crypt) {
+			return;
+		}
+
+		const FrameHeader header = { now(), m_spurt, m_spurtIndex++ };
+		std::memcpy(m_payload.data(), &header, sizeof(header));
+
+		Mumble::Protocol::AudioData audioData;
+		audioData.targetOrContext = m_target;
+		audioData.usedCodec       = Mumble::Protocol::AudioCodec::Opus;
+		audioData.frameNumber     = m_frameNumber;
+		audioData.payload         = { m_payload.data(), m_options.frameBytes };
+		audioData.isLastFrame     = !m_talking;
+		m_frameNumber += FRAMES_PER_PACKET;
+
+		gsl::span< const Mumble::Protocol::byte > packet = m_encoder.encodeAudioPacket(audioData);
+		const unsigned int length = static_cast< unsigned int >(packet.size());
+		if (length + m_crypt->overhead() > m_datagram.size()
+			|| !m_crypt->encrypt(packet.data(), m_datagram.data(), length)) {
+			return;
+		}
+
+		m_udp->writeDatagram(reinterpret_cast< const char * >(m_datagram.data()), length + m_crypt->overhead(),
+							 m_options.host, m_options.port);
+		m_sentFrames++;
+
+		if (audioData.isLastFrame) {
+			m_frameTimer->stop();
+		}
+	}
+
+	void readUDP() {
+		std::array< unsigned char, Mumble::Protocol::MAX_UDP_PACKET_SIZE > plain;
+
+		while (m_udp->hasPendingDatagrams()) {
+			const qint64 size = m_udp->readDatagram(reinterpret_cast< char * >(m_datagram.data()),
+													static_cast< qint64 >(m_datagram.size()));
+			if (!m_crypt || size <= static_cast< qint64 >(m_crypt->overhead())
+				|| !m_crypt->decrypt(m_datagram.data(), plain.data(), static_cast< unsigned int >(size))) {
+				continue;
+			}
+
+			receiveAudio(plain.data(), static_cast< std::size_t >(size) - m_crypt->overhead());
+		}
+	}
+
+	void receiveAudio(const Mumble::Protocol::byte *data, std::size_t length) {
+		if (!m_decoder.decode(gsl::span< const Mumble::Protocol::byte >(data, length))
+			|| m_decoder.getMessageType() != Mumble::Protocol::UDPMessageType::Audio) {
+			return;
+		}
+
+		const Mumble::Protocol::AudioData audioData = m_decoder.getAudioData();
+		if (audioData.payload.size() < sizeof(FrameHeader)) {
+			// Not sent by a load generator
+			return;
+		}
+
+		FrameHeader header;
+		std::memcpy(&header, audioData.payload.data(), sizeof(header));
+
+		const std::int64_t latency = std::max< std::int64_t >(now() - header.sent, 0);
+		m_stats.frames++;
+		m_stats.maxLatency = std::max(m_stats.maxLatency, latency);
+		const std::size_t bucket = static_cast< std::size_t >(latency / LATENCY_BUCKET_US);
+		m_stats.latencies[std::min(bucket, LATENCY_BUCKET_COUNT - 1)]++;
+
+		auto last = m_lastFrames.find(audioData.senderSession);
+		if (last != m_lastFrames.end() && last->second.first == header.spurt && header.index > last->second.second) {
+			m_stats.lost += header.index - last->second.second - 1;
+		}
+		m_lastFrames[audioData.senderSession] = { header.spurt, header.index };
+	}
+};
+
+bool parseOptions(const QCoreApplication &app, Options &options) {
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QLatin1String("Connects simulated clients to a server and measures the latency "
+												   "and loss of the voice they send each other."));
+	parser.addHelpOption();
+
+	const QCommandLineOption host(QLatin1String("host"), QLatin1String("The server's address."), QLatin1String("host"),
+								  QLatin1String("127.0.0.1"));
+	const QCommandLineOption port(QLatin1String("port"), QLatin1String("The server's port."), QLatin1String("port"),
+								  QString::number(options.port));
+	const QCommandLineOption password(QLatin1String("password"), QLatin1String("The server's password."),
+									  QLatin1String("password"));
+	const QCommandLineOption prefix(QLatin1String("name-prefix"), QLatin1String("What the clients' names start with."),
+									QLatin1String("prefix"), options.namePrefix);
+	const QCommandLineOption clients(QLatin1String("clients"), QLatin1String("The number of clients."),
+									 QLatin1String("count"), QString::number(options.clients));
+	const QCommandLineOption threads(QLatin1String("threads"), QLatin1String("The number of threads running them."),
+									 QLatin1String("count"), QString::number(options.threads));
+	const QCommandLineOption duration(QLatin1String("duration"),
+									  QLatin1String("How long the clients talk for once they have connected."),
+									  QLatin1String("seconds"), QString::number(options.duration));
+	const QCommandLineOption connectInterval(QLatin1String("connect-interval"),
+											 QLatin1String("The time between two clients connecting."),
+											 QLatin1String("ms"), QString::number(options.connectInterval));
+	const QCommandLineOption talk(QLatin1String("talk"), QLatin1String("The mean duration of talk spurts."),
+								  QLatin1String("ms"), QString::number(options.talkMs));
+	const QCommandLineOption silence(QLatin1String("silence"), QLatin1String("The mean duration of silence."),
+									 QLatin1String("ms"), QString::number(options.silenceMs));
+	const QCommandLineOption frameBytes(QLatin1String("frame-bytes"), QLatin1String("The payload size of frames."),
+										QLatin1String("bytes"), QString::number(options.frameBytes));
+	const QCommandLineOption whisperShare(QLatin1String("whisper-share"),
+										  QLatin1String("The share of talk spurts that are whispered."),
+										  QLatin1String("share"), QString::number(options.whisperShare));
+	const QCommandLineOption moves(QLatin1String("moves-per-minute"),
+								   QLatin1String("How often every client moves to another channel."),
+								   QLatin1String("rate"), QString::number(options.movesPerMinute));
+	const QCommandLineOption perReceiver(QLatin1String("per-receiver"),
+										 QLatin1String("Print the statistics of every client."));
+	parser.addOptions({ host, port, password, prefix, clients, threads, duration, connectInterval, talk, silence,
+						frameBytes, whisperShare, moves, perReceiver });
+	parser.process(app);
+
+	const QList< QHostAddress > addresses = QHostInfo::fromName(parser.value(host)).addresses();
+	if (addresses.isEmpty()) {
+		qWarning("Failed to resolve %s", qPrintable(parser.value(host)));
+		return false;
+	}
+
+	options.host            = addresses.first();
+	options.port            = static_cast< quint16 >(parser.value(port).toUInt());
+	options.password        = parser.value(password);
+	options.namePrefix      = parser.value(prefix);
+	options.clients         = std::max(parser.value(clients).toUInt(), 1U);
+	options.threads         = std::max(parser.value(threads).toUInt(), 1U);
+	options.duration        = parser.value(duration).toUInt();
+	options.connectInterval = parser.value(connectInterval).toUInt();
+	options.talkMs          = std::max(parser.value(talk).toUInt(), static_cast< unsigned int >(FRAME_INTERVAL_MS));
+	options.silenceMs       = parser.value(silence).toUInt();
+	options.frameBytes      = qBound(static_cast< unsigned int >(sizeof(FrameHeader)), parser.value(frameBytes).toUInt(),
+								 1000U);
+	options.whisperShare    = parser.value(whisperShare).toDouble();
+	options.movesPerMinute  = parser.value(moves).toDouble();
+	options.perReceiver     = parser.isSet(perReceiver);
+
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+
+	Options options;
+	if (!parseOptions(app, options)) {
+		return 1;
+	}
+
+	clock.start();
+
+	std::vector< std::unique_ptr< QThread > > threads;
+	for (unsigned int i = 0; i < options.threads; ++i) {
+		threads.push_back(std::make_unique< QThread >());
+		threads.back()->start();
+	}
+
+	std::random_device rd;
+	std::vector< std::unique_ptr< Client > > clients;
+	for (unsigned int i = 0; i < options.clients; ++i) {
+		clients.push_back(std::make_unique< Client >(options, i, rd()));
+		clients.back()->moveToThread(threads[i % threads.size()].get());
+	}
+
+	// The clients connect one after another and start talking as soon as they are in
+	for (unsigned int i = 0; i < options.clients; ++i) {
+		Client *client = clients[i].get();
+		QTimer::singleShot(static_cast< int >(i * options.connectInterval), client, [client]() { client->start(); });
+	}
+
+	const unsigned int rampUp = options.clients * options.connectInterval;
+	QTimer::singleShot(static_cast< int >(rampUp + options.duration * 1000), &app, &QCoreApplication::quit);
+	app.exec();
+
+	for (const std::unique_ptr< Client > &client : clients) {
+		Client *current = client.get();
+		QMetaObject::invokeMethod(
+			current, [current]() { current->finish(); }, Qt::BlockingQueuedConnection);
+	}
+	for (const std::unique_ptr< QThread > &thread : threads) {
+		thread->quit();
+		thread->wait();
+	}
+
+	ReceiverStats total;
+	std::uint64_t sent     = 0;
+	unsigned int connected = 0;
+	std::vector< const Client * > receivers;
+	for (const std::unique_ptr< Client > &client : clients) {
+		if (client->hasConnected()) {
+			connected++;
+		} else if (!client->rejection().isEmpty()) {
+			qWarning("Client %u has been rejected: %s", static_cast< unsigned int >(&client - clients.data()),
+					 qPrintable(client->rejection()));
+		}
+		sent += client->sentFrames();
+		total.add(client->stats());
+		receivers.push_back(client.get());
+	}
+
+	std::printf("Clients:  %u of %u connected\n", connected, options.clients);
+	std::printf("Frames:   %llu sent, %llu received, %llu lost (%.3f %%)\n", static_cast< unsigned long long >(sent),
+				static_cast< unsigned long long >(total.frames), static_cast< unsigned long long >(total.lost),
+				total.lossRate() * 100.0);
+	std::printf("Latency:  p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n", total.latency(0.5),
+				total.latency(0.9), total.latency(0.99), static_cast< double >(total.maxLatency) / 1000.0);
+
+	// The receivers with the highest loss come first
+	std::sort(receivers.begin(), receivers.end(), [](const Client *lhs, const Client *rhs) {
+		return lhs->stats().lossRate() > rhs->stats().lossRate();
+	});
+	const std::size_t shown = options.perReceiver ? receivers.size() : std::min< std::size_t >(receivers.size(), 10);
+	std::printf("\nsession,frames,lost,loss_percent,p50_ms,p99_ms,max_ms\n");
+	for (std::size_t i = 0; i < shown; ++i) {
+		const ReceiverStats &stats = receivers[i]->stats();
+		std::printf("%u,%llu,%llu,%.3f,%.1f,%.1f,%.1f\n", receivers[i]->session(),
+					static_cast< unsigned long long >(stats.frames), static_cast< unsigned long long >(stats.lost),
+					stats.lossRate() * 100.0, stats.latency(0.5), stats.latency(0.99),
+					static_cast< double >(stats.maxLatency) / 1000.0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// This benchmark handles a stream of control messages the way Connection::socketRead and Server::message do: every
+// message is taken out of the received data and parsed. The stream resembles what a server receives while many users
+// move around and talk over the TCP tunnel: mostly UserState and UDPTunnel messages with a few pings in between.
+
+#include <benchmark/benchmark.h>
+
+#include "MessageArena.h"
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtEndian>
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, 255);
+std::uniform_int_distribution< unsigned int > random_percentage(0, 99);
+
+constexpr const std::size_t MESSAGE_COUNT_RANGE = 0;
+
+constexpr int MULTIPLIER          = 4;
+constexpr int MESSAGE_COUNT_BEGIN = 16;
+constexpr int MESSAGE_COUNT_END   = 4096;
+
+// The size of a typical Opus voice packet
+constexpr unsigned int TUNNEL_PACKET_SIZE = 120;
+
+/// The framed messages, just like they are received from the socket
+QByteArray stream;
+
+static void appendFrame(Mumble::Protocol::TCPMessageType type, const std::string &payload) {
+	unsigned char header[6];
+	qToBigEndian< quint16 >(static_cast< quint16 >(type), &header[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(payload.size()), &header[2]);
+
+	stream.append(reinterpret_cast< const char * >(header), sizeof(header));
+	stream.append(payload.data(), static_cast< int >(payload.size()));
+}
+
+static void recordStream(std::size_t messageCount) {
+	stream.clear();
+
+	for (std::size_t i = 0; i < messageCount; ++i) {
+		const unsigned int kind = random_percentage(rng);
+
+		if (kind < 45) {
+			MumbleProto::UserState msg;
+			msg.set_session(static_cast< unsigned int >(i % 500));
+			msg.set_channel_id(random_byte(rng));
+			msg.set_self_mute(kind % 2 == 0);
+			msg.set_plugin_identity("Game-Server-" + std::to_string(i % 20));
+			msg.set_plugin_context(std::string(64, static_cast< char >(random_byte(rng))));
+			msg.add_listening_channel_add(random_byte(rng));
+
+			appendFrame(Mumble::Protocol::TCPMessageType::UserState, msg.SerializeAsString());
+		} else if (kind < 95) {
+			std::string packet(TUNNEL_PACKET_SIZE, '\0');
+			for (char &c : packet) {
+				c = static_cast< char >(random_byte(rng));
+			}
+
+			appendFrame(Mumble::Protocol::TCPMessageType::UDPTunnel, packet);
+		} else {
+			MumbleProto::Ping msg;
+			msg.set_timestamp(i);
+			msg.set_good(static_cast< unsigned int >(i));
+			msg.set_tcp_ping_avg(12.5f);
+			msg.set_tcp_ping_var(1.5f);
+
+			appendFrame(Mumble::Protocol::TCPMessageType::Ping, msg.SerializeAsString());
+		}
+	}
+}
+
+/// Calls the given function with every message of the stream, which is copied out of it like socketRead does
+template< bool reuseBuffer, typename Handler > static void forEachMessage(QByteArray &buffer, Handler handler) {
+	const char *data = stream.constData();
+	const char *end  = data + stream.size();
+
+	while (data < end) {
+		const auto type = static_cast< Mumble::Protocol::TCPMessageType >(
+			qFromBigEndian< quint16 >(reinterpret_cast< const uchar * >(data)));
+		const int length = qFromBigEndian< int >(reinterpret_cast< const uchar * >(data + 2));
+		data += 6;
+
+		if (reuseBuffer) {
+			buffer.resize(length);
+			std::memcpy(buffer.data(), data, static_cast< std::size_t >(length));
+		} else {
+			buffer = QByteArray(data, length);
+		}
+		data += length;
+
+		handler(type, buffer);
+	}
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		recordStream(static_cast< std::size_t >(state.range(MESSAGE_COUNT_RANGE)));
+	}
+};
+
+template< typename T > static void parse(T &msg, const QByteArray &buffer) {
+	if (msg.ParseFromArray(buffer.constData(), buffer.size())) {
+		msg.DiscardUnknownFields();
+		benchmark::DoNotOptimize(msg);
+	}
+}
+
+// A new buffer for every message and messages that own their contents
+BENCHMARK_DEFINE_F(Fixture, BM_parseHeap)(::benchmark::State &state) {
+	for (auto _ : state) {
+		QByteArray buffer;
+		forEachMessage< false >(buffer, [](Mumble::Protocol::TCPMessageType type, const QByteArray &data) {
+			switch (type) {
+				case Mumble::Protocol::TCPMessageType::UserState: {
+					MumbleProto::UserState msg;
+					parse(msg, data);
+					break;
+				}
+				case Mumble::Protocol::TCPMessageType::Ping: {
+					MumbleProto::Ping msg;
+					parse(msg, data);
+					break;
+				}
+				default:
+					benchmark::DoNotOptimize(data.constData());
+					break;
+			}
+		});
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(MESSAGE_COUNT_RANGE));
+}
+
+// A reused buffer and messages that are parsed into a MessageArena
+BENCHMARK_DEFINE_F(Fixture, BM_parseArena)(::benchmark::State &state) {
+	QByteArray buffer;
+	MessageArena arena;
+
+	for (auto _ : state) {
+		forEachMessage< true >(buffer, [&arena](Mumble::Protocol::TCPMessageType type, const QByteArray &data) {
+			MessageArena::Scope scope(arena);
+
+			switch (type) {
+				case Mumble::Protocol::TCPMessageType::UserState:
+					parse(*arena.create< MumbleProto::UserState >(), data);
+					break;
+				case Mumble::Protocol::TCPMessageType::Ping:
+					parse(*arena.create< MumbleProto::Ping >(), data);
+					break;
+				default:
+					benchmark::DoNotOptimize(data.constData());
+					break;
+			}
+		});
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(state.iterations() * state.range(MESSAGE_COUNT_RANGE));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_parseHeap)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(MESSAGE_COUNT_BEGIN, MESSAGE_COUNT_END);
+BENCHMARK_REGISTER_F(Fixture, BM_parseArena)
+	->RangeMultiplier(MULTIPLIER)
+	->Range(MESSAGE_COUNT_BEGIN, MESSAGE_COUNT_END);
+
+int main(int argc, char **argv) {
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,401 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// This benchmark drives the most frequent database operations (registering and authenticating users, updating their
+// info and last channel, writing to the server log and reading the state of a server on boot) through the server's
+// own code against a real database. Additionally, it replays a trace that has been recorded by a running server (see
+// the dbTraceFile option).
+//
+// The database is configured by a mumble-server.ini, just like the server's, whose path is given by
+// MUMBLE_BENCHMARK_INI (the default locations of the server are searched if it isn't set). The schema is created or
+// upgraded by ServerDB, just like on startup. MUMBLE_BENCHMARK_TRACE names the trace to replay, if any.
+//
+// The operations are benchmarked on a virtual server of their own, which is seeded with the given number of
+// registered users (and a channel tree that grows along with it), listens on random ports on the loopback interface
+// and is removed again at the end. The trace on the other hand is replayed as it has been recorded, so it should be
+// replayed against a copy of the database it has been recorded on.
+
+#include <benchmark/benchmark.h>
+
+#include "DBTrace.h"
+#include "Meta.h"
+#include "Server.h"
+#include "ServerDB.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Defined by the server's main.cpp, which the benchmark is built without
+Meta *meta   = nullptr;
+QFile *qfLog = nullptr;
+
+std::random_device rd;
+std::mt19937 rng(rd());
+
+constexpr const std::size_t USER_COUNT_RANGE = 0;
+
+/// The number of registered users per channel in the seeded dataset
+constexpr int USERS_PER_CHANNEL = 20;
+/// Every how many channels has a group with members
+constexpr int CHANNELS_PER_GROUP = 10;
+constexpr int MEMBERS_PER_GROUP  = 5;
+constexpr int ACLS_PER_CHANNEL   = 2;
+
+/// The virtual server the operations are benchmarked on
+std::unique_ptr< Server > server;
+/// The number of registered users the benchmark server has been seeded with or 0 if it hasn't been seeded yet
+int seededUsers    = 0;
+int seededChannels = 0;
+/// The ID the next user that is registered by BM_registerUser gets
+int nextUserId = 0;
+
+QString userName(int id) {
+	return QString::fromLatin1("User%1").arg(id);
+}
+
+QString randomHash(int id) {
+	return QString::fromLatin1(
+		QCryptographicHash::hash(QByteArray::number(id) + QByteArray::number(rng()), QCryptographicHash::Sha1)
+			.toHex());
+}
+
+/// Executes the given statement on the main connection for every row of the given columns
+void insertRows(const char *sql, const QList< QVariantList > &columns) {
+	QSqlQuery query(*ServerDB::db);
+	ServerDB::prepare(query, QLatin1String(sql));
+	for (const QVariantList &column : columns) {
+		query.addBindValue(column);
+	}
+	ServerDB::execBatch(query);
+}
+
+/// Deletes the benchmark server, whose rows are removed along with it
+void removeServer() {
+	if (!server) {
+		return;
+	}
+
+	const int serverId = server->iServerNum;
+	server.reset();
+	ServerDB::deleteServer(serverId);
+
+	seededUsers = 0;
+}
+
+/// Creates the benchmark server and seeds it with the given number of registered users, a channel tree with a channel
+/// for every USERS_PER_CHANNEL users, groups and ACLs
+void seed(int userCount) {
+	if (seededUsers == userCount) {
+		return;
+	}
+	removeServer();
+
+	const int serverId = ServerDB::addServer();
+	ServerDB::setConf(serverId, QLatin1String("host"), QLatin1String("127.0.0.1"));
+	ServerDB::setConf(serverId, QLatin1String("port"), 0);
+
+	const int channelCount = std::max(userCount / USERS_PER_CHANNEL, 1);
+
+	// Inserting the dataset through the server would take longer than the benchmarks themselves, so it is inserted
+	// directly (while the server doesn't exist yet)
+	ServerDB::flush();
+	ServerDB::db->transaction();
+
+	// Every channel is the child of a random channel that has been created before it
+	QVariantList servers, channelIds, parents, channelNames;
+	for (int i = 0; i < channelCount; ++i) {
+		servers << serverId;
+		channelIds << i;
+		parents << (i == 0 ? QVariant() : QVariant(static_cast< int >(rng() % static_cast< unsigned int >(i))));
+		channelNames << (i == 0 ? QString::fromLatin1("Root") : QString::fromLatin1("Channel%1").arg(i));
+	}
+	insertRows("INSERT INTO `%1channels` (`server_id`, `channel_id`, `parent_id`, `name`) VALUES (?,?,?,?)",
+			   { servers, channelIds, parents, channelNames });
+
+	QVariantList infoKeys, descriptions;
+	for (int i = 0; i < channelCount; ++i) {
+		infoKeys << ServerDB::Channel_Description;
+		descriptions << QString::fromLatin1("The description of channel %1").arg(i);
+	}
+	insertRows("INSERT INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES(?,?,?,?)",
+			   { servers, channelIds, infoKeys, descriptions });
+
+	// The users have legacy password hashes, so that authenticating them measures the database rather than PBKDF2
+	// (see the Crypto benchmark for that)
+	QVariantList userServers, userIds, names, passwords, lastChannels, hashKeys, certHashes;
+	for (int i = 1; i <= userCount; ++i) {
+		userServers << serverId;
+		userIds << i;
+		names << userName(i);
+		passwords << ServerDB::getLegacySHA1Hash(randomHash(i));
+		lastChannels << static_cast< int >(rng() % static_cast< unsigned int >(channelCount));
+		hashKeys << ServerDB::User_Hash;
+		certHashes << randomHash(i);
+	}
+	insertRows("INSERT INTO `%1users` (`server_id`, `user_id`, `name`, `pw`, `lastchannel`) VALUES (?,?,?,?,?)",
+			   { userServers, userIds, names, passwords, lastChannels });
+	insertRows("INSERT INTO `%1user_info` (`server_id`, `user_id`, `key`, `value`) VALUES (?,?,?,?)",
+			   { userServers, userIds, hashKeys, certHashes });
+
+	QVariantList groupServers, groupChannels, groupNames, flags;
+	for (int i = 0; i < channelCount; i += CHANNELS_PER_GROUP) {
+		groupServers << serverId;
+		groupChannels << i;
+		groupNames << QString::fromLatin1("moderators");
+		flags << 1;
+	}
+	insertRows("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
+			   "(?,?,?,?,?)",
+			   { groupServers, groupChannels, groupNames, flags, flags });
+
+	QVariantList memberGroups, memberServers, members, additions;
+	{
+		QSqlQuery query(*ServerDB::db);
+		ServerDB::prepare(query, QLatin1String("SELECT `group_id` FROM `%1groups` WHERE `server_id` = ?"));
+		query.addBindValue(serverId);
+		ServerDB::exec(query);
+		while (query.next()) {
+			for (int i = 0; i < MEMBERS_PER_GROUP; ++i) {
+				memberGroups << query.value(0).toInt();
+				memberServers << serverId;
+				members << static_cast< int >(rng() % static_cast< unsigned int >(userCount)) + 1;
+				additions << 1;
+			}
+		}
+	}
+	insertRows("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)",
+			   { memberGroups, memberServers, members, additions });
+
+	// The first ACL of every channel applies to its group, the others to random users
+	QVariantList aclServers, aclChannels, priorities, aclUsers, aclGroups, applyHere, applySub, grants, revokes;
+	for (int i = 0; i < channelCount; ++i) {
+		for (int j = 0; j < ACLS_PER_CHANNEL; ++j) {
+			const int user = static_cast< int >(rng() % static_cast< unsigned int >(userCount)) + 1;
+
+			aclServers << serverId;
+			aclChannels << i;
+			priorities << 5 + j;
+			aclUsers << ((j == 0) ? QVariant() : QVariant(user));
+			aclGroups << ((j == 0) ? QVariant(QString::fromLatin1("moderators")) : QVariant());
+			applyHere << 1;
+			applySub << 1;
+			grants << 0x1;
+			revokes << 0x0;
+		}
+	}
+	insertRows("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, "
+			   "`apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)",
+			   { aclServers, aclChannels, priorities, aclUsers, aclGroups, applyHere, applySub, grants, revokes });
+
+	ServerDB::db->commit();
+
+	// The server reads the dataset the way it does on boot
+	server = std::make_unique< Server >(serverId, meta);
+	if (!server->bValid) {
+		qFatal("Failed to start the benchmark server");
+	}
+
+	seededUsers    = userCount;
+	seededChannels = channelCount;
+	nextUserId     = userCount + 1;
+}
+
+int randomUser() {
+	return static_cast< int >(rng() % static_cast< unsigned int >(seededUsers)) + 1;
+}
+
+/// Waits for the writes that the server writes behind (see ServerDB::writeBehind) and reports how long that took, as
+/// the benchmark loop itself only measures how long it takes to queue them
+void flush(::benchmark::State &state, ServerDB::Dependencies dependencies) {
+	QElapsedTimer timer;
+	timer.start();
+	ServerDB::flush(dependencies);
+	state.counters["flush_us"] = static_cast< double >(timer.nsecsElapsed() / 1000);
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) { seed(static_cast< int >(state.range(USER_COUNT_RANGE))); }
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_registerUser)(::benchmark::State &state) {
+	for (auto _ : state) {
+		const int id = nextUserId++;
+
+		QMap< int, QString > info;
+		info.insert(ServerDB::User_Name, userName(id));
+		info.insert(ServerDB::User_Hash, randomHash(id));
+		info.insert(ServerDB::User_Email, userName(id) + QLatin1String("@example.com"));
+		benchmark::DoNotOptimize(server->registerUser(info));
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_authenticate)(::benchmark::State &state) {
+	const QString password = QLatin1String("wrong");
+
+	for (auto _ : state) {
+		QString name = userName(randomUser()).toUpper();
+		benchmark::DoNotOptimize(server->authenticate(name, password));
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_setInfo)(::benchmark::State &state) {
+	for (auto _ : state) {
+		const int id = randomUser();
+
+		QMap< int, QString > info;
+		info.insert(ServerDB::User_Comment, QString::fromLatin1("The comment of user %1").arg(id));
+		benchmark::DoNotOptimize(server->setInfo(id, info));
+	}
+
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_setLastChannel)(::benchmark::State &state) {
+	User user;
+
+	for (auto _ : state) {
+		const unsigned int channel = static_cast< unsigned int >(rng()) % static_cast< unsigned int >(seededChannels);
+
+		user.iId      = randomUser();
+		user.cChannel = server->qhChannels.value(channel);
+		server->setLastChannel(&user);
+	}
+
+	flush(state, ServerDB::UserActivity);
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_dblog)(::benchmark::State &state) {
+	for (auto _ : state) {
+		const int id = randomUser();
+		server->dblog(QString::fromLatin1("<%1:%2(%1)> Authenticated").arg(id).arg(userName(id)));
+	}
+
+	flush(state, ServerDB::ServerLog);
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_loadBootState)(::benchmark::State &state) {
+	std::size_t rows = 0;
+	for (auto _ : state) {
+		const ServerBootState bootState = Server::loadBootState(server->iServerNum);
+		rows += static_cast< std::size_t >(bootState.channels.size() + bootState.channelInfo.size()
+										   + bootState.groups.size() + bootState.groupMembers.size()
+										   + bootState.acls.size());
+	}
+
+	state.counters["rows"] = static_cast< double >(rows) / static_cast< double >(state.iterations());
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations()));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_registerUser)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(Fixture, BM_authenticate)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(Fixture, BM_setInfo)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(Fixture, BM_setLastChannel)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(Fixture, BM_dblog)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK_REGISTER_F(Fixture, BM_loadBootState)->Arg(1000)->Arg(10000)->Arg(100000);
+
+std::vector< DBTrace::Statement > trace;
+
+/// Executes the recorded statements one after another, as fast as possible. The trace doesn't contain the transactions
+/// the statements have been part of, so every statement is committed on its own. Statements that fail (e.g. an insert
+/// that has been replayed before) are counted, but don't stop the replay.
+void BM_replay(::benchmark::State &state) {
+	QSqlQuery query(*ServerDB::db);
+
+	qint64 recorded = 0;
+	for (const DBTrace::Statement &statement : trace) {
+		recorded += statement.duration;
+	}
+
+	std::size_t failed = 0;
+	for (auto _ : state) {
+		for (const DBTrace::Statement &statement : trace) {
+			if (!query.prepare(statement.sql)) {
+				failed++;
+				continue;
+			}
+			for (const QVariant &value : statement.values) {
+				query.addBindValue(value);
+			}
+
+			const bool success = statement.batch ? query.execBatch() : query.exec();
+			if (!success) {
+				failed++;
+				continue;
+			}
+			while (query.isSelect() && query.next()) {
+				benchmark::DoNotOptimize(query.value(0));
+			}
+		}
+	}
+
+	const double iterations = static_cast< double >(state.iterations());
+
+	state.counters["statements"]  = static_cast< double >(trace.size());
+	state.counters["failed"]      = static_cast< double >(failed) / iterations;
+	state.counters["recorded_us"] = static_cast< double >(recorded);
+	state.SetItemsProcessed(static_cast< int64_t >(state.iterations() * trace.size()));
+}
+
+bool loadTrace(const QString &path) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		return false;
+	}
+
+	while (!file.atEnd()) {
+		const QByteArray line = file.readLine().trimmed();
+		DBTrace::Statement statement;
+		// The last line may be incomplete if the server hasn't been shut down properly
+		if (!line.isEmpty() && DBTrace::decode(line, statement)) {
+			trace.push_back(std::move(statement));
+		}
+	}
+
+	return true;
+}
+
+
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+
+	// The same steps the server takes on startup
+	Meta::mp.read(qEnvironmentVariable("MUMBLE_BENCHMARK_INI"));
+	ServerDB db;
+	meta = new Meta();
+
+	const QString tracePath = qEnvironmentVariable("MUMBLE_BENCHMARK_TRACE");
+	if (!tracePath.isEmpty()) {
+		if (!loadTrace(tracePath)) {
+			qFatal("Failed to read the trace %s", qPrintable(tracePath));
+		}
+		benchmark::RegisterBenchmark("BM_replay", BM_replay)->Iterations(1)->Unit(benchmark::kMillisecond);
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+
+	removeServer();
+	delete meta;
+}
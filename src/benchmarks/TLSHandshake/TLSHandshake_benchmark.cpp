@@ -0,0 +1,188 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// Measures full TLS handshakes (without session resumption) between a server and a client that talk to each other
+// through a pair of memory BIOs, for the certificates the server can generate and the key exchanges it offers. The
+// number of items processed is the number of handshakes.
+
+#include <benchmark/benchmark.h>
+
+#include "FFDHE.h"
+#include "SelfSignedCertificate.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+
+#include <openssl/bio.h>
+#include <openssl/dh.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <cstdint>
+
+struct Configuration {
+	const char *name;
+	QSsl::KeyAlgorithm algorithm;
+	const char *cipher;
+	bool dhe;
+};
+
+static const Configuration CONFIGURATIONS[] = {
+	{ "RSA-2048 + ECDHE", QSsl::Rsa, "ECDHE-RSA-AES256-GCM-SHA384", false },
+	{ "RSA-2048 + DHE (ffdhe2048)", QSsl::Rsa, "DHE-RSA-AES256-GCM-SHA384", true },
+	{ "P-256 + ECDHE", QSsl::Ec, "ECDHE-ECDSA-AES256-GCM-SHA384", false },
+};
+
+// Generating a certificate takes much longer than a handshake, so every configuration reuses its contexts
+static SSL_CTX *serverContexts[sizeof(CONFIGURATIONS) / sizeof(CONFIGURATIONS[0])];
+static SSL_CTX *clientContexts[sizeof(CONFIGURATIONS) / sizeof(CONFIGURATIONS[0])];
+
+static bool limitVersions(SSL_CTX *ctx, const char *cipher) {
+	// TLS 1.3 doesn't let the cipher list choose the key exchange and the certificate type
+	return SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION) == 1
+		   && SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION) == 1 && SSL_CTX_set_cipher_list(ctx, cipher) == 1;
+}
+
+static SSL_CTX *createServerContext(const Configuration &configuration) {
+	QSslCertificate qscCert;
+	QSslKey qskKey;
+	if (!SelfSignedCertificate::generateMurmurV2Certificate(qscCert, qskKey, configuration.algorithm)) {
+		return nullptr;
+	}
+
+	const QByteArray certDer = qscCert.toDer();
+	const QByteArray keyDer  = qskKey.toDer();
+
+	const unsigned char *p = reinterpret_cast< const unsigned char * >(certDer.constData());
+	X509 *x509             = d2i_X509(nullptr, &p, certDer.size());
+	p                      = reinterpret_cast< const unsigned char * >(keyDer.constData());
+	EVP_PKEY *pkey         = d2i_AutoPrivateKey(nullptr, &p, keyDer.size());
+
+	SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+	bool ok      = ctx && x509 && pkey && limitVersions(ctx, configuration.cipher)
+			  && SSL_CTX_use_certificate(ctx, x509) == 1 && SSL_CTX_use_PrivateKey(ctx, pkey) == 1;
+
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+
+	if (ok) {
+		// Every iteration has to do the full handshake
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+		if (configuration.dhe) {
+			const QByteArray pem = FFDHE::PEMForNamedGroup(QLatin1String("ffdhe2048"));
+			BIO *bio             = BIO_new_mem_buf(pem.constData(), pem.size());
+			DH *dh               = PEM_read_bio_DHparams(bio, nullptr, nullptr, nullptr);
+			ok                   = dh && SSL_CTX_set_tmp_dh(ctx, dh) == 1;
+			DH_free(dh);
+			BIO_free(bio);
+		}
+	}
+
+	if (!ok) {
+		SSL_CTX_free(ctx);
+		return nullptr;
+	}
+
+	return ctx;
+}
+
+static SSL_CTX *createClientContext(const Configuration &configuration) {
+	SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+	if (!ctx || !limitVersions(ctx, configuration.cipher)) {
+		SSL_CTX_free(ctx);
+		return nullptr;
+	}
+
+	// Server certificates are self-signed, just like the ones the clients accept after asking the user
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+	return ctx;
+}
+
+/// Does a full handshake between a new server and client connection
+///
+/// @returns Whether the handshake succeeded
+static bool handshake(SSL_CTX *serverContext, SSL_CTX *clientContext) {
+	SSL *server = SSL_new(serverContext);
+	SSL *client = SSL_new(clientContext);
+
+	BIO *serverBio = nullptr;
+	BIO *clientBio = nullptr;
+	BIO_new_bio_pair(&serverBio, 0, &clientBio, 0);
+
+	SSL_set_bio(server, serverBio, serverBio);
+	SSL_set_bio(client, clientBio, clientBio);
+	SSL_set_accept_state(server);
+	SSL_set_connect_state(client);
+
+	bool serverDone = false;
+	bool clientDone = false;
+	bool failed     = false;
+
+	// Both sides take turns until neither is waiting for the other anymore
+	while (!(serverDone && clientDone) && !failed) {
+		if (!clientDone) {
+			const int rc = SSL_do_handshake(client);
+			clientDone   = rc == 1;
+			failed       = rc <= 0 && SSL_get_error(client, rc) != SSL_ERROR_WANT_READ;
+		}
+		if (!serverDone && !failed) {
+			const int rc = SSL_do_handshake(server);
+			serverDone   = rc == 1;
+			failed       = rc <= 0 && SSL_get_error(server, rc) != SSL_ERROR_WANT_READ;
+		}
+	}
+
+	// Freeing the connections frees the BIOs as well
+	SSL_free(client);
+	SSL_free(server);
+
+	return !failed;
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		const std::size_t i = static_cast< std::size_t >(state.range(0));
+
+		if (!serverContexts[i]) {
+			serverContexts[i] = createServerContext(CONFIGURATIONS[i]);
+		}
+		if (!clientContexts[i]) {
+			clientContexts[i] = createClientContext(CONFIGURATIONS[i]);
+		}
+	}
+};
+
+BENCHMARK_DEFINE_F(Fixture, BM_handshake)(::benchmark::State &state) {
+	const std::size_t i = static_cast< std::size_t >(state.range(0));
+	state.SetLabel(CONFIGURATIONS[i].name);
+
+	if (!serverContexts[i] || !clientContexts[i]) {
+		state.SkipWithError("Failed to set up the TLS contexts");
+		return;
+	}
+
+	for (auto _ : state) {
+		if (!handshake(serverContexts[i], clientContexts[i])) {
+			state.SkipWithError("Handshake failed");
+			break;
+		}
+	}
+
+	state.SetItemsProcessed(static_cast< std::int64_t >(state.iterations()));
+}
+BENCHMARK_REGISTER_F(Fixture, BM_handshake)
+	->DenseRange(0, sizeof(CONFIGURATIONS) / sizeof(CONFIGURATIONS[0]) - 1)
+	->ArgName("configuration")
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,30 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+
+// NOTE: This is merely a mock of the ServerUser class
+
+#include "Version.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <memory>
+#include <string>
+
+struct ServerUser {
+	ServerUser(unsigned int uiSession, Version::full_t version, unsigned int channel)
+		: uiSession(uiSession), m_version(version), channel(channel), csCrypt(std::make_unique< CryptStateOCB2 >()) {
+		csCrypt->genKey();
+	}
+
+	unsigned int uiSession;
+	Version::full_t m_version;
+	bool bDeaf     = false;
+	bool bSelfDeaf = false;
+	std::string ssContext;
+
+	/// The index of the channel the user is in
+	unsigned int channel;
+	std::unique_ptr< CryptStateOCB2 > csCrypt;
+};
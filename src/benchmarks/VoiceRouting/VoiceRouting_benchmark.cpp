@@ -0,0 +1,488 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// This benchmark routes voice packets the way Server::processMsg does: the receivers are collected from a synthetic
+// channel topology (including the permission lookups for linked channels), grouped by AudioReceiverBuffer, the packet
+// is encoded once per receiver range and encrypted for every receiver. Instead of sending the packets, a sink merely
+// counts them.
+//
+// If the environment variable MUMBLE_BENCHMARK_VOICE_TRACE points to a trace that has been recorded by a virtual
+// server (see the voicetracefile setting), BM_replay replays it as fast as possible as well. The users, channel links,
+// listeners and whisper targets are rebuilt from the events in the trace and every recorded frame is routed through
+// the same pipeline (with a random payload of the recorded size). Apart from the throughput, it reports how long
+// collecting and sending took per frame. As the channel tree and the groups are not part of the trace, whisper targets
+// are routed to the targeted channels only (and to the linked ones, if requested), regardless of whether they include
+// sub-channels or are restricted to a group, and all links may be spoken through.
+
+#include <benchmark/benchmark.h>
+
+#include "AudioReceiverBuffer.h"
+#include "MumbleProtocol.h"
+#include "VoiceTrace.h"
+#include "crypto/CryptStateOCB2.h"
+
+#include <QtCore/QString>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+std::random_device rd;
+std::mt19937 rng(rd());
+std::uniform_int_distribution< unsigned int > random_byte(0, 255);
+std::uniform_int_distribution< unsigned int > random_percentage(0, 99);
+std::uniform_int_distribution< int > random_listener_volume(-12, 6);
+
+constexpr const std::size_t CHANNEL_SIZE_RANGE = 0;
+constexpr const std::size_t TOPOLOGY_RANGE     = 1;
+
+/// What the receivers of a packet are made up of
+enum Topology : int {
+	/// Only the users in the speaker's channel
+	PLAIN = 0,
+	/// The users in the speaker's channel and in the channels linked to it
+	LINKED = 1,
+	/// Like LINKED, but all channels also have listeners
+	LISTENED = 2,
+	/// The speaker whispers to (shouts at) several channels that have listeners
+	WHISPER = 3,
+};
+
+constexpr unsigned int CHANNEL_COUNT     = 32;
+constexpr unsigned int LINKS_PER_CHANNEL = 2;
+constexpr unsigned int WHISPER_CHANNELS  = 4;
+/// The share of users (in percent) that use a protocol version from before the introduction of protobuf
+constexpr unsigned int LEGACY_CLIENT_SHARE = 30;
+/// The share of (user, linked channel) pairs (in percent) in which the user is not allowed to speak
+constexpr unsigned int DENIED_LINK_SHARE = 10;
+
+// The size of a typical Opus voice packet
+constexpr unsigned int PAYLOAD_SIZE = 120;
+// See CryptState::MAX_BATCH
+constexpr std::size_t MAX_CRYPT_BATCH = CryptState::MAX_BATCH;
+
+struct Channel {
+	std::vector< ServerUser * > users;
+	std::vector< unsigned int > links;
+	std::vector< std::pair< ServerUser *, VolumeAdjustment > > listeners;
+};
+
+struct CountingSink {
+	std::size_t packets   = 0;
+	std::size_t bytes     = 0;
+	std::size_t encodings = 0;
+};
+
+std::vector< std::unique_ptr< ServerUser > > users;
+std::vector< Channel > channels;
+// Takes the role of the ACL cache (which maps users and channels to their permissions)
+std::unordered_map< std::uint64_t, bool > speakPermissions;
+std::vector< Mumble::Protocol::byte > payload;
+
+bool maySpeak(const ServerUser &user, unsigned int channel) {
+	auto it = speakPermissions.find((static_cast< std::uint64_t >(user.uiSession) << 32) | channel);
+
+	return it == speakPermissions.end() || it->second;
+}
+
+class Fixture : public ::benchmark::Fixture {
+public:
+	void SetUp(const ::benchmark::State &state) {
+		const unsigned int channelSize = static_cast< unsigned int >(state.range(CHANNEL_SIZE_RANGE));
+		const Topology topology        = static_cast< Topology >(state.range(TOPOLOGY_RANGE));
+
+		users.clear();
+		channels.clear();
+		speakPermissions.clear();
+
+		channels.resize(CHANNEL_COUNT);
+		for (unsigned int channel = 0; channel < CHANNEL_COUNT; ++channel) {
+			for (unsigned int i = 0; i < channelSize; ++i) {
+				const Version::full_t version = random_percentage(rng) < LEGACY_CLIENT_SHARE
+													? Version::fromComponents(1, 4, 0)
+													: Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION;
+
+				users.push_back(
+					std::make_unique< ServerUser >(static_cast< unsigned int >(users.size() + 1), version, channel));
+				channels[channel].users.push_back(users.back().get());
+			}
+
+			if (topology == LINKED || topology == LISTENED) {
+				for (unsigned int i = 1; i <= LINKS_PER_CHANNEL; ++i) {
+					channels[channel].links.push_back((channel + i) % CHANNEL_COUNT);
+				}
+			}
+		}
+
+		if (topology == LISTENED || topology == WHISPER) {
+			// A quarter of the users listen to another channel (the one "opposite" of their own)
+			for (std::size_t i = 0; i < users.size(); i += 4) {
+				ServerUser &listener = *users[i];
+
+				channels[(listener.channel + CHANNEL_COUNT / 2) % CHANNEL_COUNT].listeners.emplace_back(
+					&listener, VolumeAdjustment::fromDBAdjustment(random_listener_volume(rng)));
+			}
+		}
+
+		for (const std::unique_ptr< ServerUser > &user : users) {
+			for (unsigned int link : channels[user->channel].links) {
+				speakPermissions[(static_cast< std::uint64_t >(user->uiSession) << 32) | link] =
+					random_percentage(rng) >= DENIED_LINK_SHARE;
+			}
+		}
+
+		payload.resize(PAYLOAD_SIZE);
+		for (Mumble::Protocol::byte &current : payload) {
+			current = static_cast< Mumble::Protocol::byte >(random_byte(rng));
+		}
+	}
+};
+
+void addChannel(const ServerUser &speaker, const Channel &channel, Mumble::Protocol::audio_context_t context,
+				AudioReceiverBuffer &buffer) {
+	for (ServerUser *user : channel.users) {
+		buffer.addReceiver(speaker, *user, context, false);
+	}
+	for (const std::pair< ServerUser *, VolumeAdjustment > &listener : channel.listeners) {
+		buffer.addReceiver(speaker, *listener.first, Mumble::Protocol::AudioContext::LISTEN, false, listener.second);
+	}
+}
+
+void collectReceivers(const ServerUser &speaker, Topology topology, AudioReceiverBuffer &buffer) {
+	if (topology == WHISPER) {
+		for (unsigned int i = 0; i < WHISPER_CHANNELS; ++i) {
+			addChannel(speaker, channels[(speaker.channel + i) % CHANNEL_COUNT], Mumble::Protocol::AudioContext::SHOUT,
+					   buffer);
+		}
+
+		return;
+	}
+
+	const Channel &channel = channels[speaker.channel];
+
+	addChannel(speaker, channel, Mumble::Protocol::AudioContext::NORMAL, buffer);
+
+	for (unsigned int link : channel.links) {
+		if (maySpeak(speaker, link)) {
+			addChannel(speaker, channels[link], Mumble::Protocol::AudioContext::NORMAL, buffer);
+		}
+	}
+}
+
+void route(Mumble::Protocol::AudioData &audioData, AudioReceiverBuffer &buffer,
+		   Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder, CountingSink &sink) {
+	static std::array< std::array< unsigned char, Mumble::Protocol::MAX_UDP_PACKET_SIZE + 32 >, MAX_CRYPT_BATCH >
+		outputs;
+	std::array< CryptBatchEntry, MAX_CRYPT_BATCH > entries;
+
+	buffer.preprocessBuffer();
+
+	std::vector< AudioReceiver > &receiverList = buffer.getReceivers(false);
+
+	encoder.prepareAudioPacket(audioData);
+
+	ReceiverRange< std::vector< AudioReceiver >::iterator > currentRange =
+		AudioReceiverBuffer::getReceiverRange(receiverList.begin(), receiverList.end());
+
+	while (currentRange.begin != currentRange.end) {
+		audioData.targetOrContext  = currentRange.begin->getContext();
+		audioData.volumeAdjustment = currentRange.begin->getVolumeAdjustment();
+
+		gsl::span< const Mumble::Protocol::byte > encodedPacket;
+		if (Mumble::Protocol::getPacketFormat(currentRange.begin->getReceiver().m_version)
+			== Mumble::Protocol::PacketFormat::Legacy) {
+			encodedPacket = encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Legacy >(audioData);
+		} else {
+			encodedPacket = encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Protobuf >(audioData);
+		}
+		sink.encodings++;
+
+		const unsigned int packetSize = static_cast< unsigned int >(encodedPacket.size());
+
+		auto flush = [&](std::size_t count) {
+			CryptState::encryptBatch(encodedPacket.data(), packetSize, entries.data(), count);
+
+			for (std::size_t i = 0; i < count; ++i) {
+				if (entries[i].success) {
+					sink.packets++;
+					sink.bytes += packetSize + entries[i].state->overhead();
+				}
+			}
+		};
+
+		std::size_t batchSize = 0;
+		for (auto it = currentRange.begin; it != currentRange.end; ++it) {
+			entries[batchSize] = { it->getReceiver().csCrypt.get(), outputs[batchSize].data(), false };
+
+			if (++batchSize == MAX_CRYPT_BATCH) {
+				flush(batchSize);
+				batchSize = 0;
+			}
+		}
+		flush(batchSize);
+
+		currentRange = AudioReceiverBuffer::getReceiverRange(currentRange.end, receiverList.end());
+	}
+}
+
+BENCHMARK_DEFINE_F(Fixture, BM_processMsg)(::benchmark::State &state) {
+	const Topology topology = static_cast< Topology >(state.range(TOPOLOGY_RANGE));
+
+	AudioReceiverBuffer buffer;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder;
+	CountingSink sink;
+
+	Mumble::Protocol::AudioData audioData;
+	audioData.payload   = { payload.data(), payload.size() };
+	audioData.usedCodec = Mumble::Protocol::AudioCodec::Opus;
+
+	std::size_t speakerIndex = 0;
+	for (auto _ : state) {
+		// Everyone gets to speak in turn
+		const ServerUser &speaker = *users[speakerIndex];
+		speakerIndex              = (speakerIndex + 1) % users.size();
+
+		audioData.senderSession = speaker.uiSession;
+		audioData.frameNumber++;
+
+		buffer.clear();
+		collectReceivers(speaker, topology, buffer);
+		route(audioData, buffer, encoder, sink);
+
+		benchmark::ClobberMemory();
+	}
+
+	const double packets = static_cast< double >(state.iterations());
+
+	state.counters["receivers"] = static_cast< double >(sink.packets) / packets;
+	state.counters["encodings"] = static_cast< double >(sink.encodings) / packets;
+	state.counters["bytes"]     = benchmark::Counter(static_cast< double >(sink.bytes), benchmark::Counter::kIsRate);
+	state.SetItemsProcessed(static_cast< int64_t >(sink.packets));
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_processMsg)->ArgsProduct({ { 4, 16, 64 }, { PLAIN, LINKED, LISTENED, WHISPER } });
+
+// The state of the virtual server the trace has been recorded on, as far as the replay has gotten
+struct ReplayState {
+	std::unordered_map< unsigned int, std::unique_ptr< ServerUser > > users;
+	std::unordered_map< unsigned int, Channel > channels;
+	std::unordered_map< std::uint64_t, VoiceTrace::Event > whisperTargets;
+
+	static std::uint64_t whisperKey(unsigned int session, unsigned int target) {
+		return (static_cast< std::uint64_t >(session) << 32) | target;
+	}
+
+	void leaveChannel(ServerUser &user) {
+		std::vector< ServerUser * > &members = channels[user.channel].users;
+		members.erase(std::remove(members.begin(), members.end(), &user), members.end());
+	}
+
+	void removeListener(ServerUser &user, unsigned int channel) {
+		std::vector< std::pair< ServerUser *, VolumeAdjustment > > &listeners = channels[channel].listeners;
+		listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+									   [&user](const std::pair< ServerUser *, VolumeAdjustment > &listener) {
+										   return listener.first == &user;
+									   }),
+						listeners.end());
+	}
+
+	void apply(const VoiceTrace::Event &event) {
+		auto user = users.find(event.session);
+
+		switch (event.type) {
+			case VoiceTrace::EventType::Voice:
+				break;
+			case VoiceTrace::EventType::UserMoved:
+				if (user == users.end()) {
+					user = users.emplace(event.session, std::make_unique< ServerUser >(event.session, event.version,
+																					   event.channel))
+							   .first;
+				} else {
+					leaveChannel(*user->second);
+					user->second->channel = event.channel;
+				}
+				channels[event.channel].users.push_back(user->second.get());
+				break;
+			case VoiceTrace::EventType::UserLeft:
+				if (user != users.end()) {
+					leaveChannel(*user->second);
+					for (auto &channel : channels) {
+						removeListener(*user->second, channel.first);
+					}
+					users.erase(user);
+				}
+				break;
+			case VoiceTrace::EventType::ChannelLinked:
+				channels[event.channel].links.push_back(event.otherChannel);
+				channels[event.otherChannel].links.push_back(event.channel);
+				break;
+			case VoiceTrace::EventType::ChannelUnlinked: {
+				auto unlink = [this](unsigned int channel, unsigned int other) {
+					std::vector< unsigned int > &links = channels[channel].links;
+					links.erase(std::remove(links.begin(), links.end(), other), links.end());
+				};
+				unlink(event.channel, event.otherChannel);
+				unlink(event.otherChannel, event.channel);
+				break;
+			}
+			case VoiceTrace::EventType::ListenerAdded:
+				if (user != users.end()) {
+					channels[event.channel].listeners.emplace_back(user->second.get(),
+																   VolumeAdjustment::fromFactor(1.0f));
+				}
+				break;
+			case VoiceTrace::EventType::ListenerRemoved:
+				if (user != users.end()) {
+					removeListener(*user->second, event.channel);
+				}
+				break;
+			case VoiceTrace::EventType::WhisperTarget:
+				if (event.sessions.empty() && event.channels.empty()) {
+					whisperTargets.erase(whisperKey(event.session, event.target));
+				} else {
+					whisperTargets[whisperKey(event.session, event.target)] = event;
+				}
+				break;
+		}
+	}
+
+	void collectReceivers(const ServerUser &speaker, unsigned int target, AudioReceiverBuffer &buffer) {
+		if (target == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
+			buffer.forceAddReceiver(*users[speaker.uiSession], Mumble::Protocol::AudioContext::NORMAL, false);
+		} else if (target == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
+			const Channel &channel = channels[speaker.channel];
+
+			addChannel(speaker, channel, Mumble::Protocol::AudioContext::NORMAL, buffer);
+			for (unsigned int link : channel.links) {
+				addChannel(speaker, channels[link], Mumble::Protocol::AudioContext::NORMAL, buffer);
+			}
+		} else {
+			auto whisperTarget = whisperTargets.find(whisperKey(speaker.uiSession, target));
+			if (whisperTarget == whisperTargets.end()) {
+				return;
+			}
+
+			for (const VoiceTrace::TargetChannel &targetChannel : whisperTarget->second.channels) {
+				const Channel &channel = channels[targetChannel.channel];
+
+				addChannel(speaker, channel, Mumble::Protocol::AudioContext::SHOUT, buffer);
+				if (targetChannel.links) {
+					for (unsigned int link : channel.links) {
+						addChannel(speaker, channels[link], Mumble::Protocol::AudioContext::SHOUT, buffer);
+					}
+				}
+			}
+			for (unsigned int session : whisperTarget->second.sessions) {
+				auto receiver = users.find(session);
+				if (receiver != users.end()) {
+					buffer.addReceiver(speaker, *receiver->second, Mumble::Protocol::AudioContext::WHISPER, false);
+				}
+			}
+		}
+	}
+};
+
+std::vector< VoiceTrace::Event > traceEvents;
+
+bool loadTrace(const QString &path) {
+	VoiceTrace::Reader reader(path);
+	if (!reader.isOpen()) {
+		return false;
+	}
+
+	VoiceTrace::Event event;
+	while (reader.next(event)) {
+		traceEvents.push_back(event);
+	}
+
+	return true;
+}
+
+void BM_replay(::benchmark::State &state) {
+	using Clock = std::chrono::steady_clock;
+
+	AudioReceiverBuffer buffer;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder;
+	CountingSink sink;
+	std::vector< Mumble::Protocol::byte > tracePayload(Mumble::Protocol::MAX_UDP_PACKET_SIZE);
+	for (Mumble::Protocol::byte &current : tracePayload) {
+		current = static_cast< Mumble::Protocol::byte >(random_byte(rng));
+	}
+
+	std::size_t frames = 0;
+	Clock::duration collecting(0);
+	Clock::duration sending(0);
+
+	for (auto _ : state) {
+		ReplayState replay;
+
+		for (const VoiceTrace::Event &event : traceEvents) {
+			if (event.type != VoiceTrace::EventType::Voice) {
+				replay.apply(event);
+				continue;
+			}
+
+			auto speaker = replay.users.find(event.session);
+			if (speaker == replay.users.end()) {
+				continue;
+			}
+
+			const std::size_t payloadSize = std::min< std::size_t >(event.payloadSize, tracePayload.size());
+
+			Mumble::Protocol::AudioData audioData;
+			audioData.payload       = { tracePayload.data(), payloadSize };
+			audioData.usedCodec     = static_cast< Mumble::Protocol::AudioCodec >(event.codec);
+			audioData.senderSession = event.session;
+			audioData.frameNumber   = frames++;
+
+			const Clock::time_point start = Clock::now();
+
+			buffer.clear();
+			replay.collectReceivers(*speaker->second, event.target, buffer);
+
+			const Clock::time_point collected = Clock::now();
+
+			route(audioData, buffer, encoder, sink);
+
+			collecting += collected - start;
+			sending += Clock::now() - collected;
+		}
+
+		benchmark::ClobberMemory();
+	}
+
+	// Traces without any frames are reported as zeros
+	const double frameCount = static_cast< double >(std::max< std::size_t >(frames, 1));
+	auto perFrame = [frameCount](Clock::duration duration) {
+		return static_cast< double >(std::chrono::nanoseconds(duration).count()) / frameCount;
+	};
+
+	state.counters["frames"]     = static_cast< double >(frames);
+	state.counters["frames/s"]   = benchmark::Counter(static_cast< double >(frames), benchmark::Counter::kIsRate);
+	state.counters["collect_ns"] = perFrame(collecting);
+	state.counters["send_ns"]    = perFrame(sending);
+	state.counters["receivers"]  = static_cast< double >(sink.packets) / frameCount;
+	state.SetItemsProcessed(static_cast< int64_t >(sink.packets));
+}
+
+
+int main(int argc, char **argv) {
+	const QString tracePath = qEnvironmentVariable("MUMBLE_BENCHMARK_VOICE_TRACE");
+	if (!tracePath.isEmpty()) {
+		if (!loadTrace(tracePath)) {
+			qFatal("Failed to read the voice trace %s", qPrintable(tracePath));
+		}
+		benchmark::RegisterBenchmark("BM_replay", BM_replay)->Iterations(1)->Unit(benchmark::kMillisecond);
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,546 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "WireProtocolTargets.h"
+
+#include "Connection.h"
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+#include "PacketDataStream.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QIODevice>
+#include <QtCore/QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace Mumble {
+namespace Protocol {
+
+	/// Gives access to the two protobuf audio decoders, of which decode() uses whichever applies
+	template< Role role > class HarnessDecoder : public UDPDecoder< role > {
+	public:
+		using UDPDecoder< role >::UDPDecoder;
+		using typename UDPDecoder< role >::WireDecodeResult;
+
+		WireDecodeResult decodeFast(const gsl::span< const byte > data) {
+			this->m_audioData = {};
+			return this->decodeAudio_protobufFast(data);
+		}
+
+		bool decodeGeneric(const gsl::span< const byte > data) {
+			this->m_audioData = {};
+			return this->decodeAudio_protobufGeneric(data);
+		}
+	};
+
+} // namespace Protocol
+} // namespace Mumble
+
+namespace WireProtocol {
+
+namespace {
+
+	using Mumble::Protocol::byte;
+	using Mumble::Protocol::Role;
+
+	void require(bool condition, const char *what) {
+		if (!condition) {
+			std::fprintf(stderr, "WireProtocol: %s\n", what);
+			std::abort();
+		}
+	}
+
+	bool sameBytes(const gsl::span< const byte > lhs, const gsl::span< const byte > rhs) {
+		return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+	}
+
+	/// Same as AudioData's operator==, except that floats are also considered equal if they are the same bits (which
+	/// makes the NaNs the fuzzer comes up with equal to themselves)
+	bool sameAudio(const Mumble::Protocol::AudioData &lhs, const Mumble::Protocol::AudioData &rhs) {
+		const bool samePosition = !lhs.containsPositionalData || lhs.position == rhs.position
+								  || std::memcmp(lhs.position.data(), rhs.position.data(), sizeof(lhs.position)) == 0;
+		const bool sameVolume =
+			lhs.volumeAdjustment == rhs.volumeAdjustment
+			|| (lhs.volumeAdjustment.dbAdjustment == rhs.volumeAdjustment.dbAdjustment
+				&& std::memcmp(&lhs.volumeAdjustment.factor, &rhs.volumeAdjustment.factor, sizeof(float)) == 0);
+
+		return lhs.targetOrContext == rhs.targetOrContext && lhs.usedCodec == rhs.usedCodec
+			   && lhs.senderSession == rhs.senderSession && lhs.frameNumber == rhs.frameNumber
+			   && lhs.isLastFrame == rhs.isLastFrame && lhs.containsPositionalData == rhs.containsPositionalData
+			   && samePosition && sameVolume && sameBytes(lhs.payload, rhs.payload)
+			   && sameBytes(lhs.redundantPayload, rhs.redundantPayload);
+	}
+
+	Version::full_t versionFor(unsigned char flags) {
+		return (flags & UDP_FLAG_PROTOBUF) ? Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION
+										   : Version::fromComponents(1, 4, 0);
+	}
+
+	/// The decoders that are reused from one input to the next (just like the server and client do), so that
+	/// decoding doesn't depend on what has been decoded before
+	template< Role role > Mumble::Protocol::HarnessDecoder< role > &reusedDecoder() {
+		static Mumble::Protocol::HarnessDecoder< role > decoder;
+		return decoder;
+	}
+
+	template< Role role > void decodeUDP(const gsl::span< const byte > datagram, unsigned char flags, bool verify) {
+		Mumble::Protocol::HarnessDecoder< role > &decoder = reusedDecoder< role >();
+		// decode() may raise the version when it comes across a protobuf ping
+		decoder.setProtocolVersion(versionFor(flags));
+
+		const bool decoded = decoder.decode(datagram);
+		if (!verify) {
+			return;
+		}
+
+		Mumble::Protocol::HarnessDecoder< role > fresh(versionFor(flags));
+		require(fresh.decode(datagram) == decoded, "A reused decoder decodes differently than a new one");
+		if (!decoded) {
+			return;
+		}
+
+		require(fresh.getMessageType() == decoder.getMessageType(), "A reused decoder decodes another message type");
+		if (decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+			require(fresh.getPingData() == decoder.getPingData(), "A reused decoder decodes another ping");
+			return;
+		}
+
+		const Mumble::Protocol::AudioData audio = decoder.getAudioData();
+		require(sameAudio(audio, fresh.getAudioData()), "A reused decoder decodes other audio");
+		require(audio.payload.size() + audio.redundantPayload.size() < datagram.size(),
+				"The decoded audio is larger than the datagram");
+
+		if (decoder.getProtocolVersion() >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION) {
+			// The fast decoder has to agree with the generic one on everything it doesn't leave to it
+			using WireDecodeResult = typename Mumble::Protocol::HarnessDecoder< role >::WireDecodeResult;
+
+			const gsl::span< const byte > message = datagram.subspan(1);
+			if (fresh.decodeFast(message) == WireDecodeResult::Decoded) {
+				const Mumble::Protocol::AudioData fast = fresh.getAudioData();
+				require(decoder.decodeGeneric(message), "The generic decoder refuses what the fast one decodes");
+				require(sameAudio(fast, decoder.getAudioData()), "The fast and the generic decoder disagree");
+			}
+		}
+	}
+
+	template< Role role > void decodePing(const gsl::span< const byte > datagram, unsigned char flags, bool verify) {
+		Mumble::Protocol::HarnessDecoder< role > &decoder = reusedDecoder< role >();
+		decoder.setProtocolVersion(versionFor(flags));
+
+		const bool decoded = decoder.decodePing(datagram);
+		if (!verify || !decoded) {
+			return;
+		}
+
+		// Whatever decodePing takes for a ping, decode has to take for the same ping
+		Mumble::Protocol::HarnessDecoder< role > fresh(versionFor(flags));
+		require(fresh.decode(datagram), "decode refuses a ping that decodePing accepts");
+		require(fresh.getMessageType() == Mumble::Protocol::UDPMessageType::Ping, "decode mistakes a ping for audio");
+		require(fresh.getPingData() == decoder.getPingData(), "decode and decodePing disagree");
+	}
+
+	/// A device that hands out the data that has been "received" so far, as the socket of a connection does
+	class ReceivingDevice : public QIODevice {
+	public:
+		ReceivingDevice() { open(QIODevice::ReadOnly); }
+
+		void receive(const char *data, qint64 length) { m_pending.append(data, static_cast< int >(length)); }
+
+		bool isSequential() const override { return true; }
+		qint64 bytesAvailable() const override {
+			return static_cast< qint64 >(m_pending.size() - m_offset) + QIODevice::bytesAvailable();
+		}
+
+	protected:
+		qint64 readData(char *data, qint64 maxSize) override {
+			const qint64 length = std::min(maxSize, static_cast< qint64 >(m_pending.size() - m_offset));
+			std::memcpy(data, m_pending.constData() + m_offset, static_cast< std::size_t >(length));
+			m_offset += static_cast< int >(length);
+			return length;
+		}
+		qint64 writeData(const char *, qint64) override { return -1; }
+
+		QByteArray m_pending;
+		int m_offset = 0;
+	};
+
+	struct FramedMessage {
+		Mumble::Protocol::TCPMessageType type;
+		QByteArray data;
+	};
+
+	/// Hands the given data to readControlMessage in chunks of the given size (or all at once for 0)
+	///
+	/// @returns Whether the data has been accepted (instead of the connection being dropped)
+	bool frame(const char *data, std::size_t size, std::size_t chunkSize, std::vector< FramedMessage > &messages) {
+		ReceivingDevice device;
+		Mumble::Protocol::TCPMessageType type = Mumble::Protocol::TCPMessageType::Version;
+		int packetLength                      = -1;
+		QByteArray message;
+
+		std::size_t offset = 0;
+		do {
+			const std::size_t length = chunkSize == 0 ? size : std::min(chunkSize, size - offset);
+			device.receive(data + offset, static_cast< qint64 >(length));
+			offset += length;
+
+			while (true) {
+				const ControlReadResult result = readControlMessage(&device, type, packetLength, message);
+				if (result == ControlReadResult::Incomplete) {
+					break;
+				}
+				if (result == ControlReadResult::TooLarge) {
+					return false;
+				}
+
+				messages.push_back({ type, message });
+			}
+		} while (offset < size);
+
+		return true;
+	}
+
+	void frameControl(const char *data, std::size_t size, unsigned char chunkSize, bool verify) {
+		std::vector< FramedMessage > messages;
+		const bool accepted = frame(data, size, 0, messages);
+		if (!verify) {
+			return;
+		}
+
+		// TCP may split the stream anywhere, which must not make any difference
+		std::vector< FramedMessage > chunked;
+		require(frame(data, size, static_cast< std::size_t >(chunkSize) + 1, chunked) == accepted,
+				"Framing accepts the data only if it is received in one go (or the other way around)");
+		require(chunked.size() == messages.size(), "Framing finds other messages if the data is received in chunks");
+		for (std::size_t i = 0; i < messages.size(); ++i) {
+			require(chunked[i].type == messages[i].type && chunked[i].data == messages[i].data,
+					"Framing finds other messages if the data is received in chunks");
+		}
+
+		std::size_t framed = 0;
+		for (const FramedMessage &message : messages) {
+			framed += 6 + static_cast< std::size_t >(message.data.size());
+		}
+		require(framed <= size, "Framing finds more data than it has received");
+	}
+
+	/// What the PacketDataStream target reads from its data, picked by the bits of the operations byte one after
+	/// another
+	enum class StreamOperation { Integer, Bytes, Float, Double };
+
+	struct StreamValue {
+		StreamOperation operation;
+		quint64 integer = 0;
+		QByteArray bytes;
+	};
+
+	StreamOperation operationAt(unsigned char operations, std::size_t index) {
+		return static_cast< StreamOperation >((operations >> ((2 * index) % 8)) & 0x3);
+	}
+
+	void readStream(PacketDataStream &stream, unsigned char operations, std::vector< StreamValue > &values) {
+		while (stream.isValid() && stream.left() > 0) {
+			StreamValue value;
+			value.operation = operationAt(operations, values.size());
+
+			switch (value.operation) {
+				case StreamOperation::Integer:
+					stream >> value.integer;
+					break;
+				case StreamOperation::Bytes:
+					stream >> value.bytes;
+					break;
+				case StreamOperation::Float: {
+					float f;
+					stream >> f;
+					std::memcpy(&value.integer, &f, sizeof(f));
+					break;
+				}
+				case StreamOperation::Double: {
+					double d;
+					stream >> d;
+					std::memcpy(&value.integer, &d, sizeof(d));
+					break;
+				}
+			}
+
+			require(stream.size() <= stream.capacity(), "PacketDataStream has read past the end of its data");
+			if (stream.isValid()) {
+				values.push_back(std::move(value));
+			}
+		}
+	}
+
+	void readPacketDataStream(const char *data, std::size_t size, unsigned char operations, bool verify) {
+		PacketDataStream stream(data, static_cast< unsigned int >(size));
+		std::vector< StreamValue > values;
+		readStream(stream, operations, values);
+		if (!verify) {
+			return;
+		}
+
+		// Whatever has been read has to be written and read back as the same values. None of them takes more than
+		// ten bytes more than it has taken to read it.
+		QByteArray buffer(static_cast< int >(10 * values.size() + size), '\0');
+		PacketDataStream out(buffer.data(), static_cast< unsigned int >(buffer.size()));
+		for (const StreamValue &value : values) {
+			switch (value.operation) {
+				case StreamOperation::Integer:
+					out << value.integer;
+					break;
+				case StreamOperation::Bytes:
+					out << value.bytes;
+					break;
+				case StreamOperation::Float: {
+					float f;
+					std::memcpy(&f, &value.integer, sizeof(f));
+					out << f;
+					break;
+				}
+				case StreamOperation::Double: {
+					double d;
+					std::memcpy(&d, &value.integer, sizeof(d));
+					out << d;
+					break;
+				}
+			}
+		}
+		require(out.isValid(), "PacketDataStream can't write back what it has read");
+
+		PacketDataStream in(buffer.constData(), out.size());
+		std::vector< StreamValue > reread;
+		readStream(in, operations, reread);
+		require(reread.size() == values.size(), "PacketDataStream reads back another number of values");
+		for (std::size_t i = 0; i < values.size(); ++i) {
+			require(reread[i].integer == values[i].integer && reread[i].bytes == values[i].bytes,
+					"PacketDataStream reads back other values than it has written");
+		}
+	}
+
+	void appendFrame(QByteArray &stream, Mumble::Protocol::TCPMessageType type, const std::string &payload) {
+		unsigned char header[6];
+		qToBigEndian< quint16 >(static_cast< quint16 >(type), &header[0]);
+		qToBigEndian< quint32 >(static_cast< quint32 >(payload.size()), &header[2]);
+
+		stream.append(reinterpret_cast< const char * >(header), sizeof(header));
+		stream.append(payload.data(), static_cast< int >(payload.size()));
+	}
+
+	QByteArray input(Target target, unsigned char parameter, const gsl::span< const byte > data) {
+		QByteArray in;
+		in.append(static_cast< char >(target));
+		in.append(static_cast< char >(parameter));
+		in.append(reinterpret_cast< const char * >(data.data()), static_cast< int >(data.size()));
+		return in;
+	}
+
+	template< Role role > void addAudioSeeds(std::vector< QByteArray > &inputs) {
+		// Packets of a role are decoded by the other one
+		constexpr unsigned char decoderFlag = role == Role::Client ? UDP_FLAG_SERVER : 0;
+
+		std::vector< byte > payload(120);
+		for (std::size_t i = 0; i < payload.size(); ++i) {
+			payload[i] = static_cast< byte >(i * 7);
+		}
+
+		Mumble::Protocol::AudioData audio;
+		audio.payload       = { payload.data(), payload.size() };
+		audio.frameNumber   = 4242;
+		audio.senderSession = 17;
+		audio.position      = { 1.5f, -2.0f, 1e6f };
+
+		Mumble::Protocol::UDPAudioEncoder< role > encoder;
+		for (unsigned char format : { static_cast< unsigned char >(0), UDP_FLAG_PROTOBUF }) {
+			encoder.setProtocolVersion(versionFor(format));
+
+			for (bool positional : { false, true }) {
+				audio.containsPositionalData = positional;
+				audio.isLastFrame            = positional;
+
+				const unsigned char flags = static_cast< unsigned char >(decoderFlag | format);
+				for (Target target : { Target::UDPDecode, Target::Ping }) {
+					inputs.push_back(input(target, flags, encoder.encodeAudioPacket(audio)));
+				}
+			}
+		}
+	}
+
+	template< Role role > void addPingSeeds(std::vector< QByteArray > &inputs) {
+		constexpr unsigned char decoderFlag = role == Role::Client ? UDP_FLAG_SERVER : 0;
+
+		Mumble::Protocol::PingData ping;
+		ping.timestamp = 123456789;
+		if (role == Role::Client) {
+			ping.packetLoss = 3;
+			ping.jitter     = 12;
+		} else {
+			ping.bitrateHint = 24000;
+		}
+
+		Mumble::Protocol::PingData extended = ping;
+		if (role == Role::Client) {
+			extended.requestAdditionalInformation = true;
+		} else {
+			extended.containsAdditionalInformation = true;
+			extended.serverVersion                 = Version::get();
+			extended.userCount                     = 12;
+			extended.maxUserCount                  = 100;
+			extended.maxBandwidthPerUser           = 72000;
+		}
+
+		Mumble::Protocol::UDPPingEncoder< role > encoder;
+		for (unsigned char format : { static_cast< unsigned char >(0), UDP_FLAG_PROTOBUF }) {
+			encoder.setProtocolVersion(versionFor(format));
+
+			for (const Mumble::Protocol::PingData &data : { ping, extended }) {
+				const unsigned char flags = static_cast< unsigned char >(decoderFlag | format);
+				for (Target target : { Target::UDPDecode, Target::Ping }) {
+					inputs.push_back(input(target, flags, encoder.encodePingPacket(data)));
+				}
+			}
+		}
+	}
+
+} // namespace
+
+const char *targetName(Target target) {
+	switch (target) {
+		case Target::UDPDecode:
+			return "UDPDecode";
+		case Target::Ping:
+			return "Ping";
+		case Target::ControlFraming:
+			return "ControlFraming";
+		case Target::PacketDataStream:
+			return "PacketDataStream";
+	}
+
+	return "Unknown";
+}
+
+std::size_t run(const std::uint8_t *data, std::size_t size, bool verify) {
+	if (size < 2) {
+		return 0;
+	}
+
+	const Target target           = static_cast< Target >(data[0] % TARGET_COUNT);
+	const unsigned char parameter = data[1];
+	const gsl::span< const byte > rest(data + 2, size - 2);
+	const char *chars = reinterpret_cast< const char * >(rest.data());
+
+	switch (target) {
+		case Target::UDPDecode:
+			if (parameter & UDP_FLAG_SERVER) {
+				decodeUDP< Role::Server >(rest, parameter, verify);
+			} else {
+				decodeUDP< Role::Client >(rest, parameter, verify);
+			}
+			break;
+		case Target::Ping:
+			if (parameter & UDP_FLAG_SERVER) {
+				decodePing< Role::Server >(rest, parameter, verify);
+			} else {
+				decodePing< Role::Client >(rest, parameter, verify);
+			}
+			break;
+		case Target::ControlFraming:
+			frameControl(chars, rest.size(), parameter, verify);
+			break;
+		case Target::PacketDataStream:
+			readPacketDataStream(chars, rest.size(), parameter, verify);
+			break;
+	}
+
+	return rest.size();
+}
+
+std::vector< QByteArray > seeds() {
+	std::vector< QByteArray > inputs;
+
+	addAudioSeeds< Role::Client >(inputs);
+	addAudioSeeds< Role::Server >(inputs);
+	addPingSeeds< Role::Client >(inputs);
+	addPingSeeds< Role::Server >(inputs);
+
+	// A few control messages, the way a client sends them after having connected
+	QByteArray stream;
+	MumbleProto::Version version;
+	version.set_version_v2(Version::get());
+	version.set_release("1.6.0");
+	version.set_os("Linux");
+	appendFrame(stream, Mumble::Protocol::TCPMessageType::Version, version.SerializeAsString());
+
+	MumbleProto::Authenticate authenticate;
+	authenticate.set_username("Zoë");
+	authenticate.set_opus(true);
+	appendFrame(stream, Mumble::Protocol::TCPMessageType::Authenticate, authenticate.SerializeAsString());
+
+	MumbleProto::Ping ping;
+	ping.set_timestamp(42);
+	ping.set_good(1000);
+	ping.set_tcp_ping_avg(12.5f);
+	appendFrame(stream, Mumble::Protocol::TCPMessageType::Ping, ping.SerializeAsString());
+	appendFrame(stream, Mumble::Protocol::TCPMessageType::UDPTunnel, std::string(120, 'x'));
+
+	const gsl::span< const byte > streamData(reinterpret_cast< const byte * >(stream.constData()),
+											 static_cast< std::size_t >(stream.size()));
+	for (unsigned int chunkSize : { 0U, 5U, 63U }) {
+		inputs.push_back(input(Target::ControlFraming, static_cast< unsigned char >(chunkSize), streamData));
+	}
+
+	// Values the way the server's (legacy) packets and the user and channel info of the database are written
+	std::array< unsigned char, 256 > buffer;
+	PacketDataStream out(buffer.data(), static_cast< unsigned int >(buffer.size()));
+	out << static_cast< quint64 >(5) << static_cast< quint64 >(300) << static_cast< quint64 >(1) << 32
+		<< static_cast< quint64 >(0x12345678) << -1 << -1000 << 1.5f << 3.25 << QByteArray("opus data")
+		<< std::numeric_limits< quint64 >::max();
+	const gsl::span< const byte > streamValues(buffer.data(), out.size());
+	for (unsigned int operations : { 0x00U, 0xE4U, 0x55U }) {
+		inputs.push_back(input(Target::PacketDataStream, static_cast< unsigned char >(operations), streamValues));
+	}
+
+	return inputs;
+}
+
+bool writeSeeds(const QString &directory) {
+	if (!QDir().mkpath(directory)) {
+		return false;
+	}
+
+	const std::vector< QByteArray > inputs = seeds();
+	for (std::size_t i = 0; i < inputs.size(); ++i) {
+		const Target target = static_cast< Target >(static_cast< unsigned char >(inputs[i][0]));
+
+		QFile file(QDir(directory).filePath(QString::fromLatin1("seed-%1-%2").arg(targetName(target)).arg(i)));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(inputs[i]) != inputs[i].size()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::vector< QByteArray > readCorpus(const QString &directory) {
+	std::vector< QByteArray > inputs;
+
+	for (const QString &name : QDir(directory).entryList(QDir::Files, QDir::Name)) {
+		QFile file(QDir(directory).filePath(name));
+		if (file.open(QIODevice::ReadOnly)) {
+			inputs.push_back(file.readAll());
+		}
+	}
+
+	return inputs;
+}
+
+} // namespace WireProtocol
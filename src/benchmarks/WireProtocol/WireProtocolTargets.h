@@ -0,0 +1,73 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_BENCHMARKS_WIREPROTOCOLTARGETS_H_
+#define MUMBLE_BENCHMARKS_WIREPROTOCOLTARGETS_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// The code that parses what the network hands us, wrapped up so that the same inputs can be fuzzed (by
+/// WireProtocol_fuzzer) and timed (by WireProtocol_benchmark).
+///
+/// An input is made up of a byte selecting the target (see Target) followed by the data for that target. Thus, any
+/// file in a corpus directory is a valid input for either tool, no matter whether it has been written by
+/// writeSeeds() or found by libFuzzer:
+///
+///     WireProtocol_benchmark --write_corpus=corpus
+///     WireProtocol_fuzzer corpus
+///     WireProtocol_benchmark --corpus=corpus
+///
+/// While fuzzing, every target verifies that the decoders agree with each other (e.g. the fast and the generic
+/// protobuf audio decoders) and with their encoders, so that optimizations of either can be checked for equivalence
+/// with the code they replace. The benchmark skips these checks and reports the time per byte decoded.
+namespace WireProtocol {
+
+enum class Target : unsigned char {
+	/// The rest of the input is the flags byte (see UDP_FLAG_*) followed by a UDP datagram for UDPDecoder::decode
+	UDPDecode,
+	/// Same as UDPDecode, but for UDPDecoder::decodePing
+	Ping,
+	/// The rest of the input is the chunk size byte followed by the data received on a control connection, which is
+	/// split into messages by readControlMessage (which is what Connection::socketRead does)
+	ControlFraming,
+	/// The rest of the input is the operations byte followed by data that is read with a PacketDataStream
+	PacketDataStream,
+};
+
+constexpr unsigned int TARGET_COUNT = 4;
+
+/// Decode as the server (instead of as the client)
+constexpr unsigned char UDP_FLAG_SERVER = 0x1;
+/// Decode in the protobuf format (instead of in the legacy one)
+constexpr unsigned char UDP_FLAG_PROTOBUF = 0x2;
+
+/// @returns The name of the given target
+const char *targetName(Target target);
+
+/// Runs the given input through its target
+///
+/// @param verify Whether to check that the target's results are consistent. Inconsistencies abort the process.
+/// @returns The number of bytes decoded, which is 0 for inputs that are too short to select a target
+std::size_t run(const std::uint8_t *data, std::size_t size, bool verify);
+
+/// @returns Some valid inputs for every target, which serve as the seeds of a fuzzing corpus
+std::vector< QByteArray > seeds();
+
+/// Writes seeds() to the given directory (one file per input)
+///
+/// @returns Whether all of them could be written
+bool writeSeeds(const QString &directory);
+
+/// @returns The inputs in the given directory
+std::vector< QByteArray > readCorpus(const QString &directory);
+
+} // namespace WireProtocol
+
+#endif // MUMBLE_BENCHMARKS_WIREPROTOCOLTARGETS_H_
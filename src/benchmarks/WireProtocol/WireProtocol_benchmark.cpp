@@ -0,0 +1,104 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// This benchmark runs the inputs of a fuzzing corpus (see WireProtocolTargets.h) through the decoders, reporting the
+// time per byte for every target. Without a corpus, it uses the seeds the corpus would start out with.
+//
+// Apart from Google Benchmark's own options, it takes
+//     --corpus=<directory>        The corpus to run (e.g. the one WireProtocol_fuzzer has been working on)
+//     --write_corpus=<directory>  Writes the seeds to the given directory and exits
+//     --verify                    Checks every input for consistency before running the benchmark
+
+#include <benchmark/benchmark.h>
+
+#include "WireProtocolTargets.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/// The inputs of every target
+std::array< std::vector< QByteArray >, WireProtocol::TARGET_COUNT > inputs;
+
+static void BM_decode(::benchmark::State &state, WireProtocol::Target target) {
+	const std::vector< QByteArray > &targetInputs = inputs[static_cast< std::size_t >(target)];
+
+	std::size_t bytes = 0;
+	for (auto _ : state) {
+		for (const QByteArray &input : targetInputs) {
+			bytes += WireProtocol::run(reinterpret_cast< const std::uint8_t * >(input.constData()),
+									   static_cast< std::size_t >(input.size()), false);
+		}
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(static_cast< std::int64_t >(bytes));
+	state.SetItemsProcessed(state.iterations() * static_cast< std::int64_t >(targetInputs.size()));
+}
+
+static const char *option(const char *argument, const char *name) {
+	const std::size_t length = std::strlen(name);
+	return std::strncmp(argument, name, length) == 0 ? argument + length : nullptr;
+}
+
+int main(int argc, char **argv) {
+	QString corpus;
+	bool verify = false;
+
+	// Google Benchmark refuses options it doesn't know, so ours are taken out before it gets to see them
+	int remaining = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (const char *seedDirectory = option(argv[i], "--write_corpus=")) {
+			if (!WireProtocol::writeSeeds(QString::fromLocal8Bit(seedDirectory))) {
+				std::fprintf(stderr, "Failed to write the seeds to %s\n", seedDirectory);
+				return 1;
+			}
+			return 0;
+		} else if (const char *corpusDirectory = option(argv[i], "--corpus=")) {
+			corpus = QString::fromLocal8Bit(corpusDirectory);
+		} else if (std::strcmp(argv[i], "--verify") == 0) {
+			verify = true;
+		} else {
+			argv[remaining++] = argv[i];
+		}
+	}
+	argc = remaining;
+
+	const std::vector< QByteArray > all = corpus.isEmpty() ? WireProtocol::seeds() : WireProtocol::readCorpus(corpus);
+	for (const QByteArray &input : all) {
+		if (input.size() < 2) {
+			continue;
+		}
+
+		if (verify) {
+			// Inconsistencies abort the benchmark
+			WireProtocol::run(reinterpret_cast< const std::uint8_t * >(input.constData()),
+							  static_cast< std::size_t >(input.size()), true);
+		}
+		inputs[static_cast< unsigned char >(input[0]) % WireProtocol::TARGET_COUNT].push_back(input);
+	}
+
+	for (unsigned int i = 0; i < WireProtocol::TARGET_COUNT; ++i) {
+		const WireProtocol::Target target = static_cast< WireProtocol::Target >(i);
+		if (!inputs[i].empty()) {
+			::benchmark::RegisterBenchmark((std::string("BM_decode/") + WireProtocol::targetName(target)).c_str(),
+										   BM_decode, target);
+		}
+	}
+
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	::benchmark::RunSpecifiedBenchmarks();
+
+	return 0;
+}
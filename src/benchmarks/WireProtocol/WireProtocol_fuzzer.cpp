@@ -0,0 +1,18 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// The libFuzzer entry point for the targets in WireProtocolTargets.h. A corpus to start from can be written by
+// running WireProtocol_benchmark --write_corpus=<directory>.
+
+#include "WireProtocolTargets.h"
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+	WireProtocol::run(data, size, true);
+
+	return 0;
+}
@@ -127,5 +127,73 @@ BENCHMARK_REGISTER_F(Fixture, BM_encodeNew_UpdateOnly)
 	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
 	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
 
+BENCHMARK_DEFINE_F(Fixture, BM_encodeNew_UpdateOnly_StaticFormat)(::benchmark::State &state) {
+	encoder.prepareAudioPacket(audioData);
+
+	for (auto _ : state) {
+		encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Protobuf >(audioData);
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_encodeNew_UpdateOnly_StaticFormat)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew)(::benchmark::State &state) {
+	encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	gsl::span< const Mumble::Protocol::byte > encoded = encoder.encodeAudioPacket(audioData);
+	std::vector< Mumble::Protocol::byte > packet(encoded.begin(), encoded.end());
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(
+		Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(packet));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE + 1, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeLegacy)(::benchmark::State &state) {
+	encoder.setProtocolVersion(Version::fromComponents(1, 3, 0));
+
+	gsl::span< const Mumble::Protocol::byte > encoded = encoder.encodeAudioPacket(audioData);
+	std::vector< Mumble::Protocol::byte > packet(encoded.begin(), encoded.end());
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(Version::fromComponents(1, 3, 0));
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(packet));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeLegacy)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE + 1, TO_PAYLOAD_SIZE);
+
+BENCHMARK_DEFINE_F(Fixture, BM_decodeNew_Generic)(::benchmark::State &state) {
+	encoder.setProtocolVersion(Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	gsl::span< const Mumble::Protocol::byte > encoded = encoder.encodeAudioPacket(audioData);
+	std::vector< Mumble::Protocol::byte > packet(encoded.begin(), encoded.end());
+	// An unknown (varint) field 15 makes the decoder fall back to the generic Protobuf parser
+	packet.push_back(15 << 3);
+	packet.push_back(1);
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(
+		Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(decoder.decode(packet));
+	}
+}
+
+BENCHMARK_REGISTER_F(Fixture, BM_decodeNew_Generic)
+	->RangeMultiplier(PAYLOAD_SIZE_MULTIPLIER)
+	->Range(FROM_PAYLOAD_SIZE + 1, TO_PAYLOAD_SIZE);
+
 
 BENCHMARK_MAIN();
@@ -0,0 +1,43 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CryptState.h"
+#include "CryptStateAEAD.h"
+#include "CryptStateOCB2.h"
+#include "OCB2Accelerated.h"
+
+#include <algorithm>
+
+std::unique_ptr< CryptState > CryptState::create(CryptMode mode) {
+	if (!isSupported(mode)) {
+		return nullptr;
+	}
+
+	if (mode == CryptMode::OCB2_AES128) {
+		return std::make_unique< CryptStateOCB2 >();
+	}
+
+	return std::make_unique< CryptStateAEAD >(mode);
+}
+
+bool CryptState::isSupported(CryptMode mode) {
+	return mode == CryptMode::OCB2_AES128 || CryptStateAEAD::cipherFor(mode) != nullptr;
+}
+
+std::vector< CryptMode > CryptState::preferredModes() {
+	std::vector< CryptMode > modes;
+
+	// Without the CPU's AES instructions, ChaCha20 is a lot faster than AES
+	if (OCB2Accelerated::isSupported()) {
+		modes = { CryptMode::AES128_GCM, CryptMode::CHACHA20_POLY1305 };
+	} else {
+		modes = { CryptMode::CHACHA20_POLY1305, CryptMode::AES128_GCM };
+	}
+
+	modes.erase(std::remove_if(modes.begin(), modes.end(), [](CryptMode mode) { return !isSupported(mode); }),
+				modes.end());
+
+	return modes;
+}
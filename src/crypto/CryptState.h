@@ -7,24 +7,49 @@
 #define MUMBLE_CRYPTSTATE_H_
 
 #include "Timer.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
+class CryptState;
+
+/// The ways in which the UDP traffic can be encrypted. The values match the ones of MumbleProto::CryptSetup::Mode.
+enum class CryptMode { OCB2_AES128 = 0, AES128_GCM = 1, CHACHA20_POLY1305 = 2 };
+
+/// A single receiver of a packet that is encrypted via CryptState::encryptBatch()
+struct CryptBatchEntry {
+	/// The receiver's crypt state. The caller has to make sure that no one else encrypts with it during
+	/// encryptBatch().
+	CryptState *state;
+	/// Receives the encrypted packet (see CryptState::encrypt)
+	unsigned char *dst;
+	/// Whether the packet could be encrypted for this receiver
+	bool success;
+};
+
+/// The encrypting and the decrypting half of a state are independent of each other: encrypt() only uses the encrypt
+/// IV, whereas decrypt() only uses the decrypt IV, the local statistics and tLastGood (the key is only read by both).
+/// Thus one thread may encrypt packets while another one is decrypting. The statistics are atomic so that they can be
+/// read from any thread.
 class CryptState {
 private:
 	Q_DISABLE_COPY(CryptState)
 public:
-	unsigned int uiGood   = 0;
-	unsigned int uiLate   = 0;
-	unsigned int uiLost   = 0;
-	unsigned int uiResync = 0;
-
-	unsigned int uiRemoteGood   = 0;
-	unsigned int uiRemoteLate   = 0;
-	unsigned int uiRemoteLost   = 0;
-	unsigned int uiRemoteResync = 0;
-
-	Timer tLastGood;
-	Timer tLastRequest;
+	std::atomic< unsigned int > uiGood{ 0 };
+	std::atomic< unsigned int > uiLate{ 0 };
+	std::atomic< unsigned int > uiLost{ 0 };
+	std::atomic< unsigned int > uiResync{ 0 };
+
+	std::atomic< unsigned int > uiRemoteGood{ 0 };
+	std::atomic< unsigned int > uiRemoteLate{ 0 };
+	std::atomic< unsigned int > uiRemoteLost{ 0 };
+	std::atomic< unsigned int > uiRemoteResync{ 0 };
+
+	/// Restarted for every packet that has been decrypted, which only has to be measured in seconds
+	CoarseTimer tLastGood;
+	CoarseTimer tLastRequest;
 	bool bInit = false;
 	CryptState(){};
 	virtual ~CryptState(){};
@@ -39,8 +64,48 @@ public:
 	virtual std::string getEncryptIV()                                                           = 0;
 	virtual std::string getDecryptIV()                                                           = 0;
 
+	/// @returns The mode implemented by this state
+	virtual CryptMode mode() const = 0;
+	/// @returns The amount of bytes an encrypted packet is longer than the plain text
+	virtual unsigned int overhead() const = 0;
+
 	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) = 0;
 	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length)   = 0;
+
+	/// @returns A new (invalid) state for the given mode or nullptr if the mode isn't supported
+	static std::unique_ptr< CryptState > create(CryptMode mode);
+	/// @returns Whether create() is able to create states for the given mode
+	static bool isSupported(CryptMode mode);
+	/// @returns All supported modes besides OCB2-AES128 in the order in which they should be used on this
+	/// 	machine. The ones that are fast without hardware support for AES are preferred if the CPU lacks it.
+	static std::vector< CryptMode > preferredModes();
+
+	/// The maximum amount of receivers a packet should be encrypted for by a single encryptBatch() call. Callers
+	/// size their buffers by it and implementations never process more entries than this at once.
+	static constexpr std::size_t MAX_BATCH = 16;
+
+	/// Encrypts the same packet for several receivers. The result is the same as calling encrypt() on every entry's
+	/// state, but implementations may share work across the receivers (e.g. by handing the blocks of several
+	/// receivers to the CPU at once).
+	static void encryptBatch(const unsigned char *source, unsigned int plain_length, CryptBatchEntry *entries,
+							 std::size_t count) {
+		std::size_t done = 0;
+		while (done < count) {
+			done += entries[done].state->encryptBatchPrefix(source, plain_length, entries + done, count - done);
+		}
+	}
+
+protected:
+	/// Encrypts the given packet for the first (at least one) of the given entries. The first entry's state is
+	/// this one, the following ones may be of any kind.
+	///
+	/// @returns The amount of entries that have been processed
+	virtual std::size_t encryptBatchPrefix(const unsigned char *source, unsigned int plain_length,
+										   CryptBatchEntry *entries, std::size_t count) {
+		Q_UNUSED(count);
+		entries[0].success = encrypt(source, entries[0].dst, plain_length);
+		return 1;
+	}
 };
 
 
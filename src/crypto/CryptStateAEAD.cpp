@@ -0,0 +1,245 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CryptStateAEAD.h"
+#include "CryptographicRandom.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+CryptStateAEAD::CryptStateAEAD(CryptMode mode)
+	: CryptState(), m_mode(mode), m_cipher(cipherFor(mode)),
+	  m_keySize(m_cipher ? static_cast< unsigned int >(EVP_CIPHER_key_length(m_cipher)) : 0),
+	  m_encryptCtx(EVP_CIPHER_CTX_new()), m_decryptCtx(EVP_CIPHER_CTX_new()) {
+	assert(m_cipher && m_keySize <= MAX_KEY_SIZE);
+
+	memset(m_rawKey, 0, sizeof(m_rawKey));
+	memset(m_encryptIV, 0, sizeof(m_encryptIV));
+	memset(m_decryptIV, 0, sizeof(m_decryptIV));
+	memset(m_decryptHistory, 0, sizeof(m_decryptHistory));
+}
+
+CryptStateAEAD::~CryptStateAEAD() noexcept {
+	EVP_CIPHER_CTX_free(m_encryptCtx);
+	EVP_CIPHER_CTX_free(m_decryptCtx);
+}
+
+const EVP_CIPHER *CryptStateAEAD::cipherFor(CryptMode mode) {
+	switch (mode) {
+		case CryptMode::AES128_GCM:
+			return EVP_aes_128_gcm();
+		case CryptMode::CHACHA20_POLY1305:
+#ifndef OPENSSL_NO_CHACHA
+			return EVP_chacha20_poly1305();
+#else
+			return nullptr;
+#endif
+		case CryptMode::OCB2_AES128:
+			break;
+	}
+
+	return nullptr;
+}
+
+bool CryptStateAEAD::isValid() const {
+	return bInit;
+}
+
+CryptMode CryptStateAEAD::mode() const {
+	return m_mode;
+}
+
+unsigned int CryptStateAEAD::overhead() const {
+	return 1 + TAG_SIZE;
+}
+
+void CryptStateAEAD::loadKey() {
+	// The nonce length defaults to 96 bits for both ciphers
+	EVP_EncryptInit_ex(m_encryptCtx, m_cipher, nullptr, m_rawKey, nullptr);
+	EVP_DecryptInit_ex(m_decryptCtx, m_cipher, nullptr, m_rawKey, nullptr);
+}
+
+void CryptStateAEAD::genKey() {
+	CryptographicRandom::fillBuffer(m_rawKey, static_cast< int >(m_keySize));
+	CryptographicRandom::fillBuffer(m_encryptIV, NONCE_SIZE);
+	CryptographicRandom::fillBuffer(m_decryptIV, NONCE_SIZE);
+	loadKey();
+	bInit = true;
+}
+
+bool CryptStateAEAD::setKey(const std::string &rkey, const std::string &eiv, const std::string &div) {
+	if (rkey.length() == m_keySize && eiv.length() == NONCE_SIZE && div.length() == NONCE_SIZE) {
+		memcpy(m_rawKey, rkey.data(), m_keySize);
+		memcpy(m_encryptIV, eiv.data(), NONCE_SIZE);
+		memcpy(m_decryptIV, div.data(), NONCE_SIZE);
+		loadKey();
+		bInit = true;
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateAEAD::setRawKey(const std::string &rkey) {
+	if (rkey.length() == m_keySize) {
+		memcpy(m_rawKey, rkey.data(), m_keySize);
+		loadKey();
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateAEAD::setEncryptIV(const std::string &iv) {
+	if (iv.length() == NONCE_SIZE) {
+		memcpy(m_encryptIV, iv.data(), NONCE_SIZE);
+		return true;
+	}
+	return false;
+}
+
+bool CryptStateAEAD::setDecryptIV(const std::string &iv) {
+	if (iv.length() == NONCE_SIZE) {
+		memcpy(m_decryptIV, iv.data(), NONCE_SIZE);
+		return true;
+	}
+	return false;
+}
+
+std::string CryptStateAEAD::getRawKey() {
+	return std::string(reinterpret_cast< const char * >(m_rawKey), m_keySize);
+}
+
+std::string CryptStateAEAD::getEncryptIV() {
+	return std::string(reinterpret_cast< const char * >(m_encryptIV), NONCE_SIZE);
+}
+
+std::string CryptStateAEAD::getDecryptIV() {
+	return std::string(reinterpret_cast< const char * >(m_decryptIV), NONCE_SIZE);
+}
+
+bool CryptStateAEAD::encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) {
+	// First, increase our nonce
+	for (unsigned int i = 0; i < NONCE_SIZE; i++)
+		if (++m_encryptIV[i])
+			break;
+
+	int outlen = 0;
+	if (EVP_EncryptInit_ex(m_encryptCtx, nullptr, nullptr, nullptr, m_encryptIV) != 1
+		|| EVP_EncryptUpdate(m_encryptCtx, dst + overhead(), &outlen, source, static_cast< int >(plain_length)) != 1
+		|| EVP_EncryptFinal_ex(m_encryptCtx, dst + overhead() + outlen, &outlen) != 1
+		|| EVP_CIPHER_CTX_ctrl(m_encryptCtx, EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, dst + 1) != 1) {
+		return false;
+	}
+
+	dst[0] = m_encryptIV[0];
+	return true;
+}
+
+bool CryptStateAEAD::decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) {
+	if (crypted_length < overhead())
+		return false;
+
+	const unsigned int plain_length = crypted_length - overhead();
+
+	unsigned char saveiv[NONCE_SIZE];
+	const unsigned char ivbyte = source[0];
+	bool restore               = false;
+
+	int lost = 0;
+	int late = 0;
+
+	memcpy(saveiv, m_decryptIV, NONCE_SIZE);
+
+	// See CryptStateOCB2::decrypt
+	if (((m_decryptIV[0] + 1) & 0xFF) == ivbyte) {
+		// In order as expected.
+		if (ivbyte > m_decryptIV[0]) {
+			m_decryptIV[0] = ivbyte;
+		} else if (ivbyte < m_decryptIV[0]) {
+			m_decryptIV[0] = ivbyte;
+			for (unsigned int i = 1; i < NONCE_SIZE; i++)
+				if (++m_decryptIV[i])
+					break;
+		} else {
+			return false;
+		}
+	} else {
+		// This is either out of order or a repeat.
+
+		int diff = ivbyte - m_decryptIV[0];
+		if (diff > 128)
+			diff = diff - 256;
+		else if (diff < -128)
+			diff = diff + 256;
+
+		if ((ivbyte < m_decryptIV[0]) && (diff > -30) && (diff < 0)) {
+			// Late packet, but no wraparound.
+			late           = 1;
+			lost           = -1;
+			m_decryptIV[0] = ivbyte;
+			restore        = true;
+		} else if ((ivbyte > m_decryptIV[0]) && (diff > -30) && (diff < 0)) {
+			// Last was 0x02, here comes 0xff from last round
+			late           = 1;
+			lost           = -1;
+			m_decryptIV[0] = ivbyte;
+			for (unsigned int i = 1; i < NONCE_SIZE; i++)
+				if (m_decryptIV[i]--)
+					break;
+			restore = true;
+		} else if ((ivbyte > m_decryptIV[0]) && (diff > 0)) {
+			// Lost a few packets, but beyond that we're good.
+			lost           = ivbyte - m_decryptIV[0] - 1;
+			m_decryptIV[0] = ivbyte;
+		} else if ((ivbyte < m_decryptIV[0]) && (diff > 0)) {
+			// Lost a few packets, and wrapped around
+			lost           = 256 - m_decryptIV[0] + ivbyte - 1;
+			m_decryptIV[0] = ivbyte;
+			for (unsigned int i = 1; i < NONCE_SIZE; i++)
+				if (++m_decryptIV[i])
+					break;
+		} else {
+			return false;
+		}
+
+		if (m_decryptHistory[m_decryptIV[0]] == m_decryptIV[1]) {
+			memcpy(m_decryptIV, saveiv, NONCE_SIZE);
+			return false;
+		}
+	}
+
+	// OpenSSL doesn't modify the tag it is given for verification
+	unsigned char *tag = const_cast< unsigned char * >(source + 1);
+
+	int outlen = 0;
+	if (EVP_DecryptInit_ex(m_decryptCtx, nullptr, nullptr, nullptr, m_decryptIV) != 1
+		|| EVP_CIPHER_CTX_ctrl(m_decryptCtx, EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag) != 1
+		|| EVP_DecryptUpdate(m_decryptCtx, dst, &outlen, source + overhead(), static_cast< int >(plain_length)) != 1
+		|| EVP_DecryptFinal_ex(m_decryptCtx, dst + outlen, &outlen) != 1) {
+		memcpy(m_decryptIV, saveiv, NONCE_SIZE);
+		return false;
+	}
+	m_decryptHistory[m_decryptIV[0]] = m_decryptIV[1];
+
+	if (restore)
+		memcpy(m_decryptIV, saveiv, NONCE_SIZE);
+
+	uiGood++;
+	// uiLate += late, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
+	if (late > 0) {
+		uiLate += static_cast< unsigned int >(late);
+	} else if (static_cast< int >(uiLate) > std::abs(late)) {
+		uiLate -= static_cast< unsigned int >(std::abs(late));
+	}
+	// uiLost += lost, but we have to make sure we don't cause wrap-arounds on the unsigned lhs
+	if (lost > 0) {
+		uiLost += static_cast< unsigned int >(lost);
+	} else if (static_cast< int >(uiLost) > std::abs(lost)) {
+		uiLost -= static_cast< unsigned int >(std::abs(lost));
+	}
+
+	tLastGood.restart();
+	return true;
+}
@@ -0,0 +1,68 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_CRYPTSTATEAEAD_H
+#define MUMBLE_CRYPTSTATEAEAD_H
+
+#include "CryptState.h"
+
+#include <openssl/evp.h>
+
+/// A crypt state that uses one of the AEAD ciphers provided by OpenSSL (AES-128-GCM or ChaCha20-Poly1305). Unlike
+/// OCB2, these don't need any countermeasures of our own and OpenSSL processes a whole packet in a single call.
+///
+/// An encrypted packet consists of the lowest byte of the nonce, the first TAG_SIZE bytes of the tag and the cipher
+/// text. Nonces are tracked the same way CryptStateOCB2 tracks its IVs (including the handling of late and lost
+/// packets).
+class CryptStateAEAD : public CryptState {
+public:
+	/// The size of the nonces (IVs) in bytes
+	static constexpr unsigned int NONCE_SIZE = 12;
+	/// The amount of bytes of the tag that are transmitted
+	static constexpr unsigned int TAG_SIZE = 8;
+
+	/// @param mode Either CryptMode::AES128_GCM or CryptMode::CHACHA20_POLY1305
+	explicit CryptStateAEAD(CryptMode mode);
+	~CryptStateAEAD() noexcept override;
+
+	bool isValid() const override;
+	void genKey() override;
+	bool setKey(const std::string &rkey, const std::string &eiv, const std::string &div) override;
+	bool setRawKey(const std::string &rkey) override;
+	bool setEncryptIV(const std::string &iv) override;
+	bool setDecryptIV(const std::string &iv) override;
+	std::string getRawKey() override;
+	std::string getEncryptIV() override;
+	std::string getDecryptIV() override;
+
+	CryptMode mode() const override;
+	unsigned int overhead() const override;
+
+	bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) override;
+	bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) override;
+
+	/// @returns The OpenSSL cipher for the given mode or nullptr if it isn't an AEAD mode supported by OpenSSL
+	static const EVP_CIPHER *cipherFor(CryptMode mode);
+
+private:
+	static constexpr unsigned int MAX_KEY_SIZE = 32;
+
+	const CryptMode m_mode;
+	const EVP_CIPHER *m_cipher;
+	const unsigned int m_keySize;
+
+	unsigned char m_rawKey[MAX_KEY_SIZE];
+	unsigned char m_encryptIV[NONCE_SIZE];
+	unsigned char m_decryptIV[NONCE_SIZE];
+	unsigned char m_decryptHistory[0x100];
+
+	EVP_CIPHER_CTX *m_encryptCtx;
+	EVP_CIPHER_CTX *m_decryptCtx;
+
+	/// Hands the raw key to the OpenSSL contexts, which only need to be given the nonce for every packet then
+	void loadKey();
+};
+
+#endif // MUMBLE_CRYPTSTATEAEAD_H
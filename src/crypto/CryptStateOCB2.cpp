@@ -32,12 +32,14 @@
 
 CryptStateOCB2::CryptStateOCB2()
 	: CryptState(), enc_ctx_ocb_enc(EVP_CIPHER_CTX_new()), dec_ctx_ocb_enc(EVP_CIPHER_CTX_new()),
-	  enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()), dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()) {
+	  enc_ctx_ocb_dec(EVP_CIPHER_CTX_new()), dec_ctx_ocb_dec(EVP_CIPHER_CTX_new()),
+	  m_accelerated(OCB2Accelerated::isSupported()) {
 	for (int i = 0; i < 0x100; i++)
 		decrypt_history[i] = 0;
 	memset(raw_key, 0, AES_KEY_SIZE_BYTES);
 	memset(encrypt_iv, 0, AES_BLOCK_SIZE);
 	memset(decrypt_iv, 0, AES_BLOCK_SIZE);
+	updateAcceleratedKey();
 }
 
 CryptStateOCB2::~CryptStateOCB2() noexcept {
@@ -51,10 +53,26 @@ bool CryptStateOCB2::isValid() const {
 	return bInit;
 }
 
+bool CryptStateOCB2::isAccelerated() const {
+	return m_accelerated;
+}
+
+void CryptStateOCB2::setAccelerated(bool enable) {
+	m_accelerated = enable && OCB2Accelerated::isSupported();
+	updateAcceleratedKey();
+}
+
+void CryptStateOCB2::updateAcceleratedKey() {
+	if (m_accelerated) {
+		OCB2Accelerated::expandKey(raw_key, m_acceleratedKey);
+	}
+}
+
 void CryptStateOCB2::genKey() {
 	CryptographicRandom::fillBuffer(raw_key, AES_KEY_SIZE_BYTES);
 	CryptographicRandom::fillBuffer(encrypt_iv, AES_BLOCK_SIZE);
 	CryptographicRandom::fillBuffer(decrypt_iv, AES_BLOCK_SIZE);
+	updateAcceleratedKey();
 	bInit = true;
 }
 
@@ -63,6 +81,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
 		memcpy(encrypt_iv, eiv.data(), AES_BLOCK_SIZE);
 		memcpy(decrypt_iv, div.data(), AES_BLOCK_SIZE);
+		updateAcceleratedKey();
 		bInit = true;
 		return true;
 	}
@@ -72,6 +91,7 @@ bool CryptStateOCB2::setKey(const std::string &rkey, const std::string &eiv, con
 bool CryptStateOCB2::setRawKey(const std::string &rkey) {
 	if (rkey.length() == AES_KEY_SIZE_BYTES) {
 		memcpy(raw_key, rkey.data(), AES_KEY_SIZE_BYTES);
+		updateAcceleratedKey();
 		return true;
 	}
 	return false;
@@ -105,13 +125,20 @@ std::string CryptStateOCB2::getDecryptIV() {
 	return std::string(reinterpret_cast< const char * >(decrypt_iv), AES_BLOCK_SIZE);
 }
 
+CryptMode CryptStateOCB2::mode() const {
+	return CryptMode::OCB2_AES128;
+}
+
+unsigned int CryptStateOCB2::overhead() const {
+	// The lowest byte of the IV and the first three bytes of the tag
+	return 4;
+}
+
 bool CryptStateOCB2::encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) {
 	unsigned char tag[AES_BLOCK_SIZE];
 
 	// First, increase our IV.
-	for (int i = 0; i < AES_BLOCK_SIZE; i++)
-		if (++encrypt_iv[i])
-			break;
+	incrementEncryptIV();
 
 	if (!ocb_encrypt(source, dst + 4, plain_length, encrypt_iv, tag)) {
 		return false;
@@ -124,6 +151,49 @@ bool CryptStateOCB2::encrypt(const unsigned char *source, unsigned char *dst, un
 	return true;
 }
 
+std::size_t CryptStateOCB2::encryptBatchPrefix(const unsigned char *source, unsigned int plain_length,
+											   CryptBatchEntry *entries, std::size_t count) {
+	if (!m_accelerated) {
+		return CryptState::encryptBatchPrefix(source, plain_length, entries, count);
+	}
+
+	// Hand all directly following receivers that can make use of the accelerated implementation to it at once
+	OCB2Accelerated::BatchEntry batch[MAX_BATCH] = {};
+	unsigned char tags[MAX_BATCH][AES_BLOCK_SIZE];
+
+	std::size_t n = 0;
+	for (; n < count && n < MAX_BATCH; ++n) {
+		CryptStateOCB2 *state = dynamic_cast< CryptStateOCB2 * >(entries[n].state);
+		if (!state || !state->m_accelerated) {
+			break;
+		}
+
+		state->incrementEncryptIV();
+		batch[n] = { &state->m_acceleratedKey, state->encrypt_iv, entries[n].dst + 4, tags[n] };
+	}
+
+	const bool success = OCB2Accelerated::encryptBatch(source, plain_length, batch, n, true);
+
+	for (std::size_t i = 0; i < n; ++i) {
+		entries[i].success = success;
+		if (success) {
+			unsigned char *dst = entries[i].dst;
+			dst[0]             = batch[i].nonce[0];
+			dst[1]             = tags[i][0];
+			dst[2]             = tags[i][1];
+			dst[3]             = tags[i][2];
+		}
+	}
+
+	return n;
+}
+
+void CryptStateOCB2::incrementEncryptIV() {
+	for (int i = 0; i < AES_BLOCK_SIZE; i++)
+		if (++encrypt_iv[i])
+			break;
+}
+
 bool CryptStateOCB2::decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) {
 	if (crypted_length < 4)
 		return false;
@@ -295,6 +365,11 @@ static void inline ZERO(keyblock &block) {
 
 bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encrypted, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
+	if (m_accelerated) {
+		return OCB2Accelerated::encrypt(m_acceleratedKey, plain, encrypted, len, nonce, tag,
+										modifyPlainOnXEXStarAttack);
+	}
+
 	keyblock checksum, delta, tmp, pad;
 	bool success = true;
 
@@ -370,6 +445,10 @@ bool CryptStateOCB2::ocb_encrypt(const unsigned char *plain, unsigned char *encr
 
 bool CryptStateOCB2::ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len,
 								 const unsigned char *nonce, unsigned char *tag) {
+	if (m_accelerated) {
+		return OCB2Accelerated::decrypt(m_acceleratedKey, encrypted, plain, len, nonce, tag);
+	}
+
 	keyblock checksum, delta, tmp, pad;
 	bool success = true;
 
@@ -7,6 +7,7 @@
 #define MUMBLE_CRYPTSTATEOCB2_H
 
 #include "CryptState.h"
+#include "OCB2Accelerated.h"
 
 #include <openssl/evp.h>
 
@@ -30,6 +31,9 @@ public:
 	virtual std::string getEncryptIV() Q_DECL_OVERRIDE;
 	virtual std::string getDecryptIV() Q_DECL_OVERRIDE;
 
+	virtual CryptMode mode() const Q_DECL_OVERRIDE;
+	virtual unsigned int overhead() const Q_DECL_OVERRIDE;
+
 	virtual bool decrypt(const unsigned char *source, unsigned char *dst, unsigned int crypted_length) Q_DECL_OVERRIDE;
 	virtual bool encrypt(const unsigned char *source, unsigned char *dst, unsigned int plain_length) Q_DECL_OVERRIDE;
 
@@ -38,6 +42,16 @@ public:
 	bool ocb_decrypt(const unsigned char *encrypted, unsigned char *plain, unsigned int len, const unsigned char *nonce,
 					 unsigned char *tag);
 
+	/// @returns Whether the CPU's AES instructions are used (see OCB2Accelerated)
+	bool isAccelerated() const;
+	/// Enables or disables the use of the CPU's AES instructions. They can only be enabled if the CPU
+	/// supports them, which is also the default.
+	void setAccelerated(bool enable);
+
+protected:
+	std::size_t encryptBatchPrefix(const unsigned char *source, unsigned int plain_length, CryptBatchEntry *entries,
+								   std::size_t count) override;
+
 private:
 	unsigned char raw_key[AES_KEY_SIZE_BYTES];
 	unsigned char encrypt_iv[AES_BLOCK_SIZE];
@@ -48,6 +62,13 @@ private:
 	EVP_CIPHER_CTX *dec_ctx_ocb_enc;
 	EVP_CIPHER_CTX *enc_ctx_ocb_dec;
 	EVP_CIPHER_CTX *dec_ctx_ocb_dec;
+
+	bool m_accelerated;
+	/// The expanded raw_key (only used if m_accelerated is set)
+	OCB2Accelerated::Key m_acceleratedKey;
+
+	void updateAcceleratedKey();
+	void incrementEncryptIV();
 };
 
 
@@ -9,8 +9,38 @@
 
 #include <QtCore/QDebug>
 
+#include <openssl/crypto.h>
 #include <openssl/rand.h>
 
+#include <atomic>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#	include <pthread.h>
+#endif
+
+namespace {
+
+/// Incremented in the child whenever the process forks, so that the child doesn't hand out the same bytes as its
+/// parent from a copy of the parent's pools
+std::atomic< unsigned int > forkGeneration{ 0 };
+
+/// The random bytes a thread has drawn from RAND_bytes() in advance. Small requests (e.g. a session's crypt key)
+/// are served from here, so that a thread generating many of them only calls into OpenSSL once per pool.
+struct RandomPool {
+	unsigned char bytes[CryptographicRandom::POOL_SIZE];
+	/// The number of bytes at the start of bytes that haven't been handed out yet
+	int available = 0;
+	/// The value of forkGeneration the bytes have been drawn at
+	unsigned int generation = 0;
+
+	~RandomPool() { OPENSSL_cleanse(bytes, sizeof(bytes)); }
+};
+
+thread_local RandomPool pool;
+
+} // namespace
+
 void CryptographicRandom::fillBuffer(void *buf, int numBytes) {
 	// We treat negative and zero values of numBytes to be
 	// fatal errors in the program. Abort the program if such
@@ -19,13 +49,38 @@ void CryptographicRandom::fillBuffer(void *buf, int numBytes) {
 		qFatal("CryptographicRandom::fillBuffer(): numBytes is <= 0");
 	}
 
+	if (numBytes > MAX_POOLED_SIZE) {
+		drawBytes(buf, numBytes);
+		return;
+	}
+
+#ifdef Q_OS_UNIX
+	static const int forkHandlerRegistered = pthread_atfork(nullptr, nullptr, []() { forkGeneration++; });
+	Q_UNUSED(forkHandlerRegistered);
+#endif
+
+	const unsigned int generation = forkGeneration.load(std::memory_order_relaxed);
+	if (pool.available < numBytes || pool.generation != generation) {
+		// Reseed: the rest of the pool is dropped rather than combined with the new bytes
+		drawBytes(pool.bytes, POOL_SIZE);
+		pool.available  = POOL_SIZE;
+		pool.generation = generation;
+	}
+
+	// The bytes are handed out from the end of the remaining ones and wiped, so that they can't be recovered from it later
+	pool.available -= numBytes;
+	std::memcpy(buf, pool.bytes + pool.available, static_cast< std::size_t >(numBytes));
+	OPENSSL_cleanse(pool.bytes + pool.available, static_cast< std::size_t >(numBytes));
+}
+
+void CryptographicRandom::drawBytes(void *buf, int numBytes) {
 	// RAND_bytes only returns an error if the entropy pool has not yet been sufficiently filled,
 	// or in the case of a catastrophic, unrecoverable error in the RAND_bytes implementation happens.
 	// OpenSSL needs at least 32-bytes of high-entropy random data to seed its CSPRNG.
 	// If OpenSSL cannot acquire enough random data to seed its CSPRNG at the time Mumble and Murmur
 	// are running, there is not much we can do about it other than aborting the program.
 	if (RAND_bytes(reinterpret_cast< unsigned char * >(buf), numBytes) != 1) {
-		qFatal("CryptographicRandom::fillBuffer(): internal error in OpenSSL's RAND_bytes or entropy pool not yet "
+		qFatal("CryptographicRandom::drawBytes(): internal error in OpenSSL's RAND_bytes or entropy pool not yet "
 			   "filled.");
 	}
 }
@@ -12,9 +12,18 @@
 /// pseudo-random data for use in cryptography.
 class CryptographicRandom {
 public:
+	/// The number of bytes each thread draws from OpenSSL at once to serve the small requests from.
+	static constexpr int POOL_SIZE = 4096;
+	/// The largest request served from the pool. Larger ones are passed to OpenSSL directly.
+	static constexpr int MAX_POOLED_SIZE = 256;
+
 	/// Fill the buffer at |buf| with |numBytes| bytes of pseudo-random data.
 	/// The value of |numBytes| must be >= 0. Otherwise, program execution is aborted.
 	///
+	/// Requests of up to MAX_POOLED_SIZE bytes are served from a pool of POOL_SIZE bytes
+	/// the calling thread has drawn from OpenSSL in advance. The pool is refilled once
+	/// it runs out and after the process has forked.
+	///
 	/// This function is equivalent to the arc4random_buf() function from OpenBSD.
 	///
 	/// This function should not ever fail. It is considered a catastrophic failure if
@@ -40,6 +49,10 @@ public:
 	/// it does. The program is aborted if the function fails, because it is generally
 	/// impossible to recover from such a scenario.
 	static uint32_t uniform(uint32_t upperBound);
+
+private:
+	/// Fill the buffer at |buf| with |numBytes| bytes drawn from OpenSSL's RAND_bytes().
+	static void drawBytes(void *buf, int numBytes);
 };
 
 #endif
@@ -0,0 +1,654 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/*
+ * This code implements OCB-AES128.
+ * In the US, OCB is covered by patents. The inventor has given a license
+ * to all programs distributed under the GPL.
+ * Mumble is BSD (revised) licensed, meaning you can use the code in a
+ * closed-source program. If you do, you'll have to either replace
+ * OCB with something else or get yourself a license.
+ */
+
+#include "OCB2Accelerated.h"
+
+#include <QtCore/QtEndian>
+#include <QtCore/QtGlobal>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define OCB2_ACCELERATED_X86
+#	include <emmintrin.h>
+#	include <wmmintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#	if defined(_MSC_VER) && !defined(__clang__)
+#		define OCB2_TARGET_AES
+#	else
+#		define OCB2_TARGET_AES __attribute__((target("sse2,aes")))
+#	endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#	define OCB2_ACCELERATED_ARM
+#	include <arm_neon.h>
+#	if defined(_MSC_VER) && !defined(__clang__)
+#		define OCB2_TARGET_AES
+#	elif defined(__clang__)
+#		define OCB2_TARGET_AES __attribute__((target("aes")))
+#	else
+#		define OCB2_TARGET_AES __attribute__((target("+crypto")))
+#	endif
+#	if defined(Q_OS_LINUX)
+#		include <sys/auxv.h>
+#		ifndef HWCAP_AES
+#			define HWCAP_AES (1 << 3)
+#		endif
+#	elif defined(Q_OS_WIN)
+#		include "win.h"
+#	endif
+#endif
+
+namespace OCB2Accelerated {
+
+namespace {
+constexpr unsigned int BLOCK_SIZE = 16;
+/// The maximum amount of blocks that are handed to the CPU at once
+constexpr unsigned int BATCH_SIZE = 8;
+/// The amount of receivers whose blocks are handed to the CPU at once by encryptBatch()
+constexpr std::size_t LANES = 8;
+
+/// A single block in memory order
+struct Block {
+	quint64 words[2];
+};
+
+inline Block load(const unsigned char *src) {
+	Block block;
+	memcpy(block.words, src, BLOCK_SIZE);
+	return block;
+}
+
+inline void store(unsigned char *dst, const Block &block) {
+	memcpy(dst, block.words, BLOCK_SIZE);
+}
+
+inline unsigned char *bytes(Block &block) {
+	return reinterpret_cast< unsigned char * >(block.words);
+}
+
+inline const unsigned char *bytes(const Block &block) {
+	return reinterpret_cast< const unsigned char * >(block.words);
+}
+
+inline Block operator^(const Block &lhs, const Block &rhs) {
+	return { { lhs.words[0] ^ rhs.words[0], lhs.words[1] ^ rhs.words[1] } };
+}
+
+/// Multiplies the block by two in GF(2^128) (S2 in CryptStateOCB2)
+inline Block times2(const Block &block) {
+	const quint64 high  = qFromBigEndian(block.words[0]);
+	const quint64 low   = qFromBigEndian(block.words[1]);
+	const quint64 carry = high >> 63;
+
+	return { { qToBigEndian((high << 1) | (low >> 63)), qToBigEndian((low << 1) ^ (carry * 0x87)) } };
+}
+
+/// Multiplies the block by three in GF(2^128) (S3 in CryptStateOCB2)
+inline Block times3(const Block &block) {
+	return block ^ times2(block);
+}
+
+/// @returns Whether all but the last byte of the given block are zero, which is what a block needs to look
+/// 	like to be used for the attack described in section 9 of https://eprint.iacr.org/2019/311
+inline bool isXEXStarAttackBlock(const unsigned char *block) {
+	unsigned char sum = 0;
+	for (unsigned int i = 0; i < BLOCK_SIZE - 1; ++i) {
+		sum |= block[i];
+	}
+	return sum == 0;
+}
+
+// clang-format off
+const unsigned char SBOX[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+// clang-format on
+
+/// The regular AES-128 key schedule. It is only computed whenever the key changes, so there is no need
+/// to use the CPU's instructions for it.
+void expandEncryptionKey(const unsigned char *rawKey, unsigned char *roundKeys) {
+	static const unsigned char RCON[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+	memcpy(roundKeys, rawKey, BLOCK_SIZE);
+
+	for (unsigned int i = BLOCK_SIZE; i < 11 * BLOCK_SIZE; i += 4) {
+		unsigned char word[4] = { roundKeys[i - 4], roundKeys[i - 3], roundKeys[i - 2], roundKeys[i - 1] };
+
+		if (i % BLOCK_SIZE == 0) {
+			// RotWord, SubWord and Rcon
+			const unsigned char first = word[0];
+			word[0]                   = SBOX[word[1]] ^ RCON[i / BLOCK_SIZE - 1];
+			word[1]                   = SBOX[word[2]];
+			word[2]                   = SBOX[word[3]];
+			word[3]                   = SBOX[first];
+		}
+
+		for (unsigned int j = 0; j < 4; ++j) {
+			roundKeys[i + j] = roundKeys[i + j - BLOCK_SIZE] ^ word[j];
+		}
+	}
+}
+
+/// The operations that make use of the CPU's AES instructions
+struct Backend {
+	/// Encrypts the given amount of consecutive blocks (ECB)
+	void (*encryptBlocks)(const unsigned char *roundKeys, const unsigned char *src, unsigned char *dst,
+						  std::size_t count);
+	/// Decrypts the given amount of consecutive blocks (ECB)
+	void (*decryptBlocks)(const unsigned char *roundKeys, const unsigned char *src, unsigned char *dst,
+						  std::size_t count);
+	/// Encrypts consecutive blocks in place, each of them with its own key. The function at index i handles i + 1
+	/// blocks.
+	void (*encryptLanes[LANES])(const unsigned char *const *roundKeys, unsigned char *blocks);
+	/// Derives the round keys for decryption from the ones for encryption
+	void (*invertKey)(const unsigned char *encryptKeys, unsigned char *decryptKeys);
+};
+
+#if defined(OCB2_ACCELERATED_X86)
+OCB2_TARGET_AES void encryptBlocksAESNI(const unsigned char *roundKeys, const unsigned char *src,
+										unsigned char *dst, std::size_t count) {
+	__m128i keys[11];
+	for (unsigned int r = 0; r < 11; ++r) {
+		keys[r] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys + r * BLOCK_SIZE));
+	}
+
+	std::size_t i = 0;
+	// Interleave four blocks so that the CPU can work on all of them at the same time
+	for (; i + 4 <= count; i += 4) {
+		__m128i blocks[4];
+		for (unsigned int j = 0; j < 4; ++j) {
+			blocks[j] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(src + (i + j) * BLOCK_SIZE));
+			blocks[j] = _mm_xor_si128(blocks[j], keys[0]);
+		}
+		for (unsigned int r = 1; r < 10; ++r) {
+			for (unsigned int j = 0; j < 4; ++j) {
+				blocks[j] = _mm_aesenc_si128(blocks[j], keys[r]);
+			}
+		}
+		for (unsigned int j = 0; j < 4; ++j) {
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + (i + j) * BLOCK_SIZE),
+							 _mm_aesenclast_si128(blocks[j], keys[10]));
+		}
+	}
+	for (; i < count; ++i) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast< const __m128i * >(src + i * BLOCK_SIZE));
+		block         = _mm_xor_si128(block, keys[0]);
+		for (unsigned int r = 1; r < 10; ++r) {
+			block = _mm_aesenc_si128(block, keys[r]);
+		}
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + i * BLOCK_SIZE), _mm_aesenclast_si128(block, keys[10]));
+	}
+}
+
+OCB2_TARGET_AES void decryptBlocksAESNI(const unsigned char *roundKeys, const unsigned char *src,
+										unsigned char *dst, std::size_t count) {
+	__m128i keys[11];
+	for (unsigned int r = 0; r < 11; ++r) {
+		keys[r] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys + r * BLOCK_SIZE));
+	}
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i blocks[4];
+		for (unsigned int j = 0; j < 4; ++j) {
+			blocks[j] = _mm_loadu_si128(reinterpret_cast< const __m128i * >(src + (i + j) * BLOCK_SIZE));
+			blocks[j] = _mm_xor_si128(blocks[j], keys[0]);
+		}
+		for (unsigned int r = 1; r < 10; ++r) {
+			for (unsigned int j = 0; j < 4; ++j) {
+				blocks[j] = _mm_aesdec_si128(blocks[j], keys[r]);
+			}
+		}
+		for (unsigned int j = 0; j < 4; ++j) {
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + (i + j) * BLOCK_SIZE),
+							 _mm_aesdeclast_si128(blocks[j], keys[10]));
+		}
+	}
+	for (; i < count; ++i) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast< const __m128i * >(src + i * BLOCK_SIZE));
+		block         = _mm_xor_si128(block, keys[0]);
+		for (unsigned int r = 1; r < 10; ++r) {
+			block = _mm_aesdec_si128(block, keys[r]);
+		}
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + i * BLOCK_SIZE), _mm_aesdeclast_si128(block, keys[10]));
+	}
+}
+
+// The amount of lanes is a template parameter so that the state of all lanes is kept in registers
+template< std::size_t N >
+OCB2_TARGET_AES void encryptLanesAESNI(const unsigned char *const *roundKeys, unsigned char *blocks) {
+	__m128i lanes[N];
+	for (std::size_t j = 0; j < N; ++j) {
+		lanes[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast< const __m128i * >(blocks + j * BLOCK_SIZE)),
+								 _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys[j])));
+	}
+	for (unsigned int r = 1; r < 10; ++r) {
+		for (std::size_t j = 0; j < N; ++j) {
+			const __m128i key = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys[j] + r * BLOCK_SIZE));
+			lanes[j]          = _mm_aesenc_si128(lanes[j], key);
+		}
+	}
+	for (std::size_t j = 0; j < N; ++j) {
+		const __m128i key = _mm_loadu_si128(reinterpret_cast< const __m128i * >(roundKeys[j] + 10 * BLOCK_SIZE));
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(blocks + j * BLOCK_SIZE), _mm_aesenclast_si128(lanes[j], key));
+	}
+}
+
+OCB2_TARGET_AES void invertKeyAESNI(const unsigned char *encryptKeys, unsigned char *decryptKeys) {
+	memcpy(decryptKeys, encryptKeys + 10 * BLOCK_SIZE, BLOCK_SIZE);
+	for (unsigned int r = 1; r < 10; ++r) {
+		const __m128i key = _mm_loadu_si128(reinterpret_cast< const __m128i * >(encryptKeys + (10 - r) * BLOCK_SIZE));
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(decryptKeys + r * BLOCK_SIZE), _mm_aesimc_si128(key));
+	}
+	memcpy(decryptKeys + 10 * BLOCK_SIZE, encryptKeys, BLOCK_SIZE);
+}
+
+bool cpuSupportsAES() {
+#	ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	const unsigned int ecx = static_cast< unsigned int >(info[2]);
+#	else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+#	endif
+	// CPUID.1:ECX.AESNI[bit 25]
+	return (ecx & (1U << 25)) != 0;
+}
+
+const Backend AESNI_BACKEND = { encryptBlocksAESNI,
+								decryptBlocksAESNI,
+								{ encryptLanesAESNI< 1 >, encryptLanesAESNI< 2 >, encryptLanesAESNI< 3 >,
+								  encryptLanesAESNI< 4 >, encryptLanesAESNI< 5 >, encryptLanesAESNI< 6 >,
+								  encryptLanesAESNI< 7 >, encryptLanesAESNI< 8 > },
+								invertKeyAESNI };
+#elif defined(OCB2_ACCELERATED_ARM)
+OCB2_TARGET_AES void encryptBlocksARM(const unsigned char *roundKeys, const unsigned char *src, unsigned char *dst,
+									  std::size_t count) {
+	uint8x16_t keys[11];
+	for (unsigned int r = 0; r < 11; ++r) {
+		keys[r] = vld1q_u8(roundKeys + r * BLOCK_SIZE);
+	}
+
+	std::size_t i = 0;
+	// Interleave four blocks so that the CPU can work on all of them at the same time
+	for (; i + 4 <= count; i += 4) {
+		uint8x16_t blocks[4];
+		for (unsigned int j = 0; j < 4; ++j) {
+			blocks[j] = vld1q_u8(src + (i + j) * BLOCK_SIZE);
+		}
+		for (unsigned int r = 0; r < 9; ++r) {
+			for (unsigned int j = 0; j < 4; ++j) {
+				blocks[j] = vaesmcq_u8(vaeseq_u8(blocks[j], keys[r]));
+			}
+		}
+		for (unsigned int j = 0; j < 4; ++j) {
+			vst1q_u8(dst + (i + j) * BLOCK_SIZE, veorq_u8(vaeseq_u8(blocks[j], keys[9]), keys[10]));
+		}
+	}
+	for (; i < count; ++i) {
+		uint8x16_t block = vld1q_u8(src + i * BLOCK_SIZE);
+		for (unsigned int r = 0; r < 9; ++r) {
+			block = vaesmcq_u8(vaeseq_u8(block, keys[r]));
+		}
+		vst1q_u8(dst + i * BLOCK_SIZE, veorq_u8(vaeseq_u8(block, keys[9]), keys[10]));
+	}
+}
+
+OCB2_TARGET_AES void decryptBlocksARM(const unsigned char *roundKeys, const unsigned char *src, unsigned char *dst,
+									  std::size_t count) {
+	uint8x16_t keys[11];
+	for (unsigned int r = 0; r < 11; ++r) {
+		keys[r] = vld1q_u8(roundKeys + r * BLOCK_SIZE);
+	}
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		uint8x16_t blocks[4];
+		for (unsigned int j = 0; j < 4; ++j) {
+			blocks[j] = vld1q_u8(src + (i + j) * BLOCK_SIZE);
+		}
+		for (unsigned int r = 0; r < 9; ++r) {
+			for (unsigned int j = 0; j < 4; ++j) {
+				blocks[j] = vaesimcq_u8(vaesdq_u8(blocks[j], keys[r]));
+			}
+		}
+		for (unsigned int j = 0; j < 4; ++j) {
+			vst1q_u8(dst + (i + j) * BLOCK_SIZE, veorq_u8(vaesdq_u8(blocks[j], keys[9]), keys[10]));
+		}
+	}
+	for (; i < count; ++i) {
+		uint8x16_t block = vld1q_u8(src + i * BLOCK_SIZE);
+		for (unsigned int r = 0; r < 9; ++r) {
+			block = vaesimcq_u8(vaesdq_u8(block, keys[r]));
+		}
+		vst1q_u8(dst + i * BLOCK_SIZE, veorq_u8(vaesdq_u8(block, keys[9]), keys[10]));
+	}
+}
+
+template< std::size_t N >
+OCB2_TARGET_AES void encryptLanesARM(const unsigned char *const *roundKeys, unsigned char *blocks) {
+	uint8x16_t lanes[N];
+	for (std::size_t j = 0; j < N; ++j) {
+		lanes[j] = vld1q_u8(blocks + j * BLOCK_SIZE);
+	}
+	for (unsigned int r = 0; r < 9; ++r) {
+		for (std::size_t j = 0; j < N; ++j) {
+			lanes[j] = vaesmcq_u8(vaeseq_u8(lanes[j], vld1q_u8(roundKeys[j] + r * BLOCK_SIZE)));
+		}
+	}
+	for (std::size_t j = 0; j < N; ++j) {
+		vst1q_u8(blocks + j * BLOCK_SIZE, veorq_u8(vaeseq_u8(lanes[j], vld1q_u8(roundKeys[j] + 9 * BLOCK_SIZE)),
+												   vld1q_u8(roundKeys[j] + 10 * BLOCK_SIZE)));
+	}
+}
+
+OCB2_TARGET_AES void invertKeyARM(const unsigned char *encryptKeys, unsigned char *decryptKeys) {
+	memcpy(decryptKeys, encryptKeys + 10 * BLOCK_SIZE, BLOCK_SIZE);
+	for (unsigned int r = 1; r < 10; ++r) {
+		vst1q_u8(decryptKeys + r * BLOCK_SIZE, vaesimcq_u8(vld1q_u8(encryptKeys + (10 - r) * BLOCK_SIZE)));
+	}
+	memcpy(decryptKeys + 10 * BLOCK_SIZE, encryptKeys, BLOCK_SIZE);
+}
+
+bool cpuSupportsAES() {
+#	if defined(Q_OS_MACOS) || defined(Q_OS_IOS)
+	// All 64-bit Apple CPUs support the cryptography extension
+	return true;
+#	elif defined(Q_OS_LINUX)
+	return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#	elif defined(Q_OS_WIN)
+	return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE);
+#	else
+	return false;
+#	endif
+}
+
+const Backend ARM_BACKEND = { encryptBlocksARM,
+							  decryptBlocksARM,
+							  { encryptLanesARM< 1 >, encryptLanesARM< 2 >, encryptLanesARM< 3 >,
+							    encryptLanesARM< 4 >, encryptLanesARM< 5 >, encryptLanesARM< 6 >,
+							    encryptLanesARM< 7 >, encryptLanesARM< 8 > },
+							  invertKeyARM };
+#endif
+
+const Backend *detectBackend() {
+#if defined(OCB2_ACCELERATED_X86)
+	if (cpuSupportsAES()) {
+		return &AESNI_BACKEND;
+	}
+#elif defined(OCB2_ACCELERATED_ARM)
+	if (cpuSupportsAES()) {
+		return &ARM_BACKEND;
+	}
+#endif
+	return nullptr;
+}
+
+const Backend *backend() {
+	static const Backend *instance = detectBackend();
+	return instance;
+}
+} // namespace
+
+bool isSupported() {
+	return backend() != nullptr;
+}
+
+void expandKey(const unsigned char *rawKey, Key &key) {
+	expandEncryptionKey(rawKey, key.encrypt);
+	backend()->invertKey(key.encrypt, key.decrypt);
+}
+
+bool encrypt(const Key &key, const unsigned char *plain, unsigned char *encrypted, unsigned int len,
+			 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack) {
+	const Backend &impl = *backend();
+	bool success        = true;
+
+	Block delta;
+	Block checksum = { { 0, 0 } };
+	impl.encryptBlocks(key.encrypt, nonce, bytes(delta), 1);
+
+	// All blocks but the last one (which may be a partial one) can be processed independently of each other
+	const unsigned int fullBlocks = len > BLOCK_SIZE ? (len - 1) / BLOCK_SIZE : 0;
+
+	Block deltas[BATCH_SIZE];
+	Block blocks[BATCH_SIZE];
+	for (unsigned int first = 0; first < fullBlocks; first += BATCH_SIZE) {
+		const unsigned int count = std::min(fullBlocks - first, BATCH_SIZE);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			const unsigned char *src = plain + (first + i) * BLOCK_SIZE;
+			Block block              = load(src);
+
+			// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+			// (see CryptStateOCB2::ocb_encrypt)
+			if (first + i == fullBlocks - 1 && isXEXStarAttackBlock(src)) {
+				if (modifyPlainOnXEXStarAttack) {
+					bytes(block)[0] ^= 1;
+				} else {
+					success = false;
+				}
+			}
+
+			delta     = times2(delta);
+			deltas[i] = delta;
+			checksum  = checksum ^ block;
+			blocks[i] = delta ^ block;
+		}
+
+		impl.encryptBlocks(key.encrypt, bytes(blocks[0]), bytes(blocks[0]), count);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			store(encrypted + (first + i) * BLOCK_SIZE, deltas[i] ^ blocks[i]);
+		}
+	}
+
+	const unsigned int remaining = len - fullBlocks * BLOCK_SIZE;
+	plain += fullBlocks * BLOCK_SIZE;
+	encrypted += fullBlocks * BLOCK_SIZE;
+
+	delta     = times2(delta);
+	Block tmp = { { 0, qToBigEndian(static_cast< quint64 >(remaining * 8)) } };
+	tmp       = tmp ^ delta;
+	Block pad;
+	impl.encryptBlocks(key.encrypt, bytes(tmp), bytes(pad), 1);
+	tmp = pad;
+	memcpy(bytes(tmp), plain, remaining);
+	checksum = checksum ^ tmp;
+	tmp      = pad ^ tmp;
+	memcpy(encrypted, bytes(tmp), remaining);
+
+	delta = times3(delta);
+	tmp   = delta ^ checksum;
+	impl.encryptBlocks(key.encrypt, bytes(tmp), tag, 1);
+
+	return success;
+}
+
+bool encryptBatch(const unsigned char *plain, unsigned int len, const BatchEntry *entries, std::size_t count,
+				  bool modifyPlainOnXEXStarAttack) {
+	const Backend &impl = *backend();
+	bool success        = true;
+
+	const unsigned int fullBlocks = len > BLOCK_SIZE ? (len - 1) / BLOCK_SIZE : 0;
+	const unsigned int remaining  = len - fullBlocks * BLOCK_SIZE;
+
+	// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+	// (see CryptStateOCB2::ocb_encrypt)
+	bool flipABit = false;
+	if (fullBlocks > 0 && isXEXStarAttackBlock(plain + (fullBlocks - 1) * BLOCK_SIZE)) {
+		if (modifyPlainOnXEXStarAttack) {
+			flipABit = true;
+		} else {
+			success = false;
+		}
+	}
+
+	// The part of the checksum that covers the full blocks is the same for all receivers
+	Block sharedChecksum = { { 0, 0 } };
+	for (unsigned int b = 0; b < fullBlocks; ++b) {
+		sharedChecksum = sharedChecksum ^ load(plain + b * BLOCK_SIZE);
+	}
+	if (flipABit) {
+		bytes(sharedChecksum)[0] ^= 1;
+	}
+
+	const Block lengthBlock = { { 0, qToBigEndian(static_cast< quint64 >(remaining * 8)) } };
+
+	for (std::size_t first = 0; first < count; first += LANES) {
+		const BatchEntry *group = entries + first;
+		const std::size_t lanes = std::min(count - first, LANES);
+
+		if (lanes == 1) {
+			// A single receiver is better off with the blocks of its packet being interleaved instead
+			encrypt(*group->key, plain, group->encrypted, len, group->nonce, group->tag, modifyPlainOnXEXStarAttack);
+			continue;
+		}
+
+		const unsigned char *keys[LANES];
+		Block deltas[LANES];
+		Block blocks[LANES];
+		for (std::size_t j = 0; j < lanes; ++j) {
+			keys[j]   = group[j].key->encrypt;
+			blocks[j] = load(group[j].nonce);
+		}
+		impl.encryptLanes[lanes - 1](keys, bytes(blocks[0]));
+		std::copy(blocks, blocks + lanes, deltas);
+
+		for (unsigned int b = 0; b < fullBlocks; ++b) {
+			Block block = load(plain + b * BLOCK_SIZE);
+			if (flipABit && b == fullBlocks - 1) {
+				bytes(block)[0] ^= 1;
+			}
+
+			for (std::size_t j = 0; j < lanes; ++j) {
+				deltas[j] = times2(deltas[j]);
+				blocks[j] = deltas[j] ^ block;
+			}
+			impl.encryptLanes[lanes - 1](keys, bytes(blocks[0]));
+			for (std::size_t j = 0; j < lanes; ++j) {
+				store(group[j].encrypted + b * BLOCK_SIZE, deltas[j] ^ blocks[j]);
+			}
+		}
+
+		for (std::size_t j = 0; j < lanes; ++j) {
+			deltas[j] = times2(deltas[j]);
+			blocks[j] = lengthBlock ^ deltas[j];
+		}
+		impl.encryptLanes[lanes - 1](keys, bytes(blocks[0]));
+
+		for (std::size_t j = 0; j < lanes; ++j) {
+			const Block pad = blocks[j];
+			Block tmp       = pad;
+			memcpy(bytes(tmp), plain + fullBlocks * BLOCK_SIZE, remaining);
+			const Block checksum = sharedChecksum ^ tmp;
+			tmp                  = pad ^ tmp;
+			memcpy(group[j].encrypted + fullBlocks * BLOCK_SIZE, bytes(tmp), remaining);
+
+			deltas[j] = times3(deltas[j]);
+			blocks[j] = deltas[j] ^ checksum;
+		}
+		impl.encryptLanes[lanes - 1](keys, bytes(blocks[0]));
+		for (std::size_t j = 0; j < lanes; ++j) {
+			store(group[j].tag, blocks[j]);
+		}
+	}
+
+	return success;
+}
+
+bool decrypt(const Key &key, const unsigned char *encrypted, unsigned char *plain, unsigned int len,
+			 const unsigned char *nonce, unsigned char *tag) {
+	const Backend &impl = *backend();
+	bool success        = true;
+
+	Block delta;
+	Block checksum = { { 0, 0 } };
+	impl.encryptBlocks(key.encrypt, nonce, bytes(delta), 1);
+
+	const unsigned int fullBlocks = len > BLOCK_SIZE ? (len - 1) / BLOCK_SIZE : 0;
+
+	Block deltas[BATCH_SIZE];
+	Block blocks[BATCH_SIZE];
+	for (unsigned int first = 0; first < fullBlocks; first += BATCH_SIZE) {
+		const unsigned int count = std::min(fullBlocks - first, BATCH_SIZE);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			delta     = times2(delta);
+			deltas[i] = delta;
+			blocks[i] = delta ^ load(encrypted + (first + i) * BLOCK_SIZE);
+		}
+
+		impl.decryptBlocks(key.decrypt, bytes(blocks[0]), bytes(blocks[0]), count);
+
+		for (unsigned int i = 0; i < count; ++i) {
+			const Block block = deltas[i] ^ blocks[i];
+			store(plain + (first + i) * BLOCK_SIZE, block);
+			checksum = checksum ^ block;
+		}
+	}
+
+	const unsigned int remaining = len - fullBlocks * BLOCK_SIZE;
+	plain += fullBlocks * BLOCK_SIZE;
+	encrypted += fullBlocks * BLOCK_SIZE;
+
+	delta     = times2(delta);
+	Block tmp = { { 0, qToBigEndian(static_cast< quint64 >(remaining * 8)) } };
+	tmp       = tmp ^ delta;
+	Block pad;
+	impl.encryptBlocks(key.encrypt, bytes(tmp), bytes(pad), 1);
+	tmp = { { 0, 0 } };
+	memcpy(bytes(tmp), encrypted, remaining);
+	tmp      = tmp ^ pad;
+	checksum = checksum ^ tmp;
+	memcpy(plain, bytes(tmp), remaining);
+
+	// Counter-cryptanalysis described in section 9 of https://eprint.iacr.org/2019/311
+	// (see CryptStateOCB2::ocb_decrypt)
+	if (memcmp(bytes(tmp), bytes(delta), BLOCK_SIZE - 1) == 0) {
+		success = false;
+	}
+
+	delta = times3(delta);
+	tmp   = delta ^ checksum;
+	impl.encryptBlocks(key.encrypt, bytes(tmp), tag, 1);
+
+	return success;
+}
+
+} // namespace OCB2Accelerated
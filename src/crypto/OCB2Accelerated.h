@@ -0,0 +1,60 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_OCB2ACCELERATED_H
+#define MUMBLE_OCB2ACCELERATED_H
+
+#include <cstddef>
+
+/// An implementation of OCB2-AES128 that uses the AES instructions of the CPU (AES-NI on x86, the
+/// cryptography extension on ARMv8). Instead of encrypting one block at a time, the blocks of a packet
+/// are handed to the CPU in groups so that several blocks are in flight at once.
+///
+/// The results are identical to the ones of CryptStateOCB2's own (portable) implementation, which is
+/// used whenever the CPU lacks the required instructions (see isSupported()).
+namespace OCB2Accelerated {
+
+/// The expanded AES-128 key
+struct Key {
+	/// The round keys for encryption
+	unsigned char encrypt[11 * 16];
+	/// The round keys for decryption (equivalent inverse cipher)
+	unsigned char decrypt[11 * 16];
+};
+
+/// @returns Whether the CPU supports the instructions required by this implementation. This is only
+/// 	checked once.
+bool isSupported();
+
+/// Expands the given raw (16-byte) key. Must only be called if isSupported() returns true.
+void expandKey(const unsigned char *rawKey, Key &key);
+
+/// The equivalent of CryptStateOCB2::ocb_encrypt
+bool encrypt(const Key &key, const unsigned char *plain, unsigned char *encrypted, unsigned int len,
+			 const unsigned char *nonce, unsigned char *tag, bool modifyPlainOnXEXStarAttack);
+/// A single receiver of a packet that is encrypted via encryptBatch()
+struct BatchEntry {
+	const Key *key;
+	const unsigned char *nonce;
+	/// Receives the encrypted packet (of the same length as the plain text)
+	unsigned char *encrypted;
+	/// Receives the tag (a full block)
+	unsigned char *tag;
+};
+
+/// Encrypts the same plain text for several receivers, each with its own key and nonce. The result is the same as
+/// calling encrypt() for every entry, but the blocks of several receivers are handed to the CPU at once and the work
+/// that only depends on the plain text (such as the XEX* countermeasures) is done only once.
+///
+/// @returns Whether the encryption succeeded. As this only depends on the plain text, it applies to all entries.
+bool encryptBatch(const unsigned char *plain, unsigned int len, const BatchEntry *entries, std::size_t count,
+				  bool modifyPlainOnXEXStarAttack);
+/// The equivalent of CryptStateOCB2::ocb_decrypt
+bool decrypt(const Key &key, const unsigned char *encrypted, unsigned char *plain, unsigned int len,
+			 const unsigned char *nonce, unsigned char *tag);
+
+} // namespace OCB2Accelerated
+
+#endif // MUMBLE_OCB2ACCELERATED_H
@@ -14,7 +14,9 @@
 #include <future>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <QObject>
 
@@ -56,11 +58,60 @@ struct MumbleAPICurator {
 		const char *m_sourceFunctionName;
 	};
 
+	/// The lock for m_entries, as resources are allocated and freed on the threads of the plugins
+	std::mutex m_entriesMutex;
 	std::unordered_map< const void *, Entry > m_entries;
 
+	/// Keeps track of the given resource
+	void insert(const void *ptr, Entry entry);
+
 	~MumbleAPICurator();
 };
 
+/// A copy of the state of the connection that the read-only API functions are answered from. Snapshots are never
+/// modified, but replaced as a whole on the main thread whenever the state changes (see
+/// MumbleAPI::invalidateSnapshot()), so that plugins can query them from any thread without waiting for the main
+/// thread.
+struct StateSnapshot {
+	struct User {
+		/// The user's name (UTF-8)
+		std::string name;
+		/// The user's certificate hash (hexadecimal)
+		std::string hash;
+		/// The channel the user is in or -1 if there is none
+		mumble_channelid_t channel = -1;
+		bool locallyMuted          = false;
+	};
+
+	struct Channel {
+		/// The channel's name (UTF-8)
+		std::string name;
+		/// The sessions of the users in the channel
+		std::vector< mumble_userid_t > users;
+	};
+
+	/// Whether there is a connection to a server at all
+	bool connected = false;
+	/// The ID of the connection (only valid if connected)
+	mumble_connection_t connection = -1;
+	/// Whether the connection has finished synchronizing
+	bool synchronized = false;
+	/// The local user's session (only valid if synchronized)
+	mumble_userid_t localUser = 0;
+	/// The hash of the server's certificate (hexadecimal)
+	std::string serverHash;
+	bool localUserMuted    = false;
+	bool localUserDeafened = false;
+
+	std::unordered_map< mumble_userid_t, User > users;
+	std::unordered_map< mumble_channelid_t, Channel > channels;
+
+	/// @returns The user with the given session or nullptr if there is none
+	const User *user(mumble_userid_t session) const;
+	/// @returns The channel with the given ID or nullptr if there is none
+	const Channel *channel(mumble_channelid_t channelID) const;
+};
+
 /// This object contains the actual API implementation. It also takes care of synchronizing API calls
 /// with Mumble's main thread so that plugins can call them from an arbitrary thread without causing
 /// issues.
@@ -73,11 +124,21 @@ class MumbleAPI : public QObject {
 public:
 	static MumbleAPI &get();
 
+	/// @returns The current state snapshot. This function may be called from any thread.
+	std::shared_ptr< const StateSnapshot > snapshot() const;
+	/// Makes the main thread replace the state snapshot in the next iteration of the event loop. Several calls before
+	/// the snapshot has been replaced are coalesced.
+	void invalidateSnapshot();
+
 public slots:
+	/// Replaces the state snapshot by one of the current state (main thread only)
+	void refreshSnapshot();
+
 	// The description of the functions is provided in MumbleAPI.h
 
-	// Note that every slot is synchronized and is therefore guaranteed to be executed in the main
-	// thread. For the synchronization strategy see below.
+	// Note that every slot that changes the state is synchronized and is therefore guaranteed to be executed in the
+	// main thread. The read-only ones are answered from the state snapshot on the calling thread. For the
+	// synchronization strategy see below.
 	void freeMemory_v_1_0_x(mumble_plugin_id_t callerID, const void *ptr, std::shared_ptr< api_promise_t > promise);
 	void getActiveServerConnection_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t *connection,
 										   std::shared_ptr< api_promise_t > promise);
@@ -160,12 +221,20 @@ public slots:
 							std::shared_ptr< api_promise_t > promise);
 	void playSample_v_1_2_x(mumble_plugin_id_t callerID, const char *samplePath, float volume,
 							std::shared_ptr< api_promise_t > promise);
+	void getAudioLatencyHistogram_v_1_3_x(mumble_plugin_id_t callerID, mumble_audio_latency_stage_t stage,
+										  mumble_latency_histogram_t *histogram,
+										  std::shared_ptr< api_promise_t > promise);
 
 
 private:
 	MumbleAPI();
 
 	MumbleAPICurator m_curator;
+	/// The state the read-only functions are answered from. It must only be accessed through std::atomic_load and
+	/// std::atomic_store.
+	std::shared_ptr< const StateSnapshot > m_snapshot;
+	/// Whether a refresh of m_snapshot has been scheduled already
+	std::atomic_bool m_snapshotInvalidated;
 };
 
 /// @returns The Mumble API struct (v1.0.x)
@@ -174,6 +243,9 @@ MumbleAPI_v_1_0_x getMumbleAPI_v_1_0_x();
 /// @returns The Mumble API struct (v1.2.x)
 MumbleAPI_v_1_2_x getMumbleAPI_v_1_2_x();
 
+/// @returns The Mumble API struct (v1.3.x)
+MumbleAPI_v_1_3_x getMumbleAPI_v_1_3_x();
+
 /// Converts from the Qt key-encoding to the API's key encoding.
 ///
 /// @param keyCode The Qt key-code that shall be converted
@@ -205,6 +277,8 @@ Q_DECLARE_METATYPE(mumble_settings_key_t)
 Q_DECLARE_METATYPE(mumble_settings_key_t *)
 Q_DECLARE_METATYPE(mumble_transmission_mode_t)
 Q_DECLARE_METATYPE(mumble_transmission_mode_t *)
+Q_DECLARE_METATYPE(mumble_audio_latency_stage_t)
+Q_DECLARE_METATYPE(mumble_latency_histogram_t *)
 Q_DECLARE_METATYPE(std::shared_ptr< API::api_promise_t >)
 
 //////////////////////////////////////////////////////////////
@@ -212,14 +286,18 @@ Q_DECLARE_METATYPE(std::shared_ptr< API::api_promise_t >)
 //////////////////////////////////////////////////////////////
 
 /**
- * Every API function call checks whether it is being called from the main thread. If it is,
- * it continues executing as usual. If it is not however, it uses Qt's signal/slot mechanism
- * to schedule the respective function to be run in the main thread in the next iteration of
- * the event loop.
+ * Every API function call that changes the state checks whether it is being called from the main
+ * thread. If it is, it continues executing as usual. If it is not however, it uses Qt's signal/slot
+ * mechanism to schedule the respective function to be run in the main thread in the next iteration
+ * of the event loop.
  * In order to synchronize with the calling thread, the return value (error code) of these
  * functions is "returned" as a promise. Thus by accessing the exit code via the corresponding
  * future, the calling thread is blocked until the function has been executed in the main thread
  * (and thereby set the exit code once it is done allowing the calling thread to unblock).
+ *
+ * The read-only functions about users, channels and the connection are executed on the calling
+ * thread instead. They read the StateSnapshot, which the main thread replaces whenever the
+ * state changes, and thus never have to wait for the main thread.
  */
 
 #endif
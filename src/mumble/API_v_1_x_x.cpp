@@ -4,6 +4,7 @@
 // Mumble source tree or at <https://www.mumble.info/LICENSE>.
 
 #include "API.h"
+#include "AudioLatency.h"
 #include "AudioOutput.h"
 #include "AudioOutputToken.h"
 #include "Channel.h"
@@ -31,6 +32,7 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstring>
@@ -61,6 +63,18 @@
 		EXIT_WITH(MUMBLE_EC_CONNECTION_UNSYNCHRONIZED); \
 	}
 
+// The read-only functions verify the connection against the state snapshot instead, as they don't run in the main
+// thread
+#define VERIFY_SNAPSHOT_CONNECTION(snapshot, connection)              \
+	if (!snapshot->connected || snapshot->connection != connection) { \
+		EXIT_WITH(MUMBLE_EC_CONNECTION_NOT_FOUND);                    \
+	}
+
+#define ENSURE_SNAPSHOT_SYNCHRONIZED(snapshot)          \
+	if (!snapshot->synchronized) {                      \
+		EXIT_WITH(MUMBLE_EC_CONNECTION_UNSYNCHRONIZED); \
+	}
+
 #define UNUSED(var) (void) var;
 
 namespace API {
@@ -90,6 +104,8 @@ void APIPromise::cancel() {
 }
 
 MumbleAPICurator::~MumbleAPICurator() {
+	std::lock_guard< std::mutex > lock(m_entriesMutex);
+
 	// free all remaining resources using the stored deleters
 	for (const auto &current : m_entries) {
 		const Entry &entry = current.second;
@@ -102,6 +118,25 @@ MumbleAPICurator::~MumbleAPICurator() {
 			   entry.m_sourceFunctionName);
 	}
 }
+
+void MumbleAPICurator::insert(const void *ptr, Entry entry) {
+	std::lock_guard< std::mutex > lock(m_entriesMutex);
+
+	m_entries.insert({ ptr, std::move(entry) });
+}
+
+const StateSnapshot::User *StateSnapshot::user(mumble_userid_t session) const {
+	auto it = users.find(session);
+
+	return it != users.end() ? &it->second : nullptr;
+}
+
+const StateSnapshot::Channel *StateSnapshot::channel(mumble_channelid_t channelID) const {
+	auto it = channels.find(channelID);
+
+	return it != channels.end() ? &it->second : nullptr;
+}
+
 // Some common delete-functions
 void defaultDeleter(const void *ptr) {
 	// We use const-cast in order to circumvent the shortcoming of the free() signature only taking
@@ -111,6 +146,16 @@ void defaultDeleter(const void *ptr) {
 	free(const_cast< void * >(ptr));
 }
 
+/// @returns A copy of the given string, allocated with malloc
+char *copyString(const std::string &str) {
+	// +1 for NULL terminator
+	char *array = reinterpret_cast< char * >(malloc((str.size() + 1) * sizeof(char)));
+
+	std::memcpy(array, str.c_str(), str.size() + 1);
+
+	return array;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////// API IMPLEMENTATION //////////////////////////////////
@@ -125,7 +170,7 @@ void defaultDeleter(const void *ptr) {
 	qRegisterMetaType< const type * >("const " #type " *"); \
 	qRegisterMetaType< const type ** >("const " #type " **");
 
-MumbleAPI::MumbleAPI() {
+MumbleAPI::MumbleAPI() : m_snapshot(std::make_shared< StateSnapshot >()), m_snapshotInvalidated(false) {
 	// Move this object to the main thread
 	moveToThread(qApp->thread());
 
@@ -135,8 +180,10 @@ MumbleAPI::MumbleAPI() {
 	REGISTER_METATYPE(double);
 	REGISTER_METATYPE(int);
 	REGISTER_METATYPE(int64_t);
+	REGISTER_METATYPE(mumble_audio_latency_stage_t);
 	REGISTER_METATYPE(mumble_channelid_t);
 	REGISTER_METATYPE(mumble_connection_t);
+	REGISTER_METATYPE(mumble_latency_histogram_t);
 	REGISTER_METATYPE(mumble_plugin_id_t);
 	REGISTER_METATYPE(mumble_settings_key_t);
 	REGISTER_METATYPE(mumble_transmission_mode_t);
@@ -162,24 +209,74 @@ MumbleAPI &MumbleAPI::get() {
 	return api;
 }
 
-void MumbleAPI::freeMemory_v_1_0_x(mumble_plugin_id_t callerID, const void *ptr,
-								   std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "freeMemory_v_1_0_x", Qt::QueuedConnection, Q_ARG(mumble_plugin_id_t, callerID),
-								  Q_ARG(const void *, ptr), Q_ARG(std::shared_ptr< api_promise_t >, promise));
+std::shared_ptr< const StateSnapshot > MumbleAPI::snapshot() const {
+	return std::atomic_load(&m_snapshot);
+}
 
-		return;
+void MumbleAPI::invalidateSnapshot() {
+	if (!m_snapshotInvalidated.exchange(true)) {
+		QMetaObject::invokeMethod(this, "refreshSnapshot", Qt::QueuedConnection);
 	}
+}
 
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
+void MumbleAPI::refreshSnapshot() {
+	m_snapshotInvalidated = false;
+
+	auto snapshot = std::make_shared< StateSnapshot >();
+
+	snapshot->localUserMuted    = Global::get().s.bMute;
+	snapshot->localUserDeafened = Global::get().s.bDeaf;
+
+	if (Global::get().sh) {
+		snapshot->connected    = true;
+		snapshot->connection   = Global::get().sh->getConnectionID();
+		snapshot->synchronized = Global::get().uiSession != 0;
+		snapshot->localUser    = Global::get().uiSession;
+		snapshot->serverHash   = Global::get().sh->qbaDigest.toHex().toStdString();
+	}
+
+	if (snapshot->synchronized) {
+		{
+			QReadLocker channelLock(&Channel::c_qrwlChannels);
+
+			snapshot->channels.reserve(static_cast< std::size_t >(Channel::c_qhChannels.size()));
+			for (auto it = Channel::c_qhChannels.constBegin(); it != Channel::c_qhChannels.constEnd(); ++it) {
+				StateSnapshot::Channel &channel = snapshot->channels[static_cast< mumble_channelid_t >(it.key())];
+				channel.name                    = it.value()->qsName.toStdString();
+
+				channel.users.reserve(static_cast< std::size_t >(it.value()->qlUsers.size()));
+				for (const User *user : it.value()->qlUsers) {
+					channel.users.push_back(user->uiSession);
+				}
+			}
+		}
+
+		QReadLocker userLock(&ClientUser::c_qrwlUsers);
+
+		snapshot->users.reserve(static_cast< std::size_t >(ClientUser::c_qmUsers.size()));
+		for (auto it = ClientUser::c_qmUsers.constBegin(); it != ClientUser::c_qmUsers.constEnd(); ++it) {
+			StateSnapshot::User &user = snapshot->users[it.key()];
+			user.name                 = it.value()->qsName.toStdString();
+			user.hash                 = it.value()->qsHash.toStdString();
+			user.locallyMuted         = it.value()->bLocalMute;
+			if (it.value()->cChannel) {
+				user.channel = static_cast< mumble_channelid_t >(it.value()->cChannel->iId);
+			}
+		}
 	}
 
+	std::atomic_store(&m_snapshot, std::shared_ptr< const StateSnapshot >(std::move(snapshot)));
+}
+
+void MumbleAPI::freeMemory_v_1_0_x(mumble_plugin_id_t callerID, const void *ptr,
+								   std::shared_ptr< api_promise_t > promise) {
+	// The curator is thread-safe, so this is executed on the calling thread
+
 	// Don't verify plugin ID here to avoid memory leaks
 	UNUSED(callerID);
 
+	std::lock_guard< std::mutex > lock(m_curator.m_entriesMutex);
+
 	auto it = m_curator.m_entries.find(ptr);
 	if (it != m_curator.m_entries.cend()) {
 		MumbleAPICurator::Entry &entry = (*it).second;
@@ -198,24 +295,13 @@ void MumbleAPI::freeMemory_v_1_0_x(mumble_plugin_id_t callerID, const void *ptr,
 
 void MumbleAPI::getActiveServerConnection_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t *connection,
 												  std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getActiveServerConnection_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t *, connection),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	if (Global::get().sh) {
-		*connection = Global::get().sh->getConnectionID();
+	if (state->connected) {
+		*connection = state->connection;
 
 		EXIT_WITH(MUMBLE_STATUS_OK);
 	} else {
@@ -225,90 +311,49 @@ void MumbleAPI::getActiveServerConnection_v_1_0_x(mumble_plugin_id_t callerID, m
 
 void MumbleAPI::isConnectionSynchronized_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 												 bool *synchronized, std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "isConnectionSynchronized_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(bool *, synchronized), Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
-	VERIFY_CONNECTION(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
 
-	// Right now there can only be one connection and if Global::get().uiSession is zero, then the synchronization has
-	// not finished yet (or there is no connection to begin with)
-	*synchronized = Global::get().uiSession != 0;
+	*synchronized = state->synchronized;
 
 	EXIT_WITH(MUMBLE_STATUS_OK);
 }
 
 void MumbleAPI::getLocalUserID_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 									   mumble_userid_t *userID, std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getLocalUserID_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t *, userID), Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	*userID = Global::get().uiSession;
+	*userID = state->localUser;
 
 	EXIT_WITH(MUMBLE_STATUS_OK);
 }
 
 void MumbleAPI::getUserName_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection, mumble_userid_t userID,
 									const char **name, std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getUserName_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t, userID), Q_ARG(const char **, name),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const ClientUser *user = ClientUser::get(userID);
+	const StateSnapshot::User *user = state->user(userID);
 
 	if (user) {
-		// +1 for NULL terminator
-		std::size_t size = static_cast< std::size_t >(user->qsName.toUtf8().size() + 1);
-
-		char *nameArray = reinterpret_cast< char * >(malloc(size * sizeof(char)));
-
-		std::strcpy(nameArray, user->qsName.toUtf8().data());
+		char *nameArray = copyString(user->name);
 
 		// save the allocated pointer and how to delete it
-		m_curator.m_entries.insert({ nameArray, { defaultDeleter, callerID, "getUserName" } });
+		m_curator.insert(nameArray, { defaultDeleter, callerID, "getUserName" });
 
 		*name = nameArray;
 
@@ -321,38 +366,21 @@ void MumbleAPI::getUserName_v_1_0_x(mumble_plugin_id_t callerID, mumble_connecti
 void MumbleAPI::getChannelName_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 									   mumble_channelid_t channelID, const char **name,
 									   std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getChannelName_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_channelid_t, channelID), Q_ARG(const char **, name),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const Channel *channel = Channel::get(static_cast< unsigned int >(channelID));
+	const StateSnapshot::Channel *channel = state->channel(channelID);
 
 	if (channel) {
-		// +1 for NULL terminator
-		std::size_t size = static_cast< std::size_t >(channel->qsName.toUtf8().size() + 1);
-
-		char *nameArray = reinterpret_cast< char * >(malloc(size * sizeof(char)));
-
-		std::strcpy(nameArray, channel->qsName.toUtf8().data());
+		char *nameArray = copyString(channel->name);
 
 		// save the allocated pointer and how to delete it
-		m_curator.m_entries.insert({ nameArray, { defaultDeleter, callerID, "getChannelName" } });
+		m_curator.insert(nameArray, { defaultDeleter, callerID, "getChannelName" });
 
 		*name = nameArray;
 
@@ -365,43 +393,26 @@ void MumbleAPI::getChannelName_v_1_0_x(mumble_plugin_id_t callerID, mumble_conne
 void MumbleAPI::getAllUsers_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 									mumble_userid_t **users, std::size_t *userCount,
 									std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getAllUsers_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t **, users), Q_ARG(std::size_t *, userCount),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
-
-	QReadLocker userLock(&ClientUser::c_qrwlUsers);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	std::size_t amount = static_cast< std::size_t >(ClientUser::c_qmUsers.size());
-
-	auto it = ClientUser::c_qmUsers.constBegin();
+	std::size_t amount = state->users.size();
 
 	mumble_userid_t *userIDs = reinterpret_cast< mumble_userid_t * >(malloc(sizeof(mumble_userid_t) * amount));
 
-	unsigned int index = 0;
-	while (it != ClientUser::c_qmUsers.constEnd()) {
-		userIDs[index] = it.key();
+	std::size_t index = 0;
+	for (const auto &current : state->users) {
+		userIDs[index] = current.first;
 
-		it++;
 		index++;
 	}
 
-	m_curator.m_entries.insert({ userIDs, { defaultDeleter, callerID, "getAllUsers" } });
+	m_curator.insert(userIDs, { defaultDeleter, callerID, "getAllUsers" });
 
 	*users     = userIDs;
 	*userCount = amount;
@@ -412,44 +423,27 @@ void MumbleAPI::getAllUsers_v_1_0_x(mumble_plugin_id_t callerID, mumble_connecti
 void MumbleAPI::getAllChannels_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 									   mumble_channelid_t **channels, std::size_t *channelCount,
 									   std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getAllChannels_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_channelid_t **, channels), Q_ARG(std::size_t *, channelCount),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
-
-	QReadLocker channelLock(&Channel::c_qrwlChannels);
-
-	std::size_t amount = static_cast< std::size_t >(Channel::c_qhChannels.size());
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	auto it = Channel::c_qhChannels.constBegin();
+	std::size_t amount = state->channels.size();
 
 	mumble_channelid_t *channelIDs =
 		reinterpret_cast< mumble_channelid_t * >(malloc(sizeof(mumble_channelid_t) * amount));
 
-	unsigned int index = 0;
-	while (it != Channel::c_qhChannels.constEnd()) {
-		channelIDs[index] = static_cast< mumble_channelid_t >(it.key());
+	std::size_t index = 0;
+	for (const auto &current : state->channels) {
+		channelIDs[index] = current.first;
 
-		it++;
 		index++;
 	}
 
-	m_curator.m_entries.insert({ channelIDs, { defaultDeleter, callerID, "getAllChannels" } });
+	m_curator.insert(channelIDs, { defaultDeleter, callerID, "getAllChannels" });
 
 	*channels     = channelIDs;
 	*channelCount = amount;
@@ -460,34 +454,22 @@ void MumbleAPI::getAllChannels_v_1_0_x(mumble_plugin_id_t callerID, mumble_conne
 void MumbleAPI::getChannelOfUser_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 										 mumble_userid_t userID, mumble_channelid_t *channelID,
 										 std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getChannelOfUser_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t, userID), Q_ARG(mumble_channelid_t *, channelID),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const ClientUser *user = ClientUser::get(userID);
+	const StateSnapshot::User *user = state->user(userID);
 
 	if (!user) {
 		EXIT_WITH(MUMBLE_EC_USER_NOT_FOUND);
 	}
 
-	if (user->cChannel) {
-		*channelID = static_cast< mumble_channelid_t >(user->cChannel->iId);
+	if (user->channel >= 0) {
+		*channelID = user->channel;
 
 		EXIT_WITH(MUMBLE_STATUS_OK);
 	} else {
@@ -498,44 +480,27 @@ void MumbleAPI::getChannelOfUser_v_1_0_x(mumble_plugin_id_t callerID, mumble_con
 void MumbleAPI::getUsersInChannel_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 										  mumble_channelid_t channelID, mumble_userid_t **users, std::size_t *userCount,
 										  std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getUsersInChannel_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_channelid_t, channelID), Q_ARG(mumble_userid_t **, users),
-								  Q_ARG(std::size_t *, userCount), Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const Channel *channel = Channel::get(static_cast< unsigned int >(channelID));
+	const StateSnapshot::Channel *channel = state->channel(channelID);
 
 	if (!channel) {
 		EXIT_WITH(MUMBLE_EC_CHANNEL_NOT_FOUND);
 	}
 
-	std::size_t amount = static_cast< std::size_t >(channel->qlUsers.size());
+	std::size_t amount = channel->users.size();
 
 	mumble_userid_t *userIDs = reinterpret_cast< mumble_userid_t * >(malloc(sizeof(mumble_userid_t) * amount));
 
-	int index = 0;
-	foreach (const User *currentUser, channel->qlUsers) {
-		userIDs[index] = currentUser->uiSession;
+	std::copy(channel->users.begin(), channel->users.end(), userIDs);
 
-		index++;
-	}
-
-	m_curator.m_entries.insert({ userIDs, { defaultDeleter, callerID, "getUsersInChannel" } });
+	m_curator.insert(userIDs, { defaultDeleter, callerID, "getUsersInChannel" });
 
 	*users     = userIDs;
 	*userCount = amount;
@@ -581,120 +546,69 @@ void MumbleAPI::getLocalUserTransmissionMode_v_1_0_x(mumble_plugin_id_t callerID
 void MumbleAPI::isUserLocallyMuted_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 										   mumble_userid_t userID, bool *muted,
 										   std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "isUserLocallyMuted_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t, userID), Q_ARG(bool *, muted),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const ClientUser *user = ClientUser::get(userID);
+	const StateSnapshot::User *user = state->user(userID);
 
 	if (!user) {
 		EXIT_WITH(MUMBLE_EC_USER_NOT_FOUND);
 	}
 
-	*muted = user->bLocalMute;
+	*muted = user->locallyMuted;
 
 	EXIT_WITH(MUMBLE_STATUS_OK);
 }
 
 void MumbleAPI::isLocalUserMuted_v_1_0_x(mumble_plugin_id_t callerID, bool *muted,
 										 std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "isLocalUserMuted_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(bool *, muted),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	*muted = Global::get().s.bMute;
+	*muted = state->localUserMuted;
 
 	EXIT_WITH(MUMBLE_STATUS_OK);
 }
 
 void MumbleAPI::isLocalUserDeafened_v_1_0_x(mumble_plugin_id_t callerID, bool *deafened,
 											std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "isLocalUserDeafened_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(bool *, deafened),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	*deafened = Global::get().s.bDeaf;
+	*deafened = state->localUserDeafened;
 
 	EXIT_WITH(MUMBLE_STATUS_OK);
 }
 
 void MumbleAPI::getUserHash_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection, mumble_userid_t userID,
 									const char **hash, std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getUserHash_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(mumble_userid_t, userID), Q_ARG(const char **, hash),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const ClientUser *user = ClientUser::get(userID);
+	const StateSnapshot::User *user = state->user(userID);
 
 	if (!user) {
 		EXIT_WITH(MUMBLE_EC_USER_NOT_FOUND);
 	}
 
 	// The user's hash is already in hexadecimal representation, so we don't have to worry about null-bytes in it
-	// +1 for NULL terminator
-	std::size_t size = static_cast< std::size_t >(user->qsHash.toUtf8().size() + 1);
-
-	char *hashArray = reinterpret_cast< char * >(malloc(size * sizeof(char)));
-
-	std::strcpy(hashArray, user->qsHash.toUtf8().data());
+	char *hashArray = copyString(user->hash);
 
-	m_curator.m_entries.insert({ hashArray, { defaultDeleter, callerID, "getUserHash" } });
+	m_curator.insert(hashArray, { defaultDeleter, callerID, "getUserHash" });
 
 	*hash = hashArray;
 
@@ -703,37 +617,19 @@ void MumbleAPI::getUserHash_v_1_0_x(mumble_plugin_id_t callerID, mumble_connecti
 
 void MumbleAPI::getServerHash_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection, const char **hash,
 									  std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "getServerHash_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(const char **, hash), Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
-
-	// Use hexadecimal representation in order for the String to be properly printable and for it to be C-encodable
-	QByteArray hashHex = Global::get().sh->qbaDigest.toHex();
-	QString strHash    = QString::fromLatin1(hashHex);
-
-	// +1 for NULL terminator
-	std::size_t size = static_cast< std::size_t >(strHash.toUtf8().size() + 1);
-
-	char *hashArray = reinterpret_cast< char * >(malloc(size * sizeof(char)));
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	std::strcpy(hashArray, strHash.toUtf8().data());
+	// The hash is in hexadecimal representation in order for the String to be properly printable and for it to be
+	// C-encodable
+	char *hashArray = copyString(state->serverHash);
 
-	m_curator.m_entries.insert({ hashArray, { defaultDeleter, callerID, "getServerHash" } });
+	m_curator.insert(hashArray, { defaultDeleter, callerID, "getServerHash" });
 
 	*hash = hashArray;
 
@@ -835,7 +731,7 @@ void MumbleAPI::getUserComment_v_1_0_x(mumble_plugin_id_t callerID, mumble_conne
 
 	std::strcpy(nameArray, user->qsComment.toUtf8().data());
 
-	m_curator.m_entries.insert({ nameArray, { defaultDeleter, callerID, "getUserComment" } });
+	m_curator.insert(nameArray, { defaultDeleter, callerID, "getUserComment" });
 
 	*comment = nameArray;
 
@@ -887,7 +783,7 @@ void MumbleAPI::getChannelDescription_v_1_0_x(mumble_plugin_id_t callerID, mumbl
 
 	std::strcpy(nameArray, channel->qsDesc.toUtf8().data());
 
-	m_curator.m_entries.insert({ nameArray, { defaultDeleter, callerID, "getChannelDescription" } });
+	m_curator.insert(nameArray, { defaultDeleter, callerID, "getChannelDescription" });
 
 	*description = nameArray;
 
@@ -1096,39 +992,22 @@ void MumbleAPI::requestSetLocalUserComment_v_1_0_x(mumble_plugin_id_t callerID,
 void MumbleAPI::findUserByName_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 									   const char *userName, mumble_userid_t *userID,
 									   std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "findUserByName_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(const char *, userName), Q_ARG(mumble_userid_t *, userID),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	const QString qsUserName = QString::fromUtf8(userName);
+	const std::string name = userName ? userName : "";
 
-	QReadLocker userLock(&ClientUser::c_qrwlUsers);
-
-	auto it = ClientUser::c_qmUsers.constBegin();
-	while (it != ClientUser::c_qmUsers.constEnd()) {
-		if (it.value()->qsName == qsUserName) {
-			*userID = it.key();
+	for (const auto &current : state->users) {
+		if (current.second.name == name) {
+			*userID = current.first;
 
 			EXIT_WITH(MUMBLE_STATUS_OK);
 		}
-
-		it++;
 	}
 
 	EXIT_WITH(MUMBLE_EC_USER_NOT_FOUND);
@@ -1137,39 +1016,22 @@ void MumbleAPI::findUserByName_v_1_0_x(mumble_plugin_id_t callerID, mumble_conne
 void MumbleAPI::findChannelByName_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_t connection,
 										  const char *channelName, mumble_channelid_t *channelID,
 										  std::shared_ptr< api_promise_t > promise) {
-	if (QThread::currentThread() != thread()) {
-		// Invoke in main thread
-		QMetaObject::invokeMethod(this, "findChannelByName_v_1_0_x", Qt::QueuedConnection,
-								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_connection_t, connection),
-								  Q_ARG(const char *, channelName), Q_ARG(mumble_channelid_t *, channelID),
-								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
-
-		return;
-	}
-
-	api_promise_t::lock_guard_t guard = promise->lock();
-	if (promise->isCancelled()) {
-		return;
-	}
+	// Read-only: answered from the state snapshot on the calling thread
+	const std::shared_ptr< const StateSnapshot > state = snapshot();
 
 	VERIFY_PLUGIN_ID(callerID);
 
-	VERIFY_CONNECTION(connection);
-	ENSURE_CONNECTION_SYNCHRONIZED(connection);
-
-	const QString qsChannelName = QString::fromUtf8(channelName);
+	VERIFY_SNAPSHOT_CONNECTION(state, connection);
+	ENSURE_SNAPSHOT_SYNCHRONIZED(state);
 
-	QReadLocker channelLock(&Channel::c_qrwlChannels);
+	const std::string name = channelName ? channelName : "";
 
-	auto it = Channel::c_qhChannels.constBegin();
-	while (it != Channel::c_qhChannels.constEnd()) {
-		if (it.value()->qsName == qsChannelName) {
-			*channelID = static_cast< mumble_channelid_t >(it.key());
+	for (const auto &current : state->channels) {
+		if (current.second.name == name) {
+			*channelID = current.first;
 
 			EXIT_WITH(MUMBLE_STATUS_OK);
 		}
-
-		it++;
 	}
 
 	EXIT_WITH(MUMBLE_EC_CHANNEL_NOT_FOUND);
@@ -1356,7 +1218,7 @@ void MumbleAPI::getMumbleSetting_string_v_1_0_x(mumble_plugin_id_t callerID, mum
 
 	std::strcpy(valueArray, stringValue.toUtf8().data());
 
-	m_curator.m_entries.insert({ valueArray, { defaultDeleter, callerID, "getMumbleSetting_string" } });
+	m_curator.insert(valueArray, { defaultDeleter, callerID, "getMumbleSetting_string" });
 
 	*outValue = valueArray;
 
@@ -1574,7 +1436,8 @@ void MumbleAPI::sendData_v_1_0_x(mumble_plugin_id_t callerID, mumble_connection_
 			EXIT_WITH(MUMBLE_EC_OPERATION_UNSUPPORTED_BY_SERVER);
 		}
 
-		Global::get().sh->sendMessage(mpdt);
+		// Messages sent in quick succession are batched (if the server supports it)
+		Global::get().sh->sendPluginData(mpdt);
 
 		EXIT_WITH(MUMBLE_STATUS_OK);
 	} else {
@@ -1647,6 +1510,71 @@ void MumbleAPI::playSample_v_1_2_x(mumble_plugin_id_t callerID, const char *samp
 	}
 }
 
+void MumbleAPI::getAudioLatencyHistogram_v_1_3_x(mumble_plugin_id_t callerID, mumble_audio_latency_stage_t stage,
+												 mumble_latency_histogram_t *histogram,
+												 std::shared_ptr< api_promise_t > promise) {
+	if (QThread::currentThread() != thread()) {
+		// Invoke in main thread
+		QMetaObject::invokeMethod(this, "getAudioLatencyHistogram_v_1_3_x", Qt::QueuedConnection,
+								  Q_ARG(mumble_plugin_id_t, callerID), Q_ARG(mumble_audio_latency_stage_t, stage),
+								  Q_ARG(mumble_latency_histogram_t *, histogram),
+								  Q_ARG(std::shared_ptr< api_promise_t >, promise));
+
+		return;
+	}
+
+	api_promise_t::lock_guard_t guard = promise->lock();
+	if (promise->isCancelled()) {
+		return;
+	}
+
+	VERIFY_PLUGIN_ID(callerID);
+
+	AudioLatency::Stage latencyStage;
+	switch (stage) {
+		case MUMBLE_ALS_ENCODE:
+			latencyStage = AudioLatency::Stage::Encode;
+			break;
+		case MUMBLE_ALS_SEND:
+			latencyStage = AudioLatency::Stage::Send;
+			break;
+		case MUMBLE_ALS_NETWORK:
+			latencyStage = AudioLatency::Stage::Network;
+			break;
+		case MUMBLE_ALS_RECEIVE:
+			latencyStage = AudioLatency::Stage::Receive;
+			break;
+		case MUMBLE_ALS_JITTER_BUFFER:
+			latencyStage = AudioLatency::Stage::JitterBuffer;
+			break;
+		case MUMBLE_ALS_MIX:
+			latencyStage = AudioLatency::Stage::Mix;
+			break;
+		case MUMBLE_ALS_PLAYBACK:
+			latencyStage = AudioLatency::Stage::Playback;
+			break;
+		case MUMBLE_ALS_ECHO_CANCELLATION:
+			latencyStage = AudioLatency::Stage::EchoCancellation;
+			break;
+		default:
+			EXIT_WITH(MUMBLE_EC_UNKNOWN_LATENCY_STAGE);
+	}
+
+	static_assert(MUMBLE_LATENCY_HISTOGRAM_BUCKETS == AudioLatency::BUCKET_COUNT,
+				  "The latency histogram of the API doesn't match Mumble's");
+
+	const AudioLatency::Histogram source = AudioLatency::histogram(latencyStage);
+	for (std::size_t i = 0; i < AudioLatency::BUCKET_COUNT; ++i) {
+		histogram->bucketBounds[i] = AudioLatency::bucketBound(i);
+		histogram->bucketCounts[i] = source.counts[i];
+	}
+	histogram->sampleCount       = source.samples;
+	histogram->totalMicroseconds = source.total;
+	histogram->maxMicroseconds   = source.max;
+
+	EXIT_WITH(MUMBLE_STATUS_OK);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 /////////////////// C FUNCTION WRAPPERS FOR USE IN API STRUCT ///////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -1925,6 +1853,13 @@ C_WRAPPER(playSample_v_1_2_x)
 #undef TYPED_ARGS
 #undef ARG_NAMES
 
+#define TYPED_ARGS \
+	mumble_plugin_id_t callerID, mumble_audio_latency_stage_t stage, mumble_latency_histogram_t *histogram
+#define ARG_NAMES callerID, stage, histogram
+C_WRAPPER(getAudioLatencyHistogram_v_1_3_x)
+#undef TYPED_ARGS
+#undef ARG_NAMES
+
 
 #undef C_WRAPPER
 
@@ -2015,6 +1950,48 @@ MumbleAPI_v_1_2_x getMumbleAPI_v_1_2_x() {
 			 playSample_v_1_2_x };
 }
 
+MumbleAPI_v_1_3_x getMumbleAPI_v_1_3_x() {
+	return { freeMemory_v_1_0_x,
+			 getActiveServerConnection_v_1_0_x,
+			 isConnectionSynchronized_v_1_0_x,
+			 getLocalUserID_v_1_0_x,
+			 getUserName_v_1_0_x,
+			 getChannelName_v_1_0_x,
+			 getAllUsers_v_1_0_x,
+			 getAllChannels_v_1_0_x,
+			 getChannelOfUser_v_1_0_x,
+			 getUsersInChannel_v_1_0_x,
+			 getLocalUserTransmissionMode_v_1_0_x,
+			 isUserLocallyMuted_v_1_0_x,
+			 isLocalUserMuted_v_1_0_x,
+			 isLocalUserDeafened_v_1_0_x,
+			 getUserHash_v_1_0_x,
+			 getServerHash_v_1_0_x,
+			 getUserComment_v_1_0_x,
+			 getChannelDescription_v_1_0_x,
+			 requestLocalUserTransmissionMode_v_1_0_x,
+			 requestUserMove_v_1_0_x,
+			 requestMicrophoneActivationOverwrite_v_1_0_x,
+			 requestLocalMute_v_1_0_x,
+			 requestLocalUserMute_v_1_0_x,
+			 requestLocalUserDeaf_v_1_0_x,
+			 requestSetLocalUserComment_v_1_0_x,
+			 findUserByName_v_1_0_x,
+			 findChannelByName_v_1_0_x,
+			 getMumbleSetting_bool_v_1_0_x,
+			 getMumbleSetting_int_v_1_0_x,
+			 getMumbleSetting_double_v_1_0_x,
+			 getMumbleSetting_string_v_1_0_x,
+			 setMumbleSetting_bool_v_1_0_x,
+			 setMumbleSetting_int_v_1_0_x,
+			 setMumbleSetting_double_v_1_0_x,
+			 setMumbleSetting_string_v_1_0_x,
+			 sendData_v_1_0_x,
+			 log_v_1_0_x,
+			 playSample_v_1_2_x,
+			 getAudioLatencyHistogram_v_1_3_x };
+}
+
 #define MAP(qtName, apiName) \
 	case Qt::Key_##qtName:   \
 		return MUMBLE_KC_##apiName
@@ -2164,4 +2141,6 @@ PluginData &PluginData::get() {
 #undef VERIFY_PLUGIN_ID
 #undef VERIFY_CONNECTION
 #undef ENSURE_CONNECTION_SYNCHRONIZED
+#undef VERIFY_SNAPSHOT_CONNECTION
+#undef ENSURE_SNAPSHOT_SYNCHRONIZED
 #undef UNUSED
@@ -74,6 +74,7 @@ void LoopUser::addFrame(const Mumble::Protocol::AudioData &audioData) {
 		if (ao) {
 			Mumble::Protocol::AudioData empty;
 			empty.usedCodec = audioData.usedCodec;
+			empty.frameSize = audioData.frameSize;
 			ao->addFrameToBuffer(this, empty);
 		}
 	}
@@ -0,0 +1,260 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioBenchmark.h"
+
+#include "Audio.h"
+#include "AudioInput.h"
+#include "AudioLatency.h"
+#include "AudioOutput.h"
+#include "Global.h"
+
+#include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace AudioBenchmark {
+
+namespace {
+	/// How long a backend runs before the probes are recorded, as the first callbacks tend to be irregular
+	constexpr int WARMUP_MSECS = 1000;
+	/// The time between two impulses, which is well above the latency that can be measured
+	constexpr int IMPULSE_INTERVAL_MSECS = 1500;
+
+	struct AtomicStatistics {
+		std::atomic< quint64 > samples;
+		std::atomic< quint64 > total;
+		std::atomic< quint64 > totalSquares;
+		std::atomic< quint64 > min;
+		std::atomic< quint64 > max;
+	};
+
+	std::array< AtomicStatistics, PROBE_COUNT > &probes() {
+		// Zero-initialized, as it is static (which is why reset() has to be called before the minima make sense)
+		static std::array< AtomicStatistics, PROBE_COUNT > instance;
+		return instance;
+	}
+
+	std::atomic< bool > active{ false };
+	std::atomic< bool > impulseRequested{ false };
+	/// When the impulse that is being looked for has been mixed, 0 if there is none
+	std::atomic< quint64 > impulseMixed{ 0 };
+
+	/// Runs the event loop for the given time
+	void wait(int msecs) {
+		QEventLoop loop;
+		QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+		loop.exec();
+	}
+
+	QString formatTime(double microseconds) {
+		return QString::number(microseconds / 1000.0, 'f', 2) + QLatin1String(" ms");
+	}
+
+	void printProbe(const char *name, Probe probe, const char *unit) {
+		const Statistics stats = statistics(probe);
+		if (stats.samples == 0) {
+			printf("  %-22s n/a\n", name);
+			return;
+		}
+
+		const QString mean      = formatTime(stats.mean());
+		const QString deviation = formatTime(stats.deviation());
+		const QString min       = formatTime(static_cast< double >(stats.min));
+		const QString max       = formatTime(static_cast< double >(stats.max));
+		printf("  %-22s mean %s, deviation %s, min %s, max %s (%llu %s)\n", name, qPrintable(mean),
+			   qPrintable(deviation), qPrintable(min), qPrintable(max),
+			   static_cast< unsigned long long >(stats.samples), unit);
+	}
+} // namespace
+
+double Statistics::mean() const {
+	return samples > 0 ? static_cast< double >(total) / static_cast< double >(samples) : 0.0;
+}
+
+double Statistics::deviation() const {
+	if (samples == 0) {
+		return 0.0;
+	}
+
+	const double average = mean();
+	const double squares = static_cast< double >(totalSquares) / static_cast< double >(samples);
+	return std::sqrt(std::max(squares - average * average, 0.0));
+}
+
+bool isActive() {
+	return active.load(std::memory_order_relaxed);
+}
+
+void record(Probe probe, quint64 microseconds) {
+	AtomicStatistics &stats = probes()[static_cast< std::size_t >(probe)];
+
+	stats.samples.fetch_add(1, std::memory_order_relaxed);
+	stats.total.fetch_add(microseconds, std::memory_order_relaxed);
+	stats.totalSquares.fetch_add(microseconds * microseconds, std::memory_order_relaxed);
+
+	quint64 min = stats.min.load(std::memory_order_relaxed);
+	while (microseconds < min && !stats.min.compare_exchange_weak(min, microseconds, std::memory_order_relaxed)) {
+	}
+	quint64 max = stats.max.load(std::memory_order_relaxed);
+	while (microseconds > max && !stats.max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {
+	}
+}
+
+void recordPeriod(Probe probe, quint64 &last) {
+	if (!isActive()) {
+		last = 0;
+		return;
+	}
+
+	const quint64 current = AudioLatency::now();
+	if (last != 0) {
+		record(probe, current > last ? current - last : 0);
+	}
+	last = current;
+}
+
+Statistics statistics(Probe probe) {
+	const AtomicStatistics &source = probes()[static_cast< std::size_t >(probe)];
+
+	// The counters are read one after the other, so a snapshot may be off by the samples recorded meanwhile
+	Statistics result;
+	result.samples      = source.samples.load(std::memory_order_relaxed);
+	result.total        = source.total.load(std::memory_order_relaxed);
+	result.totalSquares = source.totalSquares.load(std::memory_order_relaxed);
+	result.min          = result.samples > 0 ? source.min.load(std::memory_order_relaxed) : 0;
+	result.max          = source.max.load(std::memory_order_relaxed);
+
+	return result;
+}
+
+void reset() {
+	for (AtomicStatistics &stats : probes()) {
+		stats.samples.store(0, std::memory_order_relaxed);
+		stats.total.store(0, std::memory_order_relaxed);
+		stats.totalSquares.store(0, std::memory_order_relaxed);
+		stats.min.store(std::numeric_limits< quint64 >::max(), std::memory_order_relaxed);
+		stats.max.store(0, std::memory_order_relaxed);
+	}
+
+	impulseRequested.store(false, std::memory_order_relaxed);
+	impulseMixed.store(0, std::memory_order_relaxed);
+}
+
+ScopedTimer::ScopedTimer(Probe probe) : m_probe(probe), m_start(isActive() ? AudioLatency::now() : 0) {
+}
+
+ScopedTimer::~ScopedTimer() {
+	if (m_start != 0) {
+		const quint64 current = AudioLatency::now();
+		record(m_probe, current > m_start ? current - m_start : 0);
+	}
+}
+
+void requestImpulse() {
+	impulseRequested.store(true, std::memory_order_relaxed);
+}
+
+bool takeImpulse() {
+	if (!impulseRequested.exchange(false, std::memory_order_relaxed)) {
+		return false;
+	}
+
+	impulseMixed.store(AudioLatency::now(), std::memory_order_release);
+	return true;
+}
+
+void detectImpulse(const float *samples, unsigned int count, quint64 captured) {
+	quint64 mixed = impulseMixed.load(std::memory_order_acquire);
+	if (mixed == 0) {
+		return;
+	}
+
+	if (captured > mixed + IMPULSE_TIMEOUT) {
+		// The impulse hasn't made it to the microphone
+		impulseMixed.compare_exchange_strong(mixed, 0, std::memory_order_relaxed);
+		return;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (std::fabs(samples[i]) > IMPULSE_THRESHOLD) {
+			const quint64 arrived = captured + static_cast< quint64 >(i) * 1000000 / SAMPLE_RATE;
+			if (arrived > mixed && impulseMixed.compare_exchange_strong(mixed, 0, std::memory_order_relaxed)) {
+				record(Probe::Loopback, arrived - mixed);
+			}
+			return;
+		}
+	}
+}
+
+bool run(unsigned int seconds) {
+	if (!AudioInputRegistrar::qmNew || !AudioOutputRegistrar::qmNew) {
+		return false;
+	}
+
+	const QString input  = Global::get().s.qsAudioInput;
+	const QString output = Global::get().s.qsAudioOutput;
+
+	QTimer impulses;
+	impulses.setInterval(IMPULSE_INTERVAL_MSECS);
+	QObject::connect(&impulses, &QTimer::timeout, []() { requestImpulse(); });
+
+	bool opened = true;
+	for (const QString &name : AudioInputRegistrar::qmNew->keys()) {
+		if (!AudioOutputRegistrar::qmNew->contains(name)) {
+			continue;
+		}
+
+		Audio::stop();
+		Audio::start(name, name);
+		wait(WARMUP_MSECS);
+
+		AudioInputPtr ai  = Global::get().ai;
+		AudioOutputPtr ao = Global::get().ao;
+		if (!ai || !ao || !ai->isAlive() || !ao->isAlive()) {
+			printf("%s: could not be opened\n", qPrintable(name));
+			opened = false;
+			continue;
+		}
+		ai.reset();
+		ao.reset();
+
+		reset();
+		active.store(true, std::memory_order_relaxed);
+		impulses.start();
+
+		wait(static_cast< int >(seconds) * 1000);
+
+		impulses.stop();
+		active.store(false, std::memory_order_relaxed);
+
+		const unsigned int played = std::max(seconds * 1000 / IMPULSE_INTERVAL_MSECS, 1U);
+		printf("%s (%u s):\n", qPrintable(name), seconds);
+		printProbe("Input period", Probe::InputPeriod, "callbacks");
+		printProbe("Output period", Probe::OutputPeriod, "callbacks");
+		printProbe("encodeAudioFrame()", Probe::Encode, "frames");
+		printProbe("mix()", Probe::Mix, "callbacks");
+		printProbe("Loopback latency", Probe::Loopback, "impulses");
+		printf("  %-22s %llu of about %u\n", "Impulses detected",
+			   static_cast< unsigned long long >(statistics(Probe::Loopback).samples), played);
+		fflush(stdout);
+	}
+
+	// Back to the backends of the settings (which newFromChoice() has replaced)
+	Global::get().s.qsAudioInput  = input;
+	Global::get().s.qsAudioOutput = output;
+	Audio::stop();
+	Audio::start();
+
+	return opened;
+}
+
+} // namespace AudioBenchmark
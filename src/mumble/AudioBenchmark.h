@@ -0,0 +1,103 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOBENCHMARK_H_
+#define MUMBLE_MUMBLE_AUDIOBENCHMARK_H_
+
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+
+/// A self-test of the audio backends (see the --audio-benchmark option), which opens each of them in turn and
+/// measures how it performs on this machine: the periods (and their jitter) of the callbacks, the time the audio
+/// threads spend in AudioInput::encodeAudioFrame() and AudioOutput::mix() and the latency from the output back to the
+/// input, which is measured by playing impulses that the microphone is expected to pick up (through a loopback
+/// cable, or the speakers being close enough).
+///
+/// The probes are only recorded while a benchmark runs (see isActive()), so they cost nothing otherwise. Recording
+/// takes a few atomic operations that never wait, so the audio callbacks may do it. All times are in microseconds
+/// (see AudioLatency::now()).
+namespace AudioBenchmark {
+
+enum class Probe {
+	/// The time between two calls of AudioInput::addMic(), which the backends make once per callback
+	InputPeriod,
+	/// The time between two calls of AudioOutput::mix()
+	OutputPeriod,
+	/// The time AudioInput::encodeAudioFrame() takes for a frame
+	Encode,
+	/// The time AudioOutput::mix() takes for a call
+	Mix,
+	/// From the mix of an impulse until the microphone has picked it up
+	Loopback,
+};
+
+constexpr std::size_t PROBE_COUNT = 5;
+
+/// The length (in frames at SAMPLE_RATE) and the amplitude of the impulses
+constexpr unsigned int IMPULSE_FRAMES = 48;
+constexpr float IMPULSE_AMPLITUDE     = 0.5f;
+/// The level above which a sample of the microphone is taken for the impulse
+constexpr float IMPULSE_THRESHOLD = 0.1f;
+/// For how long the microphone is searched for an impulse after it has been mixed
+constexpr quint64 IMPULSE_TIMEOUT = 1000000;
+
+struct Statistics {
+	quint64 samples      = 0;
+	quint64 total        = 0;
+	quint64 totalSquares = 0;
+	quint64 min          = 0;
+	quint64 max          = 0;
+
+	/// @returns The mean, 0 if there are no samples
+	double mean() const;
+	/// @returns The standard deviation (which is the jitter of the periods), 0 if there are no samples
+	double deviation() const;
+};
+
+/// @returns Whether a benchmark is running, outside of which the probes are meant to be left alone
+bool isActive();
+
+void record(Probe probe, quint64 microseconds);
+/// Records the time since the previous call with the same last time, unless a benchmark isn't running or this is the
+/// first call (in which case last is 0)
+void recordPeriod(Probe probe, quint64 &last);
+
+/// @returns A snapshot of the statistics of the given probe
+Statistics statistics(Probe probe);
+/// Forgets everything that has been recorded, including an impulse that is on its way
+void reset();
+
+/// Records the time from its construction until its destruction, if a benchmark was running at its construction
+class ScopedTimer {
+public:
+	explicit ScopedTimer(Probe probe);
+	~ScopedTimer();
+
+private:
+	Q_DISABLE_COPY(ScopedTimer)
+
+	Probe m_probe;
+	quint64 m_start;
+};
+
+/// Makes the next call of takeImpulse() mix an impulse
+void requestImpulse();
+/// Called by AudioOutput::mix(): @returns Whether an impulse is to be mixed into the output now, which is then
+/// 	looked for in the microphone's frames
+bool takeImpulse();
+/// Called by AudioInput with every frame of the microphone (mono, at SAMPLE_RATE), the first samples of which have
+/// arrived at the given time. Records the latency of the impulse if it is found in the frame.
+void detectImpulse(const float *samples, unsigned int count, quint64 captured);
+
+/// Benchmarks every backend that provides both an input and an output (for the given number of seconds each),
+/// printing the results to stdout. The backends the settings name are restarted afterwards.
+///
+/// @returns Whether every backend has been opened
+bool run(unsigned int seconds);
+
+} // namespace AudioBenchmark
+
+#endif // MUMBLE_MUMBLE_AUDIOBENCHMARK_H_
@@ -0,0 +1,56 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioBlockRing.h"
+
+#include <cstring>
+
+AudioBlockRing::AudioBlockRing() : m_blocks(new Block[CAPACITY]) {
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		m_blocks[i].data.reset(new std::uint8_t[MAX_BYTES]);
+	}
+}
+
+bool AudioBlockRing::push(const Block &header, const void *pcm, std::size_t bytes) {
+	const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+	if (bytes > MAX_BYTES || tail - m_head.load(std::memory_order_acquire) == CAPACITY) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	Block &block       = m_blocks[tail % CAPACITY];
+	block.source       = header.source;
+	block.sampleCount  = header.sampleCount;
+	block.channelCount = header.channelCount;
+	block.sampleRate   = header.sampleRate;
+	block.isSpeech     = header.isSpeech;
+	block.userID       = header.userID;
+	block.bytes        = bytes;
+	std::memcpy(block.data.get(), pcm, bytes);
+
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+AudioBlockRing::Block *AudioBlockRing::front() {
+	const std::size_t head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+
+	return &m_blocks[head % CAPACITY];
+}
+
+void AudioBlockRing::pop() {
+	m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+std::size_t AudioBlockRing::size() const {
+	return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+std::uint64_t AudioBlockRing::dropped() const {
+	return m_dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOBLOCKRING_H_
+#define MUMBLE_MUMBLE_AUDIOBLOCKRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/// A queue of copies of audio buffers that is filled by one thread (e.g. an audio thread) and emptied by another
+/// one, without either of them having to wait for the other.
+///
+/// The storage of all blocks is allocated up front, so that push() neither locks nor allocates. Buffers that don't
+/// fit into a block and buffers that arrive while the ring is full are dropped (and counted).
+class AudioBlockRing {
+public:
+	/// The number of blocks in the ring
+	static constexpr std::size_t CAPACITY = 16;
+	/// The size of the largest buffer a block can hold (in bytes), which fits 4096 stereo float frames
+	static constexpr std::size_t MAX_BYTES = 4096 * 2 * sizeof(float);
+
+	/// Where a block's audio has been taken from
+	enum class Source { Input, SourceFetched, OutputAboutToPlay };
+
+	struct Block {
+		Source source              = Source::Input;
+		std::uint32_t sampleCount  = 0;
+		std::uint16_t channelCount = 0;
+		std::uint32_t sampleRate   = 0;
+		bool isSpeech              = false;
+		std::uint32_t userID       = 0;
+		/// The size of the audio in data (in bytes)
+		std::size_t bytes = 0;
+		/// The copy of the audio, which is short or float samples depending on the source
+		std::unique_ptr< std::uint8_t[] > data;
+	};
+
+	AudioBlockRing();
+
+	AudioBlockRing(const AudioBlockRing &) = delete;
+	AudioBlockRing &operator=(const AudioBlockRing &) = delete;
+
+	/// Copies the given audio into the ring. Must only be called by the filling thread.
+	///
+	/// @param header The block's fields besides bytes and data
+	/// @returns Whether the audio has been added (instead of being dropped)
+	bool push(const Block &header, const void *pcm, std::size_t bytes);
+	/// Must only be called by the emptying thread
+	///
+	/// @returns The oldest block or nullptr if the ring is empty. The block stays valid until pop() is called.
+	Block *front();
+	/// Removes the oldest block. Must only be called by the emptying thread.
+	void pop();
+
+	/// @returns The number of blocks in the ring, which may already be outdated
+	std::size_t size() const;
+	/// @returns The number of buffers that have been dropped so far
+	std::uint64_t dropped() const;
+
+protected:
+	std::unique_ptr< Block[] > m_blocks;
+	std::atomic< std::size_t > m_head{ 0 };
+	std::atomic< std::size_t > m_tail{ 0 };
+	std::atomic< std::uint64_t > m_dropped{ 0 };
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOBLOCKRING_H_
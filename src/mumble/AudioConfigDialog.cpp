@@ -576,6 +576,8 @@ void AudioInputDialog::on_Tick_timeout() {
 	if (!ai.get() || !ai->sppPreprocess)
 		return;
 
+	ai->requestProcessing();
+
 	abSpeech->iBelow = qsTransmitMin->value();
 	abSpeech->iAbove = qsTransmitMax->value();
 
@@ -0,0 +1,109 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioDriftResampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr double AudioDriftResampler::MAX_DRIFT;
+constexpr unsigned int AudioDriftResampler::FRACTION_BITS;
+constexpr std::uint64_t AudioDriftResampler::ONE;
+
+AudioDriftResampler::AudioDriftResampler(unsigned int channels, unsigned int maxInputFrames)
+	// The spline needs the frame before the position and the two after the next one
+	: m_channels(channels), m_capacity(maxInputFrames + 4) {
+	m_history.resize(static_cast< std::size_t >(m_capacity) * m_channels);
+
+	reset();
+}
+
+void AudioDriftResampler::setRatio(double ratio) {
+	ratio  = std::min(std::max(ratio, 1.0 - MAX_DRIFT), 1.0 + MAX_DRIFT);
+	m_step = static_cast< std::uint64_t >(std::llround(ratio * static_cast< double >(ONE)));
+}
+
+double AudioDriftResampler::ratio() const {
+	return static_cast< double >(m_step) / static_cast< double >(ONE);
+}
+
+unsigned int AudioDriftResampler::inputFramesFor(unsigned int outFrames) const {
+	if (outFrames == 0) {
+		return 0;
+	}
+
+	const std::uint64_t last   = m_position + static_cast< std::uint64_t >(outFrames - 1) * m_step;
+	const std::uint64_t needed = (last >> FRACTION_BITS) + 3;
+
+	return needed > m_buffered ? static_cast< unsigned int >(needed - m_buffered) : 0;
+}
+
+unsigned int AudioDriftResampler::maxInputFramesFor(unsigned int outFrames) {
+	// Between two calls, the history holds at least the frame after the one before the position. The position ends
+	// up at most (outFrames - 1) steps further, and its fraction may add another frame.
+	return static_cast< unsigned int >(std::ceil(static_cast< double >(outFrames) * (1.0 + MAX_DRIFT))) + 4;
+}
+
+unsigned int AudioDriftResampler::process(const float *in, unsigned int inFrames, float *out,
+										  unsigned int maxOutFrames) {
+	unsigned int produced = 0;
+
+	while (true) {
+		const unsigned int take = std::min(inFrames, m_capacity - m_buffered);
+		std::copy(in, in + static_cast< std::size_t >(take) * m_channels,
+				  m_history.begin() + static_cast< std::ptrdiff_t >(m_buffered * m_channels));
+		m_buffered += take;
+		in += static_cast< std::size_t >(take) * m_channels;
+		inFrames -= take;
+
+		while (produced < maxOutFrames && (m_position >> FRACTION_BITS) + 3 <= m_buffered) {
+			const std::size_t index = static_cast< std::size_t >(m_position >> FRACTION_BITS);
+
+			const float t =
+				static_cast< float >(static_cast< double >(m_position & (ONE - 1)) / static_cast< double >(ONE));
+
+			const float *x = m_history.data() + (index - 1) * m_channels;
+			float *frame   = out + static_cast< std::size_t >(produced) * m_channels;
+			for (unsigned int c = 0; c < m_channels; ++c) {
+				const float xm1 = x[c];
+				const float x0  = x[m_channels + c];
+				const float x1  = x[2 * m_channels + c];
+				const float x2  = x[3 * m_channels + c];
+
+				const float c1 = 0.5f * (x1 - xm1);
+				const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+				const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+				frame[c]       = ((c3 * t + c2) * t + c1) * t + x0;
+			}
+
+			m_position += m_step;
+			++produced;
+		}
+
+		// Drop the frames before the one that precedes the position
+		const unsigned int drop = static_cast< unsigned int >(
+			std::min< std::uint64_t >((m_position >> FRACTION_BITS) - 1, static_cast< std::uint64_t >(m_buffered)));
+		if (drop > 0) {
+			std::copy(m_history.begin() + static_cast< std::ptrdiff_t >(drop * m_channels),
+					  m_history.begin() + static_cast< std::ptrdiff_t >(m_buffered * m_channels), m_history.begin());
+			m_buffered -= drop;
+			m_position -= static_cast< std::uint64_t >(drop) << FRACTION_BITS;
+		}
+
+		if (inFrames == 0 || m_buffered == m_capacity) {
+			// Either all of the input has been taken or the output is full (in which case the rest is dropped)
+			break;
+		}
+	}
+
+	return produced;
+}
+
+void AudioDriftResampler::reset() {
+	// The stream starts with a frame of silence before it, which the first output frame's spline starts from
+	std::fill(m_history.begin(), m_history.end(), 0.0f);
+	m_buffered = 1;
+	m_position = ONE;
+}
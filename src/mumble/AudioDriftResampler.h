@@ -0,0 +1,64 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIODRIFTRESAMPLER_H_
+#define MUMBLE_MUMBLE_AUDIODRIFTRESAMPLER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <cstdint>
+#include <vector>
+
+/// Resamples a stream of (interleaved) float samples by a ratio close to 1 that may change between any two calls,
+/// which compensates for the drift between the clocks of two devices that nominally run at the same rate. The samples
+/// are interpolated with a cubic (Catmull-Rom) spline, whose error is far below what the echo canceller can tell
+/// apart for the frequencies of speech.
+///
+/// The position is kept in fixed point, so that process() produces exactly the frames inputFramesFor() has promised.
+/// With a ratio of 1, the samples are passed through unchanged. Nothing is allocated after construction.
+class AudioDriftResampler {
+public:
+	/// The most the ratio may deviate from 1, which is a lot more than the clocks of sound cards drift apart
+	static constexpr double MAX_DRIFT = 0.002;
+
+	/// @param maxInputFrames The most frames that are passed to process() at once
+	AudioDriftResampler(unsigned int channels, unsigned int maxInputFrames);
+
+	/// Sets the number of input frames per output frame, which is clamped to 1 +- MAX_DRIFT
+	void setRatio(double ratio);
+	double ratio() const;
+
+	/// @returns The number of input frames the next call of process() needs for exactly outFrames output frames
+	unsigned int inputFramesFor(unsigned int outFrames) const;
+	/// @returns The largest number that inputFramesFor() returns for outFrames, whatever the ratio and state
+	static unsigned int maxInputFramesFor(unsigned int outFrames);
+
+	/// Resamples the given frames, keeping the input that isn't needed for the output yet for the next call
+	///
+	/// @returns The number of frames written to out, which is at most maxOutFrames
+	unsigned int process(const float *in, unsigned int inFrames, float *out, unsigned int maxOutFrames);
+
+	/// Forgets the input of previous calls, as if the stream started anew (but keeps the ratio)
+	void reset();
+
+private:
+	Q_DISABLE_COPY(AudioDriftResampler)
+
+	/// The number of fractional bits of the position and the step
+	static constexpr unsigned int FRACTION_BITS = 32;
+	static constexpr std::uint64_t ONE          = std::uint64_t(1) << FRACTION_BITS;
+
+	const unsigned int m_channels;
+	/// The pending input (interleaved), including the frame before the next output frame's position
+	std::vector< float > m_history;
+	const unsigned int m_capacity;
+	unsigned int m_buffered = 0;
+	/// The position of the next output frame relative to the first frame in the history, which is always at least 1
+	std::uint64_t m_position = ONE;
+	/// The number of input frames per output frame
+	std::uint64_t m_step = ONE;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIODRIFTRESAMPLER_H_
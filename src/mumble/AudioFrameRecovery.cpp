@@ -0,0 +1,38 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioFrameRecovery.h"
+
+AudioFrameRecovery::Recovery AudioFrameRecovery::receive(std::uint64_t frameNumber, std::uint64_t frames,
+														 std::uint64_t redundantFrames, bool isLastFrame) {
+	Recovery recovery;
+
+	if (m_expectingFrame && frameNumber < m_nextFrameNumber && frameNumber == m_recoveredFrameNumber) {
+		// This packet has already been made up for
+		recovery.play = false;
+		return recovery;
+	}
+
+	if (m_expectingFrame && frameNumber > m_nextFrameNumber) {
+		// The packet before this one hasn't arrived (yet)
+		const std::uint64_t previousFrames = redundantFrames > 0 ? redundantFrames : frames;
+		if (previousFrames <= frameNumber && frameNumber - previousFrames >= m_nextFrameNumber) {
+			recovery.source      = redundantFrames > 0 ? Source::RedundantPayload : Source::FEC;
+			recovery.frameNumber = frameNumber - previousFrames;
+
+			m_recoveredFrameNumber = recovery.frameNumber;
+		}
+		// Otherwise the previous packet isn't missing after all (it is a different one that is)
+	}
+
+	if (isLastFrame) {
+		m_expectingFrame = false;
+	} else if (!m_expectingFrame || frameNumber >= m_nextFrameNumber) {
+		m_nextFrameNumber = frameNumber + frames;
+		m_expectingFrame  = true;
+	}
+
+	return recovery;
+}
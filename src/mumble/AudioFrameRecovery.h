@@ -0,0 +1,53 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOFRAMERECOVERY_H_
+#define MUMBLE_MUMBLE_AUDIOFRAMERECOVERY_H_
+
+#include <cstdint>
+#include <limits>
+
+/// Notices the lost packets of a speaker by the gaps in the frame numbers and tells how they are made up for (see
+/// AudioOutputSpeech::addFrameToBuffer). Only the packet right before a received one can be made up for, either from
+/// the redundant payload the sender has attached to the received packet or from the received packet's in-band FEC.
+/// The lost packet itself is dropped, should it show up after all.
+class AudioFrameRecovery {
+public:
+	enum class Source {
+		/// Nothing is to be made up for
+		None,
+		/// The redundant payload of the received packet is to be played before it
+		RedundantPayload,
+		/// The received packet is to be played twice, first decoded from its in-band FEC (which restores a lower
+		/// quality version of the previous packet, given that it has been of the same duration)
+		FEC
+	};
+
+	struct Recovery {
+		/// Whether the received packet is to be played, which it isn't if it has been made up for already
+		bool play     = true;
+		Source source = Source::None;
+		/// The frame number of the packet that is made up for
+		std::uint64_t frameNumber = 0;
+	};
+
+	/// Records the given packet
+	///
+	/// @param frames The number of frames of the packet
+	/// @param redundantFrames The number of frames of the packet's redundant payload or 0 if it has none (or one that
+	/// 	can't be played)
+	Recovery receive(std::uint64_t frameNumber, std::uint64_t frames, std::uint64_t redundantFrames,
+					 bool isLastFrame);
+
+protected:
+	/// The number of the frame that is expected to come next, which is how lost packets are noticed. It is only known
+	/// once the first packet of a transmission has arrived.
+	std::uint64_t m_nextFrameNumber = 0;
+	bool m_expectingFrame           = false;
+	/// The number of the last frame that has been made up for
+	std::uint64_t m_recoveredFrameNumber = std::numeric_limits< std::uint64_t >::max();
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOFRAMERECOVERY_H_
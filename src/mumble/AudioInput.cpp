@@ -6,12 +6,15 @@
 #include "AudioInput.h"
 
 #include "API.h"
+#include "AudioBenchmark.h"
+#include "AudioLatency.h"
 #include "AudioOutput.h"
 #include "MainWindow.h"
 #include "MumbleProtocol.h"
 #include "NetworkConfig.h"
 #include "PacketDataStream.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "ServerHandler.h"
 #include "User.h"
 #include "Utils.h"
@@ -20,61 +23,164 @@
 
 #include <opus.h>
 
-#ifdef USE_RNNOISE
-extern "C" {
-#	include "rnnoise.h"
-}
-#endif
-
 #include <algorithm>
 #include <cassert>
 #include <exception>
-#include <limits>
 
-#ifdef USE_RNNOISE
-/// Clip the given float value to a range that can be safely converted into a short (without causing integer overflow)
-static short clampFloatSample(float v) {
-	return static_cast< short >(std::min(std::max(v, static_cast< float >(std::numeric_limits< short >::min())),
-										 static_cast< float >(std::numeric_limits< short >::max())));
+namespace {
+/// The fill level the drift compensation aims for when addSpeaker() takes a sample, which is in the middle between
+/// the ones at which samples are dropped
+constexpr double TARGET_LEVEL = 2.5;
+/// The share of a new fill level in the smoothed one, which averages it over about a second
+constexpr double LEVEL_SMOOTHING = 0.01;
+/// The gains of the controller of the drift: how much a fill level off by one sample changes the ratio right away
+/// and per speaker sample. The queue then settles within a few minutes, which is plenty for the slow drift of clocks.
+constexpr double DRIFT_PROPORTIONAL_GAIN = 2e-4;
+constexpr double DRIFT_INTEGRAL_GAIN     = 2e-8;
+
+/// The number of the last frames that weren't processed (as no transmission could happen) that are run through the
+/// cleanup stage before the first frame that is processed again, so that the echo canceller and the preprocessor have
+/// caught up with the room when it starts. It is given in regular frames, shorter ones are kept for as long.
+constexpr unsigned int PREROLL_FRAMES = 5;
+/// For how long (in microseconds) requestProcessing() keeps the frames from being skipped
+constexpr quint64 PROCESSING_REQUEST_DURATION = 1000000;
+
+/// @returns The frame size asked for by the settings, if it can be used (see AudioInput::iFrameSize)
+int configuredFrameSize() {
+	const int regular   = SAMPLE_RATE / 100;
+	const int frameSize = Global::get().s.iAudioFrameSize;
+	if ((frameSize != regular / 4 && frameSize != regular / 2)
+		|| Global::get().s.echoOption != EchoCancelOptionID::DISABLED) {
+		return regular;
+	}
+
+	// Every packet comes with the same overhead, which may be too much for the server
+	const int maxBandwidth = Global::get().iMaxBandwidth;
+	if (maxBandwidth != -1 && AudioInput::getNetworkBandwidth(Global::get().s.iQuality, 1, frameSize) > maxBandwidth) {
+		return regular;
+	}
+
+	return frameSize;
 }
-#endif
+} // namespace
 
-void Resynchronizer::addMic(short *mic) {
-	bool drop = false;
-	{
-		std::unique_lock< std::mutex > l(m);
-		micQueue.push_back(mic);
-		switch (state) {
-			case S0:
-				state = S1a;
-				break;
-			case S1a:
-				state = S2;
-				break;
-			case S1b:
-				state = S2;
-				break;
-			case S2:
-				state = S3;
-				break;
-			case S3:
-				state = S4a;
-				break;
-			case S4a:
-				state = S5;
-				break;
-			case S4b:
-				drop = true;
-				break;
-			case S5:
-				drop = true;
-				break;
-		}
-		if (drop) {
-			delete[] micQueue.front();
-			micQueue.pop_front();
+bool Resynchronizer::FrameRing::push(short *frame) {
+	const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+	if (tail - m_head.load(std::memory_order_acquire) == CAPACITY) {
+		return false;
+	}
+
+	m_frames[tail % CAPACITY] = frame;
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+short *Resynchronizer::FrameRing::pop() {
+	const std::size_t head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+
+	short *frame = m_frames[head % CAPACITY];
+	m_head.store(head + 1, std::memory_order_release);
+	return frame;
+}
+
+std::size_t Resynchronizer::FrameRing::size() const {
+	return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+void Resynchronizer::FrameRing::clear() {
+	m_head = 0;
+	m_tail = 0;
+}
+
+void Resynchronizer::setFrameSizes(unsigned int micSamples, unsigned int speakerSamples) {
+	micFrames.assign(MIC_FRAMES * micSamples, 0);
+	micFrameSamples = micSamples;
+	micCaptured.fill(0);
+	speakerBuffer.assign(speakerSamples, 0);
+
+	micQueue.clear();
+	freeMic.clear();
+	for (std::size_t i = 0; i < MIC_FRAMES; ++i) {
+		freeMic.push(micFrames.data() + i * micSamples);
+	}
+	spareMic = nullptr;
+	state    = S0;
+}
+
+short *Resynchronizer::acquireMic() {
+	if (spareMic) {
+		short *mic = spareMic;
+		spareMic   = nullptr;
+		return mic;
+	}
+
+	return freeMic.pop();
+}
+
+Resynchronizer::State Resynchronizer::afterMic(State state) {
+	switch (state) {
+		case S0:
+			return S1a;
+		case S1a:
+		case S1b:
+			return S2;
+		case S2:
+			return S3;
+		case S3:
+			return S4a;
+		case S4a:
+			return S5;
+		case S4b:
+		case S5:
+			break;
+	}
+
+	return state;
+}
+
+Resynchronizer::State Resynchronizer::afterSpeaker(State state) {
+	switch (state) {
+		case S1b:
+			return S0;
+		case S2:
+			return S1b;
+		case S3:
+			return S2;
+		case S4a:
+		case S4b:
+			return S3;
+		case S5:
+			return S4b;
+		case S0:
+		case S1a:
+			break;
+	}
+
+	return state;
+}
+
+void Resynchronizer::addMic(short *mic, quint64 captured) {
+	State current   = state.load(std::memory_order_acquire);
+	const bool drop = current == S4b || current == S5;
+
+	// Published to addSpeaker() along with the frame
+	micCaptured[static_cast< std::size_t >(mic - micFrames.data()) / micFrameSamples] = captured;
+
+	if (drop) {
+		// The newest sample is dropped (instead of the oldest one), as the queue is only ever emptied by addSpeaker()
+		spareMic = mic;
+	} else {
+		// There can't be more than 5 samples in the queue (as addSpeaker() only ever takes samples away, the actual
+		// state can only be lower than the one seen here)
+		micQueue.push(mic);
+		while (!state.compare_exchange_weak(current, afterMic(current), std::memory_order_acq_rel,
+											std::memory_order_acquire)) {
 		}
 	}
+
 	if (bDebugPrintQueue) {
 		if (drop)
 			qWarning("Resynchronizer::addMic(): dropped microphone chunk due to overflow");
@@ -82,44 +188,33 @@ void Resynchronizer::addMic(short *mic) {
 	}
 }
 
+short *Resynchronizer::speakerFrame() {
+	return speakerBuffer.data();
+}
+
 AudioChunk Resynchronizer::addSpeaker(short *speaker) {
 	AudioChunk result;
-	bool drop = false;
-	{
-		std::unique_lock< std::mutex > l(m);
-		switch (state) {
-			case S0:
-				drop = true;
-				break;
-			case S1a:
-				drop = true;
-				break;
-			case S1b:
-				state = S0;
-				break;
-			case S2:
-				state = S1b;
-				break;
-			case S3:
-				state = S2;
-				break;
-			case S4a:
-				state = S3;
-				break;
-			case S4b:
-				state = S3;
-				break;
-			case S5:
-				state = S4b;
-				break;
-		}
-		if (drop == false) {
-			result = AudioChunk(micQueue.front(), speaker);
-			micQueue.pop_front();
+
+	updateDrift(micQueue.size());
+
+	State current = state.load(std::memory_order_acquire);
+	bool drop;
+	do {
+		drop = current == S0 || current == S1a;
+	} while (!drop
+			 && !state.compare_exchange_weak(current, afterSpeaker(current), std::memory_order_acq_rel,
+											 std::memory_order_acquire));
+
+	if (!drop) {
+		// The queue may only be empty after a reset has raced with addMic()
+		short *mic = micQueue.pop();
+		drop       = mic == nullptr;
+		if (mic) {
+			result          = AudioChunk(mic, speaker);
+			result.captured = micCaptured[static_cast< std::size_t >(mic - micFrames.data()) / micFrameSamples];
 		}
 	}
-	if (drop)
-		delete[] speaker;
+
 	if (bDebugPrintQueue) {
 		if (drop)
 			qWarning("Resynchronizer::addSpeaker(): dropped speaker chunk due to underflow");
@@ -128,27 +223,35 @@ AudioChunk Resynchronizer::addSpeaker(short *speaker) {
 	return result;
 }
 
+void Resynchronizer::release(const AudioChunk &chunk) {
+	if (chunk.mic) {
+		freeMic.push(chunk.mic);
+	}
+}
+
 void Resynchronizer::reset() {
 	if (bDebugPrintQueue)
 		qWarning("Resetting echo queue");
-	std::unique_lock< std::mutex > l(m);
 	state = S0;
-	while (!micQueue.empty()) {
-		delete[] micQueue.front();
-		micQueue.pop_front();
+	while (short *mic = micQueue.pop()) {
+		freeMic.push(mic);
 	}
+	filteredLevel = TARGET_LEVEL;
 }
 
-Resynchronizer::~Resynchronizer() {
-	reset();
+void Resynchronizer::updateDrift(std::size_t level) {
+	filteredLevel += LEVEL_SMOOTHING * (static_cast< double >(level) - filteredLevel);
+
+	// The queue fills up if the speaker's samples are too long (as they are taken out slower than the microphone's
+	// come in), which is why they are then made up of fewer speaker samples
+	const double error = filteredLevel - TARGET_LEVEL;
+	drift              = std::min(std::max(drift + DRIFT_INTEGRAL_GAIN * error, -AudioDriftResampler::MAX_DRIFT),
+									  AudioDriftResampler::MAX_DRIFT);
+	echoStep           = 1.0 - drift - DRIFT_PROPORTIONAL_GAIN * error;
 }
 
 void Resynchronizer::printQueue(char who) {
-	unsigned int mic;
-	{
-		std::unique_lock< std::mutex > l(m);
-		mic = static_cast< unsigned int >(micQueue.size());
-	}
+	const unsigned int mic = static_cast< unsigned int >(micQueue.size());
 	std::string line;
 	line.reserve(32);
 	line += who;
@@ -214,7 +317,8 @@ bool AudioInputRegistrar::isMicrophoneAccessDeniedByOS() {
 }
 
 AudioInput::AudioInput()
-	: opusBuffer(static_cast< std::size_t >(Global::get().s.iFramesPerPacket * (SAMPLE_RATE / 100))) {
+	: iFrameSize(configuredFrameSize()),
+	  opusBuffer(static_cast< std::size_t >(Global::get().s.iFramesPerPacket * (SAMPLE_RATE / 100))) {
 	bDebugDumpInput         = Global::get().bDebugDumpInput;
 	resync.bDebugPrintQueue = Global::get().bDebugPrintQueue;
 	if (bDebugDumpInput) {
@@ -225,14 +329,20 @@ AudioInput::AudioInput()
 
 	adjustBandwidth(Global::get().iMaxBandwidth, iAudioQuality, iAudioFrames, bAllowLowDelay);
 
-	Global::get().iAudioBandwidth = getNetworkBandwidth(iAudioQuality, iAudioFrames);
+	Global::get().iAudioBandwidth = iFrameSize == iRegularFrameSize
+										? getNetworkBandwidth(iAudioQuality, iAudioFrames)
+										: getNetworkBandwidth(iAudioQuality, 1, iFrameSize);
 
 	m_codec = Mumble::Protocol::AudioCodec::Opus;
 
 	activityState = ActivityStateActive;
 	opusState     = nullptr;
 
-	if (bAllowLowDelay && iAudioQuality >= 64000) { // > 64 kbit/s bitrate and low delay allowed
+	if (iFrameSize < iRegularFrameSize) {
+		// The other modes add a few milliseconds of look-ahead, which would defeat the point of short frames
+		opusState = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_RESTRICTED_LOWDELAY, nullptr);
+		qWarning("AudioInput: Opus encoder set for low delay with %d sample frames", iFrameSize);
+	} else if (bAllowLowDelay && iAudioQuality >= 64000) { // > 64 kbit/s bitrate and low delay allowed
 		opusState = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_RESTRICTED_LOWDELAY, nullptr);
 		qWarning("AudioInput: Opus encoder set for low delay");
 	} else if (iAudioQuality >= 32000) { // > 32 kbit/s bitrate
@@ -245,10 +355,6 @@ AudioInput::AudioInput()
 
 	opus_encoder_ctl(opusState, OPUS_SET_VBR(0)); // CBR
 
-#ifdef USE_RNNOISE
-	denoiseState = rnnoise_create(nullptr);
-#endif
-
 	qWarning("AudioInput: %d bits/s, %d hz, %d sample", iAudioQuality, iSampleRate, iFrameSize);
 	iEchoFreq = iMicFreq = iSampleRate;
 
@@ -257,16 +363,14 @@ AudioInput::AudioInput()
 	iHoldFrames     = 0;
 	iBufferedFrames = 0;
 
-	bResetProcessor = true;
-
 	bEchoMulti = false;
 
 	sppPreprocess = nullptr;
 	sesEcho       = nullptr;
-	srsMic = srsEcho = nullptr;
 
 	iEchoChannels = iMicChannels = 0;
 	iEchoFilled = iMicFilled = 0;
+	iMicFrameLength = iEchoFrameLength = 0;
 	eMicFormat = eEchoFormat = SampleFloat;
 	iMicSampleSize = iEchoSampleSize = 0;
 
@@ -298,21 +402,8 @@ AudioInput::~AudioInput() {
 		opus_encoder_destroy(opusState);
 	}
 
-#ifdef USE_RNNOISE
-	if (denoiseState) {
-		rnnoise_destroy(denoiseState);
-	}
-#endif
-
-	if (sppPreprocess)
-		speex_preprocess_state_destroy(sppPreprocess);
-	if (sesEcho)
-		speex_echo_state_destroy(sesEcho);
-
-	if (srsMic)
-		speex_resampler_destroy(srsMic);
-	if (srsEcho)
-		speex_resampler_destroy(srsEcho);
+	delete m_pendingProcessor.exchange(nullptr);
+	deleteRetiredProcessors();
 
 	delete[] pfMicInput;
 	delete[] pfEchoInput;
@@ -322,215 +413,103 @@ bool AudioInput::isTransmitting() const {
 	return bPreviousVoice;
 }
 
-#define IN_MIXER_FLOAT(channels)                                                                             \
-	static void inMixerFloat##channels(float *RESTRICT buffer, const void *RESTRICT ipt, unsigned int nsamp, \
-									   unsigned int N, quint64 mask) {                                       \
-		const float *RESTRICT input = reinterpret_cast< const float * >(ipt);                                \
-		const float m               = 1.0f / static_cast< float >(channels);                                 \
-		Q_UNUSED(N);                                                                                         \
-		Q_UNUSED(mask);                                                                                      \
-		for (unsigned int i = 0; i < nsamp; ++i) {                                                           \
-			float v = 0.0f;                                                                                  \
-			for (unsigned int j = 0; j < channels; ++j)                                                      \
-				v += input[i * channels + j];                                                                \
-			buffer[i] = v * m;                                                                               \
-		}                                                                                                    \
-	}
-
-#define IN_MIXER_SHORT(channels)                                                                             \
-	static void inMixerShort##channels(float *RESTRICT buffer, const void *RESTRICT ipt, unsigned int nsamp, \
-									   unsigned int N, quint64 mask) {                                       \
-		const short *RESTRICT input = reinterpret_cast< const short * >(ipt);                                \
-		const float m               = 1.0f / (32768.f * static_cast< float >(channels));                     \
-		Q_UNUSED(N);                                                                                         \
-		Q_UNUSED(mask);                                                                                      \
-		for (unsigned int i = 0; i < nsamp; ++i) {                                                           \
-			float v = 0.0f;                                                                                  \
-			for (unsigned int j = 0; j < channels; ++j)                                                      \
-				v += static_cast< float >(input[i * channels + j]);                                          \
-			buffer[i] = v * m;                                                                               \
-		}                                                                                                    \
-	}
-
-static void inMixerFloatMask(float *RESTRICT buffer, const void *RESTRICT ipt, unsigned int nsamp, unsigned int N,
-							 quint64 mask) {
-	const float *RESTRICT input = reinterpret_cast< const float * >(ipt);
-
-	unsigned int chancount = 0;
-	static std::vector< unsigned int > chanindex;
-	chanindex.resize(N);
-	for (unsigned int j = 0; j < N; ++j) {
-		if ((mask & (1ULL << j)) == 0) {
-			continue;
-		}
-		chanindex[chancount] = j; // Use chancount as index into chanindex.
-		++chancount;
-	}
+void AudioInput::requestProcessing() {
+	m_processingRequestedUntil.store(AudioLatency::now() + PROCESSING_REQUEST_DURATION, std::memory_order_relaxed);
+}
 
-	const float m = 1.0f / static_cast< float >(chancount);
-	for (unsigned int i = 0; i < nsamp; ++i) {
-		float v = 0.0f;
-		for (unsigned int j = 0; j < chancount; ++j) {
-			v += input[i * N + chanindex[j]];
+void AudioInput::keepForPreroll(const AudioChunk &chunk) {
+	std::copy(chunk.mic, chunk.mic + iFrameSize, m_prerollMic.begin() + m_prerollNext * iFrameSize);
+	if (!m_prerollSpeaker.empty()) {
+		short *speaker = m_prerollSpeaker.data() + m_prerollNext * iEchoFrameSize;
+		if (chunk.speaker) {
+			std::copy(chunk.speaker, chunk.speaker + iEchoFrameSize, speaker);
+		} else {
+			std::fill(speaker, speaker + iEchoFrameSize, 0);
 		}
-		buffer[i] = v * m;
 	}
+
+	m_prerollNext   = (m_prerollNext + 1) % m_prerollLength;
+	m_prerollFrames = std::min(m_prerollFrames + 1, m_prerollLength);
 }
 
-static void inMixerShortMask(float *RESTRICT buffer, const void *RESTRICT ipt, unsigned int nsamp, unsigned int N,
-							 quint64 mask) {
-	const short *RESTRICT input = reinterpret_cast< const short * >(ipt);
+void AudioInput::runPreroll(int noiseSuppression) {
+	// The oldest of the kept frames comes first
+	for (unsigned int i = m_prerollLength - m_prerollFrames; i < m_prerollLength; ++i) {
+		const unsigned int index = (m_prerollNext + i) % m_prerollLength;
 
-	unsigned int chancount = 0;
-	static std::vector< unsigned int > chanindex;
-	chanindex.resize(N);
-	for (unsigned int j = 0; j < N; ++j) {
-		if ((mask & (1ULL << j)) == 0) {
-			continue;
-		}
-		chanindex[chancount] = j; // Use chancount as index into chanindex.
-		++chancount;
+		AudioProcessingFrame frame;
+		frame.samples          = m_prerollMic.data() + index * iFrameSize;
+		frame.speaker          = m_prerollSpeaker.empty() ? nullptr : m_prerollSpeaker.data() + index * iEchoFrameSize;
+		frame.noiseSuppression = noiseSuppression;
+		m_processor->run(AudioProcessingGraph::Stage::Cleanup, frame);
 	}
 
-	const float m = 1.0f / static_cast< float >(chancount);
-	for (unsigned int i = 0; i < nsamp; ++i) {
-		float v = 0.0f;
-		for (unsigned int j = 0; j < chancount; ++j) {
-			v += static_cast< float >(input[i * N + chanindex[j]]);
-		}
-		buffer[i] = v * m;
-	}
+	m_prerollFrames = 0;
 }
 
-IN_MIXER_FLOAT(1)
-IN_MIXER_FLOAT(2)
-IN_MIXER_FLOAT(3)
-IN_MIXER_FLOAT(4)
-IN_MIXER_FLOAT(5)
-IN_MIXER_FLOAT(6)
-IN_MIXER_FLOAT(7)
-IN_MIXER_FLOAT(8)
-IN_MIXER_FLOAT(N)
-
-IN_MIXER_SHORT(1)
-IN_MIXER_SHORT(2)
-IN_MIXER_SHORT(3)
-IN_MIXER_SHORT(4)
-IN_MIXER_SHORT(5)
-IN_MIXER_SHORT(6)
-IN_MIXER_SHORT(7)
-IN_MIXER_SHORT(8)
-IN_MIXER_SHORT(N)
-
-#undef IN_MIXER_FLOAT
-#undef IN_MIXER_SHORT
-
 AudioInput::inMixerFunc AudioInput::chooseMixer(const unsigned int nchan, SampleFormat sf, quint64 chanmask) {
-	inMixerFunc r = nullptr;
-
-	if (chanmask != 0xffffffffffffffffULL) {
-		if (sf == SampleFloat) {
-			r = inMixerFloatMask;
-		} else if (sf == SampleShort) {
-			r = inMixerShortMask;
-		}
-		return r;
-	}
-
-	if (sf == SampleFloat) {
-		switch (nchan) {
-			case 1:
-				r = inMixerFloat1;
-				break;
-			case 2:
-				r = inMixerFloat2;
-				break;
-			case 3:
-				r = inMixerFloat3;
-				break;
-			case 4:
-				r = inMixerFloat4;
-				break;
-			case 5:
-				r = inMixerFloat5;
-				break;
-			case 6:
-				r = inMixerFloat6;
-				break;
-			case 7:
-				r = inMixerFloat7;
-				break;
-			case 8:
-				r = inMixerFloat8;
-				break;
-			default:
-				r = inMixerFloatN;
-				break;
-		}
-	} else {
-		switch (nchan) {
-			case 1:
-				r = inMixerShort1;
-				break;
-			case 2:
-				r = inMixerShort2;
-				break;
-			case 3:
-				r = inMixerShort3;
-				break;
-			case 4:
-				r = inMixerShort4;
-				break;
-			case 5:
-				r = inMixerShort5;
-				break;
-			case 6:
-				r = inMixerShort6;
-				break;
-			case 7:
-				r = inMixerShort7;
-				break;
-			case 8:
-				r = inMixerShort8;
-				break;
-			default:
-				r = inMixerShortN;
-				break;
-		}
-	}
-	return r;
+	// The mixers (and the microphone's channel mask) are accelerated with the vector instructions of the CPU
+	return AudioKernels::chooseDownmix(sf == SampleFloat ? AudioKernels::SampleFormat::Float
+														  : AudioKernels::SampleFormat::Short,
+									   nchan, chanmask);
 }
 
 void AudioInput::initializeMixer() {
-	int err;
-
-	if (srsMic)
-		speex_resampler_destroy(srsMic);
-	if (srsEcho)
-		speex_resampler_destroy(srsEcho);
 	delete[] pfMicInput;
 	delete[] pfEchoInput;
 
-	if (iMicFreq != iSampleRate)
-		srsMic = speex_resampler_init(1, iMicFreq, iSampleRate, 3, &err);
-
 	iMicLength = (iFrameSize * iMicFreq) / iSampleRate;
 
-	pfMicInput = new float[iMicLength];
+	// The resamplers make every frame exactly iFrameSize samples long, which is why the input they take for it may be
+	// a frame longer than iMicLength (or iEchoLength) if the rates don't divide evenly
+	if (iMicFreq != iSampleRate) {
+		m_micResampler  = std::make_unique< AudioResampler >(1, iMicFreq, iSampleRate);
+		iMicFrameLength = m_micResampler->inputFramesFor(iFrameSize);
+		pfMicInput      = new float[m_micResampler->maxInputFramesFor(iFrameSize)];
+	} else {
+		m_micResampler.reset();
+		iMicFrameLength = iMicLength;
+		pfMicInput      = new float[iMicLength];
+	}
 
 	if (iEchoChannels > 0) {
 		bEchoMulti = (Global::get().s.echoOption == EchoCancelOptionID::SPEEX_MULTICHANNEL);
-		if (iEchoFreq != iSampleRate)
-			srsEcho = speex_resampler_init(bEchoMulti ? iEchoChannels : 1, iEchoFreq, iSampleRate, 3, &err);
+
+		const unsigned int echoChannels = bEchoMulti ? iEchoChannels : 1;
+
 		iEchoLength    = (iFrameSize * iEchoFreq) / iSampleRate;
-		iEchoMCLength  = bEchoMulti ? iEchoLength * iEchoChannels : iEchoLength;
 		iEchoFrameSize = bEchoMulti ? iFrameSize * iEchoChannels : iFrameSize;
-		pfEchoInput    = new float[iEchoMCLength];
+		if (iEchoFreq != iSampleRate) {
+			m_echoResampler = std::make_unique< AudioResampler >(echoChannels, iEchoFreq, iSampleRate);
+		} else {
+			m_echoResampler.reset();
+		}
+
+		// The echo is resampled by the drift between the clocks first (at the echo's rate), then to iSampleRate
+		const unsigned int maxEchoFrames =
+			m_echoResampler ? m_echoResampler->maxInputFramesFor(iFrameSize) : static_cast< unsigned int >(iFrameSize);
+		const unsigned int maxDriftFrames = AudioDriftResampler::maxInputFramesFor(maxEchoFrames);
+
+		m_echoDrift = std::make_unique< AudioDriftResampler >(echoChannels, maxDriftFrames);
+		m_echoDrift->setRatio(resync.echoRatio());
+		iEchoFrameLength = m_echoDrift->inputFramesFor(echoFramesForFrame());
+		iEchoMCLength    = maxDriftFrames * echoChannels;
+
+		pfEchoInput = new float[iEchoMCLength];
+
+		resync.setFrameSizes(static_cast< unsigned int >(iFrameSize), iEchoFrameSize);
 	} else {
-		srsEcho     = nullptr;
+		m_echoResampler.reset();
+		m_echoDrift.reset();
 		pfEchoInput = nullptr;
 	}
 
+	m_prerollLength = PREROLL_FRAMES * static_cast< unsigned int >(iRegularFrameSize / iFrameSize);
+	m_prerollMic.assign(m_prerollLength * static_cast< unsigned int >(iFrameSize), 0);
+	m_prerollSpeaker.assign(iEchoChannels > 0 ? m_prerollLength * iEchoFrameSize : 0, 0);
+	m_prerollFrames = 0;
+	m_prerollNext   = 0;
+
 	uiMicChannelMask = Global::get().s.uiAudioInputChannelMask;
 
 	// There is no channel mask setting for the echo canceller, so allow all channels.
@@ -544,7 +523,18 @@ void AudioInput::initializeMixer() {
 	iEchoSampleSize =
 		static_cast< unsigned int >(iEchoChannels * ((eEchoFormat == SampleFloat) ? sizeof(float) : sizeof(short)));
 
-	bResetProcessor = true;
+	{
+		QMutexLocker l(&qmProcessorReset);
+
+		m_processorConfig.frameSize    = iFrameSize;
+		m_processorConfig.sampleRate   = iSampleRate;
+		m_processorConfig.micChannels  = iMicChannels;
+		m_processorConfig.echoChannels = iEchoChannels;
+		m_processorConfig.echoMulti    = bEchoMulti;
+		m_processorConfig.echoLag      = resync.getNominalLag();
+		m_processorConfigured          = true;
+	}
+	resetAudioProcessor();
 
 	qWarning("AudioInput: Initialized mixer for %d channel %d hz mic and %d channel %d hz echo", iMicChannels, iMicFreq,
 			 iEchoChannels, iEchoFreq);
@@ -554,9 +544,15 @@ void AudioInput::initializeMixer() {
 }
 
 void AudioInput::addMic(const void *data, unsigned int nsamp) {
+	AudioBenchmark::recordPeriod(AudioBenchmark::Probe::InputPeriod, m_lastMicCall);
+
 	while (nsamp > 0) {
+		if (iMicFilled == 0) {
+			m_frameCaptured = AudioLatency::now();
+		}
+
 		// Make sure we don't overrun the frame buffer
-		const unsigned int left = qMin(nsamp, iMicLength - iMicFilled);
+		const unsigned int left = qMin(nsamp, iMicFrameLength - iMicFilled);
 
 		// Append mix into pfMicInput frame buffer (converts 16bit pcm->float if necessary)
 		imfMic(pfMicInput + iMicFilled, data, left, iMicChannels, uiMicChannelMask);
@@ -572,34 +568,41 @@ void AudioInput::addMic(const void *data, unsigned int nsamp) {
 				data = reinterpret_cast< const short * >(data) + left * iMicChannels;
 		}
 
-		if (iMicFilled == iMicLength) {
+		if (iMicFilled == iMicFrameLength) {
 			// Frame complete
 			iMicFilled = 0;
 
 			// If needed resample frame
-			float *pfOutput = srsMic ? (float *) alloca(iFrameSize * sizeof(float)) : nullptr;
-			float *ptr      = srsMic ? pfOutput : pfMicInput;
+			float *pfOutput = m_micResampler ? (float *) alloca(iFrameSize * sizeof(float)) : nullptr;
+			float *ptr      = m_micResampler ? pfOutput : pfMicInput;
+
+			if (m_micResampler) {
+				m_micResampler->process(pfMicInput, iMicFrameLength, pfOutput, iFrameSize);
+				iMicFrameLength = m_micResampler->inputFramesFor(iFrameSize);
+			}
 
-			if (srsMic) {
-				spx_uint32_t inlen  = iMicLength;
-				spx_uint32_t outlen = iFrameSize;
-				speex_resampler_process_float(srsMic, 0, pfMicInput, &inlen, pfOutput, &outlen);
+			if (AudioBenchmark::isActive()) {
+				AudioBenchmark::detectImpulse(ptr, iFrameSize, m_frameCaptured);
 			}
 
-			// If echo cancellation is enabled the pointer ends up in the resynchronizer queue
-			// and may need to outlive this function's frame
-			short *psMic = iEchoChannels > 0 ? new short[iFrameSize] : (short *) alloca(iFrameSize * sizeof(short));
+			// If echo cancellation is enabled the frame ends up in the resynchronizer queue
+			// and has to outlive this function's frame
+			short *psMic = iEchoChannels > 0 ? resync.acquireMic() : (short *) alloca(iFrameSize * sizeof(short));
+			if (!psMic) {
+				// All frames are still queued, in which case the resynchronizer would drop the frame anyway
+				continue;
+			}
 
 			// Convert float to 16bit PCM
-			const float mul = 32768.f;
-			for (int j = 0; j < iFrameSize; ++j)
-				psMic[j] = static_cast< short >(qBound(-32768.f, (ptr[j] * mul), 32767.f));
+			AudioKernels::floatToShort(ptr, psMic, static_cast< std::size_t >(iFrameSize));
 
 			// If we have echo cancellation enabled...
 			if (iEchoChannels > 0) {
-				resync.addMic(psMic);
+				resync.addMic(psMic, m_frameCaptured);
 			} else {
-				encodeAudioFrame(AudioChunk(psMic));
+				AudioChunk chunk(psMic, ptr);
+				chunk.captured = m_frameCaptured;
+				encodeAudioFrame(chunk);
 			}
 		}
 	}
@@ -608,7 +611,7 @@ void AudioInput::addMic(const void *data, unsigned int nsamp) {
 void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 	while (nsamp > 0) {
 		// Make sure we don't overrun the echo frame buffer
-		const unsigned int left = qMin(nsamp, iEchoLength - iEchoFilled);
+		const unsigned int left = qMin(nsamp, iEchoFrameLength - iEchoFilled);
 
 		if (bEchoMulti) {
 			const unsigned int samples = left * iEchoChannels;
@@ -618,9 +621,8 @@ void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 					pfEchoInput[i + iEchoFilled * iEchoChannels] = reinterpret_cast< const float * >(data)[i];
 			} else {
 				// 16bit PCM -> float
-				for (unsigned int i = 0; i < samples; ++i)
-					pfEchoInput[i + iEchoFilled * iEchoChannels] =
-						static_cast< float >(reinterpret_cast< const short * >(data)[i]) * (1.0f / 32768.f);
+				AudioKernels::shortToFloat(reinterpret_cast< const short * >(data),
+										   pfEchoInput + iEchoFilled * iEchoChannels, samples);
 			}
 		} else {
 			// Mix echo channels (converts 16bit PCM -> float if needed)
@@ -638,39 +640,46 @@ void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 				data = reinterpret_cast< const short * >(data) + left * iEchoChannels;
 		}
 
-		if (iEchoFilled == iEchoLength) {
+		if (iEchoFilled == iEchoFrameLength) {
 			// Frame complete
 
 			iEchoFilled = 0;
 
-			// Resample if necessary
-			float *pfOutput = srsEcho ? (float *) alloca(iEchoFrameSize * sizeof(float)) : nullptr;
-			float *ptr      = srsEcho ? pfOutput : pfEchoInput;
+			// Compensate for the drift, then resample if necessary
+			const unsigned int echoChannels = bEchoMulti ? iEchoChannels : 1;
+			const unsigned int driftFrames  = echoFramesForFrame();
+			float *pfDrifted                = (float *) alloca(driftFrames * echoChannels * sizeof(float));
+			m_echoDrift->process(pfEchoInput, iEchoFrameLength, pfDrifted, driftFrames);
 
-			if (srsEcho) {
-				spx_uint32_t inlen  = iEchoLength;
-				spx_uint32_t outlen = iFrameSize;
-				speex_resampler_process_interleaved_float(srsEcho, pfEchoInput, &inlen, pfOutput, &outlen);
+			float *pfOutput = m_echoResampler ? (float *) alloca(iEchoFrameSize * sizeof(float)) : nullptr;
+			float *ptr      = m_echoResampler ? pfOutput : pfDrifted;
+
+			if (m_echoResampler) {
+				m_echoResampler->process(pfDrifted, driftFrames, pfOutput, iFrameSize);
 			}
 
-			short *outbuff = new short[iEchoFrameSize];
+			short *outbuff = resync.speakerFrame();
 
 			// float -> 16bit PCM
-			const float mul = 32768.f;
-			for (unsigned int j = 0; j < iEchoFrameSize; ++j) {
-				outbuff[j] = static_cast< short >(qBound(-32768.f, (ptr[j] * mul), 32767.f));
-			}
+			AudioKernels::floatToShort(ptr, outbuff, iEchoFrameSize);
 
 			auto chunk = resync.addSpeaker(outbuff);
 			if (!chunk.empty()) {
 				encodeAudioFrame(chunk);
-				delete[] chunk.mic;
-				delete[] chunk.speaker;
+				resync.release(chunk);
 			}
+
+			// The next frame takes as many of the echo's frames as the drift (which addSpeaker() has updated) needs
+			m_echoDrift->setRatio(resync.echoRatio());
+			iEchoFrameLength = m_echoDrift->inputFramesFor(echoFramesForFrame());
 		}
 	}
 }
 
+unsigned int AudioInput::echoFramesForFrame() const {
+	return m_echoResampler ? m_echoResampler->inputFramesFor(iFrameSize) : static_cast< unsigned int >(iFrameSize);
+}
+
 void AudioInput::adjustBandwidth(int bitspersec, int &bitrate, int &frames, bool &allowLowDelay) {
 	frames        = Global::get().s.iFramesPerPacket;
 	bitrate       = Global::get().s.iQuality;
@@ -733,66 +742,67 @@ void AudioInput::setMaxBandwidth(int bitspersec) {
 	Audio::startInput();
 }
 
-int AudioInput::getNetworkBandwidth(int bitrate, int frames) {
+int AudioInput::getNetworkBandwidth(int bitrate, int frames, int frameSize) {
 	int overhead = 20 + 8 + 4 + 1 + 2 + (Global::get().s.bTransmitPosition ? 12 : 0)
 				   + (NetworkConfig::TcpModeEnabled() ? 12 : 0) + frames;
-	overhead *= (800 / frames);
+	// The overhead of every packet at the number of packets per second
+	overhead *= (8 * static_cast< int >(SAMPLE_RATE) / (frames * frameSize));
 	int bw = overhead + bitrate;
 
 	return bw;
 }
 
 void AudioInput::resetAudioProcessor() {
-	if (!bResetProcessor)
-		return;
-
-	int iArg;
+	QMutexLocker l(&qmProcessorReset);
 
-	if (sppPreprocess)
-		speex_preprocess_state_destroy(sppPreprocess);
-	if (sesEcho)
-		speex_echo_state_destroy(sesEcho);
-
-	sppPreprocess = speex_preprocess_state_init(iFrameSize, iSampleRate);
-	resync.reset();
-	selectNoiseCancel();
-
-	iArg = 1;
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_VAD, &iArg);
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC, &iArg);
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_DEREVERB, &iArg);
+	if (!m_processorConfigured) {
+		// initializeMixer() is going to build the first graph once the format is known
+		return;
+	}
 
-	iArg = 30000;
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC_TARGET, &iArg);
+	// The graphs the audio thread has let go of by now are deleted here rather than by the audio thread
+	deleteRetiredProcessors();
 
-	float v = 30000.0f / static_cast< float >(Global::get().s.iMinLoudness);
-	iArg    = static_cast< int >(floorf(20.0f * log10f(v)));
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC_MAX_GAIN, &iArg);
+	AudioProcessingGraph::Config config = m_processorConfig;
+	config.noiseCancel                  = Global::get().s.noiseCancelMode;
+	config.noiseSuppression             = Global::get().s.iSpeexNoiseCancelStrength;
+	config.minLoudness                  = Global::get().s.iMinLoudness;
+	config.echoParallel                 = Global::get().s.bParallelEchoCancellation;
 
-	iArg = -60;
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC_DECREMENT, &iArg);
+	// A graph that has been built earlier but hasn't been picked up yet is never going to be
+	delete m_pendingProcessor.exchange(new AudioProcessingGraph(config, this), std::memory_order_acq_rel);
+}
 
-	if (noiseCancel == Settings::NoiseCancelSpeex) {
-		iArg = Global::get().s.iSpeexNoiseCancelStrength;
-		speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &iArg);
+void AudioInput::adoptAudioProcessor() {
+	AudioProcessingGraph *pending = m_pendingProcessor.exchange(nullptr, std::memory_order_acq_rel);
+	if (!pending) {
+		return;
 	}
 
-	if (iEchoChannels > 0) {
-		int filterSize = iFrameSize * (10 + resync.getNominalLag());
-		sesEcho =
-			speex_echo_state_init_mc(iFrameSize, filterSize, 1, bEchoMulti ? static_cast< int >(iEchoChannels) : 1);
-		iArg = iSampleRate;
-		speex_echo_ctl(sesEcho, SPEEX_ECHO_SET_SAMPLING_RATE, &iArg);
-		speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_ECHO_STATE, sesEcho);
-
-		qWarning("AudioInput: ECHO CANCELLER ACTIVE");
-	} else {
-		sesEcho = nullptr;
+	if (AudioProcessingGraph *retired = m_processor.release()) {
+		retired->nextRetired = m_retiredProcessors.load(std::memory_order_relaxed);
+		while (!m_retiredProcessors.compare_exchange_weak(retired->nextRetired, retired, std::memory_order_release,
+														  std::memory_order_relaxed)) {
+		}
 	}
+	m_processor.reset(pending);
+
+	sppPreprocess = m_processor->preprocessor();
+	sesEcho       = m_processor->echoCanceller();
+
+	// The echo canceller starts over, so the queued frames are of no use to it
+	resync.reset();
 
 	bResetEncoder = true;
+}
 
-	bResetProcessor = false;
+void AudioInput::deleteRetiredProcessors() {
+	AudioProcessingGraph *retired = m_retiredProcessors.exchange(nullptr, std::memory_order_acquire);
+	while (retired) {
+		AudioProcessingGraph *next = retired->nextRetired;
+		delete retired;
+		retired = next;
+	}
 }
 
 bool AudioInput::selectCodec() {
@@ -812,41 +822,6 @@ bool AudioInput::selectCodec() {
 	return true;
 }
 
-void AudioInput::selectNoiseCancel() {
-	noiseCancel = Global::get().s.noiseCancelMode;
-
-	if (noiseCancel == Settings::NoiseCancelRNN || noiseCancel == Settings::NoiseCancelBoth) {
-#ifdef USE_RNNOISE
-		if (!denoiseState || iFrameSize != 480) {
-			qWarning("AudioInput: Ignoring request to enable RNNoise: internal error");
-			noiseCancel = Settings::NoiseCancelSpeex;
-		}
-#else
-		qWarning("AudioInput: Ignoring request to enable RNNoise: Mumble was built without support for it");
-		noiseCancel = Settings::NoiseCancelSpeex;
-#endif
-	}
-
-	int iArg = 0;
-	switch (noiseCancel) {
-		case Settings::NoiseCancelOff:
-			qWarning("AudioInput: Noise canceller disabled");
-			break;
-		case Settings::NoiseCancelSpeex:
-			qWarning("AudioInput: Using Speex as noise canceller");
-			iArg = 1;
-			break;
-		case Settings::NoiseCancelRNN:
-			qWarning("AudioInput: Using RNNoise as noise canceller");
-			break;
-		case Settings::NoiseCancelBoth:
-			iArg = 1;
-			qWarning("AudioInput: Using RNNoise and Speex as noise canceller");
-			break;
-	}
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_DENOISE, &iArg);
-}
-
 int AudioInput::encodeOpusFrame(short *source, int size, EncodingOutputBuffer &buffer) {
 	int len;
 	if (bResetEncoder) {
@@ -854,16 +829,54 @@ int AudioInput::encodeOpusFrame(short *source, int size, EncodingOutputBuffer &b
 		bResetEncoder = false;
 	}
 
-	opus_encoder_ctl(opusState, OPUS_SET_BITRATE(iAudioQuality));
+	int bitrate    = iAudioQuality;
+	int uplinkLoss = 0;
+	{
+		ServerHandlerPtr sh = Global::get().sh;
+		if (sh) {
+			uplinkLoss = std::min(sh->m_uplinkLoss.load(), 100);
+
+			// Some of the listeners can't take the configured quality right now, so it is reduced (for as long as
+			// the server keeps suggesting so) rather than having their audio break up
+			const int bitrateHint = sh->m_bitrateHint.load();
+			if (bitrateHint > 0) {
+				bitrate = std::max(std::min(bitrate, bitrateHint), 8000);
+			}
+		}
+	}
+	opus_encoder_ctl(opusState, OPUS_SET_BITRATE(bitrate));
+	if (uplinkLoss != m_packetLossPercent) {
+		// While packets to the server get lost, every packet carries a lower quality version of the previous one
+		// (in-band FEC), from which receivers can restore that packet should it have been lost
+		opus_encoder_ctl(opusState, OPUS_SET_INBAND_FEC(uplinkLoss > 0 ? 1 : 0));
+		opus_encoder_ctl(opusState, OPUS_SET_PACKET_LOSS_PERC(uplinkLoss));
+		m_packetLossPercent = uplinkLoss;
+	}
 
 	len = opus_encode(opusState, source, size, &buffer[0], static_cast< opus_int32 >(buffer.size()));
-	const int tenMsFrameCount = (size / iFrameSize);
-	iBitrate                  = (len * 100 * 8) / tenMsFrameCount;
+	iBitrate = static_cast< int >(static_cast< long long >(len) * 8 * SAMPLE_RATE / size);
 	return len;
 }
 
+bool AudioInput::smallFramesAllowed() const {
+	if (iFrameSize == iRegularFrameSize) {
+		return false;
+	}
+
+	if (Global::get().s.lmLoopMode == Settings::Local) {
+		// The frames don't leave the client
+		return true;
+	}
+
+	ServerHandlerPtr sh = Global::get().sh;
+	return sh && sh->m_smallAudioFrames.load()
+		   && sh->m_version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION;
+}
+
 void AudioInput::encodeAudioFrame(AudioChunk chunk) {
-	int iArg;
+	AudioBenchmark::ScopedTimer timer(AudioBenchmark::Probe::Encode);
+	MUMBLE_PROFILE_ZONE("AudioInput::encodeAudioFrame");
+
 	float sum;
 	short max;
 
@@ -900,65 +913,88 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 		dPeakSpeaker = 0.0;
 	}
 
-	QMutexLocker l(&qmSpeex);
-	resetAudioProcessor();
+	// If Global::get().iPushToTalk > 0 that means that we are currently in some sort of PTT action. For
+	// instance this could mean we're currently whispering
+	bool isPTT = Global::get().iPushToTalk > 0;
 
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_GET_AGC_GAIN, &iArg);
-	float gainValue = static_cast< float >(iArg);
-	if (noiseCancel == Settings::NoiseCancelSpeex || noiseCancel == Settings::NoiseCancelBoth) {
-		iArg = Global::get().s.iSpeexNoiseCancelStrength - iArg;
-		speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &iArg);
-	}
+	const bool continuous = Global::get().s.atTransmit == Settings::Continuous
+							|| API::PluginData::get().overwriteMicrophoneActivation.load();
+	const bool pushToTalk = !continuous && Global::get().s.atTransmit == Settings::PushToTalk;
+	if (pushToTalk) {
+		// PTT is enabled, so check if it is currently active
+		bool doublePush = Global::get().s.uiDoublePush > 0
+						  && ((Global::get().uiDoublePush < Global::get().s.uiDoublePush)
+							  || (Global::get().tDoublePush.elapsed() < Global::get().s.uiDoublePush));
 
-	short psClean[iFrameSize];
-	if (sesEcho && chunk.speaker) {
-		speex_echo_cancellation(sesEcho, chunk.mic, chunk.speaker, psClean);
-		psSource = psClean;
-	} else {
-		psSource = chunk.mic;
+		// With double push enabled, we might be in a PTT state without pressing any PTT key
+		isPTT = isPTT || doublePush;
 	}
 
-#ifdef USE_RNNOISE
-	// At the time of writing this code, RNNoise only supports a sample rate of 48000 Hz.
-	if (noiseCancel == Settings::NoiseCancelRNN || noiseCancel == Settings::NoiseCancelBoth) {
-		float denoiseFrames[480];
-		for (unsigned int i = 0; i < 480; i++) {
-			denoiseFrames[i] = psSource[i];
-		}
+	ClientUser *p    = ClientUser::get(Global::get().uiSession);
+	const bool muted = Global::get().s.bMute
+					   || ((Global::get().s.lmLoopMode != Settings::Local) && p && (p->bMute || p->bSuppress))
+					   || Global::get().bPushToMute || (voiceTargetID < 0);
+	// Whether the user is told that they are talking while muted, which takes the voice activity detection
+	const bool muteCue = Global::get().s.bTxMuteCue && !Global::get().bPushToMute && !Global::get().s.bDeaf;
 
-		rnnoise_process_frame(denoiseState, denoiseFrames, denoiseFrames);
+	// Unless a transmission has to be ended, the processing is skipped for as long as none can be started, which saves
+	// the echo canceller's and the preprocessor's work while the PTT key is released or the user is muted. Only the
+	// level of the microphone (see above) is kept up to date then.
+	const bool skipProcessing = !bPreviousVoice && ((pushToTalk && !isPTT) || (muted && !muteCue))
+								&& !bDebugDumpInput
+								&& AudioLatency::now() >= m_processingRequestedUntil.load(std::memory_order_relaxed);
 
-		for (unsigned int i = 0; i < 480; i++) {
-			psSource[i] = clampFloatSample(denoiseFrames[i]);
-		}
+	QMutexLocker l(&qmSpeex);
+	adoptAudioProcessor();
+	if (!m_processor) {
+		return;
 	}
-#endif
 
-	speex_preprocess_run(sppPreprocess, psSource);
+	AudioProcessingFrame frame;
+	frame.samples          = chunk.mic;
+	frame.speaker          = chunk.speaker;
+	frame.micFloat         = chunk.micFloat;
+	frame.noiseSuppression = Global::get().s.iSpeexNoiseCancelStrength;
 
-	sum = 1.0f;
-	for (unsigned int i = 0; i < iFrameSize; i++)
-		sum += static_cast< float >(psSource[i] * psSource[i]);
-	float micLevel = sqrtf(sum / static_cast< float >(iFrameSize));
-	dPeakSignal    = qMax(20.0f * log10f(micLevel / 32768.0f), -96.0f);
+	float level = 0.0f;
+	if (skipProcessing) {
+		keepForPreroll(chunk);
 
-	if (bDebugDumpInput) {
-		outMic.write(reinterpret_cast< const char * >(chunk.mic), iFrameSize * sizeof(short));
-		if (chunk.speaker) {
-			outSpeaker.write(reinterpret_cast< const char * >(chunk.speaker),
-							 static_cast< std::streamsize >(iEchoFrameSize * sizeof(short)));
+		psSource      = chunk.mic;
+		dPeakSignal   = dPeakMic;
+		dPeakCleanMic = dPeakMic;
+		fSpeechProb   = 0.0f;
+	} else {
+		runPreroll(frame.noiseSuppression);
+
+		m_processor->run(AudioProcessingGraph::Stage::Cleanup, frame);
+
+		psSource        = frame.samples;
+		float gainValue = static_cast< float >(frame.agcGain);
+
+		sum = 1.0f;
+		for (unsigned int i = 0; i < iFrameSize; i++)
+			sum += static_cast< float >(psSource[i] * psSource[i]);
+		float micLevel = sqrtf(sum / static_cast< float >(iFrameSize));
+		dPeakSignal    = qMax(20.0f * log10f(micLevel / 32768.0f), -96.0f);
+
+		if (bDebugDumpInput) {
+			outMic.write(reinterpret_cast< const char * >(chunk.mic), iFrameSize * sizeof(short));
+			if (chunk.speaker) {
+				outSpeaker.write(reinterpret_cast< const char * >(chunk.speaker),
+								 static_cast< std::streamsize >(iEchoFrameSize * sizeof(short)));
+			}
+			outProcessed.write(reinterpret_cast< const char * >(psSource),
+							   static_cast< std::streamsize >(iFrameSize * sizeof(short)));
 		}
-		outProcessed.write(reinterpret_cast< const char * >(psSource),
-						   static_cast< std::streamsize >(iFrameSize * sizeof(short)));
-	}
 
-	spx_int32_t prob = 0;
-	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_GET_PROB, &prob);
-	fSpeechProb = static_cast< float >(prob) / 100.0f;
+		fSpeechProb = frame.speechProbability;
 
-	// clean microphone level: peak of filtered signal attenuated by AGC gain
-	dPeakCleanMic = qMax(dPeakSignal - gainValue, -96.0f);
-	float level   = (Global::get().s.vsVAD == Settings::SignalToNoise) ? fSpeechProb : (1.0f + dPeakCleanMic / 96.0f);
+		// clean microphone level: peak of filtered signal attenuated by AGC gain
+		dPeakCleanMic = qMax(dPeakSignal - gainValue, -96.0f);
+		level         =
+			(Global::get().s.vsVAD == Settings::SignalToNoise) ? fSpeechProb : (1.0f + dPeakCleanMic / 96.0f);
+	}
 
 	bool bIsSpeech = false;
 
@@ -972,38 +1008,25 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 
 	if (!bIsSpeech) {
 		iHoldFrames++;
-		if (iHoldFrames < Global::get().s.iVoiceHold)
+		// The hold is given in regular frames
+		if (iHoldFrames * iFrameSize < Global::get().s.iVoiceHold * iRegularFrameSize)
 			// Hold mic open until iVoiceHold threshold is reached
 			bIsSpeech = true;
 	} else {
 		iHoldFrames = 0;
 	}
 
-	// If Global::get().iPushToTalk > 0 that means that we are currently in some sort of PTT action. For
-	// instance this could mean we're currently whispering
-	bool isPTT = Global::get().iPushToTalk > 0;
-
-	if (Global::get().s.atTransmit == Settings::Continuous
-		|| API::PluginData::get().overwriteMicrophoneActivation.load()) {
+	if (continuous) {
 		// Continuous transmission is enabled
 		bIsSpeech = true;
-	} else if (Global::get().s.atTransmit == Settings::PushToTalk) {
-		// PTT is enabled, so check if it is currently active
-		bool doublePush = Global::get().s.uiDoublePush > 0
-						  && ((Global::get().uiDoublePush < Global::get().s.uiDoublePush)
-							  || (Global::get().tDoublePush.elapsed() < Global::get().s.uiDoublePush));
-
-		// With double push enabled, we might be in a PTT state without pressing any PTT key
-		isPTT     = isPTT || doublePush;
+	} else if (pushToTalk) {
 		bIsSpeech = isPTT;
 	}
 
 	bIsSpeech = bIsSpeech || isPTT;
 
-	ClientUser *p          = ClientUser::get(Global::get().uiSession);
 	bool bTalkingWhenMuted = false;
-	if (Global::get().s.bMute || ((Global::get().s.lmLoopMode != Settings::Local) && p && (p->bMute || p->bSuppress))
-		|| Global::get().bPushToMute || (voiceTargetID < 0)) {
+	if (muted) {
 		bTalkingWhenMuted = bIsSpeech;
 		bIsSpeech         = false;
 	}
@@ -1012,7 +1035,7 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 		iSilentFrames = 0;
 	} else {
 		iSilentFrames++;
-		if (iSilentFrames > 500)
+		if (iSilentFrames * iFrameSize > 500 * iRegularFrameSize)
 			iFrameCounter = 0;
 	}
 
@@ -1050,8 +1073,7 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 				m_activeAudioCue = ao->playSample(Global::get().s.qsTxAudioCueOff, Global::get().s.cueVolume);
 			}
 
-			if (Global::get().s.bTxMuteCue && !Global::get().bPushToMute && !Global::get().s.bDeaf
-				&& bTalkingWhenMuted) {
+			if (muteCue && bTalkingWhenMuted) {
 				if (!qetLastMuteCue.isValid() || qetLastMuteCue.elapsed() > MUTE_CUE_DELAY) {
 					qetLastMuteCue.start();
 					ao->playSample(Global::get().s.qsTxMuteCue, Global::get().s.cueVolume);
@@ -1061,7 +1083,13 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 		}
 	}
 
-	if (!bIsSpeech && !bPreviousVoice) {
+	frame.transmitted = bIsSpeech || bPreviousVoice;
+	frame.isSpeech    = bIsSpeech;
+	if (!skipProcessing) {
+		m_processor->run(AudioProcessingGraph::Stage::Transmission, frame);
+	}
+
+	if (!frame.transmitted) {
 		iBitrate = 0;
 
 		if ((tIdle.elapsed() / 1000000ULL) > Global::get().s.iIdleTime) {
@@ -1085,12 +1113,7 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 			}
 		}
 
-		spx_int32_t increment = 0;
-		speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC_INCREMENT, &increment);
 		return;
-	} else {
-		spx_int32_t increment = 12;
-		speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_SET_AGC_INCREMENT, &increment);
 	}
 
 	if (bIsSpeech && !bPreviousVoice) {
@@ -1102,8 +1125,6 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 	EncodingOutputBuffer buffer;
 	Q_ASSERT(buffer.size() >= static_cast< size_t >(iAudioQuality / 100 * iAudioFrames / 8));
 
-	emit audioInputEncountered(psSource, iFrameSize, iMicChannels, SAMPLE_RATE, bIsSpeech);
-
 	int len = 0;
 
 	bool encoded = true;
@@ -1114,22 +1135,26 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 
 	// Encode via Opus
 	encoded = false;
+	if (iBufferedFrames == 0) {
+		m_packetCaptured = chunk.captured;
+		m_packetFrames   = smallFramesAllowed() ? 1 : iAudioFrames * iRegularFrameSize / iFrameSize;
+	}
 	opusBuffer.insert(opusBuffer.end(), psSource, psSource + iFrameSize);
 	++iBufferedFrames;
 
-	if (!bIsSpeech || iBufferedFrames >= iAudioFrames) {
-		if (iBufferedFrames < iAudioFrames) {
+	if (!bIsSpeech || iBufferedFrames >= m_packetFrames) {
+		if (iBufferedFrames < m_packetFrames) {
 			// Stuff frame to framesize if speech ends and we don't have enough audio
 			// this way we are guaranteed to have a valid framecount and won't cause
 			// a codec configuration switch by suddenly using a wildly different
 			// framecount per packet.
-			const int missingFrames = iAudioFrames - iBufferedFrames;
+			const int missingFrames = m_packetFrames - iBufferedFrames;
 			opusBuffer.insert(opusBuffer.end(), static_cast< std::size_t >(iFrameSize * missingFrames), 0);
 			iBufferedFrames += missingFrames;
 			iFrameCounter += missingFrames;
 		}
 
-		Q_ASSERT(iBufferedFrames == iAudioFrames);
+		Q_ASSERT(iBufferedFrames == m_packetFrames);
 
 		len = encodeOpusFrame(&opusBuffer[0], iBufferedFrames * iFrameSize, buffer);
 		opusBuffer.clear();
@@ -1140,6 +1165,11 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 			return;
 		}
 		encoded = true;
+
+		m_packetEncoded = AudioLatency::now();
+		if (m_packetCaptured != 0) {
+			AudioLatency::record(AudioLatency::Stage::Encode, m_packetEncoded - m_packetCaptured);
+		}
 	}
 
 	if (encoded) {
@@ -1153,17 +1183,17 @@ void AudioInput::encodeAudioFrame(AudioChunk chunk) {
 	previousPTT    = isPTT;
 }
 
-static void sendAudioFrame(gsl::span< const Mumble::Protocol::byte > encodedPacket) {
+static void sendAudioFrame(gsl::span< const Mumble::Protocol::byte > encodedPacket, quint64 encoded) {
 	ServerHandlerPtr sh = Global::get().sh;
 	if (sh) {
-		sh->sendMessage(encodedPacket.data(), static_cast< int >(encodedPacket.size()));
+		sh->sendMessage(encodedPacket.data(), static_cast< int >(encodedPacket.size()), false, encoded);
 	}
 }
 
 void AudioInput::flushCheck(const QByteArray &frame, bool terminator, std::int32_t voiceTargetID) {
 	qlFrames << frame;
 
-	if (!terminator && iBufferedFrames < iAudioFrames)
+	if (!terminator && iBufferedFrames < m_packetFrames)
 		return;
 
 	Mumble::Protocol::AudioData audioData;
@@ -1192,11 +1222,18 @@ void AudioInput::flushCheck(const QByteArray &frame, bool terminator, std::int32
 	int frames      = iBufferedFrames;
 	iBufferedFrames = 0;
 
-	audioData.frameNumber = static_cast< std::size_t >(iFrameCounter - frames);
+	if (m_packetFrames == 1 && iFrameSize < iRegularFrameSize) {
+		// The frames are sent as they are, so they are counted as they are
+		audioData.frameNumber = static_cast< std::size_t >(iFrameCounter - frames);
+		audioData.frameSize   = static_cast< std::uint32_t >(iFrameSize);
+	} else {
+		audioData.frameNumber = static_cast< std::size_t >((iFrameCounter - frames) * iFrameSize / iRegularFrameSize);
+	}
 
-	if (Global::get().s.bTransmitPosition && Global::get().pluginManager && !Global::get().bCenterPosition
-		&& Global::get().pluginManager->fetchPositionalData()) {
-		Position3D currentPos = Global::get().pluginManager->getPositionalData().getPlayerPos();
+	const PositionalPose pose =
+		Global::get().pluginManager ? Global::get().pluginManager->getPositionalPose() : PositionalPose();
+	if (Global::get().s.bTransmitPosition && !Global::get().bCenterPosition && pose.available) {
+		Position3D currentPos = pose.playerPos;
 
 		audioData.position[0] = currentPos.x;
 		audioData.position[1] = currentPos.y;
@@ -1213,6 +1250,14 @@ void AudioInput::flushCheck(const QByteArray &frame, bool terminator, std::int32
 		reinterpret_cast< const Mumble::Protocol::byte * >(qlFrames[0].constData()),
 		static_cast< std::size_t >(qlFrames[0].size()));
 
+	// While packets to the server get lost, every packet also carries a copy of the previous one. The server only
+	// passes it on to receivers that are losing packets as well.
+	if (m_packetLossPercent > 0 && !m_previousFrame.isEmpty() && audioData.frameNumber == m_previousFrameEnd) {
+		audioData.redundantPayload = gsl::span< const Mumble::Protocol::byte >(
+			reinterpret_cast< const Mumble::Protocol::byte * >(m_previousFrame.constData()),
+			static_cast< std::size_t >(m_previousFrame.size()));
+	}
+
 	{
 		ServerHandlerPtr sh = Global::get().sh;
 		if (sh) {
@@ -1232,7 +1277,17 @@ void AudioInput::flushCheck(const QByteArray &frame, bool terminator, std::int32
 		// Encode audio frame and send out
 		gsl::span< const Mumble::Protocol::byte > encodedAudioPacket = m_udpEncoder.encodeAudioPacket(audioData);
 
-		sendAudioFrame(encodedAudioPacket);
+		sendAudioFrame(encodedAudioPacket, m_packetEncoded);
+	}
+
+	if (terminator) {
+		m_previousFrame.clear();
+	} else {
+		m_previousFrame    = qlFrames[0];
+		m_previousFrameEnd = audioData.frameNumber
+							 + static_cast< unsigned int >(audioData.frameSize != 0
+															   ? frames
+															   : frames * iFrameSize / iRegularFrameSize);
 	}
 
 	qlFrames.clear();
@@ -13,19 +13,23 @@
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
-#include <list>
 #include <memory>
-#include <mutex>
 #include <vector>
 
 #include <speex/speex_echo.h>
 #include <speex/speex_preprocess.h>
-#include <speex/speex_resampler.h>
 
 #include "Audio.h"
+#include "AudioDriftResampler.h"
+#include "AudioKernels.h"
 #include "AudioOutputToken.h"
+#include "AudioProcessingGraph.h"
+#include "AudioResampler.h"
 #include "EchoCancelOption.h"
 #include "MumbleProtocol.h"
 #include "Settings.h"
@@ -33,23 +37,30 @@
 
 class AudioInput;
 struct OpusEncoder;
-struct DenoiseState;
 typedef boost::shared_ptr< AudioInput > AudioInputPtr;
 
 /**
  * A chunk of audio data to process
- * This struct wraps pointers to two dynamically allocated arrays, containing
- * PCM samples of microphone and speaker readback data (for echo cancellation).
- * Does not handle pointer ownership, so you'll have to deallocate them yourself.
+ * This struct wraps pointers to two arrays, containing PCM samples of
+ * microphone and speaker readback data (for echo cancellation).
+ * Does not handle pointer ownership: the frames of chunks returned by the
+ * Resynchronizer belong to it and have to be handed back with
+ * Resynchronizer::release().
  */
 struct AudioChunk {
-	AudioChunk() : mic(nullptr), speaker(nullptr) {}
-	explicit AudioChunk(short *mic) : mic(mic), speaker(nullptr) {}
-	AudioChunk(short *mic, short *speaker) : mic(mic), speaker(speaker) {}
+	AudioChunk() : mic(nullptr), speaker(nullptr), micFloat(nullptr) {}
+	explicit AudioChunk(short *mic) : mic(mic), speaker(nullptr), micFloat(nullptr) {}
+	AudioChunk(short *mic, const float *micFloat) : mic(mic), speaker(nullptr), micFloat(micFloat) {}
+	AudioChunk(short *mic, short *speaker) : mic(mic), speaker(speaker), micFloat(nullptr) {}
 	bool empty() const { return mic == nullptr; }
 
 	short *mic;     ///< Pointer to microphone samples
 	short *speaker; ///< Pointer to speaker samples, nullptr if echo cancellation is disabled
+	/// Pointer to the microphone samples before they have been converted to 16-bit PCM (in [-1, 1]), nullptr if they
+	/// are no longer around (as is the case for chunks that have been queued for echo cancellation)
+	const float *micFloat;
+	/// When the first of the microphone samples has arrived from the device (see AudioLatency::now()), 0 if unknown
+	quint64 captured = 0;
 };
 
 /*
@@ -71,31 +82,103 @@ struct AudioChunk {
  * statemachine that introduces packet drops to control the fill level
  * to at least 2 (plus or minus one) and less than 4 elements.
  * With a 10ms chunk, this queue should introduce a ~20ms lag to the voice.
+ *
+ * As the clocks of the microphone and the speaker drift apart, the fill
+ * level would slowly move towards either end and cause a drop every now
+ * and then, after which the echo canceller has to converge again. To
+ * prevent that, addSpeaker() estimates the drift from the (smoothed) fill
+ * level and the speaker data is resampled by it before it's passed in
+ * (see echoRatio()), which holds the fill level in the middle of the
+ * queue. The drops then only happen on glitches of the devices.
+ *
+ * addMic() and addSpeaker() are called by the microphone and the speaker
+ * callback of the audio backend, which are real-time threads of their own.
+ * Thus, neither of them takes a lock or allocates memory: the frames are
+ * taken from a fixed pool that is allocated up front (see setFrameSizes())
+ * and passed between the two callbacks through lock-free rings.
  */
 class Resynchronizer {
 public:
+	/**
+	 * A queue of frames that is filled by one thread and emptied by another one,
+	 * without either of them having to wait for the other.
+	 */
+	class FrameRing {
+	public:
+		static constexpr std::size_t CAPACITY = 8;
+
+		/// Must only be called by the filling thread
+		///
+		/// \return Whether the frame has been added (instead of the ring being full)
+		bool push(short *frame);
+		/// Must only be called by the emptying thread
+		///
+		/// \return The oldest frame or nullptr if the ring is empty
+		short *pop();
+		/// \return The number of frames in the ring, which may already be outdated
+		std::size_t size() const;
+		/// Empties the ring. Must only be called while neither thread is using it.
+		void clear();
+
+	private:
+		std::array< short *, CAPACITY > m_frames = {};
+		std::atomic< std::size_t > m_head{ 0 };
+		std::atomic< std::size_t > m_tail{ 0 };
+	};
+
+	/**
+	 * Allocates the frames for the given frame sizes (in samples), which is
+	 * the only time the resynchronizer allocates memory. Must not be called
+	 * while the audio callbacks are running.
+	 */
+	void setFrameSizes(unsigned int micSamples, unsigned int speakerSamples);
+
+	/**
+	 * Called by the microphone callback for a frame to write the next
+	 * microphone samples to, which are then passed to addMic()
+	 *
+	 * \return An unused frame or nullptr if all of them are still queued
+	 * (in which case the samples have to be dropped)
+	 */
+	short *acquireMic();
+
 	/**
 	 * Add a microphone sample to the resynchronizer queue
 	 * The resynchronizer may decide to drop the sample, and in that case
-	 * the pointer will be deallocated not lo leak memory
+	 * the frame is reused by the next call to acquireMic()
 	 *
-	 * \param mic pointer to a dynamically allocated  array with PCM data
+	 * \param mic a frame returned by acquireMic() that holds the PCM data
+	 * \param captured when the frame's first samples have arrived from the device, which the chunk returned by
+	 * addSpeaker() carries along
 	 */
-	void addMic(short *mic);
+	void addMic(short *mic, quint64 captured = 0);
+
+	/**
+	 * \return The frame the speaker callback writes the speaker samples to,
+	 * which are then passed to addSpeaker()
+	 */
+	short *speakerFrame();
 
 	/**
 	 * Add a speaker sample to the resynchronizer
-	 * The resynchronizer may decide to drop the sample, and in that case
-	 * the pointer will be deallocated not lo leak memory
 	 *
-	 * \param mic pointer to a dynamically allocated array with PCM data
+	 * \param speaker the frame returned by speakerFrame() that holds the PCM data
 	 * \return If microphone data is available, the resynchronizer will return a
-	 * valid audio chunk to encode, otherwise an empty chunk will be returned
+	 * valid audio chunk to encode (which has to be passed to release() afterwards),
+	 * otherwise an empty chunk will be returned
 	 */
 	AudioChunk addSpeaker(short *speaker);
 
+	/**
+	 * Hands the microphone frame of a chunk returned by addSpeaker() back to
+	 * the resynchronizer once the chunk has been processed. Must be called
+	 * by the speaker callback.
+	 */
+	void release(const AudioChunk &chunk);
+
 	/**
 	 * Reinitialize the resynchronizer, emptying the queue in the process.
+	 * Must be called by the speaker callback (or while it isn't running).
 	 */
 	void reset();
 
@@ -106,7 +189,12 @@ public:
 	 */
 	int getNominalLag() const { return 2; }
 
-	~Resynchronizer();
+	/**
+	 * \return The number of speaker samples (at the speaker's rate) per sample
+	 * passed to addSpeaker(), which compensates for the drift between the
+	 * clocks of the devices. Must be called by the speaker callback.
+	 */
+	double echoRatio() const { return echoStep; }
 
 	bool bDebugPrintQueue = false; ///< Enables printing queue fill level stats
 
@@ -117,10 +205,33 @@ private:
 	 */
 	void printQueue(char who);
 
-	// TODO: there was a mutex (qmEcho), but can the callbacks be called concurrently?
-	mutable std::mutex m;
-	std::list< short * > micQueue;                          ///< Queue of microphone samples
-	enum { S0, S1a, S1b, S2, S3, S4a, S4b, S5 } state = S0; ///< Queue fill control statemachine
+	enum State { S0, S1a, S1b, S2, S3, S4a, S4b, S5 };
+	/// \return The state after a microphone sample has been queued in the given state
+	static State afterMic(State state);
+	/// \return The state after a speaker sample has been matched with a microphone sample in the given state
+	static State afterSpeaker(State state);
+
+	/// Updates the estimated drift with the fill level seen by addSpeaker()
+	void updateDrift(std::size_t level);
+
+	/// At most 5 frames are queued, one is being filled and one is being encoded
+	static constexpr std::size_t MIC_FRAMES = FrameRing::CAPACITY;
+
+	std::vector< short > micFrames;     ///< The memory of all microphone frames
+	std::size_t micFrameSamples = 0;    ///< The number of samples of a microphone frame
+	/// When the samples of each microphone frame (by its index in micFrames) have been captured (see addMic())
+	std::array< quint64, MIC_FRAMES > micCaptured = {};
+	std::vector< short > speakerBuffer; ///< The memory of the speaker frame
+	FrameRing micQueue;                 ///< Queue of microphone samples (filled by addMic(), emptied by addSpeaker())
+	FrameRing freeMic;                  ///< Unused microphone frames (filled by release(), emptied by acquireMic())
+	short *spareMic = nullptr;          ///< A frame dropped by addMic(), which is reused by acquireMic() right away
+	std::atomic< State > state{ S0 };   ///< Queue fill control statemachine
+
+	/// The fill level seen by addSpeaker() (before taking a sample), smoothed over a few seconds
+	double filteredLevel = 2.5;
+	/// The estimated drift of the speaker's clock relative to the microphone's, which is kept across resets
+	double drift    = 0.0;
+	double echoStep = 1.0;
 };
 
 class AudioInputRegistrar {
@@ -172,13 +283,19 @@ private:
 	Q_DISABLE_COPY(AudioInput)
 protected:
 	typedef enum { SampleShort, SampleFloat } SampleFormat;
-	typedef void (*inMixerFunc)(float *RESTRICT, const void *RESTRICT, unsigned int, unsigned int, quint64);
+	typedef AudioKernels::Downmix inMixerFunc;
 
 private:
 	bool bDebugDumpInput;                           ///< When true, dump pcm data to debug the echo canceller
 	std::ofstream outMic, outSpeaker, outProcessed; ///< Files to dump raw pcm data
 
-	SpeexResamplerState *srsMic, *srsEcho;
+	/// Convert the device's rates to iSampleRate (if they differ)
+	std::unique_ptr< AudioResampler > m_micResampler, m_echoResampler;
+	/// Compensates for the drift of the echo's clock (at the echo's rate, ahead of m_echoResampler), see
+	/// Resynchronizer::echoRatio()
+	std::unique_ptr< AudioDriftResampler > m_echoDrift;
+	/// @returns The number of frames (at the echo's rate) the next frame of the echo is resampled from
+	unsigned int echoFramesForFrame() const;
 
 	std::unique_ptr< Mumble::Protocol::byte[] > m_legacyBuffer;
 	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Client > m_udpEncoder;
@@ -186,16 +303,50 @@ private:
 	unsigned int iMicFilled, iEchoFilled;
 	inMixerFunc imfMic, imfEcho;
 	inMixerFunc chooseMixer(const unsigned int nchan, SampleFormat sf, quint64 mask);
-	void resetAudioProcessor();
+
+	/// The graph the frames are processed with. Only the audio thread (i.e. encodeAudioFrame) touches it.
+	std::unique_ptr< AudioProcessingGraph > m_processor;
+	/// A graph that has been built by resetAudioProcessor() but not yet been picked up by the audio thread
+	std::atomic< AudioProcessingGraph * > m_pendingProcessor{ nullptr };
+	/// The graphs the audio thread has replaced (linked via AudioProcessingGraph::nextRetired), which are deleted
+	/// outside of the audio thread
+	std::atomic< AudioProcessingGraph * > m_retiredProcessors{ nullptr };
+	/// Serializes resetAudioProcessor() and protects m_processorConfig
+	QMutex qmProcessorReset;
+	/// The format the graphs are built for, which is known once initializeMixer() has run
+	AudioProcessingGraph::Config m_processorConfig;
+	bool m_processorConfigured = false;
+
+	/// Picks up the graph built by resetAudioProcessor(), if there is one. Called by the audio thread with qmSpeex
+	/// locked.
+	void adoptAudioProcessor();
+	void deleteRetiredProcessors();
 
 	OpusEncoder *opusState;
-	DenoiseState *denoiseState;
 	bool selectCodec();
-	void selectNoiseCancel();
 
 	typedef boost::array< unsigned char, 960 > EncodingOutputBuffer;
 
 	int encodeOpusFrame(short *source, int size, EncodingOutputBuffer &buffer);
+	/// @returns Whether frames shorter than 10 ms may be sent as they are, i.e. one per packet
+	bool smallFramesAllowed() const;
+
+	/// The packet loss (in percent) the encoder has last been configured for (see ServerHandler::m_uplinkLoss)
+	int m_packetLossPercent = 0;
+	/// The payload of the previous packet, which is attached to the next one while packets get lost (see
+	/// Mumble::Protocol::AudioData::redundantPayload). It is empty at the start of a transmission.
+	QByteArray m_previousFrame;
+	/// The frame number the packet following the one in m_previousFrame starts with
+	std::uint64_t m_previousFrameEnd = 0;
+
+	/// When the first samples of the frame addMic() is filling have arrived (see AudioLatency::now())
+	quint64 m_frameCaptured = 0;
+	/// When addMic() has been called last, while an AudioBenchmark is running
+	quint64 m_lastMicCall = 0;
+	/// When the first samples of the oldest frame that is buffered for the next packet have arrived
+	quint64 m_packetCaptured = 0;
+	/// When the last packet has been encoded
+	quint64 m_packetEncoded = 0;
 
 	QElapsedTimer qetLastMuteCue;
 
@@ -208,19 +359,28 @@ protected:
 	unsigned int iMicChannels, iEchoChannels;
 	unsigned int iMicFreq, iEchoFreq;
 	unsigned int iMicLength, iEchoLength;
+	/// The number of frames the device has to deliver for the current frame, which differs from iMicLength (or
+	/// iEchoLength) by a frame at times if it isn't integral
+	unsigned int iMicFrameLength, iEchoFrameLength;
 	unsigned int iMicSampleSize, iEchoSampleSize;
 	unsigned int iEchoMCLength, iEchoFrameSize;
 	quint64 uiMicChannelMask, uiEchoChannelMask;
 
 	bool bEchoMulti;
-	Settings::NoiseCancel noiseCancel;
 	// Standard microphone sample rate (samples/s)
 	static const unsigned int iSampleRate = SAMPLE_RATE;
-	/// Based the sample rate, 48,000 samples/s = 48 samples/ms.
-	/// For each 10 ms, this yields 480 samples. This corresponds numerically with the calculation:
-	/// iFrameSize = 48000 / 100 = 480 samples, allowing a consistent 10ms of audio data per frame.
-	static const int iFrameSize = SAMPLE_RATE / 100;
-
+	/// The number of samples of a regular frame: 48,000 samples/s = 48 samples/ms, which yields 480 samples for
+	/// 10 ms of audio
+	static const int iRegularFrameSize = SAMPLE_RATE / 100;
+	/// The number of samples per frame, which is iRegularFrameSize unless shorter frames (2.5 or 5 ms) have been
+	/// asked for (see Settings::iAudioFrameSize). These are only used without echo cancellation (which is tuned for
+	/// 10 ms frames and whose queue would only hold a few milliseconds of them), and only sent as they are if the
+	/// server passes them on (see ServerHandler::m_smallAudioFrames). Otherwise a packet holds as many of them as it
+	/// would hold regular frames.
+	const int iFrameSize;
+
+	/// Held by the audio thread while it processes a frame. The statistics dialogs lock it to look at the states of
+	/// the graph in use, which are the ones below.
 	QMutex qmSpeex;
 	SpeexPreprocessState *sppPreprocess;
 	SpeexEchoState *sesEcho;
@@ -235,6 +395,8 @@ protected:
 	bool bAllowLowDelay;
 	/// Number of 10ms audio "frames" per packet (!= frames in packet)
 	int iAudioFrames;
+	/// The number of frames (of iFrameSize) the current packet is made of, see iAudioFrames
+	int m_packetFrames = 1;
 
 	/// The minimum time in ms that has to pass between the playback of two consecutive mute cues.
 	static constexpr unsigned int MUTE_CUE_DELAY = 5000;
@@ -245,6 +407,20 @@ protected:
 	Resynchronizer resync;
 	std::vector< short > opusBuffer;
 
+	/// Rings of the last frames (of the microphone and the speakers) that encodeAudioFrame() hasn't processed, which
+	/// are run through the processing before the next frame it does process
+	std::vector< short > m_prerollMic, m_prerollSpeaker;
+	/// The number of frames the rings hold
+	unsigned int m_prerollLength = 0;
+	unsigned int m_prerollFrames = 0;
+	unsigned int m_prerollNext   = 0;
+	/// Until when (see AudioLatency::now()) encodeAudioFrame() processes every frame, see requestProcessing()
+	std::atomic< quint64 > m_processingRequestedUntil{ 0 };
+
+	void keepForPreroll(const AudioChunk &chunk);
+	/// Runs the kept frames through the cleanup stage, discarding what comes out
+	void runPreroll(int noiseSuppression);
+
 	void encodeAudioFrame(AudioChunk chunk);
 	void addMic(const void *data, unsigned int nsamp);
 	void addEcho(const void *data, unsigned int nsamp);
@@ -283,7 +459,10 @@ public:
 
 	ActivityState activityState;
 
-	bool bResetProcessor;
+	/// Builds a new AudioProcessingGraph from the current settings, which the audio thread picks up at the start of
+	/// the next frame. This may be called from any thread, but the building itself shouldn't be done by the audio
+	/// thread while it processes frames.
+	void resetAudioProcessor();
 
 	Timer tIdle;
 
@@ -291,7 +470,8 @@ public:
 	float dPeakSpeaker, dPeakSignal, dMaxMic, dPeakMic, dPeakCleanMic;
 	float fSpeechProb;
 
-	static int getNetworkBandwidth(int bitrate, int frames);
+	/// @param frameSize The number of samples of the frames (see iFrameSize)
+	static int getNetworkBandwidth(int bitrate, int frames, int frameSize = iRegularFrameSize);
 	static void setMaxBandwidth(int bitspersec);
 
 	/// Construct an AudioInput.
@@ -308,6 +488,10 @@ public:
 	void run() Q_DECL_OVERRIDE = 0;
 	virtual bool isAlive() const;
 	bool isTransmitting() const;
+	/// Makes the audio thread process every frame for about a second, even the ones it would otherwise skip as no
+	/// transmission can happen. This is for the dialogs that show the levels of the processed audio, which call this
+	/// whenever they update them.
+	void requestProcessing();
 };
 
 #endif
@@ -0,0 +1,1098 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define AUDIO_KERNELS_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#	if defined(_MSC_VER) && !defined(__clang__)
+#		define AUDIO_TARGET_SSE2
+#		define AUDIO_TARGET_AVX2
+#	else
+#		define AUDIO_TARGET_SSE2 __attribute__((target("sse2")))
+#		define AUDIO_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// NEON is part of every ARMv8 CPU, so there is nothing to check for at runtime
+#	define AUDIO_KERNELS_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace AudioKernels {
+
+namespace {
+/// Mixes the channels of a fixed count, which have already been converted to floats. The channels that aren't in the
+/// mask don't contribute to the mix, and the sum of the others is multiplied by factor.
+typedef void (*FloatMix)(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor);
+
+struct Backend {
+	const char *name;
+	void (*floatToShort)(const float *in, short *out, std::size_t count, float scale);
+	void (*shortToFloat)(const short *in, float *out, std::size_t count, float scale);
+	float (*dot)(const float *a, const float *b, std::size_t count);
+	void (*accumulateRamp)(float *out, const float *in, unsigned int count, float start, float increment);
+	void (*accumulateStereoRamp)(float *out, const float *in, unsigned int count, float start, float increment);
+	void (*accumulatePanned)(float *out, const float *in, unsigned int count, float left, float right, float volume);
+	/// Interleaves two planes, which is what stereo output devices need (other channel counts aren't accelerated)
+	void (*interleave2)(const float *planes, float *out, unsigned int count);
+	void (*clip)(float *samples, std::size_t count);
+	/// For 1, 2, 4 and 8 channels
+	std::array< FloatMix, 4 > mix;
+};
+
+/// The number of frames that are converted to floats at once when mixing 16-bit PCM
+constexpr unsigned int SHORT_BLOCK_FRAMES = 64;
+
+constexpr unsigned int mixIndex(unsigned int channels) {
+	return channels == 1 ? 0 : channels == 2 ? 1 : channels == 4 ? 2 : 3;
+}
+
+/// @returns The number of channels that are in the mix
+unsigned int mixedChannels(unsigned int channels, quint64 mask) {
+	if (mask == ~0ULL) {
+		return channels;
+	}
+
+	unsigned int count = 0;
+	for (unsigned int j = 0; j < std::min(channels, 64U); ++j) {
+		if ((mask & (1ULL << j)) != 0) {
+			++count;
+		}
+	}
+	return count;
+}
+
+bool isMixed(quint64 mask, unsigned int channel) {
+	return (mask & (1ULL << channel)) != 0;
+}
+
+template< typename T > constexpr float fullScale();
+template<> constexpr float fullScale< float >() {
+	return 1.0f;
+}
+template<> constexpr float fullScale< short >() {
+	return 32768.f;
+}
+
+void floatToShortScalar(const float *in, short *out, std::size_t count, float scale) {
+	for (std::size_t i = 0; i < count; ++i) {
+		out[i] = static_cast< short >(qBound(-32768.f, in[i] * scale, 32767.f));
+	}
+}
+
+void shortToFloatScalar(const short *in, float *out, std::size_t count, float scale) {
+	for (std::size_t i = 0; i < count; ++i) {
+		out[i] = static_cast< float >(in[i]) * scale;
+	}
+}
+
+float dotScalar(const float *a, const float *b, std::size_t count) {
+	float sum = 0.0f;
+	for (std::size_t i = 0; i < count; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+void accumulateRampScalar(float *out, const float *in, unsigned int begin, unsigned int count, float start,
+						  float increment) {
+	for (unsigned int i = begin; i < count; ++i) {
+		out[i] += in[i] * (start + increment * static_cast< float >(i));
+	}
+}
+
+void accumulateStereoRampScalar(float *out, const float *in, unsigned int begin, unsigned int count, float start,
+								float increment) {
+	for (unsigned int i = begin; i < count; ++i) {
+		out[i] += (in[2 * i] / 2.0f + in[2 * i + 1] / 2.0f) * (start + increment * static_cast< float >(i));
+	}
+}
+
+void accumulatePannedScalar(float *out, const float *in, unsigned int begin, unsigned int count, float left,
+							float right, float volume) {
+	for (unsigned int i = begin; i < count; ++i) {
+		out[i] += (in[2 * i] * left + in[2 * i + 1] * right) * volume;
+	}
+}
+
+void interleaveScalar(const float *planes, float *out, unsigned int begin, unsigned int channels,
+					  unsigned int count) {
+	for (unsigned int i = begin; i < count; ++i) {
+		for (unsigned int c = 0; c < channels; ++c) {
+			out[i * channels + c] = planes[c * count + i];
+		}
+	}
+}
+
+void clipScalar(float *samples, std::size_t count) {
+	for (std::size_t i = 0; i < count; ++i) {
+		samples[i] = qBound(-1.0f, samples[i], 1.0f);
+	}
+}
+
+// The entries of the backends, which start at the beginning of the samples
+void accumulateRampAll(float *out, const float *in, unsigned int count, float start, float increment) {
+	accumulateRampScalar(out, in, 0, count, start, increment);
+}
+
+void accumulateStereoRampAll(float *out, const float *in, unsigned int count, float start, float increment) {
+	accumulateStereoRampScalar(out, in, 0, count, start, increment);
+}
+
+void accumulatePannedAll(float *out, const float *in, unsigned int count, float left, float right, float volume) {
+	accumulatePannedScalar(out, in, 0, count, left, right, volume);
+}
+
+void interleave2Scalar(const float *planes, float *out, unsigned int count) {
+	interleaveScalar(planes, out, 0, 2, count);
+}
+
+template< unsigned int C > void mixScalar(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	for (unsigned int i = 0; i < nsamp; ++i) {
+		float v = 0.0f;
+		for (unsigned int j = 0; j < C; ++j) {
+			if (isMixed(mask, j)) {
+				v += in[i * C + j];
+			}
+		}
+		out[i] = v * factor;
+	}
+}
+
+const Backend SCALAR_BACKEND = { "Scalar",
+								 floatToShortScalar,
+								 shortToFloatScalar,
+								 dotScalar,
+								 accumulateRampAll,
+								 accumulateStereoRampAll,
+								 accumulatePannedAll,
+								 interleave2Scalar,
+								 clipScalar,
+								 { mixScalar< 1 >, mixScalar< 2 >, mixScalar< 4 >, mixScalar< 8 > } };
+
+#if defined(AUDIO_KERNELS_X86)
+AUDIO_TARGET_SSE2 void floatToShortSSE2(const float *in, short *out, std::size_t count, float scale) {
+	const __m128 factor = _mm_set1_ps(scale);
+	const __m128 lower  = _mm_set1_ps(-32768.f);
+	const __m128 upper  = _mm_set1_ps(32767.f);
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		// The operands are in the same order as in qBound, so that NaNs end up the same as well
+		const __m128 a = _mm_max_ps(_mm_min_ps(upper, _mm_mul_ps(_mm_loadu_ps(in + i), factor)), lower);
+		const __m128 b = _mm_max_ps(_mm_min_ps(upper, _mm_mul_ps(_mm_loadu_ps(in + i + 4), factor)), lower);
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(out + i),
+						 _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+	}
+	floatToShortScalar(in + i, out + i, count - i, scale);
+}
+
+AUDIO_TARGET_SSE2 void shortToFloatSSE2(const short *in, float *out, std::size_t count, float scale) {
+	const __m128 factor = _mm_set1_ps(scale);
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast< const __m128i * >(in + i));
+		// Sign-extend by moving every sample into the upper half of a 32-bit lane
+		const __m128i low  = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), factor));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), factor));
+	}
+	shortToFloatScalar(in + i, out + i, count - i, scale);
+}
+
+AUDIO_TARGET_SSE2 float dotSSE2(const float *a, const float *b, std::size_t count) {
+	__m128 sum = _mm_setzero_ps();
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+
+	// Add up the lanes
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(sum) + dotScalar(a + i, b + i, count - i);
+}
+
+/// @returns The gains of the four samples starting at the given index (computed the same way as by the scalar code)
+AUDIO_TARGET_SSE2 inline __m128 rampSSE2(__m128 start, __m128 increment, unsigned int i) {
+	const __m128 index = _mm_add_ps(_mm_set1_ps(static_cast< float >(i)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	return _mm_add_ps(start, _mm_mul_ps(increment, index));
+}
+
+AUDIO_TARGET_SSE2 void accumulateRampSSE2(float *out, const float *in, unsigned int count, float start,
+										  float increment) {
+	const __m128 s   = _mm_set1_ps(start);
+	const __m128 inc = _mm_set1_ps(increment);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 weighted = _mm_mul_ps(_mm_loadu_ps(in + i), rampSSE2(s, inc, i));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), weighted));
+	}
+	accumulateRampScalar(out, in, i, count, start, increment);
+}
+
+AUDIO_TARGET_SSE2 void accumulateStereoRampSSE2(float *out, const float *in, unsigned int count, float start,
+												float increment) {
+	const __m128 s    = _mm_set1_ps(start);
+	const __m128 inc  = _mm_set1_ps(increment);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 a     = _mm_loadu_ps(in + i * 2);
+		const __m128 b     = _mm_loadu_ps(in + i * 2 + 4);
+		const __m128 left  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128 mean  = _mm_add_ps(_mm_mul_ps(left, half), _mm_mul_ps(right, half));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(mean, rampSSE2(s, inc, i))));
+	}
+	accumulateStereoRampScalar(out, in, i, count, start, increment);
+}
+
+AUDIO_TARGET_SSE2 void accumulatePannedSSE2(float *out, const float *in, unsigned int count, float left, float right,
+											float volume) {
+	const __m128 l = _mm_set1_ps(left);
+	const __m128 r = _mm_set1_ps(right);
+	const __m128 v = _mm_set1_ps(volume);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 a      = _mm_loadu_ps(in + i * 2);
+		const __m128 b      = _mm_loadu_ps(in + i * 2 + 4);
+		const __m128 panned = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), l),
+										 _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), r));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(panned, v)));
+	}
+	accumulatePannedScalar(out, in, i, count, left, right, volume);
+}
+
+AUDIO_TARGET_SSE2 void interleave2SSE2(const float *planes, float *out, unsigned int count) {
+	const float *left  = planes;
+	const float *right = planes + count;
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 l = _mm_loadu_ps(left + i);
+		const __m128 r = _mm_loadu_ps(right + i);
+		_mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+	}
+	interleaveScalar(planes, out, i, 2, count);
+}
+
+AUDIO_TARGET_SSE2 void clipSSE2(float *samples, std::size_t count) {
+	const __m128 lower = _mm_set1_ps(-1.0f);
+	const __m128 upper = _mm_set1_ps(1.0f);
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(samples + i, _mm_max_ps(_mm_min_ps(upper, _mm_loadu_ps(samples + i)), lower));
+	}
+	clipScalar(samples + i, count - i);
+}
+
+/// @returns The lanes of four consecutive channels (all bits set if the channel is in the mix)
+AUDIO_TARGET_SSE2 __m128 lanesSSE2(quint64 mask, unsigned int c0, unsigned int c1, unsigned int c2, unsigned int c3) {
+	return _mm_castsi128_ps(_mm_setr_epi32(isMixed(mask, c0) ? -1 : 0, isMixed(mask, c1) ? -1 : 0,
+										   isMixed(mask, c2) ? -1 : 0, isMixed(mask, c3) ? -1 : 0));
+}
+
+/// Adds four channels of four frames (one per vector) to the sums of these frames, in the order of the channels
+AUDIO_TARGET_SSE2 inline __m128 accumulateSSE2(__m128 sum, __m128 r0, __m128 r1, __m128 r2, __m128 r3) {
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(sum, r0), r1), r2), r3);
+}
+
+AUDIO_TARGET_SSE2 void mix1SSE2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m128 f = _mm_set1_ps(factor);
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), f));
+	}
+	mixScalar< 1 >(out + i, in + i, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_SSE2 void mix2SSE2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m128 f     = _mm_set1_ps(factor);
+	const __m128 lanes = lanesSSE2(mask, 0, 1, 0, 1);
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		const __m128 a     = _mm_and_ps(_mm_loadu_ps(in + i * 2), lanes);
+		const __m128 b     = _mm_and_ps(_mm_loadu_ps(in + i * 2 + 4), lanes);
+		const __m128 left  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), f));
+	}
+	mixScalar< 2 >(out + i, in + i * 2, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_SSE2 void mix4SSE2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m128 f     = _mm_set1_ps(factor);
+	const __m128 lanes = lanesSSE2(mask, 0, 1, 2, 3);
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		const float *frames = in + i * 4;
+		const __m128 sum    = accumulateSSE2(
+			   _mm_setzero_ps(), _mm_and_ps(_mm_loadu_ps(frames), lanes), _mm_and_ps(_mm_loadu_ps(frames + 4), lanes),
+			   _mm_and_ps(_mm_loadu_ps(frames + 8), lanes), _mm_and_ps(_mm_loadu_ps(frames + 12), lanes));
+		_mm_storeu_ps(out + i, _mm_mul_ps(sum, f));
+	}
+	mixScalar< 4 >(out + i, in + i * 4, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_SSE2 void mix8SSE2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m128 f    = _mm_set1_ps(factor);
+	const __m128 low  = lanesSSE2(mask, 0, 1, 2, 3);
+	const __m128 high = lanesSSE2(mask, 4, 5, 6, 7);
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		const float *frames = in + i * 8;
+		__m128 sum = accumulateSSE2(_mm_setzero_ps(), _mm_and_ps(_mm_loadu_ps(frames), low),
+									_mm_and_ps(_mm_loadu_ps(frames + 8), low),
+									_mm_and_ps(_mm_loadu_ps(frames + 16), low),
+									_mm_and_ps(_mm_loadu_ps(frames + 24), low));
+		sum        = accumulateSSE2(sum, _mm_and_ps(_mm_loadu_ps(frames + 4), high),
+									_mm_and_ps(_mm_loadu_ps(frames + 12), high),
+									_mm_and_ps(_mm_loadu_ps(frames + 20), high),
+									_mm_and_ps(_mm_loadu_ps(frames + 28), high));
+		_mm_storeu_ps(out + i, _mm_mul_ps(sum, f));
+	}
+	mixScalar< 8 >(out + i, in + i * 8, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_AVX2 void floatToShortAVX2(const float *in, short *out, std::size_t count, float scale) {
+	const __m256 factor = _mm256_set1_ps(scale);
+	const __m256 lower  = _mm256_set1_ps(-32768.f);
+	const __m256 upper  = _mm256_set1_ps(32767.f);
+
+	std::size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256 a = _mm256_max_ps(_mm256_min_ps(upper, _mm256_mul_ps(_mm256_loadu_ps(in + i), factor)), lower);
+		const __m256 b = _mm256_max_ps(_mm256_min_ps(upper, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), factor)), lower);
+		// Packing works within the 128-bit halves, which leaves the quarters in the order a0 b0 a1 b1
+		const __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(out + i),
+							_mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	// The SSE2 code takes care of the rest. It uses the legacy encoding of the instructions, which is slow while the
+	// upper halves of the YMM registers are in use.
+	_mm256_zeroupper();
+	floatToShortSSE2(in + i, out + i, count - i, scale);
+}
+
+AUDIO_TARGET_AVX2 void shortToFloatAVX2(const short *in, float *out, std::size_t count, float scale) {
+	const __m256 factor = _mm256_set1_ps(scale);
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< const __m128i * >(in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), factor));
+	}
+	_mm256_zeroupper();
+	shortToFloatSSE2(in + i, out + i, count - i, scale);
+}
+
+AUDIO_TARGET_AVX2 float dotAVX2(const float *a, const float *b, std::size_t count) {
+	__m256 sum = _mm256_setzero_ps();
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+
+	__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half        = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half        = _mm_add_ss(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 1, 1, 1)));
+
+	const float total = _mm_cvtss_f32(half);
+	_mm256_zeroupper();
+	return total + dotSSE2(a + i, b + i, count - i);
+}
+
+AUDIO_TARGET_AVX2 inline __m256 rampAVX2(__m256 start, __m256 increment, unsigned int i) {
+	const __m256 index = _mm256_add_ps(_mm256_set1_ps(static_cast< float >(i)),
+									   _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+	return _mm256_add_ps(start, _mm256_mul_ps(increment, index));
+}
+
+/// @returns The left (or right) channels of the eight stereo frames starting at in, in the order of the frames
+AUDIO_TARGET_AVX2 inline __m256 channelAVX2(const float *in, bool right) {
+	const __m256 a = _mm256_loadu_ps(in);
+	const __m256 b = _mm256_loadu_ps(in + 8);
+	// Shuffling works within the 128-bit halves, which leaves the pairs of frames in the order 0 2 1 3
+	const __m256 shuffled = right ? _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))
+								  : _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(shuffled), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+AUDIO_TARGET_AVX2 void accumulateRampAVX2(float *out, const float *in, unsigned int count, float start,
+										  float increment) {
+	const __m256 s   = _mm256_set1_ps(start);
+	const __m256 inc = _mm256_set1_ps(increment);
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 weighted = _mm256_mul_ps(_mm256_loadu_ps(in + i), rampAVX2(s, inc, i));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), weighted));
+	}
+	_mm256_zeroupper();
+	accumulateRampScalar(out, in, i, count, start, increment);
+}
+
+AUDIO_TARGET_AVX2 void accumulateStereoRampAVX2(float *out, const float *in, unsigned int count, float start,
+												float increment) {
+	const __m256 s    = _mm256_set1_ps(start);
+	const __m256 inc  = _mm256_set1_ps(increment);
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 mean = _mm256_add_ps(_mm256_mul_ps(channelAVX2(in + i * 2, false), half),
+										  _mm256_mul_ps(channelAVX2(in + i * 2, true), half));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(mean, rampAVX2(s, inc, i))));
+	}
+	_mm256_zeroupper();
+	accumulateStereoRampScalar(out, in, i, count, start, increment);
+}
+
+AUDIO_TARGET_AVX2 void accumulatePannedAVX2(float *out, const float *in, unsigned int count, float left, float right,
+											float volume) {
+	const __m256 l = _mm256_set1_ps(left);
+	const __m256 r = _mm256_set1_ps(right);
+	const __m256 v = _mm256_set1_ps(volume);
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 panned = _mm256_add_ps(_mm256_mul_ps(channelAVX2(in + i * 2, false), l),
+											_mm256_mul_ps(channelAVX2(in + i * 2, true), r));
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(panned, v)));
+	}
+	_mm256_zeroupper();
+	accumulatePannedScalar(out, in, i, count, left, right, volume);
+}
+
+AUDIO_TARGET_AVX2 void interleave2AVX2(const float *planes, float *out, unsigned int count) {
+	const float *left  = planes;
+	const float *right = planes + count;
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 l = _mm256_loadu_ps(left + i);
+		const __m256 r = _mm256_loadu_ps(right + i);
+		// Unpacking works within the 128-bit halves, which leaves frames 0-1 and 4-5 in low, 2-3 and 6-7 in high
+		const __m256 low  = _mm256_unpacklo_ps(l, r);
+		const __m256 high = _mm256_unpackhi_ps(l, r);
+		_mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(low, high, 0x20));
+		_mm256_storeu_ps(out + i * 2 + 8, _mm256_permute2f128_ps(low, high, 0x31));
+	}
+	_mm256_zeroupper();
+	interleaveScalar(planes, out, i, 2, count);
+}
+
+AUDIO_TARGET_AVX2 void clipAVX2(float *samples, std::size_t count) {
+	const __m256 lower = _mm256_set1_ps(-1.0f);
+	const __m256 upper = _mm256_set1_ps(1.0f);
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(samples + i, _mm256_max_ps(_mm256_min_ps(upper, _mm256_loadu_ps(samples + i)), lower));
+	}
+	_mm256_zeroupper();
+	clipSSE2(samples + i, count - i);
+}
+
+AUDIO_TARGET_AVX2 __m256 lanesAVX2(quint64 mask, unsigned int c0, unsigned int c1, unsigned int c2, unsigned int c3) {
+	const int l0 = isMixed(mask, c0) ? -1 : 0;
+	const int l1 = isMixed(mask, c1) ? -1 : 0;
+	const int l2 = isMixed(mask, c2) ? -1 : 0;
+	const int l3 = isMixed(mask, c3) ? -1 : 0;
+	return _mm256_castsi256_ps(_mm256_setr_epi32(l0, l1, l2, l3, l0, l1, l2, l3));
+}
+
+/// @returns The four channels at the given offsets of frames i and i + 4 (in the lower and upper half)
+AUDIO_TARGET_AVX2 inline __m256 loadFramesAVX2(const float *frames, unsigned int stride, unsigned int i) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(frames + i * stride)),
+								_mm_loadu_ps(frames + (i + 4) * stride), 1);
+}
+
+/// The equivalent of accumulateSSE2 for eight frames, where the lower halves hold the first four of them
+AUDIO_TARGET_AVX2 inline __m256 accumulateAVX2(__m256 sum, __m256 r0, __m256 r1, __m256 r2, __m256 r3) {
+	const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+	const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+	const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+	const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+	sum = _mm256_add_ps(sum, _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)));
+	sum = _mm256_add_ps(sum, _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)));
+	sum = _mm256_add_ps(sum, _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)));
+	return _mm256_add_ps(sum, _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)));
+}
+
+AUDIO_TARGET_AVX2 void mix1AVX2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m256 f = _mm256_set1_ps(factor);
+
+	unsigned int i = 0;
+	for (; i + 8 <= nsamp; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), f));
+	}
+	_mm256_zeroupper();
+	mix1SSE2(out + i, in + i, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_AVX2 void mix2AVX2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m256 f     = _mm256_set1_ps(factor);
+	const __m256 lanes = lanesAVX2(mask, 0, 1, 0, 1);
+
+	unsigned int i = 0;
+	for (; i + 8 <= nsamp; i += 8) {
+		const __m256 a = _mm256_and_ps(_mm256_loadu_ps(in + i * 2), lanes);
+		const __m256 b = _mm256_and_ps(_mm256_loadu_ps(in + i * 2 + 8), lanes);
+		// Shuffling works within the 128-bit halves, which leaves the pairs of frames in the order 0 2 1 3
+		const __m256 sum = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+										 _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		const __m256 ordered =
+			_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(ordered, f));
+	}
+	_mm256_zeroupper();
+	mix2SSE2(out + i, in + i * 2, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_AVX2 void mix4AVX2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m256 f     = _mm256_set1_ps(factor);
+	const __m256 lanes = lanesAVX2(mask, 0, 1, 2, 3);
+
+	unsigned int i = 0;
+	for (; i + 8 <= nsamp; i += 8) {
+		const float *frames = in + i * 4;
+		const __m256 sum    = accumulateAVX2(_mm256_setzero_ps(), _mm256_and_ps(loadFramesAVX2(frames, 4, 0), lanes),
+											 _mm256_and_ps(loadFramesAVX2(frames, 4, 1), lanes),
+											 _mm256_and_ps(loadFramesAVX2(frames, 4, 2), lanes),
+											 _mm256_and_ps(loadFramesAVX2(frames, 4, 3), lanes));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, f));
+	}
+	_mm256_zeroupper();
+	mix4SSE2(out + i, in + i * 4, nsamp - i, mask, factor);
+}
+
+AUDIO_TARGET_AVX2 void mix8AVX2(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const __m256 f    = _mm256_set1_ps(factor);
+	const __m256 low  = lanesAVX2(mask, 0, 1, 2, 3);
+	const __m256 high = lanesAVX2(mask, 4, 5, 6, 7);
+
+	unsigned int i = 0;
+	for (; i + 8 <= nsamp; i += 8) {
+		const float *frames = in + i * 8;
+		__m256 sum = accumulateAVX2(_mm256_setzero_ps(), _mm256_and_ps(loadFramesAVX2(frames, 8, 0), low),
+									_mm256_and_ps(loadFramesAVX2(frames, 8, 1), low),
+									_mm256_and_ps(loadFramesAVX2(frames, 8, 2), low),
+									_mm256_and_ps(loadFramesAVX2(frames, 8, 3), low));
+		sum        = accumulateAVX2(sum, _mm256_and_ps(loadFramesAVX2(frames + 4, 8, 0), high),
+									_mm256_and_ps(loadFramesAVX2(frames + 4, 8, 1), high),
+									_mm256_and_ps(loadFramesAVX2(frames + 4, 8, 2), high),
+									_mm256_and_ps(loadFramesAVX2(frames + 4, 8, 3), high));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(sum, f));
+	}
+	_mm256_zeroupper();
+	mix8SSE2(out + i, in + i * 8, nsamp - i, mask, factor);
+}
+
+void cpuid(unsigned int leaf, unsigned int (&registers)[4]) {
+#	ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, static_cast< int >(leaf), 0);
+	for (unsigned int i = 0; i < 4; ++i) {
+		registers[i] = static_cast< unsigned int >(info[i]);
+	}
+#	else
+	__cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+#	endif
+}
+
+unsigned int highestLeaf() {
+#	ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	return static_cast< unsigned int >(info[0]);
+#	else
+	return __get_cpuid_max(0, nullptr);
+#	endif
+}
+
+bool cpuSupportsSSE2() {
+	if (highestLeaf() < 1) {
+		return false;
+	}
+
+	unsigned int registers[4];
+	cpuid(1, registers);
+	// CPUID.1:EDX.SSE2[bit 26]
+	return (registers[3] & (1U << 26)) != 0;
+}
+
+bool cpuSupportsAVX2() {
+	if (highestLeaf() < 7) {
+		return false;
+	}
+
+	unsigned int registers[4];
+	cpuid(1, registers);
+	// CPUID.1:ECX.OSXSAVE[bit 27] and CPUID.1:ECX.AVX[bit 28]
+	if ((registers[2] & (3U << 27)) != (3U << 27)) {
+		return false;
+	}
+
+	// The OS has to save the upper halves of the YMM registers (XCR0 bits 1 and 2) when switching between threads
+#	ifdef _MSC_VER
+	const unsigned long long xcr0 = _xgetbv(0);
+#	else
+	unsigned int xcr0Low, xcr0High;
+	__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+	const unsigned long long xcr0 = xcr0Low | (static_cast< unsigned long long >(xcr0High) << 32);
+#	endif
+	if ((xcr0 & 0x6) != 0x6) {
+		return false;
+	}
+
+	cpuid(7, registers);
+	// CPUID.7:EBX.AVX2[bit 5]
+	return (registers[1] & (1U << 5)) != 0;
+}
+
+const Backend SSE2_BACKEND = { "SSE2",
+							   floatToShortSSE2,
+							   shortToFloatSSE2,
+							   dotSSE2,
+							   accumulateRampSSE2,
+							   accumulateStereoRampSSE2,
+							   accumulatePannedSSE2,
+							   interleave2SSE2,
+							   clipSSE2,
+							   { mix1SSE2, mix2SSE2, mix4SSE2, mix8SSE2 } };
+
+const Backend AVX2_BACKEND = { "AVX2",
+							   floatToShortAVX2,
+							   shortToFloatAVX2,
+							   dotAVX2,
+							   accumulateRampAVX2,
+							   accumulateStereoRampAVX2,
+							   accumulatePannedAVX2,
+							   interleave2AVX2,
+							   clipAVX2,
+							   { mix1AVX2, mix2AVX2, mix4AVX2, mix8AVX2 } };
+#elif defined(AUDIO_KERNELS_NEON)
+void floatToShortNEON(const float *in, short *out, std::size_t count, float scale) {
+	const float32x4_t lower = vdupq_n_f32(-32768.f);
+	const float32x4_t upper = vdupq_n_f32(32767.f);
+
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const float32x4_t a = vmaxq_f32(vminq_f32(vmulq_n_f32(vld1q_f32(in + i), scale), upper), lower);
+		const float32x4_t b = vmaxq_f32(vminq_f32(vmulq_n_f32(vld1q_f32(in + i + 4), scale), upper), lower);
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+	}
+	floatToShortScalar(in + i, out + i, count - i, scale);
+}
+
+void shortToFloatNEON(const short *in, float *out, std::size_t count, float scale) {
+	std::size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int16x8_t samples = vld1q_s16(in + i);
+		vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))), scale));
+		vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))), scale));
+	}
+	shortToFloatScalar(in + i, out + i, count - i, scale);
+}
+
+float dotNEON(const float *a, const float *b, std::size_t count) {
+	float32x4_t sum = vdupq_n_f32(0.0f);
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum = vmlaq_f32(sum, vld1q_f32(a + i), vld1q_f32(b + i));
+	}
+	return vaddvq_f32(sum) + dotScalar(a + i, b + i, count - i);
+}
+
+inline float32x4_t rampNEON(float32x4_t start, float increment, unsigned int i) {
+	const float offsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	const float32x4_t index = vaddq_f32(vdupq_n_f32(static_cast< float >(i)), vld1q_f32(offsets));
+	return vaddq_f32(start, vmulq_n_f32(index, increment));
+}
+
+void accumulateRampNEON(float *out, const float *in, unsigned int count, float start, float increment) {
+	const float32x4_t s = vdupq_n_f32(start);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float32x4_t weighted = vmulq_f32(vld1q_f32(in + i), rampNEON(s, increment, i));
+		vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), weighted));
+	}
+	accumulateRampScalar(out, in, i, count, start, increment);
+}
+
+void accumulateStereoRampNEON(float *out, const float *in, unsigned int count, float start, float increment) {
+	const float32x4_t s = vdupq_n_f32(start);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float32x4x2_t frames = vld2q_f32(in + i * 2);
+		const float32x4_t mean     = vaddq_f32(vmulq_n_f32(frames.val[0], 0.5f), vmulq_n_f32(frames.val[1], 0.5f));
+		vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vmulq_f32(mean, rampNEON(s, increment, i))));
+	}
+	accumulateStereoRampScalar(out, in, i, count, start, increment);
+}
+
+void accumulatePannedNEON(float *out, const float *in, unsigned int count, float left, float right, float volume) {
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float32x4x2_t frames = vld2q_f32(in + i * 2);
+		const float32x4_t panned   = vaddq_f32(vmulq_n_f32(frames.val[0], left), vmulq_n_f32(frames.val[1], right));
+		vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vmulq_n_f32(panned, volume)));
+	}
+	accumulatePannedScalar(out, in, i, count, left, right, volume);
+}
+
+void interleave2NEON(const float *planes, float *out, unsigned int count) {
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float32x4x2_t frames;
+		frames.val[0] = vld1q_f32(planes + i);
+		frames.val[1] = vld1q_f32(planes + count + i);
+		vst2q_f32(out + i * 2, frames);
+	}
+	interleaveScalar(planes, out, i, 2, count);
+}
+
+void clipNEON(float *samples, std::size_t count) {
+	const float32x4_t lower = vdupq_n_f32(-1.0f);
+	const float32x4_t upper = vdupq_n_f32(1.0f);
+
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(samples + i, vmaxq_f32(vminq_f32(vld1q_f32(samples + i), upper), lower));
+	}
+	clipScalar(samples + i, count - i);
+}
+
+uint32x4_t lanesNEON(quint64 mask, unsigned int c0, unsigned int c1) {
+	const std::uint32_t lanes[4] = { isMixed(mask, c0) ? ~0U : 0U, isMixed(mask, c1) ? ~0U : 0U,
+									 isMixed(mask, c0) ? ~0U : 0U, isMixed(mask, c1) ? ~0U : 0U };
+	return vld1q_u32(lanes);
+}
+
+inline float32x4_t maskNEON(float32x4_t samples, uint32x4_t lanes) {
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(samples), lanes));
+}
+
+void mix1NEON(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), factor));
+	}
+	mixScalar< 1 >(out + i, in + i, nsamp - i, mask, factor);
+}
+
+void mix2NEON(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	const uint32x4_t left  = lanesNEON(mask, 0, 0);
+	const uint32x4_t right = lanesNEON(mask, 1, 1);
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		// The structure loads separate the channels
+		const float32x4x2_t frames = vld2q_f32(in + i * 2);
+		const float32x4_t sum      = vaddq_f32(maskNEON(frames.val[0], left), maskNEON(frames.val[1], right));
+		vst1q_f32(out + i, vmulq_n_f32(sum, factor));
+	}
+	mixScalar< 2 >(out + i, in + i * 2, nsamp - i, mask, factor);
+}
+
+void mix4NEON(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	uint32x4_t lanes[4];
+	for (unsigned int j = 0; j < 4; ++j) {
+		lanes[j] = lanesNEON(mask, j, j);
+	}
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		const float32x4x4_t frames = vld4q_f32(in + i * 4);
+		float32x4_t sum            = vdupq_n_f32(0.0f);
+		for (unsigned int j = 0; j < 4; ++j) {
+			sum = vaddq_f32(sum, maskNEON(frames.val[j], lanes[j]));
+		}
+		vst1q_f32(out + i, vmulq_n_f32(sum, factor));
+	}
+	mixScalar< 4 >(out + i, in + i * 4, nsamp - i, mask, factor);
+}
+
+void mix8NEON(float *out, const float *in, unsigned int nsamp, quint64 mask, float factor) {
+	// Loading eight channels with a stride of four puts channels j and j + 4 of two frames into every vector
+	uint32x4_t lanes[4];
+	for (unsigned int j = 0; j < 4; ++j) {
+		lanes[j] = lanesNEON(mask, j, j + 4);
+	}
+
+	unsigned int i = 0;
+	for (; i + 4 <= nsamp; i += 4) {
+		float32x4_t halves[2];
+		for (unsigned int k = 0; k < 2; ++k) {
+			const float32x4x4_t frames = vld4q_f32(in + (i + k * 2) * 8);
+			halves[k]                  = vdupq_n_f32(0.0f);
+			for (unsigned int j = 0; j < 4; ++j) {
+				halves[k] = vaddq_f32(halves[k], maskNEON(frames.val[j], lanes[j]));
+			}
+		}
+		vst1q_f32(out + i, vmulq_n_f32(vpaddq_f32(halves[0], halves[1]), factor));
+	}
+	mixScalar< 8 >(out + i, in + i * 8, nsamp - i, mask, factor);
+}
+
+const Backend NEON_BACKEND = { "NEON",
+							   floatToShortNEON,
+							   shortToFloatNEON,
+							   dotNEON,
+							   accumulateRampNEON,
+							   accumulateStereoRampNEON,
+							   accumulatePannedNEON,
+							   interleave2NEON,
+							   clipNEON,
+							   { mix1NEON, mix2NEON, mix4NEON, mix8NEON } };
+#endif
+
+const Backend *detectBackend() {
+#if defined(AUDIO_KERNELS_X86)
+	if (cpuSupportsAVX2()) {
+		return &AVX2_BACKEND;
+	}
+	if (cpuSupportsSSE2()) {
+		return &SSE2_BACKEND;
+	}
+#elif defined(AUDIO_KERNELS_NEON)
+	return &NEON_BACKEND;
+#endif
+	return &SCALAR_BACKEND;
+}
+
+const Backend *backend() {
+	static const Backend *instance = detectBackend();
+	return instance;
+}
+
+void mixFrames(const Backend *kernels, unsigned int channels, float *out, const float *in, unsigned int nsamp,
+			   quint64 mask) {
+	kernels->mix[mixIndex(channels)](out, in, nsamp, mask, 1.0f / static_cast< float >(mixedChannels(channels, mask)));
+}
+
+void mixFrames(const Backend *kernels, unsigned int channels, float *out, const short *in, unsigned int nsamp,
+			   quint64 mask) {
+	const float factor = 1.0f / (32768.f * static_cast< float >(mixedChannels(channels, mask)));
+
+	// The samples are summed up as integral floats, which is why the result is the same as the one of mixing the
+	// shorts directly
+	std::array< float, SHORT_BLOCK_FRAMES * 8 > block;
+	for (unsigned int i = 0; i < nsamp; i += SHORT_BLOCK_FRAMES) {
+		const unsigned int frames = std::min(nsamp - i, SHORT_BLOCK_FRAMES);
+		kernels->shortToFloat(in + i * channels, block.data(), frames * channels, 1.0f);
+		kernels->mix[mixIndex(channels)](out + i, block.data(), frames, mask, factor);
+	}
+}
+
+/// Mixes the channels of a count that is accelerated
+template< bool SCALAR, typename T, unsigned int C >
+void mixAccelerated(float *out, const void *in, unsigned int nsamp, unsigned int, quint64 mask) {
+	mixFrames(SCALAR ? &SCALAR_BACKEND : backend(), C, out, static_cast< const T * >(in), nsamp, mask);
+}
+
+/// Mixes all channels of a count that isn't accelerated (or isn't known at compile time if C is 0)
+template< typename T, unsigned int C >
+void mixAll(float *out, const void *in, unsigned int nsamp, unsigned int N, quint64) {
+	const T *samples            = static_cast< const T * >(in);
+	const unsigned int channels = C != 0 ? C : N;
+	const float factor          = 1.0f / (fullScale< T >() * static_cast< float >(channels));
+
+	for (unsigned int i = 0; i < nsamp; ++i) {
+		float v = 0.0f;
+		for (unsigned int j = 0; j < channels; ++j) {
+			v += static_cast< float >(samples[i * channels + j]);
+		}
+		out[i] = v * factor;
+	}
+}
+
+/// Mixes the channels in the mask (out of a count that isn't accelerated)
+template< typename T > void mixMasked(float *out, const void *in, unsigned int nsamp, unsigned int N, quint64 mask) {
+	const T *samples = static_cast< const T * >(in);
+
+	// The mask only covers the first 64 channels. The indices are kept on the stack, as this is called by the
+	// real-time audio callback.
+	unsigned int chancount = 0;
+	std::array< unsigned int, 64 > chanindex;
+	for (unsigned int j = 0; j < std::min(N, static_cast< unsigned int >(chanindex.size())); ++j) {
+		if (isMixed(mask, j)) {
+			chanindex[chancount] = j; // Use chancount as index into chanindex.
+			++chancount;
+		}
+	}
+
+	const float factor = 1.0f / (fullScale< T >() * static_cast< float >(chancount));
+	for (unsigned int i = 0; i < nsamp; ++i) {
+		float v = 0.0f;
+		for (unsigned int j = 0; j < chancount; ++j) {
+			v += static_cast< float >(samples[i * N + chanindex[j]]);
+		}
+		out[i] = v * factor;
+	}
+}
+
+void mixNothing(float *out, const void *, unsigned int nsamp, unsigned int, quint64) {
+	std::fill(out, out + nsamp, 0.0f);
+}
+
+template< bool SCALAR, typename T > Downmix accelerated(unsigned int channels) {
+	switch (channels) {
+		case 1:
+			return mixAccelerated< SCALAR, T, 1 >;
+		case 2:
+			return mixAccelerated< SCALAR, T, 2 >;
+		case 4:
+			return mixAccelerated< SCALAR, T, 4 >;
+		case 8:
+			return mixAccelerated< SCALAR, T, 8 >;
+		default:
+			return nullptr;
+	}
+}
+
+template< typename T > Downmix unaccelerated(unsigned int channels, quint64 mask) {
+	if (mask != ~0ULL) {
+		return mixMasked< T >;
+	}
+
+	switch (channels) {
+		case 3:
+			return mixAll< T, 3 >;
+		case 5:
+			return mixAll< T, 5 >;
+		case 6:
+			return mixAll< T, 6 >;
+		case 7:
+			return mixAll< T, 7 >;
+		default:
+			return mixAll< T, 0 >;
+	}
+}
+
+template< bool SCALAR, typename T > Downmix choose(unsigned int channels, quint64 mask) {
+	if (mixedChannels(channels, mask) == 0) {
+		// Instead of dividing by zero
+		return mixNothing;
+	}
+
+	if (Downmix downmix = accelerated< SCALAR, T >(channels)) {
+		return downmix;
+	}
+	return unaccelerated< T >(channels, mask);
+}
+} // namespace
+
+const char *backendName() {
+	return backend()->name;
+}
+
+Downmix chooseDownmix(SampleFormat format, unsigned int channels, quint64 mask) {
+	return format == SampleFormat::Float ? choose< false, float >(channels, mask)
+										 : choose< false, short >(channels, mask);
+}
+
+void floatToShort(const float *in, short *out, std::size_t count, float scale) {
+	backend()->floatToShort(in, out, count, scale);
+}
+
+void shortToFloat(const short *in, float *out, std::size_t count, float scale) {
+	backend()->shortToFloat(in, out, count, scale);
+}
+
+float dot(const float *a, const float *b, std::size_t count) {
+	return backend()->dot(a, b, count);
+}
+
+void accumulateRamp(float *out, const float *in, unsigned int count, float start, float increment) {
+	backend()->accumulateRamp(out, in, count, start, increment);
+}
+
+void accumulateStereoRamp(float *out, const float *in, unsigned int count, float start, float increment) {
+	backend()->accumulateStereoRamp(out, in, count, start, increment);
+}
+
+void accumulatePanned(float *out, const float *in, unsigned int count, float left, float right, float volume) {
+	backend()->accumulatePanned(out, in, count, left, right, volume);
+}
+
+void interleave(const float *planes, float *out, unsigned int channels, unsigned int count) {
+	if (channels == 2) {
+		backend()->interleave2(planes, out, count);
+	} else {
+		interleaveScalar(planes, out, 0, channels, count);
+	}
+}
+
+void clip(float *samples, std::size_t count) {
+	backend()->clip(samples, count);
+}
+
+namespace Scalar {
+	Downmix chooseDownmix(SampleFormat format, unsigned int channels, quint64 mask) {
+		return format == SampleFormat::Float ? choose< true, float >(channels, mask)
+											 : choose< true, short >(channels, mask);
+	}
+
+	void floatToShort(const float *in, short *out, std::size_t count, float scale) {
+		floatToShortScalar(in, out, count, scale);
+	}
+
+	void shortToFloat(const short *in, float *out, std::size_t count, float scale) {
+		shortToFloatScalar(in, out, count, scale);
+	}
+
+	float dot(const float *a, const float *b, std::size_t count) { return dotScalar(a, b, count); }
+
+	void accumulateRamp(float *out, const float *in, unsigned int count, float start, float increment) {
+		accumulateRampScalar(out, in, 0, count, start, increment);
+	}
+
+	void accumulateStereoRamp(float *out, const float *in, unsigned int count, float start, float increment) {
+		accumulateStereoRampScalar(out, in, 0, count, start, increment);
+	}
+
+	void accumulatePanned(float *out, const float *in, unsigned int count, float left, float right, float volume) {
+		accumulatePannedScalar(out, in, 0, count, left, right, volume);
+	}
+
+	void interleave(const float *planes, float *out, unsigned int channels, unsigned int count) {
+		interleaveScalar(planes, out, 0, channels, count);
+	}
+
+	void clip(float *samples, std::size_t count) { clipScalar(samples, count); }
+} // namespace Scalar
+
+} // namespace AudioKernels
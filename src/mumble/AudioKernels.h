@@ -0,0 +1,87 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOKERNELS_H_
+#define MUMBLE_MUMBLE_AUDIOKERNELS_H_
+
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+
+/// The sample loops of the audio input and output: mixing the (interleaved) channels of the microphone and the echo
+/// source down to mono, converting between 16-bit PCM and floats, and mixing the received audio into the (planar)
+/// channels of the output. These run several times per frame in the audio callbacks, as does the filter of the
+/// AudioResampler.
+///
+/// Depending on the CPU (checked once at runtime), the loops use SSE2 or AVX2 on x86 and NEON on ARMv8. Their results
+/// are the same as the ones of the portable implementation in the Scalar namespace (which is used whenever the CPU
+/// lacks these instructions), except for rounding differences in the order in which channels (or products) are summed
+/// up.
+namespace AudioKernels {
+
+enum class SampleFormat { Short, Float };
+
+/// Mixes the given channels of nsamp interleaved frames down to their mean. Short samples are scaled to [-1, 1).
+///
+/// @param out Receives nsamp samples
+/// @param in The frames, each consisting of channels samples of the format the function has been chosen for
+/// @param mask The channels that are part of the mix (bit n corresponds to channel n). Only the first 64 channels can
+/// 	be selected this way, unless all bits are set.
+typedef void (*Downmix)(float *out, const void *in, unsigned int nsamp, unsigned int channels, quint64 mask);
+
+/// @returns The name of the instruction set the kernels use ("AVX2", "SSE2", "NEON" or "Scalar")
+const char *backendName();
+
+/// @returns The fastest Downmix for the given input. Channel counts of 1, 2, 4 and 8 are the ones that are
+/// 	accelerated.
+Downmix chooseDownmix(SampleFormat format, unsigned int channels, quint64 mask);
+
+/// Converts floats to 16-bit PCM, clamping the (scaled) samples to the range of a short
+///
+/// @param scale The factor to apply before converting. Samples in [-1, 1] require the default one.
+void floatToShort(const float *in, short *out, std::size_t count, float scale = 32768.f);
+
+/// Converts 16-bit PCM to floats
+///
+/// @param scale The factor to apply after converting. The default one results in samples in [-1, 1).
+void shortToFloat(const short *in, float *out, std::size_t count, float scale = 1.0f / 32768.f);
+
+/// @returns The dot product of the given vectors
+float dot(const float *a, const float *b, std::size_t count);
+
+/// Adds the samples to the ones in out, each weighted by a gain that changes linearly from sample to sample:
+/// out[i] += in[i] * (start + increment * i)
+void accumulateRamp(float *out, const float *in, unsigned int count, float start, float increment);
+
+/// Same as accumulateRamp, but for the mean of the channels of interleaved stereo frames
+void accumulateStereoRamp(float *out, const float *in, unsigned int count, float start, float increment);
+
+/// Adds interleaved stereo frames to the samples in out, panned by the given factors:
+/// out[i] += (in[2 * i] * left + in[2 * i + 1] * right) * volume
+void accumulatePanned(float *out, const float *in, unsigned int count, float left, float right, float volume);
+
+/// Interleaves the given planes (count samples of every channel, one channel after the other) into frames
+/// (which is only accelerated for two channels)
+void interleave(const float *planes, float *out, unsigned int channels, unsigned int count);
+
+/// Clamps the samples to [-1, 1]
+void clip(float *samples, std::size_t count);
+
+/// The portable implementation of the functions above, which serves as the reference for the accelerated ones
+namespace Scalar {
+	Downmix chooseDownmix(SampleFormat format, unsigned int channels, quint64 mask);
+	void floatToShort(const float *in, short *out, std::size_t count, float scale = 32768.f);
+	void shortToFloat(const short *in, float *out, std::size_t count, float scale = 1.0f / 32768.f);
+	float dot(const float *a, const float *b, std::size_t count);
+	void accumulateRamp(float *out, const float *in, unsigned int count, float start, float increment);
+	void accumulateStereoRamp(float *out, const float *in, unsigned int count, float start, float increment);
+	void accumulatePanned(float *out, const float *in, unsigned int count, float left, float right, float volume);
+	void interleave(const float *planes, float *out, unsigned int channels, unsigned int count);
+	void clip(float *samples, std::size_t count);
+} // namespace Scalar
+
+} // namespace AudioKernels
+
+#endif // MUMBLE_MUMBLE_AUDIOKERNELS_H_
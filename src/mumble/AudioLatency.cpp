@@ -0,0 +1,107 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioLatency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace AudioLatency {
+
+namespace {
+	constexpr std::array< quint64, BUCKET_COUNT - 1 > BOUNDS = { 1000,  2000,   5000,   10000,  20000,
+																 50000, 100000, 200000, 500000, 1000000 };
+
+	struct AtomicHistogram {
+		std::array< std::atomic< quint64 >, BUCKET_COUNT > counts;
+		std::atomic< quint64 > samples;
+		std::atomic< quint64 > total;
+		std::atomic< quint64 > max;
+	};
+
+	std::array< AtomicHistogram, STAGE_COUNT > &histograms() {
+		// Zero-initialized, as it is static
+		static std::array< AtomicHistogram, STAGE_COUNT > instance;
+		return instance;
+	}
+} // namespace
+
+quint64 bucketBound(std::size_t bucket) {
+	return bucket < BOUNDS.size() ? BOUNDS[bucket] : 0;
+}
+
+quint64 Histogram::mean() const {
+	return samples > 0 ? total / samples : 0;
+}
+
+quint64 Histogram::percentile(double fraction) const {
+	const quint64 target = static_cast< quint64 >(fraction * static_cast< double >(samples));
+	quint64 seen         = 0;
+	for (std::size_t i = 0; i < BOUNDS.size(); ++i) {
+		seen += counts[i];
+		if (seen > target) {
+			return std::min(BOUNDS[i], max);
+		}
+	}
+
+	return max;
+}
+
+quint64 now() {
+	const auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+	return static_cast< quint64 >(std::chrono::duration_cast< std::chrono::microseconds >(elapsed).count()) + 1;
+}
+
+void record(Stage stage, quint64 latency) {
+	AtomicHistogram &histogram = histograms()[static_cast< std::size_t >(stage)];
+
+	const std::size_t bucket =
+		static_cast< std::size_t >(std::upper_bound(BOUNDS.begin(), BOUNDS.end(), latency) - BOUNDS.begin());
+	histogram.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	histogram.samples.fetch_add(1, std::memory_order_relaxed);
+	histogram.total.fetch_add(latency, std::memory_order_relaxed);
+
+	quint64 max = histogram.max.load(std::memory_order_relaxed);
+	while (latency > max && !histogram.max.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {
+	}
+}
+
+void recordSince(Stage stage, quint64 start) {
+	if (start == 0) {
+		return;
+	}
+
+	const quint64 current = now();
+	record(stage, current > start ? current - start : 0);
+}
+
+Histogram histogram(Stage stage) {
+	const AtomicHistogram &source = histograms()[static_cast< std::size_t >(stage)];
+
+	// The counters are read one after the other, so a snapshot may be off by the latencies recorded meanwhile
+	Histogram result;
+	for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+		result.counts[i] = source.counts[i].load(std::memory_order_relaxed);
+	}
+	result.samples = source.samples.load(std::memory_order_relaxed);
+	result.total   = source.total.load(std::memory_order_relaxed);
+	result.max     = source.max.load(std::memory_order_relaxed);
+
+	return result;
+}
+
+void reset() {
+	for (AtomicHistogram &histogram : histograms()) {
+		for (std::atomic< quint64 > &count : histogram.counts) {
+			count.store(0, std::memory_order_relaxed);
+		}
+		histogram.samples.store(0, std::memory_order_relaxed);
+		histogram.total.store(0, std::memory_order_relaxed);
+		histogram.max.store(0, std::memory_order_relaxed);
+	}
+}
+
+} // namespace AudioLatency
@@ -0,0 +1,81 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOLATENCY_H_
+#define MUMBLE_MUMBLE_AUDIOLATENCY_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+
+/// Histograms of the time the audio spends in the stages of the pipeline, from the microphone of one user to the
+/// speakers of another. The stages are timed where the audio passes from one of them to the next, which is why
+/// recording a latency only takes a few atomic increments that never wait (and can thus be done by the audio
+/// callbacks).
+///
+/// All times are in microseconds on a monotonic clock (see now()).
+namespace AudioLatency {
+
+enum class Stage {
+	/// From the arrival of a frame's first samples from the device until the packet containing it has been encoded
+	/// (which includes the echo canceller's queue, the processing and the frames buffered per packet)
+	Encode,
+	/// From the encoding of a packet until it has been handed to the socket
+	Send,
+	/// Half of the round-trip time of the UDP pings, as the time a packet takes to travel one way can't be measured
+	Network,
+	/// From the reading of a datagram until its audio has been handed to the audio output
+	Receive,
+	/// From a packet's arrival at the audio output until it is taken out of the jitter buffer
+	JitterBuffer,
+	/// From a packet being taken out of the jitter buffer until its audio has been mixed into the output
+	Mix,
+	/// From the mix until the device plays it, as far as the audio backend measures it (which only PipeWire does)
+	Playback,
+	/// The time the echo canceller takes for a frame of the microphone (which is part of Encode), as it may take up
+	/// much of the frame's duration with many speaker channels
+	EchoCancellation,
+};
+
+constexpr std::size_t STAGE_COUNT = 8;
+
+/// Bucket i holds the latencies below its bound (and at least as high as the one of the previous bucket), the last
+/// bucket holds everything above the last bound
+constexpr std::size_t BUCKET_COUNT = 11;
+
+/// @returns The upper bound (exclusive) of the given bucket, 0 for the last one (which doesn't have a bound)
+quint64 bucketBound(std::size_t bucket);
+
+struct Histogram {
+	std::array< quint64, BUCKET_COUNT > counts = {};
+	quint64 samples = 0;
+	quint64 total   = 0;
+	quint64 max     = 0;
+
+	/// @returns The mean latency, 0 if there are no samples
+	quint64 mean() const;
+	/// @returns An upper bound for the latency that the given fraction of the samples doesn't exceed: the bound of
+	/// 	the bucket the percentile falls into (or the maximum, when that is lower or it's the last bucket)
+	quint64 percentile(double fraction) const;
+};
+
+/// @returns The current time in microseconds, which is never 0 (0 standing for an unknown time elsewhere)
+quint64 now();
+
+void record(Stage stage, quint64 latency);
+
+/// Records the time that has passed since the given one, unless that is unknown (0)
+void recordSince(Stage stage, quint64 start);
+
+/// @returns A snapshot of the histogram of the given stage
+Histogram histogram(Stage stage);
+
+/// Forgets all latencies recorded so far
+void reset();
+
+} // namespace AudioLatency
+
+#endif // MUMBLE_MUMBLE_AUDIOLATENCY_H_
@@ -5,13 +5,17 @@
 
 #include "AudioOutput.h"
 
+#include "AudioBenchmark.h"
 #include "AudioInput.h"
+#include "AudioKernels.h"
+#include "AudioLatency.h"
 #include "AudioOutputSample.h"
 #include "AudioOutputSpeech.h"
 #include "Channel.h"
 #include "ChannelListenerManager.h"
 #include "Log.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "ServerHandler.h"
 #include "Timer.h"
 #include "User.h"
@@ -19,6 +23,7 @@
 #include "VoiceRecorder.h"
 #include "Global.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -80,7 +85,20 @@ bool AudioOutputRegistrar::canExclusive() const {
 
 AudioOutput::AudioOutput() {
 	QObject::connect(this, &AudioOutput::bufferInvalidated, this, &AudioOutput::handleInvalidatedBuffer);
-	QObject::connect(this, &AudioOutput::bufferPositionChanged, this, &AudioOutput::handlePositionedBuffer);
+
+	// So that the mixer doesn't have to allocate memory when a source is added (unless there are a lot of them)
+	m_mixSources.reserve(256);
+
+	m_sampleCache = std::make_unique< AudioSampleCache >();
+
+	if (Global::get().s.bDecodeAhead) {
+		m_decoder = std::make_unique< AudioOutputDecoder >(AudioOutputDecoder::defaultThreadCount());
+	}
+
+	if (Global::get().s.bPositionalHRTF) {
+		// Computed right away, so that the mixer can use them from the start
+		m_hrtf = AudioSpatializer::dataset(SAMPLE_RATE);
+	}
 }
 
 AudioOutput::~AudioOutput() {
@@ -174,7 +192,8 @@ const float *AudioOutput::getSpeakerPos(unsigned int &speakers) {
 	return nullptr;
 }
 
-void AudioOutput::addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::AudioData &audioData) {
+void AudioOutput::addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::AudioData &audioData,
+								   quint64 arrival) {
 	if (iChannels == 0) {
 		return;
 	}
@@ -186,7 +205,7 @@ void AudioOutput::addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::A
 	// will be removed from this map and deleted.
 	AudioOutputSpeech *speech = qobject_cast< AudioOutputSpeech * >(qmOutputs.value(sender));
 
-	if (!speech || (speech->m_codec != audioData.usedCodec)) {
+	if (!speech || (speech->m_codec != audioData.usedCodec) || (speech->m_frameSize != audioData.frameSize)) {
 		qrwlOutputs.unlock();
 
 		if (speech) {
@@ -203,36 +222,57 @@ void AudioOutput::addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::A
 
 		qrwlOutputs.lockForWrite();
 
-		speech = new AudioOutputSpeech(sender, iMixerFreq, audioData.usedCodec, iBufferSize);
+		// The loopback user's frames are fetched while decoding, which may require the lock a thread that waits for
+		// the decoder is holding. Thus, it is always decoded by mix() itself.
+		speech = new AudioOutputSpeech(sender, audioData.usedCodec, audioData.frameSize, mixBufferSize(),
+									   m_devicePeriod.load(std::memory_order_relaxed),
+									   sender == &LoopUser::lpLoopy ? nullptr : m_decoder.get());
 		qmOutputs.replace(sender, speech);
+		postCommand({ SourceCommand::Add, sender, speech });
 	}
 
-	speech->addFrameToBuffer(audioData);
+	speech->addFrameToBuffer(audioData, arrival);
 
 	qrwlOutputs.unlock();
 }
 
-void AudioOutput::handleInvalidatedBuffer(AudioOutputBuffer *buffer) {
-	QWriteLocker locker(&qrwlOutputs);
-	for (auto iter = qmOutputs.begin(); iter != qmOutputs.end(); ++iter) {
-		if (iter.value() == buffer) {
-			qmOutputs.erase(iter);
-			delete buffer;
-			break;
+void AudioOutput::addFramesToBuffer(const std::vector< ReceivedFrame > &frames) {
+	if (iChannels == 0) {
+		return;
+	}
+
+	QReadLocker lock(&qrwlOutputs);
+	for (const ReceivedFrame &frame : frames) {
+		AudioOutputSpeech *speech = qobject_cast< AudioOutputSpeech * >(qmOutputs.value(frame.sender));
+
+		if (speech && speech->m_codec == frame.audioData.usedCodec
+			&& speech->m_frameSize == frame.audioData.frameSize) {
+			speech->addFrameToBuffer(frame.audioData, frame.arrival);
+		} else {
+			// The buffer has to be (re-)created, which requires the write lock
+			lock.unlock();
+			addFrameToBuffer(frame.sender, frame.audioData, frame.arrival);
+			lock.relock();
 		}
 	}
 }
 
-void AudioOutput::handlePositionedBuffer(AudioOutputBuffer *buffer, float x, float y, float z) {
-	QWriteLocker locker(&qrwlOutputs);
-	for (auto iter = qmOutputs.begin(); iter != qmOutputs.end(); ++iter) {
-		if (iter.value() == buffer) {
-			buffer->fPos[0] = x;
-			buffer->fPos[1] = y;
-			buffer->fPos[2] = z;
-			break;
+void AudioOutput::handleInvalidatedBuffer(AudioOutputBuffer *buffer) {
+	{
+		QWriteLocker locker(&qrwlOutputs);
+		auto iter = std::find(qmOutputs.begin(), qmOutputs.end(), buffer);
+		if (iter == qmOutputs.end()) {
+			// The buffer has already been deleted
+			return;
 		}
+
+		qmOutputs.erase(iter);
+		postCommand({ SourceCommand::Remove, nullptr, buffer });
 	}
+
+	// The lock isn't held while waiting, as the mixer may need it (when the loopback user's frames are fetched)
+	waitForMixer();
+	delete buffer;
 }
 
 void AudioOutput::setBufferPosition(const AudioOutputToken &token, float x, float y, float z) {
@@ -240,7 +280,68 @@ void AudioOutput::setBufferPosition(const AudioOutputToken &token, float x, floa
 		return;
 	}
 
-	emit bufferPositionChanged(token.m_buffer, x, y, z);
+	postCommand({ SourceCommand::Position, nullptr, token.m_buffer, { x, y, z } });
+}
+
+void AudioOutput::postCommand(const SourceCommand &command) {
+	std::lock_guard< std::mutex > lock(m_commandMutex);
+
+	const std::size_t tail = m_commandsTail.load(std::memory_order_relaxed);
+	while (tail - m_commandsHead.load(std::memory_order_acquire) == COMMAND_CAPACITY) {
+		// The mixer applies the commands at the start of every callback
+		QThread::yieldCurrentThread();
+	}
+
+	m_commands[tail % COMMAND_CAPACITY] = command;
+	// Sequentially consistent, so that waitForMixer() can rely on every mix() that starts after it has seen an even
+	// epoch to apply the command
+	m_commandsTail.store(tail + 1, std::memory_order_seq_cst);
+}
+
+void AudioOutput::applyCommands() {
+	const std::size_t tail = m_commandsTail.load(std::memory_order_seq_cst);
+
+	for (std::size_t head = m_commandsHead.load(std::memory_order_relaxed); head != tail; ++head) {
+		const SourceCommand &command = m_commands[head % COMMAND_CAPACITY];
+
+		// Commands for buffers the mixer doesn't know (anymore) are ignored, which is why a buffer that has been
+		// removed and deleted is never dereferenced
+		auto source = std::find_if(m_mixSources.begin(), m_mixSources.end(),
+								   [&command](const MixSource &entry) { return entry.buffer == command.buffer; });
+
+		switch (command.type) {
+			case SourceCommand::Add:
+				if (source == m_mixSources.end()) {
+					m_mixSources.push_back({ command.user, command.buffer });
+				}
+				break;
+			case SourceCommand::Remove:
+				if (source != m_mixSources.end()) {
+					m_mixSources.erase(source);
+				}
+				break;
+			case SourceCommand::Position:
+				if (source != m_mixSources.end()) {
+					source->buffer->fPos = command.position;
+				}
+				break;
+		}
+
+		m_commandsHead.store(head + 1, std::memory_order_release);
+	}
+}
+
+void AudioOutput::waitForMixer() {
+	const unsigned int epoch = m_mixEpoch.load(std::memory_order_seq_cst);
+	if (epoch % 2 == 0) {
+		// The mixer isn't mixing, and applies the commands before anything else once it starts
+		return;
+	}
+
+	// Wait for the mix to end that might still have been using the buffer
+	while (m_mixEpoch.load(std::memory_order_seq_cst) == epoch) {
+		QThread::yieldCurrentThread();
+	}
 }
 
 void AudioOutput::removeBuffer(AudioOutputBuffer *buffer) {
@@ -261,9 +362,14 @@ void AudioOutput::removeToken(AudioOutputToken &token) {
 }
 
 AudioOutputToken AudioOutput::playSample(const QString &filename, float volume, bool loop) {
-	SoundFile *handle = AudioOutputSample::loadSndfile(filename);
-	if (!handle)
-		return AudioOutputToken();
+	// The file is only decoded the first time it is played, unless it is too long to be kept in memory
+	std::shared_ptr< const DecodedSample > decoded = m_sampleCache->get(filename, SAMPLE_RATE);
+	std::unique_ptr< SoundFile > handle;
+	if (!decoded) {
+		handle.reset(AudioOutputSample::loadSndfile(filename));
+		if (!handle)
+			return AudioOutputToken();
+	}
 
 	Timer t;
 	const quint64 oneSecond = 1000000;
@@ -282,8 +388,11 @@ AudioOutputToken AudioOutput::playSample(const QString &filename, float volume,
 		return AudioOutputToken();
 
 	QWriteLocker locker(&qrwlOutputs);
-	AudioOutputSample *sample = new AudioOutputSample(handle, volume, loop, iMixerFreq, iBufferSize);
+	AudioOutputSample *sample =
+		decoded ? new AudioOutputSample(std::move(decoded), volume, loop, mixBufferSize())
+				: new AudioOutputSample(handle.release(), volume, loop, SAMPLE_RATE, mixBufferSize());
 	qmOutputs.insert(nullptr, sample);
+	postCommand({ SourceCommand::Add, nullptr, sample });
 
 	return AudioOutputToken(sample);
 }
@@ -412,6 +521,14 @@ void AudioOutput::initializeMixer(const unsigned int *chanmasks, bool forceheadp
 	}
 	iSampleSize =
 		static_cast< unsigned int >(iChannels * ((eSampleFormat == SampleFloat) ? sizeof(float) : sizeof(short)));
+
+	// The audio sources are mixed at SAMPLE_RATE, so that only the mix has to be resampled (instead of every source)
+	if (iMixerFreq != 0 && iMixerFreq != SAMPLE_RATE) {
+		m_mixResampler = std::make_unique< AudioResampler >(iChannels, SAMPLE_RATE, iMixerFreq);
+	} else {
+		m_mixResampler.reset();
+	}
+
 	qWarning("AudioOutput: Initialized %d channel %d hz mixer", iChannels, iMixerFreq);
 
 	if (Global::get().s.bPositionalAudio && iChannels == 1) {
@@ -419,17 +536,30 @@ void AudioOutput::initializeMixer(const unsigned int *chanmasks, bool forceheadp
 	}
 }
 
-bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
+bool AudioOutput::mix(void *outbuff, unsigned int deviceFrameCount) {
+	AudioBenchmark::recordPeriod(AudioBenchmark::Probe::OutputPeriod, m_lastMix);
+	AudioBenchmark::ScopedTimer timer(AudioBenchmark::Probe::Mix);
+	MUMBLE_PROFILE_ZONE("AudioOutput::mix");
+
+	// Makes the epoch odd until the end of the mix (see waitForMixer())
+	m_mixEpoch.fetch_add(1, std::memory_order_seq_cst);
+	applyCommands();
+
 #ifdef USE_MANUAL_PLUGIN
 	positions.clear();
 #endif
 
+	// The number of frames that are mixed (at SAMPLE_RATE) for the ones the device asks for
+	const unsigned int frameCount =
+		m_mixResampler ? m_mixResampler->inputFramesFor(deviceFrameCount) : deviceFrameCount;
+
 	// A list of buffers that have audio to contribute
 	QList< AudioOutputBuffer * > qlMix;
 	// A list of buffers that no longer have any audio to play and can thus be deleted
 	QList< AudioOutputBuffer * > qlDel;
 
 	if (Global::get().s.fVolume < 0.01f) {
+		m_mixEpoch.fetch_add(1, std::memory_order_seq_cst);
 		return false;
 	}
 
@@ -442,36 +572,37 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 		recorder = Global::get().sh->recorder;
 	}
 
-	qrwlOutputs.lockForRead();
-
 	bool prioritySpeakerActive = false;
 
 	// Get the users that are currently talking (and are thus serving as an audio source)
-	QMultiHash< const ClientUser *, AudioOutputBuffer * >::const_iterator it = qmOutputs.constBegin();
-	while (it != qmOutputs.constEnd()) {
-		AudioOutputBuffer *buffer = it.value();
-		if (!buffer->prepareSampleBuffer(frameCount)) {
-			qlDel.append(buffer);
+	for (const MixSource &source : m_mixSources) {
+		if (!source.buffer->prepareSampleBuffer(frameCount)) {
+			qlDel.append(source.buffer);
 		} else {
-			qlMix.append(buffer);
+			qlMix.append(source.buffer);
 
-			const ClientUser *user = it.key();
-			if (user && user->bPrioritySpeaker) {
+			if (source.user && source.user->bPrioritySpeaker) {
 				prioritySpeakerActive = true;
 			}
 		}
-		++it;
 	}
 
+	// The buffers that are done aren't mixed anymore, even before they have been deleted
+	m_mixSources.erase(std::remove_if(m_mixSources.begin(), m_mixSources.end(),
+									  [&qlDel](const MixSource &source) { return qlDel.contains(source.buffer); }),
+					   m_mixSources.end());
+
 	if (Global::get().prioritySpeakerActiveOverride) {
 		prioritySpeakerActive = true;
 	}
 
-	// If the audio backend uses a float-array we can sample and mix the audio sources directly into the output.
-	// Otherwise we'll have to use an intermediate buffer which we will convert to an array of shorts later
+	// If the audio backend uses a float-array (at SAMPLE_RATE) we can sample and mix the audio sources directly into
+	// the output. Otherwise we'll have to use an intermediate buffer which we will resample and/or convert to an array
+	// of shorts later
 	static std::vector< float > fOutput;
 	fOutput.resize(iChannels * frameCount);
-	float *output = (eSampleFormat == SampleFloat) ? reinterpret_cast< float * >(outbuff) : fOutput.data();
+	float *output = (eSampleFormat == SampleFloat && !m_mixResampler) ? reinterpret_cast< float * >(outbuff)
+																	   : fOutput.data();
 	memset(output, 0, sizeof(float) * frameCount * iChannels);
 
 	if (!qlMix.isEmpty()) {
@@ -480,26 +611,40 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 		speaker.resize(iChannels * 3);
 		static std::vector< float > svol;
 		svol.resize(iChannels);
+		// The sources are mixed into a plane per channel (which the kernels can process contiguously), which are
+		// interleaved into the output afterwards
+		static std::vector< float > planes;
+		planes.resize(iChannels * frameCount);
+		std::fill(planes.begin(), planes.end(), 0.0f);
 
 		bool validListener = false;
+		// The listener's pose as published by the PositionalDataPoller
+		const PositionalPose pose =
+			Global::get().pluginManager ? Global::get().pluginManager->getPositionalPose() : PositionalPose();
+		// The listener's frame of reference, which the HRTFs take the directions of the sources in
+		Vector3D listenerRight;
+		Vector3D listenerUp;
+		Vector3D listenerFront;
+		// HRTFs are meant for headphones, whose first channel is the left one
+		const bool spatialize          = m_hrtf && nchan == 2 && Global::get().s.bPositionalHeadphone;
+		const unsigned int leftChannel = (spatialize && fSpeakers[0] > 0.0f) ? 1 : 0;
 
 		// Initialize recorder if recording is enabled
-		boost::shared_array< float > recbuff;
 		if (recorder) {
-			recbuff = boost::shared_array< float >(new float[frameCount]);
-			memset(recbuff.get(), 0, sizeof(float) * frameCount);
+			m_recordBuffer.resize(frameCount);
+			std::fill(m_recordBuffer.begin(), m_recordBuffer.end(), 0.0f);
 			recorder->prepareBufferAdds();
 		}
 
 		for (unsigned int i = 0; i < iChannels; ++i)
 			svol[i] = mul * fSpeakerVolume[i];
 
-		if (Global::get().s.bPositionalAudio && (iChannels > 1) && Global::get().pluginManager->fetchPositionalData()) {
+		if (Global::get().s.bPositionalAudio && (iChannels > 1) && pose.available) {
 			// Calculate the positional audio effects if it is enabled
 
-			Vector3D cameraDir = Global::get().pluginManager->getPositionalData().getCameraDir();
+			Vector3D cameraDir = pose.cameraDir;
 
-			Vector3D cameraAxis = Global::get().pluginManager->getPositionalData().getCameraAxis();
+			Vector3D cameraAxis = pose.cameraAxis;
 
 			// Direction vector is dominant; if it's zero we presume all is zero.
 
@@ -560,6 +705,10 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 									 + fSpeakers[3 * i + 2] * cameraDir.z;
 			}
 			validListener = true;
+
+			listenerRight = right;
+			listenerUp    = cameraAxis;
+			listenerFront = cameraDir;
 		}
 
 		for (AudioOutputBuffer *buffer : qlMix) {
@@ -577,17 +726,23 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 
 				volumeAdjustment *= user->getLocalVolumeAdjustments();
 
-				if (sh && sh->m_version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION) {
+				// Whether we are receiving this audio packet only because we are listening to the channel the
+				// speaking user is in
+				const bool viaListenerProxy =
+					user->cChannel
+					&& Global::get().channelListenerManager->isListening(Global::get().uiSession, user->cChannel->iId)
+					&& (speech->m_audioContext == Mumble::Protocol::AudioContext::LISTEN);
+
+				if (sh && sh->m_version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION
+					&& !(viaListenerProxy && sh->m_listenerVolumesQuantized)) {
 					// The new protocol supports sending volume adjustments which is used to figure out the correct
 					// volume adjustment for listeners on the server. Thus, we only have to apply that here.
 					volumeAdjustment *= speech->m_suggestedVolumeAdjustment;
-				} else if (user->cChannel
-						   && Global::get().channelListenerManager->isListening(Global::get().uiSession,
-																				user->cChannel->iId)
-						   && (speech->m_audioContext == Mumble::Protocol::AudioContext::LISTEN)) {
+				} else if (viaListenerProxy) {
 					// We are receiving this audio packet only because we are listening to the channel
 					// the speaking user is in. Thus we receive the audio via our "listener proxy".
-					// Thus we'll apply the volume adjustment for our listener proxy as well
+					// Thus we'll apply the volume adjustment for our listener proxy as well. Servers that round the
+					// listeners' volume adjustments leave it to us as well, as they only suggest an approximation.
 					volumeAdjustment *= Global::get()
 											.channelListenerManager
 											->getListenerVolumeAdjustment(Global::get().uiSession, user->cChannel->iId)
@@ -617,18 +772,18 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 						// Mix down stereo to mono. TODO: stereo record support
 						// frame: for a stereo stream, the [LR] pair inside ...[LR]LRLRLR.... is a frame
 						for (unsigned int i = 0; i < frameCount; ++i) {
-							recbuff[i] += (pfBuffer[2 * i] / 2.0f + pfBuffer[2 * i + 1] / 2.0f) * volumeAdjustment;
+							m_recordBuffer[i] +=
+								(pfBuffer[2 * i] / 2.0f + pfBuffer[2 * i + 1] / 2.0f) * volumeAdjustment;
 						}
 					} else {
 						for (unsigned int i = 0; i < frameCount; ++i) {
-							recbuff[i] += pfBuffer[i] * volumeAdjustment;
+							m_recordBuffer[i] += pfBuffer[i] * volumeAdjustment;
 						}
 					}
 
 					if (!recorder->isInMixDownMode()) {
-						recorder->addBuffer(speech->p, recbuff, static_cast< int >(frameCount));
-						recbuff = boost::shared_array< float >(new float[frameCount]);
-						memset(recbuff.get(), 0, sizeof(float) * frameCount);
+						recorder->addBuffer(speech->p, m_recordBuffer.data(), frameCount);
+						std::fill(m_recordBuffer.begin(), m_recordBuffer.end(), 0.0f);
 					}
 
 					// Don't add the local audio to the real output
@@ -650,7 +805,7 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 
 				// If positional audio is enabled, calculate the respective audio effect here
 				Position3D outputPos = { buffer->fPos[0], buffer->fPos[1], buffer->fPos[2] };
-				Position3D ownPos    = Global::get().pluginManager->getPositionalData().getCameraPos();
+				Position3D ownPos    = pose.cameraPos;
 
 				Vector3D connectionVec = outputPos - ownPos;
 				float len              = connectionVec.norm();
@@ -681,6 +836,33 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 				const bool isAudible =
 					(Global::get().s.fAudioMaxDistVolume > 0) || (len < Global::get().s.fAudioMaxDistance);
 
+				if (spatialize) {
+					if (!buffer->spatializer) {
+						buffer->spatializer = std::make_unique< AudioSpatializer >(m_hrtf);
+					}
+
+					const float *mono = pfBuffer;
+					if (speech && speech->bStereo) {
+						static std::vector< float > downmix;
+						downmix.assign(frameCount, 0.0f);
+						AudioKernels::accumulateStereoRamp(downmix.data(), pfBuffer, frameCount, 1.0f, 0.0f);
+						mono = downmix.data();
+					}
+
+					// The direction already determines the volume of either ear
+					const float gain = isAudible ? calcGain(1.0f, len) * volumeAdjustment : 0.0f;
+					const std::array< float, 3 > direction =
+						len > 0.0f ? std::array< float, 3 >{ { connectionVec.dotProduct(listenerRight),
+																connectionVec.dotProduct(listenerUp),
+																connectionVec.dotProduct(listenerFront) } }
+								   : std::array< float, 3 >{ { 0.0f, 0.0f, 1.0f } };
+
+					buffer->spatializer->process(mono, frameCount, direction, svol[leftChannel] * gain,
+												 svol[1 - leftChannel] * gain, planes.data() + leftChannel * frameCount,
+												 planes.data() + (1 - leftChannel) * frameCount);
+					continue;
+				}
+
 				for (unsigned int s = 0; s < nchan; ++s) {
 					const float dot = bSpeakerPositional[s]
 										  ? connectionVec.x * speaker[s * 3 + 0] + connectionVec.y * speaker[s * 3 + 1]
@@ -698,7 +880,7 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 						channelVol = 0;
 					}
 
-					float *RESTRICT o   = output + s;
+					float *RESTRICT o   = planes.data() + s * frameCount;
 					const float old     = (buffer->pfVolume[s] >= 0.0f) ? buffer->pfVolume[s] : channelVol;
 					const float inc     = (channelVol - old) / static_cast< float >(frameCount);
 					buffer->pfVolume[s] = channelVol;
@@ -723,17 +905,26 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 					   speaker[s*3+1], speaker[s*3+2], dot, len, channelVol);
 					*/
 					if ((old >= 0.00000001f) || (channelVol >= 0.00000001f)) {
-						for (unsigned int i = 0; i < frameCount; ++i) {
-							unsigned int currentOffset = static_cast< unsigned int >(
-								static_cast< float >(oldOffset) + incOffset * static_cast< float >(i));
+						if (offset == oldOffset) {
+							// The offset stays the same throughout the chunk, which the kernels can take care of
 							if (speech && speech->bStereo) {
-								// Mix stereo user's stream into mono
-								// frame: for a stereo stream, the [LR] pair inside ...[LR]LRLRLR.... is a frame
-								o[i * nchan] += (pfBuffer[2 * i + currentOffset] / 2.0f
-												 + pfBuffer[2 * i + currentOffset + 1] / 2.0f)
-												* (old + inc * static_cast< float >(i));
+								AudioKernels::accumulateStereoRamp(o, pfBuffer + offset, frameCount, old, inc);
 							} else {
-								o[i * nchan] += pfBuffer[i + currentOffset] * (old + inc * static_cast< float >(i));
+								AudioKernels::accumulateRamp(o, pfBuffer + offset, frameCount, old, inc);
+							}
+						} else {
+							for (unsigned int i = 0; i < frameCount; ++i) {
+								unsigned int currentOffset = static_cast< unsigned int >(
+									static_cast< float >(oldOffset) + incOffset * static_cast< float >(i));
+								if (speech && speech->bStereo) {
+									// Mix stereo user's stream into mono
+									// frame: for a stereo stream, the [LR] pair inside ...[LR]LRLRLR.... is a frame
+									o[i] += (pfBuffer[2 * i + currentOffset] / 2.0f
+											 + pfBuffer[2 * i + currentOffset + 1] / 2.0f)
+											* (old + inc * static_cast< float >(i));
+								} else {
+									o[i] += pfBuffer[i + currentOffset] * (old + inc * static_cast< float >(i));
+								}
 							}
 						}
 					}
@@ -743,44 +934,69 @@ bool AudioOutput::mix(void *outbuff, unsigned int frameCount) {
 				// having applied a volume adjustment
 				for (unsigned int s = 0; s < nchan; ++s) {
 					const float channelVol = svol[s] * volumeAdjustment;
-					float *RESTRICT o      = output + s;
+					float *o               = planes.data() + s * frameCount;
 					if (buffer->bStereo) {
 						// Linear-panning stereo stream according to the projection of fSpeaker vector on left-right
 						// direction.
 						// frame: for a stereo stream, the [LR] pair inside ...[LR]LRLRLR.... is a frame
-						for (unsigned int i = 0; i < frameCount; ++i)
-							o[i * nchan] += (pfBuffer[2 * i] * fStereoPanningFactor[2 * s + 0]
-											 + pfBuffer[2 * i + 1] * fStereoPanningFactor[2 * s + 1])
-											* channelVol;
+						AudioKernels::accumulatePanned(o, pfBuffer, frameCount, fStereoPanningFactor[2 * s + 0],
+													   fStereoPanningFactor[2 * s + 1], channelVol);
 					} else {
-						for (unsigned int i = 0; i < frameCount; ++i)
-							o[i * nchan] += pfBuffer[i] * channelVol;
+						AudioKernels::accumulateRamp(o, pfBuffer, frameCount, channelVol, 0.0f);
 					}
 				}
 			}
 		}
 
 		if (recorder && recorder->isInMixDownMode()) {
-			recorder->addBuffer(nullptr, recbuff, static_cast< int >(frameCount));
+			recorder->addBuffer(nullptr, m_recordBuffer.data(), frameCount);
 		}
+
+		AudioKernels::interleave(planes.data(), output, nchan, frameCount);
 	}
 
 	bool pluginModifiedAudio = false;
 	emit audioOutputAboutToPlay(output, frameCount, nchan, SAMPLE_RATE, &pluginModifiedAudio);
 
+	if (AudioBenchmark::isActive() && AudioBenchmark::takeImpulse()) {
+		// The microphone is expected to pick this up (see AudioBenchmark)
+		const unsigned int impulseFrames = std::min(frameCount, AudioBenchmark::IMPULSE_FRAMES);
+		std::fill(output, output + impulseFrames * nchan, AudioBenchmark::IMPULSE_AMPLITUDE);
+		pluginModifiedAudio = true;
+	}
+
 	if (pluginModifiedAudio || (!qlMix.isEmpty())) {
+		if (m_mixResampler) {
+			// Resample the mix to the device's rate (right into the outbuff if the backend uses a float-array)
+			static std::vector< float > fResampled;
+			fResampled.resize(iChannels * deviceFrameCount);
+			float *resampled =
+				(eSampleFormat == SampleFloat) ? reinterpret_cast< float * >(outbuff) : fResampled.data();
+			m_mixResampler->process(output, frameCount, resampled, deviceFrameCount);
+			output = resampled;
+		}
+
 		// Clip the output audio
 		if (eSampleFormat == SampleFloat)
-			for (unsigned int i = 0; i < frameCount * iChannels; i++)
-				output[i] = qBound(-1.0f, output[i], 1.0f);
+			AudioKernels::clip(output, deviceFrameCount * iChannels);
 		else
 			// Also convert the intermediate float array into an array of shorts before writing it to the outbuff
-			for (unsigned int i = 0; i < frameCount * iChannels; i++)
-				reinterpret_cast< short * >(outbuff)[i] =
-					static_cast< short >(qBound(-32768.f, (output[i] * 32768.f), 32767.f));
+			AudioKernels::floatToShort(output, reinterpret_cast< short * >(outbuff), deviceFrameCount * iChannels);
+	} else if (m_mixResampler) {
+		// The device plays silence, which is what the next mix is to follow (instead of the last one)
+		m_mixResampler->reset();
 	}
 
-	qrwlOutputs.unlock();
+	// The packets that have been taken out of the jitter buffers for this mix are on their way to the device now
+	for (AudioOutputBuffer *buffer : qlMix) {
+		AudioOutputSpeech *speech = qobject_cast< AudioOutputSpeech * >(buffer);
+		if (speech && speech->m_dequeued != 0) {
+			AudioLatency::recordSince(AudioLatency::Stage::Mix, speech->m_dequeued);
+			speech->m_dequeued = 0;
+		}
+	}
+
+	m_mixEpoch.fetch_add(1, std::memory_order_seq_cst);
 
 	// Delete all AudioOutputBuffer that no longer provide any new audio
 	for (AudioOutputBuffer *buffer : qlDel) {
@@ -803,6 +1019,20 @@ unsigned int AudioOutput::getMixerFreq() const {
 	return iMixerFreq;
 }
 
+unsigned int AudioOutput::mixBufferSize() const {
+	if (iMixerFreq == 0 || iMixerFreq == SAMPLE_RATE) {
+		return iBufferSize;
+	}
+
+	// iBufferSize is in frames of the device, and the resampler may ask for two frames more than their duration
+	const quint64 frames = static_cast< quint64 >(iBufferSize) * SAMPLE_RATE;
+	return static_cast< unsigned int >((frames + iMixerFreq - 1) / iMixerFreq) + 2;
+}
+
 void AudioOutput::setBufferSize(unsigned int bufferSize) {
 	iBufferSize = bufferSize;
 }
+
+void AudioOutput::setDevicePeriod(unsigned int frames) {
+	m_devicePeriod.store(frames, std::memory_order_relaxed);
+}
@@ -10,8 +10,18 @@
 #include <QtCore/QThread>
 #include <boost/shared_ptr.hpp>
 
+#include "AudioOutputDecoder.h"
+#include "AudioResampler.h"
+#include "AudioSpatializer.h"
 #include "MumbleProtocol.h"
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #ifdef USE_MANUAL_PLUGIN
 #	include "ManualPlugin.h"
 #endif
@@ -43,6 +53,7 @@ class AudioOutput;
 class ClientUser;
 class AudioOutputBuffer;
 class AudioOutputToken;
+class AudioSampleCache;
 
 typedef boost::shared_ptr< AudioOutput > AudioOutputPtr;
 
@@ -79,11 +90,66 @@ private:
 	bool *bSpeakerPositional = nullptr;
 	/// Used when panning stereo stream w.r.t. each speaker.
 	float *fStereoPanningFactor = nullptr;
+	/// Resamples the mix (which is at SAMPLE_RATE) to the device's rate, nullptr if that is SAMPLE_RATE as well
+	std::unique_ptr< AudioResampler > m_mixResampler;
+	/// Decodes the speech ahead of time, nullptr if mix() decodes it (see Settings::bDecodeAhead)
+	std::unique_ptr< AudioOutputDecoder > m_decoder;
+	/// The HRIRs the positional sources are spatialized with, nullptr if they are panned instead (see
+	/// Settings::bPositionalHRTF)
+	std::shared_ptr< const AudioSpatializer::Dataset > m_hrtf;
+	/// The sound files playSample() has played recently. As the output is restarted whenever the settings are
+	/// applied, the cache doesn't outlive them.
+	std::unique_ptr< AudioSampleCache > m_sampleCache;
+
+	/// A change of the sources mix() mixes. The threads that create, remove or position buffers post these, and
+	/// mix() applies them at its start. This way, the mixer never has to wait for a lock.
+	struct SourceCommand {
+		enum Type { Add, Remove, Position };
+
+		Type type;
+		const ClientUser *user;
+		AudioOutputBuffer *buffer;
+		std::array< float, 3 > position;
+	};
+	/// A buffer as mix() knows it, along with the user it belongs to (nullptr for samples)
+	struct MixSource {
+		const ClientUser *user;
+		AudioOutputBuffer *buffer;
+	};
+
+	static constexpr std::size_t COMMAND_CAPACITY = 1024;
+	/// A ring of the commands that haven't been applied yet, filled by any thread and emptied by mix()
+	std::array< SourceCommand, COMMAND_CAPACITY > m_commands;
+	std::atomic< std::size_t > m_commandsHead{ 0 };
+	std::atomic< std::size_t > m_commandsTail{ 0 };
+	/// Serializes the threads that post commands
+	std::mutex m_commandMutex;
+	/// Incremented when mix() starts and when it ends, which makes it odd while mixing
+	std::atomic< unsigned int > m_mixEpoch{ 0 };
+	/// The sources mix() mixes, which only it accesses. Together with qmOutputs (which is what the other threads use
+	/// to look the buffers up), they form a double-buffered registry of the sources that's kept in sync by the
+	/// commands.
+	std::vector< MixSource > m_mixSources;
+	/// The number of frames (at SAMPLE_RATE) the device consumes at once, 0 if the backend doesn't report it
+	std::atomic< unsigned int > m_devicePeriod{ 0 };
+	/// The mono mix of a speaker (or of everything, in mixdown mode) that mix() hands to the recorder, which copies it
+	std::vector< float > m_recordBuffer;
+	/// When mix() has been called last, while an AudioBenchmark is running
+	quint64 m_lastMix = 0;
+
+	/// Blocks while the ring is full, which only lasts until the next mix()
+	void postCommand(const SourceCommand &command);
+	void applyCommands();
+	/// Waits until mix() no longer uses a buffer that a posted command has removed (which is at most until the end
+	/// of the mix in progress)
+	void waitForMixer();
+
 	void removeBuffer(AudioOutputBuffer *);
+	/// @returns The largest number of frames (at SAMPLE_RATE) the audio sources are asked for at once
+	unsigned int mixBufferSize() const;
 
 private slots:
 	void handleInvalidatedBuffer(AudioOutputBuffer *);
-	void handlePositionedBuffer(AudioOutputBuffer *, float x, float y, float z);
 
 protected:
 	enum { SampleShort, SampleFloat } eSampleFormat = SampleFloat;
@@ -93,6 +159,7 @@ protected:
 	unsigned int iChannels                          = 0;
 	unsigned int iSampleSize                        = 0;
 	unsigned int iBufferSize                        = 0;
+	/// Guards qmOutputs, which the mixer doesn't use (see m_mixSources)
 	QReadWriteLock qrwlOutputs;
 	QMultiHash< const ClientUser *, AudioOutputBuffer * > qmOutputs;
 
@@ -102,6 +169,10 @@ protected:
 
 	void initializeMixer(const unsigned int *chanmasks, bool forceheadphone = false);
 	bool mix(void *output, unsigned int frameCount);
+	/// Reports how many frames (at SAMPLE_RATE) the device consumes at once, which the jitter buffers of the speech
+	/// that starts afterwards hold at least (as every mix takes as much out of them). May be called from the audio
+	/// callback.
+	void setDevicePeriod(unsigned int frames);
 
 public:
 	void wipe();
@@ -118,7 +189,19 @@ public:
 	/// and is guaranteed to be called on the application's main thread.
 	~AudioOutput() Q_DECL_OVERRIDE;
 
-	void addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::AudioData &audioData);
+	/// A frame that has been received from the network
+	struct ReceivedFrame {
+		ClientUser *sender;
+		Mumble::Protocol::AudioData audioData;
+		/// When the frame's packet has arrived (see AudioLatency::now())
+		quint64 arrival;
+	};
+
+	/// @param arrival When the frame's packet has arrived (see AudioLatency::now()), 0 for now
+	void addFrameToBuffer(ClientUser *sender, const Mumble::Protocol::AudioData &audioData, quint64 arrival = 0);
+	/// Same as addFrameToBuffer, but for several frames (of possibly different senders) at once, which only locks the
+	/// outputs once for all of them (unless a sender's buffer has to be created first)
+	void addFramesToBuffer(const std::vector< ReceivedFrame > &frames);
 	AudioOutputToken playSample(const QString &filename, float volume, bool loop = false);
 	void run() Q_DECL_OVERRIDE = 0;
 	virtual bool isAlive() const;
@@ -152,7 +235,6 @@ signals:
 								unsigned int sampleRate, bool *modifiedAudio);
 
 	void bufferInvalidated(AudioOutputBuffer *);
-	void bufferPositionChanged(AudioOutputBuffer *, float x, float y, float z);
 };
 
 #endif
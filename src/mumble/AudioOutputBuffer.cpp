@@ -5,6 +5,8 @@
 
 #include "AudioOutputBuffer.h"
 
+#include "AudioSpatializer.h"
+
 AudioOutputBuffer::~AudioOutputBuffer() {
 	delete[] pfBuffer;
 	delete[] pfVolume;
@@ -11,6 +11,8 @@
 #include <array>
 #include <memory>
 
+class AudioSpatializer;
+
 class AudioOutputBuffer : public QObject {
 private:
 	Q_OBJECT
@@ -32,6 +34,8 @@ public:
 	float *pfVolume                   = nullptr;
 	float m_suggestedVolumeAdjustment = 1.0f;
 	std::unique_ptr< unsigned int[] > piOffset;
+	/// Spatializes the buffer's audio if it is positional and HRTFs are used
+	std::unique_ptr< AudioSpatializer > spatializer;
 	std::array< float, 3 > fPos = { 0.0, 0.0, 0.0 };
 	bool bStereo;
 	virtual bool prepareSampleBuffer(unsigned int snum) = 0;
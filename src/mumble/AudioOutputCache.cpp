@@ -38,6 +38,14 @@ Mumble::Protocol::audio_context_t AudioOutputCache::getContext() const {
 	return m_audioContext;
 }
 
+bool AudioOutputCache::decodeFEC() const {
+	return m_decodeFEC;
+}
+
+void AudioOutputCache::setDecodeFEC(bool decodeFEC) {
+	m_decodeFEC = decodeFEC;
+}
+
 void AudioOutputCache::setCapacity(std::size_t capacity) {
 	m_audioData.reserve(capacity);
 }
@@ -52,6 +60,7 @@ void AudioOutputCache::loadFrom(const Mumble::Protocol::AudioData &audioData) {
 	m_isLastFrame      = audioData.isLastFrame;
 	m_volumeAdjustment = audioData.volumeAdjustment.factor;
 	m_audioContext     = static_cast< Mumble::Protocol::audio_context_t >(audioData.targetOrContext);
+	m_decodeFEC        = false;
 
 	// And finally copy positional data, if available
 	if (audioData.containsPositionalData) {
@@ -79,3 +88,53 @@ bool AudioOutputCache::isValid() const {
 AudioOutputCache::operator bool() const {
 	return isValid();
 }
+
+constexpr std::size_t AudioOutputCachePool::INVALID_INDEX;
+
+AudioOutputCachePool::AudioOutputCachePool(std::size_t size)
+	: m_caches(size), m_next(new std::atomic< std::uint32_t >[size]), m_head(size > 0 ? 0 : END) {
+	assert(size < END);
+
+	for (std::size_t i = 0; i < size; ++i) {
+		m_caches[i].setCapacity(Mumble::Protocol::MAX_UDP_PACKET_SIZE);
+		m_next[i].store(i + 1 < size ? static_cast< std::uint32_t >(i + 1) : END, std::memory_order_relaxed);
+	}
+}
+
+std::size_t AudioOutputCachePool::acquire() {
+	std::uint64_t head = m_head.load(std::memory_order_acquire);
+	while (true) {
+		const std::uint32_t index = static_cast< std::uint32_t >(head);
+		if (index == END) {
+			return INVALID_INDEX;
+		}
+
+		const std::uint64_t next = ((head >> 32) + 1) << 32 | m_next[index].load(std::memory_order_relaxed);
+		if (m_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+			return index;
+		}
+	}
+}
+
+void AudioOutputCachePool::release(std::size_t index) {
+	assert(index < m_caches.size());
+
+	m_caches[index].clear();
+
+	std::uint64_t head = m_head.load(std::memory_order_relaxed);
+	std::uint64_t next = 0;
+	do {
+		m_next[index].store(static_cast< std::uint32_t >(head), std::memory_order_relaxed);
+		next = ((head >> 32) + 1) << 32 | index;
+	} while (!m_head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+AudioOutputCache &AudioOutputCachePool::operator[](std::size_t index) {
+	assert(index < m_caches.size());
+
+	return m_caches[index];
+}
+
+std::size_t AudioOutputCachePool::size() const {
+	return m_caches.size();
+}
@@ -9,6 +9,10 @@
 #include "MumbleProtocol.h"
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <vector>
 
 #include <gsl/span>
@@ -28,6 +32,11 @@ public:
 
 	Mumble::Protocol::audio_context_t getContext() const;
 
+	/// Whether the audio data is the packet following a lost one, which is to be decoded from the packet's in-band
+	/// FEC instead of the packet itself
+	bool decodeFEC() const;
+	void setDecodeFEC(bool decodeFEC);
+
 	void setCapacity(std::size_t capacity);
 
 	void loadFrom(const Mumble::Protocol::AudioData &audioData);
@@ -44,7 +53,40 @@ private:
 	Mumble::Protocol::audio_context_t m_audioContext = Mumble::Protocol::AudioContext::INVALID;
 	float m_volumeAdjustment                         = 1.0f;
 	bool m_containsPosition                          = false;
+	bool m_decodeFEC                                 = false;
 	std::array< float, 3 > m_position;
 };
 
+/// A fixed number of caches, which are handed out and taken back without locking or allocating, so that the network
+/// thread and the audio thread don't contend for them. The caches retain the capacity for the largest audio packet,
+/// which means that loading a packet into one doesn't allocate either.
+class AudioOutputCachePool {
+public:
+	/// Returned by acquire() if all caches are taken
+	static constexpr std::size_t INVALID_INDEX = std::numeric_limits< std::size_t >::max();
+
+	explicit AudioOutputCachePool(std::size_t size);
+
+	/// Takes a cache out of the pool, which the caller may access exclusively until it releases it
+	///
+	/// @returns The index of the cache or INVALID_INDEX if all of them are taken
+	std::size_t acquire();
+	/// Clears the cache with the given index and returns it to the pool
+	void release(std::size_t index);
+
+	AudioOutputCache &operator[](std::size_t index);
+	std::size_t size() const;
+
+private:
+	static constexpr std::uint32_t END = std::numeric_limits< std::uint32_t >::max();
+
+	std::vector< AudioOutputCache > m_caches;
+	/// The free caches form a list, whose links are the index of the next free cache
+	std::unique_ptr< std::atomic< std::uint32_t >[] > m_next;
+	/// The index of the first free cache (in the lower half) and a counter of the changes to the list (in the upper
+	/// half), which prevents a cache that has been taken and returned meanwhile from being mistaken for still being
+	/// the first one (ABA)
+	std::atomic< std::uint64_t > m_head;
+};
+
 #endif // MUMBLE_MUMBLE_AUDIOCACHE_H_
@@ -0,0 +1,97 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioOutputDecoder.h"
+
+#include "AudioOutputSpeech.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace {
+/// How long an idle worker sleeps at most, which bounds the delay caused by a wakeup that got lost. It is well below
+/// the duration of the frames that have been decoded ahead.
+constexpr std::chrono::milliseconds WAKEUP_TIMEOUT(2);
+} // namespace
+
+AudioOutputDecoder::AudioOutputDecoder(unsigned int threads) {
+	for (unsigned int i = 0; i < std::max(threads, 1U); ++i) {
+		m_workers.emplace_back(&AudioOutputDecoder::run, this);
+	}
+}
+
+AudioOutputDecoder::~AudioOutputDecoder() {
+	{
+		std::lock_guard< std::mutex > lock(m_mutex);
+		assert(m_speeches.empty());
+		m_stop = true;
+	}
+	m_wakeup.notify_all();
+
+	for (std::thread &worker : m_workers) {
+		worker.join();
+	}
+}
+
+unsigned int AudioOutputDecoder::defaultThreadCount() {
+	// Leave a core to the audio thread and the rest of the application
+	const unsigned int cores = std::thread::hardware_concurrency();
+	return std::min(std::max(cores, 2U) - 1, 4U);
+}
+
+void AudioOutputDecoder::add(AudioOutputSpeech *speech) {
+	{
+		std::lock_guard< std::mutex > lock(m_mutex);
+		m_speeches.push_back(speech);
+	}
+	m_wakeup.notify_one();
+}
+
+void AudioOutputDecoder::remove(AudioOutputSpeech *speech) {
+	std::unique_lock< std::mutex > lock(m_mutex);
+	m_speeches.erase(std::remove(m_speeches.begin(), m_speeches.end(), speech), m_speeches.end());
+
+	// Workers only claim speeches while holding the mutex and the audio thread never decodes a speech while it is
+	// being removed (which happens with the outputs locked for writing), so no one can claim it from now on
+	m_released.wait(lock, [speech]() { return !speech->isDecoding(); });
+}
+
+void AudioOutputDecoder::wake() {
+	m_wakeups.fetch_add(1, std::memory_order_relaxed);
+	m_wakeup.notify_one();
+}
+
+void AudioOutputDecoder::run() {
+	std::unique_lock< std::mutex > lock(m_mutex);
+
+	while (!m_stop) {
+		const unsigned int wakeups = m_wakeups.load(std::memory_order_relaxed);
+		bool decoded               = false;
+
+		// The list may change while a speech is being decoded, in which case a speech might be skipped or visited
+		// twice. Either way, the next round takes care of it.
+		for (std::size_t i = 0; i < m_speeches.size(); ++i) {
+			AudioOutputSpeech *speech = m_speeches[i];
+			if (!speech->claimDecoding()) {
+				// Another worker (or the audio thread) is at it
+				continue;
+			}
+
+			lock.unlock();
+			decoded = speech->decodeAhead() || decoded;
+			lock.lock();
+
+			speech->releaseDecoding();
+			m_released.notify_all();
+		}
+
+		if (!decoded) {
+			m_wakeup.wait_for(lock, WAKEUP_TIMEOUT, [this, wakeups]() {
+				return m_stop || m_wakeups.load(std::memory_order_relaxed) != wakeups;
+			});
+		}
+	}
+}
@@ -0,0 +1,63 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOOUTPUTDECODER_H_
+#define MUMBLE_MUMBLE_AUDIOOUTPUTDECODER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class AudioOutputSpeech;
+
+/// A pool of worker threads that decode the speech of every talking user ahead of time, so that the audio thread
+/// only has to mix the decoded samples (instead of decoding on its own for every speaker, which may overrun the
+/// device's deadline when many users talk at once).
+///
+/// The workers take the packets from the speeches' jitter buffers in the same order and with the same bookkeeping as
+/// AudioOutputSpeech::prepareSampleBuffer() would, but up to AudioOutputSpeech::DECODE_AHEAD_FRAMES frames before they
+/// are played. The jitter buffers see packets that arrive within that time as late and adapt their delay to it, which
+/// is what the decoding ahead costs in latency.
+class AudioOutputDecoder {
+public:
+	/// Starts the given number of workers
+	explicit AudioOutputDecoder(unsigned int threads);
+	/// Stops the workers. All speeches have to have been removed before.
+	~AudioOutputDecoder();
+
+	/// @returns The number of workers that suits the machine
+	static unsigned int defaultThreadCount();
+
+	/// Makes the workers decode the given speech
+	void add(AudioOutputSpeech *speech);
+	/// Makes the workers forget the given speech, waiting for the one that might be decoding it
+	void remove(AudioOutputSpeech *speech);
+
+	/// Tells the workers that frames have been played. This neither locks nor allocates, which is why the audio thread
+	/// may call it.
+	void wake();
+
+private:
+	Q_DISABLE_COPY(AudioOutputDecoder)
+
+	void run();
+
+	std::mutex m_mutex;
+	/// Notified by wake() (without the mutex being locked, which is why the workers only wait for so long)
+	std::condition_variable m_wakeup;
+	/// Notified whenever a worker is done decoding a speech
+	std::condition_variable m_released;
+	std::vector< AudioOutputSpeech * > m_speeches;
+	std::vector< std::thread > m_workers;
+	/// Counts the calls of wake(), so that a worker doesn't go to sleep on frames that have been played meanwhile
+	std::atomic< unsigned int > m_wakeups{ 0 };
+	bool m_stop = false;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOOUTPUTDECODER_H_
@@ -9,9 +9,11 @@
 #include "Utils.h"
 
 #include <QtCore/QDebug>
+#include <QtCore/QFileInfo>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QMessageBox>
 
+#include <algorithm>
 #include <cmath>
 
 SoundFile::SoundFile(const QString &fname) {
@@ -55,6 +57,10 @@ int SoundFile::samplerate() const {
 	return siInfo.samplerate;
 }
 
+sf_count_t SoundFile::frames() const {
+	return siInfo.frames;
+}
+
 int SoundFile::error() const {
 	return sf_error(sfFile);
 }
@@ -125,8 +131,6 @@ sf_count_t SoundFile::vio_tell(void *user_data) {
 
 AudioOutputSample::AudioOutputSample(SoundFile *psndfile, float volume, bool loop, unsigned int freq,
 									 unsigned int systemMaxBufferSize) {
-	int err;
-
 	sfHandle       = psndfile;
 	iOutSampleRate = freq;
 
@@ -149,17 +153,13 @@ AudioOutputSample::AudioOutputSample(SoundFile *psndfile, float volume, bool loo
 	qWarning() << "Format: " << sfHandle->format() << endl; */
 
 	// If the frequencies don't match initialize the resampler
-	if (sfHandle->samplerate() != static_cast< int >(freq)) {
-		srs = speex_resampler_init(bStereo ? 2 : 1, static_cast< unsigned int >(sfHandle->samplerate()), iOutSampleRate,
-								   3, &err);
-		if (err != RESAMPLER_ERR_SUCCESS) {
-			qWarning() << "Initialize " << sfHandle->samplerate() << " to " << iOutSampleRate << " resampler failed!";
-			srs      = nullptr;
-			sfHandle = nullptr;
-			return;
-		}
-	} else {
-		srs = nullptr;
+	if (sfHandle->samplerate() <= 0) {
+		qWarning() << "Initialize " << sfHandle->samplerate() << " to " << iOutSampleRate << " resampler failed!";
+		sfHandle = nullptr;
+		return;
+	} else if (sfHandle->samplerate() != static_cast< int >(freq)) {
+		m_resampler = std::make_unique< AudioResampler >(
+			bStereo ? 2 : 1, static_cast< unsigned int >(sfHandle->samplerate()), iOutSampleRate);
 	}
 
 	iLastConsume = iBufferFilled = 0;
@@ -168,14 +168,26 @@ AudioOutputSample::AudioOutputSample(SoundFile *psndfile, float volume, bool loo
 	bEof                         = false;
 }
 
+AudioOutputSample::AudioOutputSample(std::shared_ptr< const DecodedSample > sample, float volume, bool loop,
+									 unsigned int systemMaxBufferSize)
+	: sfHandle(nullptr), m_decoded(std::move(sample)) {
+	bStereo        = m_decoded->channels == 2;
+	iBufferSize    = bStereo ? systemMaxBufferSize * 2 : systemMaxBufferSize;
+	iOutSampleRate = SAMPLE_RATE;
+
+	pfBuffer = new float[iBufferSize];
+
+	iLastConsume = iBufferFilled = 0;
+	m_volume                     = volume;
+	bLoop                        = loop;
+	bEof                         = false;
+}
+
 float AudioOutputSample::getVolume() const {
 	return m_volume;
 }
 
 AudioOutputSample::~AudioOutputSample() {
-	if (srs)
-		speex_resampler_destroy(srs);
-
 	delete sfHandle;
 	sfHandle = nullptr;
 }
@@ -238,43 +250,40 @@ bool AudioOutputSample::prepareSampleBuffer(unsigned int frameCount) {
 		return true;
 
 	// Calculate the required buffersize to hold the results
-	unsigned int iInputFrames = static_cast< unsigned int >(
-		ceilf(static_cast< float >(frameCount * static_cast< unsigned int >(sfHandle->samplerate()))
-			  / static_cast< float >(iOutSampleRate)));
-	unsigned int iInputSamples = iInputFrames * channels;
-
 	static std::vector< float > fOut;
-	fOut.resize(iInputSamples);
+	if (m_resampler) {
+		fOut.resize(m_resampler->maxInputFramesFor(frameCount) * channels);
+	}
 
 	bool eof = false;
 	sf_count_t read;
 	do {
 		resizeBuffer(iBufferFilled + sampleCount + INTERAURAL_DELAY);
 
+		// The resampler asks for exactly as many frames as it needs for frameCount
+		const unsigned int iInputFrames  = m_resampler ? m_resampler->inputFramesFor(frameCount) : frameCount;
+		const unsigned int iInputSamples = iInputFrames * channels;
+
 		// If we need to resample, write to the buffer on stack
-		float *pOut = (srs) ? fOut.data() : pfBuffer + iBufferFilled;
+		float *pOut = (m_resampler) ? fOut.data() : pfBuffer + iBufferFilled;
 
 		// Try to read all samples needed to satisfy this request
-		if ((read = sfHandle->read(pOut, iInputSamples)) < iInputSamples) {
-			if (sfHandle->error() != SF_ERR_NO_ERROR || !bLoop) {
+		if ((read = this->read(pOut, iInputSamples)) < iInputSamples) {
+			if (hasError() || !bLoop) {
 				// We reached the eof or encountered an error, stuff with zeroes
 				memset(pOut, 0, sizeof(float) * static_cast< std::size_t >(iInputSamples - read));
 				read = iInputSamples;
 				eof  = true;
 			} else {
-				sfHandle->seek(SEEK_SET, 0);
+				rewind();
 			}
 		}
 
-		spx_uint32_t inlen  = static_cast< unsigned int >(read) / channels;
-		spx_uint32_t outlen = frameCount;
-		if (srs) {
+		const unsigned int inlen = static_cast< unsigned int >(read) / channels;
+		unsigned int outlen      = frameCount;
+		if (m_resampler) {
 			// If necessary resample
-			if (!bStereo) {
-				speex_resampler_process_float(srs, 0, pOut, &inlen, pfBuffer + iBufferFilled, &outlen);
-			} else {
-				speex_resampler_process_interleaved_float(srs, pOut, &inlen, pfBuffer + iBufferFilled, &outlen);
-			}
+			outlen = m_resampler->process(pOut, inlen, pfBuffer + iBufferFilled, frameCount);
 		}
 
 		iBufferFilled += outlen * channels;
@@ -287,3 +296,129 @@ bool AudioOutputSample::prepareSampleBuffer(unsigned int frameCount) {
 
 	return !eof;
 }
+
+sf_count_t AudioOutputSample::read(float *out, unsigned int samples) {
+	if (!m_decoded) {
+		return sfHandle->read(out, samples);
+	}
+
+	const std::size_t count = std::min(static_cast< std::size_t >(samples), m_decoded->samples.size() - m_position);
+	std::copy(m_decoded->samples.begin() + static_cast< std::ptrdiff_t >(m_position),
+			  m_decoded->samples.begin() + static_cast< std::ptrdiff_t >(m_position + count), out);
+	m_position += count;
+
+	return static_cast< sf_count_t >(count);
+}
+
+bool AudioOutputSample::hasError() const {
+	return !m_decoded && sfHandle->error() != SF_ERR_NO_ERROR;
+}
+
+void AudioOutputSample::rewind() {
+	if (m_decoded) {
+		m_position = 0;
+	} else {
+		sfHandle->seek(0, SEEK_SET);
+	}
+}
+
+std::shared_ptr< const DecodedSample > AudioSampleCache::get(const QString &filename, unsigned int rate) {
+	const QFileInfo info(filename);
+	const QDateTime modified = info.lastModified();
+	const qint64 fileSize    = info.size();
+
+	QMutexLocker lock(&m_mutex);
+
+	for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+		if (it->filename != filename || it->rate != rate) {
+			continue;
+		}
+
+		if (it->modified == modified && it->fileSize == fileSize) {
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			return m_entries.front().sample;
+		}
+
+		// The file has been modified since it has been decoded
+		m_size -= it->sample->samples.size() * sizeof(float);
+		m_entries.erase(it);
+		break;
+	}
+
+	std::unique_ptr< SoundFile > file(AudioOutputSample::loadSndfile(filename));
+	if (!file) {
+		return nullptr;
+	}
+
+	std::shared_ptr< const DecodedSample > sample = decode(*file, rate);
+	if (!sample) {
+		return nullptr;
+	}
+
+	m_entries.push_front({ filename, rate, modified, fileSize, sample });
+	m_size += sample->samples.size() * sizeof(float);
+
+	while (m_size > MAX_SIZE) {
+		// The playbacks that still use an evicted sample keep it alive until they are done
+		m_size -= m_entries.back().sample->samples.size() * sizeof(float);
+		m_entries.pop_back();
+	}
+
+	return sample;
+}
+
+void AudioSampleCache::clear() {
+	QMutexLocker lock(&m_mutex);
+
+	m_entries.clear();
+	m_size = 0;
+}
+
+std::shared_ptr< const DecodedSample > AudioSampleCache::decode(SoundFile &file, unsigned int rate) {
+	const unsigned int channels = static_cast< unsigned int >(file.channels());
+	const unsigned int fileRate = static_cast< unsigned int >(file.samplerate());
+	if (file.frames() <= 0 || fileRate == 0) {
+		return nullptr;
+	}
+
+	const std::uint64_t frames =
+		(static_cast< std::uint64_t >(file.frames()) * rate + fileRate - 1) / static_cast< std::uint64_t >(fileRate);
+	if (frames * channels * sizeof(float) > MAX_SAMPLE_SIZE) {
+		return nullptr;
+	}
+
+	auto sample      = std::make_shared< DecodedSample >();
+	sample->channels = channels;
+	// Zeroed, so that whatever can't be read is silence
+	sample->samples.resize(static_cast< std::size_t >(frames * channels));
+
+	if (fileRate == rate) {
+		file.read(sample->samples.data(), static_cast< sf_count_t >(sample->samples.size()));
+		return sample;
+	}
+
+	// Converted in blocks, as the resampler only buffers so much of its input
+	constexpr unsigned int BLOCK_FRAMES = 1024;
+	AudioResampler resampler(channels, fileRate, rate);
+	std::vector< float > in(resampler.maxInputFramesFor(BLOCK_FRAMES) * channels);
+
+	std::uint64_t done = 0;
+	while (done < frames) {
+		const unsigned int outFrames =
+			static_cast< unsigned int >(std::min< std::uint64_t >(BLOCK_FRAMES, frames - done));
+
+		const unsigned int inFrames = resampler.inputFramesFor(outFrames);
+
+		const sf_count_t read = std::max< sf_count_t >(file.read(in.data(), inFrames * channels), 0);
+		std::fill(in.begin() + read, in.begin() + inFrames * channels, 0.0f);
+
+		const unsigned int written =
+			resampler.process(in.data(), inFrames, sample->samples.data() + done * channels, outFrames);
+		if (written == 0) {
+			break;
+		}
+		done += written;
+	}
+
+	return sample;
+}
@@ -6,12 +6,18 @@
 #ifndef MUMBLE_MUMBLE_AUDIOOUTPUTSAMPLE_H_
 #define MUMBLE_MUMBLE_AUDIOOUTPUTSAMPLE_H_
 
+#include <QtCore/QDateTime>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <sndfile.h>
-#include <speex/speex_resampler.h>
 
 #include "AudioOutputBuffer.h"
+#include "AudioResampler.h"
+
+#include <list>
+#include <memory>
+#include <vector>
 
 class SoundFile : public QObject {
 private:
@@ -33,6 +39,8 @@ public:
 
 	int channels() const;
 	int samplerate() const;
+	/// @returns The length of the file in frames, which may be unknown (0)
+	sf_count_t frames() const;
 	int error() const;
 	QString strError() const;
 	bool isOpen() const;
@@ -41,6 +49,51 @@ public:
 	sf_count_t read(float *ptr, sf_count_t items);
 };
 
+/// The audio of a sound file, decoded and converted to the rate of the mixer
+struct DecodedSample {
+	/// The interleaved samples
+	std::vector< float > samples;
+	unsigned int channels = 1;
+};
+
+/// Keeps the sound files that have been played recently in memory, decoded and converted to the rate of the mixer, so
+/// that playing them again (like the cues for users joining or leaving) merely takes copying. The samples are shared
+/// by all of the playbacks of a file.
+///
+/// A file is decoded anew once it has been modified. Files that would take up too much memory are left to be streamed
+/// (see AudioOutputSample), and the ones that have been used the longest ago are evicted once the cache as a whole
+/// would exceed its limit.
+class AudioSampleCache {
+public:
+	/// The most memory (in bytes) the decoded samples of a single file may take up, which is about 10 seconds of
+	/// stereo audio at 48 kHz
+	static constexpr std::size_t MAX_SAMPLE_SIZE = 4 * 1024 * 1024;
+	/// The most memory (in bytes) the decoded samples of all files may take up
+	static constexpr std::size_t MAX_SIZE = 16 * 1024 * 1024;
+
+	/// @returns The decoded samples of the given file, converted to the given rate. nullptr if the file can't be
+	/// 	decoded or is too long to be cached.
+	std::shared_ptr< const DecodedSample > get(const QString &filename, unsigned int rate);
+	/// Evicts all of the files
+	void clear();
+
+private:
+	static std::shared_ptr< const DecodedSample > decode(SoundFile &file, unsigned int rate);
+
+	struct Entry {
+		QString filename;
+		unsigned int rate;
+		QDateTime modified;
+		qint64 fileSize;
+		std::shared_ptr< const DecodedSample > sample;
+	};
+
+	QMutex m_mutex;
+	/// The most recently used first
+	std::list< Entry > m_entries;
+	std::size_t m_size = 0;
+};
+
 class AudioOutputSample : public AudioOutputBuffer {
 private:
 	Q_OBJECT
@@ -49,14 +102,26 @@ protected:
 	unsigned int iLastConsume;
 	unsigned int iBufferFilled;
 	unsigned int iOutSampleRate;
-	SpeexResamplerState *srs;
+	/// Converts the file's rate to iOutSampleRate, nullptr if they are the same
+	std::unique_ptr< AudioResampler > m_resampler;
 
 	SoundFile *sfHandle;
+	/// The samples that are played instead of sfHandle, if the file has been cached (see AudioSampleCache)
+	std::shared_ptr< const DecodedSample > m_decoded;
+	/// The position of the playback in m_decoded->samples
+	std::size_t m_position = 0;
 
 	bool bLoop;
 	bool bEof;
 
 	float m_volume;
+
+	/// Reads the given number of samples from the sound file or m_decoded
+	///
+	/// @returns The number of samples that have been read, which is less if the end of the file has been reached
+	sf_count_t read(float *out, unsigned int samples);
+	bool hasError() const;
+	void rewind();
 signals:
 	void playbackFinished();
 
@@ -66,6 +131,9 @@ public:
 	virtual bool prepareSampleBuffer(unsigned int frameCount) Q_DECL_OVERRIDE;
 	float getVolume() const;
 	AudioOutputSample(SoundFile *psndfile, float volume, bool repeat, unsigned int freq, unsigned int bufferSize);
+	/// Plays the given samples, which are at the rate of the mixer already
+	AudioOutputSample(std::shared_ptr< const DecodedSample > sample, float volume, bool repeat,
+					  unsigned int bufferSize);
 	~AudioOutputSample() Q_DECL_OVERRIDE;
 };
 
@@ -6,6 +6,8 @@
 #include "AudioOutputSpeech.h"
 
 #include "Audio.h"
+#include "AudioLatency.h"
+#include "AudioOutputDecoder.h"
 #include "ClientUser.h"
 #include "PacketDataStream.h"
 #include "Utils.h"
@@ -17,49 +19,11 @@
 #include <cassert>
 #include <cmath>
 
-std::mutex AudioOutputSpeech::s_audioCachesMutex;
-std::vector< AudioOutputCache > AudioOutputSpeech::s_audioCaches(100);
-
-void AudioOutputSpeech::invalidateAudioOutputCache(void *maskedIndex) {
-	// The given "pointer" actually is to be understood as an index
-	const std::size_t index = reinterpret_cast< std::size_t >(maskedIndex) - 1;
-
-	std::lock_guard< std::mutex > lock(s_audioCachesMutex);
-
-	if (index < s_audioCaches.size()) {
-		s_audioCaches[index].clear();
-	}
-}
-
-std::size_t AudioOutputSpeech::storeAudioOutputCache(const Mumble::Protocol::AudioData &audioData) {
-	std::lock_guard< std::mutex > lock(s_audioCachesMutex);
-
-	// Find free spot in s_audioCaches
-	auto it = std::find_if(s_audioCaches.begin(), s_audioCaches.end(),
-						   [](const AudioOutputCache &chunk) { return !chunk.isValid(); });
-
-	if (it != s_audioCaches.end()) {
-		// Write audio data to that free (currently unused) chunk
-		it->loadFrom(audioData);
-
-		return static_cast< std::size_t >(std::distance(s_audioCaches.begin(), it));
-	} else {
-		// The list of audio chunks is full -> extend it
-		AudioOutputCache chunk;
-		chunk.loadFrom(audioData);
-
-		s_audioCaches.push_back(std::move(chunk));
-
-		return s_audioCaches.size() - 1;
-	}
-}
-
-
-AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble::Protocol::AudioCodec codec,
-									 unsigned int systemMaxBufferSize)
-	: iMixerFreq(freq), m_codec(codec), p(user) {
-	int err;
-
+AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, Mumble::Protocol::AudioCodec codec, std::uint32_t frameSize,
+									 unsigned int systemMaxBufferSize, unsigned int devicePeriod,
+									 AudioOutputDecoder *decoder)
+	: m_caches(AudioPlayoutBuffer::CAPACITY + 1), m_decoder(decoder), m_codec(codec), m_frameSize(frameSize),
+	  p(user) {
 	opusState = nullptr;
 
 	bHasTerminator = false;
@@ -73,8 +37,9 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble
 	// in opus term, a frame means samples that span a period of time, which can be either stereo or mono
 	// e.Global::get(). ...[LRLR....LRLR].... or ...[MMMM....MMMM].... for mono stream
 	// opus supports frames with: 2.5, 5, 10, 20, 40 or 60 ms of audio data.
-	// sample rate / 100 means 10ms mono audio data per frame.
-	iFrameSizePerChannel = iFrameSize = iSampleRate / 100; // for mono stream
+	// sample rate / 100 means 10ms mono audio data per frame, which is what the speech is counted in unless the
+	// sender uses shorter frames (2.5 or 5 ms). The jitter buffer then holds (and is configured in) these.
+	iFrameSizePerChannel = iFrameSize = frameSize != 0 ? frameSize : iSampleRate / 100; // for mono stream
 
 	assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
 
@@ -102,8 +67,7 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble
 	// the system's audio buffer. In that case, we need to decode a new opus packet. In the worst case, the buffer size
 	// needed is
 	//    60ms of new decoded audio data + system's buffer size - 1.
-	iOutputSize = static_cast< unsigned int >(
-		ceilf(static_cast< float >(iAudioBufferSize * iMixerFreq) / static_cast< float >(iSampleRate)));
+	iOutputSize = iAudioBufferSize;
 	iBufferSize = iOutputSize + systemMaxBufferSize; // -1 has been rounded up
 
 	if (bStereo) {
@@ -115,13 +79,6 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble
 
 	pfBuffer = new float[iBufferSize];
 
-	srs              = nullptr;
-	fResamplerBuffer = nullptr;
-	if (iMixerFreq != iSampleRate) {
-		srs              = speex_resampler_init(bStereo ? 2 : 1, iSampleRate, iMixerFreq, 3, &err);
-		fResamplerBuffer = new float[iAudioBufferSize];
-	}
-
 	iBufferOffset = iBufferFilled = iLastConsume = 0;
 	bLastAlive                                   = true;
 
@@ -130,19 +87,19 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble
 
 	m_audioContext = Mumble::Protocol::AudioContext::INVALID;
 
-	jbJitter   = jitter_buffer_init(static_cast< int >(iFrameSize));
-	int margin = Global::get().s.iJitterBufferSize * static_cast< int >(iFrameSize);
-	jitter_buffer_ctl(jbJitter, JITTER_BUFFER_SET_MARGIN, &margin);
+	// The configured jitter buffer size is the least delay the jitter buffer aims for, the network permitting. It
+	// starts out with the delay the user's last transmission has required. As every mix takes a whole period of the
+	// device out of the buffer, it has to hold at least that much not to run dry in between.
+	const quint64 frameDuration     = static_cast< quint64 >(iFrameSizePerChannel) * 1000000 / iSampleRate;
+	const unsigned int periodFrames = (devicePeriod + iFrameSizePerChannel - 1) / iFrameSizePerChannel;
+	const unsigned int minimumDelay =
+		std::max(static_cast< unsigned int >(std::max(Global::get().s.iJitterBufferSize, 1)), periodFrames);
+
+	m_playout = std::make_unique< AudioPlayoutBuffer >(iFrameSize, frameDuration, minimumDelay,
+													   p ? p->fPlayoutDelay : 0.0f);
 
-	// We are configuring our Jitter buffer to use a custom deleter function. This prevents the buffer from
-	// copying the stored data into the buffer itself and also from releasing the memory of it. Instead it
-	// will now call this "deleter" function instead.
-	// This allows us to manage our own (global) storage for our audio data. With that, we can reuse the same
-	// memory regions in order to avoid frequent memory allocations and deallocations.
-	// Also this is the basis for using our trick of actually only storing indices instead of proper data
-	// pointers in the buffer.
-	jitter_buffer_ctl(jbJitter, JITTER_BUFFER_SET_DESTROY_CALLBACK,
-					  reinterpret_cast< void * >(&AudioOutputSpeech::invalidateAudioOutputCache));
+	const unsigned int channels = bStereo ? 2 : 1;
+	m_stretcher                 = std::make_unique< AudioTimeStretcher >(iSampleRate, channels, iOutputSize / channels);
 
 	fFadeIn  = new float[iFrameSizePerChannel];
 	fFadeOut = new float[iFrameSizePerChannel];
@@ -150,71 +107,114 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Mumble
 	float mul = static_cast< float >(M_PI / (2.0 * static_cast< double >(iFrameSizePerChannel)));
 	for (unsigned int i = 0; i < iFrameSizePerChannel; ++i)
 		fFadeIn[i] = fFadeOut[iFrameSizePerChannel - i - 1] = sinf(static_cast< float >(i) * mul);
+
+	if (m_decoder) {
+		for (DecodedFrame &frame : m_decodedFrames) {
+			frame.samples.resize(iOutputSize);
+		}
+
+		m_decoder->add(this);
+	}
 }
 
 AudioOutputSpeech::~AudioOutputSpeech() {
+	if (m_decoder) {
+		// Waits for a worker that might still be decoding
+		m_decoder->remove(this);
+	}
+
 	if (opusState) {
 		opus_decoder_destroy(opusState);
 	}
 
-	if (srs)
-		speex_resampler_destroy(srs);
-
-	jitter_buffer_destroy(jbJitter);
-
 	if (p) {
+		p->fPlayoutDelay = static_cast< float >(m_playout->targetDelay());
 		p->setTalking(Settings::Passive);
 	}
 
 	delete[] fFadeIn;
 	delete[] fFadeOut;
-	delete[] fResamplerBuffer;
 }
 
-void AudioOutputSpeech::addFrameToBuffer(const Mumble::Protocol::AudioData &audioData) {
+void AudioOutputSpeech::addFrameToBuffer(const Mumble::Protocol::AudioData &audioData, quint64 arrival) {
 	QMutexLocker lock(&qmJitter);
 
 	if (audioData.payload.empty()) {
 		return;
 	}
 
-	int samples = 0;
+	if (arrival == 0) {
+		arrival = AudioLatency::now();
+	}
 
 	assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
 	assert(audioData.usedCodec == m_codec);
 
-	samples = opus_decoder_get_nb_samples(
-		opusState, audioData.payload.data(),
-		static_cast< int >(audioData.payload.size())); // this function return samples per channel
-	samples *= 2;                                      // since we assume all input stream is stereo.
-
+	const int samples = samplesOf(audioData.payload);
 	// We can't handle frames which are not a multiple of our configured framesize.
-	if (static_cast< unsigned int >(samples) % iFrameSize != 0) {
-		qWarning("AudioOutputSpeech: Dropping Opus audio packet, because its sample count (%d) is not a "
-				 "multiple of our frame size (%d)",
-				 samples, iFrameSize);
+	if (samples == 0) {
+		qWarning("AudioOutputSpeech: Dropping Opus audio packet, because its sample count is not a multiple of our "
+				 "frame size (%d)",
+				 iFrameSize);
 		return;
 	}
 
-	// Copy the audio data to an AudioOutputCache instance and store that in our global chunk list
-	std::size_t storageIndex = storeAudioOutputCache(audioData);
-
-	// We cheat a bit and instead of storing the actual audio data in the jitter buffer, we store the index to
-	// the created audio chunk in the buffer. Passing a length of 0 should ensure that this "pointer" will never
-	// be dereferenced.
-
-	// A call to jitter_buffer_put stores the packet in an internal array used for book-keeping.
-	// The library uses jbp.data == NULL to differentiate between unused and reserved elements
-	// of the book-keeping array.
-	// Since a storageIndex of zero will look the same as a null pointer, we always add one to
-	// ensure the library never erroneously confuses this entry with a free slot.
-	JitterBufferPacket jbp;
-	jbp.data      = reinterpret_cast< char * >(storageIndex) + 1;
-	jbp.len       = 0;
-	jbp.span      = static_cast< unsigned int >(samples);
-	jbp.timestamp = static_cast< unsigned int >(iFrameSize * audioData.frameNumber);
-
-	jitter_buffer_put(jbJitter, &jbp);
+	const int redundantSamples = audioData.redundantPayload.empty() ? 0 : samplesOf(audioData.redundantPayload);
+	const AudioFrameRecovery::Recovery recovery =
+		m_recovery.receive(audioData.frameNumber, static_cast< unsigned int >(samples) / iFrameSize,
+						   static_cast< unsigned int >(redundantSamples) / iFrameSize, audioData.isLastFrame);
+	if (!recovery.play) {
+		return;
+	}
+
+	if (recovery.source != AudioFrameRecovery::Source::None) {
+		// Make up for the packet that should have preceded this one
+		Mumble::Protocol::AudioData previous = audioData;
+		previous.frameNumber                 = recovery.frameNumber;
+		previous.redundantPayload            = {};
+		previous.isLastFrame                 = false;
+
+		if (recovery.source == AudioFrameRecovery::Source::RedundantPayload) {
+			previous.payload = audioData.redundantPayload;
+			putFrame(previous, redundantSamples, false, arrival);
+		} else {
+			putFrame(previous, samples, true, arrival);
+		}
+	}
+
+	putFrame(audioData, samples, false, arrival);
+}
+
+int AudioOutputSpeech::samplesOf(gsl::span< const Mumble::Protocol::byte > payload) const {
+	// opus_decoder_get_nb_samples() returns the samples per channel, but all streams are assumed to be stereo
+	const int samples =
+		2 * opus_decoder_get_nb_samples(opusState, payload.data(), static_cast< opus_int32 >(payload.size()));
+
+	return samples > 0 && static_cast< unsigned int >(samples) % iFrameSize == 0 ? samples : 0;
+}
+
+void AudioOutputSpeech::putFrame(const Mumble::Protocol::AudioData &audioData, int samples, bool decodeFEC,
+								 quint64 arrival) {
+	// Copy the audio data to one of our caches. The jitter buffer only stores the index of that cache, which allows us
+	// to reuse the same memory regions in order to avoid frequent memory allocations and deallocations.
+	const std::size_t index = m_caches.acquire();
+	if (index == AudioOutputCachePool::INVALID_INDEX) {
+		// The jitter buffer is full
+		return;
+	}
+	m_caches[index].loadFrom(audioData);
+	m_caches[index].setDecodeFEC(decodeFEC);
+
+	AudioPlayoutBuffer::Packet packet;
+	packet.payload   = index;
+	packet.timestamp = static_cast< std::uint64_t >(iFrameSize) * audioData.frameNumber;
+	packet.span      = static_cast< unsigned int >(samples);
+	packet.arrival   = arrival;
+
+	if (!m_playout->put(packet)) {
+		// The packet has arrived too late to be played (or is a duplicate)
+		m_caches.release(index);
+	}
 }
 
 bool AudioOutputSpeech::prepareSampleBuffer(unsigned int frameCount) {
@@ -237,251 +237,333 @@ bool AudioOutputSpeech::prepareSampleBuffer(unsigned int frameCount) {
 	if (iBufferFilled >= sampleCount + INTERAURAL_DELAY)
 		return bLastAlive;
 
-	float *pOut;
 	bool nextalive = bLastAlive;
 
 	while (iBufferFilled < sampleCount + INTERAURAL_DELAY) {
-		int decodedSamples = static_cast< int >(iFrameSize);
 		resizeBuffer(iBufferFilled + iOutputSize + INTERAURAL_DELAY);
 		// TODO: allocating memory in the audio callback will crash mumble in some cases.
 		//       we need to initialize the buffer with an appropriate size when initializing
 		//       this class. See #4250.
 
-		pOut = (srs) ? fResamplerBuffer : (pfBuffer + iBufferFilled);
+		float *pOut = pfBuffer + iBufferFilled;
 
-		if (!bLastAlive) {
-			memset(pOut, 0, iFrameSize * sizeof(float));
+		if (m_decoder) {
+			iBufferFilled += takeDecodedFrame(pOut, nextalive);
 		} else {
-			if (p == &LoopUser::lpLoopy) {
-				LoopUser::lpLoopy.fetchFrames();
-			}
-
-			int avail = 0;
-			int ts    = jitter_buffer_get_pointer_timestamp(jbJitter);
-			jitter_buffer_ctl(jbJitter, JITTER_BUFFER_GET_AVAILABLE_COUNT, &avail);
-
-			if (p && (ts == 0)) {
-				int want = static_cast< int >(p->fAverageAvailable);
-				if (avail < want) {
-					++iMissCount;
-					if (iMissCount < 20) {
-						memset(pOut, 0, iFrameSize * sizeof(float));
-						goto nextframe;
-					}
-				}
-			}
+			FrameInfo info;
+			info.alive = nextalive;
+			iBufferFilled += decodeFrame(pOut, bLastAlive, info);
+			applyFrameInfo(info);
+			nextalive = info.alive;
+		}
+	}
 
-			if (qlFrames.isEmpty()) {
-				QMutexLocker lock(&qmJitter);
+	if (p) {
+		Settings::TalkState ts;
+		if (!nextalive) {
+			m_audioContext = Mumble::Protocol::AudioContext::INVALID;
+		}
 
-				JitterBufferPacket jbp;
+		switch (m_audioContext) {
+			case Mumble::Protocol::AudioContext::LISTEN:
+				// Fallthrough
+			case Mumble::Protocol::AudioContext::NORMAL:
+				ts = Settings::Talking;
+				break;
+			case Mumble::Protocol::AudioContext::SHOUT:
+				ts = Settings::Shouting;
+				break;
+			case Mumble::Protocol::AudioContext::INVALID:
+				ts = Settings::Passive;
+				break;
+			case Mumble::Protocol::AudioContext::WHISPER:
+				ts = Settings::Whispering;
+				break;
+			default:
+				// Default to normal talking, if we don't know the used context
+				ts = Settings::Talking;
+				break;
+		}
 
-				spx_int32_t startofs = 0;
-				if (jitter_buffer_get(jbJitter, &jbp, static_cast< int >(iFrameSize), &startofs) == JITTER_BUFFER_OK) {
-					std::lock_guard< std::mutex > audioChunkLock(s_audioCachesMutex);
+		if (ts != Settings::Passive && p->bLocalMute) {
+			ts = Settings::MutedTalking;
+		}
 
-					iMissCount = 0;
+		p->setTalking(ts);
+	}
 
-					// The "data pointer" that is stored in the buffer is actually just an index to s_audioCaches
-					const std::size_t index = reinterpret_cast< std::size_t >(jbp.data) - 1;
-					assert(jbp.len == 0);
-					assert(index < s_audioCaches.size());
+	bool tmp   = bLastAlive;
+	bLastAlive = nextalive;
+	return tmp;
+}
 
-					AudioOutputCache &cache = s_audioCaches[index];
-					assert(cache.isValid());
+unsigned int AudioOutputSpeech::decodeFrame(float *out, bool alive, FrameInfo &info) {
+	const unsigned int channels = bStereo ? 2 : 1;
+	int decodedSamples          = static_cast< int >(iFrameSize);
 
-					bHasTerminator = cache.isLastFrame();
+	if (!alive) {
+		memset(out, 0, iFrameSize * sizeof(float));
+	} else {
+		if (p == &LoopUser::lpLoopy) {
+			LoopUser::lpLoopy.fetchFrames();
+		}
 
-					assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
+		bool fadeIn                             = false;
+		AudioPlayoutBuffer::Operation operation = AudioPlayoutBuffer::Operation::Normal;
 
-					// Copy audio data into qlFrames
-					qlFrames << QByteArray(reinterpret_cast< const char * >(cache.getAudioData().data()),
-										   static_cast< int >(cache.getAudioData().size()));
+		if (qlFrames.isEmpty()) {
+			QMutexLocker lock(&qmJitter);
 
-					if (cache.containsPositionalInformation()) {
-						assert(cache.getPositionalInformation().size() == 3);
-						assert(fPos.size() == 3);
+			// At the start of a transmission, the jitter buffer waits until it holds enough to cover the jitter
+			const bool starting = !m_playout->isPlaying();
 
-						for (unsigned int i = 0; i < 3; ++i) {
-							fPos[i] = cache.getPositionalInformation()[i];
-						}
-					} else {
-						fPos[0] = fPos[1] = fPos[2] = 0.0f;
-					}
+			AudioPlayoutBuffer::Packet packet;
+			if (m_playout->get(packet, operation) == AudioPlayoutBuffer::Result::Packet) {
+				iMissCount = 0;
+				fadeIn     = starting;
 
-					m_suggestedVolumeAdjustment = cache.getVolumeAdjustment();
-					m_audioContext              = cache.getContext();
+				info.dequeued = AudioLatency::now();
+				AudioLatency::record(AudioLatency::Stage::JitterBuffer, info.dequeued - packet.arrival);
 
-					if (p) {
-						float a = static_cast< float >(avail);
-						if (static_cast< float >(avail) >= p->fAverageAvailable)
-							p->fAverageAvailable = a;
-						else
-							p->fAverageAvailable *= 0.99f;
-					}
+				AudioOutputCache &cache = m_caches[packet.payload];
+				assert(cache.isValid());
 
-					// If a destroy callback has been registered, jitter_buffer_get expects the caller to
-					// invoke the destroy callback on the returned packet.
-					// We registered a destroy callback in our constructor, so we clean up the packet here.
-					cache.clear();
-				} else {
-					// Let the jitter buffer know it's the right time to adjust the buffering delay to the network
-					// conditions.
-					jitter_buffer_update_delay(jbJitter, &jbp, nullptr);
+				bHasTerminator = cache.isLastFrame();
+				bDecodeFEC     = cache.decodeFEC();
 
-					iMissCount++;
-					if (iMissCount > 10)
-						nextalive = false;
-				}
-			}
+				assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
 
-			if (!qlFrames.isEmpty()) {
-				QByteArray qba = qlFrames.takeFirst();
+				// Copy audio data into qlFrames
+				qlFrames << QByteArray(reinterpret_cast< const char * >(cache.getAudioData().data()),
+									   static_cast< int >(cache.getAudioData().size()));
 
-				assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
+				if (cache.containsPositionalInformation()) {
+					assert(cache.getPositionalInformation().size() == 3);
 
-				if (qba.isEmpty() || !(p && p->bLocalMute)) {
-					// If qba is empty, we have to let Opus know about the packet loss
-					// Otherwise if the associated user is not locally muted, we want to decode the audio
-					// packet normally in order to be able to play it.
-					decodedSamples = opus_decode_float(
-						opusState, qba.isEmpty() ? nullptr : reinterpret_cast< const unsigned char * >(qba.constData()),
-						qba.size(), pOut, static_cast< int >(iAudioBufferSize), 0);
+					for (unsigned int i = 0; i < 3; ++i) {
+						info.position[i] = cache.getPositionalInformation()[i];
+					}
 				} else {
-					// If the packet is non-empty, but the associated user is locally muted,
-					// we don't have to decode the packet. Instead it is enough to know how many
-					// samples it contained so that we can then mute the appropriate output length
-					decodedSamples = opus_packet_get_samples_per_frame(
-						reinterpret_cast< const unsigned char * >(qba.constData()), SAMPLE_RATE);
+					info.position[0] = info.position[1] = info.position[2] = 0.0f;
 				}
 
-				// The returned sample count we get from the Opus functions refer to samples per channel.
-				// Thus in order to get the total amount, we have to multiply by the channel count.
-				decodedSamples *= static_cast< int >(channels);
+				info.fromPacket       = true;
+				info.volumeAdjustment = cache.getVolumeAdjustment();
+				info.context          = cache.getContext();
 
-				if (decodedSamples < 0) {
-					decodedSamples = static_cast< int >(iFrameSize);
-					memset(pOut, 0, iFrameSize * sizeof(float));
+				// The packet's data has been copied, so the cache can be reused
+				m_caches.release(packet.payload);
+			} else if (starting && ++iMissCount < 20) {
+				memset(out, 0, iFrameSize * sizeof(float));
+				goto nextframe;
+			} else {
+				// The packet is missing, so its audio is concealed
+				iMissCount++;
+				if (iMissCount > 10)
+					info.alive = false;
+			}
+		}
+
+		if (!qlFrames.isEmpty()) {
+			QByteArray qba = qlFrames.takeFirst();
+
+			assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
+
+			if (qba.isEmpty() || !(p && p->bLocalMute)) {
+				// If qba is empty, we have to let Opus know about the packet loss
+				// Otherwise if the associated user is not locally muted, we want to decode the audio
+				// packet normally in order to be able to play it.
+				int frameSize = static_cast< int >(iAudioBufferSize);
+				if (bDecodeFEC && !qba.isEmpty()) {
+					// When decoding the FEC, Opus has to be told the exact duration of the lost packet, which is
+					// assumed to be the one of the packet carrying the FEC
+					frameSize = std::min(frameSize, opus_packet_get_nb_samples(
+														reinterpret_cast< const unsigned char * >(qba.constData()),
+														qba.size(), static_cast< opus_int32 >(iSampleRate)));
 				}
+				decodedSamples = opus_decode_float(
+					opusState, qba.isEmpty() ? nullptr : reinterpret_cast< const unsigned char * >(qba.constData()),
+					qba.size(), out, frameSize, bDecodeFEC ? 1 : 0);
+			} else {
+				// If the packet is non-empty, but the associated user is locally muted,
+				// we don't have to decode the packet. Instead it is enough to know how many
+				// samples it contained so that we can then mute the appropriate output length
+				decodedSamples = opus_packet_get_samples_per_frame(
+					reinterpret_cast< const unsigned char * >(qba.constData()), SAMPLE_RATE);
+			}
 
-				bool update = true;
-				if (p) {
-					float &fPowerMax = p->fPowerMax;
-					float &fPowerMin = p->fPowerMin;
+			// The returned sample count we get from the Opus functions refer to samples per channel.
+			// Thus in order to get the total amount, we have to multiply by the channel count.
+			decodedSamples *= static_cast< int >(channels);
 
-					float pow = 0.0f;
-					for (int i = 0; i < decodedSamples; ++i) {
-						pow += pOut[i] * pOut[i];
-					}
-					pow = sqrtf(pow / static_cast< float >(decodedSamples)); // Average over both L and R channel.
+			if (decodedSamples < 0) {
+				decodedSamples = static_cast< int >(iFrameSize);
+				memset(out, 0, iFrameSize * sizeof(float));
+			}
 
-					if (pow >= fPowerMax) {
-						fPowerMax = pow;
-					} else {
-						if (pow <= fPowerMin) {
-							fPowerMin = pow;
-						} else {
-							fPowerMax = 0.99f * fPowerMax;
-							fPowerMin += 0.0001f * pow;
-						}
-					}
+			bool quiet = false;
+			if (p) {
+				float &fPowerMax = p->fPowerMax;
+				float &fPowerMin = p->fPowerMin;
 
-					update = (pow < (fPowerMin + 0.01f * (fPowerMax - fPowerMin))); // Update jitter buffer when quiet.
+				float pow = 0.0f;
+				for (int i = 0; i < decodedSamples; ++i) {
+					pow += out[i] * out[i];
 				}
+				pow = sqrtf(pow / static_cast< float >(decodedSamples)); // Average over both L and R channel.
 
-				if (qlFrames.isEmpty() && update) {
-					jitter_buffer_update_delay(jbJitter, nullptr, nullptr);
+				if (pow >= fPowerMax) {
+					fPowerMax = pow;
+				} else {
+					if (pow <= fPowerMin) {
+						fPowerMin = pow;
+					} else {
+						fPowerMax = 0.99f * fPowerMax;
+						fPowerMin += 0.0001f * pow;
+					}
 				}
 
-				if (qlFrames.isEmpty() && bHasTerminator) {
-					nextalive = false;
-				}
-			} else {
-				assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
-				decodedSamples = opus_decode_float(opusState, nullptr, 0, pOut, static_cast< int >(iFrameSize), 0);
-				decodedSamples *= static_cast< int >(channels);
+				quiet = (pow < (fPowerMin + 0.01f * (fPowerMax - fPowerMin)));
+			}
 
-				if (decodedSamples < 0) {
-					decodedSamples = static_cast< int >(iFrameSize);
-					memset(pOut, 0, iFrameSize * sizeof(float));
+			if (operation != AudioPlayoutBuffer::Operation::Normal && !fadeIn && !bHasTerminator
+				&& decodedSamples > 0 && !(p && p->bLocalMute)) {
+				// Moves the delay towards the one the jitter buffer aims for, which is the least audible in quiet
+				// frames (where the stretcher doesn't have to find a similar segment)
+				const unsigned int frames = static_cast< unsigned int >(decodedSamples) / channels;
+				int stretched             = 0;
+				if (operation == AudioPlayoutBuffer::Operation::Shorten) {
+					stretched = static_cast< int >(m_stretcher->shorten(out, frames, quiet));
+				} else {
+					stretched = -static_cast< int >(m_stretcher->lengthen(out, frames, iOutputSize / channels, quiet));
 				}
+				stretched *= static_cast< int >(channels);
+				decodedSamples -= stretched;
+
+				QMutexLocker lock(&qmJitter);
+				m_playout->stretched(stretched);
 			}
 
-			if (!nextalive) {
-				for (unsigned int i = 0; i < static_cast< unsigned int >(iFrameSizePerChannel); ++i) {
-					for (unsigned int s = 0; s < channels; ++s)
-						pOut[i * channels + s] *= fFadeOut[i];
-				}
-			} else if (ts == 0) {
-				for (unsigned int i = 0; i < static_cast< unsigned int >(iFrameSizePerChannel); ++i) {
-					for (unsigned int s = 0; s < channels; ++s)
-						pOut[i * channels + s] *= fFadeIn[i];
-				}
+			if (qlFrames.isEmpty() && bHasTerminator) {
+				info.alive = false;
 			}
+		} else {
+			assert(m_codec == Mumble::Protocol::AudioCodec::Opus);
+			decodedSamples = opus_decode_float(opusState, nullptr, 0, out, static_cast< int >(iFrameSize), 0);
+			decodedSamples *= static_cast< int >(channels);
 
-			for (unsigned int i = static_cast< unsigned int >(decodedSamples) / iFrameSize; i > 0; --i) {
-				jitter_buffer_tick(jbJitter);
+			if (decodedSamples < 0) {
+				decodedSamples = static_cast< int >(iFrameSize);
+				memset(out, 0, iFrameSize * sizeof(float));
 			}
 		}
-	nextframe:
-		if (p && p->bLocalMute) {
-			// Overwrite the output with zeros as this user is muted
-			// NOTE: If Opus is used, then in this case no samples have actually been decoded and thus
-			// we don't discard previously done work (in form of decoding the audio stream) by overwriting
-			// it with zeros.
-			memset(pOut, 0, static_cast< unsigned int >(decodedSamples) * sizeof(float));
-		}
 
-		spx_uint32_t inlen  = static_cast< unsigned int >(decodedSamples) / channels; // per channel
-		spx_uint32_t outlen = static_cast< unsigned int >(
-			ceilf(static_cast< float >(static_cast< unsigned int >(decodedSamples) / channels * iMixerFreq)
-				  / static_cast< float >(iSampleRate)));
-		if (srs && bLastAlive) {
-			if (channels == 1) {
-				speex_resampler_process_float(srs, 0, fResamplerBuffer, &inlen, pfBuffer + iBufferFilled, &outlen);
-			} else if (channels == 2) {
-				speex_resampler_process_interleaved_float(srs, fResamplerBuffer, &inlen, pfBuffer + iBufferFilled,
-														  &outlen);
+		if (!info.alive) {
+			for (unsigned int i = 0; i < static_cast< unsigned int >(iFrameSizePerChannel); ++i) {
+				for (unsigned int s = 0; s < channels; ++s)
+					out[i * channels + s] *= fFadeOut[i];
+			}
+		} else if (fadeIn) {
+			for (unsigned int i = 0; i < static_cast< unsigned int >(iFrameSizePerChannel); ++i) {
+				for (unsigned int s = 0; s < channels; ++s)
+					out[i * channels + s] *= fFadeIn[i];
 			}
 		}
-		iBufferFilled += outlen * channels;
+	}
+nextframe:
+	if (p && p->bLocalMute) {
+		// Overwrite the output with zeros as this user is muted
+		// NOTE: If Opus is used, then in this case no samples have actually been decoded and thus
+		// we don't discard previously done work (in form of decoding the audio stream) by overwriting
+		// it with zeros.
+		memset(out, 0, static_cast< unsigned int >(decodedSamples) * sizeof(float));
 	}
 
-	if (p) {
-		Settings::TalkState ts;
-		if (!nextalive) {
-			m_audioContext = Mumble::Protocol::AudioContext::INVALID;
+	return static_cast< unsigned int >(decodedSamples);
+}
+
+void AudioOutputSpeech::applyFrameInfo(const FrameInfo &info) {
+	if (!info.fromPacket) {
+		return;
+	}
+
+	fPos                        = info.position;
+	m_suggestedVolumeAdjustment = info.volumeAdjustment;
+	m_audioContext              = info.context;
+	m_dequeued                  = info.dequeued;
+}
+
+unsigned int AudioOutputSpeech::takeDecodedFrame(float *out, bool &nextAlive) {
+	const unsigned int head = m_decodedHead.load(std::memory_order_relaxed);
+
+	if (head == m_decodedTail.load(std::memory_order_acquire)) {
+		// The workers haven't caught up, so the frame is decoded right here (unless a worker is busy decoding it)
+		if (!claimDecoding()) {
+			// Rather than waiting for the worker, a frame of silence is played
+			memset(out, 0, iFrameSize * sizeof(float));
+			return iFrameSize;
 		}
 
-		switch (m_audioContext) {
-			case Mumble::Protocol::AudioContext::LISTEN:
-				// Fallthrough
-			case Mumble::Protocol::AudioContext::NORMAL:
-				ts = Settings::Talking;
-				break;
-			case Mumble::Protocol::AudioContext::SHOUT:
-				ts = Settings::Shouting;
-				break;
-			case Mumble::Protocol::AudioContext::INVALID:
-				ts = Settings::Passive;
-				break;
-			case Mumble::Protocol::AudioContext::WHISPER:
-				ts = Settings::Whispering;
-				break;
-			default:
-				// Default to normal talking, if we don't know the used context
-				ts = Settings::Talking;
-				break;
+		if (head != m_decodedTail.load(std::memory_order_acquire)) {
+			// A worker has delivered the frame in the meantime
+			releaseDecoding();
+			return takeDecodedFrame(out, nextAlive);
 		}
 
-		if (ts != Settings::Passive && p->bLocalMute) {
-			ts = Settings::MutedTalking;
+		FrameInfo info;
+		info.alive                        = m_decoderAlive;
+		const unsigned int decodedSamples = decodeFrame(out, m_decoderAlive, info);
+		m_decoderAlive                    = info.alive;
+		releaseDecoding();
+
+		applyFrameInfo(info);
+		nextAlive = nextAlive && info.alive;
+		m_decoder->wake();
+
+		return decodedSamples;
+	}
+
+	const DecodedFrame &frame = m_decodedFrames[head % DECODE_AHEAD_FRAMES];
+	std::copy(frame.samples.begin(), frame.samples.begin() + frame.sampleCount, out);
+	applyFrameInfo(frame.info);
+	nextAlive = nextAlive && frame.info.alive;
+
+	const unsigned int decodedSamples = frame.sampleCount;
+	m_decodedHead.store(head + 1, std::memory_order_release);
+	m_decoder->wake();
+
+	return decodedSamples;
+}
+
+bool AudioOutputSpeech::claimDecoding() {
+	return !m_decoding.exchange(true, std::memory_order_acquire);
+}
+
+void AudioOutputSpeech::releaseDecoding() {
+	m_decoding.store(false, std::memory_order_release);
+}
+
+bool AudioOutputSpeech::isDecoding() const {
+	return m_decoding.load(std::memory_order_acquire);
+}
+
+bool AudioOutputSpeech::decodeAhead() {
+	bool decoded = false;
+
+	while (m_decoderAlive) {
+		const unsigned int tail = m_decodedTail.load(std::memory_order_relaxed);
+		if (tail - m_decodedHead.load(std::memory_order_acquire) >= DECODE_AHEAD_FRAMES) {
+			break;
 		}
 
-		p->setTalking(ts);
+		DecodedFrame &frame = m_decodedFrames[tail % DECODE_AHEAD_FRAMES];
+		frame.info          = FrameInfo();
+		frame.sampleCount   = decodeFrame(frame.samples.data(), true, frame.info);
+		m_decoderAlive      = frame.info.alive;
+
+		m_decodedTail.store(tail + 1, std::memory_order_release);
+		decoded = true;
 	}
 
-	bool tmp   = bLastAlive;
-	bLastAlive = nextalive;
-	return tmp;
+	return decoded;
 }
@@ -6,18 +6,23 @@
 #ifndef MUMBLE_MUMBLE_AUDIOOUTPUTSPEECH_H_
 #define MUMBLE_MUMBLE_AUDIOOUTPUTSPEECH_H_
 
-#include <speex/speex_jitter.h>
-#include <speex/speex_resampler.h>
-
 #include <QtCore/QMutex>
 
+#include "AudioFrameRecovery.h"
 #include "AudioOutputBuffer.h"
 #include "AudioOutputCache.h"
+#include "AudioPlayoutBuffer.h"
+#include "AudioTimeStretcher.h"
 #include "MumbleProtocol.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <vector>
 
+class AudioOutputDecoder;
 class ClientUser;
 struct OpusDecoder;
 
@@ -26,12 +31,6 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(AudioOutputSpeech)
 protected:
-	static std::mutex s_audioCachesMutex;
-	static std::vector< AudioOutputCache > s_audioCaches;
-
-	static void invalidateAudioOutputCache(void *maskedIndex);
-	static std::size_t storeAudioOutputCache(const Mumble::Protocol::AudioData &audioData);
-
 	unsigned int iAudioBufferSize;
 	unsigned int iBufferOffset;
 	unsigned int iBufferFilled;
@@ -40,40 +39,126 @@ protected:
 	unsigned int iFrameSize;
 	unsigned int iFrameSizePerChannel;
 	unsigned int iSampleRate;
-	unsigned int iMixerFreq;
 	bool bLastAlive;
 	bool bHasTerminator;
 
 	float *fFadeIn;
 	float *fFadeOut;
-	float *fResamplerBuffer;
-
-	SpeexResamplerState *srs;
 
 	QMutex qmJitter;
-	JitterBuffer *jbJitter;
+	std::unique_ptr< AudioPlayoutBuffer > m_playout;
+	/// The payloads of the packets in the jitter buffer, which only holds their index. There is room for as many as
+	/// the jitter buffer can hold, plus the one that is being put into it.
+	AudioOutputCachePool m_caches;
+	/// Shortens or lengthens the decoded packets whenever the jitter buffer holds more or less than it aims for
+	std::unique_ptr< AudioTimeStretcher > m_stretcher;
 	int iMissCount;
 
 	OpusDecoder *opusState;
 
 	QList< QByteArray > qlFrames;
+	/// Whether the frame in qlFrames is to be decoded from its in-band FEC (see AudioOutputCache::decodeFEC)
+	bool bDecodeFEC = false;
+
+	/// Notices the packets that have been lost
+	AudioFrameRecovery m_recovery;
+
+	/// Puts the given frame into the jitter buffer
+	///
+	/// @param samples The number of samples of the frame (for all channels)
+	/// @param decodeFEC Whether it is to be decoded from its in-band FEC (see AudioOutputCache::decodeFEC)
+	/// @param arrival When the frame's packet has arrived (see AudioLatency::now())
+	void putFrame(const Mumble::Protocol::AudioData &audioData, int samples, bool decodeFEC, quint64 arrival);
+	/// @returns The number of samples of the given Opus payload (for all channels), or 0 if it can't be played
+	int samplesOf(gsl::span< const Mumble::Protocol::byte > payload) const;
+
+	/// What decoding a frame has revealed about the stream, besides the samples themselves
+	struct FrameInfo {
+		/// Whether a packet has been taken from the jitter buffer, in which case the following fields are its metadata
+		bool fromPacket                           = false;
+		std::array< float, 3 > position           = { 0.0f, 0.0f, 0.0f };
+		float volumeAdjustment                    = 1.0f;
+		Mumble::Protocol::audio_context_t context = Mumble::Protocol::AudioContext::INVALID;
+		/// When the packet has been taken out of the jitter buffer (see AudioLatency::now())
+		quint64 dequeued = 0;
+		/// Whether the stream goes on after the frame, which decodeFrame() only ever clears
+		bool alive = true;
+	};
+
+	/// Takes the next packet from the jitter buffer and decodes it, or conceals it if there is none
+	///
+	/// @param alive Whether the stream is alive, otherwise the frame is silence
+	/// @returns The number of samples written to out (for all channels), which is at most iOutputSize
+	unsigned int decodeFrame(float *out, bool alive, FrameInfo &info);
+	/// Makes the metadata of the given frame the ones of the buffer
+	void applyFrameInfo(const FrameInfo &info);
+
+	/// The number of frames the workers of an AudioOutputDecoder decode before they are played
+	static constexpr unsigned int DECODE_AHEAD_FRAMES = 2;
+
+	/// A frame that has been decoded ahead of time
+	struct DecodedFrame {
+		std::vector< float > samples;
+		unsigned int sampleCount = 0;
+		FrameInfo info;
+	};
+
+	/// The pool decoding this speech ahead of time, nullptr if it is decoded by prepareSampleBuffer() itself
+	AudioOutputDecoder *m_decoder = nullptr;
+	/// The frames that have been decoded ahead, a ring filled by the workers and emptied by the audio thread
+	std::array< DecodedFrame, DECODE_AHEAD_FRAMES > m_decodedFrames;
+	std::atomic< unsigned int > m_decodedHead{ 0 };
+	std::atomic< unsigned int > m_decodedTail{ 0 };
+	/// Set while a thread decodes, which only one thread (a worker or the audio thread) may do at a time
+	std::atomic< bool > m_decoding{ false };
+	/// Whether the stream is alive as of the last decoded frame. Only accessed by the thread that is decoding.
+	bool m_decoderAlive = true;
+
+	/// Copies the next frame from the ring into out, or decodes it right away if the workers have fallen behind
+	///
+	/// @returns The number of samples written to out (for all channels)
+	unsigned int takeDecodedFrame(float *out, bool &nextAlive);
+
+	/// @returns Whether the calling thread may decode, in which case it has to call releaseDecoding() when done
+	bool claimDecoding();
+	void releaseDecoding();
+	bool isDecoding() const;
+	/// Decodes frames until the ring is full or the stream has ended. Requires the decoding to have been claimed.
+	///
+	/// @returns Whether a frame has been decoded
+	bool decodeAhead();
+
+	friend class AudioOutputDecoder;
 
 public:
 	Mumble::Protocol::audio_context_t m_audioContext;
 	Mumble::Protocol::AudioCodec m_codec;
+	/// The number of samples of the frames the speech is counted in (see Mumble::Protocol::AudioData::frameSize)
+	std::uint32_t m_frameSize;
 	int iMissedFrames;
 	ClientUser *p;
+	/// When the packet of the frame that is played next has been taken out of the jitter buffer, 0 once the mix
+	/// has recorded its latency (see AudioLatency::Stage::Mix)
+	quint64 m_dequeued = 0;
 
 	/// Fetch and decode frames from the jitter buffer. Called in mix().
 	///
 	/// @param frameCount Number of frames to decode. frame means a bundle of one sample from each channel.
 	virtual bool prepareSampleBuffer(unsigned int frameCount) Q_DECL_OVERRIDE;
 
-	void addFrameToBuffer(const Mumble::Protocol::AudioData &audioData);
+	/// @param arrival When the frame's packet has arrived (see AudioLatency::now()), 0 for now
+	void addFrameToBuffer(const Mumble::Protocol::AudioData &audioData, quint64 arrival = 0);
 
+	/// The speech is decoded at SAMPLE_RATE, which is the rate AudioOutput mixes at (and resamples the mix from)
+	///
+	/// @param frameSize The frame size of the speech's packets (0 for regular frames)
 	/// @param systemMaxBufferSize maximum number of samples the system audio play back may request each time
-	AudioOutputSpeech(ClientUser *, unsigned int freq, Mumble::Protocol::AudioCodec codec,
-					  unsigned int systemMaxBufferSize);
+	/// @param devicePeriod The number of frames the device consumes at once, which the jitter buffer holds at least
+	/// 	(0 if unknown)
+	/// @param decoder The pool that decodes the speech ahead of time, nullptr to decode it in prepareSampleBuffer()
+	AudioOutputSpeech(ClientUser *, Mumble::Protocol::AudioCodec codec, std::uint32_t frameSize,
+					  unsigned int systemMaxBufferSize, unsigned int devicePeriod = 0,
+					  AudioOutputDecoder *decoder = nullptr);
 	~AudioOutputSpeech() Q_DECL_OVERRIDE;
 };
 
@@ -0,0 +1,236 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioPlayoutBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+/// The share of the packets whose delay the buffer covers
+constexpr float QUANTILE = 0.95f;
+/// How much of the delay histogram is kept for every packet that arrives. With 100 packets per second, the
+/// histogram forgets about half of what it has learnt within 1.4 seconds.
+constexpr float FORGET_FACTOR = 0.995f;
+} // namespace
+
+constexpr std::size_t AudioPlayoutBuffer::CAPACITY;
+constexpr unsigned int AudioPlayoutBuffer::MAX_DELAY;
+constexpr std::size_t AudioPlayoutBuffer::HISTORY_SIZE;
+
+AudioPlayoutBuffer::AudioPlayoutBuffer(unsigned int frameSize, quint64 frameDuration, unsigned int minimumDelay,
+									   float initialDelay)
+	: m_frameSize(frameSize), m_frameDuration(frameDuration), m_minimumDelay(std::max(minimumDelay, 1u)) {
+	// Until the transmission has revealed anything about the network, it is assumed to be as jittery as last time
+	const unsigned int initial =
+		std::min(static_cast< unsigned int >(std::max(std::lround(initialDelay), 1L)), MAX_DELAY) - 1;
+	m_delays[initial] = 1.0f;
+
+	updateTargetDelay();
+	m_filteredLevel = static_cast< float >(m_targetDelay * m_frameSize);
+}
+
+bool AudioPlayoutBuffer::put(const Packet &packet) {
+	learn(packet);
+
+	if (m_playing && packet.timestamp < m_pointer) {
+		// Too late
+		return false;
+	}
+
+	std::size_t free = CAPACITY;
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		if (!m_used[i]) {
+			free = std::min(free, i);
+		} else if (m_packets[i].timestamp == packet.timestamp) {
+			return false;
+		}
+	}
+
+	if (free == CAPACITY) {
+		return false;
+	}
+
+	m_packets[free] = packet;
+	m_used[free]    = true;
+	++m_count;
+
+	return true;
+}
+
+AudioPlayoutBuffer::Result AudioPlayoutBuffer::get(Packet &packet, Operation &operation) {
+	operation = Operation::Normal;
+
+	if (!m_playing) {
+		if (m_count == 0) {
+			return Result::Empty;
+		}
+
+		if (bufferedSamples() < m_targetDelay * m_frameSize && ++m_prefetchTicks < MAX_PREFETCH) {
+			return Result::Empty;
+		}
+
+		m_playing = true;
+		m_pointer = std::numeric_limits< std::uint64_t >::max();
+		for (std::size_t i = 0; i < CAPACITY; ++i) {
+			if (m_used[i]) {
+				m_pointer = std::min(m_pointer, m_packets[i].timestamp);
+			}
+		}
+	}
+
+	bool later = false;
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		if (!m_used[i]) {
+			continue;
+		}
+
+		if (m_packets[i].timestamp == m_pointer) {
+			// The level includes the packet that is about to be played, so that it is as high as the target when
+			// every packet arrives just in time
+			const float level = static_cast< float >(bufferedSamples());
+
+			packet    = m_packets[i];
+			m_used[i] = false;
+			--m_count;
+			m_pointer += packet.span;
+
+			// The filter is slower the higher the delay, as it then takes more to notably change the level
+			float factor = 0.992f;
+			if (m_targetDelay <= 1) {
+				factor = 0.980f;
+			} else if (m_targetDelay <= 3) {
+				factor = 0.984f;
+			} else if (m_targetDelay <= 7) {
+				factor = 0.988f;
+			}
+			m_filteredLevel = factor * m_filteredLevel + (1.0f - factor) * level;
+
+			// The (filtered) level has to leave a corridor around the target for the audio to be stretched, which is
+			// at least two frames wide
+			const float frameSize = static_cast< float >(m_frameSize);
+			const float target    = static_cast< float >(m_targetDelay) * frameSize;
+			const float low       = std::max(0.75f * target, target - 8.5f * frameSize);
+			const float high      = std::max(target, low + 2.0f * frameSize);
+
+			if (m_filteredLevel >= high && level >= low) {
+				operation = Operation::Shorten;
+			} else if (m_filteredLevel < low && level < high) {
+				operation = Operation::Lengthen;
+			}
+
+			return Result::Packet;
+		}
+
+		later = later || m_packets[i].timestamp > m_pointer;
+	}
+
+	if (later) {
+		m_pointer += m_frameSize;
+		return Result::Missing;
+	}
+
+	// The buffer has run dry. Instead of skipping the missing audio, the playout waits for it, which raises the
+	// delay just as much as the network demands.
+	return Result::Empty;
+}
+
+void AudioPlayoutBuffer::stretched(int samples) {
+	m_filteredLevel = std::max(0.0f, m_filteredLevel - static_cast< float >(samples));
+}
+
+bool AudioPlayoutBuffer::drain(Packet &packet) {
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		if (m_used[i]) {
+			packet    = m_packets[i];
+			m_used[i] = false;
+			--m_count;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool AudioPlayoutBuffer::isPlaying() const {
+	return m_playing;
+}
+
+unsigned int AudioPlayoutBuffer::targetDelay() const {
+	return m_targetDelay;
+}
+
+unsigned int AudioPlayoutBuffer::bufferedSamples() const {
+	unsigned int samples = 0;
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		if (m_used[i]) {
+			samples += m_packets[i].span;
+		}
+	}
+
+	return samples;
+}
+
+void AudioPlayoutBuffer::learn(const Packet &packet) {
+	if (!m_hasReference) {
+		m_hasReference     = true;
+		m_referenceArrival = packet.arrival;
+		m_referenceStamp   = packet.timestamp;
+	}
+
+	// How much later than the first packet this one has arrived, compared to how much later it has been sent
+	const double sent = (static_cast< double >(packet.timestamp) - static_cast< double >(m_referenceStamp))
+						* static_cast< double >(m_frameDuration) / static_cast< double >(m_frameSize);
+	const double arrived = static_cast< double >(packet.arrival) - static_cast< double >(m_referenceArrival);
+
+	Arrival &arrival = m_history[m_historyNext];
+	arrival.time     = packet.arrival;
+	arrival.delay    = arrived - sent;
+	m_historyNext    = (m_historyNext + 1) % HISTORY_SIZE;
+	m_historyCount   = std::min(m_historyCount + 1, HISTORY_SIZE);
+
+	// The delay is measured against the fastest packet of the last seconds, as the clocks of the speaker and the
+	// listener drift apart over time
+	double fastest = arrival.delay;
+	for (std::size_t i = 0; i < m_historyCount; ++i) {
+		if (packet.arrival - m_history[i].time <= HISTORY_DURATION) {
+			fastest = std::min(fastest, m_history[i].delay);
+		}
+	}
+
+	const double delay = (arrival.delay - fastest) / static_cast< double >(m_frameDuration);
+
+	const std::size_t bucket =
+		std::min(static_cast< std::size_t >(std::max(delay, 0.0)), static_cast< std::size_t >(MAX_DELAY - 1));
+	for (float &probability : m_delays) {
+		probability *= FORGET_FACTOR;
+	}
+	m_delays[bucket] += 1.0f - FORGET_FACTOR;
+
+	m_packetFrames = std::max(packet.span / m_frameSize, 1u);
+	updateTargetDelay();
+}
+
+void AudioPlayoutBuffer::updateTargetDelay() {
+	float total = 0.0f;
+	for (float probability : m_delays) {
+		total += probability;
+	}
+
+	// A packet delayed by i frames (or a bit more) requires a buffer of i + 1 frames not to be late
+	float share        = 0.0f;
+	unsigned int delay = MAX_DELAY;
+	for (unsigned int i = 0; i < MAX_DELAY; ++i) {
+		share += m_delays[i];
+		if (share >= QUANTILE * total) {
+			delay = i + 1;
+			break;
+		}
+	}
+
+	// Packets spanning several frames are only played once they have arrived as a whole
+	m_targetDelay = std::max({ delay, m_minimumDelay, m_packetFrames });
+}
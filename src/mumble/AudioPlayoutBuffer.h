@@ -0,0 +1,142 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOPLAYOUTBUFFER_H_
+#define MUMBLE_MUMBLE_AUDIOPLAYOUTBUFFER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// The jitter buffer of a speaker: it holds the packets that have arrived until it is their turn to be played, for as
+/// long as the network's jitter requires. Rather than a fixed margin, the delay it aims for is the one that 95% of the
+/// packets have recently arrived within (relative to the fastest of them), which it learns from the arrival times of
+/// the packets.
+///
+/// The buffer itself never drops or inserts audio to reach that delay. Instead, get() advises to shorten or to
+/// lengthen the audio of a packet (see AudioTimeStretcher) whenever the buffer holds notably more or less than the
+/// delay it aims for, which the player has to report back (see stretched()).
+///
+/// Timestamps and spans are in samples, a frame being the smallest unit a packet can span.
+class AudioPlayoutBuffer {
+public:
+	/// The maximum number of packets that are buffered
+	static constexpr std::size_t CAPACITY = 64;
+	/// The highest delay that can be aimed for, in frames
+	static constexpr unsigned int MAX_DELAY = 50;
+
+	struct Packet {
+		/// The payload of the packet, which is opaque to the buffer
+		std::size_t payload     = 0;
+		std::uint64_t timestamp = 0;
+		unsigned int span       = 0;
+		/// When the packet has arrived, in microseconds (see AudioLatency::now())
+		quint64 arrival = 0;
+	};
+
+	enum class Result {
+		/// The next packet is returned
+		Packet,
+		/// The next packet is missing (but later ones are there), its audio has to be concealed
+		Missing,
+		/// No packet is to be played: either the buffer is waiting to fill up at the start of a transmission, or it
+		/// has run dry (in which case the audio has to be concealed until the next packet arrives)
+		Empty,
+	};
+
+	enum class Operation {
+		Normal,
+		/// The buffer holds more than the delay it aims for, so the audio of the packet should be shortened
+		Shorten,
+		/// The buffer holds less than the delay it aims for, so the audio of the packet should be lengthened
+		Lengthen,
+	};
+
+	/// @param frameSize The number of samples of a frame
+	/// @param frameDuration The duration of a frame in microseconds
+	/// @param minimumDelay The lowest delay to aim for, in frames
+	/// @param initialDelay The delay to start out with, in frames (e.g. the one the speaker's last transmission has
+	/// 	settled on)
+	AudioPlayoutBuffer(unsigned int frameSize, quint64 frameDuration, unsigned int minimumDelay, float initialDelay);
+
+	/// Stores the given packet and learns from its arrival time
+	///
+	/// @returns Whether the packet has been stored, which it isn't if it arrived too late, is a duplicate or there
+	/// 	is no room for it. Its payload then remains the caller's to release.
+	bool put(const Packet &packet);
+
+	/// Advances the playout by one packet (or frame, if it is missing). Has to be called whenever the audio of the next
+	/// packet is needed.
+	///
+	/// @param[out] operation What to do with the audio of the returned packet
+	Result get(Packet &packet, Operation &operation);
+
+	/// Reports how many samples the audio of the last packet has been shortened by (or lengthened, if negative)
+	void stretched(int samples);
+
+	/// Takes any of the packets out of the buffer, regardless of when it is to be played
+	///
+	/// @returns Whether there has been a packet left
+	bool drain(Packet &packet);
+
+	/// @returns Whether the buffer has filled up and plays the packets
+	bool isPlaying() const;
+	/// @returns The delay the buffer aims for, in frames
+	unsigned int targetDelay() const;
+	/// @returns The number of samples of the packets in the buffer
+	unsigned int bufferedSamples() const;
+
+private:
+	Q_DISABLE_COPY(AudioPlayoutBuffer)
+
+	/// The number of frames the buffer waits (silently) at the start of a transmission for the buffer to fill up,
+	/// before playing what it has got
+	static constexpr unsigned int MAX_PREFETCH = 20;
+	/// The number of packets whose arrival the delay is measured against, which ought to cover a few seconds
+	static constexpr std::size_t HISTORY_SIZE = 256;
+	static constexpr quint64 HISTORY_DURATION = 2000000;
+
+	void learn(const Packet &packet);
+	void updateTargetDelay();
+
+	const unsigned int m_frameSize;
+	const quint64 m_frameDuration;
+	const unsigned int m_minimumDelay;
+
+	std::array< Packet, CAPACITY > m_packets;
+	std::array< bool, CAPACITY > m_used = {};
+	std::size_t m_count                 = 0;
+
+	bool m_playing               = false;
+	unsigned int m_prefetchTicks = 0;
+	/// The timestamp of the packet that is to be played next
+	std::uint64_t m_pointer = 0;
+
+	/// A packet's delay (in microseconds) relative to the time it would have arrived at, had it been sent alongside the
+	/// first packet of the transmission and travelled just as fast
+	struct Arrival {
+		quint64 time = 0;
+		double delay = 0.0;
+	};
+	bool m_hasReference            = false;
+	quint64 m_referenceArrival     = 0;
+	std::uint64_t m_referenceStamp = 0;
+	std::array< Arrival, HISTORY_SIZE > m_history;
+	std::size_t m_historyCount = 0;
+	std::size_t m_historyNext  = 0;
+
+	/// How likely the recent packets have been delayed by i frames (relative to the fastest one), forgetting the old
+	/// packets exponentially
+	std::array< float, MAX_DELAY > m_delays = {};
+	unsigned int m_packetFrames             = 1;
+	unsigned int m_targetDelay              = 1;
+
+	/// The number of samples in the buffer, smoothed over time
+	float m_filteredLevel = 0.0f;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOPLAYOUTBUFFER_H_
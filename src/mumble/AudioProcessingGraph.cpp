@@ -0,0 +1,435 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioProcessingGraph.h"
+
+#include "AudioInput.h"
+#include "AudioKernels.h"
+#include "AudioLatency.h"
+
+#ifdef USE_RNNOISE
+extern "C" {
+#	include "rnnoise.h"
+}
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+/// How long an idle worker of the parallel echo canceller sleeps at most. A wakeup that gets lost doesn't delay the
+/// frame, as the audio thread takes over the partitions no worker has claimed.
+constexpr std::chrono::milliseconds ECHO_WAKEUP_TIMEOUT(2);
+
+class EchoCancellationNode : public AudioProcessingNode {
+public:
+	EchoCancellationNode(SpeexEchoState *state, unsigned int frameSize) : m_state(state), m_clean(frameSize) {}
+
+	void process(AudioProcessingFrame &frame) override {
+		if (!frame.speaker) {
+			return;
+		}
+
+		const quint64 start = AudioLatency::now();
+
+		speex_echo_cancellation(m_state, frame.samples, frame.speaker, m_clean.data());
+		frame.samples  = m_clean.data();
+		frame.micFloat = nullptr;
+
+		AudioLatency::recordSince(AudioLatency::Stage::EchoCancellation, start);
+	}
+
+private:
+	SpeexEchoState *m_state;
+	std::vector< short > m_clean;
+};
+
+/// Cancels the echo of many speaker channels with an echo canceller per partition of them, which worker threads and
+/// the audio thread process at the same time. Each canceller removes the echo of its partition from the microphone's
+/// samples (taking the echo of the others for part of the near end), so the clean samples are the microphone's minus
+/// the echo every canceller has estimated.
+///
+/// This bounds the time a frame takes by about the cost of a partition, at the price of the cancellers adapting a bit
+/// slower than a single one that knows all channels. The audio thread only waits for the partitions that workers are
+/// processing at the time it is done with its own.
+class ParallelEchoCancellationNode : public AudioProcessingNode {
+public:
+	struct Partition {
+		SpeexEchoState *state;
+		unsigned int firstChannel;
+		unsigned int channels;
+	};
+
+	ParallelEchoCancellationNode(std::vector< Partition > partitions, unsigned int frameSize, unsigned int channels)
+		: m_partitions(std::move(partitions)), m_frameSize(frameSize), m_channels(channels), m_clean(frameSize) {
+		for (const Partition &partition : m_partitions) {
+			m_speaker.emplace_back(frameSize * partition.channels);
+			m_output.emplace_back(frameSize);
+		}
+
+		// Nothing can be claimed before the first frame
+		m_next.store(m_partitions.size(), std::memory_order_relaxed);
+
+		// The audio thread processes a partition as well
+		for (std::size_t i = 1; i < m_partitions.size(); ++i) {
+			m_workers.emplace_back(&ParallelEchoCancellationNode::run, this);
+		}
+	}
+
+	~ParallelEchoCancellationNode() override {
+		{
+			std::lock_guard< std::mutex > lock(m_mutex);
+			m_stop = true;
+		}
+		m_wakeup.notify_all();
+
+		for (std::thread &worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	void process(AudioProcessingFrame &frame) override {
+		if (!frame.speaker) {
+			return;
+		}
+
+		const quint64 start = AudioLatency::now();
+
+		m_mic          = frame.samples;
+		m_speakerFrame = frame.speaker;
+		m_pending.store(m_partitions.size(), std::memory_order_relaxed);
+		m_next.store(0, std::memory_order_release);
+		m_frames.fetch_add(1, std::memory_order_release);
+		// Notified without the mutex being locked, which is why the workers only wait for so long
+		m_wakeup.notify_all();
+
+		processPartitions();
+		while (m_pending.load(std::memory_order_acquire) > 0) {
+			// A worker is at its last partition, which takes about as long as the one(s) processed here
+			std::this_thread::yield();
+		}
+
+		const int others = static_cast< int >(m_partitions.size()) - 1;
+		for (unsigned int i = 0; i < m_frameSize; ++i) {
+			int sample = -others * m_mic[i];
+			for (const std::vector< short > &output : m_output) {
+				sample += output[i];
+			}
+			m_clean[i] = static_cast< short >(qBound(-32768, sample, 32767));
+		}
+
+		frame.samples  = m_clean.data();
+		frame.micFloat = nullptr;
+
+		AudioLatency::recordSince(AudioLatency::Stage::EchoCancellation, start);
+	}
+
+private:
+	/// Processes the partitions of the current frame until all of them have been claimed
+	void processPartitions() {
+		std::size_t index;
+		while ((index = m_next.fetch_add(1, std::memory_order_acq_rel)) < m_partitions.size()) {
+			const Partition &partition = m_partitions[index];
+			short *speaker             = m_speaker[index].data();
+
+			for (unsigned int i = 0; i < m_frameSize; ++i) {
+				const short *source = m_speakerFrame + i * m_channels + partition.firstChannel;
+				std::copy(source, source + partition.channels, speaker + i * partition.channels);
+			}
+
+			speex_echo_cancellation(partition.state, m_mic, speaker, m_output[index].data());
+
+			m_pending.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void run() {
+		std::unique_lock< std::mutex > lock(m_mutex);
+		unsigned int frames = 0;
+
+		while (!m_stop) {
+			m_wakeup.wait_for(lock, ECHO_WAKEUP_TIMEOUT, [this, frames]() {
+				return m_stop || m_frames.load(std::memory_order_acquire) != frames;
+			});
+			frames = m_frames.load(std::memory_order_acquire);
+
+			lock.unlock();
+			processPartitions();
+			lock.lock();
+		}
+	}
+
+	const std::vector< Partition > m_partitions;
+	const unsigned int m_frameSize;
+	/// The number of channels of the speaker samples (which are interleaved)
+	const unsigned int m_channels;
+	/// The speaker samples of each partition's channels
+	std::vector< std::vector< short > > m_speaker;
+	/// The microphone's samples without the echo of each partition
+	std::vector< std::vector< short > > m_output;
+	std::vector< short > m_clean;
+
+	/// The samples of the current frame, which are set before it is published by m_next
+	const short *m_mic          = nullptr;
+	const short *m_speakerFrame = nullptr;
+	/// The next partition to be claimed, beyond the last one if all of them have been
+	std::atomic< std::size_t > m_next{ 0 };
+	/// The number of partitions of the current frame that haven't been processed yet
+	std::atomic< std::size_t > m_pending{ 0 };
+	/// Counts the frames, so that a worker doesn't go to sleep on a frame that has come in meanwhile
+	std::atomic< unsigned int > m_frames{ 0 };
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_stop = false;
+	std::vector< std::thread > m_workers;
+};
+
+/// @returns The number of partitions the parallel echo canceller splits the given number of speaker channels into:
+/// 	pairs of channels (which are the speakers on either side), as many as there are cores for
+unsigned int parallelEchoPartitions(unsigned int channels) {
+	const unsigned int cores = std::thread::hardware_concurrency();
+	return std::min((channels + 1) / 2, std::max(cores, 1U));
+}
+
+#ifdef USE_RNNOISE
+class RNNoiseNode : public AudioProcessingNode {
+public:
+	explicit RNNoiseNode(DenoiseState *state) : m_state(state) {}
+	~RNNoiseNode() override { rnnoise_destroy(m_state); }
+
+	void process(AudioProcessingFrame &frame) override {
+		// RNNoise works on floats in the range of a short. Unless the echo canceller has been at work, these are taken
+		// from the frame as it came from the device, so that only RNNoise's output has to be converted to 16-bit PCM.
+		if (frame.micFloat) {
+			for (std::size_t i = 0; i < m_frame.size(); ++i) {
+				m_frame[i] = frame.micFloat[i] * 32768.f;
+			}
+		} else {
+			AudioKernels::shortToFloat(frame.samples, m_frame.data(), m_frame.size(), 1.0f);
+		}
+
+		rnnoise_process_frame(m_state, m_frame.data(), m_frame.data());
+
+		AudioKernels::floatToShort(m_frame.data(), frame.samples, m_frame.size(), 1.0f);
+		frame.micFloat = nullptr;
+	}
+
+	/// At the time of writing this code, RNNoise only supports a sample rate of 48000 Hz (with 10 ms frames).
+	static constexpr unsigned int FRAME_SIZE = 480;
+
+private:
+	DenoiseState *m_state;
+	std::array< float, FRAME_SIZE > m_frame;
+};
+#endif
+
+class PreprocessNode : public AudioProcessingNode {
+public:
+	PreprocessNode(SpeexPreprocessState *state, bool denoise) : m_state(state), m_denoise(denoise) {}
+
+	void process(AudioProcessingFrame &frame) override {
+		spx_int32_t gain = 0;
+		speex_preprocess_ctl(m_state, SPEEX_PREPROCESS_GET_AGC_GAIN, &gain);
+		frame.agcGain = gain;
+
+		if (m_denoise) {
+			// The AGC's gain amplifies the noise as well
+			spx_int32_t suppression = frame.noiseSuppression - gain;
+			speex_preprocess_ctl(m_state, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &suppression);
+		}
+
+		speex_preprocess_run(m_state, frame.samples);
+
+		spx_int32_t prob = 0;
+		speex_preprocess_ctl(m_state, SPEEX_PREPROCESS_GET_PROB, &prob);
+		frame.speechProbability = static_cast< float >(prob) / 100.0f;
+	}
+
+private:
+	SpeexPreprocessState *m_state;
+	bool m_denoise;
+};
+
+/// Only lets the AGC raise the gain while transmitting, so that it doesn't amplify the silence in between
+class AGCNode : public AudioProcessingNode {
+public:
+	explicit AGCNode(SpeexPreprocessState *state) : m_state(state) {}
+
+	void process(AudioProcessingFrame &frame) override {
+		spx_int32_t increment = frame.transmitted ? 12 : 0;
+		speex_preprocess_ctl(m_state, SPEEX_PREPROCESS_SET_AGC_INCREMENT, &increment);
+	}
+
+private:
+	SpeexPreprocessState *m_state;
+};
+
+/// Hands the transmitted frames to the plugins (see AudioInput::audioInputEncountered), which may modify them in place
+class PluginNode : public AudioProcessingNode {
+public:
+	PluginNode(AudioInput &input, const AudioProcessingGraph::Config &config)
+		: m_input(input), m_frameSize(config.frameSize), m_channels(config.micChannels),
+		  m_sampleRate(config.sampleRate) {}
+
+	void process(AudioProcessingFrame &frame) override {
+		if (frame.transmitted) {
+			emit m_input.audioInputEncountered(frame.samples, m_frameSize, m_channels, m_sampleRate, frame.isSpeech);
+		}
+	}
+
+private:
+	AudioInput &m_input;
+	unsigned int m_frameSize;
+	unsigned int m_channels;
+	unsigned int m_sampleRate;
+};
+} // namespace
+
+AudioProcessingGraph::AudioProcessingGraph(const Config &config, AudioInput *input)
+	: m_noiseCancel(config.noiseCancel) {
+	const int frameSize  = static_cast< int >(config.frameSize);
+	const int sampleRate = static_cast< int >(config.sampleRate);
+
+	if (config.echoChannels > 0) {
+		const int filterSize          = frameSize * (10 + config.echoLag);
+		const unsigned int channels   = config.echoMulti ? config.echoChannels : 1;
+		const unsigned int partitions = config.echoParallel ? parallelEchoPartitions(channels) : 1;
+
+		std::vector< ParallelEchoCancellationNode::Partition > parts;
+		for (unsigned int i = 0; i < partitions; ++i) {
+			// The channels are spread evenly over the partitions
+			const unsigned int first = i * channels / partitions;
+			const unsigned int count = (i + 1) * channels / partitions - first;
+
+			SpeexEchoState *state = speex_echo_state_init_mc(frameSize, filterSize, 1, static_cast< int >(count));
+			spx_int32_t iArg      = sampleRate;
+			speex_echo_ctl(state, SPEEX_ECHO_SET_SAMPLING_RATE, &iArg);
+
+			m_echoCancellers.push_back(state);
+			parts.push_back({ state, first, count });
+		}
+
+		if (partitions > 1) {
+			addNode(Stage::Cleanup,
+					std::make_unique< ParallelEchoCancellationNode >(std::move(parts), config.frameSize, channels));
+
+			qWarning("AudioInput: ECHO CANCELLER ACTIVE (%u partitions)", partitions);
+		} else {
+			addNode(Stage::Cleanup,
+					std::make_unique< EchoCancellationNode >(m_echoCancellers.front(), config.frameSize));
+
+			qWarning("AudioInput: ECHO CANCELLER ACTIVE");
+		}
+	}
+
+	if (m_noiseCancel == Settings::NoiseCancelRNN || m_noiseCancel == Settings::NoiseCancelBoth) {
+#ifdef USE_RNNOISE
+		DenoiseState *denoiseState = config.frameSize == RNNoiseNode::FRAME_SIZE ? rnnoise_create(nullptr) : nullptr;
+		if (denoiseState) {
+			addNode(Stage::Cleanup, std::make_unique< RNNoiseNode >(denoiseState));
+		} else {
+			qWarning("AudioInput: Ignoring request to enable RNNoise: internal error");
+			m_noiseCancel = Settings::NoiseCancelSpeex;
+		}
+#else
+		qWarning("AudioInput: Ignoring request to enable RNNoise: Mumble was built without support for it");
+		m_noiseCancel = Settings::NoiseCancelSpeex;
+#endif
+	}
+
+	const bool speexDenoise = m_noiseCancel == Settings::NoiseCancelSpeex || m_noiseCancel == Settings::NoiseCancelBoth;
+	switch (m_noiseCancel) {
+		case Settings::NoiseCancelOff:
+			qWarning("AudioInput: Noise canceller disabled");
+			break;
+		case Settings::NoiseCancelSpeex:
+			qWarning("AudioInput: Using Speex as noise canceller");
+			break;
+		case Settings::NoiseCancelRNN:
+			qWarning("AudioInput: Using RNNoise as noise canceller");
+			break;
+		case Settings::NoiseCancelBoth:
+			qWarning("AudioInput: Using RNNoise and Speex as noise canceller");
+			break;
+	}
+
+	m_preprocessor = speex_preprocess_state_init(frameSize, sampleRate);
+
+	spx_int32_t iArg = speexDenoise ? 1 : 0;
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_DENOISE, &iArg);
+
+	iArg = 1;
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_VAD, &iArg);
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_AGC, &iArg);
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_DEREVERB, &iArg);
+
+	iArg = 30000;
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_AGC_TARGET, &iArg);
+
+	float v = 30000.0f / static_cast< float >(config.minLoudness);
+	iArg    = static_cast< int >(floorf(20.0f * log10f(v)));
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_AGC_MAX_GAIN, &iArg);
+
+	iArg = -60;
+	speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_AGC_DECREMENT, &iArg);
+
+	if (m_noiseCancel == Settings::NoiseCancelSpeex) {
+		iArg = config.noiseSuppression;
+		speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &iArg);
+	}
+
+	if (!m_echoCancellers.empty()) {
+		// The residual echo is suppressed as the first canceller estimates it (which covers the front speakers in the
+		// usual layouts)
+		speex_preprocess_ctl(m_preprocessor, SPEEX_PREPROCESS_SET_ECHO_STATE, m_echoCancellers.front());
+	}
+
+	addNode(Stage::Cleanup, std::make_unique< PreprocessNode >(m_preprocessor, speexDenoise));
+
+	addNode(Stage::Transmission, std::make_unique< AGCNode >(m_preprocessor));
+	if (input) {
+		addNode(Stage::Transmission, std::make_unique< PluginNode >(*input, config));
+	}
+}
+
+AudioProcessingGraph::~AudioProcessingGraph() {
+	// The nodes use the states, so they have to go first
+	for (auto &nodes : m_stages) {
+		nodes.clear();
+	}
+
+	speex_preprocess_state_destroy(m_preprocessor);
+	for (SpeexEchoState *echoCanceller : m_echoCancellers) {
+		speex_echo_state_destroy(echoCanceller);
+	}
+}
+
+void AudioProcessingGraph::addNode(Stage stage, std::unique_ptr< AudioProcessingNode > node) {
+	m_stages[static_cast< std::size_t >(stage)].push_back(std::move(node));
+}
+
+void AudioProcessingGraph::run(Stage stage, AudioProcessingFrame &frame) {
+	for (const std::unique_ptr< AudioProcessingNode > &node : m_stages[static_cast< std::size_t >(stage)]) {
+		node->process(frame);
+	}
+}
+
+Settings::NoiseCancel AudioProcessingGraph::noiseCancel() const {
+	return m_noiseCancel;
+}
+
+SpeexPreprocessState *AudioProcessingGraph::preprocessor() const {
+	return m_preprocessor;
+}
+
+SpeexEchoState *AudioProcessingGraph::echoCanceller() const {
+	return m_echoCancellers.empty() ? nullptr : m_echoCancellers.front();
+}
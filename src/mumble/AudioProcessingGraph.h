@@ -0,0 +1,113 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOPROCESSINGGRAPH_H_
+#define MUMBLE_MUMBLE_AUDIOPROCESSINGGRAPH_H_
+
+#include "Settings.h"
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <speex/speex_echo.h>
+#include <speex/speex_preprocess.h>
+
+class AudioInput;
+
+/// A frame of microphone audio on its way through an AudioProcessingGraph
+struct AudioProcessingFrame {
+	/// The samples, which nodes either process in place or replace by a buffer of their own
+	short *samples = nullptr;
+	/// The speaker samples the microphone samples have been resynchronized with, nullptr if there are none
+	const short *speaker = nullptr;
+	/// The samples as they came from the device (in [-1, 1]), nullptr once they no longer correspond to samples
+	const float *micFloat = nullptr;
+
+	/// The strength of the Speex noise suppression (in dB)
+	int noiseSuppression = 0;
+	/// The gain (in dB) the AGC has applied, as of before the frame
+	int agcGain = 0;
+	/// The probability that the frame contains speech
+	float speechProbability = 0.0f;
+
+	/// Whether the frame is sent to the server (which includes the one ending a transmission). Only known to the
+	/// nodes of the transmission stage.
+	bool transmitted = false;
+	/// Whether the frame has been found to be speech. Only known to the nodes of the transmission stage.
+	bool isSpeech = false;
+};
+
+/// A step of the processing of the microphone's audio
+class AudioProcessingNode {
+public:
+	virtual ~AudioProcessingNode() = default;
+
+	/// Processes the given frame. This is called by the audio thread for every frame, which is why a node must neither
+	/// allocate memory nor wait for locks in here. Everything it needs is set up when it is created.
+	virtual void process(AudioProcessingFrame &frame) = 0;
+};
+
+/// The processing the microphone's audio undergoes before it is encoded: the echo canceller, the noise cancellers and
+/// the preprocessor (cleanup stage) followed by the AGC's adaption and the plugins (transmission stage, run once the
+/// voice activity detection has decided on the frame).
+///
+/// A graph is built as a whole (which is where all allocations happen) and is never reconfigured afterwards. Thus,
+/// the settings can be changed by building a new graph outside of the audio thread, which merely picks it up at the
+/// start of the next frame (see AudioInput::resetAudioProcessor()).
+class AudioProcessingGraph {
+public:
+	enum class Stage { Cleanup, Transmission };
+
+	/// What a graph is built for
+	struct Config {
+		unsigned int frameSize    = 0;
+		unsigned int sampleRate   = 0;
+		unsigned int micChannels  = 0;
+		unsigned int echoChannels = 0;
+		/// Whether the echo canceller gets every channel of the speakers (instead of a mix of them)
+		bool echoMulti = false;
+		/// Whether the channels of the speakers are split among several echo cancellers that run in parallel (see
+		/// Settings::bParallelEchoCancellation)
+		bool echoParallel = false;
+		/// The lag (in frames) by which the microphone lags behind the speakers (see Resynchronizer)
+		int echoLag = 0;
+		/// The noise canceller the user asked for, which is replaced by Speex's if RNNoise isn't available
+		Settings::NoiseCancel noiseCancel = Settings::NoiseCancelSpeex;
+		int noiseSuppression              = 0;
+		int minLoudness                   = 1;
+	};
+
+	/// Builds the graph for the given configuration, which includes the plugins if an input is given
+	AudioProcessingGraph(const Config &config, AudioInput *input);
+	~AudioProcessingGraph();
+
+	/// Runs the nodes of the given stage on the frame
+	void run(Stage stage, AudioProcessingFrame &frame);
+
+	/// @returns The noise canceller that is actually used
+	Settings::NoiseCancel noiseCancel() const;
+	SpeexPreprocessState *preprocessor() const;
+	/// @returns The (first) echo canceller, nullptr if echo cancellation is disabled
+	SpeexEchoState *echoCanceller() const;
+
+	/// Links the graphs the audio thread no longer uses, until they are deleted (see AudioInput::adoptAudioProcessor)
+	AudioProcessingGraph *nextRetired = nullptr;
+
+private:
+	Q_DISABLE_COPY(AudioProcessingGraph)
+
+	void addNode(Stage stage, std::unique_ptr< AudioProcessingNode > node);
+
+	Settings::NoiseCancel m_noiseCancel;
+	SpeexPreprocessState *m_preprocessor = nullptr;
+	/// One per partition of the speaker channels, if the echo is cancelled in parallel
+	std::vector< SpeexEchoState * > m_echoCancellers;
+	std::array< std::vector< std::unique_ptr< AudioProcessingNode > >, 2 > m_stages;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOPROCESSINGGRAPH_H_
@@ -0,0 +1,219 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioResampler.h"
+
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace {
+/// The number of taps when upsampling. When downsampling, the filter covers as many output frames instead.
+constexpr unsigned int BASE_TAPS = 32;
+/// The largest number of fractional positions the filter has rows for. Rates whose ratio doesn't reduce to fewer
+/// phases use the row of the nearest position.
+constexpr unsigned int MAX_ROWS = 1024;
+/// The cutoff frequency relative to the Nyquist frequency of the lower of the two rates
+constexpr double CUTOFF = 0.9;
+/// The shape of the Kaiser window, which gives a stopband attenuation of about 80 dB
+constexpr double KAISER_BETA = 8.0;
+
+unsigned int greatestCommonDivisor(unsigned int a, unsigned int b) {
+	while (b != 0) {
+		const unsigned int r = a % b;
+		a                    = b;
+		b                    = r;
+	}
+	return a;
+}
+
+/// @returns The modified Bessel function of the first kind of order 0 (as used by the Kaiser window)
+double besselI0(double x) {
+	double sum  = 1.0;
+	double term = 1.0;
+	for (unsigned int k = 1; k < 50 && term > sum * 1e-12; ++k) {
+		const double factor = x / (2.0 * static_cast< double >(k));
+		term *= factor * factor;
+		sum += term;
+	}
+	return sum;
+}
+} // namespace
+
+struct AudioResampler::Filter {
+	Filter(unsigned int up, unsigned int down);
+
+	/// @returns The taps for the given fractional position (in units of 1/up)
+	const float *row(unsigned int phase) const {
+		const unsigned int index =
+			rows == up ? phase
+					   : static_cast< unsigned int >((static_cast< quint64 >(phase) * rows + up / 2) / up);
+		return coefficients.data() + static_cast< std::size_t >(index) * taps;
+	}
+
+	/// L, the factor by which the stream is upsampled
+	unsigned int up;
+	/// M, the factor by which the upsampled stream is decimated
+	unsigned int down;
+	unsigned int taps;
+	unsigned int rows;
+	/// The taps of rows + 1 fractional positions (rows / rows being the last one), one row after the other. Tap j of
+	/// a row weights the input frame that is j - (taps / 2 - 1) frames after the integral part of the position.
+	std::vector< float > coefficients;
+};
+
+AudioResampler::Filter::Filter(unsigned int upFactor, unsigned int downFactor)
+	: up(upFactor), down(downFactor), rows(std::min(upFactor, MAX_ROWS)) {
+	// When downsampling, the cutoff frequency (and thus the main lobe of the sinc) shrinks along with the rate
+	const double ratio = std::min(1.0, static_cast< double >(up) / static_cast< double >(down));
+	const double limit = static_cast< double >(BASE_TAPS) / ratio;
+	// The dot product is fastest for multiples of eight
+	taps = (static_cast< unsigned int >(std::ceil(limit)) + 7) & ~7U;
+
+	const double cutoff   = CUTOFF * ratio;
+	const double halfSpan = static_cast< double >(taps) / 2.0;
+	const double norm     = besselI0(KAISER_BETA);
+
+	coefficients.resize(static_cast< std::size_t >(rows + 1) * taps);
+	std::vector< double > values(taps);
+	for (unsigned int r = 0; r <= rows; ++r) {
+		float *row          = coefficients.data() + static_cast< std::size_t >(r) * taps;
+		const double offset = static_cast< double >(r) / static_cast< double >(rows);
+		double sum          = 0.0;
+
+		for (unsigned int j = 0; j < taps; ++j) {
+			// The distance of the input frame from the position of the output frame
+			const double distance = static_cast< double >(j) - (halfSpan - 1.0) - offset;
+			const double x        = M_PI * cutoff * distance;
+			const double sinc     = distance == 0.0 ? 1.0 : std::sin(x) / x;
+			const double relative = std::min(1.0, std::abs(distance) / halfSpan);
+			const double window   = besselI0(KAISER_BETA * std::sqrt(1.0 - relative * relative)) / norm;
+
+			values[j] = cutoff * sinc * window;
+			sum += values[j];
+		}
+
+		// Normalize every row to unity gain at DC, so that the fractional positions don't modulate the signal
+		for (unsigned int j = 0; j < taps; ++j) {
+			row[j] = static_cast< float >(values[j] / sum);
+		}
+	}
+}
+
+namespace {
+/// @returns The filter for the given factors, which is shared by all resamplers that exist at the same time
+std::shared_ptr< const AudioResampler::Filter > sharedFilter(unsigned int up, unsigned int down) {
+	static std::mutex mutex;
+	static std::map< std::pair< unsigned int, unsigned int >, std::weak_ptr< const AudioResampler::Filter > > filters;
+
+	std::lock_guard< std::mutex > lock(mutex);
+
+	std::weak_ptr< const AudioResampler::Filter > &entry = filters[std::make_pair(up, down)];
+	std::shared_ptr< const AudioResampler::Filter > filter = entry.lock();
+	if (!filter) {
+		filter = std::make_shared< const AudioResampler::Filter >(up, down);
+		entry  = filter;
+	}
+
+	return filter;
+}
+} // namespace
+
+AudioResampler::AudioResampler(unsigned int channels, unsigned int inRate, unsigned int outRate)
+	: m_channels(channels) {
+	const unsigned int divisor = greatestCommonDivisor(inRate, outRate);
+	m_filter                   = sharedFilter(outRate / divisor, inRate / divisor);
+
+	// Larger inputs are processed in several steps
+	m_capacity = m_filter->taps + 1024;
+	m_history.resize(static_cast< std::size_t >(m_capacity) * m_channels);
+
+	reset();
+}
+
+unsigned int AudioResampler::inputFramesFor(unsigned int outFrames) const {
+	if (outFrames == 0) {
+		return 0;
+	}
+
+	const quint64 last =
+		m_position + (m_phase + static_cast< quint64 >(outFrames - 1) * m_filter->down) / m_filter->up;
+	const quint64 needed = last + m_filter->taps;
+
+	return needed > m_buffered ? static_cast< unsigned int >(needed - m_buffered) : 0;
+}
+
+unsigned int AudioResampler::maxInputFramesFor(unsigned int outFrames) const {
+	// Between two calls, at least taps - ceil(M / L) frames are buffered (the ones the last output frame needed,
+	// minus the ones the position has moved past since), which bounds what inputFramesFor() asks for
+	return static_cast< unsigned int >(static_cast< quint64 >(outFrames) * m_filter->down / m_filter->up) + 2;
+}
+
+unsigned int AudioResampler::process(const float *in, unsigned int inFrames, float *out, unsigned int maxOutFrames) {
+	unsigned int produced = 0;
+
+	while (true) {
+		const unsigned int take = std::min(inFrames, m_capacity - m_buffered);
+		for (unsigned int c = 0; c < m_channels; ++c) {
+			float *history = m_history.data() + static_cast< std::size_t >(c) * m_capacity + m_buffered;
+			for (unsigned int i = 0; i < take; ++i) {
+				history[i] = in[i * m_channels + c];
+			}
+		}
+		m_buffered += take;
+		in += take * m_channels;
+		inFrames -= take;
+
+		while (produced < maxOutFrames && m_position + m_filter->taps <= m_buffered) {
+			filterFrame(out + produced * m_channels);
+			++produced;
+		}
+
+		// Drop the frames that no output frame depends on anymore
+		if (m_position > 0) {
+			for (unsigned int c = 0; c < m_channels; ++c) {
+				float *history = m_history.data() + static_cast< std::size_t >(c) * m_capacity;
+				std::copy(history + m_position, history + m_buffered, history);
+			}
+			m_buffered -= m_position;
+			m_position = 0;
+		}
+
+		if (inFrames == 0 || m_buffered == m_capacity) {
+			// Either all of the input has been taken or the output is full (in which case the rest is dropped)
+			break;
+		}
+	}
+
+	return produced;
+}
+
+void AudioResampler::filterFrame(float *out) {
+	const float *taps = m_filter->row(m_phase);
+	for (unsigned int c = 0; c < m_channels; ++c) {
+		out[c] = AudioKernels::dot(taps, m_history.data() + static_cast< std::size_t >(c) * m_capacity + m_position,
+								   m_filter->taps);
+	}
+
+	m_phase += m_filter->down;
+	m_position += m_phase / m_filter->up;
+	m_phase %= m_filter->up;
+}
+
+void AudioResampler::reset() {
+	// The stream is preceded by silence, so that the first output frame can be computed right away
+	std::fill(m_history.begin(), m_history.end(), 0.0f);
+	m_buffered = m_filter->taps - 1;
+	m_position = 0;
+	m_phase    = 0;
+}
+
+unsigned int AudioResampler::latency() const {
+	return m_filter->taps / 2;
+}
@@ -0,0 +1,64 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIORESAMPLER_H_
+#define MUMBLE_MUMBLE_AUDIORESAMPLER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <memory>
+#include <vector>
+
+/// Converts a stream of (interleaved) float samples from one sample rate to another with a polyphase windowed-sinc
+/// filter. The ratio of the rates is reduced to a fraction L/M, so that output frame n lies at input frame n * M / L,
+/// and every fractional position the filter is evaluated at has a row of precomputed taps.
+///
+/// The tables of taps only depend on the rates, which is why they are computed once per pair of rates and shared by
+/// all resamplers converting between them (as long as one of them exists). Creating a resampler therefore allocates
+/// its buffers and possibly the table, whereas processing never allocates memory and runs the filter with the
+/// accelerated dot product of AudioKernels.
+class AudioResampler {
+public:
+	AudioResampler(unsigned int channels, unsigned int inRate, unsigned int outRate);
+
+	/// @returns The number of input frames the next call of process() needs for exactly outFrames output frames
+	unsigned int inputFramesFor(unsigned int outFrames) const;
+	/// @returns The largest number that inputFramesFor() returns for outFrames, whatever the state of the resampler
+	unsigned int maxInputFramesFor(unsigned int outFrames) const;
+
+	/// Resamples the given frames. The input that isn't needed for the output yet is kept for the next call, as long
+	/// as it fits into the buffer (which it always does if no more than inputFramesFor(maxOutFrames) frames are
+	/// given).
+	///
+	/// @returns The number of frames written to out, which is at most maxOutFrames
+	unsigned int process(const float *in, unsigned int inFrames, float *out, unsigned int maxOutFrames);
+
+	/// Forgets the input of previous calls, as if the stream started anew
+	void reset();
+
+	/// @returns The number of input frames by which the output lags behind the input
+	unsigned int latency() const;
+
+	struct Filter;
+
+private:
+	Q_DISABLE_COPY(AudioResampler)
+
+	/// Runs the filter for the frame at the current position and advances the position
+	void filterFrame(float *out);
+
+	std::shared_ptr< const Filter > m_filter;
+	unsigned int m_channels;
+	/// The pending input of every channel, one channel after the other (each with room for m_capacity frames)
+	std::vector< float > m_history;
+	unsigned int m_capacity;
+	unsigned int m_buffered = 0;
+	/// The index of the first input frame that is part of the next output frame
+	unsigned int m_position = 0;
+	/// The fractional part of the next output frame's position (in units of 1/L)
+	unsigned int m_phase = 0;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIORESAMPLER_H_
@@ -0,0 +1,299 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioSpatializer.h"
+
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+/// The radius of the (spherical) head in m
+constexpr double HEAD_RADIUS = 0.0875;
+/// The speed of sound in m/s
+constexpr double SPEED_OF_SOUND = 343.0;
+/// The angle (in degrees) between the source and the ear at which the head's shadow is the deepest, along with the
+/// smallest gain (relative to the one at DC) at high frequencies
+constexpr double SHADOW_ANGLE = 150.0;
+constexpr double SHADOW_GAIN  = 0.1;
+/// The HRIRs are computed for angles (between the source and the ear's axis) that are this many degrees apart
+constexpr double ROW_STEP = 2.0;
+/// The filter is only rebuilt once the direction has changed by more than about 1.8 degrees (the cosine of which this
+/// is)
+constexpr float REBUILD_THRESHOLD = 0.9995f;
+
+constexpr unsigned int FFT_SIZE   = AudioSpatializer::FFT_SIZE;
+constexpr unsigned int BLOCK_SIZE = AudioSpatializer::BLOCK_SIZE;
+constexpr unsigned int PARTITIONS = AudioSpatializer::PARTITIONS;
+
+/// Unlike the operator of std::complex, this doesn't take care of infinities (which would keep it from being inlined)
+inline std::complex< float > multiply(std::complex< float > a, std::complex< float > b) {
+	return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+}
+} // namespace
+
+/// The HRIRs of a spherical head (as described by Brown and Duda in "A structural model for binaural sound synthesis",
+/// 1998), which depend on the angle between the direction of the source and the ear's axis only. An HRIR consists of
+/// the shadow the head casts (a filter with one pole and one zero whose high frequencies are boosted when facing the
+/// source and attenuated when facing away from it) and the time it takes the sound to reach the ear.
+///
+/// As the model lacks the cues of the pinnae, it tells the sides apart much better than the front from the back.
+struct AudioSpatializer::Dataset {
+	explicit Dataset(unsigned int sampleRate);
+
+	/// Interpolates the HRIR for the given angle (in radians) between the source and the ear's axis and writes it to
+	/// out, which receives PARTITIONS * BLOCK_SIZE taps
+	void hrir(double angle, float *out) const;
+
+	/// Transforms the given FFT_SIZE values in place. The inverse transform isn't scaled.
+	void fft(std::complex< float > *data, bool inverse) const;
+
+	unsigned int rows;
+	/// The number of taps of the head's shadow
+	unsigned int taps;
+	/// The taps of the head's shadow for every row, one row after the other
+	std::vector< float > shadows;
+	/// The delay (in frames) of every row
+	std::vector< double > delays;
+
+	std::array< std::complex< float >, FFT_SIZE / 2 > twiddles;
+	std::array< unsigned int, FFT_SIZE > reversed;
+};
+
+AudioSpatializer::Dataset::Dataset(unsigned int sampleRate)
+	: rows(static_cast< unsigned int >(180.0 / ROW_STEP) + 1) {
+	const double rate = static_cast< double >(sampleRate);
+	// The delays are relative to the one of an ear facing the source, thus they range from 0 to (1 + pi / 2) * a / c
+	const double maxDelay = (1.0 + M_PI / 2.0) * HEAD_RADIUS / SPEED_OF_SOUND * rate;
+	taps = PARTITIONS * BLOCK_SIZE - static_cast< unsigned int >(std::ceil(maxDelay)) - 1;
+
+	// The filter is discretized with the bilinear transform
+	const double k = rate * HEAD_RADIUS / SPEED_OF_SOUND;
+
+	shadows.resize(static_cast< std::size_t >(rows) * taps);
+	delays.resize(rows);
+	for (unsigned int r = 0; r < rows; ++r) {
+		const double degrees = ROW_STEP * static_cast< double >(r);
+		const double angle   = degrees * M_PI / 180.0;
+
+		const double alpha = (1.0 + SHADOW_GAIN / 2.0)
+							 + (1.0 - SHADOW_GAIN / 2.0) * std::cos(std::min(degrees / SHADOW_ANGLE, 1.0) * M_PI);
+		const double b0 = (1.0 + alpha * k) / (1.0 + k);
+		const double b1 = (1.0 - alpha * k) / (1.0 + k);
+		const double a1 = (1.0 - k) / (1.0 + k);
+
+		float *row = shadows.data() + static_cast< std::size_t >(r) * taps;
+		double y   = 0.0;
+		for (unsigned int i = 0; i < taps; ++i) {
+			const double x = i == 0 ? 1.0 : 0.0;
+			const double p = i == 1 ? 1.0 : 0.0;
+			y              = b0 * x + b1 * p - a1 * y;
+			row[i]         = static_cast< float >(y);
+		}
+
+		// Woodworth's formula for the time the sound takes to travel around the head
+		const double delay = angle < M_PI / 2.0 ? -std::cos(angle) : angle - M_PI / 2.0;
+		delays[r]          = (1.0 + delay) * HEAD_RADIUS / SPEED_OF_SOUND * rate;
+	}
+
+	unsigned int bits = 0;
+	while ((1U << bits) < FFT_SIZE) {
+		++bits;
+	}
+	for (unsigned int i = 0; i < FFT_SIZE; ++i) {
+		unsigned int value = 0;
+		for (unsigned int b = 0; b < bits; ++b) {
+			value |= ((i >> b) & 1U) << (bits - 1 - b);
+		}
+		reversed[i] = value;
+	}
+	for (unsigned int i = 0; i < FFT_SIZE / 2; ++i) {
+		const double phase = -2.0 * M_PI * static_cast< double >(i) / static_cast< double >(FFT_SIZE);
+		twiddles[i]        = { static_cast< float >(std::cos(phase)), static_cast< float >(std::sin(phase)) };
+	}
+}
+
+void AudioSpatializer::Dataset::hrir(double angle, float *out) const {
+	const double position = std::min(std::max(angle * 180.0 / M_PI / ROW_STEP, 0.0), static_cast< double >(rows - 1));
+	const unsigned int row = std::min(static_cast< unsigned int >(position), rows - 2);
+	const float weight     = static_cast< float >(position - static_cast< double >(row));
+
+	const float *first  = shadows.data() + static_cast< std::size_t >(row) * taps;
+	const float *second = first + taps;
+
+	// The delay is applied by linearly interpolating between the two frames it falls in between
+	const double delay        = delays[row] + (delays[row + 1] - delays[row]) * static_cast< double >(weight);
+	const unsigned int offset = static_cast< unsigned int >(delay);
+	const float fraction      = static_cast< float >(delay - static_cast< double >(offset));
+
+	std::fill(out, out + PARTITIONS * BLOCK_SIZE, 0.0f);
+	for (unsigned int i = 0; i < taps; ++i) {
+		const float tap = first[i] + (second[i] - first[i]) * weight;
+		out[offset + i] += tap * (1.0f - fraction);
+		out[offset + i + 1] += tap * fraction;
+	}
+}
+
+void AudioSpatializer::Dataset::fft(std::complex< float > *data, bool inverse) const {
+	for (unsigned int i = 0; i < FFT_SIZE; ++i) {
+		if (i < reversed[i]) {
+			std::swap(data[i], data[reversed[i]]);
+		}
+	}
+
+	for (unsigned int size = 2; size <= FFT_SIZE; size *= 2) {
+		const unsigned int half = size / 2;
+		const unsigned int step = FFT_SIZE / size;
+		for (unsigned int start = 0; start < FFT_SIZE; start += size) {
+			for (unsigned int k = 0; k < half; ++k) {
+				const std::complex< float > twiddle = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+				const std::complex< float > odd     = multiply(twiddle, data[start + k + half]);
+				data[start + k + half]              = data[start + k] - odd;
+				data[start + k] += odd;
+			}
+		}
+	}
+}
+
+std::shared_ptr< const AudioSpatializer::Dataset > AudioSpatializer::dataset(unsigned int sampleRate) {
+	static std::mutex mutex;
+	static std::map< unsigned int, std::weak_ptr< const Dataset > > datasets;
+
+	std::lock_guard< std::mutex > lock(mutex);
+
+	std::weak_ptr< const Dataset > &entry   = datasets[sampleRate];
+	std::shared_ptr< const Dataset > result = entry.lock();
+	if (!result) {
+		result = std::make_shared< const Dataset >(sampleRate);
+		entry  = result;
+	}
+
+	return result;
+}
+
+AudioSpatializer::AudioSpatializer(std::shared_ptr< const Dataset > dataset) : m_dataset(std::move(dataset)) {
+}
+
+AudioSpatializer::~AudioSpatializer() = default;
+
+void AudioSpatializer::process(const float *in, unsigned int count, const std::array< float, 3 > &direction,
+							   float leftGain, float rightGain, float *left, float *right) {
+	if (m_leftGain < 0.0f) {
+		m_leftGain  = leftGain;
+		m_rightGain = rightGain;
+	}
+
+	const float leftIncrement  = (leftGain - m_leftGain) / static_cast< float >(count);
+	const float rightIncrement = (rightGain - m_rightGain) / static_cast< float >(count);
+
+	unsigned int done = 0;
+	while (done < count) {
+		const unsigned int chunk = std::min(BLOCK_SIZE - m_fill, count - done);
+		std::copy(in + done, in + done + chunk, m_input.begin() + BLOCK_SIZE + m_fill);
+
+		const float progress = static_cast< float >(done);
+		AudioKernels::accumulateRamp(left + done, m_left.data() + m_fill, chunk,
+									 m_leftGain + leftIncrement * progress, leftIncrement);
+		AudioKernels::accumulateRamp(right + done, m_right.data() + m_fill, chunk,
+									 m_rightGain + rightIncrement * progress, rightIncrement);
+
+		m_fill += chunk;
+		done += chunk;
+
+		if (m_fill == BLOCK_SIZE) {
+			processBlock(direction);
+			m_fill = 0;
+		}
+	}
+
+	m_leftGain  = leftGain;
+	m_rightGain = rightGain;
+}
+
+void AudioSpatializer::buildFilter(Filter &filter, const std::array< float, 3 > &direction) const {
+	std::array< float, PARTITIONS * BLOCK_SIZE > leftResponse;
+	std::array< float, PARTITIONS * BLOCK_SIZE > rightResponse;
+
+	// The ears point along the x-axis
+	const double x = std::min(std::max(static_cast< double >(direction[0]), -1.0), 1.0);
+	m_dataset->hrir(std::acos(-x), leftResponse.data());
+	m_dataset->hrir(std::acos(x), rightResponse.data());
+
+	// The inverse transform's scaling is applied to the filter right away
+	const float scale = 1.0f / static_cast< float >(FFT_SIZE);
+	for (unsigned int p = 0; p < PARTITIONS; ++p) {
+		std::complex< float > *spectrum = filter[p].data();
+		for (unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+			spectrum[i] = { leftResponse[p * BLOCK_SIZE + i] * scale, rightResponse[p * BLOCK_SIZE + i] * scale };
+		}
+		std::fill(spectrum + BLOCK_SIZE, spectrum + FFT_SIZE, std::complex< float >());
+
+		m_dataset->fft(spectrum, false);
+	}
+}
+
+void AudioSpatializer::processBlock(const std::array< float, 3 > &direction) {
+	m_latest                        = (m_latest + 1) % PARTITIONS;
+	std::complex< float > *spectrum = m_history[m_latest].data();
+	for (unsigned int i = 0; i < FFT_SIZE; ++i) {
+		spectrum[i] = { m_input[i], 0.0f };
+	}
+	m_dataset->fft(spectrum, false);
+
+	const float similarity = direction[0] * m_filterDirection[0] + direction[1] * m_filterDirection[1]
+							 + direction[2] * m_filterDirection[2];
+	const bool rebuild = !m_hasFilter || similarity < REBUILD_THRESHOLD;
+	const bool fade    = rebuild && m_hasFilter;
+	if (rebuild) {
+		m_current = 1 - m_current;
+		buildFilter(m_filters[m_current], direction);
+		m_filterDirection = direction;
+		m_hasFilter       = true;
+	}
+
+	std::array< std::complex< float >, FFT_SIZE > output;
+	convolve(m_filters[m_current], output.data());
+
+	// Overlap-save: the first half of the output wraps around and is discarded
+	if (fade) {
+		std::array< std::complex< float >, FFT_SIZE > previous;
+		convolve(m_filters[1 - m_current], previous.data());
+
+		for (unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+			const float weight                = static_cast< float >(i + 1) / static_cast< float >(BLOCK_SIZE);
+			const std::complex< float > mixed = previous[BLOCK_SIZE + i] * (1.0f - weight)
+												+ output[BLOCK_SIZE + i] * weight;
+			m_left[i]  = mixed.real();
+			m_right[i] = mixed.imag();
+		}
+	} else {
+		for (unsigned int i = 0; i < BLOCK_SIZE; ++i) {
+			m_left[i]  = output[BLOCK_SIZE + i].real();
+			m_right[i] = output[BLOCK_SIZE + i].imag();
+		}
+	}
+
+	std::copy(m_input.begin() + BLOCK_SIZE, m_input.end(), m_input.begin());
+}
+
+void AudioSpatializer::convolve(const Filter &filter, std::complex< float > *out) const {
+	std::fill(out, out + FFT_SIZE, std::complex< float >());
+
+	for (unsigned int p = 0; p < PARTITIONS; ++p) {
+		// Partition p of the filter applies to the block p blocks ago
+		const std::complex< float > *spectrum = m_history[(m_latest + PARTITIONS - p) % PARTITIONS].data();
+		const std::complex< float > *taps     = filter[p].data();
+		for (unsigned int i = 0; i < FFT_SIZE; ++i) {
+			out[i] += multiply(spectrum[i], taps[i]);
+		}
+	}
+
+	m_dataset->fft(out, true);
+}
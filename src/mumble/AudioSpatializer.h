@@ -0,0 +1,83 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOSPATIALIZER_H_
+#define MUMBLE_MUMBLE_AUDIOSPATIALIZER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <complex>
+#include <memory>
+
+/// Renders a mono source for headphones as if it came from a direction, by convolving it with the head-related impulse
+/// responses (HRIRs) of both ears. The convolution is uniformly partitioned: the source is processed in blocks of
+/// BLOCK_SIZE frames, each of which is transformed once and multiplied by the spectra of the PARTITIONS parts of the
+/// HRIRs. Thus, the cost per frame doesn't depend on the direction, nor on how often it changes.
+///
+/// The HRIRs are interpolated from the ones a Dataset has computed in advance. A spatializer only builds a new filter
+/// from them once the direction has changed noticeably (and at most once per block), crossfading from the old filter to
+/// the new one over the block.
+class AudioSpatializer {
+public:
+	/// The number of frames convolved at once, by which the output lags behind the input
+	static constexpr unsigned int BLOCK_SIZE = 64;
+	/// The number of blocks the HRIRs span
+	static constexpr unsigned int PARTITIONS = 2;
+	static constexpr unsigned int FFT_SIZE   = 2 * BLOCK_SIZE;
+
+	struct Dataset;
+
+	/// @returns The HRIRs for the given sample rate, which are shared by all spatializers for it. They are computed if
+	/// 	there are none yet, which is why the audio thread shouldn't be the one to ask for them.
+	static std::shared_ptr< const Dataset > dataset(unsigned int sampleRate);
+
+	explicit AudioSpatializer(std::shared_ptr< const Dataset > dataset);
+	~AudioSpatializer();
+
+	/// Spatializes the given frames and adds them to the ones of both ears. The gains change linearly from the ones of
+	/// the previous call to the given ones.
+	///
+	/// @param direction The direction from the listener to the source in the listener's frame of reference (x pointing
+	/// 	to the right, y up and z to the front), of unit length
+	void process(const float *in, unsigned int count, const std::array< float, 3 > &direction, float leftGain,
+				 float rightGain, float *left, float *right);
+
+private:
+	Q_DISABLE_COPY(AudioSpatializer)
+
+	/// The spectra of the HRIRs' partitions, with the left ear's as the real and the right ear's as the imaginary part
+	/// (which are separated again by the inverse transform, as both ears' outputs are real)
+	using Filter = std::array< std::array< std::complex< float >, FFT_SIZE >, PARTITIONS >;
+
+	void buildFilter(Filter &filter, const std::array< float, 3 > &direction) const;
+	void processBlock(const std::array< float, 3 > &direction);
+	/// Convolves the spectra of the last PARTITIONS blocks with the filter, writing the output of both ears to out
+	void convolve(const Filter &filter, std::complex< float > *out) const;
+
+	std::shared_ptr< const Dataset > m_dataset;
+
+	/// The current and the previous filter
+	std::array< Filter, 2 > m_filters;
+	unsigned int m_current = 0;
+	/// The direction the current filter has been built for
+	std::array< float, 3 > m_filterDirection = { 0.0f, 0.0f, 0.0f };
+	bool m_hasFilter                         = false;
+
+	/// The previous block followed by the current one (which has m_fill frames so far)
+	std::array< float, FFT_SIZE > m_input = {};
+	unsigned int m_fill                   = 0;
+	/// The spectra of the last PARTITIONS blocks, the one of the latest block being at m_latest
+	std::array< std::array< std::complex< float >, FFT_SIZE >, PARTITIONS > m_history = {};
+	unsigned int m_latest                                                           = 0;
+	/// The output of the last block
+	std::array< float, BLOCK_SIZE > m_left  = {};
+	std::array< float, BLOCK_SIZE > m_right = {};
+
+	float m_leftGain  = -1.0f;
+	float m_rightGain = -1.0f;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOSPATIALIZER_H_
@@ -6,11 +6,13 @@
 #include "AudioStats.h"
 
 #include "AudioInput.h"
+#include "AudioLatency.h"
 #include "Utils.h"
 #include "smallft.h"
 #include "Global.h"
 
 #include <QtGui/QPainter>
+#include <QtWidgets/QLabel>
 
 #include <cmath>
 
@@ -145,10 +147,15 @@ void AudioEchoWidget::paintEvent(QPaintEvent *) {
 	paint.fillRect(rect(), Qt::black);
 
 	AudioInputPtr ai = Global::get().ai;
-	if (!ai || !ai->sesEcho)
+	if (!ai)
 		return;
 
+	// The echo canceller is replaced whenever the audio processor is reset
 	ai->qmSpeex.lock();
+	if (!ai->sesEcho) {
+		ai->qmSpeex.unlock();
+		return;
+	}
 
 	spx_int32_t sz;
 	speex_echo_ctl(ai->sesEcho, SPEEX_ECHO_GET_IMPULSE_RESPONSE_SIZE, &sz);
@@ -216,12 +223,16 @@ void AudioNoiseWidget::paintEvent(QPaintEvent *) {
 	paint.fillRect(rect(), pal.color(QPalette::Window));
 
 	AudioInputPtr ai = Global::get().ai;
-	if (!ai.get() || !ai->sppPreprocess)
+	if (!ai.get())
 		return;
 
 	QPolygonF poly;
 
 	ai->qmSpeex.lock();
+	if (!ai->sppPreprocess) {
+		ai->qmSpeex.unlock();
+		return;
+	}
 
 	spx_int32_t ps_size = 0;
 	speex_preprocess_ctl(ai->sppPreprocess, SPEEX_PREPROCESS_GET_PSD_SIZE, &ps_size);
@@ -298,6 +309,23 @@ AudioStats::AudioStats(QWidget *p) : QDialog(p) {
 	}
 
 
+	const QStringList stages = { tr("Encode"),        tr("Send"), tr("Network"),  tr("Receive"),
+								 tr("Jitter buffer"), tr("Mix"),  tr("Playback"), tr("Echo cancellation") };
+	const QStringList columns = { tr("Mean"), tr("95th percentile"), tr("Maximum") };
+	for (int i = 0; i < columns.size(); ++i) {
+		qglLatency->addWidget(new QLabel(columns[i], qgbLatency), 0, i + 1, Qt::AlignRight);
+	}
+	for (int i = 0; i < stages.size(); ++i) {
+		qglLatency->addWidget(new QLabel(stages[i], qgbLatency), i + 1, 0);
+		for (int j = 0; j < columns.size(); ++j) {
+			QLabel *label = new QLabel(qgbLatency);
+			label->setAlignment(Qt::AlignRight);
+			label->setAccessibleName(stages[i] + QLatin1String(" ") + columns[j]);
+			qglLatency->addWidget(label, i + 1, j + 1);
+			qlLatencies << label;
+		}
+	}
+
 	bTalking = false;
 
 	abSpeech->iPeak    = -1;
@@ -317,12 +345,42 @@ AudioStats::~AudioStats() {
 // sprintf() has been deprecated in Qt 5.5 in favor for the static QString::asprintf()
 #	define FORMAT_TO_TXT(format, arg) txt.sprintf(format, arg)
 #endif
+void AudioStats::updateLatencies() {
+	const auto format = [](quint64 latency) {
+		return tr("%1 ms").arg(QString::number(static_cast< double >(latency) / 1000.0, 'f', 1));
+	};
+
+	for (std::size_t i = 0; i < AudioLatency::STAGE_COUNT; ++i) {
+		const AudioLatency::Histogram histogram = AudioLatency::histogram(static_cast< AudioLatency::Stage >(i));
+		const int first                         = static_cast< int >(i) * 3;
+
+		if (histogram.samples == 0) {
+			for (int j = 0; j < 3; ++j) {
+				qlLatencies[first + j]->setText(tr("n/a"));
+			}
+		} else {
+			qlLatencies[first + 0]->setText(format(histogram.mean()));
+			qlLatencies[first + 1]->setText(format(histogram.percentile(0.95)));
+			qlLatencies[first + 2]->setText(format(histogram.max));
+		}
+	}
+}
+
+void AudioStats::on_qpbResetLatency_clicked() {
+	AudioLatency::reset();
+	updateLatencies();
+}
+
 void AudioStats::on_Tick_timeout() {
+	updateLatencies();
+
 	AudioInputPtr ai = Global::get().ai;
 
 	if (!ai.get() || !ai->sppPreprocess)
 		return;
 
+	ai->requestProcessing();
+
 	bool nTalking = ai->isTransmitting();
 
 	QString txt;
@@ -336,6 +394,11 @@ void AudioStats::on_Tick_timeout() {
 	FORMAT_TO_TXT("%06.2f dB", ai->dPeakSignal);
 	qlSignalLevel->setText(txt);
 
+	// The preprocessor is replaced (and the old one deleted) whenever the audio processor is reset
+	QMutexLocker l(&ai->qmSpeex);
+	if (!ai->sppPreprocess)
+		return;
+
 	spx_int32_t ps_size = 0;
 	speex_preprocess_ctl(ai->sppPreprocess, SPEEX_PREPROCESS_GET_PSD_SIZE, &ps_size);
 
@@ -363,6 +426,7 @@ void AudioStats::on_Tick_timeout() {
 
 	spx_int32_t v;
 	speex_preprocess_ctl(ai->sppPreprocess, SPEEX_PREPROCESS_GET_AGC_GAIN, &v);
+	l.unlock();
 	float fv = powf(10.0f, (static_cast< float >(v) / 20.0f));
 	FORMAT_TO_TXT("%03.0f%%", 100.0f / fv);
 	qlMicVolume->setText(txt);
@@ -58,12 +58,17 @@ private:
 protected:
 	QTimer *qtTick;
 	bool bTalking;
+	/// The mean, 95th percentile and maximum of each stage of the latency
+	QList< QLabel * > qlLatencies;
+
+	void updateLatencies();
 
 public:
 	AudioStats(QWidget *parent);
 	~AudioStats() Q_DECL_OVERRIDE;
 public slots:
 	void on_Tick_timeout();
+	void on_qpbResetLatency_clicked();
 };
 
 #else
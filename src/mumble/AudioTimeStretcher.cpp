@@ -0,0 +1,122 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioTimeStretcher.h"
+
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+/// The normalized cross-correlation above which a segment is considered similar enough to be cut out or repeated
+/// without being heard
+constexpr double SIMILARITY_THRESHOLD = 0.9;
+} // namespace
+
+AudioTimeStretcher::AudioTimeStretcher(unsigned int sampleRate, unsigned int channels, unsigned int maxFrames)
+	: m_channels(channels), m_minLength(sampleRate / 400), m_maxLength(sampleRate * 3 / 200), m_mono(maxFrames) {
+}
+
+unsigned int AudioTimeStretcher::shorten(float *frames, unsigned int count, bool quiet) {
+	const unsigned int length = findSegment(frames, count, count, quiet);
+	if (length == 0) {
+		return 0;
+	}
+
+	// The start of the frames fades into the part resembling it, which the rest of the frames follows
+	crossfade(frames, frames + length * m_channels, frames, length);
+	std::memmove(frames + length * m_channels, frames + 2 * length * m_channels,
+				 (count - 2 * length) * m_channels * sizeof(float));
+
+	return length;
+}
+
+unsigned int AudioTimeStretcher::lengthen(float *frames, unsigned int count, unsigned int capacity, bool quiet) {
+	if (capacity <= count) {
+		return 0;
+	}
+
+	const unsigned int length = findSegment(frames, count, capacity - count, quiet);
+	if (length == 0) {
+		return 0;
+	}
+
+	// The part resembling the start fades into the start again, from where the frames are played once more. The part
+	// is moved out of the way first.
+	std::memmove(frames + 2 * length * m_channels, frames + length * m_channels,
+				 (count - length) * m_channels * sizeof(float));
+	crossfade(frames + 2 * length * m_channels, frames, frames + length * m_channels, length);
+
+	return length;
+}
+
+unsigned int AudioTimeStretcher::findSegment(const float *frames, unsigned int count, unsigned int maxLength,
+											 bool quiet) {
+	count = std::min(count, static_cast< unsigned int >(m_mono.size()));
+
+	// The start is compared to the frames following each of the possible lengths, over a window as long as the longest
+	const unsigned int longest = std::min({ m_maxLength, count / 2, maxLength });
+	if (longest < m_minLength) {
+		return 0;
+	}
+	const unsigned int window = longest;
+
+	const float scale = 1.0f / static_cast< float >(m_channels);
+	for (unsigned int i = 0; i < longest + window; ++i) {
+		float sum = 0.0f;
+		for (unsigned int c = 0; c < m_channels; ++c) {
+			sum += frames[i * m_channels + c];
+		}
+		m_mono[i] = sum * scale;
+	}
+
+	const float *start  = m_mono.data();
+	const double energy = AudioKernels::dot(start, start, window);
+	if (energy < 1e-9 * window) {
+		// Silence can be cut anywhere
+		return longest;
+	}
+
+	// The energy of the window following the current length, which slides along with it
+	double candidateEnergy = AudioKernels::dot(start + m_minLength, start + m_minLength, window);
+
+	unsigned int best     = 0;
+	double bestSimilarity = 0.0;
+	for (unsigned int length = m_minLength; length <= longest; ++length) {
+		if (candidateEnergy > 0.0) {
+			const double similarity =
+				AudioKernels::dot(start, start + length, window) / std::sqrt(energy * candidateEnergy);
+			if (similarity > bestSimilarity) {
+				bestSimilarity = similarity;
+				best           = length;
+			}
+		}
+
+		if (length < longest) {
+			const double leaving  = m_mono[length];
+			const double entering = m_mono[length + window];
+			candidateEnergy       = std::max(0.0, candidateEnergy - leaving * leaving + entering * entering);
+		}
+	}
+
+	if (quiet) {
+		return best != 0 ? best : longest;
+	}
+
+	return bestSimilarity >= SIMILARITY_THRESHOLD ? best : 0;
+}
+
+void AudioTimeStretcher::crossfade(const float *a, const float *b, float *out, unsigned int length) const {
+	const float step = 1.0f / static_cast< float >(length + 1);
+	for (unsigned int i = 0; i < length; ++i) {
+		const float weight = static_cast< float >(i + 1) * step;
+		for (unsigned int c = 0; c < m_channels; ++c) {
+			const unsigned int index = i * m_channels + c;
+			out[index]               = a[index] * (1.0f - weight) + b[index] * weight;
+		}
+	}
+}
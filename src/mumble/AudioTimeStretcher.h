@@ -0,0 +1,54 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOTIMESTRETCHER_H_
+#define MUMBLE_MUMBLE_AUDIOTIMESTRETCHER_H_
+
+#include <QtCore/QtGlobal>
+
+#include <vector>
+
+/// Shortens or lengthens speech without changing its pitch, by removing or repeating a segment of it. The segment is
+/// the one between the start of the frames and the part of them that resembles the start the most (waveform
+/// similarity overlap-add, WSOLA), which for voiced speech is a multiple of the pitch period. The seam is crossfaded.
+///
+/// The frames are interleaved and processed in place. Nothing is allocated after construction, so that the audio
+/// thread may stretch.
+class AudioTimeStretcher {
+public:
+	/// @param maxFrames The most frames that are stretched at once
+	AudioTimeStretcher(unsigned int sampleRate, unsigned int channels, unsigned int maxFrames);
+
+	/// Removes a segment from the given frames
+	///
+	/// @param quiet Whether the frames are (close to) silence, in which case they are shortened even if no part of
+	/// 	them is similar enough to the start
+	/// @returns The number of frames that have been removed, 0 if the frames are too short or dissimilar
+	unsigned int shorten(float *frames, unsigned int count, bool quiet);
+
+	/// Repeats a segment of the given frames
+	///
+	/// @param capacity The number of frames there is room for
+	/// @returns The number of frames that have been inserted
+	unsigned int lengthen(float *frames, unsigned int count, unsigned int capacity, bool quiet);
+
+private:
+	Q_DISABLE_COPY(AudioTimeStretcher)
+
+	/// @returns The length (in frames) of the segment that is to be removed or repeated, 0 if there is none
+	unsigned int findSegment(const float *frames, unsigned int count, unsigned int maxLength, bool quiet);
+	/// Crossfades from a to b into out, for length frames
+	void crossfade(const float *a, const float *b, float *out, unsigned int length) const;
+
+	const unsigned int m_channels;
+	/// The range of the segment's length, which covers the pitch periods of most voices
+	const unsigned int m_minLength;
+	const unsigned int m_maxLength;
+
+	/// The mean of the channels, which the similarity is measured on
+	std::vector< float > m_mono;
+};
+
+#endif // MUMBLE_MUMBLE_AUDIOTIMESTRETCHER_H_
@@ -454,6 +454,8 @@ void AudioWizard::on_Ticker_timeout() {
 	if (!ai || !ao)
 		return;
 
+	ai->requestProcessing();
+
 	int iPeak = static_cast< int >(ai->dMaxMic);
 
 	if (iTicks++ >= 50) {
@@ -0,0 +1,53 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CachedPlugin.h"
+
+CachedPlugin::CachedPlugin(QString path, const PluginMetadata &metadata, QObject *p)
+	: Plugin(path, false, p, false), m_metadata(metadata) {
+}
+
+CachedPlugin::~CachedPlugin() {
+}
+
+bool CachedPlugin::doInitialize() {
+	// There are no functions to resolve without the library
+	return m_pluginIsValid;
+}
+
+mumble_error_t CachedPlugin::init() {
+	qWarning("CachedPlugin: Attempting to initialize \"%s\" without having loaded its library",
+			 qUtf8Printable(m_pluginPath));
+
+	return MUMBLE_EC_GENERIC_ERROR;
+}
+
+const PluginMetadata &CachedPlugin::getMetadata() const {
+	return m_metadata;
+}
+
+QString CachedPlugin::getName() const {
+	return m_metadata.name;
+}
+
+mumble_version_t CachedPlugin::getAPIVersion() const {
+	return m_metadata.apiVersion;
+}
+
+mumble_version_t CachedPlugin::getVersion() const {
+	return m_metadata.version;
+}
+
+QString CachedPlugin::getAuthor() const {
+	return m_metadata.author;
+}
+
+QString CachedPlugin::getDescription() const {
+	return m_metadata.description;
+}
+
+uint32_t CachedPlugin::getFeatures() const {
+	return m_metadata.features;
+}
@@ -0,0 +1,56 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_CACHEDPLUGIN_H_
+#define MUMBLE_MUMBLE_CACHEDPLUGIN_H_
+
+#include "Plugin.h"
+#include "PluginMetadataCache.h"
+
+#include <QtCore/QString>
+
+#include <memory>
+
+class CachedPlugin;
+
+/// Typedef for a CachedPlugin pointer
+typedef std::shared_ptr< CachedPlugin > cached_plugin_ptr_t;
+
+/// A plugin whose library hasn't been loaded. It answers from the metadata in the PluginMetadataCache, so that the
+/// plugins that aren't enabled can be listed without loading their libraries. It can't be initialized itself: the
+/// PluginManager replaces it with the actual plugin (under the same ID) once it is to be loaded.
+class CachedPlugin : public Plugin {
+	friend class Plugin; // needed in order for Plugin::createNew to access CachedPlugin::doInitialize()
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(CachedPlugin)
+
+protected:
+	/// The metadata of the plugin's library. It is effectively const and therefore it is not needed to protect
+	/// read-access by a lock.
+	const PluginMetadata m_metadata;
+
+	CachedPlugin(QString path, const PluginMetadata &metadata, QObject *p = nullptr);
+
+	virtual bool doInitialize() override;
+
+public:
+	virtual ~CachedPlugin() override;
+
+	/// Always fails, as the library has to be loaded first
+	virtual mumble_error_t init() override;
+
+	/// @returns The metadata of the plugin's library
+	const PluginMetadata &getMetadata() const;
+
+	virtual QString getName() const override;
+	virtual mumble_version_t getAPIVersion() const override;
+	virtual mumble_version_t getVersion() const override;
+	virtual QString getAuthor() const override;
+	virtual QString getDescription() const override;
+	virtual uint32_t getFeatures() const override;
+};
+
+#endif // MUMBLE_MUMBLE_CACHEDPLUGIN_H_
@@ -18,7 +18,7 @@ QReadWriteLock ClientUser::c_qrwlTalking;
 
 ClientUser::ClientUser(QObject *p)
 	: QObject(p), tsState(Settings::Passive), tLastTalkStateChange(false), bLocalIgnore(false), bLocalIgnoreTTS(false),
-	  bLocalMute(false), fPowerMin(0.0f), fPowerMax(0.0f), fAverageAvailable(0.0f), iFrames(0), iSequence(0) {
+	  bLocalMute(false), fPowerMin(0.0f), fPowerMax(0.0f), fPlayoutDelay(0.0f), iFrames(0), iSequence(0) {
 }
 
 float ClientUser::getLocalVolumeAdjustments() const {
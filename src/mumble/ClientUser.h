@@ -30,7 +30,8 @@ public:
 	bool bLocalMute;
 
 	float fPowerMin, fPowerMax;
-	float fAverageAvailable;
+	/// The delay (in frames) the jitter buffer has settled on for the user, which the next transmission starts from
+	float fPlayoutDelay;
 
 	int iFrames;
 	int iSequence;
@@ -269,7 +269,7 @@ void ConfigDialog::accept() {
 		Global::get().s.qbaConfigGeometry = saveGeometry();
 
 	// Save settings to disk
-	Global::get().s.save();
+	Global::get().s.saveLater();
 
 	QDialog::accept();
 }
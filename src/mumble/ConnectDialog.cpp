@@ -11,6 +11,7 @@
 
 #include "Channel.h"
 #include "Database.h"
+#include "PublicServerList.h"
 #include "ServerHandler.h"
 #include "ServerResolver.h"
 #include "Utils.h"
@@ -18,6 +19,7 @@
 #include "Global.h"
 
 #include <QSettings>
+#include <QtConcurrent/QtConcurrent>
 #include <QtCore/QMimeData>
 #include <QtCore/QUrlQuery>
 #include <QtCore/QtEndian>
@@ -49,6 +51,8 @@ QMap< QString, QIcon > ServerItem::qmIcons;
 QList< PublicInfo > ConnectDialog::qlPublicServers;
 QString ConnectDialog::qsUserCountry, ConnectDialog::qsUserCountryCode, ConnectDialog::qsUserContinentCode;
 Timer ConnectDialog::tPublicServers;
+constexpr int ConnectDialog::MAX_ACTIVE_LOOKUPS;
+constexpr int ConnectDialog::PINGS_PER_TICK;
 
 
 PingStats::PingStats() {
@@ -1058,6 +1062,19 @@ ConnectDialog::ConnectDialog(QWidget *p, bool autoconnect) : QDialog(p), bAutoCo
 		Global::get().zeroconf->startBrowser(QLatin1String("_mumble._tcp"));
 	}
 #endif
+	connect(&m_cachedPublicListWatcher, &QFutureWatcher< PublicServerList >::finished, this, [this]() {
+		const PublicServerList cached = m_cachedPublicListWatcher.result();
+		if (!cached.servers.isEmpty()) {
+			applyList(cached);
+		}
+
+		fetchList(cached);
+	});
+	connect(&m_fetchedPublicListWatcher, &QFutureWatcher< PublicServerList >::finished, this, [this]() {
+		applyList(m_fetchedPublicListWatcher.result());
+		tPublicServers.restart();
+	});
+
 	qtPingTick = new QTimer(this);
 	connect(qtPingTick, SIGNAL(timeout()), this, SLOT(timeTick()));
 
@@ -1374,6 +1391,12 @@ void ConnectDialog::initList() {
 
 	bPublicInit = true;
 
+	// The list that has been received last is shown right away, until the service has sent a newer one
+	const QString path = publicListCachePath();
+	m_cachedPublicListWatcher.setFuture(QtConcurrent::run([path]() { return PublicServerList::load(path); }));
+}
+
+void ConnectDialog::fetchList(const PublicServerList &cached) {
 	QUrl url;
 	url.setPath(QLatin1String("/v1/list"));
 
@@ -1381,7 +1404,22 @@ void ConnectDialog::initList() {
 	query.addQueryItem(QLatin1String("version"), Version::getRelease());
 	url.setQuery(query);
 
-	WebFetch::fetch(QLatin1String("publist"), url, this, SLOT(fetched(QByteArray, QUrl, QMap< QString, QString >)));
+	WebFetch::fetch(QLatin1String("publist"), url, this, SLOT(fetched(QByteArray, QUrl, QMap< QString, QString >)),
+					cached.conditionalHeaders());
+}
+
+void ConnectDialog::applyList(const PublicServerList &list) {
+	qlPublicServers     = list.servers;
+	qsUserCountry       = list.userCountry;
+	qsUserCountryCode   = list.userCountryCode;
+	qsUserContinentCode = list.userContinentCode;
+
+	addCountriesToSearchLocation();
+	fillList();
+}
+
+QString ConnectDialog::publicListCachePath() {
+	return Global::get().qdBasePath.absoluteFilePath(QLatin1String("publist.dat"));
 }
 
 #ifdef USE_ZEROCONF
@@ -1441,28 +1479,50 @@ void ConnectDialog::onLanResolveError(const BonjourRecord record) {
 #endif
 
 void ConnectDialog::fillList() {
+	// The items by address, so that the list is matched against them in a single pass
+	QHash< QPair< QString, unsigned short >, QList< ServerItem * > > items;
+	for (ServerItem *si : qlItems) {
+		items[qMakePair(si->qsHostname, si->usPort)] << si;
+	}
+
 	QList< QTreeWidgetItem * > ql;
 	QList< QTreeWidgetItem * > qlNew;
+	QSet< ServerItem * > listed;
 
 	foreach (const PublicInfo &pi, qlPublicServers) {
 		bool found = false;
-		foreach (ServerItem *si, qlItems) {
-			if ((pi.qsIp == si->qsHostname) && (pi.usPort == si->usPort)) {
-				si->qsCountry       = pi.qsCountry;
-				si->qsCountryCode   = pi.qsCountryCode;
-				si->qsContinentCode = pi.qsContinentCode;
-				si->qsUrl           = pi.quUrl.toString();
-				si->bCA             = pi.bCA;
-				si->setDatas();
-
-				if (si->itType == ServerItem::PublicType)
-					found = true;
+		for (ServerItem *si : items.value(qMakePair(pi.qsIp, pi.usPort))) {
+			si->qsCountry       = pi.qsCountry;
+			si->qsCountryCode   = pi.qsCountryCode;
+			si->qsContinentCode = pi.qsContinentCode;
+			si->qsUrl           = pi.quUrl.toString();
+			si->bCA             = pi.bCA;
+
+			if (si->itType == ServerItem::PublicType) {
+				si->qsName = pi.qsName;
+				listed.insert(si);
+				found = true;
 			}
+
+			si->setDatas();
 		}
 		if (!found)
 			ql << new ServerItem(pi);
 	}
 
+	// The servers that are no longer listed go away
+	const QList< ServerItem * > publicItems = qtwServers->siPublic->qlChildren;
+	for (ServerItem *si : publicItems) {
+		if (!listed.contains(si)) {
+			if (si == siAutoConnect)
+				siAutoConnect = nullptr;
+
+			stopDns(si);
+			qlItems.removeAll(si);
+			delete si;
+		}
+	}
+
 	while (!ql.isEmpty()) {
 		ServerItem *si = static_cast< ServerItem * >(ql.takeAt(QRandomGenerator::global()->bounded(0, ql.count())));
 		qlNew << si;
@@ -1478,6 +1538,8 @@ void ConnectDialog::fillList() {
 }
 
 void ConnectDialog::timeTick() {
+	applyPingReplies();
+
 	if (!bLastFound && !Global::get().s.qsLastServer.isEmpty()) {
 		QList< QTreeWidgetItem * > items =
 			qtwServers->findItems(Global::get().s.qsLastServer, Qt::MatchExactly | Qt::MatchRecursive);
@@ -1498,8 +1560,12 @@ void ConnectDialog::timeTick() {
 	}
 
 	if (bAllowHostLookup) {
-		// Start DNS Lookup of first unknown hostname
-		foreach (const UnresolvedServerAddress &unresolved, qlDNSLookup) {
+		// Start the DNS lookups of the first unknown hostnames, of which a bounded number is in flight at once
+		const QList< UnresolvedServerAddress > lookups = qlDNSLookup;
+		for (const UnresolvedServerAddress &unresolved : lookups) {
+			if (qsDNSActive.size() >= MAX_ACTIVE_LOOKUPS) {
+				break;
+			}
 			if (qsDNSActive.contains(unresolved)) {
 				continue;
 			}
@@ -1511,7 +1577,6 @@ void ConnectDialog::timeTick() {
 			ServerResolver *sr = new ServerResolver();
 			QObject::connect(sr, SIGNAL(resolved()), this, SLOT(lookedUp()));
 			sr->resolve(unresolved.hostname, unresolved.port);
-			break;
 		}
 	}
 
@@ -1540,31 +1605,52 @@ void ConnectDialog::timeTick() {
 		}
 	}
 
-	if (!si) {
-		if (qlItems.isEmpty())
-			return;
-
-		bool expanded;
+	int pinged = 0;
+	if (si) {
+		pingServer(si, current, hover);
+		++pinged;
+	}
 
-		do {
-			++iPingIndex;
-			if (iPingIndex >= qlItems.count()) {
-				if (tRestart.isElapsed(1000000ULL))
-					iPingIndex = 0;
-				else
-					return;
-			}
-			si = qlItems.at(iPingIndex);
+	// Walk through the others, a batch of them per tick
+	for (; pinged < PINGS_PER_TICK; ++pinged) {
+		si = nextPingTarget();
+		if (!si) {
+			break;
+		}
 
-			ServerItem *p = si->siParent;
-			expanded      = true;
-			while (p && expanded) {
-				expanded = expanded && p->isExpanded();
-				p        = p->siParent;
-			}
-		} while (si->qlAddresses.isEmpty() || !expanded);
+		pingServer(si, current, hover);
 	}
+}
+
+ServerItem *ConnectDialog::nextPingTarget() {
+	if (qlItems.isEmpty())
+		return nullptr;
+
+	ServerItem *si;
+	bool expanded;
+
+	do {
+		++iPingIndex;
+		if (iPingIndex >= qlItems.count()) {
+			if (tRestart.isElapsed(1000000ULL))
+				iPingIndex = 0;
+			else
+				return nullptr;
+		}
+		si = qlItems.at(iPingIndex);
 
+		ServerItem *p = si->siParent;
+		expanded      = true;
+		while (p && expanded) {
+			expanded = expanded && p->isExpanded();
+			p        = p->siParent;
+		}
+	} while (si->qlAddresses.isEmpty() || !expanded);
+
+	return si;
+}
+
+void ConnectDialog::pingServer(ServerItem *si, const ServerItem *current, const ServerItem *hover) {
 	if (si == current)
 		tCurrent.restart();
 	if (si == hover)
@@ -1612,6 +1698,11 @@ void ConnectDialog::addCountriesToSearchLocation() const {
 	}
 
 	foreach (auto location, qmCountries.keys()) {
+		// The countries of a previous list are there already
+		if (qcbSearchLocation->findData(location) >= 0) {
+			continue;
+		}
+
 		// Set Icon, Text and Data
 		qcbSearchLocation->addItem(
 			ServerItem::loadIcon(QString::fromLatin1(":/flags/%1.svg").arg(qmCountries.value(location))), location,
@@ -1821,68 +1912,74 @@ void ConnectDialog::udpReply() {
 			ServerAddress address(HostAddress(host), port);
 
 			if (qhPings.contains(address)) {
-				Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
+				PingReply reply;
+				reply.address  = address;
+				reply.pingData = m_udpDecoder.getPingData();
+				reply.elapsed  = tPing.elapsed() - (reply.pingData.timestamp ^ qhPingRand.value(address));
 
-				quint64 elapsed = tPing.elapsed() - (pingData.timestamp ^ qhPingRand.value(address));
+				// The list is updated with the replies of a tick at once (see applyPingReplies())
+				qlPingReplies << reply;
+			}
+		}
+	}
+}
 
-				for (ServerItem *si : qhPings.value(address)) {
-					si->m_version    = pingData.serverVersion;
-					quint32 users    = pingData.userCount;
-					quint32 maxusers = pingData.maxUserCount;
-					si->uiBandwidth  = pingData.maxBandwidthPerUser;
+void ConnectDialog::applyPingReplies() {
+	if (qlPingReplies.isEmpty()) {
+		return;
+	}
 
-					if (!si->uiPingSort)
-						si->uiPingSort = qmPingCache.value(UnresolvedServerAddress(si->qsHostname, si->usPort));
+	// Every change of an item would sort the list again, so it is sorted once for all of them instead
+	const bool sorting = qtwServers->isSortingEnabled();
+	qtwServers->setSortingEnabled(false);
 
-					si->setDatas(static_cast< double >(elapsed), users, maxusers);
-					if (si->itType == ServerItem::PublicType) {
-						filterServer(si);
-					}
-				}
+	for (const PingReply &reply : qlPingReplies) {
+		// The servers may have been removed since
+		for (ServerItem *si : qhPings.value(reply.address)) {
+			si->m_version    = reply.pingData.serverVersion;
+			quint32 users    = reply.pingData.userCount;
+			quint32 maxusers = reply.pingData.maxUserCount;
+			si->uiBandwidth  = reply.pingData.maxBandwidthPerUser;
+
+			if (!si->uiPingSort)
+				si->uiPingSort = qmPingCache.value(UnresolvedServerAddress(si->qsHostname, si->usPort));
+
+			si->setDatas(static_cast< double >(reply.elapsed), users, maxusers);
+			if (si->itType == ServerItem::PublicType) {
+				filterServer(si);
 			}
 		}
 	}
+	qlPingReplies.clear();
+
+	qtwServers->setSortingEnabled(sorting);
 }
 
 void ConnectDialog::fetched(QByteArray xmlData, QUrl, QMap< QString, QString > headers) {
 	if (xmlData.isNull()) {
-		QMessageBox::warning(this, QLatin1String("Mumble"), tr("Failed to fetch server list"), QMessageBox::Ok);
+		// The list that has been received last is shown instead, if there is one
+		if (qlPublicServers.isEmpty()) {
+			QMessageBox::warning(this, QLatin1String("Mumble"), tr("Failed to fetch server list"), QMessageBox::Ok);
+		}
 		return;
 	}
 
-	QDomDocument doc;
-	doc.setContent(xmlData);
-
-	qlPublicServers.clear();
-	qsUserCountry       = headers.value(QLatin1String("Geo-Country"));
-	qsUserCountryCode   = headers.value(QLatin1String("Geo-Country-Code")).toLower();
-	qsUserContinentCode = headers.value(QLatin1String("Geo-Continent-Code")).toLower();
-
-	QDomElement root = doc.documentElement();
-	QDomNode n       = root.firstChild();
-	while (!n.isNull()) {
-		QDomElement e = n.toElement();
-		if (!e.isNull()) {
-			if (e.tagName() == QLatin1String("server")) {
-				PublicInfo pi;
-				pi.qsName          = e.attribute(QLatin1String("name"));
-				pi.quUrl           = e.attribute(QLatin1String("url"));
-				pi.qsIp            = e.attribute(QLatin1String("ip"));
-				pi.usPort          = e.attribute(QLatin1String("port")).toUShort();
-				pi.qsCountry       = e.attribute(QLatin1String("country"), tr("Unknown"));
-				pi.qsCountryCode   = e.attribute(QLatin1String("country_code")).toLower();
-				pi.qsContinentCode = e.attribute(QLatin1String("continent_code")).toLower();
-				pi.bCA             = e.attribute(QLatin1String("ca")).toInt() ? true : false;
-
-				qlPublicServers << pi;
-			}
-		}
-		n = n.nextSibling();
+	if (xmlData.isEmpty()) {
+		// The list hasn't changed since the one that is shown
+		tPublicServers.restart();
+		return;
 	}
-	addCountriesToSearchLocation();
-	tPublicServers.restart();
 
-	fillList();
+	// The list is parsed (and kept for the next time) while the dialog goes on
+	const QString path = publicListCachePath();
+	m_fetchedPublicListWatcher.setFuture(QtConcurrent::run([xmlData, headers, path]() {
+		PublicServerList list = PublicServerList::parse(xmlData, headers);
+		if (!list.save(path)) {
+			qWarning("ConnectDialog: Failed to write the public server list to %s", qPrintable(path));
+		}
+
+		return list;
+	}));
 }
 
 void ConnectDialog::on_qleSearchServername_textChanged(const QString &searchServername) {
@@ -11,6 +11,7 @@
 #	include <boost/accumulators/statistics/stats.hpp>
 #endif
 
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QString>
 #include <QtCore/QUrl>
 #include <QtCore/QtGlobal>
@@ -28,6 +29,7 @@
 #include "HostAddress.h"
 #include "MumbleProtocol.h"
 #include "Net.h"
+#include "PublicServerList.h"
 #include "ServerAddress.h"
 #include "Timer.h"
 #include "UnresolvedServerAddress.h"
@@ -36,17 +38,6 @@
 struct FavoriteServer;
 class QUdpSocket;
 
-struct PublicInfo {
-	QString qsName;
-	QUrl quUrl;
-	QString qsIp;
-	QString qsCountry;
-	QString qsCountryCode;
-	QString qsContinentCode;
-	unsigned short usPort;
-	bool bCA;
-};
-
 struct PingStats {
 private:
 	Q_DISABLE_COPY(PingStats)
@@ -236,6 +227,18 @@ private:
 	Q_OBJECT
 	Q_DISABLE_COPY(ConnectDialog)
 protected:
+	/// The most DNS lookups that are in flight at once
+	static constexpr int MAX_ACTIVE_LOOKUPS = 16;
+	/// The most servers that are pinged per tick of qtPingTick
+	static constexpr int PINGS_PER_TICK = 20;
+
+	struct PingReply {
+		ServerAddress address;
+		/// The round-trip time in microseconds
+		quint64 elapsed;
+		Mumble::Protocol::PingData pingData;
+	};
+
 	static QList< PublicInfo > qlPublicServers;
 	static QString qsUserCountry, qsUserCountryCode, qsUserContinentCode;
 	static Timer tPublicServers;
@@ -246,6 +249,11 @@ protected:
 	bool bPublicInit;
 	bool bAutoConnect;
 
+	/// Loads the public server list that has been received last from the disk
+	QFutureWatcher< PublicServerList > m_cachedPublicListWatcher;
+	/// Parses the public server list that has just been received
+	QFutureWatcher< PublicServerList > m_fetchedPublicListWatcher;
+
 	Timer tPing;
 	Timer tCurrent, tHover, tRestart;
 	QUdpSocket *qusSocket4;
@@ -262,6 +270,8 @@ protected:
 
 	QHash< ServerAddress, quint64 > qhPingRand;
 	QHash< ServerAddress, QSet< ServerItem * > > qhPings;
+	/// The replies that have been received since the last tick
+	QList< PingReply > qlPingReplies;
 
 	QMap< UnresolvedServerAddress, unsigned int > qmPingCache;
 
@@ -294,11 +304,26 @@ protected:
 
 
 	void sendPing(const QHostAddress &, unsigned short port, Version::full_t protocolVersion);
+	/// @returns The next server to ping in the round through all of them, nullptr if the round is over and the next
+	/// 	one mustn't start yet
+	ServerItem *nextPingTarget();
+	/// Pings every address of the given server
+	void pingServer(ServerItem *si, const ServerItem *current, const ServerItem *hover);
+	/// Updates the servers with the replies to their pings that have been received since the last tick
+	void applyPingReplies();
 	bool writePing(const QHostAddress &host, unsigned short port, Version::full_t protocolVersion,
 				   const Mumble::Protocol::PingData &pingData);
 
 	void initList();
+	/// Fetches the public server list, which is only sent if it has changed since the given one
+	void fetchList(const PublicServerList &cached);
+	/// Shows the given public server list
+	void applyList(const PublicServerList &list);
+	/// Updates the items of the public servers to match ConnectDialog#qlPublicServers. Only the items of the servers
+	/// that have been added or removed are created or deleted.
 	void fillList();
+	/// @returns Where the public server list that has been received last is kept
+	static QString publicListCachePath();
 
 	void startDns(ServerItem *);
 	void stopDns(ServerItem *);
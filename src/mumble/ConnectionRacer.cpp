@@ -0,0 +1,129 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ConnectionRacer.h"
+
+#include <QtNetwork/QTcpSocket>
+
+ConnectionRacer::ConnectionRacer(QObject *parent) : QObject(parent) {
+	m_attemptTimer.setSingleShot(true);
+	connect(&m_attemptTimer, SIGNAL(timeout()), this, SLOT(startAttempt()));
+
+	m_timeoutTimer.setSingleShot(true);
+	connect(&m_timeoutTimer, SIGNAL(timeout()), this, SLOT(timedOut()));
+}
+
+ConnectionRacer::~ConnectionRacer() {
+	abortAttempts();
+}
+
+QList< ServerAddress > ConnectionRacer::interleave(const QList< ServerAddress > &addresses) {
+	QList< ServerAddress > v6;
+	QList< ServerAddress > v4;
+	for (const ServerAddress &address : addresses) {
+		if (address.host.isV6()) {
+			v6 << address;
+		} else {
+			v4 << address;
+		}
+	}
+
+	QList< ServerAddress > interleaved;
+	for (int i = 0; i < v6.size() || i < v4.size(); i++) {
+		if (i < v6.size()) {
+			interleaved << v6.at(i);
+		}
+		if (i < v4.size()) {
+			interleaved << v4.at(i);
+		}
+	}
+
+	return interleaved;
+}
+
+void ConnectionRacer::race(const QList< ServerAddress > &addresses, int timeout) {
+	abortAttempts();
+
+	m_pending = interleave(addresses);
+	m_winner  = ServerAddress();
+
+	m_timeoutTimer.start(timeout);
+	startAttempt();
+}
+
+ServerAddress ConnectionRacer::winner() const {
+	return m_winner;
+}
+
+void ConnectionRacer::startAttempt() {
+	if (m_pending.isEmpty()) {
+		if (m_attempts.isEmpty()) {
+			finish();
+		}
+		return;
+	}
+
+	const ServerAddress address = m_pending.takeFirst();
+
+	QTcpSocket *socket = new QTcpSocket(this);
+	connect(socket, SIGNAL(connected()), this, SLOT(attemptConnected()));
+	connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this,
+			SLOT(attemptFailed(QAbstractSocket::SocketError)));
+	m_attempts.insert(socket, address);
+
+	socket->connectToHost(address.host.toAddress(), address.port);
+
+	if (!m_pending.isEmpty()) {
+		m_attemptTimer.start(ATTEMPT_DELAY);
+	}
+}
+
+void ConnectionRacer::attemptConnected() {
+	QTcpSocket *socket = qobject_cast< QTcpSocket * >(sender());
+	if (!m_attempts.contains(socket)) {
+		return;
+	}
+
+	m_winner = m_attempts.value(socket);
+	finish();
+}
+
+void ConnectionRacer::attemptFailed(QAbstractSocket::SocketError) {
+	QTcpSocket *socket = qobject_cast< QTcpSocket * >(sender());
+	if (!m_attempts.remove(socket)) {
+		return;
+	}
+
+	socket->deleteLater();
+
+	// There is no point in waiting for the delay if the previous attempt has already failed
+	m_attemptTimer.stop();
+	startAttempt();
+}
+
+void ConnectionRacer::timedOut() {
+	finish();
+}
+
+void ConnectionRacer::finish() {
+	m_attemptTimer.stop();
+	m_timeoutTimer.stop();
+	m_pending.clear();
+	abortAttempts();
+
+	emit finished();
+}
+
+void ConnectionRacer::abortAttempts() {
+	for (auto it = m_attempts.begin(); it != m_attempts.end(); ++it) {
+		QTcpSocket *socket = it.key();
+
+		socket->disconnect(this);
+		socket->abort();
+		socket->deleteLater();
+	}
+
+	m_attempts.clear();
+}
@@ -0,0 +1,72 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_CONNECTIONRACER_H_
+#define MUMBLE_MUMBLE_CONNECTIONRACER_H_
+
+#include "ServerAddress.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtNetwork/QAbstractSocket>
+
+class QTcpSocket;
+
+/// Finds the first of a server's addresses that accepts TCP connections, as described by RFC 8305 ("Happy Eyeballs").
+///
+/// Instead of trying the addresses one after the other, each of which may take until the connection timeout if the
+/// address isn't reachable (e.g. IPv6 on a network without IPv6 connectivity), the next attempt is started
+/// ATTEMPT_DELAY after the previous one (or as soon as it has failed), while the previous ones keep going. The
+/// addresses are tried alternating between IPv6 and IPv4. The first connection that is established wins and all
+/// others are aborted.
+class ConnectionRacer : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(ConnectionRacer)
+
+public:
+	/// The time after which the next attempt is started if the previous one has neither succeeded nor failed (in
+	/// milliseconds, see RFC 8305, section 5)
+	static constexpr int ATTEMPT_DELAY = 250;
+
+	explicit ConnectionRacer(QObject *parent = nullptr);
+	~ConnectionRacer() Q_DECL_OVERRIDE;
+
+	/// @returns The given addresses ordered alternately by address family (starting with IPv6), keeping the order
+	/// 	within each family (see RFC 8305, section 4)
+	static QList< ServerAddress > interleave(const QList< ServerAddress > &addresses);
+
+	/// Starts racing the connections to the given addresses. finished() is emitted once one of them has been
+	/// established, all of them have failed or the given timeout (in milliseconds) has passed.
+	void race(const QList< ServerAddress > &addresses, int timeout);
+
+	/// @returns The address the first connection has been established to or an invalid address if there is none
+	ServerAddress winner() const;
+
+signals:
+	void finished();
+
+protected:
+	/// The addresses that haven't been tried yet
+	QList< ServerAddress > m_pending;
+	/// The attempts in progress
+	QHash< QTcpSocket *, ServerAddress > m_attempts;
+	QTimer m_attemptTimer;
+	QTimer m_timeoutTimer;
+	ServerAddress m_winner;
+
+	void finish();
+	void abortAttempts();
+
+protected slots:
+	void startAttempt();
+	void attemptConnected();
+	void attemptFailed(QAbstractSocket::SocketError);
+	void timedOut();
+};
+
+#endif // MUMBLE_MUMBLE_CONNECTIONRACER_H_
@@ -13,6 +13,8 @@
 #include "GlobalShortcutTypes.h"
 
 #include <QSettings>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
 #include <QtCore/QStandardPaths>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
@@ -230,8 +232,15 @@ Database::Database(const QString &dbname) {
 		query,
 		QLatin1String("CREATE UNIQUE INDEX IF NOT EXISTS `pingcache_host_port` ON `pingcache`(`hostname`,`port`)"));
 
+	execQueryAndLogFailure(query, QLatin1String("CREATE TABLE IF NOT EXISTS `resolved` (`id` INTEGER PRIMARY KEY "
+												"AUTOINCREMENT, `hostname` TEXT, `port` INTEGER, `records` BLOB, "
+												"`expires` INTEGER)"));
+	execQueryAndLogFailure(query, QLatin1String("CREATE UNIQUE INDEX IF NOT EXISTS `resolved_host_port` ON "
+												"`resolved`(`hostname`,`port`)"));
+
 	execQueryAndLogFailure(query, QLatin1String("DELETE FROM `comments` WHERE `seen` < datetime('now', '-1 years')"));
 	execQueryAndLogFailure(query, QLatin1String("DELETE FROM `blobs` WHERE `seen` < datetime('now', '-1 months')"));
+	trimBlobs();
 
 	execQueryAndLogFailure(query, QLatin1String("VACUUM"));
 
@@ -246,14 +255,152 @@ Database::Database(const QString &dbname) {
 	execQueryAndLogFailure(query, QLatin1String("SELECT sqlite_version()"));
 	while (query.next())
 		qWarning() << "Database SQLite:" << query.value(0).toString();
+	query.finish();
+
+	m_statements = StatementCache(db);
+	loadUserAttributes();
+	loadResolved();
+
+	m_writer = std::make_unique< DatabaseWriter >(db.databaseName(), db.connectionName() + QLatin1String("_writer"));
 }
 
 Database::~Database() {
+	// All writes have to be committed before the database is vacuumed
+	m_writer.reset();
+	m_statements.clear();
+
 	QSqlQuery query(db);
 	execQueryAndLogFailure(query, QLatin1String("PRAGMA journal_mode = DELETE"));
 	execQueryAndLogFailure(query, QLatin1String("VACUUM"));
 }
 
+static QString resolvedKey(const QString &hostname, unsigned short port) {
+	return hostname + QLatin1Char(':') + QString::number(port);
+}
+
+static QByteArray serializeRecords(const QList< ServerResolverRecord > &records) {
+	QByteArray blob;
+	QDataStream stream(&blob, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	stream << static_cast< quint32 >(records.size());
+	for (ServerResolverRecord record : records) {
+		QList< QByteArray > addresses;
+		for (const HostAddress &address : record.addresses()) {
+			addresses << address.toByteArray();
+		}
+
+		stream << record.hostname() << record.port() << record.priority() << addresses;
+	}
+
+	return blob;
+}
+
+/// @returns The records stored by serializeRecords() or an empty list if the blob is corrupt
+static QList< ServerResolverRecord > deserializeRecords(const QByteArray &blob) {
+	QDataStream stream(blob);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	QList< ServerResolverRecord > records;
+	quint32 recordCount = 0;
+	stream >> recordCount;
+	for (quint32 i = 0; i < recordCount && stream.status() == QDataStream::Ok; i++) {
+		QString hostname;
+		quint16 port    = 0;
+		qint64 priority = 0;
+		QList< QByteArray > addresses;
+		stream >> hostname >> port >> priority >> addresses;
+
+		QList< HostAddress > hostAddresses;
+		for (const QByteArray &address : addresses) {
+			hostAddresses << HostAddress(address);
+		}
+
+		records << ServerResolverRecord(hostname, port, priority, hostAddresses);
+	}
+
+	if (stream.status() != QDataStream::Ok) {
+		return QList< ServerResolverRecord >();
+	}
+
+	return records;
+}
+
+void Database::loadUserAttributes() {
+	QSqlQuery query(db);
+
+	const auto loadHashes = [&query](const QString &table, QSet< QString > &hashes) {
+		execQueryAndLogFailure(query, QString::fromLatin1("SELECT `hash` FROM `%1`").arg(table));
+		while (query.next())
+			hashes.insert(query.value(0).toString());
+	};
+
+	loadHashes(QLatin1String("ignored"), m_ignored);
+	loadHashes(QLatin1String("ignored_tts"), m_ignoredTTS);
+	loadHashes(QLatin1String("muted"), m_muted);
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, `volume` FROM `volume`"));
+	while (query.next())
+		m_volumes.insert(query.value(0).toString(), query.value(1).toString().toFloat());
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, `nickname` FROM `nicknames`"));
+	while (query.next())
+		m_nicknames.insert(query.value(0).toString(), query.value(1).toString());
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, `name` FROM `friends`"));
+	while (query.next())
+		m_friends.insert(query.value(0).toString(), query.value(1).toString());
+}
+
+void Database::loadResolved() {
+	QSqlQuery query(db);
+
+	const qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+	query.prepare(QLatin1String("DELETE FROM `resolved` WHERE `expires` <= ?"));
+	query.addBindValue(now);
+	execQueryAndLogFailure(query);
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hostname`, `port`, `records`, `expires` FROM `resolved`"));
+	while (query.next()) {
+		const auto port                             = static_cast< unsigned short >(query.value(1).toUInt());
+		const QList< ServerResolverRecord > records = deserializeRecords(query.value(2).toByteArray());
+		if (!records.isEmpty()) {
+			m_resolved.insert(resolvedKey(query.value(0).toString(), port), { records, query.value(3).toLongLong() });
+		}
+	}
+}
+
+void Database::trimBlobs() {
+	QSqlQuery query(db);
+	QList< QByteArray > expendable;
+	qint64 size = 0;
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, LENGTH(`data`) FROM `blobs` ORDER BY `seen` DESC"));
+	while (query.next()) {
+		size += query.value(1).toLongLong();
+		if (size > MAX_BLOB_CACHE_SIZE) {
+			expendable << query.value(0).toByteArray();
+		}
+	}
+	query.finish();
+
+	if (expendable.isEmpty()) {
+		return;
+	}
+
+	db.transaction();
+	query.prepare(QLatin1String("DELETE FROM `blobs` WHERE `hash` = ?"));
+	for (const QByteArray &hash : expendable) {
+		query.addBindValue(hash);
+		execQueryAndLogFailure(query);
+	}
+	db.commit();
+}
+
+void Database::writeBehind(DatabaseWriter::Task task, const QString &key) {
+	m_writer->enqueue(std::move(task), key);
+}
+
 QList< FavoriteServer > Database::getFavorites() {
 	QSqlQuery query(db);
 	QList< FavoriteServer > ql;
@@ -298,144 +445,138 @@ void Database::setFavorites(const QList< FavoriteServer > &servers) {
 }
 
 bool Database::isLocalIgnored(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return m_ignored.contains(hash);
 }
 
 void Database::setLocalIgnored(const QString &hash, bool ignored) {
-	QSqlQuery query(db);
-
 	if (ignored)
-		query.prepare(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES (?)"));
+		m_ignored.insert(hash);
 	else
-		query.prepare(QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+		m_ignored.remove(hash);
+
+	writeBehind(
+		[hash, ignored](StatementCache &statements) {
+			QSqlQuery &query = statements.prepare(ignored ? QLatin1String("REPLACE INTO `ignored` (`hash`) VALUES (?)")
+														  : QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"));
+			query.addBindValue(hash);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("ignored/") + hash);
 }
 
 bool Database::isLocalIgnoredTTS(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `ignored_tts` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return m_ignoredTTS.contains(hash);
 }
 
 void Database::setLocalIgnoredTTS(const QString &hash, bool ignoredTTS) {
-	QSqlQuery query(db);
-
 	if (ignoredTTS)
-		query.prepare(QLatin1String("INSERT INTO `ignored_tts` (`hash`) VALUES (?)"));
+		m_ignoredTTS.insert(hash);
 	else
-		query.prepare(QLatin1String("DELETE FROM `ignored_tts` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+		m_ignoredTTS.remove(hash);
+
+	writeBehind(
+		[hash, ignoredTTS](StatementCache &statements) {
+			QSqlQuery &query =
+				statements.prepare(ignoredTTS ? QLatin1String("REPLACE INTO `ignored_tts` (`hash`) VALUES (?)")
+											  : QLatin1String("DELETE FROM `ignored_tts` WHERE `hash` = ?"));
+			query.addBindValue(hash);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("ignored_tts/") + hash);
 }
 
 bool Database::isLocalMuted(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return m_muted.contains(hash);
 }
 
 void Database::setUserLocalVolume(const QString &hash, float volume) {
-	QSqlQuery query(db);
+	m_volumes.insert(hash, volume);
 
-	query.prepare(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"));
-	query.addBindValue(hash);
-	query.addBindValue(QString::number(volume));
-	execQueryAndLogFailure(query);
+	// The slider sets the volume continuously, of which only the last value has to be written
+	writeBehind(
+		[hash, volume](StatementCache &statements) {
+			QSqlQuery &query =
+				statements.prepare(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"));
+			query.addBindValue(hash);
+			query.addBindValue(QString::number(volume));
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("volume/") + hash);
 }
 
 float Database::getUserLocalVolume(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `volume` FROM `volume` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.first()) {
-		return query.value(0).toString().toFloat();
-	}
-	return 1.0f;
+	return m_volumes.value(hash, 1.0f);
 }
 
 void Database::setUserLocalNickname(const QString &hash, const QString &nickname) {
-	QSqlQuery query(db);
+	m_nicknames.insert(hash, nickname);
 
-	query.prepare(QLatin1String("INSERT OR REPLACE INTO `nicknames` (`hash`, `nickname`) VALUES (?,?)"));
-	query.addBindValue(hash);
-	query.addBindValue(nickname);
-	execQueryAndLogFailure(query);
+	writeBehind(
+		[hash, nickname](StatementCache &statements) {
+			QSqlQuery &query = statements.prepare(
+				QLatin1String("INSERT OR REPLACE INTO `nicknames` (`hash`, `nickname`) VALUES (?,?)"));
+			query.addBindValue(hash);
+			query.addBindValue(nickname);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("nicknames/") + hash);
 }
 
 QString Database::getUserLocalNickname(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `nickname` FROM `nicknames` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.first()) {
-		return query.value(0).toString();
-	}
-	return QString();
+	return m_nicknames.value(hash);
 }
 
 void Database::setLocalMuted(const QString &hash, bool muted) {
-	QSqlQuery query(db);
-
 	if (muted)
-		query.prepare(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"));
+		m_muted.insert(hash);
 	else
-		query.prepare(QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+		m_muted.remove(hash);
+
+	writeBehind(
+		[hash, muted](StatementCache &statements) {
+			QSqlQuery &query = statements.prepare(muted ? QLatin1String("REPLACE INTO `muted` (`hash`) VALUES (?)")
+														: QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"));
+			query.addBindValue(hash);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("muted/") + hash);
 }
 
 ChannelFilterMode Database::getChannelFilterMode(const QByteArray &server_cert_digest, const unsigned int channel_id) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String(
+	QSqlQuery &query = m_statements.prepare(QLatin1String(
 		"SELECT `filter_mode` FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
 	query.addBindValue(server_cert_digest);
 	query.addBindValue(channel_id);
 	execQueryAndLogFailure(query);
 
-	if (query.first()) {
-		return static_cast< ChannelFilterMode >(query.value(0).toInt());
+	ChannelFilterMode filterMode = ChannelFilterMode::NORMAL;
+	if (query.next()) {
+		filterMode = static_cast< ChannelFilterMode >(query.value(0).toInt());
 	}
+	query.finish();
 
-	return ChannelFilterMode::NORMAL;
+	return filterMode;
 }
 
 void Database::setChannelFilterMode(const QByteArray &server_cert_digest, const unsigned int channel_id,
 									const ChannelFilterMode filterMode) {
-	QSqlQuery query(db);
-
-	switch (filterMode) {
-		case ChannelFilterMode::NORMAL:
-			query.prepare(
-				QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
-			break;
-		case ChannelFilterMode::PIN:
-		case ChannelFilterMode::HIDE:
-			query.prepare(QLatin1String("INSERT OR REPLACE INTO `filtered_channels` (`server_cert_digest`, "
-										"`channel_id`, `filter_mode`) VALUES (?, ?, ?)"));
-			query.bindValue(2, static_cast< int >(filterMode));
-			break;
+	if (filterMode == ChannelFilterMode::NORMAL) {
+		QSqlQuery &query = m_statements.prepare(
+			QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
+		query.bindValue(0, server_cert_digest);
+		query.bindValue(1, channel_id);
+		execQueryAndLogFailure(query);
+		query.finish();
+	} else {
+		QSqlQuery &query = m_statements.prepare(QLatin1String("INSERT OR REPLACE INTO `filtered_channels` "
+															  "(`server_cert_digest`, `channel_id`, `filter_mode`) "
+															  "VALUES (?, ?, ?)"));
+		query.bindValue(0, server_cert_digest);
+		query.bindValue(1, channel_id);
+		query.bindValue(2, static_cast< int >(filterMode));
+		execQueryAndLogFailure(query);
+		query.finish();
 	}
-
-	query.bindValue(0, server_cert_digest);
-	query.bindValue(1, channel_id);
-
-	execQueryAndLogFailure(query);
 }
 
 QMap< UnresolvedServerAddress, unsigned int > Database::getPingCache() {
@@ -473,74 +614,80 @@ void Database::setPingCache(const QMap< UnresolvedServerAddress, unsigned int >
 }
 
 bool Database::seenComment(const QString &hash, const QByteArray &commenthash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT COUNT(*) FROM `comments` WHERE `who` = ? AND `comment` = ?"));
+	QSqlQuery &query =
+		m_statements.prepare(QLatin1String("SELECT COUNT(*) FROM `comments` WHERE `who` = ? AND `comment` = ?"));
 	query.addBindValue(hash);
 	query.addBindValue(commenthash);
 	execQueryAndLogFailure(query);
-	if (query.next()) {
-		if (query.value(0).toInt() > 0) {
-			query.prepare(
-				QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
-			query.addBindValue(hash);
-			query.addBindValue(commenthash);
-			execQueryAndLogFailure(query);
-			return true;
-		}
+	const bool seen = query.next() && query.value(0).toInt() > 0;
+	query.finish();
+
+	if (seen) {
+		QSqlQuery &update = m_statements.prepare(
+			QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
+		update.addBindValue(hash);
+		update.addBindValue(commenthash);
+		execQueryAndLogFailure(update);
+		update.finish();
 	}
-	return false;
+	return seen;
 }
 
 void Database::setSeenComment(const QString &hash, const QByteArray &commenthash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"));
+	QSqlQuery &query = m_statements.prepare(
+		QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"));
 	query.addBindValue(hash);
 	query.addBindValue(commenthash);
 	execQueryAndLogFailure(query);
+	query.finish();
 }
 
 QByteArray Database::blob(const QByteArray &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `data` FROM `blobs` WHERE `hash` = ?"));
+	QSqlQuery &query = m_statements.prepare(QLatin1String("SELECT `data` FROM `blobs` WHERE `hash` = ?"));
 	query.addBindValue(hash);
 	execQueryAndLogFailure(query);
-	if (query.next()) {
-		QByteArray qba = query.value(0).toByteArray();
+	if (!query.next()) {
+		query.finish();
+		return QByteArray();
+	}
 
-		query.prepare(QLatin1String("UPDATE `blobs` SET `seen` = datetime('now') WHERE `hash` = ?"));
-		query.addBindValue(hash);
-		execQueryAndLogFailure(query);
+	QByteArray qba = query.value(0).toByteArray();
+	query.finish();
 
-		return qba;
-	}
-	return QByteArray();
+	// Marking the blob as used again may wait for a while, as it only matters to trimBlobs()
+	writeBehind(
+		[hash](StatementCache &statements) {
+			QSqlQuery &update =
+				statements.prepare(QLatin1String("UPDATE `blobs` SET `seen` = datetime('now') WHERE `hash` = ?"));
+			update.addBindValue(hash);
+			execQueryAndLogFailure(update);
+		},
+		QLatin1String("blob/") + QString::fromLatin1(hash.toHex()));
+
+	return qba;
 }
 
 void Database::setBlob(const QByteArray &hash, const QByteArray &data) {
 	if (hash.isEmpty() || data.isEmpty())
 		return;
 
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("REPLACE INTO `blobs` (`hash`, `data`, `seen`) VALUES (?, ?, datetime('now'))"));
+	QSqlQuery &query = m_statements.prepare(
+		QLatin1String("REPLACE INTO `blobs` (`hash`, `data`, `seen`) VALUES (?, ?, datetime('now'))"));
 	query.addBindValue(hash);
 	query.addBindValue(data);
 	execQueryAndLogFailure(query);
+	query.finish();
 }
 
 QStringList Database::getTokens(const QByteArray &digest) {
 	QList< QString > qsl;
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `token` FROM `tokens` WHERE `digest` = ?"));
+	QSqlQuery &query = m_statements.prepare(QLatin1String("SELECT `token` FROM `tokens` WHERE `digest` = ?"));
 	query.addBindValue(digest);
 	execQueryAndLogFailure(query);
 	while (query.next()) {
 		qsl << query.value(0).toString();
 	}
+	query.finish();
 	return qsl;
 }
 
@@ -561,9 +708,8 @@ void Database::setTokens(const QByteArray &digest, QStringList &tokens) {
 
 QList< Shortcut > Database::getShortcuts(const QByteArray &digest) {
 	QList< Shortcut > ql;
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `type`, `shortcut`,`target`,`suppress` FROM `shortcut` WHERE `digest` = ?"));
+	QSqlQuery &query = m_statements.prepare(
+		QLatin1String("SELECT `type`, `shortcut`,`target`,`suppress` FROM `shortcut` WHERE `digest` = ?"));
 	query.addBindValue(digest);
 	execQueryAndLogFailure(query);
 	while (query.next()) {
@@ -600,6 +746,7 @@ QList< Shortcut > Database::getShortcuts(const QByteArray &digest) {
 		sc.bSuppress = query.value(3).toBool();
 		ql << sc;
 	}
+	query.finish();
 	return ql;
 }
 
@@ -653,63 +800,66 @@ void Database::setShortcuts(const QByteArray &digest, const QList< Shortcut > &s
 
 const QMap< QString, QString > Database::getFriends() {
 	QMap< QString, QString > qm;
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `name`, `hash` FROM `friends`"));
-	execQueryAndLogFailure(query);
-	while (query.next())
-		qm.insert(query.value(0).toString(), query.value(1).toString());
+	for (auto it = m_friends.constBegin(); it != m_friends.constEnd(); ++it)
+		qm.insert(it.value(), it.key());
 	return qm;
 }
 
 const QString Database::getFriend(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `name` FROM `friends` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.next())
-		return query.value(0).toString();
-	return QString();
+	return m_friends.value(hash);
 }
 
 void Database::addFriend(const QString &name, const QString &hash) {
-	QSqlQuery query(db);
+	// Both the name and the hash are unique, so REPLACE drops any other friend of the same name
+	for (auto it = m_friends.begin(); it != m_friends.end();) {
+		if (it.value() == name && it.key() != hash)
+			it = m_friends.erase(it);
+		else
+			++it;
+	}
+	m_friends.insert(hash, name);
 
-	query.prepare(QLatin1String("REPLACE INTO `friends` (`name`, `hash`) VALUES (?,?)"));
-	query.addBindValue(name);
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	writeBehind([name, hash](StatementCache &statements) {
+		QSqlQuery &query = statements.prepare(QLatin1String("REPLACE INTO `friends` (`name`, `hash`) VALUES (?,?)"));
+		query.addBindValue(name);
+		query.addBindValue(hash);
+		execQueryAndLogFailure(query);
+	});
 }
 
 void Database::removeFriend(const QString &hash) {
-	QSqlQuery query(db);
+	m_friends.remove(hash);
 
-	query.prepare(QLatin1String("DELETE FROM `friends` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	writeBehind([hash](StatementCache &statements) {
+		QSqlQuery &query = statements.prepare(QLatin1String("DELETE FROM `friends` WHERE `hash` = ?"));
+		query.addBindValue(hash);
+		execQueryAndLogFailure(query);
+	});
 }
 
 const QString Database::getDigest(const QString &hostname, unsigned short port) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `digest` FROM `cert` WHERE `hostname` = ? AND `port` = ?"));
+	QSqlQuery &query =
+		m_statements.prepare(QLatin1String("SELECT `digest` FROM `cert` WHERE `hostname` = ? AND `port` = ?"));
 	query.addBindValue(hostname);
 	query.addBindValue(port);
 	execQueryAndLogFailure(query);
+
+	QString digest;
 	if (query.next()) {
-		return query.value(0).toString();
+		digest = query.value(0).toString();
 	}
-	return QString();
+	query.finish();
+	return digest;
 }
 
 void Database::setDigest(const QString &hostname, unsigned short port, const QString &digest) {
-	QSqlQuery query(db);
-	query.prepare(QLatin1String("REPLACE INTO `cert` (`hostname`,`port`,`digest`) VALUES (?,?,?)"));
+	QSqlQuery &query =
+		m_statements.prepare(QLatin1String("REPLACE INTO `cert` (`hostname`,`port`,`digest`) VALUES (?,?,?)"));
 	query.addBindValue(hostname);
 	query.addBindValue(port);
 	query.addBindValue(digest);
 	execQueryAndLogFailure(query);
+	query.finish();
 }
 
 void Database::setPassword(const QString &hostname, unsigned short port, const QString &uname, const QString &pw) {
@@ -724,26 +874,71 @@ void Database::setPassword(const QString &hostname, unsigned short port, const Q
 }
 
 bool Database::getUdp(const QByteArray &digest) {
-	QSqlQuery query(db);
-	query.prepare(QLatin1String("SELECT COUNT(*) FROM `udp` WHERE `digest` = ? "));
+	QSqlQuery &query = m_statements.prepare(QLatin1String("SELECT COUNT(*) FROM `udp` WHERE `digest` = ? "));
 	query.addBindValue(digest);
 	execQueryAndLogFailure(query);
+
+	bool udp = true;
 	if (query.next()) {
-		return (query.value(0).toInt() == 0);
+		udp = (query.value(0).toInt() == 0);
 	}
-	return true;
+	query.finish();
+	return udp;
 }
 
 void Database::setUdp(const QByteArray &digest, bool udp) {
-	QSqlQuery query(db);
-	if (!udp)
-		query.prepare(QLatin1String("REPLACE INTO `udp` (`digest`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `udp` WHERE `digest` = ?"));
+	QSqlQuery &query = m_statements.prepare(udp ? QLatin1String("DELETE FROM `udp` WHERE `digest` = ?")
+												: QLatin1String("REPLACE INTO `udp` (`digest`) VALUES (?)"));
 	query.addBindValue(digest);
 	execQueryAndLogFailure(query);
+	query.finish();
+}
+
+QList< ServerResolverRecord > Database::getResolved(const QString &hostname, unsigned short port) {
+	const auto it = m_resolved.constFind(resolvedKey(hostname, port));
+	if (it == m_resolved.constEnd() || it->expires <= QDateTime::currentMSecsSinceEpoch() / 1000) {
+		return QList< ServerResolverRecord >();
+	}
+
+	return it->records;
+}
+
+void Database::setResolved(const QString &hostname, unsigned short port, const QList< ServerResolverRecord > &records,
+						   quint32 timeToLive) {
+	const qint64 expires = QDateTime::currentMSecsSinceEpoch() / 1000 + timeToLive;
+	const QString key    = resolvedKey(hostname, port);
+
+	m_resolved.insert(key, { records, expires });
+
+	const QByteArray blob = serializeRecords(records);
+	writeBehind(
+		[hostname, port, blob, expires](StatementCache &statements) {
+			QSqlQuery &query = statements.prepare(QLatin1String(
+				"REPLACE INTO `resolved` (`hostname`, `port`, `records`, `expires`) VALUES (?, ?, ?, ?)"));
+			query.addBindValue(hostname);
+			query.addBindValue(port);
+			query.addBindValue(blob);
+			query.addBindValue(expires);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("resolved/") + key);
 }
 
+void Database::removeResolved(const QString &hostname, unsigned short port) {
+	const QString key = resolvedKey(hostname, port);
+
+	m_resolved.remove(key);
+
+	writeBehind(
+		[hostname, port](StatementCache &statements) {
+			QSqlQuery &query =
+				statements.prepare(QLatin1String("DELETE FROM `resolved` WHERE `hostname` = ? AND `port` = ?"));
+			query.addBindValue(hostname);
+			query.addBindValue(port);
+			execQueryAndLogFailure(query);
+		},
+		QLatin1String("resolved/") + key);
+}
 
 bool Database::fuzzyMatch(QString &name, QString &user, QString &pw, QString &hostname, unsigned short port) {
 	QSqlQuery query(db);
@@ -7,10 +7,17 @@
 #define MUMBLE_MUMBLE_DATABASE_H_
 
 #include "Channel.h"
+#include "DatabaseWriter.h"
+#include "ServerResolverRecord.h"
 #include "Settings.h"
 #include "UnresolvedServerAddress.h"
 #include <QSqlDatabase>
 
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+
+#include <memory>
+
 struct FavoriteServer {
 	QString qsName;
 	QString qsUsername;
@@ -26,12 +33,50 @@ private:
 	Q_DISABLE_COPY(Database)
 
 	QSqlDatabase db;
+	/// The statements prepared on db
+	StatementCache m_statements;
+	/// Performs the writes to the tables that are cached below in the background
+	std::unique_ptr< DatabaseWriter > m_writer;
+
+	/// The per-user attributes by certificate hash. They are looked up for every user while the server is being
+	/// synchronized, so they are read once when the database is opened and kept in sync by the setters, which write
+	/// them through m_writer.
+	QSet< QString > m_ignored;
+	QSet< QString > m_ignoredTTS;
+	QSet< QString > m_muted;
+	QHash< QString, float > m_volumes;
+	QHash< QString, QString > m_nicknames;
+	/// The names of the friends by their hash
+	QHash< QString, QString > m_friends;
+
+	struct Resolved {
+		QList< ServerResolverRecord > records;
+		/// The time the records expire at (in seconds since the epoch)
+		qint64 expires;
+	};
+	/// The records the servers have been resolved to by "hostname:port". They are looked up before every connection
+	/// attempt, so they are read once when the database is opened and kept in sync by the setters, which write them
+	/// through m_writer.
+	QHash< QString, Resolved > m_resolved;
+
 	/// This function is called when no database location is configured
 	/// in the config file. It tries to find an existing database file and
 	/// creates a new one if none was found.
 	bool findOrCreateDatabase();
+	/// Fills the caches of the per-user attributes
+	void loadUserAttributes();
+	/// Fills the cache of the resolved records, dropping the ones that have expired
+	void loadResolved();
+	/// Drops the least recently used blobs until the ones that are left fit into MAX_BLOB_CACHE_SIZE
+	void trimBlobs();
+	/// Queues the given write of a per-user attribute (see DatabaseWriter::enqueue())
+	void writeBehind(DatabaseWriter::Task task, const QString &key = QString());
 
 public:
+	/// The amount of textures, comments and channel descriptions (see blob()) that is kept across sessions (in
+	/// bytes). Blobs that haven't been used for a month are dropped regardless.
+	static constexpr qint64 MAX_BLOB_CACHE_SIZE = 64 * 1024 * 1024;
+
 	Database(const QString &dbname);
 	~Database() Q_DECL_OVERRIDE;
 
@@ -84,6 +129,14 @@ public:
 
 	bool getUdp(const QByteArray &digest);
 	void setUdp(const QByteArray &digest, bool udp);
+
+	/// @returns The records the given server has been resolved to, unless they have expired (or there are none)
+	QList< ServerResolverRecord > getResolved(const QString &hostname, unsigned short port);
+	/// Stores the records the given server has been resolved to, which expire after the given time (in seconds)
+	void setResolved(const QString &hostname, unsigned short port, const QList< ServerResolverRecord > &records,
+					 quint32 timeToLive);
+	/// Drops the records the given server has been resolved to (e.g. because none of its addresses is reachable)
+	void removeResolved(const QString &hostname, unsigned short port);
 };
 
 #endif
@@ -0,0 +1,143 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DatabaseWriter.h"
+
+#include <QtCore/QDebug>
+#include <QtSql/QSqlError>
+
+StatementCache::StatementCache(const QSqlDatabase &db) : m_db(db) {
+}
+
+QSqlQuery &StatementCache::prepare(const QString &sql) {
+	auto it = m_statements.find(sql);
+	if (it == m_statements.end()) {
+		QSqlQuery query(m_db);
+		if (!query.prepare(sql)) {
+			qWarning() << "SQL Query failed" << sql;
+			qWarning() << query.lastError().nativeErrorCode() << query.lastError().text();
+		}
+		it = m_statements.insert(sql, query);
+	}
+
+	return it.value();
+}
+
+void StatementCache::finish() {
+	for (QSqlQuery &query : m_statements) {
+		query.finish();
+	}
+}
+
+void StatementCache::clear() {
+	m_statements.clear();
+}
+
+DatabaseWriter::DatabaseWriter(const QString &databaseName, const QString &connectionName)
+	: m_databaseName(databaseName), m_connectionName(connectionName) {
+	start();
+}
+
+DatabaseWriter::~DatabaseWriter() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stop = true;
+		m_queuedCondition.wakeAll();
+	}
+
+	wait();
+}
+
+void DatabaseWriter::enqueue(Task task, const QString &key) {
+	QMutexLocker l(&m_mutex);
+
+	m_queue.enqueue(std::move(task), key);
+	m_queuedCondition.wakeAll();
+}
+
+void DatabaseWriter::flush() {
+	if (QThread::currentThread() == this)
+		return;
+
+	QMutexLocker l(&m_mutex);
+
+	const quint64 target = m_queue.lastSequence();
+	while (m_written < target) {
+		m_writtenCondition.wait(&m_mutex);
+	}
+}
+
+std::size_t DatabaseWriter::queueDepth() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_queue.size();
+}
+
+void DatabaseWriter::run() {
+	{
+		QSqlDatabase db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), m_connectionName);
+		db.setDatabaseName(m_databaseName);
+		// The GUI thread may hold the database for a moment, which the writer can afford to wait for
+		db.setConnectOptions(QLatin1String("QSQLITE_BUSY_TIMEOUT=10000"));
+		if (!db.open()) {
+			qWarning("DatabaseWriter: Failed to open the database: %s", qPrintable(db.lastError().text()));
+		}
+
+		StatementCache statements(db);
+		std::vector< Entry > batch;
+		batch.reserve(MAX_BATCH_SIZE);
+
+		forever {
+			{
+				QMutexLocker l(&m_mutex);
+
+				while (m_queue.empty() && !m_stop) {
+					m_queuedCondition.wait(&m_mutex);
+				}
+
+				if (m_queue.empty()) {
+					break;
+				}
+
+				m_queue.take(batch, MAX_BATCH_SIZE);
+			}
+
+			write(db, statements, batch);
+
+			QMutexLocker l(&m_mutex);
+			m_written = batch.back().sequence;
+			m_writtenCondition.wakeAll();
+
+			batch.clear();
+		}
+
+		statements.clear();
+		db.close();
+	}
+
+	QSqlDatabase::removeDatabase(m_connectionName);
+
+	// Nobody may wait for writes that will never happen
+	QMutexLocker l(&m_mutex);
+	m_written = m_queue.lastSequence();
+	m_writtenCondition.wakeAll();
+}
+
+void DatabaseWriter::write(QSqlDatabase &db, StatementCache &statements, std::vector< Entry > &batch) {
+	if (!db.isOpen())
+		return;
+
+	db.transaction();
+	for (Entry &entry : batch) {
+		if (entry.task) {
+			entry.task(statements);
+		}
+	}
+	statements.finish();
+	if (!db.commit()) {
+		qWarning("DatabaseWriter: Failed to commit %zu writes: %s", batch.size(), qPrintable(db.lastError().text()));
+		db.rollback();
+	}
+}
@@ -0,0 +1,92 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_DATABASEWRITER_H_
+#define MUMBLE_MUMBLE_DATABASEWRITER_H_
+
+#include "WriteBehindQueue.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// The statements that have been prepared on a connection, by their SQL. It may only be used by the thread that uses
+/// the connection.
+///
+/// A statement that has been read from has to be finished (QSqlQuery::finish()) once its results aren't needed
+/// anymore, as SQLite keeps the database locked for as long as a statement is active.
+class StatementCache {
+public:
+	explicit StatementCache(const QSqlDatabase &db = QSqlDatabase());
+
+	/// @returns The statement for the given SQL, which is prepared the first time it is asked for
+	QSqlQuery &prepare(const QString &sql);
+	/// Finishes all statements, so that none of them keeps the database locked
+	void finish();
+	/// Drops all statements (e.g. because the connection is about to be closed)
+	void clear();
+
+protected:
+	QSqlDatabase m_db;
+	QHash< QString, QSqlQuery > m_statements;
+};
+
+/// A thread that writes to the client's database in the background (write-behind), so that the GUI thread doesn't
+/// have to wait for SQLite.
+///
+/// The thread uses its own connection to the database file. The queued writes (see WriteBehindQueue) are performed in
+/// the order they have been queued in and all writes that are pending when the thread wakes up are committed in a
+/// single transaction. Keys are used for writes that are queued over and over again, e.g. the local volume of a user
+/// while the slider is being dragged.
+class DatabaseWriter : public QThread {
+public:
+	/// A write, which is given the statements of the writer's connection
+	using Task = std::function< void(StatementCache &statements) >;
+
+	/// The maximum number of writes that are committed in a single transaction
+	static constexpr std::size_t MAX_BATCH_SIZE = 256;
+
+	/// Starts the thread, which connects to the given database file under the given connection name
+	DatabaseWriter(const QString &databaseName, const QString &connectionName);
+	/// Performs all pending writes before returning
+	~DatabaseWriter() override;
+
+	/// Queues the given write (see WriteBehindQueue::enqueue())
+	void enqueue(Task task, const QString &key = QString());
+	/// Blocks until all writes that have been queued before have been committed
+	void flush();
+	/// @returns The number of writes that haven't been committed yet
+	std::size_t queueDepth() const;
+
+protected:
+	using Entry = WriteBehindQueue< Task >::Entry;
+
+	QString m_databaseName;
+	QString m_connectionName;
+
+	mutable QMutex m_mutex;
+	/// Signalled when writes have been queued or the thread is supposed to stop
+	QWaitCondition m_queuedCondition;
+	/// Signalled when writes have been committed
+	QWaitCondition m_writtenCondition;
+	WriteBehindQueue< Task > m_queue;
+	/// The sequence number of the last write that has been committed
+	quint64 m_written = 0;
+	bool m_stop       = false;
+
+	void run() override;
+	/// Performs the given writes in a single transaction on the given connection
+	static void write(QSqlDatabase &db, StatementCache &statements, std::vector< Entry > &batch);
+};
+
+#endif // MUMBLE_MUMBLE_DATABASEWRITER_H_
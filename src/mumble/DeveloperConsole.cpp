@@ -6,12 +6,21 @@
 #include "DeveloperConsole.h"
 
 #include "LogEmitter.h"
+#include "Profiler.h"
 #include "Global.h"
 
+#include <QtGui/QFontDatabase>
+#include <QtWidgets/QCheckBox>
+#include <QtWidgets/QPlainTextEdit>
+#include <QtWidgets/QTabWidget>
 #include <QtWidgets/QTextBrowser>
+#include <QtWidgets/QVBoxLayout>
 
 DeveloperConsole::DeveloperConsole(QObject *parent) : QObject(parent) {
 	connect(Global::get().le.data(), SIGNAL(newLogEntry(const QString &)), this, SLOT(addLogMessage(const QString &)));
+
+	m_profilerTimer.setInterval(1000);
+	connect(&m_profilerTimer, SIGNAL(timeout()), this, SLOT(updateProfilerView()));
 }
 
 DeveloperConsole::~DeveloperConsole() {
@@ -24,8 +33,27 @@ void DeveloperConsole::show() {
 		QMainWindow *mw = new QMainWindow();
 		mw->setAttribute(Qt::WA_DeleteOnClose);
 		QTextBrowser *tb = new QTextBrowser();
+
+		QWidget *profiler   = new QWidget();
+		QVBoxLayout *layout = new QVBoxLayout(profiler);
+		QCheckBox *enable   = new QCheckBox(tr("Enable profiling"));
+		enable->setToolTip(tr("Measures the time spent and the allocations made in the client's hot paths, which "
+							  "slows them down slightly"));
+		enable->setChecked(Profiler::isEnabled());
+		connect(enable, SIGNAL(toggled(bool)), this, SLOT(setProfilerEnabled(bool)));
+		m_profilerView = new QPlainTextEdit();
+		m_profilerView->setReadOnly(true);
+		m_profilerView->setLineWrapMode(QPlainTextEdit::NoWrap);
+		m_profilerView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+		layout->addWidget(enable);
+		layout->addWidget(m_profilerView);
+
+		QTabWidget *tabs = new QTabWidget();
+		tabs->addTab(tb, tr("Log"));
+		tabs->addTab(profiler, tr("Profiler"));
+
 		mw->resize(675, 300);
-		mw->setCentralWidget(tb);
+		mw->setCentralWidget(tabs);
 		mw->setWindowTitle(tr("Developer Console"));
 
 		connect(Global::get().le.data(), SIGNAL(newLogEntry(const QString &)), tb, SLOT(append(const QString &)));
@@ -45,3 +73,26 @@ void DeveloperConsole::addLogMessage(const QString &msg) {
 
 	m_logEntries.append(msg);
 }
+
+void DeveloperConsole::setProfilerEnabled(bool enabled) {
+	Profiler::setEnabled(enabled);
+
+	// Whatever has been gathered before doesn't belong to the new measurement
+	Profiler::take();
+	m_profilerElapsed.start();
+
+	if (enabled) {
+		m_profilerTimer.start();
+	} else {
+		m_profilerTimer.stop();
+	}
+}
+
+void DeveloperConsole::updateProfilerView() {
+	const double seconds                           = static_cast< double >(m_profilerElapsed.restart()) / 1000.0;
+	const std::vector< ProfilerZone::Stats > stats = Profiler::take();
+
+	if (m_profilerView && seconds > 0.0) {
+		m_profilerView->setPlainText(Profiler::format(stats, seconds));
+	}
+}
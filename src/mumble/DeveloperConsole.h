@@ -6,11 +6,15 @@
 #ifndef MUMBLE_MUMBLE_DEVELOPERCONSOLE_H_
 #define MUMBLE_MUMBLE_DEVELOPERCONSOLE_H_
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtCore/QPointer>
 #include <QtCore/QStringList>
+#include <QtCore/QTimer>
 #include <QtWidgets/QMainWindow>
 
+class QPlainTextEdit;
+
 class DeveloperConsole : public QObject {
 private:
 	Q_OBJECT
@@ -19,8 +23,16 @@ private:
 protected:
 	QPointer< QMainWindow > m_window;
 	QStringList m_logEntries;
+	/// Shows the stats of the profiler's zones (see Profiler)
+	QPointer< QPlainTextEdit > m_profilerView;
+	/// Refreshes m_profilerView while profiling is enabled
+	QTimer m_profilerTimer;
+	/// Measures the time the current stats have been gathered over
+	QElapsedTimer m_profilerElapsed;
 public slots:
 	void addLogMessage(const QString &);
+	void setProfilerEnabled(bool enabled);
+	void updateProfilerView();
 
 public:
 	DeveloperConsole(QObject *parent = nullptr);
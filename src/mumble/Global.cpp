@@ -132,11 +132,16 @@ Global::Global(const QString &qsConfigPath) {
 
 	bHappyEaster = false;
 
-	bQuit            = false;
-	bDebugDumpInput  = false;
-	bDebugPrintQueue = false;
+	bQuit                   = false;
+	bDebugDumpInput         = false;
+	bDebugPrintQueue        = false;
+	uiAudioBenchmarkSeconds = 0;
+	uiSyncBenchmarkChannels = 0;
+	uiSyncBenchmarkUsers    = 0;
 
 	channelListenerManager = std::make_unique< ChannelListenerManager >();
+	uiUpdateScheduler      = std::make_unique< UIUpdateScheduler >();
+	settingsWriter         = std::make_unique< SettingsWriter >();
 
 	if (qsConfigPath.isEmpty()) {
 		qdBasePath.setPath(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation));
@@ -12,7 +12,9 @@
 #include "ACL.h"
 #include "ChannelListenerManager.h"
 #include "Settings.h"
+#include "SettingsWriter.h"
 #include "Timer.h"
+#include "UIUpdateScheduler.h"
 #include "Version.h"
 
 #include <memory>
@@ -51,6 +53,8 @@ public:
 
 	MainWindow *mw;
 	Settings s;
+	/// Writes the settings files in the background (see Settings::saveLater())
+	std::unique_ptr< SettingsWriter > settingsWriter;
 	boost::shared_ptr< ServerHandler > sh;
 	boost::shared_ptr< AudioInput > ai;
 	boost::shared_ptr< AudioOutput > ao;
@@ -109,7 +113,15 @@ public:
 	QString windowTitlePostfix;
 	bool bDebugDumpInput;
 	bool bDebugPrintQueue;
+	/// For how long each audio backend is benchmarked (see --audio-benchmark), 0 if there is no benchmark to run
+	unsigned int uiAudioBenchmarkSeconds;
+	/// The number of channels and users of the server to synchronize with (see --sync-benchmark), 0 if there is no
+	/// benchmark to run
+	unsigned int uiSyncBenchmarkChannels;
+	unsigned int uiSyncBenchmarkUsers;
 	std::unique_ptr< ChannelListenerManager > channelListenerManager;
+	/// Coalesces the updates of the views of users and channels (see UIUpdateScheduler)
+	std::unique_ptr< UIUpdateScheduler > uiUpdateScheduler;
 
 	bool bHappyEaster;
 	static const char ccHappyEaster[];
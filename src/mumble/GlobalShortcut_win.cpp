@@ -323,7 +323,7 @@ GlobalShortcutWin::GlobalShortcutWin()
 	: m_msgQueue(64)
 #ifdef USE_XBOXINPUT
 	  ,
-	  m_xinputDevices(0), m_xinputLastPacket()
+	  m_xinputDevices(0), m_xinputLastPacket(), m_xinputSlots(0), m_xinputRescan(true)
 #endif
 {
 	// Register the MetaTypes if they have not already been registered (e.g in Settings)
@@ -675,6 +675,7 @@ GlobalShortcutWin::DeviceMap::iterator GlobalShortcutWin::addDevice(const HANDLE
 
 	if (device.xinput) {
 		++m_xinputDevices;
+		m_xinputRescan = true;
 	}
 
 	qInfo("GlobalShortcutWin: \"%s\" added", device.name.c_str());
@@ -691,6 +692,7 @@ void GlobalShortcutWin::deviceRemoved(const HANDLE deviceHandle) {
 	const auto &device = (*iter).second;
 	if (device.xinput) {
 		--m_xinputDevices;
+		m_xinputRescan = true;
 	}
 
 	qInfo("GlobalShortcutWin: \"%s\" removed", device.name.c_str());
@@ -728,12 +730,22 @@ bool GlobalShortcutWin::xinputIsPressed(const uint8_t bit, const XboxInputState
 void GlobalShortcutWin::processOther() {
 #ifdef USE_XBOXINPUT
 	if (m_xinput && m_xinputDevices > 0) {
+		const bool rescan = m_xinputRescan.exchange(false);
+
 		for (uint8_t i = 0; i < XBOXINPUT_MAX_DEVICES; ++i) {
+			const auto slot = static_cast< uint8_t >(1 << i);
+			if (!rescan && !(m_xinputSlots & slot)) {
+				continue;
+			}
+
 			XboxInputState state;
 			if (m_xinput->GetState(i, &state) != ERROR_SUCCESS) {
+				m_xinputSlots &= static_cast< uint8_t >(~slot);
 				continue;
 			}
 
+			m_xinputSlots |= slot;
+
 			// Skip the result of GetState() if the packet number hasn't changed,
 			// or if we're at the first packet.
 			if (m_xinputLastPacket[i] != 0 && state.packetNumber == m_xinputLastPacket[i]) {
@@ -12,6 +12,7 @@
 #	include "XboxInput.h"
 #endif
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <unordered_map>
@@ -127,6 +128,13 @@ protected:
 	/// Any new data queried for a device is only valid
 	/// if the packet number is different than last time we queried it.
 	uint32_t m_xinputLastPacket[XBOXINPUT_MAX_DEVICES];
+	/// Holds a bit for each XInput slot a controller has been found in.
+	/// Only those slots are queried for every HID message, because querying
+	/// an empty slot is considerably slower (XInput looks for the device).
+	uint8_t m_xinputSlots;
+	/// Set by addDevice() and deviceRemoved() when an XInput device comes or goes,
+	/// so that processOther() queries all slots again.
+	std::atomic< bool > m_xinputRescan;
 
 	static bool xinputIsPressed(const uint8_t bit, const XboxInputState &state);
 #endif
@@ -0,0 +1,80 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "IconCache.h"
+
+#include <QtCore/QRect>
+#include <QtGui/QPainter>
+
+#include <cmath>
+
+bool IconCache::Key::operator==(const Key &other) const {
+	return icon == other.icon && size == other.size && devicePixelRatio == other.devicePixelRatio
+		   && mode == other.mode && state == other.state;
+}
+
+uint qHash(const IconCache::Key &key, uint seed) {
+	seed = qHash(key.icon, seed);
+	seed = qHash(key.size.width(), seed) ^ (qHash(key.size.height(), seed) << 1);
+	seed = qHash(static_cast< int >(std::lround(key.devicePixelRatio * 100)), seed);
+	return qHash((static_cast< int >(key.mode) << 1) | static_cast< int >(key.state), seed);
+}
+
+QPixmap IconCache::pixmap(const QIcon &icon, const QSize &size, qreal devicePixelRatio, QIcon::Mode mode,
+						  QIcon::State state) {
+	if (icon.isNull() || size.isEmpty()) {
+		return QPixmap();
+	}
+
+	const Key key = { icon.cacheKey(), size, devicePixelRatio, mode, state };
+
+	auto it = m_pixmaps.constFind(key);
+	if (it != m_pixmaps.constEnd()) {
+		return it.value();
+	}
+
+	if (m_pixmaps.size() >= MAX_PIXMAPS) {
+		m_pixmaps.clear();
+	}
+
+	const QPixmap pm = rasterize(icon, size, devicePixelRatio, mode, state);
+	m_pixmaps.insert(key, pm);
+	return pm;
+}
+
+void IconCache::warm(const QList< QIcon > &icons, const QSize &size, qreal devicePixelRatio) {
+	for (const QIcon &icon : icons) {
+		pixmap(icon, size, devicePixelRatio);
+	}
+}
+
+void IconCache::setGeneration(unsigned int generation) {
+	if (generation != m_generation) {
+		m_generation = generation;
+		clear();
+	}
+}
+
+void IconCache::clear() {
+	m_pixmaps.clear();
+}
+
+int IconCache::size() const {
+	return m_pixmaps.size();
+}
+
+QPixmap IconCache::rasterize(const QIcon &icon, const QSize &size, qreal devicePixelRatio, QIcon::Mode mode,
+							 QIcon::State state) {
+	QPixmap pm(size * devicePixelRatio);
+	pm.setDevicePixelRatio(devicePixelRatio);
+	pm.fill(Qt::transparent);
+
+	// Painting the icon (instead of asking for a pixmap) makes it render at the device pixel ratio of the pixmap
+	QPainter p(&pm);
+	p.setRenderHint(QPainter::SmoothPixmapTransform);
+	icon.paint(&p, QRect(QPoint(0, 0), size), Qt::AlignCenter, mode, state);
+
+	return pm;
+}
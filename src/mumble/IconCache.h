@@ -0,0 +1,59 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_ICONCACHE_H_
+#define MUMBLE_MUMBLE_ICONCACHE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSize>
+#include <QtGui/QIcon>
+#include <QtGui/QPixmap>
+
+/// A cache of icons that have been rasterized at a certain size and device pixel ratio.
+///
+/// QIcon renders SVG icons whenever it is asked for a size it doesn't have in QPixmapCache, which is shared with the
+/// rest of the application and thus may have dropped the pixmaps by the time the icons are painted again. The cache
+/// keeps the pixmaps for as long as the theme (see Themes::generation()) stays the same, so that painting an icon is
+/// merely a lookup.
+class IconCache {
+public:
+	/// The number of pixmaps after which the cache is cleared (e.g. because the size has changed often)
+	static constexpr int MAX_PIXMAPS = 512;
+
+	/// @returns The given icon rasterized at the given size (in device-independent pixels) and device pixel ratio
+	QPixmap pixmap(const QIcon &icon, const QSize &size, qreal devicePixelRatio, QIcon::Mode mode = QIcon::Normal,
+				   QIcon::State state = QIcon::On);
+	/// Rasterizes the given icons at the given size and device pixel ratio ahead of time
+	void warm(const QList< QIcon > &icons, const QSize &size, qreal devicePixelRatio);
+	/// Drops all pixmaps if the given theme generation differs from the one the pixmaps have been rasterized for
+	void setGeneration(unsigned int generation);
+	/// Drops all pixmaps
+	void clear();
+
+	/// @returns The number of pixmaps in the cache
+	int size() const;
+
+protected:
+	struct Key {
+		qint64 icon;
+		QSize size;
+		qreal devicePixelRatio;
+		QIcon::Mode mode;
+		QIcon::State state;
+
+		bool operator==(const Key &other) const;
+	};
+	friend uint qHash(const Key &key, uint seed);
+
+	QHash< Key, QPixmap > m_pixmaps;
+	unsigned int m_generation = 0;
+
+	/// @returns The given icon rendered into a pixmap of the given size
+	static QPixmap rasterize(const QIcon &icon, const QSize &size, qreal devicePixelRatio, QIcon::Mode mode,
+							 QIcon::State state);
+};
+
+#endif // MUMBLE_MUMBLE_ICONCACHE_H_
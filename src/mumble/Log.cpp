@@ -11,11 +11,12 @@
 #include "Channel.h"
 #include "MainWindow.h"
 #include "NetworkConfig.h"
+#include "Profiler.h"
 #include "RichTextEditor.h"
 #include "Screen.h"
 #include "ServerHandler.h"
 #ifndef USE_NO_TTS
-#	include "TextToSpeech.h"
+#	include "TextToSpeechDispatcher.h"
 #endif
 #include "Utils.h"
 #include "VolumeAdjustment.h"
@@ -395,13 +396,16 @@ void LogConfig::on_qsbTTSVolume_valueChanged(int value) {
 
 QMutex Log::qmDeferredLogs;
 QVector< LogMessage > Log::qvDeferredLogs;
+constexpr int Log::LATEST;
+constexpr int Log::HISTORY_PAGE_SIZE;
+constexpr int Log::MESSAGE_INDEX_PROPERTY;
 
 
 Log::Log(QObject *p) : QObject(p) {
 	qRegisterMetaType< Log::MsgType >();
 
 #ifndef USE_NO_TTS
-	tts = new TextToSpeech(this);
+	tts = new TextToSpeechDispatcher(this);
 	tts->setVolume(Global::get().s.iTTSVolume);
 #endif
 	uiLastId = 0;
@@ -690,8 +694,149 @@ QString Log::validHtml(const QString &html, QTextCursor *tc) {
 	}
 }
 
+void Log::insertMessage(QTextCursor &tc, const QDateTime &dt, const QString &console, QString &plain, int index) {
+	// We copy the value from the settings in order to make sure that
+	// we use the same margin everywhere while in this method (even if
+	// the setting might change in that time).
+	const int msgMargin = Global::get().s.iChatMessageMargins;
+
+	QTextFrameFormat qttf;
+	qttf.setTopMargin(0);
+	qttf.setBottomMargin(msgMargin);
+
+	// A newline is inserted after each frame, but this spaces out the
+	// log entries too much, so the line height is set to zero to reduce
+	// the space between log entries. This line height is only set for the
+	// blank lines between entries, not for entries themselves.
+	//
+	// NOTE: All further log entries must go in a new text frame.
+	// Otherwise, they will not display correctly as a result of having
+	// line height equal to 0 for the current block.
+	QTextBlockFormat bf = tc.blockFormat();
+	bf.setLineHeight(0, QTextBlockFormat::FixedHeight);
+	bf.setTopMargin(0);
+	bf.setBottomMargin(0);
+
+	// Set the line height of the leading blank line to zero
+	tc.setBlockFormat(bf);
+
+	if (qdDate != dt.date()) {
+		qdDate = dt.date();
+		tc.insertFrame(qttf);
+		tc.insertHtml(
+			tr("[Date changed to %1]\n").arg(QLocale().toString(qdDate, QLocale::ShortFormat).toHtmlEscaped()));
+		tc.setBlockFormat(bf);
+	}
+
+	// Convert CRLF to unix-style LF and old mac-style LF (single \r) to unix-style as well
+	QString fixedNLPlain =
+		plain.replace(QLatin1String("\r\n"), QLatin1String("\n")).replace(QLatin1String("\r"), QLatin1String("\n"));
+
+	if (fixedNLPlain.contains(QRegExp(QLatin1String("\\n[ \\t]*$")))) {
+		// If the message ends with one or more blank lines (or lines only containing whitespace)
+		// paint a border around the message to make clear that it contains invisible parts.
+		// The beginning of the message is clear anyway (the date and potentially the "To XY" part)
+		// so we don't have to care about that.
+		qttf.setBorder(1);
+		qttf.setPadding(2);
+		qttf.setBorderStyle(QTextFrameFormat::BorderStyle_Dashed);
+	}
+
+	// The frame remembers which message it shows (see firstShownMessage())
+	qttf.setProperty(MESSAGE_INDEX_PROPERTY, index);
+	tc.insertFrame(qttf);
+
+	const QString timeString =
+		dt.time().toString(QLatin1String(Global::get().s.bLog24HourClock ? "HH:mm:ss" : "hh:mm:ss AP"));
+	tc.insertHtml(Log::msgColor(QString::fromLatin1("[%1] ").arg(timeString.toHtmlEscaped()), Log::Time));
+
+	validHtml(console, &tc);
+	tc.movePosition(QTextCursor::End);
+
+	// Set the line height of the trailing blank line to zero
+	tc.setBlockFormat(bf);
+}
+
+void Log::showMessages(int begin, int end) {
+	LogTextBrowser *tlog = Global::get().mw->qteLog;
+	tlog->clear();
+	qdDate = QDate();
+
+	QTextCursor tc = tlog->textCursor();
+	tc.movePosition(QTextCursor::End);
+
+	for (int i = begin; i < end; i++) {
+		const LogHistory::Entry entry = m_history.at(i);
+		if (entry.time.isValid()) {
+			QString plain = QTextDocumentFragment::fromHtml(entry.html).toPlainText();
+			insertMessage(tc, entry.time, entry.html, plain, i);
+		}
+	}
+
+	tlog->setTextCursor(tc);
+}
+
+int Log::firstShownMessage() const {
+	// The document may have dropped the oldest blocks (see Settings::iMaxLogBlocks), which leaves the frames of the
+	// messages after them
+	for (const QTextFrame *frame : Global::get().mw->qteLog->document()->rootFrame()->childFrames()) {
+		const QVariant index = frame->frameFormat().property(MESSAGE_INDEX_PROPERTY);
+		if (index.isValid()) {
+			return index.toInt();
+		}
+	}
+
+	return m_history.count();
+}
+
+bool Log::hasEarlierMessages() const {
+	return m_pageBegin == LATEST ? firstShownMessage() > 0 : m_pageBegin > 0;
+}
+
+bool Log::isShowingEarlierMessages() const {
+	return m_pageBegin != LATEST;
+}
+
+void Log::showEarlierMessages() {
+	// The oldest message that is shown may only be partially, so it is part of the earlier page as well
+	const int end = m_pageBegin == LATEST ? qMin(firstShownMessage() + 1, m_history.count()) : m_pageBegin;
+	if (end <= 0) {
+		return;
+	}
+
+	m_pageBegin = qMax(end - HISTORY_PAGE_SIZE, 0);
+	showMessages(m_pageBegin, end);
+
+	Global::get().mw->qteLog->scrollLogToBottom();
+}
+
+void Log::showLaterMessages() {
+	if (m_pageBegin == LATEST) {
+		return;
+	}
+
+	const int begin = m_pageBegin + HISTORY_PAGE_SIZE;
+	if (begin + HISTORY_PAGE_SIZE >= m_history.count()) {
+		showLatestMessages();
+		return;
+	}
+
+	m_pageBegin = begin;
+	showMessages(begin, begin + HISTORY_PAGE_SIZE);
+
+	Global::get().mw->qteLog->setLogScroll(0);
+}
+
+void Log::showLatestMessages() {
+	m_pageBegin = LATEST;
+	showMessages(qMax(m_history.count() - HISTORY_PAGE_SIZE, 0), m_history.count());
+
+	Global::get().mw->qteLog->scrollLogToBottom();
+}
+
 void Log::log(MsgType mt, const QString &console, const QString &terse, bool ownMessage, const QString &overrideTTS,
 			  bool ignoreTTS) {
+	MUMBLE_PROFILE_ZONE("Log::log");
 	QDateTime dt = QDateTime::currentDateTime();
 
 	int ignore = qmIgnore.value(mt);
@@ -707,79 +852,25 @@ void Log::log(MsgType mt, const QString &console, const QString &terse, bool own
 
 	// Message output on console
 	if ((flags & Settings::LogConsole)) {
-		QTextCursor tc = Global::get().mw->qteLog->textCursor();
-
-		tc.movePosition(QTextCursor::End);
-
-		// We copy the value from the settings in order to make sure that
-		// we use the same margin everywhere while in this method (even if
-		// the setting might change in that time).
-		const int msgMargin = Global::get().s.iChatMessageMargins;
-
-		QTextFrameFormat qttf;
-		qttf.setTopMargin(0);
-		qttf.setBottomMargin(msgMargin);
-
-		LogTextBrowser *tlog     = Global::get().mw->qteLog;
-		const int oldscrollvalue = tlog->getLogScroll();
-		const bool scroll        = (oldscrollvalue == tlog->getLogScrollMaximum());
-
-		// A newline is inserted after each frame, but this spaces out the
-		// log entries too much, so the line height is set to zero to reduce
-		// the space between log entries. This line height is only set for the
-		// blank lines between entries, not for entries themselves.
-		//
-		// NOTE: All further log entries must go in a new text frame.
-		// Otherwise, they will not display correctly as a result of having
-		// line height equal to 0 for the current block.
-		QTextBlockFormat bf = tc.blockFormat();
-		bf.setLineHeight(0, QTextBlockFormat::FixedHeight);
-		bf.setTopMargin(0);
-		bf.setBottomMargin(0);
-
-		// Set the line height of the leading blank line to zero
-		tc.setBlockFormat(bf);
-
-		if (qdDate != dt.date()) {
-			qdDate = dt.date();
-			tc.insertFrame(qttf);
-			tc.insertHtml(
-				tr("[Date changed to %1]\n").arg(QLocale().toString(qdDate, QLocale::ShortFormat).toHtmlEscaped()));
-			tc.movePosition(QTextCursor::End);
-			tc.setBlockFormat(bf);
-		}
-
-		// Convert CRLF to unix-style LF and old mac-style LF (single \r) to unix-style as well
-		QString fixedNLPlain =
-			plain.replace(QLatin1String("\r\n"), QLatin1String("\n")).replace(QLatin1String("\r"), QLatin1String("\n"));
-
-		if (fixedNLPlain.contains(QRegExp(QLatin1String("\\n[ \\t]*$")))) {
-			// If the message ends with one or more blank lines (or lines only containing whitespace)
-			// paint a border around the message to make clear that it contains invisible parts.
-			// The beginning of the message is clear anyway (the date and potentially the "To XY" part)
-			// so we don't have to care about that.
-			qttf.setBorder(1);
-			qttf.setPadding(2);
-			qttf.setBorderStyle(QTextFrameFormat::BorderStyle_Dashed);
-		}
+		m_history.append(dt, console);
 
-		tc.insertFrame(qttf);
-
-		const QString timeString =
-			dt.time().toString(QLatin1String(Global::get().s.bLog24HourClock ? "HH:mm:ss" : "hh:mm:ss AP"));
-		tc.insertHtml(Log::msgColor(QString::fromLatin1("[%1] ").arg(timeString.toHtmlEscaped()), Log::Time));
+		// While paging back through the history, the message is only shown once the latest messages are again
+		if (m_pageBegin == LATEST) {
+			LogTextBrowser *tlog     = Global::get().mw->qteLog;
+			const int oldscrollvalue = tlog->getLogScroll();
+			const bool scroll        = (oldscrollvalue == tlog->getLogScrollMaximum());
 
-		validHtml(console, &tc);
-		tc.movePosition(QTextCursor::End);
-		Global::get().mw->qteLog->setTextCursor(tc);
+			QTextCursor tc = tlog->textCursor();
+			tc.movePosition(QTextCursor::End);
 
-		// Set the line height of the trailing blank line to zero
-		tc.setBlockFormat(bf);
+			insertMessage(tc, dt, console, plain, m_history.count() - 1);
+			tlog->setTextCursor(tc);
 
-		if (scroll || ownMessage)
-			tlog->scrollLogToBottom();
-		else
-			tlog->setLogScroll(oldscrollvalue);
+			if (scroll || ownMessage)
+				tlog->scrollLogToBottom();
+			else
+				tlog->setLogScroll(oldscrollvalue);
+		}
 	}
 
 	if (!ownMessage) {
@@ -863,11 +954,15 @@ void Log::log(MsgType mt, const QString &console, const QString &terse, bool own
 	}
 
 #ifndef USE_NO_TTS
+	// A pending text message is replaced by the next one of the same sender, which the terse text names
+	const QString key =
+		(mt == TextMessage || mt == PrivateTextMessage) ? QString::number(mt) + QLatin1Char(':') + terse : QString();
+
 	// TTS threshold limiter.
 	if (plain.length() <= Global::get().s.iTTSThreshold)
-		tts->say(plain);
+		tts->say(plain, key);
 	else if ((!terse.isEmpty()) && (terse.length() <= Global::get().s.iTTSThreshold))
-		tts->say(terse);
+		tts->say(terse, key);
 #else
 	// Mark as unused
 	Q_UNUSED(terse);
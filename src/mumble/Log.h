@@ -13,10 +13,11 @@
 #include <QtGui/QTextDocument>
 
 #include "ConfigDialog.h"
+#include "LogHistory.h"
 #include "ui_Log.h"
 
 #ifndef USE_NO_TTS
-class TextToSpeech;
+class TextToSpeechDispatcher;
 #endif
 
 class LogConfig : public ConfigWidget, public Ui::LogConfig {
@@ -128,13 +129,30 @@ protected:
 	static const char *msgNames[];
 	static const char *colorClasses[];
 #ifndef USE_NO_TTS
-	TextToSpeech *tts;
+	TextToSpeechDispatcher *tts;
 #endif
 	unsigned int uiLastId;
 	QDate qdDate;
+	/// Every message that has been logged to the console, including those the log's document no longer holds
+	LogHistory m_history;
+	/// The value of m_pageBegin while the latest messages are shown
+	static constexpr int LATEST = -1;
+	/// The number of messages that are shown per page of the history
+	static constexpr int HISTORY_PAGE_SIZE = 100;
+	/// The property of a message's frame that holds the message's index in the history
+	static constexpr int MESSAGE_INDEX_PROPERTY = QTextFormat::UserProperty;
+	/// The index of the oldest message shown while paging back through the history
+	int m_pageBegin = LATEST;
 	static const QStringList allowedSchemes();
 	void postNotification(MsgType mt, const QString &plain);
 	void postQtNotification(MsgType mt, const QString &plain);
+	/// Appends the message with the given index in the history to the log's document. The cursor is expected to be
+	/// at the end of the document. The line endings of plain are converted to LF.
+	void insertMessage(QTextCursor &tc, const QDateTime &dt, const QString &console, QString &plain, int index);
+	/// Replaces the contents of the log with the messages of the history in the given range
+	void showMessages(int begin, int end);
+	/// @returns The index of the oldest message that the log's document (still) holds, m_history.count() if none
+	int firstShownMessage() const;
 
 public:
 	Log(QObject *p = nullptr);
@@ -158,6 +176,17 @@ public slots:
 			 const QString &overrideTTS = QString(), bool ignoreTTS = false);
 	/// Logs LogMessages that have been deferred so far
 	void processDeferredLogs();
+
+	/// @returns Whether the history has messages older than the oldest one that the log shows
+	bool hasEarlierMessages() const;
+	/// @returns Whether the log pages back through the history (and thus doesn't show new messages)
+	bool isShowingEarlierMessages() const;
+	/// Shows the page of the history before the oldest message that the log shows
+	void showEarlierMessages();
+	/// Shows the page of the history after the newest message that the log shows (the latest messages at most)
+	void showLaterMessages();
+	/// Shows the latest messages again, which the log keeps appending new ones to
+	void showLatestMessages();
 };
 
 class LogMessage {
@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LogHistory.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryFile>
+
+constexpr int LogHistory::DEFAULT_MEMORY_CAPACITY;
+
+LogHistory::LogHistory(int memoryCapacity) : m_memoryCapacity(qMax(memoryCapacity, 1)) {
+}
+
+LogHistory::~LogHistory() = default;
+
+void LogHistory::append(const QDateTime &time, const QString &html) {
+	m_recent.push_back({ time, html });
+
+	if (static_cast< int >(m_recent.size()) > m_memoryCapacity) {
+		spill();
+	}
+}
+
+int LogHistory::count() const {
+	return m_dropped + static_cast< int >(m_offsets.size() + m_recent.size());
+}
+
+LogHistory::Entry LogHistory::at(int index) const {
+	if (index < m_dropped || index >= count()) {
+		return {};
+	}
+
+	const int inFile = static_cast< int >(m_offsets.size());
+	if (index - m_dropped >= inFile) {
+		return m_recent[static_cast< std::size_t >(index - m_dropped - inFile)];
+	}
+
+	Entry entry;
+	if (m_file->seek(m_offsets[static_cast< std::size_t >(index - m_dropped)])) {
+		QDataStream stream(m_file.get());
+		stream >> entry.time >> entry.html;
+
+		if (stream.status() != QDataStream::Ok) {
+			return {};
+		}
+	}
+
+	return entry;
+}
+
+void LogHistory::clear() {
+	m_recent.clear();
+	m_offsets.clear();
+	m_dropped = 0;
+	m_file.reset();
+}
+
+void LogHistory::spill() {
+	const Entry &oldest = m_recent.front();
+
+	if (!m_file) {
+		m_file = std::make_unique< QTemporaryFile >(QDir::tempPath() + QLatin1String("/mumble-log-XXXXXX"));
+		if (!m_file->open()) {
+			qWarning("LogHistory: Failed to create the file for the older messages");
+		}
+	}
+
+	bool written = false;
+	if (m_file->isOpen() && m_file->seek(m_file->size())) {
+		const qint64 offset = m_file->pos();
+
+		QDataStream stream(m_file.get());
+		stream << oldest.time << oldest.html;
+
+		written = stream.status() == QDataStream::Ok;
+		if (written) {
+			m_offsets.push_back(offset);
+		} else {
+			m_file->resize(offset);
+		}
+	}
+
+	if (!written) {
+		// The message is dropped rather than kept in memory, which would grow without bound again. The messages that
+		// are dropped must be the oldest ones, so those in the file go as well.
+		if (m_file->isOpen()) {
+			qWarning("LogHistory: Failed to write to the file for the older messages");
+			m_file->close();
+		}
+
+		m_dropped += static_cast< int >(m_offsets.size()) + 1;
+		m_offsets.clear();
+	}
+
+	m_recent.pop_front();
+}
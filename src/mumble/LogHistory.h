@@ -0,0 +1,61 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_LOGHISTORY_H_
+#define MUMBLE_MUMBLE_LOGHISTORY_H_
+
+#include <QtCore/QDateTime>
+#include <QtCore/QString>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+class QTemporaryFile;
+
+/// The messages that have been logged to the console since the start, so that the log can page back through them while
+/// its document only holds the most recent ones. The newest messages are kept in memory and the older ones are moved
+/// to a temporary file (which only the user may read and which is removed on exit), so neither grows without bound.
+class LogHistory {
+public:
+	/// How many messages are kept in memory by default
+	static constexpr int DEFAULT_MEMORY_CAPACITY = 1000;
+
+	struct Entry {
+		QDateTime time;
+		/// The message as it has been passed to Log::log() (before it has been sanitized)
+		QString html;
+	};
+
+	explicit LogHistory(int memoryCapacity = DEFAULT_MEMORY_CAPACITY);
+	~LogHistory();
+
+	void append(const QDateTime &time, const QString &html);
+
+	/// @returns The number of messages that have been appended
+	int count() const;
+	/// @returns The message with the given index (the oldest one being 0), which is empty if it couldn't be read back
+	Entry at(int index) const;
+
+	void clear();
+
+private:
+	Q_DISABLE_COPY(LogHistory)
+
+	/// Moves the oldest message in memory to the file
+	void spill();
+
+	const int m_memoryCapacity;
+	/// The newest messages
+	std::deque< Entry > m_recent;
+	/// The number of messages that have been dropped, as they couldn't be written to the file
+	int m_dropped = 0;
+	/// Where each of the messages in the file starts
+	std::vector< qint64 > m_offsets;
+	/// The file, which is only created once it is needed
+	std::unique_ptr< QTemporaryFile > m_file;
+};
+
+#endif // MUMBLE_MUMBLE_LOGHISTORY_H_
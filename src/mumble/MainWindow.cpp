@@ -7,6 +7,7 @@
 
 #include "ACL.h"
 #include "ACLEditor.h"
+#include "API.h"
 #include "About.h"
 #include "AudioInput.h"
 #include "AudioStats.h"
@@ -460,6 +461,15 @@ void MainWindow::setupGui() {
 	QObject::connect(pmModel, &UserModel::channelRenamed, Global::get().pluginManager,
 					 &PluginManager::on_channelRenamed);
 
+	// Keep the state snapshot that the plugin API answers its read-only functions from up to date
+	API::MumbleAPI *api = &API::MumbleAPI::get();
+	QObject::connect(pmModel, &UserModel::rowsInserted, api, &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(pmModel, &UserModel::rowsRemoved, api, &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(pmModel, &UserModel::rowsMoved, api, &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(pmModel, &UserModel::dataChanged, api, &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(pmModel, &UserModel::modelReset, api, &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(this, &MainWindow::serverSynchronized, api, &API::MumbleAPI::invalidateSnapshot);
+
 	qaAudioMute->setChecked(Global::get().s.bMute);
 	qaAudioDeaf->setChecked(Global::get().s.bDeaf);
 
@@ -1069,6 +1079,14 @@ void MainWindow::on_qteLog_customContextMenuRequested(const QPoint &mpos) {
 		qtcSaveImageCursor = cursor;
 	}
 
+	menu->addSeparator();
+	QAction *earlier = menu->addAction(tr("Show Earlier Messages"), Global::get().l, SLOT(showEarlierMessages(void)));
+	earlier->setEnabled(Global::get().l->hasEarlierMessages());
+	if (Global::get().l->isShowingEarlierMessages()) {
+		menu->addAction(tr("Show Later Messages"), Global::get().l, SLOT(showLaterMessages(void)));
+		menu->addAction(tr("Show Latest Messages"), Global::get().l, SLOT(showLatestMessages(void)));
+	}
+
 	menu->addSeparator();
 	menu->addAction(tr("Clear"), qteLog, SLOT(clear(void)));
 	menu->exec(qteLog->mapToGlobal(mpos));
@@ -1198,6 +1216,10 @@ static void recreateServerHandler() {
 	QObject::connect(sh.get(), &ServerHandler::disconnected, Global::get().talkingUI,
 					 &TalkingUI::on_serverDisconnected);
 
+	QObject::connect(sh.get(), &ServerHandler::connected, &API::MumbleAPI::get(), &API::MumbleAPI::invalidateSnapshot);
+	QObject::connect(sh.get(), &ServerHandler::disconnected, &API::MumbleAPI::get(),
+					 &API::MumbleAPI::invalidateSnapshot);
+
 	// We have to use direct connections for these here as the PluginManager must be able to access the connection's ID
 	// and in order for that to be possible the (dis)connection process must not proceed in the background.
 	Global::get().pluginManager->connect(sh.get(), &ServerHandler::connected, Global::get().pluginManager,
@@ -2636,7 +2658,7 @@ void MainWindow::userStateChanged() {
 void MainWindow::on_qaAudioReset_triggered() {
 	AudioInputPtr ai = Global::get().ai;
 	if (ai)
-		ai->bResetProcessor = true;
+		ai->resetAudioProcessor();
 }
 
 void MainWindow::on_qaFilterToggle_triggered() {
@@ -3406,6 +3428,9 @@ void MainWindow::serverConnected() {
 
 	qtvUsers->setRowHidden(0, QModelIndex(), false);
 
+	// The server is about to send its state, which the view only shows once it has been synchronized
+	pmModel->beginBulkLoad();
+
 	Global::get().bAllowHTML      = true;
 	Global::get().uiMessageLength = 5000;
 	Global::get().uiImageLength   = 131072;
@@ -3516,6 +3541,8 @@ void MainWindow::serverDisconnected(QAbstractSocket::SocketError err, QString re
 	qlUserActions.clear();
 
 	pmModel->removeAll();
+	// In case the connection has been lost before the server's state has been synchronized
+	pmModel->endBulkLoad();
 	qtvUsers->setRowHidden(0, QModelIndex(), true);
 
 	// Update QActions and menus
@@ -25,6 +25,7 @@
 #endif
 #include "ChannelListenerManager.h"
 #include "PluginManager.h"
+#include "Profiler.h"
 #include "ProtoUtils.h"
 #include "ServerHandler.h"
 #include "TalkingUI.h"
@@ -39,6 +40,9 @@
 #include "Global.h"
 
 #include <QTextDocumentFragment>
+#include <QtCore/QDateTime>
+#include <QtCore/QLocale>
+#include <QtCore/QtEndian>
 
 #define ACTOR_INIT                           \
 	ClientUser *pSrc = nullptr;              \
@@ -118,6 +122,7 @@ void MainWindow::msgReject(const MumbleProto::Reject &msg) {
 ///
 /// @param msg The message object with the respective information
 void MainWindow::msgServerSync(const MumbleProto::ServerSync &msg) {
+	MUMBLE_PROFILE_ZONE("MainWindow::msgServerSync");
 	const ClientUser *user = ClientUser::get(msg.session());
 	if (!user) {
 		Global::get().l->log(Log::CriticalError, tr("Server sync protocol violation. No user profile received."));
@@ -136,6 +141,7 @@ void MainWindow::msgServerSync(const MumbleProto::ServerSync &msg) {
 			Global::get().l->log(Log::Information, tr("Welcome message: %1").arg(str));
 		}
 	}
+	pmModel->endBulkLoad();
 	pmModel->ensureSelfVisible();
 	pmModel->recheckLinks();
 
@@ -212,6 +218,15 @@ void MainWindow::msgServerConfig(const MumbleProto::ServerConfig &msg) {
 	if (msg.has_recording_allowed()) {
 		Global::get().mw->enableRecording(msg.recording_allowed());
 	}
+	if (msg.has_plugin_data_batches()) {
+		Global::get().sh->setPluginDataBatching(msg.plugin_data_batches());
+	}
+	if (msg.has_listener_volumes_quantized()) {
+		Global::get().sh->m_listenerVolumesQuantized = msg.listener_volumes_quantized();
+	}
+	if (msg.has_small_audio_frames()) {
+		Global::get().sh->m_smallAudioFrames = msg.small_audio_frames();
+	}
 }
 
 /// This message is being received when the server denied the permission to perform a requested action. This function
@@ -332,6 +347,7 @@ void MainWindow::msgUDPTunnel(const MumbleProto::UDPTunnel &) {
 ///
 /// @param msg The message object containing the respective information
 void MainWindow::msgUserState(const MumbleProto::UserState &msg) {
+	MUMBLE_PROFILE_ZONE("MainWindow::msgUserState");
 	ACTOR_INIT;
 	ClientUser *pSelf = ClientUser::get(Global::get().uiSession);
 	ClientUser *pDst  = ClientUser::get(msg.session());
@@ -872,6 +888,7 @@ void MainWindow::msgUserRemove(const MumbleProto::UserRemove &msg) {
 ///
 /// @param msg The message object containing the details about the channel properties
 void MainWindow::msgChannelState(const MumbleProto::ChannelState &msg) {
+	MUMBLE_PROFILE_ZONE("MainWindow::msgChannelState");
 	if (!msg.has_channel_id())
 		return;
 
@@ -1002,6 +1019,12 @@ void MainWindow::msgTextMessage(const MumbleProto::TextMessage &msg) {
 	ACTOR_INIT;
 	QString target;
 
+	// The message is part of the channels' history already
+	for (int i = 0; i < msg.channel_id_size(); ++i) {
+		quint64 &shown = Global::get().sh->m_shownMessageHistory[msg.channel_id(i)];
+		shown          = std::max(shown, static_cast< quint64 >(msg.timestamp()));
+	}
+
 	// Silently drop the message if this user is set to "ignore"
 	if (pSrc && pSrc->bLocalIgnore)
 		return;
@@ -1072,7 +1095,20 @@ void MainWindow::msgCryptSetup(const MumbleProto::CryptSetup &msg) {
 	ConnectionPtr c = Global::get().sh->cConnection;
 	if (!c)
 		return;
+	// The network thread uses the crypt state as well
+	QMutexLocker l(&c->qmCrypt);
+
 	if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
+		const CryptMode mode = static_cast< CryptMode >(msg.mode());
+		if (mode != c->csCrypt->mode()) {
+			std::unique_ptr< CryptState > cs = CryptState::create(mode);
+			if (!cs) {
+				qWarning("Messages: Cipher setup failed: Unsupported mode requested by the server!");
+				return;
+			}
+			c->csCrypt = std::move(cs);
+		}
+
 		const std::string &key          = msg.key();
 		const std::string &client_nonce = msg.client_nonce();
 		const std::string &server_nonce = msg.server_nonce();
@@ -1081,11 +1117,10 @@ void MainWindow::msgCryptSetup(const MumbleProto::CryptSetup &msg) {
 		}
 	} else if (msg.has_server_nonce()) {
 		const std::string &server_nonce = msg.server_nonce();
-		if (server_nonce.size() == AES_BLOCK_SIZE) {
+		if (c->csCrypt->setDecryptIV(server_nonce)) {
 			c->csCrypt->uiResync++;
-			if (!c->csCrypt->setDecryptIV(server_nonce)) {
-				qWarning("Messages: Cipher resync failed: Invalid nonce from the server!");
-			}
+		} else {
+			qWarning("Messages: Cipher resync failed: Invalid nonce from the server!");
 		}
 	} else {
 		MumbleProto::CryptSetup mpcs;
@@ -1304,6 +1339,144 @@ void MainWindow::msgPluginDataTransmission(const MumbleProto::PluginDataTransmis
 	}
 }
 
+/// This message is being received instead of several PluginDataTransmission messages if this client has announced
+/// support for it.
+///
+/// @param msg The message object containing the (possibly compressed) messages
+void MainWindow::msgPluginDataBatch(const MumbleProto::PluginDataBatch &msg) {
+	std::vector< MumbleProto::PluginDataTransmission > transmissions;
+	if (!MumbleProto::getPluginDataBatchTransmissions(msg, transmissions)) {
+		qWarning("MainWindow: Received invalid plugin data batch");
+		return;
+	}
+
+	for (const MumbleProto::PluginDataTransmission &transmission : transmissions) {
+		msgPluginDataTransmission(transmission);
+	}
+}
+
+/// This message is being received whenever this client joins a channel (as it has announced support for it), holding
+/// the latest page of the messages that have been sent to the channel before.
+///
+/// @param msg The message object holding the messages, oldest first
+void MainWindow::msgTextMessageHistory(const MumbleProto::TextMessageHistory &msg) {
+	if (!Channel::get(msg.channel_id())) {
+		return;
+	}
+
+	quint64 &shown = Global::get().sh->m_shownMessageHistory[msg.channel_id()];
+	for (const MumbleProto::TextMessageHistory_Entry &entry : msg.entries()) {
+		const MumbleProto::TextMessage &message = entry.message();
+		if (message.timestamp() <= shown) {
+			continue;
+		}
+		shown = message.timestamp();
+
+		// The sender might still be connected
+		const ClientUser *sender = ClientUser::get(message.actor());
+		if (sender && sender->bLocalIgnore) {
+			continue;
+		}
+
+		const QString time =
+			QLocale().toString(QDateTime::fromMSecsSinceEpoch(static_cast< qint64 >(message.timestamp())),
+							   QLocale::ShortFormat);
+		const QString name = Log::msgColor(u8(entry.actor_name()).toHtmlEscaped(), Log::Source);
+
+		Global::get().l->log(Log::Information,
+							 tr("(History, %1) %2: %3").arg(time).arg(name).arg(u8(message.message())), QString(),
+							 false, QString(), true);
+	}
+}
+
+/// This message is being received while connecting to a server (if this client has announced support for it) instead
+/// of the individual ChannelState and UserState messages describing the server's channels and users.
+///
+/// @param msg The message object containing the (possibly compressed) messages
+void MainWindow::msgStateSnapshot(const MumbleProto::StateSnapshot &msg) {
+	// Protects against snapshots whose uncompressed size is excessive
+	constexpr quint32 MAX_SNAPSHOT_SIZE = 64 * 1024 * 1024;
+
+	QByteArray data = QByteArray::fromRawData(msg.data().data(), static_cast< int >(msg.data().size()));
+
+	switch (msg.compression()) {
+		case MumbleProto::StateSnapshot_Compression_None:
+			break;
+		case MumbleProto::StateSnapshot_Compression_Zlib:
+			if (data.size() < 4
+				|| qFromBigEndian< quint32 >(reinterpret_cast< const unsigned char * >(data.constData()))
+					   > MAX_SNAPSHOT_SIZE) {
+				qWarning("MainWindow: Received state snapshot of invalid size");
+				return;
+			}
+
+			data = qUncompress(data);
+			if (data.isEmpty()) {
+				qWarning("MainWindow: Failed to decompress state snapshot");
+				return;
+			}
+			break;
+		default:
+			qWarning("MainWindow: Received state snapshot with unknown compression");
+			return;
+	}
+
+	QSet< unsigned int > enterRestricted;
+	for (int i = 0; i < msg.enter_restricted_channels_size(); ++i) {
+		enterRestricted.insert(msg.enter_restricted_channels(i));
+	}
+
+	QSet< unsigned int > denied;
+	for (int i = 0; i < msg.denied_channels_size(); ++i) {
+		denied.insert(msg.denied_channels(i));
+	}
+
+	const unsigned char *buffer = reinterpret_cast< const unsigned char * >(data.constData());
+	const int size              = data.size();
+	int offset                  = 0;
+
+	// Every message is framed the same way it would be on the TCP connection
+	while (size - offset >= 6) {
+		const quint16 type   = qFromBigEndian< quint16 >(&buffer[offset]);
+		const quint32 length = qFromBigEndian< quint32 >(&buffer[offset + 2]);
+		offset += 6;
+
+		if (length > static_cast< quint32 >(size - offset)) {
+			qWarning("MainWindow: Received truncated state snapshot");
+			return;
+		}
+
+		const char *payload = data.constData() + offset;
+		offset += static_cast< int >(length);
+
+		switch (static_cast< Mumble::Protocol::TCPMessageType >(type)) {
+			case Mumble::Protocol::TCPMessageType::ChannelState: {
+				MumbleProto::ChannelState mpcs;
+				if (!mpcs.ParseFromArray(payload, static_cast< int >(length)))
+					break;
+
+				// The enter states are only part of the snapshot itself. Setting them once per channel is enough.
+				if (mpcs.has_name()) {
+					mpcs.set_is_enter_restricted(enterRestricted.contains(mpcs.channel_id()));
+					mpcs.set_can_enter(!denied.contains(mpcs.channel_id()));
+				}
+
+				msgChannelState(mpcs);
+				break;
+			}
+			case Mumble::Protocol::TCPMessageType::UserState: {
+				MumbleProto::UserState mpus;
+				if (mpus.ParseFromArray(payload, static_cast< int >(length)))
+					msgUserState(mpus);
+				break;
+			}
+			default:
+				qWarning("MainWindow: Ignoring unexpected message of type %d in state snapshot", type);
+				break;
+		}
+	}
+}
+
 #undef ACTOR_INIT
 #undef VICTIM_INIT
 #undef SELF_INIT
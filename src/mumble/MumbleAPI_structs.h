@@ -26,6 +26,12 @@
 
 #include "MumblePlugin.h"
 
+#undef EXTERNAL_MUMBLE_PLUGIN_MUMBLE_API_
+#undef MUMBLE_PLUGIN_API_MINOR_MACRO
+#define MUMBLE_PLUGIN_API_MINOR_MACRO 2
+
+#include "MumblePlugin.h"
+
 #undef MUMBLE_PLUGIN_NO_DEFAULT_FUNCTION_DEFINITIONS
 
 #endif // EXTERNAL_MUMBLE_PLUGIN_API_STRUCTS_H_
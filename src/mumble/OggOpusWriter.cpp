@@ -0,0 +1,148 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "OggOpusWriter.h"
+
+#include <opus.h>
+
+#include <algorithm>
+#include <array>
+
+namespace {
+/// The largest packet the encoder is allowed to produce (see opus_encode_float())
+constexpr int MAX_PACKET_SIZE = 4000;
+} // namespace
+
+OggOpusWriter::OggOpusWriter(QIODevice &device, unsigned int sampleRate, unsigned int channels, const QString &title)
+	: m_stream(device), m_channels(channels), m_packetFrames(sampleRate / 50) {
+	if (sampleRate == 0 || 48000 % sampleRate != 0 || channels == 0 || channels > 2) {
+		return;
+	}
+
+	int error = OPUS_OK;
+	m_encoder = opus_encoder_create(static_cast< opus_int32 >(sampleRate), static_cast< int >(channels),
+									OPUS_APPLICATION_AUDIO, &error);
+	if (error != OPUS_OK || !m_encoder) {
+		m_encoder = nullptr;
+		return;
+	}
+
+	opus_encoder_ctl(m_encoder, OPUS_SET_BITRATE(BITRATE_PER_CHANNEL * static_cast< int >(channels)));
+
+	opus_int32 lookahead = 0;
+	opus_encoder_ctl(m_encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+	m_preSkip = static_cast< unsigned int >(lookahead) * (48000 / sampleRate);
+
+	m_pending.resize(m_packetFrames * channels);
+
+	QList< QByteArray > comments;
+	if (!title.isEmpty()) {
+		comments << QByteArrayLiteral("TITLE=") + title.toUtf8();
+	}
+
+	m_valid = m_stream.writeHeaders(channels, m_preSkip, sampleRate,
+									QByteArrayLiteral("Mumble ") + opus_get_version_string(), comments);
+}
+
+OggOpusWriter::~OggOpusWriter() {
+	finish();
+
+	if (m_encoder) {
+		opus_encoder_destroy(m_encoder);
+	}
+}
+
+bool OggOpusWriter::isValid() const {
+	return m_valid;
+}
+
+bool OggOpusWriter::write(const float *samples, std::size_t frames) {
+	if (!m_valid || m_finished) {
+		return false;
+	}
+
+	m_written += frames * PACKET_FRAMES_48K / m_packetFrames;
+
+	while (frames > 0) {
+		const std::size_t count = std::min(frames, static_cast< std::size_t >(m_packetFrames) - m_pendingFrames);
+		if (m_pendingFrames == 0 && count == m_packetFrames) {
+			// A whole packet, which can be encoded right away
+			if (!encodeFrame(samples)) {
+				return false;
+			}
+		} else {
+			std::copy(samples, samples + count * m_channels,
+					  m_pending.begin() + static_cast< std::ptrdiff_t >(m_pendingFrames * m_channels));
+			m_pendingFrames += count;
+
+			if (m_pendingFrames == m_packetFrames) {
+				m_pendingFrames = 0;
+				if (!encodeFrame(m_pending.data())) {
+					return false;
+				}
+			}
+		}
+
+		samples += count * m_channels;
+		frames -= count;
+	}
+
+	return true;
+}
+
+bool OggOpusWriter::finish() {
+	if (!m_valid || m_finished) {
+		return m_valid;
+	}
+	m_finished = true;
+
+	// The decoder only outputs the last frames once it has got the lookahead after them as well
+	std::fill(m_pending.begin() + static_cast< std::ptrdiff_t >(m_pendingFrames * m_channels), m_pending.end(), 0.0f);
+	m_pendingFrames = 0;
+	while (m_encoded < m_written + m_preSkip) {
+		if (!encodeFrame(m_pending.data())) {
+			return false;
+		}
+		std::fill(m_pending.begin(), m_pending.end(), 0.0f);
+	}
+
+	return flushPage(true);
+}
+
+bool OggOpusWriter::encodeFrame(const float *samples) {
+	std::array< unsigned char, MAX_PACKET_SIZE > packet;
+	const opus_int32 size =
+		opus_encode_float(m_encoder, samples, static_cast< int >(m_packetFrames), packet.data(), MAX_PACKET_SIZE);
+	if (size < 0) {
+		m_valid = false;
+		return false;
+	}
+
+	if (!m_stream.fits(static_cast< std::size_t >(size)) && !flushPage(false)) {
+		return false;
+	}
+
+	m_stream.addPacket(packet.data(), static_cast< std::size_t >(size));
+	m_encoded += PACKET_FRAMES_48K;
+
+	// The padding is left to the last page, as only that one may end before its packets do
+	return m_finished || m_stream.pagePackets() < PACKETS_PER_PAGE || flushPage(false);
+}
+
+bool OggOpusWriter::flushPage(bool last) {
+	// The position of a page is that of the end of its last packet (including the frames to skip), which for the last
+	// page leaves out the padding
+	std::uint64_t granule = m_encoded;
+	if (last) {
+		granule = m_written + m_preSkip;
+	}
+
+	if (!m_stream.writePage(granule, last)) {
+		m_valid = false;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,80 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_OGGOPUSWRITER_H_
+#define MUMBLE_MUMBLE_OGGOPUSWRITER_H_
+
+#include "OggOpusStream.h"
+
+#include <QtCore/QString>
+
+#include <cstdint>
+#include <vector>
+
+class QIODevice;
+struct OpusEncoder;
+
+/// Encodes a stream of float samples with Opus and writes it to an Ogg Opus file (RFC 7845) as it goes, so that only
+/// the current page is held in memory.
+///
+/// The pages are flushed once they hold a second of audio, which keeps the file seekable without writing to the
+/// device for every packet.
+class OggOpusWriter {
+public:
+	/// The bitrate of every channel, which is plenty for speech
+	static constexpr int BITRATE_PER_CHANNEL = 48000;
+
+	/// @param device The device to write to, which has to be open and outlive the writer
+	/// @param sampleRate The rate of the samples, which has to be one Opus supports (8, 12, 16, 24 or 48 kHz)
+	/// @param title The title stored in the file's comments, none if empty
+	OggOpusWriter(QIODevice &device, unsigned int sampleRate, unsigned int channels, const QString &title);
+	/// Finishes the stream, unless that has happened already
+	~OggOpusWriter();
+
+	/// @returns Whether the writer has been set up and no write has failed so far
+	bool isValid() const;
+
+	/// Encodes the given (interleaved) frames. Whatever doesn't fill a whole Opus frame is kept for the next call.
+	///
+	/// @returns Whether the pages that have been completed could be written
+	bool write(const float *samples, std::size_t frames);
+
+	/// Pads the remaining frames with silence, encodes them and writes the last page, whose position trims the
+	/// padding again
+	///
+	/// @returns Whether all of the pages have been written
+	bool finish();
+
+private:
+	Q_DISABLE_COPY(OggOpusWriter)
+
+	/// The number of frames the packets span at 48 kHz, which is 20 ms (what granule positions count in)
+	static constexpr unsigned int PACKET_FRAMES_48K = 960;
+	/// The number of packets after which a page is flushed
+	static constexpr unsigned int PACKETS_PER_PAGE = 50;
+
+	bool encodeFrame(const float *samples);
+	bool flushPage(bool last);
+
+	OggOpusStream m_stream;
+	OpusEncoder *m_encoder = nullptr;
+	const unsigned int m_channels;
+	/// The number of frames a packet spans at the rate of the samples
+	const unsigned int m_packetFrames;
+	/// The number of frames (at 48 kHz) the decoder has to discard at the start (the encoder's lookahead)
+	unsigned int m_preSkip = 0;
+	bool m_valid           = false;
+	bool m_finished        = false;
+
+	/// The frames that don't fill a packet yet
+	std::vector< float > m_pending;
+	std::size_t m_pendingFrames = 0;
+
+	/// The number of frames that have been written and the ones that have been encoded, both at 48 kHz
+	std::uint64_t m_written = 0;
+	std::uint64_t m_encoded = 0;
+};
+
+#endif // MUMBLE_MUMBLE_OGGOPUSWRITER_H_
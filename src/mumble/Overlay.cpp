@@ -291,6 +291,11 @@ void Overlay::disconnected() {
 		if (oc->qlsSocket == qls) {
 			qlClients.removeAll(oc);
 			delete oc;
+
+			// Don't hold on to the pixmaps while no game is showing them
+			if (qlClients.isEmpty()) {
+				m_assetCache.clear();
+			}
 			return;
 		}
 	}
@@ -304,6 +309,10 @@ bool Overlay::isActive() const {
 	return !qlClients.isEmpty();
 }
 
+OverlayAssetCache &Overlay::assetCache() {
+	return m_assetCache;
+}
+
 void Overlay::toggleShow() {
 	if (Global::get().ocIntercept) {
 		Global::get().ocIntercept->hideGui();
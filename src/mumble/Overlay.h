@@ -13,6 +13,7 @@
 
 #include "../../overlay/overlay.h"
 #include "ConfigDialog.h"
+#include "OverlayAssetCache.h"
 #include "OverlayText.h"
 
 #include <atomic>
@@ -103,6 +104,8 @@ protected:
 	QMap< QString, QString > qmOverlayHash;
 	QLocalServer *qlsServer;
 	QList< OverlayClient * > qlClients;
+	/// The pixmaps shared by the scenes of all clients
+	OverlayAssetCache m_assetCache;
 protected slots:
 	void disconnected();
 	void error(QLocalSocket::LocalSocketError);
@@ -114,6 +117,7 @@ public:
 	bool isActive() const;
 	void verifyTexture(ClientUser *cp, bool allowupdate = true);
 	void requestTexture(ClientUser *);
+	OverlayAssetCache &assetCache();
 
 public slots:
 	void updateOverlay();
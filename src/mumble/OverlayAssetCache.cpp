@@ -0,0 +1,114 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "OverlayAssetCache.h"
+
+#include <QtCore/QBuffer>
+#include <QtGui/QImageReader>
+
+#include <algorithm>
+
+constexpr int OverlayAssetCache::SIZE_STEP;
+constexpr int OverlayAssetCache::MAX_COST;
+
+bool OverlayAssetCache::Key::operator==(const Key &other) const {
+	return kind == other.kind && size == other.size && id == other.id && style == other.style;
+}
+
+uint qHash(const OverlayAssetCache::Key &key, uint seed) {
+	seed = qHash(static_cast< int >(key.kind), seed);
+	seed = qHash(key.id, seed) ^ qHash(key.style, seed);
+	return qHash(key.size.width(), seed) ^ (qHash(key.size.height(), seed) << 1);
+}
+
+OverlayAssetCache::OverlayAssetCache() : m_pixmaps(MAX_COST) {
+}
+
+QSize OverlayAssetCache::bucket(const QSize &size) {
+	auto round = [](int value) { return std::max(SIZE_STEP, (value + SIZE_STEP / 2) / SIZE_STEP * SIZE_STEP); };
+
+	return QSize(round(size.width()), round(size.height()));
+}
+
+QPixmap OverlayAssetCache::avatar(const QByteArray &textureHash, const QByteArray &texture, const QByteArray &format,
+								  const QSize &size) {
+	if (textureHash.isEmpty() || texture.isEmpty() || size.isEmpty()) {
+		return QPixmap();
+	}
+
+	const Key key = { Kind::Avatar, QString::fromLatin1(textureHash.toHex()), QString(), bucket(size) };
+	if (const BasepointPixmap *pm = m_pixmaps.object(key)) {
+		return *pm;
+	}
+
+	QBuffer qb;
+	qb.setData(texture);
+	qb.open(QIODevice::ReadOnly);
+
+	QImageReader qir(&qb, format);
+	QSize sz = qir.size();
+	sz.scale(key.size, Qt::KeepAspectRatio);
+	qir.setScaledSize(sz);
+
+	const BasepointPixmap pm(QPixmap::fromImage(qir.read()));
+	insert(key, pm);
+	return pm;
+}
+
+QPixmap OverlayAssetCache::image(const QString &path, const QSize &size) {
+	if (size.isEmpty()) {
+		return QPixmap();
+	}
+
+	const Key key = { Kind::Image, path, QString(), bucket(size) };
+	if (const BasepointPixmap *pm = m_pixmaps.object(key)) {
+		return *pm;
+	}
+
+	QImageReader qir(path);
+	QSize sz = qir.size();
+	sz.scale(key.size, Qt::KeepAspectRatio);
+	qir.setScaledSize(sz);
+
+	const BasepointPixmap pm(QPixmap::fromImage(qir.read()));
+	insert(key, pm);
+	return pm;
+}
+
+BasepointPixmap OverlayAssetCache::text(const QString &text, const QFont &font, const QSize &size,
+										const QColor &color) {
+	if (text.isEmpty() || size.isEmpty()) {
+		return BasepointPixmap();
+	}
+
+	const Key key = { Kind::Text, text, font.key() + QLatin1Char('/') + color.name(QColor::HexArgb), bucket(size) };
+	if (const BasepointPixmap *pm = m_pixmaps.object(key)) {
+		return *pm;
+	}
+
+	OverlayTextLine line(text, font);
+	const BasepointPixmap pm = line.createPixmap(static_cast< unsigned int >(key.size.width()),
+												 static_cast< unsigned int >(key.size.height()), color);
+	insert(key, pm);
+	return pm;
+}
+
+void OverlayAssetCache::clear() {
+	m_pixmaps.clear();
+}
+
+int OverlayAssetCache::size() const {
+	return m_pixmaps.size();
+}
+
+void OverlayAssetCache::insert(const Key &key, const BasepointPixmap &pm) {
+	if (pm.isNull()) {
+		return;
+	}
+
+	// The cost is the size of the pixmap in KiB
+	const int cost = std::max(1, pm.width() * pm.height() * 4 / 1024);
+	m_pixmaps.insert(key, new BasepointPixmap(pm), cost);
+}
@@ -0,0 +1,80 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_OVERLAYASSETCACHE_H_
+#define MUMBLE_MUMBLE_OVERLAYASSETCACHE_H_
+
+#include "OverlayText.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtGui/QColor>
+#include <QtGui/QFont>
+#include <QtGui/QPixmap>
+
+/// A cache of the pixmaps the overlay users are made of: avatars, skin icons and text lines.
+///
+/// Every overlay client (one per hooked game) builds its own scene and rebuilds it whenever the settings or its size
+/// change. Without the cache, each of them decoded the same avatars and laid out the same names over and over again.
+/// The cache is shared by all clients and keys avatars by the hash of their texture, so that a user's avatar is
+/// decoded once per size no matter how many clients show it.
+///
+/// Sizes are rounded to multiples of SIZE_STEP, so that clients whose games run at slightly different resolutions
+/// share their pixmaps, too. The least recently used pixmaps are dropped once the cache holds more than MAX_COST.
+class OverlayAssetCache {
+public:
+	/// The granularity of the sizes the pixmaps are rendered at (in pixels)
+	static constexpr int SIZE_STEP = 4;
+	/// The amount of pixmap memory the cache may hold (in KiB)
+	static constexpr int MAX_COST = 32 * 1024;
+
+	OverlayAssetCache();
+
+	/// @returns The given size with each dimension rounded to a multiple of SIZE_STEP (but at least SIZE_STEP)
+	static QSize bucket(const QSize &size);
+
+	/// @param textureHash The hash the texture is identified by (see ClientUser::qbaTextureHash)
+	/// @param texture The encoded texture, which is only decoded if no pixmap for the hash and size is cached
+	/// @param format The format of the texture (see ClientUser::qbaTextureFormat)
+	/// @param size The size the texture is scaled into (keeping its aspect ratio)
+	/// @returns The decoded and scaled texture or a null pixmap if it can't be decoded
+	QPixmap avatar(const QByteArray &textureHash, const QByteArray &texture, const QByteArray &format,
+				   const QSize &size);
+	/// @returns The image at the given path (e.g. a skin's SVG file) scaled into the given size, keeping its
+	/// 	aspect ratio
+	QPixmap image(const QString &path, const QSize &size);
+	/// @returns The given text rendered to fit into the given size (see OverlayTextLine::createPixmap)
+	BasepointPixmap text(const QString &text, const QFont &font, const QSize &size, const QColor &color);
+
+	/// Drops all pixmaps
+	void clear();
+
+	/// @returns The number of pixmaps in the cache
+	int size() const;
+
+protected:
+	enum class Kind { Avatar, Image, Text };
+
+	struct Key {
+		Kind kind;
+		/// The texture hash, the path or the text
+		QString id;
+		/// The font and the color of a text
+		QString style;
+		QSize size;
+
+		bool operator==(const Key &other) const;
+	};
+	friend uint qHash(const Key &key, uint seed);
+
+	QCache< Key, BasepointPixmap > m_pixmaps;
+
+	/// Caches the given pixmap (unless it is null)
+	void insert(const Key &key, const BasepointPixmap &pm);
+};
+
+#endif // MUMBLE_MUMBLE_OVERLAYASSETCACHE_H_
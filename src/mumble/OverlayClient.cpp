@@ -23,8 +23,11 @@
 #endif
 
 #include <QtGui/QImageReader>
+#include <QtGui/QRegion>
 #include <QtWidgets/QGraphicsProxyWidget>
 
+#include <algorithm>
+
 #ifdef Q_OS_WIN
 #	include <psapi.h>
 #endif
@@ -73,6 +76,9 @@ OverlayClient::OverlayClient(QLocalSocket *socket, QObject *p)
 	iOffsetX = iOffsetY = 0;
 
 	connect(&qgs, SIGNAL(changed(const QList< QRectF > &)), this, SLOT(changed(const QList< QRectF > &)));
+
+	qtRender.setSingleShot(true);
+	connect(&qtRender, SIGNAL(timeout()), this, SLOT(render()));
 }
 
 OverlayClient::~OverlayClient() {
@@ -563,61 +569,111 @@ void OverlayClient::changed(const QList< QRectF > &region) {
 		return;
 
 	qlDirty.append(region);
-	QMetaObject::invokeMethod(this, "render", Qt::QueuedConnection);
+
+	// All changes until the next render are painted together, which happens no more often than the update rate
+	// allows
+	if (!qtRender.isActive()) {
+		const quint64 elapsed = tRender.elapsed() / 1000;
+		const int interval    = renderInterval();
+
+		qtRender.start(elapsed >= static_cast< quint64 >(interval) ? 0 : interval - static_cast< int >(elapsed));
+	}
+}
+
+int OverlayClient::renderInterval() const {
+	unsigned int rate = Global::get().s.os.uiMaxUpdateRate;
+
+	// The game can't show more updates than it renders frames
+	if (framesPerSecond > 0.0f) {
+		const unsigned int fps = std::max(MIN_UPDATE_RATE, static_cast< unsigned int >(framesPerSecond + 0.5f));
+		if (rate == 0 || fps < rate) {
+			rate = fps;
+		}
+	}
+
+	return rate == 0 ? 0 : static_cast< int >(1000 / rate);
+}
+
+QList< QRect > OverlayClient::dirtyRects(const QList< QRectF > &region) const {
+	const QRect bounds(0, 0, iWidth, iHeight);
+
+	// The changes are snapped to tiles, so that many small changes close to each other (e.g. the talking states of the
+	// users in a big channel) make for a few rectangles rather than for lots of tiny ones
+	QRegion damage;
+	foreach (const QRectF &r, region) {
+		const QRect changed = r.toAlignedRect().intersected(bounds);
+		if (changed.isEmpty())
+			continue;
+
+		const QPoint topLeft((changed.left() / DIRTY_TILE_SIZE) * DIRTY_TILE_SIZE,
+							 (changed.top() / DIRTY_TILE_SIZE) * DIRTY_TILE_SIZE);
+		const QPoint bottomRight((changed.right() / DIRTY_TILE_SIZE + 1) * DIRTY_TILE_SIZE - 1,
+								 (changed.bottom() / DIRTY_TILE_SIZE + 1) * DIRTY_TILE_SIZE - 1);
+
+		damage += QRect(topLeft, bottomRight).intersected(bounds);
+	}
+
+	if (damage.isEmpty())
+		return {};
+
+	if (damage.rectCount() > MAX_DIRTY_RECTS)
+		return { damage.boundingRect() };
+
+	QList< QRect > rects;
+	for (const QRect &r : damage) {
+		rects << r;
+	}
+
+	return rects;
 }
 
 void OverlayClient::render() {
 	const QList< QRectF > region = qlDirty;
 	qlDirty.clear();
 
+	tRender.restart();
+
 	if (!iWidth || !iHeight || !smMem)
 		return;
 
 	QRect active;
-	QRectF dirtyf;
-
-	if (region.isEmpty())
-		return;
-
-	foreach (const QRectF &r, region) { dirtyf |= r; }
-
 
-	QRect dirty = dirtyf.toAlignedRect();
-	dirty       = dirty.intersected(QRect(0, 0, iWidth, iHeight));
+	// Changes that are far apart (e.g. a user starting to talk and the clock) are kept apart, so that the game only
+	// has to upload what has actually changed
+	const QList< QRect > dirty = dirtyRects(region);
 
-	if ((dirty.width() <= 0) || (dirty.height() <= 0))
+	if (dirty.isEmpty())
 		return;
 
-	QRect target = dirty;
-	target.moveTo(0, 0);
-
+	// The scene is painted into the shared memory right away, rather than into an image that is copied there
 	QImage img(reinterpret_cast< unsigned char * >(smMem->data()), iWidth, iHeight,
 			   QImage::Format_ARGB32_Premultiplied);
-	QImage qi(target.size(), QImage::Format_ARGB32_Premultiplied);
-	qi.fill(0);
 
 	QPainter p;
-	p.begin(&qi);
-	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-	qgs.render(&p, target, dirty, Qt::IgnoreAspectRatio);
-	p.end();
-
 	p.begin(&img);
 	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_Source);
-	p.drawImage(dirty.x(), dirty.y(), qi);
+
+	foreach (const QRect &r, dirty) {
+		p.setClipRect(r);
+
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		p.fillRect(r, Qt::transparent);
+
+		p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		qgs.render(&p, r, r, Qt::IgnoreAspectRatio);
+	}
+
 	p.end();
 
-	if (dirty.isValid()) {
+	foreach (const QRect &r, dirty) {
 		OverlayMsg om;
 		om.omh.uiMagic = OVERLAY_MAGIC_NUMBER;
 		om.omh.uiType  = OVERLAY_MSGTYPE_BLIT;
 		om.omh.iLength = sizeof(OverlayMsgBlit);
-		om.omb.x       = static_cast< unsigned int >(dirty.x());
-		om.omb.y       = static_cast< unsigned int >(dirty.y());
-		om.omb.w       = static_cast< unsigned int >(dirty.width());
-		om.omb.h       = static_cast< unsigned int >(dirty.height());
+		om.omb.x       = static_cast< unsigned int >(r.x());
+		om.omb.y       = static_cast< unsigned int >(r.y());
+		om.omb.w       = static_cast< unsigned int >(r.width());
+		om.omb.h       = static_cast< unsigned int >(r.height());
 		qlsSocket->write(om.headerbuffer, sizeof(OverlayMsgHeader) + sizeof(OverlayMsgBlit));
 	}
 
@@ -7,6 +7,7 @@
 #define MUMBLE_MUMBLE_OVERLAYCLIENT_H_
 
 #include <QtCore/QScopedPointer>
+#include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtNetwork/QLocalSocket>
 
@@ -66,6 +67,21 @@ protected:
 	void readyReadMsgInit(unsigned int length);
 
 	QList< QRectF > qlDirty;
+	/// The number of separate rectangles render() updates at most. More are merged into their bounding rectangle.
+	static constexpr int MAX_DIRTY_RECTS = 8;
+	/// The size of the tiles (in pixels) the changed areas are snapped to
+	static constexpr int DIRTY_TILE_SIZE = 32;
+	/// The update rate (per second) the game's frame rate doesn't lower the overlay's below
+	static constexpr unsigned int MIN_UPDATE_RATE = 10;
+	/// Fires when the changes in qlDirty are to be rendered
+	QTimer qtRender;
+	/// When render() has been called last
+	Timer tRender;
+	/// @returns The given changed areas as tile-aligned rectangles within the overlay
+	QList< QRect > dirtyRects(const QList< QRectF > &region) const;
+	/// @returns The time (in milliseconds) between two renders, which follows the configured update rate and the
+	/// 	game's frame rate (see OVERLAY_MSGTYPE_FPS)
+	int renderInterval() const;
 protected slots:
 	void readyRead();
 	void changed(const QList< QRectF > &);
@@ -10,15 +10,13 @@
 #include "Database.h"
 #include "MainWindow.h"
 #include "NetworkConfig.h"
-#include "OverlayText.h"
+#include "OverlayAssetCache.h"
 #include "ServerHandler.h"
 #include "User.h"
 #include "Utils.h"
 #include "Global.h"
 #include "GlobalShortcut.h"
 
-#include <QtGui/QImageReader>
-
 OverlayUser::OverlayUser(ClientUser *cu, unsigned int height, OverlaySettings *osptr)
 	: OverlayGroup(), os(osptr), uiSize(height), cuUser(cu), tsColor(Settings::Passive) {
 	setup();
@@ -62,10 +60,6 @@ template< typename T > int roundToInt(T value) {
 	return static_cast< int >(value + 0.5f);
 }
 
-template< typename T > unsigned int roundToUInt(T value) {
-	return static_cast< unsigned int >(value + 0.5f);
-}
-
 void OverlayUser::updateLayout() {
 	QPixmap pm;
 
@@ -82,23 +76,12 @@ void OverlayUser::updateLayout() {
 	qgpiAvatar->setPixmap(pm);
 	qgpiChannel->setPixmap(pm);
 
-	{
-		QImageReader qir(QLatin1String("skin:muted_self.svg"));
-		QSize sz = qir.size();
-		sz.scale(roundToInt(os->qrfMutedDeafened.width() * scaleFactor),
-				 roundToInt(os->qrfMutedDeafened.height() * scaleFactor), Qt::KeepAspectRatio);
-		qir.setScaledSize(sz);
-		qgpiMuted->setPixmap(QPixmap::fromImage(qir.read()));
-	}
+	const QSize mutedDeafenedSize(roundToInt(os->qrfMutedDeafened.width() * scaleFactor),
+								  roundToInt(os->qrfMutedDeafened.height() * scaleFactor));
+	OverlayAssetCache &cache = Global::get().o->assetCache();
 
-	{
-		QImageReader qir(QLatin1String("skin:deafened_self.svg"));
-		QSize sz = qir.size();
-		sz.scale(roundToInt(os->qrfMutedDeafened.width() * scaleFactor),
-				 roundToInt(os->qrfMutedDeafened.height() * scaleFactor), Qt::KeepAspectRatio);
-		qir.setScaledSize(sz);
-		qgpiDeafened->setPixmap(QPixmap::fromImage(qir.read()));
-	}
+	qgpiMuted->setPixmap(cache.image(QLatin1String("skin:muted_self.svg"), mutedDeafenedSize));
+	qgpiDeafened->setPixmap(cache.image(QLatin1String("skin:deafened_self.svg"), mutedDeafenedSize));
 
 	qgpiMuted->setPos(alignedPosition(scaledRect(os->qrfMutedDeafened, uiSize * os->fZoom), qgpiMuted->boundingRect(),
 									  os->qaMutedDeafened));
@@ -163,16 +146,16 @@ void OverlayUser::updateLayout() {
 
 void OverlayUser::updateUser() {
 	const double scaleFactor = uiSize * os->fZoom;
+	OverlayAssetCache &cache = Global::get().o->assetCache();
 
 	if (os->bUserName && (qgpiName[0]->pixmap().isNull() || (cuUser && (qsName != cuUser->qsName)))) {
 		if (cuUser)
 			qsName = cuUser->qsName;
 
-		OverlayTextLine tl(qsName, os->qfUserName);
+		const QSize nameSize(roundToInt(os->qrfUserName.width() * scaleFactor),
+							 roundToInt(os->qrfUserName.height() * scaleFactor));
 		for (unsigned int i = 0; i < 4; ++i) {
-			const QPixmap &pm = tl.createPixmap(roundToUInt(os->qrfUserName.width() * scaleFactor),
-												roundToUInt(os->qrfUserName.height() * scaleFactor), os->qcUserName[i]);
-			qgpiName[i]->setPixmap(pm);
+			qgpiName[i]->setPixmap(cache.text(qsName, os->qfUserName, nameSize, os->qcUserName[i]));
 
 			if (i == 0)
 				qgpiName[0]->setPos(alignedPosition(scaledRect(os->qrfUserName, uiSize * os->fZoom),
@@ -186,10 +169,9 @@ void OverlayUser::updateUser() {
 		if (cuUser)
 			qsChannelName = cuUser->cChannel->qsName;
 
-		const QPixmap &pm = OverlayTextLine(qsChannelName, os->qfChannel)
-								.createPixmap(roundToUInt(os->qrfChannel.width() * scaleFactor),
-											  roundToUInt(os->qrfChannel.height() * scaleFactor), os->qcChannel);
-		qgpiChannel->setPixmap(pm);
+		const QSize channelSize(roundToInt(os->qrfChannel.width() * scaleFactor),
+								roundToInt(os->qrfChannel.height() * scaleFactor));
+		qgpiChannel->setPixmap(cache.text(qsChannelName, os->qfChannel, channelSize, os->qcChannel));
 		qgpiChannel->setPos(alignedPosition(scaledRect(os->qrfChannel, uiSize * os->fZoom), qgpiChannel->boundingRect(),
 											os->qaChannel));
 	}
@@ -198,30 +180,19 @@ void OverlayUser::updateUser() {
 		if (cuUser)
 			qbaAvatar = cuUser->qbaTextureHash;
 
-		QImage img;
+		const QSize avatarSize(roundToInt(os->qrfAvatar.width() * scaleFactor),
+							   roundToInt(os->qrfAvatar.height() * scaleFactor));
+		QPixmap pm;
 
 		if (!qbaAvatar.isNull() && cuUser->qbaTexture.isEmpty()) {
 			Global::get().o->requestTexture(cuUser);
 		} else if (qbaAvatar.isNull()) {
-			QImageReader qir(QLatin1String("skin:default_avatar.svg"));
-			QSize sz = qir.size();
-			sz.scale(roundToInt(os->qrfAvatar.width() * scaleFactor), roundToInt(os->qrfAvatar.height() * scaleFactor),
-					 Qt::KeepAspectRatio);
-			qir.setScaledSize(sz);
-			img = qir.read();
+			pm = cache.image(QLatin1String("skin:default_avatar.svg"), avatarSize);
 		} else {
-			QBuffer qb(&cuUser->qbaTexture);
-			qb.open(QIODevice::ReadOnly);
-
-			QImageReader qir(&qb, cuUser->qbaTextureFormat);
-			QSize sz = qir.size();
-			sz.scale(roundToInt(os->qrfAvatar.width() * scaleFactor), roundToInt(os->qrfAvatar.height() * scaleFactor),
-					 Qt::KeepAspectRatio);
-			qir.setScaledSize(sz);
-			img = qir.read();
+			pm = cache.avatar(qbaAvatar, cuUser->qbaTexture, cuUser->qbaTextureFormat, avatarSize);
 		}
 
-		qgpiAvatar->setPixmap(QPixmap::fromImage(img));
+		qgpiAvatar->setPixmap(pm);
 		qgpiAvatar->setPos(
 			alignedPosition(scaledRect(os->qrfAvatar, uiSize * os->fZoom), qgpiAvatar->boundingRect(), os->qaAvatar));
 	}
@@ -5,11 +5,13 @@
 
 #include "PipeWire.h"
 
+#include "AudioLatency.h"
 #include "Global.h"
 
 #include <pipewire/core.h>
 #include <pipewire/keys.h>
 #include <pipewire/stream.h>
+#include <pipewire/version.h>
 
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/builder.h>
@@ -165,6 +167,8 @@ PipeWireSystem::PipeWireSystem() : m_ok(false), m_users(0) {
 	RESOLVE(pw_stream_dequeue_buffer);
 	RESOLVE(pw_stream_queue_buffer);
 
+	pw_stream_get_time_n = reinterpret_cast< decltype(pw_stream_get_time_n) >(m_lib.resolve("pw_stream_get_time_n"));
+
 	qInfo("PipeWire %s from %s", pw_get_library_version(), qPrintable(m_lib.fileName()));
 
 	pw_init(nullptr, nullptr);
@@ -189,9 +193,14 @@ PipeWireEngine::PipeWireEngine(const char *category, void *param, const std::fun
 		return;
 	}
 
+	// The quantum the node asks the graph for, which matches the frames Mumble processes. This way, every cycle of the
+	// graph is a single mix (or input frame) without any buffering in between.
+	const QByteArray latency = QByteArray::number(SAMPLE_RATE / 100) + '/' + QByteArray::number(SAMPLE_RATE);
+
 	pw_properties *props =
 		pws->pw_properties_new(PW_KEY_APP_NAME, "Mumble", PW_KEY_NODE_NAME, category, PW_KEY_MEDIA_CATEGORY, category,
-							   PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_ROLE, "Communication", nullptr);
+							   PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_ROLE, "Communication", PW_KEY_NODE_LATENCY,
+							   latency.constData(), nullptr);
 
 	m_events          = std::make_unique< pw_stream_events >();
 	m_events->version = PW_VERSION_STREAM_EVENTS;
@@ -308,6 +317,14 @@ void PipeWireEngine::queueBuffer(pw_buffer *buffer) {
 	}
 }
 
+bool PipeWireEngine::time(pw_time &time) {
+	if (!m_stream || !pws->pw_stream_get_time_n) {
+		return false;
+	}
+
+	return pws->pw_stream_get_time_n(m_stream, &time, sizeof(time)) == 0;
+}
+
 PipeWireInput::PipeWireInput() {
 	m_engine = std::make_unique< PipeWireEngine >("Capture", this, processCallback);
 	if (!m_engine->isOk()) {
@@ -414,17 +431,38 @@ void PipeWireOutput::processCallback(void *param) {
 	chunk->offset = 0;
 	chunk->stride = static_cast< int >(sizeof(float) * pwo->iChannels);
 
-	const uint32_t frames = std::min(data.maxsize / static_cast< std::uint32_t >(chunk->stride), pwo->iFrameSize);
+	std::uint64_t frames = pwo->iFrameSize;
+#if PW_CHECK_VERSION(0, 3, 49)
+	// The graph asks for as many frames as its quantum, which are mixed right into its (mapped) buffer
+	if (buffer->requested > 0) {
+		frames = buffer->requested;
+	}
+#endif
+	frames = std::min(frames, static_cast< std::uint64_t >(data.maxsize / static_cast< std::uint32_t >(chunk->stride)));
+
+	pwo->setDevicePeriod(static_cast< unsigned int >(frames));
 
-	chunk->size = frames * static_cast< unsigned int >(chunk->stride);
-	if (!pwo->mix(data.data, frames)) {
+	chunk->size = static_cast< std::uint32_t >(frames) * static_cast< std::uint32_t >(chunk->stride);
+	if (!pwo->mix(data.data, static_cast< unsigned int >(frames))) {
 		// When the mixer has no data available to write, we still need to push silence.
 		// This is to avoid an infinite loop when destroying the stream.
 		// In that infinite loop, Pipewire would wait until the stream starts draining.
 		// But this never happens, if we don't push new data.
 		// Thus pw_stream_destroy() would block forever.
-		memset(data.data, 0, sizeof(float) * chunk->size);
+		memset(data.data, 0, chunk->size);
+	}
+
+#if PW_CHECK_VERSION(0, 3, 50)
+	// The mix is played once the graph (and the device) have played what is ahead of it
+	pw_time time{};
+	if (pwo->m_engine->time(time) && time.rate.denom > 0) {
+		const std::int64_t delay =
+			std::max< std::int64_t >(time.delay, 0) * 1000000 * time.rate.num / time.rate.denom;
+		const std::uint64_t queued = time.buffered + frames;
+		AudioLatency::record(AudioLatency::Stage::Playback,
+							 static_cast< quint64 >(delay) + queued * 1000000 / SAMPLE_RATE);
 	}
+#endif
 
 	pwo->m_engine->queueBuffer(buffer);
 }
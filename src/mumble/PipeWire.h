@@ -21,6 +21,7 @@ struct pw_properties;
 struct pw_stream;
 struct pw_stream_events;
 struct pw_thread_loop;
+struct pw_time;
 
 struct spa_dict;
 struct spa_pod;
@@ -36,6 +37,10 @@ public:
 
 	pw_buffer *dequeueBuffer();
 	void queueBuffer(pw_buffer *buffer);
+	/// Queries the timing of the stream (in the processing thread)
+	///
+	/// @returns Whether the time is known, which it isn't if the library is too old (before 0.3.50)
+	bool time(pw_time &time);
 
 	PipeWireEngine(const char *category, void *param, const std::function< void(void *param) > callback);
 	~PipeWireEngine();
@@ -88,6 +93,8 @@ protected:
 							 const spa_pod **params, uint32_t n_params);
 	pw_buffer *(*pw_stream_dequeue_buffer)(pw_stream *stream);
 	int (*pw_stream_queue_buffer)(pw_stream *stream, pw_buffer *buffer);
+	/// Optional, nullptr if the library doesn't provide it
+	int (*pw_stream_get_time_n)(pw_stream *stream, pw_time *time, size_t size);
 
 private:
 	Q_OBJECT
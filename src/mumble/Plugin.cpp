@@ -28,12 +28,13 @@ void assertPluginLoaded(const Plugin *plugin) {
 	}
 }
 
-Plugin::Plugin(QString path, bool isBuiltIn, QObject *p)
+Plugin::Plugin(QString path, bool isBuiltIn, QObject *p, bool loadLibrary)
 	: QObject(p), m_lib(path), m_pluginPath(path), m_pluginIsLoaded(false), m_pluginLock(QReadWriteLock::NonRecursive),
 	  m_pluginFnc(), m_isBuiltIn(isBuiltIn), m_positionalDataIsEnabled(true), m_positionalDataIsActive(false),
 	  m_mayMonitorKeyboard(false) {
-	// See if the plugin is loadable in the first place unless it is a built-in plugin
-	m_pluginIsValid = isBuiltIn || m_lib.load();
+	// See if the plugin is loadable in the first place unless it is a built-in plugin (or its library isn't to be
+	// loaded yet)
+	m_pluginIsValid = isBuiltIn || !loadLibrary || m_lib.load();
 
 	if (!m_pluginIsValid) {
 		// throw an exception to indicate that the plugin isn't valid
@@ -329,6 +330,9 @@ mumble_error_t Plugin::init() {
 	} else if (apiVersion >= mumble_version_t({ 1, 2, 0 }) && apiVersion < mumble_version_t({ 1, 3, 0 })) {
 		MumbleAPI_v_1_2_x api = API::getMumbleAPI_v_1_2_x();
 		registerAPIFunctions(&api);
+	} else if (apiVersion >= mumble_version_t({ 1, 3, 0 }) && apiVersion < mumble_version_t({ 1, 4, 0 })) {
+		MumbleAPI_v_1_3_x api = API::getMumbleAPI_v_1_3_x();
+		registerAPIFunctions(&api);
 	} else {
 		// The API version could not be obtained -> this is an invalid plugin that shouldn't have been loaded in the
 		// first place
@@ -456,6 +460,22 @@ uint32_t Plugin::getFeatures() const {
 	}
 }
 
+uint32_t Plugin::getAudioCallbacks() const {
+	uint32_t callbacks = 0;
+
+	if (m_pluginFnc.onAudioInput) {
+		callbacks |= AUDIO_INPUT_CALLBACK;
+	}
+	if (m_pluginFnc.onAudioSourceFetched) {
+		callbacks |= AUDIO_SOURCE_FETCHED_CALLBACK;
+	}
+	if (m_pluginFnc.onAudioOutputAboutToPlay) {
+		callbacks |= AUDIO_OUTPUT_ABOUT_TO_PLAY_CALLBACK;
+	}
+
+	return callbacks;
+}
+
 uint32_t Plugin::deactivateFeatures(uint32_t features) const {
 	assertPluginLoaded(this);
 
@@ -135,7 +135,9 @@ protected:
 	/// @param isBuiltIn A flag indicating that this is a plugin built into Mumble itself and is does not backed by a
 	/// shared library
 	/// @param p A pointer to a QObject representing the parent of this object or nullptr if there is no parent
-	Plugin(QString path, bool isBuiltIn = false, QObject *p = nullptr);
+	/// @param loadLibrary Whether to load the shared library right away. If not, the plugin has to be replaced by one
+	/// that has loaded it before it can be used (see CachedPlugin)
+	Plugin(QString path, bool isBuiltIn = false, QObject *p = nullptr, bool loadLibrary = true);
 
 	/// A flag indicating whether this plugin is valid. It is mainly used throughout the plugin's initialization.
 	bool m_pluginIsValid;
@@ -432,6 +434,14 @@ public:
 	/// @returns The plugin's features or'ed together (See the PluginFeature enum in MumblePlugin.h for what features
 	/// are available)
 	virtual uint32_t getFeatures() const;
+	/// The audio callbacks a plugin may implement. They are meant to be or'ed together.
+	enum AudioCallback : uint32_t {
+		AUDIO_INPUT_CALLBACK                = 1 << 0,
+		AUDIO_SOURCE_FETCHED_CALLBACK       = 1 << 1,
+		AUDIO_OUTPUT_ABOUT_TO_PLAY_CALLBACK = 1 << 2,
+	};
+	/// @returns The audio callbacks (see AudioCallback) this plugin implements or'ed together
+	virtual uint32_t getAudioCallbacks() const;
 	/// @return Whether the plugin has found a new/updated version of itself available for download
 	virtual bool hasUpdate() const;
 	/// @return The URL to download the updated plugin. May be empty
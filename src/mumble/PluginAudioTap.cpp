@@ -0,0 +1,103 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PluginAudioTap.h"
+
+PluginAudioTap::PluginAudioTap(plugin_ptr_t plugin) : m_plugin(std::move(plugin)), m_stop(false) {
+}
+
+PluginAudioTap::~PluginAudioTap() {
+	stop();
+}
+
+void PluginAudioTap::stop() {
+	m_stop = true;
+	wait();
+}
+
+void PluginAudioTap::addInput(const short *inputPCM, unsigned int sampleCount, unsigned int channelCount,
+							  unsigned int sampleRate, bool isSpeech) {
+	AudioBlockRing::Block header;
+	header.source       = AudioBlockRing::Source::Input;
+	header.sampleCount  = sampleCount;
+	header.channelCount = static_cast< std::uint16_t >(channelCount);
+	header.sampleRate   = sampleRate;
+	header.isSpeech     = isSpeech;
+
+	m_input.push(header, inputPCM, sampleCount * channelCount * sizeof(short));
+}
+
+void PluginAudioTap::addSourceFetched(const float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
+									  unsigned int sampleRate, bool isSpeech, unsigned int userID) {
+	AudioBlockRing::Block header;
+	header.source       = AudioBlockRing::Source::SourceFetched;
+	header.sampleCount  = sampleCount;
+	header.channelCount = static_cast< std::uint16_t >(channelCount);
+	header.sampleRate   = sampleRate;
+	header.isSpeech     = isSpeech;
+	header.userID       = userID;
+
+	m_output.push(header, outputPCM, sampleCount * channelCount * sizeof(float));
+}
+
+void PluginAudioTap::addOutputAboutToPlay(const float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
+										  unsigned int sampleRate) {
+	AudioBlockRing::Block header;
+	header.source       = AudioBlockRing::Source::OutputAboutToPlay;
+	header.sampleCount  = sampleCount;
+	header.channelCount = static_cast< std::uint16_t >(channelCount);
+	header.sampleRate   = sampleRate;
+
+	m_output.push(header, outputPCM, sampleCount * channelCount * sizeof(float));
+}
+
+const plugin_ptr_t &PluginAudioTap::plugin() const {
+	return m_plugin;
+}
+
+void PluginAudioTap::run() {
+	while (!m_stop) {
+		// Both rings are emptied on every pass, so neither can starve the other
+		const bool deliveredInput  = deliver(m_input);
+		const bool deliveredOutput = deliver(m_output);
+
+		if (!deliveredInput && !deliveredOutput) {
+			QThread::msleep(IDLE_INTERVAL);
+		}
+	}
+}
+
+bool PluginAudioTap::deliver(AudioBlockRing &ring) {
+	bool delivered = false;
+
+	while (AudioBlockRing::Block *block = ring.front()) {
+		if (m_stop) {
+			break;
+		}
+
+		if (m_plugin->isLoaded()) {
+			switch (block->source) {
+				case AudioBlockRing::Source::Input:
+					m_plugin->onAudioInput(reinterpret_cast< short * >(block->data.get()), block->sampleCount,
+										   block->channelCount, block->sampleRate, block->isSpeech);
+					break;
+				case AudioBlockRing::Source::SourceFetched:
+					m_plugin->onAudioSourceFetched(reinterpret_cast< float * >(block->data.get()), block->sampleCount,
+												   block->channelCount, block->sampleRate, block->isSpeech,
+												   block->userID);
+					break;
+				case AudioBlockRing::Source::OutputAboutToPlay:
+					m_plugin->onAudioOutputAboutToPlay(reinterpret_cast< float * >(block->data.get()),
+													   block->sampleCount, block->channelCount, block->sampleRate);
+					break;
+			}
+		}
+
+		ring.pop();
+		delivered = true;
+	}
+
+	return delivered;
+}
@@ -0,0 +1,58 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_PLUGINAUDIOTAP_H_
+#define MUMBLE_MUMBLE_PLUGINAUDIOTAP_H_
+
+#include "AudioBlockRing.h"
+#include "Plugin.h"
+
+#include <QtCore/QThread>
+
+#include <atomic>
+
+/// A thread that calls the audio callbacks of a plugin that only inspects the audio (MUMBLE_FEATURE_AUDIO_ANALYSIS).
+///
+/// The audio threads merely copy their buffers into the tap's rings, which never blocks them. The input thread and the
+/// output thread have a ring each, as every ring must only be filled by a single thread.
+class PluginAudioTap : public QThread {
+public:
+	/// How long the thread sleeps when there is no audio (in milliseconds)
+	static constexpr unsigned long IDLE_INTERVAL = 5;
+
+	explicit PluginAudioTap(plugin_ptr_t plugin);
+	/// Stops the thread
+	~PluginAudioTap() override;
+
+	/// Makes the thread stop and waits for it. The plugin's callbacks aren't called anymore once this returns.
+	void stop();
+
+	/// Queues the input audio. Must only be called by the audio input thread.
+	void addInput(const short *inputPCM, unsigned int sampleCount, unsigned int channelCount, unsigned int sampleRate,
+				  bool isSpeech);
+	/// Queues a fetched audio source. Must only be called by the audio output thread.
+	void addSourceFetched(const float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
+						  unsigned int sampleRate, bool isSpeech, unsigned int userID);
+	/// Queues the mixed output audio. Must only be called by the audio output thread.
+	void addOutputAboutToPlay(const float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
+							  unsigned int sampleRate);
+
+	/// @returns The plugin the audio is handed to
+	const plugin_ptr_t &plugin() const;
+
+protected:
+	plugin_ptr_t m_plugin;
+	AudioBlockRing m_input;
+	AudioBlockRing m_output;
+	std::atomic_bool m_stop;
+
+	void run() override;
+	/// Hands all blocks in the given ring to the plugin
+	///
+	/// @returns Whether there were any blocks
+	bool deliver(AudioBlockRing &ring);
+};
+
+#endif // MUMBLE_MUMBLE_PLUGINAUDIOTAP_H_
@@ -0,0 +1,81 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PluginDataBatcher.h"
+#include "Connection.h"
+#include "MumbleConstants.h"
+#include "ProtoUtils.h"
+
+#include <utility>
+
+PluginDataBatcher::PluginDataBatcher(Sender sender, QObject *parent) : QObject(parent), m_sender(std::move(sender)) {
+	m_timer.setSingleShot(true);
+	m_timer.setInterval(BATCH_WINDOW);
+	connect(&m_timer, &QTimer::timeout, this, &PluginDataBatcher::flush);
+}
+
+void PluginDataBatcher::setEnabled(bool enabled) {
+	if (!enabled) {
+		flush();
+	}
+
+	m_enabled = enabled;
+}
+
+bool PluginDataBatcher::isEnabled() const {
+	return m_enabled;
+}
+
+void PluginDataBatcher::send(const MumbleProto::PluginDataTransmission &msg) {
+	if (!m_enabled) {
+		m_sender(msg, Mumble::Protocol::TCPMessageType::PluginDataTransmission);
+		return;
+	}
+
+	QByteArray frame;
+	Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::PluginDataTransmission, frame);
+
+	// A batch mustn't exceed the limits the receivers check it against
+	if (m_pendingCount >= Mumble::Plugins::PluginMessage::MAX_BATCH_LENGTH
+		|| m_frames.size() + frame.size() > Mumble::Plugins::PluginMessage::MAX_BATCH_SIZE) {
+		flush();
+	}
+
+	if (m_pendingCount == 0) {
+		m_first = msg;
+		m_timer.start();
+	}
+
+	m_frames.append(frame);
+	m_pendingCount++;
+}
+
+void PluginDataBatcher::flush() {
+	m_timer.stop();
+
+	if (m_pendingCount == 1) {
+		// A batch of a single message would only be larger than the message itself
+		m_sender(m_first, Mumble::Protocol::TCPMessageType::PluginDataTransmission);
+	} else if (m_pendingCount > 1) {
+		MumbleProto::PluginDataBatch mpdb;
+		MumbleProto::setPluginDataBatchData(mpdb, m_frames);
+
+		m_sender(mpdb, Mumble::Protocol::TCPMessageType::PluginDataBatch);
+	}
+
+	clear();
+}
+
+void PluginDataBatcher::clear() {
+	m_timer.stop();
+
+	m_frames.clear();
+	m_first.Clear();
+	m_pendingCount = 0;
+}
+
+int PluginDataBatcher::pendingCount() const {
+	return m_pendingCount;
+}
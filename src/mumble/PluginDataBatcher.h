@@ -0,0 +1,61 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_PLUGINDATABATCHER_H_
+#define MUMBLE_MUMBLE_PLUGINDATABATCHER_H_
+
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+#include <functional>
+
+/// Collects the messages the plugins send for a short while, so that they are sent to the server as a single
+/// PluginDataBatch. The server's rate limit counts a batch as a single message, which allows plugins that sync their
+/// state with many small messages to do so more often.
+///
+/// The messages are sent as they are if batching is disabled (because the server doesn't support it).
+class PluginDataBatcher : public QObject {
+	Q_OBJECT
+	Q_DISABLE_COPY(PluginDataBatcher)
+
+public:
+	/// For how long messages are collected before they are sent (in milliseconds)
+	static constexpr int BATCH_WINDOW = 10;
+
+	/// The function the messages (and batches) are sent with
+	using Sender = std::function< void(const ::google::protobuf::Message &, Mumble::Protocol::TCPMessageType) >;
+
+	explicit PluginDataBatcher(Sender sender, QObject *parent = nullptr);
+
+	/// Enables or disables batching. Disabling it sends the pending messages.
+	void setEnabled(bool enabled);
+	bool isEnabled() const;
+
+	/// Sends the given message, which is batched with others if batching is enabled
+	void send(const MumbleProto::PluginDataTransmission &msg);
+	/// Sends the pending messages right away
+	void flush();
+	/// Drops the pending messages (e.g. because the connection is gone)
+	void clear();
+
+	/// @returns The number of messages waiting for the batch to be sent
+	int pendingCount() const;
+
+protected:
+	Sender m_sender;
+	QTimer m_timer;
+	bool m_enabled = false;
+	/// The pending messages, framed the way they are contained in a PluginDataBatch
+	QByteArray m_frames;
+	/// The first pending message, which is sent on its own if no other one joins it
+	MumbleProto::PluginDataTransmission m_first;
+	int m_pendingCount = 0;
+};
+
+#endif // MUMBLE_MUMBLE_PLUGINDATABATCHER_H_
@@ -5,6 +5,7 @@
 
 #include <limits>
 
+#include "CachedPlugin.h"
 #include "LegacyPlugin.h"
 #include "PluginManager.h"
 #include <QByteArray>
@@ -32,6 +33,7 @@
 #	include "ManualPlugin.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <memory>
@@ -49,7 +51,8 @@
 PluginManager::PluginManager(QSet< QString > *additionalSearchPaths, QObject *p)
 	: QObject(p), m_pluginCollectionLock(QReadWriteLock::NonRecursive), m_pluginHashMap(), m_positionalData(),
 	  m_positionalDataCheckTimer(), m_sentDataMutex(), m_sentData(),
-	  m_activePosDataPluginLock(QReadWriteLock::NonRecursive), m_activePositionalDataPlugin(), m_updater() {
+	  m_activePosDataPluginLock(QReadWriteLock::NonRecursive), m_activePositionalDataPlugin(), m_updater(),
+	  m_audioCallbacks(std::make_shared< const PluginManager_AudioCallbacks >()) {
 	qRegisterMetaType< mumble_plugin_id_t >("mumble_plugin_id_t");
 
 	std::vector< QString > pluginPaths;
@@ -87,6 +90,8 @@ PluginManager::PluginManager(QSet< QString > *additionalSearchPaths, QObject *p)
 		}
 	}
 
+	m_metadataCache.load(metadataCachePath());
+
 #ifdef Q_OS_WIN
 	// According to MS KB Q131065, we need this to OpenProcess()
 
@@ -134,9 +139,17 @@ PluginManager::PluginManager(QSet< QString > *additionalSearchPaths, QObject *p)
 	QObject::connect(this, &PluginManager::pluginLostLink, this, &PluginManager::reportLostLink);
 	QObject::connect(this, &PluginManager::pluginLinked, this, &PluginManager::reportPluginLinked);
 	QObject::connect(this, &PluginManager::pluginEncounteredPermanentError, this, &PluginManager::reportPermanentError);
+
+	// Fetch the positional data on a thread of its own, so that neither a busy GUI nor the audio threads have to wait
+	// for the plugins
+	m_positionalDataPoller = std::make_unique< PositionalDataPoller >(*this);
+	m_positionalDataPoller->start(QThread::HighPriority);
 }
 
 PluginManager::~PluginManager() {
+	// The poller uses the plugins
+	m_positionalDataPoller.reset();
+
 	clearPlugins();
 
 #ifdef Q_OS_WIN
@@ -271,6 +284,103 @@ bool PluginManager::selectActivePositionalDataPlugin() {
 #define LOG_FOUND_PLUGIN(plugin, path) LOG_FOUND(plugin, path, "")
 #define LOG_FOUND_LEGACY_PLUGIN(plugin, path) LOG_FOUND(plugin, path, "legacy ")
 #define LOG_FOUND_BUILTIN(plugin) LOG_FOUND(plugin, QString::fromLatin1("<builtin>"), "built-in ")
+
+/// @returns The key of the settings of the plugin with the given library
+static QString pluginSettingsKey(const QString &path) {
+	return QLatin1String(QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+/// @returns The metadata of the given plugin, as read from its library
+static PluginMetadata metadataOf(const Plugin &plugin, bool isLegacy) {
+	PluginMetadata metadata;
+	metadata.isPlugin    = true;
+	metadata.isLegacy    = isLegacy;
+	metadata.name        = plugin.getName();
+	metadata.author      = plugin.getAuthor();
+	metadata.description = plugin.getDescription();
+	metadata.version     = plugin.getVersion();
+	metadata.apiVersion  = plugin.getAPIVersion();
+	metadata.features    = plugin.getFeatures();
+
+	return metadata;
+}
+
+plugin_ptr_t PluginManager::createPlugin(const QFileInfo &library, PluginMetadata &metadata) const {
+	const QString path = library.absoluteFilePath();
+
+	try {
+		plugin_ptr_t p(Plugin::createNew< Plugin >(path));
+
+#ifdef MUMBLE_PLUGIN_DEBUG
+		LOG_FOUND_PLUGIN(p, path);
+#endif
+
+		metadata = metadataOf(*p, false);
+		return p;
+	} catch (const PluginError &e) {
+		// If an exception is thrown, this library does not represent a proper plugin
+		// Check if it might be a legacy plugin instead
+		try {
+			legacy_plugin_ptr_t lp(Plugin::createNew< LegacyPlugin >(path));
+
+#ifdef MUMBLE_PLUGIN_DEBUG
+			LOG_FOUND_LEGACY_PLUGIN(lp, path);
+#endif
+
+			metadata = metadataOf(*lp, true);
+			return lp;
+		} catch (const PluginError &el) {
+			Q_UNUSED(el);
+
+			metadata          = PluginMetadata();
+			metadata.isPlugin = false;
+			metadata.error    = QString::fromUtf8(e.what());
+			return nullptr;
+		}
+	}
+}
+
+bool PluginManager::loadLibraryOf(plugin_id_t pluginID) {
+	cached_plugin_ptr_t cached;
+	{
+		QReadLocker lock(&m_pluginCollectionLock);
+
+		cached = std::dynamic_pointer_cast< CachedPlugin >(m_pluginHashMap.value(pluginID));
+	}
+
+	if (!cached) {
+		return true;
+	}
+
+	plugin_ptr_t plugin;
+	try {
+		if (cached->getMetadata().isLegacy) {
+			plugin.reset(Plugin::createNew< LegacyPlugin >(cached->getFilePath()));
+		} else {
+			plugin.reset(Plugin::createNew< Plugin >(cached->getFilePath()));
+		}
+	} catch (const PluginError &e) {
+		Log::logOrDefer(Log::Warning, tr("Failed at loading plugin library \"%1\" (%2)")
+										  .arg(cached->getFilePath())
+										  .arg(QString::fromUtf8(e.what())));
+		return false;
+	}
+
+	// The plugin takes the place of the cached one, so it is still found under the same ID
+	plugin->m_pluginID = pluginID;
+	plugin->enablePositionalData(cached->isPositionalDataEnabled());
+	plugin->allowKeyboardMonitoring(cached->isKeyboardMonitoringAllowed());
+
+	QWriteLocker lock(&m_pluginCollectionLock);
+	m_pluginHashMap.insert(pluginID, plugin);
+
+	return true;
+}
+
+QString PluginManager::metadataCachePath() {
+	return Global::get().qdBasePath.absoluteFilePath(QLatin1String("plugins.dat"));
+}
+
 void PluginManager::rescanPlugins() {
 	clearPlugins();
 
@@ -289,39 +399,45 @@ void PluginManager::rescanPlugins() {
 					continue;
 				}
 
-				try {
-					plugin_ptr_t p(Plugin::createNew< Plugin >(currentInfo.absoluteFilePath()));
-
-#ifdef MUMBLE_PLUGIN_DEBUG
-					LOG_FOUND_PLUGIN(p, currentInfo.absoluteFilePath());
-#endif
+				// The libraries of the plugins that aren't enabled are only loaded if nothing is known about them yet
+				// (and only for as long as it takes to read their metadata)
+				const bool enabled =
+					Global::get().s.qhPluginSettings.value(pluginSettingsKey(currentInfo.absoluteFilePath())).enabled;
+
+				PluginMetadata metadata;
+				plugin_ptr_t p;
+				const PluginMetadata *cached = m_metadataCache.lookup(currentInfo);
+				if (cached && !enabled) {
+					metadata = *cached;
+				} else {
+					p = createPlugin(currentInfo, metadata);
+					if (!cached) {
+						m_metadataCache.insert(currentInfo, metadata);
+					}
+				}
 
-					// if this code block is reached, the plugin was instantiated successfully so we can add it to the
-					// map
-					m_pluginHashMap.insert(p->getID(), p);
-				} catch (const PluginError &e) {
-					// If an exception is thrown, this library does not represent a proper plugin
-					// Check if it might be a legacy plugin instead
-					try {
-						legacy_plugin_ptr_t lp(Plugin::createNew< LegacyPlugin >(currentInfo.absoluteFilePath()));
+				if (!metadata.isPlugin) {
+					// At the time this function is running the MainWindow is not necessarily created yet, so we
+					// can't use the normal Log::log function
+					Log::logOrDefer(Log::Warning, tr("Non-plugin found in plugin directory: \"%1\" (%2)")
+													  .arg(currentInfo.absoluteFilePath())
+													  .arg(metadata.error));
+					continue;
+				}
 
-#ifdef MUMBLE_PLUGIN_DEBUG
-						LOG_FOUND_LEGACY_PLUGIN(lp, currentInfo.absoluteFilePath());
-#endif
-						m_pluginHashMap.insert(lp->getID(), lp);
-					} catch (const PluginError &el) {
-						Q_UNUSED(el);
-
-						// At the time this function is running the MainWindow is not necessarily created yet, so we
-						// can't use the normal Log::log function
-						Log::logOrDefer(Log::Warning, tr("Non-plugin found in plugin directory: \"%1\" (%2)")
-														  .arg(currentInfo.absoluteFilePath())
-														  .arg(QString::fromUtf8(e.what())));
-					}
+				if (!enabled) {
+					p.reset(Plugin::createNew< CachedPlugin >(currentInfo.absoluteFilePath(), metadata));
 				}
+
+				m_pluginHashMap.insert(p->getID(), p);
 			}
 		}
 
+		m_metadataCache.prune();
+		if (m_metadataCache.isModified() && !m_metadataCache.save(metadataCachePath())) {
+			qWarning("PluginManager: Failed to write the plugin metadata cache to %s", qPrintable(metadataCachePath()));
+		}
+
 		// handle built-in plugins
 #ifdef USE_MANUAL_PLUGIN
 		try {
@@ -353,9 +469,7 @@ void PluginManager::rescanPlugins() {
 		auto pluginIt = m_pluginHashMap.begin();
 		while (pluginIt != m_pluginHashMap.end()) {
 			plugin_ptr_t plugin = pluginIt.value();
-			QString pluginHash  = QLatin1String(
-                QCryptographicHash::hash(plugin->getFilePath().toUtf8(), QCryptographicHash::Sha1).toHex());
-			if (pluginKey == pluginHash) {
+			if (pluginKey == pluginSettingsKey(plugin->getFilePath())) {
 				if (setting.enabled) {
 					loadPlugin(plugin->getID());
 
@@ -403,6 +517,8 @@ bool PluginManager::fetchPositionalData() {
 		m_positionalData.m_cameraDir.z  = 1.0f;
 		m_positionalData.m_cameraAxis.y = 1.0f;
 
+		publishPositionalPose(true);
+
 		return true;
 	}
 
@@ -413,6 +529,8 @@ bool PluginManager::fetchPositionalData() {
 		// Set positional data to zero-values
 		m_positionalData.reset();
 
+		publishPositionalPose(false);
+
 		return false;
 	}
 
@@ -429,6 +547,8 @@ bool PluginManager::fetchPositionalData() {
 	}
 
 	if (!retStatus) {
+		publishPositionalPose(false);
+
 		// We won't be making changes to the positional data anymore, so we can drop the lock
 		posDataLock.unlock();
 
@@ -453,11 +573,84 @@ bool PluginManager::fetchPositionalData() {
 		if (m_positionalData.m_cameraPos == Position3D(0.0f, 0.0f, 0.0f)) {
 			m_positionalData.m_cameraPos = { 0.0f, 0.0f, std::numeric_limits< float >::min() };
 		}
+
+		publishPositionalPose(true);
 	}
 
 	return retStatus;
 }
 
+void PluginManager::publishPositionalPose(bool available) {
+	PositionalPose pose;
+	pose.playerPos  = m_positionalData.m_playerPos;
+	pose.playerDir  = m_positionalData.m_playerDir;
+	pose.playerAxis = m_positionalData.m_playerAxis;
+	pose.cameraPos  = m_positionalData.m_cameraPos;
+	pose.cameraDir  = m_positionalData.m_cameraDir;
+	pose.cameraAxis = m_positionalData.m_cameraAxis;
+	pose.available  = available;
+
+	m_positionalPose.store(pose);
+}
+
+void PluginManager::registerAudioCallbacks(const plugin_ptr_t &plugin) const {
+	const uint32_t callbacks = plugin->getAudioCallbacks();
+	if (callbacks == 0) {
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock(m_audioCallbacksMutex);
+
+	auto audioCallbacks = std::make_shared< PluginManager_AudioCallbacks >(*std::atomic_load(&m_audioCallbacks));
+
+	if (plugin->getFeatures() & MUMBLE_FEATURE_AUDIO_ANALYSIS) {
+		// The plugin only inspects the audio, so it doesn't have to keep the audio threads waiting
+		auto tap = std::make_shared< PluginAudioTap >(plugin);
+		tap->start(QThread::HighPriority);
+		audioCallbacks->taps.push_back(std::move(tap));
+	} else {
+		if (callbacks & Plugin::AUDIO_INPUT_CALLBACK) {
+			audioCallbacks->input.push_back(plugin);
+		}
+		if (callbacks & Plugin::AUDIO_SOURCE_FETCHED_CALLBACK) {
+			audioCallbacks->sourceFetched.push_back(plugin);
+		}
+		if (callbacks & Plugin::AUDIO_OUTPUT_ABOUT_TO_PLAY_CALLBACK) {
+			audioCallbacks->outputAboutToPlay.push_back(plugin);
+		}
+	}
+
+	std::atomic_store(&m_audioCallbacks, std::shared_ptr< const PluginManager_AudioCallbacks >(audioCallbacks));
+}
+
+void PluginManager::unregisterAudioCallbacks(plugin_id_t pluginID) const {
+	std::lock_guard< std::mutex > lock(m_audioCallbacksMutex);
+
+	auto audioCallbacks = std::make_shared< PluginManager_AudioCallbacks >(*std::atomic_load(&m_audioCallbacks));
+
+	const auto hasID = [pluginID](const plugin_ptr_t &plugin) { return plugin->getID() == pluginID; };
+	const auto erase = [&hasID](std::vector< plugin_ptr_t > &plugins) {
+		plugins.erase(std::remove_if(plugins.begin(), plugins.end(), hasID), plugins.end());
+	};
+
+	erase(audioCallbacks->input);
+	erase(audioCallbacks->sourceFetched);
+	erase(audioCallbacks->outputAboutToPlay);
+
+	auto &taps = audioCallbacks->taps;
+	for (auto it = taps.begin(); it != taps.end();) {
+		if (hasID((*it)->plugin())) {
+			// The audio threads may still push into the tap, but it doesn't call the plugin anymore
+			(*it)->stop();
+			it = taps.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	std::atomic_store(&m_audioCallbacks, std::shared_ptr< const PluginManager_AudioCallbacks >(audioCallbacks));
+}
+
 void PluginManager::unlinkPositionalData() {
 	QWriteLocker lock(&m_activePosDataPluginLock);
 
@@ -481,6 +674,10 @@ const PositionalData &PluginManager::getPositionalData() const {
 	return m_positionalData;
 }
 
+PositionalPose PluginManager::getPositionalPose() const {
+	return m_positionalPose.load();
+}
+
 void PluginManager::enablePositionalDataFor(plugin_id_t pluginID, bool enable) const {
 	QReadLocker lock(&m_pluginCollectionLock);
 
@@ -519,7 +716,11 @@ const QVector< const_plugin_ptr_t > PluginManager::getPlugins(bool sorted) const
 	return pluginList;
 }
 
-bool PluginManager::loadPlugin(plugin_id_t pluginID) const {
+bool PluginManager::loadPlugin(plugin_id_t pluginID) {
+	if (!loadLibraryOf(pluginID)) {
+		return false;
+	}
+
 	QReadLocker lock(&m_pluginCollectionLock);
 
 	plugin_ptr_t plugin = m_pluginHashMap.value(pluginID);
@@ -532,7 +733,13 @@ bool PluginManager::loadPlugin(plugin_id_t pluginID) const {
 			return true;
 		}
 
-		return plugin->init() == MUMBLE_STATUS_OK;
+		if (plugin->init() != MUMBLE_STATUS_OK) {
+			return false;
+		}
+
+		registerAudioCallbacks(plugin);
+
+		return true;
 	}
 
 	return false;
@@ -553,6 +760,9 @@ void PluginManager::unloadPlugin(plugin_id_t pluginID) const {
 
 void PluginManager::unloadPlugin(Plugin &plugin) const {
 	if (plugin.isLoaded()) {
+		// The audio threads mustn't call the plugin while (or after) it shuts down
+		unregisterAudioCallbacks(plugin.getID());
+
 		// Only shut down loaded plugins
 		plugin.shutdown();
 	}
@@ -750,12 +960,19 @@ void PluginManager::on_audioInput(short *inputPCM, unsigned int sampleCount, uns
 			 << "samples per channel. IsSpeech:" << isSpeech;
 #endif
 
-	foreachPlugin([inputPCM, sampleCount, channelCount, sampleRate, isSpeech](Plugin &plugin) {
-		if (plugin.isLoaded()) {
-			plugin.onAudioInput(inputPCM, sampleCount, static_cast< std::uint16_t >(channelCount), sampleRate,
-								isSpeech);
+	// Only the plugins implementing the callback are called, without taking m_pluginCollectionLock
+	const auto audioCallbacks = std::atomic_load(&m_audioCallbacks);
+
+	for (const plugin_ptr_t &plugin : audioCallbacks->input) {
+		if (plugin->isLoaded()) {
+			plugin->onAudioInput(inputPCM, sampleCount, static_cast< std::uint16_t >(channelCount), sampleRate,
+								 isSpeech);
 		}
-	});
+	}
+
+	for (const auto &tap : audioCallbacks->taps) {
+		tap->addInput(inputPCM, sampleCount, channelCount, sampleRate, isSpeech);
+	}
 }
 
 void PluginManager::on_audioSourceFetched(float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
@@ -768,12 +985,19 @@ void PluginManager::on_audioSourceFetched(float *outputPCM, unsigned int sampleC
 	}
 #endif
 
-	foreachPlugin([outputPCM, sampleCount, channelCount, sampleRate, isSpeech, user](Plugin &plugin) {
-		if (plugin.isLoaded()) {
-			plugin.onAudioSourceFetched(outputPCM, sampleCount, static_cast< std::uint16_t >(channelCount), sampleRate,
-										isSpeech, user ? user->uiSession : static_cast< unsigned int >(-1));
+	const auto audioCallbacks = std::atomic_load(&m_audioCallbacks);
+	const unsigned int userID = user ? user->uiSession : static_cast< unsigned int >(-1);
+
+	for (const plugin_ptr_t &plugin : audioCallbacks->sourceFetched) {
+		if (plugin->isLoaded()) {
+			plugin->onAudioSourceFetched(outputPCM, sampleCount, static_cast< std::uint16_t >(channelCount),
+										 sampleRate, isSpeech, userID);
 		}
-	});
+	}
+
+	for (const auto &tap : audioCallbacks->taps) {
+		tap->addSourceFetched(outputPCM, sampleCount, channelCount, sampleRate, isSpeech, userID);
+	}
 }
 
 void PluginManager::on_audioOutputAboutToPlay(float *outputPCM, unsigned int sampleCount, unsigned int channelCount,
@@ -782,14 +1006,21 @@ void PluginManager::on_audioOutputAboutToPlay(float *outputPCM, unsigned int sam
 	qDebug() << "PluginManager: AudioOutput with" << channelCount << "channels and" << sampleCount
 			 << "samples per channel";
 #endif
-	foreachPlugin([outputPCM, sampleCount, channelCount, sampleRate, modifiedAudio](Plugin &plugin) {
-		if (plugin.isLoaded()) {
-			if (plugin.onAudioOutputAboutToPlay(outputPCM, sampleCount, static_cast< std::uint16_t >(channelCount),
-												sampleRate)) {
+	const auto audioCallbacks = std::atomic_load(&m_audioCallbacks);
+
+	for (const plugin_ptr_t &plugin : audioCallbacks->outputAboutToPlay) {
+		if (plugin->isLoaded()) {
+			if (plugin->onAudioOutputAboutToPlay(outputPCM, sampleCount, static_cast< std::uint16_t >(channelCount),
+												 sampleRate)) {
 				*modifiedAudio = true;
 			}
 		}
-	});
+	}
+
+	// The taps get the audio after it has been modified. They can't modify it themselves.
+	for (const auto &tap : audioCallbacks->taps) {
+		tap->addOutputAboutToPlay(outputPCM, sampleCount, channelCount, sampleRate);
+	}
 }
 
 void PluginManager::on_receiveData(const ClientUser *sender, const uint8_t *data, size_t dataLength,
@@ -911,8 +1142,8 @@ void PluginManager::on_keyEvent(unsigned int key, Qt::KeyboardModifiers modifier
 }
 
 void PluginManager::on_syncPositionalData() {
-	// fetch positional data
-	if (fetchPositionalData()) {
+	// The positional data is fetched by the PositionalDataPoller
+	if (getPositionalPose().available) {
 		// Sync the gathered data (context + identity) with the server
 		if (!Global::get().uiSession) {
 			// For some reason the local session ID is not set -> clear all data sent to the server in order to
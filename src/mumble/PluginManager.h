@@ -6,6 +6,7 @@
 #ifndef MUMBLE_MUMBLE_PLUGINMANAGER_H_
 #define MUMBLE_MUMBLE_PLUGINMANAGER_H_
 
+#include <QFileInfo>
 #include <QHash>
 #include <QMutex>
 #include <QObject>
@@ -20,7 +21,11 @@
 #endif
 #include "MumbleApplication.h"
 #include "Plugin.h"
+#include "PluginMetadataCache.h"
 #include "PositionalData.h"
+#include "PluginAudioTap.h"
+#include "PositionalDataPoller.h"
+#include "SeqLock.h"
 
 #include "Channel.h"
 #include "ClientUser.h"
@@ -29,6 +34,19 @@
 #include "User.h"
 
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// The plugins whose audio callbacks are called by the audio threads
+struct PluginManager_AudioCallbacks {
+	/// The plugins that are handed the audio buffers directly (and thus may modify them)
+	std::vector< plugin_ptr_t > input;
+	std::vector< plugin_ptr_t > sourceFetched;
+	std::vector< plugin_ptr_t > outputAboutToPlay;
+	/// The taps of the plugins that only inspect the audio (MUMBLE_FEATURE_AUDIO_ANALYSIS)
+	std::vector< std::shared_ptr< PluginAudioTap > > taps;
+};
 
 /// A struct for holding the values of the current context and identity that have been sent to the server
 struct PluginManager_SentData {
@@ -60,6 +78,10 @@ protected:
 #endif
 	/// The PositionalData object holding the current positional data (as retrieved by the respective plugin)
 	PositionalData m_positionalData;
+	/// The geometric part of m_positionalData, which the audio threads read without locking
+	SeqLock< PositionalPose > m_positionalPose;
+	/// The thread fetching the positional data
+	std::unique_ptr< PositionalDataPoller > m_positionalDataPoller;
 
 	/// A timer that causes the manager to regularly check for available plugins that can currently
 	/// deliver positional data.
@@ -79,6 +101,14 @@ protected:
 	plugin_ptr_t m_activePositionalDataPlugin;
 	/// The PluginUpdater used to handle plugin updates.
 	PluginUpdater m_updater;
+	/// The metadata of the libraries in the plugin directories, so that the plugins that aren't enabled are listed by
+	/// CachedPlugin instances rather than having their libraries loaded.
+	PluginMetadataCache m_metadataCache;
+	/// The mutex serializing the changes of m_audioCallbacks
+	mutable std::mutex m_audioCallbacksMutex;
+	/// The plugins whose audio callbacks are called. The audio threads read it without locking, so it must only be
+	/// replaced (via std::atomic_store) rather than modified.
+	mutable std::shared_ptr< const PluginManager_AudioCallbacks > m_audioCallbacks;
 
 	// We override the QObject::eventFilter function in order to be able to install the pluginManager as an event filter
 	// to the main application in order to get notified about keystrokes.
@@ -88,11 +118,35 @@ protected:
 	void unloadPlugins() const;
 	/// Clears the current list of plugins
 	void clearPlugins();
+	/// Creates the plugin of the given library, reading its metadata
+	///
+	/// @param library The library to create the plugin from
+	/// @param[out] metadata The metadata of the library, which tells why it isn't a plugin if that is the case
+	/// @returns The plugin or nullptr if the library isn't a plugin
+	plugin_ptr_t createPlugin(const QFileInfo &library, PluginMetadata &metadata) const;
+	/// Replaces the plugin with the given ID with one that has loaded its library, if it is a CachedPlugin. The plugin
+	/// keeps its ID.
+	///
+	/// @param pluginID The ID of the plugin
+	/// @returns Whether the plugin's library has been loaded (which is also the case if it is no CachedPlugin)
+	bool loadLibraryOf(plugin_id_t pluginID);
+	/// @returns Where the PluginMetadataCache is kept
+	static QString metadataCachePath();
 	/// Iterates over the plugins and tries to select a plugin that currently claims to be able to deliver positional
 	/// data. If it found a plugin, activePositionalDataPlugin is set accordingly. If not, it is set to nullptr.
 	///
 	/// @returns Whether this function succeeded in finding such a plugin
 	bool selectActivePositionalDataPlugin();
+	/// Publishes the pose contained in m_positionalData to the readers of getPositionalPose()
+	///
+	/// @param available Whether the pose has been fetched successfully
+	void publishPositionalPose(bool available);
+	/// Has the audio threads call the audio callbacks the given (loaded) plugin implements. Plugins providing
+	/// MUMBLE_FEATURE_AUDIO_ANALYSIS get a PluginAudioTap of their own.
+	void registerAudioCallbacks(const plugin_ptr_t &plugin) const;
+	/// Stops the audio threads from calling the audio callbacks of the plugin with the given ID. Once this returns,
+	/// the plugin's tap (if any) doesn't call the plugin anymore.
+	void unregisterAudioCallbacks(plugin_id_t pluginID) const;
 
 	/// A internal helper function that iterates over all plugins and calls the given function providing the current
 	/// plugin as a parameter.
@@ -119,7 +173,7 @@ public:
 	/// Checks whether there are any updates for the plugins and if there are it invokes the PluginUpdater.
 	void checkForPluginUpdates();
 	/// Fetches positional data from the activePositionalDataPlugin if there is one set. This function will update the
-	/// positionalData field
+	/// positionalData field and publish the new pose. It is called regularly by the PositionalDataPoller.
 	///
 	/// @returns Whether the positional data could be retrieved successfully
 	bool fetchPositionalData();
@@ -129,6 +183,10 @@ public:
 	bool isPositionalDataAvailable() const;
 	/// @returns The most recent positional data
 	const PositionalData &getPositionalData() const;
+	/// This function doesn't lock and may thus be called from the audio threads.
+	///
+	/// @returns The most recent pose
+	PositionalPose getPositionalPose() const;
 	/// Enables positional data gathering for the plugin with the given ID. A plugin is only even asked whether it can
 	/// deliver positional data if this is enabled.
 	///
@@ -137,11 +195,12 @@ public:
 	void enablePositionalDataFor(plugin_id_t pluginID, bool enable = true) const;
 	/// @returns A const vector of the plugins
 	const QVector< const_plugin_ptr_t > getPlugins(bool sorted = false) const;
-	/// Loads the plugin with the given ID. Loading means initializing the plugin.
+	/// Loads the plugin with the given ID. Loading means initializing the plugin (after having loaded its library, if
+	/// that hasn't happened yet).
 	///
 	/// @param pluginID The ID of the plugin to load
 	/// @returns Whether the plugin could be successfully loaded
-	bool loadPlugin(plugin_id_t pluginID) const;
+	bool loadPlugin(plugin_id_t pluginID);
 	/// Unloads the plugin with the given ID. Unloading means shutting the plugign down.
 	///
 	/// @param pluginID The ID of the plugin to unload
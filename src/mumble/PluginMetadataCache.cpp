@@ -0,0 +1,156 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PluginMetadataCache.h"
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+/// Identifies the files of the cache, and changes whenever their format does
+static const quint32 FILE_MAGIC = 0x4d504d31; // "MPM1"
+
+static QDataStream &operator<<(QDataStream &stream, const mumble_version_t &version) {
+	return stream << static_cast< qint32 >(version.major) << static_cast< qint32 >(version.minor)
+				  << static_cast< qint32 >(version.patch);
+}
+
+static QDataStream &operator>>(QDataStream &stream, mumble_version_t &version) {
+	qint32 major, minor, patch;
+	stream >> major >> minor >> patch;
+
+	version = { major, minor, patch };
+	return stream;
+}
+
+const PluginMetadata *PluginMetadataCache::lookup(const QFileInfo &library) {
+	auto it = m_entries.find(library.absoluteFilePath());
+	if (it == m_entries.end()) {
+		return nullptr;
+	}
+
+	Entry &entry          = it.value();
+	const qint64 modified = library.lastModified().toMSecsSinceEpoch();
+	if (entry.size != library.size() || entry.modified != modified) {
+		const QByteArray hash = entry.size == library.size() ? hashOf(library.absoluteFilePath()) : QByteArray();
+		if (hash.isEmpty() || hash != entry.hash) {
+			m_entries.erase(it);
+			m_modified = true;
+
+			return nullptr;
+		}
+
+		// The library is still the same one
+		entry.modified = modified;
+		m_modified     = true;
+	}
+
+	entry.used = true;
+	return &entry.metadata;
+}
+
+void PluginMetadataCache::insert(const QFileInfo &library, const PluginMetadata &metadata) {
+	m_entries.insert(library.absoluteFilePath(), { library.size(), library.lastModified().toMSecsSinceEpoch(),
+												   hashOf(library.absoluteFilePath()), metadata, true });
+	m_modified = true;
+}
+
+void PluginMetadataCache::prune() {
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		if (it->used) {
+			it->used = false;
+			++it;
+		} else {
+			it         = m_entries.erase(it);
+			m_modified = true;
+		}
+	}
+}
+
+bool PluginMetadataCache::isModified() const {
+	return m_modified;
+}
+
+void PluginMetadataCache::load(const QString &path) {
+	m_entries.clear();
+	m_modified = false;
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic;
+	stream >> magic;
+	if (magic != FILE_MAGIC) {
+		return;
+	}
+
+	quint32 count;
+	stream >> count;
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		QString library;
+		Entry entry;
+		PluginMetadata &metadata = entry.metadata;
+		stream >> library >> entry.size >> entry.modified >> entry.hash >> metadata.isPlugin >> metadata.isLegacy
+			>> metadata.name >> metadata.author >> metadata.description >> metadata.version >> metadata.apiVersion
+			>> metadata.features >> metadata.error;
+		// Entries are only kept if they are used before the next prune()
+		entry.used = false;
+
+		m_entries.insert(library, entry);
+	}
+
+	if (stream.status() != QDataStream::Ok) {
+		qWarning("PluginMetadataCache: The cache in %s is damaged", qPrintable(path));
+		m_entries.clear();
+	}
+}
+
+bool PluginMetadataCache::save(const QString &path) {
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	stream << FILE_MAGIC << static_cast< quint32 >(m_entries.size());
+	for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+		const Entry &entry             = it.value();
+		const PluginMetadata &metadata = entry.metadata;
+		stream << it.key() << entry.size << entry.modified << entry.hash << metadata.isPlugin << metadata.isLegacy
+			   << metadata.name << metadata.author << metadata.description << metadata.version << metadata.apiVersion
+			   << metadata.features << metadata.error;
+	}
+
+	if (stream.status() != QDataStream::Ok || !file.commit()) {
+		return false;
+	}
+
+	m_modified = false;
+	return true;
+}
+
+QByteArray PluginMetadataCache::hashOf(const QString &path) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	if (!hash.addData(&file)) {
+		return QByteArray();
+	}
+
+	return hash.result();
+}
@@ -0,0 +1,81 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_PLUGINMETADATACACHE_H_
+#define MUMBLE_MUMBLE_PLUGINMETADATACACHE_H_
+
+#define MUMBLE_PLUGIN_NO_DEFAULT_FUNCTION_DEFINITIONS
+#include "MumblePlugin.h"
+#undef MUMBLE_PLUGIN_NO_DEFAULT_FUNCTION_DEFINITIONS
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+class QFileInfo;
+
+/// What is known about a library in one of the plugin directories without loading it
+struct PluginMetadata {
+	/// Whether the library is a plugin at all. The other members are only set if it is.
+	bool isPlugin = false;
+	/// Whether the library is a LegacyPlugin
+	bool isLegacy = false;
+	QString name;
+	QString author;
+	QString description;
+	mumble_version_t version    = MUMBLE_VERSION_UNKNOWN;
+	mumble_version_t apiVersion = MUMBLE_VERSION_UNKNOWN;
+	uint32_t features           = MUMBLE_FEATURE_NONE;
+	/// Why the library isn't a plugin (if it isn't)
+	QString error;
+};
+
+/// The metadata of the libraries in the plugin directories, so that the PluginManager doesn't have to load the libraries
+/// of the plugins that aren't enabled in order to list them. The entries are kept by the libraries' paths and are only
+/// valid as long as the libraries' contents haven't changed.
+///
+/// The cache is kept on disk (see load() and save()) to be reused between the starts of Mumble.
+class PluginMetadataCache {
+public:
+	/// @returns The metadata of the given library or nullptr if there is none for its current contents. The library is
+	/// 	only hashed if its size or modification time have changed since it has been inserted, so that a library that
+	/// 	has been replaced by an identical copy (e.g. by an installer) is still known.
+	const PluginMetadata *lookup(const QFileInfo &library);
+	/// Stores the metadata of the given library (replacing what has been stored for it before)
+	void insert(const QFileInfo &library, const PluginMetadata &metadata);
+	/// Removes the libraries that haven't been looked up (successfully) or inserted since the last time this has been
+	/// called (or since the cache has been loaded)
+	void prune();
+
+	/// @returns Whether the cache has changed since it has been loaded or saved
+	bool isModified() const;
+
+	/// Replaces the cache's entries with the ones in the given file. If it couldn't be read, the cache is left empty.
+	void load(const QString &path);
+	/// Writes the cache to the given file (replacing it atomically)
+	///
+	/// @returns Whether the cache has been written
+	bool save(const QString &path);
+
+protected:
+	struct Entry {
+		qint64 size;
+		/// In milliseconds since the epoch
+		qint64 modified;
+		/// The SHA-1 of the library's contents
+		QByteArray hash;
+		PluginMetadata metadata;
+		/// Whether the entry has been used since the last call to prune()
+		bool used;
+	};
+
+	QHash< QString, Entry > m_entries;
+	bool m_modified = false;
+
+	/// @returns The SHA-1 of the given file's contents or an empty byte array if it couldn't be read
+	static QByteArray hashOf(const QString &path);
+};
+
+#endif // MUMBLE_MUMBLE_PLUGINMETADATACACHE_H_
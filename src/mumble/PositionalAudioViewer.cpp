@@ -26,8 +26,7 @@ void PositionalAudioViewer::update() {
 		return;
 	}
 
-	pluginManager->fetchPositionalData();
-
+	// The positional data is fetched by the PositionalDataPoller
 	const PositionalData &posData = pluginManager->getPositionalData();
 
 	updatePlayer(posData);
@@ -17,12 +17,6 @@ Vector3D::Vector3D() : x(0.0f), y(0.0f), z(0.0f) {
 Vector3D::Vector3D(float x, float y, float z) : x(x), y(y), z(z) {
 }
 
-Vector3D::Vector3D(const Vector3D &other) : x(other.x), y(other.y), z(other.z) {
-}
-
-Vector3D::~Vector3D() {
-}
-
 float Vector3D::operator[](Coord coord) const {
 	switch (coord) {
 		case Coord::X:
@@ -68,9 +68,9 @@ struct Vector3D {
 	/// Copy constructor
 	///
 	/// @param other The vector to copy
-	Vector3D(const Vector3D &other);
+	Vector3D(const Vector3D &other) = default;
 	/// Destructor
-	~Vector3D();
+	~Vector3D() = default;
 	/// @returns The squared euclidean norm (length of the vector)
 	float normSquared() const;
 	/// If possible normSquared() should be preferred as this doesn't require a square-root operator
@@ -105,6 +105,26 @@ static_assert(sizeof(Vector3D) == 3 * sizeof(float),
 typedef Vector3D Position3D;
 
 
+/// The geometric part of the positional data, which is published to the audio threads through a SeqLock (see
+/// PluginManager::getPositionalPose()). Unlike PositionalData it can be copied byte by byte.
+struct PositionalPose {
+	/// The player's position in the 3D world
+	Position3D playerPos;
+	/// The direction in which the player is looking
+	Vector3D playerDir;
+	/// The connection vector between the player's feet and his/her head
+	Vector3D playerAxis;
+	/// The camera's position in the 3D world
+	Position3D cameraPos;
+	/// The direction in which the camera is looking
+	Vector3D cameraDir;
+	/// The connection from the camera's bottom to its top
+	Vector3D cameraAxis;
+	/// Whether the pose has been fetched successfully from a plugin
+	bool available = false;
+};
+
+
 /// A class holding positional data used in the positional audio feature
 class PositionalData {
 	friend class PluginManager; // needed in order for PluginManager::fetch to write to the contained fields
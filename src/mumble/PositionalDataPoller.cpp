@@ -0,0 +1,49 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PositionalDataPoller.h"
+
+#include "PluginManager.h"
+#include "Global.h"
+
+#include <QtCore/QElapsedTimer>
+
+#include <algorithm>
+
+PositionalDataPoller::PositionalDataPoller(PluginManager &manager) : m_manager(manager) {
+}
+
+PositionalDataPoller::~PositionalDataPoller() {
+	stop();
+	wait();
+}
+
+void PositionalDataPoller::stop() {
+	QMutexLocker l(&m_mutex);
+
+	m_stop = true;
+	m_stopCondition.wakeAll();
+}
+
+void PositionalDataPoller::run() {
+	QElapsedTimer timer;
+
+	forever {
+		timer.start();
+
+		m_manager.fetchPositionalData();
+
+		const int rate     = std::min(std::max(Global::get().s.iPositionalDataRate, MIN_RATE), MAX_RATE);
+		const qint64 delay = std::max(1000 / rate - timer.elapsed(), static_cast< qint64 >(0));
+
+		QMutexLocker l(&m_mutex);
+		if (!m_stop && delay > 0) {
+			m_stopCondition.wait(&m_mutex, static_cast< unsigned long >(delay));
+		}
+		if (m_stop) {
+			break;
+		}
+	}
+}
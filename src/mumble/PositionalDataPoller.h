@@ -0,0 +1,43 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_POSITIONALDATAPOLLER_H_
+#define MUMBLE_MUMBLE_POSITIONALDATAPOLLER_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+class PluginManager;
+
+/// A thread that fetches the positional data from the active plugin at the rate given by
+/// Settings::iPositionalDataRate.
+///
+/// Polling used to happen on the GUI thread and on the audio threads, so that a busy GUI (e.g. while the server sync
+/// is processed) stalled the positional data. The audio threads now merely read what the poller has published (see
+/// PluginManager::getPositionalPose()).
+class PositionalDataPoller : public QThread {
+public:
+	/// The lowest and highest rate at which the positional data is fetched (in Hz)
+	static constexpr int MIN_RATE = 1;
+	static constexpr int MAX_RATE = 1000;
+
+	explicit PositionalDataPoller(PluginManager &manager);
+	/// Stops the thread
+	~PositionalDataPoller() override;
+
+	/// Makes the thread stop after its current iteration
+	void stop();
+
+protected:
+	PluginManager &m_manager;
+	QMutex m_mutex;
+	QWaitCondition m_stopCondition;
+	bool m_stop = false;
+
+	void run() override;
+};
+
+#endif // MUMBLE_MUMBLE_POSITIONALDATAPOLLER_H_
@@ -0,0 +1,155 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Profiler.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic< bool > enabled{ false };
+/// The innermost zone that is active on the thread
+thread_local ProfilerZone *currentZone = nullptr;
+
+QMutex &zonesMutex() {
+	static QMutex mutex;
+	return mutex;
+}
+
+std::vector< ProfilerZone * > &zones() {
+	static std::vector< ProfilerZone * > zones;
+	return zones;
+}
+} // namespace
+
+// The allocations are counted by replacing the global allocation functions. The array and nothrow versions forward to
+// these by default.
+void *operator new(std::size_t size) {
+	if (enabled.load(std::memory_order_relaxed) && currentZone) {
+		currentZone->recordAllocation(size);
+	}
+
+	if (void *memory = std::malloc(size > 0 ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+ProfilerZone::ProfilerZone(const char *name) : m_name(name) {
+	Profiler::registerZone(this);
+}
+
+ProfilerZone::Stats ProfilerZone::take() {
+	return { m_name,
+			 m_calls.exchange(0, std::memory_order_relaxed),
+			 m_totalTime.exchange(0, std::memory_order_relaxed),
+			 m_maxTime.exchange(0, std::memory_order_relaxed),
+			 m_allocations.exchange(0, std::memory_order_relaxed),
+			 m_allocatedBytes.exchange(0, std::memory_order_relaxed) };
+}
+
+void ProfilerZone::record(std::uint64_t time) {
+	m_calls.fetch_add(1, std::memory_order_relaxed);
+	m_totalTime.fetch_add(time, std::memory_order_relaxed);
+
+	std::uint64_t max = m_maxTime.load(std::memory_order_relaxed);
+	while (time > max && !m_maxTime.compare_exchange_weak(max, time, std::memory_order_relaxed)) {
+	}
+}
+
+void ProfilerZone::recordAllocation(std::size_t size) {
+	m_allocations.fetch_add(1, std::memory_order_relaxed);
+	m_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+ProfilerScope::ProfilerScope(ProfilerZone &zone)
+	: m_zone(enabled.load(std::memory_order_relaxed) ? &zone : nullptr), m_parent(currentZone) {
+	if (m_zone) {
+		currentZone = m_zone;
+		m_start     = std::chrono::steady_clock::now();
+	}
+}
+
+ProfilerScope::~ProfilerScope() {
+	if (m_zone) {
+		const auto elapsed = std::chrono::steady_clock::now() - m_start;
+		m_zone->record(static_cast< std::uint64_t >(
+			std::chrono::duration_cast< std::chrono::nanoseconds >(elapsed).count()));
+		currentZone = m_parent;
+	}
+}
+
+ProfilerZone *ProfilerScope::current() {
+	return currentZone;
+}
+
+bool Profiler::isEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::setEnabled(bool enable) {
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+std::vector< ProfilerZone::Stats > Profiler::take() {
+	QMutexLocker l(&zonesMutex());
+
+	std::vector< ProfilerZone::Stats > stats;
+	stats.reserve(zones().size());
+	for (ProfilerZone *zone : zones()) {
+		stats.push_back(zone->take());
+	}
+
+	std::sort(stats.begin(), stats.end(), [](const ProfilerZone::Stats &lhs, const ProfilerZone::Stats &rhs) {
+		return lhs.totalTime > rhs.totalTime;
+	});
+
+	return stats;
+}
+
+QString Profiler::format(const std::vector< ProfilerZone::Stats > &stats, double seconds) {
+	QStringList lines;
+	lines << QString::fromLatin1("%1 %2 %3 %4 %5 %6 %7")
+				 .arg(QLatin1String("Zone"), -32)
+				 .arg(QLatin1String("Calls/s"), 10)
+				 .arg(QLatin1String("Time %"), 8)
+				 .arg(QLatin1String("Avg us"), 10)
+				 .arg(QLatin1String("Max us"), 10)
+				 .arg(QLatin1String("Allocs/s"), 10)
+				 .arg(QLatin1String("KiB/s"), 10);
+
+	for (const ProfilerZone::Stats &zone : stats) {
+		const double average = zone.calls > 0 ? static_cast< double >(zone.totalTime) / zone.calls / 1000.0 : 0.0;
+
+		lines << QString::fromLatin1("%1 %2 %3 %4 %5 %6 %7")
+					 .arg(QLatin1String(zone.name), -32)
+					 .arg(static_cast< double >(zone.calls) / seconds, 10, 'f', 1)
+					 .arg(static_cast< double >(zone.totalTime) / (seconds * 1e7), 8, 'f', 2)
+					 .arg(average, 10, 'f', 1)
+					 .arg(static_cast< double >(zone.maxTime) / 1000.0, 10, 'f', 1)
+					 .arg(static_cast< double >(zone.allocations) / seconds, 10, 'f', 1)
+					 .arg(static_cast< double >(zone.allocatedBytes) / 1024.0 / seconds, 10, 'f', 1);
+	}
+
+	return lines.join(QLatin1Char('\n'));
+}
+
+void Profiler::registerZone(ProfilerZone *zone) {
+	QMutexLocker l(&zonesMutex());
+
+	zones().push_back(zone);
+}
@@ -0,0 +1,92 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_PROFILER_H_
+#define MUMBLE_MUMBLE_PROFILER_H_
+
+#include <QtCore/QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/// A code path whose time and allocations are measured while profiling is enabled (see Profiler). Zones are created
+/// by MUMBLE_PROFILE_ZONE and live as long as the process does.
+class ProfilerZone {
+public:
+	struct Stats {
+		const char *name;
+		std::uint64_t calls;
+		/// In nanoseconds, including the time spent in nested zones
+		std::uint64_t totalTime;
+		/// In nanoseconds
+		std::uint64_t maxTime;
+		/// The number of heap allocations made while the zone was active (excluding nested zones)
+		std::uint64_t allocations;
+		std::uint64_t allocatedBytes;
+	};
+
+	explicit ProfilerZone(const char *name);
+
+	/// @returns The stats gathered since the last call, resetting them
+	Stats take();
+
+	void record(std::uint64_t time);
+	void recordAllocation(std::size_t size);
+
+protected:
+	const char *m_name;
+	std::atomic< std::uint64_t > m_calls{ 0 };
+	std::atomic< std::uint64_t > m_totalTime{ 0 };
+	std::atomic< std::uint64_t > m_maxTime{ 0 };
+	std::atomic< std::uint64_t > m_allocations{ 0 };
+	std::atomic< std::uint64_t > m_allocatedBytes{ 0 };
+};
+
+/// Measures the zone it is created with until it goes out of scope, if profiling is enabled
+class ProfilerScope {
+public:
+	explicit ProfilerScope(ProfilerZone &zone);
+	~ProfilerScope();
+
+	/// @returns The innermost zone that is active on the calling thread or nullptr if there is none
+	static ProfilerZone *current();
+
+protected:
+	ProfilerZone *m_zone;
+	ProfilerZone *m_parent;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+/// A lightweight profiler for the client's hot paths, which users can turn on in the developer console in order to
+/// send us performance reports without needing a special build.
+///
+/// While profiling is disabled, a zone costs a single atomic load. While it is enabled, every zone counts how often
+/// it has been entered, how long it took and how many heap allocations have been made in it. All counters are
+/// atomics, so that zones may be used on the audio threads.
+class Profiler {
+public:
+	static bool isEnabled();
+	static void setEnabled(bool enabled);
+
+	/// @returns The stats of all zones gathered since the last call, resetting them
+	static std::vector< ProfilerZone::Stats > take();
+
+	/// @returns The given stats as a plain text table, e.g. for pasting into a bug report
+	static QString format(const std::vector< ProfilerZone::Stats > &stats, double seconds);
+
+protected:
+	friend class ProfilerZone;
+
+	static void registerZone(ProfilerZone *zone);
+};
+
+/// Measures the rest of the enclosing scope under the given name (at most one zone per scope)
+#define MUMBLE_PROFILE_ZONE(name)                 \
+	static ProfilerZone mumbleProfilerZone(name); \
+	ProfilerScope mumbleProfilerScope(mumbleProfilerZone)
+
+#endif // MUMBLE_MUMBLE_PROFILER_H_
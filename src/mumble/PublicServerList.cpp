@@ -0,0 +1,134 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PublicServerList.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtXml/QDomDocument>
+
+/// Identifies the files of the list, and changes whenever their format does
+static const quint32 FILE_MAGIC = 0x4d505331; // "MPS1"
+
+/// @returns The value of the given header, whose name is compared case-insensitively (as HTTP/2 sends them lowercase)
+static QString headerValue(const QMap< QString, QString > &headers, const QString &name) {
+	for (auto it = headers.constBegin(); it != headers.constEnd(); ++it) {
+		if (it.key().compare(name, Qt::CaseInsensitive) == 0) {
+			return it.value();
+		}
+	}
+
+	return QString();
+}
+
+PublicServerList PublicServerList::parse(const QByteArray &xmlData, const QMap< QString, QString > &headers) {
+	PublicServerList list;
+	list.userCountry       = headerValue(headers, QLatin1String("Geo-Country"));
+	list.userCountryCode   = headerValue(headers, QLatin1String("Geo-Country-Code")).toLower();
+	list.userContinentCode = headerValue(headers, QLatin1String("Geo-Continent-Code")).toLower();
+	list.etag              = headerValue(headers, QLatin1String("ETag")).toLatin1();
+	list.lastModified      = headerValue(headers, QLatin1String("Last-Modified")).toLatin1();
+
+	// The translation keeps the context of the ConnectDialog, which used to parse the list
+	const QString unknown = QCoreApplication::translate("ConnectDialog", "Unknown");
+
+	QDomDocument doc;
+	doc.setContent(xmlData);
+
+	QDomElement root = doc.documentElement();
+	QDomNode n       = root.firstChild();
+	while (!n.isNull()) {
+		QDomElement e = n.toElement();
+		if (!e.isNull()) {
+			if (e.tagName() == QLatin1String("server")) {
+				PublicInfo pi;
+				pi.qsName          = e.attribute(QLatin1String("name"));
+				pi.quUrl           = e.attribute(QLatin1String("url"));
+				pi.qsIp            = e.attribute(QLatin1String("ip"));
+				pi.usPort          = e.attribute(QLatin1String("port")).toUShort();
+				pi.qsCountry       = e.attribute(QLatin1String("country"), unknown);
+				pi.qsCountryCode   = e.attribute(QLatin1String("country_code")).toLower();
+				pi.qsContinentCode = e.attribute(QLatin1String("continent_code")).toLower();
+				pi.bCA             = e.attribute(QLatin1String("ca")).toInt() ? true : false;
+
+				list.servers << pi;
+			}
+		}
+		n = n.nextSibling();
+	}
+
+	return list;
+}
+
+PublicServerList PublicServerList::load(const QString &path) {
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return PublicServerList();
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic;
+	stream >> magic;
+	if (magic != FILE_MAGIC) {
+		return PublicServerList();
+	}
+
+	PublicServerList list;
+	quint32 count;
+	stream >> list.userCountry >> list.userCountryCode >> list.userContinentCode >> list.etag >> list.lastModified
+		>> count;
+
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		PublicInfo pi;
+		quint16 port;
+		stream >> pi.qsName >> pi.quUrl >> pi.qsIp >> pi.qsCountry >> pi.qsCountryCode >> pi.qsContinentCode >> port
+			>> pi.bCA;
+		pi.usPort = port;
+
+		list.servers << pi;
+	}
+
+	if (stream.status() != QDataStream::Ok) {
+		qWarning("PublicServerList: The cached list in %s is damaged", qPrintable(path));
+		return PublicServerList();
+	}
+
+	return list;
+}
+
+bool PublicServerList::save(const QString &path) const {
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	stream << FILE_MAGIC << userCountry << userCountryCode << userContinentCode << etag << lastModified
+		   << static_cast< quint32 >(servers.size());
+	for (const PublicInfo &pi : servers) {
+		stream << pi.qsName << pi.quUrl << pi.qsIp << pi.qsCountry << pi.qsCountryCode << pi.qsContinentCode
+			   << static_cast< quint16 >(pi.usPort) << pi.bCA;
+	}
+
+	return stream.status() == QDataStream::Ok && file.commit();
+}
+
+QMap< QByteArray, QByteArray > PublicServerList::conditionalHeaders() const {
+	QMap< QByteArray, QByteArray > headers;
+	if (!etag.isEmpty()) {
+		headers.insert(QByteArrayLiteral("If-None-Match"), etag);
+	}
+	if (!lastModified.isEmpty()) {
+		headers.insert(QByteArrayLiteral("If-Modified-Since"), lastModified);
+	}
+
+	return headers;
+}
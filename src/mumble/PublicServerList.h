@@ -0,0 +1,56 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_PUBLICSERVERLIST_H_
+#define MUMBLE_MUMBLE_PUBLICSERVERLIST_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+
+struct PublicInfo {
+	QString qsName;
+	QUrl quUrl;
+	QString qsIp;
+	QString qsCountry;
+	QString qsCountryCode;
+	QString qsContinentCode;
+	unsigned short usPort;
+	bool bCA;
+};
+
+/// The public server list as the list service has sent it, together with what the service has told about the user's
+/// location and the validators of the response (which a conditional fetch sends back to only receive the list if it
+/// has changed since).
+///
+/// The list is kept on disk (see load() and save()), so that the ConnectDialog can show the last one it has received
+/// right away. Neither parsing nor loading one touches anything but the list, so they may happen on a worker thread.
+struct PublicServerList {
+	QList< PublicInfo > servers;
+	QString userCountry;
+	QString userCountryCode;
+	QString userContinentCode;
+	/// The ETag header of the response, for an If-None-Match header
+	QByteArray etag;
+	/// The Last-Modified header of the response, for an If-Modified-Since header
+	QByteArray lastModified;
+
+	/// Parses the list the service has sent with the given response headers
+	static PublicServerList parse(const QByteArray &xmlData, const QMap< QString, QString > &headers);
+
+	/// @returns The list in the given file, which is empty if it couldn't be read
+	static PublicServerList load(const QString &path);
+	/// Writes the list to the given file (replacing it atomically)
+	///
+	/// @returns Whether the list has been written
+	bool save(const QString &path) const;
+
+	/// @returns The headers that only have the list sent again if it has changed since this one
+	QMap< QByteArray, QByteArray > conditionalHeaders() const;
+};
+
+#endif // MUMBLE_MUMBLE_PUBLICSERVERLIST_H_
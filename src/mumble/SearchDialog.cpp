@@ -21,6 +21,7 @@
 #include <QReadLocker>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
+#include <QSet>
 #include <QShowEvent>
 #include <QTreeWidgetItem>
 
@@ -57,25 +58,31 @@ public:
 	template< typename parent_t >
 	SearchResultItem(const SearchResult &result, unsigned int id, parent_t parent,
 					 QTreeWidgetItem *precedingItem = nullptr)
-		: QTreeWidgetItem(parent, precedingItem), m_result(result), m_id(id) {
-		constexpr int TYPE_COLUMN  = 0;
-		constexpr int MATCH_COLUMN = 1;
-
-		if (m_result.type == SearchType::User) {
+		: QTreeWidgetItem(parent, precedingItem), m_id(id) {
+		if (result.type == SearchType::User) {
 			QIcon userIcon = QIcon(QLatin1String("skin:talking_off.svg"));
 			setIcon(TYPE_COLUMN, userIcon);
 		}
 
 		setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicator);
 
-		QString matchText =
-			m_result.fullText.replace(m_result.begin, m_result.length,
-									  "<b>" + m_result.fullText.midRef(m_result.begin, m_result.length) + "</b>");
+		setTextAlignment(MATCH_COLUMN, Qt::AlignLeft | Qt::AlignVCenter);
+
+		setResult(result);
+	}
+
+	/**
+	 * Shows the given result (of the same user or channel) instead of the previous one
+	 */
+	void setResult(const SearchResult &result) {
+		m_result = result;
+
+		QString matchText = m_result.fullText;
+		matchText.replace(m_result.begin, m_result.length,
+						  "<b>" + m_result.fullText.midRef(m_result.begin, m_result.length) + "</b>");
 
 		setData(MATCH_COLUMN, Qt::DisplayRole, std::move(matchText));
 		setData(MATCH_COLUMN, SearchDialogItemDelegate::CHANNEL_TREE_ROLE, m_result.channelHierarchy);
-
-		setTextAlignment(MATCH_COLUMN, Qt::AlignLeft | Qt::AlignVCenter);
 	}
 
 	unsigned int getID() const { return m_id; }
@@ -83,10 +90,16 @@ public:
 	const SearchResult &getResult() const { return m_result; }
 
 private:
+	static constexpr int TYPE_COLUMN  = 0;
+	static constexpr int MATCH_COLUMN = 1;
+
 	SearchResult m_result;
 	unsigned int m_id;
 };
 
+constexpr int SearchResultItem::TYPE_COLUMN;
+constexpr int SearchResultItem::MATCH_COLUMN;
+
 class ChannelItem : public QTreeWidgetItem {
 	Q_DISABLE_COPY(ChannelItem)
 
@@ -150,11 +163,22 @@ SearchDialog::SearchDialog(QWidget *parent) : QWidget(parent), m_itemDelegate(ne
 		// Add the action to toggle the search dialog to this dialof as well in order to make sure that
 		// toggling it off again also works when the search dialog has focus.
 		addAction(Global::get().mw->qaSearch);
+
+		// Keep the index up to date
+		const UserModel *model = Global::get().mw->pmModel;
+		QObject::connect(model, &UserModel::userAdded, this, &SearchDialog::indexUser);
+		QObject::connect(model, &UserModel::userRenamed, this, &SearchDialog::indexUser);
+		QObject::connect(model, &UserModel::userRemoved, this, &SearchDialog::on_clientDisconnected);
+		QObject::connect(model, &UserModel::channelAdded, this, &SearchDialog::indexChannel);
+		QObject::connect(model, &UserModel::channelRenamed, this, &SearchDialog::indexChannel);
+		QObject::connect(model, &UserModel::channelRemoved, this, &SearchDialog::on_channelRemoved);
 	}
 	if (Global::get().sh) {
 		QObject::connect(Global::get().sh.get(), &ServerHandler::disconnected, this,
 						 &SearchDialog::on_serverDisconnected);
 	}
+
+	rebuildIndex();
 }
 
 void SearchDialog::on_toggleOptions_clicked() {
@@ -349,7 +373,41 @@ void SearchDialog::search(const QString &searchTerm) {
 
 	SearchResultMap matches;
 
-	// Start by searching for users
+	if (!useRegEx) {
+		// Only the names that contain the term's trigrams have to be looked at
+		for (const SearchIndex::Entry &entry : m_index.candidates(searchTerm)) {
+			if (entry.type == SearchType::User && searchUsers) {
+				const ClientUser *user = ClientUser::get(entry.id);
+				if (!user || !user->cChannel) {
+					continue;
+				}
+
+				SearchResult result = regularSearch(user->qsName, searchTerm, SearchType::User, caseSensitive);
+				if (result) {
+					result.channelHierarchy = getChannelHierarchy(*user->cChannel, true);
+					matches.insert({ result, user->uiSession });
+				}
+			} else if (entry.type == SearchType::Channel && searchChannels) {
+				const Channel *channel = Channel::get(entry.id);
+				if (!channel) {
+					continue;
+				}
+
+				SearchResult result = regularSearch(channel->qsName, searchTerm, SearchType::Channel, caseSensitive);
+				if (result) {
+					result.channelHierarchy = getChannelHierarchy(*channel, false);
+					matches.insert({ result, entry.id });
+				}
+			}
+		}
+
+		setSearchResults(matches);
+
+		return;
+	}
+
+	// A regular expression can't be looked up, so every name has to be matched against it. Start by searching for
+	// users.
 	if (searchUsers) {
 		QReadLocker userLock(&ClientUser::c_qrwlUsers);
 
@@ -357,12 +415,7 @@ void SearchDialog::search(const QString &searchTerm) {
 		while (it != ClientUser::c_qmUsers.constEnd()) {
 			const ClientUser *currentUser = it.value();
 
-			SearchResult result;
-			if (useRegEx) {
-				result = regexSearch(currentUser->qsName, regex, SearchType::User);
-			} else {
-				result = regularSearch(currentUser->qsName, searchTerm, SearchType::User, caseSensitive);
-			}
+			SearchResult result = regexSearch(currentUser->qsName, regex, SearchType::User);
 
 			if (result) {
 				result.channelHierarchy = getChannelHierarchy(*currentUser->cChannel, true);
@@ -381,12 +434,7 @@ void SearchDialog::search(const QString &searchTerm) {
 		while (it != Channel::c_qhChannels.constEnd()) {
 			const Channel *currentChannel = it.value();
 
-			SearchResult result;
-			if (useRegEx) {
-				result = regexSearch(currentChannel->qsName, regex, SearchType::Channel);
-			} else {
-				result = regularSearch(currentChannel->qsName, searchTerm, SearchType::Channel, caseSensitive);
-			}
+			SearchResult result = regexSearch(currentChannel->qsName, regex, SearchType::Channel);
 
 			if (result) {
 				result.channelHierarchy = getChannelHierarchy(*currentChannel, false);
@@ -413,37 +461,102 @@ void SearchDialog::on_serverConnectionSynchronized() {
 
 void SearchDialog::on_serverDisconnected() {
 	clearSearchResults();
+	m_index.clear();
 }
 
 void SearchDialog::on_clientDisconnected(unsigned int userSession) {
+	m_index.remove(SearchType::User, userSession);
 	removeSearchResult(userSession, true);
 }
 
 void SearchDialog::on_channelRemoved(unsigned int channelID) {
+	m_index.remove(SearchType::Channel, channelID);
 	removeSearchResult(channelID, false);
 }
 
+void SearchDialog::indexUser(unsigned int userSession) {
+	const ClientUser *user = ClientUser::get(userSession);
+	if (user) {
+		m_index.insert(SearchType::User, userSession, user->qsName);
+	}
+}
+
+void SearchDialog::indexChannel(unsigned int channelID) {
+	const Channel *channel = Channel::get(channelID);
+	if (channel) {
+		m_index.insert(SearchType::Channel, channelID, channel->qsName);
+	}
+}
+
+void SearchDialog::rebuildIndex() {
+	m_index.clear();
+
+	{
+		QReadLocker userLock(&ClientUser::c_qrwlUsers);
+
+		for (const ClientUser *user : ClientUser::c_qmUsers) {
+			m_index.insert(SearchType::User, user->uiSession, user->qsName);
+		}
+	}
+
+	QReadLocker channelLock(&Channel::c_qrwlChannels);
+
+	for (const Channel *channel : Channel::c_qhChannels) {
+		// As the channel ID is never negative, we can safely cast it to an unsigned int
+		m_index.insert(SearchType::Channel, static_cast< unsigned int >(channel->iId), channel->qsName);
+	}
+}
+
 void SearchDialog::setSearchResults(const SearchResultMap &results) {
-	// First clear all existing results
-	clearSearchResults();
+	// The items of the results that are still there are kept (along with the selection), so that typing only changes
+	// the rows whose results do
+	QHash< quint64, SearchResultItem * > previousItems;
+	for (int i = 0; i < searchResultTree->topLevelItemCount(); i++) {
+		SearchResultItem *item = static_cast< SearchResultItem * >(searchResultTree->topLevelItem(i));
+		previousItems.insert(SearchIndex::key(item->getResult().type, item->getID()), item);
+	}
+
+	QSet< quint64 > found;
+	for (const auto &current : results) {
+		found.insert(SearchIndex::key(current.first.type, current.second));
+	}
 
-	if (results.size() > 0) {
-		SearchResultMap::const_iterator it = results.cbegin();
+	auto it = previousItems.begin();
+	while (it != previousItems.end()) {
+		if (found.contains(it.key())) {
+			it++;
+		} else {
+			// Deleting an item removes it from the tree
+			delete it.value();
+			it = previousItems.erase(it);
+		}
+	}
 
-		SearchResultItem *previousItem = nullptr;
-		while (it != results.cend()) {
-			// Move the SearchResult out of the map
-			const SearchResult currentResult = std::move(it->first);
-			const unsigned int currentID     = it->second;
+	int row                        = 0;
+	SearchResultItem *previousItem = nullptr;
+	for (const auto &current : results) {
+		const SearchResult &currentResult = current.first;
+		const unsigned int currentID      = current.second;
 
+		SearchResultItem *item = previousItems.value(SearchIndex::key(currentResult.type, currentID));
+		if (item) {
+			item->setResult(currentResult);
+
+			// The rows before this one are in order already, so the item is either right here or further down
+			if (searchResultTree->topLevelItem(row) != item) {
+				searchResultTree->takeTopLevelItem(searchResultTree->indexOfTopLevelItem(item));
+				searchResultTree->insertTopLevelItem(row, item);
+			}
+		} else {
 			// Constructing this instance is enough to set everything up and adding it to the tree
 			// We have to add a pointer to the previous item so that this item is actually appended after
 			// the preceding one and thus the order of the map is preserved. Without this, the order would
 			// be reversed.
-			previousItem = new SearchResultItem(currentResult, currentID, searchResultTree, previousItem);
-
-			it++;
+			item = new SearchResultItem(currentResult, currentID, searchResultTree, previousItem);
 		}
+
+		previousItem = item;
+		row++;
 	}
 }
 
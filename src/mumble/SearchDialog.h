@@ -7,6 +7,7 @@
 #define MUMBLE_MUMBLE_SEARCHDIALOG_H_
 
 #include "MultiStyleWidgetWrapper.h"
+#include "SearchIndex.h"
 
 #include <QString>
 
@@ -27,11 +28,6 @@ class SearchDialogItemDelegate;
 
 namespace Search {
 
-/**
- * The type of a search result
- */
-enum class SearchType { User, Channel };
-
 /**
  * This struct represents a search result and contains some metainformation
  * on it.
@@ -124,11 +120,20 @@ public slots:
 	void on_serverDisconnected();
 	void on_clientDisconnected(unsigned int userSession);
 	void on_channelRemoved(unsigned int channelID);
+	/// Indexes the name of the given user (when it has been added or renamed)
+	void indexUser(unsigned int userSession);
+	/// Indexes the name of the given channel (when it has been added or renamed)
+	void indexChannel(unsigned int channelID);
 
 private:
 	MultiStyleWidgetWrapper m_searchFieldStyleWrapper;
 	std::unordered_set< void * > m_relayedKeyEvents;
 	std::unique_ptr< SearchDialogItemDelegate > m_itemDelegate;
+	/// The names of the server's users and channels
+	SearchIndex m_index;
+
+	/// Indexes all users and channels there are at the moment
+	void rebuildIndex();
 
 	void setSearchResults(const SearchResultMap &results);
 	void hideEvent(QHideEvent *event) override;
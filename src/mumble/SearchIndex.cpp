@@ -0,0 +1,105 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "SearchIndex.h"
+
+namespace Search {
+
+constexpr int SearchIndex::TRIGRAM_LENGTH;
+
+void SearchIndex::insert(SearchType type, unsigned int id, const QString &name) {
+	remove(type, id);
+
+	const quint64 entryKey = key(type, id);
+	m_entries.insert(entryKey, { type, id, name });
+
+	const QString folded = name.toCaseFolded();
+	for (int i = 0; i + TRIGRAM_LENGTH <= folded.size(); i++) {
+		m_trigrams[trigram(folded, i)].insert(entryKey);
+	}
+}
+
+void SearchIndex::remove(SearchType type, unsigned int id) {
+	const quint64 entryKey = key(type, id);
+
+	auto it = m_entries.find(entryKey);
+	if (it == m_entries.end()) {
+		return;
+	}
+
+	const QString folded = it->name.toCaseFolded();
+	for (int i = 0; i + TRIGRAM_LENGTH <= folded.size(); i++) {
+		auto postings = m_trigrams.find(trigram(folded, i));
+		if (postings != m_trigrams.end()) {
+			postings->remove(entryKey);
+
+			if (postings->isEmpty()) {
+				m_trigrams.erase(postings);
+			}
+		}
+	}
+
+	m_entries.erase(it);
+}
+
+void SearchIndex::clear() {
+	m_entries.clear();
+	m_trigrams.clear();
+}
+
+bool SearchIndex::contains(SearchType type, unsigned int id) const {
+	return m_entries.contains(key(type, id));
+}
+
+int SearchIndex::size() const {
+	return m_entries.size();
+}
+
+std::vector< SearchIndex::Entry > SearchIndex::candidates(const QString &term) const {
+	std::vector< Entry > result;
+
+	const QString folded = term.toCaseFolded();
+	if (folded.size() < TRIGRAM_LENGTH) {
+		result.reserve(static_cast< std::size_t >(m_entries.size()));
+		for (const Entry &entry : m_entries) {
+			result.push_back(entry);
+		}
+
+		return result;
+	}
+
+	// Every name containing the term contains all of its trigrams, so the entries of the rarest one are enough (the
+	// caller has to match the names anyway, to find where the term is)
+	const QSet< quint64 > *rarest = nullptr;
+	for (int i = 0; i + TRIGRAM_LENGTH <= folded.size(); i++) {
+		auto postings = m_trigrams.constFind(trigram(folded, i));
+		if (postings == m_trigrams.constEnd()) {
+			return result;
+		}
+
+		if (!rarest || postings->size() < rarest->size()) {
+			rarest = &postings.value();
+		}
+	}
+
+	result.reserve(static_cast< std::size_t >(rarest->size()));
+	for (const quint64 entryKey : *rarest) {
+		result.push_back(m_entries.value(entryKey));
+	}
+
+	return result;
+}
+
+quint64 SearchIndex::key(SearchType type, unsigned int id) {
+	return (static_cast< quint64 >(type) << 32) | id;
+}
+
+quint64 SearchIndex::trigram(const QString &foldedName, int position) {
+	return (static_cast< quint64 >(foldedName.at(position).unicode()) << 32)
+		   | (static_cast< quint64 >(foldedName.at(position + 1).unicode()) << 16)
+		   | foldedName.at(position + 2).unicode();
+}
+
+} // namespace Search
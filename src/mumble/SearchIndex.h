@@ -0,0 +1,71 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_SEARCHINDEX_H_
+#define MUMBLE_MUMBLE_SEARCHINDEX_H_
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include <vector>
+
+namespace Search {
+
+/**
+ * The type of a search result
+ */
+enum class SearchType { User, Channel };
+
+/**
+ * An index of the names of users and channels, which is kept up to date as they are added, renamed and removed (rather
+ * than being built for every search). It maps every trigram (three consecutive characters) of the case-folded names to
+ * the entries containing it, so that the entries whose names may contain a search term can be found without looking at
+ * any of the others.
+ */
+class SearchIndex {
+public:
+	struct Entry {
+		SearchType type;
+		unsigned int id;
+		QString name;
+	};
+
+	/**
+	 * Adds the given entry to the index, replacing the name it had if it is indexed already
+	 */
+	void insert(SearchType type, unsigned int id, const QString &name);
+	/**
+	 * Removes the given entry from the index (if it is in there)
+	 */
+	void remove(SearchType type, unsigned int id);
+	void clear();
+
+	bool contains(SearchType type, unsigned int id) const;
+	int size() const;
+
+	/**
+	 * @returns The entries whose names may contain the given term (ignoring the case), which includes every one that
+	 * does. A term shorter than a trigram can't be looked up, so every entry is returned for it.
+	 */
+	std::vector< Entry > candidates(const QString &term) const;
+
+	/**
+	 * @returns A key that identifies the given entry among those of both types
+	 */
+	static quint64 key(SearchType type, unsigned int id);
+
+private:
+	static constexpr int TRIGRAM_LENGTH = 3;
+
+	static quint64 trigram(const QString &foldedName, int position);
+
+	QHash< quint64, Entry > m_entries;
+	QHash< quint64, QSet< quint64 > > m_trigrams;
+};
+
+} // namespace Search
+
+#endif // MUMBLE_MUMBLE_SEARCHINDEX_H_
@@ -0,0 +1,65 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_SEQLOCK_H_
+#define MUMBLE_MUMBLE_SEQLOCK_H_
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/// A sequence lock publishing a value from a single writer to any number of readers.
+///
+/// Readers never block and never make the writer wait: they copy the value and retry if it has been written to in the
+/// meantime, which the sequence number tells (it is odd while a write is in progress). This suits small values that
+/// are written at a steady rate and read from real-time threads, such as the audio threads.
+///
+/// store() must not be called from several threads at once.
+template< typename T > class SeqLock {
+	static_assert(std::is_trivially_copyable< T >::value, "SeqLock copies its value byte by byte");
+
+public:
+	SeqLock() = default;
+	explicit SeqLock(const T &value) : m_value(value) {}
+
+	/// Publishes the given value
+	void store(const T &value) {
+		const unsigned int sequence = m_sequence.load(std::memory_order_relaxed);
+
+		m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		std::memcpy(&m_value, &value, sizeof(T));
+
+		m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/// @returns The value that has been published last
+	T load() const {
+		T value;
+		unsigned int before;
+		unsigned int after;
+
+		do {
+			before = m_sequence.load(std::memory_order_acquire);
+
+			std::memcpy(&value, &m_value, sizeof(T));
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = m_sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		return value;
+	}
+
+	/// @returns The number of values that have been published so far
+	unsigned int version() const { return m_sequence.load(std::memory_order_acquire) / 2; }
+
+protected:
+	std::atomic< unsigned int > m_sequence = { 0 };
+	T m_value                              = {};
+};
+
+#endif // MUMBLE_MUMBLE_SEQLOCK_H_
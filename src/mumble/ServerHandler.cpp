@@ -13,9 +13,11 @@
 #include "ServerHandler.h"
 
 #include "AudioInput.h"
+#include "AudioLatency.h"
 #include "AudioOutput.h"
 #include "Cert.h"
 #include "Connection.h"
+#include "ConnectionRacer.h"
 #include "Database.h"
 #include "HostAddress.h"
 #include "MainWindow.h"
@@ -23,6 +25,7 @@
 #include "NetworkConfig.h"
 #include "OSInfo.h"
 #include "PacketDataStream.h"
+#include "Profiler.h"
 #include "ProtoUtils.h"
 #include "RichTextEditor.h"
 #include "SSL.h"
@@ -40,7 +43,10 @@
 
 #include <openssl/crypto.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 
 #ifdef Q_OS_WIN
 // <delayimp.h> is not protected with an include guard on MinGW, resulting in
@@ -59,11 +65,14 @@
 #	endif
 #	include <netinet/ip.h>
 #	include <sys/socket.h>
+#	include <time.h>
 #endif
 
 // Init ServerHandler::nextConnectionID
 int ServerHandler::nextConnectionID = -1;
 QMutex ServerHandler::nextConnectionIDMutex;
+QHash< QString, QByteArray > ServerHandler::sessionTickets;
+QMutex ServerHandler::sessionTicketsMutex;
 
 ServerHandlerMessageEvent::ServerHandlerMessageEvent(const QByteArray &msg, Mumble::Protocol::TCPMessageType type,
 													 bool flush)
@@ -108,7 +117,11 @@ static HANDLE loadQoS() {
 }
 #endif
 
-ServerHandler::ServerHandler() : database(new Database(QLatin1String("ServerHandler"))) {
+ServerHandler::ServerHandler()
+	: database(new Database(QLatin1String("ServerHandler"))),
+	  m_pluginDataBatcher([this](const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
+		  sendProtoMessage(msg, type);
+	  }) {
 	cConnection.reset();
 	qusUdp                  = nullptr;
 	bStrong                 = false;
@@ -162,10 +175,19 @@ ServerHandler::ServerHandler() : database(new Database(QLatin1String("ServerHand
 #endif
 
 	connect(this, SIGNAL(pingRequested()), this, SLOT(sendPingInternal()), Qt::QueuedConnection);
+	connect(this, &ServerHandler::udpPingReceived, this, &ServerHandler::handleUdpPing, Qt::QueuedConnection);
+
+	m_udpProbeTimer = new QTimer(this);
+	m_udpProbeTimer->setInterval(UDP_PROBE_INTERVAL);
+	connect(m_udpProbeTimer, &QTimer::timeout, this, &ServerHandler::sendUdpProbe);
+
+	m_voiceThread.setObjectName(QLatin1String("Voice"));
 }
 
 ServerHandler::~ServerHandler() {
 	wait();
+	m_voiceThread.quit();
+	m_voiceThread.wait();
 	cConnection.reset();
 #ifdef Q_OS_WIN
 	if (hQoS) {
@@ -201,13 +223,138 @@ void ServerHandler::setProtocolVersion(Version::full_t version) {
 	m_version = version;
 
 	m_udpPingEncoder.setProtocolVersion(version);
-	m_udpDecoder.setProtocolVersion(version);
+	m_udpProtocolVersion.store(version);
 	m_tcpTunnelDecoder.setProtocolVersion(version);
 }
 
 void ServerHandler::udpReady() {
-	while (qusUdp->hasPendingDatagrams()) {
-		char encrypted[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+	MUMBLE_PROFILE_ZONE("ServerHandler::udpReady");
+	const Version::full_t protocolVersion = m_udpProtocolVersion.load();
+	if (protocolVersion != m_udpDecoderVersion) {
+		// The decoder may have upgraded the version on its own (see UDPDecoder::decode), so it is only overwritten if
+		// the handler has learned a new one
+		m_udpDecoder.setProtocolVersion(protocolVersion);
+		m_udpDecoderVersion = protocolVersion;
+	}
+
+	// In busy channels, lots of datagrams pile up between two wakeups. They are read in batches and their audio is
+	// handed to the audio output in one go, instead of locking the outputs for every single packet.
+	std::size_t received = 0;
+	do {
+		received = receiveDatagrams(true);
+
+		for (std::size_t i = 0; i < received; ++i) {
+			handleDatagram(m_datagrams[i]);
+		}
+
+		flushAudioBatch();
+	} while (received == m_datagrams.size());
+
+#ifdef Q_OS_LINUX
+	// QUdpSocket only re-enables its read notification once a datagram has been read through it, which recvmmsg
+	// bypasses. Whatever has arrived in the meantime is read through it, otherwise the (empty) socket is read
+	// without a buffer, which re-enables the notification without discarding anything.
+	received = receiveDatagrams(false);
+	for (std::size_t i = 0; i < received; ++i) {
+		handleDatagram(m_datagrams[i]);
+	}
+	flushAudioBatch();
+
+	if (received == 0) {
+		qusUdp->readDatagram(nullptr, 0);
+	}
+#endif
+}
+
+std::size_t ServerHandler::receiveDatagrams(bool native) {
+	m_datagramsReceived = AudioLatency::now();
+
+#ifdef Q_OS_LINUX
+	const int sock = static_cast< int >(qusUdp->socketDescriptor());
+	if (native && sock != -1) {
+		std::array< struct mmsghdr, UDP_BATCH_SIZE > msgs;
+		std::array< struct iovec, UDP_BATCH_SIZE > iovecs;
+		std::array< struct sockaddr_storage, UDP_BATCH_SIZE > addresses;
+		// Room for the timestamp of every datagram
+		union Control {
+			struct cmsghdr header;
+			char data[CMSG_SPACE(sizeof(struct timespec))];
+		};
+		std::array< Control, UDP_BATCH_SIZE > controls;
+
+		for (std::size_t i = 0; i < msgs.size(); ++i) {
+			iovecs[i].iov_base = m_datagrams[i].data.data();
+			iovecs[i].iov_len  = m_datagrams[i].data.size();
+
+			std::memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name    = &addresses[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+			msgs[i].msg_hdr.msg_iov     = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+			if (m_kernelTimestamps) {
+				msgs[i].msg_hdr.msg_control    = controls[i].data;
+				msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+			}
+		}
+
+		const int count =
+			::recvmmsg(sock, msgs.data(), static_cast< unsigned int >(msgs.size()), MSG_DONTWAIT, nullptr);
+		if (count <= 0) {
+			return 0;
+		}
+
+		// The kernel's timestamps are taken from the realtime clock, so they are converted into the clock of
+		// AudioLatency::now() through how long ago they have been taken
+		struct timespec realtime = {};
+		if (m_kernelTimestamps) {
+			clock_gettime(CLOCK_REALTIME, &realtime);
+		}
+
+		const HostAddress remote(qhaRemote);
+		for (std::size_t i = 0; i < static_cast< std::size_t >(count); ++i) {
+			Datagram &datagram = m_datagrams[i];
+
+			// Datagrams that exceed our buffer's size are discarded, as it is not very likely that the data is valid
+			// in the trimmed down form
+			datagram.length  = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+			datagram.arrival = m_datagramsReceived;
+
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg;
+				 cmsg                 = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+				if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS) {
+					continue;
+				}
+
+				struct timespec stamp;
+				std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+				const qint64 age = (static_cast< qint64 >(realtime.tv_sec) - static_cast< qint64 >(stamp.tv_sec))
+									   * 1000000
+								   + (realtime.tv_nsec - stamp.tv_nsec) / 1000;
+				// Timestamps from the future or from long ago are due to the clock having been set in between
+				if (age > 0 && static_cast< quint64 >(age) < MAX_TIMESTAMP_AGE
+					&& static_cast< quint64 >(age) < m_datagramsReceived) {
+					datagram.arrival = m_datagramsReceived - static_cast< quint64 >(age);
+				}
+			}
+
+			quint16 port = 0;
+			if (addresses[i].ss_family == AF_INET) {
+				port = ntohs(reinterpret_cast< const struct sockaddr_in * >(&addresses[i])->sin_port);
+			} else if (addresses[i].ss_family == AF_INET6) {
+				port = ntohs(reinterpret_cast< const struct sockaddr_in6 * >(&addresses[i])->sin6_port);
+			}
+			datagram.fromServer = HostAddress(addresses[i]) == remote && port == usResolvedPort;
+		}
+
+		return static_cast< std::size_t >(count);
+	}
+#else
+	Q_UNUSED(native);
+#endif
+
+	std::size_t count = 0;
+	while (count < m_datagrams.size() && qusUdp->hasPendingDatagrams()) {
+		Datagram &datagram  = m_datagrams[count++];
 		unsigned int buflen = static_cast< unsigned int >(qusUdp->pendingDatagramSize());
 
 		if (buflen > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
@@ -216,33 +363,49 @@ void ServerHandler::udpReady() {
 			// As we're using a maxSize of 0 it is okay to pass nullptr as the data buffer. Qt's docs (5.15) ensures
 			// that a maxSize of 0 means discarding the datagram.
 			qusUdp->readDatagram(nullptr, 0);
+			datagram.length  = 0;
+			datagram.arrival = m_datagramsReceived;
 			continue;
 		}
 
 		QHostAddress senderAddr;
 		quint16 senderPort;
-		qusUdp->readDatagram(encrypted, buflen, &senderAddr, &senderPort);
+		qusUdp->readDatagram(datagram.data.data(), buflen, &senderAddr, &senderPort);
 
-		if (!(HostAddress(senderAddr) == HostAddress(qhaRemote)) || (senderPort != usResolvedPort))
-			continue;
+		datagram.length     = buflen;
+		datagram.fromServer = HostAddress(senderAddr) == HostAddress(qhaRemote) && senderPort == usResolvedPort;
+		datagram.arrival    = m_datagramsReceived;
+	}
 
-		ConnectionPtr connection(cConnection);
-		if (!connection)
-			continue;
+	return count;
+}
 
-		if (!connection->csCrypt->isValid())
-			continue;
+void ServerHandler::handleDatagram(const Datagram &datagram) {
+	const unsigned int buflen = datagram.length;
+	if (buflen == 0 || !datagram.fromServer)
+		return;
 
-		if (buflen < 5)
-			continue;
+	ConnectionPtr connection(cConnection);
+	if (!connection)
+		return;
+
+	gsl::span< Mumble::Protocol::byte > buffer = m_udpDecoder.getBuffer();
+	unsigned int plainLength                   = 0;
+	{
+		QMutexLocker cryptLock(&connection->qmCrypt);
+
+		if (!connection->csCrypt->isValid())
+			return;
 
-		gsl::span< Mumble::Protocol::byte > buffer = m_udpDecoder.getBuffer();
+		// The packet has to contain at least the message type
+		if (buflen <= connection->csCrypt->overhead())
+			return;
 
-		// 4 bytes is the overhead of the encryption
-		assert(buffer.size() >= buflen - 4);
+		plainLength = buflen - connection->csCrypt->overhead();
+		assert(buffer.size() >= plainLength);
 
-		if (!connection->csCrypt->decrypt(reinterpret_cast< const unsigned char * >(encrypted), buffer.data(),
-										  buflen)) {
+		if (!connection->csCrypt->decrypt(reinterpret_cast< const unsigned char * >(datagram.data.data()),
+										  buffer.data(), buflen)) {
 			if (connection->csCrypt->tLastGood.elapsed() > 5000000ULL) {
 				if (connection->csCrypt->tLastRequest.elapsed() > 5000000ULL) {
 					connection->csCrypt->tLastRequest.restart();
@@ -250,48 +413,113 @@ void ServerHandler::udpReady() {
 					sendMessage(mpcs);
 				}
 			}
-			continue;
+			return;
 		}
+	}
 
-		if (m_udpDecoder.decode(buffer.subspan(0, buflen - 4))) {
-			switch (m_udpDecoder.getMessageType()) {
-				case Mumble::Protocol::UDPMessageType::Ping: {
-					const Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
+	if (m_udpDecoder.decode(buffer.subspan(0, plainLength))) {
+		switch (m_udpDecoder.getMessageType()) {
+			case Mumble::Protocol::UDPMessageType::Ping: {
+				const Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
 
-					accUDP(static_cast< double >(tTimestamp.elapsed() - pingData.timestamp) / 1000.0);
+				// The time the voice thread has taken to get to the datagram isn't part of the round trip
+				const quint64 elapsed = tTimestamp.elapsed() - pingData.timestamp;
+				const quint64 delay   = AudioLatency::now() - datagram.arrival;
+				const double ping     = static_cast< double >(elapsed - std::min(delay, elapsed)) / 1000.0;
+				AudioLatency::record(AudioLatency::Stage::Network, static_cast< quint64 >(ping * 1000.0 / 2.0));
 
-					break;
-				}
-				case Mumble::Protocol::UDPMessageType::Audio: {
-					const Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
+				m_bitrateHint = static_cast< int >(pingData.bitrateHint);
 
-					handleVoicePacket(audioData);
-					break;
-				};
+				// The statistics are kept in the handler's thread
+				emit udpPingReceived(ping);
+
+				break;
 			}
+			case Mumble::Protocol::UDPMessageType::Audio: {
+				Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
+
+				ClientUser *sender = voiceSender(audioData);
+				if (sender && audioData.payload.size() <= Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+					// The payload points into the decoder's buffer, which is reused for the next datagram
+					std::array< Mumble::Protocol::byte, Mumble::Protocol::MAX_UDP_PACKET_SIZE > &payload =
+						m_audioPayloads[m_audioBatch.size()];
+					std::copy(audioData.payload.begin(), audioData.payload.end(), payload.begin());
+					audioData.payload =
+						gsl::span< const Mumble::Protocol::byte >(payload.data(), audioData.payload.size());
+
+					m_audioBatch.push_back({ sender, audioData, datagram.arrival });
+				}
+				break;
+			};
 		}
 	}
 }
 
-void ServerHandler::handleVoicePacket(const Mumble::Protocol::AudioData &audioData) {
+void ServerHandler::handleUdpPing(double ping) {
+	accUDP(ping);
+
+	if (m_lastUdpPing >= 0.0) {
+		m_udpJitter += (std::abs(ping - m_lastUdpPing) - m_udpJitter) / 16.0;
+	}
+	m_lastUdpPing = ping;
+
+	m_udpPingsUnanswered = 0;
+	m_udpPingsAnswered += 1;
+	m_udpProbes = 0;
+
+	if (m_udpPathLost && !m_udpProbeTimer->isActive()) {
+		// The regular pings are answered again, so the probes confirm whether the path is back for good
+		m_udpPingsAnswered = 1;
+		m_udpProbeTimer->start();
+	}
+}
+
+void ServerHandler::flushAudioBatch() {
+	if (m_audioBatch.empty()) {
+		return;
+	}
+
+	AudioOutputPtr ao = Global::get().ao;
+	if (ao) {
+		ao->addFramesToBuffer(m_audioBatch);
+
+		const quint64 now = AudioLatency::now();
+		for (const AudioOutput::ReceivedFrame &frame : m_audioBatch) {
+			AudioLatency::record(AudioLatency::Stage::Receive, now - frame.arrival);
+		}
+	}
+
+	m_audioBatch.clear();
+}
+
+ClientUser *ServerHandler::voiceSender(const Mumble::Protocol::AudioData &audioData) const {
 	if (audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
 		qWarning("Dropping audio packet using invalid codec (not Opus): %d", static_cast< int >(audioData.usedCodec));
-		return;
+		return nullptr;
 	}
 
 	ClientUser *sender = ClientUser::get(audioData.senderSession);
 
-	AudioOutputPtr ao = Global::get().ao;
-	if (ao && sender
+	if (sender
 		&& !((audioData.targetOrContext == Mumble::Protocol::AudioContext::WHISPER) && Global::get().s.bWhisperFriends
 			 && sender->qsFriendName.isEmpty())) {
+		return sender;
+	}
+
+	return nullptr;
+}
+
+void ServerHandler::handleVoicePacket(const Mumble::Protocol::AudioData &audioData) {
+	ClientUser *sender = voiceSender(audioData);
+
+	AudioOutputPtr ao = Global::get().ao;
+	if (ao && sender) {
 		ao->addFrameToBuffer(sender, audioData);
 	}
 }
 
-void ServerHandler::sendMessage(const unsigned char *data, int len, bool force) {
+void ServerHandler::sendMessage(const unsigned char *data, int len, bool force, quint64 encoded) {
 	static std::vector< unsigned char > crypto;
-	crypto.resize(static_cast< std::size_t >(len + 4));
 
 	QMutexLocker qml(&qmUdp);
 
@@ -299,10 +527,14 @@ void ServerHandler::sendMessage(const unsigned char *data, int len, bool force)
 		return;
 
 	ConnectionPtr connection(cConnection);
-	if (!connection || !connection->csCrypt->isValid())
+	if (!connection)
+		return;
+
+	QMutexLocker cryptLock(&connection->qmCrypt);
+	if (!connection->csCrypt->isValid())
 		return;
 
-	if (!force && (NetworkConfig::TcpModeEnabled() || !bUdp)) {
+	if (!force && (NetworkConfig::TcpModeEnabled() || !bUdp || m_udpPathLost)) {
 		QByteArray qba;
 
 		qba.resize(len + 6);
@@ -315,12 +547,66 @@ void ServerHandler::sendMessage(const unsigned char *data, int len, bool force)
 		QApplication::postEvent(this,
 								new ServerHandlerMessageEvent(qba, Mumble::Protocol::TCPMessageType::UDPTunnel, true));
 	} else {
+		const int cryptedLength = len + static_cast< int >(connection->csCrypt->overhead());
+		crypto.resize(static_cast< std::size_t >(cryptedLength));
+
 		if (!connection->csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data), crypto.data(),
 										  static_cast< unsigned int >(len))) {
 			return;
 		}
-		qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto.data()), len + 4, qhaRemote, usResolvedPort);
+		// The voice thread needs the crypt state to decrypt what it receives. The buffer is still protected by qmUdp.
+		cryptLock.unlock();
+
+		// This is usually called in the audio input's thread while the socket is being read in the voice thread.
+		// The datagram is sent through the socket's descriptor, which makes sure that neither of them touches the
+		// state of the QUdpSocket while the other one does. The socket is non-blocking, so a full send buffer drops
+		// the datagram, as writeDatagram() would.
+		if (!sendDatagram(static_cast< qintptr >(qusUdp->socketDescriptor()),
+						  reinterpret_cast< const char * >(crypto.data()), cryptedLength)) {
+			qusUdp->writeDatagram(reinterpret_cast< const char * >(crypto.data()), cryptedLength, qhaRemote,
+								  usResolvedPort);
+		}
+	}
+
+	// When tunneled through TCP, the time until the message event is processed isn't part of this
+	AudioLatency::recordSince(AudioLatency::Stage::Send, encoded);
+}
+
+bool ServerHandler::sendDatagram(qintptr socket, const char *data, int len) const {
+	if (socket == -1) {
+		return false;
+	}
+
+	struct sockaddr_storage address;
+	std::memset(&address, 0, sizeof(address));
+	int addressLength = 0;
+
+	if (qhaRemote.protocol() == QAbstractSocket::IPv6Protocol) {
+		struct sockaddr_in6 *in6 = reinterpret_cast< struct sockaddr_in6 * >(&address);
+		const Q_IPV6ADDR ip      = qhaRemote.toIPv6Address();
+
+		in6->sin6_family = AF_INET6;
+		in6->sin6_port   = htons(usResolvedPort);
+		std::memcpy(&in6->sin6_addr, &ip, sizeof(ip));
+		addressLength = sizeof(struct sockaddr_in6);
+	} else {
+		struct sockaddr_in *in = reinterpret_cast< struct sockaddr_in * >(&address);
+
+		in->sin_family      = AF_INET;
+		in->sin_port        = htons(usResolvedPort);
+		in->sin_addr.s_addr = htonl(qhaRemote.toIPv4Address());
+		addressLength       = sizeof(struct sockaddr_in);
 	}
+
+#ifdef Q_OS_WIN
+	::sendto(static_cast< SOCKET >(socket), data, len, 0, reinterpret_cast< const struct sockaddr * >(&address),
+			 addressLength);
+#else
+	::sendto(static_cast< int >(socket), data, static_cast< std::size_t >(len), 0,
+			 reinterpret_cast< const struct sockaddr * >(&address), static_cast< socklen_t >(addressLength));
+#endif
+
+	return true;
 }
 
 void ServerHandler::sendProtoMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
@@ -339,6 +625,14 @@ void ServerHandler::sendProtoMessage(const ::google::protobuf::Message &msg, Mum
 	}
 }
 
+void ServerHandler::sendPluginData(const MumbleProto::PluginDataTransmission &msg) {
+	m_pluginDataBatcher.send(msg);
+}
+
+void ServerHandler::setPluginDataBatching(bool enabled) {
+	m_pluginDataBatcher.setEnabled(enabled);
+}
+
 bool ServerHandler::isConnected() const {
 	// If the digest isn't empty, then we are currently connected to a server (the digest being a hash
 	// of the server's certificate)
@@ -354,14 +648,30 @@ void ServerHandler::setServerSynchronized(bool synchronized) {
 }
 
 void ServerHandler::hostnameResolved() {
-	ServerResolver *sr                    = qobject_cast< ServerResolver * >(QObject::sender());
-	QList< ServerResolverRecord > records = sr->records();
+	ServerResolver *sr = qobject_cast< ServerResolver * >(QObject::sender());
 
 	// Exit the ServerHandler thread's event loop with an
 	// error code in case our hostname lookup failed.
-	if (records.isEmpty()) {
-		exit(-1);
-		return;
+	exit(sr->records().isEmpty() ? -1 : 0);
+}
+
+bool ServerHandler::resolveAddresses(bool useCache) {
+	QList< ServerResolverRecord > records;
+	if (useCache) {
+		records = database->getResolved(qsHostName, usPort);
+	}
+
+	m_addressesCached = !records.isEmpty();
+	if (!m_addressesCached) {
+		ServerResolver sr;
+		QObject::connect(&sr, SIGNAL(resolved()), this, SLOT(hostnameResolved()));
+		sr.resolve(qsHostName, usPort);
+		if (exec() < 0) {
+			return false;
+		}
+
+		records = sr.records();
+		database->setResolved(qsHostName, usPort, records, sr.timeToLive());
 	}
 
 	// Create the list of target host:port pairs
@@ -378,23 +688,59 @@ void ServerHandler::hostnameResolved() {
 	qlAddresses = ql;
 	qhHostnames = qh;
 
-	// Exit the event loop with 'success' status code,
-	// to continue connecting to the server.
-	exit(0);
+	return true;
+}
+
+bool ServerHandler::raceAddresses() {
+	ConnectionRacer racer;
+	connect(&racer, &ConnectionRacer::finished, this, &QThread::quit);
+	racer.race(qlAddresses, Global::get().s.iConnectionTimeoutDurationMsec);
+	exec();
+
+	// The addresses that lost the race are still tried afterwards, in the order they have been raced in
+	const ServerAddress winner = racer.winner();
+	qlAddresses                = ConnectionRacer::interleave(qlAddresses);
+	if (!winner.isValid()) {
+		return false;
+	}
+
+	qlAddresses.removeOne(winner);
+	qlAddresses.prepend(winner);
+	return true;
+}
+
+void ServerHandler::storeSessionTicket() {
+	const QByteArray ticket = qtsSock->sslConfiguration().sessionTicket();
+	if (ticket.isEmpty()) {
+		return;
+	}
+
+	QMutexLocker lock(&sessionTicketsMutex);
+	sessionTickets.insert(qsHostName + QLatin1Char(':') + QString::number(usPort), ticket);
 }
 
 void ServerHandler::run() {
 	// Resolve the hostname...
-	{
-		ServerResolver sr;
-		QObject::connect(&sr, SIGNAL(resolved()), this, SLOT(hostnameResolved()));
-		sr.resolve(qsHostName, usPort);
-		int ret = exec();
-		if (ret < 0) {
+	if (!resolveAddresses(true)) {
+		qWarning("ServerHandler: failed to resolve hostname");
+		emit error(QAbstractSocket::HostNotFoundError, tr("Unable to resolve hostname"));
+		return;
+	}
+
+	// ...and find the address that accepts connections the fastest. Addresses taken from the cache are raced even
+	// if there is only one of them, since the server may have moved in the meantime.
+	if ((qlAddresses.size() > 1 || m_addressesCached) && !raceAddresses() && m_addressesCached) {
+		database->removeResolved(qsHostName, usPort);
+
+		if (!resolveAddresses(false)) {
 			qWarning("ServerHandler: failed to resolve hostname");
 			emit error(QAbstractSocket::HostNotFoundError, tr("Unable to resolve hostname"));
 			return;
 		}
+
+		if (qlAddresses.size() > 1) {
+			raceAddresses();
+		}
 	}
 
 	QList< ServerAddress > targetAddresses(qlAddresses);
@@ -418,6 +764,16 @@ void ServerHandler::run() {
 			qtsSock->setSslConfiguration(config);
 		}
 
+		{
+			QSslConfiguration config = qtsSock->sslConfiguration();
+			// Without this, Qt discards the session tickets issued by the server
+			config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+			QMutexLocker lock(&sessionTicketsMutex);
+			config.setSessionTicket(sessionTickets.value(qsHostName + QLatin1Char(':') + QString::number(usPort)));
+			qtsSock->setSslConfiguration(config);
+		}
+
 		{
 			ConnectionPtr connection(new Connection(this, qtsSock));
 			cConnection = connection;
@@ -477,6 +833,11 @@ void ServerHandler::run() {
 		if (qusUdp) {
 			QMutexLocker qml(&qmUdp);
 
+			// The socket is deleted in its own thread, which does so before it finishes
+			qusUdp->deleteLater();
+			m_voiceThread.quit();
+			m_voiceThread.wait();
+
 #ifdef Q_OS_WIN
 			if (hQoS) {
 				if (!QOSRemoveSocketFromFlow(hQoS, 0, dwFlowUDP, 0)) {
@@ -488,7 +849,6 @@ void ServerHandler::run() {
 				dwFlowUDP = 0;
 			}
 #endif
-			delete qusUdp;
 			qusUdp = nullptr;
 		}
 
@@ -503,6 +863,8 @@ void ServerHandler::run() {
 		while (!cptr.unique()) {
 			msleep(100);
 		}
+		// TLS 1.3 servers issue their tickets after the handshake, so the socket is asked once more before it's gone
+		storeSessionTicket();
 		delete qtsSock;
 		delete tConnectionTimeoutTimer;
 	} while (shouldTryNextTargetServer && !qlAddresses.isEmpty());
@@ -583,23 +945,27 @@ void ServerHandler::sendPingInternal() {
 	quint64 t = tTimestamp.elapsed();
 
 	if (qusUdp) {
-		Mumble::Protocol::PingData pingData;
-		pingData.timestamp                    = t;
-		pingData.requestAdditionalInformation = false;
-
-		m_udpPingEncoder.setProtocolVersion(m_version);
-		gsl::span< const Mumble::Protocol::byte > encodedPacket = m_udpPingEncoder.encodePingPacket(pingData);
+		if (m_udpPingsUnanswered > 0 && bUdp && !m_udpPathLost && !NetworkConfig::TcpModeEnabled()
+			&& !m_udpProbeTimer->isActive()) {
+			// The previous ping hasn't been answered, so the path may be gone (e.g. because a NAT has rebound our
+			// port). Rather than waiting for the next regular ping, it is probed right away.
+			m_udpProbes = 0;
+			m_udpProbeTimer->start();
+		}
 
-		sendMessage(encodedPacket.data(), static_cast< int >(encodedPacket.size()), true);
+		sendUdpPing(connection);
 	}
 
 	MumbleProto::Ping mpp;
 
 	mpp.set_timestamp(t);
-	mpp.set_good(connection->csCrypt->uiGood);
-	mpp.set_late(connection->csCrypt->uiLate);
-	mpp.set_lost(connection->csCrypt->uiLost);
-	mpp.set_resync(connection->csCrypt->uiResync);
+	{
+		QMutexLocker cryptLock(&connection->qmCrypt);
+		mpp.set_good(connection->csCrypt->uiGood);
+		mpp.set_late(connection->csCrypt->uiLate);
+		mpp.set_lost(connection->csCrypt->uiLost);
+		mpp.set_resync(connection->csCrypt->uiResync);
+	}
 
 
 	if (boost::accumulators::count(accUDP)) {
@@ -619,6 +985,68 @@ void ServerHandler::sendPingInternal() {
 	iInFlightTCPPings += 1;
 }
 
+void ServerHandler::sendUdpPing(const ConnectionPtr &connection) {
+	Mumble::Protocol::PingData pingData;
+	pingData.timestamp                    = tTimestamp.elapsed();
+	pingData.requestAdditionalInformation = false;
+	pingData.jitter                       = static_cast< std::uint32_t >(std::lround(m_udpJitter));
+	{
+		QMutexLocker cryptLock(&connection->qmCrypt);
+		const unsigned int good = connection->csCrypt->uiGood - m_lastLocalGood;
+		const unsigned int lost = connection->csCrypt->uiLost - m_lastLocalLost;
+		m_lastLocalGood         = connection->csCrypt->uiGood;
+		m_lastLocalLost         = connection->csCrypt->uiLost;
+
+		const quint64 sent  = static_cast< quint64 >(good) + lost;
+		pingData.packetLoss = sent == 0 ? 0 : static_cast< std::uint32_t >((100 * lost + sent - 1) / sent);
+	}
+
+	m_udpPingEncoder.setProtocolVersion(m_version);
+	gsl::span< const Mumble::Protocol::byte > encodedPacket = m_udpPingEncoder.encodePingPacket(pingData);
+
+	if (m_udpPingsUnanswered > 0) {
+		m_udpPingsAnswered = 0;
+	}
+	m_udpPingsUnanswered += 1;
+
+	sendMessage(encodedPacket.data(), static_cast< int >(encodedPacket.size()), true);
+}
+
+void ServerHandler::sendUdpProbe() {
+	ConnectionPtr connection(cConnection);
+	if (!connection || !qusUdp || !bUdp || NetworkConfig::TcpModeEnabled()) {
+		m_udpProbeTimer->stop();
+		m_udpPathLost = false;
+		return;
+	}
+
+	if (m_udpPathLost) {
+		if (m_udpPingsAnswered >= UDP_PROBES_ANSWERED) {
+			m_udpPathLost = false;
+			m_udpProbeTimer->stop();
+			qWarning("ServerHandler: UDP path has recovered, no longer tunneling voice through TCP");
+			return;
+		}
+	} else if (m_udpPingsUnanswered >= UDP_PROBES_LOST) {
+		m_udpPathLost = true;
+		qWarning("ServerHandler: UDP path is lost, tunneling voice through TCP");
+	} else if (m_udpPingsUnanswered == 0 && m_udpPingsAnswered >= UDP_PROBES_ANSWERED) {
+		// It has only been a single lost ping
+		m_udpProbeTimer->stop();
+		return;
+	}
+
+	if (m_udpProbes >= MAX_UDP_PROBES) {
+		// The path is gone for longer, so probing it that often is a waste. The regular pings restart the probes as
+		// soon as one of them is answered.
+		m_udpProbeTimer->stop();
+		return;
+	}
+
+	m_udpProbes += 1;
+	sendUdpPing(connection);
+}
+
 void ServerHandler::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qbaMsg) {
 	const char *ptr = qbaMsg.constData();
 	if (type == Mumble::Protocol::TCPMessageType::UDPTunnel) {
@@ -644,20 +1072,41 @@ void ServerHandler::message(Mumble::Protocol::TCPMessageType type, const QByteAr
 			// connection is still OK.
 			iInFlightTCPPings = 0;
 
-			connection->csCrypt->uiRemoteGood   = msg.good();
-			connection->csCrypt->uiRemoteLate   = msg.late();
-			connection->csCrypt->uiRemoteLost   = msg.lost();
-			connection->csCrypt->uiRemoteResync = msg.resync();
+			unsigned int remoteGood = 0;
+			unsigned int good       = 0;
+			{
+				QMutexLocker cryptLock(&connection->qmCrypt);
+				connection->csCrypt->uiRemoteGood   = msg.good();
+				connection->csCrypt->uiRemoteLate   = msg.late();
+				connection->csCrypt->uiRemoteLost   = msg.lost();
+				connection->csCrypt->uiRemoteResync = msg.resync();
+
+				remoteGood = connection->csCrypt->uiRemoteGood;
+				good       = connection->csCrypt->uiGood;
+			}
+
+			// The counters start over whenever the crypt state is reset
+			const unsigned int goodSincePing =
+				msg.good() >= m_lastRemoteGood ? msg.good() - m_lastRemoteGood : msg.good();
+			const unsigned int lostSincePing =
+				msg.lost() >= m_lastRemoteLost ? msg.lost() - m_lastRemoteLost : msg.lost();
+			m_lastRemoteGood = msg.good();
+			m_lastRemoteLost = msg.lost();
+
+			const quint64 sentSincePing = static_cast< quint64 >(goodSincePing) + lostSincePing;
+			// Rounded up, so that any loss counts
+			m_uplinkLoss = sentSincePing == 0
+							   ? 0
+							   : static_cast< int >((100 * lostSincePing + sentSincePing - 1) / sentSincePing);
 			accTCP(static_cast< double >(tTimestamp.elapsed() - msg.timestamp()) / 1000.0);
 
-			if (((connection->csCrypt->uiRemoteGood == 0) || (connection->csCrypt->uiGood == 0)) && bUdp
-				&& (tTimestamp.elapsed() > 20000000ULL)) {
+			if (((remoteGood == 0) || (good == 0)) && bUdp && (tTimestamp.elapsed() > 20000000ULL)) {
 				bUdp = false;
 				if (!NetworkConfig::TcpModeEnabled()) {
-					if ((connection->csCrypt->uiRemoteGood == 0) && (connection->csCrypt->uiGood == 0))
+					if ((remoteGood == 0) && (good == 0))
 						Global::get().mw->msgBox(
 							tr("UDP packets cannot be sent to or received from the server. Switching to TCP mode."));
-					else if (connection->csCrypt->uiRemoteGood == 0)
+					else if (remoteGood == 0)
 						Global::get().mw->msgBox(
 							tr("UDP packets cannot be sent to the server. Switching to TCP mode."));
 					else
@@ -666,7 +1115,7 @@ void ServerHandler::message(Mumble::Protocol::TCPMessageType type, const QByteAr
 
 					database->setUdp(qbaDigest, false);
 				}
-			} else if (!bUdp && (connection->csCrypt->uiRemoteGood > 3) && (connection->csCrypt->uiGood > 3)) {
+			} else if (!bUdp && (remoteGood > 3) && (good > 3)) {
 				bUdp = true;
 				if (!NetworkConfig::TcpModeEnabled()) {
 					Global::get().mw->msgBox(
@@ -757,8 +1206,16 @@ void ServerHandler::serverConnectionConnected() {
 	connectionUsesPerfectForwardSecrecy = !qtsSock->sslConfiguration().ephemeralServerKey().isNull();
 #endif
 
+	storeSessionTicket();
+
 	iInFlightTCPPings = 0;
 
+	m_udpProbeTimer->stop();
+	m_udpPingsUnanswered = 0;
+	m_udpPingsAnswered   = 0;
+	m_udpProbes          = 0;
+	m_udpPathLost        = false;
+
 	tConnectionTimeoutTimer->stop();
 
 	if (Global::get().s.bQoS)
@@ -799,6 +1256,14 @@ void ServerHandler::serverConnectionConnected() {
 		mpa.add_tokens(u8(qs));
 
 	mpa.set_opus(true);
+	for (CryptMode mode : CryptState::preferredModes()) {
+		mpa.add_crypt_modes(static_cast< MumbleProto::CryptSetup_Mode >(mode));
+	}
+	mpa.set_state_snapshot(true);
+	mpa.set_voice_redundancy(true);
+	mpa.set_plugin_data_batches(true);
+	mpa.set_text_message_history(true);
+	mpa.set_small_audio_frames(true);
 	sendMessage(mpa);
 
 	{
@@ -811,7 +1276,8 @@ void ServerHandler::serverConnectionConnected() {
 			qFatal("ServerHandler: qhaLocal is unexpectedly a null addr");
 		}
 
-		qusUdp = new QUdpSocket(this);
+		// The socket has no parent, as it is moved to the voice thread
+		qusUdp = new QUdpSocket();
 		if (!qusUdp) {
 			qFatal("ServerHandler: qusUdp is unexpectedly a null addr");
 		}
@@ -825,7 +1291,17 @@ void ServerHandler::serverConnectionConnected() {
 			}
 		}
 
-		connect(qusUdp, SIGNAL(readyRead()), this, SLOT(udpReady()));
+		// The socket is the context of the connection, so that the datagrams are handled in its thread
+		connect(qusUdp, &QUdpSocket::readyRead, qusUdp, [this]() { udpReady(); });
+
+#ifdef Q_OS_LINUX
+		// The kernel's receive timestamps keep the scheduling of the voice thread out of the arrival times the
+		// jitter buffers and the ping statistics work with
+		int timestamps     = 1;
+		m_kernelTimestamps = setsockopt(static_cast< int >(qusUdp->socketDescriptor()), SOL_SOCKET, SO_TIMESTAMPNS,
+										&timestamps, sizeof(timestamps))
+							 == 0;
+#endif
 
 		if (Global::get().s.bQoS) {
 #if defined(Q_OS_UNIX)
@@ -862,6 +1338,12 @@ void ServerHandler::serverConnectionConnected() {
 			}
 #endif
 		}
+
+		m_udpDecoderVersion = m_udpProtocolVersion.load();
+		m_udpDecoder.setProtocolVersion(m_udpDecoderVersion);
+
+		m_voiceThread.start(QThread::TimeCriticalPriority);
+		qusUdp->moveToThread(&m_voiceThread);
 	}
 
 	emit connected();
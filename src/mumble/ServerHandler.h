@@ -32,11 +32,19 @@
 
 #define SERVERSEND_EVENT 3501
 
+#include "AudioOutput.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
+#include "PluginDataBatcher.h"
 #include "ServerAddress.h"
 #include "Timer.h"
 
+#include <array>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+class ClientUser;
 class Connection;
 class Database;
 class PacketDataStream;
@@ -64,6 +72,11 @@ private:
 	static QMutex nextConnectionIDMutex;
 	static int nextConnectionID;
 
+	/// The TLS session tickets the servers have last issued by "hostname:port", which let the next connection to the
+	/// same server skip the full handshake. They are kept in memory only, as they are as secret as the session keys.
+	static QHash< QString, QByteArray > sessionTickets;
+	static QMutex sessionTicketsMutex;
+
 protected:
 	QString qsHostName;
 	QString qsUserName;
@@ -90,8 +103,108 @@ protected:
 	QHostAddress qhaLocal;
 	QUdpSocket *qusUdp;
 	QMutex qmUdp;
+	/// The thread qusUdp lives in, so that the voice received from the server is neither delayed by the work done for
+	/// the TCP connection (e.g. a large sync or a download) nor by Qt's events queued in between. It runs at the
+	/// highest priority.
+	QThread m_voiceThread;
+	/// The protocol version the decoder of the datagrams is to use. It is set from the handler's thread and picked up
+	/// by the voice thread (see m_udpDecoderVersion).
+	std::atomic< Version::full_t > m_udpProtocolVersion{ Version::UNKNOWN };
+	/// The version of m_udpProtocolVersion that has last been applied to m_udpDecoder
+	Version::full_t m_udpDecoderVersion = Version::UNKNOWN;
 
 	void handleVoicePacket(const Mumble::Protocol::AudioData &audioData);
+	/// @returns The user the given audio should be played for or nullptr if it is to be dropped
+	ClientUser *voiceSender(const Mumble::Protocol::AudioData &audioData) const;
+
+	/// The most datagrams udpReady() reads (and hands to the audio output) at once
+	static constexpr std::size_t UDP_BATCH_SIZE = 32;
+
+	/// A datagram read by receiveDatagrams()
+	struct Datagram {
+		std::array< char, Mumble::Protocol::MAX_UDP_PACKET_SIZE > data;
+		unsigned int length;
+		/// Whether the datagram has been sent from the address and port of the server
+		bool fromServer;
+		/// When the datagram has arrived (see AudioLatency::now()). This is the time the kernel has received it, if
+		/// it tells (see m_kernelTimestamps), and the time it has been read otherwise.
+		quint64 arrival;
+	};
+	std::array< Datagram, UDP_BATCH_SIZE > m_datagrams;
+	/// Whether the kernel timestamps the datagrams it receives on qusUdp (SO_TIMESTAMPNS, Linux only), which are
+	/// unaffected by how long the voice thread takes to get to them
+	bool m_kernelTimestamps = false;
+	/// Kernel timestamps older than this (in microseconds) are ignored, as the realtime clock they are taken from has
+	/// most likely been set since
+	static constexpr quint64 MAX_TIMESTAMP_AGE = 1000000;
+	/// The audio received via UDP, which is handed to the audio output in one go (see flushAudioBatch())
+	std::vector< AudioOutput::ReceivedFrame > m_audioBatch;
+	/// The payloads of m_audioBatch, as the decoder's buffer is reused for every datagram
+	std::array< std::array< Mumble::Protocol::byte, Mumble::Protocol::MAX_UDP_PACKET_SIZE >, UDP_BATCH_SIZE >
+		m_audioPayloads;
+
+	/// Reads up to UDP_BATCH_SIZE pending datagrams into m_datagrams
+	///
+	/// @param native Whether to read them with a single system call (Linux only) instead of one by one through qusUdp
+	/// @returns The number of datagrams that have been read
+	std::size_t receiveDatagrams(bool native);
+	/// When receiveDatagrams() has last been called (see AudioLatency::now())
+	quint64 m_datagramsReceived = 0;
+
+	/// The packet counts the server has reported in its previous ping (see m_uplinkLoss)
+	unsigned int m_lastRemoteGood = 0;
+	unsigned int m_lastRemoteLost = 0;
+	/// The counts of the packets received from the server when the previous UDP ping has been sent, so that the
+	/// loss in between can be reported to the server
+	unsigned int m_lastLocalGood = 0;
+	unsigned int m_lastLocalLost = 0;
+	/// The round-trip time of the previous UDP ping and the jitter of these times (in milliseconds, smoothed as in
+	/// RFC 3550), which is reported to the server as well
+	double m_lastUdpPing = -1.0;
+	double m_udpJitter   = 0.0;
+
+	/// The interval (in milliseconds) of the UDP pings sent to probe the path to the server once a ping has gone
+	/// unanswered, which is much shorter than the one of the regular pings
+	static constexpr int UDP_PROBE_INTERVAL = 250;
+	/// The number of UDP pings in a row (the regular one included) that have to go unanswered for the voice to be
+	/// tunneled through TCP
+	static constexpr unsigned int UDP_PROBES_LOST = 3;
+	/// The number of probes in a row that have to be answered for the voice to be sent via UDP again
+	static constexpr unsigned int UDP_PROBES_ANSWERED = 3;
+	/// The most probes sent without any answer, after which only the regular pings keep probing the path
+	static constexpr unsigned int MAX_UDP_PROBES = 40;
+	/// Sends the probes (see sendUdpProbe())
+	QTimer *m_udpProbeTimer = nullptr;
+	/// The UDP pings sent since the last one has been answered
+	unsigned int m_udpPingsUnanswered = 0;
+	/// The UDP pings in a row that have been answered before the next one has been sent
+	unsigned int m_udpPingsAnswered = 0;
+	/// The probes sent since the last answer (see MAX_UDP_PROBES)
+	unsigned int m_udpProbes = 0;
+	/// Whether the UDP path to the server has stopped working for the time being, in which case the voice is tunneled
+	/// through TCP until enough probes have been answered. Unlike bUdp, which is only flipped if UDP doesn't work at
+	/// all, this is neither remembered for the server nor told to the user, as it is meant to bridge short outages
+	/// (e.g. a NAT rebinding).
+	std::atomic< bool > m_udpPathLost{ false };
+
+	/// Sends a UDP ping (with the statistics of the packets received since the previous one)
+	void sendUdpPing(const ConnectionPtr &connection);
+
+	/// Sends the given (encrypted) datagram to the server through the given socket descriptor, bypassing qusUdp.
+	/// Errors are ignored, as UDP is unreliable anyways.
+	///
+	/// @returns False if there is no descriptor to send through
+	bool sendDatagram(qintptr socket, const char *data, int len) const;
+
+	/// Reads and handles the pending datagrams. Called in the voice thread.
+	void udpReady();
+	void handleDatagram(const Datagram &datagram);
+	/// Hands the audio in m_audioBatch to the audio output
+	void flushAudioBatch();
+
+	/// Batches the messages of the plugins. It isn't a child of the handler, so it stays in the main thread (which the
+	/// plugin API sends from) when the handler is moved to its own thread.
+	PluginDataBatcher m_pluginDataBatcher;
 
 public:
 	Timer tTimestamp;
@@ -107,8 +220,38 @@ public:
 	QList< ServerAddress > qlAddresses;
 	QHash< ServerAddress, QString > qhHostnames;
 	ServerAddress saTargetServer;
+	/// Whether qlAddresses have been taken from the database's cache instead of being resolved
+	bool m_addressesCached = false;
+
+	/// Fills qlAddresses and qhHostnames with the records the server's hostname resolves to, which are taken from the
+	/// database's cache if allowed and available. The event loop is run for the lookup.
+	/// @returns Whether the hostname could be resolved
+	bool resolveAddresses(bool useCache);
+	/// Races the connections to qlAddresses (see ConnectionRacer) and moves the address that has won to the front.
+	/// The event loop is run for the race.
+	/// @returns Whether any of the addresses has accepted the connection
+	bool raceAddresses();
+	/// Remembers the session ticket qtsSock has been issued, if any
+	void storeSessionTicket();
 
 	Version::full_t m_version;
+	/// The share (in percent) of the UDP packets sent to the server that have been lost between the server's last two
+	/// pings. The audio input protects its packets against loss while this is above zero.
+	std::atomic< int > m_uplinkLoss{ 0 };
+	/// Whether the server only suggests rounded volume adjustments for the channels we are listening to, in which
+	/// case the audio output applies our exact listener volume adjustments itself
+	std::atomic< bool > m_listenerVolumesQuantized{ false };
+	/// Whether the server passes on frames shorter than 10 ms as they are, so that the audio input may send them
+	/// one per packet (see AudioInput::iFrameSize)
+	std::atomic< bool > m_smallAudioFrames{ false };
+	/// The timestamp of the newest message sent to each channel (by channel ID) that has been logged, so that the
+	/// message history the server sends whenever we join a channel only logs the ones we haven't seen yet. Only used
+	/// by the main thread.
+	QHash< unsigned int, quint64 > m_shownMessageHistory;
+	/// The bitrate (in bits per second) the server has last suggested not to exceed, so that the most constrained
+	/// listeners in our channel can still follow. The audio input reduces its bitrate accordingly. 0 if there is no
+	/// such suggestion.
+	std::atomic< int > m_bitrateHint{ 0 };
 	QString qsRelease;
 	QString qsOS;
 	QString qsOSVersion;
@@ -135,7 +278,14 @@ public:
 	void setProtocolVersion(Version::full_t version);
 
 	void sendProtoMessage(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
-	void sendMessage(const unsigned char *data, int len, bool force = false);
+	/// @param encoded When the audio the message carries has been encoded (see AudioLatency::now()), 0 if it doesn't
+	/// 	carry audio
+	void sendMessage(const unsigned char *data, int len, bool force = false, quint64 encoded = 0);
+	/// Sends the given plugin message, which is batched with others if the server supports that (see
+	/// PluginDataBatcher). Must be called from the main thread.
+	void sendPluginData(const MumbleProto::PluginDataTransmission &msg);
+	/// @param enabled Whether the server relays PluginDataBatch messages
+	void setPluginDataBatching(bool enabled);
 
 	/// @returns Whether this handler is currently connected to a server.
 	bool isConnected() const;
@@ -193,6 +343,8 @@ signals:
 	void disconnected(QAbstractSocket::SocketError, QString reason);
 	void connected();
 	void pingRequested();
+	/// Emitted in the voice thread for every UDP ping the server has answered (round-trip time in milliseconds)
+	void udpPingReceived(double ping);
 protected slots:
 	void message(Mumble::Protocol::TCPMessageType type, const QByteArray &);
 	void serverConnectionConnected();
@@ -200,10 +352,13 @@ protected slots:
 	void serverConnectionStateChanged(QAbstractSocket::SocketState);
 	void serverConnectionClosed(QAbstractSocket::SocketError, const QString &);
 	void setSslErrors(const QList< QSslError > &);
-	void udpReady();
+	void handleUdpPing(double ping);
 	void hostnameResolved();
 private slots:
 	void sendPingInternal();
+	/// Sends a ping to probe the UDP path to the server and decides whether the path is usable, with some hysteresis
+	/// (see UDP_PROBES_LOST and UDP_PROBES_ANSWERED)
+	void sendUdpProbe();
 public slots:
 	void sendPing();
 };
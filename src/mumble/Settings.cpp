@@ -142,78 +142,31 @@ bool operator!=(const OverlaySettings &lhs, const OverlaySettings &rhs) {
 
 
 void Settings::save(const QString &path) const {
-	// Our saving procedure is a 4-step process:
-	// 1. Write the settings that are to be saved to a temporary file
-	// 2. Check if a settings backup exists and if it does, delete it
-	// 3. If an older settings file already exists, rename it to now be the backup
-	// 4. Move the temporary file to the correct location to make sure it now serves as the proper settings file
-	// All of this is an attempt at making the system as resistant to interruptions as possible.
-	if (!path.endsWith(".json")) {
-		throw std::runtime_error("Expected settings file to have \".json\" extension");
-	}
-
-	nlohmann::json settingsJSON = *this;
-
-	QFile tmpFile(QString::fromLatin1("%1/mumble_settings.json.tmp")
-					  .arg(QStandardPaths::writableLocation(QStandardPaths::TempLocation)));
+	write(path);
 
-	{
-		// The separate scope makes sure, the stream is closed again after the write has finished
-		std::ofstream stream(tmpFile.fileName().toUtf8());
-
-		stream << settingsJSON.dump(4) << std::endl;
-	}
-
-	QFile targetFile(path);
-	QFile backupFile(path + BACKUP_FILE_EXTENSION);
+	Global::get().settingsWriter->flush();
+}
 
-	if (targetFile.exists()) {
-		if (!createdSettingsBackup) {
-			// Create a backup of the settings
-			if (backupFile.exists()) {
-				// We first have to delete our backup
-				if (!backupFile.remove()) {
-					qWarning("Failed at deleting settings backup file: %s", qUtf8Printable(backupFile.errorString()));
-				}
-			}
+void Settings::save() const {
+	save(settingsLocation.isEmpty() ? findSettingsLocation() : settingsLocation);
+}
 
-			// Turn the current settings file into the backup file
-			if (!targetFile.rename(backupFile.fileName())) {
-				qWarning("Failed at renaming settings file to backup file: %s",
-						 qUtf8Printable(targetFile.errorString()));
-			}
+void Settings::saveLater() const {
+	write(settingsLocation.isEmpty() ? findSettingsLocation() : settingsLocation);
+}
 
-			createdSettingsBackup = true;
-		} else {
-			// The current instance of Mumble has already created a settings backup while it was running. Thus
-			// performing another backup now would actually delete the backup we created before. Thus we only delete the
-			// current settings file in order to overwrite it below.
-			if (!targetFile.remove()) {
-				qWarning("Failed at deleting settings file: %s", qUtf8Printable(targetFile.errorString()));
-			}
-		}
-	} else {
-		QFileInfo info(targetFile);
-		if (!info.dir().exists()) {
-			if (!info.dir().mkpath(".")) {
-				qWarning("Failed to create directory for settings at %s", qUtf8Printable(info.dir().absolutePath()));
-			}
-		}
+void Settings::write(const QString &path) const {
+	// Only the serialization happens on the calling thread. The file itself is written by the SettingsWriter, which
+	// skips contents that haven't changed, makes sure the file is never left half-written and keeps the settings
+	// file Mumble has been started with as a backup.
+	if (!path.endsWith(".json")) {
+		throw std::runtime_error("Expected settings file to have \".json\" extension");
 	}
 
-	// Move the temp-file into place
-	if (!tmpFile.rename(path)) {
-		qWarning("Failed at moving settings from %s to %s - reason: %s", qUtf8Printable(tmpFile.fileName()),
-				 qUtf8Printable(path), qUtf8Printable(tmpFile.errorString()));
-	}
-}
+	nlohmann::json settingsJSON = *this;
 
-void Settings::save() const {
-	if (settingsLocation.isEmpty()) {
-		save(findSettingsLocation());
-	} else {
-		save(settingsLocation);
-	}
+	Global::get().settingsWriter->enqueue(path, QByteArray::fromStdString(settingsJSON.dump(4) + "\n"),
+										  path + BACKUP_FILE_EXTENSION);
 }
 
 void Settings::load(const QString &path) {
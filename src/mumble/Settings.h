@@ -123,6 +123,9 @@ struct OverlaySettings {
 	qreal fZoom            = 0.875f;
 	unsigned int uiColumns = 1;
 
+	// The most times per second the overlay is rendered (0 for no limit). Games rendering fewer frames lower it.
+	unsigned int uiMaxUpdateRate = 30;
+
 	std::array< QColor, 5 > qcUserName = {};
 	QFont qfUserName                   = {};
 
@@ -282,6 +285,16 @@ struct Settings {
 	bool bOnlyAttenuateSameOutput       = false;
 	bool bAttenuateLoopbacks            = false;
 	int iOutputDelay                    = 5;
+	/// Whether the received speech is decoded by worker threads ahead of time (see AudioOutputDecoder) instead of by
+	/// the audio thread when it is played
+	bool bDecodeAhead = false;
+	/// Whether multichannel echo cancellation splits the speakers into pairs, which several threads process at once
+	/// (see AudioProcessingGraph)
+	bool bParallelEchoCancellation = true;
+	/// The number of samples of the frames the microphone is encoded in: 480 (10 ms), 240 (5 ms) or 120 (2.5 ms).
+	/// Shorter frames are only used without echo cancellation and on servers that pass them on (see
+	/// AudioInput::iFrameSize).
+	int iAudioFrameSize = 480;
 
 	QString qsALSAInput        = QStringLiteral("default");
 	QString qsALSAOutput       = QStringLiteral("default");
@@ -329,6 +342,9 @@ struct Settings {
 	/// This is practically a direct mapping of the ERole enum
 	/// from Windows: https://msdn.microsoft.com/en-us/library/windows/desktop/dd370842
 	QString qsWASAPIRole = {};
+	/// Whether WASAPI streams in shared mode use the smallest period the audio engine supports (IAudioClient3, Windows
+	/// 10 and later) instead of the default one of 10 ms
+	bool bWASAPILowLatency = true;
 
 	bool bExclusiveInput          = false;
 	bool bExclusiveOutput         = false;
@@ -339,6 +355,10 @@ struct Settings {
 	float fAudioMaxDistance       = 15.0f;
 	float fAudioMaxDistVolume     = 0.0f;
 	float fAudioBloom             = 0.5f;
+	/// Whether the positional sources are spatialized with HRTFs (instead of being panned) in headphone mode
+	bool bPositionalHRTF = false;
+	/// How often the positional data is fetched from the active plugin (in Hz)
+	int iPositionalDataRate = 50;
 	/// Contains the settings for each individual plugin. The key in this map is the Hex-represented SHA-1
 	/// hash of the plugin's UTF-8 encoded absolute file-path on the hard-drive.
 	QHash< QString, PluginSetting > qhPluginSettings = {};
@@ -552,9 +572,6 @@ struct Settings {
 	/// If true settings in this structure require a client restart to apply fully
 	bool requireRestartToApply = false;
 	QString settingsLocation   = {};
-	/// A flag indicating whether the current Mumble session has already backed up the settings it was started with,
-	/// before writing new ones.
-	mutable bool createdSettingsBackup = false;
 
 	/// A flag used in order to determine whether or not to offer loading the setting's backup file instead
 	bool mumbleQuitNormally = false;
@@ -564,8 +581,13 @@ struct Settings {
 
 	Settings();
 
+	/// Writes the settings to the given path before returning
 	void save(const QString &path) const;
+	/// Writes the settings to their location before returning
 	void save() const;
+	/// Queues writing the settings to their location in the background (see SettingsWriter), which happens at most
+	/// once per SettingsWriter::MIN_INTERVAL
+	void saveLater() const;
 
 	void load(const QString &path);
 	void load();
@@ -575,6 +597,8 @@ struct Settings {
 	void migratePluginSettings(const MigratedPath &path);
 
 private:
+	/// Queues writing the settings to the given path
+	void write(const QString &path) const;
 	void verifySettingsKeys() const;
 	QString findSettingsLocation(bool legacy = false, bool *foundExistingFile = nullptr) const;
 };
@@ -74,6 +74,9 @@ const SettingsKey NOTIFICATION_VOLUME_KEY                     = { "notification_
 const SettingsKey CUE_VOLUME_KEY                              = { "cue_volume" };
 const SettingsKey RESTRICT_WHISPERS_TO_FRIENDS_KEY            = { "restrict_whispers_to_friends" };
 const SettingsKey NOTIFICATION_USER_LIMIT_KEY                 = { "notification_user_limit" };
+const SettingsKey DECODE_AHEAD_KEY                            = { "decode_ahead" };
+const SettingsKey PARALLEL_ECHO_CANCELLATION_KEY              = { "parallel_echo_cancellation" };
+const SettingsKey AUDIO_FRAME_SIZE_KEY                        = { "audio_frame_size" };
 
 // Idle settings
 const SettingsKey IDLE_TIME_KEY                  = { "idle_time" };
@@ -83,11 +86,13 @@ const SettingsKey UNDO_IDLE_ACTION_UPON_ACTIVITY = { "undo_idle_action_upon_acti
 // Positional audio
 const SettingsKey ENABLE_POSITIONAL_AUDIO_KEY      = { "enable_positional_audio" };
 const SettingsKey POSITIONAL_HEADPHONE_MODE_KEY    = { "use_headphone_mode" };
+const SettingsKey POSITIONAL_HRTF_KEY              = { "use_hrtf" };
 const SettingsKey POSITIONAL_MIN_DISTANCE_KEY      = { "minimum_distance" };
 const SettingsKey POSITIONAL_MAX_DISTANCE_KEY      = { "maximum_distance" };
 const SettingsKey POSITIONAL_MIN_VOLUME_KEY        = { "minimum_volume" };
 const SettingsKey POSITIONAL_BLOOM_KEY             = { "bloom" };
 const SettingsKey POSITIONAL_TRANSMIT_POSITION_KEY = { "transmit_position" };
+const SettingsKey POSITIONAL_DATA_RATE_KEY         = { "poll_rate" };
 
 // Network
 const SettingsKey JITTER_BUFFER_SIZE_KEY            = { "jitter_buffer_size" };
@@ -117,9 +122,10 @@ const SettingsKey ASIO_MICROPHONE_KEY = { "asio_microphone" };
 const SettingsKey ASIO_SPEAKER_KEY    = { "asio_speaker" };
 
 // WASAPI
-const SettingsKey WASAPI_INPUT_KEY  = { "wasapi_input" };
-const SettingsKey WASAPI_OUTPUT_KEY = { "wasapi_output" };
-const SettingsKey WASAPI_ROLE_KEY   = { "wasapi_role" };
+const SettingsKey WASAPI_INPUT_KEY       = { "wasapi_input" };
+const SettingsKey WASAPI_OUTPUT_KEY      = { "wasapi_output" };
+const SettingsKey WASAPI_ROLE_KEY        = { "wasapi_role" };
+const SettingsKey WASAPI_LOW_LATENCY_KEY = { "wasapi_low_latency" };
 
 // ALSA
 const SettingsKey ALSA_INPUT_KEY  = { "alsa_input" };
@@ -337,6 +343,7 @@ const SettingsKey OVERLAY_PATHS_KEY                 = { "paths" };
 const SettingsKey OVERLAY_PATHS_EXCLUDE_KEY         = { "paths_exclude" };
 const SettingsKey OVERLAY_BLACKLIST_KEY             = { "blacklist" };
 const SettingsKey OVERLAY_BLACKLIST_EXCLUDE_KEY     = { "blacklist_exclude" };
+const SettingsKey OVERLAY_MAX_UPDATE_RATE_KEY       = { "max_update_rate" };
 
 
 const SettingsKey SETTINGS_VERSION_KEY     = { "settings_version" };
@@ -57,7 +57,10 @@
 	PROCESS(audio, NOTIFICATION_VOLUME_KEY, notificationVolume)                             \
 	PROCESS(audio, CUE_VOLUME_KEY, cueVolume)                                               \
 	PROCESS(audio, RESTRICT_WHISPERS_TO_FRIENDS_KEY, bWhisperFriends)                       \
-	PROCESS(audio, NOTIFICATION_USER_LIMIT_KEY, iMessageLimitUserThreshold)
+	PROCESS(audio, NOTIFICATION_USER_LIMIT_KEY, iMessageLimitUserThreshold)                 \
+	PROCESS(audio, DECODE_AHEAD_KEY, bDecodeAhead)                                          \
+	PROCESS(audio, PARALLEL_ECHO_CANCELLATION_KEY, bParallelEchoCancellation)               \
+	PROCESS(audio, AUDIO_FRAME_SIZE_KEY, iAudioFrameSize)
 
 
 #define IDLE_SETTINGS                             \
@@ -73,7 +76,9 @@
 	PROCESS(positional_audio, POSITIONAL_MIN_VOLUME_KEY, fAudioMaxDistVolume)      \
 	PROCESS(positional_audio, POSITIONAL_BLOOM_KEY, fAudioBloom)                   \
 	PROCESS(positional_audio, POSITIONAL_HEADPHONE_MODE_KEY, bPositionalHeadphone) \
-	PROCESS(positional_audio, POSITIONAL_TRANSMIT_POSITION_KEY, bTransmitPosition)
+	PROCESS(positional_audio, POSITIONAL_HRTF_KEY, bPositionalHRTF)                \
+	PROCESS(positional_audio, POSITIONAL_TRANSMIT_POSITION_KEY, bTransmitPosition) \
+	PROCESS(positional_audio, POSITIONAL_DATA_RATE_KEY, iPositionalDataRate)
 
 
 #define NETWORK_SETTINGS                                                     \
@@ -106,6 +111,7 @@
 	PROCESS(audio_backend, WASAPI_INPUT_KEY, qsWASAPIInput)           \
 	PROCESS(audio_backend, WASAPI_OUTPUT_KEY, qsWASAPIOutput)         \
 	PROCESS(audio_backend, WASAPI_ROLE_KEY, qsWASAPIRole)             \
+	PROCESS(audio_backend, WASAPI_LOW_LATENCY_KEY, bWASAPILowLatency) \
 	PROCESS(audio_backend, ALSA_INPUT_KEY, qsALSAInput)               \
 	PROCESS(audio_backend, ALSA_OUTPUT_KEY, qsALSAOutput)             \
 	PROCESS(audio_backend, PIPEWIRE_INPUT_KEY, pipeWireInput)         \
@@ -313,7 +319,8 @@
 	PROCESS(overlay, OVERLAY_PATHS_KEY, qslPaths)                        \
 	PROCESS(overlay, OVERLAY_PATHS_EXCLUDE_KEY, qslPathsExclude)         \
 	PROCESS(overlay, OVERLAY_BLACKLIST_KEY, qslBlacklist)                \
-	PROCESS(overlay, OVERLAY_BLACKLIST_EXCLUDE_KEY, qslBlacklistExclude)
+	PROCESS(overlay, OVERLAY_BLACKLIST_EXCLUDE_KEY, qslBlacklistExclude) \
+	PROCESS(overlay, OVERLAY_MAX_UPDATE_RATE_KEY, uiMaxUpdateRate)
 
 
 #define PROCESS_ALL_SETTINGS   \
@@ -0,0 +1,141 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "SettingsWriter.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+constexpr int SettingsWriter::MIN_INTERVAL;
+
+SettingsWriter::SettingsWriter() {
+	start();
+}
+
+SettingsWriter::~SettingsWriter() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stop = true;
+		m_queuedCondition.wakeAll();
+	}
+
+	wait();
+}
+
+void SettingsWriter::enqueue(const QString &path, const QByteArray &contents, const QString &backupPath) {
+	QMutexLocker l(&m_mutex);
+
+	auto written = m_written.constFind(path);
+	if (written != m_written.constEnd() && written.value() == contents) {
+		// Nothing has changed since the last time the file has been written to
+		m_pending.remove(path);
+		return;
+	}
+
+	m_pending.insert(path, { contents, backupPath });
+	m_queuedCondition.wakeAll();
+}
+
+void SettingsWriter::flush() {
+	if (QThread::currentThread() == this)
+		return;
+
+	QMutexLocker l(&m_mutex);
+
+	m_flushing++;
+	m_queuedCondition.wakeAll();
+
+	while (!m_pending.isEmpty() || m_writing) {
+		m_writtenCondition.wait(&m_mutex);
+	}
+
+	m_flushing--;
+}
+
+bool SettingsWriter::write(const QString &path, const QByteArray &contents, const QString &backupPath) {
+	QFileInfo info(path);
+	if (!info.exists() && !info.dir().exists()) {
+		if (!info.dir().mkpath(".")) {
+			qWarning("Failed to create directory for settings at %s", qUtf8Printable(info.dir().absolutePath()));
+		}
+	}
+
+	if (!backupPath.isEmpty() && info.exists()) {
+		// The previous version is copied rather than moved, so that there is a settings file at all times
+		QFile backupFile(backupPath);
+		if (backupFile.exists() && !backupFile.remove()) {
+			qWarning("Failed at deleting settings backup file: %s", qUtf8Printable(backupFile.errorString()));
+		}
+
+		QFile targetFile(path);
+		if (!targetFile.copy(backupPath)) {
+			qWarning("Failed at copying settings file to backup file: %s", qUtf8Printable(targetFile.errorString()));
+		}
+	}
+
+	// QSaveFile writes to a temporary file next to the target and only replaces the target once all of the contents
+	// have been written, so that an interruption can't leave a truncated settings file behind.
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size() || !file.commit()) {
+		qWarning("Failed at writing settings to %s - reason: %s", qUtf8Printable(path),
+				 qUtf8Printable(file.errorString()));
+		return false;
+	}
+
+	return true;
+}
+
+void SettingsWriter::run() {
+	forever {
+		QMutexLocker l(&m_mutex);
+
+		while (m_pending.isEmpty() && !m_stop) {
+			m_queuedCondition.wait(&m_mutex);
+		}
+
+		if (m_pending.isEmpty()) {
+			break;
+		}
+
+		if (!m_stop && m_flushing == 0 && m_lastWrite.isValid()) {
+			const qint64 remaining = MIN_INTERVAL - m_lastWrite.elapsed();
+			if (remaining > 0) {
+				// More changes may come in while waiting (e.g. a slider that is still being dragged), which replace
+				// the pending contents instead of causing another write
+				m_queuedCondition.wait(&m_mutex, static_cast< unsigned long >(remaining));
+				continue;
+			}
+		}
+
+		auto it                  = m_pending.begin();
+		const QString path       = it.key();
+		const Entry entry        = it.value();
+		const QString backupPath = m_backedUp.contains(path) ? QString() : entry.backupPath;
+		m_pending.erase(it);
+
+		m_written.insert(path, entry.contents);
+		m_writing = true;
+
+		l.unlock();
+
+		const bool existed = QFile::exists(path);
+		if (!write(path, entry.contents, backupPath)) {
+			l.relock();
+			// The next attempt must not be skipped for having the same contents
+			m_written.remove(path);
+		} else {
+			l.relock();
+			if (existed && !backupPath.isEmpty()) {
+				m_backedUp.insert(path);
+			}
+		}
+
+		m_writing = false;
+		m_lastWrite.start();
+		m_writtenCondition.wakeAll();
+	}
+}
@@ -0,0 +1,73 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_SETTINGSWRITER_H_
+#define MUMBLE_MUMBLE_SETTINGSWRITER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+/// A thread that writes the settings files in the background, so that the GUI thread doesn't have to wait for the
+/// disk whenever the settings are saved.
+///
+/// Only the most recent contents queued for a file are written: contents that are replaced before the thread got to
+/// them are dropped, as are contents that equal what has been written to the file before. The thread writes at most
+/// once per MIN_INTERVAL, unless somebody is waiting for the writes to happen (see flush()). Every file is replaced
+/// atomically, so that it is never left half-written.
+class SettingsWriter : public QThread {
+public:
+	/// The minimum time between two writes (in milliseconds)
+	static constexpr int MIN_INTERVAL = 1000;
+
+	SettingsWriter();
+	/// Performs all pending writes before returning
+	~SettingsWriter() override;
+
+	/// Queues writing the given contents to the file at the given path, replacing the contents that are pending for
+	/// it. The first time the file is written to, its previous version is kept at the given backup path.
+	void enqueue(const QString &path, const QByteArray &contents, const QString &backupPath);
+	/// Blocks until all contents that have been queued before have been written
+	void flush();
+
+	/// Writes the given contents to the file at the given path, replacing it atomically. If a backup path is given,
+	/// the file's previous version is kept there.
+	///
+	/// @returns Whether the file has been written
+	static bool write(const QString &path, const QByteArray &contents, const QString &backupPath = QString());
+
+protected:
+	struct Entry {
+		QByteArray contents;
+		QString backupPath;
+	};
+
+	mutable QMutex m_mutex;
+	/// Signalled when contents have been queued, a flush has been requested or the thread is supposed to stop
+	QWaitCondition m_queuedCondition;
+	/// Signalled when contents have been written
+	QWaitCondition m_writtenCondition;
+	/// The contents that are waiting to be written, by path
+	QHash< QString, Entry > m_pending;
+	/// The contents that have been (or are being) written most recently, by path
+	QHash< QString, QByteArray > m_written;
+	/// The paths whose previous version has already been backed up in this session
+	QSet< QString > m_backedUp;
+	/// Measures the time since the last write
+	QElapsedTimer m_lastWrite;
+	/// The number of threads waiting in flush()
+	int m_flushing = 0;
+	bool m_writing = false;
+	bool m_stop    = false;
+
+	void run() override;
+};
+
+#endif // MUMBLE_MUMBLE_SETTINGSWRITER_H_
@@ -0,0 +1,36 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "StartupProfile.h"
+
+#include <QtCore/QStringList>
+
+static QString formatDuration(quint64 usecs) {
+	return QString::fromLatin1("%1 ms").arg(static_cast< double >(usecs) / 1000.0, 0, 'f', 1);
+}
+
+void StartupProfile::mark(const QString &name) {
+	const quint64 now = m_timer.elapsed();
+
+	m_phases.push_back({ name, now - m_lastMark });
+	m_lastMark = now;
+}
+
+const std::vector< StartupProfile::Phase > &StartupProfile::phases() const {
+	return m_phases;
+}
+
+quint64 StartupProfile::total() const {
+	return m_lastMark;
+}
+
+QString StartupProfile::summary() const {
+	QStringList parts;
+	for (const Phase &phase : m_phases) {
+		parts << QString::fromLatin1("%1: %2").arg(phase.name, formatDuration(phase.duration));
+	}
+
+	return QString::fromLatin1("%1 (total: %2)").arg(parts.join(QLatin1String(", ")), formatDuration(total()));
+}
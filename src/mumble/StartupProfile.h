@@ -0,0 +1,42 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_STARTUPPROFILE_H_
+#define MUMBLE_MUMBLE_STARTUPPROFILE_H_
+
+#include "Timer.h"
+
+#include <QtCore/QString>
+
+#include <vector>
+
+/// Measures how long the phases of the client's startup take. Each phase begins where the previous one has ended (the
+/// first one when the profile has been created), so that together they cover the whole startup.
+class StartupProfile {
+public:
+	struct Phase {
+		QString name;
+		/// In microseconds
+		quint64 duration;
+	};
+
+	/// Ends the current phase under the given name
+	void mark(const QString &name);
+
+	const std::vector< Phase > &phases() const;
+	/// @returns The time since the profile has been created until the end of the last phase, in microseconds
+	quint64 total() const;
+
+	/// @returns The phases with their durations in a single line, e.g. "settings: 12.3 ms, database: 4.5 ms (total:
+	/// 16.8 ms)"
+	QString summary() const;
+
+protected:
+	Timer m_timer;
+	quint64 m_lastMark = 0;
+	std::vector< Phase > m_phases;
+};
+
+#endif // MUMBLE_MUMBLE_STARTUPPROFILE_H_
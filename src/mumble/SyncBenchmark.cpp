@@ -0,0 +1,257 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "SyncBenchmark.h"
+
+#include "ACL.h"
+#include "ClientUser.h"
+#include "MainWindow.h"
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+#include "Profiler.h"
+#include "ServerHandler.h"
+#include "UIUpdateScheduler.h"
+#include "Global.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+
+#	include <psapi.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+namespace SyncBenchmark {
+
+namespace {
+	/// The number of subchannels of every channel
+	constexpr unsigned int FANOUT = 8;
+	/// For how many updates of the views users start and stop talking
+	constexpr unsigned int TALKING_FRAMES = 100;
+	/// How many users start or stop talking per update of the views
+	constexpr unsigned int TALKING_CHANGES = 16;
+	/// For how long to wait for an update of the views, which are due once per frame of the screen
+	constexpr int FRAME_TIMEOUT_MSECS = 1000;
+
+	struct Message {
+		Mumble::Protocol::TCPMessageType type;
+		QByteArray payload;
+	};
+
+	template< typename T >
+	void append(std::vector< Message > &messages, Mumble::Protocol::TCPMessageType type, const T &msg) {
+		const std::string payload = msg.SerializeAsString();
+		messages.push_back({ type, QByteArray(payload.data(), static_cast< int >(payload.size())) });
+	}
+
+	/// @returns An arbitrary SHA-1 hash (of a certificate, a comment or a description) for the given number
+	std::string hash(unsigned int i) {
+		return QString::fromLatin1("%1").arg(i, 40, 16, QLatin1Char('0')).toStdString();
+	}
+
+	/// @returns The messages a server with the given number of channels and users sends to a client that connects to
+	/// 	it, in the order it sends them. The session of the local user is the number of users.
+	std::vector< Message > generateSync(unsigned int channels, unsigned int users) {
+		std::vector< Message > messages;
+		messages.reserve(channels + users + 2);
+
+		std::mt19937 rng(42);
+		std::uniform_int_distribution< unsigned int > channel(0, channels - 1);
+
+		for (unsigned int id = 0; id < channels; ++id) {
+			MumbleProto::ChannelState mpcs;
+			mpcs.set_channel_id(id);
+			if (id == 0) {
+				mpcs.set_name("Root");
+			} else {
+				mpcs.set_parent((id - 1) / FANOUT);
+				mpcs.set_name("Channel " + std::to_string(id));
+				mpcs.set_position(static_cast< int >(id % FANOUT));
+			}
+			if (id % 16 == 1) {
+				mpcs.set_description_hash(hash(id));
+			}
+			if (id % 64 == 1 && id > FANOUT) {
+				mpcs.add_links((id - 1) / FANOUT);
+			}
+			append(messages, Mumble::Protocol::TCPMessageType::ChannelState, mpcs);
+		}
+
+		for (unsigned int session = 1; session <= users; ++session) {
+			MumbleProto::UserState mpus;
+			mpus.set_session(session);
+			mpus.set_name("User " + std::to_string(session));
+			mpus.set_channel_id(channel(rng));
+			if (session % 2 == 0) {
+				mpus.set_user_id(session);
+			}
+			mpus.set_hash(hash(session));
+			if (session % 5 == 0) {
+				mpus.set_self_mute(true);
+			}
+			if (session % 7 == 0) {
+				mpus.set_comment_hash(hash(session));
+			}
+			append(messages, Mumble::Protocol::TCPMessageType::UserState, mpus);
+		}
+
+		MumbleProto::ServerSync mpss;
+		mpss.set_session(users);
+		mpss.set_max_bandwidth(558000);
+		mpss.set_welcome_text("Welcome to the sync benchmark");
+		mpss.set_permissions(static_cast< unsigned int >(ChanACL::All));
+		append(messages, Mumble::Protocol::TCPMessageType::ServerSync, mpss);
+
+		MumbleProto::ServerConfig mpsc;
+		mpsc.set_allow_html(true);
+		mpsc.set_message_length(5000);
+		mpsc.set_image_message_length(131072);
+		mpsc.set_max_users(users);
+		append(messages, Mumble::Protocol::TCPMessageType::ServerConfig, mpsc);
+
+		return messages;
+	}
+
+	/// Hands the given message to MainWindow, just like ServerHandler does with the ones it receives
+	void deliver(const Message &message) {
+		ServerHandlerMessageEvent event(message.payload, message.type);
+		QCoreApplication::sendEvent(Global::get().mw, &event);
+	}
+
+	double milliseconds(qint64 nanoseconds) { return static_cast< double >(nanoseconds) / 1e6; }
+
+	double mebibytes(quint64 bytes) { return static_cast< double >(bytes) / (1024.0 * 1024.0); }
+
+	/// Prints the profiler's zones (which include the message handlers and the updates of the views), resetting them
+	void printZones(qint64 nanoseconds) {
+		printf("%s\n", qPrintable(Profiler::format(Profiler::take(), static_cast< double >(nanoseconds) / 1e9)));
+	}
+} // namespace
+
+quint64 peakMemory() {
+#ifdef Q_OS_WIN
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+#	ifdef Q_OS_MACOS
+	return static_cast< quint64 >(usage.ru_maxrss);
+#	else
+	// In KiB everywhere else
+	return static_cast< quint64 >(usage.ru_maxrss) * 1024;
+#	endif
+#endif
+}
+
+bool run(unsigned int channels, unsigned int users) {
+	if (channels == 0 || users == 0 || (Global::get().sh && Global::get().sh->isRunning())) {
+		return false;
+	}
+
+	const std::vector< Message > sync = generateSync(channels, users);
+
+	// The handlers talk to the server through a ServerHandler, which simply drops everything as it never connects
+	Global::get().sh = ServerHandlerPtr(new ServerHandler());
+
+	const bool profiling = Profiler::isEnabled();
+	Profiler::setEnabled(true);
+	Profiler::take();
+
+	const quint64 memoryBefore = peakMemory();
+
+	QElapsedTimer timer;
+	timer.start();
+
+	Global::get().mw->serverConnected();
+	for (const Message &message : sync) {
+		deliver(message);
+	}
+	const qint64 synchronized = timer.nsecsElapsed();
+
+	// Whatever the handlers have left to the event loop
+	QCoreApplication::processEvents();
+	const qint64 settled = timer.nsecsElapsed();
+
+	const quint64 memoryAfter = peakMemory();
+
+	printf("Synchronization with %u channels and %u users (%zu messages):\n", channels, users, sync.size());
+	printf("  %-22s %.1f ms\n", "Synchronized after", milliseconds(synchronized));
+	printf("  %-22s %.1f ms\n", "Events handled after", milliseconds(settled));
+	printf("  %-22s %.1f us\n", "Per message",
+		   milliseconds(synchronized) * 1000.0 / static_cast< double >(sync.size()));
+	printf("  %-22s %.1f MiB (%.1f MiB before the sync)\n", "Peak memory", mebibytes(memoryAfter),
+		   mebibytes(memoryBefore));
+	printZones(settled);
+
+	const bool synchronizedWithSelf = Global::get().uiSession == users;
+	if (!synchronizedWithSelf) {
+		printf("  The client hasn't been synchronized\n");
+	}
+
+	// Users start and stop talking, after each batch of which the views are updated with the next frame. The loop
+	// quits once the views have been updated, as it is connected to the scheduler after them.
+	QEventLoop loop;
+	QObject::connect(Global::get().uiUpdateScheduler.get(), &UIUpdateScheduler::updateDue, &loop, &QEventLoop::quit);
+	QTimer frameTimeout;
+	frameTimeout.setSingleShot(true);
+	QObject::connect(&frameTimeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution< unsigned int > session(1, users);
+
+	qint64 changing      = 0;
+	unsigned int changes = 0;
+	Profiler::take();
+	timer.restart();
+
+	for (unsigned int frame = 0; frame < TALKING_FRAMES; ++frame) {
+		QElapsedTimer changeTimer;
+		changeTimer.start();
+		for (unsigned int i = 0; i < TALKING_CHANGES; ++i) {
+			ClientUser *user = ClientUser::get(session(rng));
+			if (!user) {
+				continue;
+			}
+
+			user->setTalking(user->tsState == Settings::Passive ? Settings::Talking : Settings::Passive);
+			++changes;
+		}
+		changing += changeTimer.nsecsElapsed();
+
+		frameTimeout.start(FRAME_TIMEOUT_MSECS);
+		loop.exec();
+	}
+	const qint64 talking = timer.nsecsElapsed();
+
+	printf("Talking state changes (%u in %u frames):\n", changes, TALKING_FRAMES);
+	printf("  %-22s %.2f us\n", "Per change",
+		   changes > 0 ? milliseconds(changing) * 1000.0 / static_cast< double >(changes) : 0.0);
+	printZones(talking);
+	fflush(stdout);
+
+	Profiler::setEnabled(profiling);
+
+	return synchronizedWithSelf;
+}
+
+} // namespace SyncBenchmark
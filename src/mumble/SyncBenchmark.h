@@ -0,0 +1,32 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_SYNCBENCHMARK_H_
+#define MUMBLE_MUMBLE_SYNCBENCHMARK_H_
+
+#include <QtCore/QtGlobal>
+
+/// A benchmark of the synchronization with a large server (see the --sync-benchmark option), which doesn't need a
+/// server: the messages a server sends while a client connects (the state of every channel and user, followed by the
+/// ServerSync) are generated up front and then handed to MainWindow just like ServerHandler hands over the ones it
+/// receives. Thus they take the same path through the message handlers into UserModel and TalkingUI.
+///
+/// It measures the time until the client is synchronized, the peak memory of the process and the cost of the talking
+/// state of users changing afterwards, which is what keeps the client busy on large servers. The Qt offscreen
+/// platform (-platform offscreen) lets it run without a display.
+namespace SyncBenchmark {
+
+/// @returns The largest amount of memory (in bytes) the process has been using so far, 0 if it can't be determined
+quint64 peakMemory();
+
+/// Synchronizes with a generated server of the given number of channels (including the root channel) and users
+/// (including the local one) and then has users start and stop talking, printing the results to stdout.
+///
+/// @returns False if the benchmark couldn't run, e.g. because the client is connected to a server
+bool run(unsigned int channels, unsigned int users);
+
+} // namespace SyncBenchmark
+
+#endif // MUMBLE_MUMBLE_SYNCBENCHMARK_H_
@@ -8,6 +8,7 @@
 #include "ChannelListenerManager.h"
 #include "ClientUser.h"
 #include "MainWindow.h"
+#include "Profiler.h"
 #include "TalkingUIComponent.h"
 #include "UserModel.h"
 #include "widgets/MultiStyleWidgetWrapper.h"
@@ -35,6 +36,8 @@
 
 TalkingUI::TalkingUI(QWidget *parent) : QWidget(parent), m_containers(), m_currentSelection(nullptr) {
 	setupUI();
+
+	connect(Global::get().uiUpdateScheduler.get(), &UIUpdateScheduler::updateDue, this, &TalkingUI::on_updateDue);
 }
 
 int TalkingUI::findContainer(int associatedChannelID, ContainerType type) const {
@@ -87,18 +90,29 @@ struct container_ptr_less {
 	}
 };
 
-void TalkingUI::sortContainers() {
-	// Remove all containers from the UI
-	for (auto &currentContainer : m_containers) {
-		layout()->removeWidget(currentContainer->getWidget());
+void TalkingUI::sortContainer(const TalkingUIContainer &container) {
+	const int index = findContainer(container.getAssociatedChannelID(), container.getType());
+	if (index < 0) {
+		return;
 	}
 
-	// Sort the containers
-	std::sort(m_containers.begin(), m_containers.end(), container_ptr_less());
+	// All other containers are in order, so only this one has to be moved into place
+	std::unique_ptr< TalkingUIContainer > movedContainer = std::move(m_containers[static_cast< std::size_t >(index)]);
+	m_containers.erase(m_containers.begin() + index);
 
-	// Add them again in the order they appear in the vector
-	for (auto &currentContainer : m_containers) {
-		layout()->addWidget(currentContainer->getWidget());
+	auto position = std::lower_bound(m_containers.begin(), m_containers.end(), movedContainer, container_ptr_less());
+	position      = m_containers.insert(position, std::move(movedContainer));
+
+	QBoxLayout *boxLayout = static_cast< QBoxLayout * >(layout());
+	QWidget *widget       = (*position)->getWidget();
+	boxLayout->removeWidget(widget);
+
+	// The layout may still hold the widgets of removed containers (which are deleted later), so the widget is placed
+	// relative to the container after it rather than by its index
+	if (position + 1 != m_containers.end()) {
+		boxLayout->insertWidget(boxLayout->indexOf((*(position + 1))->getWidget()), widget);
+	} else {
+		boxLayout->addWidget(widget);
 	}
 }
 
@@ -151,7 +165,7 @@ void TalkingUI::addListener(const ClientUser *user, const Channel *channel) {
 
 		channelContainer->addEntry(std::move(listenerEntry));
 
-		sortContainers();
+		sortContainer(*channelContainer);
 	}
 }
 
@@ -347,6 +361,8 @@ void TalkingUI::addChannel(const Channel *channel) {
 		layout()->addWidget(channelWidget);
 
 		m_containers.push_back(std::move(channelContainer));
+
+		sortContainer(*m_containers.back());
 	}
 }
 
@@ -422,7 +438,7 @@ TalkingUIUser *TalkingUI::findOrAddUser(const ClientUser *user) {
 		// Actually add the user to the respective channel
 		channelContainer->addEntry(std::move(userEntry));
 
-		sortContainers();
+		sortContainer(*channelContainer);
 
 		return newUserEntry;
 	} else {
@@ -453,9 +469,12 @@ void TalkingUI::moveUserToChannel(unsigned int userSession, unsigned int channel
 
 		targetChannel->addEntry(oldContainer->removeEntry(userEntry));
 
-		removeIfSuperfluous(*oldContainer);
-
-		sortContainers();
+		// The priority of both channels may have changed
+		const TalkingUIContainer &movedTo = *targetChannel;
+		if (!removeIfSuperfluous(*oldContainer)) {
+			sortContainer(*oldContainer);
+		}
+		sortContainer(movedTo);
 	} else {
 		qCritical("TalkingUI::moveUserToChannel Unable to locate user");
 		return;
@@ -602,18 +621,41 @@ void TalkingUI::on_talkingStateChanged() {
 		return;
 	}
 
-	if (!user->cChannel) {
-		// If the user doesn't have an associated channel, something's either wrong
-		// or that user has just disconnected. In either way, we want to make sure
-		// that this user won't stick around in the UI.
-		hideUser(user->uiSession);
+	// The talking state changes many times a second for every user that speaks, so the UI only catches up with it
+	// once per frame (see on_updateDue())
+	Global::get().uiUpdateScheduler->markUser(user->uiSession);
+}
+
+void TalkingUI::on_updateDue(const QSet< unsigned int > &users, const QSet< unsigned int > &channels) {
+	MUMBLE_PROFILE_ZONE("TalkingUI::on_updateDue");
+	Q_UNUSED(channels);
+
+	if (users.isEmpty()) {
 		return;
 	}
 
-	TalkingUIUser *userEntry = findOrAddUser(user);
+	for (unsigned int session : users) {
+		const ClientUser *user = ClientUser::get(session);
 
-	if (userEntry) {
-		userEntry->setTalkingState(user->tsState);
+		if (!user) {
+			// The user has disconnected in the meantime, in which case it has been removed via
+			// on_clientDisconnected already
+			continue;
+		}
+
+		if (!user->cChannel) {
+			// If the user doesn't have an associated channel, something's either wrong
+			// or that user has just disconnected. In either way, we want to make sure
+			// that this user won't stick around in the UI.
+			hideUser(user->uiSession);
+			continue;
+		}
+
+		TalkingUIUser *userEntry = findOrAddUser(user);
+
+		if (userEntry) {
+			userEntry->setTalkingState(user->tsState);
+		}
 	}
 
 	updateUI();
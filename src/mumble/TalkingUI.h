@@ -50,7 +50,8 @@ private:
 	std::unique_ptr< TalkingUIContainer > removeContainer(int associatedChannelID, ContainerType type);
 	std::unique_ptr< TalkingUIContainer > removeIfSuperfluous(const TalkingUIContainer &container);
 
-	void sortContainers();
+	/// Moves the given container to where it belongs in the order of the containers (the others being in order)
+	void sortContainer(const TalkingUIContainer &container);
 
 	TalkingUIUser *findUser(unsigned int userSession);
 	void removeUser(unsigned int userSession);
@@ -105,6 +106,9 @@ private:
 
 	void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
 
+	/// Catches up with the talking state of the given users (see UIUpdateScheduler)
+	void on_updateDue(const QSet< unsigned int > &users, const QSet< unsigned int > &channels);
+
 public:
 	TalkingUI(QWidget *parent = nullptr);
 
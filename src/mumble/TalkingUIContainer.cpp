@@ -216,17 +216,15 @@ void TalkingUIChannel::addEntry(std::unique_ptr< TalkingUIEntry > entry) {
 	}
 	TalkingUIContainer::addEntry(std::move(entry));
 
-	// Remove all entries from the layout
-	for (const auto &currentEntry : m_entries) {
-		m_channelBox->layout()->removeWidget(currentEntry->getWidget());
-	}
-
-	// Sort entries
-	std::sort(m_entries.begin(), m_entries.end(), entry_ptr_less());
+	// The other entries are in order already, so only the new one has to be moved into place
+	auto position = std::upper_bound(m_entries.begin(), m_entries.end() - 1, m_entries.back(), entry_ptr_less());
+	std::rotate(position, m_entries.end() - 1, m_entries.end());
 
-	// Add all entries again (including the new one) in order
-	for (auto &currentEntry : m_entries) {
-		m_channelBox->layout()->addWidget(currentEntry->getWidget());
+	QBoxLayout *boxLayout = static_cast< QBoxLayout * >(m_channelBox->layout());
+	if (position + 1 != m_entries.end()) {
+		boxLayout->insertWidget(boxLayout->indexOf((*(position + 1))->getWidget()), (*position)->getWidget());
+	} else {
+		boxLayout->addWidget((*position)->getWidget());
 	}
 }
 
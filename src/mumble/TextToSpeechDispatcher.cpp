@@ -0,0 +1,103 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TextToSpeechDispatcher.h"
+
+#include "TextToSpeech.h"
+
+#include <QtCore/QMutexLocker>
+
+TextToSpeechDispatcher::TextToSpeechDispatcher(QObject *parent) : QObject(parent) {
+	m_clock.start();
+
+	m_timer.setSingleShot(true);
+	connect(&m_timer, &QTimer::timeout, &m_timer, [this]() { dispatch(); });
+	connect(this, &TextToSpeechDispatcher::pending, &m_timer, [this]() { dispatch(); });
+
+#ifdef Q_OS_MACOS
+	// NSSpeechSynthesizer reports the end of a message through the run loop of the thread it has been created in,
+	// which Qt only runs for the main thread. It doesn't block anyway.
+	m_tts = std::make_unique< TextToSpeech >();
+#else
+	m_thread.setObjectName(QLatin1String("TextToSpeech"));
+	m_timer.moveToThread(&m_thread);
+
+	// The backend is created and destroyed in its thread, as some of them (e.g. SAPI's COM objects) are bound to it
+	connect(
+		&m_thread, &QThread::started, &m_timer,
+		[this]() {
+			m_tts = std::make_unique< TextToSpeech >();
+			// Anything that has been queued before is picked up now
+			dispatch();
+		},
+		Qt::DirectConnection);
+	connect(
+		&m_thread, &QThread::finished, &m_timer,
+		[this]() {
+			m_timer.stop();
+			m_tts.reset();
+		},
+		Qt::DirectConnection);
+
+	m_thread.start(QThread::LowPriority);
+#endif
+}
+
+TextToSpeechDispatcher::~TextToSpeechDispatcher() {
+	{
+		QMutexLocker lock(&m_mutex);
+		m_queue.clear();
+	}
+
+	m_thread.quit();
+	m_thread.wait();
+}
+
+void TextToSpeechDispatcher::say(const QString &text, const QString &key) {
+	{
+		QMutexLocker lock(&m_mutex);
+		if (m_queue.push(key, text)) {
+			qWarning("TextToSpeech: Too many messages are waiting to be spoken, dropping the oldest one");
+		}
+	}
+
+	emit pending();
+}
+
+void TextToSpeechDispatcher::setVolume(int volume) {
+	{
+		QMutexLocker lock(&m_mutex);
+		m_volume = volume;
+	}
+
+	emit pending();
+}
+
+void TextToSpeechDispatcher::dispatch() {
+	if (!m_tts) {
+		return;
+	}
+
+	QString text;
+	int volume = -1;
+	qint64 wait;
+	{
+		QMutexLocker lock(&m_mutex);
+		std::swap(volume, m_volume);
+		text = m_queue.pop(m_clock.elapsed());
+		wait = m_queue.timeUntilNext(m_clock.elapsed());
+	}
+
+	if (volume != -1) {
+		m_tts->setVolume(volume);
+	}
+	if (!text.isNull()) {
+		m_tts->say(text);
+	}
+
+	if (wait >= 0) {
+		m_timer.start(static_cast< int >(wait));
+	}
+}
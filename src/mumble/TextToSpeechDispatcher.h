@@ -0,0 +1,62 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_TEXTTOSPEECHDISPATCHER_H_
+#define MUMBLE_MUMBLE_TEXTTOSPEECHDISPATCHER_H_
+
+#include "TextToSpeechQueue.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+#include <memory>
+
+class TextToSpeech;
+
+/// Hands the messages to be spoken to the TextToSpeech backend, which runs in a thread of its own.
+///
+/// Some backends block while they are being given a message (e.g. speech-dispatcher, which is talked to through a
+/// socket), which used to stall the GUI thread Log::log() runs in. The messages are queued in a TextToSpeechQueue,
+/// from which the backend's thread takes them about as fast as they can be spoken.
+class TextToSpeechDispatcher : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(TextToSpeechDispatcher)
+
+public:
+	explicit TextToSpeechDispatcher(QObject *parent = nullptr);
+	/// Drops the pending messages and stops the backend's thread
+	~TextToSpeechDispatcher() Q_DECL_OVERRIDE;
+
+	/// Queues the given text to be spoken (see TextToSpeechQueue::push()). Never blocks on the backend.
+	void say(const QString &text, const QString &key = QString());
+	void setVolume(int volume);
+
+signals:
+	/// Emitted when a message has been queued or the volume has changed
+	void pending();
+
+protected:
+	QThread m_thread;
+	/// Lives in m_thread (unless on macOS, see the constructor)
+	QTimer m_timer;
+	/// Only accessed from m_thread
+	std::unique_ptr< TextToSpeech > m_tts;
+
+	/// Guards the members below, which are shared with m_thread
+	QMutex m_mutex;
+	TextToSpeechQueue m_queue;
+	QElapsedTimer m_clock;
+	/// The volume the backend is to be set to or -1 if it hasn't changed
+	int m_volume = -1;
+
+	/// Passes the volume and the next message that is due to the backend. Runs in m_thread.
+	void dispatch();
+};
+
+#endif // MUMBLE_MUMBLE_TEXTTOSPEECHDISPATCHER_H_
@@ -0,0 +1,65 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TextToSpeechQueue.h"
+
+#include <algorithm>
+
+constexpr std::size_t TextToSpeechQueue::MAX_PENDING;
+constexpr qint64 TextToSpeechQueue::MIN_INTERVAL;
+constexpr qint64 TextToSpeechQueue::CHARACTER_DURATION;
+
+bool TextToSpeechQueue::push(const QString &key, const QString &text) {
+	if (!key.isEmpty()) {
+		auto it = std::find_if(m_pending.begin(), m_pending.end(),
+							   [&key](const Entry &entry) { return entry.key == key; });
+		if (it != m_pending.end()) {
+			it->text = text;
+			return false;
+		}
+	}
+
+	m_pending.push_back({ key, text });
+
+	if (m_pending.size() > MAX_PENDING) {
+		m_pending.pop_front();
+		return true;
+	}
+
+	return false;
+}
+
+QString TextToSpeechQueue::pop(qint64 now) {
+	if (m_pending.empty() || now < m_nextDue) {
+		return QString();
+	}
+
+	const QString text = m_pending.front().text;
+	m_pending.pop_front();
+
+	m_nextDue = now + duration(text);
+
+	return text;
+}
+
+qint64 TextToSpeechQueue::timeUntilNext(qint64 now) const {
+	if (m_pending.empty()) {
+		return -1;
+	}
+
+	return std::max< qint64 >(0, m_nextDue - now);
+}
+
+void TextToSpeechQueue::clear() {
+	m_pending.clear();
+}
+
+std::size_t TextToSpeechQueue::size() const {
+	return m_pending.size();
+}
+
+qint64 TextToSpeechQueue::duration(const QString &text) {
+	return std::max(MIN_INTERVAL, static_cast< qint64 >(text.size()) * CHARACTER_DURATION);
+}
@@ -0,0 +1,61 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_TEXTTOSPEECHQUEUE_H_
+#define MUMBLE_MUMBLE_TEXTTOSPEECHQUEUE_H_
+
+#include <QtCore/QString>
+
+#include <deque>
+
+/// The messages that are waiting to be spoken.
+///
+/// The speech backends queue everything they are given and take their time speaking it, so in a busy channel a
+/// backlog forms that is still being read out minutes later. Instead, messages are only handed to the backend about
+/// as fast as it can speak them and wait here in the meantime, where the backlog is kept short:
+/// - A message replaces the pending one with the same key (e.g. the previous text message of the same sender), as
+///   it usually makes it obsolete.
+/// - If there are more than MAX_PENDING messages, the oldest ones are dropped.
+class TextToSpeechQueue {
+public:
+	/// The most messages that are waiting to be spoken
+	static constexpr std::size_t MAX_PENDING = 8;
+	/// The least time between two messages (in milliseconds)
+	static constexpr qint64 MIN_INTERVAL = 500;
+	/// The time speaking a character is assumed to take (in milliseconds), which is about 170 words per minute
+	static constexpr qint64 CHARACTER_DURATION = 70;
+
+	/// Queues the given message. If the key isn't empty, a pending message with the same key is replaced (keeping its
+	/// position in the queue).
+	/// @returns Whether an older message has been dropped to make room for it
+	bool push(const QString &key, const QString &text);
+	/// @param now The current time on a monotonic clock (in milliseconds)
+	/// @returns The message to be spoken now or a null string if there is none or the previous one is likely still
+	/// 	being spoken
+	QString pop(qint64 now);
+	/// @param now The current time on the clock given to pop() (in milliseconds)
+	/// @returns The time until the next message is due (in milliseconds) or -1 if there is none
+	qint64 timeUntilNext(qint64 now) const;
+
+	/// Drops all pending messages
+	void clear();
+	/// @returns The number of pending messages
+	std::size_t size() const;
+
+	/// @returns The time the given message is assumed to take to be spoken (in milliseconds)
+	static qint64 duration(const QString &text);
+
+protected:
+	struct Entry {
+		QString key;
+		QString text;
+	};
+
+	std::deque< Entry > m_pending;
+	/// The time the next message may be popped at
+	qint64 m_nextDue = 0;
+};
+
+#endif // MUMBLE_MUMBLE_TEXTTOSPEECHQUEUE_H_
@@ -16,6 +16,8 @@
 class TextToSpeechPrivate {
 public:
 	ISpVoice *pVoice;
+	/// Whether COM has been initialized for the thread the voice is created in (see TextToSpeechDispatcher)
+	bool bCOMInitialized;
 	TextToSpeechPrivate();
 	~TextToSpeechPrivate();
 	void say(const QString &text);
@@ -25,6 +27,8 @@ public:
 TextToSpeechPrivate::TextToSpeechPrivate() {
 	pVoice = nullptr;
 
+	bCOMInitialized = !HAS_FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED));
+
 	HRESULT hr = CoCreateInstance(CLSID_SpVoice, nullptr, CLSCTX_ALL, IID_ISpVoice, (void **) &pVoice);
 	if (HAS_FAILED(hr))
 		qWarning("TextToSpeechPrivate: Failed to allocate TTS Voice");
@@ -33,6 +37,9 @@ TextToSpeechPrivate::TextToSpeechPrivate() {
 TextToSpeechPrivate::~TextToSpeechPrivate() {
 	if (pVoice)
 		pVoice->Release();
+
+	if (bCOMInitialized)
+		CoUninitialize();
 }
 
 void TextToSpeechPrivate::say(const QString &text) {
@@ -81,8 +81,12 @@ bool Themes::applyConfigured() {
 	return true;
 }
 
+/// Incremented by every Themes::setTheme()
+static unsigned int themeGeneration = 0;
+
 void Themes::setTheme(QString &themeQss, QStringList &skinPaths) {
 	QDir::setSearchPaths(QLatin1String("skin"), skinPaths);
+	themeGeneration++;
 
 	QString userStylesheetFn = userStylesheetPath();
 	QString userStylesheetContent;
@@ -105,6 +109,10 @@ bool Themes::apply() {
 	return result;
 }
 
+unsigned int Themes::generation() {
+	return themeGeneration;
+}
+
 ThemeMap Themes::getThemes() {
 	return ThemeInfo::scanDirectories(getSearchDirectories());
 }
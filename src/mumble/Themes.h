@@ -37,6 +37,10 @@ public:
 	/// Returns the per user themes directory
 	static QDir getUserThemesDirectory();
 
+	/// Returns a number that changes whenever a theme is applied, so that whatever has been rendered from the
+	/// previous theme's skin (e.g. by IconCache) can be dropped
+	static unsigned int generation();
+
 private:
 	/// Applies the fallback stylesheet
 	static void applyFallback();
@@ -0,0 +1,54 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UIUpdateScheduler.h"
+
+#include <QtCore/QTimer>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QScreen>
+
+#include <cmath>
+
+constexpr int UIUpdateScheduler::MAX_RATE;
+
+UIUpdateScheduler::UIUpdateScheduler(QObject *parent) : QObject(parent), m_timer(new QTimer(this)) {
+	m_timer->setSingleShot(true);
+	// A coarse timer may fire up to 5% late, which is less than what the update's rate is rounded by anyway
+	m_timer->setTimerType(Qt::PreciseTimer);
+
+	connect(m_timer, &QTimer::timeout, this, &UIUpdateScheduler::update);
+}
+
+void UIUpdateScheduler::markUser(unsigned int session) {
+	m_users.insert(session);
+	schedule();
+}
+
+void UIUpdateScheduler::markChannel(unsigned int channelID) {
+	m_channels.insert(channelID);
+	schedule();
+}
+
+int UIUpdateScheduler::interval() {
+	const QScreen *screen   = QGuiApplication::primaryScreen();
+	const qreal refreshRate = (screen && screen->refreshRate() > 0) ? screen->refreshRate() : 60.0;
+
+	return static_cast< int >(std::ceil(1000.0 / qMin(refreshRate, static_cast< qreal >(MAX_RATE))));
+}
+
+void UIUpdateScheduler::schedule() {
+	if (!m_timer->isActive()) {
+		m_timer->start(interval());
+	}
+}
+
+void UIUpdateScheduler::update() {
+	QSet< unsigned int > users;
+	QSet< unsigned int > channels;
+	users.swap(m_users);
+	channels.swap(m_channels);
+
+	emit updateDue(users, channels);
+}
@@ -0,0 +1,53 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_UIUPDATESCHEDULER_H_
+#define MUMBLE_MUMBLE_UIUPDATESCHEDULER_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+
+class QTimer;
+
+/// Collects the users and channels whose representation in the UI is out of date, so that the views update all of
+/// them at once (once per frame of the screen, but no more often than MAX_RATE times a second) rather than for every
+/// change. The talking state of a user alone may change many times a second, which would otherwise have every view
+/// repaint just as often for each user that speaks.
+///
+/// There is a single instance (see Global::uiUpdateScheduler), so all views update in the same frame.
+class UIUpdateScheduler : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(UIUpdateScheduler)
+
+public:
+	/// The most updates per second, whatever the refresh rate of the screen
+	static constexpr int MAX_RATE = 30;
+
+	explicit UIUpdateScheduler(QObject *parent = nullptr);
+
+	/// Marks the given user as out of date until the next update
+	void markUser(unsigned int session);
+	/// Marks the given channel as out of date until the next update
+	void markChannel(unsigned int channelID);
+
+	/// @returns The time between two updates in milliseconds, which follows the refresh rate of the primary screen
+	static int interval();
+
+signals:
+	/// Emitted once per frame in which something has been marked, with everything that has been marked since the
+	/// previous update. Whatever is marked while this is being handled goes into the next update.
+	void updateDue(const QSet< unsigned int > &users, const QSet< unsigned int > &channels);
+
+protected:
+	QTimer *m_timer;
+	QSet< unsigned int > m_users;
+	QSet< unsigned int > m_channels;
+
+	void schedule();
+	void update();
+};
+
+#endif // MUMBLE_MUMBLE_UIUPDATESCHEDULER_H_
@@ -11,6 +11,7 @@
 #include "LCD.h"
 #include "Log.h"
 #include "MainWindow.h"
+#include "Profiler.h"
 #ifdef USE_OVERLAY
 #	include "Overlay.h"
 #endif
@@ -41,6 +42,7 @@ ModelItem::ModelItem(Channel *c) {
 	c_qhChannels.insert(c, this);
 	parent = c_qhChannels.value(c->cParent);
 	iUsers = 0;
+	iRow   = -1;
 }
 
 ModelItem::ModelItem(ClientUser *p, bool isListener) {
@@ -59,6 +61,7 @@ ModelItem::ModelItem(ClientUser *p, bool isListener) {
 	}
 	parent = c_qhChannels.value(p->cChannel);
 	iUsers = 0;
+	iRow   = -1;
 }
 
 ModelItem::ModelItem(ModelItem *i) {
@@ -79,6 +82,7 @@ ModelItem::ModelItem(ModelItem *i) {
 		c_qhChannels.insert(cChan, this);
 
 	iUsers = i->iUsers;
+	iRow   = -1;
 }
 
 ModelItem::~ModelItem() {
@@ -147,10 +151,18 @@ int ModelItem::rowOfSelf() const {
 	if (!parent)
 		return 0;
 
-	if (pUser)
-		return parent->rowOf(pUser, isListener);
-	else
-		return parent->rowOf(cChan);
+	const QList< ModelItem * > &siblings = parent->qlChildren;
+	if (iRow < 0 || iRow >= siblings.count() || siblings.at(iRow) != this) {
+		// A sibling has been inserted or removed before this item. Renumbering all of them at once keeps the lookups
+		// of the others constant until the rows change again.
+		for (int i = 0; i < siblings.count(); i++)
+			siblings.at(i)->iRow = i;
+
+		if (iRow < 0 || iRow >= siblings.count() || siblings.at(iRow) != this)
+			return -1;
+	}
+
+	return iRow;
 }
 
 int ModelItem::rows() const {
@@ -158,38 +170,31 @@ int ModelItem::rows() const {
 }
 
 int ModelItem::insertIndex(Channel *c) const {
-	QList< Channel * > qlpc;
-	ModelItem *item;
-
+	int before = 0;
 	int ocount = 0;
 
-	foreach (item, qlChildren) {
+	// The children are kept sorted, so the channel goes right after the ones that sort before it
+	for (const ModelItem *item : qlChildren) {
 		if (item->cChan) {
-			if (item->cChan != c) {
-				qlpc << item->cChan;
+			if (item->cChan != c && Channel::lessThan(item->cChan, c)) {
+				before++;
 			}
 		} else
 			ocount++;
 	}
-	qlpc << c;
-	std::sort(qlpc.begin(), qlpc.end(), Channel::lessThan);
-	return qlpc.indexOf(c) + (bUsersTop ? ocount : 0);
+	return before + (bUsersTop ? ocount : 0);
 }
 
 int ModelItem::insertIndex(ClientUser *p, bool userIsListener) const {
-	QList< ClientUser * > qlclientuser;
-	ModelItem *item;
-
+	int before        = 0;
 	int ocount        = 0;
 	int listenerCount = 0;
 
-	foreach (item, qlChildren) {
+	for (const ModelItem *item : qlChildren) {
 		if (item->pUser) {
-			if (item->pUser != p) {
-				// Make sure listeners and non-listeners are all grouped together and not mixed
-				if ((userIsListener && item->isListener) || (!userIsListener && !item->isListener)) {
-					qlclientuser << item->pUser;
-				}
+			// Make sure listeners and non-listeners are all grouped together and not mixed
+			if (item->pUser != p && item->isListener == userIsListener && ClientUser::lessThan(item->pUser, p)) {
+				before++;
 			}
 
 			if (item->isListener) {
@@ -200,13 +205,10 @@ int ModelItem::insertIndex(ClientUser *p, bool userIsListener) const {
 		}
 	}
 
-	qlclientuser << p;
-	std::sort(qlclientuser.begin(), qlclientuser.end(), ClientUser::lessThan);
-
 	// Make sure that the a user is always added to other users either all above or all below
 	// sub-channels) and also make sure that listeners are grouped together and directly above
 	// normal users.
-	return qlclientuser.indexOf(p) + (bUsersTop ? 0 : ocount) + (userIsListener ? 0 : listenerCount);
+	return before + (bUsersTop ? 0 : ocount) + (userIsListener ? 0 : listenerCount);
 }
 
 QString ModelItem::hash() const {
@@ -266,6 +268,8 @@ UserModel::UserModel(QObject *p) : QAbstractItemModel(p) {
 	iChannelDescription = -1;
 	bClicked            = false;
 
+	connect(Global::get().uiUpdateScheduler.get(), &UIUpdateScheduler::updateDue, this, &UserModel::on_updateDue);
+
 	miRoot = new ModelItem(Channel::get(Channel::ROOT_ID));
 }
 
@@ -276,6 +280,15 @@ UserModel::~UserModel() {
 	delete miRoot;
 }
 
+QList< QIcon > UserModel::icons() const {
+	return { qiTalkingOn,       qiTalkingMuted,    qiTalkingWhisper,  qiTalkingShout,  qiTalkingOff,
+			 qiMutedPushToMute, qiMutedSelf,       qiMutedServer,     qiMutedLocal,    qiIgnoredLocal,
+			 qiMutedSuppressed, qiPrioritySpeaker, qiRecording,       qiDeafenedSelf,  qiDeafenedServer,
+			 qiAuthenticated,   qiChannel,         qiLinkedChannel,   qiActiveChannel, qiFriend,
+			 qiComment,         qiCommentSeen,     qiFilter,          qiPin,           qiLock_locked,
+			 qiLock_unlocked,   qiEar };
+}
+
 
 int UserModel::columnCount(const QModelIndex &) const {
 	return 1;
@@ -295,7 +308,7 @@ QModelIndex UserModel::index(int row, int column, const QModelIndex &p) const {
 		item = static_cast< ModelItem * >(p.internalPointer());
 	}
 
-	if (!item)
+	if (!item || m_bulkLoading)
 		return idx;
 
 	if (!item->validRow(row))
@@ -378,7 +391,7 @@ int UserModel::rowCount(const QModelIndex &p) const {
 	else
 		item = static_cast< ModelItem * >(p.internalPointer());
 
-	if (!item || (p.column() != 0))
+	if (!item || (p.column() != 0) || m_bulkLoading)
 		return 0;
 
 	val = item->rows();
@@ -851,7 +864,7 @@ ModelItem *UserModel::moveItem(ModelItem *oldparent, ModelItem *newparent, Model
 	// Here's the idea. We insert the item, update persistent indexes, THEN remove it.
 
 	// Get the current position of the item under its parent (aka its "row")
-	int oldrow = oldparent->qlChildren.indexOf(oldItem);
+	int oldrow = oldItem->rowOfSelf();
 
 	// Get the row of the item at its new position. This depends on whether we're moving a
 	// channel or a user.
@@ -862,6 +875,23 @@ ModelItem *UserModel::moveItem(ModelItem *oldparent, ModelItem *newparent, Model
 		newrow = newparent->insertIndex(oldItem->pUser);
 	}
 
+	if (m_bulkLoading) {
+		// No view knows about the item, so it can simply be moved (as the new row doesn't count the item itself, it
+		// applies after the removal)
+		oldparent->qlChildren.removeAt(oldrow);
+		oldItem->parent = newparent;
+		newparent->qlChildren.insert(newrow, oldItem);
+
+		if (oldItem->cChan) {
+			oldparent->cChan->removeChannel(oldItem->cChan);
+			newparent->cChan->addChannel(oldItem->cChan);
+		} else {
+			newparent->cChan->addClientUser(oldItem->pUser);
+		}
+
+		return oldItem;
+	}
+
 	if ((oldparent == newparent) && (newrow == oldrow)) {
 		// This is a no-op. We still claim that the data has changed in order
 		// to trigger potential event handlers.
@@ -967,6 +997,9 @@ ModelItem *UserModel::moveItem(ModelItem *oldparent, ModelItem *newparent, Model
 }
 
 void UserModel::expandAll(Channel *c) {
+	if (m_bulkLoading)
+		return;
+
 	QStack< Channel * > chans;
 
 	while (c) {
@@ -980,6 +1013,9 @@ void UserModel::expandAll(Channel *c) {
 }
 
 void UserModel::collapseEmpty(Channel *c) {
+	if (m_bulkLoading)
+		return;
+
 	while (c) {
 		ModelItem *mi = ModelItem::c_qhChannels.value(c);
 		if (mi->iUsers == 0)
@@ -991,7 +1027,7 @@ void UserModel::collapseEmpty(Channel *c) {
 }
 
 void UserModel::ensureSelfVisible() {
-	if (!Global::get().uiSession)
+	if (!Global::get().uiSession || m_bulkLoading)
 		return;
 
 	Global::get().mw->qtvUsers->scrollTo(index(ClientUser::get(Global::get().uiSession)));
@@ -1051,10 +1087,12 @@ ClientUser *UserModel::addUser(unsigned int id, const QString &name) {
 
 	int row = citem->insertIndex(p);
 
-	beginInsertRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginInsertRows(index(citem), row, row);
 	citem->qlChildren.insert(row, item);
 	c->addClientUser(p);
-	endInsertRows();
+	if (!m_bulkLoading)
+		endInsertRows();
 
 	while (citem) {
 		citem->iUsers++;
@@ -1078,12 +1116,14 @@ void UserModel::removeUser(ClientUser *p) {
 	ModelItem *item  = ModelItem::c_qhUsers.value(p);
 	ModelItem *citem = ModelItem::c_qhChannels.value(c);
 
-	int row = citem->qlChildren.indexOf(item);
+	int row = item->rowOfSelf();
 
-	beginRemoveRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginRemoveRows(index(citem), row, row);
 	c->removeUser(p);
 	citem->qlChildren.removeAt(row);
-	endRemoveRows();
+	if (!m_bulkLoading)
+		endRemoveRows();
 
 	p->cChannel = nullptr;
 
@@ -1145,6 +1185,8 @@ void UserModel::renameUser(ClientUser *p, const QString &name) {
 	moveItem(pi, pi, item);
 
 	updateOverlay();
+
+	emit userRenamed(p->uiSession);
 }
 
 void UserModel::setUserId(ClientUser *p, int id) {
@@ -1352,12 +1394,14 @@ Channel *UserModel::addChannel(unsigned int id, Channel *p, const QString &name)
 
 	int row = citem->insertIndex(c);
 
-	beginInsertRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginInsertRows(index(citem), row, row);
 	p->addChannel(c);
 	citem->qlChildren.insert(row, item);
-	endInsertRows();
+	if (!m_bulkLoading)
+		endInsertRows();
 
-	if (Global::get().s.ceExpand == Settings::AllChannels)
+	if (Global::get().s.ceExpand == Settings::AllChannels && !m_bulkLoading)
 		Global::get().mw->qtvUsers->setExpanded(index(item), true);
 
 
@@ -1374,9 +1418,11 @@ void UserModel::addChannelListener(ClientUser *p, Channel *c) {
 
 	int row = citem->insertIndex(p, true);
 
-	beginInsertRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginInsertRows(index(citem), row, row);
 	citem->qlChildren.insert(row, item);
-	endInsertRows();
+	if (!m_bulkLoading)
+		endInsertRows();
 
 	while (citem) {
 		citem->iUsers++;
@@ -1469,11 +1515,13 @@ void UserModel::removeChannelListener(ModelItem *item, ModelItem *citem) {
 		return;
 	}
 
-	int row = citem->qlChildren.indexOf(item);
+	int row = item->rowOfSelf();
 
-	beginRemoveRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginRemoveRows(index(citem), row, row);
 	citem->qlChildren.removeAt(row);
-	endRemoveRows();
+	if (!m_bulkLoading)
+		endRemoveRows();
 
 	while (citem) {
 		citem->iUsers--;
@@ -1513,13 +1561,15 @@ bool UserModel::removeChannel(Channel *c, const bool onlyIfUnoccupied) {
 
 	ModelItem *citem = ModelItem::c_qhChannels.value(p);
 
-	int row = citem->rowOf(c);
+	int row = item->rowOfSelf();
 
-	beginRemoveRows(index(citem), row, row);
+	if (!m_bulkLoading)
+		beginRemoveRows(index(citem), row, row);
 	p->removeChannel(c);
 	citem->qlChildren.removeAt(row);
 	qsLinked.remove(c);
-	endRemoveRows();
+	if (!m_bulkLoading)
+		endRemoveRows();
 
 	Channel::remove(c);
 
@@ -1574,6 +1624,14 @@ void UserModel::removeAll() {
 	ModelItem *item = miRoot;
 	ModelItem *i;
 
+	// Removing the users and channels one by one would update the views for every one of them. There is nothing
+	// to expand afterwards, so this doesn't need the rest of endBulkLoad() (which mustn't run on destruction).
+	const bool reset = !m_bulkLoading;
+	if (reset) {
+		beginResetModel();
+		m_bulkLoading = true;
+	}
+
 	uiSessionComment    = 0;
 	iChannelDescription = -1;
 	bClicked            = false;
@@ -1594,9 +1652,55 @@ void UserModel::removeAll() {
 
 	qsLinked.clear();
 
+	if (reset) {
+		m_bulkLoading = false;
+		endResetModel();
+	}
+
+	updateOverlay();
+}
+
+void UserModel::beginBulkLoad() {
+	if (m_bulkLoading)
+		return;
+
+	beginResetModel();
+	m_bulkLoading = true;
+}
+
+void UserModel::endBulkLoad() {
+	if (!m_bulkLoading)
+		return;
+
+	m_bulkLoading = false;
+	endResetModel();
+
+	// The reset has collapsed everything
+	if (Global::get().s.ceExpand != Settings::NoChannels) {
+		QTreeView *v = Global::get().mw->qtvUsers;
+
+		QStack< ModelItem * > items;
+		items.push(miRoot);
+		while (!items.isEmpty()) {
+			ModelItem *item = items.pop();
+			if (Global::get().s.ceExpand == Settings::AllChannels || item->iUsers > 0)
+				v->setExpanded(index(item), true);
+
+			for (ModelItem *child : item->qlChildren) {
+				if (child->cChan)
+					items.push(child);
+			}
+		}
+	}
+
+	ensureSelfVisible();
 	updateOverlay();
 }
 
+bool UserModel::isBulkLoading() const {
+	return m_bulkLoading;
+}
+
 ClientUser *UserModel::getUser(const QModelIndex &idx) const {
 	if (!idx.isValid())
 		return nullptr;
@@ -1701,8 +1805,32 @@ void UserModel::userStateChanged() {
 	if (!user)
 		return;
 
-	const QModelIndex idx = index(user);
-	emit dataChanged(idx, idx);
+	// The talking state of many users changes many times a second, which repaints no more often than once per frame
+	// this way
+	Global::get().uiUpdateScheduler->markUser(user->uiSession);
+}
+
+void UserModel::on_updateDue(const QSet< unsigned int > &users, const QSet< unsigned int > &channels) {
+	MUMBLE_PROFILE_ZONE("UserModel::on_updateDue");
+	// The reset at the end of a bulk load repaints everything anyway
+	if (m_bulkLoading)
+		return;
+
+	// Users and channels may have been removed since they have been marked
+	for (unsigned int session : users) {
+		ClientUser *user = ClientUser::get(session);
+		if (user && ModelItem::c_qhUsers.contains(user)) {
+			const QModelIndex idx = index(user);
+			emit dataChanged(idx, idx);
+		}
+	}
+	for (unsigned int id : channels) {
+		Channel *channel = Channel::get(id);
+		if (channel && ModelItem::c_qhChannels.contains(channel)) {
+			const QModelIndex idx = index(channel);
+			emit dataChanged(idx, idx);
+		}
+	}
 
 	updateOverlay();
 }
@@ -1716,12 +1844,12 @@ void UserModel::on_channelListenerLocalVolumeAdjustmentChanged(unsigned int chan
 }
 
 void UserModel::forceVisualUpdate(Channel *c) {
-	QModelIndex idx;
 	if (c) {
-		idx = index(c);
+		Global::get().uiUpdateScheduler->markChannel(c->iId);
+		return;
 	}
 
-	emit dataChanged(idx, idx);
+	emit dataChanged(QModelIndex(), QModelIndex());
 
 	updateOverlay();
 }
@@ -1964,6 +2092,9 @@ bool UserModel::dropMimeData(const QMimeData *md, Qt::DropAction, int row, int c
 }
 
 void UserModel::updateOverlay() const {
+	if (m_bulkLoading)
+		return;
+
 #ifdef USE_OVERLAY
 	Global::get().o->updateOverlay();
 #endif
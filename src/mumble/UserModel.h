@@ -34,6 +34,8 @@ public:
 	QList< ModelItem * > qlHiddenChildren;
 	/// Number of users in this channel (recursive)
 	int iUsers;
+	/// The row of this item under its parent as of the last lookup, which rowOfSelf() checks before relying on it
+	mutable int iRow;
 
 	static QHash< const Channel *, ModelItem * > c_qhChannels;
 	static QHash< const ClientUser *, ModelItem * > c_qhUsers;
@@ -84,6 +86,12 @@ protected:
 
 	bool bClicked;
 
+	/// Whether the model is being reset (see beginBulkLoad())
+	bool m_bulkLoading = false;
+
+	/// Updates the view for the given users and channels (see UIUpdateScheduler)
+	void on_updateDue(const QSet< unsigned int > &users, const QSet< unsigned int > &channels);
+
 	void recursiveClone(const ModelItem *old, ModelItem *item, QModelIndexList &from, QModelIndexList &to);
 	ModelItem *moveItem(ModelItem *oldparent, ModelItem *newparent, ModelItem *item);
 
@@ -110,6 +118,9 @@ public:
 	QModelIndex index(ModelItem *) const;
 	QModelIndex channelListenerIndex(const ClientUser *, const Channel *, int column = 0) const;
 
+	/// @returns All icons the model decorates its items with (e.g. so that they can be rasterized ahead of time)
+	QList< QIcon > icons() const;
+
 	QVariant data(const QModelIndex &index, int role) const Q_DECL_OVERRIDE;
 	Qt::ItemFlags flags(const QModelIndex &index) const Q_DECL_OVERRIDE;
 	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
@@ -189,6 +200,17 @@ public:
 
 	void removeAll();
 
+	/// Starts changing many users and channels at once (e.g. while the server's state is synchronized on connect),
+	/// until endBulkLoad() is called. Meanwhile, the model appears empty to the views: the tree grows without the
+	/// per-row signals (and the updates of the view, the overlay and the expansion of channels that come with them)
+	/// and the views are reset only once at the end.
+	void beginBulkLoad();
+	/// Ends what beginBulkLoad() has started (if it has), resetting the views and expanding the channels that the
+	/// settings call for
+	void endBulkLoad();
+	/// @returns Whether beginBulkLoad() has been called without endBulkLoad() yet
+	bool isBulkLoading() const;
+
 	void expandAll(Channel *c);
 	void collapseEmpty(Channel *c);
 
@@ -222,6 +244,10 @@ signals:
 	///
 	/// @param userSessionID The ID of that user's session
 	void userRemoved(unsigned int userSessionID);
+	/// A signal emitted whenever a user is renamed.
+	///
+	/// @param userSessionID The ID of that user's session
+	void userRenamed(unsigned int userSessionID);
 	/// A signal that emitted whenever a channel is added to the model.
 	///
 	/// @param channelID The ID of the channel
@@ -10,6 +10,7 @@
 #include "Log.h"
 #include "MainWindow.h"
 #include "ServerHandler.h"
+#include "Themes.h"
 #include "UserModel.h"
 #include "Global.h"
 
@@ -27,6 +28,12 @@ void UserDelegate::adjustIcons(int iconTotalDimension, int iconIconPadding, int
 	m_iconIconDimension  = iconIconDimension;
 }
 
+void UserDelegate::warmIcons(const QList< QIcon > &icons, const QSize &decorationSize, qreal devicePixelRatio) {
+	m_iconCache.setGeneration(Themes::generation());
+	m_iconCache.warm(icons, QSize(m_iconIconDimension, m_iconIconDimension), devicePixelRatio);
+	m_iconCache.warm(icons, decorationSize, devicePixelRatio);
+}
+
 void UserDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const {
 	const QAbstractItemModel *m = index.model();
 	const QModelIndex idxc1     = index.sibling(index.row(), 1);
@@ -44,8 +51,11 @@ void UserDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
 	QStyleOptionViewItem o = option;
 	initStyleOption(&o, index);
 
-	QStyle *style        = o.widget->style();
-	QIcon::Mode iconMode = QIcon::Normal;
+	QStyle *style                = o.widget->style();
+	QIcon::Mode iconMode         = QIcon::Normal;
+	const qreal devicePixelRatio = painter->device()->devicePixelRatioF();
+
+	m_iconCache.setGeneration(Themes::generation());
 
 	QPalette::ColorRole colorRole = ((o.state & QStyle::State_Selected) ? QPalette::HighlightedText : QPalette::Text);
 #if defined(Q_OS_WIN)
@@ -69,7 +79,11 @@ void UserDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
 
 	// draw icon
 	QRect decorationRect = style->subElementRect(QStyle::SE_ItemViewItemDecoration, &o, o.widget);
-	o.icon.paint(painter, decorationRect, o.decorationAlignment, iconMode, QIcon::On);
+	const QPixmap decoration = m_iconCache.pixmap(o.icon, o.decorationSize, devicePixelRatio, iconMode);
+	if (!decoration.isNull()) {
+		const QRect r = QStyle::alignedRect(o.direction, o.decorationAlignment, o.decorationSize, decorationRect);
+		painter->drawPixmap(r.topLeft(), decoration);
+	}
 
 	// draw text
 	QRect textRect   = style->subElementRect(QStyle::SE_ItemViewItemText, &o, o.widget);
@@ -87,7 +101,8 @@ void UserDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option,
 		r.setSize(QSize(m_iconIconDimension, m_iconIconDimension));
 		r.translate(i * m_iconTotalDimension + m_iconIconPadding, m_iconIconPadding);
 		QRect p = QStyle::alignedRect(option.direction, option.decorationAlignment, r.size(), r);
-		qvariant_cast< QIcon >(ql[i]).paint(painter, p, option.decorationAlignment, iconMode, QIcon::On);
+		painter->drawPixmap(p.topLeft(),
+							m_iconCache.pixmap(qvariant_cast< QIcon >(ql[i]), p.size(), devicePixelRatio, iconMode));
 	}
 
 	painter->restore();
@@ -130,9 +145,24 @@ void UserView::adjustIcons() {
 	int iconIconPadding   = 1;
 	int iconIconDimension = m_iconTotalDimension - (2 * iconIconPadding);
 	m_userDelegate->adjustIcons(m_iconTotalDimension, iconIconPadding, iconIconDimension);
+
+	// Render the icons now, rather than while the tree is being painted for the first time
+	const UserModel *userModel = qobject_cast< const UserModel * >(model());
+	if (userModel) {
+		const int decorationDimension =
+			iconSize().isValid() ? iconSize().height() : style()->pixelMetric(QStyle::PM_SmallIconSize, nullptr, this);
+		m_userDelegate->warmIcons(userModel->icons(), QSize(decorationDimension, decorationDimension),
+								  viewport()->devicePixelRatioF());
+	}
+
 	viewport()->update();
 }
 
+void UserView::setModel(QAbstractItemModel *model) {
+	QTreeView::setModel(model);
+	adjustIcons();
+}
+
 /**
  * This implementation contains a special handler to display
  * custom what's this entries for items. All other events are
@@ -10,6 +10,7 @@
 #include <QtWidgets/QStyledItemDelegate>
 #include <QtWidgets/QTreeView>
 
+#include "IconCache.h"
 #include "QtUtils.h"
 #include "Timer.h"
 
@@ -21,11 +22,15 @@ private:
 	int m_iconTotalDimension;
 	int m_iconIconPadding;
 	int m_iconIconDimension;
+	/// The icons as they are painted, so that painting doesn't have to render them
+	mutable IconCache m_iconCache;
 
 public:
 	UserDelegate(QObject *parent);
 	void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const Q_DECL_OVERRIDE;
 	void adjustIcons(int iconTotalDimension, int iconIconPadding, int iconIconDimension);
+	/// Rasterizes the given icons at the sizes they are painted at
+	void warmIcons(const QList< QIcon > &icons, const QSize &decorationSize, qreal devicePixelRatio);
 
 public slots:
 	bool helpEvent(QHelpEvent *event, QAbstractItemView *view, const QStyleOptionViewItem &option,
@@ -48,6 +53,7 @@ protected:
 
 public:
 	UserView(QWidget *);
+	void setModel(QAbstractItemModel *model) Q_DECL_OVERRIDE;
 	void keyboardSearch(const QString &search) Q_DECL_OVERRIDE;
 	void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
 					 const QVector< int > &roles = QVector< int >()) Q_DECL_OVERRIDE;
@@ -7,34 +7,74 @@
 
 #include "AudioOutput.h"
 #include "ClientUser.h"
+#include "OggOpusWriter.h"
 #include "ServerHandler.h"
 #include "Global.h"
 
 #include "../Timer.h"
 
-#include <boost/make_shared.hpp>
+#include <QtCore/QFile>
 
-VoiceRecorder::RecordBuffer::RecordBuffer(int recordInfoIndex_, boost::shared_array< float > buffer_, int samples_,
-										  quint64 absoluteStartSample_)
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
-	: recordInfoIndex(recordInfoIndex_), buffer(buffer_), samples(samples_), absoluteStartSample(absoluteStartSample_) {
-	// Nothing
-}
+namespace {
+/// How long an idle writer sleeps before it looks for new blocks again. The tracks buffer a lot more than that.
+constexpr std::chrono::milliseconds WRITE_INTERVAL(50);
+} // namespace
 
-VoiceRecorder::RecordInfo::RecordInfo(const QString &userName_)
-	: userName(userName_), soundFile(nullptr), lastWrittenAbsoluteSample(0) {
-}
+/// Encodes the audio of a track and writes it to its file.
+class VoiceRecorderEncoder {
+public:
+	virtual ~VoiceRecorderEncoder() = default;
+
+	virtual void write(const float *samples, std::size_t count) = 0;
+};
+
+namespace {
+/// Writes a track with libsndfile, which encodes all formats but Opus.
+class SndFileEncoder : public VoiceRecorderEncoder {
+public:
+	explicit SndFileEncoder(SNDFILE *soundFile) : m_soundFile(soundFile) {}
+	~SndFileEncoder() override { sf_close(m_soundFile); }
 
-VoiceRecorder::RecordInfo::~RecordInfo() {
-	if (soundFile) {
-		// Close libsndfile's handle if we have one.
-		sf_close(soundFile);
+	void write(const float *samples, std::size_t count) override {
+		sf_write_float(m_soundFile, samples, static_cast< sf_count_t >(count));
 	}
+
+private:
+	SNDFILE *m_soundFile;
+};
+
+/// Writes a track in the Ogg Opus format, whose pages are streamed to the file as they fill up.
+class OpusFileEncoder : public VoiceRecorderEncoder {
+public:
+	OpusFileEncoder(std::unique_ptr< QFile > file, unsigned int sampleRate, const QString &title)
+		: m_file(std::move(file)), m_writer(*m_file, sampleRate, 1, title) {}
+
+	bool isValid() const { return m_writer.isValid(); }
+
+	void write(const float *samples, std::size_t count) override { m_writer.write(samples, count); }
+
+private:
+	/// Declared first, so that it is closed after the writer has finished
+	std::unique_ptr< QFile > m_file;
+	OggOpusWriter m_writer;
+};
+} // namespace
+
+VoiceRecorder::Track::Track(const QString &userName_)
+	: userName(userName_), blocks(new Block[TRACK_BLOCKS]), head(0), tail(0), failed(false),
+	  lastWrittenAbsoluteSample(0) {
 }
 
+VoiceRecorder::Track::~Track() = default;
+
 VoiceRecorder::VoiceRecorder(QObject *p, const Config &config)
-	: QThread(p), m_recordUser(new RecordUser()), m_timestamp(new Timer()), m_config(config), m_recording(false),
-	  m_abort(false), m_recordingStartTime(QDateTime::currentDateTime()), m_absoluteSampleEstimation(0) {
+	: QThread(p), m_trackCount(0), m_recordUser(new RecordUser()), m_timestamp(new Timer()), m_config(config),
+	  m_recording(false), m_abort(false), m_failed(false), m_recordingStartTime(QDateTime::currentDateTime()),
+	  m_absoluteSampleEstimation(0) {
 	// Nothing
 }
 
@@ -212,18 +252,17 @@ SF_INFO VoiceRecorder::createSoundFileInfo() const {
 			qWarning() << "VoiceRecorder: recording started to" << m_config.fileName << "@" << m_config.sampleRate
 					   << "hz in FLAC format";
 			break;
-#ifdef USE_SNDFILE_OPUS
 		case VoiceRecorderFormat::OPUS:
+			// Encoded by OggOpusWriter, so libsndfile doesn't have to support it
 			sfinfo.frames     = 0;
 			sfinfo.samplerate = m_config.sampleRate;
 			sfinfo.channels   = 1;
-			sfinfo.format     = SF_FORMAT_OGG | SF_FORMAT_OPUS;
+			sfinfo.format     = 0;
 			sfinfo.sections   = 0;
 			sfinfo.seekable   = 0;
 			qWarning() << "VoiceRecorder: recording started to" << m_config.fileName << "@" << m_config.sampleRate
 					   << "hz in OPUS format";
-			break;
-#endif
+			return sfinfo;
 #ifdef USE_SNDFILE_MP3
 		case VoiceRecorderFormat::MP3:
 			sfinfo.frames     = 0;
@@ -242,159 +281,228 @@ SF_INFO VoiceRecorder::createSoundFileInfo() const {
 	return sfinfo;
 }
 
-bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO &soundFileInfo, boost::shared_ptr< RecordInfo > &ri) {
-	if (ri->soundFile) {
+bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO &soundFileInfo, Track &track) {
+	if (track.encoder) {
 		// Nothing to do
 		return true;
 	}
 
-	QString filename = expandTemplateVariables(m_config.fileName, ri->userName);
+	// The writers may open files at the same time, which could otherwise end up with the same name (until the file
+	// exists)
+	static std::mutex uniqueFilenameMutex;
+	std::lock_guard< std::mutex > lock(uniqueFilenameMutex);
+
+	QString filename = expandTemplateVariables(m_config.fileName, track.userName);
 
 	// Try to find a unique filename.
-	{
-		int cnt = 1;
-		QString nf(filename);
-		QFileInfo tfi(filename);
-		while (QFile::exists(nf)) {
-			nf = tfi.path() + QLatin1Char('/') + tfi.completeBaseName() + QString(QLatin1String(" (%1).")).arg(cnt)
-				 + tfi.suffix();
-
-			++cnt;
-		}
-		filename = nf;
+	int cnt = 1;
+	QString nf(filename);
+	QFileInfo tfi(filename);
+	while (QFile::exists(nf)) {
+		nf = tfi.path() + QLatin1Char('/') + tfi.completeBaseName() + QString(QLatin1String(" (%1).")).arg(cnt)
+			 + tfi.suffix();
+
+		++cnt;
 	}
+	filename = nf;
+
 	qWarning() << "Recorder opens file" << filename;
 	QFileInfo fi(filename);
 
 	// Create the target path.
 	if (!QDir().mkpath(fi.absolutePath())) {
 		qWarning() << "Failed to create target directory: " << fi.absolutePath();
-		m_recording = false;
-		emit error(CreateDirectoryFailed, tr("Recorder failed to create directory '%1'").arg(fi.absolutePath()));
-		emit recording_stopped();
+		fail(CreateDirectoryFailed, tr("Recorder failed to create directory '%1'").arg(fi.absolutePath()));
 		return false;
 	}
 
+	if (m_config.recordingFormat == VoiceRecorderFormat::OPUS) {
+		auto file = std::make_unique< QFile >(filename);
+		if (!file->open(QIODevice::WriteOnly)) {
+			qWarning() << "Failed to open file for recorder: " << file->errorString();
+			fail(CreateFileFailed, tr("Recorder failed to open file '%1'").arg(filename));
+			return false;
+		}
+
+		auto encoder = std::make_unique< OpusFileEncoder >(std::move(file),
+														   static_cast< unsigned int >(m_config.sampleRate),
+														   track.userName);
+		if (!encoder->isValid()) {
+			qWarning() << "Failed to set up the Opus encoder for recorder @" << m_config.sampleRate << "hz";
+			fail(InvalidSampleRate, tr("Recorder failed to encode '%1' with Opus").arg(filename));
+			return false;
+		}
+
+		track.encoder = std::move(encoder);
+		return true;
+	}
+
 #ifdef Q_OS_WIN
 	// This is needed for unicode filenames on Windows.
-	ri->soundFile = sf_wchar_open(filename.toStdWString().c_str(), SFM_WRITE, &soundFileInfo);
+	SNDFILE *soundFile = sf_wchar_open(filename.toStdWString().c_str(), SFM_WRITE, &soundFileInfo);
 #else
-	ri->soundFile = sf_open(qPrintable(filename), SFM_WRITE, &soundFileInfo);
+	SNDFILE *soundFile = sf_open(qPrintable(filename), SFM_WRITE, &soundFileInfo);
 #endif
-	if (!ri->soundFile) {
+	if (!soundFile) {
 		qWarning() << "Failed to open file for recorder: " << sf_strerror(nullptr);
-		m_recording = false;
-		emit error(CreateFileFailed, tr("Recorder failed to open file '%1'").arg(filename));
-		emit recording_stopped();
+		fail(CreateFileFailed, tr("Recorder failed to open file '%1'").arg(filename));
 		return false;
 	}
 
 	// Store the username in the title attribute of the file (if supported by the format).
-	sf_set_string(ri->soundFile, SF_STR_TITLE, qPrintable(ri->userName));
+	sf_set_string(soundFile, SF_STR_TITLE, qPrintable(track.userName));
 
 	// Enable hard-clipping for non-float formats to prevent wrapping
 	if ((soundFileInfo.format & SF_FORMAT_SUBMASK) != SF_FORMAT_FLOAT
 		&& (soundFileInfo.format & SF_FORMAT_SUBMASK) != SF_FORMAT_VORBIS) {
-		sf_command(ri->soundFile, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+		sf_command(soundFile, SFC_SET_CLIPPING, nullptr, SF_TRUE);
 	}
 
+	track.encoder = std::make_unique< SndFileEncoder >(soundFile);
 	return true;
 }
 
+void VoiceRecorder::fail(Error err, const QString &strerr) {
+	m_recording = false;
+
+	if (!m_failed.exchange(true)) {
+		emit error(err, strerr);
+		emit recording_stopped();
+	}
+	m_sleepCondition.notify_all();
+}
+
 void VoiceRecorder::run() {
 	Q_ASSERT(!m_recording);
 
 	if (Global::get().sh && Global::get().sh->m_version < Version::fromComponents(1, 2, 3))
 		return;
 
-	SF_INFO soundFileInfo = createSoundFileInfo();
-
 	m_recording = true;
 	emit recording_started();
 
-	forever {
-		// Sleep until there is new data for us to process.
-		m_sleepLock.lock();
-		m_sleepCondition.wait(&m_sleepLock);
+	// The mixdown is a single track, which a single writer takes care of. Otherwise, a core is left to the audio
+	// thread and the rest of the application.
+	const unsigned int cores   = std::thread::hardware_concurrency();
+	const unsigned int writers = m_config.mixDownMode ? 1 : std::min(std::max(cores, 2U) - 1, 4U);
 
-		if (!m_recording || m_abort
-			|| (Global::get().sh && Global::get().sh->m_version < Version::fromComponents(1, 2, 3))) {
-			m_sleepLock.unlock();
-			break;
-		}
+	// This thread is the last writer
+	std::vector< std::thread > threads;
+	for (unsigned int i = 0; i + 1 < writers; ++i) {
+		threads.emplace_back(&VoiceRecorder::writeTracks, this, i, writers);
+	}
+	writeTracks(writers - 1, writers);
 
-		while (!m_abort && !m_recordBuffer.isEmpty()) {
-			boost::shared_ptr< RecordBuffer > rb;
-			{
-				QMutexLocker l(&m_bufferLock);
-				rb = m_recordBuffer.takeFirst();
-			}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
 
-			// Create the file for this RecordInfo instance if it's not yet open.
+	if (!m_failed) {
+		emit recording_stopped();
+	}
+	qWarning() << "VoiceRecorder: recording stopped";
+}
+
+void VoiceRecorder::writeTracks(unsigned int writer, unsigned int writers) {
+	SF_INFO soundFileInfo = createSoundFileInfo();
+
+	std::vector< std::shared_ptr< Track > > tracks;
+	std::size_t knownTracks = 0;
+
+	forever {
+		if (Global::get().sh && Global::get().sh->m_version < Version::fromComponents(1, 2, 3)) {
+			m_recording = false;
+		}
 
-			Q_ASSERT(m_recordInfo.contains(rb->recordInfoIndex));
-			boost::shared_ptr< RecordInfo > ri = m_recordInfo.value(rb->recordInfoIndex);
+		// Whatever has been added until the recording stopped is still written (unless aborted)
+		const bool stopping = !m_recording;
 
-			if (!ensureFileIsOpenedFor(soundFileInfo, ri)) {
-				return;
+		const std::size_t trackCount = m_trackCount.load(std::memory_order_acquire);
+		if (trackCount > knownTracks) {
+			std::lock_guard< std::mutex > lock(m_trackLock);
+			for (; knownTracks < trackCount; ++knownTracks) {
+				if (knownTracks % writers == writer) {
+					tracks.push_back(m_trackList[knownTracks]);
+				}
 			}
+		}
 
-			const qint64 missingSamples =
-				static_cast< qint64 >(rb->absoluteStartSample) - static_cast< qint64 >(ri->lastWrittenAbsoluteSample);
+		bool wrote = false;
+		for (const std::shared_ptr< Track > &track : tracks) {
+			if (m_abort) {
+				break;
+			}
 
-			static const qint64 heuristicSilenceThreshold = m_config.sampleRate / 10; // 100ms
-			if (missingSamples > heuristicSilenceThreshold) {
-				static const qint64 maxSamplesPerIteration = m_config.sampleRate * 1; // 1s
+			wrote = writeTrack(soundFileInfo, *track) || wrote;
+		}
 
-				const bool requeue = missingSamples > maxSamplesPerIteration;
+		if (m_abort || (stopping && !wrote)) {
+			break;
+		}
 
-				// Write |missingSamples| samples of silence up to |maxSamplesPerIteration|
-				const float buffer[1024] = {};
+		if (!wrote) {
+			std::unique_lock< std::mutex > lock(m_sleepLock);
+			m_sleepCondition.wait_for(lock, WRITE_INTERVAL, [this]() { return !m_recording; });
+		}
+	}
 
-				const qint64 silenceToWrite = std::min(missingSamples, maxSamplesPerIteration);
-				qint64 rest                 = silenceToWrite;
+	// Finishes the files
+	for (const std::shared_ptr< Track > &track : tracks) {
+		track->encoder.reset();
+	}
+}
+
+bool VoiceRecorder::writeTrack(SF_INFO &soundFileInfo, Track &track) {
+	const std::size_t head = track.head.load(std::memory_order_acquire);
+	std::size_t tail       = track.tail.load(std::memory_order_relaxed);
+	if (tail == head) {
+		return false;
+	}
+
+	// Create the file for this track if it's not yet open.
+	if (!track.failed && !ensureFileIsOpenedFor(soundFileInfo, track)) {
+		track.failed = true;
+	}
 
-				for (; rest > 1024; rest -= 1024)
-					sf_write_float(ri->soundFile, buffer, 1024);
+	for (; tail != head && !m_abort; ++tail) {
+		const Block &block = track.blocks[tail % TRACK_BLOCKS];
 
-				if (rest > 0)
-					sf_write_float(ri->soundFile, buffer, rest);
+		if (!track.failed) {
+			const qint64 missingSamples = static_cast< qint64 >(block.absoluteStartSample)
+										  - static_cast< qint64 >(track.lastWrittenAbsoluteSample);
 
-				ri->lastWrittenAbsoluteSample += static_cast< quint64 >(silenceToWrite);
+			const qint64 heuristicSilenceThreshold = m_config.sampleRate / 10; // 100ms
+			if (missingSamples > heuristicSilenceThreshold) {
+				// Write |missingSamples| samples of silence
+				static const std::array< float, 4800 > silence = {};
 
-				if (requeue) {
-					// Requeue the writing for this buffer to keep thread responsive
-					QMutexLocker l(&m_bufferLock);
-					m_recordBuffer.prepend(rb);
-					continue;
+				for (qint64 rest = missingSamples; rest > 0 && !m_abort;) {
+					const qint64 count = std::min(rest, static_cast< qint64 >(silence.size()));
+					track.encoder->write(silence.data(), static_cast< std::size_t >(count));
+					rest -= count;
 				}
+
+				track.lastWrittenAbsoluteSample += static_cast< quint64 >(missingSamples);
 			}
 
-			// Write the audio buffer and update the timestamp in |ri|.
-			sf_write_float(ri->soundFile, rb->buffer.get(), rb->samples);
-			ri->lastWrittenAbsoluteSample += static_cast< quint64 >(rb->samples);
+			// Write the audio block and update the timestamp in |track|.
+			track.encoder->write(block.buffer.data(), block.samples);
+			track.lastWrittenAbsoluteSample += block.samples;
 		}
 
-		m_sleepLock.unlock();
+		// Hands the block back to the audio thread
+		track.tail.store(tail + 1, std::memory_order_release);
 	}
 
-	m_recording = false;
-	{
-		QMutexLocker l(&m_bufferLock);
-		m_recordInfo.clear();
-		m_recordBuffer.clear();
-	}
-
-	emit recording_stopped();
-	qWarning() << "VoiceRecorder: recording stopped";
+	return true;
 }
 
 void VoiceRecorder::stop(bool force) {
-	// Tell the main loop to terminate and wake up the sleep lock.
+	// Tell the writers to terminate and wake them up.
 	m_recording = false;
 	m_abort     = force;
 
-	m_sleepCondition.wakeAll();
+	m_sleepCondition.notify_all();
 }
 
 void VoiceRecorder::prepareBufferAdds() {
@@ -402,33 +510,43 @@ void VoiceRecorder::prepareBufferAdds() {
 	m_absoluteSampleEstimation = (m_timestamp->elapsed() / 1000) * (static_cast< quint64 >(m_config.sampleRate) / 1000);
 }
 
-void VoiceRecorder::addBuffer(const ClientUser *clientUser, boost::shared_array< float > buffer, int samples) {
+void VoiceRecorder::addBuffer(const ClientUser *clientUser, const float *buffer, unsigned int samples) {
 	Q_ASSERT(!m_config.mixDownMode || !clientUser);
 
 	if (!m_recording)
 		return;
 
-	// Create a new RecordInfo object if this is a new user.
+	// Create a new Track object if this is a new user.
 	const int index = indexForUser(clientUser);
 
-	if (!m_recordInfo.contains(index)) {
-		boost::shared_ptr< RecordInfo > ri =
-			boost::make_shared< RecordInfo >(m_config.mixDownMode ? QLatin1String("Mixdown") : clientUser->qsName);
+	std::shared_ptr< Track > &track = m_tracks[index];
+	if (!track) {
+		track = std::make_shared< Track >(m_config.mixDownMode ? QLatin1String("Mixdown") : clientUser->qsName);
 
-		m_recordInfo.insert(index, ri);
+		// Announce the track to the writers
+		std::lock_guard< std::mutex > lock(m_trackLock);
+		m_trackList.push_back(track);
+		m_trackCount.store(m_trackList.size(), std::memory_order_release);
 	}
 
-	{
-		// Save the buffer in |qlRecordBuffer|.
-		QMutexLocker l(&m_bufferLock);
-		boost::shared_ptr< RecordBuffer > rb =
-			boost::make_shared< RecordBuffer >(index, buffer, samples, m_absoluteSampleEstimation);
+	// Split the buffer into blocks and append them to the track's ring. The writer is woken up by its timer, so
+	// neither side ever waits for the other.
+	std::size_t head       = track->head.load(std::memory_order_relaxed);
+	const std::size_t tail = track->tail.load(std::memory_order_acquire);
+	for (unsigned int offset = 0; offset < samples; offset += BLOCK_SIZE) {
+		if (head - tail == TRACK_BLOCKS) {
+			// The writer lags behind, so the rest is dropped (and replaced with silence in the file)
+			break;
+		}
 
-		m_recordBuffer << rb;
-	}
+		Block &block              = track->blocks[head % TRACK_BLOCKS];
+		block.absoluteStartSample = m_absoluteSampleEstimation + offset;
+		block.samples             = std::min(samples - offset, static_cast< unsigned int >(BLOCK_SIZE));
+		std::copy(buffer + offset, buffer + offset + block.samples, block.buffer.begin());
 
-	// Tell the main loop that we have new audio data.
-	m_sleepCondition.wakeAll();
+		++head;
+	}
+	track->head.store(head, std::memory_order_release);
 }
 
 quint64 VoiceRecorder::getElapsedTime() const {
@@ -455,10 +573,8 @@ QString VoiceRecorderFormat::getFormatDescription(VoiceRecorderFormat::Format fm
 			return VoiceRecorder::tr(".au - Uncompressed");
 		case VoiceRecorderFormat::FLAC:
 			return VoiceRecorder::tr(".flac - Lossless compressed");
-#ifdef USE_SNDFILE_OPUS
 		case VoiceRecorderFormat::OPUS:
 			return VoiceRecorder::tr(".opus - Lossy compressed");
-#endif
 #ifdef USE_SNDFILE_MP3
 		case VoiceRecorderFormat::MP3:
 			return VoiceRecorder::tr(".mp3 - Lossy compressed");
@@ -480,10 +596,8 @@ QString VoiceRecorderFormat::getFormatDefaultExtension(VoiceRecorderFormat::Form
 			return QLatin1String("au");
 		case VoiceRecorderFormat::FLAC:
 			return QLatin1String("flac");
-#ifdef USE_SNDFILE_OPUS
 		case VoiceRecorderFormat::OPUS:
 			return QLatin1String("opus");
-#endif
 #ifdef USE_SNDFILE_MP3
 		case VoiceRecorderFormat::MP3:
 			return QLatin1String("mp3");
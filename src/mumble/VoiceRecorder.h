@@ -14,15 +14,13 @@
 
 #ifndef Q_MOC_RUN
 #	include <boost/scoped_ptr.hpp>
-#	include <boost/shared_array.hpp>
+#	include <boost/shared_ptr.hpp>
 #endif
 
 #include <QtCore/QDateTime>
 #include <QtCore/QHash>
-#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QThread>
-#include <QtCore/QWaitCondition>
 
 #ifdef Q_OS_WIN
 #	define ENABLE_SNDFILE_WINDOWS_PROTOTYPES 1
@@ -30,9 +28,17 @@
 
 #include <sndfile.h>
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 class ClientUser;
 class RecordUser;
 class Timer;
+class VoiceRecorderEncoder;
 
 /// Utilities and enums for voice recorder format handling
 namespace VoiceRecorderFormat {
@@ -51,10 +57,8 @@ enum Format {
 	AU,
 	/// FLAC Format
 	FLAC,
-#ifdef USE_SNDFILE_OPUS
-	// OPUS Format
+	/// Ogg Opus Format, which is encoded natively (see OggOpusWriter)
 	OPUS,
-#endif
 #ifdef USE_SNDFILE_MP3
 	MP3,
 #endif
@@ -75,6 +79,10 @@ QString getFormatDefaultExtension(VoiceRecorderFormat::Format fm);
 /// which is then encoded using one of the formats of VoiceRecordingFormat::Format
 /// and written to disk.
 ///
+/// Every user is recorded to a track of its own (unless in mixdown mode). The audio thread appends to the ring of a
+/// track without locking or allocating, and a pool of writers (this thread being one of them) empties the rings and
+/// encodes every track with an encoder of its own.
+///
 class VoiceRecorder : public QThread {
 	Q_OBJECT
 public:
@@ -100,7 +108,7 @@ public:
 	VoiceRecorder(QObject *p, const Config &config);
 	~VoiceRecorder() Q_DECL_OVERRIDE;
 
-	/// The main event loop of the thread, which writes all buffers to files.
+	/// The main event loop of the thread, which runs the writers until the recording stops.
 	void run() Q_DECL_OVERRIDE;
 
 	/// Stops the main loop.
@@ -112,9 +120,10 @@ public:
 
 	/// Adds an audio buffer which contains |samples| audio samples to the recorder.
 	/// The audio data will be assumed to be recorded at the time
-	/// prepareBufferAdds was last called.
+	/// prepareBufferAdds was last called. The samples are copied, and whatever doesn't fit into the user's track
+	/// anymore (as its writer lags behind) is dropped.
 	/// @param clientUser User for which to add the audio data. nullptr in mixdown mode.
-	void addBuffer(const ClientUser *clientUser, boost::shared_array< float > buffer, int samples);
+	void addBuffer(const ClientUser *clientUser, const float *buffer, unsigned int samples);
 
 	/// Returns the elapsed time since the recording started.
 	quint64 getElapsedTime() const;
@@ -134,64 +143,88 @@ signals:
 	void recording_stopped();
 
 private:
-	/// Stores information about a recording buffer.
-	struct RecordBuffer {
-		/// Constructs a new RecordBuffer object.
-		RecordBuffer(int recordInfoIndex_, boost::shared_array< float > buffer_, int samples_,
-					 quint64 absoluteStartSample_);
-
-		/// Hashmap index for the user
-		const int recordInfoIndex;
-
-		/// The buffer.
-		boost::shared_array< float > buffer;
+	/// The number of samples of a block of a track
+	static constexpr unsigned int BLOCK_SIZE = 480;
+	/// The number of blocks of a track, which buffer about 2.5 seconds at 48 kHz
+	static constexpr std::size_t TRACK_BLOCKS = 256;
+
+	/// A part of the audio of a track
+	struct Block {
+		/// Absolute sample number at the start of this block
+		quint64 absoluteStartSample;
 
 		/// The number of samples in the buffer.
-		int samples;
+		unsigned int samples;
 
-		/// Absolute sample number at the start of this buffer
-		quint64 absoluteStartSample;
+		std::array< float, BLOCK_SIZE > buffer;
 	};
 
 	/// Stores the recording state for one user.
-	struct RecordInfo {
-		RecordInfo(const QString &userName_);
-		~RecordInfo();
+	struct Track {
+		Track(const QString &userName_);
+		~Track();
 
 		/// Name of the user being recorded
 		const QString userName;
 
-		/// libsndfile's handle.
-		SNDFILE *soundFile;
+		/// A ring of TRACK_BLOCKS blocks, which the audio thread fills and the track's writer empties
+		std::unique_ptr< Block[] > blocks;
+		/// The number of blocks that have been added and the number of those that have been written. The blocks in
+		/// between belong to the writer.
+		std::atomic< std::size_t > head;
+		std::atomic< std::size_t > tail;
+
+		/// The encoder writing the track's file, which is only accessed by its writer. nullptr until the first block
+		/// is written.
+		std::unique_ptr< VoiceRecorderEncoder > encoder;
+
+		/// Whether the file couldn't be created, in which case the blocks are discarded
+		bool failed;
 
 		/// The last absolute sample we wrote for this users
 		quint64 lastWrittenAbsoluteSample;
 	};
 
-	typedef QHash< int, boost::shared_ptr< RecordInfo > > RecordInfoMap;
-
 	/// Removes invalid characters in a path component.
 	QString sanitizeFilenameOrPathComponent(const QString &str) const;
 
 	/// Expands the template variables in |path| for the given |userName|.
 	QString expandTemplateVariables(const QString &path, const QString &userName) const;
 
-	/// Returns the RecordInfo hashmap index for the given user
+	/// Returns the |m_tracks| index for the given user
 	int indexForUser(const ClientUser *clientUser) const;
 
 	/// Create a sndfile SF_INFO structure describing the currently configured recording format
 	SF_INFO createSoundFileInfo() const;
 
-	/// Opens the file for the given recording information
-	/// Helper function for run method. Will abort recording on failure.
-	bool ensureFileIsOpenedFor(SF_INFO &soundFileInfo, boost::shared_ptr< RecordInfo > &ri);
+	/// Creates the file and the encoder of the given track
+	/// Helper function for the writers. Will abort recording on failure.
+	bool ensureFileIsOpenedFor(SF_INFO &soundFileInfo, Track &track);
+
+	/// Stops the recording because of the given error (unless it has failed already)
+	void fail(Error err, const QString &strerr);
+
+	/// Writes the tracks whose index modulo |writers| is |writer| until the recording stops
+	void writeTracks(unsigned int writer, unsigned int writers);
+
+	/// Writes the blocks that have been added to the given track
+	/// @returns Whether there have been any
+	bool writeTrack(SF_INFO &soundFileInfo, Track &track);
 
 	/// Hash which maps the |uiSession| of all users for which we have to keep a recording state to the corresponding
-	/// RecordInfo object.
-	RecordInfoMap m_recordInfo;
+	/// Track object. Only accessed by the audio thread.
+	QHash< int, std::shared_ptr< Track > > m_tracks;
 
-	/// List containing all unprocessed RecordBuffer objects.
-	QList< boost::shared_ptr< RecordBuffer > > m_recordBuffer;
+	/// All of the tracks in the order they have been created, which is how the writers learn about them
+	std::vector< std::shared_ptr< Track > > m_trackList;
+	/// The size of |m_trackList|, which the writers check (without locking) for new tracks
+	std::atomic< std::size_t > m_trackCount;
+	/// Protects |m_trackList|
+	std::mutex m_trackLock;
+
+	/// Lets the idle writers sleep until they look for new blocks again or the recording stops
+	std::mutex m_sleepLock;
+	std::condition_variable m_sleepCondition;
 
 	/// The user which is used to record local audio.
 	boost::scoped_ptr< RecordUser > m_recordUser;
@@ -199,21 +232,17 @@ private:
 	/// High precision timer for buffer timestamps.
 	boost::scoped_ptr< Timer > m_timestamp;
 
-	/// Protects the buffer list |qlRecordBuffer|.
-	QMutex m_bufferLock;
-
-	/// Wait condition and mutex to block until there is new data.
-	QMutex m_sleepLock;
-	QWaitCondition m_sleepCondition;
-
 	/// Configuration for this instance
 	const Config m_config;
 
 	/// True if the main loop is active.
-	bool m_recording;
+	std::atomic< bool > m_recording;
 
 	/// Tells the recorder to not finish writing its buffers before returning
-	bool m_abort;
+	std::atomic< bool > m_abort;
+
+	/// Set once a file couldn't be created, which stops the recording
+	std::atomic< bool > m_failed;
 
 	/// The timestamp where the recording started.
 	const QDateTime m_recordingStartTime;
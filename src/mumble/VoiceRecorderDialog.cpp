@@ -162,7 +162,8 @@ void VoiceRecorderDialog::on_qpbStart_clicked() {
 
 	// Create the recorder
 	VoiceRecorder::Config config;
-	config.sampleRate      = static_cast< int >(ao->getMixerFreq());
+	// The recorder gets the audio sources before their mix is resampled to the device's rate (see AudioOutput::mix)
+	config.sampleRate      = ao->getMixerFreq() != 0 ? SAMPLE_RATE : 0;
 	config.fileName        = dir.absoluteFilePath(basename + QLatin1Char('.') + suffix);
 	config.mixDownMode     = qrbDownmix->isChecked();
 	config.recordingFormat = static_cast< VoiceRecorderFormat::Format >(ifm);
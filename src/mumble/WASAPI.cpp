@@ -196,6 +196,42 @@ bool getAndCheckMixFormat(const char *sourceName, const char *deviceName, IAudio
 	return true;
 }
 
+/// Initializes the given IAudioClient in shared mode with the smallest period the audio engine supports for the
+/// format, which is typically 2.5 to 5 ms instead of the default 10 ms. This requires IAudioClient3 (Windows 10 and
+/// later) and the format to be the engine's mix format.
+///
+/// @param sourceName Name to prepend to log
+/// @param deviceName Device name to refer to in the log
+/// @param audioClient IAudioClient to initialize, which is left uninitialized if this fails
+/// @param waveFormatEx The format of the stream
+/// @return The result of the initialization, E_NOINTERFACE if IAudioClient3 isn't available
+static HRESULT initializeLowLatencyShared(const char *sourceName, const char *deviceName, IAudioClient *audioClient,
+										  const WAVEFORMATEX *waveFormatEx) {
+	IAudioClient3 *audioClient3 = nullptr;
+
+	HRESULT hr = audioClient->QueryInterface(__uuidof(IAudioClient3), reinterpret_cast< void ** >(&audioClient3));
+	if (FAILED(hr)) {
+		return hr;
+	}
+
+	UINT32 defaultPeriod, fundamentalPeriod, minPeriod, maxPeriod;
+	hr = audioClient3->GetSharedModeEnginePeriod(waveFormatEx, &defaultPeriod, &fundamentalPeriod, &minPeriod,
+												 &maxPeriod);
+	if (SUCCEEDED(hr)) {
+		hr = audioClient3->InitializeSharedAudioStream(AUDCLNT_STREAMFLAGS_EVENTCALLBACK, minPeriod, waveFormatEx,
+													   nullptr);
+	}
+
+	if (SUCCEEDED(hr)) {
+		qWarning("%s: %s uses a period of %u frames (default %u)", sourceName, deviceName, minPeriod, defaultPeriod);
+	} else {
+		qWarning("%s: %s low latency shared mode failed: hr=0x%08lx", sourceName, deviceName, hr);
+	}
+
+	audioClient3->Release();
+	return hr;
+}
+
 
 AudioInput *WASAPIInputRegistrar::create() {
 	return new WASAPIInput();
@@ -496,8 +532,17 @@ void WASAPIInput::run() {
 			goto cleanup;
 		}
 
-		hr = pMicAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, 0, 0, micpwfx,
-										 nullptr);
+		// The microphone's frames are handed to the resynchronizer as they arrive, which queues them in frames of
+		// 10 ms along with the echo. The echo's loopback stream keeps the engine's default period, as smaller ones
+		// only apply to the streams of the application.
+		hr = E_FAIL;
+		if (Global::get().s.bWASAPILowLatency) {
+			hr = initializeLowLatencyShared("WASAPIInput", "Mic", pMicAudioClient, micpwfx);
+		}
+		if (FAILED(hr)) {
+			hr = pMicAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, 0, 0, micpwfx,
+											 nullptr);
+		}
 		if (FAILED(hr)) {
 			qWarning("WASAPIInput: Mic Initialize failed: hr=0x%08lx", hr);
 			if (hr == E_ACCESSDENIED) {
@@ -1016,8 +1061,16 @@ void WASAPIOutput::run() {
 			CoTaskMemFree(closestFormat);
 		}
 
-		hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, bufferDuration, 0,
-									  pwfx, nullptr);
+		// The engine's buffer of a low latency stream only spans a few of its periods, which leaves out the output
+		// delay
+		hr = E_FAIL;
+		if (Global::get().s.bWASAPILowLatency) {
+			hr = initializeLowLatencyShared("WASAPIOutput", "Output", pAudioClient, pwfx);
+		}
+		if (FAILED(hr)) {
+			hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, bufferDuration,
+										  0, pwfx, nullptr);
+		}
 		if (FAILED(hr)) {
 			qWarning("WASAPIOutput: Initialize failed: hr=0x%08lx", hr);
 			goto cleanup;
@@ -8,10 +8,12 @@
 #include "NetworkConfig.h"
 #include "Global.h"
 
+#include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
 
-WebFetch::WebFetch(QString service, QUrl url, QObject *obj, const char *slot)
-	: QObject(), qoObject(obj), cpSlot(slot), m_service(service) {
+WebFetch::WebFetch(QString service, QUrl url, QObject *obj, const char *slot,
+				   const QMap< QByteArray, QByteArray > &requestHeaders)
+	: QObject(), qoObject(obj), cpSlot(slot), m_service(service), m_requestHeaders(requestHeaders) {
 	url.setScheme(QLatin1String("https"));
 
 	if (!Global::get().s.qsServicePrefix.isEmpty()) {
@@ -20,7 +22,7 @@ WebFetch::WebFetch(QString service, QUrl url, QObject *obj, const char *slot)
 		url.setHost(serviceHost());
 	}
 
-	qnr = Network::get(url);
+	qnr = get(url);
 	connect(qnr, SIGNAL(finished()), this, SLOT(finished()));
 	connect(this, SIGNAL(fetched(QByteArray, QUrl, QMap< QString, QString >)), obj, slot);
 }
@@ -36,6 +38,17 @@ QString WebFetch::serviceHost() const {
 	return QString::fromLatin1("%1.mumble.info").arg(m_service);
 }
 
+QNetworkReply *WebFetch::get(const QUrl &url) const {
+	QNetworkRequest req(url);
+	Network::prepareRequest(req);
+
+	for (auto it = m_requestHeaders.constBegin(); it != m_requestHeaders.constEnd(); ++it) {
+		req.setRawHeader(it.key(), it.value());
+	}
+
+	return Global::get().nam->get(req);
+}
+
 static QString fromUtf8(const QByteArray &qba) {
 	if (qba.isEmpty())
 		return QString();
@@ -83,7 +96,7 @@ void WebFetch::finished() {
 		// different hosts.
 		url.setHost(serviceHost());
 
-		qnr = Network::get(url);
+		qnr = get(url);
 		connect(qnr, SIGNAL(finished()), this, SLOT(finished()));
 	} else {
 		emit fetched(QByteArray(), url, QMap< QString, QString >());
@@ -99,12 +112,13 @@ void WebFetch::finished() {
  * @param obj Object to invoke slot on.
  * @param slot Slot to be triggered, invoked with the signature of \link fetched.
  */
-void WebFetch::fetch(const QString &service, const QUrl &url, QObject *obj, const char *slot) {
+void WebFetch::fetch(const QString &service, const QUrl &url, QObject *obj, const char *slot,
+					 const QMap< QByteArray, QByteArray > &requestHeaders) {
 	Q_ASSERT(!service.isEmpty());
 	Q_ASSERT(url.scheme().isEmpty());
 	Q_ASSERT(url.host().isEmpty());
 	Q_ASSERT(obj);
 	Q_ASSERT(slot);
 
-	new WebFetch(service, url, obj, slot);
+	new WebFetch(service, url, obj, slot, requestHeaders);
 }
@@ -23,11 +23,15 @@ protected:
 	const char *cpSlot;
 	QNetworkReply *qnr;
 	QString m_service;
+	QMap< QByteArray, QByteArray > m_requestHeaders;
 
 	QString prefixedServiceHost() const;
 	QString serviceHost() const;
+	/// Sends the request (with m_requestHeaders) for the given URL
+	QNetworkReply *get(const QUrl &url) const;
 
-	WebFetch(QString service, QUrl url, QObject *obj, const char *slot);
+	WebFetch(QString service, QUrl url, QObject *obj, const char *slot,
+			 const QMap< QByteArray, QByteArray > &requestHeaders);
 signals:
 	void fetched(QByteArray data, QUrl url, QMap< QString, QString > headers);
 protected slots:
@@ -87,7 +91,11 @@ public:
 	///                  If the download initiated by the function was successful, the data
 	///                  parameter will be a non-null QByteArray.
 	///                  If the download failed, the data parameter will be a null QByteArray.
-	static void fetch(const QString &service, const QUrl &url, QObject *obj, const char *slot);
+	///
+	/// @param  requestHeaders Additional headers of the request. With the headers of a conditional request (such as
+	///                  If-None-Match), a response that the resource hasn't been modified (304) has empty data.
+	static void fetch(const QString &service, const QUrl &url, QObject *obj, const char *slot,
+					  const QMap< QByteArray, QByteArray > &requestHeaders = {});
 };
 
 #endif
@@ -6,6 +6,7 @@
 #ifdef USE_OVERLAY
 #	include "Overlay.h"
 #endif
+#include "AudioBenchmark.h"
 #include "AudioInput.h"
 #include "AudioOutput.h"
 #include "AudioWizard.h"
@@ -43,6 +44,8 @@
 #include "QtWidgetUtils.h"
 #include "SSL.h"
 #include "SocketRPC.h"
+#include "StartupProfile.h"
+#include "SyncBenchmark.h"
 #include "TalkingUI.h"
 #include "Themes.h"
 #include "Translations.h"
@@ -54,6 +57,7 @@
 #include <QLocale>
 #include <QScreen>
 #include <QtCore/QProcess>
+#include <QtCore/QTimer>
 #include <QtGui/QDesktopServices>
 #include <QtWidgets/QMessageBox>
 
@@ -135,6 +139,8 @@ extern HWND mumble_mw_hwnd;
 int main(int argc, char **argv) {
 	int res = 0;
 
+	StartupProfile startupProfile;
+
 #if defined(Q_OS_WIN)
 	int ret = os_early_init();
 	if (ret != 0) {
@@ -171,6 +177,8 @@ int main(int argc, char **argv) {
 
 	MumbleSSL::initialize();
 
+	startupProfile.mark(QLatin1String("application"));
+
 	// This argument has to be parsed first, since it's value is needed to create the global struct,
 	// which other switches are modifying. If it is parsed first, the order of the arguments does not matter.
 	QString settingsFile;
@@ -271,6 +279,18 @@ int main(int argc, char **argv) {
 								   "  --print-echocancel-queue\n"
 								   "                Print on stdout the echo cancellation queue state\n"
 								   "                (useful for debugging purposes)\n"
+								   "  --audio-benchmark <seconds>\n"
+								   "                Benchmark every audio backend for <seconds> each and\n"
+								   "                print the results on stdout, then quit. Measures the\n"
+								   "                callback periods, the time spent processing the audio\n"
+								   "                and the loopback latency (which requires the\n"
+								   "                microphone to pick up the output)\n"
+								   "  --sync-benchmark <channels> <users>\n"
+								   "                Synchronize with a generated server of <channels>\n"
+								   "                channels and <users> users and print on stdout how\n"
+								   "                long it took, the peak memory and the cost of users\n"
+								   "                starting and stopping to talk, then quit. Runs\n"
+								   "                without a display using -platform offscreen\n"
 								   "  --translation-dir <dir>\n"
 								   "                Specifies an additional translation directory <dir>\n"
 								   "                in which Mumble will search for translation files that\n"
@@ -376,6 +396,29 @@ int main(int argc, char **argv) {
 				Global::get().bDebugDumpInput = true;
 			} else if (args.at(i) == QLatin1String("--print-echocancel-queue")) {
 				Global::get().bDebugPrintQueue = true;
+			} else if (args.at(i) == QLatin1String("--audio-benchmark")) {
+				bool ok = false;
+				if (i + 1 < args.count()) {
+					Global::get().uiAudioBenchmarkSeconds = args.at(i + 1).toUInt(&ok);
+					++i;
+				}
+				if (!ok || Global::get().uiAudioBenchmarkSeconds == 0) {
+					qCritical("Missing or invalid argument for --audio-benchmark!");
+					return 1;
+				}
+			} else if (args.at(i) == QLatin1String("--sync-benchmark")) {
+				bool channelsOk = false;
+				bool usersOk    = false;
+				if (i + 2 < args.count()) {
+					Global::get().uiSyncBenchmarkChannels = args.at(i + 1).toUInt(&channelsOk);
+					Global::get().uiSyncBenchmarkUsers    = args.at(i + 2).toUInt(&usersOk);
+					i += 2;
+				}
+				if (!channelsOk || !usersOk || Global::get().uiSyncBenchmarkChannels == 0
+					|| Global::get().uiSyncBenchmarkUsers == 0) {
+					qCritical("Missing or invalid arguments for --sync-benchmark!");
+					return 1;
+				}
 			} else if (args.at(i) == QLatin1String("-c") || args.at(i) == QLatin1String("--config")) {
 				//	We already parsed these arguments above, so just skip over them here
 				++i;
@@ -574,6 +617,8 @@ int main(int argc, char **argv) {
 		Global::get().s.save();
 	}
 
+	startupProfile.mark(QLatin1String("settings"));
+
 	// Check whether we need to enable accessibility features
 #ifdef Q_OS_WIN
 	// Only windows for now. Could not find any information on how to query this for osx or linux
@@ -593,6 +638,8 @@ int main(int argc, char **argv) {
 
 	Themes::apply();
 
+	startupProfile.mark(QLatin1String("themes"));
+
 	QLocale systemLocale = QLocale::system();
 
 #ifdef Q_OS_MAC
@@ -645,6 +692,8 @@ int main(int argc, char **argv) {
 	Mumble::Translations::LifetimeGuard translationGuard =
 		Mumble::Translations::installTranslators(settingsLocale, a, extraTranslationDirs);
 
+	startupProfile.mark(QLatin1String("translations"));
+
 	// Initialize proxy settings
 	NetworkConfig::SetupProxy();
 
@@ -656,25 +705,29 @@ int main(int argc, char **argv) {
 	delete cr;
 #endif
 
+	startupProfile.mark(QLatin1String("network"));
+
 	// Initialize database
 	Global::get().db = new Database(QLatin1String("main"));
 
+	startupProfile.mark(QLatin1String("database"));
+
 #ifdef USE_ZEROCONF
 	// Initialize zeroconf
 	Global::get().zeroconf = new Zeroconf();
 #endif
 
-	// PluginManager
+	// PluginManager (the plugins are only loaded once the MainWindow is shown, see below)
 	Global::get().pluginManager = new PluginManager();
-	Global::get().pluginManager->rescanPlugins();
 
 #ifdef USE_OVERLAY
 	Global::get().o = new Overlay();
-	Global::get().o->setActive(Global::get().s.os.bEnable);
 #endif
 
 	Global::get().lcd = new LCD();
 
+	startupProfile.mark(QLatin1String("subsystems"));
+
 	// Process any waiting events before initializing our MainWindow.
 	// The mumble:// URL support for Mac OS X happens through AppleEvents,
 	// so we need to loop a little before we begin.
@@ -684,6 +737,8 @@ int main(int argc, char **argv) {
 	Global::get().mw = new MainWindow(nullptr);
 	Global::get().mw->show();
 
+	startupProfile.mark(QLatin1String("main window"));
+
 	Global::get().talkingUI = new TalkingUI();
 
 	// Set TalkingUI's position
@@ -735,9 +790,33 @@ int main(int argc, char **argv) {
 
 	Audio::start();
 
+	startupProfile.mark(QLatin1String("audio"));
+
+	// What isn't needed to show the MainWindow is done once the event loop runs, so that the window is drawn first
+	QTimer::singleShot(0, [&startupProfile]() {
+		Global::get().pluginManager->rescanPlugins();
+		startupProfile.mark(QLatin1String("plugins"));
+
+#ifdef USE_OVERLAY
+		Global::get().o->setActive(Global::get().s.os.bEnable);
+		startupProfile.mark(QLatin1String("overlay"));
+#endif
+
+#ifdef QT_NO_DEBUG
+		if (Global::get().s.bPluginCheck) {
+			// The plugins have to be known in order to check them for updates
+			Global::get().pluginManager->checkForPluginUpdates();
+		}
+#endif
+
+		qWarning("Startup: %s", qUtf8Printable(startupProfile.summary()));
+	});
+
 	a.setQuitOnLastWindowClosed(false);
 
-	if (!Global::get().s.audioWizardShown) {
+	const bool benchmarking = Global::get().uiAudioBenchmarkSeconds > 0 || Global::get().uiSyncBenchmarkUsers > 0;
+
+	if (!Global::get().s.audioWizardShown && !benchmarking) {
 		auto wizard = std::make_unique< AudioWizard >(Global::get().mw);
 		wizard->exec();
 
@@ -786,10 +865,6 @@ int main(int argc, char **argv) {
 		new VersionCheck(false, Global::get().mw, true);
 #	endif
 	}
-
-	if (Global::get().s.bPluginCheck) {
-		Global::get().pluginManager->checkForPluginUpdates();
-	}
 #else  // QT_NO_DEBUG
 	Global::get().mw->msgBox(MainWindow::tr("Skipping version check in debug mode."));
 #endif // QT_NO_DEBUG
@@ -802,10 +877,18 @@ int main(int argc, char **argv) {
 		OpenURLEvent *oue = new OpenURLEvent(a.quLaunchURL);
 		qApp->postEvent(Global::get().mw, oue);
 #endif
-	} else {
+	} else if (!benchmarking) {
 		Global::get().mw->on_qaServerConnect_triggered(true);
 	}
 
+	if (Global::get().uiAudioBenchmarkSeconds > 0) {
+		res                 = AudioBenchmark::run(Global::get().uiAudioBenchmarkSeconds) ? 0 : 1;
+		Global::get().bQuit = true;
+	} else if (Global::get().uiSyncBenchmarkUsers > 0) {
+		res = SyncBenchmark::run(Global::get().uiSyncBenchmarkChannels, Global::get().uiSyncBenchmarkUsers) ? 0 : 1;
+		Global::get().bQuit = true;
+	}
+
 	if (!Global::get().bQuit)
 		res = a.exec();
 
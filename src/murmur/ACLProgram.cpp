@@ -0,0 +1,353 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ACLProgram.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <QtCore/QStack>
+#include <QtCore/QStringList>
+
+#include <cstdint>
+#include <utility>
+
+namespace {
+const ChanACL::Permissions DEFAULT_PERMISSIONS =
+	ChanACL::Traverse | ChanACL::Enter | ChanACL::Speak | ChanACL::Whisper | ChanACL::TextMessage | ChanACL::Listen;
+const ChanACL::Permissions ROOT_PERMISSIONS =
+	ChanACL::Kick | ChanACL::Ban | ChanACL::ResetUserContent | ChanACL::Register | ChanACL::SelfRegister;
+} // namespace
+
+ACLProgram::ACLProgram(const Channel &channel) : m_root(channel.iId == 0) {
+	QStack< const Channel * > chain;
+	for (const Channel *ch = &channel; ch; ch = ch->cParent) {
+		chain.push(ch);
+	}
+
+	while (!chain.isEmpty()) {
+		const Channel *ch = chain.pop();
+
+		Level level;
+		level.begin = m_rules.size();
+		level.reset = !ch->bInheritACL;
+
+		for (const ChanACL *acl : ch->qlACL) {
+			Rule rule;
+			rule.userId    = acl->iUserId;
+			rule.predicate = addPredicate(channel, *ch, acl->qsGroup);
+
+			const ChanACL::Permissions affected = acl->pAllow | acl->pDeny;
+
+			rule.setsTraverse = affected.testFlag(ChanACL::Traverse);
+			rule.traverse     = !acl->pDeny.testFlag(ChanACL::Traverse);
+			rule.setsWrite    = affected.testFlag(ChanACL::Write);
+			rule.write        = !acl->pDeny.testFlag(ChanACL::Write);
+
+			if (ch->iId == 0 && ch == &channel && acl->bApplyHere) {
+				rule.allow |= acl->pAllow & ROOT_PERMISSIONS;
+			}
+			if ((ch == &channel && acl->bApplyHere) || (ch != &channel && acl->bApplySubs)) {
+				rule.allow |= acl->pAllow & ~(ROOT_PERMISSIONS | ChanACL::Cached);
+				rule.deny = acl->pDeny;
+			}
+
+			if (rule.userId == -1 && rule.predicate == -1) {
+				// Nobody can match this rule
+				continue;
+			}
+			if (!rule.setsTraverse && !rule.setsWrite && !rule.allow && !rule.deny) {
+				// The rule doesn't have any effect in this channel
+				continue;
+			}
+
+			m_rules.push_back(rule);
+		}
+
+		level.end = m_rules.size();
+
+		// Levels without rules only matter if they reset the permissions
+		if (level.reset || level.begin != level.end) {
+			m_levels.push_back(level);
+		}
+	}
+}
+
+ChanACL::Permissions ACLProgram::evaluate(const ServerUser &user) const {
+	// Superuser
+	if (user.iId == 0) {
+		return static_cast< ChanACL::Permissions >(ChanACL::All & ~(ChanACL::Speak | ChanACL::Whisper));
+	}
+
+	std::vector< std::uint64_t > matches((m_predicates.size() + 63) / 64, 0);
+	for (std::size_t i = 0; i < m_predicates.size(); ++i) {
+		if (m_predicates[i].appliesTo(user)) {
+			matches[i / 64] |= std::uint64_t(1) << (i % 64);
+		}
+	}
+
+	ChanACL::Permissions granted = DEFAULT_PERMISSIONS;
+	bool traverse                = true;
+	bool write                   = false;
+
+	for (const Level &level : m_levels) {
+		if (level.reset) {
+			granted = DEFAULT_PERMISSIONS;
+		}
+
+		for (std::size_t i = level.begin; i < level.end; ++i) {
+			const Rule &rule = m_rules[i];
+
+			const bool matchUser = rule.userId != -1 && rule.userId == user.iId;
+			const bool matchPredicate =
+				rule.predicate != -1
+				&& (matches[static_cast< std::size_t >(rule.predicate) / 64]
+					& (std::uint64_t(1) << (static_cast< std::size_t >(rule.predicate) % 64)));
+			if (!matchUser && !matchPredicate) {
+				continue;
+			}
+
+			if (rule.setsTraverse) {
+				traverse = rule.traverse;
+			}
+			if (rule.setsWrite) {
+				write = rule.write;
+			}
+
+			granted |= rule.allow;
+			granted &= ~rule.deny;
+		}
+
+		if (!traverse && !write) {
+			return ChanACL::None;
+		}
+	}
+
+	if (granted & ChanACL::Write) {
+		granted |= ChanACL::Traverse | ChanACL::Enter | ChanACL::MuteDeafen | ChanACL::Move | ChanACL::MakeChannel
+				   | ChanACL::LinkChannel | ChanACL::TextMessage | ChanACL::MakeTempChannel | ChanACL::Listen;
+		if (m_root) {
+			granted |= ROOT_PERMISSIONS;
+		}
+	}
+
+	return granted;
+}
+
+bool ACLProgram::Predicate::compile(const Channel &currentChannel, const Channel &aclChannel, QString specification) {
+	// The prefixes and special groups are the ones Group::appliesToUser knows about
+	*this = Predicate();
+	bool isAccessToken            = false;
+	bool isCertHash               = false;
+	const Channel *contextChannel = &currentChannel;
+
+	while (!specification.isEmpty()) {
+		if (specification.startsWith(QChar::fromLatin1('!'))) {
+			invert = true;
+		} else if (specification.startsWith(QChar::fromLatin1('~'))) {
+			contextChannel = &aclChannel;
+		} else if (specification.startsWith(QChar::fromLatin1('#'))) {
+			isAccessToken = true;
+		} else if (specification.startsWith(QChar::fromLatin1('$'))) {
+			isCertHash = true;
+		} else {
+			break;
+		}
+
+		specification.remove(0, 1);
+	}
+
+	if (specification.isEmpty()) {
+		return false;
+	}
+
+	if (isAccessToken) {
+		kind = Kind::AccessToken;
+		name = specification;
+	} else if (isCertHash) {
+		kind = Kind::CertHash;
+		name = specification;
+	} else if (specification == QLatin1String("none")) {
+		kind = Kind::None;
+	} else if (specification == QLatin1String("all")) {
+		kind = Kind::All;
+	} else if (specification == QLatin1String("auth")) {
+		kind = Kind::Auth;
+	} else if (specification == QLatin1String("strong")) {
+		kind = Kind::Strong;
+	} else if (specification == QLatin1String("in")) {
+		kind    = Kind::In;
+		channel = contextChannel;
+	} else if (specification == QLatin1String("out")) {
+		kind    = Kind::Out;
+		channel = contextChannel;
+	} else if (specification == QLatin1String("sub") || specification.startsWith(QLatin1String("sub,"))) {
+		specification.remove(0, 4);
+
+		int requiredChannelOffset = 0;
+		int minDescendantLevel    = 1;
+		int maxDescendantLevel    = 1000;
+
+		QStringList args = specification.split(QLatin1String(","));
+		if (args.count() >= 1 && !args[0].isEmpty()) {
+			requiredChannelOffset = args[0].toInt();
+		}
+		if (args.count() >= 2 && !args[1].isEmpty()) {
+			minDescendantLevel = args[1].toInt();
+		}
+		if (args.count() >= 3 && !args[2].isEmpty()) {
+			maxDescendantLevel = args[2].toInt();
+		}
+
+		// The hierarchy from the root channel to the channel the program is compiled for
+		QList< const Channel * > currentChannelHierarchy;
+		for (const Channel *ch = &currentChannel; ch; ch = ch->cParent) {
+			currentChannelHierarchy.prepend(ch);
+		}
+
+		int requiredChannelIndex = currentChannelHierarchy.indexOf(contextChannel) + requiredChannelOffset;
+		if (requiredChannelIndex >= currentChannelHierarchy.count()) {
+			// Nobody can be in a channel below one that doesn't exist (which is still subject to inversion)
+			kind = Kind::None;
+		} else {
+			if (requiredChannelIndex < 0) {
+				requiredChannelIndex = 0;
+			}
+
+			kind     = Kind::Sub;
+			channel  = currentChannelHierarchy[requiredChannelIndex];
+			minDepth = requiredChannelIndex + minDescendantLevel;
+			maxDepth = requiredChannelIndex + maxDescendantLevel;
+		}
+	} else {
+		// The specification is an actual group name
+		kind    = Kind::Group;
+		channel = contextChannel;
+
+		QStack< const Group * > groupStack;
+		for (const Channel *ch = contextChannel; ch; ch = ch->cParent) {
+			const Group *group = ch->qhGroups.value(specification);
+
+			if (group) {
+				if ((ch != contextChannel) && !group->bInheritable)
+					break;
+				groupStack.push(group);
+				if (!group->bInherit)
+					break;
+			}
+		}
+
+		while (!groupStack.isEmpty()) {
+			groups.push_back(groupStack.pop());
+		}
+	}
+
+	return true;
+}
+
+int ACLProgram::addPredicate(const Channel &channel, const Channel &aclChannel, QString specification) {
+	Predicate predicate;
+	if (!predicate.compile(channel, aclChannel, std::move(specification))) {
+		return -1;
+	}
+
+	// Many ACLs in a chain usually refer to the same few groups, which only have to be checked once per user
+	for (std::size_t i = 0; i < m_predicates.size(); ++i) {
+		const Predicate &other = m_predicates[i];
+		if (other.kind == predicate.kind && other.invert == predicate.invert && other.channel == predicate.channel
+			&& other.name == predicate.name && other.minDepth == predicate.minDepth
+			&& other.maxDepth == predicate.maxDepth && other.groups == predicate.groups) {
+			return static_cast< int >(i);
+		}
+	}
+
+	m_predicates.push_back(std::move(predicate));
+	return static_cast< int >(m_predicates.size() - 1);
+}
+
+bool ACLProgram::Predicate::appliesTo(const ServerUser &user) const {
+	bool matches = false;
+
+	switch (kind) {
+		case Kind::None:
+			matches = false;
+			break;
+		case Kind::All:
+			matches = true;
+			break;
+		case Kind::Auth:
+			matches = user.iId >= 0;
+			break;
+		case Kind::Strong:
+			matches = user.bVerified;
+			break;
+		case Kind::In:
+			matches = user.cChannel == channel;
+			break;
+		case Kind::Out:
+			matches = user.cChannel != channel;
+			break;
+		case Kind::Sub: {
+			// The user has to be in the required channel or below it, within the given range of depths
+			bool below = false;
+			int depth  = -1;
+			for (const Channel *ch = user.cChannel; ch; ch = ch->cParent) {
+				below = below || ch == channel;
+				++depth;
+			}
+
+			matches = below && depth >= minDepth && depth <= maxDepth;
+			break;
+		}
+		case Kind::AccessToken:
+			matches = user.qslAccessTokens.contains(name, Group::accessTokenCaseSensitivity);
+			break;
+		case Kind::CertHash:
+			matches = user.qsHash == name;
+			break;
+		case Kind::Group:
+			for (const Group *group : groups) {
+				if (group->qsAdd.contains(user.iId) || group->qsTemporary.contains(user.iId)
+					|| group->qsTemporary.contains(-static_cast< int >(user.uiSession)))
+					matches = true;
+				if (group->qsRemove.contains(user.iId))
+					matches = false;
+			}
+			break;
+	}
+
+	return invert ? !matches : matches;
+}
+
+const ACLProgram &ACLProgramCache::get(const Channel &channel) {
+	std::unique_ptr< const ACLProgram > &program = m_programs[&channel];
+	if (!program) {
+		program.reset(new ACLProgram(channel));
+	}
+
+	return *program;
+}
+
+void ACLProgramCache::invalidateBranch(const Channel &channel) {
+	QStack< const Channel * > stack;
+	stack.push(&channel);
+
+	while (!stack.isEmpty()) {
+		const Channel *ch = stack.pop();
+		m_programs.erase(ch);
+
+		for (const Channel *child : ch->qlChannels) {
+			stack.push(child);
+		}
+	}
+}
+
+void ACLProgramCache::remove(const Channel &channel) {
+	m_programs.erase(&channel);
+}
+
+void ACLProgramCache::clear() {
+	m_programs.clear();
+}
@@ -0,0 +1,126 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_ACLPROGRAM_H_
+#define MUMBLE_MURMUR_ACLPROGRAM_H_
+
+#include "ACL.h"
+
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class Channel;
+class Group;
+class ServerUser;
+
+/// The ACLs that determine the permissions in a single channel (its own ones and the ones it inherits), compiled into
+/// a flat list of rules.
+///
+/// Compiling resolves everything that doesn't depend on the user: which ACLs apply to the channel at all, the
+/// permissions they grant and deny in it, the channels the group specifications are relative to and the groups
+/// (including the inherited ones) they refer to. Every distinct group specification becomes a predicate. Evaluating
+/// the program for a user first determines which predicates the user satisfies (as a bitset) and then applies the
+/// matching rules with a few bitwise operations.
+///
+/// The result is the same as the one of ChanACL::effectivePermissions. A program refers to the groups of the channel
+/// and its parents and to the user IDs, grants and denials of their ACLs at the time it has been compiled. Thus it has
+/// to be dropped whenever any of these change (or before the groups are deleted), which is what ACLProgramCache is
+/// for. Changes to the members of groups take effect without recompiling.
+class ACLProgram {
+public:
+	explicit ACLProgram(const Channel &channel);
+
+	/// @returns The permissions of the given user in the channel the program has been compiled for
+	ChanACL::Permissions evaluate(const ServerUser &user) const;
+
+	/// @returns The number of rules the ACLs have been compiled into
+	std::size_t ruleCount() const { return m_rules.size(); }
+
+	/// A group specification (see Group::appliesToUser) resolved for the channel the program is compiled for. Like the
+	/// program, it refers to the groups at the time it has been compiled.
+	struct Predicate {
+		enum class Kind { None, All, Auth, Strong, In, Out, Sub, AccessToken, CertHash, Group };
+
+		Kind kind   = Kind::None;
+		bool invert = false;
+		/// The channel "in", "out" and named groups are relative to, or the channel a user has to be in (or below)
+		/// for "sub"
+		const Channel *channel = nullptr;
+		/// The access token or certificate hash
+		QString name;
+		/// The range of depths a user's channel has to be in for "sub"
+		int minDepth = 0;
+		int maxDepth = 0;
+		/// The groups that make up a named group, starting with the one closest to the root channel
+		std::vector< const Group * > groups;
+
+		/// Resolves the given specification of an ACL in the given channel for the given current channel, which are
+		/// the same arguments Group::appliesToUser takes
+		///
+		/// @returns Whether any user can ever match the specification
+		bool compile(const Channel &currentChannel, const Channel &aclChannel, QString specification);
+		/// @returns The same as Group::appliesToUser for the specification the predicate has been compiled from
+		bool appliesTo(const ServerUser &user) const;
+	};
+
+protected:
+	struct Rule {
+		/// The user the rule applies to (in addition to the ones matching the predicate) or -1
+		int userId = -1;
+		/// The index of the predicate that decides whether the rule applies to a user or -1
+		int predicate = -1;
+		/// The permissions the rule grants and denies in the channel
+		ChanACL::Permissions allow = ChanACL::None;
+		ChanACL::Permissions deny  = ChanACL::None;
+		/// Whether the rule changes the traverse or write state (see ChanACL::effectivePermissions) and to what
+		bool setsTraverse = false;
+		bool traverse     = false;
+		bool setsWrite    = false;
+		bool write        = false;
+	};
+
+	/// The rules that stem from the ACLs of a single channel in the chain
+	struct Level {
+		std::size_t begin;
+		std::size_t end;
+		/// Whether the channel doesn't inherit the ACLs of its parent, which resets the permissions to the default
+		bool reset;
+	};
+
+	std::vector< Predicate > m_predicates;
+	std::vector< Rule > m_rules;
+	std::vector< Level > m_levels;
+	/// Whether the program has been compiled for the root channel
+	bool m_root;
+
+	/// @returns The index of the predicate for the given specification of an ACL in the given channel or -1 if no
+	/// 	user can ever match it
+	int addPredicate(const Channel &channel, const Channel &aclChannel, QString specification);
+};
+
+/// The compiled ACL programs of all channels of a server. Programs are compiled the first time they are needed.
+///
+/// This class isn't thread-safe. Server only uses it while holding qmCache.
+class ACLProgramCache {
+public:
+	/// @returns The program of the given channel, which stays valid until it is invalidated
+	const ACLProgram &get(const Channel &channel);
+
+	/// Drops the programs of the given channel and all of its children, which is what is needed after the ACLs or
+	/// groups of the channel have been changed or after it has been moved within the channel tree
+	void invalidateBranch(const Channel &channel);
+	/// Drops the program of the given channel only (e.g. because it is about to be deleted)
+	void remove(const Channel &channel);
+	void clear();
+
+protected:
+	std::unordered_map< const Channel *, std::unique_ptr< const ACLProgram > > m_programs;
+};
+
+#endif // MUMBLE_MURMUR_ACLPROGRAM_H_
@@ -7,17 +7,20 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 
 #include <tracy/Tracy.hpp>
 
 AudioReceiver::AudioReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context,
 							 const VolumeAdjustment &volumeAdjustment)
 	: m_receiver(receiver), m_context(context), m_volumeAdjustment(volumeAdjustment) {
+	updateGroupKey();
 }
 
 AudioReceiver::AudioReceiver(ServerUser &receiver, Mumble::Protocol::audio_context_t context,
 							 VolumeAdjustment &&volumeAdjustment)
 	: m_receiver(receiver), m_context(context), m_volumeAdjustment(std::move(volumeAdjustment)) {
+	updateGroupKey();
 }
 
 ServerUser &AudioReceiver::getReceiver() {
@@ -34,6 +37,7 @@ Mumble::Protocol::audio_context_t AudioReceiver::getContext() const {
 
 void AudioReceiver::setContext(Mumble::Protocol::audio_context_t context) {
 	m_context = context;
+	updateGroupKey();
 }
 
 const VolumeAdjustment &AudioReceiver::getVolumeAdjustment() const {
@@ -42,10 +46,61 @@ const VolumeAdjustment &AudioReceiver::getVolumeAdjustment() const {
 
 void AudioReceiver::setVolumeAdjustment(const VolumeAdjustment &adjustment) {
 	m_volumeAdjustment = adjustment;
+	updateGroupKey();
 }
 
 void AudioReceiver::setVolumeAdjustment(VolumeAdjustment &&adjustment) {
 	m_volumeAdjustment = std::move(adjustment);
+	updateGroupKey();
+}
+
+std::uint32_t AudioReceiver::getGroupKey() const {
+	return m_groupKey;
+}
+
+void AudioReceiver::updateGroupKey() {
+	// Layout (from most to least significant bit):
+	// 1 bit protocol version class | 8 bits context | 15 bits factor bucket | 8 bits dB bucket
+	constexpr std::int32_t maxFactorBucket  = 0x7FFF;
+	constexpr std::int32_t minDecibelBucket = -128;
+	constexpr std::int32_t maxDecibelBucket = 127;
+
+	// At this point the protocol version only makes a difference between pre-protobuf and post-protobuf (see
+	// Mumble::Protocol::protocolVersionsAreCompatible)
+	const std::uint32_t versionClass =
+		m_receiver.get().m_version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION ? 1 : 0;
+
+	const float factor = m_volumeAdjustment.factor;
+
+	std::int32_t factorBucket  = 0;
+	std::int32_t decibelBucket = minDecibelBucket;
+	if (factor > 0) {
+		const float decibels = VolumeAdjustment::toDBAdjustment(factor);
+
+		factorBucket  = static_cast< std::int32_t >(std::min(std::floor(factor / AudioReceiverBuffer::maxFactorDiff),
+															 static_cast< float >(maxFactorBucket)));
+		decibelBucket = static_cast< std::int32_t >(
+			std::max(std::min(std::floor(decibels / AudioReceiverBuffer::maxDecibelDiff),
+							  static_cast< float >(maxDecibelBucket)),
+					 static_cast< float >(minDecibelBucket)));
+	}
+
+	// The buckets are inverted, so that louder receivers come first
+	m_groupKey = (versionClass << 31) | (static_cast< std::uint32_t >(m_context) << 23)
+				 | (static_cast< std::uint32_t >(maxFactorBucket - factorBucket) << 8)
+				 | static_cast< std::uint32_t >(maxDecibelBucket - decibelBucket);
+}
+
+VolumeAdjustment AudioReceiverBuffer::quantizeVolumeAdjustment(const VolumeAdjustment &adjustment) {
+	if (adjustment.factor <= 0) {
+		return adjustment;
+	}
+
+	const float decibels = VolumeAdjustment::toDBAdjustment(adjustment.factor);
+	const int quantized  = static_cast< int >(std::round(decibels / quantizedDecibelStep)) * quantizedDecibelStep;
+
+	return VolumeAdjustment::fromDBAdjustment(
+		std::max(minQuantizedDecibels, std::min(quantized, maxQuantizedDecibels)));
 }
 
 AudioReceiverBuffer::AudioReceiverBuffer() {
@@ -70,21 +125,27 @@ void AudioReceiverBuffer::forceAddReceiver(ServerUser &receiver, Mumble::Protoco
 	ZoneScoped;
 
 	std::vector< AudioReceiver > &receiverList = includePositionalData ? m_positionalReceivers : m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > &userEntryIndices =
-		includePositionalData ? m_positionalReceiverIndices : m_regularReceiverIndices;
+	std::vector< ReceiverSlot > &slots         = includePositionalData ? m_positionalSlots : m_regularSlots;
 
-	auto it = userEntryIndices.find(&receiver);
-	if (it == userEntryIndices.end()) {
+	if (receiver.uiSession >= slots.size()) {
+		slots.resize(receiver.uiSession + 1);
+	}
+
+	ReceiverSlot &slot = slots[receiver.uiSession];
+	if (slot.epoch != m_epoch) {
 		// No entry for that user yet
+		slot.epoch = m_epoch;
+		slot.index = static_cast< std::uint32_t >(receiverList.size());
 		receiverList.emplace_back(receiver, context, volumeAdjustment);
-		userEntryIndices[&receiver] = receiverList.size() - 1;
 	} else {
 		// We already have an entry for the given user -> update that instead of adding a new one
-		AudioReceiver &receiverEntry = receiverList[it->second];
+		AudioReceiver &receiverEntry = receiverList[slot.index];
 
 		assert(receiverEntry.getReceiver().uiSession == receiver.uiSession);
 
-		receiverEntry.setContext(std::min(receiverEntry.getContext(), context));
+		if (context < receiverEntry.getContext()) {
+			receiverEntry.setContext(context);
+		}
 
 		if (receiverEntry.getVolumeAdjustment().factor < volumeAdjustment.factor) {
 			receiverEntry.setVolumeAdjustment(volumeAdjustment);
@@ -95,15 +156,21 @@ void AudioReceiverBuffer::forceAddReceiver(ServerUser &receiver, Mumble::Protoco
 void AudioReceiverBuffer::preprocessBuffer() {
 	ZoneScoped;
 
-	preprocessBuffer(m_regularReceivers);
-	preprocessBuffer(m_positionalReceivers);
+	preprocessBuffer(m_regularReceivers, m_sortedRegularReceivers);
+	preprocessBuffer(m_positionalReceivers, m_sortedPositionalReceivers);
 }
 
 void AudioReceiverBuffer::clear() {
 	m_regularReceivers.clear();
-	m_regularReceiverIndices.clear();
 	m_positionalReceivers.clear();
-	m_positionalReceiverIndices.clear();
+
+	if (++m_epoch == 0) {
+		// The epoch has wrapped around, so old slots could be taken for valid ones
+		for (std::vector< ReceiverSlot > *slots : { &m_regularSlots, &m_positionalSlots }) {
+			std::fill(slots->begin(), slots->end(), ReceiverSlot());
+		}
+		m_epoch = 1;
+	}
 }
 
 std::vector< AudioReceiver > &AudioReceiverBuffer::getReceivers(bool receivePositionalData) {
@@ -114,7 +181,8 @@ std::vector< AudioReceiver > &AudioReceiverBuffer::getReceivers(bool receivePosi
 	}
 }
 
-void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receiverList) {
+void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receiverList,
+										   std::vector< AudioReceiver > &sortedReceivers) {
 	ZoneScoped;
 
 #ifndef NDEBUG
@@ -131,21 +199,72 @@ void AudioReceiverBuffer::preprocessBuffer(std::vector< AudioReceiver > &receive
 		   == receiverList.end());
 #endif
 
-	// Sort the receivers, such that we can efficiently partition them into different regions
+	// Sort the receivers by their group key, such that we can efficiently partition them into different regions.
+	// The sort is stable, so receivers with the same key keep the order they have been added in.
 	// Note: The list doesn't contains any duplicate receivers
-	std::sort(receiverList.begin(), receiverList.end(), [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-		// 1. Sort into block of compatible protocol versions
-		if (!Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
-															 rhs.getReceiver().m_version)) {
-			return lhs.getReceiver().m_version < rhs.getReceiver().m_version;
+	m_sortKeys.clear();
+
+	std::uint32_t differingBits = 0;
+	for (std::size_t i = 0; i < receiverList.size(); ++i) {
+		const std::uint32_t key = receiverList[i].getGroupKey();
+
+		m_sortKeys.emplace_back(key, static_cast< std::uint32_t >(i));
+		differingBits |= key ^ m_sortKeys.front().first;
+	}
+
+	if (differingBits == 0) {
+		// All receivers are going to receive the same packet -> no need to reorder anything
+		return;
+	}
+
+	if (m_sortKeys.size() <= insertionSortThreshold) {
+		// For short lists, setting up the buckets of the radix sort costs more than it saves
+		for (std::size_t i = 1; i < m_sortKeys.size(); ++i) {
+			const std::pair< std::uint32_t, std::uint32_t > entry = m_sortKeys[i];
+
+			std::size_t j = i;
+			for (; j > 0 && m_sortKeys[j - 1].first > entry.first; --j) {
+				m_sortKeys[j] = m_sortKeys[j - 1];
+			}
+			m_sortKeys[j] = entry;
+		}
+	} else {
+		radixSortKeys(differingBits);
+	}
+
+	sortedReceivers.clear();
+	for (const std::pair< std::uint32_t, std::uint32_t > &entry : m_sortKeys) {
+		sortedReceivers.push_back(receiverList[entry.second]);
+	}
+
+	receiverList.swap(sortedReceivers);
+}
+
+void AudioReceiverBuffer::radixSortKeys(std::uint32_t differingBits) {
+	m_sortKeysScratch.resize(m_sortKeys.size());
+	for (unsigned int shift = 0; shift < 32; shift += 8) {
+		if (((differingBits >> shift) & 0xFF) == 0) {
+			// All keys agree on this digit
+			continue;
 		}
 
-		// 2. Within each block, sort based on the audio context
-		if (lhs.getContext() != rhs.getContext()) {
-			return lhs.getContext() < rhs.getContext();
+		std::size_t offsets[0x100] = {};
+		for (const std::pair< std::uint32_t, std::uint32_t > &entry : m_sortKeys) {
+			offsets[(entry.first >> shift) & 0xFF]++;
 		}
 
-		// 3. Within each context, sort based on volume adjustments (but in descending order!)
-		return lhs.getVolumeAdjustment().factor > rhs.getVolumeAdjustment().factor;
-	});
+		std::size_t total = 0;
+		for (std::size_t &offset : offsets) {
+			const std::size_t count = offset;
+
+			offset = total;
+			total += count;
+		}
+
+		for (const std::pair< std::uint32_t, std::uint32_t > &entry : m_sortKeys) {
+			m_sortKeysScratch[offsets[(entry.first >> shift) & 0xFF]++] = entry;
+		}
+
+		m_sortKeys.swap(m_sortKeysScratch);
+	}
 }
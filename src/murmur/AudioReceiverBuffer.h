@@ -10,8 +10,10 @@
 #include "ServerUser.h"
 #include "VolumeAdjustment.h"
 
+#include <cstdint>
 #include <functional>
-#include <unordered_map>
+#include <iterator>
+#include <utility>
 #include <vector>
 
 #include <tracy/Tracy.hpp>
@@ -32,10 +34,25 @@ public:
 	void setVolumeAdjustment(const VolumeAdjustment &adjustment);
 	void setVolumeAdjustment(VolumeAdjustment &&adjustment);
 
+	/**
+	 * @returns The key that determines the receiver range this receiver belongs to. All receivers with the same key
+	 * receive the exact same audio packet. Sorting by the key groups receivers by protocol version class, then by
+	 * context and then by volume adjustment (loudest first).
+	 *
+	 * The volume adjustment is quantized into buckets that are AudioReceiverBuffer::maxFactorDiff and
+	 * AudioReceiverBuffer::maxDecibelDiff wide. The factor buckets cap audible differences for high volume
+	 * adjustments (where 1dB is already a big difference) and the dB buckets cap them for low volume adjustments
+	 * (e.g. a factor difference of 0.05 for an adjustment of -24dB is a difference of more than 5dB).
+	 */
+	std::uint32_t getGroupKey() const;
+
 protected:
 	std::reference_wrapper< ServerUser > m_receiver;
 	Mumble::Protocol::audio_context_t m_context = Mumble::Protocol::AudioContext::INVALID;
 	VolumeAdjustment m_volumeAdjustment         = VolumeAdjustment::fromFactor(1.0f);
+	std::uint32_t m_groupKey                    = 0;
+
+	void updateGroupKey();
 };
 
 
@@ -72,6 +89,20 @@ public:
 	 * same receiver range
 	 */
 	constexpr static const int maxDecibelDiff = 5;
+	/**
+	 * The step (in dB) that quantizeVolumeAdjustment() rounds to and the range it clamps to
+	 */
+	constexpr static const int quantizedDecibelStep = 3;
+	constexpr static const int minQuantizedDecibels = -30;
+	constexpr static const int maxQuantizedDecibels = 12;
+
+	/**
+	 * @returns The given volume adjustment rounded to the closest multiple of quantizedDecibelStep within
+	 * [minQuantizedDecibels, maxQuantizedDecibels]. Receivers with quantized volume adjustments fall into at most one
+	 * receiver range per step, however many different adjustments they have asked for (see
+	 * Server::quantizeListenerVolumes). Silenced receivers stay silenced.
+	 */
+	static VolumeAdjustment quantizeVolumeAdjustment(const VolumeAdjustment &adjustment);
 
 	template< typename Iterator > static ReceiverRange< Iterator > getReceiverRange(Iterator begin, Iterator end) {
 		ZoneScoped;
@@ -88,31 +119,50 @@ public:
 		}
 
 		// Find a range, such that all receivers in [begin, end) are compatible in the sense that they will all receive
-		// the exact same audio packet (thus: no re-encoding required between sending the packet to them).
-		range.end = std::lower_bound(begin, end, *begin, [](const AudioReceiver &lhs, const AudioReceiver &rhs) {
-			return lhs.getContext() == rhs.getContext()
-				   && Mumble::Protocol::protocolVersionsAreCompatible(lhs.getReceiver().m_version,
-																	  rhs.getReceiver().m_version)
-				   // The factor difference caps audible differences for high volume adjustments (where 1dB is already a
-				   // big difference). Thus, this is a cap on the absolute loudness difference.
-				   && std::abs(lhs.getVolumeAdjustment().factor - rhs.getVolumeAdjustment().factor) < maxFactorDiff
-				   // The dB difference caps audible difference for low volume adjustments. E.g. a factor difference of
-				   // 0.05 for an adjustment of -24dB is a difference of more than 5dB and therefore audible. Thus, this
-				   // is a cap on the relative loudness difference.
-				   && std::abs(lhs.getVolumeAdjustment().dbAdjustment - rhs.getVolumeAdjustment().dbAdjustment)
-						  < maxDecibelDiff;
-		});
+		// the exact same audio packet (thus: no re-encoding required between sending the packet to them). As the
+		// receivers are sorted by their group key, these are the ones directly following begin.
+		const std::uint32_t key = begin->getGroupKey();
+
+		range.end = std::next(begin);
+		while (range.end != end && range.end->getGroupKey() == key) {
+			++range.end;
+		}
 
 		return range;
 	}
 
 protected:
+	/// Where a user's entry can be found in one of the receiver lists. The slot is only valid if its epoch matches
+	/// the buffer's current one, which is what allows clear() to discard all slots at once.
+	struct ReceiverSlot {
+		std::uint32_t epoch = 0;
+		std::uint32_t index = 0;
+	};
+
 	std::vector< AudioReceiver > m_regularReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_regularReceiverIndices;
 	std::vector< AudioReceiver > m_positionalReceivers;
-	std::unordered_map< const ServerUser *, std::size_t > m_positionalReceiverIndices;
-
-	void preprocessBuffer(std::vector< AudioReceiver > &receiverList);
+	/// The slots of all users (indexed by session ID) for the respective receiver list. Session IDs are handed out
+	/// from a small, dense pool, so these stay small and a lookup is a plain array access.
+	std::vector< ReceiverSlot > m_regularSlots;
+	std::vector< ReceiverSlot > m_positionalSlots;
+	/// Incremented by every clear(). Starts at 1, so that freshly created slots are invalid.
+	std::uint32_t m_epoch = 1;
+
+	/// Scratch space for sorting the receivers (pairs of group key and index into the receiver list)
+	std::vector< std::pair< std::uint32_t, std::uint32_t > > m_sortKeys;
+	std::vector< std::pair< std::uint32_t, std::uint32_t > > m_sortKeysScratch;
+	/// The sorted receivers are swapped with the respective receiver list. Each list has a scratch list of its own,
+	/// so that both keep the capacity they need and sorting doesn't allocate once the buffer has warmed up.
+	std::vector< AudioReceiver > m_sortedRegularReceivers;
+	std::vector< AudioReceiver > m_sortedPositionalReceivers;
+
+	/// Lists up to this size are sorted via insertion sort instead of radix sort
+	constexpr static const std::size_t insertionSortThreshold = 32;
+
+	void preprocessBuffer(std::vector< AudioReceiver > &receiverList, std::vector< AudioReceiver > &sortedReceivers);
+	/// Sorts m_sortKeys by key using an LSD radix sort (8 bits per pass). Passes over digits that are the same for
+	/// all keys (as indicated by differingBits) are skipped.
+	void radixSortKeys(std::uint32_t differingBits);
 };
 
 #endif // MUMBLE_MURMUR_AUDIORECEIVERBUFFER_H_
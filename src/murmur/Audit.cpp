@@ -0,0 +1,189 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Audit.h"
+
+#include "TracyConstants.h"
+
+#include <tracy/Tracy.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+struct LockCounters {
+	Metrics::Counter acquisitions;
+	Metrics::Counter contended;
+	Metrics::Counter waitNanoseconds;
+};
+
+struct ZoneCounters {
+	Metrics::Counter allocations;
+	Metrics::Counter bytes;
+};
+
+/// The name of a lock or zone in the log and the plot showing how often it has been contended or allocated in
+struct Names {
+	const char *name;
+	const char *plot;
+};
+
+const std::array< Names, Audit::LOCK_COUNT > lockNames = {
+	{ { "qrwlVoiceThread", TracyConstants::LOCK_VOICE_THREAD_CONTENDED },
+	  { "qmCache", TracyConstants::LOCK_CACHE_CONTENDED },
+	  { "qmCrypt", TracyConstants::LOCK_CRYPT_CONTENDED },
+	  { "qmDecrypt", TracyConstants::LOCK_DECRYPT_CONTENDED } }
+};
+
+const std::array< Names, Audit::ZONE_COUNT > zoneNames = {
+	{ { "other", TracyConstants::ALLOC_OTHER },
+	  { "runVoiceLoop", TracyConstants::ALLOC_VOICE_LOOP },
+	  { "processMsg", TracyConstants::ALLOC_PROCESS_MSG },
+	  { "sendMessage", TracyConstants::ALLOC_SEND_MESSAGE },
+	  { "checkDecrypt", TracyConstants::ALLOC_CHECK_DECRYPT } }
+};
+
+// The counters and the zone are initialized constantly, so that the allocations made before main() (and while
+// threads are torn down) can be counted as well
+std::array< LockCounters, Audit::LOCK_COUNT > lockCounters;
+std::array< ZoneCounters, Audit::ZONE_COUNT > zoneCounters;
+thread_local Audit::Zone currentThreadZone = Audit::Zone::None;
+
+void countAllocation(std::size_t size) {
+	ZoneCounters &counters = zoneCounters[static_cast< std::size_t >(currentThreadZone)];
+	counters.allocations.add();
+	counters.bytes.add(size);
+}
+
+/// @returns The allocated memory or nullptr if there is none left, once the new handler (if any) has given up
+void *allocate(std::size_t size) {
+	countAllocation(size);
+
+	while (true) {
+		if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+			return memory;
+		}
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			return nullptr;
+		}
+		handler();
+	}
+}
+} // namespace
+
+namespace Audit {
+
+void recordLock(Lock lock, bool contended, quint64 waitNanoseconds) {
+	LockCounters &counters = lockCounters[static_cast< std::size_t >(lock)];
+	counters.acquisitions.add();
+	if (contended) {
+		counters.contended.add();
+		counters.waitNanoseconds.add(waitNanoseconds);
+	}
+}
+
+Zone currentZone() {
+	return currentThreadZone;
+}
+
+void setCurrentZone(Zone zone) {
+	currentThreadZone = zone;
+}
+
+void report() {
+	// The totals at the previous report, as only the differences are reported
+	static std::array< std::array< quint64, 3 >, LOCK_COUNT > previousLocks{};
+	static std::array< std::array< quint64, 2 >, ZONE_COUNT > previousZones{};
+
+	for (std::size_t i = 0; i < LOCK_COUNT; ++i) {
+		const std::array< quint64, 3 > totals = { { lockCounters[i].acquisitions.value(),
+													lockCounters[i].contended.value(),
+													lockCounters[i].waitNanoseconds.value() } };
+		const quint64 acquisitions = totals[0] - previousLocks[i][0];
+		const quint64 contended    = totals[1] - previousLocks[i][1];
+		const quint64 wait         = totals[2] - previousLocks[i][2];
+		previousLocks[i]           = totals;
+
+		TracyPlot(lockNames[i].plot, static_cast< std::int64_t >(contended));
+		if (acquisitions == 0) {
+			continue;
+		}
+
+		qWarning("Audit: %s acquired %llu times, contended %llu times (%.2f%%), waited %.3f ms", lockNames[i].name,
+				 static_cast< unsigned long long >(acquisitions), static_cast< unsigned long long >(contended),
+				 100.0 * static_cast< double >(contended) / static_cast< double >(acquisitions),
+				 static_cast< double >(wait) / 1e6);
+	}
+
+	for (std::size_t i = 0; i < ZONE_COUNT; ++i) {
+		const std::array< quint64, 2 > totals = { { zoneCounters[i].allocations.value(),
+													zoneCounters[i].bytes.value() } };
+		const quint64 allocations = totals[0] - previousZones[i][0];
+		const quint64 bytes       = totals[1] - previousZones[i][1];
+		previousZones[i]          = totals;
+
+		TracyPlot(zoneNames[i].plot, static_cast< std::int64_t >(allocations));
+		if (allocations == 0) {
+			continue;
+		}
+
+		qWarning("Audit: %s allocated %llu times (%llu bytes)", zoneNames[i].name,
+				 static_cast< unsigned long long >(allocations), static_cast< unsigned long long >(bytes));
+	}
+}
+
+} // namespace Audit
+
+// Every allocation of the process goes through these, so that it is counted towards the zone of the thread making it
+
+void *operator new(std::size_t size) {
+	if (void *memory = allocate(size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+	if (void *memory = allocate(size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+	return allocate(size);
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+	std::free(memory);
+}
@@ -0,0 +1,160 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_AUDIT_H_
+#define MUMBLE_MURMUR_AUDIT_H_
+
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QtGlobal>
+
+#ifdef USE_SERVER_AUDIT
+#	include "Metrics.h"
+#endif
+
+#include <cstddef>
+
+/// Counts how often the locks on the voice threads' hot paths are contended and how much memory these paths allocate
+/// (build option server-audit). The counts are logged and plotted in Tracy periodically (see report()), which tells
+/// by numbers which of the locks are worth getting rid of.
+///
+/// Without the build option, the lockers below are plain ones and the zones are empty.
+namespace Audit {
+
+enum class Lock {
+	/// Server::qrwlVoiceThread
+	VoiceThread,
+	/// Server::qmCache
+	Cache,
+	/// ServerUser::qmCrypt
+	Crypt,
+	/// ServerUser::qmDecrypt
+	Decrypt,
+};
+static constexpr std::size_t LOCK_COUNT = 4;
+
+/// The parts of the hot path whose allocations are counted (see ZoneScope). The ones outside of all of them are
+/// counted towards None.
+enum class Zone {
+	None,
+	/// Server::runVoiceLoop, apart from the zones below
+	VoiceLoop,
+	ProcessMsg,
+	SendMessage,
+	CheckDecrypt,
+};
+static constexpr std::size_t ZONE_COUNT = 5;
+
+#ifdef USE_SERVER_AUDIT
+/// The interval (in milliseconds) in which the counts are reported
+static constexpr int REPORT_INTERVAL = 60 * 1000;
+
+/// Records an acquisition of the given lock, which has had to wait for the given time if it has been contended
+void recordLock(Lock lock, bool contended, quint64 waitNanoseconds = 0);
+
+/// @returns The zone the allocations of the calling thread are counted towards
+Zone currentZone();
+void setCurrentZone(Zone zone);
+
+/// Logs the counts since the previous report and plots them in Tracy. May only be called by one thread.
+void report();
+#else
+inline void recordLock(Lock, bool, quint64 = 0) {
+}
+#endif
+
+/// Acquires a lock through the given functions, trying to do so without waiting first in order to tell whether it is
+/// contended
+template< typename TryAcquire, typename Acquire >
+inline void acquire(Lock which, TryAcquire tryAcquire, Acquire doAcquire) {
+#ifdef USE_SERVER_AUDIT
+	if (tryAcquire()) {
+		recordLock(which, false);
+		return;
+	}
+
+	const quint64 start = Metrics::now();
+	doAcquire();
+	recordLock(which, true, Metrics::now() - start);
+#else
+	Q_UNUSED(which);
+	Q_UNUSED(tryAcquire);
+	doAcquire();
+#endif
+}
+
+inline void lockForRead(QReadWriteLock &lock, Lock which) {
+	acquire(which, [&lock]() { return lock.tryLockForRead(); }, [&lock]() { lock.lockForRead(); });
+}
+
+inline void lockForWrite(QReadWriteLock &lock, Lock which) {
+	acquire(which, [&lock]() { return lock.tryLockForWrite(); }, [&lock]() { lock.lockForWrite(); });
+}
+
+inline void lock(QMutex &mutex, Lock which) {
+	acquire(which, [&mutex]() { return mutex.tryLock(); }, [&mutex]() { mutex.lock(); });
+}
+
+/// A QReadLocker that counts its acquisitions
+class ReadLocker {
+public:
+	ReadLocker(QReadWriteLock *lock, Lock which) : m_lock(lock), m_which(which) { relock(); }
+	~ReadLocker() { unlock(); }
+
+	void unlock() {
+		if (m_locked) {
+			m_lock->unlock();
+			m_locked = false;
+		}
+	}
+
+	void relock() {
+		if (!m_locked) {
+			lockForRead(*m_lock, m_which);
+			m_locked = true;
+		}
+	}
+
+private:
+	Q_DISABLE_COPY(ReadLocker)
+
+	QReadWriteLock *m_lock;
+	Lock m_which;
+	bool m_locked = false;
+};
+
+/// A QMutexLocker that counts its acquisition
+class MutexLocker {
+public:
+	MutexLocker(QMutex *mutex, Lock which) : m_mutex(mutex) { lock(*mutex, which); }
+	~MutexLocker() { m_mutex->unlock(); }
+
+private:
+	Q_DISABLE_COPY(MutexLocker)
+
+	QMutex *m_mutex;
+};
+
+/// Counts the allocations of the calling thread towards the given zone for as long as it exists
+class ZoneScope {
+public:
+#ifdef USE_SERVER_AUDIT
+	explicit ZoneScope(Zone zone) : m_previous(currentZone()) { setCurrentZone(zone); }
+	~ZoneScope() { setCurrentZone(m_previous); }
+#else
+	explicit ZoneScope(Zone) {}
+#endif
+
+private:
+	Q_DISABLE_COPY(ZoneScope)
+
+#ifdef USE_SERVER_AUDIT
+	Zone m_previous;
+#endif
+};
+
+} // namespace Audit
+
+#endif // MUMBLE_MURMUR_AUDIT_H_
@@ -0,0 +1,211 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BanIndex.h"
+
+#include <algorithm>
+
+constexpr unsigned int KEY_BITS = 128;
+
+BanIndex::BanIndex() {
+	clear();
+}
+
+void BanIndex::rebuild(const QList< Ban > &bans) {
+	clear();
+
+	for (const Ban &ban : bans) {
+		insert(ban);
+	}
+}
+
+void BanIndex::clear() {
+	m_nodes.clear();
+	m_hashes.clear();
+	m_nextExpiry = QDateTime();
+	m_size       = 0;
+
+	addNode(Key{}, 0);
+}
+
+void BanIndex::insert(const Ban &ban) {
+	if (ban.iDuration > 0) {
+		const QDateTime expiry = ban.qdtStart.addSecs(ban.iDuration);
+		if (m_nextExpiry.isNull() || expiry < m_nextExpiry) {
+			m_nextExpiry = expiry;
+		}
+	}
+
+	if (!ban.qsHash.isEmpty() && !m_hashes.contains(ban.qsHash, ban)) {
+		m_hashes.insert(ban.qsHash, ban);
+	}
+
+	unsigned int length = 0;
+	const Key key       = prefixOf(ban, length);
+
+	int current = 0;
+	while (true) {
+		if (m_nodes[current].length == length) {
+			std::vector< Ban > &bans = m_nodes[current].bans;
+			if (std::find(bans.begin(), bans.end(), ban) == bans.end()) {
+				bans.push_back(ban);
+				m_size++;
+			}
+			return;
+		}
+
+		const unsigned int direction = bit(key, m_nodes[current].length);
+		const int child              = m_nodes[current].children[direction];
+		if (child < 0) {
+			const int leaf                       = addNode(key, length);
+			m_nodes[current].children[direction] = leaf;
+			m_nodes[leaf].bans.push_back(ban);
+			m_size++;
+			return;
+		}
+
+		const unsigned int childLength = m_nodes[child].length;
+		const unsigned int common      = commonPrefixLength(key, m_nodes[child].key, std::min(length, childLength));
+		if (common == childLength) {
+			current = child;
+			continue;
+		}
+
+		// The new prefix diverges from the child's (or ends) somewhere along the child's compressed path, so the path
+		// is split by a node with the prefix they have in common
+		Key commonKey = key;
+		for (unsigned int i = common; i < KEY_BITS; ++i) {
+			commonKey[i / 8] &= static_cast< std::uint8_t >(~(0x80u >> (i % 8)));
+		}
+		const int split = addNode(commonKey, common);
+		m_nodes[split].children[bit(m_nodes[child].key, common)] = child;
+		m_nodes[current].children[direction]                     = split;
+
+		if (common == length) {
+			m_nodes[split].bans.push_back(ban);
+		} else {
+			const int leaf                            = addNode(key, length);
+			m_nodes[split].children[bit(key, common)] = leaf;
+			m_nodes[leaf].bans.push_back(ban);
+		}
+		m_size++;
+		return;
+	}
+}
+
+void BanIndex::remove(const Ban &ban) {
+	if (!ban.qsHash.isEmpty()) {
+		m_hashes.remove(ban.qsHash, ban);
+	}
+
+	unsigned int length = 0;
+	const Key key       = prefixOf(ban, length);
+
+	const int node = findNode(key, length);
+	if (node < 0) {
+		return;
+	}
+
+	// Nodes that don't hold any bans anymore are kept until the next rebuild(), they only cost a few more steps when
+	// matching
+	std::vector< Ban > &bans = m_nodes[node].bans;
+	const auto removed       = std::remove(bans.begin(), bans.end(), ban);
+	m_size -= static_cast< std::size_t >(bans.end() - removed);
+	bans.erase(removed, bans.end());
+}
+
+const Ban *BanIndex::matchAddress(const HostAddress &address) const {
+	const Key &key = address.getByteRepresentation();
+
+	int current = 0;
+	while (current >= 0) {
+		const Node &node = m_nodes[current];
+		if (commonPrefixLength(key, node.key, node.length) < node.length) {
+			return nullptr;
+		}
+		if (!node.bans.empty()) {
+			return &node.bans.front();
+		}
+		if (node.length == KEY_BITS) {
+			return nullptr;
+		}
+
+		current = node.children[bit(key, node.length)];
+	}
+
+	return nullptr;
+}
+
+const Ban *BanIndex::matchHash(const QString &hash) const {
+	if (hash.isEmpty()) {
+		return nullptr;
+	}
+
+	auto it = m_hashes.constFind(hash);
+	return it == m_hashes.constEnd() ? nullptr : &it.value();
+}
+
+bool BanIndex::mayHaveExpired() const {
+	return !m_nextExpiry.isNull() && m_nextExpiry < QDateTime::currentDateTime().toUTC();
+}
+
+std::size_t BanIndex::size() const {
+	return m_size;
+}
+
+BanIndex::Key BanIndex::prefixOf(const Ban &ban, unsigned int &length) {
+	length = static_cast< unsigned int >(std::max(0, std::min(ban.iMask, static_cast< int >(KEY_BITS))));
+
+	Key key = ban.haAddress.getByteRepresentation();
+	for (unsigned int i = length; i < KEY_BITS; ++i) {
+		key[i / 8] &= static_cast< std::uint8_t >(~(0x80u >> (i % 8)));
+	}
+
+	return key;
+}
+
+unsigned int BanIndex::bit(const Key &key, unsigned int index) {
+	return (key[index / 8] >> (7 - index % 8)) & 1u;
+}
+
+unsigned int BanIndex::commonPrefixLength(const Key &a, const Key &b, unsigned int limit) {
+	unsigned int length = 0;
+	for (std::size_t i = 0; i < a.size() && length < limit; ++i) {
+		const std::uint8_t difference = static_cast< std::uint8_t >(a[i] ^ b[i]);
+		if (difference == 0) {
+			length += 8;
+			continue;
+		}
+
+		for (std::uint8_t mask = 0x80; (difference & mask) == 0; mask >>= 1) {
+			length++;
+		}
+		break;
+	}
+
+	return std::min(length, limit);
+}
+
+int BanIndex::addNode(const Key &key, unsigned int length) {
+	m_nodes.push_back({ key, length, { { -1, -1 } }, {} });
+	return static_cast< int >(m_nodes.size() - 1);
+}
+
+int BanIndex::findNode(const Key &key, unsigned int length) const {
+	int current = 0;
+	while (current >= 0) {
+		const Node &node = m_nodes[current];
+		if (node.length > length || commonPrefixLength(key, node.key, node.length) < node.length) {
+			return -1;
+		}
+		if (node.length == length) {
+			return current;
+		}
+
+		current = node.children[bit(key, node.length)];
+	}
+
+	return -1;
+}
@@ -0,0 +1,83 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANINDEX_H_
+#define MUMBLE_MURMUR_BANINDEX_H_
+
+#include "Ban.h"
+#include "HostAddress.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QList>
+#include <QtCore/QMultiHash>
+#include <QtCore/QString>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// An index over a server's bans (see Server::qlBans), so that connections can be checked against them without
+/// looking at every ban. The address bans are kept in a path-compressed binary (Patricia) trie over the 128 bits of
+/// their (IPv6 or IPv4-mapped) prefix, which matches an address in O(prefix length) regardless of the number of bans.
+/// The certificate hash bans are kept in a hash table.
+///
+/// Identical bans are only indexed once, just like the ban list is treated as a set when it is changed.
+class BanIndex {
+public:
+	BanIndex();
+
+	/// Replaces the indexed bans with the given ones
+	void rebuild(const QList< Ban > &bans);
+	void clear();
+	void insert(const Ban &ban);
+	/// Removes the given ban (and any identical copies of it) from the index
+	void remove(const Ban &ban);
+
+	/// @returns A ban whose address prefix contains the given address or nullptr if there is none. The pointer stays
+	/// 	valid until the index is changed.
+	const Ban *matchAddress(const HostAddress &address) const;
+	/// @returns A ban for the given certificate hash or nullptr if there is none. The pointer stays valid until the
+	/// 	index is changed.
+	const Ban *matchHash(const QString &hash) const;
+
+	/// @returns Whether one of the bans that have been indexed since the last rebuild() may have expired by now. The
+	/// 	caller is expected to drop the expired bans from the ban list and to rebuild the index then.
+	bool mayHaveExpired() const;
+
+	/// @returns The number of indexed bans
+	std::size_t size() const;
+
+protected:
+	using Key = std::array< std::uint8_t, 16 >;
+
+	struct Node {
+		/// The prefix of all addresses below this node. The bits after its length are zero.
+		Key key;
+		unsigned int length;
+		/// The indices of the nodes whose prefixes continue with a 0 and a 1 bit respectively or -1 if there is none
+		std::array< int, 2 > children;
+		/// The bans whose prefix is exactly the one of this node
+		std::vector< Ban > bans;
+	};
+
+	/// The nodes of the trie. The first one is the root, whose prefix is empty. Nodes are only dropped by rebuild().
+	std::vector< Node > m_nodes;
+	QMultiHash< QString, Ban > m_hashes;
+	/// The time at which the first of the temporary bans expires or a null QDateTime if there is no temporary ban
+	QDateTime m_nextExpiry;
+	std::size_t m_size;
+
+	static Key prefixOf(const Ban &ban, unsigned int &length);
+	static unsigned int bit(const Key &key, unsigned int index);
+	/// @returns The number of leading bits (up to limit) the given keys have in common
+	static unsigned int commonPrefixLength(const Key &a, const Key &b, unsigned int limit);
+
+	int addNode(const Key &key, unsigned int length);
+	/// @returns The index of the node with exactly the given prefix or -1 if there is none
+	int findNode(const Key &key, unsigned int length) const;
+};
+
+#endif // MUMBLE_MURMUR_BANINDEX_H_
@@ -0,0 +1,95 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BandwidthRecord.h"
+
+#include <algorithm>
+#include <chrono>
+
+BandwidthRecord::BandwidthRecord()
+	: m_connected(clock()), m_theoreticalArrival(0), m_lastFrame(m_connected), m_lastControl(m_connected) {
+	for (std::atomic< quint64 > &period : m_periods) {
+		period.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool BandwidthRecord::addFrame(int size, int maxpersec, quint64 now) {
+	if (size < 0 || maxpersec <= 0)
+		return false;
+
+	const quint64 cost = (static_cast< quint64 >(size) * 1000000ULL) / static_cast< quint64 >(maxpersec);
+
+	quint64 arrival = m_theoreticalArrival.load(std::memory_order_relaxed);
+	quint64 next;
+	do {
+		if (arrival > now + BURST_MICROSECONDS)
+			return false;
+
+		next = std::max(arrival, now) + cost;
+	} while (!m_theoreticalArrival.compare_exchange_weak(arrival, next, std::memory_order_relaxed));
+
+	m_lastFrame.store(now, std::memory_order_relaxed);
+
+	const quint64 number           = now / PERIOD_MICROSECONDS;
+	std::atomic< quint64 > &period = m_periods[number % m_periods.size()];
+
+	quint64 current = period.load(std::memory_order_relaxed);
+	quint64 updated;
+	do {
+		if ((current >> 32) == (number & 0xFFFFFFFFULL)) {
+			updated = current + static_cast< quint64 >(size);
+		} else {
+			// The entry belongs to an expired period
+			updated = ((number & 0xFFFFFFFFULL) << 32) | static_cast< quint64 >(size);
+		}
+	} while (!period.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+
+	return true;
+}
+
+int BandwidthRecord::onlineSeconds() const {
+	return static_cast< int >((clock() - m_connected) / 1000000ULL);
+}
+
+int BandwidthRecord::idleSeconds() const {
+	const quint64 now  = clock();
+	const quint64 last = std::max(m_lastFrame.load(std::memory_order_relaxed),
+								  m_lastControl.load(std::memory_order_relaxed));
+
+	return now > last ? static_cast< int >((now - last) / 1000000ULL) : 0;
+}
+
+void BandwidthRecord::resetIdleSeconds() {
+	m_lastControl.store(clock(), std::memory_order_relaxed);
+}
+
+int BandwidthRecord::bandwidth() const {
+	const quint64 now     = clock();
+	const quint64 number  = now / PERIOD_MICROSECONDS;
+	const quint64 oldest  = number >= PERIOD_COUNT - 1 ? number - (PERIOD_COUNT - 1) : 0;
+	const quint64 start   = std::max(oldest * PERIOD_MICROSECONDS, m_connected);
+	const quint64 elapsed = now - std::min(start, now);
+
+	if (elapsed < PERIOD_MICROSECONDS)
+		return 0;
+
+	quint64 sum = 0;
+	for (const std::atomic< quint64 > &period : m_periods) {
+		const quint64 value = period.load(std::memory_order_relaxed);
+		const quint64 index = value >> 32;
+		// Only the lower 32 bits of the period number are stored
+		if (index >= (oldest & 0xFFFFFFFFULL) && index <= (number & 0xFFFFFFFFULL)) {
+			sum += value & 0xFFFFFFFFULL;
+		}
+	}
+
+	return static_cast< int >((sum * 1000000ULL) / elapsed);
+}
+
+quint64 BandwidthRecord::clock() {
+	return static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
@@ -0,0 +1,64 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+#define MUMBLE_MURMUR_BANDWIDTHRECORD_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <atomic>
+
+/// Limits and measures the rate at which a user sends voice data. All functions may be called by any thread without
+/// locking, as the voice threads account for packets while the main thread reads the statistics.
+///
+/// The limit is a token bucket, implemented as the time at which the bucket would be full again (a "theoretical
+/// arrival time"), so a single atomic holds all of its state. Every frame moves that time into the future by as long
+/// as it takes to send the frame at the allowed rate and frames are only accepted while it isn't more than
+/// BURST_MICROSECONDS ahead. The bandwidth is measured by counting the bytes in a few short, consecutive periods.
+///
+/// Instead of reading the clock for every frame, addFrame() takes the time from its caller, which only has to read it
+/// once per batch of packets (see VoiceContext::now).
+class BandwidthRecord {
+public:
+	BandwidthRecord();
+
+	BandwidthRecord(const BandwidthRecord &) = delete;
+	BandwidthRecord &operator=(const BandwidthRecord &) = delete;
+
+	/// @param size The size of the frame in bytes
+	/// @param maxpersec The number of bytes per second the user may send
+	/// @param now The current time (see clock())
+	/// @returns Whether the frame is within the limit (and has been accounted for)
+	bool addFrame(int size, int maxpersec, quint64 now);
+	int onlineSeconds() const;
+	int idleSeconds() const;
+	void resetIdleSeconds();
+	/// @returns The number of bytes per second the user has sent during the last second or 0 if the user hasn't
+	/// 	been connected long enough to tell
+	int bandwidth() const;
+
+	/// @returns The current time of the monotonic clock all records use in microseconds
+	static quint64 clock();
+
+	/// How far ahead of the allowed rate a user may get, which allows for (network) jitter
+	static constexpr quint64 BURST_MICROSECONDS = 2000000;
+	/// The length of the periods the bandwidth is measured in
+	static constexpr quint64 PERIOD_MICROSECONDS = 250000;
+	/// The number of periods bandwidth() looks at, including the current one
+	static constexpr quint64 PERIOD_COUNT = 4;
+
+protected:
+	const quint64 m_connected;
+	std::atomic< quint64 > m_theoreticalArrival;
+	std::atomic< quint64 > m_lastFrame;
+	std::atomic< quint64 > m_lastControl;
+	/// The bytes accepted in the last periods. Every entry holds the number of the period in its upper and the number
+	/// of bytes in its lower 32 bits. The entries are indexed by the period number modulo their count, so there is
+	/// always one that has already expired and can be reused for the next period.
+	std::array< std::atomic< quint64 >, PERIOD_COUNT + 1 > m_periods;
+};
+
+#endif // MUMBLE_MURMUR_BANDWIDTHRECORD_H_
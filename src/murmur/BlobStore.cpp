@@ -0,0 +1,88 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "BlobStore.h"
+
+#include <QtCore/QMutexLocker>
+
+BlobStore::BlobStore(std::size_t capacity) : m_capacity(capacity), m_bytes(0), m_hits(0), m_misses(0) {
+}
+
+QByteArray BlobStore::insert(const QByteArray &hash, const QByteArray &blob) {
+	if (hash.isEmpty() || blob.isEmpty()) {
+		return blob;
+	}
+
+	QMutexLocker lock(&m_mutex);
+
+	auto it = m_index.constFind(hash);
+	if (it != m_index.constEnd()) {
+		m_entries.splice(m_entries.begin(), m_entries, it.value());
+		++m_hits;
+		return it.value()->blob;
+	}
+
+	++m_misses;
+
+	m_entries.push_front({ hash, blob });
+	m_index.insert(hash, m_entries.begin());
+	m_bytes += static_cast< std::size_t >(blob.size());
+
+	evict();
+
+	return blob;
+}
+
+QByteArray BlobStore::find(const QByteArray &hash) {
+	QMutexLocker lock(&m_mutex);
+
+	auto it = m_index.constFind(hash);
+	if (it == m_index.constEnd()) {
+		++m_misses;
+		return QByteArray();
+	}
+
+	m_entries.splice(m_entries.begin(), m_entries, it.value());
+	++m_hits;
+	return it.value()->blob;
+}
+
+void BlobStore::clear() {
+	QMutexLocker lock(&m_mutex);
+
+	m_entries.clear();
+	m_index.clear();
+	m_bytes = 0;
+}
+
+std::size_t BlobStore::bytes() const {
+	QMutexLocker lock(&m_mutex);
+	return m_bytes;
+}
+
+std::size_t BlobStore::count() const {
+	QMutexLocker lock(&m_mutex);
+	return m_entries.size();
+}
+
+quint64 BlobStore::hits() const {
+	QMutexLocker lock(&m_mutex);
+	return m_hits;
+}
+
+quint64 BlobStore::misses() const {
+	QMutexLocker lock(&m_mutex);
+	return m_misses;
+}
+
+void BlobStore::evict() {
+	// The blob that has just been inserted is always kept, even if it is larger than the capacity on its own
+	while (m_bytes > m_capacity && m_entries.size() > 1) {
+		const Entry &entry = m_entries.back();
+		m_bytes -= static_cast< std::size_t >(entry.blob.size());
+		m_index.remove(entry.hash);
+		m_entries.pop_back();
+	}
+}
@@ -0,0 +1,70 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_BLOBSTORE_H_
+#define MUMBLE_MURMUR_BLOBSTORE_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+#include <list>
+
+/// Holds the blobs (e.g. user textures) that are in use, keyed by their SHA1 hash (the same one clients request them
+/// by). Identical blobs, e.g. the same avatar used by several users on any of the virtual servers, are only kept in
+/// memory once: insert() hands out the copy that is already stored, which shares its data with everyone holding it.
+///
+/// The blobs that have been used least recently are dropped once the blobs take up more than the given number of
+/// bytes. Blobs that are still held by someone else stay in memory regardless, but they aren't deduplicated anymore.
+///
+/// All functions may be called by any thread.
+class BlobStore {
+public:
+	/// @param capacity The number of bytes the blobs may take up before the least recently used ones are dropped
+	explicit BlobStore(std::size_t capacity = 32 * 1024 * 1024);
+
+	BlobStore(const BlobStore &) = delete;
+	BlobStore &operator=(const BlobStore &) = delete;
+
+	/// Stores the given blob, unless a blob with the same hash is stored already
+	///
+	/// @param hash The SHA1 hash of the blob
+	/// @returns The stored blob, which is the one that has been stored before if there is one
+	QByteArray insert(const QByteArray &hash, const QByteArray &blob);
+	/// @returns The blob with the given hash or a null QByteArray if there is none
+	QByteArray find(const QByteArray &hash);
+	void clear();
+
+	/// @returns The number of bytes the stored blobs take up
+	std::size_t bytes() const;
+	/// @returns The number of stored blobs
+	std::size_t count() const;
+	/// @returns The number of blobs that have been inserted or looked up and were stored already
+	quint64 hits() const;
+	/// @returns The number of blobs that have been inserted or looked up and weren't stored yet
+	quint64 misses() const;
+
+protected:
+	struct Entry {
+		QByteArray hash;
+		QByteArray blob;
+	};
+
+	mutable QMutex m_mutex;
+	/// The blobs, starting with the one that has been used most recently
+	std::list< Entry > m_entries;
+	QHash< QByteArray, std::list< Entry >::iterator > m_index;
+	std::size_t m_capacity;
+	std::size_t m_bytes;
+	quint64 m_hits;
+	quint64 m_misses;
+
+	/// Drops the least recently used blobs until the capacity isn't exceeded anymore. The caller has to hold m_mutex.
+	void evict();
+};
+
+#endif // MUMBLE_MURMUR_BLOBSTORE_H_
@@ -0,0 +1,104 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CELTCodec.h"
+
+#include <QtCore/QStringList>
+
+namespace {
+/// The request of celt_mode_info() for the bitstream version
+constexpr int CELT_GET_BITSTREAM_VERSION = 2000;
+
+QStringList libraryNames() {
+#if defined(Q_OS_WIN)
+	return { QLatin1String("celt0.0.7.0") };
+#elif defined(Q_OS_MACOS)
+	return { QLatin1String("libcelt0.0.7.0.dylib"), QLatin1String("libcelt0.0.dylib") };
+#else
+	return { QLatin1String("libcelt0.so.0.0.7.0"), QLatin1String("libcelt0.so.0") };
+#endif
+}
+} // namespace
+
+CELTCodec::CELTCodec() {
+	for (const QString &name : libraryNames()) {
+		m_library.setFileName(name);
+		if (m_library.load()) {
+			break;
+		}
+	}
+	if (!m_library.isLoaded()) {
+		return;
+	}
+
+	m_modeCreate     = reinterpret_cast< mode_create_t >(m_library.resolve("celt_mode_create"));
+	m_modeDestroy    = reinterpret_cast< mode_destroy_t >(m_library.resolve("celt_mode_destroy"));
+	m_modeInfo       = reinterpret_cast< mode_info_t >(m_library.resolve("celt_mode_info"));
+	m_encoderCreate  = reinterpret_cast< encoder_create_t >(m_library.resolve("celt_encoder_create"));
+	m_encoderDestroy = reinterpret_cast< encoder_destroy_t >(m_library.resolve("celt_encoder_destroy"));
+	m_encodeFloat    = reinterpret_cast< encode_float_t >(m_library.resolve("celt_encode_float"));
+	m_decoderCreate  = reinterpret_cast< decoder_create_t >(m_library.resolve("celt_decoder_create"));
+	m_decoderDestroy = reinterpret_cast< decoder_destroy_t >(m_library.resolve("celt_decoder_destroy"));
+	m_decodeFloat    = reinterpret_cast< decode_float_t >(m_library.resolve("celt_decode_float"));
+
+	if (!m_modeCreate || !m_modeDestroy || !m_modeInfo || !m_encoderCreate || !m_encoderDestroy || !m_encodeFloat
+		|| !m_decoderCreate || !m_decoderDestroy || !m_decodeFloat) {
+		return;
+	}
+
+	int error = 0;
+	m_mode    = m_modeCreate(SAMPLE_RATE, FRAME_SIZE, &error);
+	if (!m_mode) {
+		return;
+	}
+
+	// Other versions of the library export the same functions, but speak another bitstream
+	int version = 0;
+	m_modeInfo(m_mode, CELT_GET_BITSTREAM_VERSION, &version);
+	if (version != BITSTREAM_VERSION) {
+		m_modeDestroy(m_mode);
+		m_mode = nullptr;
+	}
+}
+
+CELTCodec::~CELTCodec() {
+	if (m_mode) {
+		m_modeDestroy(m_mode);
+	}
+}
+
+bool CELTCodec::isValid() const {
+	return m_mode != nullptr;
+}
+
+CELTEncoder *CELTCodec::createEncoder() const {
+	int error = 0;
+	return m_encoderCreate(m_mode, 1, &error);
+}
+
+void CELTCodec::destroyEncoder(CELTEncoder *encoder) const {
+	if (encoder) {
+		m_encoderDestroy(encoder);
+	}
+}
+
+CELTDecoder *CELTCodec::createDecoder() const {
+	int error = 0;
+	return m_decoderCreate(m_mode, 1, &error);
+}
+
+void CELTCodec::destroyDecoder(CELTDecoder *decoder) const {
+	if (decoder) {
+		m_decoderDestroy(decoder);
+	}
+}
+
+int CELTCodec::encode(CELTEncoder *encoder, const float *pcm, unsigned char *data, int size) const {
+	return m_encodeFloat(encoder, pcm, nullptr, data, size);
+}
+
+bool CELTCodec::decode(CELTDecoder *decoder, const unsigned char *data, int size, float *pcm) const {
+	return m_decodeFloat(decoder, data, size, pcm) == 0;
+}
@@ -0,0 +1,78 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CELTCODEC_H_
+#define MUMBLE_MURMUR_CELTCODEC_H_
+
+#include <QtCore/QLibrary>
+
+struct CELTMode;
+struct CELTEncoder;
+struct CELTDecoder;
+
+/// The CELT 0.7 library (the compat bitstream, see Server::applyCodecVersions), which is loaded at runtime just like
+/// the client used to do, so that the server doesn't depend on it. Legacy clients send frames of FRAME_SIZE samples
+/// of mono audio at SAMPLE_RATE.
+///
+/// The functions may be called by any thread, as long as every encoder and decoder is only used by one at a time.
+class CELTCodec {
+public:
+	static constexpr int SAMPLE_RATE = 48000;
+	static constexpr int FRAME_SIZE  = SAMPLE_RATE / 100;
+	/// The bitstream version of CELT 0.7.0 (CELT_Alpha)
+	static constexpr int BITSTREAM_VERSION = static_cast< int >(0x8000000b);
+
+	/// Loads the library, after which isValid() tells whether it has been found
+	CELTCodec();
+	~CELTCodec();
+
+	CELTCodec(const CELTCodec &) = delete;
+	CELTCodec &operator=(const CELTCodec &) = delete;
+
+	/// @returns Whether the library has been loaded and speaks the expected bitstream
+	bool isValid() const;
+
+	/// @returns A new encoder or nullptr if it couldn't be created
+	CELTEncoder *createEncoder() const;
+	void destroyEncoder(CELTEncoder *encoder) const;
+	/// @returns A new decoder or nullptr if it couldn't be created
+	CELTDecoder *createDecoder() const;
+	void destroyDecoder(CELTDecoder *decoder) const;
+
+	/// Encodes FRAME_SIZE samples into exactly the given number of bytes
+	///
+	/// @returns The number of bytes written or a negative number on error
+	int encode(CELTEncoder *encoder, const float *pcm, unsigned char *data, int size) const;
+	/// Decodes a frame into FRAME_SIZE samples. A null frame is treated as a lost one.
+	///
+	/// @returns Whether the frame could be decoded
+	bool decode(CELTDecoder *decoder, const unsigned char *data, int size, float *pcm) const;
+
+protected:
+	using mode_create_t     = CELTMode *(*) (int, int, int *);
+	using mode_destroy_t    = void (*)(CELTMode *);
+	using mode_info_t       = int (*)(const CELTMode *, int, int *);
+	using encoder_create_t  = CELTEncoder *(*) (const CELTMode *, int, int *);
+	using encoder_destroy_t = void (*)(CELTEncoder *);
+	using encode_float_t    = int (*)(CELTEncoder *, const float *, float *, unsigned char *, int);
+	using decoder_create_t  = CELTDecoder *(*) (const CELTMode *, int, int *);
+	using decoder_destroy_t = void (*)(CELTDecoder *);
+	using decode_float_t    = int (*)(CELTDecoder *, const unsigned char *, int, float *);
+
+	QLibrary m_library;
+	CELTMode *m_mode = nullptr;
+
+	mode_create_t m_modeCreate         = nullptr;
+	mode_destroy_t m_modeDestroy       = nullptr;
+	mode_info_t m_modeInfo             = nullptr;
+	encoder_create_t m_encoderCreate   = nullptr;
+	encoder_destroy_t m_encoderDestroy = nullptr;
+	encode_float_t m_encodeFloat       = nullptr;
+	decoder_create_t m_decoderCreate   = nullptr;
+	decoder_destroy_t m_decoderDestroy = nullptr;
+	decode_float_t m_decodeFloat       = nullptr;
+};
+
+#endif // MUMBLE_MURMUR_CELTCODEC_H_
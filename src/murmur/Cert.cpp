@@ -79,6 +79,7 @@ void Server::initializeCert() {
 #if defined(USE_QSSLDIFFIEHELLMANPARAMETERS)
 	qsdhpDHParams = QSslDiffieHellmanParameters();
 #endif
+	bUsingMetaCert = false;
 
 	crt      = getConf("certificate", QString()).toByteArray();
 	key      = getConf("key", QString()).toByteArray();
@@ -178,7 +179,7 @@ void Server::initializeCert() {
 		if (qscCert.isNull() || qskKey.isNull()) {
 			log("Generating new server certificate.");
 
-			if (!SelfSignedCertificate::generateMurmurV2Certificate(qscCert, qskKey)) {
+			if (!SelfSignedCertificate::generateMurmurV2Certificate(qscCert, qskKey, Meta::mp.generatedKeyAlgorithm)) {
 				log("Certificate or key generation failed");
 			}
 
@@ -187,6 +188,29 @@ void Server::initializeCert() {
 		}
 	}
 
+	m_sslConfiguration = QSslConfiguration::defaultConfiguration();
+	m_sslConfiguration.setPrivateKey(qskKey);
+	m_sslConfiguration.setLocalCertificate(qscCert);
+
+	// Treat the leaf certificate as a root.
+	// This shouldn't strictly be necessary,
+	// and is a left-over from early on.
+	// Perhaps it is necessary for self-signed
+	// certs?
+	//
+	// Also add the CA certificates specified via
+	// murmur.ini's sslCA option and the intermediate
+	// CAs found in the PEM bundle used for this
+	// server's certificate.
+	QList< QSslCertificate > caCertificates = m_sslConfiguration.caCertificates();
+	caCertificates << qscCert << Meta::mp.qlCA << qlIntermediates;
+	m_sslConfiguration.setCaCertificates(caCertificates);
+
+	m_sslConfiguration.setCiphers(Meta::mp.qlCiphers);
+#if defined(USE_QSSLDIFFIEHELLMANPARAMETERS)
+	m_sslConfiguration.setDiffieHellmanParameters(qsdhpDHParams);
+#endif
+
 	// Drain OpenSSL's per-thread error queue
 	// to ensure that errors from the operations
 	// we've done in here do not leak out into
@@ -0,0 +1,46 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELAUDIENCE_H_
+#define MUMBLE_MURMUR_CHANNELAUDIENCE_H_
+
+#include "MumbleProtocol.h"
+#include "VolumeAdjustment.h"
+
+#include <cstddef>
+#include <vector>
+
+class Channel;
+class ServerUser;
+
+/// Everyone who hears regular speech (Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) in a channel, so that the
+/// voice threads don't have to collect the receivers from the channel tree for every packet.
+///
+/// Audiences are built by the main thread (see Server::rebuildAudiences) and never change afterwards. Whenever the
+/// users, links or listeners an audience has been built from change, it is replaced in the next VoiceState.
+struct ChannelAudience {
+	struct Receiver {
+		ServerUser *user;
+		Mumble::Protocol::audio_context_t context;
+		VolumeAdjustment volumeAdjustment;
+	};
+
+	/// A channel that is linked to the audience's channel. Whether the speaker's audio reaches the receivers in there
+	/// depends on the speaker's permissions, which is why they are kept apart.
+	struct Link {
+		Channel *channel;
+		/// The range of linkedReceivers that hear speech through this link
+		std::size_t begin;
+		std::size_t end;
+	};
+
+	/// The users in the channel and the ones listening to it
+	std::vector< Receiver > receivers;
+	std::vector< Link > links;
+	/// The users in the linked channels and the ones listening to them
+	std::vector< Receiver > linkedReceivers;
+};
+
+#endif // MUMBLE_MURMUR_CHANNELAUDIENCE_H_
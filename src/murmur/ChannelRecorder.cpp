@@ -0,0 +1,298 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ChannelRecorder.h"
+
+#include "BandwidthRecord.h"
+#include "FrameAggregator.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRegularExpression>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace {
+/// The rate all Opus streams are timed with, whatever the rate of the audio
+constexpr unsigned int SAMPLE_RATE = 48000;
+/// The longest an Opus packet can be (120 ms)
+constexpr unsigned int MAX_PACKET_SAMPLES = 5760;
+/// Pauses shorter than this (100 ms) are taken to be jitter of the network rather than the speaker pausing
+constexpr std::uint64_t GAP_TOLERANCE = 4800;
+
+/// Silence: packets (of the CELT fullband configuration with frames of 20 ms) without any data in their frames, which
+/// decoders treat like frames that haven't been transmitted. The stereo flag is added for tracks with two channels.
+constexpr Mumble::Protocol::byte SILENCE_TOC = 31 << 3;
+constexpr Mumble::Protocol::byte STEREO_FLAG = 0x04;
+/// A single frame (code 0)
+constexpr unsigned int SHORT_SILENCE_SAMPLES = 960;
+/// 6 frames of the same size (code 3)
+constexpr unsigned int LONG_SILENCE_SAMPLES = 6 * 960;
+
+/// @returns The given name with everything that might not be allowed in file names replaced
+QString fileName(const QString &name) {
+	QString result = name;
+	result.replace(QRegularExpression(QLatin1String("[^\\w\\-]")), QLatin1String("_"));
+	return result;
+}
+} // namespace
+
+ChannelRecorder::ChannelRecorder(const QString &directory, std::vector< unsigned int > channels)
+	: m_directory(directory), m_channels([&channels]() {
+		  std::sort(channels.begin(), channels.end());
+		  channels.erase(std::unique(channels.begin(), channels.end()), channels.end());
+		  return std::move(channels);
+	  }()) {
+	// About a second of a hundred speakers, after which the buffers are reused
+	m_pending.frames.reserve(4096);
+	m_pending.data.reserve(4096 * 128);
+
+	QDir().mkpath(m_directory.absolutePath());
+
+	start();
+}
+
+ChannelRecorder::~ChannelRecorder() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stop = true;
+		m_condition.wakeAll();
+	}
+
+	wait();
+}
+
+bool ChannelRecorder::isRecorded(unsigned int channel) const {
+	return std::binary_search(m_channels.begin(), m_channels.end(), channel);
+}
+
+void ChannelRecorder::record(unsigned int channel, unsigned int session,
+							 gsl::span< const Mumble::Protocol::byte > frame, quint64 time) {
+	if (frame.empty() || frame.size() > MAX_FRAME_SIZE) {
+		return;
+	}
+
+	QMutexLocker l(&m_mutex);
+
+	if (m_pending.frames.size() >= MAX_PENDING_FRAMES) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	m_pending.frames.push_back({ channel, session, time, m_pending.data.size(), frame.size() });
+	m_pending.data.insert(m_pending.data.end(), frame.begin(), frame.end());
+}
+
+void ChannelRecorder::setName(unsigned int session, const QString &name) {
+	QMutexLocker l(&m_namesMutex);
+
+	m_names.insert(session, name);
+}
+
+std::uint64_t ChannelRecorder::droppedFrames() const {
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+unsigned int ChannelRecorder::packetSamples(gsl::span< const Mumble::Protocol::byte > packet) {
+	if (packet.empty()) {
+		return 0;
+	}
+
+	// The code (the lower 2 bits) determines the number of frames
+	unsigned int frames;
+	switch (packet[0] & 0x3) {
+		case 0:
+			frames = 1;
+			break;
+		case 1:
+		case 2:
+			frames = 2;
+			break;
+		default:
+			if (packet.size() < 2) {
+				return 0;
+			}
+			frames = packet[1] & 0x3F;
+			break;
+	}
+
+	const unsigned int samples = FrameAggregator::frameSamples(packet[0]) * frames;
+	return samples <= MAX_PACKET_SAMPLES ? samples : 0;
+}
+
+void ChannelRecorder::run() {
+	Buffer buffer;
+	buffer.frames.reserve(m_pending.frames.capacity());
+	buffer.data.reserve(m_pending.data.capacity());
+
+	forever {
+		bool stopping = false;
+		{
+			QMutexLocker l(&m_mutex);
+
+			if (!m_stop) {
+				m_condition.wait(&m_mutex, WRITE_INTERVAL_MSECS);
+			}
+
+			stopping = m_stop;
+			// The voice threads go on with the (empty) buffers that have been written last time
+			std::swap(buffer, m_pending);
+		}
+
+		for (const PendingFrame &frame : buffer.frames) {
+			write(frame, buffer.data.data() + frame.offset);
+		}
+		buffer.frames.clear();
+		buffer.data.clear();
+
+		for (auto &entry : m_tracks) {
+			if (entry.second) {
+				entry.second->flush();
+			}
+		}
+
+		if (stopping) {
+			break;
+		}
+	}
+
+	// Finishes the streams
+	m_tracks.clear();
+}
+
+void ChannelRecorder::write(const PendingFrame &frame, const Mumble::Protocol::byte *data) {
+	auto recording = m_recordings.find(frame.channel);
+	if (recording == m_recordings.end()) {
+		// The frame has been spoken a moment ago
+		const quint64 now     = BandwidthRecord::clock();
+		const QDateTime start = QDateTime::currentDateTimeUtc().addMSecs(
+			-static_cast< qint64 >(now > frame.time ? (now - frame.time) / 1000 : 0));
+
+		QDir directory(m_directory);
+		const QString name = QString::fromLatin1("channel%1-%2")
+								 .arg(frame.channel)
+								 .arg(start.toString(QLatin1String("yyyyMMdd-HHmmss")));
+		if (!directory.mkpath(name) || !directory.cd(name)) {
+			qWarning("ChannelRecorder: Failed to create the directory %s", qPrintable(directory.filePath(name)));
+		}
+
+		recording = m_recordings.emplace(frame.channel, Recording{ frame.time, start, directory }).first;
+	}
+
+	Track *track = this->track(frame.channel, frame.session, recording->second, data);
+	const unsigned int samples = packetSamples(gsl::span< const Mumble::Protocol::byte >(data, frame.size));
+	if (!track || samples == 0) {
+		return;
+	}
+
+	const quint64 offset = frame.time > recording->second.start ? frame.time - recording->second.start : 0;
+	track->fillUntil(offset * SAMPLE_RATE / 1000000);
+	track->append(data, frame.size, samples);
+}
+
+ChannelRecorder::Track *ChannelRecorder::track(unsigned int channel, unsigned int session,
+											   const Recording &recording, const Mumble::Protocol::byte *firstFrame) {
+	const std::uint64_t key = (static_cast< std::uint64_t >(channel) << 32) | session;
+
+	auto it = m_tracks.find(key);
+	if (it != m_tracks.end()) {
+		return it->second.get();
+	}
+
+	QString name;
+	{
+		QMutexLocker l(&m_namesMutex);
+		name = m_names.value(session);
+	}
+
+	const QString path =
+		recording.directory.filePath(QString::fromLatin1("%1-%2.opus").arg(session).arg(fileName(name)));
+	// Clients send either mono or stereo throughout
+	const unsigned int channels = (firstFrame[0] & STEREO_FLAG) ? 2 : 1;
+
+	std::unique_ptr< Track > track = std::make_unique< Track >(path, channels, name, recording.started);
+	if (!track->isValid()) {
+		qWarning("ChannelRecorder: Failed to write to %s", qPrintable(path));
+		// Not trying again for every frame
+		track.reset();
+	}
+
+	return m_tracks.emplace(key, std::move(track)).first->second.get();
+}
+
+ChannelRecorder::Track::Track(const QString &path, unsigned int channels, const QString &title,
+							  const QDateTime &started)
+	: m_file(path), m_stream(m_file), m_channels(channels) {
+	if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return;
+	}
+
+	QList< QByteArray > comments;
+	if (!title.isEmpty()) {
+		comments << QByteArrayLiteral("TITLE=") + title.toUtf8();
+	}
+	comments << QByteArrayLiteral("DATE=") + started.toString(Qt::ISODate).toUtf8();
+
+	m_valid = m_stream.writeHeaders(channels, PRE_SKIP, SAMPLE_RATE, QByteArrayLiteral("Mumble server"), comments);
+}
+
+ChannelRecorder::Track::~Track() {
+	if (m_valid) {
+		writePage(true);
+	}
+}
+
+bool ChannelRecorder::Track::isValid() const {
+	return m_valid;
+}
+
+void ChannelRecorder::Track::fillUntil(std::uint64_t position) {
+	if (position <= m_position + GAP_TOLERANCE) {
+		return;
+	}
+
+	const Mumble::Protocol::byte toc = SILENCE_TOC | (m_channels == 2 ? STEREO_FLAG : 0);
+	// Code 3, followed by the number of frames
+	const std::array< Mumble::Protocol::byte, 2 > longSilence  = { static_cast< Mumble::Protocol::byte >(toc | 3), 6 };
+	const std::array< Mumble::Protocol::byte, 1 > shortSilence = { toc };
+
+	while (m_position + LONG_SILENCE_SAMPLES <= position) {
+		append(longSilence.data(), longSilence.size(), LONG_SILENCE_SAMPLES);
+	}
+	while (m_position + SHORT_SILENCE_SAMPLES <= position) {
+		append(shortSilence.data(), shortSilence.size(), SHORT_SILENCE_SAMPLES);
+	}
+}
+
+void ChannelRecorder::Track::append(const Mumble::Protocol::byte *data, std::size_t size, unsigned int samples) {
+	if (!m_valid) {
+		return;
+	}
+
+	if (!m_stream.fits(size)) {
+		writePage(false);
+	}
+
+	m_stream.addPacket(data, size);
+	m_position += samples;
+
+	if (m_stream.pagePackets() >= PACKETS_PER_PAGE) {
+		writePage(false);
+	}
+}
+
+void ChannelRecorder::Track::flush() {
+	if (m_valid && !m_file.flush()) {
+		m_valid = false;
+	}
+}
+
+void ChannelRecorder::Track::writePage(bool last) {
+	// The position of a page is that of the end of its last packet (including the samples to skip)
+	if (!m_stream.writePage(m_position + PRE_SKIP, last)) {
+		m_valid = false;
+	}
+}
@@ -0,0 +1,160 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CHANNELRECORDER_H_
+#define MUMBLE_MURMUR_CHANNELRECORDER_H_
+
+#include "MumbleProtocol.h"
+#include "OggOpusStream.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <gsl/span>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/// Records the speech in some of the channels of a virtual server (see Server::qsRecordChannels) into one Ogg Opus
+/// file (RFC 7845) per speaker. The Opus frames are stored just like they have been received, so nothing is decoded
+/// or encoded.
+///
+/// The voice threads hand the frames over with record(), which only copies them into a buffer. The recorder's own
+/// thread writes them out at most WRITE_INTERVAL_MSECS later. All tracks of a channel start when the recording of the
+/// channel does (when the first frame has been spoken in it): the time before a speaker's first frame and the pauses
+/// in between are filled with silence, so that the tracks can be played (or mixed) together. The comments of every
+/// track hold the speaker's name (see setName()) and the time at which the recording of its channel started.
+///
+/// The files of a channel are put into a directory of their own, named after the channel and that time, inside of
+/// the directory the recorder has been given. Every track stays open until the recorder is destroyed.
+class ChannelRecorder : public QThread {
+public:
+	/// For how long frames are buffered at most before they are written
+	static constexpr unsigned long WRITE_INTERVAL_MSECS = 500;
+	/// The number of frames that may be waiting to be written. Any further ones are dropped (and counted, see
+	/// droppedFrames()), so that a stalled disk can't make the server run out of memory.
+	static constexpr std::size_t MAX_PENDING_FRAMES = 1 << 16;
+	/// The largest Opus frame that is recorded
+	static constexpr std::size_t MAX_FRAME_SIZE = 1275 * 3;
+
+	/// Starts the thread
+	///
+	/// @param directory The directory the recordings are put into, which is created if it doesn't exist
+	/// @param channels The IDs of the channels to record
+	ChannelRecorder(const QString &directory, std::vector< unsigned int > channels);
+	/// Writes the pending frames and finishes all tracks before returning
+	~ChannelRecorder() override;
+
+	/// @returns Whether the given channel is recorded, which may be asked by any thread
+	bool isRecorded(unsigned int channel) const;
+	/// Records the given Opus frame, which the given user has spoken in the given (recorded) channel at the given
+	/// time (see BandwidthRecord::clock). May be called by any thread.
+	void record(unsigned int channel, unsigned int session, gsl::span< const Mumble::Protocol::byte > frame,
+				quint64 time);
+	/// Sets the name that the tracks of the given user are going to be given
+	void setName(unsigned int session, const QString &name);
+
+	/// @returns The number of frames that have been dropped because too many were waiting to be written
+	std::uint64_t droppedFrames() const;
+
+	/// @returns The duration of the given Opus packet in samples at 48 kHz (as given by its TOC byte, see RFC 6716
+	/// 	section 3.1) or 0 if it isn't a valid packet
+	static unsigned int packetSamples(gsl::span< const Mumble::Protocol::byte > packet);
+
+protected:
+	/// A frame waiting to be written, the data of which is stored at offset in the buffer along with it
+	struct PendingFrame {
+		unsigned int channel;
+		unsigned int session;
+		quint64 time;
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	struct Buffer {
+		std::vector< PendingFrame > frames;
+		std::vector< Mumble::Protocol::byte > data;
+	};
+
+	/// The recording of a single channel
+	struct Recording {
+		/// The time of the first frame (see BandwidthRecord::clock)
+		quint64 start;
+		QDateTime started;
+		QDir directory;
+	};
+
+	/// The track of a single speaker in a recorded channel
+	class Track {
+	public:
+		/// Opens the given file and writes the headers, after which isValid() tells whether that has worked
+		Track(const QString &path, unsigned int channels, const QString &title, const QDateTime &started);
+		/// Finishes the stream
+		~Track();
+
+		bool isValid() const;
+		/// Appends silence until the track is the given number of samples (at 48 kHz) long, unless it is already
+		void fillUntil(std::uint64_t position);
+		void append(const Mumble::Protocol::byte *data, std::size_t size, unsigned int samples);
+		/// Hands the pages that have been written to the operating system. The page that is being filled is only
+		/// written once it is full (or the track is finished).
+		void flush();
+
+	protected:
+		/// The number of samples (at 48 kHz) a decoder skips at the start, which is what libopus's encoder (that all
+		/// clients use) delays its output by
+		static constexpr unsigned int PRE_SKIP = 312;
+		/// The number of packets after which a page is written
+		static constexpr unsigned int PACKETS_PER_PAGE = 50;
+
+		void writePage(bool last);
+
+		QFile m_file;
+		OggOpusStream m_stream;
+		const unsigned int m_channels;
+		/// The number of samples (at 48 kHz) of the packets that have been added so far
+		std::uint64_t m_position = 0;
+		bool m_valid             = false;
+	};
+
+	const QDir m_directory;
+	/// Sorted, and never modified once the recorder has been constructed
+	const std::vector< unsigned int > m_channels;
+
+	mutable QMutex m_mutex;
+	/// Signalled when the thread is supposed to stop
+	QWaitCondition m_condition;
+	/// The frames that haven't been written yet
+	Buffer m_pending;
+	bool m_stop = false;
+	std::atomic< std::uint64_t > m_dropped{ 0 };
+
+	QMutex m_namesMutex;
+	QHash< unsigned int, QString > m_names;
+
+	// Only used by the recorder's thread
+	std::unordered_map< unsigned int, Recording > m_recordings;
+	/// By channel (upper half) and session (lower half)
+	std::unordered_map< std::uint64_t, std::unique_ptr< Track > > m_tracks;
+
+	void run() override;
+	void write(const PendingFrame &frame, const Mumble::Protocol::byte *data);
+	/// @returns The track of the given user in the given channel, which is created if it doesn't exist yet, or nullptr
+	/// 	if it can't be created
+	Track *track(unsigned int channel, unsigned int session, const Recording &recording,
+				 const Mumble::Protocol::byte *firstFrame);
+};
+
+#endif // MUMBLE_MURMUR_CHANNELRECORDER_H_
@@ -0,0 +1,638 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Cluster.h"
+
+#include "Channel.h"
+#include "HostAddress.h"
+#include "PacketDataStream.h"
+#include "QtUtils.h"
+#include "Server.h"
+#include "ServerUser.h"
+#include "UDPSendQueue.h"
+
+#include "crypto/CryptographicRandom.h"
+
+#include <QtCore/QRegExp>
+#include <QtNetwork/QHostInfo>
+
+#include <cstring>
+#include <limits>
+
+#ifndef Q_OS_WIN
+#	include <netinet/in.h>
+#endif
+
+namespace {
+quint64 randomBootId() {
+	quint64 id = 0;
+	while (id == 0) {
+		// 0 means that a peer's boot ID isn't known (yet)
+		CryptographicRandom::fillBuffer(&id, sizeof(id));
+	}
+
+	return id;
+}
+} // namespace
+
+ClusterNode::ClusterNode(Server &server, unsigned int nodeId, const QByteArray &secret)
+	: m_server(server), m_nodeId(nodeId), m_bootId(randomBootId()),
+	  m_cipher(secret, nodeId, static_cast< unsigned int >(server.iServerNum), m_bootId) {
+	m_clock.start();
+
+	connect(&m_socket, &QUdpSocket::readyRead, this, &ClusterNode::readDatagrams);
+	connect(&m_helloTimer, &QTimer::timeout, this, &ClusterNode::sendHello);
+
+	connect(&m_server, &Server::userConnected, this, &ClusterNode::userConnected);
+	connect(&m_server, &Server::userStateChanged, this, &ClusterNode::userStateChanged);
+	connect(&m_server, &Server::userDisconnected, this, &ClusterNode::userDisconnected);
+}
+
+ClusterNode::~ClusterNode() {
+	// The users of the other nodes are only gone on this node's clients, which are about to be disconnected anyway
+	m_helloTimer.stop();
+	m_socket.close();
+}
+
+bool ClusterNode::start(const QString &peers, const QString &relayLinks, unsigned short basePort) {
+	const unsigned int serverNum = static_cast< unsigned int >(m_server.iServerNum);
+	// Virtual server N of every node uses the node's port + N - 1
+	const unsigned short port = static_cast< unsigned short >(basePort + serverNum - 1);
+
+	// Prefer a dual-stack socket, so that peers may be reached via both IPv4 and IPv6
+	m_ipv6 = m_socket.bind(QHostAddress::Any, port);
+	if (!m_ipv6 && !m_socket.bind(QHostAddress::AnyIPv4, port)) {
+		m_server.log(QString("Cluster: Failed to bind UDP port %1: %2").arg(port).arg(m_socket.errorString()));
+		return false;
+	}
+
+	// The host and base port of every node. Relay links to other virtual servers on this node go through the
+	// loopback interface.
+	QHash< unsigned int, QPair< QHostAddress, int > > nodes;
+	nodes.insert(m_nodeId, qMakePair(QHostAddress(QHostAddress::LocalHost), static_cast< int >(basePort)));
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &entry, peers.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &entry, peers.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
+#endif
+		// id=host:port, where IPv6 addresses are written as [address]
+		const int equals = entry.indexOf(QLatin1Char('='));
+		const int colon  = entry.lastIndexOf(QLatin1Char(':'));
+
+		bool idOk = false, portOk = false;
+		const unsigned int id = entry.left(equals).toUInt(&idOk);
+		const int nodePort    = entry.mid(colon + 1).toInt(&portOk);
+		QString host          = entry.mid(equals + 1, colon - equals - 1);
+		if (host.startsWith(QLatin1Char('[')) && host.endsWith(QLatin1Char(']'))) {
+			host = host.mid(1, host.size() - 2);
+		}
+
+		if (equals <= 0 || colon <= equals || !idOk || !portOk || id == 0 || id >= ClusterProtocol::MAX_NODES
+			|| nodes.contains(id) || nodePort <= 0 || nodePort > 65535) {
+			m_server.log(QString("Cluster: Ignoring invalid peer \"%1\"").arg(entry));
+			continue;
+		}
+
+		QHostAddress address;
+		if (!address.setAddress(host)) {
+			const QList< QHostAddress > addresses = QHostInfo::fromName(host).addresses();
+			if (addresses.isEmpty()) {
+				m_server.log(QString("Cluster: Lookup of peer %1 (%2) failed").arg(id).arg(host));
+				continue;
+			}
+			address = addresses.first();
+		}
+
+		nodes.insert(id, qMakePair(address, nodePort));
+		addPeer(id, serverNum, address, nodePort + static_cast< int >(serverNum) - 1);
+	}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &entry, relayLinks.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &entry, relayLinks.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
+#endif
+		// channel=node:server:channel
+		const QStringList parts = entry.split(QRegExp(QLatin1String("[=:]")));
+		bool ok                 = parts.size() == 4;
+		unsigned int values[4]  = {};
+		for (int i = 0; ok && i < 4; ++i) {
+			values[i] = parts[i].toUInt(&ok);
+		}
+
+		const unsigned int node   = values[1];
+		const unsigned int server = values[2];
+		if (!ok || !nodes.contains(node) || server == 0 || (node == m_nodeId && server == serverNum)) {
+			m_server.log(QString("Cluster: Ignoring invalid relay link \"%1\"").arg(entry));
+			continue;
+		}
+
+		Peer *p = peer(node, server);
+		if (!p) {
+			p = addPeer(node, server, nodes.value(node).first,
+						nodes.value(node).second + static_cast< int >(server) - 1);
+		}
+		if (p) {
+			p->links.push_back({ values[0], values[3] });
+		}
+	}
+
+	if (m_peers.empty()) {
+		m_server.log("Cluster: Neither peers nor relay links have been configured");
+	}
+
+	m_server.log(QString("Cluster: Running as node %1 on UDP port %2").arg(m_nodeId).arg(port));
+
+	m_helloTimer.start(HELLO_INTERVAL_MSECS);
+	sendHello();
+
+	return true;
+}
+
+ClusterNode::Peer *ClusterNode::peer(unsigned int node, unsigned int server) const {
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (p->node == node && p->server == server) {
+			return p.get();
+		}
+	}
+
+	return nullptr;
+}
+
+ClusterNode::Peer *ClusterNode::addPeer(unsigned int node, unsigned int server, const QHostAddress &host, int port) {
+	const HostAddress hostAddress(host);
+	if (port <= 0 || port > 65535 || (!m_ipv6 && hostAddress.isV6())) {
+		m_server.log(QString("Cluster: Virtual server %1 of node %2 can't be reached").arg(server).arg(node));
+		return nullptr;
+	}
+
+	std::unique_ptr< Peer > p = std::make_unique< Peer >();
+	p->index                  = m_peers.size();
+	p->node                   = node;
+	p->server                 = server;
+	memset(&p->address, 0, sizeof(p->address));
+	if (m_ipv6) {
+		sockaddr_in6 *in6 = reinterpret_cast< sockaddr_in6 * >(&p->address);
+		in6->sin6_family  = AF_INET6;
+		in6->sin6_port    = htons(static_cast< unsigned short >(port));
+		memcpy(in6->sin6_addr.s6_addr, hostAddress.getByteRepresentation().data(), 16);
+		p->addressLength = sizeof(sockaddr_in6);
+	} else {
+		sockaddr_in *in     = reinterpret_cast< sockaddr_in * >(&p->address);
+		in->sin_family      = AF_INET;
+		in->sin_port        = htons(static_cast< unsigned short >(port));
+		in->sin_addr.s_addr = hostAddress.toIPv4();
+		p->addressLength    = sizeof(sockaddr_in);
+	}
+
+	m_server.log(QString("Cluster: Virtual server %1 of node %2 is at %3")
+					 .arg(server)
+					 .arg(node)
+					 .arg(m_server.addressToString(host, static_cast< unsigned short >(port))));
+
+	m_peers.push_back(std::move(p));
+	return m_peers.back().get();
+}
+
+void ClusterNode::sendDatagram(const unsigned char *datagram, std::size_t length, const Peer &target) const {
+#ifdef Q_OS_WIN
+	using size_type = int;
+#else
+	using size_type = std::size_t;
+#endif
+
+	::sendto(static_cast< UDPSendQueue::socket_t >(m_socket.socketDescriptor()),
+			 reinterpret_cast< const char * >(datagram), static_cast< size_type >(length), 0,
+			 reinterpret_cast< const struct sockaddr * >(&target.address), target.addressLength);
+}
+
+template< typename Message >
+void ClusterNode::send(ClusterProtocol::MessageType type, const Message &message, const Peer *target) {
+	unsigned char datagram[ClusterProtocol::MAX_DATAGRAM_SIZE];
+	PacketDataStream stream(datagram, ClusterProtocol::MAX_DATAGRAM_SIZE - ClusterProtocol::OVERHEAD);
+	ClusterProtocol::write(stream,
+						   ClusterProtocol::Header{ type, m_nodeId, static_cast< unsigned int >(m_server.iServerNum) });
+	ClusterProtocol::write(stream, message);
+
+	const std::size_t length = stream.isValid() ? m_cipher.seal(datagram, stream.size(), sizeof(datagram)) : 0;
+	if (length == 0) {
+		return;
+	}
+
+	if (target) {
+		sendDatagram(datagram, length, *target);
+		return;
+	}
+
+	// The datagram is sealed once and then sent to every node that is up
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (!p->isRelayLink() && p->alive.load(std::memory_order_relaxed)) {
+			sendDatagram(datagram, length, *p);
+		}
+	}
+}
+
+void ClusterNode::sendBatch(ClusterProtocol::VoiceBatch &batch, const Peer &target) {
+	const std::size_t length = m_cipher.seal(batch.datagram.data(), batch.length, batch.datagram.size());
+	if (length > 0) {
+		sendDatagram(batch.datagram.data(), length, target);
+	}
+
+	batch.clear();
+}
+
+void ClusterNode::relay(const ClusterProtocol::Voice &voice, std::vector< ClusterProtocol::VoiceBatch > &batches) {
+	const ClusterProtocol::Header header{ ClusterProtocol::MessageType::Voice, m_nodeId,
+										  static_cast< unsigned int >(m_server.iServerNum) };
+
+	// The peers never change, so this only allocates the first time
+	batches.resize(m_peers.size());
+
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (!p->alive.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		const ClusterProtocol::Voice *frame = &voice;
+		ClusterProtocol::Voice linked;
+		if (p->isRelayLink()) {
+			// Only the channels that are linked with the peer's are of interest to it
+			linked              = voice;
+			linked.channelCount = 0;
+			for (std::size_t i = 0; i < voice.channelCount; ++i) {
+				for (const Peer::Link &link : p->links) {
+					if (link.local == voice.channels[i] && linked.channelCount < linked.channels.size()) {
+						linked.channels[linked.channelCount++] = link.remote;
+					}
+				}
+			}
+			if (linked.channelCount == 0) {
+				continue;
+			}
+			frame = &linked;
+		}
+
+		ClusterProtocol::VoiceBatch &batch = batches[p->index];
+		if (!ClusterProtocol::append(batch, header, *frame)) {
+			sendBatch(batch, *p);
+			ClusterProtocol::append(batch, header, *frame);
+		}
+	}
+}
+
+void ClusterNode::flush(std::vector< ClusterProtocol::VoiceBatch > &batches) {
+	for (std::size_t i = 0; i < batches.size(); ++i) {
+		if (!batches[i].empty()) {
+			sendBatch(batches[i], *m_peers[i]);
+		}
+	}
+}
+
+void ClusterNode::sendHello() {
+	const qint64 now = m_clock.elapsed();
+
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (p->alive.load(std::memory_order_relaxed) && now - p->lastSeen > PEER_TIMEOUT_MSECS) {
+			m_server.log(QString("Cluster: Virtual server %1 of node %2 is down").arg(p->server).arg(p->node));
+			p->alive.store(false, std::memory_order_relaxed);
+			// It has to be told about our users again once it is back
+			p->bootId = 0;
+			removeRemoteUsers(*p, std::numeric_limits< qint64 >::max());
+		}
+
+		ClusterProtocol::Hello hello;
+		hello.bootId = m_bootId;
+		// Nodes that are down are greeted as well, as that is how they find out that we are up
+		send(ClusterProtocol::MessageType::Hello, hello, p.get());
+	}
+
+	if (now - m_lastResync >= RESYNC_INTERVAL_MSECS) {
+		m_lastResync = now;
+
+		for (const std::unique_ptr< Peer > &p : m_peers) {
+			if (p->alive.load(std::memory_order_relaxed)) {
+				sendUsers(*p);
+				// Users that haven't been refreshed by a couple of resyncs have been removed without us noticing
+				removeRemoteUsers(*p, now - 3 * RESYNC_INTERVAL_MSECS);
+			}
+		}
+	}
+}
+
+void ClusterNode::sendUsers(Peer &target) {
+	if (target.isRelayLink()) {
+		// The peer may have lost track of them
+		target.announced.clear();
+	}
+
+	foreach (const ServerUser *u, m_server.qhUsers) {
+		if (u->sState != ServerUser::Authenticated) {
+			continue;
+		}
+
+		if (target.isRelayLink()) {
+			announce(target, *u);
+		} else {
+			send(ClusterProtocol::MessageType::UserState, stateOf(*u), &target);
+		}
+	}
+}
+
+void ClusterNode::announce(Peer &target, const ServerUser &u) {
+	const unsigned int channel = u.cChannel ? u.cChannel->iId : 0;
+	for (const Peer::Link &link : target.links) {
+		if (link.local == channel) {
+			ClusterProtocol::UserState state = stateOf(u);
+			state.channel                    = link.remote;
+			// Registrations are specific to a virtual server
+			state.userId = -1;
+
+			send(ClusterProtocol::MessageType::UserState, state, &target);
+			target.announced.insert(u.uiSession);
+			return;
+		}
+	}
+
+	if (target.announced.remove(u.uiSession)) {
+		ClusterProtocol::UserRemove remove;
+		remove.session = u.uiSession;
+		send(ClusterProtocol::MessageType::UserRemove, remove, &target);
+	}
+}
+
+void ClusterNode::readDatagrams() {
+	unsigned char datagram[ClusterProtocol::MAX_DATAGRAM_SIZE];
+
+	while (m_socket.hasPendingDatagrams()) {
+		const qint64 length = m_socket.readDatagram(reinterpret_cast< char * >(datagram), sizeof(datagram));
+		if (length > 0) {
+			handle(datagram, static_cast< std::size_t >(length));
+		}
+	}
+}
+
+void ClusterNode::handle(unsigned char *datagram, std::size_t length) {
+	ClusterProtocol::Nonce nonce;
+	length = m_cipher.open(datagram, length, &nonce);
+	if (length == 0) {
+		return;
+	}
+
+	PacketDataStream stream(datagram, static_cast< unsigned int >(length));
+	ClusterProtocol::Header header;
+	if (!ClusterProtocol::read(stream, header)) {
+		return;
+	}
+
+	// The key the datagram has been sealed with is the sender's only if it claims to be the sender of the key
+	if (header.node != nonce.node || header.server != nonce.server) {
+		return;
+	}
+
+	Peer *p = peer(header.node, header.server);
+	if (!p) {
+		return;
+	}
+
+	// The boot ID is part of what identifies the run of the peer that has sealed the datagram
+	ClusterProtocol::Hello hello;
+	if (header.type == ClusterProtocol::MessageType::Hello
+		&& (!ClusterProtocol::read(stream, hello) || !p->replay.start(nonce.salt, hello.bootId))) {
+		return;
+	}
+	if (!p->replay.accept(nonce)) {
+		return;
+	}
+
+	switch (header.type) {
+		case ClusterProtocol::MessageType::Hello: {
+			p->lastSeen = m_clock.elapsed();
+			if (p->bootId != hello.bootId) {
+				if (p->bootId != 0) {
+					// The node has restarted, so the users it has told us about before are gone
+					removeRemoteUsers(*p, std::numeric_limits< qint64 >::max());
+				}
+				p->bootId = hello.bootId;
+				sendUsers(*p);
+			}
+			if (!p->alive.exchange(true, std::memory_order_relaxed)) {
+				m_server.log(QString("Cluster: Virtual server %1 of node %2 is up").arg(p->server).arg(p->node));
+			}
+			break;
+		}
+		case ClusterProtocol::MessageType::UserState: {
+			ClusterProtocol::UserState state;
+			if (ClusterProtocol::read(stream, state)) {
+				updateRemoteUser(*p, state);
+			}
+			break;
+		}
+		case ClusterProtocol::MessageType::UserRemove: {
+			ClusterProtocol::UserRemove remove;
+			if (ClusterProtocol::read(stream, remove)) {
+				const unsigned int session = localSession(*p, remove.session);
+				if (session > 0) {
+					removeRemoteUser(session);
+				}
+			}
+			break;
+		}
+		case ClusterProtocol::MessageType::Voice: {
+			ClusterProtocol::Voice voice;
+			while (stream.left() > 0 && ClusterProtocol::read(stream, voice)) {
+				voice.session = localSession(*p, voice.session);
+				if (voice.session == 0) {
+					continue;
+				}
+
+				if (p->isRelayLink()) {
+					// A relay link only ever carries audio for the channels that are linked
+					std::size_t count = 0;
+					for (std::size_t i = 0; i < voice.channelCount; ++i) {
+						for (const Peer::Link &link : p->links) {
+							if (link.local == voice.channels[i]) {
+								voice.channels[count++] = link.local;
+								break;
+							}
+						}
+					}
+					voice.channelCount = count;
+				}
+
+				m_server.processRemoteVoice(voice);
+			}
+			break;
+		}
+	}
+}
+
+unsigned int ClusterNode::localSession(const Peer &peer, unsigned int remoteSession) const {
+	unsigned int session = remoteSession;
+	if (peer.isRelayLink()) {
+		session = m_bridgedSessions.value(bridgeKey(peer, remoteSession));
+	}
+
+	auto it = m_remoteUsers.constFind(session);
+	return it != m_remoteUsers.constEnd() && it->peer == &peer ? session : 0;
+}
+
+void ClusterNode::userConnected(const User *user) {
+	const ServerUser *u = static_cast< const ServerUser * >(user);
+
+	send(ClusterProtocol::MessageType::UserState, stateOf(*u));
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (p->isRelayLink() && p->alive.load(std::memory_order_relaxed)) {
+			announce(*p, *u);
+		}
+	}
+}
+
+void ClusterNode::userStateChanged(const User *user) {
+	const ServerUser *u = static_cast< const ServerUser * >(user);
+	if (u->sState == ServerUser::Authenticated) {
+		userConnected(user);
+	}
+}
+
+void ClusterNode::userDisconnected(const User *user) {
+	ClusterProtocol::UserRemove remove;
+	remove.session = user->uiSession;
+	send(ClusterProtocol::MessageType::UserRemove, remove);
+
+	for (const std::unique_ptr< Peer > &p : m_peers) {
+		if (p->announced.remove(user->uiSession)) {
+			send(ClusterProtocol::MessageType::UserRemove, remove, p.get());
+		}
+	}
+}
+
+void ClusterNode::sendRemoteUsers(ServerUser *u) {
+	MumbleProto::UserState mpus;
+	for (const RemoteUser &remote : m_remoteUsers) {
+		mpus.Clear();
+		toMessage(remote.state, mpus);
+		m_server.sendMessage(u, mpus);
+	}
+}
+
+void ClusterNode::updateRemoteUser(const Peer &peer, const ClusterProtocol::UserState &state) {
+	ClusterProtocol::UserState checked = state;
+
+	if (peer.isRelayLink()) {
+		// The users behind a relay link may only appear in the linked channels
+		bool linked = false;
+		for (const Peer::Link &link : peer.links) {
+			linked = linked || link.local == checked.channel;
+		}
+		if (!linked) {
+			return;
+		}
+
+		const quint64 key = bridgeKey(peer, state.session);
+		checked.session   = m_bridgedSessions.value(key);
+		if (checked.session == 0) {
+			if (m_server.qqIds.isEmpty()) {
+				return;
+			}
+			checked.session = m_server.qqIds.dequeue();
+			m_bridgedSessions.insert(key, checked.session);
+		}
+	} else if (ClusterProtocol::sessionNode(checked.session) != peer.node) {
+		// Sessions are partitioned among the nodes, so this can't clash with a local user
+		return;
+	}
+
+	if (!m_server.qhChannels.contains(checked.channel)) {
+		// The node knows a channel that hasn't been created here (yet)
+		checked.channel = 0;
+	}
+
+	auto it = m_remoteUsers.find(checked.session);
+	if (it != m_remoteUsers.end()) {
+		it->refreshed = m_clock.elapsed();
+		const ClusterProtocol::UserState &known = it->state;
+		if (known.channel == checked.channel && known.userId == checked.userId && known.name == checked.name
+			&& known.flags == checked.flags) {
+			// Most likely a resync
+			return;
+		}
+		it->state = checked;
+	} else {
+		m_remoteUsers.insert(checked.session, { checked, m_clock.elapsed(), &peer, state.session });
+	}
+
+	MumbleProto::UserState mpus;
+	toMessage(checked, mpus);
+	m_server.sendAll(mpus);
+}
+
+void ClusterNode::removeRemoteUser(unsigned int session) {
+	auto it = m_remoteUsers.find(session);
+	if (it == m_remoteUsers.end()) {
+		return;
+	}
+
+	if (it->peer->isRelayLink()) {
+		// The session has been taken from our own pool
+		m_bridgedSessions.remove(bridgeKey(*it->peer, it->remoteSession));
+		if (m_server.isPooledSession(session)) {
+			m_server.qqIds.enqueue(session);
+		}
+	}
+	m_remoteUsers.erase(it);
+
+	MumbleProto::UserRemove mpur;
+	mpur.set_session(session);
+	m_server.sendAll(mpur);
+}
+
+void ClusterNode::removeRemoteUsers(const Peer &peer, qint64 refreshedBefore) {
+	QList< unsigned int > sessions;
+	for (auto it = m_remoteUsers.cbegin(); it != m_remoteUsers.cend(); ++it) {
+		if (it->peer == &peer && it->refreshed < refreshedBefore) {
+			sessions << it.key();
+		}
+	}
+
+	for (unsigned int session : sessions) {
+		removeRemoteUser(session);
+	}
+}
+
+ClusterProtocol::UserState ClusterNode::stateOf(const ServerUser &u) {
+	using Flag = ClusterProtocol::UserState::Flag;
+
+	ClusterProtocol::UserState state;
+	state.session = u.uiSession;
+	state.channel = u.cChannel ? u.cChannel->iId : 0;
+	state.userId  = u.iId;
+	state.name    = u.qsName;
+	state.flags   = (u.bMute ? Flag::Mute : 0u) | (u.bDeaf ? Flag::Deaf : 0u) | (u.bSuppress ? Flag::Suppress : 0u)
+				  | (u.bSelfMute ? Flag::SelfMute : 0u) | (u.bSelfDeaf ? Flag::SelfDeaf : 0u)
+				  | (u.bPrioritySpeaker ? Flag::PrioritySpeaker : 0u) | (u.bRecording ? Flag::Recording : 0u);
+
+	return state;
+}
+
+void ClusterNode::toMessage(const ClusterProtocol::UserState &state, MumbleProto::UserState &mpus) {
+	using Flag = ClusterProtocol::UserState::Flag;
+
+	mpus.set_session(state.session);
+	mpus.set_name(u8(state.name));
+	if (state.userId >= 0) {
+		mpus.set_user_id(static_cast< unsigned int >(state.userId));
+	}
+	mpus.set_channel_id(state.channel);
+	mpus.set_mute((state.flags & Flag::Mute) != 0);
+	mpus.set_deaf((state.flags & Flag::Deaf) != 0);
+	mpus.set_suppress((state.flags & Flag::Suppress) != 0);
+	mpus.set_self_mute((state.flags & Flag::SelfMute) != 0);
+	mpus.set_self_deaf((state.flags & Flag::SelfDeaf) != 0);
+	mpus.set_priority_speaker((state.flags & Flag::PrioritySpeaker) != 0);
+	mpus.set_recording((state.flags & Flag::Recording) != 0);
+}
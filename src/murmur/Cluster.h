@@ -0,0 +1,184 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CLUSTER_H_
+#define MUMBLE_MURMUR_CLUSTER_H_
+
+#include "ClusterProtocol.h"
+#include "Mumble.pb.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QTimer>
+#include <QtNetwork/QUdpSocket>
+
+#ifdef Q_OS_WIN
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class Server;
+class ServerUser;
+class User;
+
+/// Connects a virtual server to the same virtual server on the other nodes of a cluster (see MetaParams::clusterNode).
+/// All nodes share the database, so they know the same channels and registered users. What they tell each other
+/// about are the users connected to them, which the clients of every node see alongside the local ones, and the
+/// voice of these users.
+///
+/// Sessions are partitioned among the nodes (see ClusterProtocol::sessionNode), so that they are unique across the
+/// cluster. Every voice frame of a local user is relayed once to every other node, which then routes it to its own
+/// users (see Server::processRemoteVoice). The frames a voice thread relays to the same node are aggregated into as
+/// few datagrams as possible (see ClusterProtocol::VoiceBatch).
+///
+/// Relay links (see Server::qsRelayLinks) join a channel of this virtual server with a channel of another one, on
+/// this node or on any other. The users in a linked channel appear in the channel on the other side and what is
+/// said in there is heard on the other side as well. As the other virtual server hands out its sessions on its own,
+/// its users are given sessions of this virtual server.
+///
+/// Apart from relay() and flush(), which the voice threads call, everything happens on the main thread.
+class ClusterNode : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(ClusterNode)
+
+public:
+	/// How often the nodes tell each other that they are up
+	static constexpr int HELLO_INTERVAL_MSECS = 1000;
+	/// The time after which a node that hasn't been heard of is considered to be down
+	static constexpr int PEER_TIMEOUT_MSECS = 5000;
+	/// How often all local users are sent to the other nodes again, in case an update has been lost
+	static constexpr int RESYNC_INTERVAL_MSECS = 15000;
+
+	ClusterNode(Server &server, unsigned int nodeId, const QByteArray &secret);
+	~ClusterNode() override;
+
+	/// Parses the given peers (see MetaParams::clusterPeers) and relay links and binds the socket
+	/// @returns Whether the node is ready to be used. Problems are logged.
+	bool start(const QString &peers, const QString &relayLinks, unsigned short basePort);
+
+	unsigned int nodeId() const { return m_nodeId; }
+
+	/// Sends the users of the other nodes to the given user, which is just being synchronized
+	void sendRemoteUsers(ServerUser *u);
+	/// @returns Whether the given session has been given to a user of another node or virtual server
+	bool isRemoteUser(unsigned int session) const { return m_remoteUsers.contains(session); }
+
+	/// Adds the given voice frame of a local user to the batches of all peers that are up and that are meant to hear
+	/// it. Batches that are full are sent right away. This may be called by any thread, as long as every thread uses
+	/// batches of its own.
+	void relay(const ClusterProtocol::Voice &voice, std::vector< ClusterProtocol::VoiceBatch > &batches);
+	/// Sends all batches that aren't empty
+	void flush(std::vector< ClusterProtocol::VoiceBatch > &batches);
+
+protected:
+	struct Peer {
+		/// The peer's index in m_peers, which is also the index of its batch (see relay())
+		std::size_t index;
+		unsigned int node;
+		/// The virtual server on that node. It is this one's number, unless the peer is on the other end of a relay
+		/// link.
+		unsigned int server;
+		/// The channels that are linked with the peer's, if it is on the other end of a relay link
+		struct Link {
+			unsigned int local;
+			unsigned int remote;
+		};
+		std::vector< Link > links;
+		sockaddr_storage address;
+		socklen_t addressLength;
+		/// Read by the voice threads (see relay())
+		std::atomic< bool > alive{ false };
+		quint64 bootId  = 0;
+		qint64 lastSeen = 0;
+		/// The datagrams that have been received from the peer
+		ClusterProtocol::ReplayWindow replay;
+		/// The local users the peer has been told about, if it is on the other end of a relay link
+		QSet< unsigned int > announced;
+
+		bool isRelayLink() const { return !links.empty(); }
+	};
+
+	struct RemoteUser {
+		/// The state of the user as it is known here, which means that the session and the channel are ours
+		ClusterProtocol::UserState state;
+		/// When the peer the user is connected to has last told us about it
+		qint64 refreshed;
+		const Peer *peer;
+		/// The session of the user on its own virtual server
+		unsigned int remoteSession;
+	};
+
+	Server &m_server;
+	const unsigned int m_nodeId;
+	/// Also the salt of the cipher, which is why it has to be initialized first
+	const quint64 m_bootId;
+	ClusterProtocol::Cipher m_cipher;
+	QUdpSocket m_socket;
+	/// Whether the socket is an IPv6 one, in which case IPv4 peers are addressed as IPv4-mapped IPv6 addresses
+	bool m_ipv6 = false;
+	QTimer m_helloTimer;
+	QElapsedTimer m_clock;
+	qint64 m_lastResync = 0;
+	/// Never changed once start() has succeeded, which is what allows relay() to use it from any thread
+	std::vector< std::unique_ptr< Peer > > m_peers;
+	/// The users of the other nodes and virtual servers, by their session here
+	QHash< unsigned int, RemoteUser > m_remoteUsers;
+	/// The sessions the users behind relay links have been given here, by bridgeKey()
+	QHash< quint64, unsigned int > m_bridgedSessions;
+
+	static quint64 bridgeKey(const Peer &peer, unsigned int remoteSession) {
+		return (static_cast< quint64 >(peer.index) << 32) | remoteSession;
+	}
+
+	Peer *peer(unsigned int node, unsigned int server) const;
+	/// Adds a peer for the given virtual server on the given host
+	/// @returns The peer or nullptr if it can't be reached
+	Peer *addPeer(unsigned int node, unsigned int server, const QHostAddress &host, int port);
+
+	/// Sends the given sealed datagram to the given peer. This may be called by any thread.
+	void sendDatagram(const unsigned char *datagram, std::size_t length, const Peer &target) const;
+	/// Sends the given message to the given peer or, if there isn't one, to all peers that are up and that aren't on
+	/// the other end of a relay link
+	template< typename Message >
+	void send(ClusterProtocol::MessageType type, const Message &message, const Peer *target = nullptr);
+	/// Seals the given batch, sends it to the given peer and clears it
+	void sendBatch(ClusterProtocol::VoiceBatch &batch, const Peer &target);
+
+	void sendHello();
+	/// Sends all authenticated local users the given peer is meant to know about to it
+	void sendUsers(Peer &target);
+	/// Tells the given peer on the other end of a relay link about the given user (if it is in a linked channel) or
+	/// that the user is gone (if it isn't anymore)
+	void announce(Peer &target, const ServerUser &u);
+	void readDatagrams();
+	void handle(unsigned char *datagram, std::size_t length);
+
+	void userConnected(const User *user);
+	void userStateChanged(const User *user);
+	void userDisconnected(const User *user);
+
+	void updateRemoteUser(const Peer &peer, const ClusterProtocol::UserState &state);
+	void removeRemoteUser(unsigned int session);
+	/// Removes the users of the given peer, which has gone down or restarted
+	void removeRemoteUsers(const Peer &peer, qint64 refreshedBefore);
+	/// @returns The session the given user of the given peer has here or 0 if it isn't known
+	unsigned int localSession(const Peer &peer, unsigned int remoteSession) const;
+
+	static ClusterProtocol::UserState stateOf(const ServerUser &u);
+	static void toMessage(const ClusterProtocol::UserState &state, MumbleProto::UserState &mpus);
+};
+
+#endif // MUMBLE_MURMUR_CLUSTER_H_
@@ -0,0 +1,342 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ClusterProtocol.h"
+
+#include "PacketDataStream.h"
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QtEndian>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace ClusterProtocol {
+
+namespace {
+	using CipherContext = std::unique_ptr< EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free) >;
+	using IV            = std::array< unsigned char, 12 >;
+
+	/// Tells the keys of the senders apart from anything else that might ever be derived from the secret
+	constexpr char KEY_LABEL[]           = "Mumble cluster sender key";
+	constexpr std::size_t KEY_LABEL_SIZE = sizeof(KEY_LABEL) - 1;
+
+	void writeKeyID(unsigned char *out, const std::tuple< unsigned int, unsigned int, std::uint64_t > &id) {
+		qToBigEndian< quint32 >(std::get< 0 >(id), out);
+		qToBigEndian< quint32 >(std::get< 1 >(id), out + 4);
+		qToBigEndian< quint64 >(std::get< 2 >(id), out + 8);
+	}
+
+	std::tuple< unsigned int, unsigned int, std::uint64_t > readKeyID(const unsigned char *in) {
+		return std::make_tuple(qFromBigEndian< quint32 >(in), qFromBigEndian< quint32 >(in + 4),
+							   qFromBigEndian< quint64 >(in + 8));
+	}
+
+	/// @returns The GCM nonce of the given counter. Every key only ever seals with its own counter, so the rest of the
+	/// 	nonce can be zero.
+	IV ivOf(const unsigned char *counter) {
+		IV iv = {};
+		memcpy(iv.data() + iv.size() - COUNTER_SIZE, counter, COUNTER_SIZE);
+		return iv;
+	}
+} // namespace
+
+void write(PacketDataStream &stream, const Header &header) {
+	stream << VERSION << static_cast< unsigned int >(header.type) << header.node << header.server;
+}
+
+void write(PacketDataStream &stream, const Hello &hello) {
+	stream << hello.bootId;
+}
+
+void write(PacketDataStream &stream, const UserState &state) {
+	stream << state.session << state.channel << state.userId << state.name << state.flags;
+}
+
+void write(PacketDataStream &stream, const UserRemove &remove) {
+	stream << remove.session;
+}
+
+void write(PacketDataStream &stream, const Voice &voice) {
+	stream << voice.session << static_cast< unsigned int >(voice.codec) << voice.frameNumber << voice.isLastFrame;
+
+	stream << static_cast< unsigned int >(voice.channelCount);
+	for (std::size_t i = 0; i < voice.channelCount; ++i) {
+		stream << voice.channels[i];
+	}
+
+	stream << static_cast< unsigned int >(voice.payload.size());
+	stream.append(reinterpret_cast< const char * >(voice.payload.data()), static_cast< quint32 >(voice.payload.size()));
+}
+
+bool append(VoiceBatch &batch, const Header &header, const Voice &voice) {
+	const std::size_t capacity = batch.datagram.size() - OVERHEAD;
+
+	PacketDataStream stream(batch.datagram.data() + batch.length, static_cast< unsigned int >(capacity - batch.length));
+	if (batch.empty()) {
+		write(stream, header);
+	}
+	write(stream, voice);
+
+	if (!stream.isValid()) {
+		// Whatever has been written beyond the batch's length is simply overwritten by the next frame
+		return false;
+	}
+
+	batch.length += stream.size();
+	return true;
+}
+
+bool read(PacketDataStream &stream, Header &header) {
+	unsigned int version = 0;
+	unsigned int type    = 0;
+	stream >> version >> type >> header.node >> header.server;
+
+	header.type = static_cast< MessageType >(type);
+	return stream.isValid() && version == VERSION && header.node > 0 && header.node < MAX_NODES;
+}
+
+bool read(PacketDataStream &stream, Hello &hello) {
+	stream >> hello.bootId;
+
+	return stream.isValid();
+}
+
+bool read(PacketDataStream &stream, UserState &state) {
+	stream >> state.session >> state.channel >> state.userId >> state.name >> state.flags;
+
+	return stream.isValid();
+}
+
+bool read(PacketDataStream &stream, UserRemove &remove) {
+	stream >> remove.session;
+
+	return stream.isValid();
+}
+
+bool read(PacketDataStream &stream, Voice &voice) {
+	unsigned int codec = 0;
+	stream >> voice.session >> codec >> voice.frameNumber >> voice.isLastFrame;
+	if (codec > static_cast< unsigned int >(Mumble::Protocol::AudioCodec::Speex)) {
+		return false;
+	}
+	voice.codec = static_cast< Mumble::Protocol::AudioCodec >(codec);
+
+	unsigned int channelCount = 0;
+	stream >> channelCount;
+	if (channelCount > MAX_VOICE_CHANNELS) {
+		return false;
+	}
+	voice.channelCount = channelCount;
+	for (std::size_t i = 0; i < voice.channelCount; ++i) {
+		stream >> voice.channels[i];
+	}
+
+	unsigned int payloadSize = 0;
+	stream >> payloadSize;
+	if (!stream.isValid() || payloadSize > stream.left()) {
+		return false;
+	}
+	voice.payload = gsl::span< const Mumble::Protocol::byte >(stream.dataPtr(), payloadSize);
+	stream.skip(payloadSize);
+
+	return stream.isValid();
+}
+
+Cipher::Cipher(const QByteArray &secret, unsigned int node, unsigned int server, std::uint64_t salt) {
+	// HKDF-Extract without a salt, for which RFC 5869 uses a string of zeros
+	const Key zeros     = {};
+	unsigned int length = 0;
+	HMAC(EVP_sha256(), zeros.data(), static_cast< int >(zeros.size()),
+		 reinterpret_cast< const unsigned char * >(secret.constData()), static_cast< std::size_t >(secret.size()),
+		 m_prk.data(), &length);
+
+	const KeyID id(node, server, salt);
+	writeKeyID(m_keyId.data(), id);
+	m_key = deriveKey(id);
+}
+
+Cipher::Key Cipher::deriveKey(const KeyID &id) const {
+	// HKDF-Expand, of which the first block already is as long as the key
+	std::array< unsigned char, KEY_LABEL_SIZE + KEY_ID_SIZE + 1 > info;
+	memcpy(info.data(), KEY_LABEL, KEY_LABEL_SIZE);
+	writeKeyID(info.data() + KEY_LABEL_SIZE, id);
+	info.back() = 1;
+
+	Key key;
+	unsigned int length = 0;
+	HMAC(EVP_sha256(), m_prk.data(), static_cast< int >(m_prk.size()), info.data(), info.size(), key.data(), &length);
+
+	return key;
+}
+
+std::size_t Cipher::seal(unsigned char *datagram, std::size_t length, std::size_t capacity) {
+	if (length + OVERHEAD > capacity) {
+		return 0;
+	}
+
+	unsigned char *keyId   = datagram + length;
+	unsigned char *counter = keyId + KEY_ID_SIZE;
+	unsigned char *tag     = counter + COUNTER_SIZE;
+	memcpy(keyId, m_keyId.data(), KEY_ID_SIZE);
+	qToBigEndian< quint64 >(m_counter.fetch_add(1, std::memory_order_relaxed), counter);
+	const IV iv = ivOf(counter);
+
+	CipherContext ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+	int outlen = 0;
+	if (!ctx || EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr, m_key.data(), iv.data()) != 1
+		|| EVP_EncryptUpdate(ctx.get(), datagram, &outlen, datagram, static_cast< int >(length)) != 1
+		|| EVP_EncryptFinal_ex(ctx.get(), datagram + outlen, &outlen) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_GET_TAG, TAG_SIZE, tag) != 1) {
+		return 0;
+	}
+
+	return length + OVERHEAD;
+}
+
+std::size_t Cipher::open(unsigned char *datagram, std::size_t length, Nonce *nonce) const {
+	if (length <= OVERHEAD) {
+		return 0;
+	}
+
+	const std::size_t plainLength = length - OVERHEAD;
+	const unsigned char *keyId    = datagram + plainLength;
+	const unsigned char *counter  = keyId + KEY_ID_SIZE;
+	// OpenSSL doesn't modify the tag it is given for verification
+	unsigned char *tag = datagram + plainLength + KEY_ID_SIZE + COUNTER_SIZE;
+
+	const KeyID id = readKeyID(keyId);
+	if (nonce) {
+		nonce->salt    = std::get< 2 >(id);
+		nonce->counter = qFromBigEndian< quint64 >(counter);
+		nonce->node    = std::get< 0 >(id);
+		nonce->server  = std::get< 1 >(id);
+	}
+
+	Key key;
+	bool cached = false;
+	{
+		QMutexLocker l(&m_keysMutex);
+		auto it = m_keys.find(id);
+		if (it != m_keys.end()) {
+			key    = it->second;
+			cached = true;
+		}
+	}
+	if (!cached) {
+		key = deriveKey(id);
+	}
+
+	const IV iv = ivOf(counter);
+	CipherContext ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+	int outlen = 0;
+	if (!ctx || EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr, key.data(), iv.data()) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_AEAD_SET_TAG, TAG_SIZE, tag) != 1
+		|| EVP_DecryptUpdate(ctx.get(), datagram, &outlen, datagram, static_cast< int >(plainLength)) != 1
+		|| EVP_DecryptFinal_ex(ctx.get(), datagram + outlen, &outlen) != 1) {
+		return 0;
+	}
+
+	if (!cached) {
+		// Only the keys of datagrams that could be opened are remembered, so that made up key IDs can't fill the cache
+		QMutexLocker l(&m_keysMutex);
+		if (m_keys.size() >= MAX_CACHED_KEYS) {
+			m_keys.clear();
+		}
+		m_keys.emplace(id, key);
+	}
+
+	return plainLength;
+}
+
+bool ReplayWindow::start(std::uint64_t salt, quint64 bootId) {
+	if (salt == m_salt && bootId == m_bootId) {
+		return true;
+	}
+	if (isRetired(salt)) {
+		return false;
+	}
+
+	if (m_bootId == 0 && salt == m_salt) {
+		// The peer's first Hello, which has been preceded by other datagrams
+		m_bootId = bootId;
+		return true;
+	}
+
+	retire();
+	resetCounters(salt);
+	m_bootId = bootId;
+
+	return true;
+}
+
+bool ReplayWindow::accept(const Nonce &nonce) {
+	if (nonce.salt != m_salt) {
+		if (m_bootId != 0 || isRetired(nonce.salt)) {
+			// Only a Hello may start a new run
+			return false;
+		}
+
+		// The peer has restarted before it has sent a Hello
+		retire();
+		resetCounters(nonce.salt);
+	}
+
+	if (!m_started || nonce.counter > m_latest) {
+		// The counters that drop out of the window share their bits with the new ones
+		const std::uint64_t advance = m_started ? nonce.counter - m_latest : REPLAY_WINDOW;
+		if (advance >= REPLAY_WINDOW) {
+			m_received.reset();
+		} else {
+			for (std::uint64_t i = 1; i <= advance; ++i) {
+				m_received.reset((m_latest + i) % REPLAY_WINDOW);
+			}
+		}
+
+		m_started = true;
+		m_latest  = nonce.counter;
+		m_received.set(nonce.counter % REPLAY_WINDOW);
+		return true;
+	}
+
+	if (m_latest - nonce.counter >= REPLAY_WINDOW || m_received.test(nonce.counter % REPLAY_WINDOW)) {
+		return false;
+	}
+
+	m_received.set(nonce.counter % REPLAY_WINDOW);
+	return true;
+}
+
+bool ReplayWindow::isRetired(std::uint64_t salt) const {
+	const std::size_t count = std::min(m_retiredCount, RETIRED_RUNS);
+	for (std::size_t i = 0; i < count; ++i) {
+		if (m_retired[i] == salt) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ReplayWindow::retire() {
+	if (m_bootId != 0 || m_started) {
+		m_retired[m_retiredCount % RETIRED_RUNS] = m_salt;
+		m_retiredCount++;
+	}
+}
+
+void ReplayWindow::resetCounters(std::uint64_t salt) {
+	m_salt    = salt;
+	m_bootId  = 0;
+	m_started = false;
+	m_latest  = 0;
+	m_received.reset();
+}
+
+} // namespace ClusterProtocol
@@ -0,0 +1,249 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CLUSTERPROTOCOL_H_
+#define MUMBLE_MURMUR_CLUSTERPROTOCOL_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+
+class PacketDataStream;
+
+/// The datagrams the nodes of a cluster (see ClusterNode) exchange. Every datagram starts with a header (protocol
+/// version, message type, the ID of the sending node and the virtual server it has been sent by) followed by the
+/// message itself, all encoded with a PacketDataStream. The datagram is then encrypted with AES-256-GCM using a key
+/// that is derived from the cluster's shared secret (see MetaParams::qsClusterSecret) for every run of every sender
+/// (see Cipher). Datagrams that can't be decrypted are dropped, and so are the ones that have been received before
+/// (see ReplayWindow).
+namespace ClusterProtocol {
+
+static constexpr unsigned int VERSION = 2;
+/// Node IDs range from 1 to MAX_NODES - 1. Sessions are partitioned among the nodes with it (see sessionNode).
+static constexpr unsigned int MAX_NODES = 16;
+/// The node, the virtual server and the salt of the sender, which select the key a datagram has been sealed with
+static constexpr std::size_t KEY_ID_SIZE  = 16;
+static constexpr std::size_t COUNTER_SIZE = 8;
+static constexpr std::size_t TAG_SIZE     = 16;
+/// The number of bytes sealing adds to a datagram (see Cipher::seal)
+static constexpr std::size_t OVERHEAD = KEY_ID_SIZE + COUNTER_SIZE + TAG_SIZE;
+/// The largest datagram that is ever sent (or accepted)
+static constexpr std::size_t MAX_DATAGRAM_SIZE = 2048;
+/// The number of datagrams preceding the latest one of a peer that are still accepted if they arrive late
+static constexpr std::size_t REPLAY_WINDOW = 1024;
+/// The number of runs of a peer whose datagrams are refused once the peer has restarted (see ReplayWindow)
+static constexpr std::size_t RETIRED_RUNS = 8;
+/// The maximum amount of channels a relayed voice frame is addressed to (its channel and the linked ones)
+static constexpr std::size_t MAX_VOICE_CHANNELS = 64;
+
+enum class MessageType : unsigned int {
+	/// Sent once a second to every peer, which is how the nodes find out which of them are up
+	Hello = 1,
+	/// A user connected to the sending node has joined or changed
+	UserState = 2,
+	/// A user connected to the sending node has left
+	UserRemove = 3,
+	/// One or more voice frames (see VoiceBatch), each of which starts with the session of its speaker
+	Voice = 4,
+};
+
+struct Header {
+	MessageType type;
+	unsigned int node;
+	/// The number of the virtual server that has sent the datagram. It only differs from the receiving one's across
+	/// relay links (see ClusterNode).
+	unsigned int server;
+};
+
+struct Hello {
+	/// A random number that is chosen whenever the node starts. A node whose boot ID changes has lost its state,
+	/// which means that it has to be told about all users again.
+	quint64 bootId = 0;
+};
+
+struct UserState {
+	enum Flag : unsigned int {
+		Mute            = 0x01,
+		Deaf            = 0x02,
+		Suppress        = 0x04,
+		SelfMute        = 0x08,
+		SelfDeaf        = 0x10,
+		PrioritySpeaker = 0x20,
+		Recording       = 0x40,
+	};
+
+	unsigned int session = 0;
+	unsigned int channel = 0;
+	int userId           = -1;
+	QString name;
+	unsigned int flags = 0;
+};
+
+struct UserRemove {
+	unsigned int session = 0;
+};
+
+struct Voice {
+	unsigned int session = 0;
+	Mumble::Protocol::AudioCodec codec = Mumble::Protocol::AudioCodec::Opus;
+	quint64 frameNumber                = 0;
+	bool isLastFrame                   = false;
+	/// The channels (of the receiving virtual server) whose users and listeners receive the frame
+	std::array< unsigned int, MAX_VOICE_CHANNELS > channels;
+	std::size_t channelCount = 0;
+	/// The encoded audio. When decoding, this points into the datagram.
+	gsl::span< const Mumble::Protocol::byte > payload;
+};
+
+/// Collects voice frames that are sent to the same peer, so that they can be sent (and sealed) as one datagram
+struct VoiceBatch {
+	std::array< unsigned char, MAX_DATAGRAM_SIZE > datagram;
+	/// The number of bytes that have been written to the datagram. 0 if there are no frames in it.
+	std::size_t length = 0;
+
+	bool empty() const { return length == 0; }
+	void clear() { length = 0; }
+};
+
+/// @returns The node the given session belongs to
+inline unsigned int sessionNode(unsigned int session) {
+	return session % MAX_NODES;
+}
+
+void write(PacketDataStream &stream, const Header &header);
+void write(PacketDataStream &stream, const Hello &hello);
+void write(PacketDataStream &stream, const UserState &state);
+void write(PacketDataStream &stream, const UserRemove &remove);
+void write(PacketDataStream &stream, const Voice &voice);
+
+/// Adds the given frame to the batch, which is started with the given header if it is empty
+/// @returns Whether the frame fits into the batch. If it doesn't, the batch has to be sent first.
+bool append(VoiceBatch &batch, const Header &header, const Voice &voice);
+
+/// @returns Whether a header of a known version could be read
+bool read(PacketDataStream &stream, Header &header);
+bool read(PacketDataStream &stream, Hello &hello);
+bool read(PacketDataStream &stream, UserState &state);
+bool read(PacketDataStream &stream, UserRemove &remove);
+/// Reads the next frame of a Voice message. The stream is exhausted once the last frame has been read.
+bool read(PacketDataStream &stream, Voice &voice);
+
+/// The nonce a datagram has been sealed with, along with the sender it has been sealed by
+struct Nonce {
+	/// Chosen randomly whenever the sender starts (see Cipher), which means that it tells the runs of a node apart
+	std::uint64_t salt = 0;
+	/// Incremented for every datagram the sender seals
+	std::uint64_t counter = 0;
+	unsigned int node     = 0;
+	unsigned int server   = 0;
+};
+
+/// Encrypts and authenticates datagrams with AES-256-GCM. A datagram is sealed once, no matter how many frames it
+/// carries and how many users are going to receive them.
+///
+/// Every sender, i.e. every run of a virtual server on a node, seals with a key of its own, which is derived from the
+/// cluster's secret, the node, the virtual server and the salt of the run with HKDF-SHA256. The key ID (the node, the
+/// virtual server and the salt) is sent along with every datagram, so that the receivers can derive the same key.
+/// The nonces only have to be unique for a single key, which the counter of the sender takes care of. Nodes that
+/// happen to choose the same salt still use different keys.
+///
+/// seal() only uses an atomic counter and open() a locked cache of the keys it has derived, so both may be called by
+/// several threads at once.
+class Cipher {
+public:
+	/// @param salt Tells the runs of the sending node apart, which is why it has to be chosen randomly whenever the
+	/// 	node starts (e.g. the node's boot ID)
+	Cipher(const QByteArray &secret, unsigned int node, unsigned int server, std::uint64_t salt);
+
+	/// Encrypts the given datagram in place and appends the key ID, the counter and the tag to it
+	///
+	/// @param capacity The size of the buffer the datagram is stored in
+	/// @returns The length of the sealed datagram or 0 if there is no room for the OVERHEAD
+	std::size_t seal(unsigned char *datagram, std::size_t length, std::size_t capacity);
+	/// Decrypts the given sealed datagram in place
+	///
+	/// @param[out] nonce If non-null, receives the nonce and the sender the datagram has been sealed with, which are
+	/// 	only authentic if the datagram could be decrypted
+	/// @returns The length of the decrypted datagram or 0 if it can't be decrypted
+	std::size_t open(unsigned char *datagram, std::size_t length, Nonce *nonce = nullptr) const;
+
+	/// The number of keys of other senders open() remembers. Once there are more, it starts over.
+	static constexpr std::size_t MAX_CACHED_KEYS = 256;
+
+protected:
+	using Key   = std::array< unsigned char, 32 >;
+	using KeyID = std::tuple< unsigned int, unsigned int, std::uint64_t >;
+
+	/// The pseudorandom key HKDF extracts from the secret, from which the keys of all senders are expanded
+	Key m_prk;
+	/// The key this sender seals with
+	Key m_key;
+	std::array< unsigned char, KEY_ID_SIZE > m_keyId;
+	std::atomic< std::uint64_t > m_counter{ 0 };
+
+	/// The keys of the senders whose datagrams have been opened
+	mutable QMutex m_keysMutex;
+	mutable std::map< KeyID, Key > m_keys;
+
+	Key deriveKey(const KeyID &id) const;
+};
+
+/// Remembers which datagrams of a peer have been received, so that an attacker can't replay any of them. Authentic
+/// datagrams can't be forged without the secret, but they can be recorded and sent again.
+///
+/// The nonces of a run of the peer share its salt and their counters increase (see Cipher::seal), so only the most
+/// recent REPLAY_WINDOW counters have to be remembered. Datagrams that are older than that are refused. A run starts
+/// with the first Hello of a new boot ID (see start()), and the previous runs are retired: their datagrams (including
+/// their Hellos, which would pretend that the peer has restarted again) are refused from then on.
+///
+/// This class isn't thread-safe.
+class ReplayWindow {
+public:
+	/// Starts a new run (forgetting about the received counters) if the given salt and boot ID are a run's that isn't
+	/// known yet. The datagrams that have been received before the run's first Hello count towards it, if they share
+	/// its salt.
+	///
+	/// @returns Whether the given run is the current one (which it is after starting it) rather than a retired one
+	bool start(std::uint64_t salt, quint64 bootId);
+	/// Records the given counter as received
+	///
+	/// @returns Whether the datagram with the given nonce may be processed, which is only the case if it belongs to the
+	/// 	current run (or to the first one, if there hasn't been a Hello yet), hasn't been received before and isn't
+	/// 	too old
+	bool accept(const Nonce &nonce);
+
+protected:
+	std::uint64_t m_salt = 0;
+	/// The boot ID of the current run or 0 if the peer hasn't sent a Hello yet
+	quint64 m_bootId = 0;
+	/// Whether any counter has been accepted for the current salt
+	bool m_started = false;
+	std::uint64_t m_latest = 0;
+	/// Whether the counters in the window have been received, indexed by the counter modulo REPLAY_WINDOW
+	std::bitset< REPLAY_WINDOW > m_received;
+	/// The salts of the retired runs, the oldest of which is replaced first
+	std::array< std::uint64_t, RETIRED_RUNS > m_retired{};
+	std::size_t m_retiredCount = 0;
+
+	bool isRetired(std::uint64_t salt) const;
+	/// Adds the current run (if there is one) to the retired ones
+	void retire();
+	/// Starts over with a run of the given salt whose boot ID isn't known yet
+	void resetCounters(std::uint64_t salt);
+};
+
+} // namespace ClusterProtocol
+
+#endif // MUMBLE_MURMUR_CLUSTERPROTOCOL_H_
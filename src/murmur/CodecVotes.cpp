@@ -0,0 +1,68 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "CodecVotes.h"
+
+void CodecVotes::add(unsigned int session, const QList< int > &celtVersions, bool opus) {
+	remove(session);
+
+	if (celtVersions.isEmpty() && !opus) {
+		return;
+	}
+
+	m_votes.insert(session, { celtVersions, opus });
+
+	if (opus) {
+		m_opusUsers++;
+	}
+	for (int version : celtVersions) {
+		m_celtUsers[version]++;
+	}
+}
+
+bool CodecVotes::remove(unsigned int session) {
+	auto it = m_votes.find(session);
+	if (it == m_votes.end()) {
+		return false;
+	}
+
+	if (it->opus) {
+		m_opusUsers--;
+	}
+	for (int version : it->celtVersions) {
+		auto count = m_celtUsers.find(version);
+		if (--count.value() == 0) {
+			m_celtUsers.erase(count);
+		}
+	}
+
+	m_votes.erase(it);
+	return true;
+}
+
+int CodecVotes::voters() const {
+	return m_votes.size();
+}
+
+int CodecVotes::opusPercentage() const {
+	return m_votes.isEmpty() ? 0 : m_opusUsers * 100 / m_votes.size();
+}
+
+int CodecVotes::preferredCeltVersion() const {
+	int version       = 0;
+	int maximum_users = 0;
+
+	// Going from the highest version down makes the highest one win a tie
+	auto it = m_celtUsers.constEnd();
+	while (it != m_celtUsers.constBegin()) {
+		--it;
+		if (it.value() > maximum_users) {
+			version       = it.key();
+			maximum_users = it.value();
+		}
+	}
+
+	return version;
+}
@@ -0,0 +1,48 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CODECVOTES_H_
+#define MUMBLE_MURMUR_CODECVOTES_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QtGlobal>
+
+/// Counts which codecs the users support (see Server::recheckCodecVersions()). The counts are updated whenever a user
+/// is added or removed, so that finding the codecs most users support doesn't have to look at every user.
+///
+/// This class isn't thread-safe. Server only uses it from the main thread.
+class CodecVotes {
+public:
+	/// Counts the codecs of the user with the given session, replacing the ones counted for it before. A user that
+	/// supports neither CELT nor Opus isn't counted at all.
+	void add(unsigned int session, const QList< int > &celtVersions, bool opus);
+	/// Stops counting the codecs of the user with the given session
+	///
+	/// @returns Whether the user's codecs had been counted
+	bool remove(unsigned int session);
+
+	/// @returns The number of users that are counted
+	int voters() const;
+	/// @returns The share of the counted users that support Opus (in percent), 0 if there are none
+	int opusPercentage() const;
+	/// @returns The CELT version most users support (the highest one if several are supported by as many users) or
+	/// 	0 if no user supports CELT
+	int preferredCeltVersion() const;
+
+protected:
+	struct Vote {
+		QList< int > celtVersions;
+		bool opus;
+	};
+
+	QHash< unsigned int, Vote > m_votes;
+	/// The number of users that support each CELT version
+	QMap< int, int > m_celtUsers;
+	int m_opusUsers = 0;
+};
+
+#endif // MUMBLE_MURMUR_CODECVOTES_H_
@@ -0,0 +1,139 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ConnectionThrottle.h"
+
+#include "crypto/CryptographicRandom.h"
+
+#include <algorithm>
+#include <chrono>
+
+ConnectionThrottle::ConnectionThrottle(std::size_t capacity) : m_size(0), m_seed(CryptographicRandom::uint32()) {
+	// The number of sets is a power of two, so that the set of an address is selected by masking its hash
+	std::size_t sets = 1;
+	while (sets * WAYS < capacity) {
+		sets *= 2;
+	}
+	m_sets.resize(sets);
+}
+
+ConnectionThrottle::Verdict ConnectionThrottle::attempt(const HostAddress &address, unsigned int tries,
+														quint64 timeframeUsecs, quint64 banUsecs) {
+	const quint64 time = now();
+	Entry &entry       = claim(address, time);
+
+	if (entry.bannedUntil != 0) {
+		if (time < entry.bannedUntil) {
+			return Verdict::Banned;
+		}
+
+		entry.bannedUntil      = 0;
+		entry.previousAttempts = 0;
+		entry.currentAttempts  = 0;
+		entry.windowStart      = time;
+	}
+
+	if (timeframeUsecs == 0) {
+		return Verdict::Allowed;
+	}
+
+	const quint64 sinceStart = time - entry.windowStart;
+	if (sinceStart >= timeframeUsecs) {
+		// Only the timeframe right before the current one overlaps with the last timeframe
+		entry.previousAttempts = (sinceStart < 2 * timeframeUsecs) ? entry.currentAttempts : 0;
+		entry.currentAttempts  = 0;
+		entry.windowStart      = time - sinceStart % timeframeUsecs;
+	}
+	entry.currentAttempts++;
+
+	const quint64 overlap  = timeframeUsecs - (time - entry.windowStart);
+	const quint64 attempts = static_cast< quint64 >(entry.previousAttempts) * overlap / timeframeUsecs
+							 + entry.currentAttempts;
+	if (attempts > tries) {
+		entry.bannedUntil = time + std::max< quint64 >(banUsecs, 1);
+		return Verdict::NewlyBanned;
+	}
+
+	return Verdict::Allowed;
+}
+
+void ConnectionThrottle::forgive(const HostAddress &address) {
+	for (Entry &entry : setOf(address)) {
+		if (entry.used && entry.address == address) {
+			if (entry.bannedUntil == 0) {
+				entry.previousAttempts = 0;
+				entry.currentAttempts  = 0;
+			}
+			return;
+		}
+	}
+}
+
+std::size_t ConnectionThrottle::size() const {
+	return m_size;
+}
+
+std::size_t ConnectionThrottle::capacity() const {
+	return m_sets.size() * WAYS;
+}
+
+quint64 ConnectionThrottle::now() const {
+	return static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+std::array< ConnectionThrottle::Entry, ConnectionThrottle::WAYS > &
+	ConnectionThrottle::setOf(const HostAddress &address) {
+	// The seed keeps others from picking addresses that all end up in the same set
+	quint32 hash = qHash(address) ^ m_seed;
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3Bu;
+	hash ^= hash >> 16;
+
+	return m_sets[hash & (m_sets.size() - 1)];
+}
+
+ConnectionThrottle::Entry &ConnectionThrottle::claim(const HostAddress &address, quint64 time) {
+	std::array< Entry, WAYS > &set = setOf(address);
+
+	Entry *victim = nullptr;
+	for (Entry &entry : set) {
+		if (!entry.used) {
+			if (!victim || victim->used) {
+				victim = &entry;
+			}
+			continue;
+		}
+		if (entry.address == address) {
+			entry.lastSeen = time;
+			return entry;
+		}
+
+		if (victim && !victim->used) {
+			continue;
+		}
+
+		// Bans that are still in effect are only replaced if every entry of the set is banned
+		const bool banned       = entry.bannedUntil > time;
+		const bool victimBanned = victim && victim->bannedUntil > time;
+		if (!victim || (victimBanned && !banned) || (banned == victimBanned && entry.lastSeen < victim->lastSeen)) {
+			victim = &entry;
+		}
+	}
+
+	if (!victim->used) {
+		m_size++;
+	}
+
+	*victim          = Entry();
+	victim->address  = address;
+	victim->used     = true;
+	victim->lastSeen = time;
+	// The first timeframe starts with the first attempt
+	victim->windowStart = time;
+
+	return *victim;
+}
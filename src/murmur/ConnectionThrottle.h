@@ -0,0 +1,81 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_CONNECTIONTHROTTLE_H_
+#define MUMBLE_MURMUR_CONNECTIONTHROTTLE_H_
+
+#include "HostAddress.h"
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/// Tracks the connection attempts per address for the autoban (see MetaParams::iBanTries), using a fixed amount of
+/// memory no matter how many addresses connect. The addresses are kept in a set-associative table: every address
+/// hashes to a set of WAYS entries, and if all of them are taken, the entry that has been used least recently is
+/// replaced (preferring entries that aren't banned).
+///
+/// Every entry counts the attempts in the current and in the previous timeframe. The attempts within the last
+/// timeframe are estimated by weighing the previous count by how much of the previous timeframe still overlaps with
+/// the last timeframe, so an entry takes constant space instead of one timer per attempt.
+class ConnectionThrottle {
+public:
+	enum class Verdict {
+		/// The connection may proceed
+		Allowed,
+		/// The address has been banned before
+		Banned,
+		/// The address has exceeded the allowed number of attempts with this one
+		NewlyBanned,
+	};
+
+	static constexpr std::size_t WAYS = 8;
+
+	/// @param capacity The number of addresses that can be tracked at once
+	explicit ConnectionThrottle(std::size_t capacity = 65536);
+	virtual ~ConnectionThrottle() = default;
+
+	/// Records a connection attempt from the given address
+	///
+	/// @param tries The number of attempts that are allowed within the timeframe
+	/// @param timeframeUsecs The timeframe in microseconds
+	/// @param banUsecs For how long an address that exceeds the attempts is banned in microseconds
+	Verdict attempt(const HostAddress &address, unsigned int tries, quint64 timeframeUsecs, quint64 banUsecs);
+	/// Forgets about the attempts of the given address (unless it is banned)
+	void forgive(const HostAddress &address);
+
+	/// @returns The number of addresses that are tracked
+	std::size_t size() const;
+	/// @returns The number of addresses that can be tracked at once
+	std::size_t capacity() const;
+
+protected:
+	struct Entry {
+		HostAddress address;
+		bool used = false;
+		/// The time the current timeframe has started at
+		quint64 windowStart = 0;
+		quint32 previousAttempts = 0;
+		quint32 currentAttempts  = 0;
+		/// The time until which the address is banned or 0 if it isn't
+		quint64 bannedUntil = 0;
+		quint64 lastSeen    = 0;
+	};
+
+	std::vector< std::array< Entry, WAYS > > m_sets;
+	std::size_t m_size;
+	quint32 m_seed;
+
+	/// @returns The current time in microseconds, which only has to be monotonic
+	virtual quint64 now() const;
+
+	std::array< Entry, WAYS > &setOf(const HostAddress &address);
+	/// @returns The entry of the given address, which is created (replacing another one if needed) if there isn't one
+	Entry &claim(const HostAddress &address, quint64 time);
+};
+
+#endif // MUMBLE_MURMUR_CONNECTIONTHROTTLE_H_
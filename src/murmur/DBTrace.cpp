@@ -0,0 +1,144 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DBTrace.h"
+
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtSql/QSqlQuery>
+
+#include <cmath>
+
+namespace DBTrace {
+
+static QJsonValue encodeValue(const QVariant &value) {
+	if (value.isNull()) {
+		return QJsonValue(QJsonValue::Null);
+	}
+
+	switch (value.userType()) {
+		case QMetaType::Bool:
+			return value.toBool();
+		case QMetaType::Int:
+		case QMetaType::UInt:
+		case QMetaType::LongLong:
+		case QMetaType::ULongLong:
+			return value.toLongLong();
+		case QMetaType::Float:
+		case QMetaType::Double:
+			return value.toDouble();
+		case QMetaType::QByteArray:
+			// Blobs are kept apart from strings, so that they are bound as blobs again when they are replayed
+			return QJsonObject{ { QLatin1String("blob"), QString::fromLatin1(value.toByteArray().toBase64()) } };
+		case QMetaType::QVariantList: {
+			QJsonArray array;
+			for (const QVariant &element : value.toList()) {
+				array.append(encodeValue(element));
+			}
+			return array;
+		}
+		default:
+			return value.toString();
+	}
+}
+
+static QVariant decodeValue(const QJsonValue &value) {
+	switch (value.type()) {
+		case QJsonValue::Bool:
+			return value.toBool();
+		case QJsonValue::Double: {
+			const double number = value.toDouble();
+			if (std::floor(number) == number) {
+				return static_cast< qlonglong >(number);
+			}
+			return number;
+		}
+		case QJsonValue::String:
+			return value.toString();
+		case QJsonValue::Object:
+			return QByteArray::fromBase64(value.toObject().value(QLatin1String("blob")).toString().toLatin1());
+		case QJsonValue::Array: {
+			QVariantList list;
+			for (const QJsonValue &element : value.toArray()) {
+				list << decodeValue(element);
+			}
+			return list;
+		}
+		default:
+			return QVariant();
+	}
+}
+
+QByteArray encode(const Statement &statement) {
+	QJsonArray values;
+	for (const QVariant &value : statement.values) {
+		values.append(encodeValue(value));
+	}
+
+	QJsonObject object;
+	object.insert(QLatin1String("offset"), statement.offset);
+	object.insert(QLatin1String("duration"), statement.duration);
+	object.insert(QLatin1String("sql"), statement.sql);
+	object.insert(QLatin1String("values"), values);
+	if (statement.batch) {
+		object.insert(QLatin1String("batch"), true);
+	}
+
+	return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+bool decode(const QByteArray &line, Statement &statement) {
+	QJsonParseError error;
+	const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+	if (error.error != QJsonParseError::NoError || !document.isObject()) {
+		return false;
+	}
+
+	const QJsonObject object = document.object();
+	if (!object.value(QLatin1String("sql")).isString()) {
+		return false;
+	}
+
+	statement.offset   = static_cast< qint64 >(object.value(QLatin1String("offset")).toDouble());
+	statement.duration = static_cast< qint64 >(object.value(QLatin1String("duration")).toDouble());
+	statement.sql      = object.value(QLatin1String("sql")).toString();
+	statement.batch    = object.value(QLatin1String("batch")).toBool();
+	statement.values.clear();
+	for (const QJsonValue &value : object.value(QLatin1String("values")).toArray()) {
+		statement.values << decodeValue(value);
+	}
+
+	return true;
+}
+
+Recorder::Recorder(const QString &path) : m_file(path, QIODevice::Text) {
+}
+
+bool Recorder::isOpen() const {
+	return m_file.isOpen();
+}
+
+qint64 Recorder::now() const {
+	return m_file.now();
+}
+
+void Recorder::record(const QSqlQuery &query, bool batch, qint64 started) {
+	Statement statement;
+	statement.offset   = started;
+	statement.duration = now() - started;
+	statement.sql      = query.lastQuery();
+	statement.batch    = batch;
+
+	// QSqlQuery::boundValues() is keyed by placeholder in Qt 5, so the values are collected by position instead
+	const int count = query.boundValues().size();
+	for (int i = 0; i < count; ++i) {
+		statement.values << query.boundValue(i);
+	}
+
+	m_file.write(encode(statement) + '\n');
+}
+
+} // namespace DBTrace
@@ -0,0 +1,66 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_DBTRACE_H_
+#define MUMBLE_MURMUR_DBTRACE_H_
+
+#include "TraceFile.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QtGlobal>
+
+class QSqlQuery;
+
+/// A trace of the statements the server has executed against its database (see Meta::mp.qsDBTraceFile), which can be
+/// replayed by the ServerDB benchmark. The trace is a text file with one JSON object per statement and line.
+///
+/// Note that a trace contains everything that has been written to the database, including password hashes and the
+/// server log.
+namespace DBTrace {
+
+struct Statement {
+	/// The time at which the statement has been executed in microseconds since the trace has been started
+	qint64 offset = 0;
+	/// The time it took to execute the statement in microseconds
+	qint64 duration = 0;
+	/// The SQL as it has been sent to the database, i.e. with the table prefix applied
+	QString sql;
+	/// The values that have been bound to the statement's placeholders, by position. For a batch every value is a
+	/// QVariantList.
+	QVariantList values;
+	/// Whether the statement has been executed by QSqlQuery::execBatch()
+	bool batch = false;
+};
+
+/// @returns The given statement as a single line of JSON (without the trailing newline)
+QByteArray encode(const Statement &statement);
+/// Parses a line that has been produced by encode()
+///
+/// @returns Whether the line could be parsed
+bool decode(const QByteArray &line, Statement &statement);
+
+/// Appends the statements that are executed to a trace file. All functions may be called by any thread.
+class Recorder {
+public:
+	/// Starts a trace in the given text file. Whether the file could be created can be checked with isOpen().
+	explicit Recorder(const QString &path);
+
+	bool isOpen() const;
+	/// @returns The time since the trace has been started in microseconds, which is what statements are timed with
+	qint64 now() const;
+	/// Records the statement the given query has just executed
+	///
+	/// @param started The time at which the execution has been started, as returned by now()
+	void record(const QSqlQuery &query, bool batch, qint64 started);
+
+protected:
+	TraceFile m_file;
+};
+
+} // namespace DBTrace
+
+#endif // MUMBLE_MURMUR_DBTRACE_H_
@@ -154,6 +154,7 @@ const QDBusArgument &operator>>(const QDBusArgument &a, LogEntry &s) {
 
 void MurmurDBus::registerTypes() {
 	qDBusRegisterMetaType< PlayerInfo >();
+	qDBusRegisterMetaType< PlayerMoveMap >();
 	qDBusRegisterMetaType< PlayerInfoExtended >();
 	qDBusRegisterMetaType< QList< PlayerInfoExtended > >();
 	qDBusRegisterMetaType< ChannelInfo >();
@@ -387,6 +388,18 @@ void MurmurDBus::setPlayerState(const PlayerInfo &npi, const QDBusMessage &msg)
 	server->setUserState(pUser, cChannel, npi.mute, npi.deaf, pUser->bPrioritySpeaker, npi.suppressed);
 }
 
+void MurmurDBus::movePlayers(const PlayerMoveMap &moves, const QDBusMessage &msg) {
+	QList< QPair< User *, Channel * > > qlMoves;
+	for (auto it = moves.constBegin(); it != moves.constEnd(); ++it) {
+		PLAYER_SETUP_VAR(it.key());
+		CHANNEL_SETUP_VAR(static_cast< unsigned int >(it.value()));
+
+		qlMoves.append(qMakePair< User *, Channel * >(pUser, cChannel));
+	}
+
+	server->moveUsers(qlMoves);
+}
+
 void MurmurDBus::sendMessage(unsigned int session, const QString &text, const QDBusMessage &msg) {
 	PLAYER_SETUP;
 
@@ -519,6 +532,9 @@ void MurmurDBus::setACL(int id, const QList< ACLInfo > &acls, const QList< Group
 
 	QHash< QString, QSet< int > > hOldTemp;
 
+	// The compiled programs refer to the groups that are about to be deleted
+	server->dropACLPrograms(*cChannel);
+
 	foreach (g, cChannel->qhGroups) {
 		hOldTemp.insert(g->qsName, g->qsTemporary);
 		delete g;
@@ -555,7 +571,7 @@ void MurmurDBus::setACL(int id, const QList< ACLInfo > &acls, const QList< Group
 		a->pAllow     = static_cast< ChanACL::Permissions >(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearACLCacheOfBranch(cChannel);
 	server->updateChannel(cChannel);
 }
 
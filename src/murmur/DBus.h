@@ -32,6 +32,10 @@ struct PlayerInfo {
 };
 Q_DECLARE_METATYPE(PlayerInfo)
 
+/// The channels players should be moved to, by session
+typedef QMap< unsigned int, int > PlayerMoveMap;
+Q_DECLARE_METATYPE(PlayerMoveMap)
+
 struct PlayerInfoExtended : public PlayerInfo {
 	int id;
 	QString name;
@@ -166,6 +170,7 @@ public slots:
 	void kickPlayer(unsigned int session, const QString &reason, const QDBusMessage &);
 	void getPlayerState(unsigned int session, const QDBusMessage &, PlayerInfo &state);
 	void setPlayerState(const PlayerInfo &state, const QDBusMessage &);
+	void movePlayers(const PlayerMoveMap &moves, const QDBusMessage &);
 	void sendMessage(unsigned int session, const QString &text, const QDBusMessage &);
 
 	void getChannelState(int id, const QDBusMessage &, ChannelInfo &state);
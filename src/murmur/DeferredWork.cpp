@@ -0,0 +1,80 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "DeferredWork.h"
+
+#include "Server.h"
+#include "ServerUser.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QRunnable>
+
+namespace {
+/// Runs a piece of deferred work and posts its continuation to the DeferredWork that has started it. The
+/// DeferredWork waits for all of its jobs before it is deleted, so it is still there when the continuation is posted.
+class DeferredJob : public QRunnable {
+public:
+	DeferredJob(QObject *receiver, std::function< void(const DeferredWork::Continuation &) > finish,
+				DeferredWork::Work work)
+		: m_receiver(receiver), m_finish(std::move(finish)), m_work(std::move(work)) {}
+
+	void run() override {
+		const DeferredWork::Continuation continuation = m_work();
+		QCoreApplication::instance()->postEvent(
+			m_receiver, new ExecEvent([finish = m_finish, continuation]() { finish(continuation); }));
+	}
+
+protected:
+	QObject *m_receiver;
+	std::function< void(const DeferredWork::Continuation &) > m_finish;
+	DeferredWork::Work m_work;
+};
+} // namespace
+
+DeferredWork::DeferredWork(Resolver resolver) : m_resolver(std::move(resolver)) {
+}
+
+DeferredWork::~DeferredWork() {
+	shutdown();
+}
+
+void DeferredWork::start(ServerUser *user, Work work) {
+	const quint64 id = m_nextId++;
+	m_jobs.emplace(id, Job{ user->uiSession, user });
+
+	m_pool.start(new DeferredJob(
+		this, [this, id](const Continuation &continuation) { finish(id, continuation); }, std::move(work)));
+}
+
+void DeferredWork::shutdown() {
+	m_pool.clear();
+	m_pool.waitForDone();
+
+	// The continuations that have been posted already are dropped along with the jobs
+	m_jobs.clear();
+}
+
+void DeferredWork::finish(quint64 id, const Continuation &continuation) {
+	auto it = m_jobs.find(id);
+	if (it == m_jobs.end()) {
+		return;
+	}
+
+	const Job job = it->second;
+	m_jobs.erase(it);
+
+	// The user might have disconnected in the meantime
+	ServerUser *user = m_resolver(job.session);
+	if (!user || user != job.user) {
+		return;
+	}
+
+	continuation(user);
+}
+
+void DeferredWork::customEvent(QEvent *event) {
+	if (event->type() == EXEC_QEVENT)
+		static_cast< ExecEvent * >(event)->execute();
+}
@@ -0,0 +1,68 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_DEFERREDWORK_H_
+#define MUMBLE_MURMUR_DEFERREDWORK_H_
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QThreadPool>
+
+#include <functional>
+#include <unordered_map>
+
+class ServerUser;
+
+/// Performs expensive work for the users of a server (e.g. deriving the hash of a password) on a pool of worker
+/// threads of the server's own and hands the results over to the main thread.
+///
+/// The work must not access the server or the user, as it runs on a worker thread. It returns a continuation, which
+/// is called on the main thread with the user the work has been started for. The continuation is dropped if the user
+/// has disconnected in the meantime (the user is looked up by session, so a user that has reused the session doesn't
+/// get someone else's result) or if shutdown() has been called.
+///
+/// All functions have to be called on the main thread.
+class DeferredWork : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(DeferredWork)
+
+public:
+	/// Called on the main thread with the user the work has been started for
+	using Continuation = std::function< void(ServerUser *user) >;
+	/// Called on a worker thread
+	using Work = std::function< Continuation() >;
+	/// @returns The user that has the given session or nullptr if there is none
+	using Resolver = std::function< ServerUser *(unsigned int session) >;
+
+	explicit DeferredWork(Resolver resolver);
+	/// Waits for the work that is still running (see shutdown())
+	~DeferredWork() override;
+
+	/// Runs the given work for the given user
+	void start(ServerUser *user, Work work);
+	/// Drops the work that hasn't started yet, waits for the work that is running and drops all continuations that
+	/// haven't been called yet. Nothing may be started afterwards.
+	void shutdown();
+
+protected:
+	struct Job {
+		unsigned int session;
+		/// Only ever accessed on the main thread
+		QPointer< ServerUser > user;
+	};
+
+	Resolver m_resolver;
+	QThreadPool m_pool;
+	/// The jobs whose continuations haven't been called yet by their IDs
+	std::unordered_map< quint64, Job > m_jobs;
+	quint64 m_nextId = 1;
+
+	/// Calls the continuation of the given job, if its user is still there
+	void finish(quint64 id, const Continuation &continuation);
+	void customEvent(QEvent *event) override;
+};
+
+#endif // MUMBLE_MURMUR_DEFERREDWORK_H_
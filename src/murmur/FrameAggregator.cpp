@@ -0,0 +1,287 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "FrameAggregator.h"
+
+namespace {
+/// The bits of the table of contents byte that hold the configuration and the channel count. The remaining ones
+/// tell how the frames are laid out.
+constexpr Mumble::Protocol::byte CONFIG_MASK = 0xFC;
+constexpr std::size_t MAX_FRAMES             = 48;
+
+/// Reads the length of a frame (see RFC 6716, section 3.2.1)
+///
+/// @returns Whether a valid length has been read
+bool readLength(gsl::span< const Mumble::Protocol::byte > &data, std::size_t &length) {
+	if (data.empty()) {
+		return false;
+	}
+
+	if (data[0] < 252) {
+		length = data[0];
+		data   = data.subspan(1);
+		return true;
+	}
+
+	if (data.size() < 2) {
+		return false;
+	}
+
+	length = data[0] + 4 * static_cast< std::size_t >(data[1]);
+	data   = data.subspan(2);
+	return true;
+}
+
+void writeLength(std::size_t length, std::vector< Mumble::Protocol::byte > &buffer) {
+	if (length < 252) {
+		buffer.push_back(static_cast< Mumble::Protocol::byte >(length));
+	} else {
+		const std::size_t first = 252 + ((length - 252) & 0x3);
+		buffer.push_back(static_cast< Mumble::Protocol::byte >(first));
+		buffer.push_back(static_cast< Mumble::Protocol::byte >((length - first) / 4));
+	}
+}
+} // namespace
+
+bool FrameAggregator::add(const Mumble::Protocol::AudioData &in, Mumble::Protocol::AudioData &out,
+						  std::vector< Mumble::Protocol::byte > &buffer) {
+	std::lock_guard< std::mutex > lock(m_mutex);
+
+	const unsigned int frameSize = in.frameSize;
+	if (frameSize == 0 || frameSize >= REGULAR_FRAME_SIZE || REGULAR_FRAME_SIZE % frameSize != 0) {
+		return false;
+	}
+
+	if (in.payload.empty()) {
+		// A terminator without any audio merely ends the current group
+		if (in.isLastFrame && !m_ends.empty()) {
+			flush(true, out, buffer);
+			return true;
+		}
+		return false;
+	}
+
+	Mumble::Protocol::byte toc;
+	if (!parse(in.payload, toc, m_incoming) || m_incoming.empty() || frameSamples(toc) != frameSize) {
+		return false;
+	}
+
+	// The frames of a packet have to fall into a single group
+	const std::uint64_t framesPerGroup = REGULAR_FRAME_SIZE / frameSize;
+	const std::uint64_t group          = in.frameNumber / framesPerGroup;
+	const std::uint64_t nextFrame      = in.frameNumber + m_incoming.size();
+	if ((nextFrame - 1) / framesPerGroup != group) {
+		return false;
+	}
+
+	bool flushed = false;
+	if (!m_ends.empty()) {
+		if (in.frameNumber < m_nextFrame) {
+			// Duplicated or reordered, and thus too late
+			return false;
+		}
+
+		if (group > m_group + 1) {
+			// The stream has been interrupted (e.g. its terminator has been lost), so the group is too old to be of
+			// any use
+			m_data.clear();
+			m_ends.clear();
+		} else if (group != m_group || in.frameNumber != m_nextFrame || (toc & CONFIG_MASK) != (m_toc & CONFIG_MASK)
+				   || frameSize != m_header.frameSize || in.targetOrContext != m_header.targetOrContext) {
+			if (in.isLastFrame) {
+				// There can only be a single packet, so the group that is there already ends the stream
+				flush(true, out, buffer);
+				return true;
+			}
+
+			flush(false, out, buffer);
+			flushed = true;
+		}
+	}
+
+	if (m_ends.empty()) {
+		m_header                  = in;
+		m_header.payload          = {};
+		m_header.redundantPayload = {};
+		m_toc                     = toc;
+		m_group                   = group;
+	}
+
+	for (const gsl::span< const Mumble::Protocol::byte > &frame : m_incoming) {
+		m_data.insert(m_data.end(), frame.begin(), frame.end());
+		m_ends.push_back(m_data.size());
+	}
+	m_nextFrame = nextFrame;
+
+	// The latest position is the most accurate one
+	m_header.containsPositionalData = in.containsPositionalData;
+	m_header.position               = in.position;
+
+	if (!flushed && (in.isLastFrame || nextFrame % framesPerGroup == 0)) {
+		flush(in.isLastFrame, out, buffer);
+		return true;
+	}
+
+	return flushed;
+}
+
+void FrameAggregator::flush(bool isLastFrame, Mumble::Protocol::AudioData &out,
+							std::vector< Mumble::Protocol::byte > &buffer) {
+	m_outgoing.clear();
+	std::size_t start = 0;
+	for (std::size_t end : m_ends) {
+		m_outgoing.push_back(gsl::span< const Mumble::Protocol::byte >(m_data.data() + start, end - start));
+		start = end;
+	}
+	pack(m_toc, m_outgoing, buffer);
+
+	out                  = m_header;
+	out.frameNumber      = m_group;
+	out.frameSize        = 0;
+	out.isLastFrame      = isLastFrame;
+	out.payload          = gsl::span< const Mumble::Protocol::byte >(buffer.data(), buffer.size());
+	out.redundantPayload = {};
+
+	m_data.clear();
+	m_ends.clear();
+}
+
+bool FrameAggregator::parse(gsl::span< const Mumble::Protocol::byte > packet, Mumble::Protocol::byte &toc,
+							std::vector< gsl::span< const Mumble::Protocol::byte > > &frames) {
+	frames.clear();
+	if (packet.empty()) {
+		return false;
+	}
+
+	toc                                            = packet[0];
+	gsl::span< const Mumble::Protocol::byte > data = packet.subspan(1);
+
+	switch (toc & 0x3) {
+		case 0:
+			// A single frame
+			frames.push_back(data);
+			break;
+		case 1:
+			// Two frames of the same size
+			if (data.size() % 2 != 0) {
+				return false;
+			}
+			frames.push_back(data.first(data.size() / 2));
+			frames.push_back(data.subspan(data.size() / 2));
+			break;
+		case 2: {
+			// Two frames of which the first one's length is given
+			std::size_t length;
+			if (!readLength(data, length) || length > data.size()) {
+				return false;
+			}
+			frames.push_back(data.first(length));
+			frames.push_back(data.subspan(length));
+			break;
+		}
+		default: {
+			// Any number of frames, which are either of the same size or have their lengths given, and padding
+			if (data.empty()) {
+				return false;
+			}
+			const Mumble::Protocol::byte header = data[0];
+			const std::size_t count             = header & 0x3F;
+			const bool variable                 = (header & 0x80) != 0;
+			data                                = data.subspan(1);
+			if (count == 0 || count > MAX_FRAMES) {
+				return false;
+			}
+
+			if (header & 0x40) {
+				std::size_t padding = 0;
+				Mumble::Protocol::byte value;
+				do {
+					if (data.empty()) {
+						return false;
+					}
+					value = data[0];
+					data  = data.subspan(1);
+					padding += value == 255 ? 254 : value;
+				} while (value == 255);
+
+				if (padding > data.size()) {
+					return false;
+				}
+				data = data.first(data.size() - padding);
+			}
+
+			if (variable) {
+				std::size_t lengths[MAX_FRAMES];
+				std::size_t total = 0;
+				for (std::size_t i = 0; i + 1 < count; ++i) {
+					if (!readLength(data, lengths[i])) {
+						return false;
+					}
+					total += lengths[i];
+				}
+				if (total > data.size()) {
+					return false;
+				}
+				for (std::size_t i = 0; i + 1 < count; ++i) {
+					frames.push_back(data.first(lengths[i]));
+					data = data.subspan(lengths[i]);
+				}
+				frames.push_back(data);
+			} else {
+				if (data.size() % count != 0) {
+					return false;
+				}
+				const std::size_t length = data.size() / count;
+				for (std::size_t i = 0; i < count; ++i) {
+					frames.push_back(data.subspan(i * length, length));
+				}
+			}
+			break;
+		}
+	}
+
+	for (const gsl::span< const Mumble::Protocol::byte > &frame : frames) {
+		if (frame.size() > MAX_FRAME_BYTES) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FrameAggregator::pack(Mumble::Protocol::byte toc,
+						   const std::vector< gsl::span< const Mumble::Protocol::byte > > &frames,
+						   std::vector< Mumble::Protocol::byte > &buffer) {
+	buffer.clear();
+
+	if (frames.size() == 1) {
+		buffer.push_back(toc & CONFIG_MASK);
+	} else {
+		// Variable bitrate without padding, so that the frames don't have to be of the same size
+		buffer.push_back((toc & CONFIG_MASK) | 0x3);
+		buffer.push_back(static_cast< Mumble::Protocol::byte >(0x80 | frames.size()));
+		for (std::size_t i = 0; i + 1 < frames.size(); ++i) {
+			writeLength(frames[i].size(), buffer);
+		}
+	}
+
+	for (const gsl::span< const Mumble::Protocol::byte > &frame : frames) {
+		buffer.insert(buffer.end(), frame.begin(), frame.end());
+	}
+}
+
+unsigned int FrameAggregator::frameSamples(Mumble::Protocol::byte toc) {
+	// The configuration (the upper 5 bits) determines the mode and the duration of the frames: SILK (10, 20, 40 or 60
+	// ms), hybrid (10 or 20 ms) and CELT (2.5, 5, 10 or 20 ms)
+	static const unsigned int SILK_FRAMES[] = { 480, 960, 1920, 2880 };
+	const unsigned int config               = toc >> 3;
+	if (config < 12) {
+		return SILK_FRAMES[config & 0x3];
+	} else if (config < 16) {
+		return 480u << (config & 0x1);
+	} else {
+		return 120u << (config & 0x3);
+	}
+}
@@ -0,0 +1,77 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_FRAMEAGGREGATOR_H_
+#define MUMBLE_MURMUR_FRAMEAGGREGATOR_H_
+
+#include "MumbleProtocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Combines the Opus frames of a user that speaks with frames shorter than 10 ms (see
+/// Mumble::Protocol::AudioData::frameSize) into packets of 10 ms, which is what all receivers that don't support
+/// short frames get (along with the other nodes of the cluster, the recorder, the stage mixers and the transcoder).
+///
+/// The frames are grouped by the 10 ms frame they fall into, so that the combined packets can be numbered like
+/// regular ones. The frames of a group are repacketized into a single Opus packet (see RFC 6716, section 3.2) without
+/// being decoded. A group is passed on once it is complete, once the stream ends or once a frame of another group (or
+/// one that doesn't fit the group) comes in, whichever comes first.
+///
+/// An aggregator belongs to a single user, but may be used by several voice threads one after the other.
+class FrameAggregator {
+public:
+	/// The number of samples of a regular frame
+	static constexpr unsigned int REGULAR_FRAME_SIZE = 480;
+	/// The largest Opus frame in bytes (see RFC 6716, section 3.2.1)
+	static constexpr std::size_t MAX_FRAME_BYTES = 1275;
+
+	/// Adds the frames of the given packet of short frames
+	///
+	/// @param out Receives a combined packet of regular frames if one has been completed by the given packet
+	/// @param buffer Receives the payload of the combined packet (which out refers to)
+	/// @returns Whether a combined packet has been written to out. Packets that aren't valid Opus packets of frames
+	/// 	of the announced size are dropped.
+	bool add(const Mumble::Protocol::AudioData &in, Mumble::Protocol::AudioData &out,
+			 std::vector< Mumble::Protocol::byte > &buffer);
+
+	/// Splits the given Opus packet into its frames
+	///
+	/// @param toc Receives the packet's table of contents byte
+	/// @returns Whether the packet is a valid Opus packet
+	static bool parse(gsl::span< const Mumble::Protocol::byte > packet, Mumble::Protocol::byte &toc,
+					  std::vector< gsl::span< const Mumble::Protocol::byte > > &frames);
+	/// Writes an Opus packet holding the given frames (at most 48, of at most MAX_FRAME_BYTES each) into the given
+	/// buffer. The configuration and the channel count are taken from the given table of contents byte.
+	static void pack(Mumble::Protocol::byte toc, const std::vector< gsl::span< const Mumble::Protocol::byte > > &frames,
+					 std::vector< Mumble::Protocol::byte > &buffer);
+	/// @returns The number of samples of a single frame of packets with the given table of contents byte
+	static unsigned int frameSamples(Mumble::Protocol::byte toc);
+
+protected:
+	std::mutex m_mutex;
+
+	/// The packet the current group has been started by (without its payloads)
+	Mumble::Protocol::AudioData m_header;
+	/// The table of contents byte of the frames of the current group
+	Mumble::Protocol::byte m_toc = 0;
+	/// The number of the 10 ms frame the current group falls into
+	std::uint64_t m_group = 0;
+	/// The frame number the next frame of the current group has to have
+	std::uint64_t m_nextFrame = 0;
+	/// The frames of the current group, one after the other, and where each of them ends
+	std::vector< Mumble::Protocol::byte > m_data;
+	std::vector< std::size_t > m_ends;
+	/// Scratch space for the frames of the packet that is being added and the ones of the group that is written
+	std::vector< gsl::span< const Mumble::Protocol::byte > > m_incoming;
+	std::vector< gsl::span< const Mumble::Protocol::byte > > m_outgoing;
+
+	/// Writes the current group to the given packet and starts a new one
+	void flush(bool isLastFrame, Mumble::Protocol::AudioData &out, std::vector< Mumble::Protocol::byte > &buffer);
+};
+
+#endif // MUMBLE_MURMUR_FRAMEAGGREGATOR_H_
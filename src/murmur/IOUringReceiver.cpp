@@ -0,0 +1,261 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "IOUringReceiver.h"
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+
+#include <tracy/Tracy.hpp>
+
+IOUringReceiver::IOUringReceiver() {
+	memset(&m_ring, 0, sizeof(m_ring));
+	memset(&m_msg, 0, sizeof(m_msg));
+}
+
+IOUringReceiver::~IOUringReceiver() {
+	if (m_bufferRing) {
+		io_uring_free_buf_ring(&m_ring, m_bufferRing, m_bufferCount, BUFFER_GROUP);
+	}
+	if (m_ringInitialized) {
+		// This also cancels all outstanding requests
+		io_uring_queue_exit(&m_ring);
+	}
+}
+
+bool IOUringReceiver::init(const std::vector< int > &sockets, int notifySocket, unsigned int bufferCount,
+						   std::size_t bufferSize, std::size_t controlSize) {
+	m_sockets      = sockets;
+	m_armed        = std::vector< bool >(sockets.size(), false);
+	m_notifySocket = notifySocket;
+
+	m_bufferCount = 1;
+	while (m_bufferCount < bufferCount) {
+		m_bufferCount *= 2;
+	}
+	// Provided buffer rings are limited to 2^15 entries
+	m_bufferCount = std::min(m_bufferCount, 32768U);
+
+	m_msg.msg_namelen    = sizeof(sockaddr_storage);
+	m_msg.msg_controllen = controlSize;
+
+	// The kernel prefixes every datagram with a header, its address and its control data. Keep every
+	// buffer 8-byte aligned.
+	m_bufferSize = sizeof(struct io_uring_recvmsg_out) + m_msg.msg_namelen + m_msg.msg_controllen + bufferSize;
+	m_bufferSize = (m_bufferSize + 7) & ~static_cast< std::size_t >(7);
+	m_buffers.resize(m_bufferCount * m_bufferSize + 8);
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	// Every buffer may produce one completion, so make sure they all fit into the completion queue
+	params.flags      = IORING_SETUP_CQSIZE;
+	params.cq_entries = m_bufferCount + static_cast< unsigned int >(sockets.size()) + 1;
+
+	int ret = io_uring_queue_init_params(static_cast< unsigned int >(sockets.size()) + 8, &m_ring, &params);
+	if (ret < 0) {
+		setError("io_uring_queue_init", -ret);
+		return false;
+	}
+	m_ringInitialized = true;
+
+	// Multishot recvmsg has been added in Linux 6.0, in the same release as IORING_OP_SEND_ZC. As there is no
+	// way of probing for the former directly, use the latter as an indicator.
+	struct io_uring_probe *probe = io_uring_get_probe_ring(&m_ring);
+	const bool supported         = probe && io_uring_opcode_supported(probe, IORING_OP_SEND_ZC);
+	if (probe) {
+		io_uring_free_probe(probe);
+	}
+	if (!supported) {
+		setError("Probing for multishot recvmsg", EOPNOTSUPP);
+		return false;
+	}
+
+	m_bufferRing = io_uring_setup_buf_ring(&m_ring, m_bufferCount, BUFFER_GROUP, 0, &ret);
+	if (!m_bufferRing) {
+		setError("io_uring_setup_buf_ring", -ret);
+		return false;
+	}
+
+	const int mask = io_uring_buf_ring_mask(m_bufferCount);
+	for (unsigned int i = 0; i < m_bufferCount; ++i) {
+		io_uring_buf_ring_add(m_bufferRing, buffer(static_cast< unsigned short >(i)),
+							  static_cast< unsigned int >(m_bufferSize), static_cast< unsigned short >(i), mask,
+							  static_cast< int >(i));
+	}
+	io_uring_buf_ring_advance(m_bufferRing, static_cast< int >(m_bufferCount));
+
+	for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+		if (!arm(i)) {
+			return false;
+		}
+	}
+
+	return armNotify();
+}
+
+IOUringReceiver::Result IOUringReceiver::wait(std::vector< Datagram > &datagrams) {
+	datagrams.clear();
+
+	recycleBuffers();
+
+	// Requests stop once they run out of buffers (or encounter an error) and have to be re-armed
+	for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+		if (!m_armed[i] && !arm(i)) {
+			return Result::Failed;
+		}
+	}
+
+	int ret = io_uring_submit_and_wait(&m_ring, 1);
+	if (ret < 0) {
+		if (ret == -EINTR) {
+			return Result::Received;
+		}
+
+		setError("io_uring_submit_and_wait", -ret);
+		return Result::Failed;
+	}
+
+	ZoneScoped;
+
+	Result result = Result::Received;
+
+	unsigned int head;
+	unsigned int seen = 0;
+	struct io_uring_cqe *cqe;
+	io_uring_for_each_cqe(&m_ring, head, cqe) {
+		++seen;
+
+		if (cqe->user_data == NOTIFY_TAG) {
+			result = Result::Notified;
+			continue;
+		}
+
+		const std::size_t socketIndex = static_cast< std::size_t >(cqe->user_data);
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			m_armed[socketIndex] = false;
+		}
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			m_usedBuffers.push_back(static_cast< unsigned short >(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+		}
+
+		if (cqe->res < 0) {
+			if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+				// The kernel doesn't support multishot receives after all
+				setError("Multishot recvmsg", -cqe->res);
+				result = Result::Failed;
+			}
+			// Everything else (most notably running out of buffers) is dealt with by re-arming the request
+			continue;
+		}
+
+		if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+			continue;
+		}
+
+		unsigned char *data              = buffer(m_usedBuffers.back());
+		struct io_uring_recvmsg_out *out = io_uring_recvmsg_validate(data, cqe->res, &m_msg);
+		if (!out) {
+			continue;
+		}
+
+		Datagram datagram;
+		datagram.socketIndex = socketIndex;
+
+		memset(&datagram.msg, 0, sizeof(datagram.msg));
+		datagram.msg.msg_name       = io_uring_recvmsg_name(out);
+		datagram.msg.msg_namelen    = std::min(out->namelen, m_msg.msg_namelen);
+		datagram.msg.msg_control    = static_cast< unsigned char * >(io_uring_recvmsg_name(out)) + m_msg.msg_namelen;
+		datagram.msg.msg_controllen = std::min(static_cast< std::size_t >(out->controllen), m_msg.msg_controllen);
+		datagram.msg.msg_iovlen     = 1;
+
+		// Thanks to MSG_TRUNC the length is the datagram's original one, even if it didn't fit into the buffer
+		datagram.data   = static_cast< unsigned char * >(io_uring_recvmsg_payload(out, &m_msg));
+		datagram.length = out->payloadlen;
+
+		datagrams.push_back(datagram);
+	}
+	io_uring_cq_advance(&m_ring, seen);
+
+	// The headers point to the datagram's own iovec, which is only possible once the vector doesn't grow anymore
+	for (Datagram &datagram : datagrams) {
+		datagram.iov.iov_base = datagram.data;
+		datagram.iov.iov_len  = datagram.length;
+		datagram.msg.msg_iov  = &datagram.iov;
+	}
+
+	return result;
+}
+
+const std::string &IOUringReceiver::errorMessage() const {
+	return m_error;
+}
+
+bool IOUringReceiver::arm(std::size_t socketIndex) {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+	if (!sqe) {
+		// The submission queue is full
+		io_uring_submit(&m_ring);
+		sqe = io_uring_get_sqe(&m_ring);
+		if (!sqe) {
+			setError("io_uring_get_sqe", EBUSY);
+			return false;
+		}
+	}
+
+	io_uring_prep_recvmsg_multishot(sqe, m_sockets[socketIndex], &m_msg, MSG_TRUNC);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUFFER_GROUP;
+	io_uring_sqe_set_data64(sqe, socketIndex);
+
+	m_armed[socketIndex] = true;
+
+	return true;
+}
+
+bool IOUringReceiver::armNotify() {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+	if (!sqe) {
+		setError("io_uring_get_sqe", EBUSY);
+		return false;
+	}
+
+	io_uring_prep_poll_add(sqe, m_notifySocket, POLLIN);
+	io_uring_sqe_set_data64(sqe, NOTIFY_TAG);
+
+	return true;
+}
+
+void IOUringReceiver::recycleBuffers() {
+	if (m_usedBuffers.empty()) {
+		return;
+	}
+
+	const int mask = io_uring_buf_ring_mask(m_bufferCount);
+	int offset     = 0;
+	for (unsigned short id : m_usedBuffers) {
+		io_uring_buf_ring_add(m_bufferRing, buffer(id), static_cast< unsigned int >(m_bufferSize), id, mask, offset++);
+	}
+	io_uring_buf_ring_advance(m_bufferRing, offset);
+
+	m_usedBuffers.clear();
+}
+
+unsigned char *IOUringReceiver::buffer(unsigned short id) {
+	// Align the first buffer to 8 bytes (all others follow from m_bufferSize being a multiple of 8)
+	const std::uintptr_t base = reinterpret_cast< std::uintptr_t >(m_buffers.data());
+	const std::size_t padding = static_cast< std::size_t >((8 - (base & 7)) & 7);
+
+	return m_buffers.data() + padding + static_cast< std::size_t >(id) * m_bufferSize;
+}
+
+void IOUringReceiver::setError(const char *operation, int error) {
+	m_error = std::string(operation) + ": " + strerror(error);
+}
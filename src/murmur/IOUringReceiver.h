@@ -0,0 +1,101 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_IOURINGRECEIVER_H_
+#define MUMBLE_MURMUR_IOURINGRECEIVER_H_
+
+#include <liburing.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Receives UDP datagrams on a set of sockets via io_uring (requires Linux 6.0+).
+///
+/// For every socket a multishot recvmsg request is kept outstanding that takes its buffers from a ring
+/// of provided buffers (one buffer per datagram). Thus receiving does not need a system call of its
+/// own: a single io_uring_enter() both re-arms the requests and waits for new datagrams.
+///
+/// A receiver must only ever be used by a single thread.
+class IOUringReceiver {
+public:
+	/// A datagram whose data resides in one of the provided buffers
+	struct Datagram {
+		/// The index of the socket the datagram has been received on
+		std::size_t socketIndex;
+		/// Describes the datagram's source address and control data as if it had been received via recvmsg
+		struct msghdr msg;
+		struct iovec iov;
+		unsigned char *data;
+		/// The length of the datagram. If this is bigger than the buffer size, the datagram has been truncated.
+		std::size_t length;
+	};
+
+	enum class Result {
+		/// Zero or more datagrams have been received
+		Received,
+		/// The notification socket has become readable
+		Notified,
+		/// The ring can't be used (any more). See errorMessage().
+		Failed
+	};
+
+	IOUringReceiver();
+	~IOUringReceiver();
+
+	IOUringReceiver(const IOUringReceiver &) = delete;
+	IOUringReceiver &operator=(const IOUringReceiver &) = delete;
+
+	/// Sets up the ring and starts receiving on the given sockets.
+	///
+	/// @param sockets The sockets to receive from
+	/// @param notifySocket A socket that makes wait() return Result::Notified once it becomes readable
+	/// @param bufferCount The amount of provided buffers. It is rounded up to the next power of two.
+	/// @param bufferSize The maximum size of a datagram
+	/// @param controlSize The maximum amount of control data per datagram
+	/// @returns Whether the ring has been set up. If the kernel lacks support for any of the needed
+	/// 	features, false is returned and errorMessage() says why.
+	bool init(const std::vector< int > &sockets, int notifySocket, unsigned int bufferCount, std::size_t bufferSize,
+			  std::size_t controlSize);
+
+	/// Waits until at least one datagram has been received and then collects all datagrams that are available
+	/// without waiting any further. The buffers of the datagrams returned by the previous call are handed back
+	/// to the kernel first, so the datagrams are only valid until the next call.
+	Result wait(std::vector< Datagram > &datagrams);
+
+	const std::string &errorMessage() const;
+
+protected:
+	static constexpr std::uint64_t NOTIFY_TAG    = UINT64_MAX;
+	static constexpr unsigned short BUFFER_GROUP = 0;
+
+	struct io_uring m_ring;
+	bool m_ringInitialized = false;
+
+	struct io_uring_buf_ring *m_bufferRing = nullptr;
+	unsigned int m_bufferCount             = 0;
+	/// The size of a single provided buffer including the space for the headers the kernel puts in front
+	std::size_t m_bufferSize = 0;
+	std::vector< unsigned char > m_buffers;
+	/// The buffers of the datagrams returned by the last call to wait()
+	std::vector< unsigned short > m_usedBuffers;
+
+	/// The template for the multishot requests (only the lengths of address and control data are used)
+	struct msghdr m_msg;
+	std::vector< int > m_sockets;
+	std::vector< bool > m_armed;
+	int m_notifySocket = -1;
+
+	std::string m_error;
+
+	bool arm(std::size_t socketIndex);
+	bool armNotify();
+	void recycleBuffers();
+	unsigned char *buffer(unsigned short id);
+	void setError(const char *operation, int error);
+};
+
+#endif // MUMBLE_MURMUR_IOURINGRECEIVER_H_
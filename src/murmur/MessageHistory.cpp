@@ -0,0 +1,231 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "MessageHistory.h"
+
+#include "Connection.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QStringList>
+#include <QtCore/QtEndian>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace {
+constexpr qint64 MSECS_PER_DAY = 24 * 60 * 60 * 1000;
+/// The size of an entry and the channel's ID
+constexpr int RECORD_HEADER_SIZE = 8;
+
+QStringList partitionFilter() {
+	return { QLatin1String("*.log") };
+}
+} // namespace
+
+MessageHistory::MessageHistory(const QString &directory, std::size_t maxMessages, unsigned int retentionDays,
+							   qint64 now)
+	: m_directory(directory), m_maxMessages(std::max< std::size_t >(maxMessages, 1)),
+	  m_retentionMsecs(static_cast< qint64 >(retentionDays) * MSECS_PER_DAY) {
+	m_directory.mkpath(QLatin1String("."));
+
+	// The partitions that have expired entirely aren't even replayed
+	expire(now);
+	for (const QString &partition : m_directory.entryList(partitionFilter(), QDir::Files, QDir::Name)) {
+		replay(partition);
+	}
+	expire(now);
+
+	open(dayOf(now));
+}
+
+bool MessageHistory::isValid() const {
+	return m_log.isOpen();
+}
+
+void MessageHistory::append(unsigned int channel, const MumbleProto::TextMessageHistory_Entry &entry) {
+	const qint64 now = static_cast< qint64 >(entry.message().timestamp());
+
+	write(channel, entry.SerializeAsString(), now);
+	add(channel, entry);
+}
+
+void MessageHistory::clear(unsigned int channel, qint64 now) {
+	if (m_channels.find(channel) == m_channels.end()) {
+		return;
+	}
+
+	write(channel, std::string(), now);
+	remove(channel);
+}
+
+std::size_t MessageHistory::size(unsigned int channel) const {
+	auto it = m_channels.find(channel);
+	return it == m_channels.end() ? 0 : it->second.entries.size();
+}
+
+const QByteArray &MessageHistory::page(unsigned int channel, qint64 page) {
+	MumbleProto::TextMessageHistory msg;
+	msg.set_channel_id(channel);
+
+	auto it = m_channels.find(channel);
+	if (it == m_channels.end()) {
+		msg.set_page(static_cast< unsigned int >(std::max< qint64 >(page, 0)));
+
+		m_uncachedPage.clear();
+		Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::TextMessageHistory, m_uncachedPage);
+		return m_uncachedPage;
+	}
+
+	ChannelHistory &history   = it->second;
+	const std::uint64_t total = history.firstNumber + history.entries.size();
+	const std::uint64_t first = history.firstNumber / PAGE_SIZE;
+	const std::uint64_t last  = total == 0 ? 0 : (total - 1) / PAGE_SIZE;
+
+	std::uint64_t number = last;
+	if (page >= 0) {
+		number = std::min< std::uint64_t >(static_cast< std::uint64_t >(page), std::numeric_limits< quint32 >::max());
+	}
+
+	auto cached = history.pages.find(number);
+	if (cached != history.pages.end()) {
+		return cached->second;
+	}
+
+	msg.set_page(static_cast< unsigned int >(number));
+	const std::uint64_t begin = std::max(number * PAGE_SIZE, history.firstNumber);
+	const std::uint64_t end   = std::min((number + 1) * PAGE_SIZE, total);
+	for (std::uint64_t i = begin; i < end; ++i) {
+		*msg.add_entries() = history.entries[static_cast< std::size_t >(i - history.firstNumber)];
+	}
+
+	// Only the pages that can still change are cached, so that asking for arbitrary ones doesn't fill the cache
+	QByteArray &data = (number >= first && number <= last) ? history.pages[number] : m_uncachedPage;
+	data.clear();
+	Connection::messageToNetwork(msg, Mumble::Protocol::TCPMessageType::TextMessageHistory, data);
+
+	return data;
+}
+
+void MessageHistory::add(unsigned int channel, MumbleProto::TextMessageHistory_Entry entry) {
+	ChannelHistory &history = m_channels[channel];
+
+	history.pages.erase((history.firstNumber + history.entries.size()) / PAGE_SIZE);
+	history.entries.push_back(std::move(entry));
+
+	while (history.entries.size() > m_maxMessages) {
+		dropFront(history);
+	}
+}
+
+void MessageHistory::remove(unsigned int channel) {
+	m_channels.erase(channel);
+}
+
+void MessageHistory::expire(qint64 now) {
+	const qint64 cutoff = now - m_retentionMsecs;
+
+	for (auto &entry : m_channels) {
+		ChannelHistory &history = entry.second;
+		while (!history.entries.empty()
+			   && static_cast< qint64 >(history.entries.front().message().timestamp()) < cutoff) {
+			dropFront(history);
+		}
+	}
+
+	// The names of the partitions sort just like their days do
+	const QString oldest = partitionName(dayOf(cutoff));
+	for (const QString &partition : m_directory.entryList(partitionFilter(), QDir::Files, QDir::Name)) {
+		if (partition >= oldest) {
+			break;
+		}
+
+		m_directory.remove(partition);
+	}
+}
+
+void MessageHistory::replay(const QString &fileName) {
+	QFile file(m_directory.filePath(fileName));
+	if (!file.open(QIODevice::ReadWrite)) {
+		qWarning("MessageHistory: Failed to open %s", qUtf8Printable(file.fileName()));
+		return;
+	}
+
+	const QByteArray data = file.readAll();
+	int offset            = 0;
+	while (data.size() - offset >= RECORD_HEADER_SIZE) {
+		const uchar *header   = reinterpret_cast< const uchar * >(data.constData() + offset);
+		const quint32 size    = qFromLittleEndian< quint32 >(header);
+		const quint32 channel = qFromLittleEndian< quint32 >(header + 4);
+		const int available   = data.size() - offset - RECORD_HEADER_SIZE;
+		if (size > MAX_RECORD_SIZE || size > static_cast< quint32 >(available)) {
+			break;
+		}
+		offset += RECORD_HEADER_SIZE;
+
+		if (size == 0) {
+			remove(channel);
+		} else {
+			MumbleProto::TextMessageHistory_Entry entry;
+			if (entry.ParseFromArray(data.constData() + offset, static_cast< int >(size))) {
+				add(channel, std::move(entry));
+			}
+		}
+		offset += static_cast< int >(size);
+	}
+
+	if (offset < data.size()) {
+		// The server has stopped while writing the record (or the partition is corrupt). Further records would never
+		// be read if they were appended behind it.
+		qWarning("MessageHistory: Dropping %d trailing bytes of %s", data.size() - offset,
+				 qUtf8Printable(file.fileName()));
+		file.resize(offset);
+	}
+}
+
+void MessageHistory::write(unsigned int channel, const std::string &data, qint64 now) {
+	const qint64 day = dayOf(now);
+	if (day != m_day) {
+		open(day);
+		expire(now);
+	}
+	if (!m_log.isOpen()) {
+		return;
+	}
+
+	std::array< uchar, RECORD_HEADER_SIZE > header;
+	qToLittleEndian< quint32 >(static_cast< quint32 >(data.size()), header.data());
+	qToLittleEndian< quint32 >(channel, header.data() + 4);
+
+	m_log.write(reinterpret_cast< const char * >(header.data()), RECORD_HEADER_SIZE);
+	m_log.write(data.data(), static_cast< qint64 >(data.size()));
+	m_log.flush();
+}
+
+void MessageHistory::open(qint64 day) {
+	m_log.close();
+	m_day = day;
+
+	m_log.setFileName(m_directory.filePath(partitionName(day)));
+	if (!m_log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		qWarning("MessageHistory: Failed to open %s for writing", qUtf8Printable(m_log.fileName()));
+	}
+}
+
+void MessageHistory::dropFront(ChannelHistory &history) {
+	history.pages.erase(history.firstNumber / PAGE_SIZE);
+	history.entries.pop_front();
+	++history.firstNumber;
+}
+
+qint64 MessageHistory::dayOf(qint64 msecs) {
+	return msecs >= 0 ? msecs / MSECS_PER_DAY : (msecs - MSECS_PER_DAY + 1) / MSECS_PER_DAY;
+}
+
+QString MessageHistory::partitionName(qint64 day) {
+	return QDateTime::fromMSecsSinceEpoch(day * MSECS_PER_DAY, Qt::UTC).toString(QLatin1String("yyyyMMdd"))
+		   + QLatin1String(".log");
+}
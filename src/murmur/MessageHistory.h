@@ -0,0 +1,110 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_MESSAGEHISTORY_H_
+#define MUMBLE_MURMUR_MESSAGEHISTORY_H_
+
+#include "Mumble.pb.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+/// The recent text messages of the channels of a virtual server (see Server::messageHistory), which clients are sent
+/// page by page (see MumbleProto::TextMessageHistory) when they join a channel, so that nobody has to repeat them.
+///
+/// The messages are appended to a log that is partitioned by (UTC) day into files named "yyyyMMdd.log" inside of the
+/// directory the history has been created with. The partitions are replayed when the history is created and deleted
+/// once all of their messages are older than the retention. Every record consists of the size of its entry and the
+/// channel's ID (both 32-bit little-endian), followed by the serialized MumbleProto::TextMessageHistory::Entry. A
+/// record without an entry clears the channel's history.
+///
+/// The messages of a channel are numbered in the order they have been sent, and page n holds the ones numbered
+/// n * PAGE_SIZE up to (n + 1) * PAGE_SIZE - 1. Thus, a page doesn't change anymore once it is full (until messages
+/// start expiring from it), and the serialized pages are cached until they do. Clients go back in time by fetching
+/// the previous pages until they get an empty one.
+///
+/// The history is only used by the main thread.
+class MessageHistory {
+public:
+	/// The number of messages per page
+	static constexpr unsigned int PAGE_SIZE = 25;
+	/// Records that claim to be larger than this are considered to be corrupt, ending the replay of their partition
+	static constexpr std::uint32_t MAX_RECORD_SIZE = 8 * 1024 * 1024;
+
+	/// Replays the partitions inside of the given directory, which is created if it doesn't exist
+	///
+	/// @param maxMessages The number of messages every channel keeps at most
+	/// @param retentionDays For how many days the messages are kept
+	/// @param now The current time in milliseconds since the epoch
+	MessageHistory(const QString &directory, std::size_t maxMessages, unsigned int retentionDays, qint64 now);
+
+	/// @returns Whether the current partition could be opened for writing
+	bool isValid() const;
+
+	/// Appends the given message to the history of the given channel. The message's timestamp is taken as the
+	/// current time.
+	void append(unsigned int channel, const MumbleProto::TextMessageHistory_Entry &entry);
+	/// Forgets the messages of the given channel, which is about to be removed
+	///
+	/// @param now The current time in milliseconds since the epoch
+	void clear(unsigned int channel, qint64 now);
+
+	/// @returns The number of messages the given channel has kept
+	std::size_t size(unsigned int channel) const;
+	/// @returns The given page of the given channel's messages as a TextMessageHistory message, framed just like on the
+	/// 	TCP connection (see Connection::messageToNetwork). Pages after the latest one are empty, and so are the
+	/// 	ones that have expired entirely. A negative page is taken to be the latest one. The returned array is empty
+	/// 	if the page is too large to be sent. It stays valid until the history is changed or asked for another page.
+	const QByteArray &page(unsigned int channel, qint64 page);
+
+protected:
+	struct ChannelHistory {
+		std::deque< MumbleProto::TextMessageHistory_Entry > entries;
+		/// The number of entries.front()
+		std::uint64_t firstNumber = 0;
+		/// The serialized pages by page number
+		std::unordered_map< std::uint64_t, QByteArray > pages;
+	};
+
+	QDir m_directory;
+	const std::size_t m_maxMessages;
+	const qint64 m_retentionMsecs;
+	std::unordered_map< unsigned int, ChannelHistory > m_channels;
+	/// The partition that is currently written to
+	QFile m_log;
+	/// The day (in days since the epoch) of m_log
+	qint64 m_day = -1;
+	/// The last page that has been serialized without being cached (see page())
+	QByteArray m_uncachedPage;
+
+	/// Adds the given entry to the history of the given channel, without writing it
+	void add(unsigned int channel, MumbleProto::TextMessageHistory_Entry entry);
+	/// Forgets the history of the given channel, without writing it
+	void remove(unsigned int channel);
+	/// Drops the messages that are older than the retention and deletes the partitions holding only those
+	void expire(qint64 now);
+	/// Reads the records of the given partition. A record at its end that has only been written partially is cut off.
+	void replay(const QString &fileName);
+	/// Appends the given record to the partition of the given time, switching partitions if it isn't the current one
+	void write(unsigned int channel, const std::string &data, qint64 now);
+	/// Opens the partition of the given day for writing
+	void open(qint64 day);
+
+	/// Drops the oldest message of the given history
+	static void dropFront(ChannelHistory &history);
+
+	static qint64 dayOf(qint64 msecs);
+	static QString partitionName(qint64 day);
+};
+
+#endif // MUMBLE_MURMUR_MESSAGEHISTORY_H_
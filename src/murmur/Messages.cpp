@@ -7,6 +7,7 @@
 #include "Channel.h"
 #include "ChannelListenerManager.h"
 #include "ClientType.h"
+#include "Cluster.h"
 #include "Connection.h"
 #include "Group.h"
 #include "Meta.h"
@@ -18,12 +19,14 @@
 #include "ServerUser.h"
 #include "User.h"
 #include "Version.h"
+#include "VoiceRedundancy.h"
 #include "crypto/CryptState.h"
 
 #include <QtCore/QStack>
 #include <QtCore/QtEndian>
 #include <QUuid>
 
+#include <algorithm>
 #include <cassert>
 #include <unordered_map>
 #include <chrono>
@@ -164,6 +167,171 @@ bool isChannelEnterRestricted(Channel *c) {
 	return false;
 }
 
+/// Sets the links of the given channel as the only content of the given message
+static void setChannelLinks(MumbleProto::ChannelState &mpcs, const Channel *c) {
+	mpcs.Clear();
+	mpcs.set_channel_id(c->iId);
+
+	foreach (Channel *l, c->qhLinks.keys())
+		mpcs.add_links(l->iId);
+}
+
+void Server::setChannelState(MumbleProto::ChannelState &mpcs, const Channel *c, bool hashes) {
+	mpcs.set_channel_id(c->iId);
+	if (c->cParent)
+		mpcs.set_parent(c->cParent->iId);
+	if (c->iId == 0)
+		mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
+	else
+		mpcs.set_name(u8(c->qsName));
+
+	mpcs.set_position(c->iPosition);
+
+	if (hashes && !c->qbaDescHash.isEmpty())
+		mpcs.set_description_hash(blob(c->qbaDescHash));
+	else if (!c->qsDesc.isEmpty())
+		mpcs.set_description(u8(c->qsDesc));
+
+	mpcs.set_max_users(c->uiMaxUsers);
+}
+
+void Server::setUserState(MumbleProto::UserState &mpus, const ServerUser *u, bool hashes) {
+	mpus.set_session(u->uiSession);
+	mpus.set_name(u8(u->qsName));
+	if (u->iId >= 0)
+		mpus.set_user_id(static_cast< unsigned int >(u->iId));
+	if (hashes) {
+		if (!u->qbaTextureHash.isEmpty())
+			mpus.set_texture_hash(blob(u->qbaTextureHash));
+		else if (!u->qbaTexture.isEmpty())
+			mpus.set_texture(blob(u->qbaTexture));
+	}
+	if (u->cChannel->iId != 0)
+		mpus.set_channel_id(u->cChannel->iId);
+	if (u->bDeaf)
+		mpus.set_deaf(true);
+	else if (u->bMute)
+		mpus.set_mute(true);
+	if (u->bSuppress)
+		mpus.set_suppress(true);
+	if (u->bPrioritySpeaker)
+		mpus.set_priority_speaker(true);
+	if (u->bRecording)
+		mpus.set_recording(true);
+	if (u->bSelfDeaf)
+		mpus.set_self_deaf(true);
+	else if (u->bSelfMute)
+		mpus.set_self_mute(true);
+	if (hashes && !u->qbaCommentHash.isEmpty())
+		mpus.set_comment_hash(blob(u->qbaCommentHash));
+	else if (!u->qsComment.isEmpty())
+		mpus.set_comment(u8(u->qsComment));
+	if (!u->qsHash.isEmpty())
+		mpus.set_hash(u8(u->qsHash));
+
+	for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
+		mpus.add_listening_channel_add(channelID);
+
+		if (broadcastListenerVolumeAdjustments) {
+			VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
+			MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
+			adjustment->set_listening_channel(channelID);
+			adjustment->set_volume_adjustment(volume.factor);
+		}
+	}
+}
+
+bool Server::sendChannelSnapshot(ServerUser *u) {
+	// The channels in the order they are sent in: parents always come before their children
+	QList< Channel * > channels;
+	channels << qhChannels.value(0);
+	for (int i = 0; i < channels.size(); ++i) {
+		channels << channels[i]->qlChannels;
+	}
+
+	const MumbleProto::StateSnapshot *cached = m_stateSnapshots.channels();
+	if (!cached) {
+		QByteArray data;
+		QByteArray frame;
+		MumbleProto::ChannelState mpcs;
+
+		for (Channel *c : channels) {
+			mpcs.Clear();
+
+			// Clients that support snapshots know about description hashes
+			setChannelState(mpcs, c, true);
+
+			Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, frame);
+			data.append(frame);
+		}
+
+		// Links can only be set up once all channels exist
+		for (Channel *c : channels) {
+			if (c->qhLinks.count() > 0) {
+				setChannelLinks(mpcs, c);
+
+				Connection::messageToNetwork(mpcs, Mumble::Protocol::TCPMessageType::ChannelState, frame);
+				data.append(frame);
+			}
+		}
+
+		cached = &m_stateSnapshots.setChannels(data);
+	}
+
+	// The enter states are the only part that depends on the receiver
+	MumbleProto::StateSnapshot mpss(*cached);
+	for (Channel *c : channels) {
+		if (isChannelEnterRestricted(c))
+			mpss.add_enter_restricted_channels(c->iId);
+		if (!hasPermission(u, c, ChanACL::Enter))
+			mpss.add_denied_channels(c->iId);
+	}
+
+	if (!StateSnapshotCache::fitsIntoMessage(mpss)) {
+		return false;
+	}
+
+	sendMessage(u, mpss);
+
+	return true;
+}
+
+bool Server::sendUserSnapshot(ServerUser *u) {
+	QByteArray data;
+
+	foreach (ServerUser *user, qhUsers) {
+		if (user->sState != ServerUser::Authenticated)
+			continue;
+
+		if (user == u)
+			continue;
+
+		const QByteArray *frame = m_stateSnapshots.userFrame(user->uiSession);
+		if (!frame) {
+			// Clients that support snapshots know about texture and comment hashes
+			MumbleProto::UserState mpus;
+			setUserState(mpus, user, true);
+
+			QByteArray built;
+			Connection::messageToNetwork(mpus, Mumble::Protocol::TCPMessageType::UserState, built);
+			frame = &m_stateSnapshots.setUserFrame(user->uiSession, built);
+		}
+
+		data.append(*frame);
+	}
+
+	MumbleProto::StateSnapshot mpss;
+	StateSnapshotCache::setData(mpss, data);
+
+	if (!StateSnapshotCache::fitsIntoMessage(mpss)) {
+		return false;
+	}
+
+	sendMessage(u, mpss);
+
+	return true;
+}
+
 void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg) {
 	ZoneScoped;
 
@@ -195,6 +363,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	}
 	MSG_SETUP(ServerUser::Connected);
 
+	// Deriving the hash of a password is expensive, so it happens on a worker thread. Once that is done, this message
+	// is processed again.
+	if (deferPasswordCheck(uSource, msg))
+		return;
+
 	// As the first thing, assign a session ID to this client. Given that the client initiated
 	// the authentication procedure we can be sure that this is not just a random TCP connection.
 	// Thus it is about time we assign the ID to this client in order to be able to reference it
@@ -205,6 +378,8 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		qhUsers.insert(uSource->uiSession, uSource);
 		qhHostUsers[uSource->haAddress].insert(uSource);
 	}
+	updatePingReply();
+	scheduleTimeout(uSource);
 
 	Channel *root = qhChannels.value(0);
 	Channel *c;
@@ -218,8 +393,10 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	// Fetch ID and stored username.
 	// Since this may call DBus, which may recall our dbus messages, this function needs
 	// to support re-entrancy, and also to support the fact that sessions may go away.
-	int id = authenticate(uSource->qsName, pw, static_cast< int >(uSource->uiSession), uSource->qslEmail,
-						  uSource->qsHash, uSource->bVerified, uSource->peerCertificateChain());
+	int id = authenticate(uSource->qsName, pw, static_cast< int >(uSource->uiSession),
+						  uSource->clientDetails().qslEmail, uSource->qsHash, uSource->bVerified,
+						  uSource->peerCertificateChain());
+	uSource->m_derivedPassword.reset();
 
 	uSource->iId = id >= 0 ? id : -1;
 
@@ -340,14 +517,35 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 	// Setup UDP encryption
 	{
-		QMutexLocker l(&uSource->qmCrypt);
+		// Use the first mode of the client's list that we support as well. Clients that don't send a list
+		// (or one that only contains modes we don't know) keep using OCB2-AES128.
+		CryptMode mode = CryptMode::OCB2_AES128;
+		for (int i = 0; i < msg.crypt_modes_size(); ++i) {
+			const CryptMode candidate = static_cast< CryptMode >(msg.crypt_modes(i));
+			if (CryptState::isSupported(candidate)) {
+				mode = candidate;
+				break;
+			}
+		}
 
-		uSource->csCrypt->genKey();
+		std::unique_ptr< CryptState > crypt = CryptState::create(mode);
+		crypt->genKey();
 
 		MumbleProto::CryptSetup mpcrypt;
-		mpcrypt.set_key(uSource->csCrypt->getRawKey());
-		mpcrypt.set_server_nonce(uSource->csCrypt->getEncryptIV());
-		mpcrypt.set_client_nonce(uSource->csCrypt->getDecryptIV());
+		mpcrypt.set_key(crypt->getRawKey());
+		mpcrypt.set_server_nonce(crypt->getEncryptIV());
+		mpcrypt.set_client_nonce(crypt->getDecryptIV());
+		if (mode != CryptMode::OCB2_AES128) {
+			mpcrypt.set_mode(static_cast< MumbleProto::CryptSetup_Mode >(mode));
+		}
+
+		// The voice threads use the crypt state without locking it as a whole, so the new one may only
+		// be swapped in while none of them is running. The old one is destroyed once the lock is released.
+		{
+			QWriteLocker wl(&qrwlVoiceThread);
+			std::swap(uSource->csCrypt, crypt);
+		}
+
 		sendMessage(uSource, mpcrypt);
 	}
 
@@ -359,7 +557,12 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		uSource->qlCodecs.append(static_cast< qint32 >(0x8000000b));
 		fake_celt_support = true;
 	}
-	uSource->bOpus = msg.opus();
+	uSource->bOpus               = msg.opus();
+	uSource->bStateSnapshot      = msg.state_snapshot();
+	uSource->bVoiceRedundancy    = msg.voice_redundancy();
+	uSource->bPluginDataBatches  = msg.plugin_data_batches();
+	uSource->bTextMessageHistory = msg.text_message_history();
+	uSource->bSmallAudioFrames   = msg.small_audio_frames();
 	recheckCodecVersions(uSource);
 
 	MumbleProto::CodecVersion mpcv;
@@ -376,10 +579,11 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 						  "talk to or hear most clients. Please make sure your client was built with CELT support."));
 	}
 
-	// Transmit channel tree
+	// Transmit channel tree, unless it has been sent as a snapshot
 	QQueue< Channel * > q;
 	QSet< Channel * > chans;
-	q << root;
+	if (!uSource->bStateSnapshot || !sendChannelSnapshot(uSource))
+		q << root;
 	MumbleProto::ChannelState mpcs;
 
 	while (!q.isEmpty()) {
@@ -388,22 +592,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 
 		mpcs.Clear();
 
-		mpcs.set_channel_id(c->iId);
-		if (c->cParent)
-			mpcs.set_parent(c->cParent->iId);
-		if (c->iId == 0)
-			mpcs.set_name(u8(qsRegName.isEmpty() ? QLatin1String("Root") : qsRegName));
-		else
-			mpcs.set_name(u8(c->qsName));
-
-		mpcs.set_position(c->iPosition);
-
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !c->qbaDescHash.isEmpty())
-			mpcs.set_description_hash(blob(c->qbaDescHash));
-		else if (!c->qsDesc.isEmpty())
-			mpcs.set_description(u8(c->qsDesc));
-
-		mpcs.set_max_users(c->uiMaxUsers);
+		setChannelState(mpcs, c, uSource->m_version >= Version::fromComponents(1, 2, 2));
 
 		// Include info about enter restrictions of this channel
 		mpcs.set_is_enter_restricted(isChannelEnterRestricted(c));
@@ -418,16 +607,13 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	// Transmit links
 	foreach (c, chans) {
 		if (c->qhLinks.count() > 0) {
-			mpcs.Clear();
-			mpcs.set_channel_id(c->iId);
-
-			foreach (Channel *l, c->qhLinks.keys())
-				mpcs.add_links(l->iId);
+			setChannelLinks(mpcs, c);
 			sendMessage(uSource, mpcs);
 		}
 	}
 
 	loadChannelListenersOf(*uSource);
+	restoreWhisperTargets(*uSource);
 
 	// Transmit user profile
 	MumbleProto::UserState mpus;
@@ -444,7 +630,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	if (uSource->iId >= 0) {
 		mpus.set_user_id(static_cast< unsigned int >(uSource->iId));
 
-		hashAssign(uSource->qbaTexture, uSource->qbaTextureHash, getUserTexture(uSource->iId));
+		uSource->qbaTexture = getUserTexture(uSource->iId, &uSource->qbaTextureHash);
 
 		if (!uSource->qbaTextureHash.isEmpty())
 			mpus.set_texture_hash(blob(uSource->qbaTextureHash));
@@ -475,68 +661,37 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		mpus.set_comment(u8(uSource->qsComment));
 	sendAll(mpus, Version::fromComponents(1, 2, 2), Version::CompareMode::LessThan);
 
-	// Transmit other users profiles
+	// Transmit other users profiles, unless they have been sent as a snapshot
+	const bool usersSent = uSource->bStateSnapshot && sendUserSnapshot(uSource);
 	foreach (ServerUser *u, qhUsers) {
+		if (usersSent)
+			break;
+
 		if (u->sState != ServerUser::Authenticated)
 			continue;
 
 		if (u == uSource)
 			continue;
 
+		const bool hashes = uSource->m_version >= Version::fromComponents(1, 2, 2);
+
 		mpus.Clear();
-		mpus.set_session(u->uiSession);
-		mpus.set_name(u8(u->qsName));
-		if (u->iId >= 0)
-			mpus.set_user_id(static_cast< unsigned int >(u->iId));
-		if (uSource->m_version >= Version::fromComponents(1, 2, 2)) {
-			if (!u->qbaTextureHash.isEmpty())
-				mpus.set_texture_hash(blob(u->qbaTextureHash));
-			else if (!u->qbaTexture.isEmpty())
-				mpus.set_texture(blob(u->qbaTexture));
-		} else if ((uSource->qbaTexture.length() >= 4)
-				   && (qFromBigEndian< unsigned int >(
-						   reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
-					   == 600 * 60 * 4)) {
+		setUserState(mpus, u, hashes);
+		if (!hashes && (uSource->qbaTexture.length() >= 4)
+			&& (qFromBigEndian< unsigned int >(
+					reinterpret_cast< const unsigned char * >(uSource->qbaTexture.constData()))
+				== 600 * 60 * 4)) {
 			mpus.set_texture(blob(u->qbaTexture));
 		}
-		if (u->cChannel->iId != 0)
-			mpus.set_channel_id(u->cChannel->iId);
-		if (u->bDeaf)
-			mpus.set_deaf(true);
-		else if (u->bMute)
-			mpus.set_mute(true);
-		if (u->bSuppress)
-			mpus.set_suppress(true);
-		if (u->bPrioritySpeaker)
-			mpus.set_priority_speaker(true);
-		if (u->bRecording)
-			mpus.set_recording(true);
-		if (u->bSelfDeaf)
-			mpus.set_self_deaf(true);
-		else if (u->bSelfMute)
-			mpus.set_self_mute(true);
-		if ((uSource->m_version >= Version::fromComponents(1, 2, 2)) && !u->qbaCommentHash.isEmpty())
-			mpus.set_comment_hash(blob(u->qbaCommentHash));
-		else if (!u->qsComment.isEmpty())
-			mpus.set_comment(u8(u->qsComment));
-		if (!u->qsHash.isEmpty())
-			mpus.set_hash(u8(u->qsHash));
-
-
-		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
-			mpus.add_listening_channel_add(channelID);
-
-			if (broadcastListenerVolumeAdjustments) {
-				VolumeAdjustment volume = m_channelListenerManager.getListenerVolumeAdjustment(u->uiSession, channelID);
-				MumbleProto::UserState::VolumeAdjustment *adjustment = mpus.add_listening_volume_adjustment();
-				adjustment->set_listening_channel(channelID);
-				adjustment->set_volume_adjustment(volume.factor);
-			}
-		}
 
 		sendMessage(uSource, mpus);
 	}
 
+	if (m_cluster) {
+		// The users of the other nodes are known to the clients, but not part of the snapshots
+		m_cluster->sendRemoteUsers(uSource);
+	}
+
 	// Send synchronisation packet
 	MumbleProto::ServerSync mpss;
 	mpss.set_session(uSource->uiSession);
@@ -547,9 +702,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	if (uSource->iId == 0) {
 		mpss.set_permissions(ChanACL::All);
 	} else {
-		QMutexLocker qml(&qmCache);
-		ChanACL::hasPermission(uSource, root, ChanACL::Enter, &acCache);
-		mpss.set_permissions(acCache.value(uSource)->value(root));
+		mpss.set_permissions(effectivePermissions(uSource, root) | ChanACL::Cached);
 	}
 
 	sendMessage(uSource, mpss);
@@ -593,8 +746,19 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 	mpsc.set_image_message_length(static_cast< unsigned int >(iMaxImageMessageLength));
 	mpsc.set_max_users(static_cast< unsigned int >(iMaxUsers));
 	mpsc.set_recording_allowed(allowRecording);
+	mpsc.set_plugin_data_batches(true);
+	if (quantizeListenerVolumes) {
+		mpsc.set_listener_volumes_quantized(true);
+	}
+	if (m_messageHistory) {
+		mpsc.set_text_message_history(true);
+	}
+	mpsc.set_small_audio_frames(true);
 	sendMessage(uSource, mpsc);
 
+	// The client has been put into its channel before it has been authenticated
+	sendMessageHistory(uSource, *uSource->cChannel);
+
 	MumbleProto::SuggestConfig mpsug;
 	if (m_suggestVersion != Version::UNKNOWN) {
 		MumbleProto::setSuggestedVersion(mpsug, m_suggestVersion);
@@ -640,6 +804,7 @@ void Server::msgAuthenticate(ServerUser *uSource, MumbleProto::Authenticate &msg
 		case static_cast< int >(ClientType::BOT):
 			uSource->m_clientType = ClientType::BOT;
 			m_botCount++;
+			updatePingReply();
 			break;
 		case static_cast< int >(ClientType::REGULAR):
 			// No-op (also applies to unknown values of msg.client_type())
@@ -712,6 +877,12 @@ void Server::msgBanList(ServerUser *uSource, MumbleProto::BanList &msg) {
 #endif
 		QSet< Ban > removed = previousBans - newBans;
 		QSet< Ban > added   = newBans - previousBans;
+		for (const Ban &b : removed) {
+			m_banIndex.remove(b);
+		}
+		for (const Ban &b : added) {
+			m_banIndex.insert(b);
+		}
 		foreach (const Ban &b, removed) { log(uSource, QString("Removed ban: %1").arg(b.toString())); }
 		foreach (const Ban &b, added) { log(uSource, QString("New ban: %1").arg(b.toString())); }
 		saveBans();
@@ -740,6 +911,17 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	MSG_SETUP(ServerUser::Authenticated);
 	VICTIM_SETUP;
 
+	if (msg.has_comment()) {
+		if (exceedsTextLimits(msg.comment().size())) {
+			PERM_DENIED_TYPE(TextTooLong);
+			return;
+		}
+		const auto replay = [this, uSource, msg]() mutable { msgUserState(uSource, msg); };
+		if (deferTextValidation(uSource, msg.comment(), replay)) {
+			return;
+		}
+	}
+
 	Channel *root = qhChannels.value(0);
 
 	/*
@@ -875,7 +1057,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		}
 
 
-		if (!isTextAllowed(comment, changed)) {
+		if (!isTextAllowed(uSource, comment, changed)) {
 			PERM_DENIED_TYPE(TextTooLong);
 			return;
 		}
@@ -943,6 +1125,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		bBroadcast = true;
 	}
 
+	bool pluginContextChanged = false;
+
 	// Writing to bSelfMute, bSelfDeaf and ssContext
 	// requires holding a write lock on qrwlVoiceThread.
 	{
@@ -965,6 +1149,7 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		}
 
 		if (msg.has_plugin_context()) {
+			pluginContextChanged      = pDstServerUser->ssContext != msg.plugin_context();
 			pDstServerUser->ssContext = msg.plugin_context();
 
 			// Make sure to clear this from the packet so we don't broadcast it
@@ -972,8 +1157,13 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 		}
 	}
 
+	if (pluginContextChanged) {
+		// Whisper targets are split by whether the receivers share the speaker's positional context
+		invalidateWhisperTargets({}, { pDstServerUser->uiSession });
+	}
+
 	if (msg.has_plugin_identity()) {
-		pDstServerUser->qsIdentity = u8(msg.plugin_identity());
+		pDstServerUser->editClientDetails().qsIdentity = u8(msg.plugin_identity());
 		// Make sure to clear this from the packet so we don't broadcast it
 		msg.clear_plugin_identity();
 	}
@@ -1113,12 +1303,6 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 	bool broadcastingBecauseOfVolumeChange = !bBroadcast && listenerVolumeChanged;
 	bBroadcast                             = bBroadcast || listenerChanged || listenerVolumeChanged;
 
-	if (listenerChanged || listenerVolumeChanged) {
-		// As whisper targets also contain information about ChannelListeners and
-		// their associated volume adjustment, we have to clear the target cache
-		clearWhisperTargetCache();
-	}
-
 
 	bool bDstAclChanged = false;
 	if (msg.has_user_id()) {
@@ -1127,8 +1311,8 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 		info.insert(ServerDB::User_Name, pDstServerUser->qsName);
 		info.insert(ServerDB::User_Hash, pDstServerUser->qsHash);
-		if (!pDstServerUser->qslEmail.isEmpty())
-			info.insert(ServerDB::User_Email, pDstServerUser->qslEmail.first());
+		if (!pDstServerUser->clientDetails().qslEmail.isEmpty())
+			info.insert(ServerDB::User_Email, pDstServerUser->clientDetails().qslEmail.first());
 		int id = registerUser(info);
 		if (id > 0) {
 			pDstServerUser->iId = id;
@@ -1184,10 +1368,6 @@ void Server::msgUserState(ServerUser *uSource, MumbleProto::UserState &msg) {
 
 		if (bDstAclChanged) {
 			clearACLCache(pDstServerUser);
-		} else if (listenerChanged || listenerVolumeChanged) {
-			// We only have to do this if the ACLs didn't change as
-			// clearACLCache calls clearWhisperTargetChache anyways
-			clearWhisperTargetCache();
 		}
 	}
 
@@ -1222,6 +1402,7 @@ void Server::msgUserRemove(ServerUser *uSource, MumbleProto::UserRemove &msg) {
 		b.qdtStart   = QDateTime::currentDateTime().toUTC();
 		b.iDuration  = 0;
 		qlBans << b;
+		m_banIndex.insert(b);
 		saveBans();
 	}
 
@@ -1238,6 +1419,17 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 
 	MSG_SETUP(ServerUser::Authenticated);
 
+	if (msg.has_description()) {
+		if (exceedsTextLimits(msg.description().size())) {
+			PERM_DENIED_TYPE(TextTooLong);
+			return;
+		}
+		const auto replay = [this, uSource, msg]() mutable { msgChannelState(uSource, msg); };
+		if (deferTextValidation(uSource, msg.description(), replay)) {
+			return;
+		}
+	}
+
 	Channel *c = nullptr;
 	Channel *p = nullptr;
 
@@ -1264,7 +1456,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 	if (msg.has_description()) {
 		qsDesc       = u8(msg.description());
 		bool changed = false;
-		if (!isTextAllowed(qsDesc, changed)) {
+		if (!isTextAllowed(uSource, qsDesc, changed)) {
 			PERM_DENIED_TYPE(TextTooLong);
 			return;
 		}
@@ -1356,7 +1548,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny  = ChanACL::None;
 			a->pAllow = ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearACLCacheOfBranch(c);
 		}
 		updateChannel(c);
 
@@ -1483,11 +1675,15 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 		if (p) {
 			log(uSource, QString("Moved channel %1 from %2 to %3").arg(QString(*c), QString(*c->cParent), QString(*p)));
 
+			invalidateWhisperTargetsOfBranch(c);
 			{
 				QWriteLocker wl(&qrwlVoiceThread);
 				c->cParent->removeChannel(c);
 				p->addChannel(c);
 			}
+			invalidateWhisperTargetsOfBranch(c);
+			// The channel now inherits the ACLs and groups of its new parent
+			clearACLCacheOfBranch(c);
 		}
 		if (!qsName.isNull()) {
 			log(uSource, QString("Renamed channel %1 to %2").arg(QString(*c), QString(qsName)));
@@ -1540,15 +1736,25 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 	ZoneScoped;
 
 	MSG_SETUP(ServerUser::Authenticated);
-	QMutexLocker qml(&qmCache);
+
+	if (msg.has_message()) {
+		if (exceedsTextLimits(msg.message().size())) {
+			PERM_DENIED_TYPE(TextTooLong);
+			return;
+		}
+		const auto replay = [this, uSource, msg]() mutable { msgTextMessage(uSource, msg); };
+		if (deferTextValidation(uSource, msg.message(), replay)) {
+			return;
+		}
+	}
 
 	// For signal userTextMessage (RPC consumers)
 	TextMessage tm;
 
-	// List of users to route the message to
-	QSet< ServerUser * > users;
+	// List of users to route the message to (may contain duplicates until the message is sent)
+	std::vector< ServerUser * > users;
 	// List of channels used if dest is a tree of channels
-	QQueue< Channel * > q;
+	std::vector< Channel * > trees;
 
 	RATELIMIT(uSource);
 
@@ -1571,7 +1777,7 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 	QString text = u8(msg.message());
 	bool changed = false;
 
-	if (!isTextAllowed(text, changed)) {
+	if (!isTextAllowed(uSource, text, changed)) {
 		PERM_DENIED_TYPE(TextTooLong);
 		return;
 	}
@@ -1618,21 +1824,12 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 			return;
 		}
 
-		if (!ChanACL::hasPermission(uSource, c, ChanACL::TextMessage, &acCache)) {
+		if (!hasPermission(uSource, c, ChanACL::TextMessage)) {
 			PERM_DENIED(uSource, c, ChanACL::TextMessage);
 			return;
 		}
 
-		// Users directly in that channel
-		foreach (User *p, c->qlUsers) { users.insert(static_cast< ServerUser * >(p)); }
-
-		// Users only listening in that channel
-		foreach (unsigned int session, m_channelListenerManager.getListenersForChannel(c->iId)) {
-			ServerUser *currentUser = qhUsers.value(session);
-			if (currentUser) {
-				users.insert(currentUser);
-			}
-		}
+		addTextMessageReceivers(c, users);
 
 		tm.qlChannels.append(id);
 	}
@@ -1647,32 +1844,25 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 			return;
 		}
 
-		if (!ChanACL::hasPermission(uSource, c, ChanACL::TextMessage, &acCache)) {
+		if (!hasPermission(uSource, c, ChanACL::TextMessage)) {
 			PERM_DENIED(uSource, c, ChanACL::TextMessage);
 			return;
 		}
 
-		q.enqueue(c);
+		trees.push_back(c);
 
 		tm.qlTrees.append(id);
 	}
 
-	// Go through all channels in q and append all users in those channels
+	// Go through all channels in the trees and append all users in those channels
 	// to the list of recipients
-	// Sub-channels are enqued so they are also checked by a later loop-iteration
-	while (!q.isEmpty()) {
-		Channel *c = q.dequeue();
-		if (ChanACL::hasPermission(uSource, c, ChanACL::TextMessage, &acCache)) {
-			foreach (Channel *sub, c->qlChannels) { q.enqueue(sub); }
-			// Users directly in that channel
-			foreach (User *p, c->qlUsers) { users.insert(static_cast< ServerUser * >(p)); }
-			// Users only listening in that channel
-			foreach (unsigned int session, m_channelListenerManager.getListenersForChannel(c->iId)) {
-				ServerUser *currentUser = qhUsers.value(session);
-				if (currentUser) {
-					users.insert(currentUser);
-				}
-			}
+	// Sub-channels are only visited if the sender may write to their parent
+	while (!trees.empty()) {
+		Channel *c = trees.back();
+		trees.pop_back();
+		if (hasPermission(uSource, c, ChanACL::TextMessage)) {
+			trees.insert(trees.end(), c->qlChannels.cbegin(), c->qlChannels.cend());
+			addTextMessageReceivers(c, users);
 		}
 	}
 
@@ -1681,21 +1871,33 @@ void Server::msgTextMessage(ServerUser *uSource, MumbleProto::TextMessage &msg)
 		unsigned int session = msg.session(i);
 		ServerUser *u        = qhUsers.value(session);
 		if (u) {
-			if (!ChanACL::hasPermission(uSource, u->cChannel, ChanACL::TextMessage, &acCache)) {
+			if (!hasPermission(uSource, u->cChannel, ChanACL::TextMessage)) {
 				PERM_DENIED(uSource, u->cChannel, ChanACL::TextMessage);
 				return;
 			}
-			users.insert(u);
+			users.push_back(u);
 		}
 
 		tm.qlSessions.append(session);
 	}
 
-	// Remove the message sender from the list of users to send the message to
-	users.remove(uSource);
+	std::sort(users.begin(), users.end());
+	users.erase(std::unique(users.begin(), users.end()), users.end());
 
-	// Actually send the original message to the affected users
-	foreach (ServerUser *u, users) { sendMessage(u, msg); }
+	// Actually send the original message to the affected users (except for the sender). It is serialized once and
+	// all of them queue the same buffer.
+	QByteArray cache;
+	for (ServerUser *u : users) {
+		if (u != uSource) {
+			u->sendMessage(msg, Mumble::Protocol::TCPMessageType::TextMessage, cache);
+		}
+	}
+
+	if (m_messageHistory) {
+		for (unsigned int channel : tm.qlChannels) {
+			recordTextMessage(*uSource, msg, channel);
+		}
+	}
 
 	// Emit the signal for RPC consumers
 	emit userTextMessage(uSource, tm);
@@ -1868,6 +2070,9 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 
 			QHash< QString, QSet< int > > hOldTemp;
 
+			// The compiled programs refer to the groups that are about to be deleted
+			dropACLPrograms(*c);
+
 			if (Meta::mp.bLogGroupChanges || Meta::mp.bLogACLChanges) {
 				log(uSource, QString::fromLatin1("Updating ACL in channel %1").arg(*c));
 			}
@@ -1935,7 +2140,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			}
 		}
 
-		clearACLCache();
+		clearACLCacheOfBranch(c);
 
 		if (!hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			{
@@ -1953,7 +2158,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->pAllow  = ChanACL::Write | ChanACL::Traverse;
 			}
 
-			clearACLCache();
+			clearACLCacheOfBranch(c);
 		}
 
 
@@ -2007,13 +2212,19 @@ void Server::msgPing(ServerUser *uSource, MumbleProto::Ping &msg) {
 
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 
-	QMutexLocker l(&uSource->qmCrypt);
-
 	uSource->csCrypt->uiRemoteGood   = msg.good();
 	uSource->csCrypt->uiRemoteLate   = msg.late();
 	uSource->csCrypt->uiRemoteLost   = msg.lost();
 	uSource->csCrypt->uiRemoteResync = msg.resync();
 
+	if (uSource->bVoiceRedundancy) {
+		// Clean links don't get the redundant payloads, which saves the bandwidth they take up
+		uSource->m_redundantVoice =
+			VoiceRedundancy::isLossy(msg.good(), msg.lost(), uSource->uiLastRemoteGood, uSource->uiLastRemoteLost);
+	}
+	uSource->uiLastRemoteGood = msg.good();
+	uSource->uiLastRemoteLost = msg.lost();
+
 	uSource->dUDPPingAvg  = msg.udp_ping_avg();
 	uSource->dUDPPingVar  = msg.udp_ping_var();
 	uSource->uiUDPPackets = msg.udp_packets();
@@ -2038,16 +2249,18 @@ void Server::msgCryptSetup(ServerUser *uSource, MumbleProto::CryptSetup &msg) {
 
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 
-	QMutexLocker l(&uSource->qmCrypt);
-
 	if (!msg.has_client_nonce()) {
 		log(uSource, "Requested crypt-nonce resync");
-		msg.set_server_nonce(uSource->csCrypt->getEncryptIV());
+		{
+			QMutexLocker l(&uSource->qmCrypt);
+			msg.set_server_nonce(uSource->csCrypt->getEncryptIV());
+		}
 		sendMessage(uSource, msg);
 	} else {
-		const std::string &str = msg.client_nonce();
+		QMutexLocker l(&uSource->qmDecrypt);
+
 		uSource->csCrypt->uiResync++;
-		if (!uSource->csCrypt->setDecryptIV(str)) {
+		if (!uSource->csCrypt->setDecryptIV(msg.client_nonce())) {
 			qWarning("Messages: Cipher resync failed: Invalid nonce from the client!");
 		}
 	}
@@ -2091,21 +2304,22 @@ void Server::msgVersion(ServerUser *uSource, MumbleProto::Version &msg) {
 
 	uSource->m_version = MumbleProto::getVersion(msg);
 	if (msg.has_release()) {
-		uSource->qsRelease = convertWithSizeRestriction(msg.release(), 100);
+		uSource->editClientDetails().qsRelease = convertWithSizeRestriction(msg.release(), 100);
 	}
 	if (msg.has_os()) {
-		uSource->qsOS = convertWithSizeRestriction(msg.os(), 40);
+		uSource->editClientDetails().qsOS = convertWithSizeRestriction(msg.os(), 40);
 
 		if (msg.has_os_version()) {
-			uSource->qsOSVersion = convertWithSizeRestriction(msg.os_version(), 60);
+			uSource->editClientDetails().qsOSVersion = convertWithSizeRestriction(msg.os_version(), 60);
 		}
 	}
 
+	const ServerUser::ClientDetails &details = uSource->clientDetails();
 	log(uSource, QString("Client version %1 (%2 %3: %4)")
 					 .arg(Version::toString(uSource->m_version))
-					 .arg(uSource->qsOS)
-					 .arg(uSource->qsOSVersion)
-					 .arg(uSource->qsRelease));
+					 .arg(details.qsOS)
+					 .arg(details.qsOSVersion)
+					 .arg(details.qsRelease));
 }
 
 void Server::msgUserList(ServerUser *uSource, MumbleProto::UserList &msg) {
@@ -2194,15 +2408,9 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 	if ((target < 1) || (target >= 0x1f))
 		return;
 
-	QWriteLocker lock(&qrwlVoiceThread);
-
-	uSource->qmTargetCache.remove(target);
-
+	WhisperTarget wt;
 	int count = msg.targets_size();
-	if (count == 0) {
-		uSource->qmTargets.remove(target);
-	} else {
-		WhisperTarget wt;
+	if (count > 0) {
 		for (int i = 0; i < count; ++i) {
 			const MumbleProto::VoiceTarget_Target &t = msg.targets(i);
 			for (int j = 0; j < t.session_size(); ++j) {
@@ -2223,11 +2431,45 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 				}
 			}
 		}
-		if (wt.qlSessions.isEmpty() && wt.qlChannels.isEmpty())
-			uSource->qmTargets.remove(target);
-		else
-			uSource->qmTargets.insert(target, wt);
 	}
+
+	// Clients re-send their targets on every connect and whenever a shortcut with a dynamic target is pressed. Most
+	// of the time nothing has changed, in which case the cache is kept.
+	const bool removal = wt.qlSessions.isEmpty() && wt.qlChannels.isEmpty();
+	auto existing      = uSource->qmTargets.constFind(target);
+	if (removal ? existing == uSource->qmTargets.constEnd()
+				: (existing != uSource->qmTargets.constEnd() && existing.value() == wt)) {
+		return;
+	}
+
+	// The voice threads only know about the targets in the published VoiceState, so the target may be changed right
+	// away
+	uSource->qmTargetCache.remove(target);
+	if (removal) {
+		uSource->qmTargets.remove(target);
+	} else {
+		uSource->qmTargets.insert(target, wt);
+	}
+
+	if (m_voiceTrace) {
+		VoiceTrace::Event event;
+		event.type    = VoiceTrace::EventType::WhisperTarget;
+		event.session = uSource->uiSession;
+		event.target  = static_cast< unsigned int >(target);
+
+		const WhisperTarget wt = uSource->qmTargets.value(target);
+		event.sessions.assign(wt.qlSessions.cbegin(), wt.qlSessions.cend());
+		for (const WhisperTarget::Channel &wtc : wt.qlChannels) {
+			event.channels.push_back({ static_cast< unsigned int >(wtc.iId), wtc.bChildren, wtc.bLinks,
+									   !wtc.qsGroup.isEmpty() });
+		}
+		m_voiceTrace->record(std::move(event));
+	}
+
+	// The table is rebuilt (or dropped) by the main thread, so that the voice threads never have to do that
+	// themselves
+	m_staleWhisperTargets.insert(qMakePair(uSource->uiSession, target));
+	scheduleVoiceStatePublication();
 }
 
 void Server::msgPermissionQuery(ServerUser *uSource, MumbleProto::PermissionQuery &msg) {
@@ -2250,8 +2492,7 @@ void Server::msgUserStats(ServerUser *uSource, MumbleProto::UserStats &msg) {
 
 	MSG_SETUP_NO_UNIDLE(ServerUser::Authenticated);
 	VICTIM_SETUP;
-	const BandwidthRecord &bwr            = pDstServerUser->bwr;
-	const QList< QSslCertificate > &certs = pDstServerUser->peerCertificateChain();
+	const BandwidthRecord &bwr = pDstServerUser->bwr;
 
 	bool extend = (uSource == pDstServerUser) || hasPermission(uSource, qhChannels.value(0), ChanACL::Register);
 
@@ -2270,9 +2511,8 @@ void Server::msgUserStats(ServerUser *uSource, MumbleProto::UserStats &msg) {
 	msg.set_session(pDstServerUser->uiSession);
 
 	if (details) {
-		foreach (const QSslCertificate &cert, certs) {
-			const QByteArray &der = cert.toDer();
-			msg.add_certificates(blob(der));
+		for (const std::string &der : pDstServerUser->certificateChainDer()) {
+			msg.add_certificates(der);
 		}
 		msg.set_strong_certificate(pDstServerUser->bVerified);
 	}
@@ -2280,8 +2520,6 @@ void Server::msgUserStats(ServerUser *uSource, MumbleProto::UserStats &msg) {
 	if (local) {
 		MumbleProto::UserStats_Stats *mpusss;
 
-		QMutexLocker l(&pDstServerUser->qmCrypt);
-
 		mpusss = msg.mutable_from_client();
 		mpusss->set_good(pDstServerUser->csCrypt->uiGood);
 		mpusss->set_late(pDstServerUser->csCrypt->uiLate);
@@ -2309,13 +2547,14 @@ void Server::msgUserStats(ServerUser *uSource, MumbleProto::UserStats &msg) {
 		if (pDstServerUser->m_version != Version::UNKNOWN) {
 			MumbleProto::setVersion(*mpv, pDstServerUser->m_version);
 		}
-		if (!pDstServerUser->qsRelease.isEmpty()) {
-			mpv->set_release(u8(pDstServerUser->qsRelease));
+		const ServerUser::ClientDetails &details = pDstServerUser->clientDetails();
+		if (!details.qsRelease.isEmpty()) {
+			mpv->set_release(u8(details.qsRelease));
 		}
-		if (!pDstServerUser->qsOS.isEmpty()) {
-			mpv->set_os(u8(pDstServerUser->qsOS));
-			if (!pDstServerUser->qsOSVersion.isEmpty())
-				mpv->set_os_version(u8(pDstServerUser->qsOSVersion));
+		if (!details.qsOS.isEmpty()) {
+			mpv->set_os(u8(details.qsOS));
+			if (!details.qsOSVersion.isEmpty())
+				mpv->set_os_version(u8(details.qsOSVersion));
 		}
 
 		foreach (int v, pDstServerUser->qlCodecs)
@@ -2351,7 +2590,7 @@ void Server::msgRequestBlob(ServerUser *uSource, MumbleProto::RequestBlob &msg)
 			if (c && !c->qsDesc.isEmpty()) {
 				mpcs.set_channel_id(id);
 				mpcs.set_description(u8(c->qsDesc));
-				sendMessage(uSource, mpcs);
+				sendBlob(uSource, mpcs, Mumble::Protocol::TCPMessageType::ChannelState);
 			}
 		}
 	}
@@ -2363,7 +2602,7 @@ void Server::msgRequestBlob(ServerUser *uSource, MumbleProto::RequestBlob &msg)
 			if (su && !su->qbaTexture.isEmpty()) {
 				mpus.set_session(session);
 				mpus.set_texture(blob(su->qbaTexture));
-				sendMessage(uSource, mpus);
+				sendBlob(uSource, mpus, Mumble::Protocol::TCPMessageType::UserState);
 			}
 		}
 		if (ntextures)
@@ -2374,7 +2613,7 @@ void Server::msgRequestBlob(ServerUser *uSource, MumbleProto::RequestBlob &msg)
 			if (su && !su->qsComment.isEmpty()) {
 				mpus.set_session(session);
 				mpus.set_comment(u8(su->qsComment));
-				sendMessage(uSource, mpus);
+				sendBlob(uSource, mpus, Mumble::Protocol::TCPMessageType::UserState);
 			}
 		}
 	}
@@ -2386,49 +2625,34 @@ void Server::msgServerConfig(ServerUser *, MumbleProto::ServerConfig &) {
 void Server::msgSuggestConfig(ServerUser *, MumbleProto::SuggestConfig &) {
 }
 
-void Server::msgPluginDataTransmission(ServerUser *sender, MumbleProto::PluginDataTransmission &msg) {
-	ZoneScoped;
-
-	// A client's plugin has sent us a message that we shall delegate to its receivers
-
-	if (sender->m_pluginMessageBucket.ratelimit(1)) {
-		qWarning("Dropping plugin message sent from \"%s\" (%d)", qUtf8Printable(sender->qsName), sender->uiSession);
-		return;
-	}
-
+bool Server::preparePluginData(ServerUser *sender, MumbleProto::PluginDataTransmission &msg,
+								QList< ServerUser * > &receivers) {
 	if (!msg.has_data() || !msg.has_dataid()) {
 		// Messages without data and/or without a data ID can't be used by the clients. Thus we don't even have to send
 		// them
-		return;
+		return false;
 	}
 
 	if (msg.data().size() > Mumble::Plugins::PluginMessage::MAX_DATA_LENGTH) {
 		qWarning("Dropping plugin message sent from \"%s\" (%d) - data too large", qUtf8Printable(sender->qsName),
 				 sender->uiSession);
-		return;
+		return false;
 	}
 	if (msg.dataid().size() > Mumble::Plugins::PluginMessage::MAX_DATA_ID_LENGTH) {
 		qWarning("Dropping plugin message sent from \"%s\" (%d) - data ID too long", qUtf8Printable(sender->qsName),
 				 sender->uiSession);
-		return;
+		return false;
 	}
 
 	// Always set the sender's session and don't rely on it being set correctly (would
 	// allow spoofing the sender's session)
 	msg.set_sendersession(sender->uiSession);
 
-	// Copy needed data from message in order to be able to remove info about receivers from the message as this doesn't
-	// matter for the client
-	size_t receiverAmount = static_cast< std::size_t >(msg.receiversessions_size());
-	const ::google::protobuf::RepeatedField<::google::protobuf::uint32 > receiverSessions = msg.receiversessions();
-
-	msg.clear_receiversessions();
-
 	QSet< uint32_t > uniqueReceivers;
-	uniqueReceivers.reserve(receiverSessions.size());
+	uniqueReceivers.reserve(msg.receiversessions_size());
 
-	for (int i = 0; static_cast< size_t >(i) < receiverAmount; i++) {
-		uint32_t userSession = receiverSessions.Get(i);
+	for (int i = 0; i < msg.receiversessions_size(); i++) {
+		uint32_t userSession = msg.receiversessions(i);
 
 		if (!uniqueReceivers.contains(userSession)) {
 			uniqueReceivers.insert(userSession);
@@ -2437,13 +2661,137 @@ void Server::msgPluginDataTransmission(ServerUser *sender, MumbleProto::PluginDa
 			continue;
 		}
 
-		ServerUser *receiver = qhUsers.value(receiverSessions.Get(i));
+		ServerUser *receiver = qhUsers.value(userSession);
 
 		if (receiver) {
-			// We can simply redirect the message we have received to the clients
-			sendMessage(receiver, msg);
+			receivers << receiver;
 		}
 	}
+
+	// The info about the receivers doesn't matter for the clients
+	msg.clear_receiversessions();
+
+	return true;
+}
+
+void Server::relayPluginData(const std::vector< MumbleProto::PluginDataTransmission > &messages,
+							 const std::vector< QList< ServerUser * > > &receivers) {
+	// Every message is serialized once, no matter how many receivers it has
+	std::vector< QByteArray > frames(messages.size());
+	// The messages (by index) each receiver that can process batches gets, in order
+	QHash< ServerUser *, QVector< int > > batchedMessages;
+
+	for (std::size_t i = 0; i < messages.size(); i++) {
+		Connection::messageToNetwork(messages[i], Mumble::Protocol::TCPMessageType::PluginDataTransmission, frames[i]);
+
+		for (ServerUser *receiver : receivers[i]) {
+			if (receiver->bPluginDataBatches && messages.size() > 1) {
+				batchedMessages[receiver] << static_cast< int >(i);
+			} else {
+				receiver->sendMessage(frames[i]);
+			}
+		}
+	}
+
+	// Receivers that get the same messages (which is the common case) share the serialized batch
+	QHash< QVector< int >, QByteArray > batches;
+
+	for (auto it = batchedMessages.cbegin(); it != batchedMessages.cend(); ++it) {
+		const QVector< int > &indices = it.value();
+
+		if (indices.size() == 1) {
+			it.key()->sendMessage(frames[static_cast< std::size_t >(indices.first())]);
+			continue;
+		}
+
+		QByteArray &batch = batches[indices];
+		if (batch.isEmpty()) {
+			QByteArray data;
+			for (int index : indices) {
+				data.append(frames[static_cast< std::size_t >(index)]);
+			}
+
+			MumbleProto::PluginDataBatch mpdb;
+			MumbleProto::setPluginDataBatchData(mpdb, data);
+			Connection::messageToNetwork(mpdb, Mumble::Protocol::TCPMessageType::PluginDataBatch, batch);
+		}
+
+		it.key()->sendMessage(batch);
+	}
+}
+
+void Server::msgPluginDataTransmission(ServerUser *sender, MumbleProto::PluginDataTransmission &msg) {
+	ZoneScoped;
+
+	// A client's plugin has sent us a message that we shall delegate to its receivers
+
+	if (sender->m_pluginMessageBucket.ratelimit(1)) {
+		qWarning("Dropping plugin message sent from \"%s\" (%d)", qUtf8Printable(sender->qsName), sender->uiSession);
+		return;
+	}
+
+	std::vector< QList< ServerUser * > > receivers(1);
+	if (!preparePluginData(sender, msg, receivers.front())) {
+		return;
+	}
+
+	relayPluginData({ msg }, receivers);
+}
+
+void Server::msgPluginDataBatch(ServerUser *sender, MumbleProto::PluginDataBatch &msg) {
+	ZoneScoped;
+
+	// A client has batched the messages of its plugins, which only counts as a single message towards the rate limit
+
+	if (sender->m_pluginMessageBucket.ratelimit(1)) {
+		qWarning("Dropping plugin message batch sent from \"%s\" (%d)", qUtf8Printable(sender->qsName),
+				 sender->uiSession);
+		return;
+	}
+
+	std::vector< MumbleProto::PluginDataTransmission > transmissions;
+	if (!MumbleProto::getPluginDataBatchTransmissions(msg, transmissions)) {
+		qWarning("Dropping plugin message batch sent from \"%s\" (%d) - invalid batch", qUtf8Printable(sender->qsName),
+				 sender->uiSession);
+		return;
+	}
+
+	std::vector< MumbleProto::PluginDataTransmission > messages;
+	std::vector< QList< ServerUser * > > receivers;
+	messages.reserve(transmissions.size());
+	receivers.reserve(transmissions.size());
+
+	for (MumbleProto::PluginDataTransmission &transmission : transmissions) {
+		QList< ServerUser * > messageReceivers;
+		if (preparePluginData(sender, transmission, messageReceivers)) {
+			messages.push_back(std::move(transmission));
+			receivers.push_back(std::move(messageReceivers));
+		}
+	}
+
+	relayPluginData(messages, receivers);
+}
+
+void Server::msgStateSnapshot(ServerUser *, MumbleProto::StateSnapshot &) {
+}
+
+void Server::msgTextMessageHistory(ServerUser *uSource, MumbleProto::TextMessageHistory &msg) {
+	ZoneScoped;
+
+	MSG_SETUP(ServerUser::Authenticated);
+	RATELIMIT(uSource);
+
+	Channel *c = qhChannels.value(msg.channel_id());
+	if (!c) {
+		return;
+	}
+
+	// Only the users that would be sent the channel's messages by now may read the ones that have been sent before
+	if (c != uSource->cChannel && !m_channelListenerManager.isListening(uSource->uiSession, c->iId)) {
+		return;
+	}
+
+	sendMessageHistory(uSource, *c, msg.has_page() ? static_cast< qint64 >(msg.page()) : -1);
 }
 
 #undef RATELIMIT
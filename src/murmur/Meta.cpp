@@ -5,18 +5,24 @@
 
 #include "Meta.h"
 
+#include "Audit.h"
 #include "Connection.h"
 #include "EnvUtils.h"
 #include "FFDHE.h"
+#include "MetricsServer.h"
 #include "Net.h"
 #include "OSInfo.h"
+#include "RegistrationWorker.h"
 #include "SSL.h"
 #include "Server.h"
 #include "ServerDB.h"
 #include "Version.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
 #include <QtCore/QSettings>
+#include <QtCore/QThreadPool>
 
 #ifdef Q_OS_WIN
 #	include <QtCore/QStandardPaths>
@@ -33,12 +39,16 @@
 #else
 #	include <pwd.h>
 #	include <sys/resource.h>
+#	include <unistd.h>
 #endif
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
 #	include <QRandomGenerator>
 #endif
 
+#include <algorithm>
+#include <vector>
+
 MetaParams Meta::mp;
 
 #ifdef Q_OS_WIN
@@ -70,12 +80,23 @@ MetaParams::MetaParams() {
 	qsDatabase                 = QString();
 	iSQLiteWAL                 = 0;
 	iDBPort                    = 0;
+	bDBWriteBehind             = true;
+	iDBReplicaPort             = 0;
 	qsDBusService              = "net.sourceforge.mumble.murmur";
 	qsDBDriver                 = "QSQLITE";
 	qsLogfile                  = "mumble-server.log";
 
 	iLogDays = 31;
 
+	iIceSnapshotAge = 1000;
+
+	iMetricsPort  = 0;
+	qsMetricsHost = QLatin1String("127.0.0.1");
+
+	iUserCacheSize = 10000;
+	iUserCacheTTL  = 600;
+	iBlobCacheSize = 32;
+
 	iObfuscate         = 0;
 	bSendVersion       = true;
 	bBonjour           = true;
@@ -83,10 +104,11 @@ MetaParams::MetaParams() {
 	bCertRequired      = false;
 	bForceExternalAuth = false;
 
-	iBanTries      = 10;
-	iBanTimeframe  = 120;
-	iBanTime       = 300;
-	bBanSuccessful = true;
+	iBanTries            = 10;
+	iBanTimeframe        = 120;
+	iBanTime             = 300;
+	bBanSuccessful       = true;
+	iBanTrackedAddresses = 65536;
 
 #ifdef Q_OS_UNIX
 	uiUid = uiGid = 0;
@@ -97,8 +119,8 @@ MetaParams::MetaParams() {
 	iChannelNestingLimit = 10;
 	iChannelCountLimit   = 1000;
 
-	qrUserName    = QRegExp(QLatin1String("[ -=\\w\\[\\]\\{\\}\\(\\)\\@\\|\\.]+"));
-	qrChannelName = QRegExp(QLatin1String("[ -=\\w\\#\\[\\]\\{\\}\\(\\)\\@\\|]+"));
+	qrUserName    = NamePattern(QLatin1String("[ -=\\w\\[\\]\\{\\}\\(\\)\\@\\|\\.]+"));
+	qrChannelName = NamePattern(QLatin1String("[ -=\\w\\#\\[\\]\\{\\}\\(\\)\\@\\|]+"));
 
 	iMessageLimit = 1;
 	iMessageBurst = 5;
@@ -106,9 +128,35 @@ MetaParams::MetaParams() {
 	iPluginMessageLimit = 4;
 	iPluginMessageBurst = 15;
 
+	pingLimit = 5;
+	pingBurst = 10;
+
 	broadcastListenerVolumeAdjustments = false;
 
-	qsCiphers = MumbleSSL::defaultOpenSSLCipherString();
+	udpReceiveBatchSize = 32;
+	udpOffload          = false;
+	voiceThreads        = 1;
+	ioUring             = false;
+	registeredIO        = false;
+	voiceThreadCPUs     = QString();
+	voiceThreadNode     = -1;
+	udpBusyPoll         = 0;
+	udpSpinTime         = 0;
+	udpDSCP             = 0;
+	tlsThreads            = 0;
+	bootThreads           = 1;
+	iHandoffDrain         = 30;
+	sendQueueVoiceBytes   = 64 * 1024;
+	sendQueueControlBytes = 32 * 1024 * 1024;
+	sendQueueBulkBytes    = 16 * 1024 * 1024;
+
+	clusterNode     = 0;
+	clusterPeers    = QString();
+	clusterPort     = 0;
+	qsClusterSecret = QString();
+
+	qsCiphers             = MumbleSSL::defaultOpenSSLCipherString();
+	generatedKeyAlgorithm = QSsl::Rsa;
 
 	bLogGroupChanges = false;
 	bLogACLChanges   = false;
@@ -301,13 +349,30 @@ void MetaParams::read(QString fname) {
 	qsDBOpts     = typeCheckedFromSettings("dbOpts", qsDBOpts);
 	iDBPort      = typeCheckedFromSettings("dbPort", iDBPort);
 
+	bDBWriteBehind  = typeCheckedFromSettings("dbWriteBehind", bDBWriteBehind);
+	qsDBReplicaHost = typeCheckedFromSettings("dbReplicaHost", qsDBReplicaHost);
+	iDBReplicaPort  = typeCheckedFromSettings("dbReplicaPort", iDBReplicaPort);
+	qsDBTraceFile   = typeCheckedFromSettings("dbTraceFile", qsDBTraceFile);
+
 	qsIceEndpoint    = typeCheckedFromSettings("ice", qsIceEndpoint);
 	qsIceSecretRead  = typeCheckedFromSettings("icesecret", qsIceSecretRead);
 	qsIceSecretRead  = typeCheckedFromSettings("icesecretread", qsIceSecretRead);
 	qsIceSecretWrite = typeCheckedFromSettings("icesecretwrite", qsIceSecretRead);
+	iIceSnapshotAge  = typeCheckedFromSettings("iceSnapshotAge", iIceSnapshotAge);
+
+	iMetricsPort  = typeCheckedFromSettings("metricsPort", iMetricsPort);
+	qsMetricsHost = typeCheckedFromSettings("metricsHost", qsMetricsHost);
+	if (iMetricsPort < 0 || iMetricsPort > 65535) {
+		qCritical("Configuration variable metricsPort has to be in the range [0, 65535]. Disabling the metrics.");
+		iMetricsPort = 0;
+	}
 
 	iLogDays = typeCheckedFromSettings("logdays", iLogDays);
 
+	iUserCacheSize = typeCheckedFromSettings("userCacheSize", iUserCacheSize);
+	iUserCacheTTL  = typeCheckedFromSettings("userCacheTTL", iUserCacheTTL);
+	iBlobCacheSize = typeCheckedFromSettings("blobCacheSize", iBlobCacheSize);
+
 	qsDBus        = typeCheckedFromSettings("dbus", qsDBus);
 	qsDBusService = typeCheckedFromSettings("dbusservice", qsDBusService);
 	qsLogfile     = typeCheckedFromSettings("logfile", qsLogfile);
@@ -320,10 +385,11 @@ void MetaParams::read(QString fname) {
 	qurlRegWeb    = QUrl(typeCheckedFromSettings("registerUrl", qurlRegWeb).toString());
 	bBonjour      = typeCheckedFromSettings("bonjour", bBonjour);
 
-	iBanTries      = typeCheckedFromSettings("autobanAttempts", iBanTries);
-	iBanTimeframe  = typeCheckedFromSettings("autobanTimeframe", iBanTimeframe);
-	iBanTime       = typeCheckedFromSettings("autobanTime", iBanTime);
-	bBanSuccessful = typeCheckedFromSettings("autobanSuccessfulConnections", bBanSuccessful);
+	iBanTries            = typeCheckedFromSettings("autobanAttempts", iBanTries);
+	iBanTimeframe        = typeCheckedFromSettings("autobanTimeframe", iBanTimeframe);
+	iBanTime             = typeCheckedFromSettings("autobanTime", iBanTime);
+	bBanSuccessful       = typeCheckedFromSettings("autobanSuccessfulConnections", bBanSuccessful);
+	iBanTrackedAddresses = typeCheckedFromSettings("autobanTrackedAddresses", iBanTrackedAddresses);
 
 	m_suggestVersion = Version::fromConfig(qsSettings->value("suggestVersion"));
 
@@ -367,8 +433,8 @@ void MetaParams::read(QString fname) {
 	}
 #endif
 
-	qrUserName    = QRegExp(typeCheckedFromSettings("username", qrUserName.pattern()));
-	qrChannelName = QRegExp(typeCheckedFromSettings("channelname", qrChannelName.pattern()));
+	qrUserName    = NamePattern(typeCheckedFromSettings("username", qrUserName.pattern()));
+	qrChannelName = NamePattern(typeCheckedFromSettings("channelname", qrChannelName.pattern()));
 
 	iMessageLimit = typeCheckedFromSettings< unsigned int >("messagelimit", 1);
 	iMessageBurst = typeCheckedFromSettings< unsigned int >("messageburst", 5);
@@ -376,8 +442,88 @@ void MetaParams::read(QString fname) {
 	iPluginMessageLimit = typeCheckedFromSettings< unsigned int >("pluginmessagelimit", 4);
 	iPluginMessageBurst = typeCheckedFromSettings< unsigned int >("pluginmessageburst", 15);
 
+	pingLimit = typeCheckedFromSettings("pingLimit", pingLimit);
+	pingBurst = typeCheckedFromSettings("pingBurst", pingBurst);
+
 	broadcastListenerVolumeAdjustments = typeCheckedFromSettings("broadcastlistenervolumeadjustments", false);
 
+	udpReceiveBatchSize = typeCheckedFromSettings("udpReceiveBatchSize", udpReceiveBatchSize);
+	if (udpReceiveBatchSize < 1 || udpReceiveBatchSize > 1024) {
+		qCritical("Configuration variable udpReceiveBatchSize has to be in the range [1, 1024]. Clamping it.");
+		udpReceiveBatchSize = qBound(1U, udpReceiveBatchSize, 1024U);
+	}
+	udpOffload = typeCheckedFromSettings("udpOffload", udpOffload);
+
+	voiceThreads = typeCheckedFromSettings("voiceThreads", voiceThreads);
+	if (voiceThreads < 1 || voiceThreads > 64) {
+		qCritical("Configuration variable voiceThreads has to be in the range [1, 64]. Clamping it.");
+		voiceThreads = qBound(1U, voiceThreads, 64U);
+	}
+	ioUring      = typeCheckedFromSettings("ioUring", ioUring);
+	registeredIO = typeCheckedFromSettings("registeredIO", registeredIO);
+
+	voiceThreadCPUs = typeCheckedFromSettings("voiceThreadCPUs", voiceThreadCPUs);
+	voiceThreadNode = typeCheckedFromSettings("voiceThreadNode", voiceThreadNode);
+	udpBusyPoll     = typeCheckedFromSettings("udpBusyPoll", udpBusyPoll);
+	if (udpBusyPoll > 10000) {
+		qCritical("Configuration variable udpBusyPoll has to be in the range [0, 10000]. Clamping it.");
+		udpBusyPoll = 10000;
+	}
+	udpSpinTime = typeCheckedFromSettings("udpSpinTime", udpSpinTime);
+	if (udpSpinTime > 10000) {
+		qCritical("Configuration variable udpSpinTime has to be in the range [0, 10000]. Clamping it.");
+		udpSpinTime = 10000;
+	}
+	udpDSCP = typeCheckedFromSettings("udpDSCP", udpDSCP);
+	if (udpDSCP > 63) {
+		qCritical("Configuration variable udpDSCP has to be in the range [0, 63]. Clamping it.");
+		udpDSCP = 63;
+	}
+
+	tlsThreads = typeCheckedFromSettings("tlsThreads", tlsThreads);
+	if (tlsThreads > 64) {
+		qCritical("Configuration variable tlsThreads has to be in the range [0, 64]. Clamping it.");
+		tlsThreads = 64;
+	}
+
+	bootThreads = typeCheckedFromSettings("bootThreads", bootThreads);
+	if (bootThreads < 1 || bootThreads > 64) {
+		qCritical("Configuration variable bootThreads has to be in the range [1, 64]. Clamping it.");
+		bootThreads = qBound(1U, bootThreads, 64U);
+	}
+
+	qsHandoffSocket = typeCheckedFromSettings("handoffSocket", qsHandoffSocket);
+	iHandoffDrain   = typeCheckedFromSettings("handoffDrain", iHandoffDrain);
+	if (iHandoffDrain < 0) {
+		qCritical("Configuration variable handoffDrain must not be negative. Disconnecting all users at once.");
+		iHandoffDrain = 0;
+	}
+
+	sendQueueVoiceBytes   = typeCheckedFromSettings("sendQueueVoiceBytes", sendQueueVoiceBytes);
+	sendQueueControlBytes = typeCheckedFromSettings("sendQueueControlBytes", sendQueueControlBytes);
+	sendQueueBulkBytes    = typeCheckedFromSettings("sendQueueBulkBytes", sendQueueBulkBytes);
+	if (sendQueueVoiceBytes < 0 || sendQueueControlBytes < 0 || sendQueueBulkBytes < 0) {
+		qCritical("Configuration variables sendQueueVoiceBytes, sendQueueControlBytes and sendQueueBulkBytes must not "
+				  "be negative. Clamping them.");
+		sendQueueVoiceBytes   = qMax(sendQueueVoiceBytes, 0);
+		sendQueueControlBytes = qMax(sendQueueControlBytes, 0);
+		sendQueueBulkBytes    = qMax(sendQueueBulkBytes, 0);
+	}
+
+	clusterNode  = typeCheckedFromSettings("clusterNode", clusterNode);
+	clusterPeers = typeCheckedFromSettings("clusterPeers", clusterPeers);
+	clusterPort =
+		static_cast< unsigned short >(typeCheckedFromSettings("clusterPort", static_cast< uint >(clusterPort)));
+	qsClusterSecret = typeCheckedFromSettings("clusterSecret", qsClusterSecret);
+	if (clusterNode > 15) {
+		qCritical("Configuration variable clusterNode has to be in the range [0, 15]. Disabling clustering.");
+		clusterNode = 0;
+	}
+	if (clusterNode > 0 && (clusterPort == 0 || qsClusterSecret.isEmpty())) {
+		qCritical("Clustering requires clusterPort and clusterSecret to be set. Disabling clustering.");
+		clusterNode = 0;
+	}
+
 	bool bObfuscate = typeCheckedFromSettings("obfuscate", false);
 	if (bObfuscate) {
 		qWarning("IP address obfuscation enabled.");
@@ -435,6 +581,25 @@ void MetaParams::read(QString fname) {
 	qmConfig.insert(QLatin1String("opusthreshold"), QString::number(iOpusThreshold));
 	qmConfig.insert(QLatin1String("channelnestinglimit"), QString::number(iChannelNestingLimit));
 	qmConfig.insert(QLatin1String("channelcountlimit"), QString::number(iChannelCountLimit));
+	qmConfig.insert(QLatin1String("udpReceiveBatchSize"), QString::number(udpReceiveBatchSize));
+	qmConfig.insert(QLatin1String("udpOffload"), udpOffload ? QLatin1String("true") : QLatin1String("false"));
+	qmConfig.insert(QLatin1String("voiceThreads"), QString::number(voiceThreads));
+	qmConfig.insert(QLatin1String("ioUring"), ioUring ? QLatin1String("true") : QLatin1String("false"));
+	qmConfig.insert(QLatin1String("registeredIO"), registeredIO ? QLatin1String("true") : QLatin1String("false"));
+	qmConfig.insert(QLatin1String("voiceThreadCPUs"), voiceThreadCPUs);
+	qmConfig.insert(QLatin1String("voiceThreadNode"), QString::number(voiceThreadNode));
+	qmConfig.insert(QLatin1String("udpBusyPoll"), QString::number(udpBusyPoll));
+	qmConfig.insert(QLatin1String("udpSpinTime"), QString::number(udpSpinTime));
+	qmConfig.insert(QLatin1String("tlsThreads"), QString::number(tlsThreads));
+	qmConfig.insert(QLatin1String("bootThreads"), QString::number(bootThreads));
+	qmConfig.insert(QLatin1String("handoffSocket"), qsHandoffSocket);
+	qmConfig.insert(QLatin1String("handoffDrain"), QString::number(iHandoffDrain));
+	qmConfig.insert(QLatin1String("sendQueueVoiceBytes"), QString::number(sendQueueVoiceBytes));
+	qmConfig.insert(QLatin1String("sendQueueControlBytes"), QString::number(sendQueueControlBytes));
+	qmConfig.insert(QLatin1String("sendQueueBulkBytes"), QString::number(sendQueueBulkBytes));
+	qmConfig.insert(QLatin1String("clusterNode"), QString::number(clusterNode));
+	qmConfig.insert(QLatin1String("clusterPeers"), clusterPeers);
+	qmConfig.insert(QLatin1String("clusterPort"), QString::number(clusterPort));
 	qmConfig.insert(QLatin1String("sslCiphers"), qsCiphers);
 	qmConfig.insert(QLatin1String("sslDHParams"), QString::fromLatin1(qbaDHParams.constData()));
 }
@@ -444,6 +609,8 @@ bool MetaParams::loadSSLSettings() {
 	updatedSettings.setIniCodec("UTF-8");
 
 	QString tmpCiphersStr = typeCheckedFromSettings("sslCiphers", qsCiphers);
+	QString tmpKeyTypeStr =
+		typeCheckedFromSettings("sslGeneratedKeyType", QString(QLatin1String("rsa"))).trimmed().toLower();
 
 	QString qsSSLCert     = qsSettings->value("sslCert").toString();
 	QString qsSSLKey      = qsSettings->value("sslKey").toString();
@@ -619,23 +786,36 @@ bool MetaParams::loadSSLSettings() {
 		qWarning("MetaParams: TLS cipher preference is \"%s\"", qPrintable(pref.join(QLatin1String(":"))));
 	}
 
-	qscCert         = tmpCert;
-	qlCA            = tmpCA;
-	qlIntermediates = tmpIntermediates;
-	qskKey          = tmpKey;
-	qbaDHParams     = tmpDHParams;
-	qsCiphers       = tmpCiphersStr;
-	qlCiphers       = tmpCiphers;
+	QSsl::KeyAlgorithm tmpKeyAlgorithm = QSsl::Rsa;
+	if (tmpKeyTypeStr == QLatin1String("ecdsa")) {
+		tmpKeyAlgorithm = QSsl::Ec;
+	} else if (tmpKeyTypeStr != QLatin1String("rsa")) {
+		qCritical("MetaParams: Invalid sslGeneratedKeyType option \"%s\", generating RSA keys instead",
+				  qPrintable(tmpKeyTypeStr));
+	}
+
+	qscCert               = tmpCert;
+	qlCA                  = tmpCA;
+	qlIntermediates       = tmpIntermediates;
+	qskKey                = tmpKey;
+	qbaDHParams           = tmpDHParams;
+	qsCiphers             = tmpCiphersStr;
+	qlCiphers             = tmpCiphers;
+	generatedKeyAlgorithm = tmpKeyAlgorithm;
 
 	qmConfig.insert(QLatin1String("certificate"), QString::fromUtf8(qscCert.toPem()));
 	qmConfig.insert(QLatin1String("key"), QString::fromUtf8(qskKey.toPem()));
 	qmConfig.insert(QLatin1String("sslCiphers"), qsCiphers);
 	qmConfig.insert(QLatin1String("sslDHParams"), QString::fromLatin1(qbaDHParams.constData()));
+	qmConfig.insert(QLatin1String("sslGeneratedKeyType"),
+					QLatin1String(generatedKeyAlgorithm == QSsl::Ec ? "ecdsa" : "rsa"));
 
 	return true;
 }
 
-Meta::Meta() {
+Meta::Meta()
+	: m_connectionThrottle(static_cast< std::size_t >(std::max(mp.iBanTrackedAddresses, 1))),
+	  m_blobStore(static_cast< std::size_t >(std::max(mp.iBlobCacheSize, 0)) * 1024 * 1024) {
 #ifdef Q_OS_WIN
 	QOS_VERSION qvVer;
 	qvVer.MajorVersion = 1;
@@ -654,9 +834,45 @@ Meta::Meta() {
 			Connection::setQoS(hQoS);
 	}
 #endif
+
+	for (unsigned int i = 0; i < mp.tlsThreads; ++i) {
+		m_tlsThreads.push_back(std::make_unique< QThread >());
+		m_tlsThreads.back()->setObjectName(QString::fromLatin1("TLS %1").arg(i));
+		m_tlsThreads.back()->start();
+	}
+
+	m_registrationWorker = new RegistrationWorker();
+	m_registrationWorker->moveToThread(&m_registrationThread);
+	connect(&m_registrationThread, &QThread::finished, m_registrationWorker, &QObject::deleteLater);
+	connect(m_registrationWorker, &RegistrationWorker::log, this, [this](int serverId, const QString &message) {
+		Server *s = qhServers.value(serverId);
+		if (s) {
+			s->log(message);
+		}
+	});
+	m_registrationThread.setObjectName(QLatin1String("Registration"));
+	m_registrationThread.start();
+
+#ifdef Q_OS_UNIX
+	connect(&m_handoff, &SocketHandoff::requested, this, &Meta::handOver);
+	connect(&m_drainTimer, &QTimer::timeout, this, &Meta::drainStep);
+#endif
+
+#ifdef USE_SERVER_AUDIT
+	connect(&m_auditReport, &QTimer::timeout, this, []() { Audit::report(); });
+	m_auditReport.start(Audit::REPORT_INTERVAL);
+#endif
 }
 
 Meta::~Meta() {
+	m_registrationThread.quit();
+	m_registrationThread.wait();
+
+	for (std::unique_ptr< QThread > &thread : m_tlsThreads) {
+		thread->quit();
+		thread->wait();
+	}
+
 #ifdef Q_OS_WIN
 	if (hQoS) {
 		QOSCloseHandle(hQoS);
@@ -665,22 +881,30 @@ Meta::~Meta() {
 #endif
 }
 
+QThread *Meta::nextTLSThread() {
+	if (m_tlsThreads.empty()) {
+		return nullptr;
+	}
+
+	QThread *thread = m_tlsThreads[m_nextTLSThread].get();
+	m_nextTLSThread = (m_nextTLSThread + 1) % m_tlsThreads.size();
+
+	return thread;
+}
+
 bool Meta::reloadSSLSettings() {
 	// Reload SSL settings.
 	if (!Meta::mp.loadSSLSettings()) {
 		return false;
 	}
 
-	// Re-initialize certificates for all
-	// virtual servers using the Meta server's
-	// certificate and private key.
+	// Re-initialize the certificates of all virtual servers. Even the ones
+	// that have their own certificate may use the Meta server's
+	// Diffie-Hellman parameters. Connections that have already been
+	// established are not affected.
 	foreach (Server *s, qhServers) {
-		if (s->bUsingMetaCert) {
-			s->log("Reloading certificates...");
-			s->initializeCert();
-		} else {
-			s->log("Not reloading certificates; server does not use Meta certificate");
-		}
+		s->log(s->bUsingMetaCert ? "Reloading certificates..." : "Reloading Diffie-Hellman parameters...");
+		s->initializeCert();
 	}
 
 	return true;
@@ -691,18 +915,75 @@ void Meta::getOSInfo() {
 	qsOSVersion = OSInfo::getOSDisplayableVersion();
 }
 
+void Meta::startMetrics() {
+	if (mp.iMetricsPort == 0) {
+		return;
+	}
+
+	m_metricsServer = std::make_unique< MetricsServer >();
+	if (!m_metricsServer->listen(QHostAddress(mp.qsMetricsHost), static_cast< quint16 >(mp.iMetricsPort))) {
+		qCritical("Metrics: Failed to listen on %s:%d", qPrintable(mp.qsMetricsHost), mp.iMetricsPort);
+		m_metricsServer.reset();
+		return;
+	}
+
+	qWarning("Metrics: Endpoint running at http://%s:%d/metrics", qPrintable(mp.qsMetricsHost), mp.iMetricsPort);
+}
+
+namespace {
+/// Reads the state of a server on a worker thread for Meta::bootAll()
+class BootStateLoader : public QRunnable {
+public:
+	BootStateLoader(int srvnum, ServerBootState &state, QSemaphore &loaded)
+		: m_srvnum(srvnum), m_state(state), m_loaded(loaded) {}
+
+	void run() override {
+		m_state = Server::loadBootState(m_srvnum);
+		m_loaded.release();
+	}
+
+protected:
+	int m_srvnum;
+	ServerBootState &m_state;
+	QSemaphore &m_loaded;
+};
+} // namespace
+
 void Meta::bootAll() {
-	QList< int > ql = ServerDB::getBootServers();
-	foreach (int snum, ql)
-		boot(snum);
+	QList< int > ql   = ServerDB::getBootServers();
+	const int threads = std::min(static_cast< int >(mp.bootThreads), ql.size());
+	if (threads <= 1 || !ServerDB::supportsThreadConnections()) {
+		foreach (int snum, ql)
+			boot(snum);
+		return;
+	}
+
+	// Reading their state takes most of the time it takes to boot the servers, so it is read concurrently. The servers
+	// themselves are still created one after another on the main thread, which owns all of them, in the same order
+	// as before.
+	std::vector< ServerBootState > states(static_cast< std::size_t >(ql.size()));
+	std::vector< QSemaphore > loaded(states.size());
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(threads);
+	for (std::size_t i = 0; i < states.size(); ++i) {
+		pool.start(new BootStateLoader(ql[static_cast< int >(i)], states[i], loaded[i]));
+	}
+
+	for (std::size_t i = 0; i < states.size(); ++i) {
+		loaded[i].acquire();
+		boot(ql[static_cast< int >(i)], &states[i]);
+		// The state isn't needed anymore once the server has been created
+		states[i] = ServerBootState();
+	}
 }
 
-bool Meta::boot(int srvnum) {
+bool Meta::boot(int srvnum, const ServerBootState *bootState) {
 	if (qhServers.contains(srvnum))
 		return false;
 	if (!ServerDB::serverExists(srvnum))
 		return false;
-	Server *s = new Server(srvnum, this);
+	Server *s = new Server(srvnum, this, bootState);
 	if (!s->bValid) {
 		delete s;
 		return false;
@@ -743,6 +1024,90 @@ bool Meta::boot(int srvnum) {
 	return true;
 }
 
+#ifdef Q_OS_UNIX
+void Meta::takeOverSockets() {
+	if (mp.qsHandoffSocket.isEmpty()) {
+		return;
+	}
+
+	if (SocketHandoff::takeOver(mp.qsHandoffSocket, m_handoffSockets)) {
+		qWarning("Meta: Took %u sockets over from the running instance",
+				 static_cast< unsigned int >(m_handoffSockets.size()));
+	}
+}
+
+int Meta::takeHandoffSocket(int serverId, int type, const HostAddress &address, unsigned short port) {
+	for (auto it = m_handoffSockets.begin(); it != m_handoffSockets.end(); ++it) {
+		if (it->serverId == serverId && it->type == type && it->address == address && it->port == port) {
+			const int fd = it->fd;
+			m_handoffSockets.erase(it);
+			return fd;
+		}
+	}
+
+	return -1;
+}
+
+void Meta::finishTakeOver() {
+	// Voice sockets that are left open would keep receiving some of the packets (they share their port with the
+	// ones in use)
+	for (const SocketHandoff::Socket &socket : m_handoffSockets) {
+		close(socket.fd);
+	}
+	m_handoffSockets.clear();
+
+	if (!mp.qsHandoffSocket.isEmpty()) {
+		m_handoff.listen(mp.qsHandoffSocket);
+	}
+}
+
+void Meta::handOver(int connection) {
+	std::vector< SocketHandoff::Socket > sockets;
+	foreach (Server *s, qhServers) {
+		s->collectHandoffSockets(sockets);
+	}
+
+	if (!SocketHandoff::sendSockets(connection, sockets)) {
+		qCritical("Meta: Failed to hand the sockets over to the new instance, which will bind its own");
+		return;
+	}
+
+	qWarning("Meta: Handed %u sockets over to the new instance", static_cast< unsigned int >(sockets.size()));
+
+	// There is nothing left to hand over to yet another instance
+	m_handoff.close();
+
+	int users = 0;
+	foreach (Server *s, qhServers) {
+		s->stopForHandoff();
+		users += s->qhUsers.size();
+	}
+
+	// The users are spread over the drain period, so that the new instance doesn't have to handle all of their
+	// reconnects (TLS handshakes, authentication and state synchronization) at once
+	constexpr int STEPS_PER_SECOND = 10;
+	m_drainRate = std::max(1, users / std::max(1, mp.iHandoffDrain * STEPS_PER_SECOND));
+	m_drainDeadline.restart();
+	m_drainTimer.start(1000 / STEPS_PER_SECOND);
+	drainStep();
+}
+
+void Meta::drainStep() {
+	int remaining = 0;
+	foreach (Server *s, qhServers) {
+		remaining += s->drainForHandoff(m_drainRate);
+	}
+
+	// The users that are being disconnected may not answer in time
+	const quint64 deadline = (static_cast< quint64 >(mp.iHandoffDrain) + 10) * 1000000ULL;
+	if (remaining == 0 || m_drainDeadline.isElapsed(deadline)) {
+		m_drainTimer.stop();
+		qWarning("Meta: All users have been handed over, exiting");
+		QCoreApplication::instance()->quit();
+	}
+}
+#endif
+
 void Meta::kill(int srvnum) {
 	Server *s = qhServers.take(srvnum);
 	if (!s)
@@ -759,39 +1124,17 @@ void Meta::killAll() {
 	qhServers.clear();
 }
 
-void Meta::successfulConnectionFrom(const QHostAddress &addr) {
+void Meta::successfulConnectionFrom(const HostAddress &addr) {
 	if (!mp.bBanSuccessful) {
-		QList< Timer > &ql = qhAttempts[addr];
-		// Seems like this is the most efficient way to clear the list, given:
-		// 1. ql.clear() allocates a new array
-		// 2. ql has less than iBanAttempts members
-		// 3. seems like ql.removeFirst() might actually copy elements to shift to the front
-		while (!ql.empty()) {
-			ql.removeLast();
-		}
+		m_connectionThrottle.forgive(addr);
 	}
 }
 
-bool Meta::banCheck(const QHostAddress &addr) {
+ConnectionThrottle::Verdict Meta::banCheck(const HostAddress &addr) {
 	if ((mp.iBanTries <= 0) || (mp.iBanTimeframe <= 0))
-		return false;
-
-	if (qhBans.contains(addr)) {
-		Timer t = qhBans.value(addr);
-		if (t.elapsed() < (1000000ULL * static_cast< unsigned long long >(mp.iBanTime)))
-			return true;
-		qhBans.remove(addr);
-	}
+		return ConnectionThrottle::Verdict::Allowed;
 
-	QList< Timer > &ql = qhAttempts[addr];
-
-	ql.append(Timer());
-	while (!ql.isEmpty() && (ql.at(0).elapsed() > (1000000ULL * static_cast< unsigned long long >(mp.iBanTimeframe))))
-		ql.removeFirst();
-
-	if (ql.count() > mp.iBanTries) {
-		qhBans.insert(addr, Timer());
-		return true;
-	}
-	return false;
+	return m_connectionThrottle.attempt(addr, static_cast< unsigned int >(mp.iBanTries),
+										1000000ULL * static_cast< unsigned long long >(mp.iBanTimeframe),
+										1000000ULL * static_cast< unsigned long long >(std::max(mp.iBanTime, 0)));
 }
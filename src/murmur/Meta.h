@@ -6,16 +6,23 @@
 #ifndef MUMBLE_MURMUR_META_H_
 #define MUMBLE_MURMUR_META_H_
 
+#include "BlobStore.h"
+#include "ConnectionThrottle.h"
+#include "NamePattern.h"
 #include "Timer.h"
 
 #include "Version.h"
 
 #ifdef Q_OS_WIN
 #	include "win.h"
+#else
+#	include "SocketHandoff.h"
 #endif
 
 #include <QtCore/QDir>
 #include <QtCore/QList>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include <QtNetwork/QHostAddress>
@@ -23,8 +30,14 @@
 #include <QtNetwork/QSslCipher>
 #include <QtNetwork/QSslKey>
 
+#include <memory>
+#include <vector>
+
+class MetricsServer;
+class RegistrationWorker;
 class Server;
 class QSettings;
+struct ServerBootState;
 
 class MetaParams {
 public:
@@ -64,6 +77,8 @@ public:
 	int iBanTimeframe;
 	int iBanTime;
 	bool bBanSuccessful;
+	/// The number of addresses whose connection attempts are tracked for the autoban at once
+	int iBanTrackedAddresses;
 
 	QString qsDatabase;
 	int iSQLiteWAL;
@@ -74,9 +89,25 @@ public:
 	QString qsDBPrefix;
 	QString qsDBOpts;
 	int iDBPort;
+	/// Whether frequent writes (e.g. of the last channels of users) are performed by a separate thread in the
+	/// background (see ServerDBWriter)
+	bool bDBWriteBehind;
+	/// The host (and port, if it differs from iDBPort) of a read replica of the database that read-only queries are
+	/// sent to. Empty if there is none.
+	QString qsDBReplicaHost;
+	int iDBReplicaPort;
+	/// The file the executed statements are recorded to (see DBTrace) or empty if they aren't
+	QString qsDBTraceFile;
 
 	int iLogDays;
 
+	/// The maximum number of registered user names (and IDs) each server caches
+	int iUserCacheSize;
+	/// The number of seconds after which cached user names expire or 0 if they don't
+	int iUserCacheTTL;
+	/// The number of MiB of user textures that are kept in memory after they have last been used
+	int iBlobCacheSize;
+
 	int iObfuscate;
 	bool bSendVersion;
 	bool bAllowPing;
@@ -87,6 +118,13 @@ public:
 	QString qsPid;
 	QString qsIceEndpoint;
 	QString qsIceSecretRead, qsIceSecretWrite;
+	/// The number of milliseconds for which the snapshots that the Ice bulk queries are answered from are reused
+	int iIceSnapshotAge;
+
+	/// The port the MetricsServer listens on or 0 if it is disabled
+	int iMetricsPort;
+	/// The address the MetricsServer listens on
+	QString qsMetricsHost;
 
 	QString qsRegName;
 	QString qsRegPassword;
@@ -95,8 +133,8 @@ public:
 	QUrl qurlRegWeb;
 	bool bBonjour;
 
-	QRegExp qrUserName;
-	QRegExp qrChannelName;
+	NamePattern qrUserName;
+	NamePattern qrChannelName;
 
 	unsigned int iMessageLimit;
 	unsigned int iMessageBurst;
@@ -104,8 +142,83 @@ public:
 	unsigned int iPluginMessageLimit;
 	unsigned int iPluginMessageBurst;
 
+	/// The rate (per second) and burst of the pings asking for the server's details that are answered per source
+	/// address. A limit of 0 answers all of them.
+	unsigned int pingLimit;
+	unsigned int pingBurst;
+
 	bool broadcastListenerVolumeAdjustments;
 
+	/// The maximum amount of UDP datagrams that are read with a single
+	/// call to recvmmsg by a server's voice thread (Linux only)
+	unsigned int udpReceiveBatchSize;
+
+	/// Whether UDP segmentation offload (GSO) and receive offload (GRO)
+	/// shall be used on the voice sockets (Linux only)
+	bool udpOffload;
+
+	/// The number of threads that receive and route voice packets for a
+	/// server. Every thread reads from its own SO_REUSEPORT socket (Linux only)
+	unsigned int voiceThreads;
+
+	/// Whether the voice threads shall receive packets via io_uring (only if
+	/// support for it has been built in)
+	bool ioUring;
+
+	/// Whether the voice threads shall receive and send packets via Registered
+	/// I/O (Windows only)
+	bool registeredIO;
+
+	/// A list of CPUs (e.g. "2,3" or "2-5") the voice threads are pinned to.
+	/// Empty means no pinning (Linux only)
+	QString voiceThreadCPUs;
+	/// The NUMA node whose CPUs the voice threads are pinned to if voiceThreadCPUs is empty.
+	/// -1 means no pinning (Linux only)
+	int voiceThreadNode;
+
+	/// The SO_BUSY_POLL timeout in microseconds for the voice sockets. 0
+	/// disables busy polling (Linux only)
+	unsigned int udpBusyPoll;
+
+	/// The time in microseconds the voice threads keep polling their sockets
+	/// without blocking before going to sleep. 0 disables spinning (Linux only)
+	unsigned int udpSpinTime;
+
+	/// The DSCP (0 to 63) the voice packets are marked with. 0 keeps the
+	/// default marking
+	unsigned int udpDSCP;
+
+	/// The number of threads that do the I/O (including TLS) of the clients'
+	/// TCP connections for all virtual servers. 0 leaves it to the main thread
+	unsigned int tlsThreads;
+
+	/// The number of threads that read the state of the virtual servers from
+	/// the database when they are booted at startup. 1 boots them one by one
+	unsigned int bootThreads;
+
+	/// The number of bytes of tunneled voice, control messages and requested
+	/// blobs that may be queued for a client's TCP connection (see
+	/// Connection::SendLimits). 0 means unlimited
+	int sendQueueVoiceBytes;
+	int sendQueueControlBytes;
+	int sendQueueBulkBytes;
+
+	/// The ID (1 - 15) of this node within a cluster of servers that serve the same virtual servers (see
+	/// ClusterNode). 0 disables clustering
+	unsigned int clusterNode;
+	/// The other nodes of the cluster as whitespace-separated "id=host:port" entries
+	QString clusterPeers;
+	/// The UDP port the nodes exchange users and voice on. Virtual server N uses clusterPort + N - 1
+	unsigned short clusterPort;
+	/// The key the datagrams between the nodes are authenticated with
+	QString qsClusterSecret;
+
+	/// The Unix socket a new instance takes the listeners of the running one over through (see SocketHandoff).
+	/// Empty disables the handoff (Unix only)
+	QString qsHandoffSocket;
+	/// The number of seconds over which the users of an instance that has handed its listeners over are disconnected
+	int iHandoffDrain;
+
 	QSslCertificate qscCert;
 	QSslKey qskKey;
 
@@ -132,6 +245,11 @@ public:
 	QByteArray qbaPassPhrase;
 	QString qsCiphers;
 
+	/// The kind of key to generate for a server that has no
+	/// certificate yet (sslGeneratedKeyType). ECDSA keys make
+	/// the handshakes considerably cheaper for the server.
+	QSsl::KeyAlgorithm generatedKeyAlgorithm;
+
 	QMap< QString, QString > qmConfig;
 
 #ifdef Q_OS_UNIX
@@ -180,10 +298,38 @@ private:
 public:
 	static MetaParams mp;
 	QHash< int, Server * > qhServers;
-	QHash< QHostAddress, QList< Timer > > qhAttempts;
-	QHash< QHostAddress, Timer > qhBans;
+	/// The threads the clients' connections are distributed among (see MetaParams::tlsThreads)
+	std::vector< std::unique_ptr< QThread > > m_tlsThreads;
+	std::size_t m_nextTLSThread = 0;
+	/// The connection attempts per address for the autoban
+	ConnectionThrottle m_connectionThrottle;
 	QString qsOS, qsOSVersion;
 	Timer tUptime;
+	/// The textures of the users of all virtual servers, so that identical ones are only held in memory once
+	BlobStore m_blobStore;
+	/// The thread the public server list registrations and Zeroconf announcements are performed on
+	QThread m_registrationThread;
+	/// Lives on m_registrationThread, which deletes it when it finishes
+	RegistrationWorker *m_registrationWorker = nullptr;
+	/// Exports the metrics of all virtual servers or nullptr if that is disabled (see MetaParams::iMetricsPort)
+	std::unique_ptr< MetricsServer > m_metricsServer;
+
+#ifdef USE_SERVER_AUDIT
+	/// Reports the lock contention and allocations on the hot paths (see Audit::report())
+	QTimer m_auditReport;
+#endif
+
+#ifdef Q_OS_UNIX
+	/// Waits for the instance that replaces this one (see MetaParams::qsHandoffSocket)
+	SocketHandoff m_handoff;
+	/// The sockets that have been taken over from the previous instance and haven't been claimed by a server yet
+	std::vector< SocketHandoff::Socket > m_handoffSockets;
+	/// Disconnects the users bit by bit once the sockets have been handed over (see drainStep())
+	QTimer m_drainTimer;
+	/// The number of users disconnected per step and when to stop waiting for them
+	int m_drainRate = 0;
+	Timer m_drainDeadline;
+#endif
 
 #ifdef Q_OS_WIN
 	static HANDLE hQoS;
@@ -198,17 +344,45 @@ public:
 	/// Meta server's certificate and private key.
 	bool reloadSSLSettings();
 
+	/// Starts the MetricsServer, if it is enabled
+	void startMetrics();
 	void bootAll();
-	bool boot(int);
-	bool banCheck(const QHostAddress &);
+	/// @param bootState The state of the server, if it has been read from the database already
+	bool boot(int, const ServerBootState *bootState = nullptr);
+	/// Records a connection attempt from the given address for the autoban
+	///
+	/// @returns Whether the connection has to be refused, as well as whether the address has just been banned
+	ConnectionThrottle::Verdict banCheck(const HostAddress &);
+
+	/// @returns The thread the next client connection shall be handed over to, or nullptr if connections are handled
+	/// 	by the main thread
+	QThread *nextTLSThread();
 
 	/// Called whenever we get a successful connection from a client.
 	/// Used to reset autoban tracking for the address.
-	void successfulConnectionFrom(const QHostAddress &);
+	void successfulConnectionFrom(const HostAddress &);
 	void kill(int);
 	void killAll();
 	void getOSInfo();
 	void connectListener(QObject *);
+
+#ifdef Q_OS_UNIX
+	/// Takes the sockets over from the running instance, if there is one (see MetaParams::qsHandoffSocket). Has to be
+	/// called before the servers are booted.
+	void takeOverSockets();
+	/// Takes the socket of the given type that has been taken over for the given server and address out of the list
+	///
+	/// @returns The socket or -1 if there is none
+	int takeHandoffSocket(int serverId, int type, const HostAddress &address, unsigned short port);
+	/// Closes the sockets that have been taken over but haven't been claimed by any server (e.g. because the
+	/// configuration has changed) and starts waiting for the next instance. Has to be called once the servers have
+	/// been booted.
+	void finishTakeOver();
+	/// Hands the sockets of all servers over to a new instance through the given connection and starts disconnecting
+	/// the users
+	void handOver(int connection);
+	void drainStep();
+#endif
 	static void getVersion(Version::component_t &major, Version::component_t &minor, Version::component_t &patch,
 						   QString &string);
 signals:
@@ -0,0 +1,130 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Metrics.h"
+
+#include <QtCore/QtAlgorithms>
+
+#include <algorithm>
+
+namespace Metrics {
+
+std::size_t threadShard() {
+	static std::atomic< std::size_t > nextShard{ 0 };
+	// Threads are assigned to the shards round-robin, so that the voice threads of a server (which are started one
+	// after another) end up on different ones
+	thread_local const std::size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+
+	return shard;
+}
+
+quint64 Counter::value() const {
+	quint64 value = 0;
+	for (const Shard &shard : m_shards) {
+		value += shard.value.load(std::memory_order_relaxed);
+	}
+
+	return value;
+}
+
+void Histogram::observe(quint64 value) {
+	const std::size_t bits = value == 0 ? 0 : static_cast< std::size_t >(64 - qCountLeadingZeroBits(value));
+
+	Shard &shard = m_shards[threadShard()];
+	shard.buckets[std::min(bits, BUCKET_COUNT - 1)].fetch_add(1, std::memory_order_relaxed);
+	shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+Histogram::Totals Histogram::totals() const {
+	Totals totals;
+	for (const Shard &shard : m_shards) {
+		for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+			const quint64 count = shard.buckets[i].load(std::memory_order_relaxed);
+			totals.buckets[i] += count;
+			totals.count += count;
+		}
+		totals.sum += shard.sum.load(std::memory_order_relaxed);
+	}
+
+	return totals;
+}
+
+quint64 Histogram::upperBound(std::size_t bucket) {
+	return (static_cast< quint64 >(1) << bucket) - 1;
+}
+
+void LatencyHistogram::observe(quint64 micros, quint64 count) {
+	Shard &shard = m_periods[m_current.load(std::memory_order_relaxed)][threadShard()];
+	shard.buckets[bucketOf(micros)].fetch_add(count, std::memory_order_relaxed);
+	shard.sum.fetch_add(micros * count, std::memory_order_relaxed);
+
+	quint64 max = shard.max.load(std::memory_order_relaxed);
+	while (micros > max && !shard.max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::rotate() {
+	const unsigned int ended = m_current.load(std::memory_order_relaxed);
+	m_current.store(1 - ended, std::memory_order_relaxed);
+
+	std::array< quint64, BUCKET_COUNT > buckets{};
+	Summary summary;
+	for (Shard &shard : m_periods[ended]) {
+		for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+			const quint64 count = shard.buckets[i].exchange(0, std::memory_order_relaxed);
+			buckets[i] += count;
+			summary.count += count;
+		}
+		summary.sum += shard.sum.exchange(0, std::memory_order_relaxed);
+		summary.max = std::max(summary.max, shard.max.exchange(0, std::memory_order_relaxed));
+	}
+
+	if (summary.count > 0) {
+		// The percentiles are the upper bounds of the buckets they fall into, but never more than the actual maximum
+		auto percentile = [&](quint64 permille) {
+			const quint64 rank = (summary.count * permille + 999) / 1000;
+			quint64 seen       = 0;
+			for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+				seen += buckets[i];
+				if (seen >= rank) {
+					return std::min(upperBound(i), summary.max);
+				}
+			}
+			return summary.max;
+		};
+		summary.p50  = percentile(500);
+		summary.p99  = percentile(990);
+		summary.p999 = percentile(999);
+	}
+
+	m_lastPeriod = summary;
+}
+
+std::size_t LatencyHistogram::bucketOf(quint64 micros) {
+	if (micros < SUB_BUCKETS) {
+		return static_cast< std::size_t >(micros);
+	}
+
+	// The latency lies within [2^exponent, 2^(exponent + 1)), which is split into SUB_BUCKETS buckets
+	const unsigned int exponent = 63 - qCountLeadingZeroBits(micros);
+	if (exponent >= MAX_BITS) {
+		return BUCKET_COUNT - 1;
+	}
+
+	const unsigned int shift = exponent - SUB_BUCKET_BITS;
+	return SUB_BUCKETS * (shift + 1) + static_cast< std::size_t >((micros >> shift) & (SUB_BUCKETS - 1));
+}
+
+quint64 LatencyHistogram::upperBound(std::size_t bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const unsigned int shift = static_cast< unsigned int >(bucket / SUB_BUCKETS) - 1;
+	const quint64 lower      = (static_cast< quint64 >(SUB_BUCKETS + bucket % SUB_BUCKETS)) << shift;
+	return lower + (static_cast< quint64 >(1) << shift) - 1;
+}
+
+} // namespace Metrics
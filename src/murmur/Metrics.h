@@ -0,0 +1,165 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_METRICS_H_
+#define MUMBLE_MURMUR_METRICS_H_
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+/// Counters and histograms that are cheap enough to be updated on the voice threads' hot paths. They are exported by
+/// the MetricsServer.
+///
+/// Every metric is split into shards, which are spread over their own cache lines. A thread always updates the same
+/// shard (which no other thread is likely to use at the same time) with relaxed atomic operations, so updating a
+/// metric never blocks and doesn't bounce cache lines between the voice threads. Reading a metric sums up its shards.
+namespace Metrics {
+
+static constexpr std::size_t SHARD_COUNT = 16;
+
+/// @returns The shard the calling thread updates
+std::size_t threadShard();
+
+/// @returns The current time of a monotonic clock in nanoseconds
+inline quint64 now() {
+	return static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+class Counter {
+public:
+	void add(quint64 value = 1) { m_shards[threadShard()].value.fetch_add(value, std::memory_order_relaxed); }
+
+	quint64 value() const;
+
+protected:
+	struct alignas(64) Shard {
+		std::atomic< quint64 > value{ 0 };
+	};
+
+	std::array< Shard, SHARD_COUNT > m_shards;
+};
+
+/// A histogram with exponentially growing buckets: bucket i holds the values that need i bits, i.e. the values up to
+/// 2^i - 1. The last bucket holds all larger values as well.
+class Histogram {
+public:
+	static constexpr std::size_t BUCKET_COUNT = 32;
+
+	struct Totals {
+		std::array< quint64, BUCKET_COUNT > buckets{};
+		quint64 sum   = 0;
+		quint64 count = 0;
+	};
+
+	void observe(quint64 value);
+
+	Totals totals() const;
+
+	/// @returns The largest value the given bucket holds (except for the last bucket, which holds all larger ones)
+	static quint64 upperBound(std::size_t bucket);
+
+protected:
+	struct alignas(64) Shard {
+		std::array< std::atomic< quint64 >, BUCKET_COUNT > buckets{};
+		std::atomic< quint64 > sum{ 0 };
+	};
+
+	std::array< Shard, SHARD_COUNT > m_shards;
+};
+
+/// A histogram of latencies in microseconds in the style of an HDR histogram: Every power of two is split into
+/// SUB_BUCKETS linear buckets, so that the percentiles derived from it are off by at most 1 / SUB_BUCKETS.
+///
+/// The samples are collected in periods (of a minute, see Server::m_metricsRotation), so that the percentiles reflect
+/// the recent past instead of the whole uptime. Samples are recorded into the current period, while the summary of
+/// the last complete period is kept for the readers.
+class LatencyHistogram {
+public:
+	static constexpr unsigned int SUB_BUCKET_BITS = 4;
+	static constexpr std::size_t SUB_BUCKETS      = std::size_t(1) << SUB_BUCKET_BITS;
+	/// Latencies of 2^MAX_BITS microseconds (about 17 seconds) and more are recorded as the largest bucket
+	static constexpr unsigned int MAX_BITS   = 24;
+	static constexpr std::size_t BUCKET_COUNT = SUB_BUCKETS * (MAX_BITS - SUB_BUCKET_BITS + 1);
+
+	struct Summary {
+		quint64 count = 0;
+		/// The sum of all latencies in microseconds
+		quint64 sum  = 0;
+		quint64 p50  = 0;
+		quint64 p99  = 0;
+		quint64 p999 = 0;
+		quint64 max  = 0;
+	};
+
+	/// Records the given number of samples with the given latency
+	void observe(quint64 micros, quint64 count = 1);
+
+	/// Ends the current period, whose summary is then returned by lastPeriod(). May only be called by one thread.
+	///
+	/// Samples that are recorded while the period ends might be counted towards the period after the next one.
+	void rotate();
+
+	/// @returns The summary of the last complete period. May only be called by the thread calling rotate().
+	const Summary &lastPeriod() const { return m_lastPeriod; }
+
+	/// @returns The bucket the given latency is recorded in
+	static std::size_t bucketOf(quint64 micros);
+	/// @returns The largest latency the given bucket holds
+	static quint64 upperBound(std::size_t bucket);
+
+protected:
+	struct alignas(64) Shard {
+		std::array< std::atomic< quint64 >, BUCKET_COUNT > buckets{};
+		std::atomic< quint64 > sum{ 0 };
+		std::atomic< quint64 > max{ 0 };
+	};
+	using Period = std::array< Shard, SHARD_COUNT >;
+
+	/// The current and the previous period, which is cleared when it becomes the current one again
+	std::array< Period, 2 > m_periods;
+	std::atomic< unsigned int > m_current{ 0 };
+	Summary m_lastPeriod;
+};
+
+/// The metrics of a single virtual server
+struct ServerMetrics {
+	/// The UDP datagrams that have been received (including pings)
+	Counter udpPacketsReceived;
+	/// The voice packets that have been queued for sending via UDP
+	Counter udpPacketsSent;
+	/// The voice packets that have been handed to the main thread for sending through TCP connections
+	Counter tunneledPacketsSent;
+	/// The packets of known peers that couldn't be decrypted
+	Counter decryptFailures;
+	/// The voice packets that have been dropped because their sender exceeded the bandwidth limit
+	Counter bandwidthDrops;
+	/// The voice packets that have been dropped because louder users were speaking in the channel (see SpeakerSelector)
+	Counter speakerLimitDrops;
+	/// The pings asking for the server's details that haven't been answered because their source exceeded the ping
+	/// limit (see PingRateLimiter)
+	Counter pingsLimited;
+	Counter whisperCacheHits;
+	/// Whisper and shout packets whose target hasn't been published to the voice threads yet
+	Counter whisperCacheMisses;
+	Counter aclCacheHits;
+	Counter aclCacheMisses;
+
+	/// The number of users a voice packet has been sent to
+	Histogram receiversPerFrame;
+	/// The time it takes to route a voice packet to its receivers in nanoseconds (see Server::processMsg)
+	Histogram routingNanoseconds;
+	/// The time from receiving a voice packet until its last copy has been sent (see Server::flushVoiceContext)
+	LatencyHistogram forwardingLatency;
+};
+
+} // namespace Metrics
+
+#endif // MUMBLE_MURMUR_METRICS_H_
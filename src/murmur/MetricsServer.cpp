@@ -0,0 +1,256 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "MetricsServer.h"
+
+#include "Meta.h"
+#include "Server.h"
+#include "ServerDB.h"
+#include "ServerDBWriter.h"
+#include "ServerUser.h"
+
+#include <QtCore/QTimer>
+#include <QtNetwork/QTcpSocket>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+/// How long a scraper may take to send its request
+constexpr int REQUEST_TIMEOUT_MSECS = 10000;
+
+struct CounterFamily {
+	const char *name;
+	const char *help;
+	Metrics::Counter Metrics::ServerMetrics::*counter;
+};
+
+const CounterFamily COUNTER_FAMILIES[] = {
+	{ "mumble_udp_packets_received_total", "UDP datagrams received by the voice threads",
+	  &Metrics::ServerMetrics::udpPacketsReceived },
+	{ "mumble_udp_packets_sent_total", "Voice packets sent via UDP", &Metrics::ServerMetrics::udpPacketsSent },
+	{ "mumble_tunneled_packets_sent_total", "Voice packets sent through the TCP connections of users",
+	  &Metrics::ServerMetrics::tunneledPacketsSent },
+	{ "mumble_decrypt_failures_total", "Packets of known peers that could not be decrypted",
+	  &Metrics::ServerMetrics::decryptFailures },
+	{ "mumble_bandwidth_drops_total", "Voice packets dropped because their sender exceeded the bandwidth limit",
+	  &Metrics::ServerMetrics::bandwidthDrops },
+	{ "mumble_speaker_limit_drops_total", "Voice packets dropped because louder users were speaking in the channel",
+	  &Metrics::ServerMetrics::speakerLimitDrops },
+	{ "mumble_pings_limited_total", "Server info pings ignored because their source exceeded the ping limit",
+	  &Metrics::ServerMetrics::pingsLimited },
+	{ "mumble_whisper_cache_hits_total", "Whisper and shout packets whose receivers were known",
+	  &Metrics::ServerMetrics::whisperCacheHits },
+	{ "mumble_whisper_cache_misses_total", "Whisper and shout packets whose receivers were not known yet",
+	  &Metrics::ServerMetrics::whisperCacheMisses },
+	{ "mumble_acl_cache_hits_total", "Permission checks answered by the ACL cache",
+	  &Metrics::ServerMetrics::aclCacheHits },
+	{ "mumble_acl_cache_misses_total", "Permission checks that had to evaluate the ACLs",
+	  &Metrics::ServerMetrics::aclCacheMisses },
+};
+
+struct HistogramFamily {
+	const char *name;
+	const char *help;
+	Metrics::Histogram Metrics::ServerMetrics::*histogram;
+	/// The factor that converts the observed values into the exported unit
+	double scale;
+};
+
+const HistogramFamily HISTOGRAM_FAMILIES[] = {
+	{ "mumble_voice_receivers", "Number of users a voice packet has been sent to",
+	  &Metrics::ServerMetrics::receiversPerFrame, 1.0 },
+	{ "mumble_voice_routing_seconds", "Time it took to route a voice packet to its receivers",
+	  &Metrics::ServerMetrics::routingNanoseconds, 1e-9 },
+};
+
+void writeHeader(QByteArray &out, const char *name, const char *type, const char *help) {
+	out += "# HELP ";
+	out += name;
+	out += ' ';
+	out += help;
+	out += "\n# TYPE ";
+	out += name;
+	out += ' ';
+	out += type;
+	out += '\n';
+}
+
+void writeSample(QByteArray &out, const char *name, const char *suffix, const QByteArray &labels,
+				 const QByteArray &value) {
+	out += name;
+	out += suffix;
+	if (!labels.isEmpty()) {
+		out += '{';
+		out += labels;
+		out += '}';
+	}
+	out += ' ';
+	out += value;
+	out += '\n';
+}
+
+QByteArray serverLabel(const Server *server) {
+	return "server=\"" + QByteArray::number(server->iServerNum) + '"';
+}
+} // namespace
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent) {
+	connect(&m_server, &QTcpServer::newConnection, this, &MetricsServer::newConnection);
+}
+
+bool MetricsServer::listen(const QHostAddress &address, quint16 port) {
+	return m_server.listen(address, port);
+}
+
+QByteArray MetricsServer::render() {
+	QList< Server * > servers = meta->qhServers.values();
+	std::sort(servers.begin(), servers.end(),
+			  [](const Server *lhs, const Server *rhs) { return lhs->iServerNum < rhs->iServerNum; });
+
+	QByteArray out;
+
+	for (const CounterFamily &family : COUNTER_FAMILIES) {
+		writeHeader(out, family.name, "counter", family.help);
+		for (const Server *server : servers) {
+			writeSample(out, family.name, "", serverLabel(server),
+						QByteArray::number((server->m_metrics.*family.counter).value()));
+		}
+	}
+
+	for (const HistogramFamily &family : HISTOGRAM_FAMILIES) {
+		writeHeader(out, family.name, "histogram", family.help);
+		for (const Server *server : servers) {
+			const Metrics::Histogram::Totals totals = (server->m_metrics.*family.histogram).totals();
+			const QByteArray labels                 = serverLabel(server);
+
+			// Prometheus expects the buckets to be cumulative
+			quint64 cumulative = 0;
+			for (std::size_t i = 0; i + 1 < Metrics::Histogram::BUCKET_COUNT; ++i) {
+				cumulative += totals.buckets[i];
+				const double bound = static_cast< double >(Metrics::Histogram::upperBound(i)) * family.scale;
+				writeSample(out, family.name, "_bucket", labels + ",le=\"" + QByteArray::number(bound, 'g', 6) + '"',
+							QByteArray::number(cumulative));
+			}
+			writeSample(out, family.name, "_bucket", labels + ",le=\"+Inf\"", QByteArray::number(totals.count));
+			writeSample(out, family.name, "_sum", labels,
+						QByteArray::number(static_cast< double >(totals.sum) * family.scale, 'g', 12));
+			writeSample(out, family.name, "_count", labels, QByteArray::number(totals.count));
+		}
+	}
+
+	// Unlike the histograms above, which count since the server has been started, the summary covers the last minute
+	writeHeader(out, "mumble_voice_forwarding_seconds", "summary",
+				"Time from receiving a voice packet until its last copy has been sent, over the last minute");
+	for (const Server *server : servers) {
+		const Metrics::LatencyHistogram::Summary &latency = server->m_metrics.forwardingLatency.lastPeriod();
+		const QByteArray labels                           = serverLabel(server);
+
+		const std::pair< const char *, quint64 > quantiles[] = {
+			{ "0.5", latency.p50 }, { "0.99", latency.p99 }, { "0.999", latency.p999 }, { "1", latency.max }
+		};
+		for (const std::pair< const char *, quint64 > &quantile : quantiles) {
+			writeSample(out, "mumble_voice_forwarding_seconds", "", labels + ",quantile=\"" + quantile.first + '"',
+						QByteArray::number(static_cast< double >(quantile.second) * 1e-6, 'g', 6));
+		}
+		writeSample(out, "mumble_voice_forwarding_seconds", "_sum", labels,
+					QByteArray::number(static_cast< double >(latency.sum) * 1e-6, 'g', 12));
+		writeSample(out, "mumble_voice_forwarding_seconds", "_count", labels, QByteArray::number(latency.count));
+	}
+
+	// The users are owned by the main thread, which is the one we are running on
+	writeHeader(out, "mumble_users", "gauge", "Authenticated users");
+	writeHeader(out, "mumble_tcp_fallback_users", "gauge", "Authenticated users whose voice is tunneled through TCP");
+	for (const Server *server : servers) {
+		int users = 0;
+		int tcp   = 0;
+		foreach (const ServerUser *u, server->qhUsers) {
+			if (u->sState != ServerUser::Authenticated) {
+				continue;
+			}
+
+			users++;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+			tcp += u->aiUdpFlag.loadRelaxed() == 0 ? 1 : 0;
+#else
+			// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
+			tcp += u->aiUdpFlag.load() == 0 ? 1 : 0;
+#endif
+		}
+
+		writeSample(out, "mumble_users", "", serverLabel(server), QByteArray::number(users));
+		writeSample(out, "mumble_tcp_fallback_users", "", serverLabel(server), QByteArray::number(tcp));
+	}
+
+	// Only users whose packets have been dropped are listed, so that the number of series stays small
+	writeHeader(out, "mumble_user_bandwidth_drops_total", "counter",
+				"Voice packets of a user that have been dropped because they exceeded the bandwidth limit");
+	for (const Server *server : servers) {
+		foreach (const ServerUser *u, server->qhUsers) {
+			const quint64 drops = u->m_bandwidthDrops.load(std::memory_order_relaxed);
+			if (drops > 0) {
+				writeSample(out, "mumble_user_bandwidth_drops_total", "",
+							serverLabel(server) + ",session=\"" + QByteArray::number(u->uiSession) + '"',
+							QByteArray::number(drops));
+			}
+		}
+	}
+
+	// The placement is decided when a server is started, so that it can be read without synchronization
+	writeHeader(out, "mumble_voice_thread_cpu", "gauge",
+				"The CPU a voice thread is pinned to (see voiceThreadCPUs and voiceThreadNode) or -1");
+	for (const Server *server : servers) {
+		for (unsigned int thread = 0; thread < server->voiceThreads; ++thread) {
+			writeSample(out, "mumble_voice_thread_cpu", "",
+						serverLabel(server) + ",thread=\"" + QByteArray::number(thread) + '"',
+						QByteArray::number(server->voiceThreadCPU(thread)));
+		}
+	}
+
+	writeHeader(out, "mumble_db_write_queue_depth", "gauge", "Database writes that have not been committed yet");
+	writeSample(out, "mumble_db_write_queue_depth", "", QByteArray(),
+				QByteArray::number(ServerDB::writer ? static_cast< quint64 >(ServerDB::writer->queueDepth()) : 0));
+
+	return out;
+}
+
+void MetricsServer::newConnection() {
+	while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+		connect(socket, &QTcpSocket::readyRead, this, &MetricsServer::readRequest);
+		connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		QTimer::singleShot(REQUEST_TIMEOUT_MSECS, socket, &QTcpSocket::abort);
+	}
+}
+
+void MetricsServer::readRequest() {
+	QTcpSocket *socket = qobject_cast< QTcpSocket * >(sender());
+	if (!socket) {
+		return;
+	}
+
+	const QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+	if (!request.contains("\r\n\r\n")) {
+		if (request.size() >= MAX_REQUEST_SIZE) {
+			socket->abort();
+		}
+		return;
+	}
+
+	socket->disconnect(this);
+
+	const QList< QByteArray > requestLine = request.left(request.indexOf("\r\n")).split(' ');
+	QByteArray response;
+	if (requestLine.size() == 3 && requestLine[0] == "GET"
+		&& (requestLine[1] == "/metrics" || requestLine[1].startsWith("/metrics?"))) {
+		const QByteArray body = render();
+		response              = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+				   + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+	} else {
+		response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	}
+
+	socket->write(response);
+	socket->disconnectFromHost();
+}
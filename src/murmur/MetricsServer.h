@@ -0,0 +1,45 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_METRICSSERVER_H_
+#define MUMBLE_MURMUR_METRICSSERVER_H_
+
+#include "Metrics.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QObject>
+#include <QtNetwork/QTcpServer>
+
+class QTcpSocket;
+
+/// Serves the metrics of all running virtual servers (see Metrics::ServerMetrics) in the Prometheus text format over
+/// HTTP, for scrapers that GET /metrics (see MetaParams::iMetricsPort). It lives on the main thread, so everything
+/// owned by the main thread can be exported as well.
+class MetricsServer : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(MetricsServer)
+
+public:
+	/// The maximum size of a request. Scrapers don't send bodies, so anything larger is dropped.
+	static constexpr int MAX_REQUEST_SIZE = 8192;
+
+	explicit MetricsServer(QObject *parent = nullptr);
+
+	/// @returns Whether the server is listening on the given address and port
+	bool listen(const QHostAddress &address, quint16 port);
+
+	/// @returns The current metrics in the Prometheus text format
+	static QByteArray render();
+
+protected:
+	QTcpServer m_server;
+
+protected slots:
+	void newConnection();
+	void readRequest();
+};
+
+#endif // MUMBLE_MURMUR_METRICSSERVER_H_
@@ -24,6 +24,11 @@ public:
 								   const ::MumbleServer::ServerCallbackPrx &, const ::Ice::Current &);
 	virtual void removeCallback_async(const ::MumbleServer::AMD_Server_removeCallbackPtr &,
 									  const ::MumbleServer::ServerCallbackPrx &, const ::Ice::Current &);
+	virtual void addEventCallback_async(const ::MumbleServer::AMD_Server_addEventCallbackPtr &,
+										const ::MumbleServer::ServerEventCallbackPrx &,
+										const ::MumbleServer::EventFilter &, const ::Ice::Current &);
+	virtual void removeEventCallback_async(const ::MumbleServer::AMD_Server_removeEventCallbackPtr &,
+										   const ::MumbleServer::ServerEventCallbackPrx &, const ::Ice::Current &);
 
 	virtual void setAuthenticator_async(const ::MumbleServer::AMD_Server_setAuthenticatorPtr &,
 										const ::MumbleServer::ServerAuthenticatorPrx &, const ::Ice::Current &);
@@ -52,6 +57,19 @@ public:
 
 	virtual void getTree_async(const ::MumbleServer::AMD_Server_getTreePtr &, const Ice::Current &);
 
+	virtual void getUsersSnapshot_async(const ::MumbleServer::AMD_Server_getUsersSnapshotPtr &, const Ice::Current &);
+
+	virtual void getChannelsSnapshot_async(const ::MumbleServer::AMD_Server_getChannelsSnapshotPtr &,
+										   const Ice::Current &);
+
+	virtual void getUsersPage_async(const ::MumbleServer::AMD_Server_getUsersPagePtr &,
+									const ::MumbleServer::UserQuery &, const Ice::Current &);
+
+	virtual void getForwardingLatency_async(const ::MumbleServer::AMD_Server_getForwardingLatencyPtr &,
+											const Ice::Current &);
+
+	virtual void getMemoryUsage_async(const ::MumbleServer::AMD_Server_getMemoryUsagePtr &, const Ice::Current &);
+
 	virtual void getCertificateList_async(const ::MumbleServer::AMD_Server_getCertificateListPtr &, ::Ice::Int,
 										  const ::Ice::Current &);
 
@@ -83,6 +101,9 @@ public:
 	virtual void setState_async(const ::MumbleServer::AMD_Server_setStatePtr &, const ::MumbleServer::User &,
 								const Ice::Current &);
 
+	virtual void moveUsers_async(const ::MumbleServer::AMD_Server_moveUsersPtr &, const ::MumbleServer::MoveMap &,
+								 const Ice::Current &);
+
 	virtual void getChannelState_async(const ::MumbleServer::AMD_Server_getChannelStatePtr &, ::Ice::Int,
 									   const Ice::Current &);
 
@@ -143,6 +164,9 @@ public:
 
 	virtual void getUptime_async(const ::MumbleServer::AMD_Server_getUptimePtr &, const Ice::Current &);
 
+	virtual void getUserCacheStats_async(const ::MumbleServer::AMD_Server_getUserCacheStatsPtr &,
+										 const Ice::Current &);
+
 	virtual void updateCertificate_async(const ::MumbleServer::AMD_Server_updateCertificatePtr &, const std::string &,
 										 const std::string &, const std::string &, const Ice::Current &);
 
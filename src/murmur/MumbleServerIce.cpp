@@ -21,6 +21,7 @@
 #include <QtCore/QCoreApplication>
 #include <QtCore/QSettings>
 #include <QtCore/QStack>
+#include <QtCore/QTimer>
 
 #include <openssl/err.h>
 
@@ -28,6 +29,7 @@
 #include <Ice/SliceChecksums.h>
 #include <IceUtil/IceUtil.h>
 
+#include <algorithm>
 #include <limits>
 
 using namespace std;
@@ -96,33 +98,53 @@ static void logToLog(const ServerDB::LogRecord &r, ::MumbleServer::LogEntry &ent
 	entry.txt       = iceString(r.second);
 }
 
-static void userToUser(const ::User *p, ::MumbleServer::User &mp) {
-	mp.session         = static_cast< int >(p->uiSession);
-	mp.userid          = p->iId;
-	mp.name            = iceString(p->qsName);
-	mp.mute            = p->bMute;
-	mp.deaf            = p->bDeaf;
-	mp.suppress        = p->bSuppress;
-	mp.recording       = p->bRecording;
-	mp.prioritySpeaker = p->bPrioritySpeaker;
-	mp.selfMute        = p->bSelfMute;
-	mp.selfDeaf        = p->bSelfDeaf;
-	mp.channel         = static_cast< int >(p->cChannel->iId);
-	mp.comment         = iceString(p->qsComment);
-
-	const ServerUser *u = static_cast< const ServerUser * >(p);
-	mp.onlinesecs       = u->bwr.onlineSeconds();
-	mp.bytespersec      = u->bwr.bandwidth();
-	mp.version2         = static_cast< long >(u->m_version);
-	mp.version          = static_cast< int >(Version::toLegacyVersion(u->m_version));
-	mp.release          = iceString(u->qsRelease);
-	mp.os               = iceString(u->qsOS);
-	mp.osversion        = iceString(u->qsOSVersion);
-	mp.identity         = iceString(u->qsIdentity);
-	mp.context          = iceBase64(u->ssContext);
-	mp.idlesecs         = u->bwr.idleSeconds();
-	mp.udpPing          = u->dUDPPingAvg;
-	mp.tcpPing          = u->dTCPPingAvg;
+/// @param fields The fields to fill in (see ::MumbleServer::UserFieldName). The others keep their default values.
+static void userToUser(const ::User *p, ::MumbleServer::User &mp, int fields = UserFieldAll) {
+	mp.session = static_cast< int >(p->uiSession);
+	mp.userid  = p->iId;
+
+	if (fields & UserFieldName) {
+		mp.name = iceString(p->qsName);
+	}
+	// The generated structs don't initialize their members, so the fields that aren't requested are reset explicitly
+	mp.channel = (fields & UserFieldChannel) ? static_cast< int >(p->cChannel->iId) : 0;
+
+	const bool flags   = fields & UserFieldFlags;
+	mp.mute            = flags && p->bMute;
+	mp.deaf            = flags && p->bDeaf;
+	mp.suppress        = flags && p->bSuppress;
+	mp.recording       = flags && p->bRecording;
+	mp.prioritySpeaker = flags && p->bPrioritySpeaker;
+	mp.selfMute        = flags && p->bSelfMute;
+	mp.selfDeaf        = flags && p->bSelfDeaf;
+
+	if (fields & UserFieldComment) {
+		mp.comment = iceString(p->qsComment);
+	}
+
+	const ServerUser *u   = static_cast< const ServerUser * >(p);
+	const bool statistics = fields & UserFieldStatistics;
+	mp.onlinesecs         = statistics ? u->bwr.onlineSeconds() : 0;
+	mp.bytespersec        = statistics ? u->bwr.bandwidth() : 0;
+	mp.idlesecs           = statistics ? u->bwr.idleSeconds() : 0;
+	mp.udpPing            = statistics ? u->dUDPPingAvg : 0.0f;
+	mp.tcpPing            = statistics ? u->dTCPPingAvg : 0.0f;
+
+	if (!(fields & UserFieldClient)) {
+		mp.version  = 0;
+		mp.version2 = 0;
+		mp.tcponly  = false;
+		return;
+	}
+
+	mp.version2  = static_cast< long >(u->m_version);
+	mp.version   = static_cast< int >(Version::toLegacyVersion(u->m_version));
+	const ServerUser::ClientDetails &details = u->clientDetails();
+	mp.release   = iceString(details.qsRelease);
+	mp.os        = iceString(details.qsOS);
+	mp.osversion = iceString(details.qsOSVersion);
+	mp.identity  = iceString(details.qsIdentity);
+	mp.context   = iceBase64(u->ssContext);
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
 	mp.tcponly = u->aiUdpFlag.loadRelaxed() == 0;
@@ -361,6 +383,164 @@ void MumbleServerIce::removeServerCallbacks(const ::Server *server) {
 	}
 }
 
+void MumbleServerIce::badEventProxy(const ::MumbleServer::ServerEventCallbackPrx &prx, const ::Server *server) {
+	server->log(
+		QString("Ice ServerEventCallback %1 failed").arg(QString::fromStdString(communicator->proxyToString(prx))));
+	removeEventCallback(server, prx);
+}
+
+void MumbleServerIce::addEventCallback(const ::Server *server, const ::MumbleServer::ServerEventCallbackPrx &prx,
+									   const ::MumbleServer::EventFilter &filter) {
+	QList< EventSubscription > &subscriptions = qmEventSubscriptions[server->iServerNum];
+
+	for (EventSubscription &subscription : subscriptions) {
+		if (subscription.prx == prx) {
+			subscription.filter = filter;
+			return;
+		}
+	}
+
+	server->log(
+		QString("Added Ice ServerEventCallback %1").arg(QString::fromStdString(communicator->proxyToString(prx))));
+	subscriptions.append({ prx, filter, {} });
+}
+
+void MumbleServerIce::removeEventCallback(const ::Server *server, const ::MumbleServer::ServerEventCallbackPrx &prx) {
+	QList< EventSubscription > &subscriptions = qmEventSubscriptions[server->iServerNum];
+
+	for (int i = 0; i < subscriptions.size(); ++i) {
+		if (subscriptions[i].prx == prx) {
+			subscriptions.removeAt(i);
+			server->log(QString("Removed Ice ServerEventCallback %1")
+							.arg(QString::fromStdString(communicator->proxyToString(prx))));
+			return;
+		}
+	}
+}
+
+void MumbleServerIce::removeEventCallbacks(const ::Server *server) {
+	if (qmEventSubscriptions.remove(server->iServerNum)) {
+		server->log(QString("Removed all Ice ServerEventCallbacks"));
+	}
+}
+
+static bool eventPasses(const ::MumbleServer::EventFilter &filter, ::MumbleServer::EventType type,
+						const ::Channel *channel) {
+	if (!filter.types.empty() && std::find(filter.types.begin(), filter.types.end(), type) == filter.types.end()) {
+		return false;
+	}
+
+	if (filter.channels.empty()) {
+		return true;
+	}
+	for (const ::Channel *c = channel; c; c = c->cParent) {
+		if (std::find(filter.channels.begin(), filter.channels.end(), static_cast< int >(c->iId))
+			!= filter.channels.end()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// Drops a pending state change of the user or channel that the given state change is about, as it is superseded.
+/// The new state change is appended rather than merged into the old one, so that it doesn't end up in front of the
+/// events it may depend on (e.g. the creation of the channel a user has moved to).
+static void supersedeEvent(::MumbleServer::EventList &pending, const ::MumbleServer::Event &event) {
+	for (auto it = pending.begin(); it != pending.end(); ++it) {
+		if (it->type != event.type) {
+			continue;
+		}
+
+		if ((event.type == EventUserStateChanged && it->user.session == event.user.session)
+			|| (event.type == EventChannelStateChanged && it->channel.id == event.channel.id)) {
+			pending.erase(it);
+			return;
+		}
+	}
+}
+
+void MumbleServerIce::queueEvent(const ::Server *server, ::MumbleServer::EventType type, const ::User *user,
+								 const ::Channel *channel, const ::TextMessage *message) {
+	auto subscriptions = qmEventSubscriptions.find(server->iServerNum);
+	if (subscriptions == qmEventSubscriptions.end()) {
+		return;
+	}
+
+	::MumbleServer::Event event;
+	bool converted = false;
+	QList<::MumbleServer::ServerEventCallbackPrx > due;
+
+	for (EventSubscription &subscription : *subscriptions) {
+		if (!eventPasses(subscription.filter, type, user ? user->cChannel : channel)) {
+			continue;
+		}
+
+		// The event is only converted once someone actually wants it
+		if (!converted) {
+			event.type = type;
+			if (user) {
+				userToUser(user, event.user);
+			}
+			if (channel) {
+				channelToChannel(channel, event.channel);
+			}
+			if (message) {
+				textmessageToTextmessage(*message, event.message);
+			}
+			converted = true;
+		}
+
+		const bool scheduled = !subscription.pending.empty();
+		if (type == EventUserStateChanged || type == EventChannelStateChanged) {
+			supersedeEvent(subscription.pending, event);
+		}
+		subscription.pending.push_back(event);
+
+		if (subscription.filter.window <= 0) {
+			due << subscription.prx;
+		} else if (!scheduled) {
+			const int server_id                              = server->iServerNum;
+			const ::MumbleServer::ServerEventCallbackPrx prx = subscription.prx;
+			QTimer::singleShot(subscription.filter.window, this,
+							   [this, server_id, prx]() { flushEvents(server_id, prx); });
+		}
+	}
+
+	// Delivering may remove subscriptions, so it mustn't happen while iterating over them
+	for (const ::MumbleServer::ServerEventCallbackPrx &prx : due) {
+		flushEvents(server->iServerNum, prx);
+	}
+}
+
+void MumbleServerIce::flushEvents(int server_id, const ::MumbleServer::ServerEventCallbackPrx &prx) {
+	auto subscriptions = qmEventSubscriptions.find(server_id);
+	if (subscriptions == qmEventSubscriptions.end()) {
+		return;
+	}
+
+	::MumbleServer::EventList events;
+	for (EventSubscription &subscription : *subscriptions) {
+		if (subscription.prx == prx) {
+			events.swap(subscription.pending);
+			break;
+		}
+	}
+
+	if (events.empty()) {
+		return;
+	}
+
+	try {
+		prx->events(events);
+	} catch (...) {
+		::Server *server = meta->qhServers.value(server_id);
+		if (server) {
+			badEventProxy(prx, server);
+		}
+	}
+}
+
 void MumbleServerIce::addServerContextCallback(const ::Server *server, int session_id, const QString &action,
 											   const ::MumbleServer::ServerContextCallbackPrx &prx) {
 	QMap< QString, ::MumbleServer::ServerContextCallbackPrx > &callbacks =
@@ -429,6 +609,109 @@ void MumbleServerIce::removeServerUpdatingAuthenticator(const ::Server *server)
 	}
 }
 
+/// The number of disconnected sessions that are remembered for Server.getUsersPage
+static const int REMEMBERED_DISCONNECTS = 4096;
+
+void MumbleServerIce::userChanged(const ::Server *server, const ::User *user, bool disconnected) {
+	IceUserGenerations &generations = qhUserGenerations[server->iServerNum];
+	generations.current++;
+
+	if (!disconnected) {
+		generations.changed.insert(user->uiSession, generations.current);
+		return;
+	}
+
+	generations.changed.remove(user->uiSession);
+	generations.removed.insert(generations.current, user->uiSession);
+	if (generations.removed.size() > REMEMBERED_DISCONNECTS) {
+		// Whoever hasn't asked for the changes since before this disconnect can't be told about it anymore
+		generations.removedSince = generations.removed.firstKey();
+		generations.removed.erase(generations.removed.begin());
+	}
+}
+
+const IceUserGenerations &MumbleServerIce::getUserGenerations(const ::Server *server) {
+	return qhUserGenerations[server->iServerNum];
+}
+
+static bool userSort(const ::User *a, const ::User *b) {
+	return ::User::lessThan(a, b);
+}
+
+static bool channelSort(const ::Channel *a, const ::Channel *b) {
+	return ::Channel::lessThan(a, b);
+}
+
+/// Builds the tree of the given channel out of the users and channels that have already been converted for the given
+/// snapshot
+static TreePtr recurseTree(const ::Channel *c, const IceServerSnapshot &snapshot) {
+	TreePtr t = new Tree();
+	t->c      = snapshot.channels.at(static_cast< int >(c->iId));
+
+	QList<::User * > users = c->qlUsers;
+	std::sort(users.begin(), users.end(), userSort);
+
+	foreach (const ::User *p, users) {
+		auto it = snapshot.users.find(static_cast< int >(p->uiSession));
+		if (it != snapshot.users.end()) {
+			t->users.push_back(it->second);
+		} else {
+			::MumbleServer::User mp;
+			userToUser(p, mp);
+			t->users.push_back(mp);
+		}
+	}
+
+	QList<::Channel * > channels = c->qlChannels;
+	std::sort(channels.begin(), channels.end(), channelSort);
+
+	foreach (const ::Channel *chn, channels) { t->children.push_back(recurseTree(chn, snapshot)); }
+
+	return t;
+}
+
+std::shared_ptr< const IceServerSnapshot > MumbleServerIce::getSnapshot(int server_id) {
+	QMutexLocker lock(&qmSnapshots);
+
+	std::shared_ptr< const IceServerSnapshot > snapshot = qhSnapshots.value(server_id);
+	if (snapshot
+		&& std::chrono::steady_clock::now() - snapshot->taken < std::chrono::milliseconds(Meta::mp.iIceSnapshotAge)) {
+		return snapshot;
+	}
+
+	return nullptr;
+}
+
+std::shared_ptr< const IceServerSnapshot > MumbleServerIce::takeSnapshot(const ::Server *server) {
+	// Several queries may have missed the snapshot before the first of them got to take a new one
+	std::shared_ptr< const IceServerSnapshot > current = getSnapshot(server->iServerNum);
+	if (current) {
+		return current;
+	}
+
+	std::shared_ptr< IceServerSnapshot > snapshot = std::make_shared< IceServerSnapshot >();
+	foreach (const ::User *p, server->qhUsers) {
+		if (static_cast< const ServerUser * >(p)->sState == ::ServerUser::Authenticated) {
+			userToUser(p, snapshot->users[static_cast< int >(p->uiSession)]);
+		}
+	}
+	foreach (const ::Channel *c, server->qhChannels) {
+		channelToChannel(c, snapshot->channels[static_cast< int >(c->iId)]);
+	}
+	snapshot->tree  = recurseTree(server->qhChannels.value(0), *snapshot);
+	snapshot->taken = std::chrono::steady_clock::now();
+
+	QMutexLocker lock(&qmSnapshots);
+	qhSnapshots.insert(server->iServerNum, snapshot);
+
+	return snapshot;
+}
+
+void MumbleServerIce::dropSnapshot(const ::Server *server) {
+	QMutexLocker lock(&qmSnapshots);
+	qhSnapshots.remove(server->iServerNum);
+}
+
 static ServerPrx idToProxy(int id, const Ice::ObjectAdapterPtr &adapter) {
 	Ice::Identity ident;
 	ident.category = "s";
@@ -457,6 +740,16 @@ void MumbleServerIce::started(::Server *s) {
 }
 
 void MumbleServerIce::stopped(::Server *s) {
+	dropSnapshot(s);
+	removeEventCallbacks(s);
+
+	// The sessions start over when the server is started again, so nobody may ask for the changes since before that.
+	// The generation itself keeps counting, so that it doesn't go back.
+	IceUserGenerations &generations = qhUserGenerations[s->iServerNum];
+	generations.changed.clear();
+	generations.removed.clear();
+	generations.removedSince = generations.current;
+
 	removeServerCallbacks(s);
 	removeServerAuthenticator(s);
 	removeServerUpdatingAuthenticator(s);
@@ -478,6 +771,10 @@ void MumbleServerIce::stopped(::Server *s) {
 void MumbleServerIce::userConnected(const ::User *p) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventUserConnected, p, nullptr);
+	userChanged(s, p);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -498,6 +795,10 @@ void MumbleServerIce::userConnected(const ::User *p) {
 void MumbleServerIce::userDisconnected(const ::User *p) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventUserDisconnected, p, nullptr);
+	userChanged(s, p, true);
+
 	qmServerContextCallbacks[s->iServerNum].remove(static_cast< int >(p->uiSession));
 
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
@@ -520,6 +821,10 @@ void MumbleServerIce::userDisconnected(const ::User *p) {
 void MumbleServerIce::userStateChanged(const ::User *p) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventUserStateChanged, p, nullptr);
+	userChanged(s, p);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -540,6 +845,8 @@ void MumbleServerIce::userStateChanged(const ::User *p) {
 void MumbleServerIce::userTextMessage(const ::User *p, const ::TextMessage &message) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	queueEvent(s, EventUserTextMessage, p, nullptr, &message);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -563,6 +870,9 @@ void MumbleServerIce::userTextMessage(const ::User *p, const ::TextMessage &mess
 void MumbleServerIce::channelCreated(const ::Channel *c) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventChannelCreated, nullptr, c);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -583,6 +893,9 @@ void MumbleServerIce::channelCreated(const ::Channel *c) {
 void MumbleServerIce::channelRemoved(const ::Channel *c) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventChannelRemoved, nullptr, c);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -603,6 +916,9 @@ void MumbleServerIce::channelRemoved(const ::Channel *c) {
 void MumbleServerIce::channelStateChanged(const ::Channel *c) {
 	::Server *s = qobject_cast<::Server * >(sender());
 
+	dropSnapshot(s);
+	queueEvent(s, EventChannelStateChanged, nullptr, c);
+
 	const QList<::MumbleServer::ServerCallbackPrx > &qmList = qmServerCallbacks[s->iServerNum];
 
 	if (qmList.isEmpty())
@@ -945,6 +1261,35 @@ static void impl_Server_removeCallback(const MumbleServer::AMD_Server_removeCall
 	}
 }
 
+static void impl_Server_addEventCallback(const MumbleServer::AMD_Server_addEventCallbackPtr cb, int server_id,
+										 const MumbleServer::ServerEventCallbackPrx &cbptr,
+										 const MumbleServer::EventFilter &filter) {
+	NEED_SERVER;
+
+	try {
+		const MumbleServer::ServerEventCallbackPrx &oneway =
+			MumbleServer::ServerEventCallbackPrx::checkedCast(cbptr->ice_oneway()->ice_connectionCached(false));
+		mi->addEventCallback(server, oneway, filter);
+		cb->ice_response();
+	} catch (...) {
+		cb->ice_exception(InvalidCallbackException());
+	}
+}
+
+static void impl_Server_removeEventCallback(const MumbleServer::AMD_Server_removeEventCallbackPtr cb, int server_id,
+											const MumbleServer::ServerEventCallbackPrx &cbptr) {
+	NEED_SERVER;
+
+	try {
+		const MumbleServer::ServerEventCallbackPrx &oneway =
+			MumbleServer::ServerEventCallbackPrx::uncheckedCast(cbptr->ice_oneway()->ice_connectionCached(false));
+		mi->removeEventCallback(server, oneway);
+		cb->ice_response();
+	} catch (...) {
+		cb->ice_exception(InvalidCallbackException());
+	}
+}
+
 static void impl_Server_setAuthenticator(const ::MumbleServer::AMD_Server_setAuthenticatorPtr &cb, int server_id,
 										 const ::MumbleServer::ServerAuthenticatorPrx &aptr) {
 	NEED_SERVER;
@@ -1076,38 +1421,99 @@ static void impl_Server_getChannels(const ::MumbleServer::AMD_Server_getChannels
 	cb->ice_response(cm);
 }
 
-static bool userSort(const ::User *a, const ::User *b) {
-	return ::User::lessThan(a, b);
+#define ACCESS_Server_getUsersSnapshot_READ
+#define DISPATCH_Server_getUsersSnapshot_DIRECT
+static void impl_Server_getUsersSnapshot(const ::MumbleServer::AMD_Server_getUsersSnapshotPtr cb, int server_id) {
+	// This runs on the Ice thread, which must not touch the server itself
+	std::shared_ptr< const IceServerSnapshot > snapshot = mi->getSnapshot(server_id);
+	if (snapshot) {
+		cb->ice_response(snapshot->users);
+		return;
+	}
+
+	QCoreApplication::instance()->postEvent(mi, new ExecEvent([cb, server_id]() {
+		NEED_SERVER;
+		cb->ice_response(mi->takeSnapshot(server)->users);
+	}));
 }
 
-static bool channelSort(const ::Channel *a, const ::Channel *b) {
-	return ::Channel::lessThan(a, b);
+#define ACCESS_Server_getChannelsSnapshot_READ
+#define DISPATCH_Server_getChannelsSnapshot_DIRECT
+static void impl_Server_getChannelsSnapshot(const ::MumbleServer::AMD_Server_getChannelsSnapshotPtr cb,
+											int server_id) {
+	// This runs on the Ice thread, which must not touch the server itself
+	std::shared_ptr< const IceServerSnapshot > snapshot = mi->getSnapshot(server_id);
+	if (snapshot) {
+		cb->ice_response(snapshot->channels);
+		return;
+	}
+
+	QCoreApplication::instance()->postEvent(mi, new ExecEvent([cb, server_id]() {
+		NEED_SERVER;
+		cb->ice_response(mi->takeSnapshot(server)->channels);
+	}));
 }
 
-TreePtr recurseTree(const ::Channel *c) {
-	TreePtr t = new Tree();
-	channelToChannel(c, t->c);
-	QList<::User * > users = c->qlUsers;
-	std::sort(users.begin(), users.end(), userSort);
+#define ACCESS_Server_getUsersPage_READ
+static void impl_Server_getUsersPage(const ::MumbleServer::AMD_Server_getUsersPagePtr cb, int server_id,
+									 const ::MumbleServer::UserQuery &query) {
+	NEED_SERVER;
 
-	foreach (const ::User *p, users) {
-		::MumbleServer::User mp;
-		userToUser(p, mp);
-		t->users.push_back(mp);
+	const IceUserGenerations &generations = mi->getUserGenerations(server);
+
+	::MumbleServer::UserPage page;
+	page.generation = generations.current;
+	page.next       = -1;
+	// A generation from the future has been handed out before the server process has been restarted
+	page.complete = query.since < generations.removedSince || query.since > generations.current;
+
+	const bool delta = query.since > 0 && !page.complete;
+	if (delta && query.after <= 0) {
+		for (auto it = generations.removed.upperBound(query.since); it != generations.removed.cend(); ++it) {
+			page.removed.push_back(static_cast< int >(it.value()));
+		}
 	}
 
-	QList<::Channel * > channels = c->qlChannels;
-	std::sort(channels.begin(), channels.end(), channelSort);
+	QList< unsigned int > sessions;
+	foreach (const ::ServerUser *u, server->qhUsers) {
+		if (u->sState != ::ServerUser::Authenticated || static_cast< int >(u->uiSession) <= query.after) {
+			continue;
+		}
+		if (delta && generations.changed.value(u->uiSession) <= query.since) {
+			continue;
+		}
+		sessions << u->uiSession;
+	}
+	std::sort(sessions.begin(), sessions.end());
 
-	foreach (const ::Channel *chn, channels) { t->children.push_back(recurseTree(chn)); }
+	for (unsigned int session : sessions) {
+		if (query.limit > 0 && page.users.size() >= static_cast< std::size_t >(query.limit)) {
+			page.next = static_cast< int >(page.users.back().session);
+			break;
+		}
 
-	return t;
+		::MumbleServer::User mu;
+		userToUser(server->qhUsers.value(session), mu, query.fields);
+		page.users.push_back(std::move(mu));
+	}
+
+	cb->ice_response(page);
 }
 
 #define ACCESS_Server_getTree_READ
+#define DISPATCH_Server_getTree_DIRECT
 static void impl_Server_getTree(const ::MumbleServer::AMD_Server_getTreePtr cb, int server_id) {
-	NEED_SERVER;
-	cb->ice_response(recurseTree(server->qhChannels.value(0)));
+	// This runs on the Ice thread, which must not touch the server itself
+	std::shared_ptr< const IceServerSnapshot > snapshot = mi->getSnapshot(server_id);
+	if (snapshot) {
+		cb->ice_response(snapshot->tree);
+		return;
+	}
+
+	QCoreApplication::instance()->postEvent(mi, new ExecEvent([cb, server_id]() {
+		NEED_SERVER;
+		cb->ice_response(mi->takeSnapshot(server)->tree);
+	}));
 }
 
 #define ACCESS_Server_getCertificateList_READ
@@ -1133,6 +1539,66 @@ static void impl_Server_getCertificateList(const ::MumbleServer::AMD_Server_getC
 	cb->ice_response(certs);
 }
 
+#define ACCESS_Server_getForwardingLatency_READ
+static void impl_Server_getForwardingLatency(const ::MumbleServer::AMD_Server_getForwardingLatencyPtr cb,
+											 int server_id) {
+	NEED_SERVER;
+
+	const Metrics::LatencyHistogram::Summary &latency = server->m_metrics.forwardingLatency.lastPeriod();
+
+	auto clamp = [](quint64 micros) {
+		return static_cast< int >(std::min< quint64 >(micros, std::numeric_limits< int >::max()));
+	};
+
+	::MumbleServer::LatencySummary summary;
+	summary.samples = static_cast< ::Ice::Long >(latency.count);
+	summary.sum     = static_cast< ::Ice::Long >(latency.sum);
+	summary.p50     = clamp(latency.p50);
+	summary.p99     = clamp(latency.p99);
+	summary.p999    = clamp(latency.p999);
+	summary.max     = clamp(latency.max);
+	cb->ice_response(summary);
+}
+
+#define ACCESS_Server_getMemoryUsage_READ
+static void impl_Server_getMemoryUsage(const ::MumbleServer::AMD_Server_getMemoryUsagePtr cb, int server_id) {
+	NEED_SERVER;
+
+	::MumbleServer::ServerMemoryUsage usage;
+	usage.usersTotal = 0;
+	foreach (const ::ServerUser *u, server->qhUsers) {
+		const ServerUser::MemoryUsage userUsage = u->memoryUsage();
+
+		::MumbleServer::UserMemoryUsage mu;
+		mu.session        = static_cast< int >(u->uiSession);
+		mu.object         = static_cast< ::Ice::Long >(userUsage.object);
+		mu.strings        = static_cast< ::Ice::Long >(userUsage.strings);
+		mu.whisperTargets = static_cast< ::Ice::Long >(userUsage.whisperTargets);
+		mu.sendQueue      = static_cast< ::Ice::Long >(userUsage.sendQueue);
+		mu.total          = static_cast< ::Ice::Long >(userUsage.total());
+		usage.users.push_back(mu);
+		usage.usersTotal += mu.total;
+	}
+
+	usage.channels = 0;
+	foreach (const Channel *c, server->qhChannels) {
+		usage.channels += static_cast< ::Ice::Long >(sizeof(Channel) + c->qbaDescHash.capacity())
+						  + static_cast< ::Ice::Long >(c->qsName.capacity() + c->qsDesc.capacity())
+								* static_cast< ::Ice::Long >(sizeof(QChar));
+	}
+
+	usage.bans = 0;
+	foreach (const Ban &ban, server->qlBans) {
+		usage.bans += static_cast< ::Ice::Long >(sizeof(Ban))
+					  + static_cast< ::Ice::Long >(ban.qsUsername.capacity() + ban.qsHash.capacity()
+												   + ban.qsReason.capacity())
+							* static_cast< ::Ice::Long >(sizeof(QChar));
+	}
+
+	usage.total = usage.usersTotal + usage.channels + usage.bans;
+	cb->ice_response(usage);
+}
+
 #define ACCESS_Server_getBans_READ
 static void impl_Server_getBans(const ::MumbleServer::AMD_Server_getBansPtr cb, int server_id) {
 	NEED_SERVER;
@@ -1156,6 +1622,7 @@ static void impl_Server_setBans(const ::MumbleServer::AMD_Server_setBansPtr cb,
 			banToBan(mb, ban);
 			server->qlBans << ban;
 		}
+		server->m_banIndex.rebuild(server->qlBans);
 	}
 
 	server->saveBans();
@@ -1301,6 +1768,24 @@ static void impl_Server_setState(const ::MumbleServer::AMD_Server_setStatePtr cb
 	cb->ice_response();
 }
 
+static void impl_Server_moveUsers(const ::MumbleServer::AMD_Server_moveUsersPtr cb, int server_id,
+								 const ::MumbleServer::MoveMap &moves) {
+	NEED_SERVER;
+
+	QList< QPair< ::User *, ::Channel * > > qlMoves;
+	for (const auto &move : moves) {
+		int session = move.first;
+		::Channel *channel;
+		NEED_PLAYER;
+		NEED_CHANNEL_VAR(channel, move.second);
+
+		qlMoves.append(qMakePair< ::User *, ::Channel * >(user, channel));
+	}
+
+	server->moveUsers(qlMoves);
+	cb->ice_response();
+}
+
 static void impl_Server_sendMessageChannel(const ::MumbleServer::AMD_Server_sendMessageChannelPtr cb, int server_id,
 										   ::Ice::Int channelid, bool tree, const ::std::string &text) {
 	NEED_SERVER;
@@ -1471,6 +1956,10 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 		ChanACL *acl;
 
 		QHash< QString, QSet< int > > hOldTemp;
+
+		// The compiled programs refer to the groups that are about to be deleted
+		server->dropACLPrograms(*channel);
+
 		foreach (g, channel->qhGroups) {
 			hOldTemp.insert(g->qsName, g->qsTemporary);
 			delete g;
@@ -1511,7 +2000,7 @@ static void impl_Server_setACL(const ::MumbleServer::AMD_Server_setACLPtr cb, in
 		}
 	}
 
-	server->clearACLCache();
+	server->clearACLCacheOfBranch(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1695,6 +2184,17 @@ static void impl_Server_getUptime(const ::MumbleServer::AMD_Server_getUptimePtr
 	cb->ice_response(static_cast< int >(server->tUptime.elapsed() / 1000000LL));
 }
 
+#define ACCESS_Server_getUserCacheStats_READ
+static void impl_Server_getUserCacheStats(const ::MumbleServer::AMD_Server_getUserCacheStatsPtr cb, int server_id) {
+	NEED_SERVER;
+
+	::MumbleServer::UserCacheStats stats;
+	stats.hits   = static_cast< Ice::Long >(server->m_userNameCache.hits());
+	stats.misses = static_cast< Ice::Long >(server->m_userNameCache.misses());
+	stats.size   = static_cast< int >(server->m_userNameCache.size());
+	cb->ice_response(stats);
+}
+
 static void impl_Server_updateCertificate(const ::MumbleServer::AMD_Server_updateCertificatePtr cb, int server_id,
 										  const ::std::string &certificate, const ::std::string &privateKey,
 										  const ::std::string &passphrase) {
@@ -2016,6 +2516,14 @@ static void impl_Meta_getUptime(const ::MumbleServer::AMD_Meta_getUptimePtr cb,
 #undef ACCESS_Server_getUsers_READ
 #undef ACCESS_Server_getChannels_READ
 #undef ACCESS_Server_getTree_READ
+#undef DISPATCH_Server_getTree_DIRECT
+#undef ACCESS_Server_getUsersPage_READ
+#undef ACCESS_Server_getForwardingLatency_READ
+#undef ACCESS_Server_getMemoryUsage_READ
+#undef ACCESS_Server_getUsersSnapshot_READ
+#undef DISPATCH_Server_getUsersSnapshot_DIRECT
+#undef ACCESS_Server_getChannelsSnapshot_READ
+#undef DISPATCH_Server_getChannelsSnapshot_DIRECT
 #undef ACCESS_Server_getCertificateList_READ
 #undef ACCESS_Server_getBans_READ
 #undef ACCESS_Server_hasPermission_READ
@@ -2030,6 +2538,7 @@ static void impl_Meta_getUptime(const ::MumbleServer::AMD_Meta_getUptimePtr cb,
 #undef ACCESS_Server_verifyPassword_READ
 #undef ACCESS_Server_getTexture_READ
 #undef ACCESS_Server_getUptime_READ
+#undef ACCESS_Server_getUserCacheStats_READ
 #undef ACCESS_Meta_getSliceChecksums_ALL
 #undef ACCESS_Meta_getServer_READ
 #undef ACCESS_Meta_getAllServers_READ
@@ -13,6 +13,7 @@
 #	define WIN32_LEAN_AND_MEAN
 #endif
 
+#include <QtCore/QHash>
 #include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtCore/QMutex>
@@ -22,11 +23,36 @@
 
 #include "MumbleServerI.h"
 
+#include <chrono>
+#include <memory>
+
 class Channel;
 class Server;
 class User;
 struct TextMessage;
 
+/// An immutable copy of the users and channels of a running server. Ice threads answer bulk queries from it, so that
+/// they don't have to wait for the main thread (see MetaParams::iIceSnapshotAge).
+struct IceServerSnapshot {
+	::MumbleServer::UserMap users;
+	::MumbleServer::ChannelMap channels;
+	/// The channels and users as returned by Server.getTree, built from the ones above
+	::MumbleServer::TreePtr tree;
+	std::chrono::steady_clock::time_point taken;
+};
+
+/// Tracks when the users of a server have last changed, so that Server.getUsersPage can return the changes only
+struct IceUserGenerations {
+	qint64 current = 0;
+	/// The generation at which each connected user has last changed, by session
+	QHash< unsigned int, qint64 > changed;
+	/// The sessions that have disconnected, by the generation they have disconnected at. Only the latest ones are kept,
+	/// so that the memory stays bounded no matter how many users come and go.
+	QMap< qint64, unsigned int > removed;
+	/// The generation since which all disconnects are in removed
+	qint64 removedSince = 0;
+};
+
 class MumbleServerIce : public QObject {
 	friend class MurmurLocker;
 	Q_OBJECT
@@ -39,11 +65,31 @@ protected:
 	void badMetaProxy(const ::MumbleServer::MetaCallbackPrx &prx);
 	void badServerProxy(const ::MumbleServer::ServerCallbackPrx &prx, const ::Server *server);
 	void badAuthenticator(::Server *);
+	void badEventProxy(const ::MumbleServer::ServerEventCallbackPrx &prx, const ::Server *server);
 	QList<::MumbleServer::MetaCallbackPrx > qlMetaCallbacks;
 	QMap< int, QList<::MumbleServer::ServerCallbackPrx > > qmServerCallbacks;
 	QMap< int, QMap< int, QMap< QString, ::MumbleServer::ServerContextCallbackPrx > > > qmServerContextCallbacks;
 	QMap< int, ::MumbleServer::ServerAuthenticatorPrx > qmServerAuthenticator;
 	QMap< int, ::MumbleServer::ServerUpdatingAuthenticatorPrx > qmServerUpdatingAuthenticator;
+	/// A ServerEventCallback together with its filter and the events that haven't been delivered to it yet
+	struct EventSubscription {
+		::MumbleServer::ServerEventCallbackPrx prx;
+		::MumbleServer::EventFilter filter;
+		::MumbleServer::EventList pending;
+	};
+	QMap< int, QList< EventSubscription > > qmEventSubscriptions;
+	/// Hands the given event to every event callback of the server whose filter it passes
+	void queueEvent(const ::Server *server, ::MumbleServer::EventType type, const ::User *user,
+					const ::Channel *channel, const ::TextMessage *message = nullptr);
+	/// Delivers the pending events of the given event callback
+	void flushEvents(int server_id, const ::MumbleServer::ServerEventCallbackPrx &prx);
+	QHash< int, IceUserGenerations > qhUserGenerations;
+	void userChanged(const ::Server *server, const ::User *user, bool disconnected = false);
+
+	/// Guards qhSnapshots, which is accessed by the Ice threads as well
+	QMutex qmSnapshots;
+	QHash< int, std::shared_ptr< const IceServerSnapshot > > qhSnapshots;
+	void dropSnapshot(const ::Server *server);
 
 public:
 	Ice::CommunicatorPtr communicator;
@@ -56,6 +102,11 @@ public:
 	void addServerCallback(const ::Server *server, const ::MumbleServer::ServerCallbackPrx &prx);
 	void removeServerCallback(const ::Server *server, const ::MumbleServer::ServerCallbackPrx &prx);
 	void removeServerCallbacks(const ::Server *server);
+	void addEventCallback(const ::Server *server, const ::MumbleServer::ServerEventCallbackPrx &prx,
+						  const ::MumbleServer::EventFilter &filter);
+	void removeEventCallback(const ::Server *server, const ::MumbleServer::ServerEventCallbackPrx &prx);
+	void removeEventCallbacks(const ::Server *server);
+	const IceUserGenerations &getUserGenerations(const ::Server *server);
 	void addServerContextCallback(const ::Server *server, int session_id, const QString &action,
 								  const ::MumbleServer::ServerContextCallbackPrx &prx);
 	const QMap< int, QMap< QString, ::MumbleServer::ServerContextCallbackPrx > >
@@ -69,6 +120,13 @@ public:
 	const ::MumbleServer::ServerUpdatingAuthenticatorPrx getServerUpdatingAuthenticator(const ::Server *server) const;
 	void removeServerUpdatingAuthenticator(const ::Server *server);
 
+	/// @returns The snapshot of the given server or nullptr if there is none that is recent enough. May be called from
+	/// 	any thread.
+	std::shared_ptr< const IceServerSnapshot > getSnapshot(int server_id);
+	/// @returns A snapshot of the given server, which is taken unless there is one that is recent enough. Must be
+	/// 	called from the main thread.
+	std::shared_ptr< const IceServerSnapshot > takeSnapshot(const ::Server *server);
+
 public slots:
 	void started(Server *);
 	void stopped(Server *);
@@ -0,0 +1,26 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "NamePattern.h"
+
+NamePattern::NamePattern() : NamePattern(QString()) {
+}
+
+NamePattern::NamePattern(const QString &pattern)
+	: m_pattern(pattern),
+	  // This is what QRegularExpression::anchoredPattern() does, which isn't available in all supported Qt versions.
+	  // Just like QRegExp, \w and friends have to match any letter and not only the ASCII ones.
+	  m_expression(QString::fromLatin1("\\A(?:%1)\\z").arg(pattern), QRegularExpression::UseUnicodePropertiesOption) {
+	// Compiles the expression (with the JIT, where available) right away
+	m_expression.optimize();
+}
+
+const QString &NamePattern::pattern() const {
+	return m_pattern;
+}
+
+bool NamePattern::exactMatch(const QString &name) const {
+	return m_expression.isValid() && m_expression.match(name).hasMatch();
+}
@@ -0,0 +1,34 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_NAMEPATTERN_H_
+#define MUMBLE_MURMUR_NAMEPATTERN_H_
+
+#include <QtCore/QRegularExpression>
+#include <QtCore/QString>
+
+/// The pattern user and channel names have to match (see Server::validateUserName() and
+/// Server::validateChannelName()). The expression is compiled once when the pattern is set, instead of every time a
+/// name is checked.
+///
+/// Unlike QRegExp, matching doesn't modify the object, so names may be checked by several threads at once.
+class NamePattern {
+public:
+	/// Constructs a pattern that only matches the empty name
+	NamePattern();
+	explicit NamePattern(const QString &pattern);
+
+	/// @returns The pattern as it has been configured
+	const QString &pattern() const;
+	/// @returns Whether the pattern matches the whole name
+	bool exactMatch(const QString &name) const;
+
+protected:
+	QString m_pattern;
+	/// The pattern, anchored at both ends of the name
+	QRegularExpression m_expression;
+};
+
+#endif // MUMBLE_MURMUR_NAMEPATTERN_H_
@@ -0,0 +1,180 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "PingResponder.h"
+
+#include "MumbleUDP.pb.h"
+
+#include <QtCore/QtEndian>
+
+#ifdef Q_OS_WIN
+#	include <ws2tcpip.h>
+#else
+#	include <netinet/in.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+/// Legacy replies consist of the version, the timestamp, the user count, the maximum user count and the maximum
+/// bandwidth
+constexpr std::size_t LEGACY_REPLY_SIZE       = 4 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+constexpr std::size_t LEGACY_TIMESTAMP_OFFSET = sizeof(std::uint32_t);
+/// The tag of the timestamp (field 1, varint)
+constexpr Mumble::Protocol::byte TIMESTAMP_TAG = 0x08;
+/// The tag and the longest varint
+constexpr std::size_t MAX_TIMESTAMP_SIZE = 1 + 10;
+
+std::uint64_t mix(std::uint64_t value) {
+	// The finalizer of splitmix64
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ULL;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	return value;
+}
+} // namespace
+
+PingResponder::PingResponder() : m_sequence(0) {
+	for (Template *target : { &m_legacy, &m_protobuf }) {
+		for (std::atomic< std::uint64_t > &word : target->words) {
+			word.store(0, std::memory_order_relaxed);
+		}
+		target->size.store(0, std::memory_order_relaxed);
+	}
+	update(Details());
+}
+
+void PingResponder::update(const Details &details) {
+	std::array< Mumble::Protocol::byte, MAX_REPLY_SIZE > legacy{};
+	std::uint32_t value = qToBigEndian(Version::toLegacyVersion(details.version));
+	memcpy(legacy.data(), &value, sizeof(value));
+	// The timestamp follows, which is filled in by reply()
+	std::size_t offset = LEGACY_TIMESTAMP_OFFSET + sizeof(std::uint64_t);
+	for (unsigned int field : { details.userCount, details.maxUserCount, details.maxBandwidth }) {
+		value = qToBigEndian(static_cast< std::uint32_t >(field));
+		memcpy(legacy.data() + offset, &value, sizeof(value));
+		offset += sizeof(value);
+	}
+
+	MumbleUDP::Ping ping;
+	ping.set_server_version_v2(details.version);
+	ping.set_user_count(details.userCount);
+	ping.set_max_user_count(details.maxUserCount);
+	ping.set_max_bandwidth_per_user(details.maxBandwidth);
+
+	std::array< Mumble::Protocol::byte, MAX_REPLY_SIZE > protobuf{};
+	const std::size_t protobufSize = ping.ByteSizeLong();
+	assert(1 + protobufSize + MAX_TIMESTAMP_SIZE <= MAX_REPLY_SIZE);
+	ping.SerializeToArray(protobuf.data(), static_cast< int >(protobuf.size()));
+
+	const std::uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+	m_sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	store(m_legacy, legacy.data(), LEGACY_REPLY_SIZE);
+	store(m_protobuf, protobuf.data(), protobufSize);
+
+	m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+std::size_t PingResponder::reply(std::uint64_t timestamp, bool protobuf, Mumble::Protocol::byte *buffer) const {
+	const Template &source = protobuf ? m_protobuf : m_legacy;
+
+	std::array< std::uint64_t, WORDS > words;
+	std::size_t size;
+	std::uint64_t sequence;
+	do {
+		sequence = m_sequence.load(std::memory_order_acquire);
+		for (std::size_t i = 0; i < WORDS; ++i) {
+			words[i] = source.words[i].load(std::memory_order_relaxed);
+		}
+		size = source.size.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) != 0 || m_sequence.load(std::memory_order_relaxed) != sequence);
+
+	if (!protobuf) {
+		memcpy(buffer, words.data(), size);
+		// Just like the client has sent it
+		memcpy(buffer + LEGACY_TIMESTAMP_OFFSET, &timestamp, sizeof(timestamp));
+		return size;
+	}
+
+	buffer[0] = static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDPMessageType::Ping);
+	memcpy(buffer + 1, words.data(), size);
+	size += 1;
+
+	if (timestamp != 0) {
+		buffer[size++] = TIMESTAMP_TAG;
+		do {
+			buffer[size++] = static_cast< Mumble::Protocol::byte >((timestamp & 0x7f) | (timestamp > 0x7f ? 0x80 : 0));
+			timestamp >>= 7;
+		} while (timestamp != 0);
+	}
+
+	return size;
+}
+
+void PingResponder::store(Template &target, const Mumble::Protocol::byte *data, std::size_t size) {
+	for (std::size_t i = 0; i < WORDS; ++i) {
+		std::uint64_t word;
+		memcpy(&word, data + i * sizeof(word), sizeof(word));
+		target.words[i].store(word, std::memory_order_relaxed);
+	}
+	target.size.store(size, std::memory_order_relaxed);
+}
+
+PingRateLimiter::PingRateLimiter(unsigned int pingsPerSecond, unsigned int burst)
+	: m_interval(0), m_tolerance(0), m_due(SLOTS, 0) {
+	configure(pingsPerSecond, burst);
+}
+
+void PingRateLimiter::configure(unsigned int pingsPerSecond, unsigned int burst) {
+	const quint64 interval = pingsPerSecond == 0 ? 0 : std::max< quint64 >(1000000 / pingsPerSecond, 1);
+
+	m_tolerance.store(interval * (std::max(burst, 1U) - 1), std::memory_order_relaxed);
+	m_interval.store(interval, std::memory_order_relaxed);
+}
+
+bool PingRateLimiter::allow(const sockaddr_storage &from, quint64 now) {
+	const quint64 interval = m_interval.load(std::memory_order_relaxed);
+	if (interval == 0) {
+		return true;
+	}
+
+	quint64 &due       = m_due[slot(from)];
+	const quint64 next = std::max(due, now);
+	if (next - now > m_tolerance.load(std::memory_order_relaxed)) {
+		return false;
+	}
+
+	due = next + interval;
+	return true;
+}
+
+std::size_t PingRateLimiter::slot(const sockaddr_storage &from) {
+	std::uint64_t key = 0;
+	if (from.ss_family == AF_INET6) {
+		const unsigned char *address = reinterpret_cast< const sockaddr_in6 * >(&from)->sin6_addr.s6_addr;
+
+		static const unsigned char V4_MAPPED[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+		if (memcmp(address, V4_MAPPED, sizeof(V4_MAPPED)) == 0) {
+			// IPv4 pings received by dual-stack sockets count just like the ones received by IPv4 sockets
+			std::uint32_t v4;
+			memcpy(&v4, address + sizeof(V4_MAPPED), sizeof(v4));
+			key = v4;
+		} else {
+			memcpy(&key, address, sizeof(key));
+			key = mix(key) + 1;
+		}
+	} else {
+		key = reinterpret_cast< const sockaddr_in * >(&from)->sin_addr.s_addr;
+	}
+
+	return static_cast< std::size_t >(mix(key) % SLOTS);
+}
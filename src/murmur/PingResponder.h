@@ -0,0 +1,113 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_PINGRESPONDER_H_
+#define MUMBLE_MURMUR_PINGRESPONDER_H_
+
+#include "MumbleProtocol.h"
+#include "Version.h"
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#else
+#	include <sys/socket.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// The replies to the unencrypted pings that ask for the server's details (its version, the number of users, the
+/// maximum number of users and the maximum bandwidth), which the public server list and the connect dialog of every
+/// client that knows about the server keep sending.
+///
+/// The replies are encoded whenever the details change (see update()) instead of for every ping, so that answering a
+/// ping only takes copying the reply and filling in the ping's timestamp. They are published through a sequence lock,
+/// which lets any thread answer pings (see reply()) without taking Server::qrwlVoiceThread or any other lock.
+class PingResponder {
+public:
+	/// The size of the largest reply in bytes
+	static constexpr std::size_t MAX_REPLY_SIZE = 48;
+
+	struct Details {
+		Version::full_t version   = Version::UNKNOWN;
+		unsigned int userCount    = 0;
+		unsigned int maxUserCount = 0;
+		unsigned int maxBandwidth = 0;
+	};
+
+	PingResponder();
+
+	/// Encodes the replies for the given details. Must not be called by several threads at once.
+	void update(const Details &details);
+
+	/// Writes the reply to a ping with the given timestamp that requests the server's details into the given buffer
+	///
+	/// @param protobuf Whether the reply has to be in the protobuf format (as opposed to the legacy one), which is the
+	/// 	format the request has been in
+	/// @param buffer Receives the reply. It has to hold MAX_REPLY_SIZE bytes.
+	/// @returns The size of the reply
+	std::size_t reply(std::uint64_t timestamp, bool protobuf, Mumble::Protocol::byte *buffer) const;
+
+protected:
+	static constexpr std::size_t WORDS = MAX_REPLY_SIZE / sizeof(std::uint64_t);
+
+	/// An encoded reply along with its size. The words are atomics (albeit only ever accessed with relaxed ordering),
+	/// so that reading them while they are being written is well-defined.
+	struct Template {
+		std::array< std::atomic< std::uint64_t >, WORDS > words;
+		std::atomic< std::size_t > size;
+	};
+
+	/// Odd while the templates are being written
+	std::atomic< std::uint64_t > m_sequence;
+	Template m_legacy;
+	/// The reply without its header byte and timestamp, which is appended as the last field (protobuf doesn't care
+	/// about the order of the fields)
+	Template m_protobuf;
+
+	static void store(Template &target, const Mumble::Protocol::byte *data, std::size_t size);
+};
+
+/// Limits the rate at which every source address may ask for the server's details via ping, so that floods of these
+/// pings can't keep a voice thread busy.
+///
+/// The limits are kept in a table of fixed size that is indexed by a hash of the source address (without its port,
+/// and only the network prefix for IPv6, which is what a single host usually gets), so that spoofed sources can't make
+/// it grow. Sources that end up in the same slot share their limit.
+///
+/// The limits may be configured by any thread, but only a single thread may check them.
+class PingRateLimiter {
+public:
+	/// The number of slots of the table
+	static constexpr std::size_t SLOTS = 4096;
+
+	/// @param pingsPerSecond The rate at which a source may ping in the long run. 0 disables the limit.
+	/// @param burst The number of pings a source may send at once
+	PingRateLimiter(unsigned int pingsPerSecond, unsigned int burst);
+
+	void configure(unsigned int pingsPerSecond, unsigned int burst);
+
+	/// @param now The current time in microseconds (see BandwidthRecord::clock)
+	/// @returns Whether the ping from the given source may be answered
+	bool allow(const sockaddr_storage &from, quint64 now);
+
+protected:
+	/// The time between two pings in microseconds (0 if there is no limit) and for how long pings may come in faster
+	std::atomic< quint64 > m_interval;
+	std::atomic< quint64 > m_tolerance;
+	/// For every slot, the time at which the next ping is due (as in the generic cell rate algorithm). A source may
+	/// ping as long as this isn't further ahead than the tolerance.
+	std::vector< quint64 > m_due;
+
+	static std::size_t slot(const sockaddr_storage &from);
+};
+
+#endif // MUMBLE_MURMUR_PINGRESPONDER_H_
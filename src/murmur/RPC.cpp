@@ -120,11 +120,15 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 			return false;
 		}
 
+		invalidateWhisperTargetsOfBranch(cChannel);
 		{
 			QWriteLocker wl(&qrwlVoiceThread);
 			cChannel->cParent->removeChannel(cChannel);
 			cParent->addChannel(cChannel);
 		}
+		invalidateWhisperTargetsOfBranch(cChannel);
+		// The channel now inherits the ACLs and groups of its new parent
+		clearACLCacheOfBranch(cChannel);
 
 		mpcs.set_parent(cParent->iId);
 
@@ -237,16 +241,23 @@ void Server::setTempGroups(int userid, int sessionId, Channel *cChannel, const Q
 				g->qsTemporary.remove(-sessionId);
 		}
 
+		bool created = false;
 		QString gname;
 		foreach (gname, groups) {
 			g = cChannel->qhGroups.value(gname);
 			if (!g) {
-				g = new Group(cChannel, gname);
+				g       = new Group(cChannel, gname);
+				created = true;
 			}
 			g->qsTemporary.insert(userid);
 			if (sessionId != 0)
 				g->qsTemporary.insert(-sessionId);
 		}
+
+		if (created) {
+			// The compiled programs of the branch have looked the group up by its name and not found it
+			dropACLPrograms(*cChannel);
+		}
 	}
 
 	if (userid >= 0) {
@@ -5,11 +5,11 @@
 
 #include "Meta.h"
 #include "OSInfo.h"
+#include "RegistrationWorker.h"
 #include "Server.h"
 #include "Version.h"
 
-#include <QtNetwork/QNetworkAccessManager>
-#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
 #include <QtXml/QDomDocument>
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
@@ -40,10 +40,6 @@ void Server::update() {
 	if (qsRegName.isEmpty() || qsRegPassword.isEmpty() || !qurlRegWeb.isValid() || !qsPassword.isEmpty() || !bAllowPing)
 		return;
 
-	// When QNAM distinguishes connections by client cert, move this to Meta
-	if (!qnamNetwork)
-		qnamNetwork = new QNetworkAccessManager(this);
-
 #if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
 	qtTick.start(1000 * (60 * 60 + (static_cast< int >(QRandomGenerator::global()->generate()) % 300)));
 #else
@@ -126,24 +122,6 @@ void Server::update() {
 
 	qnr.setSslConfiguration(ssl);
 
-	QNetworkReply *rep = qnamNetwork->post(qnr, doc.toString().toUtf8());
-	connect(rep, SIGNAL(finished()), this, SLOT(finished()));
-	connect(rep, SIGNAL(sslErrors(const QList< QSslError > &)), this, SLOT(regSslError(const QList< QSslError > &)));
-}
-
-void Server::finished() {
-	QNetworkReply *rep = qobject_cast< QNetworkReply * >(sender());
-
-	if (rep->error() != QNetworkReply::NoError) {
-		log(QString("Registration failed: %1").arg(rep->errorString()));
-	} else {
-		QByteArray qba = rep->readAll();
-		log(QString("Registration: %1").arg(QLatin1String(qba)));
-	}
-	rep->deleteLater();
-}
-
-void Server::regSslError(const QList< QSslError > &errs) {
-	foreach (const QSslError &e, errs)
-		log(QString("Registration: SSL Handshake error: %1").arg(e.errorString()));
+	// The request is sent from the registration thread, so that a slow or unreachable list server never stalls us
+	meta->m_registrationWorker->submit({ iServerNum, qnr, doc.toString().toUtf8() });
 }
@@ -0,0 +1,342 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "RegisteredIO.h"
+
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+
+namespace {
+/// Keeps the buffers 8-byte aligned
+std::size_t stride(std::size_t size) {
+	return (size + 7) / 8 * 8;
+}
+
+std::size_t addressLength(const sockaddr_storage &address) {
+	return (address.ss_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+} // namespace
+
+RegisteredIO::RegisteredIO() {
+	memset(&m_rio, 0, sizeof(m_rio));
+}
+
+RegisteredIO::~RegisteredIO() {
+	// The request queues are closed along with their sockets, which has to have happened by now (see
+	// VoiceContext::registeredIO)
+	if (m_rioLoaded) {
+		if (m_receiveQueue != RIO_INVALID_CQ) {
+			m_rio.RIOCloseCompletionQueue(m_receiveQueue);
+		}
+		if (m_sendQueue != RIO_INVALID_CQ) {
+			m_rio.RIOCloseCompletionQueue(m_sendQueue);
+		}
+		for (RIO_BUFFERID id : { m_receiveBufferId, m_receiveAddressId, m_sendBufferId, m_sendAddressId }) {
+			if (id != RIO_INVALID_BUFFERID) {
+				m_rio.RIODeregisterBuffer(id);
+			}
+		}
+	}
+	if (m_completionEvent) {
+		CloseHandle(m_completionEvent);
+	}
+}
+
+bool RegisteredIO::init(const std::vector< SOCKET > &sockets, HANDLE notifyEvent, unsigned int receiveBuffers,
+						std::size_t bufferSize, unsigned int sendBuffers, std::size_t sendBufferSize) {
+	if (sockets.empty() || !loadFunctions(sockets.front())) {
+		return false;
+	}
+
+	m_sockets           = sockets;
+	m_notifyEvent       = notifyEvent;
+	m_receivesPerSocket = std::max(receiveBuffers, 1U);
+	sendBuffers         = std::max(sendBuffers, 1U);
+	m_sendBufferSize    = sendBufferSize;
+	m_receiveBufferSize = bufferSize;
+
+	// Like our other receive buffers, every buffer starts 4 bytes after an 8-byte boundary so that the payload
+	// following the crypt header is aligned
+	m_receiveStride = stride(bufferSize + 4);
+	m_sendStride    = stride(sendBufferSize);
+
+	const std::size_t receiveCount = m_sockets.size() * m_receivesPerSocket;
+	m_receiveBuffers.resize(receiveCount * m_receiveStride);
+	m_receiveAddresses.resize(receiveCount);
+	m_sendBuffers.resize(sendBuffers * m_sendStride);
+	m_sendAddresses.resize(sendBuffers);
+
+	m_receiveBufferId  = m_rio.RIORegisterBuffer(reinterpret_cast< PCHAR >(m_receiveBuffers.data()),
+												 static_cast< DWORD >(m_receiveBuffers.size()));
+	m_receiveAddressId = m_rio.RIORegisterBuffer(reinterpret_cast< PCHAR >(m_receiveAddresses.data()),
+												 static_cast< DWORD >(m_receiveAddresses.size() * sizeof(AddressSlot)));
+	m_sendBufferId     = m_rio.RIORegisterBuffer(reinterpret_cast< PCHAR >(m_sendBuffers.data()),
+												 static_cast< DWORD >(m_sendBuffers.size()));
+	m_sendAddressId    = m_rio.RIORegisterBuffer(reinterpret_cast< PCHAR >(m_sendAddresses.data()),
+												 static_cast< DWORD >(m_sendAddresses.size() * sizeof(AddressSlot)));
+	if (m_receiveBufferId == RIO_INVALID_BUFFERID || m_receiveAddressId == RIO_INVALID_BUFFERID
+		|| m_sendBufferId == RIO_INVALID_BUFFERID || m_sendAddressId == RIO_INVALID_BUFFERID) {
+		setError("RIORegisterBuffer", WSAGetLastError());
+		return false;
+	}
+
+	m_completionEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (!m_completionEvent) {
+		setError("CreateEvent", static_cast< int >(GetLastError()));
+		return false;
+	}
+
+	RIO_NOTIFICATION_COMPLETION completion;
+	completion.Type              = RIO_EVENT_COMPLETION;
+	completion.Event.EventHandle = m_completionEvent;
+	completion.Event.NotifyReset = TRUE;
+
+	m_receiveQueue = m_rio.RIOCreateCompletionQueue(static_cast< DWORD >(receiveCount), &completion);
+	// The completed sends are only collected when a send buffer is needed, so nothing has to be notified
+	m_sendQueue = m_rio.RIOCreateCompletionQueue(static_cast< DWORD >(m_sockets.size() * sendBuffers), nullptr);
+	if (m_receiveQueue == RIO_INVALID_CQ || m_sendQueue == RIO_INVALID_CQ) {
+		setError("RIOCreateCompletionQueue", WSAGetLastError());
+		return false;
+	}
+
+	// The send buffers are shared by all sockets, so every socket may have all of them in flight
+	for (std::size_t i = 0; i < m_sockets.size(); ++i) {
+		RIO_RQ queue = m_rio.RIOCreateRequestQueue(m_sockets[i], m_receivesPerSocket, 1, sendBuffers, 1,
+												   m_receiveQueue, m_sendQueue, reinterpret_cast< PVOID >(i));
+		if (queue == RIO_INVALID_RQ) {
+			setError("RIOCreateRequestQueue", WSAGetLastError());
+			return false;
+		}
+		m_requestQueues.push_back(queue);
+	}
+	m_pendingSends.assign(m_sockets.size(), false);
+
+	m_freeSends.reserve(sendBuffers);
+	for (ULONG i = 0; i < sendBuffers; ++i) {
+		m_freeSends.push_back(sendBuffers - 1 - i);
+	}
+
+	// All receive buffers are posted the same way as the ones of received datagrams are
+	m_usedReceives.reserve(receiveCount);
+	for (ULONG i = 0; i < receiveCount; ++i) {
+		m_usedReceives.push_back(i);
+	}
+	if (!recycleReceives()) {
+		return false;
+	}
+
+	m_valid = true;
+	return true;
+}
+
+bool RegisteredIO::isValid() const {
+	return m_valid;
+}
+
+RegisteredIO::Result RegisteredIO::wait(std::vector< Datagram > &datagrams, std::size_t maxDatagrams) {
+	datagrams.clear();
+
+	if (!m_valid) {
+		return Result::Failed;
+	}
+	if (!recycleReceives()) {
+		m_valid = false;
+		return Result::Failed;
+	}
+
+	maxDatagrams = std::max< std::size_t >(maxDatagrams, 1);
+	if (m_results.size() < maxDatagrams) {
+		m_results.resize(maxDatagrams);
+	}
+
+	while (true) {
+		const ULONG count =
+			m_rio.RIODequeueCompletion(m_receiveQueue, m_results.data(), static_cast< ULONG >(maxDatagrams));
+		if (count == RIO_CORRUPT_CQ) {
+			setError("RIODequeueCompletion", WSAGetLastError());
+			m_valid = false;
+			return Result::Failed;
+		}
+
+		if (count > 0) {
+			for (ULONG i = 0; i < count; ++i) {
+				const RIORESULT &result = m_results[i];
+				const ULONG buffer      = static_cast< ULONG >(result.RequestContext);
+
+				// The buffer is posted again by the next call, even if the receive has failed
+				m_usedReceives.push_back(buffer);
+				if (result.Status != 0) {
+					continue;
+				}
+
+				Datagram datagram;
+				datagram.socketIndex = static_cast< std::size_t >(result.SocketContext);
+				datagram.from        = &m_receiveAddresses[buffer].address;
+				datagram.data        = m_receiveBuffers.data() + buffer * m_receiveStride + 4;
+				datagram.length      = result.BytesTransferred;
+				datagrams.push_back(datagram);
+			}
+
+			return Result::Received;
+		}
+
+		// Nothing has been received yet. The event is signaled right away if something arrives in between.
+		const INT ret = m_rio.RIONotify(m_receiveQueue);
+		if (ret != ERROR_SUCCESS && ret != WSAEALREADY) {
+			setError("RIONotify", ret);
+			m_valid = false;
+			return Result::Failed;
+		}
+
+		// The notification comes first, so that stopping isn't delayed by a flood of datagrams
+		const HANDLE events[] = { m_notifyEvent, m_completionEvent };
+		const DWORD woken     = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+		if (woken == WAIT_OBJECT_0) {
+			return Result::Notified;
+		}
+		if (woken != WAIT_OBJECT_0 + 1) {
+			setError("WaitForMultipleObjects", static_cast< int >(GetLastError()));
+			m_valid = false;
+			return Result::Failed;
+		}
+	}
+}
+
+bool RegisteredIO::queueSend(SOCKET socket, const unsigned char *data, std::size_t length,
+							 const sockaddr_storage &destination) {
+	if (!m_valid || length > m_sendBufferSize) {
+		return false;
+	}
+
+	const auto it = std::find(m_sockets.begin(), m_sockets.end(), socket);
+	if (it == m_sockets.end()) {
+		return false;
+	}
+	const std::size_t socketIndex = static_cast< std::size_t >(it - m_sockets.begin());
+
+	if (m_freeSends.empty()) {
+		reapSends();
+		if (m_freeSends.empty()) {
+			return false;
+		}
+	}
+
+	const ULONG buffer = m_freeSends.back();
+
+	memcpy(m_sendBuffers.data() + buffer * m_sendStride, data, length);
+	memcpy(&m_sendAddresses[buffer].address, &destination, addressLength(destination));
+
+	RIO_BUF dataBuffer;
+	dataBuffer.BufferId = m_sendBufferId;
+	dataBuffer.Offset   = static_cast< ULONG >(buffer * m_sendStride);
+	dataBuffer.Length   = static_cast< ULONG >(length);
+
+	RIO_BUF addressBuffer;
+	addressBuffer.BufferId = m_sendAddressId;
+	addressBuffer.Offset   = static_cast< ULONG >(buffer * sizeof(AddressSlot));
+	addressBuffer.Length   = sizeof(SOCKADDR_INET);
+
+	if (!m_rio.RIOSendEx(m_requestQueues[socketIndex], &dataBuffer, 1, nullptr, &addressBuffer, nullptr, nullptr,
+						 RIO_MSG_DEFER, reinterpret_cast< PVOID >(static_cast< ULONG_PTR >(buffer)))) {
+		return false;
+	}
+
+	m_freeSends.pop_back();
+	m_pendingSends[socketIndex] = true;
+
+	return true;
+}
+
+void RegisteredIO::commitSends() {
+	ZoneScoped;
+
+	for (std::size_t i = 0; i < m_requestQueues.size(); ++i) {
+		if (m_pendingSends[i]) {
+			m_rio.RIOSend(m_requestQueues[i], nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr);
+			m_pendingSends[i] = false;
+		}
+	}
+}
+
+const std::string &RegisteredIO::errorMessage() const {
+	return m_error;
+}
+
+bool RegisteredIO::loadFunctions(SOCKET socket) {
+	GUID id      = WSAID_MULTIPLE_RIO;
+	DWORD bytes  = 0;
+	m_rio.cbSize = sizeof(m_rio);
+
+	if (WSAIoctl(socket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &id, sizeof(id), &m_rio, sizeof(m_rio), &bytes,
+				 nullptr, nullptr)
+		== SOCKET_ERROR) {
+		setError("WSAIoctl(SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER)", WSAGetLastError());
+		return false;
+	}
+
+	m_rioLoaded = true;
+	return true;
+}
+
+bool RegisteredIO::postReceive(std::size_t socketIndex, ULONG buffer, DWORD flags) {
+	RIO_BUF dataBuffer;
+	dataBuffer.BufferId = m_receiveBufferId;
+	dataBuffer.Offset   = static_cast< ULONG >(buffer * m_receiveStride + 4);
+	dataBuffer.Length   = static_cast< ULONG >(m_receiveBufferSize);
+
+	RIO_BUF addressBuffer;
+	addressBuffer.BufferId = m_receiveAddressId;
+	addressBuffer.Offset   = static_cast< ULONG >(buffer * sizeof(AddressSlot));
+	addressBuffer.Length   = sizeof(SOCKADDR_INET);
+
+	return m_rio.RIOReceiveEx(m_requestQueues[socketIndex], &dataBuffer, 1, nullptr, &addressBuffer, nullptr, nullptr,
+							  flags, reinterpret_cast< PVOID >(static_cast< ULONG_PTR >(buffer)));
+}
+
+bool RegisteredIO::recycleReceives() {
+	if (m_usedReceives.empty()) {
+		return true;
+	}
+
+	// The receives are only handed to the network stack once per socket
+	std::vector< bool > posted(m_sockets.size(), false);
+	for (ULONG buffer : m_usedReceives) {
+		const std::size_t socketIndex = buffer / m_receivesPerSocket;
+		if (!postReceive(socketIndex, buffer, RIO_MSG_DEFER)) {
+			setError("RIOReceiveEx", WSAGetLastError());
+			return false;
+		}
+		posted[socketIndex] = true;
+	}
+	m_usedReceives.clear();
+
+	for (std::size_t i = 0; i < m_requestQueues.size(); ++i) {
+		if (posted[i] && !m_rio.RIOReceive(m_requestQueues[i], nullptr, 0, RIO_MSG_COMMIT_ONLY, nullptr)) {
+			setError("RIOReceive", WSAGetLastError());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RegisteredIO::reapSends() {
+	RIORESULT results[64];
+
+	ULONG count;
+	while ((count = m_rio.RIODequeueCompletion(m_sendQueue, results, 64)) > 0 && count != RIO_CORRUPT_CQ) {
+		for (ULONG i = 0; i < count; ++i) {
+			m_freeSends.push_back(static_cast< ULONG >(results[i].RequestContext));
+		}
+	}
+}
+
+void RegisteredIO::setError(const char *operation, int error) {
+	m_error = std::string(operation) + " failed with error " + std::to_string(error);
+}
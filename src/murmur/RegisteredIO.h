@@ -0,0 +1,141 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_REGISTEREDIO_H_
+#define MUMBLE_MURMUR_REGISTEREDIO_H_
+
+#include "win.h"
+
+#include <winsock2.h>
+#include <mswsock.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// Receives and sends UDP datagrams on a set of sockets via Registered I/O (requires Windows 8 or Windows Server 2012
+/// and sockets that have been created with WSA_FLAG_REGISTERED_IO).
+///
+/// All buffers (including the ones holding the addresses) are registered once, so that the network stack doesn't have
+/// to lock and map them for every datagram. For every socket a fixed number of receives is kept outstanding, and their
+/// completions are collected from a single completion queue. Thus, a single wait (see wait()) collects the datagrams
+/// of all sockets. Datagrams that are to be sent (see queueSend()) are copied into send buffers of their own and handed
+/// to the network stack all at once (see commitSends()), just like sendmmsg does on Linux.
+///
+/// The sockets may still be used with the regular Winsock functions by other threads (e.g. by the ones sending the
+/// mixed or transcoded voice packets), but an instance must only ever be used by a single thread.
+class RegisteredIO {
+public:
+	/// A datagram whose data resides in one of the registered receive buffers
+	struct Datagram {
+		/// The index of the socket the datagram has been received on
+		std::size_t socketIndex;
+		sockaddr_storage *from;
+		unsigned char *data;
+		/// The length of the datagram. Datagrams that haven't fit into their buffer are dropped.
+		std::size_t length;
+	};
+
+	enum class Result {
+		/// Zero or more datagrams have been received
+		Received,
+		/// The notification event has been signaled
+		Notified,
+		/// Registered I/O can't be used (any more). See errorMessage().
+		Failed
+	};
+
+	RegisteredIO();
+	~RegisteredIO();
+
+	RegisteredIO(const RegisteredIO &) = delete;
+	RegisteredIO &operator=(const RegisteredIO &) = delete;
+
+	/// Registers the buffers and starts receiving on the given sockets.
+	///
+	/// @param sockets The sockets to receive from and send through
+	/// @param notifyEvent An event that makes wait() return Result::Notified once it is signaled
+	/// @param receiveBuffers The amount of receives that are kept outstanding per socket
+	/// @param bufferSize The maximum size of a received datagram
+	/// @param sendBuffers The amount of sends that may be in flight at once (for all sockets together)
+	/// @param sendBufferSize The maximum size of a datagram that is sent
+	/// @returns Whether Registered I/O can be used. If it can't, false is returned and errorMessage() says why.
+	bool init(const std::vector< SOCKET > &sockets, HANDLE notifyEvent, unsigned int receiveBuffers,
+			  std::size_t bufferSize, unsigned int sendBuffers, std::size_t sendBufferSize);
+
+	/// @returns Whether the instance has been initialized and hasn't failed since
+	bool isValid() const;
+
+	/// Waits until at least one datagram has been received and then collects the datagrams that have arrived so far
+	/// (but not more than the given maximum). The buffers of the datagrams returned by the previous call are handed
+	/// back to the network stack first, so the datagrams are only valid until the next call.
+	Result wait(std::vector< Datagram > &datagrams, std::size_t maxDatagrams);
+
+	/// Queues a copy of the given datagram to be sent through the given socket, which has to be one of the sockets the
+	/// instance has been initialized with. The datagram is only sent once the sends are committed.
+	///
+	/// @returns Whether the datagram has been queued. It isn't if all send buffers are in flight (or the datagram is
+	/// 	too large), in which case it has to be sent by other means.
+	bool queueSend(SOCKET socket, const unsigned char *data, std::size_t length, const sockaddr_storage &destination);
+	/// Hands all datagrams that have been queued since the last commit to the network stack
+	void commitSends();
+
+	const std::string &errorMessage() const;
+
+protected:
+	/// The datagrams' addresses are laid out like a sockaddr_storage, which SOCKADDR_INET is the start of
+	struct AddressSlot {
+		sockaddr_storage address;
+	};
+
+	RIO_EXTENSION_FUNCTION_TABLE m_rio;
+	bool m_rioLoaded = false;
+	bool m_valid     = false;
+
+	std::vector< SOCKET > m_sockets;
+	std::vector< RIO_RQ > m_requestQueues;
+	/// Whether sends have been queued for the socket since the last commit
+	std::vector< bool > m_pendingSends;
+	RIO_CQ m_receiveQueue    = RIO_INVALID_CQ;
+	RIO_CQ m_sendQueue       = RIO_INVALID_CQ;
+	HANDLE m_completionEvent = nullptr;
+	HANDLE m_notifyEvent     = nullptr;
+
+	/// The size of a single buffer including the padding that keeps the following one aligned
+	std::size_t m_receiveStride      = 0;
+	std::size_t m_sendStride         = 0;
+	std::size_t m_receiveBufferSize  = 0;
+	std::size_t m_sendBufferSize     = 0;
+	unsigned int m_receivesPerSocket = 0;
+
+	/// The receive buffers of the n-th socket are the ones from n * m_receivesPerSocket on
+	std::vector< unsigned char > m_receiveBuffers;
+	std::vector< AddressSlot > m_receiveAddresses;
+	std::vector< unsigned char > m_sendBuffers;
+	std::vector< AddressSlot > m_sendAddresses;
+	RIO_BUFFERID m_receiveBufferId  = RIO_INVALID_BUFFERID;
+	RIO_BUFFERID m_receiveAddressId = RIO_INVALID_BUFFERID;
+	RIO_BUFFERID m_sendBufferId     = RIO_INVALID_BUFFERID;
+	RIO_BUFFERID m_sendAddressId    = RIO_INVALID_BUFFERID;
+
+	/// The receive buffers of the datagrams returned by the last call to wait()
+	std::vector< ULONG > m_usedReceives;
+	/// The send buffers that aren't in flight
+	std::vector< ULONG > m_freeSends;
+	std::vector< RIORESULT > m_results;
+
+	std::string m_error;
+
+	bool loadFunctions(SOCKET socket);
+	/// Posts the receive into the buffer with the given index, which belongs to the socket with the given index
+	bool postReceive(std::size_t socketIndex, ULONG buffer, DWORD flags);
+	/// Posts the receives of the buffers in m_usedReceives again
+	bool recycleReceives();
+	/// Takes the completed sends out of their queue, making their buffers available again
+	void reapSends();
+	void setError(const char *operation, int error);
+};
+
+#endif // MUMBLE_MURMUR_REGISTEREDIO_H_
@@ -0,0 +1,130 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "RegistrationWorker.h"
+
+#include "Server.h"
+#include "crypto/CryptographicRandom.h"
+
+#ifdef USE_ZEROCONF
+#	include "Zeroconf.h"
+#endif
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+RegistrationWorker::RegistrationWorker() = default;
+
+// This runs on the worker's thread (see Meta::Meta()), on which the Zeroconf objects withdraw their announcements
+RegistrationWorker::~RegistrationWorker() = default;
+
+void RegistrationWorker::submit(const Registration &registration) {
+	post([this, registration]() {
+		for (Registration &pending : m_pending) {
+			if (pending.serverId == registration.serverId) {
+				pending = registration;
+				return;
+			}
+		}
+
+		m_pending.append(registration);
+		schedule();
+	});
+}
+
+void RegistrationWorker::cancel(int serverId) {
+	post([this, serverId]() {
+		for (int i = 0; i < m_pending.size(); ++i) {
+			if (m_pending[i].serverId == serverId) {
+				m_pending.removeAt(i);
+				return;
+			}
+		}
+	});
+}
+
+void RegistrationWorker::publishZeroconf(int serverId, const QString &name, quint16 port) {
+#ifdef USE_ZEROCONF
+	post([this, serverId, name, port]() {
+		std::unique_ptr< Zeroconf > zeroconf = std::make_unique< Zeroconf >();
+		if (!zeroconf->isOk()) {
+			m_zeroconf.erase(serverId);
+			return;
+		}
+
+		emit log(serverId, QLatin1String("Registering zeroconf service..."));
+		zeroconf->registerService(BonjourRecord(name, "_mumble._tcp", ""), port);
+		m_zeroconf[serverId] = std::move(zeroconf);
+	});
+#else
+	Q_UNUSED(serverId);
+	Q_UNUSED(name);
+	Q_UNUSED(port);
+#endif
+}
+
+void RegistrationWorker::unpublishZeroconf(int serverId) {
+#ifdef USE_ZEROCONF
+	post([this, serverId]() {
+		if (m_zeroconf.erase(serverId) > 0) {
+			emit log(serverId, QLatin1String("Unregistering zeroconf service..."));
+		}
+	});
+#else
+	Q_UNUSED(serverId);
+#endif
+}
+
+void RegistrationWorker::customEvent(QEvent *evt) {
+	if (evt->type() == EXEC_QEVENT)
+		static_cast< ExecEvent * >(evt)->execute();
+}
+
+void RegistrationWorker::post(std::function< void() > func) {
+	QCoreApplication::instance()->postEvent(this, new ExecEvent(std::move(func)));
+}
+
+void RegistrationWorker::schedule() {
+	if (m_pending.isEmpty() || (m_timer && m_timer->isActive())) {
+		return;
+	}
+
+	if (!m_timer) {
+		// Both are created here, so that they belong to the worker's thread
+		m_network = new QNetworkAccessManager(this);
+		m_timer   = new QTimer(this);
+		m_timer->setSingleShot(true);
+		connect(m_timer, &QTimer::timeout, this, &RegistrationWorker::sendNext);
+	}
+
+	m_timer->start(static_cast< int >(CryptographicRandom::uniform(MAX_JITTER_MSECS)));
+}
+
+void RegistrationWorker::sendNext() {
+	if (m_pending.isEmpty()) {
+		return;
+	}
+
+	const Registration registration = m_pending.takeFirst();
+	const int serverId              = registration.serverId;
+
+	QNetworkReply *rep = m_network->post(registration.request, registration.body);
+	connect(rep, &QNetworkReply::finished, this, [this, rep, serverId]() {
+		if (rep->error() != QNetworkReply::NoError) {
+			emit log(serverId, QString("Registration failed: %1").arg(rep->errorString()));
+		} else {
+			emit log(serverId, QString("Registration: %1").arg(QLatin1String(rep->readAll())));
+		}
+		rep->deleteLater();
+	});
+	connect(rep, &QNetworkReply::sslErrors, this, [this, serverId](const QList< QSslError > &errs) {
+		foreach (const QSslError &e, errs)
+			emit log(serverId, QString("Registration: SSL Handshake error: %1").arg(e.errorString()));
+	});
+
+	schedule();
+}
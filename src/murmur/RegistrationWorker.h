@@ -0,0 +1,85 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_REGISTRATIONWORKER_H_
+#define MUMBLE_MURMUR_REGISTRATIONWORKER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtNetwork/QNetworkRequest>
+
+#include <functional>
+#include <map>
+#include <memory>
+
+class QEvent;
+class QNetworkAccessManager;
+class QTimer;
+class Zeroconf;
+
+/// Registers the virtual servers with the public server list and announces them via Zeroconf (Bonjour). It lives on
+/// a thread of its own (see Meta::m_registrationThread), so that the TLS handshakes with the list and the DNS-SD
+/// traffic don't delay the main thread.
+///
+/// Registrations are queued and sent one after another with a random delay in between, so that the registrations of
+/// many virtual servers are spread out instead of all happening at once.
+///
+/// The public functions may be called from any thread.
+class RegistrationWorker : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(RegistrationWorker)
+
+public:
+	/// A registration that has been prepared by a server (see Server::update())
+	struct Registration {
+		int serverId;
+		/// The request, including the TLS configuration the server identifies itself with
+		QNetworkRequest request;
+		/// The XML describing the server
+		QByteArray body;
+	};
+
+	/// The maximum delay between two registrations in milliseconds
+	static constexpr int MAX_JITTER_MSECS = 5000;
+
+	RegistrationWorker();
+	~RegistrationWorker() override;
+
+	/// Queues the given registration. It replaces a registration of the same server that is still queued.
+	void submit(const Registration &registration);
+	/// Drops the queued registration of the given server (e.g. because it has been stopped)
+	void cancel(int serverId);
+
+	/// Announces the given server via Zeroconf, replacing an earlier announcement
+	void publishZeroconf(int serverId, const QString &name, quint16 port);
+	/// Withdraws the Zeroconf announcement of the given server
+	void unpublishZeroconf(int serverId);
+
+signals:
+	/// Emitted (by the worker's thread) with a line for the log of the given server
+	void log(int serverId, const QString &message);
+
+protected:
+	/// Created on the worker's thread once it is needed
+	QNetworkAccessManager *m_network = nullptr;
+	/// Fires when the next registration is due (created along with m_network)
+	QTimer *m_timer = nullptr;
+	QList< Registration > m_pending;
+#ifdef USE_ZEROCONF
+	std::map< int, std::unique_ptr< Zeroconf > > m_zeroconf;
+#endif
+
+	void customEvent(QEvent *evt) Q_DECL_OVERRIDE;
+	/// Runs the given function on the worker's thread
+	void post(std::function< void() > func);
+	/// Starts the timer for the next registration, if there is one and the timer isn't running already
+	void schedule();
+	void sendNext();
+};
+
+#endif // MUMBLE_MURMUR_REGISTRATIONWORKER_H_
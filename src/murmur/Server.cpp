@@ -8,6 +8,7 @@
 #include "ACL.h"
 #include "Channel.h"
 #include "ClientType.h"
+#include "Cluster.h"
 #include "Connection.h"
 #include "EnvUtils.h"
 #include "Group.h"
@@ -17,18 +18,24 @@
 #include "MumbleProtocol.h"
 #include "ProtoUtils.h"
 #include "QtUtils.h"
+#include "RegistrationWorker.h"
 #include "ServerDB.h"
 #include "ServerUser.h"
 #include "User.h"
 #include "Version.h"
+#include "VoiceRedundancy.h"
 
-#ifdef USE_ZEROCONF
-#	include "Zeroconf.h"
+#ifdef USE_IO_URING
+#	include "IOUringReceiver.h"
 #endif
 
 #include "Utils.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QPointer>
 #include <QtCore/QSet>
 #include <QtCore/QXmlStreamAttributes>
 #include <QtCore/QtEndian>
@@ -43,6 +50,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef Q_OS_WIN
@@ -53,6 +64,113 @@
 #	include <poll.h>
 #endif
 
+#ifdef Q_OS_LINUX
+#	include <netinet/udp.h>
+#	include <pthread.h>
+#	include <sched.h>
+
+// Older C libraries don't know about UDP segmentation offload yet
+#	ifndef SOL_UDP
+#		define SOL_UDP 17
+#	endif
+#	ifndef UDP_SEGMENT
+#		define UDP_SEGMENT 103
+#	endif
+#	ifndef UDP_GRO
+#		define UDP_GRO 104
+#	endif
+// SO_PREFER_BUSY_POLL has been added in Linux 5.11
+#	ifndef SO_PREFER_BUSY_POLL
+#		define SO_PREFER_BUSY_POLL 69
+#	endif
+
+namespace {
+/// The size of the receive buffers when UDP GRO is in use. Coalesced datagrams can be up to 64 KiB in size.
+constexpr std::size_t GRO_RECEIVE_BUFFER_SIZE = 65536;
+
+/// Returns the segment size of a datagram that the kernel has coalesced (GRO) or 0 if the datagram has not been
+/// coalesced. The corresponding control message is removed so that the remaining control data (the packet info)
+/// can be reused when replying to the datagram.
+std::size_t takeGROSegmentSize(struct msghdr &msg) {
+	std::size_t segmentSize = 0;
+	unsigned char *control  = static_cast< unsigned char * >(msg.msg_control);
+	std::size_t kept        = 0;
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	while (cmsg) {
+		struct cmsghdr *next = CMSG_NXTHDR(&msg, cmsg);
+
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+			int size = 0;
+			memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+			segmentSize = size > 0 ? static_cast< std::size_t >(size) : 0;
+		} else {
+			const std::size_t space = CMSG_ALIGN(cmsg->cmsg_len);
+			if (reinterpret_cast< unsigned char * >(cmsg) != control + kept) {
+				memmove(control + kept, cmsg, space);
+			}
+			kept += space;
+		}
+
+		cmsg = next;
+	}
+
+	msg.msg_controllen = kept;
+
+	return segmentSize;
+}
+
+/// Adds the packet(s) contained in the given received datagram to the given list
+void addReceivedDatagram(std::vector< VoiceDatagram > &datagrams, std::size_t socketIndex, struct msghdr &msg,
+						 unsigned char *data, std::size_t length, std::size_t bufferSize) {
+	const std::size_t segmentSize = takeGROSegmentSize(msg);
+	sockaddr_storage *from        = static_cast< sockaddr_storage * >(msg.msg_name);
+
+	if (segmentSize == 0 || length > bufferSize) {
+		// Either a regular datagram or a truncated one (which will be discarded based on its length)
+		datagrams.push_back({ socketIndex, data, static_cast< qint32 >(length), from, &msg });
+	} else {
+		// Split up a datagram that has been coalesced by the kernel (GRO) into the original packets
+		for (std::size_t offset = 0; offset < length; offset += segmentSize) {
+			const std::size_t packetLength = std::min(segmentSize, length - offset);
+			datagrams.push_back({ socketIndex, data + offset, static_cast< qint32 >(packetLength), from, &msg });
+		}
+	}
+}
+
+/// Parses a list of CPUs like "0,2,4-7"
+///
+/// @param[out] ok Whether the whole list could be parsed. Invalid entries are skipped.
+std::vector< int > parseCPUList(const QString &list, bool &ok) {
+	std::vector< int > cpus;
+	ok = true;
+
+	for (const QString &entry : list.split(QLatin1Char(','))) {
+		if (entry.trimmed().isEmpty()) {
+			continue;
+		}
+
+		const QStringList bounds = entry.trimmed().split(QLatin1Char('-'));
+
+		bool firstOk    = false;
+		bool lastOk     = false;
+		const int first = bounds.first().toInt(&firstOk);
+		const int last  = bounds.last().toInt(&lastOk);
+		if (bounds.size() > 2 || !firstOk || !lastOk || first < 0 || last < first || last >= CPU_SETSIZE) {
+			ok = false;
+			continue;
+		}
+
+		for (int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+
+	return cpus;
+}
+} // namespace
+#endif
+
 ExecEvent::ExecEvent(boost::function< void() > f) : QEvent(static_cast< QEvent::Type >(EXEC_QEVENT)) {
 	func = f;
 }
@@ -65,6 +183,36 @@ SslServer::SslServer(QObject *p) : QTcpServer(p) {
 }
 
 void SslServer::incomingConnection(qintptr v) {
+	// The autoban is checked before anything is set up for the connection, so that a connection flood costs as little
+	// as possible
+	sockaddr_storage address;
+#ifdef Q_OS_UNIX
+	int sock      = static_cast< int >(v);
+	socklen_t len = sizeof(address);
+#else
+	SOCKET sock = static_cast< SOCKET >(v);
+	int len     = sizeof(address);
+#endif
+	memset(&address, 0, sizeof(address));
+	if (getpeername(sock, reinterpret_cast< struct sockaddr * >(&address), &len) == 0) {
+		const HostAddress host(address);
+		const ConnectionThrottle::Verdict verdict = meta->banCheck(host);
+		if (verdict != ConnectionThrottle::Verdict::Allowed) {
+			if (verdict == ConnectionThrottle::Verdict::NewlyBanned) {
+				const Server *server = static_cast< Server * >(parent());
+				server->log(QString("Ignoring connections from %1 for %2 seconds (Global ban)")
+								.arg(host.toString())
+								.arg(Meta::mp.iBanTime));
+			}
+#ifdef Q_OS_UNIX
+			close(sock);
+#else
+			closesocket(sock);
+#endif
+			return;
+		}
+	}
+
 	QSslSocket *s = new QSslSocket(this);
 	s->setSocketDescriptor(v);
 	qlSockets.append(s);
@@ -77,14 +225,15 @@ QSslSocket *SslServer::nextPendingSSLConnection() {
 }
 
 
-Server::Server(int snum, QObject *p) : QThread(p) {
+Server::Server(int snum, QObject *p, const ServerBootState *bootState)
+	: QThread(p), m_pingLimiter(Meta::mp.pingLimit, Meta::mp.pingBurst),
+	  m_userNameCache(static_cast< std::size_t >(std::max(Meta::mp.iUserCacheSize, 1)),
+					  static_cast< quint64 >(std::max(Meta::mp.iUserCacheTTL, 0)) * 1000),
+	  m_deferredWork([this](unsigned int session) { return qhUsers.value(session); }) {
 	tracy::SetThreadName("Main");
 
 	bValid     = true;
 	iServerNum = snum;
-#ifdef USE_ZEROCONF
-	zeroconf = nullptr;
-#endif
 	bUsingMetaCert = false;
 
 #ifdef Q_OS_UNIX
@@ -93,32 +242,215 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 	hNotify = nullptr;
 #endif
 	qtTimeout = new QTimer(this);
+	m_timeoutClock.start();
+	qtCodecCheck = new QTimer(this);
+	qtCodecCheck->setSingleShot(true);
+	qtCodecCheck->setInterval(CODEC_CHECK_DELAY);
 
 	iCodecAlpha = iCodecBeta = 0;
 	bPreferAlpha             = false;
 	bOpus                    = true;
 
-	qnamNetwork = nullptr;
-
 	readParams();
-	initialize();
+	const bool initialized = initialize();
+
+#ifndef Q_OS_LINUX
+	if (voiceThreads > 1) {
+		log("Server: Multiple voice threads are only supported on Linux");
+		voiceThreads = 1;
+	}
+#endif
+#ifndef USE_IO_URING
+	if (ioUring) {
+		log("Server: This server has been built without io_uring support");
+		ioUring = false;
+	}
+#endif
+#ifndef Q_OS_WIN
+	if (registeredIO) {
+		log("Server: Registered I/O is only available on Windows");
+		registeredIO = false;
+	}
+#endif
+
+	for (unsigned int threadIndex = 0; threadIndex < voiceThreads; ++threadIndex) {
+		m_voiceContexts.push_back(std::make_unique< VoiceContext >());
+		m_voiceEpochs.addReader(m_voiceContexts.back()->epochReader);
+	}
+	updatePingLimits();
+	updatePingReply();
+#ifdef USE_SERVER_MIXING
+	if (!qsStageChannels.isEmpty()) {
+		for (unsigned int threadIndex = 0; threadIndex < mixingThreads; ++threadIndex) {
+			m_mixingContexts.push_back(std::make_unique< VoiceContext >());
+			m_voiceEpochs.addReader(m_mixingContexts.back()->epochReader);
+		}
+	}
+#else
+	if (!qsStageChannels.isEmpty()) {
+		log("Server: This server has been built without support for mixing stage channels");
+	}
+#endif
+#ifdef USE_SERVER_TRANSCODING
+	if (transcodingThreads > 0) {
+		m_celt = std::make_unique< CELTCodec >();
+		if (m_celt->isValid()) {
+			for (unsigned int threadIndex = 0; threadIndex < transcodingThreads; ++threadIndex) {
+				m_transcodingContexts.push_back(std::make_unique< VoiceContext >());
+				m_voiceEpochs.addReader(m_transcodingContexts.back()->epochReader);
+			}
+
+			// The only version of CELT that can be transcoded is this one, which every legacy client supports
+			iCodecAlpha  = CELTCodec::BITSTREAM_VERSION;
+			bPreferAlpha = true;
+			log(QString("Transcoding speech between Opus and CELT with %1 thread(s)").arg(transcodingThreads));
+		} else {
+			log("Server: Not transcoding speech, as the CELT 0.7 library couldn't be loaded");
+			m_celt.reset();
+		}
+	}
+#else
+	if (transcodingThreads > 0) {
+		log("Server: This server has been built without support for transcoding speech");
+	}
+#endif
+
+	bValid = bindListeners();
+	if (!bValid)
+		return;
+
+	if (voiceThreads > 1) {
+		log(QString("Server: Using %1 voice threads").arg(voiceThreads));
+	}
+
+#ifdef Q_OS_LINUX
+	bool cpuListOk    = true;
+	m_voiceThreadCPUs = parseCPUList(voiceThreadCPUs, cpuListOk);
+	if (!cpuListOk) {
+		log(QString("Server: Ignoring invalid entries in voiceThreadCPUs \"%1\"").arg(voiceThreadCPUs));
+	}
+	if (voiceThreadCPUs.isEmpty() && voiceThreadNode >= 0) {
+		// Pinning the voice threads to the CPUs of a node also makes the memory they allocate come from that node
+		QFile cpuList(QString::fromLatin1("/sys/devices/system/node/node%1/cpulist").arg(voiceThreadNode));
+		if (cpuList.open(QIODevice::ReadOnly)) {
+			m_voiceThreadCPUs = parseCPUList(QString::fromLatin1(cpuList.readAll()), cpuListOk);
+		}
+
+		if (m_voiceThreadCPUs.empty()) {
+			log(QString("Server: Failed to find the CPUs of NUMA node %1").arg(voiceThreadNode));
+		} else {
+			log(QString("Server: Pinning the voice threads to the CPUs of NUMA node %1").arg(voiceThreadNode));
+		}
+	}
+#else
+	if (!voiceThreadCPUs.isEmpty() || voiceThreadNode >= 0 || udpBusyPoll > 0 || udpSpinTime > 0) {
+		log("Server: voiceThreadCPUs, voiceThreadNode, udpBusyPoll and udpSpinTime are only supported on Linux");
+	}
+#endif
+
+#ifdef Q_OS_LINUX
+	if (m_udpSegmentationOffload || m_udpReceiveOffload) {
+		log(QString("Server: Using UDP offload (GSO: %1, GRO: %2)")
+				.arg(m_udpSegmentationOffload ? "yes" : "no")
+				.arg(m_udpReceiveOffload ? "yes" : "no"));
+	}
+#endif
+
+#ifdef Q_OS_UNIX
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, aiNotify) != 0) {
+		log("Failed to create notify socket");
+		bValid = false;
+		return;
+	}
+#else
+	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+#endif
+
+	connect(this, SIGNAL(tcpTunnelPending()), this, SLOT(drainTCPTunnelQueues()), Qt::QueuedConnection);
+	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
+
+	if (Meta::mp.clusterNode > 0) {
+		m_cluster = std::make_unique< ClusterNode >(*this, Meta::mp.clusterNode, Meta::mp.qsClusterSecret.toUtf8());
+		if (!m_cluster->start(Meta::mp.clusterPeers, qsRelayLinks, Meta::mp.clusterPort)) {
+			m_cluster.reset();
+		}
+	}
+
+	resetSessionIds();
+
+	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(checkTimeout()));
+	connect(qtCodecCheck, SIGNAL(timeout()), this, SLOT(applyCodecVersions()));
+
+	connect(&m_metricsRotation, &QTimer::timeout, this, [this]() { m_metrics.forwardingLatency.rotate(); });
+	m_metricsRotation.start(60 * 1000);
+
+	// What initialize() has just created isn't part of a state that has been read before
+	ServerBootState loadedState;
+	if (!bootState || initialized) {
+		loadedState = loadBootState(iServerNum);
+		bootState   = &loadedState;
+	}
+
+	getBans(*bootState);
+	readChannels(*bootState);
+	readLinks(*bootState);
+	readListeners(*bootState);
+	if (!qsVoiceTraceFile.isEmpty()) {
+		startVoiceTrace();
+	}
+	readSpeakerLimits();
+	if (!qsRecordChannels.isEmpty()) {
+		startRecording();
+	}
+	if (messageHistory > 0) {
+		startMessageHistory();
+	}
+#ifdef USE_SERVER_MIXING
+	readStageChannels();
+#endif
+	initializeCert();
+
+	if (bValid) {
+#ifdef USE_ZEROCONF
+		if (bBonjour)
+			initZeroconf();
+#endif
+		initRegister();
+	}
+}
+
+bool Server::bindListeners() {
+	bool ok = true;
 
 	foreach (const QHostAddress &qha, qlBind) {
 		SslServer *ss = new SslServer(this);
 
 		connect(ss, SIGNAL(newConnection()), this, SLOT(newClient()), Qt::QueuedConnection);
 
+#ifdef Q_OS_UNIX
+		// A listener the previous instance has handed over still holds the connections that wait to be accepted
+		const int inherited = meta->takeHandoffSocket(iServerNum, SOCK_STREAM, HostAddress(qha), usPort);
+		if (inherited >= 0) {
+			if (ss->setSocketDescriptor(inherited)) {
+				log(QString("Server listening on %1 (taken over)").arg(addressToString(qha, usPort)));
+				qlServer << ss;
+				continue;
+			}
+			close(inherited);
+		}
+#endif
+
 		if (!ss->listen(qha, usPort)) {
 			log(QString("Server: TCP Listen on %1 failed: %2").arg(addressToString(qha, usPort), ss->errorString()));
-			bValid = false;
+			ok = false;
 		} else {
 			log(QString("Server listening on %1").arg(addressToString(qha, usPort)));
 		}
 		qlServer << ss;
 	}
 
-	if (!bValid)
-		return;
+	if (!ok)
+		return false;
 
 	foreach (SslServer *ss, qlServer) {
 		sockaddr_storage addr;
@@ -131,185 +463,471 @@ Server::Server(int snum, QObject *p) : QThread(p) {
 #endif
 		memset(&addr, 0, sizeof(addr));
 		getsockname(tcpsock, reinterpret_cast< struct sockaddr * >(&addr), &len);
+		for (unsigned int threadIndex = 0; threadIndex < voiceThreads; ++threadIndex) {
 #ifdef Q_OS_UNIX
-		int sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
+			// The voice sockets the previous instance has handed over are bound already
+			int sock             = meta->takeHandoffSocket(iServerNum, SOCK_DGRAM, HostAddress(addr), ss->serverPort());
+			const bool inherited = sock >= 0;
+			if (!inherited)
+				sock = ::socket(addr.ss_family, SOCK_DGRAM, 0);
 #	ifdef Q_OS_LINUX
-		int sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
-		sockopt = 1;
-		if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
-			log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			int sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IP, IP_PKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IP_PKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			sockopt = 1;
+			if (setsockopt(sock, IPPROTO_IPV6, IPV6_RECVPKTINFO, &sockopt, sizeof(sockopt)))
+				log(QString("Failed to set IPV6_RECVPKTINFO for %1").arg(addressToString(ss->serverAddress(), usPort)));
 #	endif
 #else
 #	ifndef SIO_UDP_CONNRESET
 #		define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
 #	endif
-		SOCKET sock           = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_OVERLAPPED);
-		DWORD dwBytesReturned = 0;
-		BOOL bNewBehaviour    = FALSE;
-		if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
-					 nullptr, nullptr)
-			== SOCKET_ERROR) {
-			log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
-		}
-#endif
-		if (sock == INVALID_SOCKET) {
-			log("Failed to create UDP Socket");
-			bValid = false;
-			return;
-		} else {
-			if (addr.ss_family == AF_INET6) {
-				// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
-				// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
-				// This will fail for WindowsXP which is ok. Our TCP code will have split that up
-				// into two sockets.
-				int ipv6only     = 0;
-				socklen_t optlen = sizeof(ipv6only);
-				if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
-					== 0) {
-					if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
-									 optlen)
-						== SOCKET_ERROR) {
-						log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+#	ifndef WSA_FLAG_REGISTERED_IO
+#		define WSA_FLAG_REGISTERED_IO 0x100
+#	endif
+			// Sockets can only be used with Registered I/O if they say so when they are created
+			SOCKET sock = ::WSASocket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0,
+									  WSA_FLAG_OVERLAPPED | (registeredIO ? WSA_FLAG_REGISTERED_IO : 0));
+			const bool inherited  = false;
+			DWORD dwBytesReturned = 0;
+			BOOL bNewBehaviour    = FALSE;
+			if (WSAIoctl(sock, SIO_UDP_CONNRESET, &bNewBehaviour, sizeof(bNewBehaviour), nullptr, 0, &dwBytesReturned,
+						 nullptr, nullptr)
+				== SOCKET_ERROR) {
+				log(QString("Failed to set SIO_UDP_CONNRESET: %1").arg(WSAGetLastError()));
+			}
+#endif
+#ifdef Q_OS_LINUX
+			if (sock != INVALID_SOCKET && voiceThreads > 1) {
+				// Let every voice thread have its own socket bound to the same address. The kernel distributes
+				// incoming packets among them based on the sender's address, so all packets of one client
+				// always end up on the same socket (and thus in the same thread).
+				sockopt = 1;
+				if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt)))
+					log(QString("Failed to set SO_REUSEPORT for %1").arg(addressToString(ss->serverAddress(), usPort)));
+			}
+#endif
+			if (sock == INVALID_SOCKET) {
+				log("Failed to create UDP Socket");
+				return false;
+			} else {
+				if (!inherited && addr.ss_family == AF_INET6) {
+					// Copy IPV6_V6ONLY attribute from tcp socket, it defaults to nonzero on Windows
+					// See https://msdn.microsoft.com/en-us/library/windows/desktop/ms738574%28v=vs.85%29.aspx
+					// This will fail for WindowsXP which is ok. Our TCP code will have split that up
+					// into two sockets.
+					int ipv6only     = 0;
+					socklen_t optlen = sizeof(ipv6only);
+					if (::getsockopt(tcpsock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< char * >(&ipv6only), &optlen)
+						== 0) {
+						if (::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast< const char * >(&ipv6only),
+										 optlen)
+							== SOCKET_ERROR) {
+							log(QString("Failed to copy IPV6_V6ONLY socket attribute from tcp to udp socket"));
+						}
 					}
 				}
-			}
 
-			if (::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
-				log(QString("Failed to bind UDP Socket to %1").arg(addressToString(ss->serverAddress(), usPort)));
-			} else {
+				if (!inherited && ::bind(sock, reinterpret_cast< sockaddr * >(&addr), len) == SOCKET_ERROR) {
+					log(QString("Failed to bind UDP Socket to %1").arg(addressToString(ss->serverAddress(), usPort)));
+				} else {
 #ifdef Q_OS_UNIX
-				int val = 0xe0;
-				if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
-					val = 0x80;
-					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
-						log("Server: Failed to set TOS for UDP Socket");
-				}
+					// The marking applies to every packet sent through the socket
+					int val = udpDSCP > 0 ? static_cast< int >(udpDSCP << 2) : 0xe0;
+					if (setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val))) {
+						val = 0x80;
+						if (udpDSCP > 0 || setsockopt(sock, IPPROTO_IP, IP_TOS, &val, sizeof(val)))
+							log("Server: Failed to set TOS for UDP Socket");
+					}
+					if (udpDSCP > 0 && addr.ss_family == AF_INET6) {
+						val = static_cast< int >(udpDSCP << 2);
+						if (setsockopt(sock, IPPROTO_IPV6, IPV6_TCLASS, &val, sizeof(val)))
+							log("Server: Failed to set the traffic class for UDP Socket");
+					}
 #	if defined(SO_PRIORITY)
-				socklen_t optlen = sizeof(val);
-				if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
-					if (val == 0) {
-						val = 6;
-						setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+					socklen_t optlen = sizeof(val);
+					if (getsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, &optlen) == 0) {
+						if (val == 0) {
+							val = 6;
+							setsockopt(sock, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+						}
+					}
+#	endif
+#	ifdef Q_OS_LINUX
+					if (udpOffload) {
+						// UDP segmentation offload requires Linux 4.18+ and receive offload Linux 5.0+
+						int segmentSize          = 0;
+						socklen_t segmentSizeLen = sizeof(segmentSize);
+						if (m_udpSegmentationOffload
+							&& getsockopt(sock, SOL_UDP, UDP_SEGMENT, &segmentSize, &segmentSizeLen) != 0) {
+							log("Server: UDP segmentation offload (GSO) is not supported by the kernel");
+							m_udpSegmentationOffload = false;
+						}
+
+						val = 1;
+						if (m_udpReceiveOffload && setsockopt(sock, SOL_UDP, UDP_GRO, &val, sizeof(val)) != 0) {
+							log("Server: UDP receive offload (GRO) is not supported by the kernel");
+							m_udpReceiveOffload = false;
+						}
+					}
+
+					if (udpBusyPoll > 0) {
+						// Raising SO_BUSY_POLL above net.core.busy_read requires CAP_NET_ADMIN
+						val = static_cast< int >(udpBusyPoll);
+						if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) != 0) {
+							log("Server: Failed to enable busy polling (SO_BUSY_POLL) for UDP Socket");
+						}
+						val = 1;
+						if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &val, sizeof(val)) != 0) {
+							log("Server: SO_PREFER_BUSY_POLL is not supported by the kernel");
+						}
 					}
-				}
 #	endif
 #endif
+				}
+				QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
+				connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
+				if (threadIndex == 0)
+					qlUdpSocket << sock;
+				qlUdpNotifier << qsn;
+				m_voiceContexts[threadIndex]->sockets.push_back(sock);
 			}
-			QSocketNotifier *qsn = new QSocketNotifier(sock, QSocketNotifier::Read, this);
-			connect(qsn, SIGNAL(activated(int)), this, SLOT(udpActivated(int)));
-			qlUdpSocket << sock;
-			qlUdpNotifier << qsn;
 		}
 	}
 
-	bValid = bValid && (qlServer.count() == qlBind.count()) && (qlUdpSocket.count() == qlBind.count());
-	if (!bValid)
-		return;
+	if (qlServer.count() != qlBind.count() || qlUdpSocket.count() != qlBind.count())
+		return false;
 
-#ifdef Q_OS_UNIX
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, aiNotify) != 0) {
-		log("Failed to create notify socket");
-		bValid = false;
-		return;
+	// Sending via TCP-received audio goes out through the first voice thread's sockets
+	m_tcpVoiceContext.sockets.assign(qlUdpSocket.begin(), qlUdpSocket.end());
+	m_tcpVoiceContext.primarySockets = m_tcpVoiceContext.sockets;
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		context->primarySockets = m_tcpVoiceContext.sockets;
+	}
+#ifdef USE_SERVER_MIXING
+	// The mixing threads send through the first voice thread's sockets as well
+	for (std::unique_ptr< VoiceContext > &context : m_mixingContexts) {
+		context->sockets        = m_tcpVoiceContext.sockets;
+		context->primarySockets = m_tcpVoiceContext.sockets;
 	}
-#else
-	hNotify = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-#endif
-
-	connect(this, SIGNAL(tcpTransmit(QByteArray, unsigned int)), this, SLOT(tcpTransmitData(QByteArray, unsigned int)),
-			Qt::QueuedConnection);
-	connect(this, SIGNAL(reqSync(unsigned int)), this, SLOT(doSync(unsigned int)));
-
-	for (unsigned int i = 1; i < iMaxUsers * 2; ++i)
-		qqIds.enqueue(i);
-
-	connect(qtTimeout, SIGNAL(timeout()), this, SLOT(checkTimeout()));
-
-	getBans();
-	readChannels();
-	readLinks();
-	initializeCert();
-
-	if (bValid) {
-#ifdef USE_ZEROCONF
-		if (bBonjour)
-			initZeroconf();
 #endif
-		initRegister();
+#ifdef USE_SERVER_TRANSCODING
+	// So do the transcoding threads
+	for (std::unique_ptr< VoiceContext > &context : m_transcodingContexts) {
+		context->sockets        = m_tcpVoiceContext.sockets;
+		context->primarySockets = m_tcpVoiceContext.sockets;
 	}
-}
-
-void Server::startThread() {
-	if (!isRunning()) {
-		log("Starting voice thread");
-		bRunning = true;
+#endif
 
-		foreach (QSocketNotifier *qsn, qlUdpNotifier)
-			qsn->setEnabled(false);
-		start(QThread::HighestPriority);
 #ifdef Q_OS_LINUX
-		// QThread::HighestPriority == Same as everything else...
-		int policy;
-		struct sched_param param;
-		if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
-			if (policy == SCHED_OTHER) {
-				policy               = SCHED_FIFO;
-				param.sched_priority = 1;
-				pthread_setschedparam(pthread_self(), policy, &param);
-			}
+	if (udpOffload && !m_udpReceiveOffload) {
+		// Coalesced datagrams need bigger receive buffers, so GRO has to be used either on all or on none of the
+		// sockets.
+		int val = 0;
+		for (const std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+			for (int sock : context->sockets)
+				setsockopt(sock, SOL_UDP, UDP_GRO, &val, sizeof(val));
 		}
-#endif
 	}
-	if (!qtTimeout->isActive())
-		qtTimeout->start(15500);
-}
-
-void Server::stopThread() {
-	bRunning = false;
-	if (isRunning()) {
-		log("Ending voice thread");
-
-#ifdef Q_OS_UNIX
-		unsigned char val = 0;
-		if (::write(aiNotify[1], &val, 1) != 1)
-			log("Failed to signal voice thread");
-#else
-		SetEvent(hNotify);
-#endif
-		wait();
 
-		foreach (QSocketNotifier *qsn, qlUdpNotifier)
-			qsn->setEnabled(true);
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		context->sendQueue.setSegmentationOffload(m_udpSegmentationOffload);
 	}
-	qtTimeout->stop();
-}
-
-Server::~Server() {
-#ifdef USE_ZEROCONF
-	removeZeroconf();
+	m_tcpVoiceContext.sendQueue.setSegmentationOffload(m_udpSegmentationOffload);
+#	ifdef USE_SERVER_MIXING
+	for (std::unique_ptr< VoiceContext > &context : m_mixingContexts) {
+		context->sendQueue.setSegmentationOffload(m_udpSegmentationOffload);
+	}
+#	endif
+#	ifdef USE_SERVER_TRANSCODING
+	for (std::unique_ptr< VoiceContext > &context : m_transcodingContexts) {
+		context->sendQueue.setSegmentationOffload(m_udpSegmentationOffload);
+	}
+#	endif
 #endif
 
-	stopThread();
+	m_boundAddresses = qlBind;
+	m_boundPort      = usPort;
+	return true;
+}
 
+void Server::closeListeners() {
 	foreach (QSocketNotifier *qsn, qlUdpNotifier)
 		delete qsn;
+	qlUdpNotifier.clear();
 
 #ifdef Q_OS_UNIX
 	foreach (int s, qlUdpSocket)
 		close(s);
-
-	if (aiNotify[0] >= 0)
-		close(aiNotify[0]);
-	if (aiNotify[1] >= 0)
-		close(aiNotify[1]);
+	for (std::size_t i = 1; i < m_voiceContexts.size(); ++i) {
+		for (int s : m_voiceContexts[i]->sockets)
+			close(s);
+	}
 #else
 	foreach (SOCKET s, qlUdpSocket)
 		closesocket(s);
-	if (hNotify)
-		CloseHandle(hNotify);
+	// The outstanding receives have been cancelled along with the sockets
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		context->registeredIO.reset();
+	}
 #endif
+	qlUdpSocket.clear();
+
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		context->sockets.clear();
+		context->primarySockets.clear();
+	}
+	m_tcpVoiceContext.sockets.clear();
+	m_tcpVoiceContext.primarySockets.clear();
+#ifdef USE_SERVER_MIXING
+	for (std::unique_ptr< VoiceContext > &context : m_mixingContexts) {
+		context->sockets.clear();
+		context->primarySockets.clear();
+	}
+#endif
+#ifdef USE_SERVER_TRANSCODING
+	for (std::unique_ptr< VoiceContext > &context : m_transcodingContexts) {
+		context->sockets.clear();
+		context->primarySockets.clear();
+	}
+#endif
+
+	foreach (SslServer *ss, qlServer)
+		delete ss;
+	qlServer.clear();
+}
+
+void Server::dropUdpAssociations() {
+	QWriteLocker wl(&qrwlVoiceThread);
+	foreach (ServerUser *u, qhUsers) {
+		if (u->sUdpSocket == INVALID_SOCKET) {
+			continue;
+		}
+
+		quint16 port = (u->udpDestination.address.ss_family == AF_INET6)
+						   ? (reinterpret_cast< sockaddr_in6 * >(&u->udpDestination.address)->sin6_port)
+						   : (reinterpret_cast< sockaddr_in * >(&u->udpDestination.address)->sin_port);
+		m_peerUsers.remove(PeerKey(u->haAddress, port));
+		u->sUdpSocket = INVALID_SOCKET;
+		u->aiUdpFlag  = 0;
+	}
+	m_peerUsers.reclaim();
+}
+
+#ifdef Q_OS_UNIX
+void Server::collectHandoffSockets(std::vector< SocketHandoff::Socket > &sockets) const {
+	foreach (SslServer *ss, qlServer) {
+		sockets.push_back({ iServerNum, SOCK_STREAM, static_cast< int >(ss->socketDescriptor()), HostAddress(), 0 });
+	}
+	for (const std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		for (int sock : context->sockets) {
+			sockets.push_back({ iServerNum, SOCK_DGRAM, sock, HostAddress(), 0 });
+		}
+	}
+}
+
+void Server::stopForHandoff() {
+	log("Handed the listeners over to the new instance, disconnecting the users");
+
+	stopThread();
+	// The new instance receives all voice packets from now on
+	dropUdpAssociations();
+	closeListeners();
+
+	m_drainQueue = qhUsers.keys();
+}
+
+int Server::drainForHandoff(int count) {
+	while (count > 0 && !m_drainQueue.isEmpty()) {
+		ServerUser *u = qhUsers.value(m_drainQueue.takeFirst());
+		if (u) {
+			u->disconnectSocket();
+			--count;
+		}
+	}
+
+	return qhUsers.size();
+}
+#endif
+
+void Server::scheduleRebind() {
+	if (m_rebindScheduled) {
+		return;
+	}
+
+	// This is usually called with qrwlVoiceThread being locked, which the voice threads might be waiting for. So they
+	// can only be stopped once the lock has been released.
+	m_rebindScheduled = true;
+	QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::rebindListeners, this)));
+}
+
+void Server::rebindListeners() {
+	m_rebindScheduled = false;
+	if (!bValid || (qlBind == m_boundAddresses && usPort == m_boundPort)) {
+		return;
+	}
+
+	log("Rebinding listeners");
+
+	const bool wasRunning = isRunning();
+	stopThread();
+
+	// The users' UDP associations refer to sockets that are about to be closed
+	dropUdpAssociations();
+
+	closeListeners();
+	if (!bindListeners()) {
+		log("Server: Binding to the new addresses failed, going back to the previous ones");
+		closeListeners();
+		qlBind = m_boundAddresses;
+		usPort = m_boundPort;
+		if (!bindListeners()) {
+			log("Server: Binding to the previous addresses failed as well");
+		}
+	}
+
+	if (wasRunning) {
+		startThread();
+	}
+
+#ifdef USE_ZEROCONF
+	if (m_zeroconfPublished) {
+		removeZeroconf();
+		initZeroconf();
+	}
+#endif
+	update();
+}
+
+void Server::startThread() {
+	if (!isRunning()) {
+		log("Starting voice thread");
+		bRunning = true;
+
+		foreach (QSocketNotifier *qsn, qlUdpNotifier)
+			qsn->setEnabled(false);
+		start(QThread::HighestPriority);
+		for (std::size_t i = 1; i < m_voiceContexts.size(); ++i) {
+			m_voiceThreads.push_back(std::make_unique< VoiceThread >(*this, *m_voiceContexts[i]));
+			m_voiceThreads.back()->start(QThread::HighestPriority);
+		}
+#ifdef USE_SERVER_MIXING
+		m_mixing = !m_stageMixers.empty();
+		for (std::size_t i = 0; m_mixing && i < m_mixingContexts.size(); ++i) {
+			m_mixingThreads.push_back(std::make_unique< MixingThread >(*this, i));
+			m_mixingThreads.back()->start(QThread::HighPriority);
+		}
+#endif
+#ifdef USE_SERVER_TRANSCODING
+		if (m_celt) {
+			m_transcoder = std::make_unique< Transcoder >(
+				*m_celt, m_transcodingContexts.size(), [this](const Transcoder::Frame &frame, std::size_t worker) {
+					sendTranscoded(frame, *m_transcodingContexts[worker]);
+				});
+		}
+#endif
+#ifdef Q_OS_LINUX
+		// QThread::HighestPriority == Same as everything else...
+		int policy;
+		struct sched_param param;
+		if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+			if (policy == SCHED_OTHER) {
+				policy               = SCHED_FIFO;
+				param.sched_priority = 1;
+				pthread_setschedparam(pthread_self(), policy, &param);
+			}
+		}
+#endif
+	}
+	if (!qtTimeout->isActive())
+		qtTimeout->start(15500);
+}
+
+void Server::stopThread() {
+	bRunning = false;
+	if (isRunning()) {
+		log("Ending voice thread");
+
+#ifdef Q_OS_UNIX
+		unsigned char val = 0;
+		if (::write(aiNotify[1], &val, 1) != 1)
+			log("Failed to signal voice thread");
+#else
+		SetEvent(hNotify);
+#endif
+		wait();
+		for (std::unique_ptr< VoiceThread > &voiceThread : m_voiceThreads) {
+			voiceThread->wait();
+		}
+		m_voiceThreads.clear();
+#ifdef USE_SERVER_MIXING
+		m_mixing = false;
+		for (std::unique_ptr< MixingThread > &mixingThread : m_mixingThreads) {
+			mixingThread->wait();
+		}
+		m_mixingThreads.clear();
+#endif
+#ifdef USE_SERVER_TRANSCODING
+		if (m_transcoder && m_transcoder->droppedFrames() > 0) {
+			log(QString("Dropped %1 frame(s) that couldn't be transcoded in time").arg(m_transcoder->droppedFrames()));
+		}
+		m_transcoder.reset();
+#endif
+
+#ifdef Q_OS_UNIX
+		// The voice threads leave the notification in the pipe so that every one of them gets to see it
+		while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
+		};
+#endif
+
+		foreach (QSocketNotifier *qsn, qlUdpNotifier)
+			qsn->setEnabled(true);
+	}
+	qtTimeout->stop();
+}
+
+Server::~Server() {
+#ifdef USE_ZEROCONF
+	removeZeroconf();
+#endif
+	meta->m_registrationWorker->cancel(iServerNum);
+
+	// Nothing may be handed over to the users anymore
+	m_deferredWork.shutdown();
+
+	stopThread();
+
+	// The voice threads, which relay voice to the other nodes, are gone now
+	m_cluster.reset();
+
+	if (m_recorder) {
+		if (m_recorder->droppedFrames() > 0) {
+			log(QString("Dropped %1 recorded frame(s) that couldn't be written in time")
+					.arg(m_recorder->droppedFrames()));
+		}
+		// Finishes the recordings
+		m_recorder.reset();
+	}
+
+	closeListeners();
+
+#ifdef Q_OS_UNIX
+	if (aiNotify[0] >= 0)
+		close(aiNotify[0]);
+	if (aiNotify[1] >= 0)
+		close(aiNotify[1]);
+#else
+	if (hNotify)
+		CloseHandle(hNotify);
+#endif
+
+	// No voice thread is running anymore, so everything that is waiting for the voice threads can go right away
+	for (std::function< void() > &destroy : m_voiceStateRetirements) {
+		m_voiceEpochs.retire(std::move(destroy));
+	}
+	m_voiceStateRetirements.clear();
+	m_voiceEpochs.reclaim();
+
 	clearACLCache();
 
 	log("Stopped");
@@ -347,6 +965,8 @@ void Server::readParams() {
 	iMessageBurst                      = Meta::mp.iMessageBurst;
 	iPluginMessageLimit                = Meta::mp.iPluginMessageLimit;
 	iPluginMessageBurst                = Meta::mp.iPluginMessageBurst;
+	pingLimit                          = Meta::mp.pingLimit;
+	pingBurst                          = Meta::mp.pingBurst;
 	broadcastListenerVolumeAdjustments = Meta::mp.broadcastListenerVolumeAdjustments;
 	m_suggestVersion                   = Meta::mp.m_suggestVersion;
 	qvSuggestPositional                = Meta::mp.qvSuggestPositional;
@@ -354,39 +974,20 @@ void Server::readParams() {
 	iOpusThreshold                     = Meta::mp.iOpusThreshold;
 	iChannelNestingLimit               = Meta::mp.iChannelNestingLimit;
 	iChannelCountLimit                 = Meta::mp.iChannelCountLimit;
+	udpReceiveBatchSize                = Meta::mp.udpReceiveBatchSize;
+	udpOffload                         = Meta::mp.udpOffload;
+	voiceThreads                       = Meta::mp.voiceThreads;
+	ioUring                            = Meta::mp.ioUring;
+	registeredIO                       = Meta::mp.registeredIO;
+	voiceThreadCPUs                    = Meta::mp.voiceThreadCPUs;
+	voiceThreadNode                    = Meta::mp.voiceThreadNode;
+	udpBusyPoll                        = Meta::mp.udpBusyPoll;
+	udpSpinTime                        = Meta::mp.udpSpinTime;
+	udpDSCP                            = Meta::mp.udpDSCP;
 
 	QString qsHost = getConf("host", QString()).toString();
-	if (!qsHost.isEmpty()) {
-		qlBind.clear();
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-		foreach (const QString &host, qsHost.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
-#else
-		// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
-		foreach (const QString &host, qsHost.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
-#endif
-			QHostAddress qhaddr;
-			if (qhaddr.setAddress(qsHost)) {
-				qlBind << qhaddr;
-			} else {
-				bool found   = false;
-				QHostInfo hi = QHostInfo::fromName(host);
-				foreach (QHostAddress qha, hi.addresses()) {
-					if ((qha.protocol() == QAbstractSocket::IPv4Protocol)
-						|| (qha.protocol() == QAbstractSocket::IPv6Protocol)) {
-						qlBind << qha;
-						found = true;
-					}
-				}
-				if (!found) {
-					log(QString("Lookup of bind hostname %1 failed").arg(host));
-				}
-			}
-		}
-		foreach (const QHostAddress &qha, qlBind)
-			log(QString("Binding to address %1").arg(qha.toString()));
-		if (qlBind.isEmpty())
-			qlBind = Meta::mp.qlBind;
-	}
+	if (!qsHost.isEmpty())
+		qlBind = bindAddresses(qsHost);
 
 	qsPassword             = getConf("password", qsPassword).toString();
 	usPort                 = static_cast< unsigned short >(getConf("port", usPort).toUInt());
@@ -444,8 +1045,37 @@ void Server::readParams() {
 	iChannelNestingLimit = getConf("channelnestinglimit", iChannelNestingLimit).toInt();
 	iChannelCountLimit   = getConf("channelcountlimit", iChannelCountLimit).toInt();
 
-	qrUserName    = QRegExp(getConf("username", qrUserName.pattern()).toString());
-	qrChannelName = QRegExp(getConf("channelname", qrChannelName.pattern()).toString());
+	// recvmmsg does not accept more than UIO_MAXIOV (1024) messages per call
+	udpReceiveBatchSize = qBound(1U, getConf("udpReceiveBatchSize", udpReceiveBatchSize).toUInt(), 1024U);
+	udpOffload          = getConf("udpOffload", udpOffload).toBool();
+	voiceThreads        = qBound(1U, getConf("voiceThreads", voiceThreads).toUInt(), 64U);
+	ioUring             = getConf("ioUring", ioUring).toBool();
+	registeredIO        = getConf("registeredIO", registeredIO).toBool();
+	voiceThreadCPUs     = getConf("voiceThreadCPUs", voiceThreadCPUs).toString();
+	voiceThreadNode     = getConf("voiceThreadNode", voiceThreadNode).toInt();
+	udpBusyPoll         = qMin(getConf("udpBusyPoll", udpBusyPoll).toUInt(), 10000U);
+	udpSpinTime         = qMin(getConf("udpSpinTime", udpSpinTime).toUInt(), 10000U);
+	udpDSCP             = qMin(getConf("udpDSCP", udpDSCP).toUInt(), 63U);
+	qsRelayLinks        = getConf("relayLinks", QString()).toString();
+	qsVoiceTraceFile    = getConf("voiceTraceFile", QString()).toString();
+	qsSpeakerLimits     = getConf("speakerLimits", QString()).toString();
+	qsRecordChannels    = getConf("recordChannels", QString()).toString();
+	qsRecordingDir      = getConf("recordingDir", QString()).toString();
+	qsStageChannels     = getConf("stageChannels", QString()).toString();
+	mixingThreads       = qBound(1U, getConf("mixingThreads", 1U).toUInt(), 16U);
+	transcodingThreads  = qMin(getConf("transcodingThreads", 0U).toUInt(), 16U);
+
+	quantizeListenerVolumes = getConf("quantizeListenerVolumes", false).toBool();
+	messageHistory          = qMin(getConf("messageHistory", 0U).toUInt(), 10000U);
+	qsMessageHistoryDir     = getConf("messageHistoryDir", QString()).toString();
+	messageHistoryDays      = qBound(1U, getConf("messageHistoryDays", 7U).toUInt(), 3650U);
+
+	// Whether the offloads are actually available is determined once the sockets are created
+	m_udpSegmentationOffload = udpOffload;
+	m_udpReceiveOffload      = udpOffload;
+
+	qrUserName    = NamePattern(getConf("username", qrUserName.pattern()).toString());
+	qrChannelName = NamePattern(getConf("channelname", qrChannelName.pattern()).toString());
 
 	iMessageLimit = getConf("messagelimit", iMessageLimit).toUInt();
 	if (iMessageLimit < 1) { // Prevent disabling messages entirely
@@ -464,683 +1094,1981 @@ void Server::readParams() {
 	if (iPluginMessageBurst < 1) { // Prevent disabling messages entirely
 		iPluginMessageBurst = 1;
 	}
+	pingLimit = getConf("pingLimit", pingLimit).toUInt();
+	pingBurst = getConf("pingBurst", pingBurst).toUInt();
 	broadcastListenerVolumeAdjustments =
 		getConf("broadcastlistenervolumeadjustments", broadcastListenerVolumeAdjustments).toBool();
 }
 
-void Server::setLiveConf(const QString &key, const QString &value) {
-	QString v = value.trimmed().isEmpty() ? QString() : value;
-	int i     = v.toInt();
-	if ((key == "password") || (key == "serverpassword"))
-		qsPassword = !v.isNull() ? v : Meta::mp.qsPassword;
-	else if (key == "timeout")
-		iTimeout = i ? i : Meta::mp.iTimeout;
-	else if (key == "bandwidth") {
-		int length = i ? i : Meta::mp.iMaxBandwidth;
-		if (length != iMaxBandwidth) {
-			iMaxBandwidth = length;
-			MumbleProto::ServerConfig mpsc;
-			mpsc.set_max_bandwidth(static_cast< unsigned int >(length));
-			sendAll(mpsc);
+QList< QHostAddress > Server::bindAddresses(const QString &hosts) {
+	QList< QHostAddress > addresses;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &host, hosts.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &host, hosts.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
+#endif
+		QHostAddress qhaddr;
+		if (qhaddr.setAddress(host)) {
+			addresses << qhaddr;
+		} else {
+			bool found   = false;
+			QHostInfo hi = QHostInfo::fromName(host);
+			foreach (QHostAddress qha, hi.addresses()) {
+				if ((qha.protocol() == QAbstractSocket::IPv4Protocol)
+					|| (qha.protocol() == QAbstractSocket::IPv6Protocol)) {
+					addresses << qha;
+					found = true;
+				}
+			}
+			if (!found) {
+				log(QString("Lookup of bind hostname %1 failed").arg(host));
+			}
 		}
-	} else if (key == "users") {
-		unsigned int newmax = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxUsers;
-		if (iMaxUsers == newmax)
-			return;
+	}
+	foreach (const QHostAddress &qha, addresses)
+		log(QString("Binding to address %1").arg(qha.toString()));
+	if (addresses.isEmpty())
+		addresses = Meta::mp.qlBind;
 
-		iMaxUsers = newmax;
-		qqIds.clear();
-		for (unsigned int id = 1; id < iMaxUsers * 2; ++id)
-			if (!qhUsers.contains(id))
-				qqIds.enqueue(id);
+	return addresses;
+}
 
-		MumbleProto::ServerConfig mpsc;
-		mpsc.set_max_users(iMaxUsers);
-		sendAll(mpsc);
-	} else if (key == "usersperchannel")
-		iMaxUsersPerChannel = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxUsersPerChannel;
-	else if (key == "textmessagelength") {
-		int length = i ? i : Meta::mp.iMaxTextMessageLength;
-		if (length != iMaxTextMessageLength) {
-			iMaxTextMessageLength = length;
-			MumbleProto::ServerConfig mpsc;
-			mpsc.set_message_length(static_cast< unsigned int >(length));
-			sendAll(mpsc);
-		}
-	} else if (key == "imagemessagelength") {
-		int length = i ? i : Meta::mp.iMaxImageMessageLength;
-		if (length != iMaxImageMessageLength) {
-			iMaxImageMessageLength = length;
-			MumbleProto::ServerConfig mpsc;
-			mpsc.set_image_message_length(static_cast< unsigned int >(length));
-			sendAll(mpsc);
-		}
-	} else if (key == "allowhtml") {
-		bool allow = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowHTML;
-		if (allow != bAllowHTML) {
-			bAllowHTML = allow;
-			MumbleProto::ServerConfig mpsc;
-			mpsc.set_allow_html(bAllowHTML);
-			sendAll(mpsc);
-		}
-	} else if (key == "defaultchannel")
-		iDefaultChan = i ? static_cast< unsigned int >(i) : Meta::mp.iDefaultChan;
-	else if (key == "rememberchannel")
-		bRememberChan = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bRememberChan;
-	else if (key == "rememberchannelduration") {
-		iRememberChanDuration = !v.isNull() ? v.toInt() : Meta::mp.iRememberChanDuration;
-		if (iRememberChanDuration < 0) {
-			iRememberChanDuration = 0;
-		}
-	} else if (key == "welcometext") {
-		QString text = !v.isNull() ? v : Meta::mp.qsWelcomeText;
-		if (text != qsWelcomeText) {
-			qsWelcomeText = text;
-		}
-	} else if (key == "registername") {
-		QString text = !v.isNull() ? v : Meta::mp.qsRegName;
-		if (text != qsRegName) {
-			qsRegName = text;
-			if (!qsRegName.isEmpty()) {
-				MumbleProto::ChannelState mpcs;
-				mpcs.set_channel_id(0);
-				mpcs.set_name(u8(qsRegName));
-				sendAll(mpcs);
+void Server::startVoiceTrace() {
+	m_voiceTrace = std::make_unique< VoiceTrace::Recorder >(qsVoiceTraceFile);
+	if (!m_voiceTrace->isOpen()) {
+		log(QString("Failed to open the voice trace %1").arg(qsVoiceTraceFile));
+		m_voiceTrace.reset();
+		return;
+	}
+	log(QString("Recording the voice traffic to %1").arg(qsVoiceTraceFile));
+
+	// Links are symmetric, so every one of them is recorded once
+	for (const Channel *c : qhChannels) {
+		for (const Channel *l : c->qhLinks.keys()) {
+			if (c->iId < l->iId) {
+				traceLink(VoiceTrace::EventType::ChannelLinked, *c, *l);
 			}
 		}
-	} else if (key == "registerpassword")
-		qsRegPassword = !v.isNull() ? v : Meta::mp.qsRegPassword;
-	else if (key == "registerhostname")
-		qsRegHost = !v.isNull() ? v : Meta::mp.qsRegHost;
-	else if (key == "registerlocation")
-		qsRegLocation = !v.isNull() ? v : Meta::mp.qsRegLocation;
-	else if (key == "registerurl")
-		qurlRegWeb = !v.isNull() ? v : Meta::mp.qurlRegWeb;
-	else if (key == "certrequired")
-		bCertRequired = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bCertRequired;
-	else if (key == "forceExternalAuth")
-		bForceExternalAuth = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bForceExternalAuth;
-	else if (key == "bonjour") {
-		bBonjour = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bBonjour;
-#ifdef USE_ZEROCONF
-		if (bBonjour && !zeroconf) {
-			initZeroconf();
-		} else if (!bBonjour && zeroconf) {
-			removeZeroconf();
-		}
+	}
+}
+
+void Server::readSpeakerLimits() {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &entry, qsSpeakerLimits.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &entry, qsSpeakerLimits.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
 #endif
-	} else if (key == "allowping")
-		bAllowPing = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowPing;
-	else if (key == "allowrecording")
-		allowRecording = !v.isNull() ? QVariant(v).toBool() : Meta::mp.allowRecording;
-	else if (key == "username")
-		qrUserName = !v.isNull() ? QRegExp(v) : Meta::mp.qrUserName;
-	else if (key == "channelname")
-		qrChannelName = !v.isNull() ? QRegExp(v) : Meta::mp.qrChannelName;
-	else if (key == "suggestversion")
-		m_suggestVersion = !v.isNull() ? Version::fromConfig(v) : Meta::mp.m_suggestVersion;
-	else if (key == "suggestpositional")
-		qvSuggestPositional = !v.isNull() ? (v.isEmpty() ? QVariant() : v) : Meta::mp.qvSuggestPositional;
-	else if (key == "suggestpushtotalk")
-		qvSuggestPushToTalk = !v.isNull() ? (v.isEmpty() ? QVariant() : v) : Meta::mp.qvSuggestPushToTalk;
-	else if (key == "opusthreshold")
-		iOpusThreshold = (i >= 0 && !v.isNull()) ? qBound(0, i, 100) : Meta::mp.iOpusThreshold;
-	else if (key == "channelnestinglimit")
-		iChannelNestingLimit = (i >= 0 && !v.isNull()) ? i : Meta::mp.iChannelNestingLimit;
-	else if (key == "channelcountlimit")
-		iChannelCountLimit = (i >= 0 && !v.isNull()) ? i : Meta::mp.iChannelCountLimit;
-	else if (key == "messagelimit") {
-		iMessageLimit = (!v.isNull()) ? v.toUInt() : Meta::mp.iMessageLimit;
-		if (iMessageLimit < 1) {
-			iMessageLimit = 1;
-		}
-	} else if (key == "messageburst") {
-		iMessageBurst = (!v.isNull()) ? v.toUInt() : Meta::mp.iMessageBurst;
-		if (iMessageBurst < 1) {
-			iMessageBurst = 1;
+		// channel=speakers
+		const QStringList parts     = entry.split(QLatin1Char('='));
+		bool ok                     = parts.size() == 2;
+		const unsigned int channel  = ok ? parts[0].toUInt(&ok) : 0;
+		const unsigned int speakers = ok ? parts[1].toUInt(&ok) : 0;
+		if (!ok || speakers == 0) {
+			log(QString("Ignoring invalid speaker limit \"%1\"").arg(entry));
+			continue;
 		}
-	} else if (key == "broadcastlistenervolumeadjustments") {
-		broadcastListenerVolumeAdjustments =
-			(!v.isNull() ? QVariant(v).toBool() : Meta::mp.broadcastListenerVolumeAdjustments);
+
+		m_speakerSelectors[channel] = std::make_unique< SpeakerSelector >(speakers);
+	}
+
+	if (!m_speakerSelectors.empty()) {
+		log(QString("Limiting the number of concurrent speakers in %1 channel(s)").arg(m_speakerSelectors.size()));
 	}
 }
 
-#ifdef USE_ZEROCONF
-void Server::initZeroconf() {
-	zeroconf = new Zeroconf();
-	if (zeroconf->isOk()) {
-		log("Registering zeroconf service...");
-		zeroconf->registerService(BonjourRecord(qsRegName, "_mumble._tcp", ""), usPort);
+void Server::startRecording() {
+	std::vector< unsigned int > channels;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &entry, qsRecordChannels.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &entry, qsRecordChannels.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
+#endif
+		bool ok                    = false;
+		const unsigned int channel = entry.toUInt(&ok);
+		if (!ok) {
+			log(QString("Ignoring invalid recorded channel \"%1\"").arg(entry));
+			continue;
+		}
+
+		channels.push_back(channel);
+	}
+
+	if (channels.empty()) {
+		return;
+	}
+	if (qsRecordingDir.isEmpty()) {
+		log("Not recording any channel as recordingDir isn't set");
 		return;
 	}
 
-	delete zeroconf;
-	zeroconf = nullptr;
+	const std::size_t count = channels.size();
+	m_recorder              = std::make_unique< ChannelRecorder >(qsRecordingDir, std::move(channels));
+	log(QString("Recording %1 channel(s) to %2").arg(count).arg(qsRecordingDir));
 }
 
-void Server::removeZeroconf() {
-	if (!zeroconf) {
+void Server::startMessageHistory() {
+	if (qsMessageHistoryDir.isEmpty()) {
+		log("Not keeping any message history as messageHistoryDir isn't set");
 		return;
 	}
 
-	if (zeroconf->isOk()) {
-		log("Unregistering zeroconf service...");
+	// Every virtual server keeps a history of its own
+	const QString directory = QDir(qsMessageHistoryDir).filePath(QString::number(iServerNum));
+
+	m_messageHistory = std::make_unique< MessageHistory >(directory, messageHistory, messageHistoryDays,
+														  QDateTime::currentMSecsSinceEpoch());
+	if (!m_messageHistory->isValid()) {
+		log(QString("Not keeping any message history as %1 can't be written to").arg(directory));
+		m_messageHistory.reset();
+		return;
 	}
 
-	delete zeroconf;
-	zeroconf = nullptr;
+	log(QString("Keeping the last %1 message(s) of every channel in %2").arg(messageHistory).arg(directory));
 }
-#endif
 
-gsl::span< const Mumble::Protocol::byte >
-	Server::handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
-					   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder,
-					   bool expectExtended) {
-	Mumble::Protocol::PingData pingData = decoder.getPingData();
+void Server::recordTextMessage(const ServerUser &sender, const MumbleProto::TextMessage &msg, unsigned int channel) {
+	MumbleProto::TextMessageHistory_Entry entry;
+	MumbleProto::TextMessage *message = entry.mutable_message();
+	message->set_actor(msg.actor());
+	message->set_message(msg.message());
+	message->set_message_id(msg.message_id());
+	message->set_timestamp(msg.timestamp());
+	entry.set_actor_name(u8(sender.qsName));
 
-	if (pingData.requestAdditionalInformation) {
-		pingData.requestAdditionalInformation = false;
+	m_messageHistory->append(channel, entry);
+}
 
-		pingData.serverVersion = Version::get();
-		assert(qhUsers.size() >= static_cast< int >(m_botCount));
-		pingData.userCount                     = static_cast< unsigned int >(qhUsers.size()) - m_botCount;
-		pingData.maxUserCount                  = iMaxUsers;
-		pingData.maxBandwidthPerUser           = static_cast< unsigned int >(iMaxBandwidth);
-		pingData.containsAdditionalInformation = true;
-	} else if (expectExtended) {
-		// Return zero-length span
-		return {};
+void Server::sendMessageHistory(ServerUser *u, const Channel &c, qint64 page) {
+	if (!m_messageHistory || !u->bTextMessageHistory) {
+		return;
 	}
 
-	// Encode in the same protocol version that we decoded with
-	encoder.setProtocolVersion(decoder.getProtocolVersion());
-
-	return encoder.encodePingPacket(pingData);
+	// The pages are cached, so every one is only serialized once for all the users that are sent it
+	const QByteArray &data = m_messageHistory->page(c.iId, page);
+	if (!data.isEmpty()) {
+		u->sendMessage(data, Connection::SendLane::Bulk);
+	}
 }
 
+void Server::recordSpeech(const ServerUser &u, const VoiceState &state, const Mumble::Protocol::AudioData &audioData,
+						  quint64 now) {
+	if (audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+		return;
+	}
 
-void Server::customEvent(QEvent *evt) {
-	if (evt->type() == EXEC_QEVENT)
-		static_cast< ExecEvent * >(evt)->execute();
+	const unsigned int *channel = state.channels.find(u.uiSession);
+	if (channel && m_recorder->isRecorded(*channel)) {
+		m_recorder->record(*channel, u.uiSession, audioData.payload, now);
+	}
 }
 
-void Server::udpActivated(int socket) {
-	// At this part we are only expecting pings of clients we don't know yet -> thus we also don't know which protocol
-	// version they are using.
-	m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
+#ifdef USE_SERVER_MIXING
+void Server::readStageChannels() {
+#	if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	foreach (const QString &entry, qsStageChannels.split(QRegExp(QLatin1String("\\s+")), Qt::SkipEmptyParts)) {
+#	else
+	// Qt 5.14 introduced the Qt::SplitBehavior flags deprecating the QString fields
+	foreach (const QString &entry, qsStageChannels.split(QRegExp(QLatin1String("\\s+")), QString::SkipEmptyParts)) {
+#	endif
+		bool ok                    = false;
+		const unsigned int channel = entry.toUInt(&ok);
+		if (!ok || m_mixingContexts.empty()) {
+			log(QString("Ignoring invalid stage channel \"%1\"").arg(entry));
+			continue;
+		}
 
-	qint32 len;
+		auto mixer = std::make_unique< StageMixer >(channel, StageMixer::DEFAULT_BITRATE);
+		if (!mixer->isValid()) {
+			log(QString("Failed to create the mixer for stage channel %1").arg(channel));
+			continue;
+		}
+		m_stageMixers[channel] = std::move(mixer);
+	}
 
-	sockaddr_storage from;
-#ifdef Q_OS_UNIX
-#	ifdef Q_OS_LINUX
-	struct msghdr msg;
-	struct iovec iov[1];
+	if (!m_stageMixers.empty()) {
+		log(QString("Mixing the speech of %1 stage channel(s) on %2 thread(s)")
+				.arg(m_stageMixers.size())
+				.arg(m_mixingContexts.size()));
+	}
+}
 
-	iov[0].iov_base = m_udpDecoder.getBuffer().data();
-	iov[0].iov_len  = m_udpDecoder.getBuffer().size();
+MixingThread::MixingThread(Server &server, std::size_t index) : m_server(server), m_index(index) {
+}
 
-	uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+void MixingThread::run() {
+	m_server.runMixingLoop(m_index);
+}
 
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
-	msg.msg_namelen    = sizeof(from);
-	msg.msg_iov        = iov;
-	msg.msg_iovlen     = 1;
-	msg.msg_control    = controldata;
-	msg.msg_controllen = sizeof(controldata);
+void Server::runMixingLoop(std::size_t index) {
+	tracy::SetThreadName("Mixing");
 
-	int &sock = socket;
-	len       = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-#	else
-	socklen_t fromlen = sizeof(from);
-	int &sock         = socket;
-	len = static_cast< qint32 >(::recvfrom(sock, m_udpDecoder.getBuffer().data(), m_udpDecoder.getBuffer().size(),
-										   MSG_TRUNC, reinterpret_cast< struct sockaddr * >(&from), &fromlen));
-#	endif
-#else
-	int fromlen = static_cast< int >(sizeof(from));
-	SOCKET sock = static_cast< SOCKET >(socket);
-	len         = ::recvfrom(sock, reinterpret_cast< char * >(m_udpDecoder.getBuffer().data()),
-                     static_cast< int >(m_udpDecoder.getBuffer().size()), 0,
-                     reinterpret_cast< struct sockaddr * >(&from), &fromlen);
-#endif
+	VoiceContext &context = *m_mixingContexts[index];
 
-	gsl::span< Mumble::Protocol::byte > inputData(&m_udpDecoder.getBuffer()[0], static_cast< std::size_t >(len));
+	// Every thread mixes every n-th stage channel
+	std::vector< StageMixer * > mixers;
+	std::size_t position = 0;
+	for (auto &entry : m_stageMixers) {
+		if (position++ % m_mixingContexts.size() == index) {
+			mixers.push_back(entry.second.get());
+		}
+	}
 
-	if (bAllowPing && m_udpDecoder.decodePing(inputData)
-		&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-		gsl::span< const Mumble::Protocol::byte > encodedPing = handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	StageMixer::Frame frame;
+	auto deadline = std::chrono::steady_clock::now();
+	while (m_mixing) {
+		deadline += std::chrono::microseconds(StageMixer::FRAME_DURATION);
+		std::this_thread::sleep_until(deadline);
 
-		if (!encodedPing.empty()) {
-#ifdef Q_OS_LINUX
-			// There will be space for only one header, and the only data we have asked for is the incoming
-			// address. So we can reuse most of the same msg and control data.
-			iov[0].iov_len  = encodedPing.size();
-			iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-			::sendmsg(sock, &msg, 0);
-#else
-#	ifdef Q_OS_WIN
-            using size_type = int;
-#	else
-			using size_type = std::size_t;
-#	endif
-            ::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
-                     static_cast< size_type >(encodedPing.size()), 0, reinterpret_cast< struct sockaddr * >(&from),
-                     fromlen);
-#endif
+		for (StageMixer *mixer : mixers) {
+			if (mixer->mix(frame, BandwidthRecord::clock())) {
+				sendMix(*mixer, frame, context);
+			}
 		}
 	}
 }
 
-void Server::run() {
-	tracy::SetThreadName("Audio");
+void Server::sendMix(const StageMixer &mixer, const StageMixer::Frame &frame, VoiceContext &context) {
+	ZoneScoped;
 
-	qint32 len;
-#if defined(__LP64__)
-	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
-	unsigned char *encrypt = encbuff + 4;
-#else
-	unsigned char encrypt[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
-#endif
-	unsigned char buffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+	{
+		m_voiceEpochs.enter(context.epochReader);
+		QReadLocker rl(&qrwlVoiceThread);
 
-	sockaddr_storage from;
-	unsigned int nfds = static_cast< unsigned int >(qlUdpSocket.count());
+		const VoiceState *state         = m_voiceState.load();
+		const ChannelAudience *audience = nullptr;
+		if (state) {
+			audience = state->audienceOfChannel(mixer.channel());
+		}
+		if (!audience) {
+			// Nobody is in the channel anymore
+			m_voiceEpochs.leave(context.epochReader);
+			return;
+		}
 
-#ifdef Q_OS_UNIX
-	socklen_t fromlen;
-	std::vector< struct pollfd > fds;
-	fds.resize(static_cast< std::size_t >(nfds + 1));
+		context.now = BandwidthRecord::clock();
+		context.receivers.clear();
 
-	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i].fd      = qlUdpSocket.at(static_cast< int >(i));
-		fds[i].events  = POLLIN;
-		fds[i].revents = 0;
-	}
+		// The speakers hear each other directly (see routeStageSpeech)
+		std::array< unsigned int, StageMixer::MAX_SPEAKERS > speakers;
+		const std::size_t speakerCount = mixer.speakers(speakers, context.now);
 
-	fds[nfds].fd      = aiNotify[0];
-	fds[nfds].events  = POLLIN;
-	fds[nfds].revents = 0;
-#else
-	int fromlen;
-	std::vector< SOCKET > fds;
-	fds.resize(nfds);
-	std::vector< HANDLE > events;
-	events.resize(nfds + 1);
-	for (unsigned int i = 0; i < nfds; ++i) {
-		fds[i]    = qlUdpSocket.at(i);
-		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-		::WSAEventSelect(fds[i], events[i], FD_READ);
+		for (const ChannelAudience::Receiver &receiver : audience->receivers) {
+			if (receiver.user->bDeaf || receiver.user->bSelfDeaf
+				|| std::find(speakers.data(), speakers.data() + speakerCount, receiver.user->uiSession)
+					   != speakers.data() + speakerCount) {
+				continue;
+			}
+			context.receivers.forceAddReceiver(*receiver.user, receiver.context, false, receiver.volumeAdjustment);
+		}
+
+		Mumble::Protocol::AudioData audioData;
+		audioData.usedCodec     = Mumble::Protocol::AudioCodec::Opus;
+		audioData.senderSession = frame.session;
+		audioData.frameNumber   = frame.frameNumber;
+		audioData.isLastFrame   = frame.isLastFrame;
+		audioData.payload       = frame.payload;
+
+		sendAudio(audioData, context.receivers, context);
+		context.routedPackets++;
+
+		m_voiceEpochs.leave(context.epochReader);
 	}
-	events[nfds] = hNotify;
-#endif
 
-	++nfds;
+	flushVoiceContext(context);
+}
 
-	while (bRunning) {
-		FrameMarkNamed(TracyConstants::UDP_FRAME);
+void Server::routeStageSpeech(ServerUser &u, StageMixer &mixer, const Mumble::Protocol::AudioData &audioData,
+							  VoiceContext &context) {
+	mixer.push(u.uiSession, audioData, context.now);
 
-#ifdef Q_OS_UNIX
-		int pret = poll(fds.data(), nfds, -1);
-		if (pret <= 0) {
-			if (errno == EINTR)
-				continue;
-			qCritical("poll failure");
-			bRunning = false;
-			break;
-		}
+	std::array< unsigned int, StageMixer::MAX_SPEAKERS > speakers;
+	const std::size_t speakerCount = mixer.speakers(speakers, context.now);
 
-		if (fds[nfds - 1].revents) {
-			// Drain pipe
-			unsigned char val;
-			while (::recv(aiNotify[0], &val, 1, MSG_DONTWAIT) == 1) {
-			};
-			break;
+	for (std::size_t i = 0; i < speakerCount; ++i) {
+		ServerUser *speaker = qhUsers.value(speakers[i]);
+		if (speaker && speaker != &u && !speaker->bDeaf && !speaker->bSelfDeaf) {
+			context.receivers.forceAddReceiver(*speaker, Mumble::Protocol::AudioContext::NORMAL,
+											   audioData.containsPositionalData);
 		}
+	}
 
-		for (unsigned int i = 0; i < nfds - 1; ++i) {
-			if (fds[i].revents) {
-				if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
-					qCritical("poll event failure");
-					bRunning = false;
-					break;
-				}
-
-				int sock = fds[i].fd;
-#else
-		for (unsigned int i = 0; i < 1; ++i) {
-			{
-				DWORD ret = WaitForMultipleObjects(nfds, events.data(), FALSE, INFINITE);
-				if (ret == (WAIT_OBJECT_0 + nfds - 1)) {
-					break;
-				}
-				if (ret == WAIT_FAILED) {
-					qCritical("UDP wait failed");
-					bRunning = false;
-					break;
-				}
-				SOCKET sock = fds[ret - WAIT_OBJECT_0];
+	sendAudio(audioData, context.receivers, context);
+}
 #endif
 
-				fromlen = sizeof(from);
-#ifdef Q_OS_WIN
-				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
-								 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
-#else
-#	ifdef Q_OS_LINUX
-				struct msghdr msg;
-				struct iovec iov[1];
+#ifdef USE_SERVER_TRANSCODING
+void Server::divertToTranscoder(const ServerUser &u, const Mumble::Protocol::AudioData &audioData,
+								AudioReceiverBuffer &buffer) {
+	// Every frame is transcoded into a single codec: Opus for those who can decode it and CELT for everybody else
+	const bool receiversHaveOpus = audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus;
+	const Mumble::Protocol::AudioCodec targetCodec = Transcoder::targetCodec(audioData.usedCodec, receiversHaveOpus);
+	if (targetCodec == audioData.usedCodec) {
+		return;
+	}
+
+	Transcoder::Frame frame;
+	for (bool positional : { false, true }) {
+		// Nothing is added to the buffer anymore before it is sent, so the receivers can simply be taken out of it
+		std::vector< AudioReceiver > &receivers = buffer.getReceivers(positional);
+		auto end = std::remove_if(receivers.begin(), receivers.end(), [&](const AudioReceiver &receiver) {
+			if (receiver.getReceiver().bOpus != receiversHaveOpus) {
+				return false;
+			}
 
-				iov[0].iov_base = encrypt;
-				iov[0].iov_len  = Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+			frame.receivers.push_back({ receiver.getReceiver().uiSession, receiver.getContext(),
+										receiver.getVolumeAdjustment(), positional });
+			return true;
+		});
+		receivers.erase(end, receivers.end());
+	}
 
-				uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+	if (frame.receivers.empty()) {
+		return;
+	}
 
-				memset(&msg, 0, sizeof(msg));
-				msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
-				msg.msg_namelen    = sizeof(from);
-				msg.msg_iov        = iov;
-				msg.msg_iovlen     = 1;
-				msg.msg_control    = controldata;
-				msg.msg_controllen = sizeof(controldata);
+	frame.session                = u.uiSession;
+	frame.codec                  = audioData.usedCodec;
+	frame.targetCodec            = targetCodec;
+	frame.frameNumber            = audioData.frameNumber;
+	frame.isLastFrame            = audioData.isLastFrame;
+	frame.containsPositionalData = audioData.containsPositionalData;
+	frame.position               = audioData.position;
+	frame.payload.assign(audioData.payload.begin(), audioData.payload.end());
 
-				len = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
-				Q_UNUSED(fromlen);
-#	else
-				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
-													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
-#	endif
-#endif
+	m_transcoder->submit(std::move(frame));
+}
 
-				// Capture only the processing without the polling
-				ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
+void Server::sendTranscoded(const Transcoder::Frame &frame, VoiceContext &context) {
+	ZoneScoped;
 
-				if (len == 0) {
-					break;
-				} else if (len == SOCKET_ERROR) {
-					break;
-				} else if (len < 5) {
-					// 4 bytes crypt header + type + session
-					continue;
-				} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
-					// This will also catch the len == -1 case (indicating error)
-					static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE,
-								  "Invalid assumption");
-					continue;
-				}
+	{
+		m_voiceEpochs.enter(context.epochReader);
+		QReadLocker rl(&qrwlVoiceThread);
 
-				QReadLocker rl(&qrwlVoiceThread);
+		context.now = BandwidthRecord::clock();
+		context.receivers.clear();
 
-				quint16 port = (from.ss_family == AF_INET6) ? (reinterpret_cast< sockaddr_in6 * >(&from)->sin6_port)
-															: (reinterpret_cast< sockaddr_in * >(&from)->sin_port);
-				const HostAddress &ha = HostAddress(from);
+		for (const Transcoder::Receiver &receiver : frame.receivers) {
+			// The receivers might have left (or deafened themselves) in the meantime
+			ServerUser *user = qhUsers.value(receiver.session);
+			if (user && !user->bDeaf && !user->bSelfDeaf) {
+				context.receivers.forceAddReceiver(*user, receiver.context, receiver.positional,
+												   receiver.volumeAdjustment);
+			}
+		}
 
-				const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(ha, port);
+		Mumble::Protocol::AudioData audioData;
+		audioData.usedCodec              = frame.codec;
+		audioData.senderSession          = frame.session;
+		audioData.frameNumber            = frame.frameNumber;
+		audioData.isLastFrame            = frame.isLastFrame;
+		audioData.containsPositionalData = frame.containsPositionalData;
+		audioData.position               = frame.position;
+		audioData.payload                = frame.payload;
 
-				ServerUser *u = qhPeerUsers.value(key);
+		sendAudio(audioData, context.receivers, context);
+		context.routedPackets++;
 
-				if (u) {
-					m_udpDecoder.setProtocolVersion(u->m_version);
-				} else {
-					m_udpDecoder.setProtocolVersion(Version::UNKNOWN);
-				}
-				// This may be a general ping requesting server details, unencrypted.
-				if (bAllowPing
-					&& m_udpDecoder.decodePing(
-						gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
-					&& m_udpDecoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
-					ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+		m_voiceEpochs.leave(context.epochReader);
+	}
 
-					gsl::span< const Mumble::Protocol::byte > encodedPing =
-						handlePing(m_udpDecoder, m_udpPingEncoder, true);
+	flushVoiceContext(context);
+}
+#endif
 
-					if (!encodedPing.empty()) {
-#ifdef Q_OS_LINUX
-						// We are only reading from the buffer and thus the const_cast should be fine
-						iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
-						iov[0].iov_len  = encodedPing.size();
-						::sendmsg(sock, &msg, 0);
+bool Server::isTranscoding() const {
+#ifdef USE_SERVER_TRANSCODING
+	return m_celt != nullptr;
 #else
-#	ifdef Q_OS_WIN
-						using size_type = int;
-#	else
-						using size_type = std::size_t;
-#	endif
-						::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
-								 static_cast< size_type >(encodedPing.size()), 0,
-								 reinterpret_cast< struct sockaddr * >(&from), fromlen);
+	return false;
 #endif
-					}
+}
 
-					continue;
-				}
+VolumeAdjustment Server::listenerVolumeAdjustment(const ChannelListenerManager::ListenerEntry &listener) const {
+	return quantizeListenerVolumes ? AudioReceiverBuffer::quantizeVolumeAdjustment(listener.volumeAdjustment)
+								   : listener.volumeAdjustment;
+}
+
+void Server::traceLink(VoiceTrace::EventType type, const Channel &c, const Channel &l) {
+	if (m_voiceTrace) {
+		VoiceTrace::Event event;
+		event.type         = type;
+		event.channel      = c.iId;
+		event.otherChannel = l.iId;
+		m_voiceTrace->record(std::move(event));
+	}
+}
+
+void Server::traceListener(VoiceTrace::EventType type, const ServerUser &user, const Channel &channel) {
+	if (m_voiceTrace) {
+		VoiceTrace::Event event;
+		event.type    = type;
+		event.session = user.uiSession;
+		event.channel = channel.iId;
+		m_voiceTrace->record(std::move(event));
+	}
+}
+
+void Server::resetSessionIds() {
+	const unsigned int node = m_cluster ? m_cluster->nodeId() : 0;
+
+	qqIds.clear();
+	for (unsigned int i = 0; i < iMaxUsers * 2; ++i) {
+		// In a cluster, every node hands out the sessions that belong to it (see ClusterProtocol::sessionNode)
+		const unsigned int id = node > 0 ? i * ClusterProtocol::MAX_NODES + node : i;
+		if (id > 0 && !qhUsers.contains(id) && !(m_cluster && m_cluster->isRemoteUser(id)))
+			qqIds.enqueue(id);
+	}
+}
+
+bool Server::isPooledSession(unsigned int session) const {
+	if (m_cluster) {
+		return ClusterProtocol::sessionNode(session) == m_cluster->nodeId()
+			   && session / ClusterProtocol::MAX_NODES < iMaxUsers * 2;
+	}
+
+	return session > 0 && session < iMaxUsers * 2;
+}
+
+void Server::setLiveConf(const QString &key, const QString &value) {
+	QString v = value.trimmed().isEmpty() ? QString() : value;
+	int i     = v.toInt();
+	if ((key == "password") || (key == "serverpassword"))
+		qsPassword = !v.isNull() ? v : Meta::mp.qsPassword;
+	else if (key == "timeout") {
+		iTimeout = i ? i : Meta::mp.iTimeout;
+		// A shorter timeout has to move the deadlines that have been scheduled with the previous one
+		foreach (const ServerUser *u, qhUsers)
+			scheduleTimeout(u);
+	}
+	else if (key == "host") {
+		qlBind = !v.isNull() ? bindAddresses(v) : Meta::mp.qlBind;
+		scheduleRebind();
+	} else if (key == "port") {
+		usPort = static_cast< unsigned short >(i ? i : Meta::mp.usPort + iServerNum - 1);
+		scheduleRebind();
+	} else if (key == "sslDHParams") {
+		// The certificate and its key can't be changed one after another, which is why they are only ever updated
+		// together (see the Ice method updateCertificate)
+		initializeCert();
+	}
+	else if (key == "bandwidth") {
+		int length = i ? i : Meta::mp.iMaxBandwidth;
+		if (length != iMaxBandwidth) {
+			iMaxBandwidth = length;
+			updatePingReply();
+			MumbleProto::ServerConfig mpsc;
+			mpsc.set_max_bandwidth(static_cast< unsigned int >(length));
+			sendAll(mpsc);
+		}
+	} else if (key == "users") {
+		unsigned int newmax = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxUsers;
+		if (iMaxUsers == newmax)
+			return;
+
+		iMaxUsers = newmax;
+		resetSessionIds();
+		updatePingReply();
+
+		MumbleProto::ServerConfig mpsc;
+		mpsc.set_max_users(iMaxUsers);
+		sendAll(mpsc);
+	} else if (key == "usersperchannel")
+		iMaxUsersPerChannel = i ? static_cast< unsigned int >(i) : Meta::mp.iMaxUsersPerChannel;
+	else if (key == "textmessagelength") {
+		int length = i ? i : Meta::mp.iMaxTextMessageLength;
+		if (length != iMaxTextMessageLength) {
+			iMaxTextMessageLength = length;
+			MumbleProto::ServerConfig mpsc;
+			mpsc.set_message_length(static_cast< unsigned int >(length));
+			sendAll(mpsc);
+		}
+	} else if (key == "imagemessagelength") {
+		int length = i ? i : Meta::mp.iMaxImageMessageLength;
+		if (length != iMaxImageMessageLength) {
+			iMaxImageMessageLength = length;
+			MumbleProto::ServerConfig mpsc;
+			mpsc.set_image_message_length(static_cast< unsigned int >(length));
+			sendAll(mpsc);
+		}
+	} else if (key == "allowhtml") {
+		bool allow = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowHTML;
+		if (allow != bAllowHTML) {
+			bAllowHTML = allow;
+			MumbleProto::ServerConfig mpsc;
+			mpsc.set_allow_html(bAllowHTML);
+			sendAll(mpsc);
+		}
+	} else if (key == "defaultchannel")
+		iDefaultChan = i ? static_cast< unsigned int >(i) : Meta::mp.iDefaultChan;
+	else if (key == "rememberchannel")
+		bRememberChan = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bRememberChan;
+	else if (key == "rememberchannelduration") {
+		iRememberChanDuration = !v.isNull() ? v.toInt() : Meta::mp.iRememberChanDuration;
+		if (iRememberChanDuration < 0) {
+			iRememberChanDuration = 0;
+		}
+	} else if (key == "welcometext") {
+		QString text = !v.isNull() ? v : Meta::mp.qsWelcomeText;
+		if (text != qsWelcomeText) {
+			qsWelcomeText = text;
+		}
+	} else if (key == "registername") {
+		QString text = !v.isNull() ? v : Meta::mp.qsRegName;
+		if (text != qsRegName) {
+			qsRegName = text;
+			m_stateSnapshots.invalidateChannels();
+			if (!qsRegName.isEmpty()) {
+				MumbleProto::ChannelState mpcs;
+				mpcs.set_channel_id(0);
+				mpcs.set_name(u8(qsRegName));
+				sendAll(mpcs);
+			}
+		}
+	} else if (key == "registerpassword")
+		qsRegPassword = !v.isNull() ? v : Meta::mp.qsRegPassword;
+	else if (key == "registerhostname")
+		qsRegHost = !v.isNull() ? v : Meta::mp.qsRegHost;
+	else if (key == "registerlocation")
+		qsRegLocation = !v.isNull() ? v : Meta::mp.qsRegLocation;
+	else if (key == "registerurl")
+		qurlRegWeb = !v.isNull() ? v : Meta::mp.qurlRegWeb;
+	else if (key == "certrequired")
+		bCertRequired = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bCertRequired;
+	else if (key == "forceExternalAuth")
+		bForceExternalAuth = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bForceExternalAuth;
+	else if (key == "bonjour") {
+		bBonjour = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bBonjour;
+#ifdef USE_ZEROCONF
+		if (bBonjour && !m_zeroconfPublished) {
+			initZeroconf();
+		} else if (!bBonjour && m_zeroconfPublished) {
+			removeZeroconf();
+		}
+#endif
+	} else if (key == "allowping")
+		bAllowPing = !v.isNull() ? QVariant(v).toBool() : Meta::mp.bAllowPing;
+	else if (key == "pingLimit") {
+		pingLimit = !v.isNull() ? v.toUInt() : Meta::mp.pingLimit;
+		updatePingLimits();
+	} else if (key == "pingBurst") {
+		pingBurst = !v.isNull() ? v.toUInt() : Meta::mp.pingBurst;
+		updatePingLimits();
+	} else if (key == "allowrecording")
+		allowRecording = !v.isNull() ? QVariant(v).toBool() : Meta::mp.allowRecording;
+	else if (key == "username")
+		qrUserName = !v.isNull() ? NamePattern(v) : Meta::mp.qrUserName;
+	else if (key == "channelname")
+		qrChannelName = !v.isNull() ? NamePattern(v) : Meta::mp.qrChannelName;
+	else if (key == "suggestversion")
+		m_suggestVersion = !v.isNull() ? Version::fromConfig(v) : Meta::mp.m_suggestVersion;
+	else if (key == "suggestpositional")
+		qvSuggestPositional = !v.isNull() ? (v.isEmpty() ? QVariant() : v) : Meta::mp.qvSuggestPositional;
+	else if (key == "suggestpushtotalk")
+		qvSuggestPushToTalk = !v.isNull() ? (v.isEmpty() ? QVariant() : v) : Meta::mp.qvSuggestPushToTalk;
+	else if (key == "opusthreshold")
+		iOpusThreshold = (i >= 0 && !v.isNull()) ? qBound(0, i, 100) : Meta::mp.iOpusThreshold;
+	else if (key == "channelnestinglimit")
+		iChannelNestingLimit = (i >= 0 && !v.isNull()) ? i : Meta::mp.iChannelNestingLimit;
+	else if (key == "channelcountlimit")
+		iChannelCountLimit = (i >= 0 && !v.isNull()) ? i : Meta::mp.iChannelCountLimit;
+	else if (key == "messagelimit") {
+		iMessageLimit = (!v.isNull()) ? v.toUInt() : Meta::mp.iMessageLimit;
+		if (iMessageLimit < 1) {
+			iMessageLimit = 1;
+		}
+	} else if (key == "messageburst") {
+		iMessageBurst = (!v.isNull()) ? v.toUInt() : Meta::mp.iMessageBurst;
+		if (iMessageBurst < 1) {
+			iMessageBurst = 1;
+		}
+	} else if (key == "broadcastlistenervolumeadjustments") {
+		broadcastListenerVolumeAdjustments =
+			(!v.isNull() ? QVariant(v).toBool() : Meta::mp.broadcastListenerVolumeAdjustments);
+		// The snapshots of the users contain the volume adjustments only if they are broadcast
+		m_stateSnapshots.invalidateUsers();
+	}
+}
+
+#ifdef USE_ZEROCONF
+void Server::initZeroconf() {
+	meta->m_registrationWorker->publishZeroconf(iServerNum, qsRegName, usPort);
+	m_zeroconfPublished = true;
+}
+
+void Server::removeZeroconf() {
+	if (!m_zeroconfPublished) {
+		return;
+	}
+
+	meta->m_registrationWorker->unpublishZeroconf(iServerNum);
+	m_zeroconfPublished = false;
+}
+#endif
+
+gsl::span< const Mumble::Protocol::byte >
+	Server::handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+					   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder,
+					   bool expectExtended, std::uint32_t bitrateHint) {
+	Mumble::Protocol::PingData pingData = decoder.getPingData();
+	// The quality of the client's link is of no use to the client itself
+	pingData.packetLoss  = 0;
+	pingData.jitter      = 0;
+	pingData.bitrateHint = bitrateHint;
+
+	if (pingData.requestAdditionalInformation) {
+		pingData.requestAdditionalInformation = false;
+
+		pingData.serverVersion = Version::get();
+		assert(qhUsers.size() >= static_cast< int >(m_botCount));
+		pingData.userCount                     = static_cast< unsigned int >(qhUsers.size()) - m_botCount;
+		pingData.maxUserCount                  = iMaxUsers;
+		pingData.maxBandwidthPerUser           = static_cast< unsigned int >(iMaxBandwidth);
+		pingData.containsAdditionalInformation = true;
+	} else if (expectExtended) {
+		// Return zero-length span
+		return {};
+	}
+
+	// Encode in the same protocol version that we decoded with
+	encoder.setProtocolVersion(decoder.getProtocolVersion());
+
+	return encoder.encodePingPacket(pingData);
+}
+
+void Server::updatePingReply() {
+	assert(qhUsers.size() >= static_cast< int >(m_botCount));
+
+	PingResponder::Details details;
+	details.version      = Version::get();
+	details.userCount    = static_cast< unsigned int >(qhUsers.size()) - m_botCount;
+	details.maxUserCount = iMaxUsers;
+	details.maxBandwidth = static_cast< unsigned int >(iMaxBandwidth);
+
+	m_pingResponder.update(details);
+}
+
+void Server::updatePingLimits() {
+	m_pingLimiter.configure(pingLimit, pingBurst);
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		context->pingLimiter.configure(pingLimit, pingBurst);
+	}
+}
+
+std::size_t Server::infoPingReply(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+								  PingRateLimiter &limiter, const sockaddr_storage &from, quint64 now,
+								  Mumble::Protocol::byte *buffer) {
+	const Mumble::Protocol::PingData pingData = decoder.getPingData();
+	if (!pingData.requestAdditionalInformation) {
+		// Plain connectivity pings are only answered for the users they belong to
+		return 0;
+	}
+
+	if (!limiter.allow(from, now)) {
+		m_metrics.pingsLimited.add();
+		return 0;
+	}
+
+	// Reply in the same protocol version that the ping has been decoded with
+	const bool protobuf = decoder.getProtocolVersion() >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION;
+	return m_pingResponder.reply(pingData.timestamp, protobuf, buffer);
+}
+
+unsigned int Server::linkBitrate(unsigned int packetLoss, unsigned int jitter) {
+	// Lower bitrates leave room for the loss to be recovered from (see AudioInput::encodeOpusFrame) and keep
+	// packets small, which makes them less likely to be queued (as hinted at by the jitter) on a congested link
+	if (packetLoss >= 10 || jitter >= 60) {
+		return 16000;
+	}
+	if (packetLoss >= 5 || jitter >= 30) {
+		return 24000;
+	}
+	if (packetLoss >= 2 || jitter >= 15) {
+		return 40000;
+	}
+
+	return 0;
+}
+
+std::uint32_t Server::channelBitrateHint(const ServerUser &u) const {
+	const VoiceState *state         = m_voiceState.load();
+	const ChannelAudience *audience = state ? state->audienceOf(u.uiSession) : nullptr;
+	if (!audience) {
+		return 0;
+	}
+
+	unsigned int hint = 0;
+	for (const std::vector< ChannelAudience::Receiver > *receivers :
+		 { &audience->receivers, &audience->linkedReceivers }) {
+		for (const ChannelAudience::Receiver &receiver : *receivers) {
+			const unsigned int bitrate = receiver.user->m_linkBitrate.load(std::memory_order_relaxed);
+			if (receiver.user != &u && bitrate != 0 && (hint == 0 || bitrate < hint)) {
+				hint = bitrate;
+			}
+		}
+	}
+
+	return hint;
+}
+
+
+void Server::customEvent(QEvent *evt) {
+	if (evt->type() == EXEC_QEVENT)
+		static_cast< ExecEvent * >(evt)->execute();
+}
+
+void Server::udpActivated(int socket) {
+	// This runs on the main thread (while no voice thread is running), whose voice context isn't decoding anything else
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder = m_tcpVoiceContext.decoder;
+
+	// At this part we are only expecting pings of clients we don't know yet -> thus we also don't know which protocol
+	// version they are using.
+	decoder.setProtocolVersion(Version::UNKNOWN);
+
+	qint32 len;
+
+	sockaddr_storage from;
+#ifdef Q_OS_UNIX
+#	ifdef Q_OS_LINUX
+	struct msghdr msg;
+	struct iovec iov[1];
+
+	iov[0].iov_base = decoder.getBuffer().data();
+	iov[0].iov_len  = decoder.getBuffer().size();
+
+	uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name       = reinterpret_cast< struct sockaddr * >(&from);
+	msg.msg_namelen    = sizeof(from);
+	msg.msg_iov        = iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = controldata;
+	msg.msg_controllen = sizeof(controldata);
+
+	int &sock = socket;
+	len       = static_cast< qint32 >(::recvmsg(sock, &msg, MSG_TRUNC));
+#	else
+	socklen_t fromlen = sizeof(from);
+	int &sock         = socket;
+	len = static_cast< qint32 >(::recvfrom(sock, decoder.getBuffer().data(), decoder.getBuffer().size(),
+										   MSG_TRUNC, reinterpret_cast< struct sockaddr * >(&from), &fromlen));
+#	endif
+#else
+	int fromlen = static_cast< int >(sizeof(from));
+	SOCKET sock = static_cast< SOCKET >(socket);
+	len         = ::recvfrom(sock, reinterpret_cast< char * >(decoder.getBuffer().data()),
+                     static_cast< int >(decoder.getBuffer().size()), 0,
+                     reinterpret_cast< struct sockaddr * >(&from), &fromlen);
+#endif
+
+	gsl::span< Mumble::Protocol::byte > inputData(&decoder.getBuffer()[0], static_cast< std::size_t >(len));
+
+	if (bAllowPing && decoder.decodePing(inputData)
+		&& decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+		std::array< Mumble::Protocol::byte, PingResponder::MAX_REPLY_SIZE > reply;
+		const gsl::span< const Mumble::Protocol::byte > encodedPing(
+			reply.data(), infoPingReply(decoder, m_pingLimiter, from, BandwidthRecord::clock(), reply.data()));
+
+		if (!encodedPing.empty()) {
+#ifdef Q_OS_LINUX
+			// There will be space for only one header, and the only data we have asked for is the incoming
+			// address. So we can reuse most of the same msg and control data.
+			iov[0].iov_len  = encodedPing.size();
+			iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
+			::sendmsg(sock, &msg, 0);
+#else
+#	ifdef Q_OS_WIN
+            using size_type = int;
+#	else
+			using size_type = std::size_t;
+#	endif
+            ::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
+                     static_cast< size_type >(encodedPing.size()), 0, reinterpret_cast< struct sockaddr * >(&from),
+                     fromlen);
+#endif
+		}
+	}
+}
+
+VoiceContext::VoiceContext()
+	: pingLimiter(Meta::mp.pingLimit, Meta::mp.pingBurst), tcpTunnelQueue(TCP_TUNNEL_QUEUE_CAPACITY),
+	  tcpTunnelNotified(false) {
+}
+
+VoiceContext::socket_t VoiceContext::socketFor(socket_t primarySocket) const {
+	for (std::size_t i = 0; i < primarySockets.size() && i < sockets.size(); ++i) {
+		if (primarySockets[i] == primarySocket) {
+			return sockets[i];
+		}
+	}
+
+	return primarySocket;
+}
+
+VoiceThread::VoiceThread(Server &server, VoiceContext &context) : m_server(server), m_context(context) {
+}
+
+void VoiceThread::run() {
+	m_server.runVoiceLoop(m_context);
+}
+
+void Server::run() {
+	runVoiceLoop(*m_voiceContexts.front());
+}
+
+int Server::voiceThreadCPU(std::size_t thread) const {
+	return m_voiceThreadCPUs.empty() ? -1 : m_voiceThreadCPUs[thread % m_voiceThreadCPUs.size()];
+}
+
+void Server::runVoiceLoop(VoiceContext &context) {
+	tracy::SetThreadName("Audio");
+	Audit::ZoneScope auditZone(Audit::Zone::VoiceLoop);
+
+#ifdef Q_OS_LINUX
+	if (!m_voiceThreadCPUs.empty()) {
+		const std::size_t threadIndex = static_cast< std::size_t >(
+			std::find_if(m_voiceContexts.begin(), m_voiceContexts.end(),
+						 [&context](const std::unique_ptr< VoiceContext > &other) { return other.get() == &context; })
+			- m_voiceContexts.begin());
+		const int cpu = voiceThreadCPU(threadIndex);
+
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(cpu, &cpuSet);
+		const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+		if (error != 0) {
+			log(QString("Server: Failed to pin voice thread %1 to CPU %2: %3")
+					.arg(threadIndex)
+					.arg(cpu)
+					.arg(QString::fromLatin1(strerror(error))));
+		}
+	}
+#endif
+
+#ifdef USE_IO_URING
+	if (ioUring) {
+		if (runIOUringVoiceLoop(context)) {
+			return;
+		}
+
+		log("Server: Falling back to poll() for receiving voice packets");
+	}
+#endif
+#ifdef Q_OS_WIN
+	if (registeredIO) {
+		if (runRegisteredIOVoiceLoop(context)) {
+			return;
+		}
+
+		log("Server: Falling back to receiving voice packets one by one");
+	}
+#endif
+
+#ifndef Q_OS_LINUX
+	qint32 len;
+#	if defined(__LP64__)
+	unsigned char encbuff[Mumble::Protocol::MAX_UDP_PACKET_SIZE + 8];
+	unsigned char *encrypt = encbuff + 4;
+#	else
+	unsigned char encrypt[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+#	endif
+
+	sockaddr_storage from;
+#endif
+
+	unsigned int nfds = static_cast< unsigned int >(context.sockets.size());
+
+#ifdef Q_OS_LINUX
+	// On Linux we read as many datagrams as are available (up to udpReceiveBatchSize) with a single
+	// call to recvmmsg. Every slot carries its own address, control data and (aligned) receive buffer
+	// so that all received packets can be processed one after another afterwards.
+	struct ReceiveSlot {
+		sockaddr_storage from;
+		struct iovec iov;
+		// Room for the packet info and the GRO segment size
+		alignas(struct cmsghdr)
+			uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))
+								+ CMSG_SPACE(sizeof(int))];
+		unsigned char *data;
+	};
+
+	const unsigned int batchSize = udpReceiveBatchSize;
+	const std::size_t slotSize = m_udpReceiveOffload ? GRO_RECEIVE_BUFFER_SIZE : Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+	std::vector< ReceiveSlot > receiveSlots(batchSize);
+	std::vector< struct mmsghdr > receiveMsgs(batchSize);
+	std::vector< VoiceDatagram > receivedPackets;
+	receivedPackets.reserve(batchSize);
+	// Every slot's buffer starts 8 bytes after the previous one ends, keeping all of them 8-byte aligned
+	std::vector< unsigned char > receiveBuffer(batchSize * (slotSize + 8));
+
+	for (unsigned int j = 0; j < batchSize; ++j) {
+		ReceiveSlot &slot  = receiveSlots[j];
+		struct msghdr &hdr = receiveMsgs[j].msg_hdr;
+
+		slot.data = receiveBuffer.data() + j * (slotSize + 8);
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name    = reinterpret_cast< struct sockaddr * >(&slot.from);
+		hdr.msg_iov     = &slot.iov;
+		hdr.msg_iovlen  = 1;
+		hdr.msg_control = slot.controldata;
+	}
+#endif
+
+#ifdef Q_OS_UNIX
+	std::vector< struct pollfd > fds;
+	fds.resize(static_cast< std::size_t >(nfds + 1));
+
+	for (unsigned int i = 0; i < nfds; ++i) {
+		fds[i].fd      = context.sockets[i];
+		fds[i].events  = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	fds[nfds].fd      = aiNotify[0];
+	fds[nfds].events  = POLLIN;
+	fds[nfds].revents = 0;
+#else
+	std::vector< SOCKET > fds;
+	fds.resize(nfds);
+	std::vector< HANDLE > events;
+	events.resize(nfds + 1);
+	for (unsigned int i = 0; i < nfds; ++i) {
+		fds[i]    = context.sockets[i];
+		events[i] = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		::WSAEventSelect(fds[i], events[i], FD_READ);
+	}
+	events[nfds] = hNotify;
+#endif
+
+	++nfds;
+
+	while (bRunning) {
+		FrameMarkNamed(TracyConstants::UDP_FRAME);
+
+#ifdef Q_OS_UNIX
+		int pret = 0;
+#	ifdef Q_OS_LINUX
+		if (udpSpinTime > 0) {
+			// Keep checking for new packets for a bit before going to sleep. This trades CPU time for not
+			// having to wait for the thread to be woken up if the next packet arrives soon.
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(udpSpinTime);
+			do {
+				pret = poll(fds.data(), nfds, 0);
+			} while (pret == 0 && std::chrono::steady_clock::now() < deadline);
+		}
+#	endif
+		if (pret == 0) {
+			pret = poll(fds.data(), nfds, -1);
+		}
+		if (pret <= 0) {
+			if (errno == EINTR)
+				continue;
+			qCritical("poll failure");
+			bRunning = false;
+			break;
+		}
+
+		if (fds[nfds - 1].revents) {
+			// The pipe is drained by stopThread() once all voice threads have seen it
+			break;
+		}
+
+		for (unsigned int i = 0; i < nfds - 1; ++i) {
+			if (fds[i].revents) {
+				if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+					qCritical("poll event failure");
+					bRunning = false;
+					break;
+				}
+
+				int sock                      = fds[i].fd;
+				const std::size_t socketIndex = i;
+#else
+		for (unsigned int i = 0; i < 1; ++i) {
+			{
+				DWORD ret = WaitForMultipleObjects(nfds, events.data(), FALSE, INFINITE);
+				if (ret == (WAIT_OBJECT_0 + nfds - 1)) {
+					break;
+				}
+				if (ret == WAIT_FAILED) {
+					qCritical("UDP wait failed");
+					bRunning = false;
+					break;
+				}
+				const std::size_t socketIndex = ret - WAIT_OBJECT_0;
+				SOCKET sock                   = fds[socketIndex];
+#endif
+
+				// All packets received in this batch are accounted for at the same time (see VoiceContext::now)
+				context.now = BandwidthRecord::clock();
+
+#ifdef Q_OS_LINUX
+				// recvmmsg overwrites the lengths in the headers, so they have to be reset before every call
+				for (unsigned int j = 0; j < batchSize; ++j) {
+					ReceiveSlot &slot  = receiveSlots[j];
+					struct msghdr &hdr = receiveMsgs[j].msg_hdr;
+
+					slot.iov.iov_base  = slot.data + 4;
+					slot.iov.iov_len   = slotSize;
+					hdr.msg_namelen    = sizeof(slot.from);
+					hdr.msg_controllen = sizeof(slot.controldata);
+					hdr.msg_flags      = 0;
+				}
+
+				// MSG_WAITFORONE: Block only until the first datagram has been received (which poll told us is
+				// already the case) and then collect whatever else is queued up without blocking.
+				const int received =
+					::recvmmsg(sock, receiveMsgs.data(), batchSize, MSG_TRUNC | MSG_WAITFORONE, nullptr);
+				if (received <= 0) {
+					break;
+				}
+
+				receivedPackets.clear();
+				for (std::size_t j = 0; j < static_cast< std::size_t >(received); ++j) {
+					addReceivedDatagram(receivedPackets, socketIndex, receiveMsgs[j].msg_hdr, receiveSlots[j].data + 4,
+										receiveMsgs[j].msg_len, slotSize);
+				}
+#else
+				socklen_t fromlen = sizeof(from);
+#	ifdef Q_OS_WIN
+				len = ::recvfrom(sock, reinterpret_cast< char * >(encrypt), Mumble::Protocol::MAX_UDP_PACKET_SIZE, 0,
+								 reinterpret_cast< struct sockaddr * >(&from), &fromlen);
+#	else
+				len = static_cast< qint32 >(::recvfrom(sock, encrypt, Mumble::Protocol::MAX_UDP_PACKET_SIZE, MSG_TRUNC,
+													   reinterpret_cast< struct sockaddr * >(&from), &fromlen));
+#	endif
+				const VoiceDatagram receivedPackets[] = { { socketIndex, encrypt, len, &from } };
+#endif
+
+				{
+					// The whole batch is processed while holding the read lock only once (and with the same
+					// VoiceState)
+					m_voiceEpochs.enter(context.epochReader);
+					Audit::ReadLocker rl(&qrwlVoiceThread, Audit::Lock::VoiceThread);
+
+					for (const VoiceDatagram &datagram : receivedPackets) {
+						processDatagram(context, datagram);
+					}
+
+					associatePendingPeers(context, rl);
+					m_voiceEpochs.leave(context.epochReader);
+				}
+
+				// Hand everything that has been queued while processing this batch over at once
+				flushVoiceContext(context);
+#ifdef Q_OS_UNIX
+				fds[i].revents = 0;
+#endif
+			}
+		}
+	}
+#ifdef Q_OS_WIN
+	for (unsigned int i = 0; i < nfds - 1; ++i) {
+		::WSAEventSelect(fds[i], nullptr, 0);
+		CloseHandle(events[i]);
+	}
+#endif
+}
+
+#ifdef USE_IO_URING
+bool Server::runIOUringVoiceLoop(VoiceContext &context) {
+	const std::size_t bufferSize =
+		m_udpReceiveOffload ? GRO_RECEIVE_BUFFER_SIZE : Mumble::Protocol::MAX_UDP_PACKET_SIZE;
+	// Room for the packet info and the GRO segment size
+	const std::size_t controlSize =
+		CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo))) + CMSG_SPACE(sizeof(int));
+
+	IOUringReceiver receiver;
+	// Keep enough buffers around for the kernel to fill while we are processing the previous batch
+	if (!receiver.init(context.sockets, aiNotify[0], std::max(2 * udpReceiveBatchSize, 16U), bufferSize, controlSize)) {
+		log(QString("Server: Unable to use io_uring (%1)").arg(QString::fromStdString(receiver.errorMessage())));
+		return false;
+	}
+
+	std::vector< IOUringReceiver::Datagram > datagrams;
+	std::vector< VoiceDatagram > receivedPackets;
+
+	while (bRunning) {
+		FrameMarkNamed(TracyConstants::UDP_FRAME);
+
+		switch (receiver.wait(datagrams)) {
+			case IOUringReceiver::Result::Received:
+				break;
+			case IOUringReceiver::Result::Notified:
+				// The pipe is drained by stopThread() once all voice threads have seen it
+				return true;
+			case IOUringReceiver::Result::Failed:
+				log(QString("Server: io_uring failed (%1)").arg(QString::fromStdString(receiver.errorMessage())));
+				return false;
+		}
+
+		context.now = BandwidthRecord::clock();
+
+		receivedPackets.clear();
+		for (IOUringReceiver::Datagram &datagram : datagrams) {
+			addReceivedDatagram(receivedPackets, datagram.socketIndex, datagram.msg, datagram.data, datagram.length,
+								bufferSize);
+		}
+
+		{
+			m_voiceEpochs.enter(context.epochReader);
+			Audit::ReadLocker rl(&qrwlVoiceThread, Audit::Lock::VoiceThread);
+
+			for (const VoiceDatagram &datagram : receivedPackets) {
+				processDatagram(context, datagram);
+			}
+
+			associatePendingPeers(context, rl);
+			m_voiceEpochs.leave(context.epochReader);
+		}
+
+		flushVoiceContext(context);
+	}
+
+	return true;
+}
+#endif
+
+#ifdef Q_OS_WIN
+bool Server::runRegisteredIOVoiceLoop(VoiceContext &context) {
+	if (!context.registeredIO) {
+		context.registeredIO = std::make_unique< RegisteredIO >();
+		// Keep enough receives outstanding for the network stack to fill while we are processing the previous batch.
+		// Every flush of the send queue commits at most UDPSendQueue::CAPACITY packets, so there is room for a few of
+		// them to be in flight.
+		if (!context.registeredIO->init(context.sockets, hNotify, std::max(2 * udpReceiveBatchSize, 16U),
+										Mumble::Protocol::MAX_UDP_PACKET_SIZE, 4 * UDPSendQueue::CAPACITY,
+										UDPSendQueue::MAX_PACKET_SIZE)) {
+			log(QString("Server: Unable to use Registered I/O (%1)")
+					.arg(QString::fromStdString(context.registeredIO->errorMessage())));
+		}
+	}
+
+	RegisteredIO &rio = *context.registeredIO;
+	if (!rio.isValid()) {
+		return false;
+	}
+
+	std::vector< RegisteredIO::Datagram > datagrams;
+	std::vector< VoiceDatagram > receivedPackets;
+
+	// The packets queued while processing a batch are committed at once when the queue is flushed
+	context.sendQueue.setRegisteredIO(&rio);
+
+	bool usable = true;
+	while (bRunning) {
+		FrameMarkNamed(TracyConstants::UDP_FRAME);
+
+		const RegisteredIO::Result result = rio.wait(datagrams, udpReceiveBatchSize);
+		if (result == RegisteredIO::Result::Notified) {
+			break;
+		}
+		if (result == RegisteredIO::Result::Failed) {
+			log(QString("Server: Registered I/O failed (%1)").arg(QString::fromStdString(rio.errorMessage())));
+			usable = false;
+			break;
+		}
+
+		context.now = BandwidthRecord::clock();
+
+		receivedPackets.clear();
+		for (const RegisteredIO::Datagram &datagram : datagrams) {
+			receivedPackets.push_back(
+				{ datagram.socketIndex, datagram.data, static_cast< qint32 >(datagram.length), datagram.from });
+		}
+
+		{
+			m_voiceEpochs.enter(context.epochReader);
+			Audit::ReadLocker rl(&qrwlVoiceThread, Audit::Lock::VoiceThread);
+
+			for (const VoiceDatagram &datagram : receivedPackets) {
+				processDatagram(context, datagram);
+			}
+
+			associatePendingPeers(context, rl);
+			m_voiceEpochs.leave(context.epochReader);
+		}
+
+		flushVoiceContext(context);
+	}
+
+	context.sendQueue.setRegisteredIO(nullptr);
+
+	return usable;
+}
+#endif
+
+void Server::processDatagram(VoiceContext &context, const VoiceDatagram &datagram) {
+	// Capture only the processing without the polling
+	ZoneScopedN(TracyConstants::UDP_PACKET_PROCESSING_ZONE);
+
+	const VoiceContext::socket_t sock = context.sockets[datagram.socketIndex];
+	unsigned char *encrypt            = datagram.data;
+	unsigned char *buffer             = context.decryptBuffer;
+	sockaddr_storage &from            = *datagram.from;
+	qint32 len                        = datagram.length;
+#ifdef Q_OS_LINUX
+	struct msghdr &msg = *datagram.msg;
+	struct iovec *iov  = msg.msg_iov;
+#else
+	const socklen_t fromlen =
+		static_cast< socklen_t >((from.ss_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+#endif
+
+	if (len == 0) {
+		return;
+	} else if (len == SOCKET_ERROR) {
+		return;
+	} else if (len < 5) {
+		// 4 bytes crypt header (OCB2, the shortest one) + type + session
+		return;
+	} else if (static_cast< unsigned int >(len) > Mumble::Protocol::MAX_UDP_PACKET_SIZE) {
+		// This will also catch the len == -1 case (indicating error)
+		static_assert(static_cast< unsigned int >(-1) > Mumble::Protocol::MAX_UDP_PACKET_SIZE, "Invalid assumption");
+		return;
+	}
+
+	m_metrics.udpPacketsReceived.add();
+
+	const PeerKey key(from);
+
+	ServerUser *u = m_peerUsers.lookup(key);
+
+	if (u) {
+		context.decoder.setProtocolVersion(u->m_version);
+	} else {
+		context.decoder.setProtocolVersion(Version::UNKNOWN);
+	}
+	// This may be a general ping requesting server details, unencrypted.
+	if (bAllowPing
+		&& context.decoder.decodePing(gsl::span< Mumble::Protocol::byte >(encrypt, static_cast< std::size_t >(len)))
+		&& context.decoder.getMessageType() == Mumble::Protocol::UDPMessageType::Ping) {
+		ZoneScopedN(TracyConstants::PING_PROCESSING_ZONE);
+
+		std::array< Mumble::Protocol::byte, PingResponder::MAX_REPLY_SIZE > reply;
+		const gsl::span< const Mumble::Protocol::byte > encodedPing(
+			reply.data(), infoPingReply(context.decoder, context.pingLimiter, from, context.now, reply.data()));
+
+		if (!encodedPing.empty()) {
+#ifdef Q_OS_LINUX
+			// We are only reading from the buffer and thus the const_cast should be fine
+			iov[0].iov_base = const_cast< Mumble::Protocol::byte * >(encodedPing.data());
+			iov[0].iov_len  = encodedPing.size();
+			::sendmsg(sock, &msg, 0);
+#else
+#	ifdef Q_OS_WIN
+			using size_type = int;
+#	else
+			using size_type = std::size_t;
+#	endif
+			::sendto(sock, reinterpret_cast< const char * >(encodedPing.data()),
+					 static_cast< size_type >(encodedPing.size()), 0, reinterpret_cast< struct sockaddr * >(&from),
+					 fromlen);
+#endif
+		}
 
+		return;
+	}
 
-				if (u) {
-					if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len))) {
-						continue;
-					}
-				} else {
-					ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
-
-					// Unknown peer
-					foreach (ServerUser *usr, qhHostUsers.value(ha)) {
-						if (checkDecrypt(
-								usr, encrypt, buffer,
-								static_cast< unsigned int >(len))) { // checkDecrypt takes the User's qrwlCrypt lock.
-							// Every time we relock, reverify users' existence.
-							// The main thread might delete the user while the lock isn't held.
-							unsigned int uiSession = usr->uiSession;
-							rl.unlock();
-							qrwlVoiceThread.lockForWrite();
-							if (qhUsers.contains(uiSession)) {
-								u             = usr;
-								u->sUdpSocket = sock;
-								memcpy(&u->saiUdpAddress, &from, sizeof(from));
-								qhHostUsers[from].remove(u);
-								qhPeerUsers.insert(key, u);
-							}
-							qrwlVoiceThread.unlock();
-							rl.relock();
-							if (u && !qhUsers.contains(uiSession))
-								u = nullptr;
-							break;
-						}
-					}
-					if (!u) {
-						continue;
-					}
-				}
-				len -= 4;
-
-				if (m_udpDecoder.decode(gsl::span< Mumble::Protocol::byte >(buffer, static_cast< std::size_t >(len)))) {
-					switch (m_udpDecoder.getMessageType()) {
-						case Mumble::Protocol::UDPMessageType::Audio: {
-							Mumble::Protocol::AudioData audioData = m_udpDecoder.getAudioData();
-
-							// Allow all voice packets through by default.
-							bool ok = true;
-							// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-							if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
-								ok = false;
-							}
 
-							if (ok) {
-								u->aiUdpFlag = 1;
+	if (!u) {
+		// Finding out which user the packet belongs to requires trial decryptions, which are deferred until
+		// the rest of the batch has been handled (see associatePendingPeers)
+		if (context.pendingAssociationCount < VoiceContext::MAX_PENDING_ASSOCIATIONS) {
+			VoiceContext::PendingAssociation &pending = context.pendingAssociations[context.pendingAssociationCount++];
+			pending.socketIndex = datagram.socketIndex;
+			pending.from        = from;
+			pending.length      = static_cast< unsigned int >(len);
+			memcpy(pending.data, encrypt, static_cast< std::size_t >(len));
+		}
+		return;
+	}
+
+	unsigned int plainLength = 0;
+	if (!checkDecrypt(u, encrypt, buffer, static_cast< unsigned int >(len), plainLength)) {
+		m_metrics.decryptFailures.add();
+		return;
+	}
 
-								// Add session id
-								audioData.senderSession = u->uiSession;
+	processDecryptedDatagram(context, u, buffer, plainLength);
+}
 
-								processMsg(u, audioData, m_udpAudioReceivers, m_udpAudioEncoder);
-							}
-							break;
-						}
-						case Mumble::Protocol::UDPMessageType::Ping: {
-							ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
-
-							Mumble::Protocol::PingData pingData = m_udpDecoder.getPingData();
-							if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
-								// At this point here, we only want to handle connectivity pings
-								gsl::span< const Mumble::Protocol::byte > encodedPing =
-									handlePing(m_udpDecoder, m_udpPingEncoder, false);
-
-								QByteArray cache;
-								sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache,
-											true);
-							}
-							break;
-						}
-					}
+void Server::associatePendingPeers(VoiceContext &context, Audit::ReadLocker &rl) {
+	if (context.pendingAssociationCount == 0) {
+		return;
+	}
+
+	ZoneScopedN(TracyConstants::DECRYPT_UNKNOWN_PEER_ZONE);
+
+	const std::size_t count         = context.pendingAssociationCount;
+	context.pendingAssociationCount = 0;
+
+	bool needsWriteLock = false;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		VoiceContext::PendingAssociation &pending = context.pendingAssociations[i];
+		pending.user                              = nullptr;
+		pending.associate                         = false;
+
+		const PeerKey key(pending.from);
+
+		// The peer may have been associated by another voice thread in the meantime or by an earlier
+		// packet of this very batch
+		ServerUser *candidate = m_peerUsers.lookup(key);
+		bool associated       = candidate != nullptr;
+		bool knownStray       = false;
+		for (std::size_t j = 0; !candidate && j < i; ++j) {
+			const VoiceContext::PendingAssociation &earlier = context.pendingAssociations[j];
+			if (PeerKey(earlier.from) == key) {
+				candidate  = earlier.user;
+				knownStray = !earlier.user;
+				break;
+			}
+		}
+
+		if (candidate && checkDecrypt(candidate, pending.data, pending.plain, pending.length, pending.plainLength)) {
+			pending.user = candidate;
+		} else if (!associated && !knownStray) {
+			// Try every user that connected from this host (unless an earlier packet from the same source has
+			// already been found not to belong to any of them). This includes the ones that are associated with
+			// another port already, whose NAT may have rebound them to a new one, so that they don't need a new
+			// connection to get their UDP back.
+			foreach (ServerUser *usr, qhHostUsers.value(HostAddress(pending.from))) {
+				if (usr != candidate
+					&& checkDecrypt(usr, pending.data, pending.plain, pending.length, pending.plainLength)) {
+					pending.user = usr;
+					break;
 				}
-#ifdef Q_OS_UNIX
-				fds[i].revents = 0;
-#endif
 			}
 		}
+
+		if (pending.user) {
+			pending.session   = pending.user->uiSession;
+			pending.associate = !associated;
+			needsWriteLock    = needsWriteLock || pending.associate;
+		}
 	}
+
+	if (needsWriteLock) {
+		rl.unlock();
+		Audit::lockForWrite(qrwlVoiceThread, Audit::Lock::VoiceThread);
+		for (std::size_t i = 0; i < count; ++i) {
+			VoiceContext::PendingAssociation &pending = context.pendingAssociations[i];
+			const PeerKey key(pending.from);
+
+			// Every time we relock, reverify users' existence.
+			// The main thread might delete the user while the lock isn't held.
+			if (!pending.associate || qhUsers.value(pending.session) != pending.user
+				|| m_peerUsers.lookup(key) == pending.user) {
+				continue;
+			}
+
+			ServerUser *u = pending.user;
+			if (u->sUdpSocket != INVALID_SOCKET) {
+				// The user has moved on from the port it has been associated with
+				quint16 port = (u->udpDestination.address.ss_family == AF_INET6)
+								   ? (reinterpret_cast< sockaddr_in6 * >(&u->udpDestination.address)->sin6_port)
+								   : (reinterpret_cast< sockaddr_in * >(&u->udpDestination.address)->sin_port);
+				m_peerUsers.remove(PeerKey(u->haAddress, port));
+			}
+
+			// Sending is done through the socket of the voice thread that is
+			// handling the packet at the time (see VoiceContext::socketFor)
+			u->sUdpSocket = context.primarySockets[pending.socketIndex];
+			u->udpDestination = UDPDestination(pending.from, u->haTcpLocalAddress);
 #ifdef Q_OS_WIN
-	for (unsigned int i = 0; i < nfds - 1; ++i) {
-		::WSAEventSelect(fds[i], nullptr, 0);
-		CloseHandle(events[i]);
-	}
+			updateQoSFlow(*u);
 #endif
+			m_peerUsers.insert(key, u);
+		}
+		// No other thread can be looking up peers while we are holding the write lock
+		m_peerUsers.reclaim();
+		qrwlVoiceThread.unlock();
+		rl.relock();
+	}
+
+	for (std::size_t i = 0; i < count; ++i) {
+		VoiceContext::PendingAssociation &pending = context.pendingAssociations[i];
+		if (pending.user && qhUsers.value(pending.session) == pending.user) {
+			context.decoder.setProtocolVersion(pending.user->m_version);
+			processDecryptedDatagram(context, pending.user, pending.plain, pending.plainLength);
+		}
+	}
+}
+
+void Server::processDecryptedDatagram(VoiceContext &context, ServerUser *u, unsigned char *plain, unsigned int len) {
+	if (context.decoder.decode(gsl::span< Mumble::Protocol::byte >(plain, static_cast< std::size_t >(len)))) {
+		switch (context.decoder.getMessageType()) {
+			case Mumble::Protocol::UDPMessageType::Audio: {
+				Mumble::Protocol::AudioData audioData = context.decoder.getAudioData();
+
+				// Allow all voice packets through by default.
+				bool ok = true;
+				// ...Unless we're in Opus mode (and not transcoding). In Opus mode, only Opus packets are allowed.
+				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus && !isTranscoding()) {
+					ok = false;
+				}
+
+				if (ok) {
+					u->aiUdpFlag = 1;
+
+					// Add session id
+					audioData.senderSession = u->uiSession;
+
+					processMsg(u, audioData, context);
+				}
+				break;
+			}
+			case Mumble::Protocol::UDPMessageType::Ping: {
+				ZoneScopedN(TracyConstants::UDP_PING_PROCESSING_ZONE);
+
+				Mumble::Protocol::PingData pingData = context.decoder.getPingData();
+				if (!pingData.requestAdditionalInformation && !pingData.containsAdditionalInformation) {
+					// At this point here, we only want to handle connectivity pings. They report how well the user
+					// receives audio and are answered with how well the others in its channel do.
+					u->m_linkBitrate.store(linkBitrate(pingData.packetLoss, pingData.jitter),
+										   std::memory_order_relaxed);
+
+					gsl::span< const Mumble::Protocol::byte > encodedPing =
+						handlePing(context.decoder, context.pingEncoder, false, channelBitrateHint(*u));
+
+					QByteArray cache;
+					sendMessage(*u, encodedPing.data(), static_cast< int >(encodedPing.size()), cache, context, true);
+				}
+				break;
+			}
+		}
+	}
+}
+
+void Server::flushVoiceContext(VoiceContext &context) {
+	context.sendQueue.flush();
+	if (m_cluster) {
+		m_cluster->flush(context.relayBatches);
+	}
+
+	if (context.routedPackets > 0) {
+		// All packets of the batch have been received at the same time and their last copies have just been sent
+		m_metrics.forwardingLatency.observe(BandwidthRecord::clock() - context.now, context.routedPackets);
+		context.routedPackets = 0;
+	}
+
+	// Only notify the main thread if it isn't going to look at the queue anyway
+	if (!context.tcpTunnelQueue.empty() && !context.tcpTunnelNotified.exchange(true)) {
+		emit tcpTunnelPending();
+	}
 }
 
-bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned char *plain, unsigned int len) {
+bool Server::checkDecrypt(ServerUser *u, const unsigned char *encrypt, unsigned char *plain, unsigned int len,
+						  unsigned int &plainlen) {
 	ZoneScoped;
+	Audit::ZoneScope auditZone(Audit::Zone::CheckDecrypt);
 
-	QMutexLocker l(&u->qmCrypt);
+	// The decrypting half of the user's crypt state has its own lock, so that decrypting never waits for packets
+	// being encrypted for the user. It is only ever contended while the user's packets arrive at two voice threads
+	// at once (e.g. because its address has just changed).
+	Audit::MutexLocker l(&u->qmDecrypt, Audit::Lock::Decrypt);
 
-	if (u->csCrypt->isValid() && u->csCrypt->decrypt(encrypt, plain, len)) {
+	CryptState &crypt = *u->csCrypt;
+
+	if (crypt.isValid() && crypt.decrypt(encrypt, plain, len)) {
+		plainlen = len - crypt.overhead();
 		return true;
 	}
 
-	if (u->csCrypt->tLastGood.elapsed() > 5000000ULL) {
-		if (u->csCrypt->tLastRequest.elapsed() > 5000000ULL) {
-			u->csCrypt->tLastRequest.restart();
+	if (crypt.tLastGood.elapsed() > 5000000ULL) {
+		if (crypt.tLastRequest.elapsed() > 5000000ULL) {
+			crypt.tLastRequest.restart();
 			emit reqSync(u->uiSession);
 		}
 	}
 	return false;
 }
 
-void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force) {
+namespace {
+/// @returns Whether packets for the given user are sent via UDP (instead of being tunneled through TCP)
+bool usesUDP(const ServerUser &u, bool force) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	return (u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET);
+#else
+	// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
+	return (u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET);
+#endif
+}
+} // namespace
+
+void Server::sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache,
+						 VoiceContext &context, bool force) {
+	ZoneScoped;
+	Audit::ZoneScope auditZone(Audit::Zone::SendMessage);
+
+	if (usesUDP(u, force)) {
+		if (!u.udpDestination.valid) {
+			// Don't waste a nonce on a packet that can't be sent
+			return;
+		}
+
+		UDPSendQueue &sendQueue           = context.sendQueue;
+		const VoiceContext::socket_t sock = context.socketFor(u.sUdpSocket);
+		unsigned char *buffer             = sendQueue.prepare(sock);
+		std::size_t length                = 0;
+		{
+			Audit::MutexLocker wl(&u.qmCrypt, Audit::Lock::Crypt);
+
+			if (!u.csCrypt->isValid()) {
+				return;
+			}
+
+			length = static_cast< std::size_t >(len) + u.csCrypt->overhead();
+			if (length > UDPSendQueue::MAX_PACKET_SIZE) {
+				// Such a packet would exceed the maximum UDP packet size anyway
+				return;
+			}
+
+			if (!u.csCrypt->encrypt(data, buffer, static_cast< unsigned int >(len))) {
+				return;
+			}
+		}
+
+		commitUDP(u, sock, length, context);
+	} else {
+		if (cache.isEmpty()) {
+			// The UDPTunnel message is built only once for all receivers of this packet
+			cache.resize(len + 6);
+			unsigned char *uc = reinterpret_cast< unsigned char * >(cache.data());
+			*reinterpret_cast< quint16 * >(&uc[0]) =
+				qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel));
+			*reinterpret_cast< quint32 * >(&uc[2]) = qToBigEndian(static_cast< quint32 >(len));
+			memcpy(uc + 6, data, static_cast< std::size_t >(len));
+		}
+
+		// If the queue is full, the main thread is lagging far behind and the packet is dropped
+		if (context.tcpTunnelQueue.try_push({ u.uiSession, cache })) {
+			m_metrics.tunneledPacketsSent.add();
+		}
+	}
+}
+
+void Server::sendUDPBatch(ServerUser **users, std::size_t count, const unsigned char *data, int len,
+						  VoiceContext &context) {
+	ZoneScoped;
+	Audit::ZoneScope auditZone(Audit::Zone::SendMessage);
+
+	// The encrypting halves of several users' crypt states are locked at the same time. Doing so in a fixed order
+	// (their address) ensures that this can't deadlock with another voice thread. Grouping the users by socket
+	// comes first though, as a batch can only contain packets for the same socket.
+	std::sort(users, users + count, [](const ServerUser *lhs, const ServerUser *rhs) {
+		return lhs->sUdpSocket != rhs->sUdpSocket ? lhs->sUdpSocket < rhs->sUdpSocket : lhs < rhs;
+	});
+
+	UDPSendQueue &sendQueue = context.sendQueue;
+
+	std::size_t first = 0;
+	while (first < count) {
+		const VoiceContext::socket_t sock = context.socketFor(users[first]->sUdpSocket);
+
+		std::size_t end = first + 1;
+		while (end < count && end - first < CryptState::MAX_BATCH
+			   && users[end]->sUdpSocket == users[first]->sUdpSocket) {
+			++end;
+		}
+
+		unsigned char *buffers[CryptState::MAX_BATCH];
+		const std::size_t batchSize = sendQueue.prepareBatch(sock, end - first, buffers);
+
+		CryptBatchEntry entries[CryptState::MAX_BATCH];
+		ServerUser *receivers[CryptState::MAX_BATCH];
+		std::size_t lengths[CryptState::MAX_BATCH];
+		std::size_t nEntries = 0;
+
+		for (std::size_t i = 0; i < batchSize; ++i) {
+			ServerUser *u = users[first + i];
+			Audit::lock(u->qmCrypt, Audit::Lock::Crypt);
+
+			const std::size_t length = static_cast< std::size_t >(len) + u->csCrypt->overhead();
+			// Packets that would exceed the maximum UDP packet size are skipped
+			if (u->csCrypt->isValid() && length <= UDPSendQueue::MAX_PACKET_SIZE) {
+				entries[nEntries]   = { u->csCrypt.get(), buffers[i], false };
+				receivers[nEntries] = u;
+				lengths[nEntries]   = length;
+				++nEntries;
+			}
+		}
+
+		CryptState::encryptBatch(data, static_cast< unsigned int >(len), entries, nEntries);
+
+		for (std::size_t i = 0; i < batchSize; ++i) {
+			users[first + i]->qmCrypt.unlock();
+		}
+
+		for (std::size_t i = 0; i < nEntries; ++i) {
+			if (!entries[i].success) {
+				continue;
+			}
+
+			// If a receiver has been skipped, the following packets have to be moved up in the queue
+			unsigned char *buffer = sendQueue.prepare(sock);
+			if (buffer != entries[i].dst) {
+				memcpy(buffer, entries[i].dst, lengths[i]);
+			}
+
+			commitUDP(*receivers[i], sock, lengths[i], context);
+		}
+
+		first += batchSize;
+	}
+}
+
+void Server::commitUDP(ServerUser &u, VoiceContext::socket_t sock, std::size_t length, VoiceContext &context) {
+	// The packet is sent in the user's QoS flow (if any), which has been set up along with its address
+	Q_UNUSED(sock);
+
+	// On Linux this only queues the packet. On other platforms it is sent right away.
+	context.sendQueue.commit(length, u.udpDestination);
+	m_metrics.udpPacketsSent.add();
+}
+
+#ifdef Q_OS_WIN
+void Server::updateQoSFlow(ServerUser &u) {
+	if (!Meta::hQoS) {
+		return;
+	}
+
+	if (u.m_qosFlow) {
+		QOSRemoveSocketFromFlow(Meta::hQoS, 0, u.m_qosFlow, 0);
+		u.m_qosFlow = 0;
+	}
+
+	DWORD flow = 0;
+	if (!QOSAddSocketToFlow(Meta::hQoS, u.sUdpSocket, reinterpret_cast< struct sockaddr * >(&u.udpDestination.address),
+							QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&flow))) {
+		return;
+	}
+	u.m_qosFlow = flow;
+
+	if (udpDSCP > 0) {
+		// Overriding the marking of the traffic type requires administrative privileges
+		DWORD dscp = udpDSCP;
+		if (!QOSSetFlow(Meta::hQoS, flow, QOSSetOutgoingDSCPValue, sizeof(dscp), &dscp, 0, nullptr)) {
+			qWarning("Server: Failed to set the DSCP of the QoS flow (error %lu)", GetLastError());
+		}
+	}
+}
+#endif
+
+void Server::invalidateAudience(unsigned int channelID) {
+	Channel *c = qhChannels.value(channelID);
+	if (c) {
+		// Speech in a channel is also heard in all channels that are linked to it
+		for (Channel *affected : c->linkGroup()) {
+			m_staleAudiences.insert(affected->iId);
+		}
+	} else {
+		m_staleAudiences.insert(channelID);
+	}
+
+	scheduleVoiceStatePublication();
+}
+
+void Server::invalidateMembership(unsigned int session) {
+	m_staleMemberships.insert(session);
+
+	scheduleVoiceStatePublication();
+}
+
+void Server::scheduleVoiceStatePublication() {
+	if (!m_voiceStatePublicationPending) {
+		m_voiceStatePublicationPending = true;
+		// Everything that is changed in one go (e.g. all users leaving a removed channel) is published at once
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::publishVoiceState, this)));
+	}
+}
+
+void Server::publishVoiceState() {
+	ZoneScoped;
+
+	m_voiceStatePublicationPending = false;
+
+	std::shared_ptr< VoiceState > state = m_publishedVoiceState ? std::make_shared< VoiceState >(*m_publishedVoiceState)
+																: std::make_shared< VoiceState >();
+
+	// Only the shards of the maps that contain changed entries are copied (see ShardedMap)
+	for (unsigned int session : m_staleMemberships) {
+		ServerUser *u = qhUsers.value(session);
+		if (u && u->cChannel) {
+			state->channels.set(session, u->cChannel->iId);
+		} else {
+			state->channels.erase(session);
+		}
+	}
+	m_staleMemberships.clear();
+
+	rebuildAudiences(*state);
+	refreshWhisperTargets(*state);
+
+	m_voiceState.store(state.get());
+
+	// Voice threads that enter from now on get to see the new state, so neither the old one nor anything that has
+	// been removed before the new one was built can be reached by them
+	if (m_publishedVoiceState) {
+		m_voiceEpochs.retire(std::move(m_publishedVoiceState));
+	}
+	for (std::function< void() > &destroy : m_voiceStateRetirements) {
+		m_voiceEpochs.retire(std::move(destroy));
+	}
+	m_voiceStateRetirements.clear();
+
+	m_publishedVoiceState = std::move(state);
+
+	reclaimVoiceStates();
+}
+
+void Server::reclaimVoiceStates() {
+	m_voiceStateReclaimPending = false;
+
+	// The voice threads leave after every batch of packets, so this rarely has to be retried
+	if (m_voiceEpochs.reclaim() && !m_voiceStateReclaimPending) {
+		m_voiceStateReclaimPending = true;
+		QTimer::singleShot(1, this, &Server::reclaimVoiceStates);
+	}
+}
+
+void Server::retireWithVoiceState(std::function< void() > destroy) {
+	m_voiceStateRetirements.push_back(std::move(destroy));
+
+	scheduleVoiceStatePublication();
+}
+
+void Server::rebuildAudiences(VoiceState &state) {
 	ZoneScoped;
 
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
-	if ((u.aiUdpFlag.loadRelaxed() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
-#else
-	// Qt 5.14 introduced QAtomicInteger::loadRelaxed() which deprecates QAtomicInteger::load()
-	if ((u.aiUdpFlag.load() == 1 || force) && (u.sUdpSocket != INVALID_SOCKET)) {
-#endif
-#if defined(__LP64__)
-		static std::vector< char > ebuffer;
-		ebuffer.resize(static_cast< std::size_t >(len + 4 + 16));
-		char *buffer = reinterpret_cast< char * >(
-			((reinterpret_cast< quint64 >(ebuffer.data()) + 8) & static_cast< quint64 >(~7)) + 4);
-#else
-		std::vector< char > bufVec;
-		bufVec.resize(len + 4);
-		char *buffer    = bufVec.data();
-#endif
-		{
-			QMutexLocker wl(&u.qmCrypt);
+	for (unsigned int id : m_staleAudiences) {
+		Channel *c = qhChannels.value(id);
+		if (c) {
+			state.audiences.set(id, buildAudience(c));
+		} else {
+			// The audiences of removed channels are simply dropped
+			state.audiences.erase(id);
+		}
+	}
+	m_staleAudiences.clear();
+}
+
+std::unique_ptr< ChannelAudience > Server::buildAudience(Channel *c) const {
+	std::unique_ptr< ChannelAudience > audience = std::make_unique< ChannelAudience >();
+
+	auto addChannel = [this](const Channel &channel, std::vector< ChannelAudience::Receiver > &receivers) {
+		const auto listeners = m_channelListenerManager.getListenerEntries(channel.iId);
+		for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+			ServerUser *pDst = qhUsers.value(listener.userSession);
+			if (pDst) {
+				receivers.push_back(
+					{ pDst, Mumble::Protocol::AudioContext::LISTEN, listenerVolumeAdjustment(listener) });
+			}
+		}
+
+		for (User *p : channel.qlUsers) {
+			receivers.push_back({ static_cast< ServerUser * >(p), Mumble::Protocol::AudioContext::NORMAL,
+								  VolumeAdjustment::fromFactor(1.0f) });
+		}
+	};
+
+	addChannel(*c, audience->receivers);
+
+	if (!c->qhLinks.isEmpty()) {
+		for (Channel *l : c->linkGroup()) {
+			if (l == c) {
+				continue;
+			}
+
+			const std::size_t begin = audience->linkedReceivers.size();
+			addChannel(*l, audience->linkedReceivers);
+			audience->links.push_back({ l, begin, audience->linkedReceivers.size() });
+		}
+	}
+
+	return audience;
+}
+
+void Server::addTextMessageReceivers(Channel *c, std::vector< ServerUser * > &receivers) const {
+	// The published audience of the channel is the same as long as its users and listeners haven't changed since
+	if (m_publishedVoiceState && !m_staleAudiences.contains(c->iId)) {
+		const ChannelAudience *audience = m_publishedVoiceState->audienceOfChannel(c->iId);
+		if (audience) {
+			for (const ChannelAudience::Receiver &receiver : audience->receivers) {
+				receivers.push_back(receiver.user);
+			}
+			return;
+		}
+	}
+
+	for (User *p : c->qlUsers) {
+		receivers.push_back(static_cast< ServerUser * >(p));
+	}
+
+	const auto listeners = m_channelListenerManager.getListenerEntries(c->iId);
+	for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+		ServerUser *pDst = qhUsers.value(listener.userSession);
+		if (pDst) {
+			receivers.push_back(pDst);
+		}
+	}
+}
+
+void Server::addRegularSpeechReceivers(ServerUser &u, const ChannelAudience &audience, bool positional,
+									   AudioReceiverBuffer &buffer) {
+	for (const ChannelAudience::Receiver &receiver : audience.receivers) {
+		buffer.addReceiver(u, *receiver.user, receiver.context, positional, receiver.volumeAdjustment);
+	}
+
+	// Only linked channels the user has speak-permission in receive the audio
+	for (const ChannelAudience::Link &link : audience.links) {
+		if (hasPermission(&u, link.channel, ChanACL::Speak)) {
+			for (std::size_t i = link.begin; i < link.end; ++i) {
+				const ChannelAudience::Receiver &receiver = audience.linkedReceivers[i];
+				buffer.addReceiver(u, *receiver.user, receiver.context, positional, receiver.volumeAdjustment);
+			}
+		}
+	}
+}
+
+WhisperTargetCache Server::buildWhisperTargetCache(ServerUser *u, const WhisperTarget &wt) {
+	ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_CREATE);
+
+	WhisperTargetCache cache;
+
+	std::vector< WhisperReceiverTable::Receiver > receivers;
+	QHash< ServerUser *, std::size_t > receiverIndices;
+
+	// Users that are reached in multiple ways are merged the same way AudioReceiverBuffer::forceAddReceiver does it
+	auto addReceiver = [&](ServerUser &receiver, Mumble::Protocol::audio_context_t context,
+						   const VolumeAdjustment &volumeAdjustment) {
+		cache.dependentSessions.insert(receiver.uiSession);
+
+		auto it = receiverIndices.constFind(&receiver);
+		if (it == receiverIndices.constEnd()) {
+			receiverIndices.insert(&receiver, receivers.size());
+			receivers.push_back({ &receiver, context, volumeAdjustment });
+		} else {
+			WhisperReceiverTable::Receiver &entry = receivers[it.value()];
+
+			entry.context = std::min(entry.context, context);
+			if (entry.volumeAdjustment.factor < volumeAdjustment.factor) {
+				entry.volumeAdjustment = volumeAdjustment;
+			}
+		}
+	};
+
+	foreach (const WhisperTarget::Channel &wtc, wt.qlChannels) {
+		cache.dependentChannels.insert(static_cast< unsigned int >(wtc.iId));
+
+		Channel *wc = qhChannels.value(static_cast< unsigned int >(wtc.iId));
+		if (wc) {
+			bool link       = wtc.bLinks && !wc->qhLinks.isEmpty();
+			bool dochildren = wtc.bChildren && !wc->qlChannels.isEmpty();
+			bool group      = !wtc.qsGroup.isEmpty();
+			if (!link && !dochildren && !group) {
+				// Common case
+				if (hasPermission(u, wc, ChanACL::Whisper)) {
+					foreach (User *p, wc->qlUsers) {
+						addReceiver(*static_cast< ServerUser * >(p), Mumble::Protocol::AudioContext::SHOUT,
+									VolumeAdjustment::fromFactor(1.0f));
+					}
+
+					const auto listeners = m_channelListenerManager.getListenerEntries(wc->iId);
+					for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+						ServerUser *pDst = qhUsers.value(listener.userSession);
+
+						if (pDst) {
+							addReceiver(*pDst, Mumble::Protocol::AudioContext::LISTEN,
+										listenerVolumeAdjustment(listener));
+						}
+					}
+				}
+			} else {
+				QSet< Channel * > channels;
+				if (link)
+					channels = wc->allLinks();
+				else
+					channels.insert(wc);
+				if (dochildren)
+					channels.unite(wc->allChildren());
+				const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
+				const QString &qsg      = redirect.isEmpty() ? wtc.qsGroup : redirect;
+				foreach (Channel *tc, channels) {
+					cache.dependentChannels.insert(tc->iId);
+
+					if (hasPermission(u, tc, ChanACL::Whisper)) {
+						// The group is only looked up once per channel instead of once per user in it
+						ACLProgram::Predicate predicate;
+						const bool matchable = group && predicate.compile(*tc, *tc, qsg);
+
+						foreach (User *p, tc->qlUsers) {
+							ServerUser *su = static_cast< ServerUser * >(p);
+
+							if (!group || (matchable && predicate.appliesTo(*su))) {
+								addReceiver(*su, Mumble::Protocol::AudioContext::SHOUT,
+											VolumeAdjustment::fromFactor(1.0f));
+							}
+						}
+
+						const auto listeners = m_channelListenerManager.getListenerEntries(tc->iId);
+						for (const ChannelListenerManager::ListenerEntry &listener : *listeners) {
+							ServerUser *pDst = qhUsers.value(listener.userSession);
 
-			if (!u.csCrypt->isValid()) {
-				return;
+							if (pDst && (!group || (matchable && predicate.appliesTo(*pDst)))) {
+								// Only send audio to listener if the user exists and it is in the group the
+								// speech is directed at (if any)
+								addReceiver(*pDst, Mumble::Protocol::AudioContext::LISTEN,
+											listenerVolumeAdjustment(listener));
+							}
+						}
+					}
+				}
 			}
+		}
+	}
 
-			if (!u.csCrypt->encrypt(reinterpret_cast< const unsigned char * >(data),
-									reinterpret_cast< unsigned char * >(buffer), static_cast< unsigned int >(len))) {
-				return;
-			}
+	foreach (unsigned int id, wt.qlSessions) {
+		cache.dependentSessions.insert(id);
+
+		ServerUser *pDst = qhUsers.value(id);
+		if (pDst && hasPermission(u, pDst->cChannel, ChanACL::Whisper)) {
+			// Users that are also shouted to keep the SHOUT context
+			addReceiver(*pDst, Mumble::Protocol::AudioContext::WHISPER, VolumeAdjustment::fromFactor(1.0f));
 		}
-#ifdef Q_OS_WIN
-		DWORD dwFlow = 0;
-		if (Meta::hQoS)
-			QOSAddSocketToFlow(Meta::hQoS, u.sUdpSocket, reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-							   QOSTrafficTypeVoice, QOS_NON_ADAPTIVE_FLOW, reinterpret_cast< PQOS_FLOWID >(&dwFlow));
-#endif
-#ifdef Q_OS_LINUX
-		struct msghdr msg;
-		struct iovec iov[1];
-
-		iov[0].iov_base = buffer;
-		iov[0].iov_len  = static_cast< unsigned int >(len + 4);
-
-		uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
-		memset(controldata, 0, sizeof(controldata));
-
-		memset(&msg, 0, sizeof(msg));
-		msg.msg_name    = reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress);
-		msg.msg_namelen = static_cast< socklen_t >(
-			(u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-		msg.msg_iov        = iov;
-		msg.msg_iovlen     = 1;
-		msg.msg_control    = controldata;
-		msg.msg_controllen = CMSG_SPACE((u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct in6_pktinfo)
-																				: sizeof(struct in_pktinfo));
-
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-		HostAddress tcpha(u.saiTcpLocalAddress);
-		if (u.saiUdpAddress.ss_family == AF_INET6) {
-			cmsg->cmsg_level            = IPPROTO_IPV6;
-			cmsg->cmsg_type             = IPV6_PKTINFO;
-			cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
-			struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
-				   sizeof(pktinfo->ipi6_addr.s6_addr));
+	}
+
+	auto table = std::make_shared< WhisperReceiverTable >();
+	for (const WhisperReceiverTable::Receiver &receiver : receivers) {
+		if (receiver.user->ssContext == u->ssContext) {
+			table->positional.push_back(receiver);
 		} else {
-			cmsg->cmsg_level           = IPPROTO_IP;
-			cmsg->cmsg_type            = IP_PKTINFO;
-			cmsg->cmsg_len             = CMSG_LEN(sizeof(struct in_pktinfo));
-			struct in_pktinfo *pktinfo = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
-			memset(pktinfo, 0, sizeof(*pktinfo));
-			if (tcpha.isV6())
-				return;
-			pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
+			table->regular.push_back(receiver);
 		}
-
-
-		::sendmsg(u.sUdpSocket, &msg, 0);
-#else
-#	ifdef Q_OS_WIN
-		using size_type = int;
-#	else
-		using size_type = std::size_t;
-#	endif
-		::sendto(u.sUdpSocket, buffer, static_cast< size_type >(len + 4), 0,
-				 reinterpret_cast< struct sockaddr * >(&u.saiUdpAddress),
-				 (u.saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
-#endif
-#ifdef Q_OS_WIN
-		if (Meta::hQoS && dwFlow)
-			QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
-#else
-#endif
-	} else {
-		if (cache.isEmpty())
-			cache = QByteArray(reinterpret_cast< const char * >(data), len);
-		emit tcpTransmit(cache, u.uiSession);
 	}
-}
 
-void Server::addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel) {
-	const VolumeAdjustment &volumeAdjustment =
-		m_channelListenerManager.getListenerVolumeAdjustment(user.uiSession, channel.iId);
+	auto bySession = [](const WhisperReceiverTable::Receiver &lhs, const WhisperReceiverTable::Receiver &rhs) {
+		return lhs.user->uiSession < rhs.user->uiSession;
+	};
+	std::sort(table->positional.begin(), table->positional.end(), bySession);
+	std::sort(table->regular.begin(), table->regular.end(), bySession);
 
-	auto it = listeners.find(&user);
+	cache.receivers = std::move(table);
 
-	if (it == listeners.end() || it->factor < volumeAdjustment.factor) {
-		listeners[&user] = volumeAdjustment;
-	}
+	return cache;
 }
 
-void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-						Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder) {
+void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, VoiceContext &context) {
 	ZoneScoped;
+	Audit::ZoneScope auditZone(Audit::Zone::ProcessMsg);
+
+	AudioReceiverBuffer &buffer = context.receivers;
 
 	// Note that in this function we never have to acquire a read-lock on qrwlVoiceThread
 	// as all places that call this function will hold that lock at the point of calling
@@ -1157,197 +3085,184 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 		// IP + UDP + Crypt + Data
 		const std::size_t packetsize = 20 + 8 + 4 + audioData.payload.size();
 
-		if (!bw->addFrame(static_cast< int >(packetsize), iMaxBandwidth / 8)) {
+		// The redundant payload isn't counted, as it is only ever a copy of the previous payload. Anything larger
+		// than the payload itself can't be that and is left out.
+		if (audioData.redundantPayload.size() > audioData.payload.size()) {
+			audioData.redundantPayload = {};
+		}
+
+		if (!bw->addFrame(static_cast< int >(packetsize), iMaxBandwidth / 8, context.now)) {
 			// Suppress packet.
+			u->m_bandwidthDrops.fetch_add(1, std::memory_order_relaxed);
+			m_metrics.bandwidthDrops.add();
 			return;
 		}
 	}
 
+	if (m_voiceTrace) {
+		VoiceTrace::Event event;
+		event.type        = VoiceTrace::EventType::Voice;
+		event.session     = u->uiSession;
+		event.target      = audioData.targetOrContext;
+		event.codec       = static_cast< unsigned int >(audioData.usedCodec);
+		event.payloadSize = static_cast< unsigned int >(audioData.payload.size());
+		event.positional  = audioData.containsPositionalData;
+		m_voiceTrace->record(std::move(event));
+	}
+
+	const quint64 routingStart = Metrics::now();
+
+	// Frames shorter than 10 ms are only passed on as they are to the receivers that support them. Everybody else
+	// (and everything that processes the audio any further) gets them combined into regular frames, which means
+	// nothing at all until a combined frame is complete.
+	Mumble::Protocol::AudioData regularData = audioData;
+	bool hasRegularData                     = true;
+	if (audioData.frameSize != 0) {
+		hasRegularData = u->m_frameAggregator.add(audioData, regularData, context.aggregatedPayload);
+	}
+
 	buffer.clear();
 
+	// Voice threads load the state only after having entered m_voiceEpochs (see runVoiceLoop), which keeps it alive
+	// until they are done with the current batch of packets. The main thread is the one replacing states, so it can
+	// use the state right away.
+	const VoiceState *state = m_voiceState.load();
+
 	if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::SERVER_LOOPBACK) {
 		buffer.forceAddReceiver(*u, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
+	} else if (!state) {
+		// Nobody has joined a channel yet
+		return;
 	} else if (audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
-		Channel *c = u->cChannel;
+		const ChannelAudience *audience = state->audienceOf(u->uiSession);
+#ifdef USE_SERVER_MIXING
+		if (audience && !m_stageMixers.empty()) {
+			auto mixer = m_stageMixers.find(*state->channels.find(u->uiSession));
+			if (mixer != m_stageMixers.end()) {
+				if (hasRegularData) {
+					routeStageSpeech(*u, *mixer->second, regularData, context);
+					if (m_recorder) {
+						recordSpeech(*u, *state, regularData, context.now);
+					}
+				}
 
-		// Send audio to all users that are listening to the channel
-		foreach (unsigned int currentSession, m_channelListenerManager.getListenersForChannel(c->iId)) {
-			ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-			if (pDst) {
-				buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								   m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, c->iId));
+				m_metrics.routingNanoseconds.observe(Metrics::now() - routingStart);
+				context.routedPackets++;
+				return;
 			}
 		}
-
-		// Send audio to all users in the same channel
-		for (User *p : c->qlUsers) {
-			ServerUser *pDst = static_cast< ServerUser * >(p);
-
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL, audioData.containsPositionalData);
+#endif
+		if (audience && !m_speakerSelectors.empty()) {
+			auto selector = m_speakerSelectors.find(*state->channels.find(u->uiSession));
+			if (selector != m_speakerSelectors.end()
+				&& !selector->second->admit(u->uiSession, audioData, context.now)) {
+				// Somebody louder is speaking
+				m_metrics.speakerLimitDrops.add();
+				return;
+			}
 		}
+		if (audience) {
+			addRegularSpeechReceivers(*u, *audience, audioData.containsPositionalData, buffer);
 
-		// Send audio to all linked channels the user has speak-permission
-		if (!c->qhLinks.isEmpty()) {
-			QSet< Channel * > chans = c->allLinks();
-			chans.remove(c);
-
-			QMutexLocker qml(&qmCache);
-
-			for (Channel *l : chans) {
-				if (ChanACL::hasPermission(u, l, ChanACL::Speak, &acCache)) {
-					// Send the audio stream to all users that are listening to the linked channel
-					for (unsigned int currentSession : m_channelListenerManager.getListenersForChannel(l->iId)) {
-						ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-						if (pDst) {
-							buffer.addReceiver(
-								*u, *pDst, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-								m_channelListenerManager.getListenerVolumeAdjustment(pDst->uiSession, l->iId));
-						}
-					}
-
-					// Send audio to users in the linked channel
-					for (User *p : l->qlUsers) {
-						ServerUser *pDst = static_cast< ServerUser * >(p);
-
-						buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::NORMAL,
-										   audioData.containsPositionalData);
-					}
-				}
+			if (m_cluster && hasRegularData) {
+				relayRegularSpeech(*u, *state->channels.find(u->uiSession), *audience, regularData, context);
 			}
 		}
-	} else if (u->qmTargets.contains(static_cast< int >(audioData.targetOrContext))) { // Whisper/Shout
-		QSet< ServerUser * > channel;
-		QSet< ServerUser * > direct;
-		QHash< ServerUser *, VolumeAdjustment > cachedListeners;
-
-		if (u->qmTargetCache.contains(static_cast< int >(audioData.targetOrContext))) {
-			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
-
-			const WhisperTargetCache &cache = u->qmTargetCache.value(static_cast< int >(audioData.targetOrContext));
-			channel                         = cache.channelTargets;
-			direct                          = cache.directTargets;
-			cachedListeners                 = cache.listeningTargets;
-		} else {
-			ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_CREATE);
-
-			const WhisperTarget &wt = u->qmTargets.value(static_cast< int >(audioData.targetOrContext));
-			if (!wt.qlChannels.isEmpty()) {
-				QMutexLocker qml(&qmCache);
-
-				foreach (const WhisperTarget::Channel &wtc, wt.qlChannels) {
-					Channel *wc = qhChannels.value(static_cast< unsigned int >(wtc.iId));
-					if (wc) {
-						bool link       = wtc.bLinks && !wc->qhLinks.isEmpty();
-						bool dochildren = wtc.bChildren && !wc->qlChannels.isEmpty();
-						bool group      = !wtc.qsGroup.isEmpty();
-						if (!link && !dochildren && !group) {
-							// Common case
-							if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
-								foreach (User *p, wc->qlUsers) { channel.insert(static_cast< ServerUser * >(p)); }
-
-								foreach (unsigned int currentSession,
-										 m_channelListenerManager.getListenersForChannel(wc->iId)) {
-									ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-
-									if (pDst) {
-										addListener(cachedListeners, *pDst, *wc);
-									}
-								}
-							}
-						} else {
-							QSet< Channel * > channels;
-							if (link)
-								channels = wc->allLinks();
-							else
-								channels.insert(wc);
-							if (dochildren)
-								channels.unite(wc->allChildren());
-							const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
-							const QString &qsg      = redirect.isEmpty() ? wtc.qsGroup : redirect;
-							foreach (Channel *tc, channels) {
-								if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
-									foreach (User *p, tc->qlUsers) {
-										ServerUser *su = static_cast< ServerUser * >(p);
-
-										if (!group || Group::appliesToUser(*tc, *tc, qsg, *su)) {
-											channel.insert(su);
-										}
-									}
-
-									foreach (unsigned int currentSession,
-											 m_channelListenerManager.getListenersForChannel(tc->iId)) {
-										ServerUser *pDst = static_cast< ServerUser * >(qhUsers.value(currentSession));
-
-										if (pDst && (!group || Group::appliesToUser(*tc, *tc, qsg, *pDst))) {
-											// Only send audio to listener if the user exists and it is in the group the
-											// speech is directed at (if any)
-											addListener(cachedListeners, *pDst, *tc);
-										}
-									}
-								}
-							}
-						}
-					}
+	} else { // Whisper/Shout
+		ZoneScopedN(TracyConstants::AUDIO_WHISPER_CACHE_STORE);
+
+		// The tables are maintained by the main thread (see refreshWhisperTargets). Targets are only known to the
+		// voice threads once their table has been published.
+		const WhisperReceiverTable *receivers =
+			state->whisperTarget(u->uiSession, static_cast< int >(audioData.targetOrContext));
+		if (!receivers) {
+			m_metrics.whisperCacheMisses.add();
+			return;
+		}
+		m_metrics.whisperCacheHits.add();
+
+		// The table is free of duplicates and has already been split by positional context, so all that is left to
+		// check is whether the receivers are able to hear the speaker at the moment
+		auto addReceivers = [&](const std::vector< WhisperReceiverTable::Receiver > &group, bool positional) {
+			for (const WhisperReceiverTable::Receiver &receiver : group) {
+				if (receiver.user != u && !receiver.user->bDeaf && !receiver.user->bSelfDeaf) {
+					buffer.forceAddReceiver(*receiver.user, receiver.context, positional, receiver.volumeAdjustment);
 				}
 			}
+		};
+		addReceivers(receivers->positional, audioData.containsPositionalData);
+		addReceivers(receivers->regular, false);
+	}
 
-			{
-				QMutexLocker qml(&qmCache);
-
-				foreach (unsigned int id, wt.qlSessions) {
-					ServerUser *pDst = qhUsers.value(id);
-					if (pDst && ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache)
-						&& !channel.contains(pDst))
-						direct.insert(pDst);
+	AudioReceiverBuffer &regularBuffer = audioData.frameSize != 0 ? context.regularReceivers : buffer;
+	if (audioData.frameSize != 0) {
+		// Nothing is added to the buffer anymore before it is sent, so the receivers can simply be taken out of it
+		regularBuffer.clear();
+		for (bool positional : { false, true }) {
+			std::vector< AudioReceiver > &receivers = buffer.getReceivers(positional);
+			auto end = std::remove_if(receivers.begin(), receivers.end(), [&](AudioReceiver &receiver) {
+				ServerUser &user = receiver.getReceiver();
+				if (user.bSmallAudioFrames
+					&& Mumble::Protocol::getPacketFormat(user.m_version) == Mumble::Protocol::PacketFormat::Protobuf) {
+					return false;
 				}
-			}
-
-			unsigned int uiSession = u->uiSession;
-			qrwlVoiceThread.unlock();
-			qrwlVoiceThread.lockForWrite();
 
-			if (qhUsers.contains(uiSession))
-				u->qmTargetCache.insert(static_cast< int >(audioData.targetOrContext),
-										{ channel, direct, cachedListeners });
-			qrwlVoiceThread.unlock();
-			qrwlVoiceThread.lockForRead();
-			if (!qhUsers.contains(uiSession))
-				return;
-		}
-		// These users receive the audio because someone is shouting to their channel
-		for (ServerUser *pDst : channel) {
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::SHOUT, audioData.containsPositionalData);
+				regularBuffer.forceAddReceiver(user, receiver.getContext(), positional, receiver.getVolumeAdjustment());
+				return true;
+			});
+			receivers.erase(end, receivers.end());
 		}
-		// These users receive audio because someone is whispering to them
-		for (ServerUser *pDst : direct) {
-			buffer.addReceiver(*u, *pDst, Mumble::Protocol::AudioContext::WHISPER, audioData.containsPositionalData);
-		}
-		// These users receive audio because someone is sending audio to one of their listeners
-		QHashIterator< ServerUser *, VolumeAdjustment > it(cachedListeners);
-		while (it.hasNext()) {
-			it.next();
-			ServerUser *user                         = it.key();
-			const VolumeAdjustment &volumeAdjustment = it.value();
 
-			buffer.addReceiver(*u, *user, Mumble::Protocol::AudioContext::LISTEN, audioData.containsPositionalData,
-							   volumeAdjustment);
+		sendAudio(audioData, buffer, context);
+	}
+
+	if (hasRegularData) {
+#ifdef USE_SERVER_TRANSCODING
+		if (m_transcoder) {
+			divertToTranscoder(*u, regularData, regularBuffer);
 		}
+#endif
+
+		sendAudio(regularData, regularBuffer, context);
+	}
+
+	if (m_recorder && state && hasRegularData
+		&& audioData.targetOrContext == Mumble::Protocol::ReservedTargetIDs::REGULAR_SPEECH) {
+		// Only what has actually been forwarded (e.g. not what the speaker limits have dropped) is recorded
+		recordSpeech(*u, *state, regularData, context.now);
 	}
 
-	ZoneNamedN(__tracy_scoped_zone2, TracyConstants::AUDIO_SENDOUT_ZONE, true);
+	m_metrics.routingNanoseconds.observe(Metrics::now() - routingStart);
+	context.routedPackets++;
+}
+
+void Server::sendAudio(Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer, VoiceContext &context) {
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder = context.audioEncoder;
+
+	ZoneScopedN(TracyConstants::AUDIO_SENDOUT_ZONE);
 
 	buffer.preprocessBuffer();
+	m_metrics.receiversPerFrame.observe(buffer.getReceivers(true).size() + buffer.getReceivers(false).size());
+
+	// The packet is encoded for either packet format at most once, as receivers of both formats come up
+	{
+		ZoneScopedN(TracyConstants::AUDIO_ENCODE);
+
+		encoder.prepareAudioPacket(audioData);
+		encoder.addPositionalData(audioData);
+	}
 
-	bool isFirstIteration = true;
 	QByteArray tcpCache;
+	std::array< ServerUser *, UDPSendQueue::CAPACITY > udpBatch;
+	const bool containsPositionalData = audioData.containsPositionalData;
+	// Only receivers on lossy links get the redundant payload (see VoiceRedundancy)
+	const gsl::span< const Mumble::Protocol::byte > redundantPayload = audioData.redundantPayload;
+	audioData.redundantPayload                                       = {};
 	for (bool includePositionalData : { true, false }) {
 		std::vector< AudioReceiver > &receiverList = buffer.getReceivers(includePositionalData);
 
-		audioData.containsPositionalData = includePositionalData && audioData.containsPositionalData;
-
-		if (!audioData.containsPositionalData) {
-			encoder.dropPositionalData();
-		}
+		// The encoder keeps the packet with and without the positional data, so there is nothing to re-encode
+		audioData.containsPositionalData = includePositionalData && containsPositionalData;
 
 		// Note: The receiver-ranges are determined in such a way, that they are all going to receive the exact
 		// same audio packet.
@@ -1355,39 +3270,65 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 			AudioReceiverBuffer::getReceiverRange(receiverList.begin(), receiverList.end());
 
 		while (currentRange.begin != currentRange.end) {
-			// Setup encoder for this range
-			if (isFirstIteration
-				|| !Mumble::Protocol::protocolVersionsAreCompatible(encoder.getProtocolVersion(),
-																	currentRange.begin->getReceiver().m_version)) {
-				ZoneScopedN(TracyConstants::AUDIO_ENCODE);
-
-				encoder.setProtocolVersion(currentRange.begin->getReceiver().m_version);
-
-				// We have to re-encode the "fixed" part of the audio message
-				encoder.prepareAudioPacket(audioData);
-
-				if (audioData.containsPositionalData) {
-					encoder.addPositionalData(audioData);
-				}
-
-				isFirstIteration = false;
-			}
-
 			audioData.targetOrContext  = currentRange.begin->getContext();
 			audioData.volumeAdjustment = currentRange.begin->getVolumeAdjustment();
 
-			// Update data
+			// Update data. All receivers of the range use the same packet format.
 			TracyCZoneN(__tracy_zone, TracyConstants::AUDIO_UPDATE, true);
-			gsl::span< const Mumble::Protocol::byte > encodedPacket = encoder.updateAudioPacket(audioData);
+			gsl::span< const Mumble::Protocol::byte > encodedPacket;
+			const Mumble::Protocol::PacketFormat format =
+				Mumble::Protocol::getPacketFormat(currentRange.begin->getReceiver().m_version);
+			if (format == Mumble::Protocol::PacketFormat::Legacy) {
+				encodedPacket = encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Legacy >(audioData);
+			} else {
+				encodedPacket = encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Protobuf >(audioData);
+			}
 			TracyCZoneEnd(__tracy_zone);
 
+			context.redundantReceivers.clear();
+
 			// Clear TCP cache
 			tcpCache.clear();
 
-			// Send encoded packet to all receivers of this range
+			// Send encoded packet to all receivers of this range. The ones that are reached via UDP are collected
+			// so that the packet can be encrypted for several of them at once.
+			const int packetSize  = static_cast< int >(encodedPacket.size());
+			std::size_t batchSize = 0;
 			for (auto it = currentRange.begin; it != currentRange.end; ++it) {
-				sendMessage(it->getReceiver(), encodedPacket.data(), static_cast< int >(encodedPacket.size()),
-							tcpCache);
+				ServerUser &receiver = it->getReceiver();
+				const bool viaUDP    = usesUDP(receiver, false) && receiver.udpDestination.valid;
+
+				if (!redundantPayload.empty()
+					&& VoiceRedundancy::includesPayload(format, viaUDP, receiver.m_redundantVoice)) {
+					context.redundantReceivers.push_back(&receiver);
+					continue;
+				}
+
+				if (!viaUDP) {
+					sendMessage(receiver, encodedPacket.data(), packetSize, tcpCache, context);
+					continue;
+				}
+
+				udpBatch[batchSize++] = &receiver;
+				if (batchSize == udpBatch.size()) {
+					sendUDPBatch(udpBatch.data(), batchSize, encodedPacket.data(), packetSize, context);
+					batchSize = 0;
+				}
+			}
+			sendUDPBatch(udpBatch.data(), batchSize, encodedPacket.data(), packetSize, context);
+
+			if (!context.redundantReceivers.empty()) {
+				audioData.redundantPayload = redundantPayload;
+				encodedPacket = encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Protobuf >(audioData);
+				audioData.redundantPayload = {};
+
+				const int redundantSize = static_cast< int >(encodedPacket.size());
+				for (std::size_t i = 0; i < context.redundantReceivers.size(); i += udpBatch.size()) {
+					batchSize = std::min(udpBatch.size(), context.redundantReceivers.size() - i);
+					std::copy_n(context.redundantReceivers.begin() + static_cast< std::ptrdiff_t >(i), batchSize,
+								udpBatch.begin());
+					sendUDPBatch(udpBatch.data(), batchSize, encodedPacket.data(), redundantSize, context);
+				}
 			}
 
 			// Find next range
@@ -1396,6 +3337,73 @@ void Server::processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, Au
 	}
 }
 
+void Server::relayRegularSpeech(ServerUser &u, unsigned int channel, const ChannelAudience &audience,
+								const Mumble::Protocol::AudioData &audioData, VoiceContext &context) {
+	ClusterProtocol::Voice voice;
+	voice.session     = u.uiSession;
+	voice.codec       = audioData.usedCodec;
+	voice.frameNumber = audioData.frameNumber;
+	voice.isLastFrame = audioData.isLastFrame;
+	voice.payload     = audioData.payload;
+
+	// The other nodes have the same channels and ACLs, but they can't tell which linked channels the speaker may
+	// speak in, so they are given all channels the audio is meant for
+	voice.channels[voice.channelCount++] = channel;
+	for (const ChannelAudience::Link &link : audience.links) {
+		if (voice.channelCount == voice.channels.size()) {
+			break;
+		}
+		if (hasPermission(&u, link.channel, ChanACL::Speak)) {
+			voice.channels[voice.channelCount++] = link.channel->iId;
+		}
+	}
+
+	m_cluster->relay(voice, context.relayBatches);
+}
+
+void Server::processRemoteVoice(const ClusterProtocol::Voice &voice) {
+	ZoneScoped;
+
+	QReadLocker rl(&qrwlVoiceThread);
+
+	// This runs on the main thread, which is the one replacing states, so the state can be used right away
+	const VoiceState *state = m_voiceState.load();
+	if (!state) {
+		return;
+	}
+
+	VoiceContext &context = m_tcpVoiceContext;
+	context.now           = BandwidthRecord::clock();
+	context.receivers.clear();
+
+	// Positional audio isn't relayed, as the speaker's context isn't known here
+	for (std::size_t i = 0; i < voice.channelCount; ++i) {
+		const ChannelAudience *audience = state->audienceOfChannel(voice.channels[i]);
+		if (!audience) {
+			continue;
+		}
+
+		for (const ChannelAudience::Receiver &receiver : audience->receivers) {
+			if (!receiver.user->bDeaf && !receiver.user->bSelfDeaf) {
+				context.receivers.forceAddReceiver(*receiver.user, receiver.context, false,
+												   receiver.volumeAdjustment);
+			}
+		}
+	}
+
+	Mumble::Protocol::AudioData audioData;
+	audioData.usedCodec     = voice.codec;
+	audioData.senderSession = voice.session;
+	audioData.frameNumber   = voice.frameNumber;
+	audioData.isLastFrame   = voice.isLastFrame;
+	audioData.payload       = voice.payload;
+
+	sendAudio(audioData, context.receivers, context);
+	context.routedPackets++;
+
+	flushVoiceContext(context);
+}
+
 void Server::log(ServerUser *u, const QString &str) const {
 	QString msg = QString("<%1:%2(%3)> %4").arg(QString::number(u->uiSession), u->qsName, QString::number(u->iId), str);
 	log(msg);
@@ -1406,6 +3414,28 @@ void Server::log(const QString &msg) const {
 	qWarning("%d => %s", iServerNum, msg.toUtf8().constData());
 }
 
+/// @param[out] verified Set to false if the error means that the client's certificate can't be verified
+/// @returns Whether a connection may be established despite the given error
+static bool isTolerableSslError(const QSslError &error, bool &verified) {
+	switch (error.error()) {
+		case QSslError::InvalidPurpose:
+			// Allow email certificates.
+			return true;
+		case QSslError::NoPeerCertificate:
+		case QSslError::SelfSignedCertificate:
+		case QSslError::SelfSignedCertificateInChain:
+		case QSslError::UnableToGetLocalIssuerCertificate:
+		case QSslError::UnableToVerifyFirstCertificate:
+		case QSslError::HostNameMismatch:
+		case QSslError::CertificateNotYetValid:
+		case QSslError::CertificateExpired:
+			verified = false;
+			return true;
+		default:
+			return false;
+	}
+}
+
 void Server::newClient() {
 	SslServer *ss = qobject_cast< SslServer * >(sender());
 	if (!ss)
@@ -1415,39 +3445,30 @@ void Server::newClient() {
 		if (!sock)
 			return;
 
-		QHostAddress adr = sock->peerAddress();
+		HostAddress ha(sock->peerAddress());
+
+		if (m_banIndex.mayHaveExpired()) {
+			QList< Ban > tmpBans = qlBans;
+			foreach (const Ban &ban, qlBans) {
+				if (ban.isExpired())
+					tmpBans.removeOne(ban);
+			}
+			if (qlBans.count() != tmpBans.count()) {
+				qlBans = tmpBans;
+				saveBans();
+			}
+			m_banIndex.rebuild(qlBans);
+		}
 
-		if (meta->banCheck(adr)) {
-			log(QString("Ignoring connection: %1 (Global ban)")
-					.arg(addressToString(sock->peerAddress(), sock->peerPort())));
+		if (const Ban *ban = m_banIndex.matchAddress(ha)) {
+			log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
+					.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban->qsReason, ban->qsUsername,
+						 ban->qsHash));
 			sock->disconnectFromHost();
 			sock->deleteLater();
 			return;
 		}
 
-		HostAddress ha(adr);
-
-		QList< Ban > tmpBans = qlBans;
-		foreach (const Ban &ban, qlBans) {
-			if (ban.isExpired())
-				tmpBans.removeOne(ban);
-		}
-		if (qlBans.count() != tmpBans.count()) {
-			qlBans = tmpBans;
-			saveBans();
-		}
-
-		foreach (const Ban &ban, qlBans) {
-			if (ban.haAddress.match(ha, static_cast< unsigned int >(ban.iMask))) {
-				log(QString("Ignoring connection: %1, Reason: %2, Username: %3, Hash: %4 (Server ban)")
-						.arg(addressToString(sock->peerAddress(), sock->peerPort()), ban.qsReason, ban.qsUsername,
-							 ban.qsHash));
-				sock->disconnectFromHost();
-				sock->deleteLater();
-				return;
-			}
-		}
-
 #ifdef Q_OS_MAC
 		// One unexpected behavior of Qt's SSL backend is: it will add the key pair
 		// it uses in a connection into the default keychain, and when access the private
@@ -1459,54 +3480,7 @@ void Server::newClient() {
 		// See #4298 and https://codereview.qt-project.org/c/qt/qtbase/+/184243
 		EnvUtils::setenv("QT_SSL_USE_TEMPORARY_KEYCHAIN", "1");
 #endif
-		sock->setPrivateKey(qskKey);
-		sock->setLocalCertificate(qscCert);
-
-		QSslConfiguration config;
-#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
-		config = sock->sslConfiguration();
-		// Qt 5.15 introduced QSslConfiguration::addCaCertificate(s) that should be preferred over the functions in
-		// QSslSocket
-
-		// Treat the leaf certificate as a root.
-		// This shouldn't strictly be necessary,
-		// and is a left-over from early on.
-		// Perhaps it is necessary for self-signed
-		// certs?
-		config.addCaCertificate(qscCert);
-
-		// Add CA certificates specified via
-		// murmur.ini's sslCA option.
-		config.addCaCertificates(Meta::mp.qlCA);
-
-		// Add intermediate CAs found in the PEM
-		// bundle used for this server's certificate.
-		config.addCaCertificates(qlIntermediates);
-#else
-		// Treat the leaf certificate as a root.
-		// This shouldn't strictly be necessary,
-		// and is a left-over from early on.
-		// Perhaps it is necessary for self-signed
-		// certs?
-		sock->addCaCertificate(qscCert);
-
-		// Add CA certificates specified via
-		// murmur.ini's sslCA option.
-		sock->addCaCertificates(Meta::mp.qlCA);
-
-		// Add intermediate CAs found in the PEM
-		// bundle used for this server's certificate.
-		sock->addCaCertificates(qlIntermediates);
-
-		// Must not get config from socket before setting CA certificates
-		config = sock->sslConfiguration();
-#endif
-
-		config.setCiphers(Meta::mp.qlCiphers);
-#if defined(USE_QSSLDIFFIEHELLMANPARAMETERS)
-		config.setDiffieHellmanParameters(qsdhpDHParams);
-#endif
-		sock->setSslConfiguration(config);
+		sock->setSslConfiguration(m_sslConfiguration);
 
 		if (qqIds.isEmpty()) {
 			log(QString("Session ID pool (%1) empty, rejecting connection").arg(iMaxUsers));
@@ -1517,7 +3491,7 @@ void Server::newClient() {
 
 		ServerUser *u = new ServerUser(this, sock);
 		u->haAddress  = ha;
-		HostAddress(sock->localAddress()).toSockaddr(&u->saiTcpLocalAddress);
+		u->haTcpLocalAddress = HostAddress(sock->localAddress());
 
 		connect(u, &ServerUser::connectionClosed, this, &Server::connectionClosed);
 		connect(u, SIGNAL(message(Mumble::Protocol::TCPMessageType, const QByteArray &)), this,
@@ -1538,9 +3512,29 @@ void Server::newClient() {
 #else
 		sock->setProtocol(QSsl::TlsV1_0);
 #endif
-		sock->startServerEncryption();
 
-		meta->successfulConnectionFrom(adr);
+		Connection::SendLimits sendLimits;
+		sendLimits.voiceBytes   = Meta::mp.sendQueueVoiceBytes;
+		sendLimits.controlBytes = Meta::mp.sendQueueControlBytes;
+		sendLimits.bulkBytes    = Meta::mp.sendQueueBulkBytes;
+		u->setSendLimits(sendLimits);
+
+		QThread *ioThread = meta->nextTLSThread();
+		if (ioThread) {
+			// The same decision sslError() makes, but it has to be made by the I/O thread
+			u->moveToIOThread(ioThread, [](const QList< QSslError > &errors) {
+				bool verified = true;
+				for (const QSslError &e : errors) {
+					if (!isTolerableSslError(e, verified))
+						return false;
+				}
+				return true;
+			});
+		}
+
+		u->startServerEncryption();
+
+		meta->successfulConnectionFrom(ha);
 	}
 }
 
@@ -1560,9 +3554,12 @@ void Server::encrypted() {
 	if (!certs.isEmpty()) {
 		// Get the client's immediate SSL certificate
 		const QSslCertificate &cert = certs.first();
-		uSource->qslEmail           = cert.subjectAlternativeNames().values(QSsl::EmailEntry);
+		const QStringList emails    = cert.subjectAlternativeNames().values(QSsl::EmailEntry);
 		uSource->qsHash             = QString::fromLatin1(cert.digest(QCryptographicHash::Sha1).toHex());
-		if (!uSource->qslEmail.isEmpty() && uSource->bVerified) {
+		if (!emails.isEmpty()) {
+			uSource->editClientDetails().qslEmail = emails;
+		}
+		if (!emails.isEmpty() && uSource->bVerified) {
 			QString subject;
 			QString issuer;
 
@@ -1578,16 +3575,14 @@ void Server::encrypted() {
 
 			log(uSource, QString::fromUtf8("Strong certificate for %1 <%2> (signed by %3)")
 							 .arg(subject)
-							 .arg(uSource->qslEmail.join(", "))
+							 .arg(emails.join(", "))
 							 .arg(issuer));
 		}
 
-		foreach (const Ban &ban, qlBans) {
-			if (ban.qsHash == uSource->qsHash) {
-				log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
-								 .arg(ban.qsHash, ban.qsUsername, ban.qsReason));
-				uSource->disconnectSocket();
-			}
+		if (const Ban *ban = m_banIndex.matchHash(uSource->qsHash)) {
+			log(uSource, QString("Certificate hash is banned: %1, Username: %2, Reason: %3.")
+							 .arg(ban->qsHash, ban->qsUsername, ban->qsReason));
+			uSource->disconnectSocket();
 		}
 	}
 }
@@ -1599,23 +3594,9 @@ void Server::sslError(const QList< QSslError > &errors) {
 
 	bool ok = true;
 	foreach (QSslError e, errors) {
-		switch (e.error()) {
-			case QSslError::InvalidPurpose:
-				// Allow email certificates.
-				break;
-			case QSslError::NoPeerCertificate:
-			case QSslError::SelfSignedCertificate:
-			case QSslError::SelfSignedCertificateInChain:
-			case QSslError::UnableToGetLocalIssuerCertificate:
-			case QSslError::UnableToVerifyFirstCertificate:
-			case QSslError::HostNameMismatch:
-			case QSslError::CertificateNotYetValid:
-			case QSslError::CertificateExpired:
-				u->bVerified = false;
-				break;
-			default:
-				log(u, QString("SSL Error: %1").arg(e.errorString()));
-				ok = false;
+		if (!isTolerableSslError(e, u->bVerified)) {
+			log(u, QString("SSL Error: %1").arg(e.errorString()));
+			ok = false;
 		}
 	}
 
@@ -1684,13 +3665,29 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 
 	log(u, QString("Connection closed: %1 [%2]").arg(reason).arg(err));
 
+	const Connection::SendStatistics &sendStatistics = u->sendStatistics();
+	if (sendStatistics.droppedVoiceMessages > 0 || sendStatistics.droppedBulkMessages > 0) {
+		log(u, QString("Dropped %1 voice packets (%2 bytes) and %3 blobs (%4 bytes) the client didn't receive in time; "
+					   "at most %5 bytes were queued")
+				   .arg(sendStatistics.droppedVoiceMessages)
+				   .arg(sendStatistics.droppedVoiceBytes)
+				   .arg(sendStatistics.droppedBulkMessages)
+				   .arg(sendStatistics.droppedBulkBytes)
+				   .arg(sendStatistics.peakQueuedBytes));
+	}
+
 	setLastDisconnect(u);
 
+	// All whisper targets that might contain the user
+	QSet< unsigned int > whisperChannels;
+
 	if (u->sState == ServerUser::Authenticated) {
 		if (m_channelListenerManager.isListeningToAny(u->uiSession)) {
 			for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(u->uiSession)) {
 				// Remove the client from the list on the server
 				m_channelListenerManager.removeListener(u->uiSession, channelID);
+				invalidateAudience(channelID);
+				whisperChannels.insert(channelID);
 			}
 		}
 
@@ -1702,40 +3699,67 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 			m_botCount--;
 		}
 
+		saveWhisperTargets(*u);
+
+		if (m_voiceTrace) {
+			VoiceTrace::Event event;
+			event.type    = VoiceTrace::EventType::UserLeft;
+			event.session = u->uiSession;
+			m_voiceTrace->record(std::move(event));
+		}
+
 		emit userDisconnected(u);
 	}
 
 	Channel *old = u->cChannel;
 
 	{
+		// The voice threads look users up by session and by address
 		QWriteLocker wl(&qrwlVoiceThread);
 
 		qhUsers.remove(u->uiSession);
 		qhHostUsers[u->haAddress].remove(u);
+		m_timeouts.remove(u->uiSession);
+		updatePingReply();
+
+		quint16 port = (u->udpDestination.address.ss_family == AF_INET6)
+						   ? (reinterpret_cast< sockaddr_in6 * >(&u->udpDestination.address)->sin6_port)
+						   : (reinterpret_cast< sockaddr_in * >(&u->udpDestination.address)->sin_port);
+		m_peerUsers.remove(PeerKey(u->haAddress, port));
+		m_peerUsers.reclaim();
+	}
 
-		quint16 port = (u->saiUdpAddress.ss_family == AF_INET6)
-						   ? (reinterpret_cast< sockaddr_in6 * >(&u->saiUdpAddress)->sin6_port)
-						   : (reinterpret_cast< sockaddr_in * >(&u->saiUdpAddress)->sin_port);
-		const QPair< HostAddress, quint16 > &key = QPair< HostAddress, quint16 >(u->haAddress, port);
-		qhPeerUsers.remove(key);
-
-		if (old)
-			old->removeUser(u);
+	// The voice threads only ever see the channel's users through its audience
+	invalidateMembership(u->uiSession);
+	if (old) {
+		old->removeUser(u);
+		invalidateAudience(old->iId);
+		whisperChannels.insert(old->iId);
 	}
 
+	invalidateWhisperTargets(whisperChannels, { u->uiSession });
+
 	if (old && old->bTemporary && old->qlUsers.isEmpty())
 		QCoreApplication::instance()->postEvent(this,
 												new ExecEvent(boost::bind(&Server::removeChannel, this, old->iId)));
 
-	if (u->uiSession > 0 && u->uiSession < iMaxUsers * 2)
+	if (isPooledSession(u->uiSession))
 		qqIds.enqueue(u->uiSession); // Reinsert session id into pool
 
 	if (u->sState == ServerUser::Authenticated) {
-		clearTempGroups(u);     // Also clears ACL cache
+		clearTempGroups(u); // Also clears ACL cache
+	}
+
+	if (m_codecVotes.remove(u->uiSession)) {
 		recheckCodecVersions(); // Maybe can choose a better codec now
 	}
 
-	u->deleteLater();
+	// The published VoiceState might still refer to the user
+	retireWithVoiceState([this, u]() {
+		// A user that is created at the same address must not inherit the cached permissions
+		acCache.invalidateUser(u);
+		u->deleteLater();
+	});
 
 	if (qhUsers.isEmpty())
 		stopThread();
@@ -1772,8 +3796,8 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 				Mumble::Protocol::AudioData audioData = m_tcpTunnelDecoder.getAudioData();
 				// Allow all voice packets through by default.
 				bool ok = true;
-				// ...Unless we're in Opus mode. In Opus mode, only Opus packets are allowed.
-				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+				// ...Unless we're in Opus mode (and not transcoding). In Opus mode, only Opus packets are allowed.
+				if (bOpus && audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus && !isTranscoding()) {
 					ok = false;
 				}
 
@@ -1781,7 +3805,9 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 					// Add session id
 					audioData.senderSession = u->uiSession;
 
-					processMsg(u, std::move(audioData), m_tcpAudioReceivers, m_tcpAudioEncoder);
+					m_tcpVoiceContext.now = BandwidthRecord::clock();
+					processMsg(u, std::move(audioData), m_tcpVoiceContext);
+					flushVoiceContext(m_tcpVoiceContext);
 				}
 			}
 		}
@@ -1789,29 +3815,33 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 		return;
 	}
 
+	// The message and everything it contains is parsed into the arena, which is reset once the (outermost) message has
+	// been handled
+	MessageArena::Scope arenaScope(m_messageArena);
+
 #ifdef QT_NO_DEBUG
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                  \
+		case Mumble::Protocol::TCPMessageType::name: {                              \
+			MumbleProto::name &msg = *m_messageArena.create< MumbleProto::name >(); \
+			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) {            \
+				msg.DiscardUnknownFields();                                         \
+				msg##name(u, msg);                                                  \
+			}                                                                       \
+			break;                                                                  \
 		}
 #else
-#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                      \
-		case Mumble::Protocol::TCPMessageType::name: {                   \
-			MumbleProto::name msg;                                       \
-			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) { \
-				if (type != Mumble::Protocol::TCPMessageType::Ping) {    \
-					printf("== %s:\n", #name);                           \
-					msg.PrintDebugString();                              \
-				}                                                        \
-				msg.DiscardUnknownFields();                              \
-				msg##name(u, msg);                                       \
-			}                                                            \
-			break;                                                       \
+#	define PROCESS_MUMBLE_TCP_MESSAGE(name, value)                                  \
+		case Mumble::Protocol::TCPMessageType::name: {                              \
+			MumbleProto::name &msg = *m_messageArena.create< MumbleProto::name >(); \
+			if (msg.ParseFromArray(qbaMsg.constData(), qbaMsg.size())) {            \
+				if (type != Mumble::Protocol::TCPMessageType::Ping) {               \
+					printf("== %s:\n", #name);                                      \
+					msg.PrintDebugString();                                         \
+				}                                                                   \
+				msg.DiscardUnknownFields();                                         \
+				msg##name(u, msg);                                                  \
+			}                                                                       \
+			break;                                                                  \
 		}
 #endif
 
@@ -1821,35 +3851,77 @@ void Server::message(Mumble::Protocol::TCPMessageType type, const QByteArray &qb
 }
 
 void Server::checkTimeout() {
+	// Only the users whose deadline has passed are looked at. Their deadlines aren't moved while they are active (see
+	// Connection::resetActivityTime()), so they may have been active since and are rescheduled in that case.
 	QList< ServerUser * > qlClose;
 
-	qrwlVoiceThread.lockForRead();
-	foreach (ServerUser *u, qhUsers) {
+	for (unsigned int session : m_timeouts.advance(static_cast< quint64 >(m_timeoutClock.elapsed() / TIMEOUT_TICK))) {
+		ServerUser *u = qhUsers.value(session);
+		if (!u) {
+			continue;
+		}
+
 		if (u->activityTime() > (iTimeout * 1000)) {
 			log(u, "Timeout");
 			qlClose.append(u);
+		} else {
+			scheduleTimeout(u);
 		}
 	}
-	qrwlVoiceThread.unlock();
+
 	foreach (ServerUser *u, qlClose)
 		u->disconnectSocket(true);
 }
 
-void Server::tcpTransmitData(QByteArray a, unsigned int id) {
-	Connection *c = qhUsers.value(id);
-	if (c) {
-		QByteArray qba;
-		int len = a.size();
+void Server::scheduleTimeout(const ServerUser *u) {
+	const qint64 deadline = std::max(qint64(0), m_timeoutClock.elapsed() + iTimeout * 1000 - u->activityTime());
+
+	// Rounding up makes sure the user has really timed out once the deadline has passed
+	m_timeouts.schedule(u->uiSession, static_cast< quint64 >((deadline + TIMEOUT_TICK - 1) / TIMEOUT_TICK));
+}
+
+void Server::drainTCPTunnelQueues() {
+	ZoneScoped;
+
+	// Every connection is only flushed once, after all of its packets have been written
+	QSet< unsigned int > written;
+
+	auto drain = [this, &written](VoiceContext &context) {
+		// Reset the flag before looking at the queue so that packets that are added afterwards will cause
+		// another notification. The exchange synchronizes with the one in flushVoiceContext.
+		context.tcpTunnelNotified.exchange(false);
+
+		while (VoiceContext::TunneledPacket *packet = context.tcpTunnelQueue.front()) {
+			Connection *c = qhUsers.value(packet->session);
+			if (c) {
+				c->sendMessage(packet->message);
+				written.insert(packet->session);
+			}
+			context.tcpTunnelQueue.pop();
+		}
+	};
 
-		qba.resize(len + 6);
-		unsigned char *uc = reinterpret_cast< unsigned char * >(qba.data());
-		*reinterpret_cast< quint16 * >(&uc[0]) =
-			qToBigEndian(static_cast< quint16 >(Mumble::Protocol::TCPMessageType::UDPTunnel));
-		*reinterpret_cast< quint32 * >(&uc[2]) = qToBigEndian(static_cast< quint32 >(len));
-		memcpy(uc + 6, a.constData(), static_cast< std::size_t >(len));
+	drain(m_tcpVoiceContext);
+	for (std::unique_ptr< VoiceContext > &context : m_voiceContexts) {
+		drain(*context);
+	}
+#ifdef USE_SERVER_MIXING
+	for (std::unique_ptr< VoiceContext > &context : m_mixingContexts) {
+		drain(*context);
+	}
+#endif
+#ifdef USE_SERVER_TRANSCODING
+	for (std::unique_ptr< VoiceContext > &context : m_transcodingContexts) {
+		drain(*context);
+	}
+#endif
 
-		c->sendMessage(qba);
-		c->forceFlush();
+	for (unsigned int session : written) {
+		// Flushing may close connections, so look every user up again
+		Connection *c = qhUsers.value(session);
+		if (c) {
+			c->forceFlush();
+		}
 	}
 }
 
@@ -1868,6 +3940,12 @@ void Server::sendProtoMessage(ServerUser *u, const ::google::protobuf::Message &
 	u->sendMessage(msg, msgType, cache);
 }
 
+void Server::sendBlob(ServerUser *u, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType) {
+	QByteArray cache;
+	Connection::messageToNetwork(msg, msgType, cache);
+	u->sendMessage(cache, Connection::SendLane::Bulk);
+}
+
 void Server::sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType msgType,
 						  Version::full_t version, Version::CompareMode mode) {
 	sendProtoExcept(nullptr, msg, msgType, version, mode);
@@ -1876,6 +3954,11 @@ void Server::sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protoc
 void Server::sendProtoExcept(ServerUser *u, const ::google::protobuf::Message &msg,
 							 Mumble::Protocol::TCPMessageType msgType, Version::full_t version,
 							 Version::CompareMode mode) {
+	// Whatever is broadcast changes the state new clients have to be told about
+	m_stateSnapshots.invalidate(msg, msgType);
+
+	// The message is serialized for the first receiver only. All others queue a reference to the same buffer, which
+	// is written along with whatever else they are sent until control returns to the event loop.
 	QByteArray cache;
 	foreach (ServerUser *usr, qhUsers)
 		if ((usr != u) && (usr->sState == ServerUser::Authenticated)) {
@@ -1903,18 +3986,18 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	if (!dest)
 		dest = chan->cParent;
 
-	{
-		QWriteLocker wl(&qrwlVoiceThread);
-		chan->unlink(nullptr);
-	}
+	// The voice threads only know about the channel's links and users through the audiences in the published
+	// VoiceState, so none of the following requires the write lock on qrwlVoiceThread
+	invalidateWhisperTargetsOfLinks(chan);
+	invalidateAudience(chan->iId);
+	chan->unlink(nullptr);
 
 	foreach (c, chan->qlChannels) { removeChannel(c, dest); }
 
+	QList< QPair< User *, Channel * > > moves;
 	foreach (p, chan->qlUsers) {
-		{
-			QWriteLocker wl(&qrwlVoiceThread);
-			chan->removeUser(p);
-		}
+		chan->removeUser(p);
+		invalidateAudience(chan->iId);
 
 		Channel *target = dest;
 		while (target->cParent
@@ -1922,13 +4005,9 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 				   || isChannelFull(target, static_cast< ServerUser * >(p))))
 			target = target->cParent;
 
-		MumbleProto::UserState mpus;
-		mpus.set_session(p->uiSession);
-		mpus.set_channel_id(target->iId);
-		userEnterChannel(p, target, mpus);
-		sendAll(mpus);
-		emit userStateChanged(p);
+		moves.append(qMakePair(p, target));
 	}
+	moveUsers(moves);
 
 	foreach (unsigned int userSession, m_channelListenerManager.getListenersForChannel(chan->iId)) {
 		const ServerUser *user = qhUsers.value(userSession);
@@ -1951,20 +4030,46 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 	sendAll(mpcr);
 
 	removeChannelDB(chan);
+	if (m_messageHistory) {
+		m_messageHistory->clear(chan->iId, QDateTime::currentMSecsSinceEpoch());
+	}
 	emit channelRemoved(chan);
 
+	// This includes all targets that contain the channel as a child of one of its parents
+	invalidateWhisperTargetsOfBranch(chan);
+
 	if (chan->cParent) {
-		QWriteLocker wl(&qrwlVoiceThread);
-		chan->cParent->removeChannel(chan);
+		{
+			// The voice threads walk up the channel tree when evaluating permissions (which they do while holding
+			// qmCache)
+			QMutexLocker qml(&qmCache);
+			chan->cParent->removeChannel(chan);
+		}
+		// The channel's own audience is dropped when the next VoiceState is built
+		invalidateAudience(chan->iId);
 	}
 
-	delete chan;
+	// The audiences in the published VoiceState might still link to the channel. Until they are gone, the voice
+	// threads might also keep caching permissions for it.
+	retireWithVoiceState([this, chan]() {
+		// A channel that is created at the same address must not inherit the cached permissions (or the program)
+		acCache.invalidateChannel(chan);
+		{
+			QMutexLocker qml(&qmCache);
+			m_aclPrograms.remove(*chan);
+		}
+		delete chan;
+	});
 }
 
 bool Server::unregisterUser(int id) {
 	if (!unregisterUserDB(id))
 		return false;
 
+	m_savedWhisperTargets.remove(id);
+	// The database drops the user's listeners along with the user
+	m_storedListeners.remove(id);
+
 	{
 		QMutexLocker lock(&qmCache);
 
@@ -1983,8 +4088,11 @@ bool Server::unregisterUser(int id) {
 				bool remrem = g->qsRemove.remove(id);
 				write       = write || addrem || remrem;
 			}
-			if (write)
+			if (write) {
+				// The compiled programs contain the ACLs that have been removed
+				m_aclPrograms.invalidateBranch(*c);
 				updateChannel(c);
+			}
 		}
 	}
 
@@ -2000,75 +4108,204 @@ bool Server::unregisterUser(int id) {
 			mpus.set_user_id(static_cast< unsigned int >(-1));
 			sendAll(mpus);
 
-			u->iId = -1;
-			break;
+			u->iId = -1;
+			break;
+		}
+	}
+	return true;
+}
+
+void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus) {
+	std::vector< ChannelEntry > entries = { { p, c, &mpus } };
+	enterChannels(entries);
+}
+
+void Server::moveUsers(const QList< QPair< User *, Channel * > > &moves) {
+	std::vector< MumbleProto::UserState > messages(static_cast< std::size_t >(moves.size()));
+	std::vector< ChannelEntry > entries;
+	entries.reserve(messages.size());
+
+	for (int i = 0; i < moves.size(); ++i) {
+		MumbleProto::UserState &mpus = messages[static_cast< std::size_t >(i)];
+		mpus.set_session(moves[i].first->uiSession);
+		mpus.set_channel_id(moves[i].second->iId);
+
+		entries.push_back({ moves[i].first, moves[i].second, &mpus });
+	}
+
+	enterChannels(entries);
+
+	// The messages are only written once control returns to the event loop, so every client receives all of them at
+	// once (see Connection::sendMessage)
+	for (std::size_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].moved) {
+			sendAll(messages[i]);
+			emit userStateChanged(entries[i].user);
+		}
+	}
+}
+
+void Server::enterChannels(std::vector< ChannelEntry > &entries) {
+	// The channels the users have left, by session (a user might be moved more than once)
+	QHash< unsigned int, Channel * > oldChannels;
+
+	{
+		// The voice threads take the users' channels from the published VoiceState, but permissions (which they
+		// evaluate while holding qmCache) depend on them as well
+		QMutexLocker qml(&qmCache);
+		for (ChannelEntry &entry : entries) {
+			if (entry.user->cChannel == entry.channel)
+				continue;
+
+			if (!oldChannels.contains(entry.user->uiSession)) {
+				oldChannels.insert(entry.user->uiSession, entry.user->cChannel);
+			}
+			entry.channel->addUser(entry.user);
+			entry.moved = true;
 		}
 	}
-	return true;
-}
 
-void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus) {
-	if (p->cChannel == c)
+	if (oldChannels.isEmpty())
 		return;
 
-	Channel *old = p->cChannel;
+	QSet< unsigned int > channels;
+	QSet< unsigned int > sessions;
+	for (ChannelEntry &entry : entries) {
+		if (!entry.moved)
+			continue;
 
-	{
-		QWriteLocker wl(&qrwlVoiceThread);
-		c->addUser(p);
+		User *p = entry.user;
+
+		if (m_voiceTrace) {
+			VoiceTrace::Event event;
+			event.type    = VoiceTrace::EventType::UserMoved;
+			event.session = p->uiSession;
+			event.channel = entry.channel->iId;
+			event.version = static_cast< ServerUser * >(p)->m_version;
+			m_voiceTrace->record(std::move(event));
+		}
+		if (m_recorder && m_recorder->isRecorded(entry.channel->iId)) {
+			m_recorder->setName(p->uiSession, p->qsName);
+		}
+
+		// The permissions of a user in all channels depend on the channel the user is in
+		acCache.invalidateUser(p);
+
+		invalidateMembership(p->uiSession);
+		invalidateAudience(entry.channel->iId);
 
-		bool mayspeak = ChanACL::hasPermission(static_cast< ServerUser * >(p), c, ChanACL::Speak, nullptr);
-		bool sup      = p->bSuppress;
+		Channel *old = oldChannels.value(p->uiSession);
+		if (old) {
+			invalidateAudience(old->iId);
+			channels.insert(old->iId);
+		}
+
+		// Apart from the user's own targets, only the ones the user may receive speech from through their group
+		// memberships are affected
+		channels.insert(entry.channel->iId);
+		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(p->uiSession)) {
+			channels.insert(channelID);
+		}
+		sessions.insert(p->uiSession);
+	}
 
-		if (mayspeak == sup) {
+	QList< ChannelEntry * > suppressionChanges;
+	for (ChannelEntry &entry : entries) {
+		if (!entry.moved)
+			continue;
+
+		User *p = entry.user;
+
+		bool mayspeak = hasPermission(static_cast< ServerUser * >(p), entry.channel, ChanACL::Speak);
+		if (mayspeak == p->bSuppress) {
 			// Ok, he can speak and was suppressed, or vice versa
-			p->bSuppress = !mayspeak;
-			mpus.set_suppress(p->bSuppress);
+			suppressionChanges.append(&entry);
 		}
 
 		if (p->bPrioritySpeaker) {
 			// Clear priority speaker flag when switching channels
 			p->bPrioritySpeaker = false;
-			mpus.set_priority_speaker(p->bPrioritySpeaker);
+			entry.mpus->set_priority_speaker(p->bPrioritySpeaker);
+		}
+	}
+
+	if (!suppressionChanges.isEmpty()) {
+		// This is the only thing the voice threads read directly, so all users are changed under a single lock
+		QWriteLocker wl(&qrwlVoiceThread);
+		for (ChannelEntry *entry : suppressionChanges) {
+			entry->user->bSuppress = !entry->user->bSuppress;
+			entry->mpus->set_suppress(entry->user->bSuppress);
 		}
 	}
 
-	clearACLCache(p);
-	setLastChannel(p);
+	invalidateWhisperTargets(channels, sessions);
 
-	if (old && old->bTemporary && old->qlUsers.isEmpty()) {
-		QCoreApplication::instance()->postEvent(this,
-												new ExecEvent(boost::bind(&Server::removeChannel, this, old->iId)));
+	QList< const User * > users;
+	QSet< Channel * > left;
+	MumbleProto::PermissionQuery mppq;
+	for (const ChannelEntry &entry : entries) {
+		if (!entry.moved)
+			continue;
+
+		ServerUser *u = static_cast< ServerUser * >(entry.user);
+
+		flushClientPermissionCache(u, mppq);
+		sendClientPermission(u, entry.channel);
+		if (entry.channel->cParent)
+			sendClientPermission(u, entry.channel->cParent);
+		// Users that are still authenticating are sent the history once they are done
+		if (u->sState == ServerUser::Authenticated) {
+			sendMessageHistory(u, *entry.channel);
+		}
+
+		users.append(u);
+		Channel *old = oldChannels.value(u->uiSession);
+		if (old) {
+			left.insert(old);
+		}
 	}
 
-	sendClientPermission(static_cast< ServerUser * >(p), c);
-	if (c->cParent)
-		sendClientPermission(static_cast< ServerUser * >(p), c->cParent);
+	setLastChannels(users);
+
+	for (Channel *old : left) {
+		if (old->bTemporary && old->qlUsers.isEmpty()) {
+			QCoreApplication::instance()->postEvent(
+				this, new ExecEvent(boost::bind(&Server::removeChannel, this, old->iId)));
+		}
+	}
 }
 
 bool Server::hasPermission(ServerUser *p, Channel *c, QFlags< ChanACL::Perm > perm) {
-	QMutexLocker qml(&qmCache);
-	return ChanACL::hasPermission(p, c, perm, &acCache);
+	return (effectivePermissions(p, c) & perm) != ChanACL::None;
 }
 
 QFlags< ChanACL::Perm > Server::effectivePermissions(ServerUser *p, Channel *c) {
-	QMutexLocker qml(&qmCache);
-	return ChanACL::effectivePermissions(p, c, &acCache);
+	unsigned int cached;
+	PermissionCache::Stamp stamp;
+	if (acCache.lookup(p, c, cached, &stamp)) {
+		m_metrics.aclCacheHits.add();
+		return static_cast< ChanACL::Permissions >(cached);
+	}
+	m_metrics.aclCacheMisses.add();
+
+	ChanACL::Permissions granted;
+	{
+		// Both the programs and the data they are evaluated on may only be used while holding qmCache (see there)
+		Audit::MutexLocker qml(&qmCache, Audit::Lock::Cache);
+		granted = m_aclPrograms.get(*c).evaluate(*p);
+	}
+
+	acCache.store(p, c, stamp, granted | ChanACL::Cached);
+
+	return granted;
 }
 
 void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested) {
-	unsigned int perm;
-
 	if (u->iId == 0)
 		return;
 
-	{
-		QMutexLocker qml(&qmCache);
-		// Abuse that hasPermission will update acCache with the latest permissions (all of them,
-		// not only the requested one) so that we can pull this information out of it afterwards.
-		ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-		perm = acCache.value(u)->value(c);
-	}
+	// The Cached flag tells the client that it knows all of its permissions in the channel
+	unsigned int perm = effectivePermissions(u, c) | ChanACL::Cached;
 
 	if (explicitlyRequested) {
 		// Store the last channel the client showed explicit interest in
@@ -2089,7 +4326,7 @@ void Server::sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequ
 	}
 }
 
-/* This function is a helper for clearACLCache and assumes qmCache is held.
+/* This function is a helper for clearACLCache.
  * First, check if anything actually changed, or if the list is getting awfully large,
  * because this function is potentially quite expensive.
  * If all the items are still valid; great. If they aren't, send off the last channel
@@ -2104,8 +4341,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 		if (!c) {
 			match = false;
 		} else {
-			ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-			unsigned int perm = acCache.value(u)->value(c);
+			unsigned int perm = effectivePermissions(u, c) | ChanACL::Cached;
 			if (perm != i.value())
 				match = false;
 		}
@@ -2122,8 +4358,7 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 		u->iLastPermissionCheck = static_cast< int >(c->iId);
 	}
 
-	ChanACL::hasPermission(u, c, ChanACL::Enter, &acCache);
-	unsigned int perm = acCache.value(u)->value(c);
+	unsigned int perm = effectivePermissions(u, c) | ChanACL::Cached;
 	u->qmPermissionSent.insert(static_cast< int >(c->iId), perm);
 
 	mppq.Clear();
@@ -2134,62 +4369,338 @@ void Server::flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQu
 	sendMessage(u, mppq);
 }
 
+void Server::pushClientPermissionChanges(ServerUser *u, const QSet< Channel * > &branch,
+										 MumbleProto::PermissionQuery &mppq) {
+	QList< QPair< Channel *, unsigned int > > changed;
+	for (auto i = u->qmPermissionSent.constBegin(); i != u->qmPermissionSent.constEnd(); ++i) {
+		Channel *c = qhChannels.value(static_cast< unsigned int >(i.key()));
+		if (!c) {
+			// The client has to fetch everything again anyway
+			flushClientPermissionCache(u, mppq);
+			return;
+		}
+		if (!branch.contains(c)) {
+			continue;
+		}
+
+		unsigned int perm = effectivePermissions(u, c) | ChanACL::Cached;
+		if (perm != i.value()) {
+			changed.append(qMakePair(c, perm));
+		}
+	}
+
+	if (changed.count() > MAX_PERMISSION_PUSH) {
+		flushClientPermissionCache(u, mppq);
+		return;
+	}
+
+	for (const QPair< Channel *, unsigned int > &entry : changed) {
+		u->qmPermissionSent.insert(static_cast< int >(entry.first->iId), entry.second);
+
+		mppq.Clear();
+		mppq.set_channel_id(entry.first->iId);
+		mppq.set_permissions(entry.second);
+
+		sendMessage(u, mppq);
+	}
+}
+
 void Server::clearACLCache(User *p) {
 	MumbleProto::PermissionQuery mppq;
 
-	{
-		QMutexLocker qml(&qmCache);
+	if (p) {
+		acCache.invalidateUser(p);
 
-		if (p) {
-			ChanACL::ChanCache *h = acCache.take(p);
-			delete h;
+		flushClientPermissionCache(static_cast< ServerUser * >(p), mppq);
+	} else {
+		{
+			QMutexLocker qml(&qmCache);
+			m_aclPrograms.clear();
+		}
+		acCache.invalidateAll();
 
-			flushClientPermissionCache(static_cast< ServerUser * >(p), mppq);
-		} else {
-			foreach (ChanACL::ChanCache *h, acCache)
-				delete h;
-			acCache.clear();
+		foreach (ServerUser *u, qhUsers)
+			if (u->sState == ServerUser::Authenticated)
+				flushClientPermissionCache(u, mppq);
+	}
+
+	// A change in ACLs could also change a user's suppression state
+	if (p) {
+		recheckSuppression(static_cast< ServerUser * >(p));
+	} else {
+		for (ServerUser *currentUser : qhUsers) {
+			recheckSuppression(currentUser);
+		}
+	}
+
+	// A change in ACLs means that the user might be able to whisper
+	// to users it didn't have permission to do before (or vice versa)
+	if (p) {
+		// Apart from the user's own targets, only the ones the user may receive speech from through their group
+		// memberships are affected
+		QSet< unsigned int > channels;
+		if (p->cChannel) {
+			channels.insert(p->cChannel->iId);
+		}
+		for (unsigned int channelID : m_channelListenerManager.getListenedChannelsForUser(p->uiSession)) {
+			channels.insert(channelID);
+		}
+
+		invalidateWhisperTargets(channels, { p->uiSession });
+	} else {
+		clearWhisperTargetCache();
+	}
+}
+
+void Server::clearACLCacheOfBranch(Channel *chan) {
+	dropACLPrograms(*chan);
+
+	// The permissions in a channel only depend on the ACLs and groups of the channel itself and the ones of its parents
+	QSet< Channel * > branch = chan->allChildren();
+	branch.insert(chan);
+
+	QSet< unsigned int > channels;
+	for (Channel *c : branch) {
+		acCache.invalidateChannel(c);
+		channels.insert(c->iId);
+	}
+
+	MumbleProto::PermissionQuery mppq;
+	QSet< unsigned int > sessions;
+	for (ServerUser *u : qhUsers) {
+		// Only the permissions within the branch can have changed, so only these are sent again
+		if (u->sState == ServerUser::Authenticated) {
+			pushClientPermissionChanges(u, branch, mppq);
+		}
 
-			foreach (ServerUser *u, qhUsers)
-				if (u->sState == ServerUser::Authenticated)
-					flushClientPermissionCache(u, mppq);
+		if (u->cChannel && branch.contains(u->cChannel)) {
+			recheckSuppression(u);
+			// Whispering to a user depends on the permissions in the user's channel
+			sessions.insert(u->uiSession);
 		}
+	}
+
+	invalidateWhisperTargets(channels, sessions);
+}
+
+void Server::dropACLPrograms(const Channel &chan) {
+	QMutexLocker qml(&qmCache);
+	m_aclPrograms.invalidateBranch(chan);
+}
+
+void Server::recheckSuppression(ServerUser *user) {
+	bool maySpeak = hasPermission(user, user->cChannel, ChanACL::Speak);
+
+	if (maySpeak == user->bSuppress) {
+		// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
+		// property (not being allowed to speak -> suppressed and vice versa)
+		user->bSuppress = !maySpeak;
 
-		// A change in ACLs could also change a user's suppression state
 		MumbleProto::UserState mpus;
-		auto processingFunction = [&](ServerUser *user) {
-			bool maySpeak = ChanACL::hasPermission(user, user->cChannel, ChanACL::Speak, &acCache);
+		mpus.set_session(user->uiSession);
+		mpus.set_suppress(true);
+		sendAll(mpus);
+	}
+}
 
-			if (maySpeak == user->bSuppress) {
-				// Mirror a user's ability to speak in the current channel (by means of the ACLs) in the suppress
-				// property (not being allowed to speak -> suppressed and vice versa)
-				user->bSuppress = !maySpeak;
+void Server::saveWhisperTargets(const ServerUser &u) {
+	if (u.iId < 0) {
+		return;
+	}
 
-				mpus.Clear();
-				mpus.set_session(user->uiSession);
-				mpus.set_suppress(true);
-				sendAll(mpus);
+	QMap< int, SavedWhisperTarget > saved;
+	for (auto it = u.qmTargets.constBegin(); it != u.qmTargets.constEnd(); ++it) {
+		SavedWhisperTarget target;
+		for (unsigned int session : it.value().qlSessions) {
+			const ServerUser *receiver = qhUsers.value(session);
+			if (receiver && receiver->iId >= 0) {
+				target.qlUsers << receiver->iId;
 			}
-		};
+		}
+		target.qlChannels = it.value().qlChannels;
 
-		if (p) {
-			processingFunction(static_cast< ServerUser * >(p));
-		} else {
-			for (ServerUser *currentUser : qhUsers) {
-				processingFunction(currentUser);
+		if (!target.qlUsers.isEmpty() || !target.qlChannels.isEmpty()) {
+			saved.insert(it.key(), target);
+		}
+	}
+
+	if (saved.isEmpty()) {
+		m_savedWhisperTargets.remove(u.iId);
+	} else {
+		m_savedWhisperTargets.insert(u.iId, saved);
+	}
+}
+
+void Server::restoreWhisperTargets(ServerUser &u) {
+	if (u.iId < 0) {
+		return;
+	}
+
+	const QMap< int, SavedWhisperTarget > saved = m_savedWhisperTargets.take(u.iId);
+	if (saved.isEmpty()) {
+		return;
+	}
+
+	// The sessions of the users who are connected right now
+	QHash< int, unsigned int > sessions;
+	foreach (const ServerUser *other, qhUsers) {
+		if (other->iId >= 0 && other->sState == ServerUser::Authenticated) {
+			sessions.insert(other->iId, other->uiSession);
+		}
+	}
+
+	for (auto it = saved.constBegin(); it != saved.constEnd(); ++it) {
+		WhisperTarget wt;
+		for (int id : it.value().qlUsers) {
+			if (sessions.contains(id)) {
+				wt.qlSessions << sessions.value(id);
+			}
+		}
+		for (const WhisperTarget::Channel &wtc : it.value().qlChannels) {
+			if (qhChannels.contains(static_cast< unsigned int >(wtc.iId))) {
+				wt.qlChannels << wtc;
 			}
 		}
+
+		if (!wt.qlSessions.isEmpty() || !wt.qlChannels.isEmpty()) {
+			u.qmTargets.insert(it.key(), wt);
+			m_staleWhisperTargets.insert(qMakePair(u.uiSession, it.key()));
+		}
 	}
 
-	// A change in ACLs means that the user might be able to whisper
-	// to users it didn't have permission to do before (or vice versa)
-	clearWhisperTargetCache();
+	if (!u.qmTargets.isEmpty()) {
+		scheduleVoiceStatePublication();
+	}
 }
 
 void Server::clearWhisperTargetCache() {
-	QWriteLocker lock(&qrwlVoiceThread);
+	// The caches are only used by the main thread (the voice threads use the tables in the published VoiceState)
+	foreach (ServerUser *u, qhUsers) {
+		for (auto it = u->qmTargetCache.constBegin(); it != u->qmTargetCache.constEnd(); ++it) {
+			m_staleWhisperTargets.insert(qMakePair(u->uiSession, it.key()));
+		}
+		u->qmTargetCache.clear();
+	}
+
+	if (!m_staleWhisperTargets.isEmpty()) {
+		scheduleVoiceStatePublication();
+	}
+}
+
+void Server::invalidateWhisperTargets(const QSet< unsigned int > &channels, const QSet< unsigned int > &sessions) {
+	if (channels.isEmpty() && sessions.isEmpty()) {
+		return;
+	}
+
+	bool invalidated = false;
+
+	foreach (ServerUser *u, qhUsers) {
+		const bool speakerChanged = sessions.contains(u->uiSession);
+
+		for (auto it = u->qmTargetCache.begin(); it != u->qmTargetCache.end();) {
+			if (speakerChanged || it.value().dependentChannels.intersects(channels)
+				|| it.value().dependentSessions.intersects(sessions)) {
+				m_staleWhisperTargets.insert(qMakePair(u->uiSession, it.key()));
+				it          = u->qmTargetCache.erase(it);
+				invalidated = true;
+			} else {
+				++it;
+			}
+		}
+	}
+
+	if (invalidated) {
+		scheduleVoiceStatePublication();
+	}
+}
+
+void Server::invalidateWhisperTargetsOfBranch(const Channel *c) {
+	QSet< unsigned int > channels;
+	for (const Channel *current = c; current; current = current->cParent) {
+		channels.insert(current->iId);
+	}
+
+	invalidateWhisperTargets(channels, {});
+}
+
+void Server::invalidateWhisperTargetsOfLinks(Channel *c) {
+	QSet< unsigned int > channels;
+	for (const Channel *linked : c->linkGroup()) {
+		channels.insert(linked->iId);
+	}
+
+	invalidateWhisperTargets(channels, {});
+}
+
+namespace {
+std::size_t hashReceiverTable(const WhisperReceiverTable &table) {
+	std::size_t hash = table.positional.size();
+	for (const std::vector< WhisperReceiverTable::Receiver > *group : { &table.positional, &table.regular }) {
+		for (const WhisperReceiverTable::Receiver &receiver : *group) {
+			hash ^= std::hash< const ServerUser * >()(receiver.user) + receiver.context + 0x9e3779b9 + (hash << 6)
+					+ (hash >> 2);
+		}
+	}
+	return hash;
+}
+} // namespace
+
+void Server::refreshWhisperTargets(VoiceState &state) {
+	ZoneScoped;
+
+	if (m_staleWhisperTargets.isEmpty()) {
+		return;
+	}
+
+	QList< QPair< QPair< unsigned int, int >, WhisperTargetCache > > rebuilt;
+	QList< QPair< unsigned int, int > > removed;
+	for (const QPair< unsigned int, int > &entry : m_staleWhisperTargets) {
+		ServerUser *u = qhUsers.value(entry.first);
+		if (u && u->qmTargets.contains(entry.second)) {
+			rebuilt << qMakePair(entry, buildWhisperTargetCache(u, u->qmTargets.value(entry.second)));
+		} else {
+			// The target (or its speaker) is gone
+			removed << entry;
+		}
+	}
+	m_staleWhisperTargets.clear();
+
+	// Speakers whose targets lead to the same receivers (e.g. the members of a squad whispering to each other) share
+	// a single table
+	std::unordered_multimap< std::size_t, std::shared_ptr< const WhisperReceiverTable > > tables;
+	foreach (ServerUser *u, qhUsers) {
+		for (const WhisperTargetCache &cache : u->qmTargetCache) {
+			tables.emplace(hashReceiverTable(*cache.receivers), cache.receivers);
+		}
+	}
+	for (QPair< QPair< unsigned int, int >, WhisperTargetCache > &entry : rebuilt) {
+		std::shared_ptr< const WhisperReceiverTable > &receivers = entry.second.receivers;
+
+		const std::size_t hash = hashReceiverTable(*receivers);
+		auto range             = tables.equal_range(hash);
+		auto existing          = std::find_if(range.first, range.second, [&receivers](const auto &candidate) {
+			return *candidate.second == *receivers;
+		});
+
+		if (existing != range.second) {
+			receivers = existing->second;
+		} else {
+			tables.emplace(hash, receivers);
+		}
+	}
+
+	for (const QPair< QPair< unsigned int, int >, WhisperTargetCache > &entry : rebuilt) {
+		state.whispering.set(VoiceState::whisperKey(entry.first.first, entry.first.second), entry.second.receivers);
+		qhUsers.value(entry.first.first)->qmTargetCache.insert(entry.first.second, entry.second);
+	}
+	for (const QPair< unsigned int, int > &entry : removed) {
+		state.whispering.erase(VoiceState::whisperKey(entry.first, entry.second));
 
-	foreach (ServerUser *u, qhUsers) { u->qmTargetCache.clear(); }
+		ServerUser *u = qhUsers.value(entry.first);
+		if (u) {
+			u->qmTargetCache.remove(entry.second);
+		}
+	}
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
@@ -2221,41 +4732,40 @@ bool Server::validateChannelName(const QString &name) {
 }
 
 void Server::recheckCodecVersions(ServerUser *connectingUser) {
-	QMap< int, int > qmCodecUsercount;
-	QMap< int, int >::const_iterator i;
-	int users = 0;
-	int opus  = 0;
-
-	// Count how many users use which codec
-	foreach (ServerUser *u, qhUsers) {
-		if (u->qlCodecs.isEmpty() && !u->bOpus)
-			continue;
+	if (connectingUser) {
+		m_codecVotes.add(connectingUser->uiSession, connectingUser->qlCodecs, connectingUser->bOpus);
 
-		++users;
-		if (u->bOpus)
-			++opus;
+		// The connecting user is told about the codecs that are in use right away (see msgAuthenticate), so it has
+		// to be warned right away, too, unless the server is about to switch away from Opus
+		if (bOpus && !connectingUser->bOpus && !isTranscoding() && m_codecVotes.opusPercentage() >= iOpusThreshold) {
+			sendTextMessage(
+				nullptr, connectingUser, false,
+				QLatin1String(
+					"<strong>WARNING:</strong> Your client doesn't support the Opus codec the server is using, you "
+					"won't be able to talk or hear anyone. Please upgrade to a client with Opus support."));
+		}
+	}
 
-		foreach (int version, u->qlCodecs)
-			++qmCodecUsercount[version];
+	if (!qtCodecCheck->isActive()) {
+		qtCodecCheck->start();
 	}
+}
 
-	if (!users)
+void Server::applyCodecVersions() {
+	if (!m_codecVotes.voters())
 		return;
 
 	// Enable Opus if the number of users with Opus is higher than the threshold
-	bool enableOpus = ((opus * 100 / users) >= iOpusThreshold);
+	bool enableOpus = (m_codecVotes.opusPercentage() >= iOpusThreshold);
 
 	// Find the best possible codec most users support
-	int version       = 0;
-	int maximum_users = 0;
-	i                 = qmCodecUsercount.constEnd();
-	do {
-		--i;
-		if (i.value() > maximum_users) {
-			version       = i.key();
-			maximum_users = i.value();
-		}
-	} while (i != qmCodecUsercount.constBegin());
+	int version = m_codecVotes.preferredCeltVersion();
+
+	if (isTranscoding()) {
+		// Everybody gets speech in a codec they support, so Opus stays and CELT is the one that can be transcoded
+		enableOpus = true;
+		version    = static_cast< qint32 >(0x8000000b);
+	}
 
 	int current_version = bPreferAlpha ? iCodecAlpha : iCodecBeta;
 
@@ -2275,13 +4785,6 @@ void Server::recheckCodecVersions(ServerUser *connectingUser) {
 		else
 			iCodecBeta = version;
 	} else if (bOpus == enableOpus) {
-		if (bOpus && connectingUser && !connectingUser->bOpus) {
-			sendTextMessage(
-				nullptr, connectingUser, false,
-				QLatin1String(
-					"<strong>WARNING:</strong> Your client doesn't support the Opus codec the server is using, you "
-					"won't be able to talk or hear anyone. Please upgrade to a client with Opus support."));
-		}
 		return;
 	}
 
@@ -2294,12 +4797,11 @@ void Server::recheckCodecVersions(ServerUser *connectingUser) {
 	mpcv.set_opus(bOpus);
 	sendAll(mpcv);
 
-	if (bOpus) {
+	if (bOpus && !isTranscoding()) {
 		foreach (ServerUser *u, qhUsers) {
 			// Prevent connected users that could not yet declare their opus capability during msgAuthenticate from
-			// being spammed. Only authenticated users and the currently connecting user (if recheck is called in
-			// that context) have a reliable u->bOpus.
-			if ((u->sState == ServerUser::Authenticated || u == connectingUser) && !u->bOpus) {
+			// being spammed. Only authenticated users have a reliable u->bOpus.
+			if (u->sState == ServerUser::Authenticated && !u->bOpus) {
 				sendTextMessage(nullptr, u, false,
 								QLatin1String("<strong>WARNING:</strong> Your client doesn't support the Opus "
 											  "codec the server is switching "
@@ -2325,36 +4827,39 @@ void Server::hashAssign(QString &dest, QByteArray &hash, const QString &src) {
 }
 
 void Server::hashAssign(QByteArray &dest, QByteArray &hash, const QByteArray &src) {
-	dest = src;
-	if (src.length() >= 128)
+	if (src.length() >= 128) {
 		hash = sha1(src);
-	else
+		// Identical blobs (e.g. a popular avatar) share their memory
+		dest = meta->m_blobStore.insert(hash, src);
+	} else {
+		dest = src;
 		hash = QByteArray();
+	}
 }
 
-bool Server::isTextAllowed(QString &text, bool &changed) {
+bool Server::isTextAllowed(QString &text, bool &changed, const TextLimits &limits) {
 	changed = false;
 
-	if (!bAllowHTML) {
+	if (!limits.allowHTML) {
 		QString out;
 		if (HTMLFilter::filter(text, out)) {
 			changed = true;
 			text    = out;
 		}
-		return ((iMaxTextMessageLength == 0) || (text.length() <= iMaxTextMessageLength));
+		return ((limits.maxTextLength == 0) || (text.length() <= limits.maxTextLength));
 	} else {
 		int length = text.length();
 
 		// No limits
-		if ((iMaxTextMessageLength == 0) && (iMaxImageMessageLength == 0))
+		if ((limits.maxTextLength == 0) && (limits.maxImageLength == 0))
 			return true;
 
 		// Over Image limit? (If so, always fail)
-		if ((iMaxImageMessageLength != 0) && (length > iMaxImageMessageLength))
+		if ((limits.maxImageLength != 0) && (length > limits.maxImageLength))
 			return false;
 
 		// Under textlength?
-		if ((iMaxTextMessageLength == 0) || (length <= iMaxTextMessageLength))
+		if ((limits.maxTextLength == 0) || (length <= limits.maxTextLength))
 			return true;
 
 		// Over textlength, under imagelength. If no XML, this is a fail.
@@ -2388,8 +4893,93 @@ bool Server::isTextAllowed(QString &text, bool &changed) {
 
 		length = qsOut.length();
 
-		return (length <= iMaxTextMessageLength);
+		return (length <= limits.maxTextLength);
+	}
+}
+
+Server::TextLimits Server::textLimits() const {
+	return { bAllowHTML, iMaxTextMessageLength, iMaxImageMessageLength };
+}
+
+bool Server::isTextAllowed(QString &text, bool &changed) {
+	return isTextAllowed(text, changed, textLimits());
+}
+
+bool Server::isTextAllowed(ServerUser *user, QString &text, bool &changed) {
+	const std::unique_ptr< ServerUser::ValidatedText > &validated = user->m_validatedText;
+	if (validated && validated->text == text) {
+		changed = validated->filtered != text;
+		text    = validated->filtered;
+		return validated->allowed;
+	}
+
+	return isTextAllowed(text, changed);
+}
+
+bool Server::exceedsTextLimits(std::size_t utf8Length) const {
+	// No text (filtered or not) may be longer than an image message. Every UTF-16 code unit takes up at most three
+	// bytes in UTF-8, so anything beyond that is too long regardless of its content.
+	return iMaxImageMessageLength > 0 && utf8Length > 3 * static_cast< std::size_t >(iMaxImageMessageLength);
+}
+
+bool Server::deferTextValidation(ServerUser *user, const std::string &text, std::function< void() > replay) {
+	if (user->m_validatedText) {
+		// The message is being replayed
+		return false;
+	}
+
+	const bool idle = user->m_pendingTextValidations.empty();
+	if (idle && text.size() < ASYNC_TEXT_VALIDATION_BYTES) {
+		return false;
+	}
+
+	if (user->m_pendingTextValidations.size() >= MAX_PENDING_TEXT_VALIDATIONS) {
+		log(user, QString("Too many messages waiting to be validated, dropping one"));
+		return true;
+	}
+
+	user->m_pendingTextValidations.push_back({ text, std::move(replay) });
+	if (idle) {
+		startTextValidation(user);
 	}
+
+	return true;
+}
+
+void Server::startTextValidation(ServerUser *user) {
+	const std::string text  = user->m_pendingTextValidations.front().text;
+	const TextLimits limits = textLimits();
+
+	m_deferredWork.start(user, [this, text, limits]() -> DeferredWork::Continuation {
+		ServerUser::ValidatedText result;
+		result.text     = u8(text);
+		result.filtered = result.text;
+
+		bool changed   = false;
+		result.allowed = isTextAllowed(result.filtered, changed, limits);
+
+		return [this, result](ServerUser *user) {
+			if (user->m_pendingTextValidations.empty()) {
+				return;
+			}
+
+			const std::function< void() > replay = std::move(user->m_pendingTextValidations.front().replay);
+			user->m_pendingTextValidations.pop_front();
+
+			// Handling the message might disconnect the user
+			QPointer< ServerUser > guard = user;
+			user->m_validatedText        = std::make_unique< ServerUser::ValidatedText >(result);
+			replay();
+			if (!guard) {
+				return;
+			}
+			user->m_validatedText.reset();
+
+			if (!user->m_pendingTextValidations.empty()) {
+				startTextValidation(user);
+			}
+		};
+	});
 }
 
 bool Server::isChannelFull(Channel *c, ServerUser *u) {
@@ -13,21 +13,57 @@
 #endif
 
 #include "ACL.h"
+#include "ACLProgram.h"
+#include "Audit.h"
 #include "AudioReceiverBuffer.h"
 #include "Ban.h"
+#include "BanIndex.h"
+#include "ChannelAudience.h"
 #include "ChannelListenerManager.h"
+#include "ChannelRecorder.h"
+#include "ClusterProtocol.h"
+#include "CodecVotes.h"
+#include "DeferredWork.h"
+#include "EpochReclaimer.h"
 #include "HostAddress.h"
+#include "MessageArena.h"
+#include "MessageHistory.h"
+#include "Metrics.h"
 #include "Mumble.pb.h"
 #include "MumbleProtocol.h"
+#include "NamePattern.h"
+#include "PermissionCache.h"
+#include "PingResponder.h"
+#include "SpeakerSelector.h"
+#include "StateSnapshotCache.h"
+#include "TimeoutWheel.h"
 #include "Timer.h"
+#include "UDPSendQueue.h"
 #include "User.h"
+#include "UserNameCache.h"
 #include "Version.h"
+#include "VoiceState.h"
+#include "VoiceTrace.h"
 #include "VolumeAdjustment.h"
 
+#ifdef Q_OS_WIN
+#	include "RegisteredIO.h"
+#else
+#	include "SocketHandoff.h"
+#endif
+#ifdef USE_SERVER_MIXING
+#	include "StageMixer.h"
+#endif
+#ifdef USE_SERVER_TRANSCODING
+#	include "CELTCodec.h"
+#	include "Transcoder.h"
+#endif
+
 #ifndef Q_MOC_RUN
 #	include <boost/function.hpp>
 #endif
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QEvent>
 #include <QtCore/QMutex>
 #include <QtCore/QQueue>
@@ -38,6 +74,7 @@
 #include <QtCore/QTimer>
 #include <QtCore/QUrl>
 #include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslConfiguration>
 #include <QtNetwork/QSslKey>
 #include <QtNetwork/QSslSocket>
 #include <QtNetwork/QTcpServer>
@@ -45,16 +82,28 @@
 #	include <QtNetwork/QSslDiffieHellmanParameters>
 #endif
 
+#include <rigtorp/SPSCQueue.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
 #endif
 
-class Zeroconf;
 class Channel;
+class ClusterNode;
 class PacketDataStream;
+class Server;
 class ServerUser;
 class User;
-class QNetworkAccessManager;
+struct SavedWhisperTarget;
+struct WhisperTarget;
+struct WhisperTargetCache;
 
 struct TextMessage {
 	QList< unsigned int > qlSessions;
@@ -89,6 +138,205 @@ public:
 	void execute();
 };
 
+/// Everything a thread needs in order to receive, route and send out voice packets. A context must
+/// only ever be used by a single thread at a time.
+struct VoiceContext {
+	using socket_t = UDPSendQueue::socket_t;
+
+	/// A voice packet that has to be sent to a user through its TCP connection (because UDP doesn't work for it)
+	struct TunneledPacket {
+		unsigned int session;
+		/// The complete UDPTunnel message including its header. It is shared among all receivers of the packet.
+		QByteArray message;
+	};
+
+	/// The maximum amount of tunneled packets that may be waiting for the main thread. Any further ones are
+	/// dropped (just like they would have been if they had been sent via UDP).
+	static constexpr std::size_t TCP_TUNNEL_QUEUE_CAPACITY = 4096;
+
+	VoiceContext();
+
+	/// The UDP sockets of this context. The socket at index i is bound to the same address as the
+	/// socket at index i in primarySockets.
+	std::vector< socket_t > sockets;
+	/// The sockets of the server's first voice thread (Server::qlUdpSocket). These are the ones that
+	/// are stored in ServerUser::sUdpSocket.
+	std::vector< socket_t > primarySockets;
+
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > decoder;
+	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > pingEncoder;
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > audioEncoder;
+	/// The limits of the pings asking for the server's details that are received by this context (see
+	/// Server::infoPingReply). The kernel hands all packets of a source to the same voice thread, so every source is
+	/// limited only once.
+	PingRateLimiter pingLimiter;
+	AudioReceiverBuffer receivers;
+	/// The receivers of the current packet that don't support frames shorter than 10 ms and thus get the packets the
+	/// sender's frames are combined into (see FrameAggregator), along with the payload of the combined packet
+	AudioReceiverBuffer regularReceivers;
+	std::vector< Mumble::Protocol::byte > aggregatedPayload;
+	UDPSendQueue sendQueue;
+
+	/// The time (see BandwidthRecord::clock) the current batch of packets has been received at. It is updated once
+	/// per batch, so that the rate limit doesn't have to read the clock for every packet.
+	quint64 now = 0;
+	/// The number of voice packets of the current batch that have been routed to their receivers. Their forwarding
+	/// latency is recorded once the batch has been sent (see Server::flushVoiceContext).
+	quint64 routedPackets = 0;
+	/// The voice frames that are about to be relayed to the other nodes of the cluster, one batch per peer (see
+	/// ClusterNode::relay). They are sent along with the rest of the batch (see Server::flushVoiceContext).
+	std::vector< ClusterProtocol::VoiceBatch > relayBatches;
+	/// The receivers of the current receiver range that get the packet with its redundant payload (see
+	/// Server::sendAudio)
+	std::vector< ServerUser * > redundantReceivers;
+
+	/// The buffer incoming packets are decrypted into
+	alignas(8) unsigned char decryptBuffer[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+
+	/// A packet from a peer that is not associated with any user yet (see Server::associatePendingPeers)
+	struct PendingAssociation {
+		std::size_t socketIndex;
+		sockaddr_storage from;
+		unsigned int length;
+		/// The length of the decrypted packet in plain
+		unsigned int plainLength;
+		/// The user the packet has turned out to belong to (if any)
+		ServerUser *user;
+		unsigned int session;
+		/// Whether the peer has to be associated with the user
+		bool associate;
+		unsigned char data[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+		alignas(8) unsigned char plain[Mumble::Protocol::MAX_UDP_PACKET_SIZE];
+	};
+
+	/// The maximum amount of packets from unknown peers that are kept per batch. Any further ones are
+	/// dropped, which bounds the amount of trial decryptions a flood of stray packets can cause.
+	static constexpr std::size_t MAX_PENDING_ASSOCIATIONS = 32;
+	std::array< PendingAssociation, MAX_PENDING_ASSOCIATIONS > pendingAssociations;
+	std::size_t pendingAssociationCount = 0;
+
+	/// The packets that the thread owning this context wants to have tunneled through TCP. The main thread
+	/// takes them out of the queue in Server::drainTCPTunnelQueues.
+	rigtorp::SPSCQueue< TunneledPacket > tcpTunnelQueue;
+	/// Whether the main thread has already been told to drain tcpTunnelQueue
+	std::atomic< bool > tcpTunnelNotified;
+
+	/// Announces which VoiceState the thread owning this context might be using (see Server::m_voiceEpochs)
+	EpochReclaimer::Reader epochReader;
+
+#ifdef Q_OS_WIN
+	/// Receives and sends the packets of this context's sockets if Server::registeredIO is enabled. It is created
+	/// when the voice thread first starts and kept until the sockets are closed (see Server::closeListeners), as the
+	/// receives it has posted can't be cancelled otherwise and the sockets can't be registered twice.
+	std::unique_ptr< RegisteredIO > registeredIO;
+#endif
+
+	/// @returns This context's socket that is bound to the same address as the given primary socket
+	socket_t socketFor(socket_t primarySocket) const;
+};
+
+/// A (single) packet that has been received by a voice thread
+struct VoiceDatagram {
+	/// The index (within VoiceContext::sockets) of the socket the packet has been received on
+	std::size_t socketIndex;
+	unsigned char *data;
+	/// The length of the packet in bytes (or SOCKET_ERROR)
+	qint32 length;
+	sockaddr_storage *from;
+#ifdef Q_OS_LINUX
+	/// The header the packet has been received with. Its address and control data are reused when
+	/// answering pings.
+	struct msghdr *msg;
+#endif
+};
+
+/// A thread that handles voice packets for a Server in addition to the Server's own voice thread
+/// (see Server::voiceThreads)
+class VoiceThread : public QThread {
+public:
+	VoiceThread(Server &server, VoiceContext &context);
+
+protected:
+	Server &m_server;
+	VoiceContext &m_context;
+
+	void run() Q_DECL_OVERRIDE;
+};
+
+#ifdef USE_SERVER_MIXING
+/// A thread that mixes the speech of the stage channels of a Server (see Server::qsStageChannels) and sends the mix
+/// to their listeners
+class MixingThread : public QThread {
+public:
+	MixingThread(Server &server, std::size_t index);
+
+protected:
+	Server &m_server;
+	/// The index of the thread's context in Server::m_mixingContexts
+	std::size_t m_index;
+
+	void run() Q_DECL_OVERRIDE;
+};
+#endif
+
+/// The rows a Server reads from the database when it is created (see Server::loadBootState()). Reading them doesn't
+/// touch the Server, so that the states of several servers can be read concurrently (see Meta::bootAll()).
+struct ServerBootState {
+	struct ChannelRow {
+		unsigned int id;
+		/// -1 for the root channel
+		int parentId;
+		QString name;
+		bool inheritACL;
+	};
+	struct ChannelInfoRow {
+		unsigned int channelId;
+		int key;
+		QString value;
+	};
+	struct GroupRow {
+		int id;
+		unsigned int channelId;
+		QString name;
+		bool inherit;
+		bool inheritable;
+	};
+	struct GroupMemberRow {
+		int groupId;
+		int userId;
+		bool add;
+	};
+	struct ACLRow {
+		unsigned int channelId;
+		/// -1 if the ACL applies to a group
+		int userId;
+		QString group;
+		bool applyHere;
+		bool applySubs;
+		int allow;
+		int deny;
+	};
+	struct ListenerRow {
+		int userId;
+		unsigned int channelId;
+		float volumeAdjustment;
+		bool enabled;
+	};
+
+	QList< Ban > bans;
+	/// The channels in the order they are sorted in by name
+	QList< ChannelRow > channels;
+	QList< ChannelInfoRow > channelInfo;
+	QList< GroupRow > groups;
+	QList< GroupMemberRow > groupMembers;
+	/// The ACLs of every channel in the order of their priority
+	QList< ACLRow > acls;
+	/// Pairs of linked channels
+	QList< QPair< unsigned int, unsigned int > > links;
+	/// The channel listeners of all registered users
+	QList< ListenerRow > listeners;
+};
+
 class Server : public QThread {
 private:
 	Q_OBJECT
@@ -97,14 +345,55 @@ private:
 protected:
 	bool bRunning;
 
-	QNetworkAccessManager *qnamNetwork;
-
 #ifdef USE_ZEROCONF
-	Zeroconf *zeroconf;
+	/// Whether the server has been announced via Zeroconf (see RegistrationWorker)
+	bool m_zeroconfPublished = false;
 #endif
 	void startThread();
 	void stopThread();
 
+	/// The addresses and port the listeners are currently bound to. qlBind and usPort may differ from them until
+	/// rebindListeners() has run.
+	QList< QHostAddress > m_boundAddresses;
+	unsigned short m_boundPort = 0;
+	bool m_rebindScheduled     = false;
+
+	/// Creates the TCP listeners and the UDP sockets of all voice threads for qlBind and usPort
+	/// @returns Whether all of them could be bound
+	bool bindListeners();
+	/// Closes everything bindListeners() has created. The voice threads must not be running.
+	void closeListeners();
+	/// Makes rebindListeners() run once the event loop is idle again
+	void scheduleRebind();
+	/// Moves the listeners to qlBind and usPort (if they have changed) without disconnecting anyone. The voice
+	/// threads are paused while their sockets are replaced.
+	void rebindListeners();
+	/// Resolves the given whitespace-separated list of hosts (see the "host" option)
+	QList< QHostAddress > bindAddresses(const QString &hosts);
+	/// Forgets the UDP associations of all users, whose voice is tunneled through TCP from then on (unless their
+	/// clients find the server's UDP port again)
+	void dropUdpAssociations();
+
+#ifdef Q_OS_UNIX
+	/// The sessions of the users that are connected to this instance and have yet to be disconnected by
+	/// drainForHandoff()
+	QList< unsigned int > m_drainQueue;
+
+public:
+	/// Appends the TCP listeners and the voice sockets to the given list, so that they can be handed over to the
+	/// instance that replaces this one (see SocketHandoff)
+	void collectHandoffSockets(std::vector< SocketHandoff::Socket > &sockets) const;
+	/// Stops accepting connections and receiving voice, as the sockets have been handed over. The users stay connected
+	/// (with their voice tunneled through TCP) until drainForHandoff() disconnects them.
+	void stopForHandoff();
+	/// Disconnects up to the given number of users, whose clients then reconnect to the instance that has taken over
+	///
+	/// @returns The number of users that are still connected
+	int drainForHandoff(int count);
+
+protected:
+#endif
+
 	void customEvent(QEvent *evt);
 	// Former ServerParams
 public:
@@ -137,8 +426,8 @@ public:
 	bool bAllowPing;
 	bool allowRecording;
 
-	QRegExp qrUserName;
-	QRegExp qrChannelName;
+	NamePattern qrUserName;
+	NamePattern qrChannelName;
 
 	unsigned int iMessageLimit;
 	unsigned int iMessageBurst;
@@ -146,8 +435,82 @@ public:
 	unsigned int iPluginMessageLimit;
 	unsigned int iPluginMessageBurst;
 
+	/// The number of pings asking for the server's details that every source address may send per second (or 0 for
+	/// no limit) and at once (see PingRateLimiter)
+	unsigned int pingLimit;
+	unsigned int pingBurst;
+
 	bool broadcastListenerVolumeAdjustments;
 
+	/// The maximum amount of datagrams the voice thread reads from a UDP
+	/// socket with a single system call (only used on Linux)
+	unsigned int udpReceiveBatchSize;
+	/// Whether UDP segmentation offload (GSO) and receive offload (GRO) shall be
+	/// used if the kernel supports them (only used on Linux)
+	bool udpOffload;
+	/// The number of threads that process voice packets received via UDP. All
+	/// but the first one are only supported on Linux.
+	unsigned int voiceThreads;
+	/// Whether voice packets shall be received via io_uring instead of poll(). Only
+	/// available if the server has been built with io_uring support.
+	bool ioUring;
+	/// Whether voice packets shall be received and sent via Registered I/O instead of one by one (Windows only)
+	bool registeredIO;
+	/// The CPUs the voice threads are pinned to (e.g. "2,3" or "2-5"). The n-th
+	/// voice thread is pinned to the n-th CPU of the list (only used on Linux).
+	QString voiceThreadCPUs;
+	/// The NUMA node whose CPUs the voice threads are pinned to if voiceThreadCPUs
+	/// is empty or -1 (only used on Linux)
+	int voiceThreadNode;
+	/// @returns The CPU the given voice thread is pinned to or -1 if it isn't pinned
+	int voiceThreadCPU(std::size_t thread) const;
+	/// The SO_BUSY_POLL timeout in microseconds for the voice sockets or 0 to
+	/// disable busy polling (only used on Linux)
+	unsigned int udpBusyPoll;
+	/// For how many microseconds the voice threads spin before blocking in
+	/// poll() or 0 to never spin (only used on Linux)
+	unsigned int udpSpinTime;
+	/// The DSCP (0 to 63) the UDP packets are marked with or 0 to keep the default marking. It is set once per
+	/// socket (or per flow on Windows, see updateQoSFlow), so it costs nothing per packet. Only read on startup.
+	unsigned int udpDSCP;
+	/// The channels of this virtual server that are linked with channels of other virtual servers of the cluster,
+	/// as whitespace-separated "channel=node:server:channel" entries (e.g. "5=2:1:7" links channel 5 with channel 7
+	/// of virtual server 1 on node 2). Both sides have to link the channels. Only read on startup and only used in
+	/// cluster mode (see ClusterNode).
+	QString qsRelayLinks;
+	/// The file the voice traffic of this virtual server is recorded to (see VoiceTrace) or empty if it isn't. Only
+	/// read on startup.
+	QString qsVoiceTraceFile;
+	/// The channels that only forward the speech of the loudest few users speaking at once, as whitespace-separated
+	/// "channel=speakers" entries (e.g. "5=4" forwards the 4 loudest speakers in channel 5). See SpeakerSelector.
+	/// Only read on startup.
+	QString qsSpeakerLimits;
+	/// The channels whose speech is recorded into one Ogg Opus file per speaker (see ChannelRecorder), as
+	/// whitespace-separated channel IDs. Only read on startup.
+	QString qsRecordChannels;
+	/// The directory the recordings of the channels in qsRecordChannels are put into
+	QString qsRecordingDir;
+	/// The channels whose speech is mixed by the server (see StageMixer), as whitespace-separated channel IDs. Only
+	/// read on startup and only used if the server has been built with mixing support.
+	QString qsStageChannels;
+	/// The number of threads that mix the speech of the stage channels (see MixingThread)
+	unsigned int mixingThreads;
+	/// The number of threads that transcode speech between Opus and CELT for the clients that can't decode it (see
+	/// Transcoder), 0 if speech isn't transcoded. Only used if the server has been built with transcoding support
+	/// and the CELT library can be loaded.
+	unsigned int transcodingThreads;
+	/// Whether the volume adjustments of channel listeners are rounded to a few steps (see
+	/// AudioReceiverBuffer::quantizeVolumeAdjustment), so that listeners with similar adjustments share the packets
+	/// they receive. The clients are told about it, so that they apply their exact adjustments themselves.
+	bool quantizeListenerVolumes;
+	/// The number of text messages every channel keeps in its history (see MessageHistory), 0 if there is none. Only
+	/// read on startup.
+	unsigned int messageHistory;
+	/// The directory the message history is written to
+	QString qsMessageHistoryDir;
+	/// For how many days the messages of the history are kept
+	unsigned int messageHistoryDays;
+
 	Version::full_t m_suggestVersion;
 
 	QVariant qvSuggestPositional;
@@ -169,6 +532,9 @@ public:
 #if defined(USE_QSSLDIFFIEHELLMANPARAMETERS)
 	QSslDiffieHellmanParameters qsdhpDHParams;
 #endif
+	/// The TLS configuration every connection is given, which is assembled from the above by initializeCert(). It
+	/// only changes along with the certificate, so it isn't built anew for each of the clients reconnecting at once.
+	QSslConfiguration m_sslConfiguration;
 
 	Timer tUptime;
 
@@ -176,16 +542,54 @@ public:
 
 	ChannelListenerManager m_channelListenerManager;
 
+	/// A channel listener of a registered user the way it is stored in the database
+	struct StoredListener {
+		unsigned int channelId;
+		float volumeAdjustment;
+		bool enabled;
+	};
+	/// The channel listeners of the registered users (by user ID). They are read along with the rest of the boot
+	/// state and kept in step with the database, so that authenticating users doesn't take a query (main thread
+	/// only).
+	QHash< int, std::vector< StoredListener > > m_storedListeners;
+	/// @returns The stored listener of the given registered user for the given channel or nullptr if there is none
+	StoredListener *storedListener(int userId, unsigned int channelId);
+
 
-	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_udpDecoder;
 	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > m_tcpTunnelDecoder;
-	Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > m_udpPingEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_udpAudioEncoder;
-	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > m_tcpAudioEncoder;
+	/// The arena the control messages are parsed into (see message())
+	MessageArena m_messageArena;
+	/// The replies to the pings that ask for the server's details (see updatePingReply())
+	PingResponder m_pingResponder;
+	/// The limits of the pings the main thread answers (see udpActivated())
+	PingRateLimiter m_pingLimiter;
+
+	/// Encodes the replies of m_pingResponder again. Has to be called whenever the number of users, the maximum number
+	/// of users or the maximum bandwidth changes.
+	void updatePingReply();
+	/// Applies pingLimit and pingBurst to all ping limiters
+	void updatePingLimits();
+	/// Writes the reply to the unencrypted ping that has been decoded by the given decoder into the given buffer,
+	/// unless it doesn't ask for the server's details or its source has exceeded the given limiter's limit. Doesn't
+	/// need qrwlVoiceThread.
+	///
+	/// @param buffer Receives the reply. It has to hold PingResponder::MAX_REPLY_SIZE bytes.
+	/// @returns The size of the reply or 0 if the ping mustn't be answered
+	std::size_t infoPingReply(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
+							  PingRateLimiter &limiter, const sockaddr_storage &from, quint64 now,
+							  Mumble::Protocol::byte *buffer);
 
 	gsl::span< const Mumble::Protocol::byte >
 		handlePing(const Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Server > &decoder,
-				   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder, bool expectExtended);
+				   Mumble::Protocol::UDPPingEncoder< Mumble::Protocol::Role::Server > &encoder, bool expectExtended,
+				   std::uint32_t bitrateHint = 0);
+	/// @returns The bitrate (in bits per second) that audio sent to a user whose link has the given loss (in percent)
+	/// and jitter (in milliseconds) should not exceed, or 0 if the link isn't constrained
+	static unsigned int linkBitrate(unsigned int packetLoss, unsigned int jitter);
+	/// @returns The bitrate hint for the given user, which is the lowest link bitrate (see linkBitrate()) of all the
+	/// other users that may hear its regular speech, or 0 if none of them is constrained. Must only be called by a
+	/// voice thread.
+	std::uint32_t channelBitrateHint(const ServerUser &u) const;
 
 	void readParams();
 
@@ -193,13 +597,24 @@ public:
 	int iCodecBeta;
 	bool bPreferAlpha;
 	bool bOpus;
+	/// The codecs the users support, which are counted as they connect and disconnect
+	CodecVotes m_codecVotes;
+	/// Delays applying the codec votes by CODEC_CHECK_DELAY (see recheckCodecVersions())
+	QTimer *qtCodecCheck;
+	/// The time by which the codec votes are applied after a user has connected or disconnected (in milliseconds)
+	static constexpr int CODEC_CHECK_DELAY = 1000;
+	/// Schedules choosing the codecs again, as the codecs the connected users support have changed. The codecs are
+	/// chosen CODEC_CHECK_DELAY after the first change, so that any number of users connecting or disconnecting in the
+	/// meantime causes at most one announcement of the codecs.
+	///
+	/// @param connectingUser The user that has just connected, whose codecs are added to the votes
 	void recheckCodecVersions(ServerUser *connectingUser = 0);
 
 #ifdef USE_ZEROCONF
 	void initZeroconf();
 	void removeZeroconf();
 #endif
-	// Registration, implementation in Register.cpp
+	// Registration, implementation in Register.cpp. The registrations are sent by Meta's RegistrationWorker.
 	QTimer qtTick;
 	void initRegister();
 
@@ -207,12 +622,33 @@ private:
 	int iChannelNestingLimit;
 	int iChannelCountLimit;
 
-	AudioReceiverBuffer m_udpAudioReceivers;
-	AudioReceiverBuffer m_tcpAudioReceivers;
+	/// One context per voice thread. The first one is used by the Server thread itself, all others by
+	/// the threads in m_voiceThreads.
+	std::vector< std::unique_ptr< VoiceContext > > m_voiceContexts;
+	/// The CPUs the voice threads are pinned to (see voiceThreadCPUs)
+	std::vector< int > m_voiceThreadCPUs;
+	/// The context used by the main thread for routing audio that has been received via TCP
+	VoiceContext m_tcpVoiceContext;
+	std::vector< std::unique_ptr< VoiceThread > > m_voiceThreads;
+
+	/// Whether UDP segmentation offload is actually available on our sockets
+	bool m_udpSegmentationOffload = false;
+	/// Whether UDP receive offload is actually enabled on our sockets
+	bool m_udpReceiveOffload = false;
+
+	struct ChannelEntry {
+		User *user;
+		Channel *channel;
+		/// The message the changes of the user's state are added to
+		MumbleProto::UserState *mpus;
+		/// Whether the user has actually been moved
+		bool moved = false;
+	};
+
+	/// Moves the given users into the given channels (see userEnterChannel)
+	void enterChannels(std::vector< ChannelEntry > &entries);
 
 public slots:
-	void regSslError(const QList< QSslError > &);
-	void finished();
 	void update();
 
 	// Certificate stuff, implemented partially in Cert.cpp
@@ -232,19 +668,106 @@ public slots:
 	void sslError(const QList< QSslError > &);
 	void message(Mumble::Protocol::TCPMessageType, const QByteArray &, ServerUser *cCon = nullptr);
 	void checkTimeout();
-	void tcpTransmitData(QByteArray, unsigned int);
+	/// Chooses the codecs most users support and announces them if they have changed
+	void applyCodecVersions();
+	void drainTCPTunnelQueues();
 	void doSync(unsigned int);
 	void encrypted();
 	void udpActivated(int);
 signals:
 	void reqSync(unsigned int);
-	void tcpTransmit(QByteArray, unsigned int id);
+	/// Emitted by the voice threads once packets have been added to an empty tunnel queue (see VoiceContext)
+	void tcpTunnelPending();
 
 public:
 	int iServerNum;
 	QQueue< unsigned int > qqIds;
+	/// Refills qqIds with all sessions this server may hand out that aren't in use
+	void resetSessionIds();
+	/// @returns Whether the given session is one of the ones in qqIds
+	bool isPooledSession(unsigned int session) const;
+	/// The connection to the other nodes of the cluster or nullptr if this server isn't part of one
+	std::unique_ptr< ClusterNode > m_cluster;
+	/// Records the voice frames and everything that changes who receives them if qsVoiceTraceFile is set, otherwise
+	/// nullptr
+	std::unique_ptr< VoiceTrace::Recorder > m_voiceTrace;
+	/// Opens m_voiceTrace and records the links between the channels that have been read so far
+	void startVoiceTrace();
+	/// The speaker selectors of the channels that are listed in qsSpeakerLimits by channel ID. The map is only
+	/// filled on startup, so the voice threads may use it without locking.
+	std::unordered_map< unsigned int, std::unique_ptr< SpeakerSelector > > m_speakerSelectors;
+	/// Fills m_speakerSelectors from qsSpeakerLimits
+	void readSpeakerLimits();
+	/// Records the speech in the channels listed in qsRecordChannels or nullptr if there are none. Only set on startup,
+	/// so the voice threads may use it without locking.
+	std::unique_ptr< ChannelRecorder > m_recorder;
+	/// Creates m_recorder from qsRecordChannels and qsRecordingDir
+	void startRecording();
+	/// The recent text messages of the channels or nullptr if messageHistory is 0
+	std::unique_ptr< MessageHistory > m_messageHistory;
+	/// Creates m_messageHistory from messageHistory, qsMessageHistoryDir and messageHistoryDays
+	void startMessageHistory();
+	/// Adds the given message, which has been sent to the given channel, to the channel's history
+	void recordTextMessage(const ServerUser &sender, const MumbleProto::TextMessage &msg, unsigned int channel);
+	/// Sends the given page (the latest one if it is negative) of the given channel's history to the given user, if
+	/// the user has asked to be sent the history of the channels it joins
+	void sendMessageHistory(ServerUser *u, const Channel &c, qint64 page = -1);
+	/// Hands the given frame of regular speech to m_recorder if the speaker's channel is recorded
+	void recordSpeech(const ServerUser &u, const VoiceState &state, const Mumble::Protocol::AudioData &audioData,
+					  quint64 now);
+#ifdef USE_SERVER_MIXING
+	/// The mixers of the stage channels by channel ID. The map is only filled on startup, so the voice threads may use
+	/// it without locking.
+	std::unordered_map< unsigned int, std::unique_ptr< StageMixer > > m_stageMixers;
+	/// One context per mixing thread. The mixers of m_stageMixers are spread across them.
+	std::vector< std::unique_ptr< VoiceContext > > m_mixingContexts;
+	std::vector< std::unique_ptr< MixingThread > > m_mixingThreads;
+	std::atomic< bool > m_mixing{ false };
+	/// Fills m_stageMixers from qsStageChannels
+	void readStageChannels();
+	/// Mixes the stage channels that the mixing thread with the given index is responsible for, every
+	/// StageMixer::FRAME_DURATION, until m_mixing is cleared
+	void runMixingLoop(std::size_t index);
+	/// Sends a mixed frame to the listeners of the mixer's channel
+	void sendMix(const StageMixer &mixer, const StageMixer::Frame &frame, VoiceContext &context);
+	/// Routes a frame of the given speaker in a stage channel: it goes to the mixer and to the other speakers
+	void routeStageSpeech(ServerUser &u, StageMixer &mixer, const Mumble::Protocol::AudioData &audioData,
+						  VoiceContext &context);
+#endif
+#ifdef USE_SERVER_TRANSCODING
+	/// The CELT library, if speech is transcoded
+	std::unique_ptr< CELTCodec > m_celt;
+	/// Only exists while the voice threads are running (if speech is transcoded)
+	std::unique_ptr< Transcoder > m_transcoder;
+	/// One context per transcoding thread
+	std::vector< std::unique_ptr< VoiceContext > > m_transcodingContexts;
+	/// Takes the receivers that can't decode the given frame out of the buffer and hands the frame to m_transcoder
+	/// for them
+	void divertToTranscoder(const ServerUser &u, const Mumble::Protocol::AudioData &audioData,
+							AudioReceiverBuffer &buffer);
+	/// Sends a transcoded frame to the receivers it has been transcoded for
+	void sendTranscoded(const Transcoder::Frame &frame, VoiceContext &context);
+#endif
+	/// @returns Whether speech is transcoded, in which case neither Opus nor CELT has to be given up for the other
+	bool isTranscoding() const;
+	/// @returns The volume adjustment the given listener's packets are sent with (see quantizeListenerVolumes)
+	VolumeAdjustment listenerVolumeAdjustment(const ChannelListenerManager::ListenerEntry &listener) const;
+	/// Records that the given channels have been linked or unlinked, if the voice traffic is recorded
+	void traceLink(VoiceTrace::EventType type, const Channel &c, const Channel &l);
+	/// Records that the given user has started or stopped listening to the given channel, if the voice traffic is
+	/// recorded
+	void traceListener(VoiceTrace::EventType type, const ServerUser &user, const Channel &channel);
 	QList< SslServer * > qlServer;
 	QTimer *qtTimeout;
+	/// The length of the ticks of m_timeouts (in milliseconds)
+	static constexpr qint64 TIMEOUT_TICK = 1000;
+	/// The times the authenticated users time out at unless they have been active since, by session (see
+	/// checkTimeout())
+	TimeoutWheel m_timeouts;
+	/// The clock of m_timeouts
+	QElapsedTimer m_timeoutClock;
+	/// Schedules the given user to time out iTimeout after its last activity
+	void scheduleTimeout(const ServerUser *u);
 
 #ifdef Q_OS_UNIX
 	int aiNotify[2];
@@ -257,10 +780,17 @@ public:
 
 	/// This lock provides synchronization between the
 	/// main thread (where control channel messages and
-	/// RPC happens), and the Server's voice thread.
+	/// RPC happens), and the Server's voice threads.
 	///
-	/// These are the only two threads in Murmur that
-	/// access a Server's data.
+	/// These are the only threads in Murmur that access
+	/// a Server's data. There is at least one voice thread
+	/// (the Server thread itself) and there may be more
+	/// (see voiceThreads). Everything said about "the voice
+	/// thread" below applies to every one of them. As all
+	/// of them only read data owned by the main thread, any
+	/// number of them may hold the read lock at once. Data
+	/// that a voice thread writes to (see VoiceContext) is
+	/// never shared with another voice thread.
 	///
 	/// The easiest way to understand the locking strategy
 	/// and synchronization between the main thread and the
@@ -300,43 +830,278 @@ public:
 	///    by itself, it DOES NOT hold a lock on qrwlVoiceThread.
 	///    That is because ownership of data guarantees that no
 	///    other thread can write to that data.
+	///
+	/// The exception to this is the routing state (who is in
+	/// which channel, the channels' audiences and the whisper
+	/// targets), which the voice thread only ever reads from
+	/// the published VoiceState (see m_voiceState). Changing it
+	/// doesn't require the write lock, as the main thread
+	/// publishes a new state instead of modifying the current
+	/// one. The objects a replaced state refers to (users and
+	/// channels) are only deleted once no voice thread can be
+	/// using that state anymore (see retireWithVoiceState).
 	QReadWriteLock qrwlVoiceThread;
 	QHash< unsigned int, ServerUser * > qhUsers;
-	QHash< QPair< HostAddress, quint16 >, ServerUser * > qhPeerUsers;
+	/// Maps the UDP address of every user to the user. Lookups don't need a lock of their own, but
+	/// modifications require the write lock on qrwlVoiceThread (which also makes it safe to reclaim
+	/// replaced snapshots right away, as the voice threads only look peers up while holding the read lock).
+	PeerTable< ServerUser * > m_peerUsers;
+	/// The users by the address they have connected from, whether they are associated with a port (see m_peerUsers)
+	/// or not, as the datagrams from unknown ports are matched against all of them
 	QHash< HostAddress, QSet< ServerUser * > > qhHostUsers;
 	QHash< unsigned int, Channel * > qhChannels;
-
+	/// The routing state the voice threads use. A voice thread loads it after entering m_voiceEpochs and may use it
+	/// until it leaves again. The main thread keeps the state alive through m_publishedVoiceState.
+	std::atomic< const VoiceState * > m_voiceState{ nullptr };
+	std::shared_ptr< const VoiceState > m_publishedVoiceState;
+	/// Tells when the voice threads can no longer be using a replaced VoiceState (main thread only, except for
+	/// entering and leaving)
+	EpochReclaimer m_voiceEpochs;
+	/// The functions that destroy objects the published VoiceState might still refer to. They are retired (see
+	/// m_voiceEpochs) as soon as the next state has been published (main thread only)
+	std::vector< std::function< void() > > m_voiceStateRetirements;
+	/// The channels whose audience has to be rebuilt (main thread only)
+	QSet< unsigned int > m_staleAudiences;
+	/// The users (by session) whose channel has changed since the last state has been published (main thread only)
+	QSet< unsigned int > m_staleMemberships;
+	/// The whisper targets (by the session of the speaker and the target ID) whose cache has to be rebuilt (main
+	/// thread only)
+	QSet< QPair< unsigned int, int > > m_staleWhisperTargets;
+	/// The whisper targets (by target ID) of the registered users (by user ID) who have disconnected, which are
+	/// restored once they connect again (main thread only)
+	QHash< int, QMap< int, SavedWhisperTarget > > m_savedWhisperTargets;
+	/// Whether publishVoiceState() has already been scheduled (main thread only)
+	bool m_voiceStatePublicationPending = false;
+	/// Whether reclaimVoiceStates() has already been scheduled (main thread only)
+	bool m_voiceStateReclaimPending = false;
+
+	/// The parts of the StateSnapshot messages that are the same for all clients supporting them (main thread only)
+	StateSnapshotCache m_stateSnapshots;
+
+	/// Serializes the evaluation of ACLs by the voice threads (which only happens if acCache doesn't know the
+	/// permissions yet) with the changes the main thread makes to the data read by it without holding the write lock
+	/// on qrwlVoiceThread (access tokens, channel memberships and the removal of channels)
 	QMutex qmCache;
+	/// The effective permissions of users in channels. Lookups and stores don't need any lock.
 	ChanACL::ACLCache acCache;
-
-	QHash< int, QString > qhUserNameCache;
-	QHash< QString, int > qhUserIDCache;
+	/// The compiled ACLs of the channels, which are evaluated whenever acCache doesn't know the permissions yet
+	/// (protected by qmCache)
+	ACLProgramCache m_aclPrograms;
+
+	/// The names and IDs of registered users that have been looked up recently
+	UserNameCache m_userNameCache;
+
+	/// What the voice threads and the main thread have done, as exported by the MetricsServer
+	Metrics::ServerMetrics m_metrics;
+	/// Ends the period of the latency histograms in m_metrics once per minute
+	QTimer m_metricsRotation;
+
+	/// A password that has been verified recently (see verifyPassword())
+	struct VerifiedCredential {
+		int userId;
+		/// The stored PBKDF2 hash the password has been verified against, so that changing the password takes effect
+		/// right away
+		QString storedHash;
+		/// A cheap digest of the salt and the password that has been verified
+		QByteArray digest;
+		/// When the password has been verified (see tUptime)
+		quint64 verified;
+	};
+	/// The passwords that have been verified recently, by the hash of the certificate they have been used with
+	QHash< QString, VerifiedCredential > m_verifiedCredentials;
+	/// How long a verified password is remembered for
+	static constexpr quint64 VERIFIED_CREDENTIAL_MICROSECONDS = 60ULL * 1000 * 1000;
+	static constexpr int MAX_VERIFIED_CREDENTIALS = 4096;
+	/// Derives password hashes and validates large texts in the background (see deferPasswordCheck() and
+	/// deferTextValidation()). It is shut down before the users are deleted.
+	DeferredWork m_deferredWork;
+	/// The hashes of the textures of registered users that have been loaded from the database (empty for users
+	/// without a texture), by which they can be found in Meta::m_blobStore
+	QHash< int, QByteArray > m_textureHashes;
 
 	QList< Ban > qlBans;
-
-	void addListener(QHash< ServerUser *, VolumeAdjustment > &listeners, ServerUser &user, const Channel &channel);
-	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer,
-					Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > &encoder);
-	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, bool force = false);
+	/// The bans of qlBans, indexed for the checks of incoming connections. It has to be updated along with qlBans.
+	BanIndex m_banIndex;
+
+	/// Marks the audience of the given channel and of all channels linked to it as stale and schedules a new
+	/// VoiceState with rebuilt audiences. Has to be called by the main thread whenever the users in a channel, its
+	/// links or its listeners change. Until the new state has been published, the voice threads keep using the
+	/// previous audiences.
+	void invalidateAudience(unsigned int channelID);
+	/// Marks the channel of the given user as changed and schedules a new VoiceState
+	void invalidateMembership(unsigned int session);
+	/// Schedules publishVoiceState()
+	void scheduleVoiceStatePublication();
+	/// Builds a new VoiceState from the published one, in which everything that has been invalidated since is
+	/// brought up to date, and publishes it. The replaced state is reclaimed once the voice threads are done with it.
+	void publishVoiceState();
+	/// Destroys all replaced VoiceStates (and the objects retired along with them) that the voice threads can no
+	/// longer be using and schedules itself again as long as there are others left
+	void reclaimVoiceStates();
+	/// Calls the given function (which is supposed to delete an object the voice threads might know about, such as
+	/// a user or a channel) once no voice thread can be using a VoiceState that refers to that object anymore. The
+	/// object has to be gone from the main thread's own data structures already, so that the next state won't
+	/// refer to it.
+	void retireWithVoiceState(std::function< void() > destroy);
+	/// Rebuilds the audiences of all channels that have been invalidated (see invalidateAudience)
+	void rebuildAudiences(VoiceState &state);
+	std::unique_ptr< ChannelAudience > buildAudience(Channel *c) const;
+	/// Appends the users in the given channel and the ones listening to it to the given list. The channel's audience
+	/// is used for this, if it is up to date.
+	void addTextMessageReceivers(Channel *c, std::vector< ServerUser * > &receivers) const;
+	/// Adds the receivers of regular speech (based on the given audience of the speaker's channel) to the buffer
+	void addRegularSpeechReceivers(ServerUser &u, const ChannelAudience &audience, bool positional,
+								   AudioReceiverBuffer &buffer);
+	/// Collects the receivers of the given whisper target of the given user. This is done by the main thread
+	/// whenever a target's cache has to be rebuilt (see refreshWhisperTargets).
+	WhisperTargetCache buildWhisperTargetCache(ServerUser *u, const WhisperTarget &wt);
+	/// Keeps the whisper targets of the given registered user, who is disconnecting, for the next time they connect
+	void saveWhisperTargets(const ServerUser &u);
+	/// Gives the given user, who has just authenticated, the whisper targets they had when they last disconnected.
+	/// Their caches are built along with the next VoiceState, so that they are ready before the client re-sends its
+	/// targets (which then don't change anything, see msgVoiceTarget).
+	void restoreWhisperTargets(ServerUser &u);
+	void processMsg(ServerUser *u, Mumble::Protocol::AudioData audioData, VoiceContext &context);
+	/// Encodes the given audio for all receivers in the given buffer (one of the context's) and sends it to them
+	void sendAudio(Mumble::Protocol::AudioData audioData, AudioReceiverBuffer &buffer, VoiceContext &context);
+	/// Adds regular speech of the given user, who is in the given channel, to the context's batches for the other
+	/// nodes of the cluster and the relay links
+	void relayRegularSpeech(ServerUser &u, unsigned int channel, const ChannelAudience &audience,
+							const Mumble::Protocol::AudioData &audioData, VoiceContext &context);
+	/// Routes a voice frame of a user connected to another node of the cluster to the local users
+	void processRemoteVoice(const ClusterProtocol::Voice &voice);
+	/// Sends the given data to the given user. If the user can be reached via UDP, the encrypted packet is
+	/// put into the context's send queue and it is the caller's responsibility to flush that queue afterwards.
+	void sendMessage(ServerUser &u, const unsigned char *data, int len, QByteArray &cache, VoiceContext &context,
+					 bool force = false);
+	/// Sends the same packet to several users that can all be reached via UDP (see sendMessage()). The packet is
+	/// encrypted for all of them at once (see CryptState::encryptBatch()). The given list is reordered.
+	void sendUDPBatch(ServerUser **users, std::size_t count, const unsigned char *data, int len,
+					  VoiceContext &context);
+	/// Queues the packet that has been encrypted for the given user into the buffer that has last been obtained
+	/// from the context's send queue
+	void commitUDP(ServerUser &u, VoiceContext::socket_t sock, std::size_t length, VoiceContext &context);
+#ifdef Q_OS_WIN
+	/// Puts the UDP packets sent to the given user (through the user's socket to the user's current address) into a
+	/// qWAVE flow of their own, replacing the flow the user has had so far (see ServerUser::m_qosFlow). Called
+	/// whenever the address is learned or changes, so that sending a packet doesn't have to touch the flows.
+	void updateQoSFlow(ServerUser &u);
+#endif
 	void run();
+	/// The loop of every voice thread: Receives packets on the context's sockets and routes them until
+	/// the voice threads are stopped.
+	void runVoiceLoop(VoiceContext &context);
+	/// Handles a single packet that has been received by a voice thread. The caller has to hold a read lock on
+	/// qrwlVoiceThread (see below). Packets from unknown peers are only queued for associatePendingPeers().
+	void processDatagram(VoiceContext &context, const VoiceDatagram &datagram);
+	/// Hands everything that has been queued in the given context while processing a batch of packets over to
+	/// the kernel (UDP) or the main thread (TCP tunnel)
+	void flushVoiceContext(VoiceContext &context);
+	/// Handles a decrypted packet of the given user. The packet's plain text has to start with the message type.
+	void processDecryptedDatagram(VoiceContext &context, ServerUser *u, unsigned char *plain, unsigned int len);
+	/// Tries to match the packets from unknown peers that have been collected while processing the last batch
+	/// with the users that connected from the respective hosts. All peers identified this way are associated
+	/// with their user while holding the write lock only once. The given locker has to hold a read lock on
+	/// qrwlVoiceThread and will do so again once the function returns.
+	void associatePendingPeers(VoiceContext &context, Audit::ReadLocker &rl);
+#ifdef USE_IO_URING
+	/// The io_uring based variant of runVoiceLoop()
+	///
+	/// @returns false, if io_uring can't be used (in which case the caller is expected to fall back to poll())
+	bool runIOUringVoiceLoop(VoiceContext &context);
+#endif
+#ifdef Q_OS_WIN
+	/// The Registered I/O based variant of runVoiceLoop()
+	///
+	/// @returns false, if Registered I/O can't be used (in which case the caller is expected to fall back to
+	/// 	receiving the packets one by one)
+	bool runRegisteredIOVoiceLoop(VoiceContext &context);
+#endif
 
 	bool validateChannelName(const QString &name);
 	bool validateUserName(const QString &name);
 
-	bool checkDecrypt(ServerUser *u, const unsigned char *encrypted, unsigned char *plain, unsigned int cryptlen);
+	/// Decrypts a packet from the given user while holding the lock of the decrypting half of the user's crypt
+	/// state (ServerUser::qmDecrypt).
+	///
+	/// @param[out] plainlen Receives the length of the plain text if the packet could be decrypted
+	/// @returns Whether the packet could be decrypted
+	bool checkDecrypt(ServerUser *u, const unsigned char *encrypted, unsigned char *plain, unsigned int cryptlen,
+					  unsigned int &plainlen);
 
 	bool hasPermission(ServerUser *p, Channel *c, QFlags< ChanACL::Perm > perm);
 	QFlags< ChanACL::Perm > effectivePermissions(ServerUser *p, Channel *c);
 	void sendClientPermission(ServerUser *u, Channel *c, bool explicitlyRequested = false);
 	void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
+	/// The maximum number of changed channel permissions pushClientPermissionChanges() sends to a client one by one.
+	/// If more have changed, the client's permission cache is flushed instead.
+	static constexpr int MAX_PERMISSION_PUSH = 20;
+	/// Sends the client the permissions that have changed in the channels of the given branch, out of the ones it has
+	/// been told about before. Unlike flushClientPermissionCache(), this leaves the client's other cached permissions
+	/// alone, so that it doesn't have to query them all again.
+	void pushClientPermissionChanges(ServerUser *u, const QSet< Channel * > &branch,
+									 MumbleProto::PermissionQuery &mppq);
 	void clearACLCache(User *p = nullptr);
+	/// Invalidates the cached permissions in the given channel and all of its children, which is what is needed after
+	/// the ACLs or groups of the channel have been changed or after it has been moved within the channel tree
+	void clearACLCacheOfBranch(Channel *chan);
+	/// Drops the compiled ACL programs of the given channel and all of its children. As the programs refer to the
+	/// groups of these channels, this has to happen before any of these groups are deleted.
+	void dropACLPrograms(const Channel &chan);
+	/// Updates the suppression state of the given user according to the Speak permission in the user's channel
+	void recheckSuppression(ServerUser *user);
+	/// Drops all whisper target caches and schedules them to be rebuilt
 	void clearWhisperTargetCache();
-
+	/// Drops the caches of all whisper targets that depend on any of the given channels or users (by session) or
+	/// that belong to any of the given users and schedules them to be rebuilt. Has to be called by the main thread.
+	void invalidateWhisperTargets(const QSet< unsigned int > &channels, const QSet< unsigned int > &sessions);
+	/// Invalidates the whisper targets that depend on the given channel or any of its parents, which is what is
+	/// needed when the channel is added to, moved within or removed from the channel tree
+	void invalidateWhisperTargetsOfBranch(const Channel *c);
+	/// Invalidates the whisper targets that depend on the given channel or any channel linked to it (directly or
+	/// indirectly)
+	void invalidateWhisperTargetsOfLinks(Channel *c);
+	/// Rebuilds the caches of all whisper targets that have been invalidated (or changed) and updates the given state
+	/// accordingly
+	void refreshWhisperTargets(VoiceState &state);
+
+	/// Fills the given (cleared) ChannelState message with the state of the given channel, apart from the enter states
+	/// (which depend on the receiver) and the links
+	///
+	/// @param hashes Whether the receiver knows about description hashes
+	void setChannelState(MumbleProto::ChannelState &mpcs, const Channel *c, bool hashes);
+	/// Fills the given (cleared) UserState message with the state of the given user
+	///
+	/// @param hashes Whether the receiver knows about texture and comment hashes. If not, the texture is left out.
+	void setUserState(MumbleProto::UserState &mpus, const ServerUser *u, bool hashes);
+	/// Sends the channel tree to the given user as a StateSnapshot
+	///
+	/// @returns Whether the snapshot has been sent. If not (because it is too big), the channels have to be sent
+	/// 	individually.
+	bool sendChannelSnapshot(ServerUser *u);
+	/// Sends all authenticated users except for the given one to it as a StateSnapshot
+	///
+	/// @returns Whether the snapshot has been sent. If not (because it is too big), the users have to be sent
+	/// 	individually.
+	bool sendUserSnapshot(ServerUser *u);
+	/// Checks the given plugin message sent by the given user and strips it of what the receivers don't need
+	///
+	/// @param[out] receivers The users the message has to be relayed to
+	/// @returns Whether the message can be relayed
+	bool preparePluginData(ServerUser *sender, MumbleProto::PluginDataTransmission &msg,
+						   QList< ServerUser * > &receivers);
+	/// Relays the given (prepared) plugin messages to their receivers. Every message is serialized only once, and the
+	/// messages of receivers that can process PluginDataBatch messages are batched.
+	void relayPluginData(const std::vector< MumbleProto::PluginDataTransmission > &messages,
+						 const std::vector< QList< ServerUser * > > &receivers);
 	void sendProtoAll(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
 					  Version::full_t version, Version::CompareMode mode);
 	void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type,
 						 Version::full_t version, Version::CompareMode mode);
 	void sendProtoMessage(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
+	/// Sends a message carrying a requested blob (texture, comment or description), which is queued behind all other
+	/// messages (see Connection::SendLane)
+	void sendBlob(ServerUser *, const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
 
 	// sendAll sends a protobuf message to all users on the server whose version is either bigger than v or
 	// lower than ~v. If v == 0 the message is sent to everyone.
@@ -358,7 +1123,36 @@ public:
 
 	static void hashAssign(QString &destination, QByteArray &hash, const QString &str);
 	static void hashAssign(QByteArray &destination, QByteArray &hash, const QByteArray &source);
+	/// The settings text messages, comments and descriptions are checked against
+	struct TextLimits {
+		bool allowHTML;
+		int maxTextLength;
+		int maxImageLength;
+	};
+	TextLimits textLimits() const;
+	/// Filters the given text and checks it against the given limits. It doesn't access the server, so it may be
+	/// called by any thread.
+	static bool isTextAllowed(QString &str, bool &changed, const TextLimits &limits);
 	bool isTextAllowed(QString &str, bool &changed);
+	/// Like isTextAllowed(), but takes the result of validating the text in the background if the given user's
+	/// message is being replayed after that (see deferTextValidation)
+	bool isTextAllowed(ServerUser *user, QString &str, bool &changed);
+	/// A fast check that is done before the text is even decoded
+	/// @param utf8Length The length of the UTF-8 encoded text in bytes
+	/// @returns Whether the text is too long to ever be allowed, no matter what it contains
+	bool exceedsTextLimits(std::size_t utf8Length) const;
+	/// Validates the given text of one of the user's messages on a worker thread, if it is large or if the user has
+	/// messages being validated already (so that the user's messages are handled in the order they have been sent).
+	/// Once the text has been validated, the given function is called on the main thread to handle the message
+	/// again, with isTextAllowed() taking the result.
+	/// @returns Whether the message has been deferred or dropped, in which case it must not be handled any further
+	bool deferTextValidation(ServerUser *user, const std::string &text, std::function< void() > replay);
+	/// Validates the text of the user's oldest message that is waiting to be validated in the background
+	void startTextValidation(ServerUser *user);
+	/// Texts smaller than this are validated right away, as handing them to a worker costs more than it saves
+	static constexpr std::size_t ASYNC_TEXT_VALIDATION_BYTES = 16 * 1024;
+	/// How many messages of a single user may wait for their text to be validated. Any further ones are dropped.
+	static constexpr std::size_t MAX_PENDING_TEXT_VALIDATIONS = 4;
 
 	void setLiveConf(const QString &key, const QString &value);
 
@@ -370,9 +1164,14 @@ public:
 	void removeChannel(unsigned int id);
 	void removeChannel(Channel *c, Channel *dest = nullptr);
 	void userEnterChannel(User *u, Channel *c, MumbleProto::UserState &mpus);
+	/// Moves several users at once and tells everyone about it. This is a lot cheaper than moving them one by one, as
+	/// the caches are invalidated and the database is updated only once.
+	void moveUsers(const QList< QPair< User *, Channel * > > &moves);
 	bool unregisterUser(int id);
 
-	Server(int snum, QObject *parent = nullptr);
+	/// @param bootState The state of the server, if it has been read from the database already. Otherwise it is read
+	/// 	by the constructor.
+	Server(int snum, QObject *parent = nullptr, const ServerBootState *bootState = nullptr);
 	~Server();
 
 	bool canNest(Channel *newParent, Channel *channel = nullptr) const;
@@ -428,18 +1227,37 @@ public:
 	bool isChannelFull(Channel *c, ServerUser *u = 0);
 
 	// Database / DBus functions. Implementation in ServerDB.cpp
-	void initialize();
+	/// Creates the root channel, the SuperUser and the default ACLs and groups if they don't exist yet
+	///
+	/// @returns Whether anything had to be created
+	bool initialize();
+	/// Reads the state of the given server from the database. This may be called on any thread.
+	static ServerBootState loadBootState(int srvnum);
 	int authenticate(QString &name, const QString &pw, int sessionId = 0, const QStringList &emails = QStringList(),
 					 const QString &certhash = QString(), bool bStrongCert = false,
 					 const QList< QSslCertificate > & = QList< QSslCertificate >());
+	/// Starts deriving the hash of the password the given user tries to authenticate with on a worker thread, if
+	/// verifying it would be expensive. Once the hash is known, the authentication is processed again on the main
+	/// thread, which then uses the derived hash (see verifyPassword()).
+	///
+	/// @returns Whether the authentication has been deferred
+	bool deferPasswordCheck(ServerUser *user, const MumbleProto::Authenticate &msg);
+	/// @param sessionId The session of the user that tries to authenticate, whose password might have been derived
+	/// 	in the background already
+	/// @param certhash The hash of the user's certificate. If the same password has been verified together with the
+	/// 	same certificate recently, the password isn't derived again.
+	/// @returns Whether the given password matches the stored PBKDF2 hash
+	bool verifyPassword(int sessionId, const QString &certhash, int userId, const QString &password,
+						const QString &salt, int iterations, const QString &storedHash);
 	Channel *addChannel(Channel *c, const QString &name, bool temporary = false, int position = 0,
 						unsigned int maxUsers = 0);
 	void removeChannelDB(const Channel *c);
-	void readChannels(Channel *p = nullptr);
-	void readLinks();
+	void readChannels(const ServerBootState &state);
+	void readLinks(const ServerBootState &state);
+	void readListeners(const ServerBootState &state);
 	void updateChannel(const Channel *c);
-	void readChannelPrivs(Channel *c);
 	void setLastChannel(const User *u);
+	void setLastChannels(const QList< const User * > &users);
 	int readLastChannel(int id);
 
 	/// Set last_disconnect of a registered user to the current time
@@ -447,7 +1265,8 @@ public:
 	void dumpChannel(const Channel *c);
 	int getUserID(const QString &name);
 	QString getUserName(int id);
-	QByteArray getUserTexture(int id);
+	/// @param[out] hash If non-null, receives the hash of the texture (see hashAssign())
+	QByteArray getUserTexture(int id, QByteArray *hash = nullptr);
 	QMap< int, QString > getRegistration(int id);
 	int registerUser(const QMap< int, QString > &info);
 	bool unregisterUserDB(int id);
@@ -458,7 +1277,7 @@ public:
 	bool isUserId(int id);
 	void addLink(Channel *c, Channel *l);
 	void removeLink(Channel *c, Channel *l);
-	void getBans();
+	void getBans(const ServerBootState &state);
 	void saveBans();
 	QVariant getConf(const QString &key, QVariant def);
 	void setConf(const QString &key, const QVariant &value);
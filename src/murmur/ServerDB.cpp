@@ -14,19 +14,31 @@
 #include "ACL.h"
 #include "Channel.h"
 #include "Connection.h"
+#include "DBTrace.h"
 #include "Group.h"
 #include "Meta.h"
 #include "PBKDF2.h"
 #include "PasswordGenerator.h"
+#include "QtUtils.h"
 #include "Server.h"
+#include "ServerDBWriter.h"
 #include "ServerUser.h"
 #include "User.h"
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QMetaMethod>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtSql/QSqlDriver>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
 
+#include <algorithm>
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
@@ -38,32 +50,143 @@
 #define SQLDO(x) ServerDB::exec(query, QLatin1String(x), true)
 #define SQLDO_NO_CONVERSION(x) ServerDB::exec(query, x, true)
 #define SQLMAY(x) ServerDB::exec(query, QLatin1String(x), false, false)
-#define SQLPREP(x) ServerDB::prepare(query, QLatin1String(x))
+#define SQLPREP(x) ServerDB::prepareCached(query, QLatin1String(x))
 #define SQLEXEC() ServerDB::exec(query)
 #define SQLEXECBATCH() ServerDB::execBatch(query)
 #define SOFTEXEC() ServerDB::exec(query, QString(), false)
 
+QSqlDatabase *ServerDB::db       = nullptr;
+QSqlDatabase *ServerDB::replica  = nullptr;
+ServerDBWriter *ServerDB::writer = nullptr;
+ServerDB::ConnectionParameters ServerDB::connectionParameters;
+ServerDB::StatementCache ServerDB::statementCache;
+ServerDB::StatementCache ServerDB::replicaStatementCache;
+
+/// Whether the database only exists in memory, in which case it can't be shared by several connections
+static bool inMemoryDatabase = false;
+
+/// The configuration of the servers (see ServerDB::getConf()) by server and key. Every server's configuration is read
+/// with a single query the first time it is needed and then kept in sync by ServerDB::setConf(), so that looking up
+/// a key doesn't need a query anymore. This assumes that the config table isn't changed behind the server's back
+/// while it is running.
+static QHash< int, QHash< QString, QString > > configCache;
+static QMutex configCacheMutex;
+/// Incremented whenever a configuration is changed, so that a configuration read at the same time isn't cached
+static quint64 configGeneration = 0;
+
+/// Records the executed statements if Meta::mp.qsDBTraceFile is set, otherwise nullptr
+static DBTrace::Recorder *traceRecorder = nullptr;
+
+namespace {
+/// The connection of a thread other than the main and the write-behind thread (e.g. a voice thread that writes to
+/// the log), which is closed when the thread ends
+struct ThreadConnection {
+	QString name;
+	ServerDB::StatementCache statementCache;
+
+	ThreadConnection()
+		: name(QString::fromLatin1("thread_%1").arg(reinterpret_cast< quintptr >(QThread::currentThread()))) {
+		if (!ServerDB::connectionParameters.open(name).isOpen()) {
+			qWarning("ServerDB: Failed to open a connection for thread %s", qPrintable(name));
+		}
+	}
+
+	~ThreadConnection() {
+		statementCache.statements.clear();
+		QSqlDatabase::database(name, false).close();
+		QSqlDatabase::removeDatabase(name);
+	}
+};
+
+QThreadStorage< ThreadConnection * > threadConnections;
+
+/// @returns Whether the calling thread is the one that has opened ServerDB::db
+bool isMainThread() {
+	return QThread::currentThread() == ServerDB::db->driver()->thread();
+}
+
+/// @returns The connection of the calling thread, if it isn't the main or the write-behind thread
+ThreadConnection &threadConnection() {
+	if (!threadConnections.hasLocalData()) {
+		threadConnections.setLocalData(new ThreadConnection());
+	}
+
+	return *threadConnections.localData();
+}
+} // namespace
+
+/// @returns The connection the calling thread uses for the primary database: The main thread uses ServerDB::db, the
+/// 	write-behind thread its own connection and every other thread gets a connection of its own
+static QSqlDatabase currentDatabase() {
+	if (ServerDB::writer && ServerDB::writer->isCurrentThread()) {
+		return ServerDB::writer->database();
+	}
+	if (inMemoryDatabase || isMainThread()) {
+		return *ServerDB::db;
+	}
+
+	return QSqlDatabase::database(threadConnection().name, false);
+}
+
+/// @returns The prepared statements of the connection the calling thread uses (see currentDatabase())
+static ServerDB::StatementCache &currentStatementCache() {
+	if (ServerDB::writer && ServerDB::writer->isCurrentThread()) {
+		return ServerDB::writer->statementCache();
+	}
+	if (inMemoryDatabase || isMainThread()) {
+		return ServerDB::statementCache;
+	}
+
+	return threadConnection().statementCache;
+}
+
+/// @returns Whether the given query belongs to the replica connection
+static bool isReplicaQuery(const QSqlQuery &query) {
+	return ServerDB::replica && query.driver() == ServerDB::replica->driver();
+}
+
+/// @returns The connection the given query belongs to
+static QSqlDatabase databaseOf(const QSqlQuery &query) {
+	return isReplicaQuery(query) ? *ServerDB::replica : currentDatabase();
+}
+
+/// @returns The prepared statements of the connection the given query belongs to
+static ServerDB::StatementCache &statementCacheOf(const QSqlQuery &query) {
+	return isReplicaQuery(query) ? ServerDB::replicaStatementCache : currentStatementCache();
+}
 
 class TransactionHolder {
 public:
 	QSqlQuery *qsqQuery;
-	TransactionHolder() {
-		ServerDB::db->transaction();
-		qsqQuery = new QSqlQuery();
+	QSqlDatabase database;
+	/// The parts of the database that are written behind and that the transaction reads or writes
+	ServerDB::Dependencies dependencies;
+	/// @param dependencies The parts of the database that are written behind (see ServerDB::writeBehind) and that the
+	/// 	transaction reads or writes. The transaction only waits for the queued writes that change these.
+	/// @param readOnly Whether the transaction only reads, in which case it uses the read replica if there is one.
+	/// 	The replica may lag behind the primary a bit, so this must not be used for reads that have to see a write
+	/// 	that has just happened.
+	explicit TransactionHolder(ServerDB::Dependencies dependencies = ServerDB::AllDependencies, bool readOnly = false)
+		: dependencies(dependencies) {
+		// Whatever is done on the main connection has to see the writes that have been queued before
+		ServerDB::flush(dependencies);
+		database = (readOnly && ServerDB::replica && isMainThread()) ? *ServerDB::replica : currentDatabase();
+		database.transaction();
+		qsqQuery = new QSqlQuery(database);
 	}
 
 	~TransactionHolder() {
+		ServerDB::releaseStatement(*qsqQuery);
 		qsqQuery->clear();
 		delete qsqQuery;
-		ServerDB::db->commit();
+		database.commit();
 	}
-	TransactionHolder(const TransactionHolder &other) {
-		ServerDB::db->transaction();
+	TransactionHolder(const TransactionHolder &other) : database(other.database), dependencies(other.dependencies) {
+		ServerDB::flush(dependencies);
+		database.transaction();
 		qsqQuery = other.qsqQuery ? new QSqlQuery(*other.qsqQuery) : 0;
 	}
 };
-
-QSqlDatabase *ServerDB::db = nullptr;
 Timer ServerDB::tLogClean;
 QString ServerDB::qsUpgradeSuffix;
 
@@ -172,6 +295,53 @@ ServerDB::ServerDB() {
 		qFatal("ServerDB: Failed initialization: %s", qPrintable(e.text()));
 	}
 
+	connectionParameters.driver         = db->driverName();
+	connectionParameters.databaseName   = db->databaseName();
+	connectionParameters.hostName       = db->hostName();
+	connectionParameters.port           = db->port();
+	connectionParameters.userName       = db->userName();
+	connectionParameters.password       = db->password();
+	connectionParameters.connectOptions = db->connectOptions();
+
+	// An in-memory SQLite database can't be shared by several connections
+	inMemoryDatabase = Meta::mp.qsDBDriver == "QSQLITE"
+					   && (db->databaseName() == QLatin1String(":memory:")
+						   || db->databaseName().contains(QLatin1String("mode=memory")));
+
+	if (!Meta::mp.qsDBReplicaHost.isEmpty()) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			qWarning("ServerDB: SQLite doesn't support read replicas, ignoring dbReplicaHost");
+		} else {
+			ConnectionParameters replicaParameters = connectionParameters;
+			replicaParameters.hostName             = Meta::mp.qsDBReplicaHost;
+			if (Meta::mp.iDBReplicaPort > 0) {
+				replicaParameters.port = Meta::mp.iDBReplicaPort;
+			}
+
+			replica = new QSqlDatabase(replicaParameters.open(QLatin1String("replica")));
+			if (replica->isOpen()) {
+				qWarning("ServerDB: Using the read replica at %s", qPrintable(Meta::mp.qsDBReplicaHost));
+			} else {
+				qWarning("ServerDB: Failed to connect to the read replica, using the primary database only: %s",
+						 qPrintable(replica->lastError().text()));
+				delete replica;
+				replica = nullptr;
+				QSqlDatabase::removeDatabase(QLatin1String("replica"));
+			}
+		}
+	}
+
+	if (!Meta::mp.qsDBTraceFile.isEmpty()) {
+		traceRecorder = new DBTrace::Recorder(Meta::mp.qsDBTraceFile);
+		if (traceRecorder->isOpen()) {
+			qWarning("ServerDB: Recording the executed statements to %s", qPrintable(Meta::mp.qsDBTraceFile));
+		} else {
+			qWarning("ServerDB: Failed to open the trace file %s", qPrintable(Meta::mp.qsDBTraceFile));
+			delete traceRecorder;
+			traceRecorder = nullptr;
+		}
+	}
+
 	// Use SQLite in WAL mode if possible.
 	if (Meta::mp.qsDBDriver == "QSQLITE") {
 		if (Meta::mp.iSQLiteWAL == 0) {
@@ -873,23 +1043,63 @@ ServerDB::ServerDB() {
 		}
 	}
 	query.clear();
+
+	if (Meta::mp.bDBWriteBehind && !inMemoryDatabase) {
+		writer = new ServerDBWriter(connectionParameters);
+	}
 }
 
 ServerDB::~ServerDB() {
+	// Performs the pending writes
+	delete writer;
+	writer = nullptr;
+
+	if (replica) {
+		replicaStatementCache.statements.clear();
+		replica->close();
+		delete replica;
+		replica = nullptr;
+		QSqlDatabase::removeDatabase(QLatin1String("replica"));
+	}
+
+	clearStatementCache();
 	db->close();
 	delete db;
 	db = nullptr;
+
+	delete traceRecorder;
+	traceRecorder = nullptr;
 }
 
-bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
-	if (!db->isValid()) {
-		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
-		return false;
+QSqlDatabase ServerDB::ConnectionParameters::open(const QString &name) const {
+	QSqlDatabase database = QSqlDatabase::addDatabase(driver, name);
+	database.setDatabaseName(databaseName);
+	database.setHostName(hostName);
+	database.setPort(port);
+	database.setUserName(userName);
+	database.setPassword(password);
+	database.setConnectOptions(connectOptions);
+
+	if (!database.open()) {
+		return database;
 	}
+
+	// The journal mode is stored in the database, but the synchronous setting is per connection
+	if (driver == QLatin1String("QSQLITE") && (Meta::mp.iSQLiteWAL == 1 || Meta::mp.iSQLiteWAL == 2)) {
+		QSqlQuery query(database);
+		query.exec(Meta::mp.iSQLiteWAL == 1 ? QLatin1String("PRAGMA synchronous=NORMAL;")
+											: QLatin1String("PRAGMA synchronous=FULL;"));
+	}
+
+	return database;
+}
+
+/// @returns The given SQL with the table prefix (and upgrade suffix) filled in and quoted for the driver in use
+static QString formatStatement(const QString &str) {
 	QString q;
 	if (str.contains(QLatin1String("%1"))) {
 		if (str.contains(QLatin1String("%2")))
-			q = str.arg(Meta::mp.qsDBPrefix, qsUpgradeSuffix);
+			q = str.arg(Meta::mp.qsDBPrefix, ServerDB::qsUpgradeSuffix);
 		else
 			q = str.arg(Meta::mp.qsDBPrefix);
 	} else {
@@ -900,20 +1110,34 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 		q.replace("`", "\"");
 	}
 
+	return q;
+}
+
+bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
+	QSqlDatabase database = databaseOf(query);
+	if (!database.isValid()) {
+		qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
+		return false;
+	}
+	const QString q = formatStatement(str);
+
 	if (query.prepare(q)) {
 		return true;
 	} else {
-		db->close();
-		if (!db->open()) {
-			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(db->lastError().text()));
+		// The statements that have been prepared on the old connection can't be used anymore
+		statementCacheOf(query).statements.clear();
+		database.close();
+		if (!database.open()) {
+			qFatal("Lost connection to SQL Database: Reconnect: %s", qPrintable(database.lastError().text()));
 		}
-		query = QSqlQuery();
+		query = QSqlQuery(database);
 		if (query.prepare(q)) {
 			qWarning("SQL Connection lost, reconnection OK");
 			return true;
 		}
 
 		if (fatal) {
+			clearStatementCache();
 			*db = QSqlDatabase();
 			qFatal("SQL Prepare Error [%s]: %s", qPrintable(q), qPrintable(query.lastError().text()));
 		} else if (warn) {
@@ -923,30 +1147,75 @@ bool ServerDB::prepare(QSqlQuery &query, const QString &str, bool fatal, bool wa
 	}
 }
 
+bool ServerDB::prepareCached(QSqlQuery &query, const QString &str) {
+	QSqlDatabase database = databaseOf(query);
+	if (!database.isValid()) {
+		return prepare(query, str);
+	}
+
+	// The caller is done with whatever statement the query has been prepared with before
+	releaseStatement(query);
+
+	const QString q       = formatStatement(str);
+	StatementCache &cache = statementCacheOf(query);
+	auto it               = cache.statements.find(q);
+	if (it != cache.statements.end()) {
+		// The statement is handed over to the caller until it is released again, so that nobody else can use it
+		// in the meantime
+		QSqlQuery statement = it.value();
+		cache.statements.erase(it);
+
+		if (statement.driver() == database.driver()) {
+			query = statement;
+			return true;
+		}
+	}
+
+	if (!prepare(query, str)) {
+		return false;
+	}
+
+	cache.cacheable.insert(q);
+	return true;
+}
+
+void ServerDB::releaseStatement(QSqlQuery &query) {
+	StatementCache &cache = statementCacheOf(query);
+
+	const QString key = query.lastQuery();
+	if (key.isEmpty() || !cache.cacheable.contains(key)) {
+		return;
+	}
+
+	query.finish();
+	cache.statements.insert(key, query);
+	// The caller must not use the cached statement anymore
+	query = QSqlQuery(databaseOf(query));
+}
+
+void ServerDB::clearStatementCache() {
+	currentStatementCache().statements.clear();
+}
+
 bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (!str.isEmpty()) {
-		if (!db->isValid()) {
+		if (!databaseOf(query).isValid()) {
 			qWarning("SQL [%s] rejected: Database is gone", qPrintable(str));
 			return false;
 		}
-		QString q;
-		if (str.contains(QLatin1String("%1"))) {
-			if (str.contains(QLatin1String("%2")))
-				q = str.arg(Meta::mp.qsDBPrefix, qsUpgradeSuffix);
-			else
-				q = str.arg(Meta::mp.qsDBPrefix);
-		} else {
-			q = str;
-		}
+		const QString q = formatStatement(str);
 
-		if (Meta::mp.qsDBDriver == "QPSQL") {
-			q.replace("`", "\"");
+		const qint64 started = traceRecorder ? traceRecorder->now() : 0;
+		const bool success   = query.exec(q);
+		if (traceRecorder) {
+			traceRecorder->record(query, false, started);
 		}
 
-		if (query.exec(q)) {
+		if (success) {
 			return true;
 		} else {
 			if (fatal) {
+				clearStatementCache();
 				*db = QSqlDatabase();
 				qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 			} else if (warn) {
@@ -962,10 +1231,18 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (!str.isEmpty())
 		prepare(query, str, fatal, warn);
-	if (query.exec()) {
+
+	const qint64 started = traceRecorder ? traceRecorder->now() : 0;
+	const bool success   = query.exec();
+	if (traceRecorder) {
+		traceRecorder->record(query, false, started);
+	}
+
+	if (success) {
 		return true;
 	} else {
 		if (fatal) {
+			clearStatementCache();
 			*db = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else if (warn) {
@@ -978,10 +1255,18 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 	if (!str.isEmpty())
 		prepare(query, str, fatal);
-	if (query.execBatch()) {
+
+	const qint64 started = traceRecorder ? traceRecorder->now() : 0;
+	const bool success   = query.execBatch();
+	if (traceRecorder) {
+		traceRecorder->record(query, true, started);
+	}
+
+	if (success) {
 		return true;
 	} else {
 		if (fatal) {
+			clearStatementCache();
 			*db = QSqlDatabase();
 			qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
 		} else
@@ -990,7 +1275,29 @@ bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 	}
 }
 
-void Server::initialize() {
+void ServerDB::writeBehind(Dependencies changes, const std::function< void(QSqlQuery &query) > &task,
+							const QString &key) {
+	if (writer) {
+		writer->enqueue(task, changes, key);
+	} else {
+		TransactionHolder th(changes);
+		task(*th.qsqQuery);
+	}
+}
+
+void ServerDB::flush(Dependencies dependencies) {
+	if (writer) {
+		writer->flush(dependencies);
+	}
+}
+
+bool ServerDB::supportsThreadConnections() {
+	return !inMemoryDatabase;
+}
+
+bool Server::initialize() {
+	bool created = false;
+
 	TransactionHolder th;
 
 	QSqlQuery &query = *th.qsqQuery;
@@ -999,6 +1306,8 @@ void Server::initialize() {
 	query.addBindValue(iServerNum);
 	SQLEXEC();
 	if (!query.next()) {
+		created = true;
+
 		SQLPREP("INSERT INTO `%1channels` (`server_id`, `channel_id`, `parent_id`, `name`) VALUES (?, ?, ?, ?)");
 		query.addBindValue(iServerNum);
 		query.addBindValue(0);
@@ -1016,6 +1325,8 @@ void Server::initialize() {
 	query.addBindValue(iServerNum);
 	SQLEXEC();
 	if (!query.next()) {
+		created = true;
+
 		SQLPREP("INSERT INTO `%1users` (`server_id`, `user_id`, `name`) VALUES (?, ?, ?)");
 		query.addBindValue(iServerNum);
 		query.addBindValue(0);
@@ -1038,6 +1349,8 @@ void Server::initialize() {
 	if (query.next()) {
 		int c = query.value(0).toInt();
 		if (c == 0) {
+			created = true;
+
 			SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `group_name`, `apply_here`, "
 					"`apply_sub`, `grantpriv`) VALUES (?,?,?,?,?,?,?)");
 
@@ -1077,6 +1390,8 @@ void Server::initialize() {
 	if (query.next()) {
 		int c = query.value(0).toInt();
 		if (c == 0) {
+			created = true;
+
 			SQLPREP("INSERT INTO `%1groups`(`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
 					"(?,?,?,?,?)");
 			query.addBindValue(iServerNum);
@@ -1088,6 +1403,8 @@ void Server::initialize() {
 		}
 	}
 	query.clear();
+
+	return created;
 }
 
 int Server::registerUser(const QMap< int, QString > &info) {
@@ -1102,12 +1419,14 @@ int Server::registerUser(const QMap< int, QString > &info) {
 	if (getUserID(name) >= 0)
 		return -1;
 
-	qhUserIDCache.remove(name);
+	m_userNameCache.removeName(name);
+	// The new user might have been looked up under a different spelling of their name
+	m_userNameCache.removeUnknown();
 
 	int res = -2;
 	emit registerUserSig(res, info);
 	if (res != -2) {
-		qhUserIDCache.remove(name);
+		m_userNameCache.removeName(name);
 	}
 	if (res == -1)
 		return res;
@@ -1150,7 +1469,8 @@ int Server::registerUser(const QMap< int, QString > &info) {
 		}
 	}
 
-	qhUserNameCache.remove(id);
+	m_userNameCache.removeID(id);
+	m_textureHashes.remove(id);
 
 	setInfo(id, info);
 
@@ -1166,8 +1486,9 @@ bool Server::unregisterUserDB(int id) {
 	if (info.isEmpty())
 		return false;
 
-	qhUserIDCache.remove(info.value(ServerDB::User_Name));
-	qhUserNameCache.remove(id);
+	m_userNameCache.removeName(info.value(ServerDB::User_Name));
+	m_userNameCache.removeID(id);
+	m_textureHashes.remove(id);
 
 	int res = -2;
 	emit unregisterUserSig(res, id);
@@ -1201,7 +1522,7 @@ QList< UserInfo > Server::getRegisteredUsersEx() {
 		users.insert(it.key(), UserInfo(it.key(), it.value()));
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::UserActivity, true);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `user_id`, `name`, `lastchannel`, `last_active` FROM `%1users` WHERE `server_id` = ?");
@@ -1227,7 +1548,7 @@ QMap< int, QString > Server::getRegisteredUsers(const QString &filter) {
 
 	emit getRegisteredUsersSig(filter, m);
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency, true);
 
 	QSqlQuery &query = *th.qsqQuery;
 	if (filter.isEmpty()) {
@@ -1255,7 +1576,7 @@ bool Server::isUserId(int id) {
 	if (res >= 0)
 		return (res > 0);
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
@@ -1275,7 +1596,7 @@ QMap< int, QString > Server::getRegistration(int id) {
 	if (res >= 0)
 		return info;
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::UserActivity);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `name`, `last_active` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
@@ -1341,13 +1662,13 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 			}
 		}
 		if (res >= 0) {
-			qhUserNameCache.remove(res);
-			qhUserIDCache.remove(name);
+			m_userNameCache.removeID(res);
+			m_userNameCache.removeName(name);
 		}
 		return res;
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP("SELECT `user_id`,`name`,`pw`, `salt`, `kdfiterations` FROM `%1users` WHERE `server_id` = ? AND "
@@ -1385,7 +1706,8 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 					}
 				}
 			} else {
-				if (PBKDF2::getHash(storedSalt, password, storedKdfIterations) == storedPasswordHash) {
+				if (verifyPassword(sessionId, certhash, userId, password, storedSalt, storedKdfIterations,
+								   storedPasswordHash)) {
 					name = query.value(1).toString();
 					res  = query.value(0).toInt();
 
@@ -1502,12 +1824,121 @@ int Server::authenticate(QString &name, const QString &password, int sessionId,
 		}
 	}
 	if (res >= 0) {
-		qhUserNameCache.remove(res);
-		qhUserIDCache.remove(name);
+		m_userNameCache.removeID(res);
+		m_userNameCache.removeName(name);
 	}
 	return res;
 }
 
+bool Server::deferPasswordCheck(ServerUser *user, const MumbleProto::Authenticate &msg) {
+	if (user->m_passwordCheckPending) {
+		// The client has sent another Authenticate message while the first one is being processed
+		return true;
+	}
+	if (user->m_derivedPassword) {
+		// The password has been derived already, the authentication can be processed now
+		return false;
+	}
+
+	const QString name     = u8(msg.username()).trimmed();
+	const QString password = u8(msg.password());
+	if (password.isEmpty() || bForceExternalAuth || !validateUserName(name)
+		|| isSignalConnected(QMetaMethod::fromSignal(&Server::authenticateSig))) {
+		// Authenticators verify passwords on their own, which has to happen on the main thread
+		return false;
+	}
+
+	ServerUser::DerivedPassword derived;
+	derived.password = password;
+
+	int userId = -1;
+	QString storedHash;
+	{
+		TransactionHolder th(ServerDB::NoDependency);
+		QSqlQuery &query = *th.qsqQuery;
+
+		SQLPREP("SELECT `user_id`, `pw`, `salt`, `kdfiterations` FROM `%1users` WHERE `server_id` = ? AND "
+				"LOWER(`name`) = LOWER(?)");
+		query.addBindValue(iServerNum);
+		query.addBindValue(name);
+		SQLEXEC();
+		if (!query.next()) {
+			return false;
+		}
+
+		userId             = query.value(0).toInt();
+		storedHash         = query.value(1).toString();
+		derived.salt       = query.value(2).toString();
+		derived.iterations = query.value(3).toInt();
+	}
+
+	if (storedHash.isEmpty() || derived.iterations <= 0) {
+		// Without a password or with a legacy SHA1 hash, there is nothing expensive to do
+		return false;
+	}
+
+	auto it = m_verifiedCredentials.constFind(user->qsHash);
+	if (it != m_verifiedCredentials.constEnd() && it->userId == userId && it->storedHash == storedHash
+		&& tUptime.elapsed() < it->verified + VERIFIED_CREDENTIAL_MICROSECONDS) {
+		// verifyPassword() will most likely be able to skip the derivation
+		return false;
+	}
+
+	user->m_passwordCheckPending = true;
+	m_deferredWork.start(user, [this, msg, derived]() mutable -> DeferredWork::Continuation {
+		derived.hash = PBKDF2::getHash(derived.salt, derived.password, derived.iterations);
+
+		return [this, msg, derived](ServerUser *user) {
+			user->m_passwordCheckPending = false;
+			user->m_derivedPassword.reset(new ServerUser::DerivedPassword(derived));
+
+			MumbleProto::Authenticate authenticate = msg;
+			msgAuthenticate(user, authenticate);
+		};
+	});
+
+	return true;
+}
+
+bool Server::verifyPassword(int sessionId, const QString &certhash, int userId, const QString &password,
+							const QString &salt, int iterations, const QString &storedHash) {
+	const QByteArray digest = QCryptographicHash::hash((salt + password).toUtf8(), QCryptographicHash::Sha256);
+
+	bool verified = false;
+	bool derived  = false;
+
+	ServerUser *user = qhUsers.value(static_cast< unsigned int >(sessionId));
+	if (user && user->m_derivedPassword) {
+		const std::unique_ptr< ServerUser::DerivedPassword > precomputed = std::move(user->m_derivedPassword);
+		if (precomputed->salt == salt && precomputed->iterations == iterations && precomputed->password == password) {
+			verified = precomputed->hash == storedHash;
+			derived  = true;
+		}
+	}
+
+	if (!derived && !certhash.isEmpty()) {
+		auto it = m_verifiedCredentials.constFind(certhash);
+		if (it != m_verifiedCredentials.constEnd() && it->userId == userId && it->storedHash == storedHash
+			&& it->digest == digest && tUptime.elapsed() < it->verified + VERIFIED_CREDENTIAL_MICROSECONDS) {
+			verified = true;
+			derived  = true;
+		}
+	}
+
+	if (!derived) {
+		verified = PBKDF2::getHash(salt, password, iterations) == storedHash;
+	}
+
+	if (verified && !certhash.isEmpty()) {
+		if (m_verifiedCredentials.size() >= MAX_VERIFIED_CREDENTIALS) {
+			m_verifiedCredentials.clear();
+		}
+		m_verifiedCredentials.insert(certhash, { userId, storedHash, digest, tUptime.elapsed() });
+	}
+
+	return verified;
+}
+
 bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 	int res = -2;
 
@@ -1520,16 +1951,16 @@ bool Server::setInfo(int id, const QMap< int, QString > &setinfo) {
 		int idmatch = getUserID(uname);
 		if ((idmatch >= 0) && (idmatch != id))
 			return false;
-		qhUserIDCache.remove(qhUserNameCache.value(id));
-		qhUserNameCache.remove(id);
-		qhUserIDCache.remove(info.value(ServerDB::User_Name));
+		m_userNameCache.removeID(id);
+		m_userNameCache.removeName(info.value(ServerDB::User_Name));
+		m_userNameCache.removeUnknown();
 	}
 
 	emit setInfoSig(res, id, info);
 	if (res >= 0)
 		return (res > 0);
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 	QSqlQuery &query = *th.qsqQuery;
 
 	if (info.contains(ServerDB::User_LastActive)) {
@@ -1620,6 +2051,8 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 	else
 		tex = texture;
 
+	m_textureHashes.remove(id);
+
 	foreach (ServerUser *u, qhUsers) {
 		if (u->iId == id)
 			hashAssign(u->qbaTexture, u->qbaTextureHash, tex);
@@ -1630,7 +2063,7 @@ bool Server::setTexture(int id, const QByteArray &texture) {
 	if (res >= 0)
 		return (res > 0);
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("UPDATE `%1users` SET `texture`=? WHERE `server_id` = ? AND `user_id`=?");
@@ -1691,17 +2124,16 @@ QString ServerDB::getLegacySHA1Hash(const QString &password) {
 }
 
 QString Server::getUserName(int id) {
-	if (qhUserNameCache.contains(id))
-		return qhUserNameCache.value(id);
 	QString name;
+	if (m_userNameCache.lookupName(id, name))
+		return name;
 	emit idToNameSig(name, id);
 	if (!name.isEmpty()) {
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		m_userNameCache.insert(id, name);
 		return name;
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency, true);
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
 	query.addBindValue(iServerNum);
@@ -1709,20 +2141,20 @@ QString Server::getUserName(int id) {
 	SQLEXEC();
 	if (query.next()) {
 		name = query.value(0).toString();
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		m_userNameCache.insert(id, name);
+	} else {
+		m_userNameCache.insertUnknownID(id);
 	}
 	return name;
 }
 
 int Server::getUserID(const QString &name) {
-	if (qhUserIDCache.contains(name))
-		return qhUserIDCache.value(name);
 	int id = -2;
+	if (m_userNameCache.lookupID(name, id))
+		return id;
 	emit nameToIdSig(id, name);
 	if (id != -2) {
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		m_userNameCache.insert(id, name);
 		return id;
 	}
 
@@ -1730,7 +2162,7 @@ int Server::getUserID(const QString &name) {
 		return id;
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `user_id` FROM `%1users` WHERE `server_id` = ? AND LOWER(`name`) = LOWER(?)");
@@ -1739,20 +2171,39 @@ int Server::getUserID(const QString &name) {
 	SQLEXEC();
 	if (query.next()) {
 		id = query.value(0).toInt();
-		qhUserIDCache.insert(name, id);
-		qhUserNameCache.insert(id, name);
+		m_userNameCache.insert(id, name);
+	} else {
+		m_userNameCache.insertUnknownName(name);
 	}
 	return id;
 }
 
-QByteArray Server::getUserTexture(int id) {
+QByteArray Server::getUserTexture(int id, QByteArray *hash) {
 	QByteArray qba;
+	QByteArray texture;
+	QByteArray textureHash;
+
 	emit idToTextureSig(qba, id);
 	if (!qba.isNull()) {
-		return qba;
+		hashAssign(texture, textureHash, qba);
+		if (hash)
+			*hash = textureHash;
+		return texture;
+	}
+
+	// Textures that are still in memory (e.g. because the user reconnects) don't have to be loaded and hashed again
+	auto it = m_textureHashes.constFind(id);
+	if (it != m_textureHashes.constEnd()) {
+		textureHash = it.value();
+		texture     = textureHash.isEmpty() ? QByteArray() : meta->m_blobStore.find(textureHash);
+		if (textureHash.isEmpty() || !texture.isNull()) {
+			if (hash)
+				*hash = textureHash;
+			return texture;
+		}
 	}
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency, true);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("SELECT `texture` FROM `%1users` WHERE `server_id` = ? AND `user_id` = ?");
@@ -1765,18 +2216,33 @@ QByteArray Server::getUserTexture(int id) {
 			if (qba.size() == 600 * 60 * 4)
 				qba = qCompress(qba);
 	}
-	return qba;
+
+	hashAssign(texture, textureHash, qba);
+
+	// Small textures aren't hashed and thus can't be found in the blob store
+	if (texture.isEmpty() || !textureHash.isEmpty()) {
+		if (m_textureHashes.size() >= Meta::mp.iUserCacheSize)
+			m_textureHashes.clear();
+		m_textureHashes.insert(id, textureHash);
+	}
+
+	if (hash)
+		*hash = textureHash;
+	return texture;
 }
 
 void Server::addLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
+		invalidateAudience(c->iId);
 	}
+	invalidateWhisperTargetsOfLinks(c);
+	traceLink(VoiceTrace::EventType::ChannelLinked, *c, *l);
 
 	if (c->bTemporary || l->bTemporary)
 		return;
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("INSERT INTO `%1channel_links` (`server_id`, `channel_id`, `link_id`) VALUES (?,?,?)");
@@ -1792,14 +2258,18 @@ void Server::addLink(Channel *c, Channel *l) {
 }
 
 void Server::removeLink(Channel *c, Channel *l) {
+	// Once unlinked, the channels that are no longer reachable from c can't be determined anymore
+	invalidateWhisperTargetsOfLinks(c);
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
+		invalidateAudience(c->iId);
 		c->unlink(l);
 	}
+	traceLink(VoiceTrace::EventType::ChannelUnlinked, *c, *l);
 
 	if (c->bTemporary || l->bTemporary)
 		return;
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1816,7 +2286,7 @@ void Server::removeLink(Channel *c, Channel *l) {
 }
 
 Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int position, unsigned int maxUsers) {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::ChannelTree);
 
 	QSqlQuery &query = *th.qsqQuery;
 
@@ -1866,6 +2336,9 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 	c->iPosition  = position;
 	c->uiMaxUsers = maxUsers;
 	qhChannels.insert(id, c);
+
+	// Targets including the children of one of the new channel's parents have to pick it up
+	invalidateWhisperTargetsOfBranch(c);
 	return c;
 }
 
@@ -1882,21 +2355,47 @@ void Server::removeChannelDB(const Channel *c) {
 	qhChannels.remove(c->iId);
 }
 
-void Server::updateChannel(const Channel *c) {
-	if (c->bTemporary)
-		return;
-	TransactionHolder th;
-	Group *g;
-	ChanACL *acl;
+namespace {
+/// A copy of everything Server::updateChannel writes, so that it can be written in the background
+struct ChannelRecord {
+	struct Group {
+		QString name;
+		bool inherit;
+		bool inheritable;
+		std::vector< int > add;
+		std::vector< int > remove;
+	};
+
+	struct ACL {
+		int userId;
+		QString group;
+		bool applyHere;
+		bool applySubs;
+		int allow;
+		int deny;
+	};
+
+	int serverNum;
+	int id;
+	QString name;
+	QVariant parentId;
+	bool inheritACL;
+	QString description;
+	int position;
+	unsigned int maxUsers;
+	std::vector< Group > groups;
+	std::vector< ACL > acls;
+};
+} // namespace
 
-	QSqlQuery &query = *th.qsqQuery;
+static void writeChannel(QSqlQuery &query, const ChannelRecord &record) {
 	SQLPREP("UPDATE `%1channels` SET `name` = ?, `parent_id` = ?, `inheritacl` = ? WHERE `server_id` = ? AND "
 			"`channel_id` = ?");
-	query.addBindValue(c->qsName);
-	query.addBindValue(c->cParent ? c->cParent->iId : QVariant());
-	query.addBindValue(c->bInheritACL ? 1 : 0);
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
+	query.addBindValue(record.name);
+	query.addBindValue(record.parentId);
+	query.addBindValue(record.inheritACL ? 1 : 0);
+	query.addBindValue(record.serverNum);
+	query.addBindValue(record.id);
 	SQLEXEC();
 
 	// Update channel description information
@@ -1905,82 +2404,81 @@ void Server::updateChannel(const Channel *c) {
 				":channel_id, :key, :value) ON CONFLICT (`server_id`, `channel_id`, `key`) DO UPDATE SET `value` = "
 				":u_value WHERE `%1channel_info`.`server_id` = :u_server_id AND `%1channel_info`.`channel_id` = "
 				":u_channel_id AND `%1channel_info`.`key` = :u_key");
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
+		query.bindValue(":server_id", record.serverNum);
+		query.bindValue(":channel_id", record.id);
 		query.bindValue(":key", ServerDB::Channel_Description);
-		query.bindValue(":value", c->qsDesc);
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
+		query.bindValue(":value", record.description);
+		query.bindValue(":u_server_id", record.serverNum);
+		query.bindValue(":u_channel_id", record.id);
 		query.bindValue(":u_key", ServerDB::Channel_Description);
-		query.bindValue(":u_value", c->qsDesc);
+		query.bindValue(":u_value", record.description);
 		SQLEXEC();
 	} else {
 		SQLPREP("REPLACE INTO `%1channel_info` (`server_id`, `channel_id`, `key`, `value`) VALUES (?, ?, ?, ?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
+		query.addBindValue(record.serverNum);
+		query.addBindValue(record.id);
 		query.addBindValue(ServerDB::Channel_Description);
-		query.addBindValue(c->qsDesc);
+		query.addBindValue(record.description);
 		SQLEXEC();
 	}
 	// Update channel position information
 	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
+		query.bindValue(":server_id", record.serverNum);
+		query.bindValue(":channel_id", record.id);
 		query.bindValue(":key", ServerDB::Channel_Position);
-		query.bindValue(":value", QVariant(c->iPosition).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
+		query.bindValue(":value", QString::number(record.position));
+		query.bindValue(":u_server_id", record.serverNum);
+		query.bindValue(":u_channel_id", record.id);
 		query.bindValue(":u_key", ServerDB::Channel_Position);
-		query.bindValue(":u_value", QVariant(c->iPosition).toString());
+		query.bindValue(":u_value", QString::number(record.position));
 		SQLEXEC();
 	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
+		query.addBindValue(record.serverNum);
+		query.addBindValue(record.id);
 		query.addBindValue(ServerDB::Channel_Position);
-		query.addBindValue(QVariant(c->iPosition).toString());
+		query.addBindValue(QString::number(record.position));
 		SQLEXEC();
 	}
 	// Update channel maximum channels
 	if (Meta::mp.qsDBDriver == "QPSQL") {
-		query.bindValue(":server_id", iServerNum);
-		query.bindValue(":channel_id", c->iId);
+		query.bindValue(":server_id", record.serverNum);
+		query.bindValue(":channel_id", record.id);
 		query.bindValue(":key", ServerDB::Channel_Max_Users);
-		query.bindValue(":value", QVariant(c->uiMaxUsers).toString());
-		query.bindValue(":u_server_id", iServerNum);
-		query.bindValue(":u_channel_id", c->iId);
+		query.bindValue(":value", QString::number(record.maxUsers));
+		query.bindValue(":u_server_id", record.serverNum);
+		query.bindValue(":u_channel_id", record.id);
 		query.bindValue(":u_key", ServerDB::Channel_Max_Users);
-		query.bindValue(":u_value", QVariant(c->uiMaxUsers).toString());
+		query.bindValue(":u_value", QString::number(record.maxUsers));
 		SQLEXEC();
 	} else {
-		query.addBindValue(iServerNum);
-		query.addBindValue(c->iId);
+		query.addBindValue(record.serverNum);
+		query.addBindValue(record.id);
 		query.addBindValue(ServerDB::Channel_Max_Users);
-		query.addBindValue(QVariant(c->uiMaxUsers).toString());
+		query.addBindValue(QString::number(record.maxUsers));
 		SQLEXEC();
 	}
 
 	SQLPREP("DELETE FROM `%1groups` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
+	query.addBindValue(record.serverNum);
+	query.addBindValue(record.id);
 	SQLEXEC();
 
 	SQLPREP("DELETE FROM `%1acl` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(c->iId);
+	query.addBindValue(record.serverNum);
+	query.addBindValue(record.id);
 	SQLEXEC();
 
-	foreach (g, c->qhGroups) {
+	for (const ChannelRecord::Group &group : record.groups) {
 		int id = 0;
-		int pid;
 
 		if (Meta::mp.qsDBDriver == "QPSQL") {
 			SQLPREP("INSERT INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
 					"(?,?,?,?,?) RETURNING group_id");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
+			query.addBindValue(record.serverNum);
+			query.addBindValue(record.id);
+			query.addBindValue(group.name);
+			query.addBindValue(group.inherit ? 1 : 0);
+			query.addBindValue(group.inheritable ? 1 : 0);
 			SQLEXEC();
 
 			if (query.next()) {
@@ -1992,28 +2490,28 @@ void Server::updateChannel(const Channel *c) {
 		} else {
 			SQLPREP("REPLACE INTO `%1groups` (`server_id`, `channel_id`, `name`, `inherit`, `inheritable`) VALUES "
 					"(?,?,?,?,?)");
-			query.addBindValue(iServerNum);
-			query.addBindValue(g->c->iId);
-			query.addBindValue(g->qsName);
-			query.addBindValue(g->bInherit ? 1 : 0);
-			query.addBindValue(g->bInheritable ? 1 : 0);
+			query.addBindValue(record.serverNum);
+			query.addBindValue(record.id);
+			query.addBindValue(group.name);
+			query.addBindValue(group.inherit ? 1 : 0);
+			query.addBindValue(group.inheritable ? 1 : 0);
 			SQLEXEC();
 
 			id = query.lastInsertId().toInt();
 		}
 
-		foreach (pid, g->qsAdd) {
+		for (int pid : group.add) {
 			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
 			query.addBindValue(id);
-			query.addBindValue(iServerNum);
+			query.addBindValue(record.serverNum);
 			query.addBindValue(pid);
 			query.addBindValue(1);
 			SQLEXEC();
 		}
-		foreach (pid, g->qsRemove) {
+		for (int pid : group.remove) {
 			SQLPREP("INSERT INTO `%1group_members` (`group_id`, `server_id`, `user_id`, `addit`) VALUES (?, ?, ?, ?)");
 			query.addBindValue(id);
-			query.addBindValue(iServerNum);
+			query.addBindValue(record.serverNum);
 			query.addBindValue(pid);
 			query.addBindValue(0);
 			SQLEXEC();
@@ -2022,172 +2520,299 @@ void Server::updateChannel(const Channel *c) {
 
 	int pri = 5;
 
-	foreach (acl, c->qlACL) {
+	for (const ChannelRecord::ACL &acl : record.acls) {
 		SQLPREP("INSERT INTO `%1acl` (`server_id`, `channel_id`, `priority`, `user_id`, `group_name`, `apply_here`, "
 				"`apply_sub`, `grantpriv`, `revokepriv`) VALUES (?,?,?,?,?,?,?,?,?)");
-		query.addBindValue(iServerNum);
-		query.addBindValue(acl->c->iId);
+		query.addBindValue(record.serverNum);
+		query.addBindValue(record.id);
 		query.addBindValue(pri++);
 
-		query.addBindValue((acl->iUserId == -1) ? QVariant() : acl->iUserId);
-		query.addBindValue((acl->qsGroup.isEmpty()) ? QVariant() : acl->qsGroup);
-		query.addBindValue(acl->bApplyHere ? 1 : 0);
-		query.addBindValue(acl->bApplySubs ? 1 : 0);
-		query.addBindValue(static_cast< int >(acl->pAllow));
-		query.addBindValue(static_cast< int >(acl->pDeny));
+		query.addBindValue((acl.userId == -1) ? QVariant() : acl.userId);
+		query.addBindValue((acl.group.isEmpty()) ? QVariant() : acl.group);
+		query.addBindValue(acl.applyHere ? 1 : 0);
+		query.addBindValue(acl.applySubs ? 1 : 0);
+		query.addBindValue(acl.allow);
+		query.addBindValue(acl.deny);
 		SQLEXEC();
 	}
 }
 
-/** Reads the channel privileges (group and acl) as well as the channel information key/value pairs from the database.
- * @param c Channel to fetch information for
+void Server::updateChannel(const Channel *c) {
+	if (c->bTemporary)
+		return;
+
+	ChannelRecord record;
+	record.serverNum   = iServerNum;
+	record.id          = c->iId;
+	record.name        = c->qsName;
+	record.parentId    = c->cParent ? c->cParent->iId : QVariant();
+	record.inheritACL  = c->bInheritACL;
+	record.description = c->qsDesc;
+	record.position    = c->iPosition;
+	record.maxUsers    = c->uiMaxUsers;
+
+	for (const Group *g : c->qhGroups) {
+		ChannelRecord::Group group;
+		group.name        = g->qsName;
+		group.inherit     = g->bInherit;
+		group.inheritable = g->bInheritable;
+		group.add.assign(g->qsAdd.begin(), g->qsAdd.end());
+		group.remove.assign(g->qsRemove.begin(), g->qsRemove.end());
+		record.groups.push_back(std::move(group));
+	}
+
+	for (const ChanACL *acl : c->qlACL) {
+		ChannelRecord::ACL entry;
+		entry.userId    = acl->iUserId;
+		entry.group     = acl->qsGroup;
+		entry.applyHere = acl->bApplyHere;
+		entry.applySubs = acl->bApplySubs;
+		entry.allow     = static_cast< int >(acl->pAllow);
+		entry.deny      = static_cast< int >(acl->pDeny);
+		record.acls.push_back(std::move(entry));
+	}
+
+	// Every update writes the whole channel, so only the last one has to be written
+	ServerDB::writeBehind(
+		ServerDB::ChannelTree, [record](QSqlQuery &query) { writeChannel(query, record); },
+		QString::fromLatin1("channel/%1/%2").arg(record.serverNum).arg(record.id));
+}
+
+/** Reads the channel tree of this server including the channel information key/value pairs, the groups and the ACLs
+ * from the database. Instead of querying every channel on its own, each table is read with a single query for the
+ * whole server and the tree is built in memory.
  */
-void Server::readChannelPrivs(Channel *c) {
-	TransactionHolder th;
+ServerBootState Server::loadBootState(int srvnum) {
+	ServerBootState state;
 
-	unsigned int cid = c->iId;
+	// Reading the configuration here as well means that the server finds it in the cache
+	ServerDB::getAllConf(srvnum);
 
+	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
 
-	SQLPREP("SELECT `key`, `value` FROM `%1channel_info` WHERE `server_id` = ? AND `channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+	SQLPREP("SELECT `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration` FROM `%1bans` WHERE `server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
 	SQLEXEC();
 	while (query.next()) {
-		int key              = query.value(0).toInt();
-		const QString &value = query.value(1).toString();
-		if (key == ServerDB::Channel_Description) {
-			hashAssign(c->qsDesc, c->qbaDescHash, value);
-		} else if (key == ServerDB::Channel_Position) {
-			c->iPosition = QVariant(value).toInt(); // If the conversion fails it'll return the default value 0
-		} else if (key == ServerDB::Channel_Max_Users) {
-			c->uiMaxUsers = QVariant(value).toUInt(); // If the conversion fails it'll return the default value 0
-		}
+		Ban ban;
+		ban.haAddress = query.value(0).toByteArray();
+
+		ban.iMask      = query.value(1).toInt();
+		ban.qsUsername = query.value(2).toString();
+		ban.qsHash     = query.value(3).toString();
+		ban.qsReason   = query.value(4).toString();
+		ban.qdtStart   = query.value(5).toDateTime();
+		ban.qdtStart.setTimeSpec(Qt::UTC);
+		ban.iDuration = query.value(6).toUInt();
+
+		if (ban.isValid())
+			state.bans << ban;
 	}
 
-	SQLPREP("SELECT `group_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ? AND "
-			"`channel_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+	SQLPREP("SELECT `channel_id`, `parent_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? ORDER BY "
+			"`name`");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
 	SQLEXEC();
 	while (query.next()) {
-		int gid         = query.value(0).toInt();
-		QString name    = query.value(1).toString();
-		Group *g        = new Group(c, name);
-		g->bInherit     = query.value(2).toBool();
-		g->bInheritable = query.value(3).toBool();
-
-		QSqlQuery mem;
-		mem.prepare(QString::fromLatin1("SELECT user_id, addit FROM %1group_members WHERE group_id = ?")
-						.arg(Meta::mp.qsDBPrefix));
-		mem.addBindValue(gid);
-		mem.exec();
-		while (mem.next()) {
-			int uid = mem.value(0).toInt();
-			if (mem.value(1).toBool())
-				g->qsAdd << uid;
-			else
-				g->qsRemove << uid;
-		}
+		state.channels.append({ query.value(0).toUInt(), query.value(1).isNull() ? -1 : query.value(1).toInt(),
+								query.value(2).toString(), query.value(3).toBool() });
 	}
 
-	SQLPREP("SELECT `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM `%1acl` WHERE "
-			"`server_id` = ? AND `channel_id` = ? ORDER BY `priority`");
-	query.addBindValue(iServerNum);
-	query.addBindValue(cid);
+	SQLPREP("SELECT `channel_id`, `key`, `value` FROM `%1channel_info` WHERE `server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
 	SQLEXEC();
 	while (query.next()) {
-		ChanACL *acl    = new ChanACL(c);
-		acl->iUserId    = query.value(0).isNull() ? -1 : query.value(0).toInt();
-		acl->qsGroup    = query.value(1).toString();
-		acl->bApplyHere = query.value(2).toBool();
-		acl->bApplySubs = query.value(3).toBool();
-		acl->pAllow     = static_cast< ChanACL::Permissions >(query.value(4).toInt());
-		acl->pDeny      = static_cast< ChanACL::Permissions >(query.value(5).toInt());
+		state.channelInfo.append({ query.value(0).toUInt(), query.value(1).toInt(), query.value(2).toString() });
 	}
-}
 
-void Server::readChannels(Channel *p) {
-	QList< Channel * > kids;
-	Channel *c;
-	QSqlQuery query;
-	int parentid = -1;
+	SQLPREP("SELECT `group_id`, `channel_id`, `name`, `inherit`, `inheritable` FROM `%1groups` WHERE `server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
+	SQLEXEC();
+	while (query.next()) {
+		state.groups.append({ query.value(0).toInt(), query.value(1).toUInt(), query.value(2).toString(),
+							  query.value(3).toBool(), query.value(4).toBool() });
+	}
 
-	if (p) {
-		parentid = static_cast< int >(p->iId);
-		readChannelPrivs(qhChannels.value(p->iId));
+	SQLPREP("SELECT `group_id`, `user_id`, `addit` FROM `%1group_members` WHERE `server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
+	SQLEXEC();
+	while (query.next()) {
+		state.groupMembers.append({ query.value(0).toInt(), query.value(1).toInt(), query.value(2).toBool() });
 	}
 
-	{
-		TransactionHolder th;
-		if (parentid == -1) {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND `parent_id` "
-					"IS NULL ORDER BY `name`");
-			query.addBindValue(iServerNum);
-		} else {
-			SQLPREP("SELECT `channel_id`, `name`, `inheritacl` FROM `%1channels` WHERE `server_id` = ? AND "
-					"`parent_id`=? ORDER BY `name`");
-			query.addBindValue(iServerNum);
-			query.addBindValue(parentid);
-		}
-		SQLEXEC();
+	SQLPREP("SELECT `channel_id`, `user_id`, `group_name`, `apply_here`, `apply_sub`, `grantpriv`, `revokepriv` FROM "
+			"`%1acl` WHERE `server_id` = ? ORDER BY `channel_id`, `priority`");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
+	SQLEXEC();
+	while (query.next()) {
+		state.acls.append({ query.value(0).toUInt(), query.value(1).isNull() ? -1 : query.value(1).toInt(),
+							query.value(2).toString(), query.value(3).toBool(), query.value(4).toBool(),
+							query.value(5).toInt(), query.value(6).toInt() });
+	}
 
-		while (query.next()) {
-			c = new Channel(query.value(0).toUInt(), query.value(1).toString(), p);
-			if (!p)
+	SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
+	SQLEXEC();
+	while (query.next()) {
+		state.links.append(qMakePair(query.value(0).toUInt(), query.value(1).toUInt()));
+	}
+
+	SQLPREP("SELECT `user_id`, `channel_id`, `volume_adjustment`, `enabled` FROM `%1channel_listeners` WHERE "
+			"`server_id` = ?");
+	query.setForwardOnly(true);
+	query.addBindValue(srvnum);
+	SQLEXEC();
+	while (query.next()) {
+		state.listeners.append({ query.value(0).toInt(), query.value(1).toUInt(), query.value(2).toFloat(),
+								 query.value(3).toUInt() == 1 });
+	}
+
+	return state;
+}
+
+void Server::readChannels(const ServerBootState &state) {
+	// The channels by their parent (or -1 for the root channel), each in the order they are sorted in by name
+	QHash< int, QList< const ServerBootState::ChannelRow * > > children;
+	for (const ServerBootState::ChannelRow &row : state.channels) {
+		children[row.parentId].append(&row);
+	}
+
+	// Channels are created top-down, so that every channel is added to its parent in the same order as before.
+	// Channels whose parent doesn't exist are skipped.
+	QList< QPair< Channel *, int > > pending;
+	pending.append(qMakePair(static_cast< Channel * >(nullptr), -1));
+	while (!pending.isEmpty()) {
+		const QPair< Channel *, int > parent = pending.takeFirst();
+
+		for (const ServerBootState::ChannelRow *row : children.value(parent.second)) {
+			Channel *c = new Channel(row->id, row->name, parent.first);
+			if (!parent.first)
 				c->setParent(this);
 			qhChannels.insert(c->iId, c);
-			c->bInheritACL = query.value(2).toBool();
-			kids << c;
+			c->bInheritACL = row->inheritACL;
+
+			pending.append(qMakePair(c, static_cast< int >(c->iId)));
 		}
 	}
 
-	query.clear();
+	for (const ServerBootState::ChannelInfoRow &row : state.channelInfo) {
+		Channel *c = qhChannels.value(row.channelId);
+		if (!c)
+			continue;
 
-	foreach (c, kids)
-		readChannels(c);
-}
+		if (row.key == ServerDB::Channel_Description) {
+			hashAssign(c->qsDesc, c->qbaDescHash, row.value);
+		} else if (row.key == ServerDB::Channel_Position) {
+			c->iPosition = QVariant(row.value).toInt(); // If the conversion fails it'll return the default value 0
+		} else if (row.key == ServerDB::Channel_Max_Users) {
+			c->uiMaxUsers = QVariant(row.value).toUInt(); // If the conversion fails it'll return the default value 0
+		}
+	}
 
-void Server::readLinks() {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+	QHash< int, Group * > groups;
 
-	SQLPREP("SELECT `channel_id`, `link_id` FROM `%1channel_links` WHERE `server_id` = ?");
-	query.addBindValue(iServerNum);
-	SQLEXEC();
+	for (const ServerBootState::GroupRow &row : state.groups) {
+		Channel *c = qhChannels.value(row.channelId);
+		if (!c)
+			continue;
 
-	while (query.next()) {
-		unsigned int cid = query.value(0).toUInt();
-		unsigned int lid = query.value(1).toUInt();
+		Group *g        = new Group(c, row.name);
+		g->bInherit     = row.inherit;
+		g->bInheritable = row.inheritable;
+		groups.insert(row.id, g);
+	}
+
+	for (const ServerBootState::GroupMemberRow &row : state.groupMembers) {
+		Group *g = groups.value(row.groupId);
+		if (!g)
+			continue;
+
+		if (row.add)
+			g->qsAdd << row.userId;
+		else
+			g->qsRemove << row.userId;
+	}
+
+	for (const ServerBootState::ACLRow &row : state.acls) {
+		Channel *c = qhChannels.value(row.channelId);
+		if (!c)
+			continue;
 
-		Channel *c = qhChannels.value(cid);
-		Channel *l = qhChannels.value(lid);
+		ChanACL *acl    = new ChanACL(c);
+		acl->iUserId    = row.userId;
+		acl->qsGroup    = row.group;
+		acl->bApplyHere = row.applyHere;
+		acl->bApplySubs = row.applySubs;
+		acl->pAllow     = static_cast< ChanACL::Permissions >(row.allow);
+		acl->pDeny      = static_cast< ChanACL::Permissions >(row.deny);
+	}
+}
+
+void Server::readLinks(const ServerBootState &state) {
+	for (const QPair< unsigned int, unsigned int > &link : state.links) {
+		Channel *c = qhChannels.value(link.first);
+		Channel *l = qhChannels.value(link.second);
 		if (c && l) {
 			QWriteLocker wl(&qrwlVoiceThread);
 			c->link(l);
+			invalidateAudience(c->iId);
 		}
 	}
 }
 
 void Server::setLastChannel(const User *p) {
-	if (p->iId < 0)
-		return;
+	setLastChannels({ p });
+}
 
-	if (p->cChannel->bTemporary)
-		return;
+/// @param entries Pairs of user and channel IDs
+static void writeLastChannels(QSqlQuery &query, int serverNum, const std::vector< std::pair< int, int > > &entries) {
+	for (const std::pair< int, int > &entry : entries) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			SQLPREP(
+				"UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(entry.second);
+		query.addBindValue(serverNum);
+		query.addBindValue(entry.first);
+		SQLEXEC();
+	}
+}
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
+void Server::setLastChannels(const QList< const User * > &users) {
+	std::vector< std::pair< int, int > > remembered;
+	for (const User *p : users) {
+		if (p->iId >= 0 && !p->cChannel->bTemporary) {
+			remembered.emplace_back(p->iId, p->cChannel->iId);
+		}
+	}
 
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=? WHERE `server_id` = ? AND `user_id` = ?");
+	if (remembered.empty())
+		return;
+
+	const int serverNum = iServerNum;
+	if (ServerDB::writer) {
+		// Only the last channel a user has been in has to be written
+		for (const std::pair< int, int > &entry : remembered) {
+			ServerDB::writeBehind(
+				ServerDB::UserActivity,
+				[serverNum, entry](QSqlQuery &query) { writeLastChannels(query, serverNum, { entry }); },
+				QString::fromLatin1("lastchannel/%1/%2").arg(serverNum).arg(entry.first));
+		}
 	} else {
-		SQLPREP("UPDATE `%1users` SET `lastchannel`=?, `last_active` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		ServerDB::writeBehind(ServerDB::UserActivity, [serverNum, remembered](QSqlQuery &query) {
+			writeLastChannels(query, serverNum, remembered);
+		});
 	}
-	query.addBindValue(p->cChannel->iId);
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
 }
 
 int Server::readLastChannel(int id) {
@@ -2197,7 +2822,7 @@ int Server::readLastChannel(int id) {
 	if (!Meta::mp.bRememberChan)
 		return -1;
 
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::UserActivity);
 	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP(
@@ -2255,18 +2880,19 @@ void Server::setLastDisconnect(const User *p) {
 	if (p->iId < 0)
 		return;
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	if (Meta::mp.qsDBDriver == "QSQLITE") {
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
-	} else {
-		// MySQL or PostgreSQL
-		SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
-	}
-	query.addBindValue(iServerNum);
-	query.addBindValue(p->iId);
-	SQLEXEC();
+	const int serverNum = iServerNum;
+	const int userId    = p->iId;
+	ServerDB::writeBehind(ServerDB::UserActivity, [serverNum, userId](QSqlQuery &query) {
+		if (Meta::mp.qsDBDriver == "QSQLITE") {
+			SQLPREP("UPDATE `%1users` SET `last_disconnect` = datetime('now') WHERE `server_id` = ? AND `user_id` = ?");
+		} else {
+			// MySQL or PostgreSQL
+			SQLPREP("UPDATE `%1users` SET `last_disconnect` = now() WHERE `server_id` = ? AND `user_id` = ?");
+		}
+		query.addBindValue(serverNum);
+		query.addBindValue(userId);
+		SQLEXEC();
+	});
 }
 
 void Server::dumpChannel(const Channel *c) {
@@ -2298,34 +2924,13 @@ void Server::dumpChannel(const Channel *c) {
 	foreach (c, c->qlChannels) { dumpChannel(c); }
 }
 
-void Server::getBans() {
-	TransactionHolder th;
-
-	qlBans.clear();
-
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `base`,`mask`,`name`,`hash`,`reason`,`start`,`duration` FROM `%1bans` WHERE `server_id` = ?");
-	query.addBindValue(iServerNum);
-	SQLEXEC();
-	while (query.next()) {
-		Ban ban;
-		ban.haAddress = query.value(0).toByteArray();
-
-		ban.iMask      = query.value(1).toInt();
-		ban.qsUsername = query.value(2).toString();
-		ban.qsHash     = query.value(3).toString();
-		ban.qsReason   = query.value(4).toString();
-		ban.qdtStart   = query.value(5).toDateTime();
-		ban.qdtStart.setTimeSpec(Qt::UTC);
-		ban.iDuration = query.value(6).toUInt();
-
-		if (ban.isValid())
-			qlBans << ban;
-	}
+void Server::getBans(const ServerBootState &state) {
+	qlBans = state.bans;
+	m_banIndex.rebuild(qlBans);
 }
 
 void Server::saveBans() {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	QSqlQuery &query = *th.qsqQuery;
 	SQLPREP("DELETE FROM `%1bans` WHERE `server_id` = ? ");
@@ -2351,31 +2956,60 @@ QVariant Server::getConf(const QString &key, QVariant def) {
 	return ServerDB::getConf(iServerNum, key, def);
 }
 
-QVariant ServerDB::getConf(int server_id, const QString &key, QVariant def) {
-	TransactionHolder th;
+/// @returns The configuration of the given server, which is read from the database the first time it is needed.
+/// 	The database is read without holding configCacheMutex, so that several servers can read theirs concurrently.
+static QHash< QString, QString > cachedConf(int server_id) {
+	quint64 generation;
+	{
+		QMutexLocker lock(&configCacheMutex);
+		auto it = configCache.constFind(server_id);
+		if (it != configCache.constEnd()) {
+			return it.value();
+		}
+		generation = configGeneration;
+	}
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `value` FROM `%1config` WHERE `server_id` = ? AND `key` = ?");
-	query.addBindValue(server_id);
-	query.addBindValue(key);
-	SQLEXEC();
-	if (query.next()) {
-		return query.value(0);
+	QHash< QString, QString > conf;
+	{
+		TransactionHolder th(ServerDB::NoDependency);
+
+		QSqlQuery &query = *th.qsqQuery;
+		SQLPREP("SELECT `key`, `value` FROM `%1config` WHERE `server_id` = ?");
+		query.setForwardOnly(true);
+		query.addBindValue(server_id);
+		SQLEXEC();
+		while (query.next()) {
+			conf.insert(query.value(0).toString(), query.value(1).toString());
+		}
+	}
+
+	QMutexLocker lock(&configCacheMutex);
+	auto it = configCache.constFind(server_id);
+	if (it != configCache.constEnd()) {
+		// Another thread has been faster
+		return it.value();
+	}
+	if (generation == configGeneration) {
+		configCache.insert(server_id, conf);
+	}
+	return conf;
+}
+
+QVariant ServerDB::getConf(int server_id, const QString &key, QVariant def) {
+	const QHash< QString, QString > conf = cachedConf(server_id);
+	auto it                              = conf.constFind(key);
+	if (it != conf.constEnd()) {
+		return it.value();
 	}
 	return def;
 }
 
 QMap< QString, QString > ServerDB::getAllConf(int server_id) {
-	TransactionHolder th;
-
 	QMap< QString, QString > map;
 
-	QSqlQuery &query = *th.qsqQuery;
-	SQLPREP("SELECT `key`, `value` FROM `%1config` WHERE `server_id` = ?");
-	query.addBindValue(server_id);
-	SQLEXEC();
-	while (query.next()) {
-		map.insert(query.value(0).toString(), query.value(1).toString());
+	const QHash< QString, QString > conf = cachedConf(server_id);
+	for (auto it = conf.constBegin(); it != conf.constEnd(); ++it) {
+		map.insert(it.key(), it.value());
 	}
 	return map;
 }
@@ -2385,16 +3019,22 @@ void Server::setConf(const QString &key, const QVariant &value) {
 }
 
 void Server::dblog(const QString &str) const {
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	// Is logging disabled?
 	if (Meta::mp.iLogDays < 0)
 		return;
 
+	if (ServerDB::writer) {
+		// The lines are inserted in batches and the expired ones are removed in the background
+		ServerDB::writer->appendLog(iServerNum, str);
+		return;
+	}
+
 	// Once per hour
-	if (Meta::mp.iLogDays > 0) {
-		if (ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL)) {
+	const bool clean = Meta::mp.iLogDays > 0 && ServerDB::tLogClean.isElapsed(3600ULL * 1000000ULL);
+
+	const int serverNum = iServerNum;
+	ServerDB::writeBehind(ServerDB::ServerLog, [serverNum, str, clean](QSqlQuery &query) {
+		if (clean) {
 			QString qstr;
 			if (Meta::mp.qsDBDriver == "QSQLITE") {
 				qstr = QString::fromLatin1("msgtime < datetime('now','-%1 days')").arg(Meta::mp.iLogDays);
@@ -2406,12 +3046,33 @@ void Server::dblog(const QString &str) const {
 			ServerDB::prepare(query, QString::fromLatin1("DELETE FROM %1slog WHERE ") + qstr);
 			SQLEXEC();
 		}
+
+		SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
+		query.addBindValue(serverNum);
+		query.addBindValue(str);
+		SQLEXEC();
+	});
+}
+
+void Server::readListeners(const ServerBootState &state) {
+	m_storedListeners.clear();
+	for (const ServerBootState::ListenerRow &row : state.listeners) {
+		m_storedListeners[row.userId].push_back({ row.channelId, row.volumeAdjustment, row.enabled });
 	}
+}
 
-	SQLPREP("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES(?,?)");
-	query.addBindValue(iServerNum);
-	query.addBindValue(str);
-	SQLEXEC();
+Server::StoredListener *Server::storedListener(int userId, unsigned int channelId) {
+	auto it = m_storedListeners.find(userId);
+	if (it == m_storedListeners.end()) {
+		return nullptr;
+	}
+
+	for (StoredListener &listener : it.value()) {
+		if (listener.channelId == channelId) {
+			return &listener;
+		}
+	}
+	return nullptr;
 }
 
 void Server::loadChannelListenersOf(const ServerUser &user) {
@@ -2420,62 +3081,79 @@ void Server::loadChannelListenersOf(const ServerUser &user) {
 		return;
 	}
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
-	SQLPREP("SELECT `channel_id`, `volume_adjustment`, `enabled` FROM `%1channel_listeners` WHERE `server_id` = ? AND "
-			"`user_id` = ?");
-	query.addBindValue(iServerNum);
-	query.addBindValue(user.iId);
-	SQLEXEC();
-
-	while (query.next()) {
-		unsigned int channelID = query.value(0).toUInt();
-		float volume           = query.value(1).toFloat();
-		bool enabled           = query.value(2).toUInt() == 1;
+	auto it = m_storedListeners.find(user.iId);
+	if (it == m_storedListeners.end()) {
+		return;
+	}
 
-		if (enabled) {
-			m_channelListenerManager.addListener(user.uiSession, channelID);
+	// The database drops the listeners of removed channels, so they are dropped here as well
+	std::vector< StoredListener > &stored = it.value();
+	stored.erase(std::remove_if(stored.begin(), stored.end(),
+								[this](const StoredListener &listener) {
+									return !qhChannels.contains(listener.channelId);
+								}),
+				 stored.end());
+
+	QSet< unsigned int > listenedChannels;
+	for (const StoredListener &listener : stored) {
+		if (listener.enabled) {
+			m_channelListenerManager.addListener(user.uiSession, listener.channelId);
+			invalidateAudience(listener.channelId);
+			listenedChannels.insert(listener.channelId);
 		}
 
 		// We load the volume adjustment regardless of whether the listener is currently enabled in case the listener
 		// gets re-activated
-		m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channelID,
-															 VolumeAdjustment::fromFactor(volume));
+		m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, listener.channelId,
+															 VolumeAdjustment::fromFactor(listener.volumeAdjustment));
 	}
+
+	invalidateWhisperTargets(listenedChannels, {});
 }
 
 void Server::addChannelListener(const ServerUser &user, const Channel &channel) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
+		const int serverNum = iServerNum;
+		const int userId    = user.iId;
+		const int channelId = channel.iId;
+		ServerDB::writeBehind(ServerDB::ChannelListeners, [serverNum, userId, channelId](QSqlQuery &query) {
+			// Update or insert entry
+			SQLPREP("SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			query.addBindValue(serverNum);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
 
-		// Update or insert entry
-		SQLPREP(
-			"SELECT COUNT(*) FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+			SQLEXEC();
 
-		SQLEXEC();
+			bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
 
-		bool entryAlreadyExists = query.next() && query.value(0).toInt() > 0;
+			if (entryAlreadyExists) {
+				SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
+						"`channel_id` = ?");
+			} else {
+				SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
+			}
 
-		if (entryAlreadyExists) {
-			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = 1 WHERE `server_id` = ? AND `user_id`= ? AND "
-					"`channel_id` = ?");
-		} else {
-			SQLPREP("INSERT INTO `%1channel_listeners` (`server_id`, `user_id`, `channel_id`) VALUES (?, ?, ?)");
-		}
+			query.addBindValue(serverNum);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
 
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
+			SQLEXEC();
+		});
 
-		SQLEXEC();
+		StoredListener *stored = storedListener(user.iId, channel.iId);
+		if (stored) {
+			stored->enabled = true;
+		} else {
+			m_storedListeners[user.iId].push_back({ channel.iId, 1.0f, true });
+		}
 	}
 
 	m_channelListenerManager.addListener(user.uiSession, channel.iId);
+	invalidateAudience(channel.iId);
+	invalidateWhisperTargets({ channel.iId }, {});
+	traceListener(VoiceTrace::EventType::ListenerAdded, user, channel);
 }
 
 void Server::disableChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2484,20 +3162,30 @@ void Server::disableChannelListener(const ServerUser &user, const Channel &chann
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
+		const int serverNum = iServerNum;
+		const int userId    = user.iId;
+		const int channelId = channel.iId;
+		ServerDB::writeBehind(ServerDB::ChannelListeners, [serverNum, userId, channelId](QSqlQuery &query) {
+			SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
+					"`channel_id` = ?");
+			// Explicit cast to int is required for Postgresql
+			query.addBindValue(static_cast< int >(false));
+			query.addBindValue(serverNum);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
+			SQLEXEC();
+		});
 
-		SQLPREP("UPDATE `%1channel_listeners` SET `enabled` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		// Explicit cast to int is required for Postgresql
-		query.addBindValue(static_cast< int >(false));
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		StoredListener *stored = storedListener(user.iId, channel.iId);
+		if (stored) {
+			stored->enabled = false;
+		}
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	invalidateAudience(channel.iId);
+	invalidateWhisperTargets({ channel.iId }, {});
+	traceListener(VoiceTrace::EventType::ListenerRemoved, user, channel);
 }
 
 void Server::deleteChannelListener(const ServerUser &user, const Channel &channel) {
@@ -2506,46 +3194,75 @@ void Server::deleteChannelListener(const ServerUser &user, const Channel &channe
 	}
 
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
-
-		SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		const int serverNum = iServerNum;
+		const int userId    = user.iId;
+		const int channelId = channel.iId;
+		ServerDB::writeBehind(ServerDB::ChannelListeners, [serverNum, userId, channelId](QSqlQuery &query) {
+			SQLPREP("DELETE FROM `%1channel_listeners` WHERE `server_id` = ? AND `user_id` = ? AND `channel_id` = ?");
+			query.addBindValue(serverNum);
+			query.addBindValue(userId);
+			query.addBindValue(channelId);
+			SQLEXEC();
+		});
+
+		auto it = m_storedListeners.find(user.iId);
+		if (it != m_storedListeners.end()) {
+			std::vector< StoredListener > &stored = it.value();
+			stored.erase(std::remove_if(stored.begin(), stored.end(),
+										[&channel](const StoredListener &listener) {
+											return listener.channelId == channel.iId;
+										}),
+						 stored.end());
+		}
 	}
 
 	m_channelListenerManager.removeListener(user.uiSession, channel.iId);
+	invalidateAudience(channel.iId);
+	invalidateWhisperTargets({ channel.iId }, {});
+	traceListener(VoiceTrace::EventType::ListenerRemoved, user, channel);
 }
 
 void Server::setChannelListenerVolume(const ServerUser &user, const Channel &channel, float volumeAdjustment) {
 	if (user.iId >= 0) {
-		TransactionHolder th;
-		QSqlQuery &query = *th.qsqQuery;
+		const int serverNum = iServerNum;
+		const int userId    = user.iId;
+		const int channelId = channel.iId;
+		// Enabling, disabling or deleting the listener in between doesn't depend on the volume, so only the last
+		// volume has to be written
+		ServerDB::writeBehind(
+			ServerDB::ChannelListeners,
+			[serverNum, userId, channelId, volumeAdjustment](QSqlQuery &query) {
+				SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND "
+						"`user_id` = ? AND `channel_id` = ?");
+				query.addBindValue(volumeAdjustment);
+				query.addBindValue(serverNum);
+				query.addBindValue(userId);
+				query.addBindValue(channelId);
+				SQLEXEC();
+			},
+			QString::fromLatin1("listenervolume/%1/%2/%3").arg(serverNum).arg(userId).arg(channelId));
 
-		SQLPREP("UPDATE `%1channel_listeners` SET `volume_adjustment` = ? WHERE `server_id` = ? AND `user_id` = ? AND "
-				"`channel_id` = ?");
-		query.addBindValue(volumeAdjustment);
-		query.addBindValue(iServerNum);
-		query.addBindValue(user.iId);
-		query.addBindValue(channel.iId);
-		SQLEXEC();
+		StoredListener *stored = storedListener(user.iId, channel.iId);
+		if (stored) {
+			stored->volumeAdjustment = volumeAdjustment;
+		}
 	}
 
 	m_channelListenerManager.setListenerVolumeAdjustment(user.uiSession, channel.iId,
 														 VolumeAdjustment::fromFactor(volumeAdjustment));
+	invalidateAudience(channel.iId);
+	invalidateWhisperTargets({ channel.iId }, {});
 }
 
 void ServerDB::wipeLogs() {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::ServerLog);
 	QSqlQuery &query = *th.qsqQuery;
 
 	SQLDO("DELETE FROM %1slog");
 }
 
 QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned int offs_min, unsigned int offs_max) {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::ServerLog);
 	QSqlQuery &query = *th.qsqQuery;
 
 	if (Meta::mp.qsDBDriver == "QPSQL") {
@@ -2572,7 +3289,7 @@ QList< QPair< unsigned int, QString > > ServerDB::getLog(int server_id, unsigned
 }
 
 int ServerDB::getLogLen(int server_id) {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::ServerLog);
 	QSqlQuery &query = *th.qsqQuery;
 
 	SQLPREP("SELECT COUNT(`msgtime`) FROM `%1slog` WHERE `server_id` = ?");
@@ -2587,7 +3304,7 @@ int ServerDB::getLogLen(int server_id) {
 }
 
 void ServerDB::setConf(int server_id, const QString &k, const QVariant &value) {
-	TransactionHolder th;
+	TransactionHolder th(ServerDB::NoDependency);
 
 	const QString &key = (k == "serverpassword") ? "password" : k;
 
@@ -2615,6 +3332,17 @@ void ServerDB::setConf(int server_id, const QString &k, const QVariant &value) {
 		}
 	}
 	SQLEXEC();
+
+	QMutexLocker lock(&configCacheMutex);
+	configGeneration++;
+	auto it = configCache.find(server_id);
+	if (it != configCache.end()) {
+		if (value.isNull() || value.toString().trimmed().isEmpty()) {
+			it->remove(key);
+		} else {
+			it->insert(key, value.toString());
+		}
+	}
 }
 
 
@@ -2633,16 +3361,11 @@ QList< int > ServerDB::getAllServers() {
 QList< int > ServerDB::getBootServers() {
 	QList< int > ql = getAllServers();
 
-	TransactionHolder th;
-	QSqlQuery &query = *th.qsqQuery;
-
 	QList< int > bootlist;
 	foreach (int i, ql) {
-		SQLPREP("SELECT `value` FROM `%1config` WHERE `server_id` = ? AND `key` = ?");
-		query.addBindValue(i);
-		query.addBindValue(QLatin1String("boot"));
-		SQLEXEC();
-		if (!query.next() || query.value(0).toBool())
+		// This reads the whole configuration of the server, which is needed to boot it anyway
+		const QVariant boot = getConf(i, QLatin1String("boot"));
+		if (boot.isNull() || boot.toBool())
 			bootlist << i;
 	}
 	return bootlist;
@@ -2679,4 +3402,9 @@ void ServerDB::deleteServer(int server_id) {
 	SQLPREP("DELETE FROM `%1servers` WHERE `server_id` = ?");
 	query.addBindValue(server_id);
 	SQLEXEC();
+
+	// The configuration has been deleted along with the server
+	QMutexLocker lock(&configCacheMutex);
+	configGeneration++;
+	configCache.remove(server_id);
 }
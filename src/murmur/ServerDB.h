@@ -6,16 +6,23 @@
 #ifndef MUMBLE_MURMUR_DATABASE_H_
 #define MUMBLE_MURMUR_DATABASE_H_
 
+#include <QtCore/QFlags>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
 #include <QtCore/QVariant>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
 
 #include "Timer.h"
 
+#include <cstddef>
+#include <functional>
+
 class Server;
 class Channel;
 class User;
 class Connection;
-class QSqlDatabase;
-class QSqlQuery;
+class ServerDBWriter;
 
 class ServerDB : public QObject {
 	Q_OBJECT
@@ -38,12 +45,63 @@ public:
 		User_LastActive,
 		User_KDFIterations
 	};
+	/// The parts of the database that are written behind (see writeBehind()). Everything that accesses the database on
+	/// the main connection states which of them it depends on, so that it only waits for the queued writes that
+	/// change them (see flush()).
+	enum Dependency {
+		NoDependency     = 0x0,
+		/// The channels along with their info, groups and ACLs (see Server::updateChannel)
+		ChannelTree      = 0x1,
+		/// The last channels and the last disconnects of the users, which also change their last activity
+		UserActivity     = 0x2,
+		ChannelListeners = 0x4,
+		/// The server log (see ServerDBWriter::appendLog)
+		ServerLog        = 0x8,
+		AllDependencies  = 0xf
+	};
+	Q_DECLARE_FLAGS(Dependencies, Dependency)
+	static constexpr std::size_t DEPENDENCY_COUNT = 4;
+
+	/// The statements that have been prepared by prepareCached() on one connection. It may only be used by the thread
+	/// that uses the connection.
+	struct StatementCache {
+		/// The prepared statements that currently aren't used by anyone, by their SQL
+		QHash< QString, QSqlQuery > statements;
+		/// The SQL of all statements that have been prepared by prepareCached()
+		QSet< QString > cacheable;
+	};
+
+	/// What is needed to open another connection to a database
+	struct ConnectionParameters {
+		QString driver;
+		QString databaseName;
+		QString hostName;
+		int port = 0;
+		QString userName;
+		QString password;
+		QString connectOptions;
+
+		/// Opens a connection with these parameters under the given name. The connection belongs to the calling
+		/// thread. Whether it could be opened can be checked with QSqlDatabase::isOpen().
+		QSqlDatabase open(const QString &name) const;
+	};
+
 	ServerDB();
 	~ServerDB();
 	typedef QPair< unsigned int, QString > LogRecord;
 	static Timer tLogClean;
 	static QSqlDatabase *db;
+	/// The parameters db has been opened with
+	static ConnectionParameters connectionParameters;
+	/// The connection to the read replica (see Meta::mp.qsDBReplicaHost) or nullptr if there is none
+	static QSqlDatabase *replica;
+	/// The prepared statements of the replica connection
+	static StatementCache replicaStatementCache;
+	/// The thread that performs writes in the background or nullptr if they are performed right away
+	static ServerDBWriter *writer;
 	static QString qsUpgradeSuffix;
+	/// The prepared statements of the main connection
+	static StatementCache statementCache;
 	static void setSUPW(int iServNum, const QString &pw);
 	static void disableSU(int srvnum);
 	static QList< int > getBootServers();
@@ -59,9 +117,26 @@ public:
 	static int getLogLen(int server_id);
 	static void wipeLogs();
 	static bool prepare(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
+	/// Like prepare(), but reuses the statement if it has been prepared before. The statement belongs to the given
+	/// query until it is prepared again or releaseStatement() is called.
+	static bool prepareCached(QSqlQuery &, const QString &);
+	/// Puts the statement the given query has been prepared with by prepareCached() back into the cache
+	static void releaseStatement(QSqlQuery &);
+	/// Drops the prepared statements of the connection the calling thread uses (e.g. because it is reconnecting)
+	static void clearStatementCache();
 	static bool query(QSqlQuery &, const QString &, bool fatal = true, bool warn = true);
 	static bool exec(QSqlQuery &, const QString &str = QString(), bool fatal = true, bool warn = true);
 	static bool execBatch(QSqlQuery &, const QString &str = QString(), bool fatal = true);
+	/// Performs the given write, which changes the given parts of the database, in the background (see ServerDBWriter)
+	/// or right away if write-behind is disabled
+	static void writeBehind(Dependencies changes, const std::function< void(QSqlQuery &query) > &task,
+							const QString &key = QString());
+	/// Waits until all writes that have been queued by writeBehind() and change any of the given parts of the database
+	/// have been committed
+	static void flush(Dependencies dependencies = AllDependencies);
+	/// @returns Whether threads other than the main thread can read from the database. They can't if it only exists
+	/// 	in memory, as such a database is only visible to the connection that has created it.
+	static bool supportsThreadConnections();
 	// No copy; private declaration without implementation
 	ServerDB(const ServerDB &);
 
@@ -70,4 +145,6 @@ private:
 	static void writeSUPW(int srvnum, const QString &pwHash, const QString &saltHash, const QVariant &kdfIterations);
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(ServerDB::Dependencies)
+
 #endif
@@ -0,0 +1,267 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ServerDBWriter.h"
+
+#include "Meta.h"
+
+#include <QtCore/QStringList>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include <algorithm>
+#include <vector>
+
+ServerDBWriter::ServerDBWriter(const ServerDB::ConnectionParameters &parameters)
+	: m_connectionName(QLatin1String("writebehind")), m_parameters(parameters) {
+	start();
+}
+
+ServerDBWriter::~ServerDBWriter() {
+	{
+		QMutexLocker l(&m_mutex);
+		m_stop = true;
+		m_queuedCondition.wakeAll();
+	}
+
+	wait();
+
+	QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+void ServerDBWriter::enqueue(Task task, ServerDB::Dependencies changes, const QString &key) {
+	QMutexLocker l(&m_mutex);
+
+	m_queue.enqueue(std::move(task), key);
+	recordChanges(changes, m_queue.lastSequence());
+
+	m_queuedCondition.wakeAll();
+}
+
+void ServerDBWriter::appendLog(int serverId, const QString &message) {
+	QMutexLocker l(&m_mutex);
+
+	if (m_logLines.empty()) {
+		m_logTimer.start();
+		// Makes the thread wait for LOG_INTERVAL_MSECS at most
+		m_queuedCondition.wakeAll();
+	} else if (m_logLines.size() + 1 >= MAX_LOG_LINES) {
+		m_queuedCondition.wakeAll();
+	}
+
+	m_logLines.push_back({ m_queue.nextSequence(), serverId, message });
+	recordChanges(ServerDB::ServerLog, m_logLines.back().sequence);
+}
+
+void ServerDBWriter::flush(ServerDB::Dependencies dependencies) {
+	if (isCurrentThread())
+		return;
+
+	QMutexLocker l(&m_mutex);
+
+	quint64 target = 0;
+	for (std::size_t i = 0; i < m_lastChanges.size(); ++i) {
+		if (dependencies.testFlag(static_cast< ServerDB::Dependency >(1 << i))) {
+			target = std::max(target, m_lastChanges[i]);
+		}
+	}
+
+	while (m_written < target) {
+		m_flushRequested = true;
+		m_queuedCondition.wakeAll();
+		m_writtenCondition.wait(&m_mutex);
+	}
+}
+
+std::size_t ServerDBWriter::queueDepth() const {
+	QMutexLocker l(&m_mutex);
+
+	return m_queue.size() + m_logLines.size();
+}
+
+bool ServerDBWriter::isCurrentThread() const {
+	return QThread::currentThread() == this;
+}
+
+QSqlDatabase ServerDBWriter::database() const {
+	return QSqlDatabase::database(m_connectionName, false);
+}
+
+void ServerDBWriter::run() {
+	if (!connect()) {
+		qFatal("ServerDB: Failed to connect the write-behind thread: %s", qPrintable(database().lastError().text()));
+	}
+
+	std::vector< Entry > batch;
+	batch.reserve(MAX_BATCH_SIZE);
+	std::vector< LogLine > logLines;
+
+	QElapsedTimer expiryTimer;
+	expiryTimer.start();
+	// Whether expired log lines are being removed (one chunk per iteration)
+	bool expiring = false;
+
+	forever {
+		bool stopping = false;
+		{
+			QMutexLocker l(&m_mutex);
+
+			bool writeLogs = false;
+			forever {
+				writeLogs = !m_logLines.empty()
+							&& (m_stop || m_flushRequested || m_logLines.size() >= MAX_LOG_LINES
+								|| m_logTimer.hasExpired(LOG_INTERVAL_MSECS));
+				if (!expiring && !m_stop && Meta::mp.iLogDays > 0 && expiryTimer.hasExpired(EXPIRY_INTERVAL_MSECS)) {
+					expiring = true;
+				}
+
+				if (!m_queue.empty() || writeLogs || m_stop || expiring) {
+					break;
+				}
+
+				// Wait until there is something to do or until the log lines or the expiry are due
+				qint64 timeout = -1;
+				if (!m_logLines.empty()) {
+					timeout = std::max< qint64 >(LOG_INTERVAL_MSECS - m_logTimer.elapsed(), 1);
+				}
+				if (!expiring && Meta::mp.iLogDays > 0) {
+					const qint64 expiry = std::max< qint64 >(EXPIRY_INTERVAL_MSECS - expiryTimer.elapsed(), 1);
+					timeout             = timeout < 0 ? expiry : std::min(timeout, expiry);
+				}
+
+				if (timeout < 0) {
+					m_queuedCondition.wait(&m_mutex);
+				} else {
+					m_queuedCondition.wait(&m_mutex, static_cast< unsigned long >(timeout));
+				}
+			}
+
+			stopping = m_stop;
+			if (stopping && m_queue.empty() && m_logLines.empty()) {
+				break;
+			}
+
+			m_queue.take(batch, MAX_BATCH_SIZE);
+
+			if (writeLogs) {
+				std::swap(logLines, m_logLines);
+				m_flushRequested = false;
+			}
+		}
+
+		QSqlDatabase db = database();
+
+		if (!batch.empty() || !logLines.empty()) {
+			db.transaction();
+			{
+				QSqlQuery query(db);
+				for (Entry &entry : batch) {
+					if (entry.task) {
+						entry.task(query);
+					}
+				}
+				insertLogs(query, logLines);
+				ServerDB::releaseStatement(query);
+			}
+			db.commit();
+		}
+
+		if (expiring && !stopping) {
+			// Every chunk is a transaction of its own, so that neither the log nor the queued writes have to wait for
+			// long
+			int removed = 0;
+			db.transaction();
+			{
+				QSqlQuery query(db);
+				removed = expireLogs(query);
+				ServerDB::releaseStatement(query);
+			}
+			db.commit();
+
+			if (removed < EXPIRY_CHUNK_SIZE) {
+				expiring = false;
+				expiryTimer.restart();
+			}
+		}
+
+		QMutexLocker l(&m_mutex);
+		updateWritten();
+		m_writtenCondition.wakeAll();
+
+		batch.clear();
+		logLines.clear();
+	}
+
+	ServerDB::clearStatementCache();
+	database().close();
+}
+
+void ServerDBWriter::recordChanges(ServerDB::Dependencies changes, quint64 sequence) {
+	for (std::size_t i = 0; i < m_lastChanges.size(); ++i) {
+		if (changes.testFlag(static_cast< ServerDB::Dependency >(1 << i))) {
+			m_lastChanges[i] = sequence;
+		}
+	}
+}
+
+void ServerDBWriter::updateWritten() {
+	// Everything before the first pending write or log line has been committed
+	quint64 next = m_queue.frontSequence();
+	if (!m_logLines.empty()) {
+		next = std::min(next, m_logLines.front().sequence);
+	}
+
+	m_written = next - 1;
+}
+
+void ServerDBWriter::insertLogs(QSqlQuery &query, const std::vector< LogLine > &lines) {
+	for (std::size_t begin = 0; begin < lines.size(); begin += LOG_LINES_PER_INSERT) {
+		const std::size_t end = std::min(begin + LOG_LINES_PER_INSERT, lines.size());
+
+		QStringList rows;
+		for (std::size_t i = begin; i < end; ++i) {
+			rows << QStringLiteral("(?,?)");
+		}
+
+		ServerDB::prepareCached(query, QLatin1String("INSERT INTO `%1slog` (`server_id`, `msg`) VALUES ")
+										   + rows.join(QLatin1String(",")));
+		for (std::size_t i = begin; i < end; ++i) {
+			query.addBindValue(lines[i].serverId);
+			query.addBindValue(lines[i].message);
+		}
+		ServerDB::exec(query);
+	}
+}
+
+int ServerDBWriter::expireLogs(QSqlQuery &query) {
+	const QString days  = QString::number(Meta::mp.iLogDays);
+	const QString limit = QString::number(EXPIRY_CHUNK_SIZE);
+
+	// The expired lines are found through the index on msgtime. MySQL supports limiting a DELETE directly, the others
+	// need the row IDs of the lines.
+	QString sql;
+	if (Meta::mp.qsDBDriver == "QSQLITE") {
+		sql = QLatin1String("DELETE FROM `%1slog` WHERE `rowid` IN (SELECT `rowid` FROM `%1slog` WHERE `msgtime` < "
+							"datetime('now','-")
+			  + days + QLatin1String(" days') LIMIT ") + limit + QLatin1String(")");
+	} else if (Meta::mp.qsDBDriver == "QPSQL") {
+		sql = QLatin1String("DELETE FROM `%1slog` WHERE `ctid` IN (SELECT `ctid` FROM `%1slog` WHERE `msgtime` < now() "
+							"- INTERVAL '")
+			  + days + QLatin1String(" day' LIMIT ") + limit + QLatin1String(")");
+	} else {
+		sql = QLatin1String("DELETE FROM `%1slog` WHERE `msgtime` < now() - INTERVAL ") + days
+			  + QLatin1String(" day LIMIT ") + limit;
+	}
+
+	ServerDB::prepareCached(query, sql);
+	ServerDB::exec(query);
+
+	return query.numRowsAffected();
+}
+
+bool ServerDBWriter::connect() {
+	return m_parameters.open(m_connectionName).isOpen();
+}
@@ -0,0 +1,130 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SERVERDBWRITER_H_
+#define MUMBLE_MURMUR_SERVERDBWRITER_H_
+
+#include "ServerDB.h"
+#include "WriteBehindQueue.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// A thread that performs writes to the database in the background (write-behind), so that the main thread doesn't
+/// have to wait for them.
+///
+/// The thread uses its own connection to the database, which is opened with the same parameters as
+/// ServerDB::db (see ServerDB::connectionParameters). The queued writes (see WriteBehindQueue) are performed in the
+/// order they have been queued in and all writes that are pending when the thread wakes up are committed in a single
+/// transaction. Keys are used for writes of which only the latest one matters, e.g. the last channel of a user.
+///
+/// Everything that accesses the database on the main connection has to call flush() first, so that it sees the
+/// results of (and is ordered after) the writes that have been queued before. TransactionHolder takes care of that.
+/// As every write states which parts of the database it changes, flush() only waits for the writes that change the
+/// parts the caller depends on (and for the ones queued before them, as the writes are committed in order).
+///
+/// The server log is written separately: log lines are collected for up to LOG_INTERVAL_MSECS and inserted with a few
+/// multi-row INSERTs. Once per EXPIRY_INTERVAL_MSECS, the thread also removes the lines that are older than the
+/// configured number of days (logdays), EXPIRY_CHUNK_SIZE lines at a time and with the queued writes being performed
+/// in between, so that neither the log nor the rest of the database has to wait for a long DELETE.
+class ServerDBWriter : public QThread {
+public:
+	/// A write, which is given a query on the writer's connection
+	using Task = std::function< void(QSqlQuery &query) >;
+
+	/// The maximum number of writes that are committed in a single transaction
+	static constexpr std::size_t MAX_BATCH_SIZE = 512;
+	/// The maximum time log lines are kept before they are written
+	static constexpr qint64 LOG_INTERVAL_MSECS = 250;
+	/// The number of log lines that are written right away, regardless of LOG_INTERVAL_MSECS
+	static constexpr std::size_t MAX_LOG_LINES = 1024;
+	/// The maximum number of log lines that are inserted by a single statement
+	static constexpr std::size_t LOG_LINES_PER_INSERT = 64;
+	/// How often expired log lines are removed
+	static constexpr qint64 EXPIRY_INTERVAL_MSECS = 3600 * 1000;
+	/// The maximum number of log lines that are removed in a single transaction
+	static constexpr int EXPIRY_CHUNK_SIZE = 1000;
+
+	/// Starts the thread, which connects to the database with the given parameters
+	explicit ServerDBWriter(const ServerDB::ConnectionParameters &parameters);
+	/// Performs all pending writes before returning
+	~ServerDBWriter() override;
+
+	/// Queues the given write, which changes the given parts of the database (see WriteBehindQueue::enqueue())
+	void enqueue(Task task, ServerDB::Dependencies changes, const QString &key = QString());
+	/// Queues the given line for the log of the given server
+	void appendLog(int serverId, const QString &message);
+	/// Blocks until all writes that have been queued before and change any of the given parts of the database have
+	/// been committed. This is a no-op if called by the writer itself.
+	void flush(ServerDB::Dependencies dependencies = ServerDB::AllDependencies);
+	/// @returns The number of writes and log lines that haven't been committed yet
+	std::size_t queueDepth() const;
+
+	/// @returns Whether the calling thread is the writer, i.e. whether queries have to use the writer's connection
+	bool isCurrentThread() const;
+	/// @returns The writer's connection, which may only be used by the writer itself
+	QSqlDatabase database() const;
+	/// @returns The statements prepared on the writer's connection, which may only be used by the writer itself
+	ServerDB::StatementCache &statementCache() { return m_statementCache; }
+
+protected:
+	using Entry = WriteBehindQueue< Task >::Entry;
+
+	struct LogLine {
+		quint64 sequence;
+		int serverId;
+		QString message;
+	};
+
+	QString m_connectionName;
+	ServerDB::ConnectionParameters m_parameters;
+
+	ServerDB::StatementCache m_statementCache;
+
+	mutable QMutex m_mutex;
+	/// Signalled when writes have been queued or the thread is supposed to stop
+	QWaitCondition m_queuedCondition;
+	/// Signalled when writes have been committed
+	QWaitCondition m_writtenCondition;
+	/// The queued writes, which share their sequence numbers with the log lines
+	WriteBehindQueue< Task > m_queue;
+	/// The sequence number of the last write that has been queued for each of the parts of the database (by the bit
+	/// of its ServerDB::Dependency)
+	std::array< quint64, ServerDB::DEPENDENCY_COUNT > m_lastChanges = {};
+	/// The sequence number of the last write that has been committed
+	quint64 m_written = 0;
+	bool m_stop       = false;
+	/// Whether flush() is waiting, which means that the log lines have to be written right away
+	bool m_flushRequested = false;
+	/// The log lines that haven't been written yet
+	std::vector< LogLine > m_logLines;
+	/// Started when the first of m_logLines has been queued
+	QElapsedTimer m_logTimer;
+
+	void run() override;
+	/// Opens the writer's connection
+	bool connect();
+	/// Records that the write or log line with the given sequence number changes the given parts of the database. The
+	/// caller has to hold m_mutex.
+	void recordChanges(ServerDB::Dependencies changes, quint64 sequence);
+	/// Sets m_written according to what is still pending. The caller has to hold m_mutex.
+	void updateWritten();
+	/// Inserts the given lines into the log
+	static void insertLogs(QSqlQuery &query, const std::vector< LogLine > &lines);
+	/// Removes up to EXPIRY_CHUNK_SIZE expired lines from the log
+	///
+	/// @returns The number of lines that have been removed
+	static int expireLogs(QSqlQuery &query);
+};
+
+#endif // MUMBLE_MURMUR_SERVERDBWRITER_H_
@@ -7,12 +7,17 @@
 
 #include "ClientType.h"
 #include "Meta.h"
+#include "QtUtils.h"
 #include "Server.h"
 
 #ifdef Q_OS_UNIX
 #	include "Utils.h"
 #endif
 
+#ifdef Q_OS_WIN
+#	include <qos2.h>
+#endif
+
 ServerUser::ServerUser(Server *p, QSslSocket *socket)
 	: Connection(p, socket), User(), s(nullptr), leakyBucket(p->iMessageLimit, p->iMessageBurst),
 	  m_pluginMessageBucket(p->iPluginMessageLimit, p->iPluginMessageBurst) {
@@ -20,9 +25,6 @@ ServerUser::ServerUser(Server *p, QSslSocket *socket)
 	m_clientType = ClientType::REGULAR;
 	sUdpSocket   = INVALID_SOCKET;
 
-	memset(&saiUdpAddress, 0, sizeof(saiUdpAddress));
-	memset(&saiTcpLocalAddress, 0, sizeof(saiTcpLocalAddress));
-
 	dUDPPingAvg = dUDPPingVar = 0.0f;
 	dTCPPingAvg = dTCPPingVar = 0.0f;
 	uiUDPPackets = uiTCPPackets = 0;
@@ -32,89 +34,114 @@ ServerUser::ServerUser(Server *p, QSslSocket *socket)
 	bVerified            = true;
 	iLastPermissionCheck = -1;
 
-	bOpus = false;
+	bOpus               = false;
+	bStateSnapshot      = false;
+	bVoiceRedundancy    = false;
+	bPluginDataBatches  = false;
+	bTextMessageHistory = false;
+	bSmallAudioFrames   = false;
+	uiLastRemoteGood    = uiLastRemoteLost = 0;
 }
 
-
-ServerUser::operator QString() const {
-	return QString::fromLatin1("%1:%2(%3)").arg(qsName).arg(uiSession).arg(iId);
-}
-BandwidthRecord::BandwidthRecord() {
-	iRecNum = 0;
-	iSum    = 0;
-	for (int i = 0; i < N_BANDWIDTH_SLOTS; i++)
-		a_iBW[i] = 0;
+ServerUser::~ServerUser() {
+#ifdef Q_OS_WIN
+	if (Meta::hQoS && m_qosFlow) {
+		QOSRemoveSocketFromFlow(Meta::hQoS, 0, m_qosFlow, 0);
+	}
+#endif
 }
 
-bool BandwidthRecord::addFrame(int size, int maxpersec) {
-	QMutexLocker ml(&qmMutex);
-
-	quint64 elapsed = a_qtWhen[iRecNum].elapsed();
-
-	if (elapsed == 0)
-		return false;
-
-	int nsum = iSum - a_iBW[iRecNum] + size;
-	int bw   = static_cast< int >((static_cast< quint64 >(nsum) * 1000000ULL) / elapsed);
 
-	if (bw > maxpersec)
-		return false;
+const ServerUser::ClientDetails &ServerUser::clientDetails() const {
+	static const ClientDetails none;
 
-	a_iBW[iRecNum] = static_cast< unsigned short >(size);
-	a_qtWhen[iRecNum].restart();
-
-	iSum = nsum;
+	return m_clientDetails ? *m_clientDetails : none;
+}
 
-	iRecNum++;
-	if (iRecNum == N_BANDWIDTH_SLOTS)
-		iRecNum = 0;
+ServerUser::ClientDetails &ServerUser::editClientDetails() {
+	if (!m_clientDetails) {
+		m_clientDetails = std::make_unique< ClientDetails >();
+	}
 
-	return true;
+	return *m_clientDetails;
 }
 
-int BandwidthRecord::onlineSeconds() const {
-	QMutexLocker ml(&qmMutex);
+const std::vector< std::string > &ServerUser::certificateChainDer() {
+	if (!m_certificateChainDer) {
+		m_certificateChainDer = std::make_unique< std::vector< std::string > >();
+		for (const QSslCertificate &cert : peerCertificateChain()) {
+			m_certificateChainDer->push_back(blob(cert.toDer()));
+		}
+	}
 
-	return static_cast< int >(tFirst.elapsed() / 1000000LL);
+	return *m_certificateChainDer;
 }
 
-int BandwidthRecord::idleSeconds() const {
-	QMutexLocker ml(&qmMutex);
-
-	quint64 iIdle = a_qtWhen[(iRecNum + N_BANDWIDTH_SLOTS - 1) % N_BANDWIDTH_SLOTS].elapsed();
-	if (tIdleControl.elapsed() < iIdle)
-		iIdle = tIdleControl.elapsed();
+namespace {
+std::size_t stringBytes(const QString &str) {
+	return static_cast< std::size_t >(str.capacity()) * sizeof(QChar);
+}
 
-	return static_cast< int >(iIdle / 1000000LL);
+std::size_t stringBytes(const QByteArray &bytes) {
+	return static_cast< std::size_t >(bytes.capacity());
 }
 
-void BandwidthRecord::resetIdleSeconds() {
-	QMutexLocker ml(&qmMutex);
+std::size_t stringBytes(const QStringList &list) {
+	std::size_t bytes = static_cast< std::size_t >(list.size()) * sizeof(QString);
+	for (const QString &str : list) {
+		bytes += stringBytes(str);
+	}
 
-	tIdleControl.restart();
+	return bytes;
 }
+} // namespace
 
-int BandwidthRecord::bandwidth() const {
-	QMutexLocker ml(&qmMutex);
+ServerUser::MemoryUsage ServerUser::memoryUsage() const {
+	MemoryUsage usage;
 
-	int sum         = 0;
-	quint64 elapsed = 0ULL;
+	usage.object = sizeof(ServerUser);
+	if (m_clientDetails) {
+		usage.object += sizeof(ClientDetails);
+	}
+	if (m_derivedPassword) {
+		usage.object += sizeof(DerivedPassword);
+	}
 
-	for (int i = 1; i < N_BANDWIDTH_SLOTS; ++i) {
-		int idx   = (iRecNum + N_BANDWIDTH_SLOTS - i) % N_BANDWIDTH_SLOTS;
-		quint64 e = a_qtWhen[idx].elapsed();
-		if (e > 1000000ULL) {
-			break;
-		} else {
-			sum += a_iBW[idx];
-			elapsed = e;
+	usage.strings = stringBytes(qsName) + stringBytes(qsComment) + stringBytes(qbaCommentHash) + stringBytes(qsHash)
+					+ stringBytes(qbaTexture) + stringBytes(qbaTextureHash) + stringBytes(qslAccessTokens)
+					+ ssContext.capacity();
+	if (m_clientDetails) {
+		usage.strings += stringBytes(m_clientDetails->qsRelease) + stringBytes(m_clientDetails->qsOS)
+						 + stringBytes(m_clientDetails->qsOSVersion) + stringBytes(m_clientDetails->qsIdentity)
+						 + stringBytes(m_clientDetails->qslEmail);
+	}
+	if (m_certificateChainDer) {
+		usage.object += sizeof(std::vector< std::string >);
+		for (const std::string &der : *m_certificateChainDer) {
+			usage.strings += der.capacity();
 		}
 	}
 
-	if (elapsed < 250000ULL)
-		return 0;
+	// The receiver tables of the caches are shared between users, so only the caches themselves are accounted for
+	usage.whisperTargets = static_cast< std::size_t >(qmTargets.size()) * sizeof(WhisperTarget)
+						   + static_cast< std::size_t >(qmTargetCache.size()) * sizeof(WhisperTargetCache)
+						   + static_cast< std::size_t >(qmPermissionSent.size()) * 2 * sizeof(int);
+	for (const WhisperTarget &target : qmTargets) {
+		usage.whisperTargets += static_cast< std::size_t >(target.qlSessions.size()) * sizeof(unsigned int)
+								+ static_cast< std::size_t >(target.qlChannels.size()) * sizeof(WhisperTarget::Channel);
+	}
+	for (const WhisperTargetCache &cache : qmTargetCache) {
+		const int dependencies = cache.dependentChannels.size() + cache.dependentSessions.size();
+		usage.whisperTargets += static_cast< std::size_t >(dependencies) * sizeof(unsigned int);
+	}
 
-	return static_cast< int >((static_cast< quint64 >(sum) * 1000000ULL) / elapsed);
+	usage.sendQueue = static_cast< std::size_t >(m_sendQueueBytes);
+
+	return usage;
+}
+
+ServerUser::operator QString() const {
+	return QString::fromLatin1("%1:%2(%3)").arg(qsName).arg(uiSession).arg(iId);
 }
 
 LeakyBucket::LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens)
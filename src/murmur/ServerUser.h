@@ -12,61 +12,99 @@
 #	include "win.h"
 #endif
 
+#include "BandwidthRecord.h"
 #include "ClientType.h"
 #include "Connection.h"
+#include "FrameAggregator.h"
 #include "HostAddress.h"
+#include "MumbleProtocol.h"
 #include "Timer.h"
+#include "UDPSendQueue.h"
 #include "User.h"
+#include "VolumeAdjustment.h"
 
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QStringList>
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
 #ifdef Q_OS_WIN
 #	include <winsock2.h>
 #else
 #	include <sys/socket.h>
 #endif
 
-// Unfortunately, this needs to be "large enough" to hold
-// enough frames to account for both short-term and
-// long-term "maladjustments".
-
-#define N_BANDWIDTH_SLOTS 360
-
-struct BandwidthRecord {
-	int iRecNum;
-	int iSum;
-	Timer tFirst;
-	Timer tIdleControl;
-	unsigned short a_iBW[N_BANDWIDTH_SLOTS];
-	Timer a_qtWhen[N_BANDWIDTH_SLOTS];
-	mutable QMutex qmMutex;
-
-	BandwidthRecord();
-	bool addFrame(int size, int maxpersec);
-	int onlineSeconds() const;
-	int idleSeconds() const;
-	void resetIdleSeconds();
-	int bandwidth() const;
-};
-
 struct WhisperTarget {
 	struct Channel {
 		int iId;
 		bool bChildren;
 		bool bLinks;
 		QString qsGroup;
+
+		bool operator==(const Channel &other) const {
+			return iId == other.iId && bChildren == other.bChildren && bLinks == other.bLinks
+				   && qsGroup == other.qsGroup;
+		}
 	};
 	QList< unsigned int > qlSessions;
 	QList< WhisperTarget::Channel > qlChannels;
+
+	bool operator==(const WhisperTarget &other) const {
+		return qlSessions == other.qlSessions && qlChannels == other.qlChannels;
+	}
+	bool operator!=(const WhisperTarget &other) const { return !(*this == other); }
+};
+
+/// A whisper target of a registered user that is kept while the user is disconnected (see
+/// Server::saveWhisperTargets). Sessions change with every connection, so the users are kept by their registration
+/// ID instead (and users who aren't registered are left out).
+struct SavedWhisperTarget {
+	QList< int > qlUsers;
+	QList< WhisperTarget::Channel > qlChannels;
 };
 
 class ServerUser;
 
+/// Everyone who receives the audio sent to a whisper target. Every user is contained only once (with the context and
+/// volume adjustment AudioReceiverBuffer would end up with) and the receivers are sorted by session.
+///
+/// Tables are immutable once built, which allows them to be shared by all speakers whose targets lead to the same
+/// receivers (see Server::refreshWhisperTargets).
+struct WhisperReceiverTable {
+	struct Receiver {
+		ServerUser *user;
+		Mumble::Protocol::audio_context_t context;
+		VolumeAdjustment volumeAdjustment;
+
+		bool operator==(const Receiver &other) const {
+			return user == other.user && context == other.context
+				   && volumeAdjustment.factor == other.volumeAdjustment.factor;
+		}
+	};
+
+	/// The receivers that share the speaker's positional context and thus get positional data (if the speaker sends
+	/// any)
+	std::vector< Receiver > positional;
+	/// All other receivers
+	std::vector< Receiver > regular;
+
+	bool operator==(const WhisperReceiverTable &other) const {
+		return positional == other.positional && regular == other.regular;
+	}
+};
+
 struct WhisperTargetCache {
-	QSet< ServerUser * > channelTargets;
-	QSet< ServerUser * > directTargets;
-	QHash< ServerUser *, VolumeAdjustment > listeningTargets;
+	std::shared_ptr< const WhisperReceiverTable > receivers;
+
+	/// The channels and users (by session) the receivers have been determined from. Whenever any of them changes,
+	/// the cache is invalidated (see Server::invalidateWhisperTargets).
+	QSet< unsigned int > dependentChannels;
+	QSet< unsigned int > dependentSessions;
 };
 
 class Server;
@@ -99,7 +137,50 @@ public:
 	LeakyBucket(unsigned int tokensPerSec, unsigned int maxTokens);
 };
 
-class ServerUser : public Connection, public User {
+/// The state of a user the voice threads touch for (nearly) every packet they route from or to the user. It is kept
+/// together, starting at a cache line of its own, so that routing a packet only loads a few cache lines per user
+/// instead of touching fields scattered throughout the (rather large) rest of the ServerUser.
+struct alignas(64) ServerUserVoicePath {
+	/// Holds whether the user is using TCP
+	/// or UDP for voice packets.
+	///
+	/// If the flag is 0, the user is using
+	/// TCP.
+	///
+	/// If the flag is 1, the user is using
+	/// UDP.
+	QAtomicInt aiUdpFlag;
+#ifdef Q_OS_UNIX
+	int sUdpSocket;
+#else
+	SOCKET sUdpSocket;
+#endif
+	/// Locks access to the decrypting half of csCrypt (see Server::checkDecrypt), whereas its encrypting half is
+	/// protected by qmCrypt. Thus decrypting a packet from this user doesn't wait for packets being sent to it.
+	QMutex qmDecrypt;
+	/// The number of voice packets of this user that have been dropped because of the bandwidth limit (see bwr)
+	std::atomic< quint64 > m_bandwidthDrops{ 0 };
+	/// Whether the audio sent to this user includes the redundant payloads, which is the case if the client has asked
+	/// for them and has been losing packets lately (see VoiceRedundancy)
+	std::atomic< bool > m_redundantVoice{ false };
+	/// The bitrate (in bits per second) the audio of the user's channel should not exceed for the user to receive it
+	/// well, as derived from the quality of its link (see Server::linkBitrate). 0 if the link isn't constrained.
+	std::atomic< unsigned int > m_linkBitrate{ 0 };
+	BandwidthRecord bwr;
+	/// Combines the user's frames into regular ones if it speaks with frames shorter than 10 ms (see
+	/// Server::processMsg)
+	FrameAggregator m_frameAggregator;
+	/// Where UDP packets for this user are sent to. Its address is the one the user's UDP packets come from and it
+	/// is updated whenever that changes.
+	UDPDestination udpDestination;
+#ifdef Q_OS_WIN
+	/// The qWAVE flow the UDP packets sent to udpDestination belong to (see Server::updateQoSFlow) or 0 if there is
+	/// none. It is removed along with the user.
+	DWORD m_qosFlow = 0;
+#endif
+};
+
+class ServerUser : public Connection, public User, public ServerUserVoicePath {
 private:
 	Q_OBJECT
 	Q_DISABLE_COPY(ServerUser)
@@ -117,34 +198,35 @@ public:
 	quint32 uiUDPPackets, uiTCPPackets;
 
 	Version::full_t m_version;
-	QString qsRelease;
-	QString qsOS;
-	QString qsOSVersion;
 
 	std::string ssContext;
-	QString qsIdentity;
 
 	bool bVerified;
-	QStringList qslEmail;
 
 	HostAddress haAddress;
-
-	/// Holds whether the user is using TCP
-	/// or UDP for voice packets.
-	///
-	/// If the flag is 0, the user is using
-	/// TCP.
-	///
-	/// If the flag is 1, the user is using
-	/// UDP.
-	QAtomicInt aiUdpFlag;
+	/// The local address the user has connected to, which is where UDP packets to the user are sent from
+	HostAddress haTcpLocalAddress;
 
 	QList< int > qlCodecs;
 	bool bOpus;
+	/// Whether the client wants to receive the server's channels and users as StateSnapshot messages when connecting
+	bool bStateSnapshot;
+	/// Whether the client wants to receive redundant audio while its connection is lossy (see m_redundantVoice)
+	bool bVoiceRedundancy;
+	/// Whether the client can process PluginDataBatch messages
+	bool bPluginDataBatches;
+	/// Whether the client wants to be sent the message history of the channels it joins (see Server::m_messageHistory)
+	bool bTextMessageHistory;
+	/// Whether the client can play audio with frames shorter than 10 ms (see FrameAggregator)
+	bool bSmallAudioFrames;
+	/// The packet counts the client has reported in its previous ping, so that the loss in between can be told
+	quint32 uiLastRemoteGood, uiLastRemoteLost;
 
 	QStringList qslAccessTokens;
 
 	QMap< int, WhisperTarget > qmTargets;
+	/// Only used by the main thread, the voice threads use the tables in the published VoiceState (see
+	/// Server::m_voiceState)
 	QMap< int, WhisperTargetCache > qmTargetCache;
 	QMap< QString, QString > qmWhisperRedirect;
 
@@ -153,15 +235,79 @@ public:
 
 	int iLastPermissionCheck;
 	QMap< int, unsigned int > qmPermissionSent;
-#ifdef Q_OS_UNIX
-	int sUdpSocket;
-#else
-	SOCKET sUdpSocket;
-#endif
-	BandwidthRecord bwr;
-	struct sockaddr_storage saiUdpAddress;
-	struct sockaddr_storage saiTcpLocalAddress;
+
+	/// What the client has told about itself (and what its certificate says). It is only ever needed when somebody
+	/// asks for it, so it is kept out of line and only allocated once there is anything to keep (see
+	/// editClientDetails()).
+	struct ClientDetails {
+		QString qsRelease;
+		QString qsOS;
+		QString qsOSVersion;
+		/// The identity reported by the client's positional audio plugin
+		QString qsIdentity;
+		QStringList qslEmail;
+	};
+	/// @returns The details of the user's client, which are all empty if it hasn't sent any
+	const ClientDetails &clientDetails() const;
+	/// @returns The details of the user's client, which are allocated if they haven't been yet
+	ClientDetails &editClientDetails();
+	/// @returns The DER encoding of the certificates in the user's chain, which is only serialized the first time it is
+	/// 	needed, as the chain doesn't change once the user has connected
+	const std::vector< std::string > &certificateChainDer();
+
+	/// An estimate of the memory the user takes up, in bytes
+	struct MemoryUsage {
+		/// The ServerUser itself and everything it keeps out of line
+		std::size_t object = 0;
+		/// The user's name, comment, texture, certificate hash and client details
+		std::size_t strings = 0;
+		/// The user's whisper targets, their caches and the permissions that have been sent to the user
+		std::size_t whisperTargets = 0;
+		/// The messages that are waiting to be written to the user's connection
+		std::size_t sendQueue = 0;
+
+		std::size_t total() const { return object + strings + whisperTargets + sendQueue; }
+	};
+	MemoryUsage memoryUsage() const;
+
+	/// A password hash that has been derived in the background before the user's authentication is processed (see
+	/// Server::deferPasswordCheck)
+	struct DerivedPassword {
+		QString salt;
+		int iterations = 0;
+		QString password;
+		QString hash;
+	};
+	std::unique_ptr< DerivedPassword > m_derivedPassword;
+	/// Whether the user's password is being derived in the background
+	bool m_passwordCheckPending = false;
+
+	/// The result of validating the text of one of the user's messages in the background (see
+	/// Server::deferTextValidation). It is only set while the message is being handled again.
+	struct ValidatedText {
+		/// The text as it has been sent
+		QString text;
+		/// The text after it has been filtered
+		QString filtered;
+		bool allowed;
+	};
+	std::unique_ptr< ValidatedText > m_validatedText;
+	/// A message whose text is waiting to be validated
+	struct PendingTextValidation {
+		std::string text;
+		/// Handles the message again once its text has been validated
+		std::function< void() > replay;
+	};
+	/// The user's messages whose text is waiting to be validated, oldest first. Only the first one is being validated
+	/// at any time.
+	std::deque< PendingTextValidation > m_pendingTextValidations;
+
 	ServerUser(Server *parent, QSslSocket *socket);
+	~ServerUser() override;
+
+protected:
+	std::unique_ptr< ClientDetails > m_clientDetails;
+	std::unique_ptr< std::vector< std::string > > m_certificateChainDer;
 };
 
 #endif
@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SHARDEDMAP_H_
+#define MUMBLE_MURMUR_SHARDEDMAP_H_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+/// A map from integers to values whose entries are spread across a fixed amount of shards, which copies of the map
+/// share. Changing a copy only copies the shards it changes, so that deriving a slightly different map from a large
+/// one takes time proportional to the changes rather than to the whole map.
+///
+/// Shards are never changed once they are shared. A map that has been copied may thus still be read by other threads
+/// while the copy is being changed.
+template< typename Key, typename Value > class ShardedMap {
+public:
+	static constexpr std::size_t SHARD_COUNT = 64;
+
+	ShardedMap() = default;
+	/// The copy shares all shards with the given map, which has to copy them as well if it is changed afterwards
+	ShardedMap(const ShardedMap &other) : m_shards(other.m_shards) { other.m_owned.reset(); }
+	ShardedMap &operator=(const ShardedMap &other) {
+		m_shards = other.m_shards;
+		m_owned.reset();
+		other.m_owned.reset();
+		return *this;
+	}
+
+	/// @returns The value stored for the given key or nullptr if there is none
+	const Value *find(const Key &key) const {
+		const Shard *shard = m_shards[shardOf(key)].get();
+		if (!shard) {
+			return nullptr;
+		}
+
+		auto it = shard->find(key);
+		return it != shard->end() ? &it->second : nullptr;
+	}
+
+	/// Stores the given value for the given key, replacing any value that was stored for it before
+	void set(const Key &key, Value value) { (*ownShard(key))[key] = std::move(value); }
+
+	void erase(const Key &key) {
+		// Don't copy a shard only to find out that there is nothing to erase
+		if (find(key)) {
+			ownShard(key)->erase(key);
+		}
+	}
+
+	std::size_t size() const {
+		std::size_t size = 0;
+		for (const std::shared_ptr< Shard > &shard : m_shards) {
+			size += shard ? shard->size() : 0;
+		}
+		return size;
+	}
+
+	/// @returns Whether this map and the given one share the shard of the given key (for testing)
+	bool sharesShardWith(const ShardedMap &other, const Key &key) const {
+		return m_shards[shardOf(key)] == other.m_shards[shardOf(key)];
+	}
+
+private:
+	using Shard = std::unordered_map< Key, Value >;
+
+	std::array< std::shared_ptr< Shard >, SHARD_COUNT > m_shards;
+	/// The shards that no other map shares, which may thus be changed in place
+	mutable std::bitset< SHARD_COUNT > m_owned;
+
+	static std::size_t shardOf(const Key &key) {
+		// Sessions and channel IDs are mostly consecutive, so the upper bits of a multiplicative hash spread them
+		// evenly
+		static_assert(SHARD_COUNT == 64, "The shard is selected by the upper 6 bits of the hash");
+		return static_cast< std::size_t >((static_cast< std::uint64_t >(key) * 0x9E3779B97F4A7C15ULL) >> 58);
+	}
+
+	Shard *ownShard(const Key &key) {
+		const std::size_t index = shardOf(key);
+		if (!m_owned[index]) {
+			if (m_shards[index]) {
+				m_shards[index] = std::make_shared< Shard >(*m_shards[index]);
+			} else {
+				m_shards[index] = std::make_shared< Shard >();
+			}
+			m_owned[index] = true;
+		}
+
+		return m_shards[index].get();
+	}
+};
+
+#endif // MUMBLE_MURMUR_SHARDEDMAP_H_
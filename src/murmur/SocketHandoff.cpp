@@ -0,0 +1,254 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "SocketHandoff.h"
+
+#include <QtCore/QSocketNotifier>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+/// The payload of every message
+struct Header {
+	std::int32_t serverId;
+	std::int32_t type;
+};
+
+bool toAddress(const QString &path, sockaddr_un &address) {
+	const QByteArray encoded = path.toLocal8Bit();
+	memset(&address, 0, sizeof(address));
+	if (encoded.isEmpty() || static_cast< std::size_t >(encoded.size()) >= sizeof(address.sun_path)) {
+		return false;
+	}
+
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, encoded.constData(), static_cast< std::size_t >(encoded.size()));
+	return true;
+}
+
+/// @returns Whether the process at the other end of the given connection runs as the same user as this one
+bool samePeer(int connection) {
+#ifdef Q_OS_LINUX
+	struct ucred credentials;
+	socklen_t length = sizeof(credentials);
+	if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+		return false;
+	}
+	return credentials.uid == geteuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	if (getpeereid(connection, &uid, &gid) != 0) {
+		return false;
+	}
+	return uid == geteuid();
+#endif
+}
+} // namespace
+
+SocketHandoff::SocketHandoff(QObject *parent) : QObject(parent) {
+}
+
+SocketHandoff::~SocketHandoff() {
+	close();
+}
+
+bool SocketHandoff::listen(const QString &path) {
+	close();
+
+	sockaddr_un address;
+	if (!toAddress(path, address)) {
+		qWarning("SocketHandoff: %s is not a valid socket path", qPrintable(path));
+		return false;
+	}
+
+	m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_socket < 0) {
+		qWarning("SocketHandoff: Failed to create socket: %s", strerror(errno));
+		return false;
+	}
+
+	// A previous instance either is gone or has handed everything over already
+	unlink(address.sun_path);
+	if (::bind(m_socket, reinterpret_cast< sockaddr * >(&address), sizeof(address)) != 0
+		|| ::listen(m_socket, 1) != 0) {
+		qWarning("SocketHandoff: Failed to listen on %s: %s", qPrintable(path), strerror(errno));
+		::close(m_socket);
+		m_socket = -1;
+		return false;
+	}
+
+	m_notifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+	connect(m_notifier, &QSocketNotifier::activated, this, [this]() { accept(); });
+	return true;
+}
+
+void SocketHandoff::close() {
+	delete m_notifier;
+	m_notifier = nullptr;
+
+	if (m_socket >= 0) {
+		::close(m_socket);
+		m_socket = -1;
+	}
+}
+
+void SocketHandoff::accept() {
+	const int connection = ::accept(m_socket, nullptr, nullptr);
+	if (connection < 0) {
+		return;
+	}
+
+	if (samePeer(connection)) {
+		emit requested(connection);
+	} else {
+		qWarning("SocketHandoff: Refused to hand the sockets over to a process of another user");
+	}
+
+	::close(connection);
+}
+
+bool SocketHandoff::takeOver(const QString &path, std::vector< Socket > &sockets) {
+	sockaddr_un address;
+	if (!toAddress(path, address)) {
+		return false;
+	}
+
+	const int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0) {
+		return false;
+	}
+
+	// The running instance answers from its event loop, which shouldn't take long unless it hangs
+	struct timeval timeout;
+	timeout.tv_sec  = 10;
+	timeout.tv_usec = 0;
+	setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	if (::connect(connection, reinterpret_cast< sockaddr * >(&address), sizeof(address)) != 0) {
+		// Nobody to take over from
+		::close(connection);
+		return false;
+	}
+
+	const bool received = receiveSockets(connection, sockets);
+	::close(connection);
+	return received && !sockets.empty();
+}
+
+bool SocketHandoff::sendSockets(int connection, const std::vector< Socket > &sockets) {
+	for (const Socket &socket : sockets) {
+		Header header = { static_cast< std::int32_t >(socket.serverId), static_cast< std::int32_t >(socket.type) };
+
+		struct iovec iov;
+		iov.iov_base = &header;
+		iov.iov_len  = sizeof(header);
+
+		union {
+			struct cmsghdr header;
+			char data[CMSG_SPACE(sizeof(int))];
+		} control;
+		memset(&control, 0, sizeof(control));
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov        = &iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = control.data;
+		msg.msg_controllen = sizeof(control.data);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level     = SOL_SOCKET;
+		cmsg->cmsg_type      = SCM_RIGHTS;
+		cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &socket.fd, sizeof(int));
+
+		ssize_t sent;
+		do {
+			sent = ::sendmsg(connection, &msg, 0);
+		} while (sent < 0 && errno == EINTR);
+
+		if (sent != static_cast< ssize_t >(sizeof(header))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SocketHandoff::receiveSockets(int connection, std::vector< Socket > &sockets) {
+	while (true) {
+		Header header;
+
+		struct iovec iov;
+		iov.iov_base = &header;
+		iov.iov_len  = sizeof(header);
+
+		union {
+			struct cmsghdr header;
+			char data[CMSG_SPACE(sizeof(int))];
+		} control;
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov        = &iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = control.data;
+		msg.msg_controllen = sizeof(control.data);
+
+		ssize_t received;
+		do {
+			received = ::recvmsg(connection, &msg, MSG_WAITALL);
+		} while (received < 0 && errno == EINTR);
+
+		if (received == 0) {
+			// All sockets have been sent
+			return true;
+		}
+
+		int fd = -1;
+		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+				&& cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+				memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+			}
+		}
+
+		if (received != static_cast< ssize_t >(sizeof(header)) || (msg.msg_flags & MSG_CTRUNC) || fd < 0) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+			return false;
+		}
+
+		Socket socket;
+		socket.serverId = header.serverId;
+		socket.type     = header.type;
+		socket.fd       = fd;
+		socket.port     = 0;
+
+		sockaddr_storage address;
+		socklen_t length = sizeof(address);
+		memset(&address, 0, sizeof(address));
+		if (getsockname(fd, reinterpret_cast< sockaddr * >(&address), &length) == 0) {
+			socket.address = HostAddress(address);
+			if (address.ss_family == AF_INET6) {
+				socket.port = ntohs(reinterpret_cast< sockaddr_in6 * >(&address)->sin6_port);
+			} else if (address.ss_family == AF_INET) {
+				socket.port = ntohs(reinterpret_cast< sockaddr_in * >(&address)->sin_port);
+			}
+		}
+
+		sockets.push_back(socket);
+	}
+}
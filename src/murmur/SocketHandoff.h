@@ -0,0 +1,75 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SOCKETHANDOFF_H_
+#define MUMBLE_MURMUR_SOCKETHANDOFF_H_
+
+#include "HostAddress.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <vector>
+
+class QSocketNotifier;
+
+/// Hands the listening sockets of all virtual servers over from a running instance to the one that replaces it (see
+/// MetaParams::qsHandoffSocket), so that the ports keep accepting connections while the server is restarted.
+///
+/// The new instance connects to the Unix socket the running one listens on and receives every socket as a message
+/// of its own: the ID of the server that the socket belongs to and the socket's type as the payload, and the socket
+/// itself as SCM_RIGHTS control data. The running instance closes the connection once it has sent all of them.
+///
+/// Only instances that run as the same user may take the sockets over (Unix only).
+class SocketHandoff : public QObject {
+private:
+	Q_OBJECT
+	Q_DISABLE_COPY(SocketHandoff)
+
+public:
+	struct Socket {
+		int serverId;
+		/// SOCK_STREAM for a TCP listener and SOCK_DGRAM for a voice socket
+		int type;
+		int fd;
+		/// The address and port the socket is bound to (filled in by receiveSockets())
+		HostAddress address;
+		unsigned short port;
+	};
+
+	SocketHandoff(QObject *parent = nullptr);
+	~SocketHandoff() Q_DECL_OVERRIDE;
+
+	/// Starts listening for the next instance at the given path, replacing whatever is there
+	bool listen(const QString &path);
+	/// Stops listening. The path is left alone, as it belongs to the next instance by then.
+	void close();
+
+	/// Takes the sockets over from the instance listening at the given path
+	///
+	/// @returns Whether there has been an instance that has handed its sockets over
+	static bool takeOver(const QString &path, std::vector< Socket > &sockets);
+
+	/// Sends the given sockets (which stay open) over the given connection
+	static bool sendSockets(int connection, const std::vector< Socket > &sockets);
+	/// Receives sockets from the given connection until it is closed
+	///
+	/// @returns Whether all sockets have been received. Sockets that have been received until an error occurred are
+	/// 	in the list nonetheless.
+	static bool receiveSockets(int connection, std::vector< Socket > &sockets);
+
+signals:
+	/// A new instance asks for the sockets. Whoever is connected has to send them over the given connection (see
+	/// sendSockets()), which is closed afterwards.
+	void requested(int connection);
+
+protected:
+	int m_socket                = -1;
+	QSocketNotifier *m_notifier = nullptr;
+
+	void accept();
+};
+
+#endif // MUMBLE_MURMUR_SOCKETHANDOFF_H_
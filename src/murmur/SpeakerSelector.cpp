@@ -0,0 +1,115 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "SpeakerSelector.h"
+
+#include <algorithm>
+
+namespace {
+/// The weight of the latest frame in the smoothed level of a speaker
+constexpr float SMOOTHING = 0.2f;
+
+/// The duration of the frames of the Opus configurations in units of 2.5 ms (see RFC 6716, section 3.1)
+unsigned int opusFrameDuration(unsigned int config) {
+	static const unsigned int SILK[]   = { 4, 8, 16, 24 };
+	static const unsigned int HYBRID[] = { 4, 8 };
+	static const unsigned int CELT[]   = { 1, 2, 4, 8 };
+
+	if (config < 12) {
+		return SILK[config % 4];
+	} else if (config < 16) {
+		return HYBRID[config % 2];
+	} else {
+		return CELT[config % 4];
+	}
+}
+} // namespace
+
+SpeakerSelector::SpeakerSelector(unsigned int maxSpeakers) : m_maxSpeakers(std::max(maxSpeakers, 1U)) {
+}
+
+unsigned int SpeakerSelector::maxSpeakers() const {
+	return m_maxSpeakers;
+}
+
+float SpeakerSelector::opusRate(const gsl::span< const Mumble::Protocol::byte > packet) {
+	if (packet.empty()) {
+		return 0.0f;
+	}
+
+	// The table of contents byte tells the configuration (and thus the duration of the frames) and how many frames
+	// the packet contains
+	const unsigned int toc = packet[0];
+	unsigned int frames    = 1;
+	switch (toc & 0x3) {
+		case 0:
+			break;
+		case 1:
+		case 2:
+			frames = 2;
+			break;
+		case 3:
+			if (packet.size() < 2 || (packet[1] & 0x3F) == 0) {
+				return 0.0f;
+			}
+			frames = packet[1] & 0x3F;
+			break;
+	}
+
+	const unsigned int duration = opusFrameDuration(toc >> 3) * frames;
+
+	return static_cast< float >(packet.size()) * 4.0f / static_cast< float >(duration);
+}
+
+bool SpeakerSelector::admit(unsigned int session, const Mumble::Protocol::AudioData &audioData, quint64 now) {
+	const float rate = audioData.usedCodec == Mumble::Protocol::AudioCodec::Opus
+						   ? opusRate(audioData.payload)
+						   : static_cast< float >(audioData.payload.size());
+
+	std::lock_guard< std::mutex > lock(m_mutex);
+
+	// Forget about the ones that have stopped speaking without saying so
+	m_speakers.erase(std::remove_if(m_speakers.begin(), m_speakers.end(),
+									[now](const Speaker &speaker) { return speaker.lastFrame + TIMEOUT < now; }),
+					 m_speakers.end());
+
+	auto speaker = std::find_if(m_speakers.begin(), m_speakers.end(),
+								[session](const Speaker &current) { return current.session == session; });
+	if (speaker == m_speakers.end()) {
+		m_speakers.push_back({ session, rate, now, false });
+		speaker = m_speakers.end() - 1;
+	} else {
+		speaker->level     = speaker->level * (1.0f - SMOOTHING) + rate * SMOOTHING;
+		speaker->lastFrame = now;
+	}
+
+	if (!speaker->forwarded) {
+		unsigned int forwarded = 0;
+		auto quietest          = m_speakers.end();
+		for (auto it = m_speakers.begin(); it != m_speakers.end(); ++it) {
+			if (it->forwarded) {
+				forwarded++;
+				if (quietest == m_speakers.end() || it->level < quietest->level) {
+					quietest = it;
+				}
+			}
+		}
+
+		if (forwarded < m_maxSpeakers) {
+			speaker->forwarded = true;
+		} else if (speaker->level > quietest->level * HYSTERESIS) {
+			quietest->forwarded = false;
+			speaker->forwarded  = true;
+		}
+	}
+
+	const bool forward = speaker->forwarded;
+	if (audioData.isLastFrame) {
+		// The speaker has stopped, which makes room for somebody else
+		m_speakers.erase(speaker);
+	}
+
+	return forward;
+}
@@ -0,0 +1,64 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SPEAKERSELECTOR_H_
+#define MUMBLE_MURMUR_SPEAKERSELECTOR_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/// Decides whose speech is forwarded in a channel that only lets a limited number of users speak at once (see
+/// Server::qsSpeakerLimits). The loudest speakers are picked, with the loudness of a speaker being estimated from the
+/// bitrate of their Opus frames: with variable bitrate, speech is encoded with (a lot) more bits than silence or
+/// background noise, and discontinuous transmission sends hardly anything at all.
+///
+/// A speaker that has been picked keeps being forwarded until they stop speaking or somebody else gets considerably
+/// louder than them (HYSTERESIS), so that several speakers of about the same loudness don't keep replacing each other.
+/// The selector may be used by several voice threads at once.
+class SpeakerSelector {
+public:
+	/// How much louder a speaker has to be than the quietest one that is forwarded in order to replace them
+	static constexpr float HYSTERESIS = 1.5f;
+	/// Speakers whose last frame has been received longer ago than this (in microseconds) are no longer speaking
+	static constexpr quint64 TIMEOUT = 500000;
+
+	/// @param maxSpeakers The number of speakers that are forwarded at once (at least 1)
+	explicit SpeakerSelector(unsigned int maxSpeakers);
+
+	SpeakerSelector(const SpeakerSelector &) = delete;
+	SpeakerSelector &operator=(const SpeakerSelector &) = delete;
+
+	unsigned int maxSpeakers() const;
+
+	/// Accounts for a frame of the given speaker
+	///
+	/// @param now The current time in microseconds (see BandwidthRecord::clock())
+	/// @returns Whether the frame shall be forwarded
+	bool admit(unsigned int session, const Mumble::Protocol::AudioData &audioData, quint64 now);
+
+	/// @returns The bitrate of the given Opus packet in bytes per 10 ms or 0 if it isn't a valid Opus packet
+	static float opusRate(const gsl::span< const Mumble::Protocol::byte > packet);
+
+protected:
+	struct Speaker {
+		unsigned int session;
+		/// The smoothed bitrate of the speaker (see opusRate())
+		float level;
+		quint64 lastFrame;
+		bool forwarded;
+	};
+
+	const unsigned int m_maxSpeakers;
+	std::mutex m_mutex;
+	/// The users that are speaking at the moment, whether they are forwarded or not
+	std::vector< Speaker > m_speakers;
+};
+
+#endif // MUMBLE_MURMUR_SPEAKERSELECTOR_H_
@@ -0,0 +1,207 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "StageMixer.h"
+
+#include <opus.h>
+
+#include <algorithm>
+
+namespace {
+/// The longest a speaker's buffered audio may get (in samples) before the oldest part is dropped
+constexpr std::size_t MAX_BUFFERED_SAMPLES = 10 * StageMixer::FRAME_SAMPLES;
+/// The longest Opus packet (120 ms) in samples
+constexpr int MAX_PACKET_SAMPLES = StageMixer::SAMPLE_RATE / 1000 * 120;
+} // namespace
+
+StageMixer::StageMixer(unsigned int channel, int bitrate) : m_channel(channel) {
+	int error = OPUS_OK;
+	m_encoder = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_AUDIO, &error);
+	if (error != OPUS_OK) {
+		m_encoder = nullptr;
+		return;
+	}
+
+	opus_encoder_ctl(m_encoder, OPUS_SET_VBR(0));
+	opus_encoder_ctl(m_encoder, OPUS_SET_BITRATE(bitrate));
+}
+
+StageMixer::~StageMixer() {
+	for (Speaker &speaker : m_speakers) {
+		opus_decoder_destroy(speaker.decoder);
+	}
+	if (m_encoder) {
+		opus_encoder_destroy(m_encoder);
+	}
+}
+
+unsigned int StageMixer::channel() const {
+	return m_channel;
+}
+
+bool StageMixer::isValid() const {
+	return m_encoder != nullptr;
+}
+
+void StageMixer::push(unsigned int session, const Mumble::Protocol::AudioData &audioData, quint64 now) {
+	if (audioData.usedCodec != Mumble::Protocol::AudioCodec::Opus) {
+		return;
+	}
+
+	std::lock_guard< std::mutex > lock(m_queueMutex);
+
+	auto activity = std::find_if(m_activity.begin(), m_activity.end(),
+								 [session](const Activity &current) { return current.session == session; });
+	if (activity != m_activity.end()) {
+		activity->lastFrame = now;
+	} else if (m_activity.size() < MAX_SPEAKERS) {
+		m_activity.push_back({ session, now });
+	} else {
+		// Too many people on stage already
+		return;
+	}
+
+	m_queue.push_back({ session, std::vector< Mumble::Protocol::byte >(audioData.payload.begin(),
+																		 audioData.payload.end()),
+						audioData.isLastFrame });
+}
+
+std::size_t StageMixer::speakers(std::array< unsigned int, MAX_SPEAKERS > &sessions, quint64 now) const {
+	std::lock_guard< std::mutex > lock(m_queueMutex);
+
+	std::size_t count = 0;
+	for (const Activity &activity : m_activity) {
+		if (activity.lastFrame + TIMEOUT >= now) {
+			sessions[count++] = activity.session;
+		}
+	}
+
+	return count;
+}
+
+bool StageMixer::mix(Frame &frame, quint64 now) {
+	if (!m_encoder) {
+		return false;
+	}
+
+	std::array< unsigned int, MAX_SPEAKERS > active;
+	std::size_t activeCount = 0;
+	{
+		std::lock_guard< std::mutex > lock(m_queueMutex);
+		m_pending.swap(m_queue);
+
+		// Nobody is interested in the activity of speakers who have been gone for a while anymore
+		m_activity.erase(std::remove_if(m_activity.begin(), m_activity.end(),
+										[now](const Activity &activity) { return activity.lastFrame + TIMEOUT < now; }),
+						 m_activity.end());
+		for (const Activity &activity : m_activity) {
+			active[activeCount++] = activity.session;
+		}
+	}
+
+	for (const Packet &packet : m_pending) {
+		decode(packet);
+	}
+	m_pending.clear();
+
+	m_mix.fill(0.0f);
+	bool anybody = false;
+	for (Speaker &speaker : m_speakers) {
+		if (!speaker.playing) {
+			speaker.playing = speaker.stopped
+							  || speaker.samples.size() >= static_cast< std::size_t >(JITTER_FRAMES * FRAME_SAMPLES);
+		}
+		if (!speaker.playing) {
+			continue;
+		}
+
+		// Whatever is missing is silence
+		const std::size_t available = std::min(speaker.samples.size(), static_cast< std::size_t >(FRAME_SAMPLES));
+		for (std::size_t i = 0; i < available; ++i) {
+			m_mix[i] += speaker.samples[i];
+		}
+		speaker.samples.erase(speaker.samples.begin(),
+							  speaker.samples.begin() + static_cast< std::ptrdiff_t >(available));
+		anybody = true;
+	}
+
+	// Speakers are gone once all of their audio has been mixed and they have either said so or haven't sent anything
+	// in a while
+	for (auto it = m_speakers.begin(); it != m_speakers.end();) {
+		const bool timedOut = std::find(active.data(), active.data() + activeCount, it->session)
+							  == active.data() + activeCount;
+		if (it->playing && it->samples.empty() && (it->stopped || timedOut)) {
+			opus_decoder_destroy(it->decoder);
+			it = m_speakers.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	if (!anybody && !m_active) {
+		return false;
+	}
+
+	for (float &sample : m_mix) {
+		sample = std::max(-1.0f, std::min(1.0f, sample));
+	}
+
+	frame.payload.resize(Mumble::Protocol::MAX_UDP_PACKET_SIZE);
+	const opus_int32 length = opus_encode_float(m_encoder, m_mix.data(), FRAME_SAMPLES, frame.payload.data(),
+												static_cast< opus_int32 >(frame.payload.size()));
+	if (length <= 0) {
+		return false;
+	}
+	frame.payload.resize(static_cast< std::size_t >(length));
+
+	if (!m_speakers.empty()) {
+		m_session = m_speakers.front().session;
+	}
+	frame.session     = m_session;
+	frame.frameNumber = m_frameNumber;
+	frame.isLastFrame = m_speakers.empty();
+
+	// Frame numbers count 10 ms frames
+	m_frameNumber += FRAME_DURATION / 10000;
+	m_active = !m_speakers.empty();
+
+	return true;
+}
+
+void StageMixer::decode(const Packet &packet) {
+	auto speaker = std::find_if(m_speakers.begin(), m_speakers.end(),
+								[&packet](const Speaker &current) { return current.session == packet.session; });
+	if (speaker == m_speakers.end()) {
+		if (m_speakers.size() == MAX_SPEAKERS) {
+			return;
+		}
+
+		int error            = OPUS_OK;
+		OpusDecoder *decoder = opus_decoder_create(SAMPLE_RATE, 1, &error);
+		if (error != OPUS_OK) {
+			return;
+		}
+
+		m_speakers.emplace_back();
+		speaker          = m_speakers.end() - 1;
+		speaker->session = packet.session;
+		speaker->decoder = decoder;
+	}
+
+	speaker->stopped = packet.isLastFrame;
+
+	const std::size_t offset = speaker->samples.size();
+	speaker->samples.resize(offset + static_cast< std::size_t >(MAX_PACKET_SAMPLES));
+	const int decoded =
+		opus_decode_float(speaker->decoder, packet.data.data(), static_cast< opus_int32 >(packet.data.size()),
+						  speaker->samples.data() + offset, MAX_PACKET_SAMPLES, 0);
+	speaker->samples.resize(offset + static_cast< std::size_t >(std::max(decoded, 0)));
+
+	if (speaker->samples.size() > MAX_BUFFERED_SAMPLES) {
+		// The speaker is sending faster than real time (or has been sending in bursts), so the oldest audio gives way
+		speaker->samples.erase(speaker->samples.begin(),
+							   speaker->samples.end() - static_cast< std::ptrdiff_t >(MAX_BUFFERED_SAMPLES));
+	}
+}
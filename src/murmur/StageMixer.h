@@ -0,0 +1,126 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_STAGEMIXER_H_
+#define MUMBLE_MURMUR_STAGEMIXER_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct OpusDecoder;
+struct OpusEncoder;
+
+/// Mixes the speech in a stage channel (see Server::qsStageChannels) into a single stream. Channels like that have
+/// few speakers and a lot of listeners, so instead of sending every speaker's frames to every listener, the server
+/// decodes the speakers' Opus frames, mixes them and encodes the mix once for all listeners. The speakers themselves
+/// get each other's frames as they are (which also keeps them from hearing themselves).
+///
+/// The voice threads hand the frames they receive to push(), while a mixing thread calls mix() every FRAME_DURATION.
+/// Every speaker's audio is delayed by JITTER_FRAMES mixed frames, which evens out the jitter of their packets. At
+/// most MAX_SPEAKERS users are mixed at once, any further ones are ignored until somebody stops speaking.
+class StageMixer {
+public:
+	static constexpr int SAMPLE_RATE = 48000;
+	/// The duration of a mixed frame in microseconds
+	static constexpr quint64 FRAME_DURATION = 20000;
+	static constexpr int FRAME_SAMPLES      = SAMPLE_RATE / 50;
+	/// How many frames of a speaker are buffered before their audio becomes part of the mix
+	static constexpr int JITTER_FRAMES        = 2;
+	static constexpr std::size_t MAX_SPEAKERS = 16;
+	/// Speakers who haven't sent anything for this long (in microseconds) no longer count as speakers
+	static constexpr quint64 TIMEOUT = 1000000;
+	/// The bitrate the mix is encoded with by default in bits per second
+	static constexpr int DEFAULT_BITRATE = 64000;
+
+	/// A mixed frame
+	struct Frame {
+		std::vector< Mumble::Protocol::byte > payload;
+		/// The session the frame is sent on behalf of, which is the one of the speaker who has been speaking the
+		/// longest (so that clients can tell who is speaking, at least roughly)
+		unsigned int session      = 0;
+		std::uint64_t frameNumber = 0;
+		bool isLastFrame          = false;
+	};
+
+	/// @param channel The ID of the stage channel
+	/// @param bitrate The bitrate of the mix in bits per second
+	StageMixer(unsigned int channel, int bitrate);
+	~StageMixer();
+
+	StageMixer(const StageMixer &) = delete;
+	StageMixer &operator=(const StageMixer &) = delete;
+
+	unsigned int channel() const;
+	/// @returns Whether the encoder for the mix could be created
+	bool isValid() const;
+
+	/// Queues a frame of the given speaker for the next call to mix(). May be called by any thread.
+	///
+	/// @param now The current time in microseconds (see BandwidthRecord::clock())
+	void push(unsigned int session, const Mumble::Protocol::AudioData &audioData, quint64 now);
+	/// Copies the sessions of the users who are speaking at the moment to the given array. May be called by any thread.
+	///
+	/// @returns The number of speakers
+	std::size_t speakers(std::array< unsigned int, MAX_SPEAKERS > &sessions, quint64 now) const;
+
+	/// Mixes and encodes the next FRAME_DURATION of audio. Must only be called by a single thread at a time.
+	///
+	/// @param now The current time in microseconds (see BandwidthRecord::clock())
+	/// @returns Whether there is a frame to be sent, which is the case as long as anybody is speaking (plus a final
+	/// frame once everybody has stopped)
+	bool mix(Frame &frame, quint64 now);
+
+protected:
+	/// A frame that has been received, but not decoded yet
+	struct Packet {
+		unsigned int session;
+		std::vector< Mumble::Protocol::byte > data;
+		bool isLastFrame;
+	};
+
+	struct Speaker {
+		unsigned int session;
+		OpusDecoder *decoder = nullptr;
+		/// The decoded audio that hasn't been mixed yet
+		std::vector< float > samples;
+		/// Whether the speaker has buffered enough audio to be mixed
+		bool playing = false;
+		/// Whether the speaker has sent their last frame
+		bool stopped = false;
+	};
+
+	/// A speaker as seen by the voice threads
+	struct Activity {
+		unsigned int session;
+		quint64 lastFrame;
+	};
+
+	const unsigned int m_channel;
+	OpusEncoder *m_encoder = nullptr;
+
+	mutable std::mutex m_queueMutex;
+	std::vector< Packet > m_queue;
+	std::vector< Activity > m_activity;
+
+	// Only used by the mixing thread
+	std::vector< Packet > m_pending;
+	std::vector< Speaker > m_speakers;
+	std::array< float, FRAME_SAMPLES > m_mix;
+	std::uint64_t m_frameNumber = 0;
+	/// The session the last frame has been sent on behalf of, which the final frame is sent on behalf of as well
+	unsigned int m_session = 0;
+	bool m_active          = false;
+
+	void decode(const Packet &packet);
+};
+
+#endif // MUMBLE_MURMUR_STAGEMIXER_H_
@@ -0,0 +1,76 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "StateSnapshotCache.h"
+
+#include <cstddef>
+
+const MumbleProto::StateSnapshot *StateSnapshotCache::channels() const {
+	return m_channels.has_data() ? &m_channels : nullptr;
+}
+
+const MumbleProto::StateSnapshot &StateSnapshotCache::setChannels(const QByteArray &data) {
+	setData(m_channels, data);
+	return m_channels;
+}
+
+const QByteArray *StateSnapshotCache::userFrame(unsigned int session) const {
+	auto it = m_userFrames.constFind(session);
+	return it != m_userFrames.constEnd() ? &it.value() : nullptr;
+}
+
+const QByteArray &StateSnapshotCache::setUserFrame(unsigned int session, const QByteArray &frame) {
+	return m_userFrames.insert(session, frame).value();
+}
+
+void StateSnapshotCache::invalidate(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
+	switch (type) {
+		case Mumble::Protocol::TCPMessageType::ChannelState:
+			invalidateChannels();
+			break;
+		case Mumble::Protocol::TCPMessageType::ChannelRemove:
+			invalidateChannels();
+			// Users might have been listening to the removed channel
+			invalidateUsers();
+			break;
+		case Mumble::Protocol::TCPMessageType::UserState:
+			m_userFrames.remove(static_cast< const MumbleProto::UserState & >(msg).session());
+			break;
+		case Mumble::Protocol::TCPMessageType::UserRemove:
+			m_userFrames.remove(static_cast< const MumbleProto::UserRemove & >(msg).session());
+			break;
+		default:
+			break;
+	}
+}
+
+void StateSnapshotCache::invalidateChannels() {
+	m_channels.Clear();
+}
+
+void StateSnapshotCache::invalidateUsers() {
+	m_userFrames.clear();
+}
+
+void StateSnapshotCache::setData(MumbleProto::StateSnapshot &snapshot, const QByteArray &data) {
+	const QByteArray compressed = qCompress(data);
+
+	if (compressed.size() < data.size()) {
+		snapshot.set_compression(MumbleProto::StateSnapshot_Compression_Zlib);
+		snapshot.set_data(compressed.constData(), static_cast< std::size_t >(compressed.size()));
+	} else {
+		snapshot.set_compression(MumbleProto::StateSnapshot_Compression_None);
+		snapshot.set_data(data.constData(), static_cast< std::size_t >(data.size()));
+	}
+}
+
+bool StateSnapshotCache::fitsIntoMessage(const MumbleProto::StateSnapshot &snapshot) {
+#if GOOGLE_PROTOBUF_VERSION >= 3004000
+	return snapshot.ByteSizeLong() <= 0x7fffff;
+#else
+	// ByteSize() has been deprecated as of protobuf v3.4
+	return snapshot.ByteSize() <= 0x7fffff;
+#endif
+}
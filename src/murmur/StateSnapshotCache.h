@@ -0,0 +1,55 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_STATESNAPSHOTCACHE_H_
+#define MUMBLE_MURMUR_STATESNAPSHOTCACHE_H_
+
+#include "Mumble.pb.h"
+#include "MumbleProtocol.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+
+/// The parts of the StateSnapshot messages sent to joining clients that are the same for every receiver (see
+/// Server::sendChannelSnapshot and Server::sendUserSnapshot). Everything that is broadcast drops the parts it changes
+/// (see invalidate()), so that the cached parts always describe the state the other clients have been told about.
+///
+/// The per-receiver parts (the enter states of the channels) are never cached, which is why changed ACLs don't
+/// invalidate anything.
+class StateSnapshotCache {
+public:
+	/// @returns The channel tree (without the enter states) or nullptr if it has to be built (again)
+	const MumbleProto::StateSnapshot *channels() const;
+	/// Caches the channel tree consisting of the given framed ChannelState messages
+	///
+	/// @returns The cached snapshot
+	const MumbleProto::StateSnapshot &setChannels(const QByteArray &data);
+
+	/// @returns The framed UserState message describing the given user or nullptr if it has to be built (again)
+	const QByteArray *userFrame(unsigned int session) const;
+	/// Caches the given framed UserState message describing the given user
+	///
+	/// @returns The cached frame
+	const QByteArray &setUserFrame(unsigned int session, const QByteArray &frame);
+
+	/// Drops the parts the given message (which is about to be broadcast) changes
+	void invalidate(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type);
+	/// Drops the channel tree (e.g. because the name of the root channel has changed)
+	void invalidateChannels();
+	/// Drops the frames of all users (e.g. because the fields they contain have changed)
+	void invalidateUsers();
+
+	/// Sets the data of the given snapshot, which is compressed if that makes it smaller
+	static void setData(MumbleProto::StateSnapshot &snapshot, const QByteArray &data);
+	/// @returns Whether the given snapshot is small enough to be sent as a single message
+	static bool fitsIntoMessage(const MumbleProto::StateSnapshot &snapshot);
+
+private:
+	MumbleProto::StateSnapshot m_channels;
+	/// The framed UserState messages by session
+	QHash< unsigned int, QByteArray > m_userFrames;
+};
+
+#endif // MUMBLE_MURMUR_STATESNAPSHOTCACHE_H_
@@ -0,0 +1,125 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TimeoutWheel.h"
+
+#include <algorithm>
+
+constexpr unsigned int TimeoutWheel::SLOT_BITS;
+constexpr unsigned int TimeoutWheel::SLOTS;
+constexpr unsigned int TimeoutWheel::LEVELS;
+constexpr quint64 TimeoutWheel::RANGE;
+
+/// If the wheel has to be advanced by more than this many ticks at once, the deadlines are sorted into their slots
+/// from scratch instead of turning the wheel tick by tick
+static constexpr quint64 MAX_TURN = TimeoutWheel::SLOTS * TimeoutWheel::SLOTS;
+
+TimeoutWheel::TimeoutWheel(quint64 now) : m_now(now) {
+}
+
+void TimeoutWheel::schedule(unsigned int session, quint64 deadline) {
+	remove(session);
+
+	// The current slot of the lowest level has already been expired
+	insert(session, deadline, std::max(deadline, m_now + 1));
+}
+
+void TimeoutWheel::remove(unsigned int session) {
+	auto it = m_entries.find(session);
+	if (it == m_entries.end()) {
+		return;
+	}
+
+	m_slots[it->slot].remove(session);
+	m_entries.erase(it);
+}
+
+bool TimeoutWheel::contains(unsigned int session) const {
+	return m_entries.contains(session);
+}
+
+QList< unsigned int > TimeoutWheel::advance(quint64 now) {
+	QList< unsigned int > expired;
+
+	if (now <= m_now) {
+		return expired;
+	}
+
+	if (m_entries.isEmpty()) {
+		m_now = now;
+		return expired;
+	}
+
+	if (now - m_now > MAX_TURN) {
+		const QHash< unsigned int, Entry > entries = m_entries;
+		m_entries.clear();
+		for (QSet< unsigned int > &slot : m_slots) {
+			slot.clear();
+		}
+
+		m_now = now;
+		for (auto it = entries.begin(); it != entries.end(); ++it) {
+			if (it->deadline <= now) {
+				expired << it.key();
+			} else {
+				insert(it.key(), it->deadline, it->deadline);
+			}
+		}
+
+		return expired;
+	}
+
+	while (m_now < now) {
+		m_now++;
+
+		// Whenever a level has turned once, the next slot of the level above is moved down
+		for (unsigned int level = 1; level < LEVELS; level++) {
+			const unsigned int shift = SLOT_BITS * level;
+			if ((m_now & ((quint64(1) << shift) - 1)) != 0) {
+				break;
+			}
+
+			cascade(level * SLOTS + static_cast< unsigned int >((m_now >> shift) & (SLOTS - 1)));
+		}
+
+		QSet< unsigned int > &slot = m_slots[static_cast< unsigned int >(m_now & (SLOTS - 1))];
+		for (unsigned int session : slot) {
+			m_entries.remove(session);
+			expired << session;
+		}
+		slot.clear();
+	}
+
+	return expired;
+}
+
+std::size_t TimeoutWheel::size() const {
+	return static_cast< std::size_t >(m_entries.size());
+}
+
+void TimeoutWheel::insert(unsigned int session, quint64 deadline, quint64 at) {
+	// Deadlines beyond the reach of the wheel wait in the top level until they are in reach
+	at = std::min(at, m_now + RANGE - 1);
+
+	const quint64 delta = at - m_now;
+	unsigned int level  = 0;
+	while (level < LEVELS - 1 && delta >= (quint64(1) << (SLOT_BITS * (level + 1)))) {
+		level++;
+	}
+
+	const unsigned int slot = level * SLOTS + static_cast< unsigned int >((at >> (SLOT_BITS * level)) & (SLOTS - 1));
+	m_slots[slot].insert(session);
+	m_entries.insert(session, { deadline, slot });
+}
+
+void TimeoutWheel::cascade(unsigned int slot) {
+	const QSet< unsigned int > sessions = m_slots[slot];
+	m_slots[slot].clear();
+
+	for (unsigned int session : sessions) {
+		const quint64 deadline = m_entries.value(session).deadline;
+		insert(session, deadline, std::max(deadline, m_now));
+	}
+}
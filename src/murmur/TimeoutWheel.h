@@ -0,0 +1,73 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_TIMEOUTWHEEL_H_
+#define MUMBLE_MURMUR_TIMEOUTWHEEL_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QtGlobal>
+
+#include <array>
+#include <cstddef>
+
+/// Keeps track of the deadlines of the sessions (see Server::checkTimeout()), so that only the sessions whose
+/// deadline has passed have to be looked at instead of all of them.
+///
+/// This is a hierarchical timing wheel: every level has SLOTS slots, each of which covers SLOTS times as many ticks
+/// as a slot of the level below. A deadline is put into the lowest level that reaches it, and the slots of the
+/// higher levels are moved down a level whenever the level below has turned once. Scheduling and removing a deadline
+/// thus take constant time, and advancing the wheel only touches the deadlines that have passed (plus the ones that
+/// move down a level).
+///
+/// Time is measured in ticks of an arbitrary length, which only have to increase monotonically.
+class TimeoutWheel {
+public:
+	static constexpr unsigned int SLOT_BITS = 6;
+	static constexpr unsigned int SLOTS     = 1 << SLOT_BITS;
+	static constexpr unsigned int LEVELS    = 4;
+	/// The number of ticks the wheel reaches into the future. Later deadlines are moved down from the top level
+	/// repeatedly until they are in reach.
+	static constexpr quint64 RANGE = quint64(1) << (SLOT_BITS * LEVELS);
+
+	/// @param now The current time
+	explicit TimeoutWheel(quint64 now = 0);
+
+	/// Schedules the given session to time out at the given time, replacing its previous deadline. A deadline that
+	/// has already passed expires with the next advance() to a later time.
+	void schedule(unsigned int session, quint64 deadline);
+	/// Forgets about the deadline of the given session
+	void remove(unsigned int session);
+	bool contains(unsigned int session) const;
+
+	/// Advances the wheel to the given time
+	///
+	/// @returns The sessions whose deadline has passed, which are removed from the wheel
+	QList< unsigned int > advance(quint64 now);
+
+	/// @returns The number of scheduled sessions
+	std::size_t size() const;
+
+protected:
+	struct Entry {
+		quint64 deadline;
+		/// The index of the slot in m_slots
+		unsigned int slot;
+	};
+
+	quint64 m_now;
+	QHash< unsigned int, Entry > m_entries;
+	/// The slots of all levels, starting with the lowest one
+	std::array< QSet< unsigned int >, SLOTS * LEVELS > m_slots;
+
+	/// Puts the given session into the slot of the given time, which must not be earlier than m_now. Deadlines at
+	/// m_now go into the current slot of the lowest level, which advance() is about to expire.
+	void insert(unsigned int session, quint64 deadline, quint64 at);
+	/// Moves the sessions in the given slot down to where they belong now
+	void cascade(unsigned int slot);
+};
+
+#endif // MUMBLE_MURMUR_TIMEOUTWHEEL_H_
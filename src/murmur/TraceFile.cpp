@@ -0,0 +1,28 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "TraceFile.h"
+
+#include <QtCore/QMutexLocker>
+
+TraceFile::TraceFile(const QString &path, QIODevice::OpenMode flags, const QByteArray &header) : m_file(path) {
+	if (m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | flags)) {
+		m_file.write(header);
+	}
+	m_clock.start();
+}
+
+bool TraceFile::isOpen() const {
+	return m_file.isOpen();
+}
+
+qint64 TraceFile::now() const {
+	return m_clock.nsecsElapsed() / 1000;
+}
+
+void TraceFile::write(const QByteArray &entry) {
+	QMutexLocker lock(&m_mutex);
+	m_file.write(entry);
+}
@@ -0,0 +1,40 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_TRACEFILE_H_
+#define MUMBLE_MURMUR_TRACEFILE_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+/// The file a trace (see DBTrace and VoiceTrace) is written to. The entries of a trace are timed relative to the point
+/// at which the file has been created, and may be appended by any thread.
+class TraceFile {
+public:
+	/// Creates the given file, replacing what it contains, and writes the header a trace of its kind starts with
+	///
+	/// @param flags Added to the mode the file is opened with (e.g. QIODevice::Text)
+	TraceFile(const QString &path, QIODevice::OpenMode flags, const QByteArray &header = QByteArray());
+
+	TraceFile(const TraceFile &) = delete;
+	TraceFile &operator=(const TraceFile &) = delete;
+
+	bool isOpen() const;
+	/// @returns The time since the file has been created in microseconds
+	qint64 now() const;
+	/// Appends the given entry as a whole, even if other threads append theirs at the same time
+	void write(const QByteArray &entry);
+
+protected:
+	QFile m_file;
+	QElapsedTimer m_clock;
+	QMutex m_mutex;
+};
+
+#endif // MUMBLE_MURMUR_TRACEFILE_H_
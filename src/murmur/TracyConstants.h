@@ -20,6 +20,18 @@ static constexpr const char *AUDIO_ENCODE               = "audio_encode";
 static constexpr const char *AUDIO_UPDATE               = "audio_update";
 static constexpr const char *AUDIO_WHISPER_CACHE_STORE  = "audio_whisper_cache_restore";
 static constexpr const char *AUDIO_WHISPER_CACHE_CREATE = "audio_whisper_cache_create";
+
+// The plots of the audit build (see Audit::report)
+static constexpr const char *LOCK_VOICE_THREAD_CONTENDED = "lock_voice_thread_contended";
+static constexpr const char *LOCK_CACHE_CONTENDED        = "lock_cache_contended";
+static constexpr const char *LOCK_CRYPT_CONTENDED        = "lock_crypt_contended";
+static constexpr const char *LOCK_DECRYPT_CONTENDED      = "lock_decrypt_contended";
+
+static constexpr const char *ALLOC_OTHER         = "alloc_other";
+static constexpr const char *ALLOC_VOICE_LOOP    = "alloc_voice_loop";
+static constexpr const char *ALLOC_PROCESS_MSG   = "alloc_process_msg";
+static constexpr const char *ALLOC_SEND_MESSAGE  = "alloc_send_message";
+static constexpr const char *ALLOC_CHECK_DECRYPT = "alloc_check_decrypt";
 } // namespace TracyConstants
 
 #endif // MUMBLE_MURMUR_TRACYCONSTANTS_H_
@@ -0,0 +1,320 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Transcoder.h"
+
+#include "BandwidthRecord.h"
+#include "CELTCodec.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <opus.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr int SAMPLE_RATE = CELTCodec::SAMPLE_RATE;
+/// The samples of a CELT frame, which is what frame numbers count for either codec
+constexpr int FRAME_SAMPLES = CELTCodec::FRAME_SIZE;
+/// The longest Opus packet (120 ms) in samples
+constexpr int MAX_OPUS_SAMPLES = SAMPLE_RATE / 1000 * 120;
+/// The durations (in CELT frames) an Opus packet may have, which the decoded CELT frames are encoded in. Longer ones
+/// come first, as they cost less.
+constexpr std::array< int, 4 > OPUS_FRAMES = { 6, 4, 2, 1 };
+/// The size of the Opus packets the transcoder encodes at most
+constexpr int MAX_OPUS_BYTES = 1000;
+/// In every legacy payload, every CELT frame is preceded by a header byte holding its size (which can't be larger than
+/// 0x7f) and a flag telling whether another frame follows
+constexpr Mumble::Protocol::byte CELT_CONTINUATION = 0x80;
+constexpr Mumble::Protocol::byte CELT_SIZE_MASK    = 0x7f;
+
+std::uint64_t streamKey(const Transcoder::Frame &frame) {
+	return (static_cast< std::uint64_t >(frame.session) << 8) | static_cast< std::uint64_t >(frame.targetCodec);
+}
+} // namespace
+
+Transcoder::Worker::Worker(Transcoder &transcoder, std::size_t index) : m_transcoder(transcoder), m_index(index) {
+}
+
+void Transcoder::Worker::run() {
+	m_transcoder.run(*this, m_index);
+}
+
+Transcoder::Transcoder(const CELTCodec &celt, std::size_t workers, Sender sender)
+	: m_celt(celt), m_sender(std::move(sender)) {
+	for (std::size_t i = 0; i < std::max< std::size_t >(workers, 1); ++i) {
+		m_workers.push_back(std::make_unique< Worker >(*this, i));
+		m_workers.back()->start(QThread::HighPriority);
+	}
+}
+
+Transcoder::~Transcoder() {
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		QMutexLocker l(&worker->m_mutex);
+		worker->m_stop = true;
+		worker->m_condition.wakeAll();
+	}
+	for (std::unique_ptr< Worker > &worker : m_workers) {
+		worker->wait();
+	}
+}
+
+Mumble::Protocol::AudioCodec Transcoder::targetCodec(Mumble::Protocol::AudioCodec codec, bool receiverHasOpus) {
+	switch (codec) {
+		case Mumble::Protocol::AudioCodec::Opus:
+			return receiverHasOpus ? codec : Mumble::Protocol::AudioCodec::CELT_Alpha;
+		case Mumble::Protocol::AudioCodec::CELT_Alpha:
+			// Clients that support Opus get it, even if they would support CELT as well
+			return receiverHasOpus ? Mumble::Protocol::AudioCodec::Opus : codec;
+		case Mumble::Protocol::AudioCodec::CELT_Beta:
+		case Mumble::Protocol::AudioCodec::Speex:
+			// Not supported by the library (and never announced while transcoding, see Server::applyCodecVersions)
+			break;
+	}
+
+	return codec;
+}
+
+void Transcoder::submit(Frame &&frame) {
+	Worker &worker = *m_workers[frame.session % m_workers.size()];
+
+	QMutexLocker l(&worker.m_mutex);
+
+	if (worker.m_queue.size() >= MAX_QUEUED_FRAMES) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	worker.m_queue.push_back(std::move(frame));
+	worker.m_condition.wakeOne();
+}
+
+std::uint64_t Transcoder::droppedFrames() const {
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+void Transcoder::run(Worker &worker, std::size_t index) {
+	// Only ever used by this thread
+	std::unordered_map< std::uint64_t, Stream > streams;
+	std::deque< Frame > frames;
+	Frame output;
+
+	forever {
+		{
+			QMutexLocker l(&worker.m_mutex);
+
+			if (worker.m_queue.empty() && !worker.m_stop) {
+				worker.m_condition.wait(&worker.m_mutex, STREAM_TIMEOUT_MSECS);
+			}
+			if (worker.m_stop) {
+				break;
+			}
+
+			std::swap(frames, worker.m_queue);
+		}
+
+		const quint64 now = BandwidthRecord::clock();
+
+		for (Frame &frame : frames) {
+			const std::uint64_t key = streamKey(frame);
+
+			auto it = streams.find(key);
+			if (it == streams.end()) {
+				Stream stream;
+				if (!open(stream, frame.targetCodec)) {
+					close(stream);
+					continue;
+				}
+				stream.frameNumber = frame.frameNumber;
+				it                 = streams.emplace(key, std::move(stream)).first;
+			}
+			it->second.lastUsed = now;
+
+			output.session                = frame.session;
+			output.codec                  = frame.targetCodec;
+			output.targetCodec            = frame.targetCodec;
+			output.containsPositionalData = frame.containsPositionalData;
+			output.position               = frame.position;
+			// The receivers are only lent to the output, to save copying them
+			output.receivers.swap(frame.receivers);
+
+			if (frame.targetCodec == Mumble::Protocol::AudioCodec::Opus) {
+				transcodeToOpus(it->second, frame, output, index);
+			} else {
+				transcodeToCELT(it->second, frame, output, index);
+			}
+
+			output.receivers.swap(frame.receivers);
+
+			if (frame.isLastFrame) {
+				// The next transmission starts afresh
+				close(it->second);
+				streams.erase(it);
+			}
+		}
+		frames.clear();
+
+		for (auto it = streams.begin(); it != streams.end();) {
+			if (it->second.lastUsed + STREAM_TIMEOUT_MSECS * 1000 < now) {
+				close(it->second);
+				it = streams.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto &entry : streams) {
+		close(entry.second);
+	}
+}
+
+bool Transcoder::open(Stream &stream, Mumble::Protocol::AudioCodec targetCodec) const {
+	int error = OPUS_OK;
+	if (targetCodec == Mumble::Protocol::AudioCodec::Opus) {
+		stream.celtDecoder = m_celt.createDecoder();
+		stream.opusEncoder = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &error);
+		if (error != OPUS_OK) {
+			stream.opusEncoder = nullptr;
+			return false;
+		}
+		opus_encoder_ctl(stream.opusEncoder, OPUS_SET_BITRATE(OPUS_BITRATE));
+
+		return stream.celtDecoder != nullptr;
+	}
+
+	stream.opusDecoder = opus_decoder_create(SAMPLE_RATE, 1, &error);
+	if (error != OPUS_OK) {
+		stream.opusDecoder = nullptr;
+		return false;
+	}
+	stream.celtEncoder = m_celt.createEncoder();
+
+	return stream.celtEncoder != nullptr;
+}
+
+void Transcoder::close(Stream &stream) const {
+	if (stream.opusDecoder) {
+		opus_decoder_destroy(stream.opusDecoder);
+	}
+	if (stream.opusEncoder) {
+		opus_encoder_destroy(stream.opusEncoder);
+	}
+	m_celt.destroyDecoder(stream.celtDecoder);
+	m_celt.destroyEncoder(stream.celtEncoder);
+	stream = {};
+}
+
+void Transcoder::transcodeToOpus(Stream &stream, const Frame &frame, Frame &output, std::size_t worker) {
+	// The CELT frames of the payload, each preceded by its header
+	std::size_t pos = 0;
+	while (pos < frame.payload.size()) {
+		const Mumble::Protocol::byte header = frame.payload[pos++];
+		const std::size_t size              = header & CELT_SIZE_MASK;
+		if (size == 0 || pos + size > frame.payload.size()) {
+			// The transmission has ended (or the payload is broken)
+			break;
+		}
+
+		const std::size_t offset = stream.pcm.size();
+		stream.pcm.resize(offset + FRAME_SAMPLES);
+		if (!m_celt.decode(stream.celtDecoder, frame.payload.data() + pos, static_cast< int >(size),
+						   stream.pcm.data() + offset)) {
+			stream.pcm.resize(offset);
+		}
+		pos += size;
+
+		if (!(header & CELT_CONTINUATION)) {
+			break;
+		}
+	}
+
+	if (frame.isLastFrame && stream.pcm.size() % FRAME_SAMPLES != 0) {
+		stream.pcm.resize(stream.pcm.size() + FRAME_SAMPLES - stream.pcm.size() % FRAME_SAMPLES, 0.0f);
+	}
+	if (frame.isLastFrame && stream.pcm.empty()) {
+		// Something has to tell the receivers that the transmission has ended
+		stream.pcm.resize(FRAME_SAMPLES, 0.0f);
+	}
+
+	std::size_t consumed = 0;
+	while (stream.pcm.size() - consumed >= static_cast< std::size_t >(FRAME_SAMPLES)) {
+		const std::size_t available = (stream.pcm.size() - consumed) / FRAME_SAMPLES;
+		int frames                  = 1;
+		for (int count : OPUS_FRAMES) {
+			if (static_cast< std::size_t >(count) <= available) {
+				frames = count;
+				break;
+			}
+		}
+
+		output.payload.resize(MAX_OPUS_BYTES);
+		const int size = opus_encode_float(stream.opusEncoder, stream.pcm.data() + consumed, frames * FRAME_SAMPLES,
+										   output.payload.data(), MAX_OPUS_BYTES);
+		consumed += static_cast< std::size_t >(frames * FRAME_SAMPLES);
+
+		output.frameNumber = stream.frameNumber;
+		stream.frameNumber += static_cast< std::uint64_t >(frames);
+		if (size <= 0) {
+			continue;
+		}
+
+		output.payload.resize(static_cast< std::size_t >(size));
+		output.isLastFrame = frame.isLastFrame && consumed == stream.pcm.size();
+		m_sender(output, worker);
+	}
+
+	stream.pcm.erase(stream.pcm.begin(), stream.pcm.begin() + static_cast< std::ptrdiff_t >(consumed));
+}
+
+void Transcoder::transcodeToCELT(Stream &stream, const Frame &frame, Frame &output, std::size_t worker) {
+	const std::size_t offset = stream.pcm.size();
+	stream.pcm.resize(offset + MAX_OPUS_SAMPLES);
+	const int samples = opus_decode_float(stream.opusDecoder, frame.payload.data(),
+										  static_cast< opus_int32 >(frame.payload.size()), stream.pcm.data() + offset,
+										  MAX_OPUS_SAMPLES, 0);
+	stream.pcm.resize(offset + static_cast< std::size_t >(std::max(samples, 0)));
+
+	if (frame.isLastFrame && stream.pcm.size() % FRAME_SAMPLES != 0) {
+		stream.pcm.resize(stream.pcm.size() + FRAME_SAMPLES - stream.pcm.size() % FRAME_SAMPLES, 0.0f);
+	}
+
+	// All complete frames go into a single payload, followed by an empty frame if the transmission ends with it
+	const std::size_t frames = stream.pcm.size() / FRAME_SAMPLES;
+	if (frames == 0 && !frame.isLastFrame) {
+		return;
+	}
+
+	output.payload.clear();
+	for (std::size_t i = 0; i < frames; ++i) {
+		const bool more = i + 1 < frames || frame.isLastFrame;
+
+		const std::size_t header = output.payload.size();
+		output.payload.resize(header + 1 + CELT_FRAME_BYTES);
+		const int size = m_celt.encode(stream.celtEncoder, stream.pcm.data() + i * FRAME_SAMPLES,
+									   output.payload.data() + header + 1, CELT_FRAME_BYTES);
+		if (size <= 0) {
+			output.payload.resize(header);
+			continue;
+		}
+
+		output.payload.resize(header + 1 + static_cast< std::size_t >(size));
+		output.payload[header] =
+			static_cast< Mumble::Protocol::byte >((size & CELT_SIZE_MASK) | (more ? CELT_CONTINUATION : 0));
+	}
+	if (frame.isLastFrame) {
+		output.payload.push_back(0);
+	}
+
+	output.frameNumber = stream.frameNumber;
+	output.isLastFrame = frame.isLastFrame;
+	stream.frameNumber += frames;
+	stream.pcm.erase(stream.pcm.begin(), stream.pcm.begin() + static_cast< std::ptrdiff_t >(frames * FRAME_SAMPLES));
+
+	if (!output.payload.empty()) {
+		m_sender(output, worker);
+	}
+}
@@ -0,0 +1,146 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_TRANSCODER_H_
+#define MUMBLE_MURMUR_TRANSCODER_H_
+
+#include "MumbleProtocol.h"
+#include "VolumeAdjustment.h"
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class CELTCodec;
+struct CELTDecoder;
+struct CELTEncoder;
+struct OpusDecoder;
+struct OpusEncoder;
+
+/// Transcodes speech between Opus and the legacy CELT codec (see CELTCodec) for the receivers that can't decode the
+/// codec it has been sent with (see Server::transcodingThreads), so that a server with clients of both kinds doesn't
+/// have to fall back to the codec everybody supports.
+///
+/// The voice threads only hand the frames over (see submit()), along with the receivers that need them transcoded.
+/// The frames are decoded and encoded again by a pool of worker threads, each of which takes care of a fixed share of
+/// the speakers, which keeps the frames of a speaker in order and the codecs' state on a single thread. The transcoded
+/// frames are handed to the sender the transcoder has been created with, on the worker thread that has produced them.
+class Transcoder {
+public:
+	/// The number of frames that may be waiting for a worker. Any further ones are dropped (and counted, see
+	/// droppedFrames()), just like they would be by a congested network.
+	static constexpr std::size_t MAX_QUEUED_FRAMES = 512;
+	/// The bitrate of the Opus frames in bits per second
+	static constexpr int OPUS_BITRATE = 40000;
+	/// The size of every CELT frame (of 10 ms) in bytes, which makes for 48 kbit/s. Legacy packets can't hold frames
+	/// larger than 127 bytes.
+	static constexpr int CELT_FRAME_BYTES = 60;
+	/// Streams without any frames for this long (in milliseconds) are forgotten, in case their last frame has been lost
+	static constexpr unsigned long STREAM_TIMEOUT_MSECS = 5000;
+
+	struct Receiver {
+		unsigned int session;
+		Mumble::Protocol::audio_context_t context;
+		VolumeAdjustment volumeAdjustment;
+		/// Whether the receiver gets the positional data of the frame
+		bool positional;
+	};
+
+	/// A frame along with the receivers that need it in another codec
+	struct Frame {
+		unsigned int session;
+		Mumble::Protocol::AudioCodec codec;
+		/// The codec the receivers need
+		Mumble::Protocol::AudioCodec targetCodec;
+		std::uint64_t frameNumber;
+		bool isLastFrame;
+		bool containsPositionalData;
+		std::array< float, 3 > position;
+		std::vector< Mumble::Protocol::byte > payload;
+		std::vector< Receiver > receivers;
+	};
+
+	/// Called with every transcoded frame (the codec of which is the original frame's target codec) and the index of
+	/// the worker thread that is calling
+	using Sender = std::function< void(const Frame &frame, std::size_t worker) >;
+
+	/// Starts the given number of worker threads
+	///
+	/// @param celt The library to use, which has to outlive the transcoder
+	Transcoder(const CELTCodec &celt, std::size_t workers, Sender sender);
+	/// Stops the worker threads, dropping the frames that are still waiting
+	~Transcoder();
+
+	Transcoder(const Transcoder &) = delete;
+	Transcoder &operator=(const Transcoder &) = delete;
+
+	/// @returns The codec the given frame has to be transcoded into for a receiver with the given capabilities, or the
+	/// 	frame's own codec if the receiver can decode it (or the frame can't be transcoded)
+	static Mumble::Protocol::AudioCodec targetCodec(Mumble::Protocol::AudioCodec codec, bool receiverHasOpus);
+
+	/// Queues the given frame for the worker that is responsible for its speaker. May be called by any thread.
+	void submit(Frame &&frame);
+
+	/// @returns The number of frames that have been dropped because their worker has been too busy
+	std::uint64_t droppedFrames() const;
+
+protected:
+	/// The codecs' state of a speaker whose frames are transcoded in one direction
+	struct Stream {
+		OpusDecoder *opusDecoder = nullptr;
+		OpusEncoder *opusEncoder = nullptr;
+		CELTDecoder *celtDecoder = nullptr;
+		CELTEncoder *celtEncoder = nullptr;
+		/// The decoded samples that haven't been encoded again yet
+		std::vector< float > pcm;
+		/// The frame number of the next transcoded frame
+		std::uint64_t frameNumber = 0;
+		/// When the stream has last been used (see BandwidthRecord::clock)
+		quint64 lastUsed = 0;
+	};
+
+	class Worker : public QThread {
+	public:
+		Worker(Transcoder &transcoder, std::size_t index);
+
+		QMutex m_mutex;
+		QWaitCondition m_condition;
+		std::deque< Frame > m_queue;
+		bool m_stop = false;
+
+	protected:
+		Transcoder &m_transcoder;
+		const std::size_t m_index;
+
+		void run() override;
+	};
+
+	const CELTCodec &m_celt;
+	const Sender m_sender;
+	std::vector< std::unique_ptr< Worker > > m_workers;
+	std::atomic< std::uint64_t > m_dropped{ 0 };
+
+	/// Transcodes the frames of the worker with the given index until it is stopped
+	void run(Worker &worker, std::size_t index);
+	/// @returns Whether the codecs of the given stream (for frames into the given codec) could be created
+	bool open(Stream &stream, Mumble::Protocol::AudioCodec targetCodec) const;
+	void close(Stream &stream) const;
+	/// Decode the given frame and send whatever can be encoded into the target codec so far as output (which has the
+	/// frame's receivers already)
+	void transcodeToOpus(Stream &stream, const Frame &frame, Frame &output, std::size_t worker);
+	void transcodeToCELT(Stream &stream, const Frame &frame, Frame &output, std::size_t worker);
+};
+
+#endif // MUMBLE_MURMUR_TRANSCODER_H_
@@ -0,0 +1,334 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UDPSendQueue.h"
+
+#include "HostAddress.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+#include <tracy/Tracy.hpp>
+
+#ifdef Q_OS_WIN
+#	include "RegisteredIO.h"
+
+#	include <ws2tcpip.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#	include <netinet/udp.h>
+
+// Older C libraries don't know about UDP segmentation offload yet
+#	ifndef SOL_UDP
+#		define SOL_UDP 17
+#	endif
+#	ifndef UDP_SEGMENT
+#		define UDP_SEGMENT 103
+#	endif
+#endif
+
+namespace {
+#ifdef Q_OS_WIN
+using addrlen_t = int;
+#else
+using addrlen_t = socklen_t;
+#endif
+
+addrlen_t sockaddrLength(const sockaddr_storage &address) {
+	return static_cast< addrlen_t >((address.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+																	 : sizeof(struct sockaddr_in));
+}
+
+#ifdef Q_OS_LINUX
+/// The maximum amount of segments the kernel accepts in a single UDP_SEGMENT message
+constexpr std::size_t MAX_SEGMENTS = 64;
+/// The maximum total size of a segmented message (it has to fit into a single IP datagram)
+constexpr std::size_t MAX_SEGMENTED_SIZE = 65000;
+
+int compareDestinations(const sockaddr_storage &lhs, const sockaddr_storage &rhs) {
+	if (lhs.ss_family != rhs.ss_family) {
+		return lhs.ss_family < rhs.ss_family ? -1 : 1;
+	}
+
+	return memcmp(&lhs, &rhs, static_cast< std::size_t >(sockaddrLength(lhs)));
+}
+#endif
+} // namespace
+
+UDPDestination::UDPDestination() : addressLength(0), valid(false) {
+	memset(&address, 0, sizeof(address));
+#ifdef Q_OS_LINUX
+	controlLength = 0;
+#endif
+}
+
+UDPDestination::UDPDestination(const sockaddr_storage &destination, const HostAddress &localAddress)
+	: address(destination), addressLength(sockaddrLength(destination)), valid(true) {
+#ifdef Q_OS_LINUX
+	memset(controldata, 0, sizeof(controldata));
+
+	// Make sure the packets originate from the same address that the client connected to via TCP
+	struct cmsghdr *cmsg = reinterpret_cast< struct cmsghdr * >(controldata);
+	const HostAddress &tcpha = localAddress;
+	if (destination.ss_family == AF_INET6) {
+		cmsg->cmsg_level            = IPPROTO_IPV6;
+		cmsg->cmsg_type             = IPV6_PKTINFO;
+		cmsg->cmsg_len              = CMSG_LEN(sizeof(struct in6_pktinfo));
+		struct in6_pktinfo *pktinfo = reinterpret_cast< struct in6_pktinfo * >(CMSG_DATA(cmsg));
+		memcpy(&pktinfo->ipi6_addr.s6_addr[0], tcpha.getByteRepresentation().data(),
+			   sizeof(pktinfo->ipi6_addr.s6_addr));
+		controlLength = CMSG_SPACE(sizeof(struct in6_pktinfo));
+	} else {
+		if (tcpha.isV6()) {
+			// We can't send IPv4 packets from an IPv6 address
+			valid         = false;
+			controlLength = 0;
+			return;
+		}
+
+		cmsg->cmsg_level             = IPPROTO_IP;
+		cmsg->cmsg_type              = IP_PKTINFO;
+		cmsg->cmsg_len               = CMSG_LEN(sizeof(struct in_pktinfo));
+		struct in_pktinfo *pktinfo   = reinterpret_cast< struct in_pktinfo * >(CMSG_DATA(cmsg));
+		pktinfo->ipi_spec_dst.s_addr = tcpha.toIPv4();
+		controlLength                = CMSG_SPACE(sizeof(struct in_pktinfo));
+	}
+#else
+	Q_UNUSED(localAddress);
+#endif
+}
+
+#ifdef Q_OS_LINUX
+UDPSendQueue::UDPSendQueue()
+	: m_packets(CAPACITY), m_headers(CAPACITY), m_order(CAPACITY), m_segmentedHeaders(CAPACITY), m_segments(CAPACITY),
+	  m_socket(INVALID_SOCKET) {
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		Packet &packet     = m_packets[i];
+		struct msghdr &hdr = m_headers[i].msg_hdr;
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_name    = reinterpret_cast< struct sockaddr * >(&packet.destination);
+		hdr.msg_iov     = &packet.iov;
+		hdr.msg_iovlen  = 1;
+		hdr.msg_control = packet.controldata;
+
+		packet.iov.iov_base = packet.data + 4;
+	}
+}
+#else
+UDPSendQueue::UDPSendQueue() : m_packets(CAPACITY), m_socket(INVALID_SOCKET) {
+}
+#endif
+
+void UDPSendQueue::setSegmentationOffload(bool enable) {
+#ifdef Q_OS_LINUX
+	m_segmentationOffload = enable;
+#else
+	Q_UNUSED(enable);
+#endif
+}
+
+bool UDPSendQueue::segmentationOffload() const {
+	return m_segmentationOffload;
+}
+
+#ifdef Q_OS_WIN
+void UDPSendQueue::setRegisteredIO(RegisteredIO *registeredIO) {
+	flush();
+
+	m_registeredIO = registeredIO;
+}
+#endif
+
+unsigned char *UDPSendQueue::prepare(socket_t socket) {
+	unsigned char *buffer = nullptr;
+	prepareBatch(socket, 1, &buffer);
+
+	return buffer;
+}
+
+std::size_t UDPSendQueue::prepareBatch(socket_t socket, std::size_t count, unsigned char **buffers) {
+	count = std::min(count, m_packets.size());
+
+	if (m_size + count > m_packets.size() || (m_size > 0 && socket != m_socket)) {
+		flush();
+	}
+
+	m_socket = socket;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		buffers[i] = m_packets[m_size + i].data + 4;
+	}
+
+	return count;
+}
+
+void UDPSendQueue::commit(std::size_t length, const UDPDestination &destination) {
+	assert(length <= MAX_PACKET_SIZE);
+	assert(m_size < m_packets.size());
+	assert(destination.valid);
+
+	Packet &packet = m_packets[m_size];
+
+#ifdef Q_OS_LINUX
+	struct msghdr &msg = m_headers[m_size].msg_hdr;
+
+	memcpy(&packet.destination, &destination.address, static_cast< std::size_t >(destination.addressLength));
+	packet.iov.iov_len = length;
+
+	memcpy(packet.controldata, destination.controldata, destination.controlLength);
+	msg.msg_namelen    = destination.addressLength;
+	msg.msg_controllen = destination.controlLength;
+	msg.msg_flags      = 0;
+
+	++m_size;
+#else
+#	ifdef Q_OS_WIN
+	using size_type = int;
+
+	if (m_registeredIO && m_registeredIO->queueSend(m_socket, packet.data + 4, length, destination.address)) {
+		// Sent along with the rest of the queue once it is flushed
+		++m_size;
+		return;
+	}
+#	else
+	using size_type = std::size_t;
+#	endif
+
+	::sendto(m_socket, reinterpret_cast< const char * >(packet.data + 4), static_cast< size_type >(length), 0,
+			 reinterpret_cast< const struct sockaddr * >(&destination.address), destination.addressLength);
+
+	// The buffer is only reused once the queue is flushed (see prepareBatch())
+	++m_size;
+#endif
+}
+
+void UDPSendQueue::flush() {
+#ifdef Q_OS_LINUX
+	if (m_size == 0) {
+		return;
+	}
+
+	ZoneScoped;
+
+	if (m_segmentationOffload && m_size > 1) {
+		flushSegmented();
+	} else {
+		sendAll(m_headers, m_size);
+	}
+#elif defined(Q_OS_WIN)
+	if (m_registeredIO && m_size > 0) {
+		m_registeredIO->commitSends();
+	}
+#endif
+
+	m_size = 0;
+}
+
+#ifdef Q_OS_LINUX
+void UDPSendQueue::sendAll(std::vector< struct mmsghdr > &headers, std::size_t count) {
+	std::size_t sent = 0;
+	while (sent < count) {
+		int ret = ::sendmmsg(m_socket, &headers[sent], static_cast< unsigned int >(count - sent), 0);
+
+		if (ret > 0) {
+			sent += static_cast< std::size_t >(ret);
+			continue;
+		}
+
+		// sendmmsg only reports an error if the very first message could not be sent
+		struct msghdr &failed = headers[sent].msg_hdr;
+
+		if (failed.msg_iovlen > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+			// The kernel (or the network device) can't handle segmented messages after all. Stop
+			// using them and send the segments of this message one by one instead.
+			m_segmentationOffload = false;
+
+			struct iovec *segments = failed.msg_iov;
+			std::size_t nSegments  = failed.msg_iovlen;
+
+			failed.msg_controllen -= CMSG_SPACE(sizeof(std::uint16_t));
+			failed.msg_iovlen = 1;
+			for (std::size_t i = 0; i < nSegments; ++i) {
+				failed.msg_iov = &segments[i];
+				::sendmsg(m_socket, &failed, 0);
+			}
+		}
+
+		// Skip the failed message (e.g. because its destination is unreachable) instead of
+		// dropping the remaining ones.
+		++sent;
+	}
+}
+
+void UDPSendQueue::flushSegmented() {
+	// Group packets by destination. The sort is stable so that the packets for a given receiver
+	// keep their relative order.
+	std::iota(m_order.begin(), m_order.begin() + static_cast< std::ptrdiff_t >(m_size), std::size_t(0));
+	std::stable_sort(m_order.begin(), m_order.begin() + static_cast< std::ptrdiff_t >(m_size),
+					 [this](std::size_t lhs, std::size_t rhs) {
+						 return compareDestinations(m_packets[lhs].destination, m_packets[rhs].destination) < 0;
+					 });
+
+	std::size_t nMessages = 0;
+	std::size_t i         = 0;
+	while (i < m_size) {
+		const std::size_t leaderIndex = m_order[i];
+		Packet &leader                = m_packets[leaderIndex];
+		const std::size_t segmentSize = leader.iov.iov_len;
+
+		// Find all following packets with the same destination and length
+		std::size_t end = i + 1;
+		while (end < m_size && end - i < MAX_SEGMENTS && (end - i + 1) * segmentSize <= MAX_SEGMENTED_SIZE) {
+			const Packet &candidate = m_packets[m_order[end]];
+			if (candidate.iov.iov_len != segmentSize
+				|| compareDestinations(candidate.destination, leader.destination) != 0) {
+				break;
+			}
+			++end;
+		}
+
+		struct mmsghdr &message = m_segmentedHeaders[nMessages];
+		message                 = m_headers[leaderIndex];
+
+		if (end - i > 1) {
+			for (std::size_t k = i; k < end; ++k) {
+				m_segments[k] = m_packets[m_order[k]].iov;
+			}
+
+			message.msg_hdr.msg_iov    = &m_segments[i];
+			message.msg_hdr.msg_iovlen = end - i;
+
+			// The packet info has been written by commit(). The segment size goes right after it.
+			struct cmsghdr *cmsg = reinterpret_cast< struct cmsghdr * >(leader.controldata
+																		 + message.msg_hdr.msg_controllen);
+			cmsg->cmsg_level     = SOL_UDP;
+			cmsg->cmsg_type      = UDP_SEGMENT;
+			cmsg->cmsg_len       = CMSG_LEN(sizeof(std::uint16_t));
+			*reinterpret_cast< std::uint16_t * >(CMSG_DATA(cmsg)) = static_cast< std::uint16_t >(segmentSize);
+
+			message.msg_hdr.msg_controllen += CMSG_SPACE(sizeof(std::uint16_t));
+		}
+
+		++nMessages;
+		i = end;
+	}
+
+	sendAll(m_segmentedHeaders, nMessages);
+}
+#endif
+
+std::size_t UDPSendQueue::size() const {
+	return m_size;
+}
+
+bool UDPSendQueue::isEmpty() const {
+	return m_size == 0;
+}
@@ -0,0 +1,169 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_UDPSENDQUEUE_H_
+#define MUMBLE_MURMUR_UDPSENDQUEUE_H_
+
+#include <QtCore/QtGlobal>
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#endif
+
+#include "MumbleProtocol.h"
+
+#ifdef Q_OS_WIN
+#	include <winsock2.h>
+#else
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class HostAddress;
+#ifdef Q_OS_WIN
+class RegisteredIO;
+#endif
+
+/// Describes where packets are to be sent to. Creating the description once whenever a client's
+/// UDP address becomes known (instead of for every single packet) saves rebuilding the address
+/// length and the packet info for every receiver of every packet.
+struct UDPDestination {
+	/// The address the packets shall be sent to
+	sockaddr_storage address;
+#ifdef Q_OS_WIN
+	int addressLength;
+#else
+	socklen_t addressLength;
+#endif
+#ifdef Q_OS_LINUX
+	/// A ready-made packet info control message that makes packets originate from the
+	/// local address the client connected to via TCP
+	alignas(struct cmsghdr)
+		std::uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))];
+	std::size_t controlLength;
+#endif
+	/// Whether packets can be sent to this destination at all
+	bool valid;
+
+	/// Creates an invalid destination
+	UDPDestination();
+	/// @param destination The address the packets shall be sent to
+	/// @param localAddress The local address the packets shall originate from
+	UDPDestination(const sockaddr_storage &destination, const HostAddress &localAddress);
+};
+
+/// A queue of outgoing (already encrypted) UDP packets. On Linux all packets that are queued
+/// for the same socket are handed to the kernel with a single call to sendmmsg once the queue
+/// is flushed. On all other platforms packets are sent out as soon as they are committed (the
+/// queue's buffers are only reused once it is flushed).
+///
+/// Packets are written directly into the queue's own buffers (see prepare()), which means that
+/// queuing a packet does not allocate any memory.
+///
+/// On Windows the packets can be handed to Registered I/O instead (see setRegisteredIO()), which sends all
+/// packets of the queue with a single commit once it is flushed.
+///
+/// If segmentation offload (GSO) is enabled, packets of the same length that are addressed to
+/// the same destination are coalesced into a single UDP_SEGMENT message when the queue is
+/// flushed. Should the kernel reject such a message, the queue permanently falls back to
+/// sending every packet on its own.
+///
+/// A queue must only ever be used by a single thread at a time.
+class UDPSendQueue {
+public:
+#ifdef Q_OS_WIN
+	using socket_t = SOCKET;
+#else
+	using socket_t = int;
+#endif
+
+	/// The maximum size in bytes of a single packet in the queue. This is a bit bigger than
+	/// the maximum UDP packet size as re-encoding a packet for a receiver may add a few bytes.
+	static constexpr std::size_t MAX_PACKET_SIZE = Mumble::Protocol::MAX_UDP_PACKET_SIZE + 64;
+	/// The amount of packets after which the queue is flushed automatically
+	static constexpr std::size_t CAPACITY = 64;
+
+	UDPSendQueue();
+
+	/// Enables or disables the use of UDP generic segmentation offload (Linux only)
+	void setSegmentationOffload(bool enable);
+	bool segmentationOffload() const;
+#ifdef Q_OS_WIN
+	/// Makes the queue send its packets via the given instance, which has to be initialized with the sockets the
+	/// packets are sent through. Packets that it can't take are sent right away instead. The queue is flushed first.
+	///
+	/// @param registeredIO The instance to use or nullptr to go back to sending every packet on its own
+	void setRegisteredIO(RegisteredIO *registeredIO);
+#endif
+
+	/// Obtains the buffer into which the next packet for the given socket has to be written. If the
+	/// queue is full or contains packets for a different socket, it is flushed first.
+	///
+	/// @param socket The socket that the packet is going to be sent through
+	/// @returns A buffer of MAX_PACKET_SIZE bytes. Like our receive buffers, it starts 4 bytes after an
+	/// 	8-byte boundary so that the payload following the crypt header is aligned.
+	unsigned char *prepare(socket_t socket);
+	/// Obtains the buffers into which the next packets for the given socket have to be written, so that several
+	/// packets can be written before any of them is committed. If there isn't enough room left in the queue or it
+	/// contains packets for a different socket, it is flushed first.
+	///
+	/// The packets have to be committed in the order of the buffers. If a packet is to be skipped, the following
+	/// ones have to be moved into the buffer returned by prepare() before committing them.
+	///
+	/// @param socket The socket that the packets are going to be sent through
+	/// @param count The amount of buffers that are requested
+	/// @param[out] buffers Receives the buffers (see prepare())
+	/// @returns The amount of buffers that have been obtained. This is at most CAPACITY.
+	std::size_t prepareBatch(socket_t socket, std::size_t count, unsigned char **buffers);
+	/// Enqueues the packet that has been written into the buffer obtained by the last call to prepare().
+	///
+	/// @param length The size of the packet in bytes
+	/// @param destination Where the packet shall be sent to. It must be valid.
+	void commit(std::size_t length, const UDPDestination &destination);
+	/// Sends out all packets that are currently in the queue
+	void flush();
+
+	std::size_t size() const;
+	bool isEmpty() const;
+
+protected:
+	struct Packet {
+		sockaddr_storage destination;
+#ifdef Q_OS_LINUX
+		struct iovec iov;
+		// Room for the packet info and (if this packet leads a segmented message) the segment size
+		alignas(struct cmsghdr)
+			std::uint8_t controldata[CMSG_SPACE(std::max(sizeof(struct in6_pktinfo), sizeof(struct in_pktinfo)))
+									 + CMSG_SPACE(sizeof(std::uint16_t))];
+#endif
+		alignas(8) unsigned char data[MAX_PACKET_SIZE + 4];
+	};
+
+	std::vector< Packet > m_packets;
+#ifdef Q_OS_LINUX
+	std::vector< struct mmsghdr > m_headers;
+
+	// Scratch space for coalescing packets when segmentation offload is used
+	std::vector< std::size_t > m_order;
+	std::vector< struct mmsghdr > m_segmentedHeaders;
+	std::vector< struct iovec > m_segments;
+
+	void sendAll(std::vector< struct mmsghdr > &headers, std::size_t count);
+	void flushSegmented();
+#endif
+	std::size_t m_size = 0;
+	socket_t m_socket;
+	bool m_segmentationOffload = false;
+#ifdef Q_OS_WIN
+	RegisteredIO *m_registeredIO = nullptr;
+#endif
+};
+
+#endif // MUMBLE_MURMUR_UDPSENDQUEUE_H_
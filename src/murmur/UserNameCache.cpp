@@ -0,0 +1,128 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "UserNameCache.h"
+
+#include <chrono>
+
+UserNameCache::UserNameCache(std::size_t capacity, quint64 ttlMsecs)
+	: m_capacity(capacity > 0 ? capacity : 1), m_ttl(ttlMsecs), m_unknownGeneration(1), m_hits(0), m_misses(0) {
+}
+
+bool UserNameCache::lookupName(int id, QString &name) {
+	return lookup(m_names, id, name);
+}
+
+bool UserNameCache::lookupID(const QString &name, int &id) {
+	return lookup(m_ids, name, id);
+}
+
+void UserNameCache::insert(int id, const QString &name) {
+	store(m_names, id, name, false);
+	store(m_ids, name, id, false);
+}
+
+void UserNameCache::insertUnknownID(int id) {
+	store(m_names, id, QString(), true);
+}
+
+void UserNameCache::insertUnknownName(const QString &name) {
+	store(m_ids, name, -2, true);
+}
+
+void UserNameCache::removeID(int id) {
+	auto it = m_names.index.constFind(id);
+	if (it != m_names.index.constEnd()) {
+		const QString name = it.value()->value;
+		remove(m_names, id);
+		if (!name.isEmpty()) {
+			remove(m_ids, name);
+		}
+	}
+}
+
+void UserNameCache::removeName(const QString &name) {
+	auto it = m_ids.index.constFind(name);
+	if (it != m_ids.index.constEnd()) {
+		const int id = it.value()->value;
+		remove(m_ids, name);
+		if (id >= 0) {
+			remove(m_names, id);
+		}
+	}
+}
+
+void UserNameCache::removeUnknown() {
+	++m_unknownGeneration;
+}
+
+void UserNameCache::clear() {
+	m_names.entries.clear();
+	m_names.index.clear();
+	m_ids.entries.clear();
+	m_ids.index.clear();
+}
+
+quint64 UserNameCache::now() const {
+	return static_cast< quint64 >(
+		std::chrono::duration_cast< std::chrono::milliseconds >(std::chrono::steady_clock::now().time_since_epoch())
+			.count());
+}
+
+template< typename Key, typename Value >
+bool UserNameCache::lookup(Table< Key, Value > &table, const Key &key, Value &value) {
+	auto it = table.index.constFind(key);
+	if (it == table.index.constEnd()) {
+		++m_misses;
+		return false;
+	}
+
+	auto entry         = it.value();
+	const bool expired = m_ttl > 0 && entry->expires <= now();
+	if (expired || (entry->generation != 0 && entry->generation != m_unknownGeneration)) {
+		table.index.erase(it);
+		table.entries.erase(entry);
+		++m_misses;
+		return false;
+	}
+
+	// Splicing moves the entry to the front without invalidating the iterator in the index
+	table.entries.splice(table.entries.begin(), table.entries, entry);
+	value = entry->value;
+	++m_hits;
+	return true;
+}
+
+template< typename Key, typename Value >
+void UserNameCache::store(Table< Key, Value > &table, const Key &key, const Value &value, bool unknown) {
+	const quint64 expires    = m_ttl > 0 ? now() + m_ttl : 0;
+	const quint64 generation = unknown ? m_unknownGeneration : 0;
+
+	auto it = table.index.find(key);
+	if (it != table.index.end()) {
+		auto entry        = it.value();
+		entry->value      = value;
+		entry->expires    = expires;
+		entry->generation = generation;
+		table.entries.splice(table.entries.begin(), table.entries, entry);
+		return;
+	}
+
+	while (table.size() >= m_capacity) {
+		table.index.remove(table.entries.back().key);
+		table.entries.pop_back();
+	}
+
+	table.entries.push_front({ key, value, expires, generation });
+	table.index.insert(key, table.entries.begin());
+}
+
+template< typename Key, typename Value > void UserNameCache::remove(Table< Key, Value > &table, const Key &key) {
+	auto it = table.index.find(key);
+	if (it != table.index.end()) {
+		table.entries.erase(it.value());
+		table.index.erase(it);
+	}
+}
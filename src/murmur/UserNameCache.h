@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_USERNAMECACHE_H_
+#define MUMBLE_MURMUR_USERNAMECACHE_H_
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+#include <cstddef>
+#include <list>
+
+/// Caches the names of registered users by their IDs and their IDs by their names, so that neither the database nor
+/// an RPC authenticator has to be asked every time.
+///
+/// Both directions are bounded: If one of them holds more than the given number of entries, the one that has been
+/// used least recently is evicted. Entries expire after the given time, which limits how long changes made behind the
+/// server's back (e.g. by an authenticator) go unnoticed. Lookups that have failed are cached as well (as negative
+/// entries), so that repeatedly asking for unknown names or IDs doesn't hit the database every time.
+///
+/// This class isn't thread-safe. Server only uses it from the main thread.
+class UserNameCache {
+public:
+	/// @param capacity The maximum number of entries in each direction
+	/// @param ttlMsecs The number of milliseconds after which an entry expires or 0 if entries don't expire
+	explicit UserNameCache(std::size_t capacity = 10000, quint64 ttlMsecs = 0);
+	virtual ~UserNameCache() = default;
+
+	/// @param[out] name Receives the name of the user or an empty string if it is known that there is no user with
+	/// 	the given ID
+	/// @returns Whether the cache knows about the given ID
+	bool lookupName(int id, QString &name);
+	/// @param[out] id Receives the ID of the user or -2 if it is known that there is no user with the given name
+	/// @returns Whether the cache knows about the given name
+	bool lookupID(const QString &name, int &id);
+
+	/// Remembers that the given ID belongs to the user with the given name (and vice versa)
+	void insert(int id, const QString &name);
+	/// Remembers that there is no user with the given ID
+	void insertUnknownID(int id);
+	/// Remembers that there is no user with the given name
+	void insertUnknownName(const QString &name);
+
+	/// Forgets about the given ID and the name it belongs to
+	void removeID(int id);
+	/// Forgets about the given name and the ID it belongs to
+	void removeName(const QString &name);
+	/// Forgets about all negative entries, which is necessary whenever a user has been registered or renamed, as
+	/// names are matched case-insensitively by the database but not by the cache.
+	void removeUnknown();
+	void clear();
+
+	/// @returns The number of lookups the cache has known the answer to
+	quint64 hits() const { return m_hits; }
+	/// @returns The number of lookups the cache hasn't known the answer to
+	quint64 misses() const { return m_misses; }
+	/// @returns The number of entries in both directions
+	std::size_t size() const { return m_names.size() + m_ids.size(); }
+
+protected:
+	template< typename Key, typename Value > struct Table {
+		struct Entry {
+			Key key;
+			Value value;
+			quint64 expires;
+			/// The value of m_unknownGeneration at the time a negative entry has been inserted or 0 for positive
+			/// entries
+			quint64 generation;
+		};
+
+		/// The entries, starting with the one that has been used most recently
+		std::list< Entry > entries;
+		QHash< Key, typename std::list< Entry >::iterator > index;
+
+		std::size_t size() const { return entries.size(); }
+	};
+
+	Table< int, QString > m_names;
+	Table< QString, int > m_ids;
+	std::size_t m_capacity;
+	quint64 m_ttl;
+	/// Negative entries from earlier generations are ignored (see removeUnknown())
+	quint64 m_unknownGeneration;
+	quint64 m_hits;
+	quint64 m_misses;
+
+	/// @returns The current time in milliseconds
+	virtual quint64 now() const;
+
+	template< typename Key, typename Value > bool lookup(Table< Key, Value > &table, const Key &key, Value &value);
+	template< typename Key, typename Value >
+	void store(Table< Key, Value > &table, const Key &key, const Value &value, bool unknown);
+	template< typename Key, typename Value > void remove(Table< Key, Value > &table, const Key &key);
+};
+
+#endif // MUMBLE_MURMUR_USERNAMECACHE_H_
@@ -0,0 +1,23 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceRedundancy.h"
+
+namespace VoiceRedundancy {
+
+bool isLossy(quint32 good, quint32 lost, quint32 previousGood, quint32 previousLost) {
+	// The counters start over whenever the client's crypt state is reset
+	good = good >= previousGood ? good - previousGood : good;
+	lost = lost >= previousLost ? lost - previousLost : lost;
+
+	return lost > 0 && static_cast< quint64 >(lost) * 100 > (static_cast< quint64 >(good) + lost) * LOSS_PERCENT;
+}
+
+bool includesPayload(Mumble::Protocol::PacketFormat format, bool viaUDP, bool lossy) {
+	// The legacy packet format has no room for a redundant payload and TCP doesn't lose any packets
+	return format == Mumble::Protocol::PacketFormat::Protobuf && viaUDP && lossy;
+}
+
+} // namespace VoiceRedundancy
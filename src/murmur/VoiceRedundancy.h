@@ -0,0 +1,38 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICEREDUNDANCY_H_
+#define MUMBLE_MURMUR_VOICEREDUNDANCY_H_
+
+#include "MumbleProtocol.h"
+
+#include <QtCore/QtGlobal>
+
+/// Decides which receivers get the redundant payloads that clients attach to their audio packets while their uplink
+/// is lossy (see Mumble::Protocol::AudioData::redundantPayload). They take up bandwidth, so only the receivers that
+/// have asked for them get them, and only while their own downlink is lossy. Everybody else gets the packets without
+/// them (see Server::sendMessage).
+namespace VoiceRedundancy {
+
+/// Redundant audio is sent to users that have lost more than this share (in percent) of the packets since their
+/// previous ping
+static constexpr quint32 LOSS_PERCENT = 1;
+
+/// @param good The number of packets the client has received, as reported in its latest ping
+/// @param lost The number of packets the client has lost, as reported in its latest ping
+/// @param previousGood The number of received packets the client has reported in its previous ping
+/// @param previousLost The number of lost packets the client has reported in its previous ping
+/// @returns Whether the client has lost enough packets in between the pings to get redundant audio
+bool isLossy(quint32 good, quint32 lost, quint32 previousGood, quint32 previousLost);
+
+/// @param format The packet format of the receiver
+/// @param viaUDP Whether the packet is sent to the receiver via UDP rather than tunneled through TCP
+/// @param lossy Whether the receiver wants redundant audio and has been losing packets lately (see isLossy)
+/// @returns Whether the packet sent to the receiver includes the redundant payload
+bool includesPayload(Mumble::Protocol::PacketFormat format, bool viaUDP, bool lossy);
+
+} // namespace VoiceRedundancy
+
+#endif // MUMBLE_MURMUR_VOICEREDUNDANCY_H_
@@ -0,0 +1,60 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICESTATE_H_
+#define MUMBLE_MURMUR_VOICESTATE_H_
+
+#include "ChannelAudience.h"
+#include "ShardedMap.h"
+
+#include <cstdint>
+#include <memory>
+
+struct WhisperReceiverTable;
+
+/// Everything the voice threads need to know in order to find the receivers of a voice packet: which channel every
+/// user is in, who hears regular speech in every channel (which covers links and listeners) and who receives the
+/// audio sent to every whisper target.
+///
+/// A state is never modified once it has been published (see Server::publishVoiceState). Instead, the main thread
+/// builds a new state and swaps it in, which is why the voice threads can use a state without holding any lock. The
+/// next state shares all shards of the maps (see ShardedMap) that haven't changed in the meantime, so publishing a
+/// state only copies the parts that cover changed users and channels.
+struct VoiceState {
+	/// Maps the session of every user that is in a channel to the ID of that channel
+	using ChannelMap = ShardedMap< unsigned int, unsigned int >;
+	/// Maps channel IDs to the channels' audiences
+	using AudienceMap = ShardedMap< unsigned int, std::shared_ptr< const ChannelAudience > >;
+	/// Maps the speaker's session and the target ID (see whisperKey()) to the target's receivers
+	using WhisperTargetMap = ShardedMap< std::uint64_t, std::shared_ptr< const WhisperReceiverTable > >;
+
+	ChannelMap channels;
+	AudienceMap audiences;
+	WhisperTargetMap whispering;
+
+	static std::uint64_t whisperKey(unsigned int session, int target) {
+		return (static_cast< std::uint64_t >(session) << 32) | static_cast< std::uint32_t >(target);
+	}
+
+	/// @returns The audience of the channel the given user is in or nullptr if there is none (yet)
+	const ChannelAudience *audienceOf(unsigned int session) const {
+		const unsigned int *channel = channels.find(session);
+		return channel ? audienceOfChannel(*channel) : nullptr;
+	}
+
+	/// @returns The audience of the given channel or nullptr if there is none (yet)
+	const ChannelAudience *audienceOfChannel(unsigned int channel) const {
+		const std::shared_ptr< const ChannelAudience > *audience = audiences.find(channel);
+		return audience ? audience->get() : nullptr;
+	}
+
+	/// @returns The receivers of the given whisper target of the given user or nullptr if there is no such target
+	const WhisperReceiverTable *whisperTarget(unsigned int session, int target) const {
+		const std::shared_ptr< const WhisperReceiverTable > *receivers = whispering.find(whisperKey(session, target));
+		return receivers ? receivers->get() : nullptr;
+	}
+};
+
+#endif // MUMBLE_MURMUR_VOICESTATE_H_
@@ -0,0 +1,173 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "VoiceTrace.h"
+
+#include "PacketDataStream.h"
+
+#include <array>
+
+namespace VoiceTrace {
+
+namespace {
+	/// The largest number of sessions or channels a whisper target is recorded with
+	constexpr unsigned int MAX_TARGET_ENTRIES = 512;
+} // namespace
+
+QByteArray encode(const Event &event) {
+	std::array< char, MAX_RECORD_LENGTH > buffer;
+	PacketDataStream stream(buffer.data(), static_cast< unsigned int >(buffer.size()));
+
+	stream << static_cast< unsigned int >(event.type) << event.offset << event.session;
+
+	switch (event.type) {
+		case EventType::Voice:
+			stream << event.target << event.codec << event.payloadSize << event.positional;
+			break;
+		case EventType::UserMoved:
+			stream << event.channel << event.version;
+			break;
+		case EventType::UserLeft:
+			break;
+		case EventType::ChannelLinked:
+		case EventType::ChannelUnlinked:
+			stream << event.channel << event.otherChannel;
+			break;
+		case EventType::ListenerAdded:
+		case EventType::ListenerRemoved:
+			stream << event.channel;
+			break;
+		case EventType::WhisperTarget:
+			stream << event.target;
+			stream << static_cast< unsigned int >(event.sessions.size());
+			for (unsigned int session : event.sessions) {
+				stream << session;
+			}
+			stream << static_cast< unsigned int >(event.channels.size());
+			for (const TargetChannel &channel : event.channels) {
+				stream << channel.channel << channel.children << channel.links << channel.group;
+			}
+			break;
+	}
+
+	if (!stream.isValid()) {
+		return QByteArray();
+	}
+
+	return QByteArray(buffer.data(), static_cast< int >(stream.size()));
+}
+
+bool decode(const QByteArray &record, Event &event) {
+	PacketDataStream stream(record);
+
+	unsigned int type = 0;
+	stream >> type >> event.offset >> event.session;
+	event.type = static_cast< EventType >(type);
+
+	event.sessions.clear();
+	event.channels.clear();
+
+	switch (event.type) {
+		case EventType::Voice:
+			stream >> event.target >> event.codec >> event.payloadSize >> event.positional;
+			break;
+		case EventType::UserMoved:
+			stream >> event.channel >> event.version;
+			break;
+		case EventType::UserLeft:
+			break;
+		case EventType::ChannelLinked:
+		case EventType::ChannelUnlinked:
+			stream >> event.channel >> event.otherChannel;
+			break;
+		case EventType::ListenerAdded:
+		case EventType::ListenerRemoved:
+			stream >> event.channel;
+			break;
+		case EventType::WhisperTarget: {
+			unsigned int count = 0;
+			stream >> event.target >> count;
+			if (count > MAX_TARGET_ENTRIES) {
+				return false;
+			}
+			event.sessions.resize(count);
+			for (unsigned int &session : event.sessions) {
+				stream >> session;
+			}
+
+			count = 0;
+			stream >> count;
+			if (count > MAX_TARGET_ENTRIES) {
+				return false;
+			}
+			event.channels.resize(count);
+			for (TargetChannel &channel : event.channels) {
+				stream >> channel.channel >> channel.children >> channel.links >> channel.group;
+			}
+			break;
+		}
+		default:
+			return false;
+	}
+
+	return stream.isValid() && stream.left() == 0;
+}
+
+Recorder::Recorder(const QString &path) : m_file(path, QIODevice::NotOpen, QByteArray(MAGIC, sizeof(MAGIC))) {
+}
+
+bool Recorder::isOpen() const {
+	return m_file.isOpen();
+}
+
+void Recorder::record(Event event) {
+	event.offset = static_cast< quint64 >(m_file.now());
+
+	// Whisper targets are the only events that can get long. The ones that don't fit are simply left out.
+	if (event.sessions.size() > MAX_TARGET_ENTRIES || event.channels.size() > MAX_TARGET_ENTRIES) {
+		return;
+	}
+
+	QByteArray record = encode(event);
+	if (record.isEmpty()) {
+		return;
+	}
+
+	const char length[2] = { static_cast< char >(record.size() & 0xFF), static_cast< char >(record.size() >> 8) };
+	m_file.write(record.prepend(length, sizeof(length)));
+}
+
+Reader::Reader(const QString &path) : m_file(path) {
+	if (m_file.open(QIODevice::ReadOnly)) {
+		m_valid = m_file.read(sizeof(MAGIC)) == QByteArray(MAGIC, sizeof(MAGIC));
+	}
+}
+
+bool Reader::isOpen() const {
+	return m_valid;
+}
+
+bool Reader::next(Event &event) {
+	if (!m_valid) {
+		return false;
+	}
+
+	const QByteArray length = m_file.read(2);
+	if (length.size() != 2) {
+		return false;
+	}
+
+	const int recordLength =
+		static_cast< unsigned char >(length[0]) | (static_cast< int >(static_cast< unsigned char >(length[1])) << 8);
+	const QByteArray record = m_file.read(recordLength);
+	if (record.size() != recordLength || !decode(record, event)) {
+		m_valid = false;
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace VoiceTrace
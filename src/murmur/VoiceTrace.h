@@ -0,0 +1,120 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_VOICETRACE_H_
+#define MUMBLE_MURMUR_VOICETRACE_H_
+
+#include "TraceFile.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+#include <vector>
+
+/// A trace of the voice traffic a virtual server has routed (see Server::qsVoiceTraceFile), which can be replayed by
+/// the VoiceRouting benchmark. Apart from the voice frames (as they are about to be routed), the trace contains
+/// everything that decides who receives them: users entering and leaving channels, links, listeners and whisper
+/// targets.
+///
+/// The trace is a binary file that starts with MAGIC, followed by one record per event. Every record is made up of its
+/// length (two bytes, little endian) and the event encoded with a PacketDataStream. The audio itself isn't recorded,
+/// only the size of every frame.
+namespace VoiceTrace {
+
+static constexpr char MAGIC[] = "MumbleVoiceTrace1";
+/// Records are at most this long, as their length is stored in two bytes
+static constexpr int MAX_RECORD_LENGTH = 0xFFFF;
+
+enum class EventType : unsigned int {
+	/// session sent a frame to target (Mumble::Protocol::AudioData::targetOrContext)
+	Voice = 1,
+	/// session has entered channel (which is also how users first appear in the trace)
+	UserMoved = 2,
+	UserLeft  = 3,
+	/// channel has been linked to otherChannel
+	ChannelLinked   = 4,
+	ChannelUnlinked = 5,
+	/// session has started listening to channel
+	ListenerAdded   = 6,
+	ListenerRemoved = 7,
+	/// session has changed the whisper target with the ID target. If there are neither sessions nor channels, the
+	/// target has been removed.
+	WhisperTarget = 8,
+};
+
+struct TargetChannel {
+	unsigned int channel = 0;
+	bool children        = false;
+	bool links           = false;
+	/// Whether the target is restricted to the members of a group (which isn't recorded)
+	bool group = false;
+};
+
+struct Event {
+	EventType type = EventType::Voice;
+	/// The time at which the event has happened in microseconds since the trace has been started
+	quint64 offset            = 0;
+	unsigned int session      = 0;
+	unsigned int channel      = 0;
+	unsigned int otherChannel = 0;
+	unsigned int target       = 0;
+	/// The protocol version of the user (UserMoved only)
+	quint64 version = 0;
+	// Voice only
+	unsigned int codec       = 0;
+	unsigned int payloadSize = 0;
+	bool positional          = false;
+	// WhisperTarget only
+	std::vector< unsigned int > sessions;
+	std::vector< TargetChannel > channels;
+};
+
+/// @returns The given event as a record (without its length)
+QByteArray encode(const Event &event);
+/// Parses a record that has been produced by encode()
+///
+/// @returns Whether the record could be parsed
+bool decode(const QByteArray &record, Event &event);
+
+/// Appends the events that happen to a trace file. All functions may be called by any thread.
+class Recorder {
+public:
+	/// Starts a trace in the given file, writing MAGIC right away so that even a trace without any events can be told
+	/// apart from other files. Whether the file could be created can be checked with isOpen().
+	explicit Recorder(const QString &path);
+
+	bool isOpen() const;
+	/// Records the given event, which happens now
+	void record(Event event);
+
+protected:
+	TraceFile m_file;
+};
+
+/// Reads the events of a trace file one after another
+class Reader {
+public:
+	/// Opens the given file. Whether it could be opened (and is a trace) can be checked with isOpen().
+	explicit Reader(const QString &path);
+
+	Reader(const Reader &) = delete;
+	Reader &operator=(const Reader &) = delete;
+
+	bool isOpen() const;
+	/// Reads the next event
+	///
+	/// @returns Whether there has been another event. Reading stops at the first record that can't be parsed.
+	bool next(Event &event);
+
+protected:
+	QFile m_file;
+	bool m_valid = false;
+};
+
+} // namespace VoiceTrace
+
+#endif // MUMBLE_MURMUR_VOICETRACE_H_
@@ -647,13 +647,23 @@ int main(int argc, char **argv) {
 	IceStart();
 #endif
 
+	meta->startMetrics();
+
 	meta->getOSInfo();
 
 	qWarning("Murmur %s running on %s: %s: Booting servers", qPrintable(Version::toString(Version::get())),
 			 qPrintable(meta->qsOS), qPrintable(meta->qsOSVersion));
 
+#ifdef Q_OS_UNIX
+	meta->takeOverSockets();
+#endif
+
 	meta->bootAll();
 
+#ifdef Q_OS_UNIX
+	meta->finishTakeOver();
+#endif
+
 	signal(SIGTERM, cleanup);
 	signal(SIGINT, cleanup);
 
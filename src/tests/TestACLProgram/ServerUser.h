@@ -0,0 +1,28 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+
+// NOTE: This is merely a mock of the ServerUser class
+
+#ifndef MUMBLE_TEST_ACLPROGRAM_SERVERUSER_H_
+#define MUMBLE_TEST_ACLPROGRAM_SERVERUSER_H_
+
+#include "User.h"
+
+#include <QtCore/QStringList>
+
+class ServerUser : public User {
+public:
+	ServerUser(unsigned int session, int id, Channel *channel) {
+		uiSession = session;
+		iId       = id;
+		cChannel  = channel;
+	}
+
+	bool bVerified = false;
+	QStringList qslAccessTokens;
+};
+
+#endif // MUMBLE_TEST_ACLPROGRAM_SERVERUSER_H_
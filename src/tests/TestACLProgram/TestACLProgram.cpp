@@ -0,0 +1,260 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ACL.h"
+#include "ACLProgram.h"
+#include "Channel.h"
+#include "Group.h"
+#include "ServerUser.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+ChanACL *addACL(Channel *channel, const QString &group, ChanACL::Permissions allow, ChanACL::Permissions deny,
+				bool applyHere = true, bool applySubs = true, int userId = -1) {
+	ChanACL *acl    = new ChanACL(channel);
+	acl->qsGroup    = group;
+	acl->pAllow     = allow;
+	acl->pDeny      = deny;
+	acl->bApplyHere = applyHere;
+	acl->bApplySubs = applySubs;
+	acl->iUserId    = userId;
+	return acl;
+}
+
+Group *addGroup(Channel *channel, const QString &name, QSet< int > add, QSet< int > remove = {}) {
+	Group *group    = new Group(channel, name);
+	group->qsAdd    = std::move(add);
+	group->qsRemove = std::move(remove);
+	return group;
+}
+
+/// Root - A - B - C and Root - D, with ACLs and groups that make use of every kind of group specification
+struct Tree {
+	Channel root{ 0, QLatin1String("Root") };
+	Channel *a = new Channel(1, QLatin1String("A"), &root);
+	Channel *b = new Channel(2, QLatin1String("B"), a);
+	Channel *c = new Channel(3, QLatin1String("C"), b);
+	Channel *d = new Channel(4, QLatin1String("D"), &root);
+	QList< Channel * > channels = { &root, a, b, c, d };
+
+	std::vector< std::unique_ptr< ServerUser > > users;
+
+	Tree() {
+		// "admin" is extended in A and starts over in B
+		addGroup(&root, QLatin1String("admin"), { 1 });
+		addGroup(a, QLatin1String("admin"), { 2 }, { 1 });
+		addGroup(b, QLatin1String("admin"), { 3 })->bInherit = false;
+		// Only visible in the root channel itself
+		addGroup(&root, QLatin1String("private"), { 4 })->bInheritable = false;
+
+		addACL(&root, QLatin1String("all"), ChanACL::None, ChanACL::Speak);
+		addACL(&root, QLatin1String("admin"), ChanACL::Write, ChanACL::None, false, true);
+		addACL(&root, QString(), ChanACL::Kick | ChanACL::Ban, ChanACL::None, true, false, 5);
+		addACL(&root, QLatin1String("private"), ChanACL::Register, ChanACL::None);
+
+		addACL(a, QLatin1String("~admin"), ChanACL::MuteDeafen, ChanACL::None);
+		addACL(a, QLatin1String("!auth"), ChanACL::None, ChanACL::Enter | ChanACL::TextMessage);
+		addACL(a, QLatin1String("#token"), ChanACL::Speak, ChanACL::None);
+		addACL(a, QLatin1String("$hash"), ChanACL::LinkChannel, ChanACL::None);
+		addACL(a, QLatin1String("in"), ChanACL::Move, ChanACL::None);
+		addACL(a, QLatin1String("out"), ChanACL::None, ChanACL::Whisper);
+		addACL(a, QLatin1String("~sub,0,1"), ChanACL::MakeChannel, ChanACL::None);
+		addACL(a, QLatin1String("strong"), ChanACL::MakeTempChannel, ChanACL::None);
+		addACL(a, QLatin1String("private"), ChanACL::Speak, ChanACL::None);
+		addACL(a, QLatin1String("!~in"), ChanACL::None, ChanACL::Listen, false, true);
+
+		b->bInheritACL = false;
+		addACL(b, QLatin1String("admin"), ChanACL::None, ChanACL::Traverse, true, false);
+		addACL(b, QLatin1String("none"), ChanACL::Write, ChanACL::None);
+		addACL(b, QString(), ChanACL::Write, ChanACL::None, true, true, 3);
+		addACL(b, QLatin1String("sub,-1"), ChanACL::Speak, ChanACL::None);
+
+		addACL(c, QLatin1String("!admin"), ChanACL::None, ChanACL::Speak, true, false);
+		addACL(d, QLatin1String("!in"), ChanACL::None, ChanACL::Traverse);
+
+		addUser(1, 1, a);
+		addUser(2, 2, b);
+		addUser(3, 3, c);
+		addUser(4, 4, &root);
+		addUser(5, 5, d);
+		addUser(6, -1, a)->qslAccessTokens << QLatin1String("TOKEN");
+		ServerUser *verified = addUser(7, 7, c);
+		verified->bVerified  = true;
+		verified->qsHash     = QLatin1String("hash");
+		addUser(8, 0, b);
+	}
+
+	ServerUser *addUser(unsigned int session, int id, Channel *channel) {
+		users.emplace_back(new ServerUser(session, id, channel));
+		return users.back().get();
+	}
+
+	ServerUser *user(unsigned int session) const {
+		for (const std::unique_ptr< ServerUser > &user : users) {
+			if (user->uiSession == session) {
+				return user.get();
+			}
+		}
+		return nullptr;
+	}
+};
+
+int expected(ServerUser *user, Channel *channel) {
+	return static_cast< int >(ChanACL::effectivePermissions(user, channel, nullptr));
+}
+
+int evaluated(const ACLProgram &program, const ServerUser *user) {
+	return static_cast< int >(program.evaluate(*user));
+}
+
+/// Compares the given programs with ChanACL::effectivePermissions for all users in all channels
+void compareAll(const Tree &tree, ACLProgramCache &cache) {
+	for (Channel *channel : tree.channels) {
+		const ACLProgram &program = cache.get(*channel);
+		for (const std::unique_ptr< ServerUser > &user : tree.users) {
+			if (evaluated(program, user.get()) != expected(user.get(), channel)) {
+				QFAIL(qPrintable(QString::fromLatin1("User %1 in channel %2: %3 instead of %4")
+									 .arg(user->uiSession)
+									 .arg(channel->qsName)
+									 .arg(evaluated(program, user.get()))
+									 .arg(expected(user.get(), channel))));
+			}
+		}
+	}
+}
+} // namespace
+
+class TestACLProgram : public QObject {
+	Q_OBJECT
+private slots:
+	void equivalence();
+	void userMoves();
+	void groupMembers();
+	void newGroup();
+	void invalidateBranch();
+	void removeAndClear();
+};
+
+void TestACLProgram::equivalence() {
+	Tree tree;
+	ACLProgramCache cache;
+	compareAll(tree, cache);
+
+	// A few of the results, so that the comparison doesn't pass by both sides being wrong in the same way
+	QVERIFY(cache.get(*tree.a).evaluate(*tree.user(2)) & ChanACL::Write);
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(1)) & ChanACL::Write));
+	QVERIFY(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::Speak);
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::Enter));
+	QVERIFY(cache.get(tree.root).evaluate(*tree.user(5)) & ChanACL::Kick);
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(5)) & ChanACL::Kick));
+	QVERIFY(cache.get(tree.root).evaluate(*tree.user(4)) & ChanACL::Register);
+	QCOMPARE(evaluated(cache.get(*tree.d), tree.user(4)), static_cast< int >(ChanACL::None));
+}
+
+void TestACLProgram::userMoves() {
+	Tree tree;
+	ACLProgramCache cache;
+
+	// "in", "out" and "sub" depend on the user's channel, which doesn't require recompiling
+	for (Channel *channel : tree.channels) {
+		for (const std::unique_ptr< ServerUser > &user : tree.users) {
+			user->cChannel = channel;
+		}
+		compareAll(tree, cache);
+	}
+}
+
+void TestACLProgram::groupMembers() {
+	Tree tree;
+	ACLProgramCache cache;
+	compareAll(tree, cache);
+
+	// Changes to the members of groups take effect without recompiling
+	tree.a->qhGroups.value(QLatin1String("admin"))->qsAdd.insert(6);
+	tree.a->qhGroups.value(QLatin1String("admin"))->qsRemove.insert(2);
+	compareAll(tree, cache);
+
+	tree.root.qhGroups.value(QLatin1String("admin"))->qsAdd.insert(5);
+	tree.b->qhGroups.value(QLatin1String("admin"))->qsAdd.remove(3);
+	compareAll(tree, cache);
+
+	// Temporary members are given by user ID or (for unregistered users) by negated session
+	tree.b->qhGroups.value(QLatin1String("admin"))->qsTemporary.insert(7);
+	tree.root.qhGroups.value(QLatin1String("admin"))->qsTemporary.insert(-6);
+	compareAll(tree, cache);
+	QVERIFY(cache.get(*tree.d).evaluate(*tree.user(6)) & ChanACL::Write);
+
+	tree.root.qhGroups.value(QLatin1String("admin"))->qsTemporary.remove(-6);
+	compareAll(tree, cache);
+}
+
+void TestACLProgram::newGroup() {
+	Tree tree;
+	addACL(tree.a, QLatin1String("temp"), ChanACL::MakeTempChannel, ChanACL::None);
+	ACLProgramCache cache;
+	compareAll(tree, cache);
+
+	// Like Server::setTempGroups, which creates the group if it doesn't exist yet
+	Group *temp = new Group(tree.a, QLatin1String("temp"));
+	temp->qsTemporary.insert(-6);
+
+	// The program has been compiled while there has been no such group
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::MakeTempChannel));
+	QVERIFY(ChanACL::effectivePermissions(tree.user(6), tree.a, nullptr) & ChanACL::MakeTempChannel);
+
+	cache.invalidateBranch(*tree.a);
+	compareAll(tree, cache);
+	QVERIFY(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::MakeTempChannel);
+}
+
+void TestACLProgram::invalidateBranch() {
+	Tree tree;
+	ACLProgramCache cache;
+	compareAll(tree, cache);
+
+	// The groups of A are referred to by the programs of its children as well
+	for (Group *group : tree.a->qhGroups) {
+		delete group;
+	}
+	tree.a->qhGroups.clear();
+	addGroup(tree.a, QLatin1String("admin"), { 6 });
+	tree.a->qhGroups.value(QLatin1String("admin"))->bInherit = false;
+	addACL(tree.a, QLatin1String("admin"), ChanACL::None, ChanACL::Listen);
+
+	cache.invalidateBranch(*tree.a);
+	compareAll(tree, cache);
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::Listen));
+
+	// Programs outside of the branch are kept
+	const ACLProgram *root = &cache.get(tree.root);
+	cache.invalidateBranch(*tree.d);
+	QCOMPARE(&cache.get(tree.root), root);
+}
+
+void TestACLProgram::removeAndClear() {
+	Tree tree;
+	ACLProgramCache cache;
+	compareAll(tree, cache);
+
+	addACL(&tree.root, QLatin1String("all"), ChanACL::None, ChanACL::Listen);
+
+	// Only the removed program is compiled again
+	cache.remove(*tree.a);
+	QCOMPARE(evaluated(cache.get(*tree.a), tree.user(6)), expected(tree.user(6), tree.a));
+	QVERIFY(!(cache.get(*tree.a).evaluate(*tree.user(6)) & ChanACL::Listen));
+	QVERIFY(cache.get(*tree.d).evaluate(*tree.user(5)) & ChanACL::Listen);
+
+	cache.clear();
+	compareAll(tree, cache);
+	QVERIFY(!(cache.get(*tree.d).evaluate(*tree.user(5)) & ChanACL::Listen));
+}
+
+QTEST_MAIN(TestACLProgram)
+#include "TestACLProgram.moc"
@@ -0,0 +1,97 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioBenchmark.h"
+#include "AudioLatency.h"
+
+#include <cmath>
+#include <vector>
+
+class TestAudioBenchmark : public QObject {
+	Q_OBJECT
+private slots:
+	void init();
+	void statistics();
+	void impulse();
+	void impulseTimeout();
+};
+
+void TestAudioBenchmark::init() {
+	AudioBenchmark::reset();
+}
+
+void TestAudioBenchmark::statistics() {
+	using AudioBenchmark::Probe;
+
+	QCOMPARE(AudioBenchmark::statistics(Probe::Mix).samples, static_cast< quint64 >(0));
+	QCOMPARE(AudioBenchmark::statistics(Probe::Mix).mean(), 0.0);
+
+	AudioBenchmark::record(Probe::Mix, 1000);
+	AudioBenchmark::record(Probe::Mix, 3000);
+	AudioBenchmark::record(Probe::Mix, 2000);
+
+	const AudioBenchmark::Statistics stats = AudioBenchmark::statistics(Probe::Mix);
+	QCOMPARE(stats.samples, static_cast< quint64 >(3));
+	QCOMPARE(stats.min, static_cast< quint64 >(1000));
+	QCOMPARE(stats.max, static_cast< quint64 >(3000));
+	QCOMPARE(stats.mean(), 2000.0);
+	QVERIFY(std::fabs(stats.deviation() - std::sqrt(2000000.0 / 3.0)) < 1e-6);
+
+	// The other probes are left alone
+	QCOMPARE(AudioBenchmark::statistics(Probe::Encode).samples, static_cast< quint64 >(0));
+
+	// Periods aren't recorded while no benchmark runs
+	quint64 last = 1;
+	AudioBenchmark::recordPeriod(Probe::InputPeriod, last);
+	QCOMPARE(last, static_cast< quint64 >(0));
+	QCOMPARE(AudioBenchmark::statistics(Probe::InputPeriod).samples, static_cast< quint64 >(0));
+
+	AudioBenchmark::reset();
+	QCOMPARE(AudioBenchmark::statistics(Probe::Mix).samples, static_cast< quint64 >(0));
+}
+
+void TestAudioBenchmark::impulse() {
+	using AudioBenchmark::Probe;
+
+	QVERIFY(!AudioBenchmark::takeImpulse());
+	AudioBenchmark::requestImpulse();
+	QVERIFY(AudioBenchmark::takeImpulse());
+	QVERIFY(!AudioBenchmark::takeImpulse());
+
+	// A frame that has arrived 10 ms after the impulse has been mixed, with the impulse in its second half
+	const quint64 captured = AudioLatency::now() + 10000;
+	std::vector< float > frame(480, 0.01f);
+	frame[240] = AudioBenchmark::IMPULSE_AMPLITUDE;
+
+	AudioBenchmark::detectImpulse(frame.data(), static_cast< unsigned int >(frame.size()), captured);
+	const AudioBenchmark::Statistics stats = AudioBenchmark::statistics(Probe::Loopback);
+	QCOMPARE(stats.samples, static_cast< quint64 >(1));
+	QVERIFY(stats.min >= 15000);
+	QVERIFY(stats.min < 15000 + AudioBenchmark::IMPULSE_TIMEOUT);
+
+	// An impulse is only recorded once
+	AudioBenchmark::detectImpulse(frame.data(), static_cast< unsigned int >(frame.size()), captured + 10000);
+	QCOMPARE(AudioBenchmark::statistics(Probe::Loopback).samples, static_cast< quint64 >(1));
+}
+
+void TestAudioBenchmark::impulseTimeout() {
+	using AudioBenchmark::Probe;
+
+	AudioBenchmark::requestImpulse();
+	QVERIFY(AudioBenchmark::takeImpulse());
+
+	// The impulse is given up on once the microphone should have picked it up long ago
+	std::vector< float > frame(480, AudioBenchmark::IMPULSE_AMPLITUDE);
+	const quint64 late = AudioLatency::now() + AudioBenchmark::IMPULSE_TIMEOUT + 1000;
+	AudioBenchmark::detectImpulse(frame.data(), static_cast< unsigned int >(frame.size()), late);
+	AudioBenchmark::detectImpulse(frame.data(), static_cast< unsigned int >(frame.size()), AudioLatency::now());
+	QCOMPARE(AudioBenchmark::statistics(Probe::Loopback).samples, static_cast< quint64 >(0));
+}
+
+QTEST_MAIN(TestAudioBenchmark)
+#include "TestAudioBenchmark.moc"
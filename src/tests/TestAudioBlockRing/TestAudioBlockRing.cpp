@@ -0,0 +1,123 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioBlockRing.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+class TestAudioBlockRing : public QObject {
+	Q_OBJECT
+private slots:
+	void pushPop();
+	void full();
+	void oversized();
+	void concurrent();
+};
+
+static AudioBlockRing::Block headerOf(unsigned int sampleCount) {
+	AudioBlockRing::Block header;
+	header.source       = AudioBlockRing::Source::SourceFetched;
+	header.sampleCount  = sampleCount;
+	header.channelCount = 1;
+	header.sampleRate   = 48000;
+	header.isSpeech     = true;
+	header.userID       = 42;
+	return header;
+}
+
+void TestAudioBlockRing::pushPop() {
+	AudioBlockRing ring;
+	QVERIFY(!ring.front());
+
+	const std::vector< float > pcm = { 0.25f, -0.5f, 1.0f };
+	QVERIFY(ring.push(headerOf(3), pcm.data(), pcm.size() * sizeof(float)));
+	QCOMPARE(ring.size(), static_cast< std::size_t >(1));
+
+	AudioBlockRing::Block *block = ring.front();
+	QVERIFY(block);
+	QVERIFY(block->source == AudioBlockRing::Source::SourceFetched);
+	QCOMPARE(block->sampleCount, static_cast< std::uint32_t >(3));
+	QCOMPARE(block->sampleRate, static_cast< std::uint32_t >(48000));
+	QCOMPARE(block->userID, static_cast< std::uint32_t >(42));
+	QCOMPARE(block->bytes, pcm.size() * sizeof(float));
+	QCOMPARE(reinterpret_cast< const float * >(block->data.get())[1], -0.5f);
+
+	ring.pop();
+	QVERIFY(!ring.front());
+	QCOMPARE(ring.dropped(), static_cast< std::uint64_t >(0));
+}
+
+void TestAudioBlockRing::full() {
+	AudioBlockRing ring;
+	const float sample = 0.0f;
+
+	for (std::size_t i = 0; i < AudioBlockRing::CAPACITY; i++) {
+		QVERIFY(ring.push(headerOf(static_cast< unsigned int >(i)), &sample, sizeof(sample)));
+	}
+
+	// A full ring drops the new buffer rather than overwriting the old ones
+	QVERIFY(!ring.push(headerOf(1000), &sample, sizeof(sample)));
+	QCOMPARE(ring.dropped(), static_cast< std::uint64_t >(1));
+	QCOMPARE(ring.front()->sampleCount, static_cast< std::uint32_t >(0));
+
+	ring.pop();
+	QVERIFY(ring.push(headerOf(1000), &sample, sizeof(sample)));
+	QCOMPARE(ring.size(), AudioBlockRing::CAPACITY);
+}
+
+void TestAudioBlockRing::oversized() {
+	AudioBlockRing ring;
+	const std::vector< std::uint8_t > pcm(AudioBlockRing::MAX_BYTES + 1);
+
+	QVERIFY(!ring.push(headerOf(1), pcm.data(), pcm.size()));
+	QCOMPARE(ring.dropped(), static_cast< std::uint64_t >(1));
+	QVERIFY(!ring.front());
+
+	QVERIFY(ring.push(headerOf(1), pcm.data(), AudioBlockRing::MAX_BYTES));
+}
+
+void TestAudioBlockRing::concurrent() {
+	AudioBlockRing ring;
+	constexpr unsigned int buffers = 100000;
+
+	std::thread producer([&ring]() {
+		for (unsigned int i = 0; i < buffers; i++) {
+			while (!ring.push(headerOf(i), &i, sizeof(i))) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	// Every buffer arrives once, in order and with the audio it has been pushed with
+	bool intact           = true;
+	unsigned int received = 0;
+	while (received < buffers) {
+		AudioBlockRing::Block *block = ring.front();
+		if (!block) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		unsigned int value;
+		std::memcpy(&value, block->data.get(), sizeof(value));
+		intact = intact && block->sampleCount == received && value == received;
+
+		ring.pop();
+		received++;
+	}
+
+	producer.join();
+
+	QVERIFY(intact);
+	QCOMPARE(ring.size(), static_cast< std::size_t >(0));
+}
+
+QTEST_MAIN(TestAudioBlockRing)
+#include "TestAudioBlockRing.moc"
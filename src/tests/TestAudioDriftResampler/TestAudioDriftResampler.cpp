@@ -0,0 +1,109 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioDriftResampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+class TestAudioDriftResampler : public QObject {
+	Q_OBJECT
+private slots:
+	void passthrough();
+	void ratio();
+	void accuracy();
+};
+
+void TestAudioDriftResampler::passthrough() {
+	const unsigned int frames = 480;
+	AudioDriftResampler resampler(2, AudioDriftResampler::maxInputFramesFor(frames));
+
+	std::vector< float > input(2 * 100 * frames);
+	for (std::size_t i = 0; i < input.size(); ++i) {
+		input[i] = std::sin(static_cast< float >(i) * 0.01f);
+	}
+
+	// With a ratio of 1, the frames come out as they went in (apart from the first call taking two more)
+	std::vector< float > output(2 * frames);
+	std::size_t consumed = 0;
+	for (unsigned int chunk = 0; chunk < 90; ++chunk) {
+		const unsigned int needed = resampler.inputFramesFor(frames);
+		QCOMPARE(resampler.process(input.data() + 2 * consumed, needed, output.data(), frames), frames);
+
+		for (unsigned int i = 0; i < 2 * frames; ++i) {
+			QCOMPARE(output[i], input[2 * chunk * frames + i]);
+		}
+		consumed += needed;
+	}
+	QCOMPARE(consumed, static_cast< std::size_t >(90 * frames + 2));
+}
+
+void TestAudioDriftResampler::ratio() {
+	const unsigned int frames = 480;
+
+	// Ratios beyond the drift of clocks are clamped
+	AudioDriftResampler clamped(1, AudioDriftResampler::maxInputFramesFor(frames));
+	clamped.setRatio(1.1);
+	QVERIFY(std::fabs(clamped.ratio() - (1.0 + AudioDriftResampler::MAX_DRIFT)) < 1e-9);
+	clamped.setRatio(0.9);
+	QVERIFY(std::fabs(clamped.ratio() - (1.0 - AudioDriftResampler::MAX_DRIFT)) < 1e-9);
+
+	for (const double ratio : { 0.998, 0.9995, 1.0007, 1.002 }) {
+		AudioDriftResampler resampler(1, AudioDriftResampler::maxInputFramesFor(frames));
+		resampler.setRatio(ratio);
+		QVERIFY(std::fabs(resampler.ratio() - ratio) < 1e-9);
+
+		// Every call produces exactly the frames it has been asked for, taking (on average) ratio times as many
+		std::vector< float > input(AudioDriftResampler::maxInputFramesFor(frames), 0.5f);
+		std::vector< float > output(frames);
+		std::size_t consumed = 0;
+		for (unsigned int chunk = 0; chunk < 300; ++chunk) {
+			const unsigned int needed = resampler.inputFramesFor(frames);
+			QVERIFY(needed <= AudioDriftResampler::maxInputFramesFor(frames));
+			QCOMPARE(resampler.process(input.data(), needed, output.data(), frames), frames);
+			consumed += needed;
+		}
+
+		const double expected = 300 * frames * resampler.ratio();
+		QVERIFY(std::fabs(static_cast< double >(consumed) - expected) < 4.0);
+	}
+}
+
+void TestAudioDriftResampler::accuracy() {
+	const unsigned int frames = 480;
+	AudioDriftResampler resampler(1, AudioDriftResampler::maxInputFramesFor(frames));
+	resampler.setRatio(1.0013);
+
+	std::vector< float > input(100 * frames);
+	for (std::size_t i = 0; i < input.size(); ++i) {
+		input[i] = static_cast< float >(std::sin(static_cast< double >(i) * 0.05));
+	}
+
+	// A tone well within the band of speech keeps its shape
+	std::vector< float > output(frames);
+	std::size_t consumed = 0;
+	std::size_t produced = 0;
+	float error          = 0.0f;
+	for (unsigned int chunk = 0; chunk < 90; ++chunk) {
+		const unsigned int needed = resampler.inputFramesFor(frames);
+		resampler.process(input.data() + consumed, needed, output.data(), frames);
+		consumed += needed;
+
+		for (unsigned int i = 0; i < frames; ++i, ++produced) {
+			const double position = static_cast< double >(produced) * resampler.ratio();
+			if (produced > 0) {
+				error = std::max(error, std::fabs(output[i] - static_cast< float >(std::sin(position * 0.05))));
+			}
+		}
+	}
+	QVERIFY(error < 1e-4f);
+}
+
+QTEST_MAIN(TestAudioDriftResampler)
+#include "TestAudioDriftResampler.moc"
@@ -0,0 +1,129 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioFrameRecovery.h"
+
+using Source = AudioFrameRecovery::Source;
+
+/// Frame numbers count 10 ms frames, and every packet holds 20 ms
+static constexpr std::uint64_t FRAMES = 2;
+
+class TestAudioFrameRecovery : public QObject {
+	Q_OBJECT
+private slots:
+	void inOrder();
+	void singleLoss();
+	void duplicates();
+	void gaps();
+	void transmissions();
+};
+
+void TestAudioFrameRecovery::inOrder() {
+	AudioFrameRecovery recovery;
+
+	for (std::uint64_t frameNumber = 0; frameNumber < 20; frameNumber += FRAMES) {
+		const AudioFrameRecovery::Recovery result = recovery.receive(frameNumber, FRAMES, FRAMES, false);
+		QVERIFY(result.play);
+		QCOMPARE(result.source, Source::None);
+	}
+}
+
+void TestAudioFrameRecovery::singleLoss() {
+	// The redundant payload of the next packet is preferred
+	AudioFrameRecovery redundant;
+	QVERIFY(redundant.receive(0, FRAMES, FRAMES, false).play);
+	QVERIFY(redundant.receive(2, FRAMES, FRAMES, false).play);
+
+	AudioFrameRecovery::Recovery result = redundant.receive(6, FRAMES, FRAMES, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::RedundantPayload);
+	QCOMPARE(result.frameNumber, static_cast< std::uint64_t >(4));
+
+	// Without one, the next packet's in-band FEC is decoded
+	AudioFrameRecovery fec;
+	QVERIFY(fec.receive(0, FRAMES, 0, false).play);
+	QVERIFY(fec.receive(2, FRAMES, 0, false).play);
+
+	result = fec.receive(6, FRAMES, 0, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::FEC);
+	QCOMPARE(result.frameNumber, static_cast< std::uint64_t >(4));
+	QCOMPARE(fec.receive(8, FRAMES, 0, false).source, Source::None);
+}
+
+void TestAudioFrameRecovery::duplicates() {
+	AudioFrameRecovery recovery;
+	recovery.receive(0, FRAMES, FRAMES, false);
+	recovery.receive(2, FRAMES, FRAMES, false);
+	QCOMPARE(recovery.receive(6, FRAMES, FRAMES, false).source, Source::RedundantPayload);
+
+	// The lost packet is dropped once it shows up after all, as it has been made up for already
+	QVERIFY(!recovery.receive(4, FRAMES, FRAMES, false).play);
+	QVERIFY(!recovery.receive(4, FRAMES, FRAMES, false).play);
+
+	// Duplicates of packets that have arrived are left to the jitter buffer, but never make up for anything
+	AudioFrameRecovery::Recovery result = recovery.receive(2, FRAMES, FRAMES, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::None);
+	result = recovery.receive(6, FRAMES, FRAMES, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::None);
+
+	// Neither do they throw off the frame that is expected next
+	QCOMPARE(recovery.receive(8, FRAMES, FRAMES, false).source, Source::None);
+}
+
+void TestAudioFrameRecovery::gaps() {
+	AudioFrameRecovery recovery;
+	recovery.receive(0, FRAMES, FRAMES, false);
+	recovery.receive(2, FRAMES, FRAMES, false);
+
+	// Only the packet right before the received one can be made up for
+	AudioFrameRecovery::Recovery result = recovery.receive(10, FRAMES, FRAMES, false);
+	QCOMPARE(result.source, Source::RedundantPayload);
+	QCOMPARE(result.frameNumber, static_cast< std::uint64_t >(8));
+
+	// The other lost packets are still played if they arrive late, unlike the one that has been made up for
+	result = recovery.receive(4, FRAMES, FRAMES, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::None);
+	QVERIFY(!recovery.receive(8, FRAMES, FRAMES, false).play);
+
+	// A previous packet that would overlap with one that has arrived isn't missing, it is a different one that is
+	recovery.receive(12, FRAMES, FRAMES, false);
+	result = recovery.receive(16, FRAMES, 4, false);
+	QVERIFY(result.play);
+	QCOMPARE(result.source, Source::None);
+
+	// The same goes for packets of a different duration, whose in-band FEC would overlap
+	recovery.receive(18, FRAMES, 0, false);
+	result = recovery.receive(22, 4, 0, false);
+	QCOMPARE(result.source, Source::None);
+	result = recovery.receive(34, 4, 0, false);
+	QCOMPARE(result.source, Source::FEC);
+	QCOMPARE(result.frameNumber, static_cast< std::uint64_t >(30));
+}
+
+void TestAudioFrameRecovery::transmissions() {
+	AudioFrameRecovery recovery;
+
+	// Nothing has been lost before the first packet of a transmission
+	QCOMPARE(recovery.receive(100, FRAMES, FRAMES, false).source, Source::None);
+	QCOMPARE(recovery.receive(102, FRAMES, FRAMES, true).source, Source::None);
+
+	// Nor before the first one of the next transmission, which may start with any frame number
+	QCOMPARE(recovery.receive(500, FRAMES, FRAMES, false).source, Source::None);
+	QCOMPARE(recovery.receive(502, FRAMES, FRAMES, true).source, Source::None);
+	QCOMPARE(recovery.receive(0, FRAMES, FRAMES, false).source, Source::None);
+
+	// The previous packet can't have preceded the first frame
+	QCOMPARE(recovery.receive(3, 4, 0, false).source, Source::None);
+}
+
+QTEST_MAIN(TestAudioFrameRecovery)
+#include "TestAudioFrameRecovery.moc"
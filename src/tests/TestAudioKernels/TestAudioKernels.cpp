@@ -0,0 +1,269 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/// Lengths around the widths of the vectors (4 floats for SSE2 and NEON, 8 for AVX2), so that every kernel has to
+/// deal with a tail that doesn't fill a vector
+static const std::size_t LENGTHS[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 127, 481 };
+/// Offsets (in samples) of the buffers from an aligned address
+static const std::size_t OFFSETS[] = { 0, 1, 3 };
+/// Followed by every output, so that writes beyond its end are noticed
+static const std::size_t GUARD = 16;
+static const float GUARD_VALUE = 12345.0f;
+
+/// @returns count random samples in [-range, range]
+static std::vector< float > randomFloats(std::size_t count, float range, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution< float > distribution(-range, range);
+
+	std::vector< float > samples(count);
+	for (float &sample : samples) {
+		sample = distribution(rng);
+	}
+	return samples;
+}
+
+static std::vector< short > randomShorts(std::size_t count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution< int > distribution(-32768, 32767);
+
+	std::vector< short > samples(count);
+	for (short &sample : samples) {
+		sample = static_cast< short >(distribution(rng));
+	}
+	return samples;
+}
+
+/// @returns Whether the given results match, allowing for the rounding differences of summing up in another order
+static bool nearlyEqual(float actual, float expected, float tolerance = 1e-5f) {
+	return std::abs(actual - expected) <= tolerance * std::max(1.0f, std::abs(expected));
+}
+
+/// Compares the first count samples of the given outputs and checks that neither has been written beyond them
+static void compareSamples(const float *actual, const float *expected, std::size_t count, float tolerance) {
+	for (std::size_t i = 0; i < count; ++i) {
+		if (!nearlyEqual(actual[i], expected[i], tolerance)) {
+			QFAIL(qPrintable(QString::fromLatin1("Sample %1 of %2: %3 instead of %4")
+								 .arg(i)
+								 .arg(count)
+								 .arg(static_cast< double >(actual[i]))
+								 .arg(static_cast< double >(expected[i]))));
+		}
+	}
+	for (std::size_t i = count; i < count + GUARD; ++i) {
+		QCOMPARE(actual[i], expected[i]);
+	}
+}
+
+class TestAudioKernels : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void floatToShort();
+	void shortToFloat();
+	void dot();
+	void accumulateRamp();
+	void accumulateStereoRamp();
+	void accumulatePanned();
+	void interleave();
+	void clip();
+	void downmixFloat();
+	void downmixShort();
+};
+
+void TestAudioKernels::initTestCase() {
+	// Only the kernels of the CPU the test runs on can be tested
+	qInfo("Testing the %s kernels", AudioKernels::backendName());
+}
+
+void TestAudioKernels::floatToShort() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			// Some of the samples are beyond [-1, 1], which is where they are clamped
+			const std::vector< float > in = randomFloats(offset + count, 1.5f, static_cast< unsigned int >(count));
+
+			for (float scale : { 32768.f, 1.0f, 20000.f }) {
+				std::vector< short > actual(offset + count + GUARD, 1234);
+				std::vector< short > expected(actual);
+				AudioKernels::floatToShort(in.data() + offset, actual.data() + offset, count, scale);
+				AudioKernels::Scalar::floatToShort(in.data() + offset, expected.data() + offset, count, scale);
+				QCOMPARE(actual, expected);
+			}
+		}
+	}
+}
+
+void TestAudioKernels::shortToFloat() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			const std::vector< short > in = randomShorts(offset + count, static_cast< unsigned int >(count));
+
+			for (float scale : { 1.0f / 32768.f, 1.0f }) {
+				std::vector< float > actual(offset + count + GUARD, GUARD_VALUE);
+				std::vector< float > expected(actual);
+				AudioKernels::shortToFloat(in.data() + offset, actual.data() + offset, count, scale);
+				AudioKernels::Scalar::shortToFloat(in.data() + offset, expected.data() + offset, count, scale);
+				QCOMPARE(actual, expected);
+			}
+		}
+	}
+}
+
+void TestAudioKernels::dot() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			const std::vector< float > a = randomFloats(offset + count, 1.0f, 1);
+			const std::vector< float > b = randomFloats(offset + count, 1.0f, 2);
+
+			const float actual   = AudioKernels::dot(a.data() + offset, b.data() + offset, count);
+			const float expected = AudioKernels::Scalar::dot(a.data() + offset, b.data() + offset, count);
+			// The products are summed up in another order, whose error grows with the length
+			QVERIFY(nearlyEqual(actual, expected, 1e-6f * static_cast< float >(count + 1)));
+		}
+	}
+}
+
+void TestAudioKernels::accumulateRamp() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			const std::vector< float > in = randomFloats(offset + count, 1.0f, 3);
+			std::vector< float > actual   = randomFloats(offset + count, 1.0f, 4);
+			actual.resize(offset + count + GUARD, GUARD_VALUE);
+			std::vector< float > expected = actual;
+
+			const unsigned int n = static_cast< unsigned int >(count);
+			AudioKernels::accumulateRamp(actual.data() + offset, in.data() + offset, n, 0.25f, 0.001f);
+			AudioKernels::Scalar::accumulateRamp(expected.data() + offset, in.data() + offset, n, 0.25f, 0.001f);
+			compareSamples(actual.data() + offset, expected.data() + offset, count, 1e-5f);
+		}
+	}
+}
+
+void TestAudioKernels::accumulateStereoRamp() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			const std::vector< float > in = randomFloats(2 * (offset + count), 1.0f, 5);
+			std::vector< float > actual   = randomFloats(offset + count, 1.0f, 6);
+			actual.resize(offset + count + GUARD, GUARD_VALUE);
+			std::vector< float > expected = actual;
+
+			const unsigned int n = static_cast< unsigned int >(count);
+			AudioKernels::accumulateStereoRamp(actual.data() + offset, in.data() + 2 * offset, n, 1.0f, -0.002f);
+			AudioKernels::Scalar::accumulateStereoRamp(expected.data() + offset, in.data() + 2 * offset, n, 1.0f,
+													   -0.002f);
+			compareSamples(actual.data() + offset, expected.data() + offset, count, 1e-5f);
+		}
+	}
+}
+
+void TestAudioKernels::accumulatePanned() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			const std::vector< float > in = randomFloats(2 * (offset + count), 1.0f, 7);
+			std::vector< float > actual   = randomFloats(offset + count, 1.0f, 8);
+			actual.resize(offset + count + GUARD, GUARD_VALUE);
+			std::vector< float > expected = actual;
+
+			const unsigned int n = static_cast< unsigned int >(count);
+			AudioKernels::accumulatePanned(actual.data() + offset, in.data() + 2 * offset, n, 0.8f, 0.3f, 0.5f);
+			AudioKernels::Scalar::accumulatePanned(expected.data() + offset, in.data() + 2 * offset, n, 0.8f, 0.3f,
+												   0.5f);
+			compareSamples(actual.data() + offset, expected.data() + offset, count, 1e-5f);
+		}
+	}
+}
+
+void TestAudioKernels::interleave() {
+	for (unsigned int channels : { 1U, 2U, 3U }) {
+		for (std::size_t count : LENGTHS) {
+			for (std::size_t offset : OFFSETS) {
+				const std::vector< float > planes = randomFloats(offset + channels * count, 1.0f, 9);
+				std::vector< float > actual(offset + channels * count + GUARD, GUARD_VALUE);
+				std::vector< float > expected(actual);
+
+				const unsigned int n = static_cast< unsigned int >(count);
+				AudioKernels::interleave(planes.data() + offset, actual.data() + offset, channels, n);
+				AudioKernels::Scalar::interleave(planes.data() + offset, expected.data() + offset, channels, n);
+				QCOMPARE(actual, expected);
+			}
+		}
+	}
+}
+
+void TestAudioKernels::clip() {
+	for (std::size_t count : LENGTHS) {
+		for (std::size_t offset : OFFSETS) {
+			std::vector< float > actual = randomFloats(offset + count, 2.0f, 10);
+			actual.resize(offset + count + GUARD, GUARD_VALUE);
+			std::vector< float > expected = actual;
+
+			AudioKernels::clip(actual.data() + offset, count);
+			AudioKernels::Scalar::clip(expected.data() + offset, count);
+			QCOMPARE(actual, expected);
+		}
+	}
+}
+
+void TestAudioKernels::downmixFloat() {
+	for (unsigned int channels : { 1U, 2U, 3U, 4U, 6U, 8U }) {
+		for (quint64 mask : { ~0ULL, 0x1ULL, 0x5ULL, 0x0ULL }) {
+			const AudioKernels::Downmix downmix =
+				AudioKernels::chooseDownmix(AudioKernels::SampleFormat::Float, channels, mask);
+			const AudioKernels::Downmix reference =
+				AudioKernels::Scalar::chooseDownmix(AudioKernels::SampleFormat::Float, channels, mask);
+
+			for (std::size_t count : LENGTHS) {
+				for (std::size_t offset : OFFSETS) {
+					const std::vector< float > in = randomFloats(channels * (offset + count), 1.0f, channels);
+					std::vector< float > actual(offset + count + GUARD, GUARD_VALUE);
+					std::vector< float > expected(actual);
+
+					const unsigned int n = static_cast< unsigned int >(count);
+					downmix(actual.data() + offset, in.data() + channels * offset, n, channels, mask);
+					reference(expected.data() + offset, in.data() + channels * offset, n, channels, mask);
+					compareSamples(actual.data() + offset, expected.data() + offset, count, 1e-5f);
+				}
+			}
+		}
+	}
+}
+
+void TestAudioKernels::downmixShort() {
+	for (unsigned int channels : { 1U, 2U, 3U, 4U, 6U, 8U }) {
+		for (quint64 mask : { ~0ULL, 0x1ULL, 0x5ULL, 0x0ULL }) {
+			const AudioKernels::Downmix downmix =
+				AudioKernels::chooseDownmix(AudioKernels::SampleFormat::Short, channels, mask);
+			const AudioKernels::Downmix reference =
+				AudioKernels::Scalar::chooseDownmix(AudioKernels::SampleFormat::Short, channels, mask);
+
+			// Some of the lengths span several of the blocks the shorts are converted to floats in
+			for (std::size_t count : LENGTHS) {
+				for (std::size_t offset : OFFSETS) {
+					const std::vector< short > in = randomShorts(channels * (offset + count), channels);
+					std::vector< float > actual(offset + count + GUARD, GUARD_VALUE);
+					std::vector< float > expected(actual);
+
+					const unsigned int n = static_cast< unsigned int >(count);
+					downmix(actual.data() + offset, in.data() + channels * offset, n, channels, mask);
+					reference(expected.data() + offset, in.data() + channels * offset, n, channels, mask);
+					// The shorts are summed up as integral floats, so that the result is exactly the same
+					compareSamples(actual.data() + offset, expected.data() + offset, count, 0.0f);
+				}
+			}
+		}
+	}
+}
+
+QTEST_MAIN(TestAudioKernels)
+#include "TestAudioKernels.moc"
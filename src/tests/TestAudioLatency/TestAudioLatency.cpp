@@ -0,0 +1,92 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioLatency.h"
+
+class TestAudioLatency : public QObject {
+	Q_OBJECT
+private slots:
+	void init();
+
+	void buckets();
+	void statistics();
+	void stagesAreSeparate();
+	void unknownStart();
+	void reset();
+};
+
+void TestAudioLatency::init() {
+	AudioLatency::reset();
+}
+
+void TestAudioLatency::buckets() {
+	// The bounds are exclusive
+	AudioLatency::record(AudioLatency::Stage::Encode, 999);
+	AudioLatency::record(AudioLatency::Stage::Encode, 1000);
+	AudioLatency::record(AudioLatency::Stage::Encode, 15000);
+	AudioLatency::record(AudioLatency::Stage::Encode, 5000000);
+
+	const AudioLatency::Histogram histogram = AudioLatency::histogram(AudioLatency::Stage::Encode);
+	QCOMPARE(histogram.counts[0], quint64(1));
+	QCOMPARE(histogram.counts[1], quint64(1));
+	// 10 ms to 20 ms
+	QCOMPARE(histogram.counts[4], quint64(1));
+	QCOMPARE(histogram.counts[AudioLatency::BUCKET_COUNT - 1], quint64(1));
+
+	QCOMPARE(AudioLatency::bucketBound(0), quint64(1000));
+	QCOMPARE(AudioLatency::bucketBound(AudioLatency::BUCKET_COUNT - 1), quint64(0));
+}
+
+void TestAudioLatency::statistics() {
+	for (int i = 0; i < 95; ++i) {
+		AudioLatency::record(AudioLatency::Stage::JitterBuffer, 3000);
+	}
+	for (int i = 0; i < 5; ++i) {
+		AudioLatency::record(AudioLatency::Stage::JitterBuffer, 43000);
+	}
+
+	const AudioLatency::Histogram histogram = AudioLatency::histogram(AudioLatency::Stage::JitterBuffer);
+	QCOMPARE(histogram.samples, quint64(100));
+	QCOMPARE(histogram.mean(), quint64(5000));
+	QCOMPARE(histogram.max, quint64(43000));
+	// The bound of the bucket holding the percentile
+	QCOMPARE(histogram.percentile(0.5), quint64(5000));
+	// The maximum, as it is below the bound of its bucket
+	QCOMPARE(histogram.percentile(0.99), quint64(43000));
+}
+
+void TestAudioLatency::stagesAreSeparate() {
+	AudioLatency::record(AudioLatency::Stage::Send, 100);
+
+	QCOMPARE(AudioLatency::histogram(AudioLatency::Stage::Send).samples, quint64(1));
+	QCOMPARE(AudioLatency::histogram(AudioLatency::Stage::Mix).samples, quint64(0));
+	QCOMPARE(AudioLatency::histogram(AudioLatency::Stage::Mix).mean(), quint64(0));
+}
+
+void TestAudioLatency::unknownStart() {
+	AudioLatency::recordSince(AudioLatency::Stage::Receive, 0);
+	QCOMPARE(AudioLatency::histogram(AudioLatency::Stage::Receive).samples, quint64(0));
+
+	const quint64 start = AudioLatency::now();
+	QVERIFY(start != 0);
+	AudioLatency::recordSince(AudioLatency::Stage::Receive, start);
+	QCOMPARE(AudioLatency::histogram(AudioLatency::Stage::Receive).samples, quint64(1));
+}
+
+void TestAudioLatency::reset() {
+	AudioLatency::record(AudioLatency::Stage::Network, 20000);
+	AudioLatency::reset();
+
+	const AudioLatency::Histogram histogram = AudioLatency::histogram(AudioLatency::Stage::Network);
+	QCOMPARE(histogram.samples, quint64(0));
+	QCOMPARE(histogram.max, quint64(0));
+	QCOMPARE(histogram.counts[5], quint64(0));
+}
+
+QTEST_MAIN(TestAudioLatency)
+#include "TestAudioLatency.moc"
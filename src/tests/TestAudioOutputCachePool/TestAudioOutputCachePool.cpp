@@ -0,0 +1,99 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioOutputCache.h"
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class TestAudioOutputCachePool : public QObject {
+	Q_OBJECT
+private slots:
+	void exhaustion();
+	void reuse();
+	void concurrency();
+};
+
+void TestAudioOutputCachePool::exhaustion() {
+	AudioOutputCachePool pool(3);
+	QCOMPARE(pool.size(), static_cast< std::size_t >(3));
+
+	std::vector< bool > taken(3, false);
+	for (int i = 0; i < 3; ++i) {
+		const std::size_t index = pool.acquire();
+		QVERIFY(index < 3);
+		QVERIFY(!taken[index]);
+		taken[index] = true;
+	}
+
+	QCOMPARE(pool.acquire(), AudioOutputCachePool::INVALID_INDEX);
+
+	AudioOutputCachePool empty(0);
+	QCOMPARE(empty.acquire(), AudioOutputCachePool::INVALID_INDEX);
+}
+
+void TestAudioOutputCachePool::reuse() {
+	AudioOutputCachePool pool(1);
+
+	const std::array< Mumble::Protocol::byte, 4 > payload = { 1, 2, 3, 4 };
+	Mumble::Protocol::AudioData audioData;
+	audioData.payload = payload;
+
+	const std::size_t index = pool.acquire();
+	pool[index].loadFrom(audioData);
+	QVERIFY(pool[index].isValid());
+	QCOMPARE(pool.acquire(), AudioOutputCachePool::INVALID_INDEX);
+
+	// Releasing clears the cache
+	pool.release(index);
+	QCOMPARE(pool.acquire(), index);
+	QVERIFY(!pool[index].isValid());
+}
+
+void TestAudioOutputCachePool::concurrency() {
+	constexpr std::size_t SIZE = 8;
+	AudioOutputCachePool pool(SIZE);
+
+	// Every thread marks the caches it holds, which no other thread may hold at the same time
+	std::array< std::atomic< bool >, SIZE > held = {};
+	std::atomic< bool > conflict(false);
+
+	std::vector< std::thread > threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&]() {
+			for (int j = 0; j < 100000; ++j) {
+				const std::size_t index = pool.acquire();
+				if (index == AudioOutputCachePool::INVALID_INDEX) {
+					continue;
+				}
+
+				if (held[index].exchange(true)) {
+					conflict = true;
+				}
+				held[index] = false;
+				pool.release(index);
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	QVERIFY(!conflict);
+
+	// All of the caches have been returned
+	for (std::size_t i = 0; i < SIZE; ++i) {
+		QVERIFY(pool.acquire() != AudioOutputCachePool::INVALID_INDEX);
+	}
+	QCOMPARE(pool.acquire(), AudioOutputCachePool::INVALID_INDEX);
+}
+
+QTEST_MAIN(TestAudioOutputCachePool)
+#include "TestAudioOutputCachePool.moc"
@@ -0,0 +1,142 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "AudioPlayoutBuffer.h"
+
+namespace {
+constexpr unsigned int FRAME_SIZE = 480;
+constexpr quint64 FRAME_DURATION  = 10000;
+
+AudioPlayoutBuffer::Packet packet(std::uint64_t frame, quint64 arrival) {
+	AudioPlayoutBuffer::Packet result;
+	result.payload   = static_cast< std::size_t >(frame);
+	result.timestamp = frame * FRAME_SIZE;
+	result.span      = FRAME_SIZE;
+	result.arrival   = arrival;
+
+	return result;
+}
+} // namespace
+
+class TestAudioPlayoutBuffer : public QObject {
+	Q_OBJECT
+private slots:
+	void steadyArrivals();
+	void jitterRaisesDelay();
+	void minimumDelay();
+	void rejected();
+	void missing();
+	void drain();
+};
+
+void TestAudioPlayoutBuffer::steadyArrivals() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 1, 0.0f);
+
+	AudioPlayoutBuffer::Packet out;
+	AudioPlayoutBuffer::Operation operation;
+	for (std::uint64_t i = 0; i < 500; ++i) {
+		QVERIFY(buffer.put(packet(i, 1 + i * FRAME_DURATION)));
+
+		QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+		QCOMPARE(out.payload, static_cast< std::size_t >(i));
+		QCOMPARE(operation, AudioPlayoutBuffer::Operation::Normal);
+	}
+
+	QVERIFY(buffer.isPlaying());
+	QCOMPARE(buffer.targetDelay(), 1u);
+	QCOMPARE(buffer.bufferedSamples(), 0u);
+}
+
+void TestAudioPlayoutBuffer::jitterRaisesDelay() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 1, 0.0f);
+
+	// Every other packet is held up by 40 ms
+	for (std::uint64_t i = 0; i < 60; ++i) {
+		buffer.put(packet(i, 1 + i * FRAME_DURATION + (i % 2) * 4 * FRAME_DURATION));
+	}
+
+	QCOMPARE(buffer.targetDelay(), 5u);
+}
+
+void TestAudioPlayoutBuffer::minimumDelay() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 3, 0.0f);
+	QCOMPARE(buffer.targetDelay(), 3u);
+
+	AudioPlayoutBuffer::Packet out;
+	AudioPlayoutBuffer::Operation operation;
+
+	// The playout waits for the buffer to hold the minimum delay
+	QVERIFY(buffer.put(packet(0, 1)));
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Empty);
+	QVERIFY(buffer.put(packet(1, 1 + FRAME_DURATION)));
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Empty);
+	QVERIFY(buffer.put(packet(2, 1 + 2 * FRAME_DURATION)));
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+	QCOMPARE(out.payload, static_cast< std::size_t >(0));
+
+	// The delay of the last transmission is carried over
+	AudioPlayoutBuffer next(FRAME_SIZE, FRAME_DURATION, 1, 4.0f);
+	QCOMPARE(next.targetDelay(), 4u);
+}
+
+void TestAudioPlayoutBuffer::rejected() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 1, 0.0f);
+
+	AudioPlayoutBuffer::Packet out;
+	AudioPlayoutBuffer::Operation operation;
+	QVERIFY(buffer.put(packet(0, 1)));
+	QVERIFY(buffer.put(packet(2, 1 + 2 * FRAME_DURATION)));
+	// Duplicate
+	QVERIFY(!buffer.put(packet(2, 1 + 2 * FRAME_DURATION)));
+
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Missing);
+	// Too late, as its audio has been concealed already
+	QVERIFY(!buffer.put(packet(1, 1 + 3 * FRAME_DURATION)));
+	QCOMPARE(buffer.bufferedSamples(), FRAME_SIZE);
+}
+
+void TestAudioPlayoutBuffer::missing() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 1, 0.0f);
+
+	AudioPlayoutBuffer::Packet out;
+	AudioPlayoutBuffer::Operation operation;
+	QVERIFY(buffer.put(packet(0, 1)));
+	QVERIFY(buffer.put(packet(2, 1 + 2 * FRAME_DURATION)));
+
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+	QCOMPARE(out.payload, static_cast< std::size_t >(0));
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Missing);
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+	QCOMPARE(out.payload, static_cast< std::size_t >(2));
+	// The buffer runs dry, and waits for the next packet rather than skipping it
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Empty);
+	QVERIFY(buffer.put(packet(3, 1 + 5 * FRAME_DURATION)));
+	QCOMPARE(buffer.get(out, operation), AudioPlayoutBuffer::Result::Packet);
+	QCOMPARE(out.payload, static_cast< std::size_t >(3));
+}
+
+void TestAudioPlayoutBuffer::drain() {
+	AudioPlayoutBuffer buffer(FRAME_SIZE, FRAME_DURATION, 1, 0.0f);
+
+	for (std::uint64_t i = 0; i < 3; ++i) {
+		QVERIFY(buffer.put(packet(i, 1 + i * FRAME_DURATION)));
+	}
+
+	AudioPlayoutBuffer::Packet out;
+	unsigned int drained = 0;
+	while (buffer.drain(out)) {
+		++drained;
+	}
+
+	QCOMPARE(drained, 3u);
+	QCOMPARE(buffer.bufferedSamples(), 0u);
+}
+
+QTEST_MAIN(TestAudioPlayoutBuffer)
+#include "TestAudioPlayoutBuffer.moc"
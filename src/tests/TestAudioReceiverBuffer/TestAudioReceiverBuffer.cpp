@@ -11,10 +11,36 @@
 #include <QtTest>
 
 #include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <unordered_set>
+#include <vector>
 
 #include <QDebug>
 
+namespace {
+/// The number of heap allocations that have been made by this process so far
+std::atomic< std::size_t > allocationCount{ 0 };
+} // namespace
+
+void *operator new(std::size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *memory = std::malloc(size > 0 ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
 QDebug &operator<<(QDebug &stream, const ServerUser &user) {
 	return stream.nospace() << "ServerUser{ session: " << user.uiSession
 							<< ", version: " << Version::toString(user.m_version) << ", deaf: " << user.bDeaf
@@ -162,6 +188,36 @@ private slots:
 		QVERIFY(buffer.getReceivers(true).empty());
 	}
 
+	void test_clear() {
+		AudioReceiverBuffer buffer;
+
+		ServerUser &sender = users[0];
+
+		buffer.addReceiver(sender, users[1], Mumble::Protocol::AudioContext::NORMAL, false);
+		buffer.addReceiver(sender, users[2], Mumble::Protocol::AudioContext::WHISPER, false);
+		buffer.addReceiver(sender, contextUser1, Mumble::Protocol::AudioContext::SHOUT, false);
+
+		buffer.clear();
+
+		QVERIFY(buffer.getReceivers(false).empty());
+		QVERIFY(buffer.getReceivers(true).empty());
+
+		// Receivers from before clearing must neither be merged with the new ones nor change their properties
+		buffer.addReceiver(sender, users[2], Mumble::Protocol::AudioContext::LISTEN, false);
+		buffer.addReceiver(sender, users[2], Mumble::Protocol::AudioContext::SHOUT, false);
+		buffer.addReceiver(sender, users[3], Mumble::Protocol::AudioContext::LISTEN, false);
+
+		QCOMPARE(buffer.getReceivers(false).size(), static_cast< std::size_t >(2));
+		for (const AudioReceiver &current : buffer.getReceivers(false)) {
+			if (current.getReceiver().uiSession == users[2].uiSession) {
+				QCOMPARE(current.getContext(), Mumble::Protocol::AudioContext::SHOUT);
+			} else {
+				QCOMPARE(current.getReceiver().uiSession, users[3].uiSession);
+				QCOMPARE(current.getContext(), Mumble::Protocol::AudioContext::LISTEN);
+			}
+		}
+	}
+
 	void test_preprocessBuffer() {
 		AudioReceiverBuffer buffer;
 
@@ -208,35 +264,75 @@ private slots:
 
 		ServerUser &sender = contextUser2;
 
+		// Volume adjustments are grouped into buckets that are maxFactorDiff (for high adjustments) and maxDecibelDiff
+		// (for low adjustments) wide
 		buffer.addReceiver(sender, users[0], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromFactor(1.22f));
+						   VolumeAdjustment::fromFactor(24.2f * AudioReceiverBuffer::maxFactorDiff));
 		buffer.addReceiver(sender, users[1], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromFactor(1.22f + 0.6f * AudioReceiverBuffer::maxFactorDiff));
+						   VolumeAdjustment::fromFactor(24.8f * AudioReceiverBuffer::maxFactorDiff));
 		buffer.addReceiver(sender, users[2], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromFactor(1.22f + 1.1f * AudioReceiverBuffer::maxFactorDiff));
+						   VolumeAdjustment::fromFactor(25.1f * AudioReceiverBuffer::maxFactorDiff));
 		buffer.addReceiver(sender, users[3], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromDBAdjustment(-60));
+						   VolumeAdjustment::fromDBAdjustment(-12 * AudioReceiverBuffer::maxDecibelDiff + 1));
 		buffer.addReceiver(sender, users[4], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromDBAdjustment(-60 + AudioReceiverBuffer::maxDecibelDiff - 1));
+						   VolumeAdjustment::fromDBAdjustment(-11 * AudioReceiverBuffer::maxDecibelDiff - 1));
 		buffer.addReceiver(sender, users[5], Mumble::Protocol::AudioContext::NORMAL, false,
-						   VolumeAdjustment::fromDBAdjustment(-60 + AudioReceiverBuffer::maxDecibelDiff));
+						   VolumeAdjustment::fromDBAdjustment(-11 * AudioReceiverBuffer::maxDecibelDiff + 1));
 
 		buffer.preprocessBuffer();
 
 		std::vector< AudioReceiver > receivers = buffer.getReceivers(false);
 		auto receiverRange = AudioReceiverBuffer::getReceiverRange(receivers.begin(), receivers.end());
 
-		std::array< int, 4 > expectedGroupSizes = { 2, 1, 2, 1 };
+		// Ranges are sorted by descending volume adjustment
+		std::array< int, 4 > expectedGroupSizes = { 1, 2, 1, 2 };
 
 		for (std::size_t i = 0; i < expectedGroupSizes.size(); ++i) {
 			QVERIFY(receiverRange.begin != receiverRange.end);
 			QCOMPARE(std::distance(receiverRange.begin, receiverRange.end), expectedGroupSizes.at(i));
+
+			for (auto it = receiverRange.begin; it != receiverRange.end; ++it) {
+				QVERIFY(std::abs(it->getVolumeAdjustment().factor - receiverRange.begin->getVolumeAdjustment().factor)
+						< AudioReceiverBuffer::maxFactorDiff);
+				QVERIFY(std::abs(VolumeAdjustment::toDBAdjustment(it->getVolumeAdjustment().factor)
+								 - VolumeAdjustment::toDBAdjustment(receiverRange.begin->getVolumeAdjustment().factor))
+						< AudioReceiverBuffer::maxDecibelDiff);
+			}
+
 			receiverRange = AudioReceiverBuffer::getReceiverRange(receiverRange.end, receivers.end());
 		}
 
 		QVERIFY(receiverRange.begin == receiverRange.end);
 	}
 
+	void test_quantizeVolumeAdjustment() {
+		auto quantizedDB = [](float factor) {
+			return VolumeAdjustment::toIntegerDBAdjustment(
+				AudioReceiverBuffer::quantizeVolumeAdjustment(VolumeAdjustment::fromFactor(factor)).factor);
+		};
+
+		QCOMPARE(quantizedDB(1.0f), 0);
+		QCOMPARE(AudioReceiverBuffer::quantizeVolumeAdjustment(VolumeAdjustment::fromFactor(1.0f)),
+				 VolumeAdjustment::fromFactor(1.0f));
+
+		// Adjustments are rounded to the closest step, so that similar ones become the same
+		for (int db = -40; db <= 20; ++db) {
+			const int quantized = quantizedDB(VolumeAdjustment::fromDBAdjustment(db).factor);
+
+			QCOMPARE(quantized % AudioReceiverBuffer::quantizedDecibelStep, 0);
+			QVERIFY(quantized >= AudioReceiverBuffer::minQuantizedDecibels);
+			QVERIFY(quantized <= AudioReceiverBuffer::maxQuantizedDecibels);
+			if (db >= AudioReceiverBuffer::minQuantizedDecibels && db <= AudioReceiverBuffer::maxQuantizedDecibels) {
+				QVERIFY(std::abs(quantized - db) <= AudioReceiverBuffer::quantizedDecibelStep / 2);
+			}
+		}
+		QCOMPARE(AudioReceiverBuffer::quantizeVolumeAdjustment(VolumeAdjustment::fromDBAdjustment(-5)),
+				 AudioReceiverBuffer::quantizeVolumeAdjustment(VolumeAdjustment::fromDBAdjustment(-7)));
+
+		// Silenced receivers stay silenced
+		QCOMPARE(AudioReceiverBuffer::quantizeVolumeAdjustment(VolumeAdjustment::fromFactor(0.0f)).factor, 0.0f);
+	}
+
 
 	void test_encoding() {
 		AudioReceiverBuffer buffer;
@@ -305,6 +401,51 @@ private slots:
 		qDebug() << "Sample receiver list required" << requiredReencodings << "encoding steps";
 	}
 
+	void test_steadyStateAllocations() {
+		// Enough receivers for the radix sort to be used, with different versions, contexts and volume adjustments
+		std::vector< ServerUser > receivers;
+		for (unsigned int i = 0; i < 64; ++i) {
+			receivers.emplace_back(100 + i, i % 3 == 0 ? vOld1 : vNew, false, false, i % 2 == 0 ? "context1" : "");
+		}
+		ServerUser sender(99, vNew, false, false, "context1");
+
+		AudioReceiverBuffer buffer;
+		std::size_t ranges = 0;
+		auto route         = [&]() {
+			buffer.clear();
+			for (std::size_t i = 0; i < receivers.size(); ++i) {
+				const Mumble::Protocol::audio_context_t context = i % 4 == 0 ? Mumble::Protocol::AudioContext::LISTEN
+																			 : Mumble::Protocol::AudioContext::NORMAL;
+				buffer.addReceiver(sender, receivers[i], context, true,
+								   VolumeAdjustment::fromFactor(1.0f + static_cast< float >(i % 5)));
+			}
+			buffer.preprocessBuffer();
+
+			for (bool positional : { true, false }) {
+				std::vector< AudioReceiver > &list = buffer.getReceivers(positional);
+				auto range = AudioReceiverBuffer::getReceiverRange(list.begin(), list.end());
+				while (range.begin != range.end) {
+					ranges++;
+					range = AudioReceiverBuffer::getReceiverRange(range.end, list.end());
+				}
+			}
+		};
+
+		// The first packets make the buffer grow to the size it needs
+		for (int i = 0; i < 3; ++i) {
+			route();
+		}
+
+		const std::size_t before = allocationCount.load();
+		for (int i = 0; i < 1000; ++i) {
+			route();
+		}
+		const std::size_t after = allocationCount.load();
+
+		QVERIFY(ranges > 0);
+		QCOMPARE(after - before, static_cast< std::size_t >(0));
+	}
+
 	void test_emptyRange() {
 		AudioReceiverBuffer buffer;
 
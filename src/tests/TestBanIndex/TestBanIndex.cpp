@@ -0,0 +1,206 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "BanIndex.h"
+
+#include <random>
+
+/// @param mask The prefix length within the 128 bits of IPv6 (or IPv4-mapped) addresses
+static Ban makeBan(const char *address, int mask, const QString &hash = QString()) {
+	Ban ban;
+	ban.haAddress = HostAddress(QHostAddress(QLatin1String(address)));
+	ban.iMask     = mask;
+	ban.qsHash    = hash;
+	ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+	ban.iDuration = 0;
+	return ban;
+}
+
+static HostAddress address(const char *address) {
+	return HostAddress(QHostAddress(QLatin1String(address)));
+}
+
+class TestBanIndex : public QObject {
+	Q_OBJECT
+private slots:
+	void exact();
+	void prefixes();
+	void ipv6();
+	void remove();
+	void duplicates();
+	void hashes();
+	void expiry();
+	void matchesLinearScan();
+};
+
+void TestBanIndex::exact() {
+	BanIndex index;
+	index.insert(makeBan("192.168.1.10", 128));
+
+	QVERIFY(index.matchAddress(address("192.168.1.10")));
+	QVERIFY(!index.matchAddress(address("192.168.1.11")));
+	QCOMPARE(index.size(), static_cast< std::size_t >(1));
+}
+
+void TestBanIndex::prefixes() {
+	BanIndex index;
+	// 10.0.0.0/8, 172.16.0.0/12 and 192.168.16.0/20
+	index.insert(makeBan("10.0.0.0", 96 + 8));
+	index.insert(makeBan("172.16.0.0", 96 + 12));
+	index.insert(makeBan("192.168.16.0", 96 + 20));
+
+	QVERIFY(index.matchAddress(address("10.255.1.2")));
+	QVERIFY(index.matchAddress(address("172.31.255.255")));
+	QVERIFY(!index.matchAddress(address("172.32.0.1")));
+	QVERIFY(index.matchAddress(address("192.168.31.1")));
+	QVERIFY(!index.matchAddress(address("192.168.32.1")));
+	QVERIFY(!index.matchAddress(address("192.168.15.255")));
+	QVERIFY(!index.matchAddress(address("11.0.0.1")));
+}
+
+void TestBanIndex::ipv6() {
+	BanIndex index;
+	index.insert(makeBan("2001:db8::", 32));
+	index.insert(makeBan("2001:db8:1::", 48));
+
+	QVERIFY(index.matchAddress(address("2001:db8:ffff::1")));
+	QVERIFY(!index.matchAddress(address("2001:db9::1")));
+
+	// An IPv6 ban doesn't match IPv4 addresses
+	QVERIFY(!index.matchAddress(address("32.1.13.184")));
+}
+
+void TestBanIndex::remove() {
+	BanIndex index;
+	const Ban wide   = makeBan("10.0.0.0", 96 + 8);
+	const Ban narrow = makeBan("10.1.0.0", 96 + 16);
+	index.insert(wide);
+	index.insert(narrow);
+
+	index.remove(wide);
+	QVERIFY(!index.matchAddress(address("10.2.0.1")));
+	QVERIFY(index.matchAddress(address("10.1.0.1")));
+
+	index.remove(narrow);
+	QVERIFY(!index.matchAddress(address("10.1.0.1")));
+	QCOMPARE(index.size(), static_cast< std::size_t >(0));
+
+	// Removing a ban that isn't indexed does nothing
+	index.remove(makeBan("10.1.0.0", 96 + 24));
+	QCOMPARE(index.size(), static_cast< std::size_t >(0));
+}
+
+void TestBanIndex::duplicates() {
+	BanIndex index;
+	const Ban ban = makeBan("10.0.0.1", 128, QLatin1String("abc"));
+
+	index.rebuild({ ban, ban });
+	QCOMPARE(index.size(), static_cast< std::size_t >(1));
+
+	// A single removal lifts the ban, just like removing it from the ban list (which is treated as a set)
+	index.remove(ban);
+	QVERIFY(!index.matchAddress(address("10.0.0.1")));
+	QVERIFY(!index.matchHash(QLatin1String("abc")));
+}
+
+void TestBanIndex::hashes() {
+	BanIndex index;
+	index.insert(makeBan("10.0.0.1", 128, QLatin1String("abc")));
+
+	const Ban *ban = index.matchHash(QLatin1String("abc"));
+	QVERIFY(ban);
+	QCOMPARE(ban->qsHash, QLatin1String("abc"));
+	QVERIFY(!index.matchHash(QLatin1String("def")));
+	QVERIFY(!index.matchHash(QString()));
+}
+
+void TestBanIndex::expiry() {
+	BanIndex index;
+	index.insert(makeBan("10.0.0.1", 128));
+	QVERIFY(!index.mayHaveExpired());
+
+	Ban temporary       = makeBan("10.0.0.2", 128);
+	temporary.qdtStart  = QDateTime::currentDateTime().toUTC().addSecs(-100);
+	temporary.iDuration = 10;
+	index.insert(temporary);
+	QVERIFY(index.mayHaveExpired());
+
+	index.rebuild({ makeBan("10.0.0.1", 128) });
+	QVERIFY(!index.mayHaveExpired());
+}
+
+void TestBanIndex::matchesLinearScan() {
+	// Compares the index against a naive check of every ban on random bans and addresses
+	std::mt19937 rng(42);
+	QList< Ban > bans;
+	for (int i = 0; i < 2000; ++i) {
+		Q_IPV6ADDR raw;
+		for (int j = 0; j < 16; ++j) {
+			raw[j] = static_cast< quint8 >(rng());
+		}
+		// Keep the addresses close to each other, so that the prefixes overlap
+		raw[0] = 0x20;
+		raw[1] = static_cast< quint8 >(rng() % 4);
+
+		// Shorter prefixes would match every address
+		Ban ban;
+		ban.haAddress = HostAddress(raw);
+		ban.iMask     = 32 + static_cast< int >(rng() % 97);
+		ban.qdtStart  = QDateTime::currentDateTime().toUTC();
+		ban.iDuration = 0;
+		bans << ban;
+	}
+
+	BanIndex index;
+	index.rebuild(bans);
+
+	auto prefixMatches = [](const HostAddress &candidate, const Ban &ban) {
+		const auto &a = candidate.getByteRepresentation();
+		const auto &b = ban.haAddress.getByteRepresentation();
+		for (int i = 0; i < ban.iMask; ++i) {
+			const int shift = 7 - i % 8;
+			if (((a[i / 8] >> shift) & 1) != ((b[i / 8] >> shift) & 1)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	for (int i = 0; i < 5000; ++i) {
+		// Half of the addresses are taken from the bans, with their last bits changed
+		Q_IPV6ADDR raw;
+		if (i % 2 == 0) {
+			const auto &source = bans[static_cast< int >(rng() % 2000)].haAddress.getByteRepresentation();
+			for (int j = 0; j < 16; ++j) {
+				raw[j] = source[j];
+			}
+			raw[15] = static_cast< quint8 >(rng());
+		} else {
+			for (int j = 0; j < 16; ++j) {
+				raw[j] = static_cast< quint8 >(rng());
+			}
+			raw[0] = 0x20;
+			raw[1] = static_cast< quint8 >(rng() % 4);
+		}
+		const HostAddress candidate(raw);
+
+		bool expected = false;
+		for (const Ban &ban : bans) {
+			expected = expected || prefixMatches(candidate, ban);
+		}
+
+		const Ban *match = index.matchAddress(candidate);
+		QCOMPARE(match != nullptr, expected);
+		if (match) {
+			QVERIFY(prefixMatches(candidate, *match));
+		}
+	}
+}
+
+QTEST_MAIN(TestBanIndex)
+#include "TestBanIndex.moc"
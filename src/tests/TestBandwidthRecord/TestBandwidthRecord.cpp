@@ -0,0 +1,135 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "BandwidthRecord.h"
+
+#include <thread>
+#include <vector>
+
+class TestBandwidthRecord : public QObject {
+	Q_OBJECT
+private slots:
+	void invalidLimit();
+	void burst();
+	void sustainedRate();
+	void recovery();
+	void bandwidth();
+	void idleSeconds();
+	void concurrentFrames();
+};
+
+void TestBandwidthRecord::invalidLimit() {
+	BandwidthRecord record;
+	const quint64 now = BandwidthRecord::clock();
+
+	QVERIFY(!record.addFrame(100, 0, now));
+	QVERIFY(!record.addFrame(-1, 1000, now));
+}
+
+void TestBandwidthRecord::burst() {
+	BandwidthRecord record;
+	const quint64 now = BandwidthRecord::clock();
+
+	// At 1000 bytes per second, a burst of up to BURST_MICROSECONDS worth of data is allowed at once
+	int accepted = 0;
+	while (record.addFrame(100, 1000, now)) {
+		++accepted;
+		QVERIFY(accepted < 1000);
+	}
+
+	const int expected = static_cast< int >(BandwidthRecord::BURST_MICROSECONDS / 100000) + 1;
+	QCOMPARE(accepted, expected);
+}
+
+void TestBandwidthRecord::sustainedRate() {
+	BandwidthRecord record;
+	const quint64 start = BandwidthRecord::clock();
+
+	// 100 byte frames every 10 ms are 10000 bytes per second
+	for (quint64 i = 0; i < 1000; ++i) {
+		QVERIFY(record.addFrame(100, 10000, start + i * 10000));
+	}
+
+	// Twice as many frames exceed the limit once the burst tolerance has been used up
+	BandwidthRecord fast;
+	int rejected = 0;
+	for (quint64 i = 0; i < 1000; ++i) {
+		if (!fast.addFrame(100, 10000, start + i * 5000)) {
+			++rejected;
+		}
+	}
+	QVERIFY(rejected > 0);
+	QVERIFY(rejected < 1000);
+}
+
+void TestBandwidthRecord::recovery() {
+	BandwidthRecord record;
+	const quint64 now = BandwidthRecord::clock();
+
+	while (record.addFrame(1000, 1000, now)) {
+	}
+	QVERIFY(!record.addFrame(1000, 1000, now));
+
+	// Rejected frames don't count, so the user may send again once enough time has passed
+	QVERIFY(record.addFrame(1000, 1000, now + 2000000));
+}
+
+void TestBandwidthRecord::bandwidth() {
+	BandwidthRecord record;
+
+	// Too short to tell
+	QCOMPARE(record.bandwidth(), 0);
+
+	QThread::msleep(300);
+	QVERIFY(record.addFrame(5000, 1000000, BandwidthRecord::clock()));
+
+	QVERIFY(record.bandwidth() > 0);
+	// The frame has been sent within at least one complete period
+	QVERIFY(record.bandwidth() <= static_cast< int >(5000 * 1000000ULL / BandwidthRecord::PERIOD_MICROSECONDS));
+}
+
+void TestBandwidthRecord::idleSeconds() {
+	BandwidthRecord record;
+
+	QCOMPARE(record.onlineSeconds(), 0);
+	QCOMPARE(record.idleSeconds(), 0);
+
+	// A frame from the future (relative to the idle time) doesn't make the idle time negative
+	QVERIFY(record.addFrame(100, 1000, BandwidthRecord::clock() + 1000000));
+	QCOMPARE(record.idleSeconds(), 0);
+
+	record.resetIdleSeconds();
+	QCOMPARE(record.idleSeconds(), 0);
+}
+
+void TestBandwidthRecord::concurrentFrames() {
+	BandwidthRecord record;
+	const quint64 now = BandwidthRecord::clock();
+	std::atomic< int > accepted(0);
+
+	std::vector< std::thread > threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&record, &accepted, now]() {
+			for (int i = 0; i < 10000; ++i) {
+				if (record.addFrame(100, 1000, now)) {
+					++accepted;
+				}
+			}
+		});
+	}
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	// No matter how the threads interleave, exactly the burst is accepted
+	QCOMPARE(accepted.load(), static_cast< int >(BandwidthRecord::BURST_MICROSECONDS / 100000) + 1);
+}
+
+QTEST_MAIN(TestBandwidthRecord)
+#include "TestBandwidthRecord.moc"
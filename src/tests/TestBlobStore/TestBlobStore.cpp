@@ -0,0 +1,102 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "BlobStore.h"
+
+static QByteArray hashOf(const QByteArray &blob) {
+	return QCryptographicHash::hash(blob, QCryptographicHash::Sha1);
+}
+
+class TestBlobStore : public QObject {
+	Q_OBJECT
+private slots:
+	void deduplicate();
+	void find();
+	void eviction();
+	void oversized();
+	void emptyBlobs();
+};
+
+void TestBlobStore::deduplicate() {
+	BlobStore store;
+
+	const QByteArray first(1000, 'a');
+	// An identical blob that doesn't share its data with the first one
+	const QByteArray second = QByteArray(1000, 'a');
+
+	const QByteArray stored = store.insert(hashOf(first), first);
+	QVERIFY(stored.constData() == first.constData());
+
+	const QByteArray deduplicated = store.insert(hashOf(second), second);
+	QCOMPARE(deduplicated, second);
+	QVERIFY(deduplicated.constData() == first.constData());
+
+	QCOMPARE(store.count(), static_cast< std::size_t >(1));
+	QCOMPARE(store.bytes(), static_cast< std::size_t >(1000));
+	QCOMPARE(store.hits(), static_cast< quint64 >(1));
+	QCOMPARE(store.misses(), static_cast< quint64 >(1));
+}
+
+void TestBlobStore::find() {
+	BlobStore store;
+
+	const QByteArray blob(500, 'b');
+	QVERIFY(store.find(hashOf(blob)).isNull());
+
+	store.insert(hashOf(blob), blob);
+	QCOMPARE(store.find(hashOf(blob)), blob);
+}
+
+void TestBlobStore::eviction() {
+	BlobStore store(3000);
+
+	QList< QByteArray > blobs;
+	for (char c = 'a'; c < 'e'; ++c) {
+		blobs << QByteArray(1000, c);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		store.insert(hashOf(blobs[i]), blobs[i]);
+	}
+
+	// Using the first blob makes the second one the least recently used
+	QVERIFY(!store.find(hashOf(blobs[0])).isNull());
+	store.insert(hashOf(blobs[3]), blobs[3]);
+
+	QCOMPARE(store.bytes(), static_cast< std::size_t >(3000));
+	QVERIFY(!store.find(hashOf(blobs[0])).isNull());
+	QVERIFY(store.find(hashOf(blobs[1])).isNull());
+	QVERIFY(!store.find(hashOf(blobs[2])).isNull());
+	QVERIFY(!store.find(hashOf(blobs[3])).isNull());
+}
+
+void TestBlobStore::oversized() {
+	BlobStore store(100);
+
+	const QByteArray small(50, 'a');
+	const QByteArray large(1000, 'b');
+
+	store.insert(hashOf(small), small);
+	store.insert(hashOf(large), large);
+
+	// The blob that has been inserted last is kept even if it exceeds the capacity on its own
+	QVERIFY(!store.find(hashOf(large)).isNull());
+	QVERIFY(store.find(hashOf(small)).isNull());
+	QCOMPARE(store.count(), static_cast< std::size_t >(1));
+}
+
+void TestBlobStore::emptyBlobs() {
+	BlobStore store;
+
+	QVERIFY(store.insert(QByteArray(), QByteArray(10, 'a')) == QByteArray(10, 'a'));
+	QVERIFY(store.insert(hashOf(QByteArray()), QByteArray()).isEmpty());
+	QCOMPARE(store.count(), static_cast< std::size_t >(0));
+}
+
+QTEST_MAIN(TestBlobStore)
+#include "TestBlobStore.moc"
@@ -0,0 +1,70 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "Channel.h"
+
+class TestChannel : public QObject {
+	Q_OBJECT
+private slots:
+	void levelAndDepth();
+	void move();
+	void remove();
+};
+
+void TestChannel::levelAndDepth() {
+	Channel root(0, QLatin1String("Root"));
+	Channel *a = new Channel(1, QLatin1String("A"), &root);
+	Channel *b = new Channel(2, QLatin1String("B"), a);
+	Channel *c = new Channel(3, QLatin1String("C"), b);
+	Channel *d = new Channel(4, QLatin1String("D"), &root);
+
+	QCOMPARE(root.getLevel(), static_cast< size_t >(0));
+	QCOMPARE(c->getLevel(), static_cast< size_t >(3));
+	QCOMPARE(d->getLevel(), static_cast< size_t >(1));
+
+	QCOMPARE(root.getDepth(), static_cast< size_t >(3));
+	QCOMPARE(a->getDepth(), static_cast< size_t >(2));
+	QCOMPARE(b->getDepth(), static_cast< size_t >(1));
+	QCOMPARE(c->getDepth(), static_cast< size_t >(0));
+	QCOMPARE(d->getDepth(), static_cast< size_t >(0));
+}
+
+void TestChannel::move() {
+	Channel root(0, QLatin1String("Root"));
+	Channel *a = new Channel(1, QLatin1String("A"), &root);
+	Channel *b = new Channel(2, QLatin1String("B"), a);
+	Channel *c = new Channel(3, QLatin1String("C"), b);
+	Channel *d = new Channel(4, QLatin1String("D"), &root);
+
+	// Moves B (and C along with it) below D
+	a->removeChannel(b);
+	d->addChannel(b);
+
+	QCOMPARE(b->getLevel(), static_cast< size_t >(2));
+	QCOMPARE(c->getLevel(), static_cast< size_t >(3));
+	QCOMPARE(a->getDepth(), static_cast< size_t >(0));
+	QCOMPARE(d->getDepth(), static_cast< size_t >(2));
+	QCOMPARE(root.getDepth(), static_cast< size_t >(3));
+}
+
+void TestChannel::remove() {
+	Channel root(0, QLatin1String("Root"));
+	Channel *a = new Channel(1, QLatin1String("A"), &root);
+	Channel *b = new Channel(2, QLatin1String("B"), a);
+	new Channel(3, QLatin1String("C"), &root);
+
+	delete b;
+	QCOMPARE(a->getDepth(), static_cast< size_t >(0));
+	QCOMPARE(root.getDepth(), static_cast< size_t >(1));
+
+	delete a;
+	QCOMPARE(root.getDepth(), static_cast< size_t >(1));
+}
+
+QTEST_MAIN(TestChannel)
+#include "TestChannel.moc"
@@ -0,0 +1,138 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ChannelListenerManager.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using ListenerList = std::shared_ptr< const ChannelListenerManager::ChannelListeners >;
+
+class TestChannelListenerManager : public QObject {
+	Q_OBJECT
+private slots:
+	void entries();
+	void volumeAdjustments();
+	void snapshotsDontChange();
+	void clear();
+	void concurrentReaders();
+};
+
+void TestChannelListenerManager::entries() {
+	ChannelListenerManager manager;
+	QVERIFY(manager.getListenerEntries(1)->empty());
+
+	manager.addListener(7, 1);
+	manager.addListener(3, 1);
+	manager.addListener(5, 2);
+
+	ListenerList listeners = manager.getListenerEntries(1);
+	QCOMPARE(listeners->size(), static_cast< std::size_t >(2));
+	// The listeners are sorted by session
+	QCOMPARE(listeners->at(0).userSession, 3U);
+	QCOMPARE(listeners->at(1).userSession, 7U);
+	QCOMPARE(listeners->at(0).volumeAdjustment.factor, 1.0f);
+
+	manager.removeListener(7, 1);
+	listeners = manager.getListenerEntries(1);
+	QCOMPARE(listeners->size(), static_cast< std::size_t >(1));
+	QCOMPARE(listeners->at(0).userSession, 3U);
+
+	manager.removeListener(5, 2);
+	QVERIFY(manager.getListenerEntries(2)->empty());
+
+	// The locking API sees the same state
+	QCOMPARE(manager.getListenersForChannel(1), QSet< unsigned int >({ 3 }));
+}
+
+void TestChannelListenerManager::volumeAdjustments() {
+	ChannelListenerManager manager;
+	manager.addListener(3, 1);
+	manager.setListenerVolumeAdjustment(3, 1, VolumeAdjustment::fromFactor(0.5f));
+
+	ListenerList listeners = manager.getListenerEntries(1);
+	QCOMPARE(listeners->size(), static_cast< std::size_t >(1));
+	QCOMPARE(listeners->at(0).volumeAdjustment.factor, 0.5f);
+
+	// Adjustments of users that don't listen (yet) don't add listeners
+	manager.setListenerVolumeAdjustment(4, 1, VolumeAdjustment::fromFactor(2.0f));
+	QCOMPARE(manager.getListenerEntries(1)->size(), static_cast< std::size_t >(1));
+
+	manager.addListener(4, 1);
+	listeners = manager.getListenerEntries(1);
+	QCOMPARE(listeners->size(), static_cast< std::size_t >(2));
+	QCOMPARE(listeners->at(1).userSession, 4U);
+	QCOMPARE(listeners->at(1).volumeAdjustment.factor, 2.0f);
+}
+
+void TestChannelListenerManager::snapshotsDontChange() {
+	ChannelListenerManager manager;
+	manager.addListener(3, 1);
+
+	const ListenerList before = manager.getListenerEntries(1);
+	manager.addListener(4, 1);
+	manager.setListenerVolumeAdjustment(3, 1, VolumeAdjustment::fromFactor(0.5f));
+
+	QCOMPARE(before->size(), static_cast< std::size_t >(1));
+	QCOMPARE(before->at(0).volumeAdjustment.factor, 1.0f);
+	QCOMPARE(manager.getListenerEntries(1)->size(), static_cast< std::size_t >(2));
+}
+
+void TestChannelListenerManager::clear() {
+	ChannelListenerManager manager;
+	manager.addListener(3, 1);
+	manager.addListener(3, 2);
+
+	manager.clear();
+
+	QVERIFY(manager.getListenerEntries(1)->empty());
+	QVERIFY(manager.getListenerEntries(2)->empty());
+}
+
+void TestChannelListenerManager::concurrentReaders() {
+	constexpr unsigned int CHANNELS = 8;
+	constexpr unsigned int SESSIONS = 64;
+
+	ChannelListenerManager manager;
+	std::atomic< bool > done(false);
+	std::atomic< bool > consistent(true);
+
+	std::thread reader([&]() {
+		while (!done.load()) {
+			for (unsigned int channel = 0; channel < CHANNELS; ++channel) {
+				const ListenerList listeners = manager.getListenerEntries(channel);
+				for (std::size_t i = 1; i < listeners->size(); ++i) {
+					if (listeners->at(i - 1).userSession >= listeners->at(i).userSession) {
+						consistent.store(false);
+					}
+				}
+			}
+		}
+	});
+
+	for (unsigned int round = 0; round < 20; ++round) {
+		for (unsigned int session = 0; session < SESSIONS; ++session) {
+			manager.addListener(session, session % CHANNELS);
+		}
+		for (unsigned int session = 0; session < SESSIONS; ++session) {
+			manager.removeListener(session, session % CHANNELS);
+		}
+	}
+
+	done.store(true);
+	reader.join();
+
+	QVERIFY(consistent.load());
+	for (unsigned int channel = 0; channel < CHANNELS; ++channel) {
+		QVERIFY(manager.getListenerEntries(channel)->empty());
+	}
+}
+
+QTEST_MAIN(TestChannelListenerManager)
+#include "TestChannelListenerManager.moc"
@@ -0,0 +1,170 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ChannelRecorder.h"
+
+#include <array>
+#include <vector>
+
+namespace {
+struct Page {
+	char type       = 0;
+	quint64 granule = 0;
+	QList< QByteArray > packets;
+};
+
+/// Splits the stream into its pages and those into their packets (none of which span pages)
+QList< Page > parse(const QByteArray &data) {
+	QList< Page > pages;
+
+	int pos = 0;
+	while (pos < data.size()) {
+		if (data.size() - pos < 27 || data.mid(pos, 4) != "OggS") {
+			return {};
+		}
+
+		Page page;
+		page.type    = data[pos + 5];
+		page.granule = qFromLittleEndian< quint64 >(data.constData() + pos + 6);
+
+		const int segments = static_cast< unsigned char >(data[pos + 26]);
+		int offset         = pos + 27 + segments;
+		int size           = 0;
+		for (int i = 0; i < segments; ++i) {
+			const int lacing = static_cast< unsigned char >(data[pos + 27 + i]);
+			size += lacing;
+			if (lacing < 255) {
+				page.packets.append(data.mid(offset, size));
+				offset += size;
+				size = 0;
+			}
+		}
+
+		pages.append(page);
+		pos = offset;
+	}
+
+	return pages;
+}
+
+std::array< Mumble::Protocol::byte, 4 > frame(Mumble::Protocol::byte toc) {
+	return { toc, 0x11, 0x22, 0x33 };
+}
+} // namespace
+
+class TestChannelRecorder : public QObject {
+	Q_OBJECT
+private slots:
+	void packetSamples();
+	void record();
+};
+
+void TestChannelRecorder::packetSamples() {
+	using Bytes = std::vector< Mumble::Protocol::byte >;
+	auto samples = [](const Bytes &packet) { return ChannelRecorder::packetSamples(packet); };
+
+	// CELT fullband, 20 ms (config 31) and 10 ms (config 30)
+	QCOMPARE(samples({ 31 << 3 }), 960u);
+	QCOMPARE(samples({ 30 << 3 }), 480u);
+	// SILK wideband, 60 ms (config 11)
+	QCOMPARE(samples({ 11 << 3 }), 2880u);
+	// Hybrid fullband, 10 ms (config 14)
+	QCOMPARE(samples({ 14 << 3 }), 480u);
+	// The stereo flag doesn't matter, two frames (code 1 and 2)
+	QCOMPARE(samples({ (31 << 3) | 0x04 | 1 }), 1920u);
+	QCOMPARE(samples({ (31 << 3) | 2, 1 }), 1920u);
+	// Code 3 counts the frames in the second byte
+	QCOMPARE(samples({ (31 << 3) | 3, 6 }), 5760u);
+	QCOMPARE(samples({ (31 << 3) | 3 }), 0u);
+	// More than 120 ms
+	QCOMPARE(samples({ (31 << 3) | 3, 7 }), 0u);
+	QCOMPARE(samples({}), 0u);
+}
+
+void TestChannelRecorder::record() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	const auto speech = frame(31 << 3);
+	{
+		ChannelRecorder recorder(dir.path(), { 7, 5, 7 });
+		QVERIFY(recorder.isRecorded(5));
+		QVERIFY(recorder.isRecorded(7));
+		QVERIFY(!recorder.isRecorded(6));
+
+		recorder.setName(1, QLatin1String("alice/bob"));
+
+		const quint64 start = 1000000000;
+		// Two frames in a row, followed by a pause of a second
+		recorder.record(5, 1, speech, start);
+		recorder.record(5, 1, speech, start + 20000);
+		recorder.record(5, 1, speech, start + 1040000);
+		// Another speaker starting later, in stereo
+		recorder.record(5, 2, frame((31 << 3) | 0x04), start + 500000);
+		// Nothing to record
+		recorder.record(5, 1, {}, start + 1060000);
+
+		QCOMPARE(recorder.droppedFrames(), static_cast< std::uint64_t >(0));
+	}
+
+	const QStringList recordings = QDir(dir.path()).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+	QCOMPARE(recordings.size(), 1);
+	QVERIFY(recordings[0].startsWith(QLatin1String("channel5-")));
+
+	QDir recording(dir.path());
+	QVERIFY(recording.cd(recordings[0]));
+	QCOMPARE(recording.entryList(QDir::Files, QDir::Name),
+			 QStringList({ QLatin1String("1-alice_bob.opus"), QLatin1String("2-.opus") }));
+
+	QFile file(recording.filePath(QLatin1String("1-alice_bob.opus")));
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	const QList< Page > pages = parse(file.readAll());
+	QVERIFY(pages.size() >= 3);
+
+	QCOMPARE(pages[0].type, static_cast< char >(0x02));
+	QCOMPARE(pages[0].packets.size(), 1);
+	QVERIFY(pages[0].packets[0].startsWith("OpusHead"));
+	QCOMPARE(static_cast< int >(pages[0].packets[0][9]), 1);
+	const quint64 preSkip = qFromLittleEndian< quint16 >(pages[0].packets[0].constData() + 10);
+
+	QCOMPARE(pages[1].packets.size(), 1);
+	QVERIFY(pages[1].packets[0].startsWith("OpusTags"));
+	QVERIFY(pages[1].packets[0].contains("TITLE=alice/bob"));
+	QVERIFY(pages[1].packets[0].contains("DATE="));
+
+	QList< QByteArray > packets;
+	for (int i = 2; i < pages.size(); ++i) {
+		packets.append(pages[i].packets);
+	}
+	QCOMPARE(pages.last().type, static_cast< char >(0x04));
+
+	// The frames are stored as they are, the pause of a second (but no jitter) being filled with silence
+	const QByteArray spoken(reinterpret_cast< const char * >(speech.data()), static_cast< int >(speech.size()));
+	QCOMPARE(packets.first(), spoken);
+	QCOMPARE(packets[1], spoken);
+	QCOMPARE(packets.last(), spoken);
+	unsigned int samples = 0;
+	for (const QByteArray &packet : packets) {
+		samples += ChannelRecorder::packetSamples(gsl::span< const Mumble::Protocol::byte >(
+			reinterpret_cast< const Mumble::Protocol::byte * >(packet.constData()),
+			static_cast< std::size_t >(packet.size())));
+	}
+	QCOMPARE(samples, 1040u * 48 + 960);
+	QCOMPARE(pages.last().granule, samples + preSkip);
+
+	// The later speaker's track starts with the silence before the first frame
+	QFile stereo(recording.filePath(QLatin1String("2-.opus")));
+	QVERIFY(stereo.open(QIODevice::ReadOnly));
+	const QList< Page > stereoPages = parse(stereo.readAll());
+	QVERIFY(stereoPages.size() >= 3);
+	QCOMPARE(static_cast< int >(stereoPages[0].packets[0][9]), 2);
+	QCOMPARE(stereoPages.last().granule, 500u * 48 + 960 + preSkip);
+}
+
+QTEST_MAIN(TestChannelRecorder)
+#include "TestChannelRecorder.moc"
@@ -0,0 +1,275 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ClusterProtocol.h"
+#include "PacketDataStream.h"
+
+#include <array>
+#include <cstring>
+
+class TestClusterProtocol : public QObject {
+	Q_OBJECT
+private slots:
+	void userState();
+	void voice();
+	void invalidHeader();
+	void batch();
+	void sealing();
+	void replayWindow();
+	void restart();
+};
+
+void TestClusterProtocol::userState() {
+	std::array< unsigned char, ClusterProtocol::MAX_DATAGRAM_SIZE > buffer;
+
+	ClusterProtocol::UserState state;
+	state.session = 3 * ClusterProtocol::MAX_NODES + 5;
+	state.channel = 42;
+	state.userId  = -1;
+	state.name    = QString::fromUtf8("Zoë");
+	state.flags   = ClusterProtocol::UserState::SelfMute | ClusterProtocol::UserState::Recording;
+
+	PacketDataStream out(buffer.data(), static_cast< unsigned int >(buffer.size()));
+	ClusterProtocol::write(out, ClusterProtocol::Header{ ClusterProtocol::MessageType::UserState, 5, 2 });
+	ClusterProtocol::write(out, state);
+	QVERIFY(out.isValid());
+
+	PacketDataStream in(buffer.data(), out.size());
+	ClusterProtocol::Header header;
+	QVERIFY(ClusterProtocol::read(in, header));
+	QCOMPARE(header.type, ClusterProtocol::MessageType::UserState);
+	QCOMPARE(header.node, 5U);
+	QCOMPARE(header.server, 2U);
+
+	ClusterProtocol::UserState decoded;
+	QVERIFY(ClusterProtocol::read(in, decoded));
+	QCOMPARE(decoded.session, state.session);
+	QCOMPARE(decoded.channel, state.channel);
+	QCOMPARE(decoded.userId, state.userId);
+	QCOMPARE(decoded.name, state.name);
+	QCOMPARE(decoded.flags, state.flags);
+	QCOMPARE(ClusterProtocol::sessionNode(decoded.session), 5U);
+}
+
+void TestClusterProtocol::voice() {
+	std::array< unsigned char, ClusterProtocol::MAX_DATAGRAM_SIZE > buffer;
+	const std::array< Mumble::Protocol::byte, 5 > payload = { 1, 2, 3, 4, 5 };
+
+	ClusterProtocol::Voice voice;
+	voice.session      = 17;
+	voice.frameNumber  = 123456789;
+	voice.isLastFrame  = true;
+	voice.payload      = payload;
+	voice.channels[0]  = 0;
+	voice.channels[1]  = 8;
+	voice.channelCount = 2;
+
+	PacketDataStream out(buffer.data(), static_cast< unsigned int >(buffer.size()));
+	ClusterProtocol::write(out, voice);
+	QVERIFY(out.isValid());
+
+	PacketDataStream in(buffer.data(), out.size());
+	ClusterProtocol::Voice decoded;
+	QVERIFY(ClusterProtocol::read(in, decoded));
+	QCOMPARE(decoded.session, voice.session);
+	QCOMPARE(decoded.codec, Mumble::Protocol::AudioCodec::Opus);
+	QCOMPARE(decoded.frameNumber, voice.frameNumber);
+	QCOMPARE(decoded.isLastFrame, true);
+	QCOMPARE(decoded.channelCount, static_cast< std::size_t >(2));
+	QCOMPARE(decoded.channels[1], 8U);
+	QCOMPARE(static_cast< std::size_t >(decoded.payload.size()), payload.size());
+	QVERIFY(std::equal(payload.begin(), payload.end(), decoded.payload.begin()));
+
+	// A truncated frame is rejected instead of pointing past the datagram
+	PacketDataStream truncated(buffer.data(), out.size() - 1);
+	QVERIFY(!ClusterProtocol::read(truncated, decoded));
+}
+
+void TestClusterProtocol::invalidHeader() {
+	std::array< unsigned char, 16 > buffer;
+	ClusterProtocol::Header header;
+
+	// Node IDs have to be in the range [1, MAX_NODES)
+	PacketDataStream out(buffer.data(), static_cast< unsigned int >(buffer.size()));
+	ClusterProtocol::write(out, ClusterProtocol::Header{ ClusterProtocol::MessageType::Hello, 0, 1 });
+	PacketDataStream in(buffer.data(), out.size());
+	QVERIFY(!ClusterProtocol::read(in, header));
+
+	// Datagrams of other versions are ignored
+	PacketDataStream other(buffer.data(), static_cast< unsigned int >(buffer.size()));
+	other << ClusterProtocol::VERSION + 1 << 1U << 1U << 1U;
+	PacketDataStream otherIn(buffer.data(), other.size());
+	QVERIFY(!ClusterProtocol::read(otherIn, header));
+}
+
+void TestClusterProtocol::batch() {
+	const std::array< Mumble::Protocol::byte, 100 > payload = {};
+	const ClusterProtocol::Header header{ ClusterProtocol::MessageType::Voice, 3, 1 };
+
+	ClusterProtocol::Voice voice;
+	voice.payload      = payload;
+	voice.channelCount = 1;
+
+	ClusterProtocol::VoiceBatch batch;
+	QVERIFY(batch.empty());
+	for (unsigned int session = 1; session <= 3; ++session) {
+		voice.session = session;
+		QVERIFY(ClusterProtocol::append(batch, header, voice));
+	}
+
+	// The header is only written once, followed by all frames
+	PacketDataStream in(batch.datagram.data(), static_cast< unsigned int >(batch.length));
+	ClusterProtocol::Header decodedHeader;
+	QVERIFY(ClusterProtocol::read(in, decodedHeader));
+	QCOMPARE(decodedHeader.node, 3U);
+
+	unsigned int frames = 0;
+	ClusterProtocol::Voice decoded;
+	while (in.left() > 0 && ClusterProtocol::read(in, decoded)) {
+		QCOMPARE(decoded.session, ++frames);
+	}
+	QCOMPARE(frames, 3U);
+
+	// Frames that don't fit anymore leave the batch as it is (and there is always room for sealing it)
+	while (ClusterProtocol::append(batch, header, voice)) {
+	}
+	const std::size_t length = batch.length;
+	QVERIFY(length + ClusterProtocol::OVERHEAD <= batch.datagram.size());
+	QVERIFY(!ClusterProtocol::append(batch, header, voice));
+	QCOMPARE(batch.length, length);
+
+	batch.clear();
+	QVERIFY(batch.empty());
+}
+
+void TestClusterProtocol::sealing() {
+	using Buffer = std::array< unsigned char, 128 >;
+
+	ClusterProtocol::Cipher cipher(QByteArray("secret"), 1, 1, 7);
+	Buffer buffer;
+	for (std::size_t i = 0; i < 32; ++i) {
+		buffer[i] = static_cast< unsigned char >(i);
+	}
+
+	const std::size_t sealed = cipher.seal(buffer.data(), 32, buffer.size());
+	QCOMPARE(sealed, 32 + ClusterProtocol::OVERHEAD);
+	QVERIFY(buffer[1] != 1 || buffer[2] != 2 || buffer[3] != 3);
+
+	// Other secrets, tampered data or key IDs and truncated datagrams are all refused
+	Buffer copy = buffer;
+	QCOMPARE(ClusterProtocol::Cipher(QByteArray("other"), 2, 1, 8).open(copy.data(), sealed),
+			 static_cast< std::size_t >(0));
+	copy = buffer;
+	copy[3] ^= 1;
+	QCOMPARE(cipher.open(copy.data(), sealed), static_cast< std::size_t >(0));
+	copy = buffer;
+	// The node of the key ID, which would make it the key of another sender
+	copy[32 + 3] ^= 1;
+	QCOMPARE(cipher.open(copy.data(), sealed), static_cast< std::size_t >(0));
+	copy = buffer;
+	QCOMPARE(cipher.open(copy.data(), sealed - 1), static_cast< std::size_t >(0));
+	QCOMPARE(cipher.open(copy.data(), ClusterProtocol::OVERHEAD), static_cast< std::size_t >(0));
+
+	// Other nodes open it with their own cipher for the same secret, which tells them who has sealed it
+	ClusterProtocol::Nonce nonce;
+	nonce.counter = 42;
+	QCOMPARE(ClusterProtocol::Cipher(QByteArray("secret"), 2, 1, 8).open(buffer.data(), sealed, &nonce),
+			 static_cast< std::size_t >(32));
+	QCOMPARE(nonce.salt, static_cast< std::uint64_t >(7));
+	QCOMPARE(nonce.counter, static_cast< std::uint64_t >(0));
+	QCOMPARE(nonce.node, 1u);
+	QCOMPARE(nonce.server, 1u);
+	for (std::size_t i = 0; i < 32; ++i) {
+		QCOMPARE(buffer[i], static_cast< unsigned char >(i));
+	}
+
+	// Senders that happen to use the same salt and counter still seal with different keys
+	Buffer first  = {};
+	Buffer second = {};
+	QCOMPARE(ClusterProtocol::Cipher(QByteArray("secret"), 1, 1, 7).seal(first.data(), 32, first.size()), sealed);
+	QCOMPARE(ClusterProtocol::Cipher(QByteArray("secret"), 2, 1, 7).seal(second.data(), 32, second.size()), sealed);
+	QVERIFY(memcmp(first.data(), second.data(), 32) != 0);
+	QVERIFY(memcmp(first.data() + 32 + ClusterProtocol::KEY_ID_SIZE + ClusterProtocol::COUNTER_SIZE,
+				   second.data() + 32 + ClusterProtocol::KEY_ID_SIZE + ClusterProtocol::COUNTER_SIZE,
+				   ClusterProtocol::TAG_SIZE)
+			!= 0);
+
+	// There has to be room for the key ID, the counter and the tag
+	QCOMPARE(cipher.seal(buffer.data(), buffer.size() - ClusterProtocol::OVERHEAD + 1, buffer.size()),
+			 static_cast< std::size_t >(0));
+}
+
+void TestClusterProtocol::replayWindow() {
+	ClusterProtocol::ReplayWindow window;
+	QVERIFY(window.start(7, 1));
+
+	auto accept = [&window](std::uint64_t counter) { return window.accept(ClusterProtocol::Nonce{ 7, counter }); };
+
+	QVERIFY(accept(10));
+	QVERIFY(!accept(10));
+	// Datagrams sealed by several threads may arrive out of order
+	QVERIFY(accept(12));
+	QVERIFY(accept(11));
+	QVERIFY(accept(5));
+	QVERIFY(!accept(11));
+	QVERIFY(!accept(5));
+
+	QVERIFY(accept(10 + ClusterProtocol::REPLAY_WINDOW));
+	// 10 has dropped out of the window, whereas 11 is the oldest one still in it
+	QVERIFY(!accept(9));
+	QVERIFY(!accept(10));
+	QVERIFY(!accept(11));
+	QVERIFY(accept(13));
+	QVERIFY(!accept(13));
+
+	// A jump that is larger than the window forgets all of it
+	QVERIFY(accept(100 * ClusterProtocol::REPLAY_WINDOW));
+	QVERIFY(!accept(100 * ClusterProtocol::REPLAY_WINDOW));
+	QVERIFY(accept(100 * ClusterProtocol::REPLAY_WINDOW - 1));
+	QVERIFY(!accept(99 * ClusterProtocol::REPLAY_WINDOW));
+
+	// Further Hellos of the same run don't change anything
+	QVERIFY(window.start(7, 1));
+	QVERIFY(!accept(100 * ClusterProtocol::REPLAY_WINDOW - 1));
+
+	// Datagrams of any other salt are only accepted once a Hello has started their run
+	QVERIFY(!window.accept(ClusterProtocol::Nonce{ 8, 0 }));
+}
+
+void TestClusterProtocol::restart() {
+	ClusterProtocol::ReplayWindow window;
+
+	// Before the first Hello, the datagrams of the first salt that shows up are accepted
+	QVERIFY(window.accept(ClusterProtocol::Nonce{ 1, 3 }));
+	QVERIFY(!window.accept(ClusterProtocol::Nonce{ 1, 3 }));
+	QVERIFY(window.start(1, 100));
+	QVERIFY(window.accept(ClusterProtocol::Nonce{ 1, 4 }));
+	QVERIFY(!window.accept(ClusterProtocol::Nonce{ 1, 3 }));
+
+	// The peer restarts, which starts its counter over
+	QVERIFY(window.start(2, 200));
+	QVERIFY(window.accept(ClusterProtocol::Nonce{ 2, 0 }));
+	QVERIFY(window.accept(ClusterProtocol::Nonce{ 2, 3 }));
+	QVERIFY(!window.accept(ClusterProtocol::Nonce{ 2, 3 }));
+
+	// Neither the datagrams nor the Hellos of the previous run are accepted anymore
+	QVERIFY(!window.accept(ClusterProtocol::Nonce{ 1, 5 }));
+	QVERIFY(!window.start(1, 100));
+	QVERIFY(window.accept(ClusterProtocol::Nonce{ 2, 4 }));
+
+	// The oldest runs are forgotten eventually
+	for (std::uint32_t salt = 3; salt < 3 + ClusterProtocol::RETIRED_RUNS; ++salt) {
+		QVERIFY(window.start(salt, salt * 100));
+		QVERIFY(window.accept(ClusterProtocol::Nonce{ salt, 0 }));
+	}
+	QVERIFY(window.start(1, 100));
+	QVERIFY(!window.start(3, 300));
+}
+
+QTEST_MAIN(TestClusterProtocol)
+#include "TestClusterProtocol.moc"
@@ -0,0 +1,100 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "CodecVotes.h"
+
+/// The CELT 0.7.0 bitstream, which is negative as a qint32
+static const int CELT_0_7_0  = static_cast< qint32 >(0x8000000b);
+static const int CELT_0_11_0 = static_cast< qint32 >(0x80000010);
+
+class TestCodecVotes : public QObject {
+	Q_OBJECT
+private slots:
+	void empty();
+	void opus();
+	void preferred();
+	void tie();
+	void remove();
+	void replace();
+};
+
+void TestCodecVotes::empty() {
+	CodecVotes votes;
+
+	QCOMPARE(votes.voters(), 0);
+	QCOMPARE(votes.opusPercentage(), 0);
+	QCOMPARE(votes.preferredCeltVersion(), 0);
+
+	// A user without any codec doesn't vote
+	votes.add(1, QList< int >(), false);
+	QCOMPARE(votes.voters(), 0);
+}
+
+void TestCodecVotes::opus() {
+	CodecVotes votes;
+	votes.add(1, QList< int >() << CELT_0_7_0, true);
+	votes.add(2, QList< int >() << CELT_0_7_0, true);
+	votes.add(3, QList< int >() << CELT_0_7_0, false);
+
+	QCOMPARE(votes.voters(), 3);
+	QCOMPARE(votes.opusPercentage(), 66);
+
+	// Supporting Opus alone is enough to vote
+	votes.add(4, QList< int >(), true);
+	QCOMPARE(votes.voters(), 4);
+	QCOMPARE(votes.opusPercentage(), 75);
+}
+
+void TestCodecVotes::preferred() {
+	CodecVotes votes;
+	votes.add(1, QList< int >() << CELT_0_7_0 << CELT_0_11_0, true);
+	votes.add(2, QList< int >() << CELT_0_7_0, true);
+
+	QCOMPARE(votes.preferredCeltVersion(), CELT_0_7_0);
+}
+
+void TestCodecVotes::tie() {
+	CodecVotes votes;
+	votes.add(1, QList< int >() << CELT_0_7_0 << CELT_0_11_0, true);
+
+	// The versions are compared as signed integers, just like the server always did
+	QCOMPARE(votes.preferredCeltVersion(), qMax(CELT_0_7_0, CELT_0_11_0));
+}
+
+void TestCodecVotes::remove() {
+	CodecVotes votes;
+	votes.add(1, QList< int >() << CELT_0_7_0, false);
+	votes.add(2, QList< int >() << CELT_0_11_0, true);
+	votes.add(3, QList< int >() << CELT_0_11_0, true);
+
+	QCOMPARE(votes.preferredCeltVersion(), CELT_0_11_0);
+
+	QVERIFY(votes.remove(2));
+	QVERIFY(votes.remove(3));
+	QVERIFY(!votes.remove(3));
+
+	QCOMPARE(votes.voters(), 1);
+	QCOMPARE(votes.opusPercentage(), 0);
+	QCOMPARE(votes.preferredCeltVersion(), CELT_0_7_0);
+
+	QVERIFY(votes.remove(1));
+	QCOMPARE(votes.preferredCeltVersion(), 0);
+}
+
+void TestCodecVotes::replace() {
+	CodecVotes votes;
+	votes.add(1, QList< int >() << CELT_0_7_0, false);
+	votes.add(1, QList< int >() << CELT_0_11_0, true);
+
+	QCOMPARE(votes.voters(), 1);
+	QCOMPARE(votes.opusPercentage(), 100);
+	QCOMPARE(votes.preferredCeltVersion(), CELT_0_11_0);
+}
+
+QTEST_MAIN(TestCodecVotes)
+#include "TestCodecVotes.moc"
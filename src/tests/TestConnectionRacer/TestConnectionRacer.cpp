@@ -0,0 +1,67 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtNetwork>
+#include <QtTest>
+
+#include "ConnectionRacer.h"
+
+class TestConnectionRacer : public QObject {
+	Q_OBJECT
+private slots:
+	void interleave();
+	void race();
+	void allFailed();
+};
+
+static ServerAddress addressOf(const char *host, unsigned short port) {
+	return ServerAddress(HostAddress(QHostAddress(QLatin1String(host))), port);
+}
+
+/// @returns A port on the loopback interface nothing listens on
+static unsigned short closedPort() {
+	QTcpServer server;
+	server.listen(QHostAddress::LocalHost);
+	return server.serverPort();
+}
+
+void TestConnectionRacer::interleave() {
+	const QList< ServerAddress > addresses = { addressOf("10.0.0.1", 1), addressOf("10.0.0.2", 1),
+											   addressOf("10.0.0.3", 1), addressOf("::1", 1), addressOf("::2", 1) };
+
+	const QList< ServerAddress > expected = { addressOf("::1", 1), addressOf("10.0.0.1", 1), addressOf("::2", 1),
+											  addressOf("10.0.0.2", 1), addressOf("10.0.0.3", 1) };
+
+	QCOMPARE(ConnectionRacer::interleave(addresses), expected);
+}
+
+void TestConnectionRacer::race() {
+	QTcpServer server;
+	QVERIFY(server.listen(QHostAddress::LocalHost));
+
+	const ServerAddress open = addressOf("127.0.0.1", server.serverPort());
+
+	ConnectionRacer racer;
+	QSignalSpy spy(&racer, &ConnectionRacer::finished);
+	// The refused connection doesn't hold up the next attempt
+	racer.race({ addressOf("127.0.0.1", closedPort()), open }, 5000);
+
+	QVERIFY(spy.wait(ConnectionRacer::ATTEMPT_DELAY * 4));
+	QCOMPARE(racer.winner(), open);
+}
+
+void TestConnectionRacer::allFailed() {
+	ConnectionRacer racer;
+	QSignalSpy spy(&racer, &ConnectionRacer::finished);
+	racer.race({ addressOf("127.0.0.1", closedPort()) }, 5000);
+
+	QVERIFY(spy.wait(5000));
+	QCOMPARE(spy.count(), 1);
+	QVERIFY(!racer.winner().isValid());
+}
+
+QTEST_MAIN(TestConnectionRacer)
+#include "TestConnectionRacer.moc"
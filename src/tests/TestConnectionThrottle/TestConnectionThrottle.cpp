@@ -0,0 +1,136 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ConnectionThrottle.h"
+
+using Verdict = ConnectionThrottle::Verdict;
+
+constexpr unsigned int TRIES = 10;
+constexpr quint64 TIMEFRAME  = 120ULL * 1000 * 1000;
+constexpr quint64 BAN_TIME   = 300ULL * 1000 * 1000;
+constexpr quint64 ONE_SECOND = 1000ULL * 1000;
+
+/// A throttle whose clock only advances when it is told to
+class ManualClockThrottle : public ConnectionThrottle {
+public:
+	using ConnectionThrottle::ConnectionThrottle;
+
+	quint64 time = 1000;
+
+	Verdict attempt(const HostAddress &address) {
+		return ConnectionThrottle::attempt(address, TRIES, TIMEFRAME, BAN_TIME);
+	}
+
+protected:
+	quint64 now() const override { return time; }
+};
+
+static HostAddress address(quint32 ipv4) {
+	HostAddress address;
+	address.fromIPv4(ipv4);
+	return address;
+}
+
+class TestConnectionThrottle : public QObject {
+	Q_OBJECT
+private slots:
+	void burst();
+	void banExpires();
+	void slidingWindow();
+	void forgive();
+	void boundedMemory();
+};
+
+void TestConnectionThrottle::burst() {
+	ManualClockThrottle throttle;
+
+	for (unsigned int i = 0; i < TRIES; ++i) {
+		QCOMPARE(throttle.attempt(address(1)), Verdict::Allowed);
+	}
+	QCOMPARE(throttle.attempt(address(1)), Verdict::NewlyBanned);
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Banned);
+
+	// Other addresses aren't affected
+	QCOMPARE(throttle.attempt(address(2)), Verdict::Allowed);
+}
+
+void TestConnectionThrottle::banExpires() {
+	ManualClockThrottle throttle;
+
+	for (unsigned int i = 0; i <= TRIES; ++i) {
+		throttle.attempt(address(1));
+	}
+
+	throttle.time += BAN_TIME - 1;
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Banned);
+
+	throttle.time += 1;
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Allowed);
+}
+
+void TestConnectionThrottle::slidingWindow() {
+	ManualClockThrottle throttle;
+
+	// Attempts that are spread out enough are fine, no matter how many there are
+	for (unsigned int i = 0; i < 5 * TRIES; ++i) {
+		QCOMPARE(throttle.attempt(address(1)), Verdict::Allowed);
+		throttle.time += TIMEFRAME / (TRIES / 2);
+	}
+
+	// Attempts that straddle two timeframes are still counted together
+	ManualClockThrottle straddled;
+	QCOMPARE(straddled.attempt(address(1)), Verdict::Allowed);
+	straddled.time += TIMEFRAME - 10 * ONE_SECOND;
+	for (unsigned int i = 0; i < TRIES / 2; ++i) {
+		QCOMPARE(straddled.attempt(address(1)), Verdict::Allowed);
+	}
+	straddled.time += 11 * ONE_SECOND;
+	for (unsigned int i = 0; i < TRIES / 2; ++i) {
+		QCOMPARE(straddled.attempt(address(1)), Verdict::Allowed);
+	}
+	QCOMPARE(straddled.attempt(address(1)), Verdict::NewlyBanned);
+}
+
+void TestConnectionThrottle::forgive() {
+	ManualClockThrottle throttle;
+
+	for (unsigned int i = 0; i < TRIES; ++i) {
+		throttle.attempt(address(1));
+	}
+	throttle.forgive(address(1));
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Allowed);
+
+	// Bans are not lifted though
+	for (unsigned int i = 0; i < TRIES; ++i) {
+		throttle.attempt(address(1));
+	}
+	throttle.forgive(address(1));
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Banned);
+}
+
+void TestConnectionThrottle::boundedMemory() {
+	ManualClockThrottle throttle(1024);
+	QCOMPARE(throttle.capacity(), static_cast< std::size_t >(1024));
+
+	for (unsigned int i = 0; i <= TRIES; ++i) {
+		throttle.attempt(address(1));
+	}
+
+	// A flood from many addresses doesn't take up more memory, and it doesn't lift the ban of the flooding address
+	// either, as bans are only replaced if their whole set is banned
+	for (quint32 i = 2; i < 100000; ++i) {
+		throttle.time++;
+		throttle.attempt(address(i));
+	}
+
+	QVERIFY(throttle.size() <= throttle.capacity());
+	QCOMPARE(throttle.attempt(address(1)), Verdict::Banned);
+}
+
+QTEST_MAIN(TestConnectionThrottle)
+#include "TestConnectionThrottle.moc"
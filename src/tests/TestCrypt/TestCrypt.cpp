@@ -9,8 +9,11 @@
 #include "SSL.h"
 #include "Timer.h"
 #include "Utils.h"
+#include "crypto/CryptStateAEAD.h"
 #include "crypto/CryptStateOCB2.h"
+#include <memory>
 #include <string>
+#include <vector>
 
 class TestCrypt : public QObject {
 	Q_OBJECT
@@ -23,6 +26,9 @@ private slots:
 	void ivrecovery();
 	void reverserecovery();
 	void tamper();
+	void accelerated();
+	void batch();
+	void aead();
 };
 
 void TestCrypt::initTestCase() {
@@ -126,7 +132,7 @@ void TestCrypt::ivrecovery() {
 		for (int j = 0; j < 15; j++)
 			enc.encrypt(secret, crypted, 10);
 		QVERIFY(dec.decrypt(crypted, decr, 14));
-		QCOMPARE(dec.uiLost, 14U);
+		QCOMPARE(dec.uiLost.load(), 14U);
 	}
 
 	QVERIFY(enc.getEncryptIV() == dec.getDecryptIV());
@@ -301,5 +307,139 @@ void TestCrypt::tamper() {
 	QVERIFY(cs.decrypt(encrypted.data(), decrypted.data(), len + 4));
 }
 
+void TestCrypt::accelerated() {
+	if (!OCB2Accelerated::isSupported()) {
+		QSKIP("The CPU lacks the instructions required for the accelerated implementation");
+	}
+
+	const unsigned char rawkey[AES_BLOCK_SIZE] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+												   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const unsigned char nonce[AES_BLOCK_SIZE]  = { 0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99, 0x88,
+												   0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
+	std::string rawkey_str = std::string(reinterpret_cast< const char * >(rawkey), AES_BLOCK_SIZE);
+
+	CryptStateOCB2 accelerated, portable;
+	accelerated.setKey(rawkey_str, rawkey_str, rawkey_str);
+	portable.setKey(rawkey_str, rawkey_str, rawkey_str);
+	portable.setAccelerated(false);
+	QVERIFY(accelerated.isAccelerated());
+	QVERIFY(!portable.isAccelerated());
+
+	// Cover partial and full last blocks as well as a packet with more blocks than are processed at once
+	for (unsigned int len = 0; len < 200; len++) {
+		std::vector< unsigned char > source(len);
+		for (unsigned int i = 0; i < len; i++)
+			source[i] = static_cast< unsigned char >(i * 7 + len);
+		// Every other packet's second to last block is one that triggers the XEX* countermeasures
+		if (len > AES_BLOCK_SIZE && len % 2 == 0)
+			memset(source.data() + ((len - 1) / AES_BLOCK_SIZE - 1) * AES_BLOCK_SIZE, 0, AES_BLOCK_SIZE - 1);
+
+		std::vector< unsigned char > crypt1(len), crypt2(len), plain1(len), plain2(len);
+		unsigned char tag1[AES_BLOCK_SIZE], tag2[AES_BLOCK_SIZE];
+
+		QCOMPARE(accelerated.ocb_encrypt(source.data(), crypt1.data(), len, nonce, tag1),
+				 portable.ocb_encrypt(source.data(), crypt2.data(), len, nonce, tag2));
+		QVERIFY(crypt1 == crypt2);
+		QVERIFY(memcmp(tag1, tag2, AES_BLOCK_SIZE) == 0);
+
+		QCOMPARE(accelerated.ocb_decrypt(crypt1.data(), plain1.data(), len, nonce, tag1),
+				 portable.ocb_decrypt(crypt1.data(), plain2.data(), len, nonce, tag2));
+		QVERIFY(plain1 == plain2);
+		QVERIFY(memcmp(tag1, tag2, AES_BLOCK_SIZE) == 0);
+
+		// Without modifying the plain text, the countermeasures have to be reported by both implementations
+		QCOMPARE(accelerated.ocb_encrypt(source.data(), crypt1.data(), len, nonce, tag1, false),
+				 portable.ocb_encrypt(source.data(), crypt2.data(), len, nonce, tag2, false));
+	}
+}
+
+void TestCrypt::batch() {
+	// Enough receivers for several groups to be formed, some of which don't use the accelerated implementation
+	constexpr std::size_t RECEIVERS = 37;
+
+	std::vector< std::unique_ptr< CryptStateOCB2 > > batched, single;
+	for (std::size_t i = 0; i < RECEIVERS; ++i) {
+		batched.push_back(std::make_unique< CryptStateOCB2 >());
+		batched.back()->genKey();
+		batched.back()->setAccelerated(i % 5 != 3);
+
+		single.push_back(std::make_unique< CryptStateOCB2 >());
+		single.back()->setKey(batched.back()->getRawKey(), batched.back()->getEncryptIV(),
+							  batched.back()->getDecryptIV());
+	}
+
+	for (unsigned int len = 0; len < 100; len += 7) {
+		std::vector< unsigned char > source(len);
+		for (unsigned int i = 0; i < len; i++)
+			source[i] = static_cast< unsigned char >(i);
+
+		std::vector< std::vector< unsigned char > > crypted(RECEIVERS, std::vector< unsigned char >(len + 4));
+		std::vector< CryptBatchEntry > entries;
+		for (std::size_t i = 0; i < RECEIVERS; ++i) {
+			entries.push_back({ batched[i].get(), crypted[i].data(), false });
+		}
+
+		CryptState::encryptBatch(source.data(), len, entries.data(), entries.size());
+
+		for (std::size_t i = 0; i < RECEIVERS; ++i) {
+			std::vector< unsigned char > expected(len + 4);
+			QVERIFY(single[i]->encrypt(source.data(), expected.data(), len));
+
+			QVERIFY(entries[i].success);
+			QVERIFY(crypted[i] == expected);
+			QCOMPARE(batched[i]->getEncryptIV(), single[i]->getEncryptIV());
+		}
+	}
+}
+
+void TestCrypt::aead() {
+	for (CryptMode mode : { CryptMode::AES128_GCM, CryptMode::CHACHA20_POLY1305 }) {
+		if (!CryptState::isSupported(mode)) {
+			continue;
+		}
+
+		std::unique_ptr< CryptState > enc = CryptState::create(mode);
+		std::unique_ptr< CryptState > dec = CryptState::create(mode);
+		QCOMPARE(enc->mode(), mode);
+
+		enc->genKey();
+		QVERIFY(dec->setKey(enc->getRawKey(), enc->getDecryptIV(), enc->getEncryptIV()));
+
+		const unsigned char msg[] = "It was a funky funky town!";
+		const unsigned int len    = sizeof(msg);
+
+		std::vector< unsigned char > encrypted(len + enc->overhead());
+		std::vector< unsigned char > decrypted(len);
+
+		// Roundtrip, and the same packet mustn't be accepted twice
+		QVERIFY(enc->encrypt(msg, encrypted.data(), len));
+		QVERIFY(dec->decrypt(encrypted.data(), decrypted.data(), len + enc->overhead()));
+		QVERIFY(memcmp(msg, decrypted.data(), len) == 0);
+		QVERIFY(!dec->decrypt(encrypted.data(), decrypted.data(), len + enc->overhead()));
+
+		// Every flipped bit (of the tag or the cipher text) has to be detected
+		QVERIFY(enc->encrypt(msg, encrypted.data(), len));
+		for (std::size_t i = 8; i < encrypted.size() * 8; i++) {
+			encrypted[i / 8] ^= static_cast< unsigned char >(1 << (i % 8));
+			QVERIFY(!dec->decrypt(encrypted.data(), decrypted.data(), len + enc->overhead()));
+			encrypted[i / 8] ^= static_cast< unsigned char >(1 << (i % 8));
+		}
+		QVERIFY(dec->decrypt(encrypted.data(), decrypted.data(), len + enc->overhead()));
+
+		// Out of order packets are accepted once and counted as late
+		std::vector< unsigned char > first(len + enc->overhead());
+		std::vector< unsigned char > second(len + enc->overhead());
+		QVERIFY(enc->encrypt(msg, first.data(), len));
+		QVERIFY(enc->encrypt(msg, second.data(), len));
+		QVERIFY(dec->decrypt(second.data(), decrypted.data(), len + enc->overhead()));
+		QVERIFY(dec->decrypt(first.data(), decrypted.data(), len + enc->overhead()));
+		QVERIFY(!dec->decrypt(first.data(), decrypted.data(), len + enc->overhead()));
+		QCOMPARE(dec->uiLate.load(), 1u);
+
+		// Packets shorter than the overhead are rejected
+		QVERIFY(!dec->decrypt(encrypted.data(), decrypted.data(), enc->overhead() - 1));
+	}
+}
+
 QTEST_MAIN(TestCrypt)
 #include "TestCrypt.moc"
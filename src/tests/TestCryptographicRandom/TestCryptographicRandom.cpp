@@ -20,6 +20,7 @@ private slots:
 	void initTestCase();
 	void cleanupTestCase();
 	void fillBuffer();
+	void fillBufferPooled();
 	void uint32();
 	void uniform();
 };
@@ -55,6 +56,22 @@ void TestCryptographicRandom::fillBuffer() {
 	}
 }
 
+void TestCryptographicRandom::fillBufferPooled() {
+	const int chunk  = 16;
+	const int buflen = CryptographicRandom::POOL_SIZE * 64;
+
+	// Small requests are served from the thread's pool, which is refilled many times over here
+	unsigned char *buf = reinterpret_cast< unsigned char * >(calloc(buflen, 1));
+	QSet< QByteArray > chunks;
+	for (int off = 0; off < buflen; off += chunk) {
+		CryptographicRandom::fillBuffer(buf + off, chunk);
+		chunks.insert(QByteArray(reinterpret_cast< const char * >(buf + off), chunk));
+	}
+	QVERIFY(verifyEntropy(buf, buflen));
+	QCOMPARE(chunks.size(), buflen / chunk);
+	free(buf);
+}
+
 void TestCryptographicRandom::uint32() {
 	const int buflen = 1000000;
 
@@ -0,0 +1,163 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtSql>
+#include <QtTest>
+
+#include "DatabaseWriter.h"
+
+class TestDatabaseWriter : public QObject {
+	Q_OBJECT
+private slots:
+	void init();
+	void cleanup();
+
+	void flush();
+	void order();
+	void keys();
+	void destructor();
+
+private:
+	QTemporaryDir *m_dir = nullptr;
+	QString m_path;
+};
+
+static DatabaseWriter::Task setVolume(const QString &hash, float volume) {
+	return [hash, volume](StatementCache &statements) {
+		QSqlQuery &query =
+			statements.prepare(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"));
+		query.addBindValue(hash);
+		query.addBindValue(QString::number(volume));
+		query.exec();
+	};
+}
+
+static DatabaseWriter::Task removeVolume(const QString &hash) {
+	return [hash](StatementCache &statements) {
+		QSqlQuery &query = statements.prepare(QLatin1String("DELETE FROM `volume` WHERE `hash` = ?"));
+		query.addBindValue(hash);
+		query.exec();
+	};
+}
+
+static QMap< QString, QString > volumes(const QString &path) {
+	QMap< QString, QString > map;
+	{
+		QSqlDatabase db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), QLatin1String("reader"));
+		db.setDatabaseName(path);
+		if (db.open()) {
+			QSqlQuery query(QLatin1String("SELECT `hash`, `volume` FROM `volume`"), db);
+			while (query.next())
+				map.insert(query.value(0).toString(), query.value(1).toString());
+		}
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("reader"));
+	return map;
+}
+
+void TestDatabaseWriter::init() {
+	m_dir = new QTemporaryDir();
+	QVERIFY(m_dir->isValid());
+	m_path = m_dir->filePath(QLatin1String("mumble.sqlite"));
+
+	{
+		QSqlDatabase db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), QLatin1String("schema"));
+		db.setDatabaseName(m_path);
+		QVERIFY(db.open());
+		QSqlQuery query(db);
+		QVERIFY(query.exec(QLatin1String("CREATE TABLE `volume` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hash` TEXT, "
+										 "`volume` FLOAT)")));
+		QVERIFY(query.exec(QLatin1String("CREATE UNIQUE INDEX `volume_hash` ON `volume`(`hash`)")));
+	}
+	QSqlDatabase::removeDatabase(QLatin1String("schema"));
+}
+
+void TestDatabaseWriter::cleanup() {
+	delete m_dir;
+	m_dir = nullptr;
+}
+
+void TestDatabaseWriter::flush() {
+	DatabaseWriter writer(m_path, QLatin1String("writer"));
+
+	writer.enqueue(setVolume(QLatin1String("first"), 0.5f));
+	writer.enqueue(setVolume(QLatin1String("second"), 2.0f));
+	writer.flush();
+
+	QCOMPARE(writer.queueDepth(), static_cast< std::size_t >(0));
+
+	const QMap< QString, QString > map = volumes(m_path);
+	QCOMPARE(map.size(), 2);
+	QCOMPARE(map.value(QLatin1String("first")), QLatin1String("0.5"));
+	QCOMPARE(map.value(QLatin1String("second")), QLatin1String("2"));
+}
+
+void TestDatabaseWriter::order() {
+	DatabaseWriter writer(m_path, QLatin1String("writer"));
+
+	// Writes without a key are all performed, in the order they have been queued in
+	writer.enqueue(setVolume(QLatin1String("user"), 0.5f));
+	writer.enqueue(removeVolume(QLatin1String("user")));
+	writer.enqueue(setVolume(QLatin1String("user"), 1.5f));
+	writer.flush();
+
+	QCOMPARE(volumes(m_path).value(QLatin1String("user")), QLatin1String("1.5"));
+}
+
+void TestDatabaseWriter::keys() {
+	DatabaseWriter writer(m_path, QLatin1String("writer"));
+
+	int performed      = 0;
+	const auto counted = [&performed](DatabaseWriter::Task task) {
+		return [&performed, task](StatementCache &statements) {
+			performed++;
+			task(statements);
+		};
+	};
+
+	// Keep the writer busy, so that the following writes are still pending when they are replaced
+	QSemaphore started;
+	QMutex mutex;
+	mutex.lock();
+	writer.enqueue([&started, &mutex](StatementCache &) {
+		started.release();
+		mutex.lock();
+		mutex.unlock();
+	});
+	started.acquire();
+
+	for (int i = 1; i <= 10; i++) {
+		writer.enqueue(counted(setVolume(QLatin1String("user"), static_cast< float >(i))), QLatin1String("user"));
+	}
+	writer.enqueue(counted(setVolume(QLatin1String("other"), 0.5f)), QLatin1String("other"));
+	const std::size_t depth = writer.queueDepth();
+
+	mutex.unlock();
+	writer.flush();
+
+	// The replaced writes are still queued, but they are skipped
+	QCOMPARE(depth, static_cast< std::size_t >(11));
+	// Only the last write of every key has been performed
+	QCOMPARE(performed, 2);
+	const QMap< QString, QString > map = volumes(m_path);
+	QCOMPARE(map.value(QLatin1String("user")), QLatin1String("10"));
+	QCOMPARE(map.value(QLatin1String("other")), QLatin1String("0.5"));
+}
+
+void TestDatabaseWriter::destructor() {
+	{
+		DatabaseWriter writer(m_path, QLatin1String("writer"));
+		for (int i = 0; i < 1000; i++) {
+			writer.enqueue(setVolume(QString::number(i), 1.0f));
+		}
+	}
+
+	// The pending writes are performed before the writer is gone
+	QCOMPARE(volumes(m_path).size(), 1000);
+}
+
+QTEST_MAIN(TestDatabaseWriter)
+#include "TestDatabaseWriter.moc"
@@ -0,0 +1,145 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "EpochReclaimer.h"
+
+#include <memory>
+
+class TestEpochReclaimer : public QObject {
+	Q_OBJECT
+private slots:
+	void reclaimWithoutReaders();
+	void activeReaderDelays();
+	void laterReaderDoesNotDelay();
+	void reclaimInOrder();
+	void retireSharedPointer();
+	void removeReader();
+	void destroyPending();
+};
+
+void TestEpochReclaimer::reclaimWithoutReaders() {
+	EpochReclaimer reclaimer;
+	int destroyed = 0;
+
+	reclaimer.retire([&destroyed]() { ++destroyed; });
+	QVERIFY(reclaimer.hasPending());
+	QCOMPARE(destroyed, 0);
+
+	QVERIFY(!reclaimer.reclaim());
+	QCOMPARE(destroyed, 1);
+	QVERIFY(!reclaimer.hasPending());
+}
+
+void TestEpochReclaimer::activeReaderDelays() {
+	EpochReclaimer reclaimer;
+	EpochReclaimer::Reader reader;
+	reclaimer.addReader(reader);
+	int destroyed = 0;
+
+	reclaimer.enter(reader);
+	reclaimer.retire([&destroyed]() { ++destroyed; });
+
+	// The reader might still be using the object
+	QVERIFY(reclaimer.reclaim());
+	QCOMPARE(destroyed, 0);
+
+	reclaimer.leave(reader);
+	QVERIFY(!reclaimer.reclaim());
+	QCOMPARE(destroyed, 1);
+}
+
+void TestEpochReclaimer::laterReaderDoesNotDelay() {
+	EpochReclaimer reclaimer;
+	EpochReclaimer::Reader reader;
+	reclaimer.addReader(reader);
+	int destroyed = 0;
+
+	reclaimer.retire([&destroyed]() { ++destroyed; });
+	// A reader that enters after the object has been retired can't reach it anymore
+	reclaimer.enter(reader);
+
+	QVERIFY(!reclaimer.reclaim());
+	QCOMPARE(destroyed, 1);
+
+	reclaimer.leave(reader);
+}
+
+void TestEpochReclaimer::reclaimInOrder() {
+	EpochReclaimer reclaimer;
+	EpochReclaimer::Reader first;
+	EpochReclaimer::Reader second;
+	reclaimer.addReader(first);
+	reclaimer.addReader(second);
+	QVector< int > destroyed;
+
+	reclaimer.enter(first);
+	reclaimer.retire([&destroyed]() { destroyed << 1; });
+	reclaimer.enter(second);
+	reclaimer.retire([&destroyed]() { destroyed << 2; });
+
+	QVERIFY(reclaimer.reclaim());
+	QVERIFY(destroyed.isEmpty());
+
+	// The second object is still in use by the second reader
+	reclaimer.leave(first);
+	QVERIFY(reclaimer.reclaim());
+	QCOMPARE(destroyed, QVector< int >({ 1 }));
+
+	reclaimer.leave(second);
+	QVERIFY(!reclaimer.reclaim());
+	QCOMPARE(destroyed, QVector< int >({ 1, 2 }));
+}
+
+void TestEpochReclaimer::retireSharedPointer() {
+	EpochReclaimer reclaimer;
+	EpochReclaimer::Reader reader;
+	reclaimer.addReader(reader);
+
+	std::shared_ptr< int > object = std::make_shared< int >(42);
+	std::weak_ptr< int > observer = object;
+
+	reclaimer.enter(reader);
+	reclaimer.retire(std::move(object));
+
+	reclaimer.reclaim();
+	QVERIFY(!observer.expired());
+
+	reclaimer.leave(reader);
+	reclaimer.reclaim();
+	QVERIFY(observer.expired());
+}
+
+void TestEpochReclaimer::removeReader() {
+	EpochReclaimer reclaimer;
+	EpochReclaimer::Reader reader;
+	reclaimer.addReader(reader);
+	int destroyed = 0;
+
+	reclaimer.enter(reader);
+	reclaimer.leave(reader);
+	reclaimer.removeReader(reader);
+
+	reclaimer.retire([&destroyed]() { ++destroyed; });
+	QVERIFY(!reclaimer.reclaim());
+	QCOMPARE(destroyed, 1);
+}
+
+void TestEpochReclaimer::destroyPending() {
+	int destroyed = 0;
+
+	{
+		EpochReclaimer reclaimer;
+		reclaimer.retire([&destroyed]() { ++destroyed; });
+		reclaimer.retire([&destroyed]() { ++destroyed; });
+	}
+
+	QCOMPARE(destroyed, 2);
+}
+
+QTEST_MAIN(TestEpochReclaimer)
+#include "TestEpochReclaimer.moc"
@@ -0,0 +1,209 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "FrameAggregator.h"
+
+#include <vector>
+
+using Bytes = std::vector< Mumble::Protocol::byte >;
+
+namespace {
+/// CELT (fullband) with frames of 2.5 ms and 5 ms
+constexpr Mumble::Protocol::byte TOC_2_5_MS = 28 << 3;
+constexpr Mumble::Protocol::byte TOC_5_MS   = 29 << 3;
+
+/// A packet of a single frame, whose bytes are the given value
+Bytes packet(Mumble::Protocol::byte toc, std::size_t size, Mumble::Protocol::byte value) {
+	Bytes data(1 + size, value);
+	data[0] = toc;
+	return data;
+}
+
+Mumble::Protocol::AudioData audio(const Bytes &payload, std::uint64_t frameNumber, std::uint32_t frameSize,
+								  bool isLastFrame = false) {
+	Mumble::Protocol::AudioData data;
+	data.frameNumber = frameNumber;
+	data.frameSize   = frameSize;
+	data.payload     = gsl::span< const Mumble::Protocol::byte >(payload.data(), payload.size());
+	data.isLastFrame = isLastFrame;
+	return data;
+}
+
+std::vector< Bytes > frames(const Mumble::Protocol::AudioData &data, Mumble::Protocol::byte &toc) {
+	std::vector< gsl::span< const Mumble::Protocol::byte > > spans;
+	if (!FrameAggregator::parse(data.payload, toc, spans)) {
+		return {};
+	}
+
+	std::vector< Bytes > result;
+	for (const gsl::span< const Mumble::Protocol::byte > &span : spans) {
+		result.emplace_back(span.begin(), span.end());
+	}
+	return result;
+}
+} // namespace
+
+class TestFrameAggregator : public QObject {
+	Q_OBJECT
+private slots:
+	void parse();
+	void pack();
+	void groups();
+	void partialGroups();
+	void invalid();
+};
+
+void TestFrameAggregator::parse() {
+	Mumble::Protocol::byte toc;
+	std::vector< gsl::span< const Mumble::Protocol::byte > > spans;
+
+	// Two frames of the same size
+	const Bytes equal = { TOC_5_MS | 0x1, 1, 2, 3, 4 };
+	QVERIFY(FrameAggregator::parse(equal, toc, spans));
+	QCOMPARE(spans.size(), static_cast< std::size_t >(2));
+	QCOMPARE(spans[1][0], static_cast< Mumble::Protocol::byte >(3));
+	QVERIFY(!FrameAggregator::parse(gsl::span< const Mumble::Protocol::byte >(equal.data(), 4), toc, spans));
+
+	// Two frames with the first one's length given in two bytes (252 + 4 * 1 = 256)
+	Bytes twoFrames = { TOC_5_MS | 0x2, 252, 1 };
+	twoFrames.resize(twoFrames.size() + 256 + 10, 7);
+	QVERIFY(FrameAggregator::parse(twoFrames, toc, spans));
+	QCOMPARE(spans[0].size(), static_cast< std::size_t >(256));
+	QCOMPARE(spans[1].size(), static_cast< std::size_t >(10));
+
+	// Three frames of the same size with 2 bytes of padding
+	const Bytes padded = { TOC_5_MS | 0x3, 0x40 | 3, 2, 1, 2, 3, 0, 0 };
+	QVERIFY(FrameAggregator::parse(padded, toc, spans));
+	QCOMPARE(spans.size(), static_cast< std::size_t >(3));
+	QCOMPARE(spans[2][0], static_cast< Mumble::Protocol::byte >(3));
+
+	// Lengths beyond the end of the packet
+	const Bytes truncated = { TOC_5_MS | 0x3, 0x80 | 2, 20, 1, 2 };
+	QVERIFY(!FrameAggregator::parse(truncated, toc, spans));
+	QVERIFY(!FrameAggregator::parse(Bytes(), toc, spans));
+
+	QCOMPARE(FrameAggregator::frameSamples(TOC_2_5_MS), 120u);
+	QCOMPARE(FrameAggregator::frameSamples(TOC_5_MS), 240u);
+	// SILK, 20 ms
+	QCOMPARE(FrameAggregator::frameSamples(1 << 3), 960u);
+}
+
+void TestFrameAggregator::pack() {
+	const Bytes first(300, 1);
+	const Bytes second(3, 2);
+	const Bytes third(0);
+
+	Bytes buffer;
+	FrameAggregator::pack(TOC_2_5_MS | 0x4, { first, second, third }, buffer);
+
+	Mumble::Protocol::byte toc;
+	std::vector< gsl::span< const Mumble::Protocol::byte > > spans;
+	QVERIFY(FrameAggregator::parse(buffer, toc, spans));
+	// The configuration and the stereo flag are kept
+	QCOMPARE(toc & 0xFC, TOC_2_5_MS | 0x4);
+	QCOMPARE(spans.size(), static_cast< std::size_t >(3));
+	QVERIFY(Bytes(spans[0].begin(), spans[0].end()) == first);
+	QVERIFY(Bytes(spans[1].begin(), spans[1].end()) == second);
+	QVERIFY(spans[2].empty());
+
+	// A single frame needs no frame count
+	FrameAggregator::pack(TOC_2_5_MS | 0x3, { second }, buffer);
+	QVERIFY(buffer == Bytes({ TOC_2_5_MS, 2, 2, 2 }));
+}
+
+void TestFrameAggregator::groups() {
+	FrameAggregator aggregator;
+	Mumble::Protocol::AudioData out;
+	Bytes buffer;
+
+	// Frames 8 to 11 make up the third regular frame
+	for (std::uint64_t frame = 8; frame < 11; ++frame) {
+		const Bytes data = packet(TOC_2_5_MS, 5, static_cast< Mumble::Protocol::byte >(frame));
+		QVERIFY(!aggregator.add(audio(data, frame, 120), out, buffer));
+	}
+	const Bytes last = packet(TOC_2_5_MS, 5, 11);
+	QVERIFY(aggregator.add(audio(last, 11, 120), out, buffer));
+
+	QCOMPARE(out.frameNumber, static_cast< std::uint64_t >(2));
+	QCOMPARE(out.frameSize, 0u);
+	QVERIFY(!out.isLastFrame);
+
+	Mumble::Protocol::byte toc;
+	const std::vector< Bytes > combined = frames(out, toc);
+	QCOMPARE(combined.size(), static_cast< std::size_t >(4));
+	QCOMPARE(combined[3], Bytes(5, 11));
+	QCOMPARE(FrameAggregator::frameSamples(toc), 120u);
+
+	// Frames of 5 ms come in pairs
+	const Bytes first  = packet(TOC_5_MS, 3, 1);
+	const Bytes second = packet(TOC_5_MS, 4, 2);
+	QVERIFY(!aggregator.add(audio(first, 6, 240), out, buffer));
+	QVERIFY(aggregator.add(audio(second, 7, 240, true), out, buffer));
+	QCOMPARE(out.frameNumber, static_cast< std::uint64_t >(3));
+	QVERIFY(out.isLastFrame);
+	QCOMPARE(frames(out, toc).size(), static_cast< std::size_t >(2));
+}
+
+void TestFrameAggregator::partialGroups() {
+	FrameAggregator aggregator;
+	Mumble::Protocol::AudioData out;
+	Bytes buffer;
+	Mumble::Protocol::byte toc;
+
+	// The end of the stream ends the group early
+	const Bytes data = packet(TOC_2_5_MS, 2, 1);
+	QVERIFY(!aggregator.add(audio(data, 4, 120), out, buffer));
+	QVERIFY(aggregator.add(audio(data, 5, 120, true), out, buffer));
+	QCOMPARE(out.frameNumber, static_cast< std::uint64_t >(1));
+	QVERIFY(out.isLastFrame);
+	QCOMPARE(frames(out, toc).size(), static_cast< std::size_t >(2));
+
+	// A lost frame passes on what is there so far
+	QVERIFY(!aggregator.add(audio(data, 8, 120), out, buffer));
+	QVERIFY(aggregator.add(audio(data, 10, 120), out, buffer));
+	QCOMPARE(out.frameNumber, static_cast< std::uint64_t >(2));
+	QCOMPARE(frames(out, toc).size(), static_cast< std::size_t >(1));
+
+	// So does a change of the configuration
+	const Bytes other = packet(TOC_2_5_MS | 0x4, 2, 1);
+	QVERIFY(aggregator.add(audio(other, 11, 120), out, buffer));
+	QCOMPARE(frames(out, toc).size(), static_cast< std::size_t >(1));
+	QCOMPARE(toc & 0x4, 0);
+
+	// Groups that are left over from an interrupted stream are dropped
+	QVERIFY(!aggregator.add(audio(data, 40, 120), out, buffer));
+	QVERIFY(!aggregator.add(audio(data, 41, 120), out, buffer));
+	QVERIFY(aggregator.add(audio(data, 42, 120, true), out, buffer));
+	QCOMPARE(out.frameNumber, static_cast< std::uint64_t >(10));
+	QCOMPARE(frames(out, toc).size(), static_cast< std::size_t >(3));
+
+	// Late frames are dropped
+	QVERIFY(!aggregator.add(audio(data, 48, 120), out, buffer));
+	QVERIFY(!aggregator.add(audio(data, 47, 120), out, buffer));
+}
+
+void TestFrameAggregator::invalid() {
+	FrameAggregator aggregator;
+	Mumble::Protocol::AudioData out;
+	Bytes buffer;
+
+	const Bytes data = packet(TOC_2_5_MS, 2, 1);
+	// The frame size has to divide a regular frame
+	QVERIFY(!aggregator.add(audio(data, 0, 0, true), out, buffer));
+	QVERIFY(!aggregator.add(audio(data, 0, 100, true), out, buffer));
+	QVERIFY(!aggregator.add(audio(data, 0, 480, true), out, buffer));
+	// And it has to be the one of the Opus frames
+	QVERIFY(!aggregator.add(audio(data, 0, 240, true), out, buffer));
+	// The frames of a packet mustn't belong to different groups
+	const Bytes twoFrames = { TOC_2_5_MS | 0x1, 1, 2 };
+	QVERIFY(!aggregator.add(audio(twoFrames, 3, 120), out, buffer));
+	QVERIFY(aggregator.add(audio(twoFrames, 2, 120), out, buffer));
+}
+
+QTEST_MAIN(TestFrameAggregator)
+#include "TestFrameAggregator.moc"
@@ -0,0 +1,83 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "HostAddress.h"
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#else
+#	include <arpa/inet.h>
+#endif
+
+class TestHostAddress : public QObject {
+	Q_OBJECT
+private slots:
+	void defaultConstructed();
+	void equality();
+	void hashFollowsChanges();
+	void ipv4();
+	void hashTable();
+};
+
+static HostAddress address(const char *address) {
+	return HostAddress(QHostAddress(QLatin1String(address)));
+}
+
+void TestHostAddress::defaultConstructed() {
+	HostAddress ha;
+	QVERIFY(!ha.isValid());
+	QVERIFY(ha == HostAddress(QByteArray(16, '\0')));
+	QCOMPARE(ha.hash(), HostAddress(QByteArray(16, '\0')).hash());
+}
+
+void TestHostAddress::equality() {
+	QVERIFY(address("192.168.0.1") == address("::ffff:192.168.0.1"));
+	QVERIFY(address("192.168.0.1") != address("192.168.0.2"));
+	QVERIFY(address("2001:db8::1") == address("2001:db8::1"));
+	QVERIFY(address("2001:db8::1") != address("2001:db9::1"));
+	// Same lower half, different upper half
+	QVERIFY(address("::ffff:10.0.0.1") != address("1::ffff:10.0.0.1"));
+}
+
+void TestHostAddress::hashFollowsChanges() {
+	HostAddress ha = address("10.0.0.1");
+	ha.setByte(15, 2);
+	QVERIFY(ha == address("10.0.0.2"));
+	QCOMPARE(ha.hash(), address("10.0.0.2").hash());
+	QCOMPARE(qHash(ha), qHash(address("10.0.0.2")));
+
+	ha.fromIPv4(0x0A000003);
+	QCOMPARE(ha.hash(), address("10.0.0.3").hash());
+
+	ha.reset();
+	QCOMPARE(ha.hash(), HostAddress().hash());
+}
+
+void TestHostAddress::ipv4() {
+	const HostAddress ha = address("10.1.2.3");
+	QVERIFY(!ha.isV6());
+	QCOMPARE(ha.toIPv4(), htonl(0x0A010203));
+	QCOMPARE(ha.toString(), QLatin1String("10.1.2.3"));
+}
+
+void TestHostAddress::hashTable() {
+	QHash< HostAddress, int > hash;
+	for (int i = 0; i < 1000; ++i) {
+		HostAddress ha;
+		ha.fromIPv4(0x0A000000 + static_cast< std::uint32_t >(i));
+		hash.insert(ha, i);
+	}
+
+	QCOMPARE(hash.size(), 1000);
+	QCOMPARE(hash.value(address("10.0.1.0"), -1), 256);
+	QCOMPARE(hash.value(address("11.0.1.0"), -1), -1);
+}
+
+QTEST_MAIN(TestHostAddress)
+#include "TestHostAddress.moc"
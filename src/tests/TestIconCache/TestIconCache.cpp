@@ -0,0 +1,101 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtGui>
+#include <QtTest>
+
+#include "IconCache.h"
+
+class TestIconCache : public QObject {
+	Q_OBJECT
+private slots:
+	void hit();
+	void keys();
+	void devicePixelRatio();
+	void warm();
+	void generation();
+	void nullIcon();
+};
+
+static QIcon iconOf(const QColor &color) {
+	QPixmap pm(64, 64);
+	pm.fill(color);
+	return QIcon(pm);
+}
+
+void TestIconCache::hit() {
+	IconCache cache;
+	const QIcon icon = iconOf(Qt::red);
+
+	const QPixmap first  = cache.pixmap(icon, QSize(16, 16), 1.0);
+	const QPixmap second = cache.pixmap(icon, QSize(16, 16), 1.0);
+
+	QVERIFY(!first.isNull());
+	QCOMPARE(first.cacheKey(), second.cacheKey());
+	QCOMPARE(cache.size(), 1);
+}
+
+void TestIconCache::keys() {
+	IconCache cache;
+	const QIcon red  = iconOf(Qt::red);
+	const QIcon blue = iconOf(Qt::blue);
+
+	cache.pixmap(red, QSize(16, 16), 1.0);
+	cache.pixmap(red, QSize(24, 24), 1.0);
+	cache.pixmap(red, QSize(16, 16), 1.0, QIcon::Disabled);
+	cache.pixmap(blue, QSize(16, 16), 1.0);
+	QCOMPARE(cache.size(), 4);
+
+	QCOMPARE(cache.pixmap(blue, QSize(16, 16), 1.0).toImage().pixelColor(8, 8), QColor(Qt::blue));
+}
+
+void TestIconCache::devicePixelRatio() {
+	IconCache cache;
+	const QIcon icon = iconOf(Qt::red);
+
+	const QPixmap pm = cache.pixmap(icon, QSize(16, 16), 2.0);
+	QCOMPARE(pm.size(), QSize(32, 32));
+	QCOMPARE(pm.devicePixelRatio(), 2.0);
+
+	cache.pixmap(icon, QSize(16, 16), 1.0);
+	QCOMPARE(cache.size(), 2);
+}
+
+void TestIconCache::warm() {
+	IconCache cache;
+	const QList< QIcon > icons = { iconOf(Qt::red), iconOf(Qt::green), iconOf(Qt::blue) };
+
+	cache.warm(icons, QSize(16, 16), 1.0);
+	QCOMPARE(cache.size(), 3);
+
+	// Painting the warmed icons doesn't add any pixmaps
+	for (const QIcon &icon : icons) {
+		cache.pixmap(icon, QSize(16, 16), 1.0);
+	}
+	QCOMPARE(cache.size(), 3);
+}
+
+void TestIconCache::generation() {
+	IconCache cache;
+	cache.pixmap(iconOf(Qt::red), QSize(16, 16), 1.0);
+
+	cache.setGeneration(0);
+	QCOMPARE(cache.size(), 1);
+
+	cache.setGeneration(1);
+	QCOMPARE(cache.size(), 0);
+}
+
+void TestIconCache::nullIcon() {
+	IconCache cache;
+
+	QVERIFY(cache.pixmap(QIcon(), QSize(16, 16), 1.0).isNull());
+	QVERIFY(cache.pixmap(iconOf(Qt::red), QSize(), 1.0).isNull());
+	QCOMPARE(cache.size(), 0);
+}
+
+QTEST_MAIN(TestIconCache)
+#include "TestIconCache.moc"
@@ -0,0 +1,90 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "LogHistory.h"
+
+class TestLogHistory : public QObject {
+	Q_OBJECT
+private slots:
+	void memory();
+	void spill();
+	void outOfRange();
+	void clear();
+};
+
+static QDateTime timeOf(int index) {
+	return QDateTime(QDate(2023, 1, 1), QTime(0, 0)).addSecs(index);
+}
+
+static QString messageOf(int index) {
+	return QString::fromLatin1("<b>Message %1</b>").arg(index);
+}
+
+void TestLogHistory::memory() {
+	LogHistory history(10);
+	for (int i = 0; i < 10; i++) {
+		history.append(timeOf(i), messageOf(i));
+	}
+
+	QCOMPARE(history.count(), 10);
+	for (int i = 0; i < 10; i++) {
+		const LogHistory::Entry entry = history.at(i);
+		QCOMPARE(entry.time, timeOf(i));
+		QCOMPARE(entry.html, messageOf(i));
+	}
+}
+
+void TestLogHistory::spill() {
+	LogHistory history(4);
+	for (int i = 0; i < 100; i++) {
+		history.append(timeOf(i), messageOf(i));
+	}
+
+	// The messages beyond the capacity are read back from the file, in any order
+	QCOMPARE(history.count(), 100);
+	for (int i = 99; i >= 0; i -= 7) {
+		const LogHistory::Entry entry = history.at(i);
+		QCOMPARE(entry.time, timeOf(i));
+		QCOMPARE(entry.html, messageOf(i));
+	}
+
+	// Appending after reading doesn't overwrite the messages in the file
+	history.append(timeOf(100), messageOf(100));
+	for (int i = 0; i <= 100; i++) {
+		QCOMPARE(history.at(i).html, messageOf(i));
+	}
+}
+
+void TestLogHistory::outOfRange() {
+	LogHistory history(2);
+	QVERIFY(history.at(0).html.isNull());
+
+	history.append(timeOf(0), messageOf(0));
+	QVERIFY(!history.at(-1).time.isValid());
+	QVERIFY(!history.at(1).time.isValid());
+}
+
+void TestLogHistory::clear() {
+	LogHistory history(2);
+	for (int i = 0; i < 5; i++) {
+		history.append(timeOf(i), messageOf(i));
+	}
+
+	history.clear();
+	QCOMPARE(history.count(), 0);
+
+	history.append(timeOf(5), messageOf(5));
+	history.append(timeOf(6), messageOf(6));
+	history.append(timeOf(7), messageOf(7));
+	QCOMPARE(history.count(), 3);
+	QCOMPARE(history.at(0).html, messageOf(5));
+	QCOMPARE(history.at(2).html, messageOf(7));
+}
+
+QTEST_MAIN(TestLogHistory)
+#include "TestLogHistory.moc"
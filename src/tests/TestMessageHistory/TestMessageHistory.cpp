@@ -0,0 +1,189 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "MessageHistory.h"
+#include "MumbleProtocol.h"
+
+namespace {
+constexpr qint64 DAY = 24 * 60 * 60 * 1000;
+
+const qint64 NOW = QDateTime(QDate(2023, 6, 1), QTime(12, 0), Qt::UTC).toMSecsSinceEpoch();
+
+MumbleProto::TextMessageHistory_Entry entry(const QString &text, qint64 timestamp) {
+	MumbleProto::TextMessageHistory_Entry entry;
+	entry.mutable_message()->set_actor(1);
+	entry.mutable_message()->set_message(text.toStdString());
+	entry.mutable_message()->set_timestamp(static_cast< quint64 >(timestamp));
+	entry.set_actor_name("alice");
+	return entry;
+}
+
+/// Parses the given framed page
+MumbleProto::TextMessageHistory parse(const QByteArray &data) {
+	MumbleProto::TextMessageHistory msg;
+	if (data.size() < 6
+		|| qFromBigEndian< quint16 >(data.constData())
+			   != static_cast< quint16 >(Mumble::Protocol::TCPMessageType::TextMessageHistory)
+		|| !msg.ParseFromArray(data.constData() + 6, data.size() - 6)) {
+		msg.Clear();
+	}
+	return msg;
+}
+
+QStringList texts(const MumbleProto::TextMessageHistory &page) {
+	QStringList result;
+	for (const MumbleProto::TextMessageHistory_Entry &entry : page.entries()) {
+		result.append(QString::fromStdString(entry.message().message()));
+	}
+	return result;
+}
+} // namespace
+
+class TestMessageHistory : public QObject {
+	Q_OBJECT
+private slots:
+	void pages();
+	void replay();
+	void expire();
+	void clear();
+};
+
+void TestMessageHistory::pages() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	MessageHistory history(dir.path(), 40, 7, NOW);
+	QVERIFY(history.isValid());
+
+	// Channels without messages have an empty page
+	MumbleProto::TextMessageHistory page = parse(history.page(5, -1));
+	QCOMPARE(page.channel_id(), 5u);
+	QCOMPARE(page.page(), 0u);
+	QCOMPARE(page.entries_size(), 0);
+
+	for (int i = 0; i < 60; ++i) {
+		history.append(5, entry(QString::number(i), NOW + i));
+	}
+	QCOMPARE(history.size(5), static_cast< std::size_t >(40));
+	QCOMPARE(history.size(6), static_cast< std::size_t >(0));
+
+	// Messages 20 to 59 are kept, the latest page holding 50 to 59
+	page = parse(history.page(5, -1));
+	QCOMPARE(page.page(), 2u);
+	QCOMPARE(texts(page).size(), 10);
+	QCOMPARE(texts(page).first(), QLatin1String("50"));
+	QCOMPARE(texts(page).last(), QLatin1String("59"));
+	QCOMPARE(page.entries(0).actor_name(), std::string("alice"));
+
+	page = parse(history.page(5, 1));
+	QCOMPARE(page.page(), 1u);
+	QCOMPARE(texts(page).size(), 25);
+	QCOMPARE(texts(page).first(), QLatin1String("25"));
+
+	// The first page has been partially dropped, and there isn't anything before it
+	page = parse(history.page(5, 0));
+	QCOMPARE(texts(page), QStringList({ QLatin1String("20"), QLatin1String("21"), QLatin1String("22"),
+										QLatin1String("23"), QLatin1String("24") }));
+	QCOMPARE(parse(history.page(5, 3)).entries_size(), 0);
+	QCOMPARE(parse(history.page(5, 1000)).entries_size(), 0);
+
+	// Full pages are cached, while the latest page changes with the next message
+	const QByteArray &full = history.page(5, 1);
+	QCOMPARE(history.page(5, 1).constData(), full.constData());
+
+	history.append(5, entry(QLatin1String("60"), NOW + 60));
+	page = parse(history.page(5, -1));
+	QCOMPARE(texts(page).size(), 11);
+	QCOMPARE(texts(page).last(), QLatin1String("60"));
+	// The oldest message has been dropped from the first page
+	QCOMPARE(texts(parse(history.page(5, 0))).first(), QLatin1String("21"));
+}
+
+void TestMessageHistory::replay() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	{
+		MessageHistory history(dir.path(), 10, 7, NOW - DAY);
+		history.append(1, entry(QLatin1String("yesterday"), NOW - DAY));
+		history.append(2, entry(QLatin1String("other"), NOW - DAY));
+		history.append(1, entry(QLatin1String("today"), NOW));
+	}
+
+	const QStringList partitions = QDir(dir.path()).entryList(QDir::Files, QDir::Name);
+	QCOMPARE(partitions, QStringList({ QLatin1String("20230531.log"), QLatin1String("20230601.log") }));
+
+	// A record that hasn't been written completely
+	{
+		QFile file(QDir(dir.path()).filePath(partitions.last()));
+		QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+		file.write(QByteArray("\x40\x00\x00\x00\x01\x00\x00\x00\x0a", 9));
+	}
+
+	{
+		MessageHistory history(dir.path(), 10, 7, NOW);
+		QCOMPARE(texts(parse(history.page(1, -1))),
+				 QStringList({ QLatin1String("yesterday"), QLatin1String("today") }));
+		QCOMPARE(texts(parse(history.page(2, -1))), QStringList({ QLatin1String("other") }));
+
+		// Messages appended after the partial record have to be read as well
+		history.append(2, entry(QLatin1String("later"), NOW + 1));
+	}
+
+	MessageHistory history(dir.path(), 10, 7, NOW);
+	QCOMPARE(texts(parse(history.page(2, -1))), QStringList({ QLatin1String("other"), QLatin1String("later") }));
+}
+
+void TestMessageHistory::expire() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	{
+		MessageHistory history(dir.path(), 10, 2, NOW - 3 * DAY);
+		history.append(1, entry(QLatin1String("old"), NOW - 3 * DAY));
+		history.append(1, entry(QLatin1String("recent"), NOW - DAY));
+		QCOMPARE(history.size(1), static_cast< std::size_t >(2));
+
+		// The retention is enforced as soon as the next day starts
+		history.append(1, entry(QLatin1String("now"), NOW));
+		QCOMPARE(texts(parse(history.page(1, -1))), QStringList({ QLatin1String("recent"), QLatin1String("now") }));
+	}
+
+	// The partition holding only expired messages is gone
+	QCOMPARE(QDir(dir.path()).entryList(QDir::Files, QDir::Name),
+			 QStringList({ QLatin1String("20230531.log"), QLatin1String("20230601.log") }));
+
+	MessageHistory history(dir.path(), 10, 2, NOW + 2 * DAY);
+	QCOMPARE(texts(parse(history.page(1, -1))), QStringList({ QLatin1String("now") }));
+	QCOMPARE(QDir(dir.path()).entryList(QDir::Files, QDir::Name),
+			 QStringList({ QLatin1String("20230601.log"), QLatin1String("20230603.log") }));
+}
+
+void TestMessageHistory::clear() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	{
+		MessageHistory history(dir.path(), 10, 7, NOW);
+		history.append(1, entry(QLatin1String("gone"), NOW));
+		history.append(2, entry(QLatin1String("kept"), NOW));
+		history.clear(1, NOW + 1);
+		QCOMPARE(history.size(1), static_cast< std::size_t >(0));
+		QCOMPARE(parse(history.page(1, -1)).entries_size(), 0);
+
+		// A channel that is created with the same ID starts afresh
+		history.append(1, entry(QLatin1String("new"), NOW + 2));
+	}
+
+	MessageHistory history(dir.path(), 10, 7, NOW);
+	QCOMPARE(texts(parse(history.page(1, -1))), QStringList({ QLatin1String("new") }));
+	QCOMPARE(texts(parse(history.page(2, -1))), QStringList({ QLatin1String("kept") }));
+}
+
+QTEST_MAIN(TestMessageHistory)
+#include "TestMessageHistory.moc"
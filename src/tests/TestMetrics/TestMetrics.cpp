@@ -0,0 +1,135 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "Metrics.h"
+
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class TestMetrics : public QObject {
+	Q_OBJECT
+private slots:
+	void counter();
+	void concurrentCounter();
+	void histogramBuckets();
+	void histogramOverflow();
+	void latencyBuckets();
+	void latencyPercentiles();
+};
+
+void TestMetrics::counter() {
+	Metrics::Counter counter;
+	QCOMPARE(counter.value(), static_cast< quint64 >(0));
+
+	counter.add();
+	counter.add(41);
+	QCOMPARE(counter.value(), static_cast< quint64 >(42));
+}
+
+void TestMetrics::concurrentCounter() {
+	constexpr int THREADS    = 8;
+	constexpr int INCREMENTS = 100000;
+
+	Metrics::Counter counter;
+
+	std::vector< std::thread > threads;
+	for (int i = 0; i < THREADS; ++i) {
+		threads.emplace_back([&counter]() {
+			for (int j = 0; j < INCREMENTS; ++j) {
+				counter.add();
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	QCOMPARE(counter.value(), static_cast< quint64 >(THREADS) * INCREMENTS);
+}
+
+void TestMetrics::histogramBuckets() {
+	Metrics::Histogram histogram;
+	histogram.observe(0);
+	histogram.observe(1);
+	histogram.observe(2);
+	histogram.observe(3);
+	histogram.observe(4);
+
+	const Metrics::Histogram::Totals totals = histogram.totals();
+	QCOMPARE(totals.count, static_cast< quint64 >(5));
+	QCOMPARE(totals.sum, static_cast< quint64 >(10));
+
+	// 0 | 1 | 2, 3 | 4 - 7
+	QCOMPARE(totals.buckets[0], static_cast< quint64 >(1));
+	QCOMPARE(totals.buckets[1], static_cast< quint64 >(1));
+	QCOMPARE(totals.buckets[2], static_cast< quint64 >(2));
+	QCOMPARE(totals.buckets[3], static_cast< quint64 >(1));
+
+	for (std::size_t i = 0; i + 1 < Metrics::Histogram::BUCKET_COUNT; ++i) {
+		QVERIFY(Metrics::Histogram::upperBound(i) < (static_cast< quint64 >(1) << i));
+	}
+	QCOMPARE(Metrics::Histogram::upperBound(3), static_cast< quint64 >(7));
+}
+
+void TestMetrics::histogramOverflow() {
+	Metrics::Histogram histogram;
+	histogram.observe(std::numeric_limits< quint64 >::max() / 2);
+
+	const Metrics::Histogram::Totals totals = histogram.totals();
+	QCOMPARE(totals.count, static_cast< quint64 >(1));
+	QCOMPARE(totals.buckets[Metrics::Histogram::BUCKET_COUNT - 1], static_cast< quint64 >(1));
+}
+
+void TestMetrics::latencyBuckets() {
+	using Histogram = Metrics::LatencyHistogram;
+
+	// Every latency lies within its bucket, whose width is at most 1 / SUB_BUCKETS of the latencies it holds
+	for (quint64 micros = 0; micros < (static_cast< quint64 >(1) << Histogram::MAX_BITS); micros += 1 + micros / 64) {
+		const std::size_t bucket = Histogram::bucketOf(micros);
+		QVERIFY(bucket < Histogram::BUCKET_COUNT);
+		QVERIFY(micros <= Histogram::upperBound(bucket));
+		if (bucket > 0) {
+			QVERIFY(micros > Histogram::upperBound(bucket - 1));
+			const quint64 width = Histogram::upperBound(bucket) - Histogram::upperBound(bucket - 1);
+			QVERIFY(width <= 1 + micros / Histogram::SUB_BUCKETS);
+		}
+	}
+
+	QCOMPARE(Histogram::bucketOf(std::numeric_limits< quint64 >::max()), Histogram::BUCKET_COUNT - 1);
+}
+
+void TestMetrics::latencyPercentiles() {
+	std::unique_ptr< Metrics::LatencyHistogram > histogram = std::make_unique< Metrics::LatencyHistogram >();
+
+	for (quint64 micros = 1; micros <= 1000; ++micros) {
+		histogram->observe(micros);
+	}
+	histogram->observe(5000, 10);
+
+	// Nothing is reported before the period has ended
+	QCOMPARE(histogram->lastPeriod().count, static_cast< quint64 >(0));
+
+	histogram->rotate();
+	const Metrics::LatencyHistogram::Summary summary = histogram->lastPeriod();
+	QCOMPARE(summary.count, static_cast< quint64 >(1010));
+	QCOMPARE(summary.sum, static_cast< quint64 >(500500 + 50000));
+	QCOMPARE(summary.max, static_cast< quint64 >(5000));
+	QVERIFY(summary.p50 >= 505 && summary.p50 <= 505 + 505 / Metrics::LatencyHistogram::SUB_BUCKETS);
+	QVERIFY(summary.p99 >= 1000 && summary.p99 <= 1000 + 1000 / Metrics::LatencyHistogram::SUB_BUCKETS);
+	// Percentiles never exceed the maximum, even if their bucket does
+	QCOMPARE(summary.p999, static_cast< quint64 >(5000));
+
+	// The next period starts empty
+	histogram->rotate();
+	QCOMPARE(histogram->lastPeriod().count, static_cast< quint64 >(0));
+}
+
+QTEST_MAIN(TestMetrics)
+#include "TestMetrics.moc"
@@ -10,9 +10,12 @@
 #include <QObject>
 #include <QtTest>
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace Mumble {
 namespace Protocol {
@@ -77,6 +80,23 @@ namespace Protocol {
 		using UDPAudioEncoder< role >::getPreEncodedVolumeAdjustment;
 	};
 
+	template< Role role > class TestDecoder : public UDPDecoder< role > {
+	public:
+		using UDPDecoder< role >::UDPDecoder;
+		using typename UDPDecoder< role >::WireDecodeResult;
+
+		// Decode the given (header-less) audio message with either of the two decoders
+		WireDecodeResult decodeFast(const gsl::span< const byte > data) {
+			this->m_audioData = {};
+			return this->decodeAudio_protobufFast(data);
+		}
+
+		bool decodeGeneric(const gsl::span< const byte > data) {
+			this->m_audioData = {};
+			return this->decodeAudio_protobufGeneric(data);
+		}
+	};
+
 } // namespace Protocol
 } // namespace Mumble
 
@@ -102,6 +122,17 @@ template< Mumble::Protocol::Role encoderRole, Mumble::Protocol::Role decoderRole
 		QCOMPARE(decoder.getMessageType(), Mumble::Protocol::UDPMessageType::Ping);
 		QCOMPARE(decoder.getPingData(), data);
 
+		if (version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION) {
+			// Connectivity pings carry the quality of the link
+			Mumble::Protocol::PingData quality = data;
+			quality.packetLoss                 = 3;
+			quality.jitter                     = 12;
+			quality.bitrateHint                = 24000;
+
+			QVERIFY(decoder.decode(encoder.encodePingPacket(quality)));
+			QCOMPARE(decoder.getPingData(), quality);
+		}
+
 		// Extended ping (request)
 #ifdef _MSVC_LANG
 #	pragma warning(push)
@@ -148,6 +179,18 @@ void printData(gsl::span< const Mumble::Protocol::byte > data) {
 	qDebug() << str;
 }
 
+std::vector< Mumble::Protocol::byte > serialize(const MumbleUDP::Audio &msg) {
+#if GOOGLE_PROTOBUF_VERSION >= 3002000
+	// ByteSizeLong() was introduced in Protobuf v3.2 as a replacement for ByteSize()
+	std::vector< Mumble::Protocol::byte > buffer(msg.ByteSizeLong());
+#else
+	std::vector< Mumble::Protocol::byte > buffer(static_cast< std::size_t >(msg.ByteSize()));
+#endif
+	msg.SerializeWithCachedSizesToArray(buffer.data());
+
+	return buffer;
+}
+
 template< Mumble::Protocol::Role encoderRole, Mumble::Protocol::Role decoderRole > void do_test_audio() {
 	Mumble::Protocol::UDPAudioEncoder< encoderRole > encoder;
 	Mumble::Protocol::UDPDecoder< decoderRole > decoder;
@@ -177,6 +220,10 @@ template< Mumble::Protocol::Role encoderRole, Mumble::Protocol::Role decoderRole
 			// and only in the server->client direction
 			data.volumeAdjustment = VolumeAdjustment::fromFactor(1.4f);
 		}
+		if (version >= Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION) {
+			// Frames shorter than 10 ms are only supported by the new packet format as well (in either direction)
+			data.frameSize = 240;
+		}
 
 #ifdef _MSVC_LANG
 #	pragma warning(push)
@@ -259,6 +306,208 @@ private slots:
 		do_test_audio< Mumble::Protocol::Role::Server, Mumble::Protocol::Role::Client >();
 	}
 
+	void test_audio_alternating_formats() {
+		Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder;
+		Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > reference;
+
+		std::string payloadData = "I am the payload";
+
+		Mumble::Protocol::AudioData data;
+		data.payload = { reinterpret_cast< const Mumble::Protocol::byte * >(payloadData.c_str()), payloadData.size() };
+		data.frameNumber            = 7;
+		data.senderSession          = 42;
+		data.containsPositionalData = true;
+		data.position               = { 1, 2, 3 };
+
+		// The packet is only prepared once, while the receivers alternate between the packet formats and between
+		// getting the positional data and not getting it
+		encoder.prepareAudioPacket(data);
+		encoder.addPositionalData(data);
+
+		for (bool positional : { true, false, true }) {
+			data.containsPositionalData = positional;
+
+			for (Version::full_t version :
+				 { Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, Version::fromComponents(1, 3, 0),
+				   Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION, Version::fromComponents(1, 4, 0) }) {
+				data.targetOrContext = positional ? Mumble::Protocol::AudioContext::NORMAL
+												  : Mumble::Protocol::AudioContext::WHISPER;
+
+				encoder.setProtocolVersion(version);
+				reference.setProtocolVersion(version);
+
+				gsl::span< const Mumble::Protocol::byte > packet   = encoder.updateAudioPacket(data);
+				gsl::span< const Mumble::Protocol::byte > expected = reference.encodeAudioPacket(data);
+
+				QCOMPARE(packet.size(), expected.size());
+				QVERIFY(std::equal(packet.begin(), packet.end(), expected.begin()));
+
+				// Receivers that have been grouped by format may just as well pick it at compile time
+				packet = Mumble::Protocol::getPacketFormat(version) == Mumble::Protocol::PacketFormat::Legacy
+							 ? encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Legacy >(data)
+							 : encoder.updateAudioPacket< Mumble::Protocol::PacketFormat::Protobuf >(data);
+
+				QCOMPARE(packet.size(), expected.size());
+				QVERIFY(std::equal(packet.begin(), packet.end(), expected.begin()));
+			}
+		}
+	}
+
+	void test_audio_fast_decoder() {
+		Mumble::Protocol::TestDecoder< Mumble::Protocol::Role::Client > decoder(
+			Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+		using WireDecodeResult = Mumble::Protocol::TestDecoder< Mumble::Protocol::Role::Client >::WireDecodeResult;
+
+		MumbleUDP::Audio msg;
+		msg.set_target(12);
+		// target and context are a oneof, so this replaces the target
+		msg.set_context(Mumble::Protocol::AudioContext::WHISPER);
+		msg.set_sender_session(300);
+		msg.set_frame_number(std::numeric_limits< std::uint64_t >::max());
+		msg.set_frame_size(120);
+		msg.set_opus_data(std::string(200, 'x'));
+		msg.add_positional_data(1.5f);
+		msg.add_positional_data(-2.0f);
+		msg.add_positional_data(1e6f);
+		msg.set_volume_adjustment(0.5f);
+		msg.set_is_terminator(true);
+
+		std::vector< Mumble::Protocol::byte > buffer = serialize(msg);
+
+		QCOMPARE(decoder.decodeFast(buffer), WireDecodeResult::Decoded);
+		const Mumble::Protocol::AudioData fast = decoder.getAudioData();
+		QVERIFY(decoder.decodeGeneric(buffer));
+		QCOMPARE(fast, decoder.getAudioData());
+
+		QCOMPARE(fast.targetOrContext, static_cast< std::uint32_t >(Mumble::Protocol::AudioContext::WHISPER));
+		QVERIFY(fast.containsPositionalData);
+		QVERIFY(fast.isLastFrame);
+		QCOMPARE(fast.frameSize, 120u);
+		// The payload is not copied out of the packet
+		QVERIFY(fast.payload.data() > buffer.data() && fast.payload.data() < buffer.data() + buffer.size());
+
+		// Unpacked positional data is understood as well
+		std::vector< Mumble::Protocol::byte > unpacked = { (5 << 3) | 2, 1, 'x' };
+		for (float coordinate : { 1.0f, 2.0f, 3.0f }) {
+			unpacked.push_back((6 << 3) | 5);
+			const std::size_t offset = unpacked.size();
+			unpacked.resize(offset + sizeof(float));
+			std::memcpy(&unpacked[offset], &coordinate, sizeof(float));
+		}
+		QCOMPARE(decoder.decodeFast(unpacked), WireDecodeResult::Decoded);
+		QVERIFY(decoder.getAudioData().containsPositionalData);
+		QCOMPARE(decoder.getAudioData().position[2], 3.0f);
+
+		// Unknown fields are left to the generic parser, which is what decode() falls back to
+		std::vector< Mumble::Protocol::byte > extended = buffer;
+		extended.push_back(15 << 3);
+		extended.push_back(1);
+		QCOMPARE(decoder.decodeFast(extended), WireDecodeResult::Unsupported);
+		extended.insert(extended.begin(),
+						static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDPMessageType::Audio));
+		QVERIFY(decoder.decode(extended));
+		QCOMPARE(decoder.getAudioData(), fast);
+
+		// Truncated packets and packets without audio are invalid for both
+		const gsl::span< const Mumble::Protocol::byte > truncated(buffer.data(), buffer.size() - 1);
+		QCOMPARE(decoder.decodeFast(truncated), WireDecodeResult::Invalid);
+		QVERIFY(!decoder.decodeGeneric(truncated));
+
+		msg.clear_opus_data();
+		buffer = serialize(msg);
+		QCOMPARE(decoder.decodeFast(buffer), WireDecodeResult::Invalid);
+		QVERIFY(!decoder.decodeGeneric(buffer));
+	}
+
+	void test_audio_redundancy() {
+		Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder(
+			Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+		Mumble::Protocol::TestDecoder< Mumble::Protocol::Role::Client > decoder(
+			Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+		using WireDecodeResult = Mumble::Protocol::TestDecoder< Mumble::Protocol::Role::Client >::WireDecodeResult;
+
+		std::string payloadData   = "I am the payload";
+		std::string redundantData = "I was the payload";
+
+		Mumble::Protocol::AudioData data;
+		data.payload = { reinterpret_cast< const Mumble::Protocol::byte * >(payloadData.c_str()), payloadData.size() };
+		data.frameNumber   = 8;
+		data.senderSession = 42;
+
+		const gsl::span< const Mumble::Protocol::byte > redundantPayload = {
+			reinterpret_cast< const Mumble::Protocol::byte * >(redundantData.c_str()), redundantData.size()
+		};
+
+		encoder.prepareAudioPacket(data);
+
+		// The redundant payload is part of the variable part, so receivers with and without it may alternate
+		for (bool redundant : { true, false, true }) {
+			data.redundantPayload = redundant ? redundantPayload : gsl::span< const Mumble::Protocol::byte >();
+
+			const gsl::span< const Mumble::Protocol::byte > packet = encoder.updateAudioPacket(data);
+			// Skip the header byte
+			const std::vector< Mumble::Protocol::byte > message(packet.begin() + 1, packet.end());
+
+			QCOMPARE(decoder.decodeFast(message), WireDecodeResult::Decoded);
+			const Mumble::Protocol::AudioData fast = decoder.getAudioData();
+			QCOMPARE(fast, data);
+			QCOMPARE(fast.redundantPayload.size(), redundant ? redundantData.size() : 0);
+
+			QVERIFY(decoder.decodeGeneric(message));
+			QCOMPARE(decoder.getAudioData(), data);
+		}
+
+		// The legacy format has no room for it
+		encoder.setProtocolVersion(Version::fromComponents(1, 4, 0));
+		Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > legacyDecoder(Version::fromComponents(1, 4, 0));
+		QVERIFY(legacyDecoder.decode(encoder.updateAudioPacket(data)));
+		QVERIFY(legacyDecoder.getAudioData().redundantPayload.empty());
+	}
+
+	void test_audio_legacy_multi_frame() {
+		Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder(Version::fromComponents(1, 4, 0));
+		Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(Version::fromComponents(1, 4, 0));
+
+		// Every frame of the old codecs starts with a TOC byte holding its length, whose most significant bit tells
+		// whether another frame follows
+		const std::string frames = std::string("\x85" "aaaaa" "\x83" "bbb" "\x7F", 11) + std::string(0x7F, 'c');
+		const std::string terminated = std::string("\x82" "dd" "\x00", 4);
+
+		for (Mumble::Protocol::AudioCodec codec : { Mumble::Protocol::AudioCodec::CELT_Alpha,
+													Mumble::Protocol::AudioCodec::CELT_Beta,
+													Mumble::Protocol::AudioCodec::Speex }) {
+			for (bool isLastFrame : { false, true }) {
+				const std::string &payloadData = isLastFrame ? terminated : frames;
+
+				for (bool positional : { false, true }) {
+					Mumble::Protocol::AudioData data;
+					data.usedCodec = codec;
+					data.payload   = { reinterpret_cast< const Mumble::Protocol::byte * >(payloadData.data()),
+									   payloadData.size() };
+					data.frameNumber            = 3;
+					data.senderSession          = 42;
+					data.containsPositionalData = positional;
+					data.position               = { 1, 2, 3 };
+
+					encoder.prepareAudioPacket(data);
+					if (positional) {
+						encoder.addPositionalData(data);
+					}
+
+					// The payload covers all of the frames, including their headers, and nothing after them
+					QVERIFY(decoder.decode(encoder.updateAudioPacket(data)));
+					const Mumble::Protocol::AudioData &decoded = decoder.getAudioData();
+					QCOMPARE(decoded.usedCodec, codec);
+					QCOMPARE(std::string(reinterpret_cast< const char * >(decoded.payload.data()),
+										 decoded.payload.size()),
+							 payloadData);
+					QCOMPARE(decoded.isLastFrame, isLastFrame);
+					QCOMPARE(decoded.containsPositionalData, positional);
+				}
+			}
+		}
+	}
+
 	void test_preEncode_audio_context() {
 		Mumble::Protocol::TestAudioEncoder< Mumble::Protocol::Role::Server > encoder;
 
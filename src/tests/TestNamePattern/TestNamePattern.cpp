@@ -0,0 +1,76 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "NamePattern.h"
+
+/// The server's default pattern for user names
+static const QString USER_NAME = QLatin1String("[ -=\\w\\[\\]\\{\\}\\(\\)\\@\\|\\.]+");
+
+class TestNamePattern : public QObject {
+	Q_OBJECT
+private slots:
+	void defaultPattern();
+	void unicode();
+	void wholeName();
+	void alternatives();
+	void invalid();
+	void empty();
+};
+
+void TestNamePattern::defaultPattern() {
+	NamePattern pattern(USER_NAME);
+
+	QCOMPARE(pattern.pattern(), USER_NAME);
+	QVERIFY(pattern.exactMatch(QLatin1String("Some User (away)")));
+	QVERIFY(!pattern.exactMatch(QLatin1String("<b>")));
+	QVERIFY(!pattern.exactMatch(QString()));
+}
+
+void TestNamePattern::unicode() {
+	NamePattern pattern(USER_NAME);
+
+	// QRegExp's \w always matched any letter
+	QVERIFY(pattern.exactMatch(QString::fromUtf8("J\xc3\xbcrgen")));
+	QVERIFY(pattern.exactMatch(QString::fromUtf8("\xe5\xb1\xb1\xe7\x94\xb0")));
+}
+
+void TestNamePattern::wholeName() {
+	NamePattern pattern(QLatin1String("[a-z]+"));
+
+	QVERIFY(pattern.exactMatch(QLatin1String("abc")));
+	QVERIFY(!pattern.exactMatch(QLatin1String("abc1")));
+	QVERIFY(!pattern.exactMatch(QLatin1String("1abc")));
+	// A trailing newline would satisfy $
+	QVERIFY(!pattern.exactMatch(QLatin1String("abc\n")));
+}
+
+void TestNamePattern::alternatives() {
+	// The anchors have to apply to all alternatives
+	NamePattern pattern(QLatin1String("a|b"));
+
+	QVERIFY(pattern.exactMatch(QLatin1String("a")));
+	QVERIFY(pattern.exactMatch(QLatin1String("b")));
+	QVERIFY(!pattern.exactMatch(QLatin1String("ab")));
+}
+
+void TestNamePattern::invalid() {
+	NamePattern pattern(QLatin1String("[a-"));
+
+	QVERIFY(!pattern.exactMatch(QLatin1String("a")));
+	QVERIFY(!pattern.exactMatch(QLatin1String("[a-")));
+}
+
+void TestNamePattern::empty() {
+	NamePattern pattern;
+
+	QVERIFY(pattern.exactMatch(QString()));
+	QVERIFY(!pattern.exactMatch(QLatin1String("a")));
+}
+
+QTEST_MAIN(TestNamePattern)
+#include "TestNamePattern.moc"
@@ -0,0 +1,163 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "OggOpusWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+struct Page {
+	char type            = 0;
+	quint64 granule      = 0;
+	quint32 sequence     = 0;
+	unsigned int packets = 0;
+	bool continued       = false;
+	QByteArray firstPacket;
+};
+
+quint32 checksum(QByteArray page) {
+	page[22] = page[23] = page[24] = page[25] = 0;
+
+	quint32 crc = 0;
+	for (const char byte : page) {
+		crc ^= static_cast< quint32 >(static_cast< unsigned char >(byte)) << 24;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+		}
+	}
+
+	return crc;
+}
+
+/// Splits the stream into its pages, checking their framing on the way
+QList< Page > parse(const QByteArray &data) {
+	QList< Page > pages;
+
+	int pos = 0;
+	while (pos < data.size()) {
+		if (data.size() - pos < 27 || data.mid(pos, 4) != "OggS") {
+			return {};
+		}
+
+		const int segments = static_cast< unsigned char >(data[pos + 26]);
+		int size           = 0;
+		Page page;
+		for (int i = 0; i < segments; ++i) {
+			const int lacing = static_cast< unsigned char >(data[pos + 27 + i]);
+			if (page.packets == 0 && lacing < 255) {
+				page.firstPacket = data.mid(pos + 27 + segments, size + lacing);
+			}
+			size += lacing;
+			if (lacing < 255) {
+				++page.packets;
+			}
+			page.continued = lacing == 255;
+		}
+
+		const QByteArray raw = data.mid(pos, 27 + segments + size);
+		page.type            = raw[5];
+		page.granule         = qFromLittleEndian< quint64 >(raw.constData() + 6);
+		page.sequence        = qFromLittleEndian< quint32 >(raw.constData() + 18);
+		if (checksum(raw) != qFromLittleEndian< quint32 >(raw.constData() + 22)) {
+			return {};
+		}
+
+		pages.append(page);
+		pos += raw.size();
+	}
+
+	return pages;
+}
+} // namespace
+
+class TestOggOpusWriter : public QObject {
+	Q_OBJECT
+private slots:
+	void stream();
+	void invalidFormat();
+};
+
+void TestOggOpusWriter::stream() {
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+
+	// Three seconds and a bit of a tone, written in chunks that don't line up with the packets
+	const std::size_t frames = 3 * 48000 + 123;
+	std::vector< float > samples(frames);
+	for (std::size_t i = 0; i < frames; ++i) {
+		samples[i] = 0.5f * std::sin(static_cast< float >(i) * 0.05f);
+	}
+
+	{
+		OggOpusWriter writer(buffer, 48000, 1, QLatin1String("alice"));
+		QVERIFY(writer.isValid());
+
+		for (std::size_t offset = 0; offset < frames; offset += 441) {
+			QVERIFY(writer.write(samples.data() + offset, std::min< std::size_t >(441, frames - offset)));
+		}
+		QVERIFY(writer.finish());
+		// Finishing twice is harmless
+		QVERIFY(writer.finish());
+	}
+
+	const QList< Page > pages = parse(buffer.data());
+	QVERIFY(pages.size() > 3);
+
+	// The headers are each on a page of their own, the first one starting the stream
+	QCOMPARE(pages[0].type, static_cast< char >(0x02));
+	QCOMPARE(pages[0].packets, 1u);
+	QVERIFY(pages[0].firstPacket.startsWith("OpusHead"));
+	QCOMPARE(static_cast< int >(pages[0].firstPacket[9]), 1);
+	const unsigned int preSkip = qFromLittleEndian< quint16 >(pages[0].firstPacket.constData() + 10);
+	QCOMPARE(qFromLittleEndian< quint32 >(pages[0].firstPacket.constData() + 12), 48000u);
+
+	QCOMPARE(pages[1].packets, 1u);
+	QVERIFY(pages[1].firstPacket.startsWith("OpusTags"));
+	QVERIFY(pages[1].firstPacket.contains("TITLE=alice"));
+	QCOMPARE(pages[1].granule, static_cast< quint64 >(0));
+
+	unsigned int packets = 0;
+	for (int i = 0; i < pages.size(); ++i) {
+		QCOMPARE(pages[i].sequence, static_cast< quint32 >(i));
+		QVERIFY(!pages[i].continued);
+		if (i >= 2) {
+			packets += pages[i].packets;
+			QVERIFY(pages[i].granule >= pages[i - 1].granule);
+		}
+	}
+
+	// Only the last page ends the stream, and its position trims the padding
+	for (int i = 0; i < pages.size() - 1; ++i) {
+		QVERIFY(!(pages[i].type & 0x04));
+	}
+	QVERIFY(pages.last().type & 0x04);
+	QCOMPARE(pages.last().granule, static_cast< quint64 >(frames + preSkip));
+
+	// Enough packets of 20 ms to cover the frames, including the ones to skip
+	QCOMPARE(packets, static_cast< unsigned int >((frames + preSkip + 959) / 960));
+}
+
+void TestOggOpusWriter::invalidFormat() {
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+
+	OggOpusWriter rate(buffer, 44100, 1, QString());
+	QVERIFY(!rate.isValid());
+	OggOpusWriter channels(buffer, 48000, 3, QString());
+	QVERIFY(!channels.isValid());
+
+	const float sample = 0.0f;
+	QVERIFY(!rate.write(&sample, 1));
+	QVERIFY(!rate.finish());
+	QCOMPARE(buffer.size(), static_cast< qint64 >(0));
+}
+
+QTEST_MAIN(TestOggOpusWriter)
+#include "TestOggOpusWriter.moc"
@@ -0,0 +1,112 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtGui>
+#include <QtTest>
+
+#include "OverlayAssetCache.h"
+
+class TestOverlayAssetCache : public QObject {
+	Q_OBJECT
+private slots:
+	void bucket();
+	void avatar();
+	void avatarKeys();
+	void image();
+	void text();
+	void invalid();
+};
+
+static QByteArray textureOf(const QColor &color) {
+	QImage img(64, 32, QImage::Format_ARGB32);
+	img.fill(color);
+
+	QByteArray texture;
+	QBuffer qb(&texture);
+	qb.open(QIODevice::WriteOnly);
+	img.save(&qb, "PNG");
+	return texture;
+}
+
+void TestOverlayAssetCache::bucket() {
+	QCOMPARE(OverlayAssetCache::bucket(QSize(30, 33)), QSize(32, 32));
+	QCOMPARE(OverlayAssetCache::bucket(QSize(29, 34)), QSize(28, 36));
+	QCOMPARE(OverlayAssetCache::bucket(QSize(1, 0)), QSize(4, 4));
+}
+
+void TestOverlayAssetCache::avatar() {
+	OverlayAssetCache cache;
+	const QByteArray texture = textureOf(Qt::red);
+
+	const QPixmap first = cache.avatar("hash", texture, "PNG", QSize(32, 32));
+	// A slightly different size falls into the same bucket
+	const QPixmap second = cache.avatar("hash", texture, "PNG", QSize(31, 33));
+
+	QVERIFY(!first.isNull());
+	// The texture is scaled into the size, keeping its aspect ratio
+	QCOMPARE(first.size(), QSize(32, 16));
+	QCOMPARE(first.cacheKey(), second.cacheKey());
+	QCOMPARE(cache.size(), 1);
+}
+
+void TestOverlayAssetCache::avatarKeys() {
+	OverlayAssetCache cache;
+	const QByteArray texture = textureOf(Qt::red);
+
+	const QPixmap pm = cache.avatar("hash", texture, "PNG", QSize(32, 32));
+
+	QVERIFY(cache.avatar("other", texture, "PNG", QSize(32, 32)).cacheKey() != pm.cacheKey());
+	QCOMPARE(cache.avatar("hash", texture, "PNG", QSize(64, 64)).size(), QSize(64, 32));
+	QCOMPARE(cache.size(), 3);
+
+	cache.clear();
+	QCOMPARE(cache.size(), 0);
+}
+
+void TestOverlayAssetCache::image() {
+	QTemporaryFile file(QDir::tempPath() + QLatin1String("/XXXXXX.png"));
+	QVERIFY(file.open());
+	file.write(textureOf(Qt::blue));
+	file.close();
+
+	OverlayAssetCache cache;
+
+	const QPixmap first  = cache.image(file.fileName(), QSize(16, 16));
+	const QPixmap second = cache.image(file.fileName(), QSize(16, 16));
+
+	QCOMPARE(first.size(), QSize(16, 8));
+	QCOMPARE(first.cacheKey(), second.cacheKey());
+}
+
+void TestOverlayAssetCache::text() {
+	OverlayAssetCache cache;
+	const QFont font;
+
+	const BasepointPixmap first  = cache.text(QLatin1String("Name"), font, QSize(100, 20), Qt::white);
+	const BasepointPixmap second = cache.text(QLatin1String("Name"), font, QSize(100, 20), Qt::white);
+
+	QVERIFY(!first.isNull());
+	QCOMPARE(first.cacheKey(), second.cacheKey());
+	// The base point is kept as well
+	QCOMPARE(first.qpBasePoint, second.qpBasePoint);
+
+	QVERIFY(cache.text(QLatin1String("Name"), font, QSize(100, 20), Qt::red).cacheKey() != first.cacheKey());
+	QVERIFY(cache.text(QLatin1String("Other"), font, QSize(100, 20), Qt::white).cacheKey() != first.cacheKey());
+	QCOMPARE(cache.size(), 3);
+}
+
+void TestOverlayAssetCache::invalid() {
+	OverlayAssetCache cache;
+
+	// Nothing that can't be rendered is cached
+	QVERIFY(cache.avatar("hash", "not an image", "PNG", QSize(32, 32)).isNull());
+	QVERIFY(cache.avatar("hash", textureOf(Qt::red), "PNG", QSize()).isNull());
+	QVERIFY(cache.text(QString(), QFont(), QSize(100, 20), Qt::white).isNull());
+	QCOMPARE(cache.size(), 0);
+}
+
+QTEST_MAIN(TestOverlayAssetCache)
+#include "TestOverlayAssetCache.moc"
@@ -15,6 +15,10 @@ class TestPacketDataStream : public QObject {
 private slots:
 	void integer();
 	void integer_data();
+	void truncatedInteger();
+	void truncatedInteger_data();
+	void truncatedEncodings();
+	void truncatedEncodings_data();
 	void string();
 	void string_data();
 	void space();
@@ -89,6 +93,63 @@ void TestPacketDataStream::integer() {
 	QVERIFY(in.left() == 0);
 }
 
+void TestPacketDataStream::truncatedInteger_data() {
+	integer_data();
+}
+
+void TestPacketDataStream::truncatedInteger() {
+	QFETCH(quint64, value);
+
+	char buff[256];
+	quint64 v = 42;
+	PacketDataStream out(buff, 256);
+	out << value;
+	PacketDataStream in(buff, out.size() - 1);
+	in >> v;
+
+	// The missing byte is read as a zero, just like any other byte beyond the end of the stream
+	buff[out.size() - 1] = 0;
+	quint64 expected;
+	PacketDataStream padded(buff, out.size());
+	padded >> expected;
+
+	QCOMPARE(v, expected);
+	QVERIFY(!in.isValid());
+	QVERIFY(in.left() == 0);
+
+	// Which also goes for everything that is read afterwards
+	v = 42;
+	in >> v;
+	QCOMPARE(v, 0ULL);
+	QVERIFY(!in.isValid());
+}
+
+void TestPacketDataStream::truncatedEncodings_data() {
+	QTest::addColumn< QByteArray >("encoding");
+	QTest::addColumn< quint64 >("value");
+	QTest::newRow("Empty") << QByteArray() << 0ULL;
+	QTest::newRow("2 bytes") << QByteArray("\x81", 1) << 0x100ULL;
+	QTest::newRow("3 bytes") << QByteArray("\xC1\x23", 2) << 0x12300ULL;
+	QTest::newRow("4 bytes") << QByteArray("\xE1", 1) << 0x1000000ULL;
+	QTest::newRow("32-bit") << QByteArray("\xF0\x12\x34\x56", 4) << 0x12345600ULL;
+	QTest::newRow("64-bit") << QByteArray("\xF4\x12", 2) << 0x1200000000000000ULL;
+	QTest::newRow("Negative") << QByteArray("\xF8", 1) << ~0ULL;
+	QTest::newRow("Negative 2 bytes") << QByteArray("\xF8\x81", 2) << ~0x100ULL;
+}
+
+void TestPacketDataStream::truncatedEncodings() {
+	QFETCH(QByteArray, encoding);
+	QFETCH(quint64, value);
+
+	quint64 v = 42;
+	PacketDataStream in(encoding.constData(), static_cast< unsigned int >(encoding.size()));
+	in >> v;
+
+	QCOMPARE(v, value);
+	QVERIFY(!in.isValid());
+	QVERIFY(in.left() == 0);
+}
+
 void TestPacketDataStream::string_data() {
 	QTest::addColumn< QString >("string");
 	QTest::newRow("Empty") << QString("");
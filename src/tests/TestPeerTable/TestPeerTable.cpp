@@ -0,0 +1,180 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "HostAddress.h"
+
+#ifdef Q_OS_WIN
+#	include "win.h"
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <arpa/inet.h>
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#endif
+
+#include <cstring>
+
+class TestPeerTable : public QObject {
+	Q_OBJECT
+private slots:
+	void keyFromSockaddr();
+	void keyEquals();
+	void lookupEmpty();
+	void insertLookup();
+	void insertReplaces();
+	void remove();
+	void grow();
+	void churn();
+};
+
+void TestPeerTable::keyFromSockaddr() {
+	sockaddr_storage storage;
+	memset(&storage, 0, sizeof(storage));
+
+	sockaddr_in *in     = reinterpret_cast< sockaddr_in * >(&storage);
+	in->sin_family      = AF_INET;
+	in->sin_port        = htons(64738);
+	in->sin_addr.s_addr = htonl(0x7F000001);
+
+	const PeerKey v4(storage);
+	QVERIFY(v4 == PeerKey(HostAddress(QHostAddress("127.0.0.1")), htons(64738)));
+	QCOMPARE(v4.hash(), PeerKey(HostAddress(QHostAddress("127.0.0.1")), htons(64738)).hash());
+
+	memset(&storage, 0, sizeof(storage));
+	sockaddr_in6 *in6 = reinterpret_cast< sockaddr_in6 * >(&storage);
+	in6->sin6_family  = AF_INET6;
+	in6->sin6_port    = htons(443);
+	in6->sin6_addr    = in6addr_loopback;
+
+	const PeerKey v6(storage);
+	QVERIFY(v6 == PeerKey(HostAddress(QHostAddress("::1")), htons(443)));
+	QVERIFY(!(v6 == v4));
+}
+
+void TestPeerTable::keyEquals() {
+	const HostAddress address(QHostAddress("10.0.0.1"));
+
+	QVERIFY(PeerKey(address, 1) == PeerKey(address, 1));
+	QVERIFY(!(PeerKey(address, 1) == PeerKey(address, 2)));
+	QVERIFY(!(PeerKey(address, 1) == PeerKey(HostAddress(QHostAddress("10.0.0.2")), 1)));
+}
+
+void TestPeerTable::lookupEmpty() {
+	PeerTable< int * > table;
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(0));
+	QVERIFY(table.lookup(PeerKey()) == nullptr);
+
+	// Removing from an empty table is a no-op
+	table.remove(PeerKey());
+	QCOMPARE(table.size(), static_cast< std::size_t >(0));
+}
+
+void TestPeerTable::insertLookup() {
+	PeerTable< int * > table;
+	int a = 0;
+	int b = 0;
+
+	const PeerKey keyA(HostAddress(QHostAddress("127.0.0.1")), 1000);
+	const PeerKey keyB(HostAddress(QHostAddress("127.0.0.1")), 1001);
+
+	table.insert(keyA, &a);
+	table.insert(keyB, &b);
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(2));
+	QVERIFY(table.lookup(keyA) == &a);
+	QVERIFY(table.lookup(keyB) == &b);
+	QVERIFY(table.lookup(PeerKey(HostAddress(QHostAddress("127.0.0.2")), 1000)) == nullptr);
+}
+
+void TestPeerTable::insertReplaces() {
+	PeerTable< int * > table;
+	int a = 0;
+	int b = 0;
+
+	const PeerKey key(HostAddress(QHostAddress("::1")), 64738);
+
+	table.insert(key, &a);
+	table.insert(key, &b);
+	table.reclaim();
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(1));
+	QVERIFY(table.lookup(key) == &b);
+}
+
+void TestPeerTable::remove() {
+	PeerTable< int * > table;
+	int a = 0;
+	int b = 0;
+
+	const PeerKey keyA(HostAddress(QHostAddress("192.168.0.1")), 1);
+	const PeerKey keyB(HostAddress(QHostAddress("192.168.0.2")), 1);
+
+	table.insert(keyA, &a);
+	table.insert(keyB, &b);
+	table.remove(keyA);
+	table.reclaim();
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(1));
+	QVERIFY(table.lookup(keyA) == nullptr);
+	QVERIFY(table.lookup(keyB) == &b);
+
+	// Removing a peer that isn't contained doesn't change anything
+	table.remove(keyA);
+	QCOMPARE(table.size(), static_cast< std::size_t >(1));
+}
+
+void TestPeerTable::grow() {
+	PeerTable< std::size_t > table;
+
+	const HostAddress address(QHostAddress("10.0.0.1"));
+	for (std::size_t i = 1; i <= 1000; ++i) {
+		table.insert(PeerKey(address, static_cast< std::uint16_t >(i)), i);
+	}
+	table.reclaim();
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(1000));
+	for (std::size_t i = 1; i <= 1000; ++i) {
+		QCOMPARE(table.lookup(PeerKey(address, static_cast< std::uint16_t >(i))), i);
+	}
+	QCOMPARE(table.lookup(PeerKey(address, 1001)), static_cast< std::size_t >(0));
+}
+
+void TestPeerTable::churn() {
+	PeerTable< std::size_t > table;
+
+	// Peers connecting and disconnecting over and over leave tombstones behind, which must neither hide
+	// other peers nor make the table grow without bounds
+	const HostAddress address(QHostAddress("10.0.0.1"));
+	const PeerKey stable(HostAddress(QHostAddress("10.0.0.2")), 1);
+	table.insert(stable, 1);
+
+	for (std::size_t i = 1; i <= 10000; ++i) {
+		const PeerKey key(address, static_cast< std::uint16_t >(i));
+		table.insert(key, i);
+		QCOMPARE(table.lookup(key), i);
+		QCOMPARE(table.lookup(stable), static_cast< std::size_t >(1));
+
+		table.remove(key);
+		QCOMPARE(table.lookup(key), static_cast< std::size_t >(0));
+		table.reclaim();
+	}
+
+	QCOMPARE(table.size(), static_cast< std::size_t >(1));
+
+	// A removed peer can be inserted again
+	table.remove(stable);
+	QCOMPARE(table.size(), static_cast< std::size_t >(0));
+	table.insert(stable, 2);
+	QCOMPARE(table.size(), static_cast< std::size_t >(1));
+	QCOMPARE(table.lookup(stable), static_cast< std::size_t >(2));
+}
+
+QTEST_MAIN(TestPeerTable)
+#include "TestPeerTable.moc"
@@ -0,0 +1,184 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "PermissionCache.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// The cache never dereferences the pointers, so any distinct addresses will do
+static const User *user(std::uintptr_t i) {
+	return reinterpret_cast< const User * >((i + 1) * 64);
+}
+
+static const Channel *channel(std::uintptr_t i) {
+	return reinterpret_cast< const Channel * >((i + 1) * 128);
+}
+
+class TestPermissionCache : public QObject {
+	Q_OBJECT
+private slots:
+	void storeAndLookup();
+	void invalidateUser();
+	void invalidateChannel();
+	void invalidateAll();
+	void staleStore();
+	void eviction();
+	void concurrentAccess();
+};
+
+void TestPermissionCache::storeAndLookup() {
+	PermissionCache cache;
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	QVERIFY(!cache.lookup(user(0), channel(0), permissions, &stamp));
+	cache.store(user(0), channel(0), stamp, 42);
+
+	QVERIFY(cache.lookup(user(0), channel(0), permissions));
+	QCOMPARE(permissions, 42u);
+
+	// The key consists of both the user and the channel
+	QVERIFY(!cache.lookup(user(1), channel(0), permissions));
+	QVERIFY(!cache.lookup(user(0), channel(1), permissions));
+
+	// Storing again replaces the entry
+	cache.store(user(0), channel(0), stamp, 7);
+	QVERIFY(cache.lookup(user(0), channel(0), permissions));
+	QCOMPARE(permissions, 7u);
+}
+
+void TestPermissionCache::invalidateUser() {
+	PermissionCache cache;
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	for (std::uintptr_t i = 0; i < 2; ++i) {
+		QVERIFY(!cache.lookup(user(i), channel(0), permissions, &stamp));
+		cache.store(user(i), channel(0), stamp, 1);
+	}
+
+	cache.invalidateUser(user(0));
+
+	QVERIFY(!cache.lookup(user(0), channel(0), permissions));
+	QVERIFY(cache.lookup(user(1), channel(0), permissions));
+}
+
+void TestPermissionCache::invalidateChannel() {
+	PermissionCache cache;
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	for (std::uintptr_t i = 0; i < 2; ++i) {
+		QVERIFY(!cache.lookup(user(0), channel(i), permissions, &stamp));
+		cache.store(user(0), channel(i), stamp, 1);
+	}
+
+	cache.invalidateChannel(channel(1));
+
+	QVERIFY(cache.lookup(user(0), channel(0), permissions));
+	QVERIFY(!cache.lookup(user(0), channel(1), permissions, &stamp));
+
+	// The channel can be cached again right away
+	cache.store(user(0), channel(1), stamp, 2);
+	QVERIFY(cache.lookup(user(0), channel(1), permissions));
+	QCOMPARE(permissions, 2u);
+}
+
+void TestPermissionCache::invalidateAll() {
+	PermissionCache cache;
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	for (std::uintptr_t i = 0; i < 4; ++i) {
+		QVERIFY(!cache.lookup(user(i), channel(i), permissions, &stamp));
+		cache.store(user(i), channel(i), stamp, 1);
+	}
+
+	cache.invalidateAll();
+
+	for (std::uintptr_t i = 0; i < 4; ++i) {
+		QVERIFY(!cache.lookup(user(i), channel(i), permissions));
+	}
+}
+
+void TestPermissionCache::staleStore() {
+	PermissionCache cache;
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	// Permissions that have been evaluated before an invalidation must not be used afterwards
+	QVERIFY(!cache.lookup(user(0), channel(0), permissions, &stamp));
+	cache.invalidateChannel(channel(0));
+	cache.store(user(0), channel(0), stamp, 1);
+
+	QVERIFY(!cache.lookup(user(0), channel(0), permissions));
+}
+
+void TestPermissionCache::eviction() {
+	PermissionCache cache(64);
+	PermissionCache::Stamp stamp;
+	unsigned int permissions = 0;
+
+	for (std::uintptr_t i = 0; i < 1000; ++i) {
+		QVERIFY(!cache.lookup(user(i), channel(0), permissions, &stamp));
+		cache.store(user(i), channel(0), stamp, static_cast< unsigned int >(i));
+	}
+
+	// Entries may have been evicted, but the ones that are left have to be correct
+	int hits = 0;
+	for (std::uintptr_t i = 0; i < 1000; ++i) {
+		if (cache.lookup(user(i), channel(0), permissions)) {
+			QCOMPARE(permissions, static_cast< unsigned int >(i));
+			++hits;
+		}
+	}
+	QVERIFY(hits > 0);
+	QVERIFY(hits <= 64);
+}
+
+void TestPermissionCache::concurrentAccess() {
+	PermissionCache cache(256);
+	std::atomic< bool > failed(false);
+
+	auto expected = [](std::uintptr_t u, std::uintptr_t c) { return static_cast< unsigned int >(u * 1000 + c); };
+
+	std::vector< std::thread > threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&cache, &failed, &expected, t]() {
+			for (std::uintptr_t i = 0; i < 100000; ++i) {
+				const std::uintptr_t u = i % 300;
+				const std::uintptr_t c = i % 7;
+
+				PermissionCache::Stamp stamp;
+				unsigned int permissions = 0;
+				if (cache.lookup(user(u), channel(c), permissions, &stamp)) {
+					if (permissions != expected(u, c)) {
+						failed = true;
+					}
+				} else {
+					cache.store(user(u), channel(c), stamp, expected(u, c));
+				}
+
+				if (t == 0 && i % 1000 == 0) {
+					cache.invalidateChannel(channel(c));
+				}
+			}
+		});
+	}
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	QVERIFY(!failed);
+}
+
+QTEST_MAIN(TestPermissionCache)
+#include "TestPermissionCache.moc"
@@ -0,0 +1,166 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "PingResponder.h"
+
+#ifdef Q_OS_WIN
+#	include <ws2tcpip.h>
+#else
+#	include <arpa/inet.h>
+#	include <netinet/in.h>
+#endif
+
+#include <cstring>
+
+namespace {
+constexpr quint64 SECOND = 1000000;
+
+sockaddr_storage address(const char *text) {
+	sockaddr_storage storage;
+	memset(&storage, 0, sizeof(storage));
+
+	if (strchr(text, ':')) {
+		sockaddr_in6 *v6 = reinterpret_cast< sockaddr_in6 * >(&storage);
+		v6->sin6_family  = AF_INET6;
+		inet_pton(AF_INET6, text, &v6->sin6_addr);
+	} else {
+		sockaddr_in *v4 = reinterpret_cast< sockaddr_in * >(&storage);
+		v4->sin_family  = AF_INET;
+		inet_pton(AF_INET, text, &v4->sin_addr);
+	}
+
+	return storage;
+}
+
+/// Decodes the given reply the way clients do
+Mumble::Protocol::PingData decode(const Mumble::Protocol::byte *data, std::size_t size, bool protobuf) {
+	Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder;
+	decoder.setProtocolVersion(protobuf ? Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION
+										: Version::fromComponents(1, 4, 0));
+	if (!decoder.decode(gsl::span< const Mumble::Protocol::byte >(data, size))
+		|| decoder.getMessageType() != Mumble::Protocol::UDPMessageType::Ping) {
+		return {};
+	}
+
+	return decoder.getPingData();
+}
+} // namespace
+
+class TestPingResponder : public QObject {
+	Q_OBJECT
+private slots:
+	void legacy();
+	void protobuf();
+	void limits();
+	void prefixes();
+};
+
+void TestPingResponder::legacy() {
+	PingResponder responder;
+
+	PingResponder::Details details;
+	details.version      = Version::fromComponents(1, 5, 634);
+	details.userCount    = 12;
+	details.maxUserCount = 100;
+	details.maxBandwidth = 558000;
+	responder.update(details);
+
+	std::array< Mumble::Protocol::byte, PingResponder::MAX_REPLY_SIZE > buffer;
+	const std::size_t size = responder.reply(0x0123456789abcdefULL, false, buffer.data());
+	QCOMPARE(size, static_cast< std::size_t >(24));
+
+	const Mumble::Protocol::PingData data = decode(buffer.data(), size, false);
+	// The legacy format only holds the major and minor versions and patch levels up to 255
+	QCOMPARE(data.serverVersion, Version::fromLegacyVersion(Version::toLegacyVersion(details.version)));
+	QCOMPARE(data.timestamp, static_cast< std::uint64_t >(0x0123456789abcdefULL));
+	QCOMPARE(data.userCount, 12u);
+	QCOMPARE(data.maxUserCount, 100u);
+	QCOMPARE(data.maxBandwidthPerUser, 558000u);
+
+	// Updates are picked up by the next reply
+	details.userCount = 13;
+	responder.update(details);
+	QCOMPARE(decode(buffer.data(), responder.reply(1, false, buffer.data()), false).userCount, 13u);
+}
+
+void TestPingResponder::protobuf() {
+	PingResponder responder;
+
+	PingResponder::Details details;
+	details.version      = Version::fromComponents(1, 6, 0);
+	details.userCount    = 3;
+	details.maxUserCount = 4294967295u;
+	details.maxBandwidth = 558000;
+	responder.update(details);
+
+	std::array< Mumble::Protocol::byte, PingResponder::MAX_REPLY_SIZE > buffer;
+	for (std::uint64_t timestamp : { static_cast< std::uint64_t >(0), static_cast< std::uint64_t >(127),
+									 static_cast< std::uint64_t >(128), ~static_cast< std::uint64_t >(0) }) {
+		const std::size_t size = responder.reply(timestamp, true, buffer.data());
+		QVERIFY(size <= PingResponder::MAX_REPLY_SIZE);
+		QCOMPARE(buffer[0], static_cast< Mumble::Protocol::byte >(Mumble::Protocol::UDPMessageType::Ping));
+
+		const Mumble::Protocol::PingData data = decode(buffer.data(), size, true);
+		QVERIFY(data.containsAdditionalInformation);
+		QCOMPARE(data.timestamp, timestamp);
+		QCOMPARE(data.serverVersion, details.version);
+		QCOMPARE(data.userCount, 3u);
+		QCOMPARE(data.maxUserCount, 4294967295u);
+		QCOMPARE(data.maxBandwidthPerUser, 558000u);
+	}
+}
+
+void TestPingResponder::limits() {
+	PingRateLimiter limiter(2, 3);
+	const sockaddr_storage source = address("192.0.2.1");
+	const sockaddr_storage other  = address("198.51.100.7");
+
+	quint64 now = 100 * SECOND;
+	// The burst is answered at once
+	QVERIFY(limiter.allow(source, now));
+	QVERIFY(limiter.allow(source, now));
+	QVERIFY(limiter.allow(source, now));
+	QVERIFY(!limiter.allow(source, now));
+	// Other sources have limits of their own
+	QVERIFY(limiter.allow(other, now));
+
+	// Afterwards, pings are answered at the configured rate
+	now += SECOND / 2;
+	QVERIFY(limiter.allow(source, now));
+	QVERIFY(!limiter.allow(source, now));
+
+	// Being quiet replenishes the burst
+	now += 10 * SECOND;
+	for (int i = 0; i < 3; ++i) {
+		QVERIFY(limiter.allow(source, now));
+	}
+	QVERIFY(!limiter.allow(source, now));
+
+	// A rate of 0 disables the limit
+	limiter.configure(0, 3);
+	for (int i = 0; i < 100; ++i) {
+		QVERIFY(limiter.allow(source, now));
+	}
+}
+
+void TestPingResponder::prefixes() {
+	PingRateLimiter limiter(1, 1);
+	const quint64 now = 100 * SECOND;
+
+	// Hosts of the same /64 network share their limit
+	QVERIFY(limiter.allow(address("2001:db8:1:2::1"), now));
+	QVERIFY(!limiter.allow(address("2001:db8:1:2::ffff"), now));
+	QVERIFY(limiter.allow(address("2001:db8:1:3::1"), now));
+
+	// IPv4 sources are the same whether they are received by a dual-stack socket or not
+	QVERIFY(limiter.allow(address("203.0.113.5"), now));
+	QVERIFY(!limiter.allow(address("::ffff:203.0.113.5"), now));
+}
+
+QTEST_MAIN(TestPingResponder)
+#include "TestPingResponder.moc"
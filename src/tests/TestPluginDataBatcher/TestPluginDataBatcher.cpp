@@ -0,0 +1,183 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "MumbleConstants.h"
+#include "PluginDataBatcher.h"
+#include "ProtoUtils.h"
+
+#include <vector>
+
+class TestPluginDataBatcher : public QObject {
+	Q_OBJECT
+private slots:
+	void init();
+
+	void disabled();
+	void single();
+	void batch();
+	void window();
+	void limit();
+	void disable();
+	void invalid();
+
+private:
+	struct Sent {
+		Mumble::Protocol::TCPMessageType type;
+		MumbleProto::PluginDataTransmission transmission;
+		MumbleProto::PluginDataBatch batch;
+	};
+	std::vector< Sent > m_sent;
+
+	PluginDataBatcher::Sender sender();
+};
+
+static MumbleProto::PluginDataTransmission transmissionOf(const std::string &data) {
+	MumbleProto::PluginDataTransmission mpdt;
+	mpdt.set_sendersession(1);
+	mpdt.add_receiversessions(2);
+	mpdt.set_data(data);
+	mpdt.set_dataid("test");
+	return mpdt;
+}
+
+PluginDataBatcher::Sender TestPluginDataBatcher::sender() {
+	return [this](const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
+		Sent sent;
+		sent.type = type;
+		if (type == Mumble::Protocol::TCPMessageType::PluginDataBatch) {
+			sent.batch.CopyFrom(msg);
+		} else {
+			sent.transmission.CopyFrom(msg);
+		}
+		m_sent.push_back(sent);
+	};
+}
+
+void TestPluginDataBatcher::init() {
+	m_sent.clear();
+}
+
+void TestPluginDataBatcher::disabled() {
+	PluginDataBatcher batcher(sender());
+
+	batcher.send(transmissionOf("first"));
+	batcher.send(transmissionOf("second"));
+
+	// Without batching, every message is sent right away
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(2));
+	QVERIFY(m_sent[1].type == Mumble::Protocol::TCPMessageType::PluginDataTransmission);
+	QCOMPARE(m_sent[1].transmission.data(), std::string("second"));
+	QCOMPARE(batcher.pendingCount(), 0);
+}
+
+void TestPluginDataBatcher::single() {
+	PluginDataBatcher batcher(sender());
+	batcher.setEnabled(true);
+
+	batcher.send(transmissionOf("only"));
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(0));
+
+	// A single message isn't wrapped in a batch
+	batcher.flush();
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(1));
+	QVERIFY(m_sent[0].type == Mumble::Protocol::TCPMessageType::PluginDataTransmission);
+	QCOMPARE(m_sent[0].transmission.data(), std::string("only"));
+}
+
+void TestPluginDataBatcher::batch() {
+	PluginDataBatcher batcher(sender());
+	batcher.setEnabled(true);
+
+	for (int i = 0; i < 10; i++) {
+		batcher.send(transmissionOf(std::string(100, static_cast< char >('a' + i))));
+	}
+	QCOMPARE(batcher.pendingCount(), 10);
+
+	batcher.flush();
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(1));
+	QVERIFY(m_sent[0].type == Mumble::Protocol::TCPMessageType::PluginDataBatch);
+	// The repetitive data compresses well
+	QVERIFY(m_sent[0].batch.compression() == MumbleProto::PluginDataBatch_Compression_Zlib);
+
+	std::vector< MumbleProto::PluginDataTransmission > transmissions;
+	QVERIFY(MumbleProto::getPluginDataBatchTransmissions(m_sent[0].batch, transmissions));
+	QCOMPARE(transmissions.size(), static_cast< std::size_t >(10));
+	for (std::size_t i = 0; i < transmissions.size(); i++) {
+		QCOMPARE(transmissions[i].data(), std::string(100, static_cast< char >('a' + i)));
+		QCOMPARE(transmissions[i].receiversessions(0), 2u);
+	}
+}
+
+void TestPluginDataBatcher::window() {
+	PluginDataBatcher batcher(sender());
+	batcher.setEnabled(true);
+
+	batcher.send(transmissionOf("first"));
+	batcher.send(transmissionOf("second"));
+
+	// The batch is sent once the window has passed
+	QTRY_COMPARE(m_sent.size(), static_cast< std::size_t >(1));
+	QVERIFY(m_sent[0].type == Mumble::Protocol::TCPMessageType::PluginDataBatch);
+	QCOMPARE(batcher.pendingCount(), 0);
+}
+
+void TestPluginDataBatcher::limit() {
+	PluginDataBatcher batcher(sender());
+	batcher.setEnabled(true);
+
+	for (int i = 0; i <= Mumble::Plugins::PluginMessage::MAX_BATCH_LENGTH; i++) {
+		batcher.send(transmissionOf(std::to_string(i)));
+	}
+
+	// The batch has been sent as soon as it was full
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(1));
+	QCOMPARE(batcher.pendingCount(), 1);
+
+	std::vector< MumbleProto::PluginDataTransmission > transmissions;
+	QVERIFY(MumbleProto::getPluginDataBatchTransmissions(m_sent[0].batch, transmissions));
+	QCOMPARE(transmissions.size(), static_cast< std::size_t >(Mumble::Plugins::PluginMessage::MAX_BATCH_LENGTH));
+}
+
+void TestPluginDataBatcher::disable() {
+	PluginDataBatcher batcher(sender());
+	batcher.setEnabled(true);
+
+	batcher.send(transmissionOf("first"));
+	batcher.send(transmissionOf("second"));
+	batcher.setEnabled(false);
+
+	// Disabling batching sends the pending messages
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(1));
+	QCOMPARE(batcher.pendingCount(), 0);
+
+	batcher.send(transmissionOf("third"));
+	QCOMPARE(m_sent.size(), static_cast< std::size_t >(2));
+	QVERIFY(m_sent[1].type == Mumble::Protocol::TCPMessageType::PluginDataTransmission);
+}
+
+void TestPluginDataBatcher::invalid() {
+	std::vector< MumbleProto::PluginDataTransmission > transmissions;
+
+	MumbleProto::PluginDataBatch truncated;
+	truncated.set_data(std::string("\x00\x1a\x00\x00\x00\x10", 6));
+	QVERIFY(!MumbleProto::getPluginDataBatchTransmissions(truncated, transmissions));
+
+	// Batches may only contain PluginDataTransmission messages
+	MumbleProto::PluginDataBatch wrongType;
+	wrongType.set_data(std::string("\x00\x03\x00\x00\x00\x00", 6));
+	QVERIFY(!MumbleProto::getPluginDataBatchTransmissions(wrongType, transmissions));
+
+	// The announced size of compressed data is checked before it is decompressed
+	MumbleProto::PluginDataBatch huge;
+	huge.set_compression(MumbleProto::PluginDataBatch_Compression_Zlib);
+	huge.set_data(std::string("\x7f\xff\xff\xff\x00", 5));
+	QVERIFY(!MumbleProto::getPluginDataBatchTransmissions(huge, transmissions));
+}
+
+QTEST_MAIN(TestPluginDataBatcher)
+#include "TestPluginDataBatcher.moc"
@@ -0,0 +1,183 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "PluginMetadataCache.h"
+
+class TestPluginMetadataCache : public QObject {
+	Q_OBJECT
+private slots:
+	void lookup();
+	void changedContents();
+	void touched();
+	void prune();
+	void roundTrip();
+	void damagedFile();
+};
+
+static void writeLibrary(const QString &path, const QByteArray &contents) {
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+	QCOMPARE(file.write(contents), static_cast< qint64 >(contents.size()));
+}
+
+static void setModified(const QString &path, const QDateTime &time) {
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::ReadWrite));
+	QVERIFY(file.setFileTime(time, QFileDevice::FileModificationTime));
+}
+
+static PluginMetadata metadataOf(const QString &name) {
+	PluginMetadata metadata;
+	metadata.isPlugin    = true;
+	metadata.name        = name;
+	metadata.author      = QLatin1String("Author");
+	metadata.description = QLatin1String("Description");
+	metadata.version     = { 1, 2, 3 };
+	metadata.apiVersion  = { 1, 0, 0 };
+	metadata.features    = MUMBLE_FEATURE_POSITIONAL;
+	return metadata;
+}
+
+void TestPluginMetadataCache::lookup() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath(QLatin1String("plugin.so"));
+	writeLibrary(path, "library");
+
+	PluginMetadataCache cache;
+	QVERIFY(!cache.lookup(QFileInfo(path)));
+
+	cache.insert(QFileInfo(path), metadataOf(QLatin1String("Plugin")));
+	QVERIFY(cache.isModified());
+
+	const PluginMetadata *metadata = cache.lookup(QFileInfo(path));
+	QVERIFY(metadata);
+	QCOMPARE(metadata->name, QLatin1String("Plugin"));
+	QCOMPARE(metadata->features, static_cast< uint32_t >(MUMBLE_FEATURE_POSITIONAL));
+}
+
+void TestPluginMetadataCache::changedContents() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath(QLatin1String("plugin.so"));
+	writeLibrary(path, "library");
+
+	PluginMetadataCache cache;
+	cache.insert(QFileInfo(path), metadataOf(QLatin1String("Plugin")));
+
+	// A library of the same size, but with different contents
+	writeLibrary(path, "LIBRARY");
+	setModified(path, QDateTime::currentDateTime().addSecs(60));
+
+	QVERIFY(!cache.lookup(QFileInfo(path)));
+}
+
+void TestPluginMetadataCache::touched() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath(QLatin1String("plugin.so"));
+	writeLibrary(path, "library");
+
+	PluginMetadataCache cache;
+	cache.insert(QFileInfo(path), metadataOf(QLatin1String("Plugin")));
+
+	// The same library with a different modification time is still known
+	writeLibrary(path, "library");
+	setModified(path, QDateTime::currentDateTime().addSecs(60));
+
+	const PluginMetadata *metadata = cache.lookup(QFileInfo(path));
+	QVERIFY(metadata);
+	QCOMPARE(metadata->name, QLatin1String("Plugin"));
+}
+
+void TestPluginMetadataCache::prune() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString first  = dir.filePath(QLatin1String("first.so"));
+	const QString second = dir.filePath(QLatin1String("second.so"));
+	writeLibrary(first, "first");
+	writeLibrary(second, "second");
+
+	PluginMetadataCache cache;
+	cache.insert(QFileInfo(first), metadataOf(QLatin1String("First")));
+	cache.insert(QFileInfo(second), metadataOf(QLatin1String("Second")));
+	cache.prune();
+
+	// Only the library that has been looked up since is kept
+	QVERIFY(cache.lookup(QFileInfo(first)));
+	cache.prune();
+
+	QVERIFY(cache.lookup(QFileInfo(first)));
+	QVERIFY(!cache.lookup(QFileInfo(second)));
+}
+
+void TestPluginMetadataCache::roundTrip() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString library = dir.filePath(QLatin1String("plugin.so"));
+	const QString other   = dir.filePath(QLatin1String("other.so"));
+	const QString path    = dir.filePath(QLatin1String("plugins.dat"));
+	writeLibrary(library, "library");
+	writeLibrary(other, "other");
+
+	PluginMetadata legacy = metadataOf(QLatin1String("Legacy"));
+	legacy.isLegacy       = true;
+
+	PluginMetadata nonPlugin;
+	nonPlugin.error = QLatin1String("Not a plugin");
+
+	PluginMetadataCache cache;
+	cache.insert(QFileInfo(library), legacy);
+	cache.insert(QFileInfo(other), nonPlugin);
+	QVERIFY(cache.save(path));
+	QVERIFY(!cache.isModified());
+
+	PluginMetadataCache loaded;
+	loaded.load(path);
+	QVERIFY(!loaded.isModified());
+
+	const PluginMetadata *metadata = loaded.lookup(QFileInfo(library));
+	QVERIFY(metadata);
+	QVERIFY(metadata->isPlugin);
+	QVERIFY(metadata->isLegacy);
+	QCOMPARE(metadata->name, legacy.name);
+	QCOMPARE(metadata->author, legacy.author);
+	QCOMPARE(metadata->description, legacy.description);
+	QCOMPARE(metadata->version.major, 1);
+	QCOMPARE(metadata->version.minor, 2);
+	QCOMPARE(metadata->version.patch, 3);
+	QCOMPARE(metadata->apiVersion.major, 1);
+	QCOMPARE(metadata->features, legacy.features);
+
+	metadata = loaded.lookup(QFileInfo(other));
+	QVERIFY(metadata);
+	QVERIFY(!metadata->isPlugin);
+	QCOMPARE(metadata->error, nonPlugin.error);
+}
+
+void TestPluginMetadataCache::damagedFile() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString library = dir.filePath(QLatin1String("plugin.so"));
+	const QString path    = dir.filePath(QLatin1String("plugins.dat"));
+	writeLibrary(library, "library");
+
+	PluginMetadataCache cache;
+	cache.insert(QFileInfo(library), metadataOf(QLatin1String("Plugin")));
+	QVERIFY(cache.save(path));
+
+	QFile file(path);
+	QVERIFY(file.resize(file.size() / 2));
+
+	PluginMetadataCache loaded;
+	loaded.load(path);
+	QVERIFY(!loaded.lookup(QFileInfo(library)));
+}
+
+QTEST_MAIN(TestPluginMetadataCache)
+#include "TestPluginMetadataCache.moc"
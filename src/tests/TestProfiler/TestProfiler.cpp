@@ -0,0 +1,115 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "Profiler.h"
+
+#include <algorithm>
+
+class TestProfiler : public QObject {
+	Q_OBJECT
+private slots:
+	void init();
+	void cleanup();
+	void disabled();
+	void calls();
+	void nested();
+	void allocations();
+	void format();
+};
+
+/// Keeps the compiler from eliding the allocations
+static int *volatile sink = nullptr;
+
+static void inner() {
+	MUMBLE_PROFILE_ZONE("inner");
+
+	sink = new int(1);
+	delete sink;
+}
+
+static void outer() {
+	MUMBLE_PROFILE_ZONE("outer");
+
+	QThread::msleep(2);
+	inner();
+	sink = new int(2);
+	delete sink;
+}
+
+static ProfilerZone::Stats statsOf(const std::vector< ProfilerZone::Stats > &stats, const char *name) {
+	auto it = std::find_if(stats.begin(), stats.end(),
+						   [name](const ProfilerZone::Stats &zone) { return qstrcmp(zone.name, name) == 0; });
+	return it != stats.end() ? *it : ProfilerZone::Stats{ name, 0, 0, 0, 0, 0 };
+}
+
+void TestProfiler::init() {
+	Profiler::setEnabled(true);
+	Profiler::take();
+}
+
+void TestProfiler::cleanup() {
+	Profiler::setEnabled(false);
+}
+
+void TestProfiler::disabled() {
+	Profiler::setEnabled(false);
+
+	outer();
+
+	const std::vector< ProfilerZone::Stats > stats = Profiler::take();
+	QCOMPARE(statsOf(stats, "outer").calls, static_cast< std::uint64_t >(0));
+	QCOMPARE(statsOf(stats, "outer").allocations, static_cast< std::uint64_t >(0));
+	QVERIFY(!ProfilerScope::current());
+}
+
+void TestProfiler::calls() {
+	outer();
+	outer();
+
+	const ProfilerZone::Stats stats = statsOf(Profiler::take(), "outer");
+	QCOMPARE(stats.calls, static_cast< std::uint64_t >(2));
+	QVERIFY(stats.totalTime >= 4000000);
+	QVERIFY(stats.maxTime >= 2000000);
+	QVERIFY(stats.maxTime <= stats.totalTime);
+
+	// The stats are reset by taking them
+	QCOMPARE(statsOf(Profiler::take(), "outer").calls, static_cast< std::uint64_t >(0));
+}
+
+void TestProfiler::nested() {
+	outer();
+
+	const std::vector< ProfilerZone::Stats > stats = Profiler::take();
+	QCOMPARE(statsOf(stats, "inner").calls, static_cast< std::uint64_t >(1));
+	// The time of the outer zone includes the inner one
+	QVERIFY(statsOf(stats, "outer").totalTime >= statsOf(stats, "inner").totalTime);
+	QVERIFY(!ProfilerScope::current());
+}
+
+void TestProfiler::allocations() {
+	outer();
+
+	const std::vector< ProfilerZone::Stats > stats = Profiler::take();
+	// Each zone only counts its own allocations
+	QCOMPARE(statsOf(stats, "inner").allocations, static_cast< std::uint64_t >(1));
+	QCOMPARE(statsOf(stats, "inner").allocatedBytes, static_cast< std::uint64_t >(sizeof(int)));
+	QVERIFY(statsOf(stats, "outer").allocations >= 1);
+}
+
+void TestProfiler::format() {
+	outer();
+
+	const QStringList lines = Profiler::format(Profiler::take(), 1.0).split(QLatin1Char('\n'));
+	QVERIFY(lines.size() >= 3);
+	QVERIFY(lines.at(0).startsWith(QLatin1String("Zone")));
+	// The zones are sorted by the time spent in them
+	QVERIFY(lines.at(1).startsWith(QLatin1String("outer")));
+}
+
+QTEST_MAIN(TestProfiler)
+#include "TestProfiler.moc"
@@ -0,0 +1,125 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "PublicServerList.h"
+
+class TestPublicServerList : public QObject {
+	Q_OBJECT
+private slots:
+	void parse();
+	void roundTrip();
+	void missingFile();
+	void damagedFile();
+	void conditionalHeaders();
+};
+
+static const char *LIST = "<servers>"
+						  "<server name=\"First\" url=\"https://example.com\" ip=\"192.0.2.1\" port=\"64738\" "
+						  "country=\"Germany\" country_code=\"DE\" continent_code=\"EU\" ca=\"1\"/>"
+						  "<server name=\"Second\" ip=\"second.example.com\" port=\"1234\"/>"
+						  "</servers>";
+
+static QMap< QString, QString > headersOf() {
+	QMap< QString, QString > headers;
+	headers.insert(QLatin1String("Geo-Country"), QLatin1String("Germany"));
+	headers.insert(QLatin1String("geo-country-code"), QLatin1String("DE"));
+	headers.insert(QLatin1String("Geo-Continent-Code"), QLatin1String("EU"));
+	headers.insert(QLatin1String("etag"), QLatin1String("\"abc\""));
+	headers.insert(QLatin1String("Last-Modified"), QLatin1String("Sun, 01 Jan 2023 00:00:00 GMT"));
+	return headers;
+}
+
+void TestPublicServerList::parse() {
+	const PublicServerList list = PublicServerList::parse(LIST, headersOf());
+
+	// The headers are matched regardless of their case
+	QCOMPARE(list.userCountry, QLatin1String("Germany"));
+	QCOMPARE(list.userCountryCode, QLatin1String("de"));
+	QCOMPARE(list.userContinentCode, QLatin1String("eu"));
+	QCOMPARE(list.etag, QByteArray("\"abc\""));
+	QCOMPARE(list.lastModified, QByteArray("Sun, 01 Jan 2023 00:00:00 GMT"));
+
+	QCOMPARE(list.servers.size(), 2);
+	QCOMPARE(list.servers[0].qsName, QLatin1String("First"));
+	QCOMPARE(list.servers[0].quUrl, QUrl(QLatin1String("https://example.com")));
+	QCOMPARE(list.servers[0].qsIp, QLatin1String("192.0.2.1"));
+	QCOMPARE(list.servers[0].usPort, static_cast< unsigned short >(64738));
+	QCOMPARE(list.servers[0].qsCountryCode, QLatin1String("de"));
+	QCOMPARE(list.servers[0].qsContinentCode, QLatin1String("eu"));
+	QVERIFY(list.servers[0].bCA);
+
+	QCOMPARE(list.servers[1].qsIp, QLatin1String("second.example.com"));
+	QCOMPARE(list.servers[1].usPort, static_cast< unsigned short >(1234));
+	QCOMPARE(list.servers[1].qsCountry, QLatin1String("Unknown"));
+	QVERIFY(!list.servers[1].bCA);
+}
+
+void TestPublicServerList::roundTrip() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath(QLatin1String("publist.dat"));
+
+	const PublicServerList list = PublicServerList::parse(LIST, headersOf());
+	QVERIFY(list.save(path));
+
+	const PublicServerList loaded = PublicServerList::load(path);
+	QCOMPARE(loaded.userCountry, list.userCountry);
+	QCOMPARE(loaded.userCountryCode, list.userCountryCode);
+	QCOMPARE(loaded.userContinentCode, list.userContinentCode);
+	QCOMPARE(loaded.etag, list.etag);
+	QCOMPARE(loaded.lastModified, list.lastModified);
+
+	QCOMPARE(loaded.servers.size(), list.servers.size());
+	for (int i = 0; i < list.servers.size(); i++) {
+		QCOMPARE(loaded.servers[i].qsName, list.servers[i].qsName);
+		QCOMPARE(loaded.servers[i].quUrl, list.servers[i].quUrl);
+		QCOMPARE(loaded.servers[i].qsIp, list.servers[i].qsIp);
+		QCOMPARE(loaded.servers[i].qsCountry, list.servers[i].qsCountry);
+		QCOMPARE(loaded.servers[i].qsCountryCode, list.servers[i].qsCountryCode);
+		QCOMPARE(loaded.servers[i].qsContinentCode, list.servers[i].qsContinentCode);
+		QCOMPARE(loaded.servers[i].usPort, list.servers[i].usPort);
+		QCOMPARE(loaded.servers[i].bCA, list.servers[i].bCA);
+	}
+}
+
+void TestPublicServerList::missingFile() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	const PublicServerList list = PublicServerList::load(dir.filePath(QLatin1String("missing.dat")));
+	QVERIFY(list.servers.isEmpty());
+	QVERIFY(list.conditionalHeaders().isEmpty());
+}
+
+void TestPublicServerList::damagedFile() {
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath(QLatin1String("publist.dat"));
+
+	QVERIFY(PublicServerList::parse(LIST, headersOf()).save(path));
+
+	// A list that has been cut off is dropped as a whole, so that no stale validators are sent along
+	QFile file(path);
+	QVERIFY(file.resize(file.size() / 2));
+
+	const PublicServerList list = PublicServerList::load(path);
+	QVERIFY(list.servers.isEmpty());
+	QVERIFY(list.etag.isEmpty());
+}
+
+void TestPublicServerList::conditionalHeaders() {
+	const PublicServerList list = PublicServerList::parse(LIST, headersOf());
+
+	const QMap< QByteArray, QByteArray > headers = list.conditionalHeaders();
+	QCOMPARE(headers.size(), 2);
+	QCOMPARE(headers.value("If-None-Match"), QByteArray("\"abc\""));
+	QCOMPARE(headers.value("If-Modified-Since"), QByteArray("Sun, 01 Jan 2023 00:00:00 GMT"));
+}
+
+QTEST_MAIN(TestPublicServerList)
+#include "TestPublicServerList.moc"
@@ -0,0 +1,111 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "SearchIndex.h"
+
+#include <algorithm>
+
+using Search::SearchIndex;
+using Search::SearchType;
+
+/// @returns The sorted keys of the candidates for the given term
+static std::vector< quint64 > candidateKeys(const SearchIndex &index, const QString &term) {
+	std::vector< quint64 > keys;
+	for (const SearchIndex::Entry &entry : index.candidates(term)) {
+		keys.push_back(SearchIndex::key(entry.type, entry.id));
+	}
+	std::sort(keys.begin(), keys.end());
+
+	return keys;
+}
+
+class TestSearchIndex : public QObject {
+	Q_OBJECT
+private slots:
+	void candidates();
+	void shortTerms();
+	void rename();
+	void remove();
+};
+
+void TestSearchIndex::candidates() {
+	SearchIndex index;
+	index.insert(SearchType::User, 1, QLatin1String("Alice"));
+	index.insert(SearchType::User, 2, QLatin1String("Malicious"));
+	index.insert(SearchType::Channel, 1, QLatin1String("Lobby"));
+
+	// Users and channels with the same ID are different entries
+	QCOMPARE(index.size(), 3);
+
+	// The case doesn't matter
+	const std::vector< quint64 > lic = { SearchIndex::key(SearchType::User, 1), SearchIndex::key(SearchType::User, 2) };
+	QCOMPARE(candidateKeys(index, QLatin1String("LIC")), lic);
+	QCOMPARE(candidateKeys(index, QLatin1String("alic")), lic);
+
+	const std::vector< quint64 > lobby = { SearchIndex::key(SearchType::Channel, 1) };
+	QCOMPARE(candidateKeys(index, QLatin1String("obb")), lobby);
+
+	// A trigram that no name contains rules out everything
+	QVERIFY(candidateKeys(index, QLatin1String("Alicx")).empty());
+	QVERIFY(candidateKeys(index, QLatin1String("xyz")).empty());
+
+	// Every name that contains the term is a candidate
+	for (const QString &term : { QLatin1String("ali"), QLatin1String("cious"), QLatin1String("lobby") }) {
+		bool found = false;
+		for (const SearchIndex::Entry &entry : index.candidates(term)) {
+			found = found || entry.name.contains(term, Qt::CaseInsensitive);
+		}
+		QVERIFY(found);
+	}
+}
+
+void TestSearchIndex::shortTerms() {
+	SearchIndex index;
+	index.insert(SearchType::User, 1, QLatin1String("Al"));
+	index.insert(SearchType::User, 2, QLatin1String("Bob"));
+
+	// Neither a term nor a name shorter than a trigram can be looked up
+	QCOMPARE(candidateKeys(index, QLatin1String("l")).size(), static_cast< std::size_t >(2));
+	QCOMPARE(candidateKeys(index, QString()).size(), static_cast< std::size_t >(2));
+	QVERIFY(candidateKeys(index, QLatin1String("Als")).empty());
+}
+
+void TestSearchIndex::rename() {
+	SearchIndex index;
+	index.insert(SearchType::Channel, 7, QLatin1String("Gaming"));
+	index.insert(SearchType::Channel, 7, QLatin1String("Music"));
+
+	QCOMPARE(index.size(), 1);
+	QVERIFY(candidateKeys(index, QLatin1String("gam")).empty());
+
+	const std::vector< SearchIndex::Entry > music = index.candidates(QLatin1String("usi"));
+	QCOMPARE(music.size(), static_cast< std::size_t >(1));
+	QCOMPARE(music.front().name, QLatin1String("Music"));
+	QCOMPARE(music.front().id, 7U);
+}
+
+void TestSearchIndex::remove() {
+	SearchIndex index;
+	index.insert(SearchType::User, 1, QLatin1String("Alice"));
+	index.insert(SearchType::User, 2, QLatin1String("Alicia"));
+
+	index.remove(SearchType::User, 1);
+	index.remove(SearchType::Channel, 2);
+
+	QVERIFY(!index.contains(SearchType::User, 1));
+	QVERIFY(index.contains(SearchType::User, 2));
+	const std::vector< quint64 > alicia = { SearchIndex::key(SearchType::User, 2) };
+	QCOMPARE(candidateKeys(index, QLatin1String("ali")), alicia);
+
+	index.clear();
+	QCOMPARE(index.size(), 0);
+	QVERIFY(index.candidates(QLatin1String("ali")).empty());
+}
+
+QTEST_MAIN(TestSearchIndex)
+#include "TestSearchIndex.moc"
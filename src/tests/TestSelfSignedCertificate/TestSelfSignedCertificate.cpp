@@ -17,6 +17,7 @@ private slots:
 	void cleanupTestCase();
 	void exerciseClientCert();
 	void exerciseServerCert();
+	void exerciseECCert();
 };
 
 void TestSelfSignedCertificate::initTestCase() {
@@ -69,5 +70,28 @@ void TestSelfSignedCertificate::exerciseServerCert() {
 	QCOMPARE(key.isNull(), false);
 }
 
+void TestSelfSignedCertificate::exerciseECCert() {
+#if QT_VERSION >= 0x050500
+	QSslCertificate cert;
+	QSslKey key;
+
+	bool ok = SelfSignedCertificate::generateMurmurV2Certificate(cert, key, QSsl::Ec);
+	QCOMPARE(ok, true);
+	QCOMPARE(cert.isNull(), false);
+	QCOMPARE(key.isNull(), false);
+	QCOMPARE(key.algorithm(), QSsl::Ec);
+	QCOMPARE(cert.publicKey().algorithm(), QSsl::Ec);
+
+	ok = SelfSignedCertificate::generateMumbleCertificate(QLatin1String("John Doe"), QString(), cert, key, QSsl::Ec);
+	QCOMPARE(ok, true);
+	QCOMPARE(key.algorithm(), QSsl::Ec);
+
+	// The key has to survive being stored as PEM, which is how the server keeps its certificate
+	QCOMPARE(QSslKey(key.toPem(), QSsl::Ec).isNull(), false);
+#else
+	QSKIP("QSslKey doesn't support EC keys before Qt 5.5");
+#endif
+}
+
 QTEST_MAIN(TestSelfSignedCertificate)
 #include "TestSelfSignedCertificate.moc"
@@ -0,0 +1,94 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "SeqLock.h"
+
+#include <atomic>
+#include <thread>
+
+struct Pose {
+	float values[12];
+	bool available;
+};
+
+class TestSeqLock : public QObject {
+	Q_OBJECT
+private slots:
+	void initial();
+	void store();
+	void concurrent();
+};
+
+static Pose poseOf(float value) {
+	Pose pose;
+	for (float &v : pose.values) {
+		v = value;
+	}
+	pose.available = true;
+	return pose;
+}
+
+void TestSeqLock::initial() {
+	SeqLock< Pose > lock;
+
+	const Pose pose = lock.load();
+	QCOMPARE(pose.values[0], 0.0f);
+	QVERIFY(!pose.available);
+	QCOMPARE(lock.version(), 0u);
+}
+
+void TestSeqLock::store() {
+	SeqLock< Pose > lock;
+
+	lock.store(poseOf(1.0f));
+	lock.store(poseOf(2.0f));
+
+	const Pose pose = lock.load();
+	QCOMPARE(pose.values[0], 2.0f);
+	QCOMPARE(pose.values[11], 2.0f);
+	QVERIFY(pose.available);
+	QCOMPARE(lock.version(), 2u);
+}
+
+void TestSeqLock::concurrent() {
+	SeqLock< Pose > lock;
+	std::atomic< bool > done(false);
+
+	std::thread writer([&lock, &done]() {
+		for (int i = 1; i <= 200000; i++) {
+			lock.store(poseOf(static_cast< float >(i)));
+		}
+		done = true;
+	});
+
+	// A reader never sees a value that is only partly written
+	int torn     = 0;
+	float latest = 0.0f;
+	bool ordered = true;
+	while (!done) {
+		const Pose pose = lock.load();
+		for (float v : pose.values) {
+			if (v != pose.values[0]) {
+				torn++;
+				break;
+			}
+		}
+		if (pose.values[0] < latest) {
+			ordered = false;
+		}
+		latest = pose.values[0];
+	}
+	writer.join();
+
+	QCOMPARE(torn, 0);
+	QVERIFY(ordered);
+	QCOMPARE(lock.load().values[0], 200000.0f);
+}
+
+QTEST_MAIN(TestSeqLock)
+#include "TestSeqLock.moc"
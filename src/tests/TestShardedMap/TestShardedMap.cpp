@@ -0,0 +1,137 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "ShardedMap.h"
+
+#include <map>
+#include <random>
+
+using Map = ShardedMap< unsigned int, unsigned int >;
+
+class TestShardedMap : public QObject {
+	Q_OBJECT
+private slots:
+	void setFindErase();
+	void copiesAreIndependent();
+	void unchangedShardsAreShared();
+	void matchesReference();
+};
+
+void TestShardedMap::setFindErase() {
+	Map map;
+
+	QVERIFY(!map.find(1));
+	QCOMPARE(map.size(), static_cast< std::size_t >(0));
+
+	map.set(1, 10);
+	map.set(2, 20);
+	map.set(1, 11);
+
+	QCOMPARE(map.size(), static_cast< std::size_t >(2));
+	QCOMPARE(*map.find(1), 11u);
+	QCOMPARE(*map.find(2), 20u);
+
+	map.erase(1);
+	map.erase(3);
+
+	QCOMPARE(map.size(), static_cast< std::size_t >(1));
+	QVERIFY(!map.find(1));
+	QCOMPARE(*map.find(2), 20u);
+}
+
+void TestShardedMap::copiesAreIndependent() {
+	Map original;
+	for (unsigned int i = 0; i < 1000; ++i) {
+		original.set(i, i);
+	}
+
+	Map copy(original);
+	copy.set(1, 100);
+	copy.erase(2);
+	copy.set(1000, 1000);
+
+	QCOMPARE(*original.find(1), 1u);
+	QCOMPARE(*original.find(2), 2u);
+	QVERIFY(!original.find(1000));
+	QCOMPARE(original.size(), static_cast< std::size_t >(1000));
+
+	QCOMPARE(*copy.find(1), 100u);
+	QVERIFY(!copy.find(2));
+	QCOMPARE(*copy.find(1000), 1000u);
+	QCOMPARE(copy.size(), static_cast< std::size_t >(1000));
+
+	// Changing the original after it has been copied (again) mustn't affect the copies either
+	Map second;
+	second = original;
+	original.set(3, 300);
+	QCOMPARE(*second.find(3), 3u);
+	QCOMPARE(*copy.find(3), 3u);
+	QCOMPARE(*original.find(3), 300u);
+}
+
+void TestShardedMap::unchangedShardsAreShared() {
+	Map original;
+	for (unsigned int i = 0; i < 1000; ++i) {
+		original.set(i, i);
+	}
+
+	Map copy(original);
+	copy.set(1, 100);
+
+	std::size_t shared = 0;
+	for (unsigned int i = 0; i < 1000; ++i) {
+		if (copy.sharesShardWith(original, i)) {
+			++shared;
+		}
+	}
+
+	// Only the entries in the changed key's shard have been copied
+	QVERIFY(!copy.sharesShardWith(original, 1));
+	QVERIFY(shared > 900);
+
+	// Erasing a key that isn't contained doesn't copy its shard
+	Map unchanged(original);
+	unchanged.erase(5000);
+	QVERIFY(unchanged.sharesShardWith(original, 5000));
+}
+
+void TestShardedMap::matchesReference() {
+	std::mt19937 rng(42);
+	std::map< unsigned int, unsigned int > reference;
+	Map map;
+
+	for (int round = 0; round < 50; ++round) {
+		// Every round changes a copy of the previous map, just like every published VoiceState is derived from the
+		// previous one
+		Map next(map);
+		for (int i = 0; i < 100; ++i) {
+			const unsigned int key = rng() % 500;
+			if (rng() % 3 == 0) {
+				next.erase(key);
+				reference.erase(key);
+			} else {
+				next.set(key, rng());
+				reference[key] = *next.find(key);
+			}
+		}
+		map = next;
+
+		QCOMPARE(map.size(), reference.size());
+		for (unsigned int key = 0; key < 500; ++key) {
+			auto it = reference.find(key);
+			if (it == reference.end()) {
+				QVERIFY(!map.find(key));
+			} else {
+				QCOMPARE(*map.find(key), it->second);
+			}
+		}
+	}
+}
+
+QTEST_MAIN(TestShardedMap)
+#include "TestShardedMap.moc"
@@ -0,0 +1,112 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "SocketHandoff.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace {
+/// Creates a socket of the given type that is bound to a free port of the loopback interface
+int boundSocket(int type, unsigned short &port) {
+	const int fd = ::socket(AF_INET, type, 0);
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family      = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	::bind(fd, reinterpret_cast< sockaddr * >(&address), sizeof(address));
+	if (type == SOCK_STREAM) {
+		::listen(fd, 1);
+	}
+
+	socklen_t length = sizeof(address);
+	getsockname(fd, reinterpret_cast< sockaddr * >(&address), &length);
+	port = ntohs(address.sin_port);
+	return fd;
+}
+} // namespace
+
+class TestSocketHandoff : public QObject {
+	Q_OBJECT
+private slots:
+	void transfer();
+	void truncated();
+	void noInstance();
+};
+
+void TestSocketHandoff::transfer() {
+	int pair[2];
+	QCOMPARE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+
+	unsigned short udpPort, tcpPort;
+	const int udp = boundSocket(SOCK_DGRAM, udpPort);
+	const int tcp = boundSocket(SOCK_STREAM, tcpPort);
+
+	const std::vector< SocketHandoff::Socket > sent = { { 1, SOCK_STREAM, tcp, HostAddress(), 0 },
+														{ 1, SOCK_DGRAM, udp, HostAddress(), 0 },
+														{ 7, SOCK_DGRAM, udp, HostAddress(), 0 } };
+	QVERIFY(SocketHandoff::sendSockets(pair[0], sent));
+	::close(pair[0]);
+
+	std::vector< SocketHandoff::Socket > received;
+	QVERIFY(SocketHandoff::receiveSockets(pair[1], received));
+	::close(pair[1]);
+
+	QCOMPARE(received.size(), static_cast< std::size_t >(3));
+	QCOMPARE(received[0].serverId, 1);
+	QCOMPARE(received[0].type, static_cast< int >(SOCK_STREAM));
+	QCOMPARE(received[0].port, tcpPort);
+	QCOMPARE(received[1].type, static_cast< int >(SOCK_DGRAM));
+	QCOMPARE(received[1].port, udpPort);
+	QCOMPARE(received[2].serverId, 7);
+	// The address the sockets are bound to is filled in
+	QVERIFY(received[1].address == HostAddress(QHostAddress(QHostAddress::LocalHost)));
+
+	// The received sockets are duplicates, which stay open when the sent ones are closed
+	::close(udp);
+	::close(tcp);
+	for (const SocketHandoff::Socket &socket : received) {
+		QVERIFY(socket.fd != udp && socket.fd != tcp);
+
+		int type         = 0;
+		socklen_t length = sizeof(type);
+		QCOMPARE(getsockopt(socket.fd, SOL_SOCKET, SO_TYPE, &type, &length), 0);
+		QCOMPARE(type, socket.type);
+		::close(socket.fd);
+	}
+}
+
+void TestSocketHandoff::truncated() {
+	int pair[2];
+	QCOMPARE(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+
+	// A message without a socket
+	const char garbage[3] = { 1, 2, 3 };
+	QCOMPARE(::send(pair[0], garbage, sizeof(garbage), 0), static_cast< ssize_t >(sizeof(garbage)));
+	::close(pair[0]);
+
+	std::vector< SocketHandoff::Socket > received;
+	QVERIFY(!SocketHandoff::receiveSockets(pair[1], received));
+	QVERIFY(received.empty());
+	::close(pair[1]);
+}
+
+void TestSocketHandoff::noInstance() {
+	QTemporaryDir dir;
+	std::vector< SocketHandoff::Socket > sockets;
+	QVERIFY(!SocketHandoff::takeOver(dir.filePath(QLatin1String("handoff.sock")), sockets));
+	QVERIFY(sockets.empty());
+}
+
+QTEST_MAIN(TestSocketHandoff)
+#include "TestSocketHandoff.moc"
@@ -0,0 +1,97 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "SpeakerSelector.h"
+
+#include <vector>
+
+class TestSpeakerSelector : public QObject {
+	Q_OBJECT
+private slots:
+	void opusRate();
+	void loudestSpeakers();
+	void stoppedSpeakers();
+};
+
+namespace {
+/// @returns An Opus packet of the given size for the given configuration and frame count code
+std::vector< Mumble::Protocol::byte > opusPacket(unsigned int config, unsigned int code, std::size_t size) {
+	std::vector< Mumble::Protocol::byte > packet(size, 0);
+	packet[0] = static_cast< Mumble::Protocol::byte >((config << 3) | code);
+	return packet;
+}
+
+Mumble::Protocol::AudioData frame(const std::vector< Mumble::Protocol::byte > &packet, bool isLastFrame = false) {
+	Mumble::Protocol::AudioData data;
+	data.payload     = packet;
+	data.isLastFrame = isLastFrame;
+	return data;
+}
+} // namespace
+
+void TestSpeakerSelector::opusRate() {
+	// Fullband hybrid, 20 ms
+	QCOMPARE(SpeakerSelector::opusRate(opusPacket(15, 0, 40)), 20.0f);
+	// Two 10 ms CELT frames
+	QCOMPARE(SpeakerSelector::opusRate(opusPacket(30, 1, 40)), 20.0f);
+	// Three 60 ms SILK frames, whose count is part of the packet
+	std::vector< Mumble::Protocol::byte > packet = opusPacket(3, 3, 180);
+	packet[1]                                    = 3;
+	QCOMPARE(SpeakerSelector::opusRate(packet), 10.0f);
+
+	packet[1] = 0;
+	QCOMPARE(SpeakerSelector::opusRate(packet), 0.0f);
+	QCOMPARE(SpeakerSelector::opusRate({}), 0.0f);
+}
+
+void TestSpeakerSelector::loudestSpeakers() {
+	SpeakerSelector selector(2);
+
+	const std::vector< Mumble::Protocol::byte > quiet   = opusPacket(15, 0, 40);
+	const std::vector< Mumble::Protocol::byte > loud    = opusPacket(15, 0, 60);
+	const std::vector< Mumble::Protocol::byte > loudest = opusPacket(15, 0, 200);
+
+	quint64 now = 1000000;
+	QVERIFY(selector.admit(1, frame(quiet), now));
+	QVERIFY(selector.admit(2, frame(quiet), now));
+	// Not loud enough to replace one of the others
+	QVERIFY(!selector.admit(3, frame(loud), now));
+
+	now += 20000;
+	QVERIFY(selector.admit(1, frame(loud), now));
+	QVERIFY(selector.admit(2, frame(quiet), now));
+	QVERIFY(selector.admit(4, frame(loudest), now));
+
+	// The quietest speaker has been replaced, the other one keeps being forwarded
+	now += 20000;
+	QVERIFY(selector.admit(1, frame(quiet), now));
+	QVERIFY(!selector.admit(2, frame(quiet), now));
+	QVERIFY(selector.admit(4, frame(quiet), now));
+}
+
+void TestSpeakerSelector::stoppedSpeakers() {
+	SpeakerSelector selector(1);
+
+	const std::vector< Mumble::Protocol::byte > packet = opusPacket(15, 0, 40);
+
+	quint64 now = 1000000;
+	QVERIFY(selector.admit(1, frame(packet), now));
+	QVERIFY(!selector.admit(2, frame(packet), now));
+
+	// The last frame of a speaker is still forwarded and makes room for the next one
+	QVERIFY(selector.admit(1, frame(packet, true), now));
+	QVERIFY(selector.admit(2, frame(packet), now));
+
+	// So do speakers that just stop sending
+	now += SpeakerSelector::TIMEOUT + 1;
+	QVERIFY(selector.admit(3, frame(packet), now));
+	QVERIFY(!selector.admit(2, frame(packet), now));
+}
+
+QTEST_MAIN(TestSpeakerSelector)
+#include "TestSpeakerSelector.moc"
@@ -0,0 +1,207 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "StageMixer.h"
+
+#include <opus.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+/// Encodes the frames speakers send to a StageMixer
+class Speaker {
+public:
+	explicit Speaker(unsigned int session) : m_session(session) {
+		int error = OPUS_OK;
+		m_encoder = opus_encoder_create(StageMixer::SAMPLE_RATE, 1, OPUS_APPLICATION_AUDIO, &error);
+	}
+	~Speaker() { opus_encoder_destroy(m_encoder); }
+
+	Speaker(const Speaker &) = delete;
+	Speaker &operator=(const Speaker &) = delete;
+
+	/// Pushes the given number of 20 ms frames of a sine wave to the given mixer
+	void speak(StageMixer &mixer, int frames, bool isLastFrame = false) {
+		std::vector< float > samples(StageMixer::FRAME_SAMPLES);
+		std::vector< Mumble::Protocol::byte > payload(Mumble::Protocol::MAX_UDP_PACKET_SIZE);
+
+		for (int i = 0; i < frames; ++i) {
+			for (float &sample : samples) {
+				sample = 0.5f * std::sin(static_cast< float >(m_position++) * 0.05f);
+			}
+
+			const opus_int32 length = opus_encode_float(m_encoder, samples.data(), StageMixer::FRAME_SAMPLES,
+														payload.data(), static_cast< opus_int32 >(payload.size()));
+			QVERIFY(length > 0);
+
+			Mumble::Protocol::AudioData audioData;
+			audioData.usedCodec   = Mumble::Protocol::AudioCodec::Opus;
+			audioData.payload     = { payload.data(), static_cast< std::size_t >(length) };
+			audioData.isLastFrame = isLastFrame && i == frames - 1;
+			mixer.push(m_session, audioData, 0);
+		}
+	}
+
+private:
+	const unsigned int m_session;
+	OpusEncoder *m_encoder  = nullptr;
+	unsigned int m_position = 0;
+};
+
+/// @returns The loudest sample of the given mixed frame
+static float peakOf(const StageMixer::Frame &frame) {
+	int error            = OPUS_OK;
+	OpusDecoder *decoder = opus_decoder_create(StageMixer::SAMPLE_RATE, 1, &error);
+
+	std::vector< float > samples(StageMixer::FRAME_SAMPLES);
+	const int decoded = opus_decode_float(decoder, frame.payload.data(),
+										  static_cast< opus_int32 >(frame.payload.size()), samples.data(),
+										  StageMixer::FRAME_SAMPLES, 0);
+	opus_decoder_destroy(decoder);
+
+	float peak = 0.0f;
+	for (int i = 0; i < decoded; ++i) {
+		peak = std::max(peak, std::abs(samples[static_cast< std::size_t >(i)]));
+	}
+
+	return peak;
+}
+
+class TestStageMixer : public QObject {
+	Q_OBJECT
+private slots:
+	void mixing();
+	void maxSpeakers();
+	void speakerChanges();
+	void terminatorFrame();
+};
+
+void TestStageMixer::mixing() {
+	StageMixer mixer(1, StageMixer::DEFAULT_BITRATE);
+	QVERIFY(mixer.isValid());
+	QCOMPARE(mixer.channel(), 1u);
+
+	// There is nothing to send as long as nobody speaks
+	StageMixer::Frame frame;
+	QVERIFY(!mixer.mix(frame, 0));
+
+	// A speaker is only mixed once JITTER_FRAMES of their audio have arrived
+	Speaker speaker(5);
+	speaker.speak(mixer, 1);
+	QVERIFY(!mixer.mix(frame, 0));
+	speaker.speak(mixer, StageMixer::JITTER_FRAMES - 1);
+
+	QVERIFY(mixer.mix(frame, 0));
+	QVERIFY(!frame.payload.empty());
+	QCOMPARE(frame.session, 5u);
+	QCOMPARE(frame.frameNumber, static_cast< std::uint64_t >(0));
+	QVERIFY(!frame.isLastFrame);
+
+	// Frame numbers count 10 ms frames, and the mix carries the speaker's audio after the encoder has settled
+	for (int i = 0; i < 10; ++i) {
+		speaker.speak(mixer, 1);
+		QVERIFY(mixer.mix(frame, 0));
+	}
+	QCOMPARE(frame.frameNumber, static_cast< std::uint64_t >(20));
+	QVERIFY(peakOf(frame) > 0.1f);
+}
+
+void TestStageMixer::maxSpeakers() {
+	StageMixer mixer(1, StageMixer::DEFAULT_BITRATE);
+
+	std::vector< std::unique_ptr< Speaker > > speakers;
+	for (unsigned int session = 1; session <= StageMixer::MAX_SPEAKERS + 1; ++session) {
+		speakers.push_back(std::make_unique< Speaker >(session));
+		speakers.back()->speak(mixer, 1);
+	}
+
+	// Anybody beyond MAX_SPEAKERS is ignored
+	std::array< unsigned int, StageMixer::MAX_SPEAKERS > sessions;
+	QCOMPARE(mixer.speakers(sessions, 0), StageMixer::MAX_SPEAKERS);
+	QCOMPARE(sessions.front(), 1u);
+	QCOMPARE(sessions.back(), static_cast< unsigned int >(StageMixer::MAX_SPEAKERS));
+
+	// Speakers who haven't sent anything in a while no longer count
+	QCOMPARE(mixer.speakers(sessions, StageMixer::TIMEOUT + 1), static_cast< std::size_t >(0));
+}
+
+void TestStageMixer::speakerChanges() {
+	StageMixer mixer(1, StageMixer::DEFAULT_BITRATE);
+	StageMixer::Frame frame;
+
+	Speaker first(1);
+	first.speak(mixer, StageMixer::JITTER_FRAMES);
+	QVERIFY(mixer.mix(frame, 0));
+	QCOMPARE(frame.session, 1u);
+
+	// The mix is sent on behalf of the speaker who has been speaking the longest
+	Speaker second(2);
+	second.speak(mixer, StageMixer::JITTER_FRAMES);
+	first.speak(mixer, 1);
+	QVERIFY(mixer.mix(frame, 0));
+	QCOMPARE(frame.session, 1u);
+
+	std::array< unsigned int, StageMixer::MAX_SPEAKERS > sessions;
+	QCOMPARE(mixer.speakers(sessions, 0), static_cast< std::size_t >(2));
+
+	// Once the first speaker's audio has been mixed completely, the second one takes over
+	first.speak(mixer, 1, true);
+	for (int i = 0; i < StageMixer::JITTER_FRAMES + 1; ++i) {
+		second.speak(mixer, 1);
+		QVERIFY(mixer.mix(frame, 0));
+		QVERIFY(!frame.isLastFrame);
+	}
+	QCOMPARE(frame.session, 2u);
+}
+
+void TestStageMixer::terminatorFrame() {
+	// A single frame is reused for all mixers of a mixing thread (see Server::runMixingLoop)
+	StageMixer first(1, StageMixer::DEFAULT_BITRATE);
+	StageMixer second(2, StageMixer::DEFAULT_BITRATE);
+	StageMixer::Frame frame;
+
+	Speaker firstSpeaker(1);
+	Speaker secondSpeaker(2);
+	firstSpeaker.speak(first, StageMixer::JITTER_FRAMES, true);
+	secondSpeaker.speak(second, StageMixer::JITTER_FRAMES + 1, true);
+
+	std::vector< StageMixer::Frame > firstFrames;
+	std::vector< StageMixer::Frame > secondFrames;
+	for (int i = 0; i < StageMixer::JITTER_FRAMES + 3; ++i) {
+		if (first.mix(frame, 0)) {
+			firstFrames.push_back(frame);
+		}
+		if (second.mix(frame, 0)) {
+			secondFrames.push_back(frame);
+		}
+	}
+
+	// Every frame, including the final one, is sent on behalf of the mixer's own speaker
+	QCOMPARE(firstFrames.size(), static_cast< std::size_t >(StageMixer::JITTER_FRAMES));
+	QCOMPARE(secondFrames.size(), static_cast< std::size_t >(StageMixer::JITTER_FRAMES + 1));
+	for (const StageMixer::Frame &current : firstFrames) {
+		QCOMPARE(current.session, 1u);
+	}
+	for (const StageMixer::Frame &current : secondFrames) {
+		QCOMPARE(current.session, 2u);
+	}
+
+	QVERIFY(firstFrames.back().isLastFrame);
+	QVERIFY(secondFrames.back().isLastFrame);
+	QVERIFY(!secondFrames.front().isLastFrame);
+
+	// Nothing is sent after the final frame
+	QVERIFY(!first.mix(frame, 0));
+	QVERIFY(!second.mix(frame, 0));
+}
+
+QTEST_MAIN(TestStageMixer)
+#include "TestStageMixer.moc"
@@ -0,0 +1,61 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "StartupProfile.h"
+
+class TestStartupProfile : public QObject {
+	Q_OBJECT
+private slots:
+	void empty();
+	void phases();
+	void summary();
+};
+
+void TestStartupProfile::empty() {
+	StartupProfile profile;
+
+	QVERIFY(profile.phases().empty());
+	QCOMPARE(profile.total(), static_cast< quint64 >(0));
+}
+
+void TestStartupProfile::phases() {
+	StartupProfile profile;
+
+	QThread::msleep(20);
+	profile.mark(QLatin1String("first"));
+	profile.mark(QLatin1String("second"));
+	QThread::msleep(10);
+	profile.mark(QLatin1String("third"));
+
+	const std::vector< StartupProfile::Phase > &phases = profile.phases();
+	QCOMPARE(phases.size(), static_cast< std::size_t >(3));
+	QCOMPARE(phases[0].name, QLatin1String("first"));
+	QCOMPARE(phases[1].name, QLatin1String("second"));
+	QCOMPARE(phases[2].name, QLatin1String("third"));
+
+	QVERIFY(phases[0].duration >= 20000);
+	QVERIFY(phases[2].duration >= 10000);
+
+	// The phases cover the whole time without gaps
+	QCOMPARE(phases[0].duration + phases[1].duration + phases[2].duration, profile.total());
+}
+
+void TestStartupProfile::summary() {
+	StartupProfile profile;
+	profile.mark(QLatin1String("settings"));
+	profile.mark(QLatin1String("database"));
+
+	const QString summary = profile.summary();
+	QVERIFY(summary.startsWith(QLatin1String("settings: ")));
+	QVERIFY(summary.contains(QLatin1String(", database: ")));
+	QVERIFY(summary.contains(QLatin1String(" ms (total: ")));
+	QVERIFY(summary.endsWith(QLatin1String(" ms)")));
+}
+
+QTEST_MAIN(TestStartupProfile)
+#include "TestStartupProfile.moc"
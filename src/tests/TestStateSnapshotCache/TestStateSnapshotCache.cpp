@@ -0,0 +1,224 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "StateSnapshotCache.h"
+
+#include <random>
+#include <string>
+
+/// Frames the given message the way it is framed on the TCP connection (see Connection::messageToNetwork)
+static QByteArray frame(const ::google::protobuf::Message &msg, Mumble::Protocol::TCPMessageType type) {
+	const std::string payload = msg.SerializeAsString();
+
+	QByteArray framed(6, 0);
+	unsigned char *header = reinterpret_cast< unsigned char * >(framed.data());
+	qToBigEndian< quint16 >(static_cast< quint16 >(type), &header[0]);
+	qToBigEndian< quint32 >(static_cast< quint32 >(payload.size()), &header[2]);
+	framed.append(payload.data(), static_cast< int >(payload.size()));
+
+	return framed;
+}
+
+static QByteArray channelTree(unsigned int count) {
+	QByteArray data;
+	for (unsigned int i = 0; i < count; ++i) {
+		MumbleProto::ChannelState mpcs;
+		mpcs.set_channel_id(i);
+		if (i > 0) {
+			mpcs.set_parent(0);
+		}
+		mpcs.set_name(QString::fromLatin1("Channel %1").arg(i).toStdString());
+		data.append(frame(mpcs, Mumble::Protocol::TCPMessageType::ChannelState));
+	}
+
+	return data;
+}
+
+static QByteArray userFrame(unsigned int session) {
+	MumbleProto::UserState mpus;
+	mpus.set_session(session);
+	mpus.set_name(QString::fromLatin1("User %1").arg(session).toStdString());
+
+	return frame(mpus, Mumble::Protocol::TCPMessageType::UserState);
+}
+
+/// @returns The uncompressed data of the given snapshot
+static QByteArray dataOf(const MumbleProto::StateSnapshot &snapshot) {
+	const QByteArray data(snapshot.data().data(), static_cast< int >(snapshot.data().size()));
+	return snapshot.compression() == MumbleProto::StateSnapshot_Compression_Zlib ? qUncompress(data) : data;
+}
+
+class TestStateSnapshotCache : public QObject {
+	Q_OBJECT
+private slots:
+	void compression();
+	void fitsIntoMessage();
+	void channels();
+	void users();
+	void channelChanges();
+	void userChanges();
+	void aclChanges();
+};
+
+void TestStateSnapshotCache::compression() {
+	// The framed messages of a channel tree are highly redundant
+	const QByteArray tree = channelTree(100);
+
+	MumbleProto::StateSnapshot compressed;
+	StateSnapshotCache::setData(compressed, tree);
+	QCOMPARE(compressed.compression(), MumbleProto::StateSnapshot_Compression_Zlib);
+	QVERIFY(compressed.data().size() < static_cast< std::size_t >(tree.size()));
+	QCOMPARE(dataOf(compressed), tree);
+
+	// Data that compression would only make bigger is sent as it is
+	const QByteArray tiny = userFrame(1);
+
+	MumbleProto::StateSnapshot uncompressed;
+	StateSnapshotCache::setData(uncompressed, tiny);
+	QCOMPARE(uncompressed.compression(), MumbleProto::StateSnapshot_Compression_None);
+	QCOMPARE(dataOf(uncompressed), tiny);
+}
+
+void TestStateSnapshotCache::fitsIntoMessage() {
+	MumbleProto::StateSnapshot small;
+	StateSnapshotCache::setData(small, channelTree(10));
+	QVERIFY(StateSnapshotCache::fitsIntoMessage(small));
+
+	// Random data can't be compressed, so it stays bigger than a single message may be
+	std::mt19937 rng(1);
+	QByteArray random(0x800000, 0);
+	for (char &byte : random) {
+		byte = static_cast< char >(rng());
+	}
+
+	MumbleProto::StateSnapshot big;
+	StateSnapshotCache::setData(big, random);
+	QVERIFY(!StateSnapshotCache::fitsIntoMessage(big));
+}
+
+void TestStateSnapshotCache::channels() {
+	StateSnapshotCache cache;
+	QVERIFY(!cache.channels());
+
+	const QByteArray tree = channelTree(20);
+	cache.setChannels(tree);
+
+	const MumbleProto::StateSnapshot *snapshot = cache.channels();
+	QVERIFY(snapshot);
+	QCOMPARE(dataOf(*snapshot), tree);
+
+	// The per-receiver parts are never part of the cached snapshot
+	QCOMPARE(snapshot->enter_restricted_channels_size(), 0);
+	QCOMPARE(snapshot->denied_channels_size(), 0);
+}
+
+void TestStateSnapshotCache::users() {
+	StateSnapshotCache cache;
+	QVERIFY(!cache.userFrame(1));
+
+	cache.setUserFrame(1, userFrame(1));
+	cache.setUserFrame(2, userFrame(2));
+
+	QVERIFY(cache.userFrame(1));
+	QCOMPARE(*cache.userFrame(1), userFrame(1));
+	QCOMPARE(*cache.userFrame(2), userFrame(2));
+	QVERIFY(!cache.userFrame(3));
+
+	// Building a frame again replaces the previous one
+	MumbleProto::UserState renamed;
+	renamed.set_session(1);
+	renamed.set_name("Renamed");
+	cache.setUserFrame(1, frame(renamed, Mumble::Protocol::TCPMessageType::UserState));
+	QCOMPARE(*cache.userFrame(1), frame(renamed, Mumble::Protocol::TCPMessageType::UserState));
+}
+
+void TestStateSnapshotCache::channelChanges() {
+	StateSnapshotCache cache;
+
+	// A broadcast ChannelState (e.g. a new, renamed, moved or (un)linked channel) only drops the channel tree
+	cache.setChannels(channelTree(5));
+	cache.setUserFrame(1, userFrame(1));
+
+	MumbleProto::ChannelState mpcs;
+	mpcs.set_channel_id(3);
+	mpcs.set_name("Renamed");
+	cache.invalidate(mpcs, Mumble::Protocol::TCPMessageType::ChannelState);
+
+	QVERIFY(!cache.channels());
+	QVERIFY(cache.userFrame(1));
+
+	// A removed channel might have been listened to by any user
+	cache.setChannels(channelTree(5));
+
+	MumbleProto::ChannelRemove mpcr;
+	mpcr.set_channel_id(3);
+	cache.invalidate(mpcr, Mumble::Protocol::TCPMessageType::ChannelRemove);
+
+	QVERIFY(!cache.channels());
+	QVERIFY(!cache.userFrame(1));
+
+	// Changes that aren't broadcast as a ChannelState (e.g. the name of the root channel) drop it explicitly
+	cache.setChannels(channelTree(5));
+	cache.invalidateChannels();
+	QVERIFY(!cache.channels());
+}
+
+void TestStateSnapshotCache::userChanges() {
+	StateSnapshotCache cache;
+	cache.setChannels(channelTree(5));
+	for (unsigned int session = 1; session <= 3; ++session) {
+		cache.setUserFrame(session, userFrame(session));
+	}
+
+	// A broadcast UserState only drops the frame of the user it is about
+	MumbleProto::UserState mpus;
+	mpus.set_session(2);
+	mpus.set_self_mute(true);
+	cache.invalidate(mpus, Mumble::Protocol::TCPMessageType::UserState);
+
+	QVERIFY(cache.userFrame(1));
+	QVERIFY(!cache.userFrame(2));
+	QVERIFY(cache.userFrame(3));
+	QVERIFY(cache.channels());
+
+	MumbleProto::UserRemove mpur;
+	mpur.set_session(3);
+	cache.invalidate(mpur, Mumble::Protocol::TCPMessageType::UserRemove);
+
+	QVERIFY(cache.userFrame(1));
+	QVERIFY(!cache.userFrame(3));
+	QVERIFY(cache.channels());
+
+	// Changes to the fields that every frame contains drop all of them
+	cache.invalidateUsers();
+	QVERIFY(!cache.userFrame(1));
+	QVERIFY(cache.channels());
+}
+
+void TestStateSnapshotCache::aclChanges() {
+	StateSnapshotCache cache;
+	cache.setChannels(channelTree(5));
+	cache.setUserFrame(1, userFrame(1));
+
+	// Changed ACLs only affect the enter states, which are evaluated for every receiver, so neither the ACL nor the
+	// flushed permissions drop anything
+	MumbleProto::ACL mpacl;
+	mpacl.set_channel_id(3);
+	cache.invalidate(mpacl, Mumble::Protocol::TCPMessageType::ACL);
+
+	MumbleProto::PermissionQuery mppq;
+	mppq.set_channel_id(3);
+	mppq.set_flush(true);
+	cache.invalidate(mppq, Mumble::Protocol::TCPMessageType::PermissionQuery);
+
+	QVERIFY(cache.channels());
+	QVERIFY(cache.userFrame(1));
+}
+
+QTEST_MAIN(TestStateSnapshotCache)
+#include "TestStateSnapshotCache.moc"
@@ -0,0 +1,80 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "TextToSpeechQueue.h"
+
+class TestTextToSpeechQueue : public QObject {
+	Q_OBJECT
+private slots:
+	void order();
+	void coalesce();
+	void dropOldest();
+	void rateLimit();
+};
+
+void TestTextToSpeechQueue::order() {
+	TextToSpeechQueue queue;
+	queue.push(QString(), QLatin1String("first"));
+	queue.push(QString(), QLatin1String("second"));
+
+	QCOMPARE(queue.pop(0), QLatin1String("first"));
+
+	const qint64 next = TextToSpeechQueue::duration(QLatin1String("first"));
+	QCOMPARE(queue.pop(next), QLatin1String("second"));
+	QVERIFY(queue.pop(next * 2).isNull());
+	QCOMPARE(queue.timeUntilNext(next * 2), qint64(-1));
+}
+
+void TestTextToSpeechQueue::coalesce() {
+	TextToSpeechQueue queue;
+	queue.push(QLatin1String("alice"), QLatin1String("hi"));
+	queue.push(QLatin1String("bob"), QLatin1String("hello"));
+	queue.push(QLatin1String("alice"), QLatin1String("never mind"));
+	// Messages without a key are never coalesced
+	queue.push(QString(), QLatin1String("joined"));
+	queue.push(QString(), QLatin1String("joined"));
+
+	QCOMPARE(queue.size(), std::size_t(4));
+	// The replacement keeps the position of the message it replaces
+	QCOMPARE(queue.pop(0), QLatin1String("never mind"));
+	QCOMPARE(queue.pop(1000000), QLatin1String("hello"));
+}
+
+void TestTextToSpeechQueue::dropOldest() {
+	TextToSpeechQueue queue;
+	for (std::size_t i = 0; i < TextToSpeechQueue::MAX_PENDING; i++) {
+		QVERIFY(!queue.push(QString(), QString::number(i)));
+	}
+
+	QVERIFY(queue.push(QString(), QLatin1String("newest")));
+	QCOMPARE(queue.size(), TextToSpeechQueue::MAX_PENDING);
+	QCOMPARE(queue.pop(0), QLatin1String("1"));
+}
+
+void TestTextToSpeechQueue::rateLimit() {
+	TextToSpeechQueue queue;
+	const QString longText(100, QLatin1Char('a'));
+	queue.push(QString(), longText);
+	queue.push(QString(), QLatin1String("b"));
+
+	QCOMPARE(queue.pop(1000), longText);
+
+	const qint64 duration = TextToSpeechQueue::duration(longText);
+	QCOMPARE(duration, 100 * TextToSpeechQueue::CHARACTER_DURATION);
+	QCOMPARE(queue.timeUntilNext(1000), duration);
+
+	// The next message isn't handed out while the previous one is likely still being spoken
+	QVERIFY(queue.pop(1000 + duration - 1).isNull());
+	QCOMPARE(queue.pop(1000 + duration), QLatin1String("b"));
+
+	// Short messages are still spaced out
+	QCOMPARE(TextToSpeechQueue::duration(QLatin1String("b")), TextToSpeechQueue::MIN_INTERVAL);
+}
+
+QTEST_MAIN(TestTextToSpeechQueue)
+#include "TestTextToSpeechQueue.moc"
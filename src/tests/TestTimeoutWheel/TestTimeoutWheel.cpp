@@ -0,0 +1,158 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "TimeoutWheel.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+static QList< unsigned int > sorted(QList< unsigned int > sessions) {
+	std::sort(sessions.begin(), sessions.end());
+	return sessions;
+}
+
+class TestTimeoutWheel : public QObject {
+	Q_OBJECT
+private slots:
+	void expiry();
+	void reschedule();
+	void remove();
+	void passed();
+	void cascade();
+	void farFuture();
+	void jump();
+	void matchesReference();
+};
+
+void TestTimeoutWheel::expiry() {
+	TimeoutWheel wheel(100);
+	wheel.schedule(1, 110);
+	wheel.schedule(2, 120);
+
+	QVERIFY(wheel.advance(109).isEmpty());
+	QCOMPARE(wheel.advance(110), QList< unsigned int >() << 1);
+	QVERIFY(!wheel.contains(1));
+	QCOMPARE(wheel.size(), static_cast< std::size_t >(1));
+	QCOMPARE(wheel.advance(200), QList< unsigned int >() << 2);
+	QCOMPARE(wheel.size(), static_cast< std::size_t >(0));
+}
+
+void TestTimeoutWheel::reschedule() {
+	TimeoutWheel wheel;
+	wheel.schedule(1, 10);
+	wheel.schedule(1, 30);
+
+	QVERIFY(wheel.advance(20).isEmpty());
+	QCOMPARE(wheel.advance(30), QList< unsigned int >() << 1);
+}
+
+void TestTimeoutWheel::remove() {
+	TimeoutWheel wheel;
+	wheel.schedule(1, 10);
+	wheel.remove(1);
+	wheel.remove(2);
+
+	QVERIFY(!wheel.contains(1));
+	QVERIFY(wheel.advance(20).isEmpty());
+}
+
+void TestTimeoutWheel::passed() {
+	TimeoutWheel wheel(50);
+	wheel.schedule(1, 10);
+
+	// Advancing to the current time doesn't expire anything
+	QVERIFY(wheel.advance(50).isEmpty());
+	QCOMPARE(wheel.advance(51), QList< unsigned int >() << 1);
+}
+
+void TestTimeoutWheel::cascade() {
+	TimeoutWheel wheel;
+	// These end up in the higher levels
+	wheel.schedule(1, 1000);
+	wheel.schedule(2, 70000);
+	wheel.schedule(3, 1001);
+
+	QVERIFY(wheel.advance(999).isEmpty());
+	QCOMPARE(wheel.advance(1000), QList< unsigned int >() << 1);
+	QCOMPARE(wheel.advance(1001), QList< unsigned int >() << 3);
+	for (quint64 now = 2000; now < 70000; now += 1000) {
+		QVERIFY(wheel.advance(now).isEmpty());
+	}
+	QVERIFY(wheel.advance(69999).isEmpty());
+	QCOMPARE(wheel.advance(70000), QList< unsigned int >() << 2);
+}
+
+void TestTimeoutWheel::farFuture() {
+	TimeoutWheel wheel;
+	wheel.schedule(1, TimeoutWheel::RANGE + 5000);
+
+	// The wheel is advanced in small steps, so that it turns instead of being sorted from scratch
+	for (quint64 now = 4000; now < TimeoutWheel::RANGE + 5000; now += 4000) {
+		QVERIFY(wheel.advance(now).isEmpty());
+	}
+	QCOMPARE(wheel.advance(TimeoutWheel::RANGE + 5000), QList< unsigned int >() << 1);
+}
+
+void TestTimeoutWheel::jump() {
+	TimeoutWheel wheel;
+	wheel.schedule(1, 100);
+	wheel.schedule(2, 1000000);
+	wheel.schedule(3, 2000000);
+
+	// The wheel is sorted from scratch, as it is too far behind to turn
+	QCOMPARE(sorted(wheel.advance(1000000)), QList< unsigned int >() << 1 << 2);
+	QCOMPARE(wheel.advance(2000000), QList< unsigned int >() << 3);
+}
+
+void TestTimeoutWheel::matchesReference() {
+	std::mt19937_64 rng(42);
+
+	quint64 now = 12345;
+	TimeoutWheel wheel(now);
+	std::map< unsigned int, quint64 > reference;
+
+	for (int i = 0; i < 50000; i++) {
+		const unsigned int session = static_cast< unsigned int >(rng() % 500);
+
+		switch (rng() % 4) {
+			case 0:
+			case 1: {
+				const quint64 deadline = now + rng() % 5000;
+				wheel.schedule(session, deadline);
+				reference[session] = std::max(deadline, now + 1);
+				break;
+			}
+			case 2:
+				wheel.remove(session);
+				reference.erase(session);
+				break;
+			default: {
+				now += rng() % 50;
+
+				QList< unsigned int > expected;
+				for (auto it = reference.begin(); it != reference.end();) {
+					if (it->second <= now) {
+						expected << it->first;
+						it = reference.erase(it);
+					} else {
+						++it;
+					}
+				}
+
+				QCOMPARE(sorted(wheel.advance(now)), expected);
+				break;
+			}
+		}
+
+		QCOMPARE(wheel.size(), reference.size());
+	}
+}
+
+QTEST_MAIN(TestTimeoutWheel)
+#include "TestTimeoutWheel.moc"
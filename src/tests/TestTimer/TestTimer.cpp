@@ -13,6 +13,7 @@ class TestTimer : public QObject {
 private slots:
 	void resolution();
 	void order();
+	void coarse();
 };
 
 // This tests that the timer implemented by the Timer
@@ -62,5 +63,21 @@ void TestTimer::order() {
 	QVERIFY(b < a);
 }
 
+void TestTimer::coarse() {
+	CoarseTimer t;
+	QVERIFY(t.isStarted());
+	QVERIFY(!CoarseTimer(false).isStarted());
+
+	QThread::msleep(100);
+
+	// The coarse clock may lag behind by a few ticks of the system's timer
+	const quint64 elapsed = t.elapsed();
+	QVERIFY(elapsed >= 50000);
+	QVERIFY(elapsed < 5000000);
+
+	QVERIFY(t.restart() >= elapsed);
+	QVERIFY(t.elapsed() < elapsed);
+}
+
 QTEST_MAIN(TestTimer)
 #include "TestTimer.moc"
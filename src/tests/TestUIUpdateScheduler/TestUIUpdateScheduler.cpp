@@ -0,0 +1,70 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "UIUpdateScheduler.h"
+
+class TestUIUpdateScheduler : public QObject {
+	Q_OBJECT
+private slots:
+	void interval();
+	void coalesce();
+	void markWhileUpdating();
+};
+
+void TestUIUpdateScheduler::interval() {
+	QVERIFY(UIUpdateScheduler::interval() >= 1000 / UIUpdateScheduler::MAX_RATE);
+}
+
+void TestUIUpdateScheduler::coalesce() {
+	UIUpdateScheduler scheduler;
+
+	QList< QSet< unsigned int > > userUpdates;
+	QList< QSet< unsigned int > > channelUpdates;
+	connect(&scheduler, &UIUpdateScheduler::updateDue, this,
+			[&](const QSet< unsigned int > &users, const QSet< unsigned int > &channels) {
+				userUpdates.append(users);
+				channelUpdates.append(channels);
+			});
+
+	for (unsigned int i = 0; i < 100; i++) {
+		scheduler.markUser(i % 10);
+	}
+	scheduler.markChannel(3);
+	scheduler.markChannel(3);
+
+	QTRY_COMPARE(userUpdates.size(), 1);
+	QCOMPARE(userUpdates.at(0).size(), 10);
+	QCOMPARE(channelUpdates.at(0), QSet< unsigned int >({ 3 }));
+
+	// Nothing is due until something is marked again
+	QTest::qWait(3 * UIUpdateScheduler::interval());
+	QCOMPARE(userUpdates.size(), 1);
+}
+
+void TestUIUpdateScheduler::markWhileUpdating() {
+	UIUpdateScheduler scheduler;
+
+	QList< QSet< unsigned int > > updates;
+	connect(&scheduler, &UIUpdateScheduler::updateDue, this,
+			[&](const QSet< unsigned int > &users, const QSet< unsigned int > &) {
+				updates.append(users);
+				if (updates.size() == 1) {
+					scheduler.markUser(2);
+				}
+			});
+
+	scheduler.markUser(1);
+
+	// What is marked during an update goes into the next one
+	QTRY_COMPARE(updates.size(), 2);
+	QCOMPARE(updates.at(0), QSet< unsigned int >({ 1 }));
+	QCOMPARE(updates.at(1), QSet< unsigned int >({ 2 }));
+}
+
+QTEST_MAIN(TestUIUpdateScheduler)
+#include "TestUIUpdateScheduler.moc"
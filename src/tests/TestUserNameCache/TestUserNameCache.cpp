@@ -0,0 +1,146 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "UserNameCache.h"
+
+/// A cache whose clock only advances when it is told to
+class ManualClockCache : public UserNameCache {
+public:
+	using UserNameCache::UserNameCache;
+
+	quint64 time = 1000;
+
+protected:
+	quint64 now() const override { return time; }
+};
+
+class TestUserNameCache : public QObject {
+	Q_OBJECT
+private slots:
+	void lookup();
+	void unknown();
+	void remove();
+	void eviction();
+	void expiry();
+	void counters();
+};
+
+void TestUserNameCache::lookup() {
+	UserNameCache cache;
+	QString name;
+	int id = 0;
+
+	QVERIFY(!cache.lookupName(1, name));
+	QVERIFY(!cache.lookupID(QLatin1String("alice"), id));
+
+	cache.insert(1, QLatin1String("alice"));
+
+	QVERIFY(cache.lookupName(1, name));
+	QCOMPARE(name, QLatin1String("alice"));
+	QVERIFY(cache.lookupID(QLatin1String("alice"), id));
+	QCOMPARE(id, 1);
+}
+
+void TestUserNameCache::unknown() {
+	UserNameCache cache;
+	QString name = QLatin1String("x");
+	int id       = 0;
+
+	cache.insertUnknownID(5);
+	cache.insertUnknownName(QLatin1String("mallory"));
+
+	QVERIFY(cache.lookupName(5, name));
+	QVERIFY(name.isEmpty());
+	QVERIFY(cache.lookupID(QLatin1String("mallory"), id));
+	QCOMPARE(id, -2);
+
+	// Negative entries are dropped when users are registered or renamed
+	cache.removeUnknown();
+	QVERIFY(!cache.lookupName(5, name));
+	QVERIFY(!cache.lookupID(QLatin1String("mallory"), id));
+
+	// Positive entries are not
+	cache.insert(6, QLatin1String("bob"));
+	cache.removeUnknown();
+	QVERIFY(cache.lookupID(QLatin1String("bob"), id));
+	QCOMPARE(id, 6);
+}
+
+void TestUserNameCache::remove() {
+	UserNameCache cache;
+	QString name;
+	int id = 0;
+
+	cache.insert(1, QLatin1String("alice"));
+	cache.insert(2, QLatin1String("bob"));
+
+	// Removing either side forgets about both directions
+	cache.removeID(1);
+	QVERIFY(!cache.lookupName(1, name));
+	QVERIFY(!cache.lookupID(QLatin1String("alice"), id));
+
+	cache.removeName(QLatin1String("bob"));
+	QVERIFY(!cache.lookupName(2, name));
+	QVERIFY(!cache.lookupID(QLatin1String("bob"), id));
+
+	QCOMPARE(cache.size(), static_cast< std::size_t >(0));
+}
+
+void TestUserNameCache::eviction() {
+	UserNameCache cache(100);
+	QString name;
+
+	for (int i = 0; i < 1000; ++i) {
+		cache.insert(i, QString::number(i));
+
+		// Keep the first user in use, so that it is never the least recently used one
+		QVERIFY(cache.lookupName(0, name));
+	}
+
+	QCOMPARE(cache.size(), static_cast< std::size_t >(200));
+	QVERIFY(cache.lookupName(0, name));
+	QVERIFY(cache.lookupName(999, name));
+	QVERIFY(!cache.lookupName(500, name));
+}
+
+void TestUserNameCache::expiry() {
+	ManualClockCache cache(100, 1000);
+	QString name;
+
+	cache.insert(1, QLatin1String("alice"));
+	cache.insertUnknownID(2);
+
+	cache.time += 999;
+	QVERIFY(cache.lookupName(1, name));
+	QVERIFY(cache.lookupName(2, name));
+
+	cache.time += 1;
+	QVERIFY(!cache.lookupName(1, name));
+	QVERIFY(!cache.lookupName(2, name));
+
+	// Inserting again renews the entry
+	cache.insert(1, QLatin1String("alice"));
+	cache.time += 500;
+	QVERIFY(cache.lookupName(1, name));
+}
+
+void TestUserNameCache::counters() {
+	UserNameCache cache;
+	QString name;
+
+	QVERIFY(!cache.lookupName(1, name));
+	cache.insert(1, QLatin1String("alice"));
+	QVERIFY(cache.lookupName(1, name));
+	QVERIFY(cache.lookupName(1, name));
+
+	QCOMPARE(cache.hits(), static_cast< quint64 >(2));
+	QCOMPARE(cache.misses(), static_cast< quint64 >(1));
+}
+
+QTEST_MAIN(TestUserNameCache)
+#include "TestUserNameCache.moc"
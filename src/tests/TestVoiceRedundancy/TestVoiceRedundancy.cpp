@@ -0,0 +1,122 @@
+// Copyright 2023 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include <QtCore>
+#include <QtTest>
+
+#include "MumbleProtocol.h"
+#include "Version.h"
+#include "VoiceRedundancy.h"
+
+#include <string>
+
+class TestVoiceRedundancy : public QObject {
+	Q_OBJECT
+private slots:
+	void lossyLinks();
+	void resetCounters();
+	void receivers();
+	void stripping();
+};
+
+void TestVoiceRedundancy::lossyLinks() {
+	// Clean links don't get any redundancy
+	QVERIFY(!VoiceRedundancy::isLossy(1000, 0, 0, 0));
+	QVERIFY(!VoiceRedundancy::isLossy(0, 0, 0, 0));
+
+	// Only a loss of more than LOSS_PERCENT counts
+	QVERIFY(!VoiceRedundancy::isLossy(99, 1, 0, 0));
+	QVERIFY(VoiceRedundancy::isLossy(98, 2, 0, 0));
+	QVERIFY(VoiceRedundancy::isLossy(0, 1, 0, 0));
+
+	// Only the loss since the previous ping counts, no matter how lossy the link has been before
+	QVERIFY(!VoiceRedundancy::isLossy(2000, 500, 1000, 500));
+	QVERIFY(VoiceRedundancy::isLossy(2000, 520, 1000, 500));
+}
+
+void TestVoiceRedundancy::resetCounters() {
+	// The counters start over whenever the client's crypt state is reset, in which case they are taken as they are
+	QVERIFY(VoiceRedundancy::isLossy(50, 10, 1000, 500));
+	QVERIFY(!VoiceRedundancy::isLossy(50, 0, 1000, 500));
+}
+
+void TestVoiceRedundancy::receivers() {
+	using Mumble::Protocol::PacketFormat;
+
+	QVERIFY(VoiceRedundancy::includesPayload(PacketFormat::Protobuf, true, true));
+
+	// Clean links, TCP and the legacy packet format don't get it
+	QVERIFY(!VoiceRedundancy::includesPayload(PacketFormat::Protobuf, true, false));
+	QVERIFY(!VoiceRedundancy::includesPayload(PacketFormat::Protobuf, false, true));
+	QVERIFY(!VoiceRedundancy::includesPayload(PacketFormat::Legacy, true, true));
+	QVERIFY(!VoiceRedundancy::includesPayload(PacketFormat::Legacy, false, false));
+}
+
+void TestVoiceRedundancy::stripping() {
+	using Mumble::Protocol::PacketFormat;
+
+	struct Receiver {
+		PacketFormat format;
+		bool viaUDP;
+		bool lossy;
+	};
+
+	// The receivers the packet of a speaker is sent to one after the other, as Server::sendMessage does
+	const Receiver receivers[] = {
+		{ PacketFormat::Protobuf, true, true },  { PacketFormat::Protobuf, true, false },
+		{ PacketFormat::Legacy, true, true },    { PacketFormat::Protobuf, false, true },
+		{ PacketFormat::Protobuf, true, true },  { PacketFormat::Legacy, false, false },
+	};
+
+	std::string payloadData   = "I am the payload";
+	std::string redundantData = "I was the payload";
+	const gsl::span< const Mumble::Protocol::byte > redundantPayload = {
+		reinterpret_cast< const Mumble::Protocol::byte * >(redundantData.c_str()), redundantData.size()
+	};
+
+	Mumble::Protocol::AudioData data;
+	data.payload = { reinterpret_cast< const Mumble::Protocol::byte * >(payloadData.c_str()), payloadData.size() };
+	data.frameNumber   = 8;
+	data.senderSession = 42;
+
+	Mumble::Protocol::UDPAudioEncoder< Mumble::Protocol::Role::Server > encoder(
+		Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION);
+	encoder.prepareAudioPacket(data);
+
+	for (const Receiver &receiver : receivers) {
+		const bool included = VoiceRedundancy::includesPayload(receiver.format, receiver.viaUDP, receiver.lossy);
+		data.redundantPayload = included ? redundantPayload : gsl::span< const Mumble::Protocol::byte >();
+
+		gsl::span< const Mumble::Protocol::byte > packet;
+		Version::full_t version;
+		if (receiver.format == PacketFormat::Legacy) {
+			packet  = encoder.updateAudioPacket< PacketFormat::Legacy >(data);
+			version = Version::fromComponents(1, 4, 0);
+		} else {
+			packet  = encoder.updateAudioPacket< PacketFormat::Protobuf >(data);
+			version = Mumble::Protocol::PROTOBUF_INTRODUCTION_VERSION;
+		}
+
+		// Whatever a receiver gets, the rest of the packet stays the same
+		Mumble::Protocol::UDPDecoder< Mumble::Protocol::Role::Client > decoder(version);
+		QVERIFY(decoder.decode(packet));
+		const Mumble::Protocol::AudioData &decoded = decoder.getAudioData();
+		QCOMPARE(decoded.frameNumber, data.frameNumber);
+		QCOMPARE(decoded.senderSession, data.senderSession);
+		QCOMPARE(std::string(reinterpret_cast< const char * >(decoded.payload.data()), decoded.payload.size()),
+				 payloadData);
+
+		if (included) {
+			QCOMPARE(std::string(reinterpret_cast< const char * >(decoded.redundantPayload.data()),
+								 decoded.redundantPayload.size()),
+					 redundantData);
+		} else {
+			QVERIFY(decoded.redundantPayload.empty());
+		}
+	}
+}
+
+QTEST_MAIN(TestVoiceRedundancy)
+#include "TestVoiceRedundancy.moc"